@@ -90,6 +90,7 @@ usage (int status)
               "  --help               Display brief help\n"
               "  -P nr_threads        Use at most nr_threads\n"
               "  -q|--quiet           No output, just exit code\n"
+              "  --sizing type        Size the appliance automatically\n"
               "  --uuid               Print UUIDs instead of names\n"
               "  -v|--verbose         Verbose messages\n"
               "  -V|--version         Display version and exit\n"
@@ -120,6 +121,7 @@ main (int argc, char *argv[])
     { "long-options", 0, 0, 0 },
     { "quiet", 0, 0, 'q' },
     { "short-options", 0, 0, 0 },
+    { "sizing", 1, 0, 0 },
     { "uuid", 0, 0, 0 },
     { "verbose", 0, 0, 'v' },
     { "version", 0, 0, 'V' },
@@ -150,6 +152,8 @@ main (int argc, char *argv[])
         display_short_options (options);
       else if (STREQ (long_options[option_index].name, "format")) {
         OPTION_format;
+      } else if (STREQ (long_options[option_index].name, "sizing")) {
+        OPTION_sizing;
       } else if (STREQ (long_options[option_index].name, "uuid")) {
         uuid = 1;
       } else
@@ -222,7 +226,7 @@ main (int argc, char *argv[])
   if (drvs == NULL) {
 #if defined(HAVE_LIBVIRT)
     get_all_libvirt_domains (libvirt_uri);
-    r = start_threads (max_threads, g, scan_work);
+    r = start_threads (max_threads, g, scan_work, 0, 0);
     free_domains ();
     if (r == -1)
       exit (EXIT_FAILURE);
@@ -353,18 +357,10 @@ scan (guestfs_h *g, const char *prefix, FILE *fp)
 static int
 scan_work (guestfs_h *g, size_t i, FILE *fp)
 {
-  struct guestfs_add_libvirt_dom_argv optargs;
-
-  optargs.bitmask =
-    GUESTFS_ADD_LIBVIRT_DOM_READONLY_BITMASK |
-    GUESTFS_ADD_LIBVIRT_DOM_READONLYDISK_BITMASK;
-  optargs.readonly = 1;
-  optargs.readonlydisk = "read";
-
-  if (guestfs_add_libvirt_dom_argv (g, domains[i].dom, &optargs) == -1)
+  if (add_domain_disks (g, i) == -1)
     return -1;
 
-  if (guestfs_launch (g) == -1)
+  if (launch_domain_handle (g) == -1)
     return -1;
 
   return scan (g, !uuid ? domains[i].name : domains[i].uuid, fp);
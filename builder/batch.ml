@@ -0,0 +1,160 @@
+(* virt-builder
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *)
+
+open Common_gettext.Gettext
+open Common_utils
+
+open Unix
+open Printf
+
+type entry = {
+  output : string;
+  ops : Customize_cmdline.ops;
+}
+
+(* Split a line into words, handling quoting like the shell does. *)
+let split_words filename lineno line =
+  let len = String.length line in
+  let words = ref [] in
+  let word = Buffer.create 64 in
+  let in_word = ref false in
+  let i = ref 0 in
+  let finish_word () =
+    if !in_word then (
+      push_front (Buffer.contents word) words;
+      Buffer.clear word;
+      in_word := false
+    )
+  in
+  let unterminated () =
+    error (f_"%s:%d: unterminated quoted string") filename lineno
+  in
+  while !i < len do
+    (match line.[!i] with
+    | ' ' | '\t' -> finish_word ()
+    | '\'' ->
+      in_word := true;
+      let j = try String.index_from line (!i+1) '\''
+              with Not_found -> unterminated () in
+      Buffer.add_string word (String.sub line (!i+1) (j - !i - 1));
+      i := j
+    | '"' ->
+      in_word := true;
+      incr i;
+      while !i < len && line.[!i] <> '"' do
+        if line.[!i] = '\\' && !i+1 < len then incr i;
+        Buffer.add_char word line.[!i];
+        incr i
+      done;
+      if !i >= len then unterminated ()
+    | '\\' when !i+1 < len ->
+      in_word := true;
+      incr i;
+      Buffer.add_char word line.[!i]
+    | c ->
+      in_word := true;
+      Buffer.add_char word c
+    );
+    incr i
+  done;
+  finish_word ();
+  List.rev !words
+
+let parse_batch_file filename =
+  let lines = String.lines_split (read_whole_file filename) in
+  let lines = mapi (fun i line -> i+1, String.trim line) lines in
+  let lines = List.filter (
+    fun (_, line) -> line <> "" && line.[0] <> '#'
+  ) lines in
+  let entries = List.map (
+    fun (lineno, line) ->
+      match split_words filename lineno line with
+      | [] -> assert false
+      | output :: args ->
+        let argspec, get_ops = Customize_cmdline.argspec () in
+        let argspec = List.map (fun (spec, _, _) -> spec) argspec in
+        let anon_fun s =
+          error (f_"%s:%d: unexpected argument '%s'.  Each line must contain an output filename and customize options.")
+            filename lineno s in
+        let usage_msg = sprintf (f_"%s: --batch file") prog in
+        let opthandle = Getopt.create argspec ~anon_fun usage_msg in
+        Getopt.parse_argv opthandle (Array.of_list (prog :: args));
+        { output = output; ops = get_ops () }
+  ) lines in
+
+  if entries = [] then
+    error (f_"%s: the batch file does not list any images") filename;
+
+  (* Each output must be different, or the appliances would write
+   * to the same overlay.
+   *)
+  let outputs = List.map (fun { output = output } -> output) entries in
+  if List.length (sort_uniq outputs) <> List.length outputs then
+    error (f_"%s: the same output file is listed more than once") filename;
+
+  entries
+
+let run ~jobs build entries =
+  let running = Hashtbl.create 13 in
+  let failed = ref [] in
+
+  let wait_one () =
+    let pid, status = wait () in
+    try
+      let output = Hashtbl.find running pid in
+      Hashtbl.remove running pid;
+      match status with
+      | WEXITED 0 -> ()
+      | WEXITED _ | WSIGNALED _ | WSTOPPED _ -> push_front output failed
+    with Not_found -> ()
+  in
+
+  List.iter (
+    fun entry ->
+      while Hashtbl.length running >= jobs do wait_one () done;
+
+      let pid = fork () in
+      if pid = 0 then (
+        (* Child.  Don't run the at_exit handlers of the parent if
+         * the build calls exit (eg. through 'error'), since they
+         * would delete the base image and the temporary directory.
+         * Handlers run in reverse order, so this one runs first.
+         *)
+        at_exit (
+          fun () ->
+            Pervasives.flush Pervasives.stdout;
+            Pervasives.flush Pervasives.stderr;
+            Exit._exit 1
+        );
+        (try build entry
+         with exn ->
+           eprintf "%s: %s: %s\n%!" prog entry.output (Printexc.to_string exn);
+           Exit._exit 1
+        );
+        Pervasives.flush Pervasives.stdout;
+        Pervasives.flush Pervasives.stderr;
+        Exit._exit 0
+      );
+
+      (* Parent. *)
+      Hashtbl.add running pid entry.output
+  ) entries;
+
+  while Hashtbl.length running > 0 do wait_one () done;
+
+  List.rev !failed
@@ -0,0 +1,53 @@
+(* virt-builder
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *)
+
+(** {1 Building several images from one template ([--batch]).}
+
+    The template is uncompressed (and resized) once to a base image.
+    Each image in the batch is a qcow2 overlay backed by the base,
+    customized by its own appliance.  The appliances run in parallel
+    in a bounded pool of worker processes. *)
+
+type entry = {
+  output : string;                      (** Output overlay filename. *)
+  ops : Customize_cmdline.ops;          (** Customizations of this image. *)
+}
+
+val parse_batch_file : string -> entry list
+(** [parse_batch_file filename] reads the batch file.
+
+    Each non-blank line which does not start with [#] is an output
+    filename followed by optional customize options for that image,
+    eg:
+
+{v
+web1.qcow2 --hostname web1 --install nginx
+web2.qcow2 --hostname web2 --install nginx
+db.qcow2 --hostname db --run-command 'echo hello > /etc/motd'
+v}
+
+    Words are split at whitespace, and may be quoted using single or
+    double quotes as in the shell. *)
+
+val run : jobs:int -> (entry -> unit) -> entry list -> string list
+(** [run ~jobs build entries] calls [build entry] for each entry, in
+    up to [jobs] subprocesses at a time.  [build] runs in the
+    subprocess, and should raise an exception if building the image
+    fails.
+
+    Returns the outputs of the entries which could not be built. *)
@@ -248,16 +248,20 @@ let main () =
       (match cache with
       | None ->
         error (f_"no cache directory")
-      | Some _ ->
+      | Some cache ->
         List.iter (
           fun (name,
                { Index.revision = revision; file_uri = file_uri;
                  proxy = proxy }) ->
-            let template = name, cmdline.arch, revision in
-            message (f_"Downloading: %s") file_uri;
-            let progress_bar = not (quiet ()) in
-            ignore (Downloader.download downloader ~template ~progress_bar
-                      ~proxy file_uri)
+            if not (Cache.is_cached cache name cmdline.arch revision) then (
+              let template = name, cmdline.arch, revision in
+              message (f_"Downloading: %s") file_uri;
+              let progress_bar = not (quiet ()) in
+              let filename, delete =
+                Downloader.download downloader ~template ~progress_bar
+                  ~proxy file_uri in
+              if delete then unlink filename
+            )
         ) index;
         exit 0
       );
@@ -288,6 +292,14 @@ let main () =
 
   (* --- If we get here, we want to create a guest. --- *)
 
+  (* Read the batch file first, so mistakes in it are found before
+   * spending time on the template.
+   *)
+  let batch =
+    match cmdline.batch with
+    | None -> None
+    | Some filename -> Some (Batch.parse_batch_file filename) in
+
   (* Warn if the user might be writing to a partition on a USB key. *)
   (match cmdline.output with
    | Some device when is_partition device ->
@@ -297,6 +309,14 @@ let main () =
    | Some _ | None -> ()
   );
 
+  (* New-style templates have checksums, which are computed while the
+   * template is downloaded or put together from the cache.
+   *)
+  let checksums =
+    match entry with
+    | { Index.checksums = Some csums } -> Some (Checksums.create csums)
+    | { Index.checksums = None } -> None in
+
   (* Download the template, or it may be in the cache. *)
   let template =
     let template, delete_on_exit =
@@ -306,22 +326,21 @@ let main () =
       message (f_"Downloading: %s") file_uri;
       let progress_bar = not (quiet ()) in
       Downloader.download downloader ~template ~progress_bar ~proxy
-        file_uri in
+        ?checksums file_uri in
     if delete_on_exit then unlink_on_exit template;
     template in
 
   (* Check the signature of the file. *)
   let () =
-    match entry with
-    (* New-style: Using a checksum. *)
-    | { Index.checksums = Some csums } ->
-      (try Checksums.verify_checksums csums template
+    match checksums with
+    | Some checksums ->
+      (try Checksums.verify checksums
       with Checksums.Mismatched_checksum (csum, csum_actual) ->
         error (f_"%s checksum of template did not match the expected checksum!\n  found checksum: %s\n  expected checksum: %s\nTry:\n - Use the '-v' option and look for earlier error messages.\n - Delete the cache: virt-builder --delete-cache\n - Check no one has tampered with the website or your network!")
           (Checksums.string_of_csum_t csum) csum_actual (Checksums.string_of_csum csum)
       )
 
-    | { Index.checksums = None } ->
+    | None ->
       (* Old-style: detached signature. *)
       let sigfile =
         match entry with
@@ -348,6 +367,7 @@ let main () =
     let compression_tag =
       match detect_file_type template with
       | `XZ -> [ `XZ, "" ]
+      | `Zstd -> [ `Zstd, "" ]
       | `GZip | `Tar | `Zip ->
         error (f_"input file (%s) has an unsupported type") template
       | `Unknown -> [] in
@@ -405,7 +425,7 @@ let main () =
     ] in
 
     (* MUST NOT *)
-    let goal_must_not = [ `Template, ""; `XZ, "" ] in
+    let goal_must_not = [ `Template, ""; `XZ, ""; `Zstd, "" ] in
 
     goal_must, goal_must_not in
 
@@ -457,6 +477,14 @@ let main () =
       tr `Pxzcat 80
         ((`Filename, tempfile) :: remove `XZ (remove `Template itags));
     )
+    else if is `Zstd then (
+      (* Similarly for zstd-compressed templates. *)
+      if not output_is_block_dev then
+        tr `Pzstdcat 80
+          ((`Filename, output_filename) :: remove `Zstd (remove `Template itags));
+      tr `Pzstdcat 80
+        ((`Filename, tempfile) :: remove `Zstd (remove `Template itags));
+    )
     else (
       (* If the input is NOT compressed then we could run virt-resize
        * if it makes sense to resize the image.  Note that virt-resize
@@ -527,12 +555,14 @@ let main () =
          let v = List.assoc `Format tags in printf " +format=%s" v
        with Not_found -> ());
       if List.mem_assoc `Template tags then printf " +template";
-      if List.mem_assoc `XZ tags then printf " +xz"
+      if List.mem_assoc `XZ tags then printf " +xz";
+      if List.mem_assoc `Zstd tags then printf " +zstd"
     in
     let print_task = function
       | `Copy -> printf "cp"
       | `Rename -> printf "mv"
       | `Pxzcat -> printf "pxzcat"
+      | `Pzstdcat -> printf "pzstdcat"
       | `Virt_resize -> printf "virt-resize"
       | `Disk_resize -> printf "qemu-img resize"
       | `Convert -> printf "qemu-img convert"
@@ -564,8 +594,7 @@ let main () =
   at_exit delete_file;
 
   (* Carry out the plan. *)
-  List.iter (
-    function
+  let run_task = function
     | itags, `Copy, otags ->
       let ifile = List.assoc `Filename itags in
       let ofile = List.assoc `Filename otags in
@@ -585,6 +614,12 @@ let main () =
       message (f_"Uncompressing");
       Pxzcat.pxzcat ifile ofile
 
+    | itags, `Pzstdcat, otags ->
+      let ifile = List.assoc `Filename itags in
+      let ofile = List.assoc `Filename otags in
+      message (f_"Uncompressing");
+      Pzstdcat.pzstdcat ifile ofile
+
     | itags, `Virt_resize, otags ->
       let ifile = List.assoc `Filename itags in
       let iformat =
@@ -643,11 +678,11 @@ let main () =
         (quote ifile) (quote oformat) (quote (qemu_input_filename ofile))
         (if verbose () then "" else " >/dev/null 2>&1") in
       if shell_command cmd <> 0 then exit 1
-  ) plan;
+  in
+  List.iter run_task plan;
 
-  (* Now mount the output disk so we can make changes. *)
-  message (f_"Opening the new disk");
-  let g =
+  (* Open a disk in a new appliance, and mount up its filesystems. *)
+  let open_disk filename format =
     let g = open_guestfs () in
 
     may g#set_memsize cmdline.memsize;
@@ -655,7 +690,7 @@ let main () =
     g#set_network cmdline.network;
 
     (* The output disk is being created, so use cache=unsafe here. *)
-    g#add_drive_opts ~format:output_format ~cachemode:"unsafe" output_filename;
+    g#add_drive_opts ~format ~cachemode:"unsafe" filename;
 
     (* Attach ISOs, if we have any. *)
     List.iter (
@@ -665,17 +700,67 @@ let main () =
 
     g#launch ();
 
-    g in
+    (* Inspect the disk and mount it up. *)
+    let root =
+      match Array.to_list (g#inspect_os ()) with
+      | [root] ->
+        inspect_mount_root g root;
+        root
+      | _ ->
+        error (f_"no guest operating systems or multiboot OS found in this disk image\nThis is a failure of the source repository.  Use -v for more information.")
+    in
 
-  (* Inspect the disk and mount it up. *)
-  let root =
-    match Array.to_list (g#inspect_os ()) with
-    | [root] ->
-      inspect_mount_root g root;
-      root
-    | _ ->
-      error (f_"no guest operating systems or multiboot OS found in this disk image\nThis is a failure of the source repository.  Use -v for more information.")
-  in
+    g, root in
+
+  (* In --batch mode the disk built above is the base image shared
+   * by all the outputs, which are qcow2 overlays customized in
+   * parallel.  The base itself is not customized.
+   *)
+  (match batch with
+  | None -> ()
+  | Some entries ->
+    if cmdline.sync then
+      Fsync.file output_filename;
+    delete_output_file := false;
+
+    let base = absolute_path output_filename in
+    let build { Batch.output = output; ops = ops } =
+      let cmd = [ "qemu-img"; "create"; "-q"; "-f"; "qcow2";
+                  "-b"; base; "-F"; output_format; output ] in
+      if run_command cmd <> 0 then
+        error (f_"%s: could not create the overlay") output;
+
+      message (f_"Customizing %s") output;
+      let g, root = open_disk output "qcow2" in
+      let ops = { cmdline.customize_ops with
+                  ops = cmdline.customize_ops.ops @ ops.ops } in
+      Customize_run.run g root ops;
+      g#umount_all ();
+      g#shutdown ();
+      g#close ();
+
+      if cmdline.sync then
+        Fsync.file output
+    in
+    let failed = Batch.run ~jobs:cmdline.jobs build entries in
+
+    if cmdline.delete_on_failure then
+      List.iter (fun output -> try unlink output with _ -> ()) failed;
+    if failed <> [] then
+      error (f_"some images could not be built: %s")
+        (String.concat " " failed);
+
+    message (f_"Finishing off");
+    printf (f_"Base image: %s\n") output_filename;
+    List.iter (
+      fun { Batch.output = output } -> printf (f_"Output file: %s\n") output
+    ) entries;
+    exit 0
+  );
+
+  (* Now mount the output disk so we can make changes. *)
+  message (f_"Opening the new disk");
+  let g, root = open_disk output_filename output_format in
 
   Customize_run.run g root cmdline.customize_ops;
 
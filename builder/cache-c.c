@@ -0,0 +1,218 @@
+/* virt-builder
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Store the chunks of a cached template, see cache.ml. */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <caml/alloc.h>
+#include <caml/fail.h>
+#include <caml/memory.h>
+#include <caml/mlvalues.h>
+
+#include "guestfs.h"
+#include "guestfs-internal-frontend.h"
+
+#include "sha256.h"
+
+#ifdef HAVE_CAML_UNIXSUPPORT_H
+#include <caml/unixsupport.h>
+#else
+#define Nothing ((value) 0)
+extern void unix_error (int errcode, char * cmdname, value arg) Noreturn;
+#endif
+
+/* Chunks are split at the boundaries passed by the caller, and also
+ * so they are never larger than this.
+ */
+#define CHUNK_MAX (64 * 1024 * 1024)
+
+struct chunk {
+  char hash[SHA256_DIGEST_SIZE * 2 + 1];
+  int64_t size;
+};
+
+static int
+xread (int fd, void *bufvp, size_t count)
+{
+  char *buf = bufvp;
+  ssize_t r;
+
+  while (count > 0) {
+    r = read (fd, buf, count);
+    if (r == -1)
+      return -1;
+    if (r == 0) {
+      errno = EIO;              /* file was truncated */
+      return -1;
+    }
+    count -= r;
+    buf += r;
+  }
+
+  return 0;
+}
+
+static int
+xwrite (int fd, const void *bufvp, size_t count)
+{
+  const char *buf = bufvp;
+  ssize_t r;
+
+  while (count > 0) {
+    r = write (fd, buf, count);
+    if (r == -1)
+      return -1;
+    count -= r;
+    buf += r;
+  }
+
+  return 0;
+}
+
+/* Write the chunk to dir/hash, unless a chunk with the same content
+ * is already stored.  It is written to a temporary file first so
+ * other virt-builder processes never see a partial chunk.
+ */
+static int
+store_chunk (const char *dir, const char *hash, const void *buf, size_t size)
+{
+  CLEANUP_FREE char *path = NULL, *tmppath = NULL;
+  int fd;
+
+  if (asprintf (&path, "%s/%s", dir, hash) == -1 ||
+      asprintf (&tmppath, "%s/%s.XXXXXX", dir, hash) == -1)
+    return -1;
+
+  if (access (path, F_OK) == 0)
+    return 0;
+
+  fd = mkstemp (tmppath);
+  if (fd == -1)
+    return -1;
+  if (xwrite (fd, buf, size) == -1 || close (fd) == -1) {
+    const int err = errno;
+    close (fd);
+    unlink (tmppath);
+    errno = err;
+    return -1;
+  }
+  if (chmod (tmppath, 0644) == -1 || rename (tmppath, path) == -1) {
+    const int err = errno;
+    unlink (tmppath);
+    errno = err;
+    return -1;
+  }
+
+  return 0;
+}
+
+extern value virt_builder_store_chunks (value filenamev, value dirv, value boundariesv);
+
+value
+virt_builder_store_chunks (value filenamev, value dirv, value boundariesv)
+{
+  CAMLparam3 (filenamev, dirv, boundariesv);
+  CAMLlocal2 (rv, v);
+  int fd;
+  struct stat statbuf;
+  CLEANUP_FREE char *buf = NULL;
+  CLEANUP_FREE struct chunk *chunks = NULL;
+  struct chunk *p;
+  size_t nr_chunks = 0, b = 0, i;
+  const size_t nr_boundaries = Wosize_val (boundariesv);
+  int64_t offset = 0, end;
+  unsigned char digest[SHA256_DIGEST_SIZE];
+
+  fd = open (String_val (filenamev), O_RDONLY|O_CLOEXEC);
+  if (fd == -1)
+    unix_error (errno, (char *) "open", filenamev);
+  if (fstat (fd, &statbuf) == -1) {
+    const int err = errno;
+    close (fd);
+    unix_error (err, (char *) "fstat", filenamev);
+  }
+
+  buf = malloc (CHUNK_MAX);
+  if (buf == NULL) {
+    close (fd);
+    caml_raise_out_of_memory ();
+  }
+
+  while (offset < statbuf.st_size) {
+    /* Find the end of this chunk. */
+    while (b < nr_boundaries && Int64_val (Field (boundariesv, b)) <= offset)
+      b++;
+    end = b < nr_boundaries ? Int64_val (Field (boundariesv, b))
+      : statbuf.st_size;
+    if (end > statbuf.st_size)
+      end = statbuf.st_size;
+    if (end - offset > CHUNK_MAX)
+      end = offset + CHUNK_MAX;
+
+    p = realloc (chunks, (nr_chunks+1) * sizeof (struct chunk));
+    if (p == NULL) {
+      close (fd);
+      caml_raise_out_of_memory ();
+    }
+    chunks = p;
+    p = &chunks[nr_chunks++];
+    p->size = end - offset;
+
+    if (xread (fd, buf, p->size) == -1) {
+      const int err = errno;
+      close (fd);
+      unix_error (err, (char *) "read", filenamev);
+    }
+
+    sha256_buffer (buf, p->size, digest);
+    for (i = 0; i < SHA256_DIGEST_SIZE; ++i)
+      sprintf (&p->hash[i*2], "%02x", digest[i]);
+
+    if (store_chunk (String_val (dirv), p->hash, buf, p->size) == -1) {
+      const int err = errno;
+      close (fd);
+      unix_error (err, (char *) "store_chunk", dirv);
+    }
+
+    offset = end;
+  }
+
+  if (close (fd) == -1)
+    unix_error (errno, (char *) "close", filenamev);
+
+  rv = caml_alloc (nr_chunks, 0);
+  for (i = 0; i < nr_chunks; ++i) {
+    v = caml_alloc_tuple (2);
+    Store_field (v, 0, caml_copy_string (chunks[i].hash));
+    Store_field (v, 1, caml_copy_int64 (chunks[i].size));
+    Store_field (rv, i, v);
+  }
+
+  CAMLreturn (rv);
+}
@@ -42,9 +42,81 @@ let create ~directory =
 let cache_of_name t name arch revision =
   t.directory // sprintf "%s.%s.%s" name arch (string_of_revision revision)
 
+(* Templates are stored as a list of chunks (the "manifest"), with
+ * the chunks in a shared directory named by their SHA-256 hash, so
+ * templates and revisions which have chunks in common only store
+ * them once.  Chunks are split at xz block boundaries.  Files cached
+ * by older versions of virt-builder are complete templates with no
+ * manifest, and are still used.
+ *)
+external store_chunks : string -> string -> int64 array -> (string * int64) array = "virt_builder_store_chunks"
+
+let chunks_dir t = t.directory // "chunks"
+
+let manifest_of_name t name arch revision =
+  cache_of_name t name arch revision ^ ".chunks"
+
 let is_cached t name arch revision =
   let filename = cache_of_name t name arch revision in
-  Sys.file_exists filename
+  Sys.file_exists filename ||
+    Sys.file_exists (manifest_of_name t name arch revision)
+
+let add_template t name arch revision filename =
+  let boundaries =
+    try Pxzcat.block_offsets filename with Invalid_argument _ -> [||] in
+  let dir = chunks_dir t in
+  if not (is_directory dir) then
+    mkdir_p dir 0o755;
+  let chunks = store_chunks filename dir boundaries in
+
+  (* Write the manifest atomically, as the chunks were. *)
+  let manifest = manifest_of_name t name arch revision in
+  let manifest_new = manifest ^ "." ^ String.random8 () in
+  let chan = open_out manifest_new in
+  Array.iter (fun (hash, size) -> fprintf chan "%s %Ld\n" hash size) chunks;
+  close_out chan;
+  rename manifest_new manifest
+
+let get_template t ?checksums name arch revision filename =
+  let manifest = manifest_of_name t name arch revision in
+  if not (Sys.file_exists manifest) then
+    false
+  else (
+    let dir = chunks_dir t in
+    let lines = read_whole_file manifest in
+    let lines = String.nsplit "\n" lines in
+    let lines = List.filter ((<>) "") lines in
+    let buf = Bytes.create 65536 in
+    let ochan = open_out_bin filename in
+    List.iter (
+      fun line ->
+        let hash, size = String.split " " line in
+        let size = Int64.of_string size in
+        let chunk = dir // hash in
+        let ichan =
+          try open_in_bin chunk
+          with Sys_error msg ->
+            error (f_"cache %s: chunk missing: %s\nYou can delete the cache using: virt-builder --delete-cache") t.directory msg in
+        let rec copy n =
+          let r = input ichan buf 0 (Bytes.length buf) in
+          if r > 0 then (
+            output ochan buf 0 r;
+            may (fun c -> Checksums.update c buf 0 r) checksums;
+            copy (Int64.add n (Int64.of_int r))
+          )
+          else n
+        in
+        let n = copy 0L in
+        close_in ichan;
+        if n <> size then
+          error (f_"cache %s: chunk %s has the wrong size\nYou can delete the cache using: virt-builder --delete-cache") t.directory hash
+    ) lines;
+    close_out ochan;
+    true
+  )
+
+let index_of_uri t uri =
+  t.directory // sprintf "index.%s" (Digest.to_hex (Digest.string uri))
 
 let print_item_status t ~header l =
   if header then (
@@ -36,6 +36,25 @@ val is_cached : t -> string -> string -> Utils.revision -> bool
 (** [is_cached t name arch revision] return whether the file with
     specified name, architecture and revision is cached. *)
 
+val add_template : t -> string -> string -> Utils.revision -> string -> unit
+(** [add_template t name arch revision filename] adds the template
+    [filename] to the cache, split into chunks.  Chunks already in
+    the cache (from any template) are not stored again.  [filename]
+    is not changed, and can be deleted by the caller. *)
+
+val get_template : t -> ?checksums:Checksums.t -> string -> string -> Utils.revision -> string -> bool
+(** [get_template t name arch revision filename] writes the cached
+    template with the specified name, architecture and revision to
+    [filename], and returns [true].  If it is not stored as chunks,
+    it returns [false] and does nothing.
+
+    The data written is also passed to [checksums]. *)
+
+val index_of_uri : t -> string -> string
+(** [index_of_uri t uri] return the filename of the cached copy of
+    the index downloaded from [uri].  (As with {!cache_of_name}, it
+    doesn't check if the filename exists). *)
+
 val print_item_status : t -> header:bool -> (string * string * Utils.revision) list -> unit
 (** [print_item_status t header items] print the status in the cache
     of the specified items (which are tuples of name, architecture,
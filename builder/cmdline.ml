@@ -37,6 +37,7 @@ type cmdline = {
   arg : string;
   arch : string;
   attach : (string option * string) list;
+  batch : string option;
   cache : string option;
   check_signature : bool;
   curl : string;
@@ -44,6 +45,7 @@ type cmdline = {
   delete_on_failure : bool;
   format : string option;
   gpg : string;
+  jobs : int;
   list_format : List_entries.format;
   memsize : int option;
   network : bool;
@@ -74,6 +76,8 @@ let parse_cmdline () =
   in
   let attach_disk s = push_front (!attach_format, s) attach in
 
+  let batch = ref "" in
+
   let cache = ref Paths.xdg_cache_home in
   let set_cache arg = cache := Some arg in
   let no_cache () = cache := None in
@@ -88,6 +92,7 @@ let parse_cmdline () =
 
   let format = ref "" in
   let gpg = ref "gpg" in
+  let jobs = ref 4 in
 
   let list_format = ref List_entries.Short in
   let list_set_long () = list_format := List_entries.Long in
@@ -125,6 +130,7 @@ let parse_cmdline () =
     [ L"attach" ],  Getopt.String ("iso", attach_disk),     s_"Attach data disk/ISO during install";
     [ L"attach-format" ],  Getopt.String ("format", set_attach_format),
                                              s_"Set attach disk format";
+    [ L"batch" ],   Getopt.Set_string ("file", batch),      s_"Build the images listed in file";
     [ L"cache" ],   Getopt.String ("dir", set_cache),       s_"Set template cache dir";
     [ L"no-cache" ], Getopt.Unit no_cache,        s_"Disable template cache";
     [ L"cache-all-templates" ], Getopt.Unit cache_all_mode,
@@ -144,6 +150,7 @@ let parse_cmdline () =
     [ L"get-kernel" ], Getopt.Unit get_kernel_mode,
                                             s_"Get kernel from image";
     [ L"gpg" ],    Getopt.Set_string ("gpg", gpg),          s_"Set GPG binary/command";
+    [ S 'j'; L"jobs" ], Getopt.Set_int ("n", jobs),          s_"Number of images built in parallel with --batch";
     [ S 'l'; L"list" ],        Getopt.Unit list_mode,        s_"List available templates";
     [ L"long" ],    Getopt.Unit list_set_long,    s_"Shortcut for --list-format long";
     [ L"list-format" ], Getopt.Symbol (formats_string, formats, list_set_format),
@@ -175,6 +182,7 @@ let parse_cmdline () =
 %s: build virtual machine images quickly
 
  virt-builder OS-VERSION
+ virt-builder --batch FILE OS-VERSION
  virt-builder -l
  virt-builder --notes OS-VERSION
  virt-builder --print-cache
@@ -194,6 +202,7 @@ read the man page virt-builder(1).
   let mode = !mode in
   let arch = !arch in
   let attach = List.rev !attach in
+  let batch = match !batch with "" -> None | s -> Some s in
   let cache = !cache in
   let check_signature = !check_signature in
   let curl = !curl in
@@ -201,6 +210,7 @@ read the man page virt-builder(1).
   let fingerprints = List.rev !fingerprints in
   let format = match !format with "" -> None | s -> Some s in
   let gpg = !gpg in
+  let jobs = !jobs in
   let list_format = !list_format in
   let machine_readable = !machine_readable in
   let memsize = !memsize in
@@ -217,10 +227,12 @@ read the man page virt-builder(1).
   if args = [] && machine_readable then (
     printf "virt-builder\n";
     printf "arch\n";
+    printf "batch\n";
     printf "config-file\n";
     printf "customize\n";
     printf "json-list\n";
     if Pxzcat.using_parallel_xzcat () then printf "pxzcat\n";
+    if Pzstdcat.using_parallel_zstdcat () then printf "pzstdcat\n";
     exit 0
   );
 
@@ -269,6 +281,11 @@ read the man page virt-builder(1).
         error (f_"--get-kernel: too many parameters")
       ) in
 
+  if jobs < 1 then
+    error (f_"--jobs must be at least 1");
+  if batch <> None && mode <> `Install then
+    error (f_"--batch can only be used when building images");
+
   (* Check source(s) and fingerprint(s). *)
   let sources =
     let rec repeat x = function
@@ -318,11 +335,11 @@ read the man page virt-builder(1).
     ) in
 
   { mode = mode; arg = arg;
-    arch = arch; attach = attach; cache = cache;
+    arch = arch; attach = attach; batch = batch; cache = cache;
     check_signature = check_signature; curl = curl;
     customize_ops = customize_ops;
     delete_on_failure = delete_on_failure; format = format;
-    gpg = gpg; list_format = list_format; memsize = memsize;
+    gpg = gpg; jobs = jobs; list_format = list_format; memsize = memsize;
     network = network; output = output;
     size = size; smp = smp; sources = sources; sync = sync;
     warn_if_partition = warn_if_partition;
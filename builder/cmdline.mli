@@ -24,6 +24,7 @@ type cmdline = {
   arg : string;
   arch : string;
   attach : (string option * string) list;
+  batch : string option;
   cache : string option;
   check_signature : bool;
   curl : string;
@@ -31,6 +32,7 @@ type cmdline = {
   delete_on_failure : bool;
   format : string option;
   gpg : string;
+  jobs : int;
   list_format : List_entries.format;
   memsize : int option;
   network : bool;
@@ -39,32 +39,221 @@ let create ~curl ~tmpdir ~cache = {
   cache = cache;
 }
 
-let rec download t ?template ?progress_bar ?(proxy = Curl.SystemProxy) uri =
+(* Templates are downloaded in pieces of this size, several at a time,
+ * when the server supports range requests.  The pieces already
+ * downloaded are kept in the cache, so an interrupted download can be
+ * resumed.
+ *)
+let piece_size = 64L *^ 1024L *^ 1024L
+let max_connections = 4
+
+(* Return the value of a header in the output of curl --dump-header,
+ * taken from the last response if there were redirects.  The name
+ * must be in lower case, and the value is returned in lower case.
+ *)
+let header headers name =
+  let prefix = name ^ ":" in
+  List.fold_left (
+    fun value line ->
+      let line = String.lowercase_ascii (String.trim line) in
+      if String.is_prefix line "http/" then None
+      else if String.is_prefix line prefix then (
+        let n = String.length prefix in
+        Some (String.trim (String.sub line n (String.length line - n)))
+      )
+      else value
+  ) None headers
+
+(* Download piece [i] of the file, writing it to [fd] at the same
+ * offset, then record that it is done in the state file.
+ *)
+let download_piece t fd state_fd uri size i =
+  let offset = Int64.of_int i *^ piece_size in
+  let len = min piece_size (size -^ offset) in
+  debug "downloading %s range %Ld+%Ld" uri offset len;
+  let curl_args = [
+    "location", None;
+    "url", Some uri;
+    "range", Some (sprintf "%Ld-%Ld" offset (offset +^ len -^ 1L));
+    "fail", None;               (* Exit with an error on 4xx/5xx. *)
+    "silent", None;
+    "show-error", None;
+  ] in
+  let curl_h = Curl.create ~curl:t.curl ~tmpdir:t.tmpdir curl_args in
+
+  ignore (LargeFile.lseek fd offset SEEK_SET);
+  let received = ref 0L in
+  Curl.stream curl_h (
+    fun buf pos n ->
+      received := !received +^ Int64.of_int n;
+      (* eg. the server ignored the range and sent the whole file *)
+      if !received > len then
+        error (f_"failed to download %s: the server sent more data than requested") uri;
+      ignore (write fd buf pos n)
+  );
+  if !received <> len then
+    error (f_"failed to download %s: the server sent %Ld bytes instead of %Ld")
+      uri !received len;
+
+  let line = sprintf "%d\n" i in
+  ignore (write state_fd (Bytes.of_string line) 0 (String.length line))
+
+(* Download the file, which has the given size, into [partial] using
+ * up to [max_connections] range requests at the same time.  The
+ * pieces downloaded are listed in [partial.done], so that if this is
+ * interrupted, the next call only downloads the missing pieces.
+ *
+ * Returns [false] if another virt-builder process is downloading the
+ * same file, in which case the caller should just download it
+ * normally.
+ *)
+let download_ranges t ~partial uri size =
+  let state = partial ^ ".done" in
+  let state_fd = openfile state [O_RDWR; O_CREAT; O_APPEND; O_CLOEXEC] 0o644 in
+  let locked =
+    try lockf state_fd F_TLOCK 0; true
+    with Unix_error ((EAGAIN|EACCES), _, _) -> false in
+  if not locked then (
+    close state_fd;
+    false
+  )
+  else (
+    (* Read the state through the locked fd, since closing any other
+     * fd of the file would release the lock.
+     *)
+    let lines =
+      let b = Buffer.create 256 in
+      let buf = Bytes.create 4096 in
+      let rec loop () =
+        let n = read state_fd buf 0 (Bytes.length buf) in
+        if n > 0 then (
+          Buffer.add_string b (Bytes.sub_string buf 0 n);
+          loop ()
+        )
+      in
+      loop ();
+      List.filter ((<>) "") (String.nsplit "\n" (Buffer.contents b)) in
+
+    let nr_pieces = Int64.to_int ((size +^ piece_size -^ 1L) /^ piece_size) in
+    let is_done = Array.make nr_pieces false in
+    (match lines with
+    | first :: pieces
+         when first = Int64.to_string size &&
+              (try (LargeFile.stat partial).LargeFile.st_size = size
+               with Unix_error _ -> false) ->
+      debug "resuming download of %s" uri;
+      List.iter (
+        fun i ->
+          try is_done.(int_of_string i) <- true
+          with Failure _ | Invalid_argument _ -> ()
+      ) pieces
+    | _ ->
+      (* Start again with an empty (sparse) file of the right size. *)
+      ftruncate state_fd 0;
+      let line = Int64.to_string size ^ "\n" in
+      ignore (write state_fd (Bytes.of_string line) 0 (String.length line));
+      let fd = openfile partial [O_WRONLY; O_CREAT; O_TRUNC; O_CLOEXEC] 0o644 in
+      LargeFile.ftruncate fd size;
+      close fd
+    );
+
+    let todo = ref [] in
+    for i = nr_pieces-1 downto 0 do
+      if not is_done.(i) then push_front i todo
+    done;
+    let todo = Array.of_list !todo in
+    let nr_workers = min max_connections (Array.length todo) in
+
+    (* Each worker is a subprocess which downloads every nr_workers'th
+     * piece.
+     *)
+    let pids = List.map (
+      fun k ->
+        let pid = fork () in
+        if pid = 0 then (
+          (* Child.  As in Batch.run, don't run the at_exit handlers
+           * of the parent, which would delete its temporary files.
+           *)
+          at_exit (
+            fun () ->
+              Pervasives.flush Pervasives.stdout;
+              Pervasives.flush Pervasives.stderr;
+              Exit._exit 1
+          );
+          (try
+            let fd = openfile partial [O_WRONLY; O_CLOEXEC] 0 in
+            Array.iteri (
+              fun j i ->
+                if j mod nr_workers = k then
+                  download_piece t fd state_fd uri size i
+            ) todo;
+            close fd
+          with exn ->
+            eprintf "%s: %s: %s\n%!" prog uri (Printexc.to_string exn);
+            Exit._exit 1
+          );
+          Pervasives.flush Pervasives.stdout;
+          Pervasives.flush Pervasives.stderr;
+          Exit._exit 0
+        );
+        pid
+    ) (Array.to_list (Array.init nr_workers (fun k -> k))) in
+
+    let failed =
+      List.fold_left (
+        fun failed pid ->
+          let _, status = waitpid [] pid in
+          failed || status <> WEXITED 0
+      ) false pids in
+    close state_fd;             (* releases the lock *)
+    if failed then
+      error (f_"failed to download %s.  Run virt-builder again to resume the download.") uri;
+    true
+  )
+
+let rec download t ?template ?progress_bar ?(proxy = Curl.SystemProxy)
+                 ?checksums uri =
   match template with
   | None ->                       (* no cache, simple download *)
     (* Create a temporary name. *)
     let tmpfile = Filename.temp_file ~temp_dir:t.tmpdir "vbcache" ".txt" in
-    download_to t ?progress_bar ~proxy uri tmpfile;
+    download_to t ?progress_bar ~proxy ?checksums uri tmpfile;
     (tmpfile, true)
 
   | Some (name, arch, revision) ->
     match t.cache with
     | None ->
       (* Not using the cache at all? *)
-      download t ?progress_bar ~proxy uri
+      download t ?progress_bar ~proxy ?checksums uri
 
     | Some cache ->
       let filename = Cache.cache_of_name cache name arch revision in
 
-      (* Is the requested template name + revision in the cache already?
-       * If not, download it.
+      (* Templates cached by old versions of virt-builder are
+       * complete files.
        *)
-      if not (Sys.file_exists filename) then
-        download_to t ?progress_bar ~proxy uri filename;
-
-      (filename, false)
+      if Sys.file_exists filename then (
+        may (fun c -> Checksums.update_from_file c filename) checksums;
+        (filename, false)
+      )
+      else (
+        (* The template is put together from the chunks in the cache,
+         * or downloaded and then split into chunks.  Either way, the
+         * complete file is temporary.
+         *)
+        let tmpfile = filename ^ "." ^ String.random8 () in
+        unlink_on_exit tmpfile;
+        if not (Cache.get_template cache ?checksums name arch revision
+                  tmpfile) then (
+          let partial = filename ^ ".part" in
+          download_to t ?progress_bar ~proxy ?checksums ~partial uri tmpfile;
+          Cache.add_template cache name arch revision tmpfile
+        );
+        (tmpfile, true)
+      )
 
-and download_to t ?(progress_bar = false) ~proxy uri filename =
+and download_to t ?(progress_bar = false) ~proxy ?checksums ?partial
+                uri filename =
   let parseduri =
     try URI.parse_uri uri
     with Invalid_argument "URI.parse_uri" ->
@@ -79,9 +268,43 @@ and download_to t ?(progress_bar = false) ~proxy uri filename =
   let filename_new = filename ^ "." ^ String.random8 () in
   unlink_on_exit filename_new;
 
-  (match parseduri.URI.protocol with
+  (* When computing checksums, the data is passed through us on its
+   * way to the file, so it doesn't have to be read again later.
+   *)
+  let output_with_checksums checksums f =
+    let chan = open_out_bin filename_new in
+    f (
+      fun buf offset len ->
+        output chan buf offset len;
+        Checksums.update checksums buf offset len
+    );
+    close_out chan
+  in
+
+  (match parseduri.URI.protocol, checksums with
+  | "file", Some checksums ->
+    let path = parseduri.URI.path in
+    debug "copying %s" path;
+    let ichan =
+      try open_in_bin path
+      with Sys_error msg ->
+        error (f_"cannot open '%s' for download: %s") path msg in
+    output_with_checksums checksums (
+      fun f ->
+        let buf = Bytes.create 65536 in
+        let rec loop () =
+          let n = input ichan buf 0 (Bytes.length buf) in
+          if n > 0 then (
+            f buf 0 n;
+            loop ()
+          )
+        in
+        loop ()
+    );
+    close_in ichan
+
   (* Download (ie. copy) from a local file. *)
-  | "file" ->
+  | "file", None ->
     let path = parseduri.URI.path in
     let cmd = [ "cp" ] @
       (if verbose () then [ "-v" ] else []) @
@@ -105,6 +328,7 @@ and download_to t ?(progress_bar = false) ~proxy uri filename =
       if not (verbose ()) then append curl_args quiet_args;
       append curl_args [
         "output", Some "/dev/null"; (* Write output to /dev/null. *)
+        "dump-header", Some "-";    (* Headers to stdout. *)
         "head", None;               (* Request only HEAD. *)
         "write-out", Some "%{http_code}" (* HTTP status code to stdout. *)
       ];
@@ -112,9 +336,11 @@ and download_to t ?(progress_bar = false) ~proxy uri filename =
       Curl.create ~curl:t.curl ~tmpdir:t.tmpdir !curl_args in
 
     let lines = Curl.run curl_h in
-    if List.length lines < 1 then
-      error (f_"unexpected output from curl command, enable debug and look at previous messages");
-    let status_code = List.hd lines in
+    let status_code, headers =
+      match List.rev lines with
+      | [] ->
+        error (f_"unexpected output from curl command, enable debug and look at previous messages")
+      | status_code :: headers -> status_code, List.rev headers in
     let bad_status_code = function
       | "" -> true
       | s when s.[0] = '4' -> true (* 4xx *)
@@ -124,20 +350,122 @@ and download_to t ?(progress_bar = false) ~proxy uri filename =
     if bad_status_code status_code then
       error (f_"failed to download %s: HTTP status code %s") uri status_code;
 
-    (* Now download the file. *)
-    let curl_h =
-      let curl_args = ref common_args in
-      push_back curl_args ("output", Some filename_new);
+    (* Use range requests for large templates, if the server says
+     * that it supports them.
+     *)
+    let ranges =
+      match partial, header headers "content-length",
+            header headers "accept-ranges" with
+      | Some partial, Some size, Some "bytes" ->
+        (try
+          let size = Int64.of_string size in
+          if size > piece_size then Some (partial, size) else None
+        with Failure _ -> None)
+      | _ -> None in
 
-      if not (verbose ()) then (
-        if progress_bar then push_back curl_args ("progress-bar", None)
-        else append curl_args quiet_args
-      );
+    match ranges with
+    | Some (partial, size) when download_ranges t ~partial uri size ->
+      may (fun c -> Checksums.update_from_file c partial) checksums;
+      rename partial filename_new;
+      unlink (partial ^ ".done")
 
-      Curl.create ~curl:t.curl ~tmpdir:t.tmpdir !curl_args in
+    | Some _ | None ->
+      (* Now download the file.  With checksums, curl writes it to
+       * stdout, and we copy it to the file.
+       *)
+      let curl_h =
+        let curl_args = ref common_args in
+        if checksums = None then
+          push_back curl_args ("output", Some filename_new);
+
+        if not (verbose ()) then (
+          if progress_bar then push_back curl_args ("progress-bar", None)
+          else append curl_args quiet_args
+        );
 
-    ignore (Curl.run curl_h)
+        Curl.create ~curl:t.curl ~tmpdir:t.tmpdir !curl_args in
+
+      match checksums with
+      | None -> ignore (Curl.run curl_h)
+      | Some checksums -> output_with_checksums checksums (Curl.stream curl_h)
   );
 
   (* Rename the file if the download was successful. *)
   rename filename_new filename
+
+(* Download uri to a new file if it is newer than filename, using
+ * curl --time-cond.  Returns None if it is not newer.
+ *)
+let download_if_modified t ~proxy uri filename =
+  let filename_new = filename ^ "." ^ String.random8 () in
+  unlink_on_exit filename_new;
+
+  let curl_args = ref [
+    "location", None;
+    "url", Some uri;
+    "output", Some filename_new;
+    "remote-time", None;        (* Set mtime from Last-Modified. *)
+    "write-out", Some "%{http_code}";
+  ] in
+  if Sys.file_exists filename then
+    push_back curl_args ("time-cond", Some filename);
+  if not (verbose ()) then
+    append curl_args [ "silent", None; "show-error", None ];
+
+  let curl_h =
+    Curl.create ~curl:t.curl ~proxy ~tmpdir:t.tmpdir !curl_args in
+  let lines = Curl.run curl_h in
+  let status_code = match lines with [] -> "" | l :: _ -> l in
+  match status_code with
+  | "304" -> None
+  | "200" when Sys.file_exists filename_new -> Some filename_new
+  (* Some servers ignore If-Modified-Since when the index has not
+   * changed, in which case curl itself skips the download.
+   *)
+  | "200" -> None
+  | _ ->
+    error (f_"failed to download %s: HTTP status code %s") uri status_code
+
+(* How long a cached index is used before checking for a new one. *)
+let index_max_age = 3600.
+
+let download_index t ~verify ?(proxy = Curl.SystemProxy) uri =
+  let parseduri =
+    try URI.parse_uri uri
+    with Invalid_argument "URI.parse_uri" ->
+      error (f_"error parsing URI '%s'. Look for error messages printed above.")
+        uri in
+
+  match t.cache with
+  | Some cache when parseduri.URI.protocol <> "file" ->
+    let filename = Cache.index_of_uri cache uri in
+    (* The time of the last check is the mtime of this file.  The
+     * mtime of the index itself is the Last-Modified time from the
+     * server, used for If-Modified-Since.
+     *)
+    let checked = filename ^ ".checked" in
+    let is_fresh () =
+      try
+        Sys.file_exists filename &&
+          Unix.time () -. (stat checked).st_mtime < index_max_age
+      with Unix_error _ -> false in
+
+    if is_fresh () then
+      debug "using cached index %s for %s" filename uri
+    else (
+      (match download_if_modified t ~proxy uri filename with
+      | None ->
+        debug "cached index %s for %s is up to date" filename uri
+      | Some filename_new ->
+        verify filename_new;
+        rename filename_new filename
+      );
+      close_out (open_out checked);
+      utimes checked 0. 0.
+    );
+    filename
+
+  | Some _ | None ->                    (* no cache, simple download *)
+    let tmpfile, _ = download t ~proxy uri in
+    verify tmpfile;
+    tmpfile
@@ -27,7 +27,7 @@ type t
 val create : curl:string -> tmpdir:string -> cache:Cache.t option -> t
 (** Create the abstract type. *)
 
-val download : t -> ?template:(string*string*Utils.revision) -> ?progress_bar:bool -> ?proxy:Curl.proxy -> uri -> (filename * bool)
+val download : t -> ?template:(string*string*Utils.revision) -> ?progress_bar:bool -> ?proxy:Curl.proxy -> ?checksums:Checksums.t -> uri -> (filename * bool)
 (** Download the URI, returning the downloaded filename and a
     temporary file flag.  The temporary file flag is [true] iff
     the downloaded file is temporary and should be deleted by the
@@ -36,10 +36,34 @@ val download : t -> ?template:(string*string*Utils.revision) -> ?progress_bar:bo
     For templates, you must supply [~template:(name, arch, revision)].
     This causes the cache to be used (if possible).  Name, arch(itecture)
     and revision are used for cache control (see the man page for details).
+    Templates are stored in the cache as chunks, so the file returned
+    for a template is normally a temporary copy put together from them.
+    Large templates are downloaded with several range requests at
+    the same time if the server supports them, and an interrupted
+    download is resumed the next time.
 
     If [~progress_bar:true] then display a progress bar if the file
     doesn't come from the cache.  In verbose mode, progress messages
     are always displayed.
 
     [proxy] specifies the type of proxy to be used in the transfer,
-    if possible. *)
+    if possible.
+
+    If [~checksums] is given, the contents of the returned file are
+    passed to it.  This is done while the file is downloaded or put
+    together from the cache, so verifying the checksums doesn't need
+    another pass over the file. *)
+
+val download_index : t -> verify:(filename -> unit) -> ?proxy:Curl.proxy -> uri -> filename
+(** Download the index at the URI, returning the filename.  The
+    caller must not delete the file.
+
+    If the cache is used, a copy of the index is kept in it.  The
+    cached copy is used without any network access if it was checked
+    less than an hour ago, and otherwise it is only downloaded again
+    if the server says that it has been modified (using
+    [If-Modified-Since]).
+
+    [verify] is called on each file actually downloaded, before it
+    is put into the cache, and should fail if the file is not
+    correctly signed.  So the cached copy has always been verified. *)
@@ -31,13 +31,13 @@ let get_index ~downloader ~sigchecker
   in
 
   let rec get_index () =
-    (* Get the index page. *)
-    let tmpfile, _ = Downloader.download downloader ~proxy uri in
-
-    (* Check index file signature (also verifies it was fully
-     * downloaded and not corrupted in transit).
+    (* Get the index page.  Check index file signature (also verifies
+     * it was fully downloaded and not corrupted in transit).  If the
+     * index comes from the cache, it was checked when it was cached.
      *)
-    Sigchecker.verify sigchecker tmpfile;
+    let tmpfile =
+      Downloader.download_index downloader
+        ~verify:(Sigchecker.verify sigchecker) ~proxy uri in
 
     (* Try parsing the file. *)
     let sections = Ini_reader.read_ini tmpfile in
@@ -69,8 +69,62 @@ virt_builder_using_parallel_xzcat (value unitv)
 
 #if PARALLEL_XZCAT
 static void pxzcat (value filenamev, value outputfilev, unsigned nr_threads);
+static int check_header_magic (int fd);
+static lzma_index *parse_indexes (value filenamev, int fd);
 #endif /* PARALLEL_XZCAT */
 
+extern value virt_builder_xz_block_offsets (value filenamev);
+
+/* Return the offsets in the file of the start of each xz block, and
+ * of the end of the last block, or an empty array if the file is not
+ * an xz file or liblzma is not available.
+ */
+value
+virt_builder_xz_block_offsets (value filenamev)
+{
+  CAMLparam1 (filenamev);
+  CAMLlocal1 (rv);
+
+#if PARALLEL_XZCAT
+  int fd;
+  lzma_index *idx;
+  lzma_index_iter iter;
+  lzma_vli n;
+  size_t i;
+
+  fd = open (String_val (filenamev), O_RDONLY|O_CLOEXEC);
+  if (fd == -1)
+    unix_error (errno, (char *) "open", filenamev);
+
+  if (!check_header_magic (fd)) {
+    close (fd);
+    CAMLreturn (caml_alloc (0, 0));
+  }
+
+  /* NB: This might throw an exception if the file is corrupt. */
+  idx = parse_indexes (filenamev, fd);
+  close (fd);
+
+  n = lzma_index_block_count (idx);
+  rv = caml_alloc (n > 0 ? n+1 : 0, 0);
+  lzma_index_iter_init (&iter, idx);
+  i = 0;
+  while (!lzma_index_iter_next (&iter, LZMA_INDEX_ITER_BLOCK)) {
+    Store_field (rv, i++, caml_copy_int64 (iter.block.compressed_file_offset));
+    if (i == n)
+      Store_field (rv, i++,
+                   caml_copy_int64 (iter.block.compressed_file_offset +
+                                    iter.block.total_size));
+  }
+
+  lzma_index_end (idx, NULL);
+#else
+  rv = caml_alloc (0, 0);
+#endif
+
+  CAMLreturn (rv);
+}
+
 extern value virt_builder_pxzcat (value inputfilev, value outputfilev);
 
 value
@@ -150,8 +204,6 @@ virt_builder_pxzcat (value inputfilev, value outputfilev)
 #define XZ_HEADER_MAGIC     "\xfd" "7zXZ\0"
 #define XZ_HEADER_MAGIC_LEN 6
 
-static int check_header_magic (int fd);
-static lzma_index *parse_indexes (value filenamev, int fd);
 static void iter_blocks (lzma_index *idx, unsigned nr_threads, value filenamev, int fd, value outputfilev, int ofd);
 
 static void
@@ -409,24 +461,6 @@ parse_indexes (value filenamev, int fd)
   return combined_index;
 }
 
-/* Return true iff the buffer is all zero bytes.
- *
- * Note that gcc is smart enough to optimize this properly:
- * http://stackoverflow.com/questions/1493936/faster-means-of-checking-for-an-empty-buffer-in-c/1493989#1493989
- */
-static inline int
-is_zero (const unsigned char *buffer, size_t size)
-{
-  size_t i;
-
-  for (i = 0; i < size; ++i) {
-    if (buffer[i] != 0)
-      return 0;
-  }
-
-  return 1;
-}
-
 struct global_state {
   /* Current iterator.  Threads update this, but it is protected by a
    * mutex, and each thread takes a copy of it when working on it.
@@ -681,7 +715,7 @@ worker_thread (void *vp)
         /* Don't write if the block is all zero, to preserve output file
          * sparseness.  However we have to update oposition.
          */
-        if (!is_zero (outbuf, wsz)) {
+        if (!is_zero ((const char *) outbuf, wsz)) {
           if (xpwrite (global->ofd, outbuf, wsz, oposition) == -1) {
             perror (global->outputfile);
             return &state->status;
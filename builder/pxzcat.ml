@@ -18,3 +18,4 @@
 
 external pxzcat : string -> string -> unit = "virt_builder_pxzcat"
 external using_parallel_xzcat : unit -> bool = "virt_builder_using_parallel_xzcat" "noalloc"
+external block_offsets : string -> int64 array = "virt_builder_xz_block_offsets"
@@ -32,3 +32,11 @@ val pxzcat : string -> string -> unit
 
 val using_parallel_xzcat : unit -> bool
 (** Returns [true] iff the implementation uses parallel xzcat. *)
+
+val block_offsets : string -> int64 array
+(** [block_offsets input] returns the offsets in the xz file [input]
+    where each block starts, followed by the offset where the last
+    block ends.  It returns an empty array if [input] is not an xz
+    file or liblzma was not found at compile time.
+
+    Raises [Invalid_argument] if the file is corrupt. *)
@@ -0,0 +1,542 @@
+/* virt-builder
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#include <pthread.h>
+
+#include <caml/alloc.h>
+#include <caml/fail.h>
+#include <caml/memory.h>
+#include <caml/mlvalues.h>
+
+#include "guestfs.h"
+#include "guestfs-internal-frontend.h"
+
+#if HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#ifdef HAVE_CAML_UNIXSUPPORT_H
+#include <caml/unixsupport.h>
+#else
+#define Nothing ((value) 0)
+extern void unix_error (int errcode, char * cmdname, value arg) Noreturn;
+#endif
+
+#ifndef ZSTDCAT
+#define ZSTDCAT "zstdcat"
+#endif
+
+#if HAVE_LIBZSTD
+#define PARALLEL_ZSTDCAT 1
+#else
+#define PARALLEL_ZSTDCAT 0
+#endif
+
+extern value virt_builder_using_parallel_zstdcat (value unitv);
+
+value
+virt_builder_using_parallel_zstdcat (value unitv)
+{
+  return PARALLEL_ZSTDCAT ? Val_true : Val_false;
+}
+
+#if PARALLEL_ZSTDCAT
+static void pzstdcat (value filenamev, value outputfilev, unsigned nr_threads);
+#endif /* PARALLEL_ZSTDCAT */
+
+extern value virt_builder_pzstdcat (value inputfilev, value outputfilev);
+
+value
+virt_builder_pzstdcat (value inputfilev, value outputfilev)
+{
+  CAMLparam2 (inputfilev, outputfilev);
+
+#if PARALLEL_ZSTDCAT
+
+  long i;
+  unsigned nr_threads;
+
+  i = sysconf (_SC_NPROCESSORS_ONLN);
+  if (i <= 0) {
+    perror ("could not get number of cores");
+    i = 1;
+  }
+  nr_threads = (unsigned) i;
+
+  /* NB: This might throw an exception if something fails.  If it
+   * does, this function won't return as a regular C function.
+   */
+  pzstdcat (inputfilev, outputfilev, nr_threads);
+
+#else /* !PARALLEL_ZSTDCAT */
+
+  /* Fallback: use regular zstdcat. */
+  int fd;
+  pid_t pid;
+  int status;
+
+  fd = open (String_val (outputfilev), O_WRONLY|O_CREAT|O_TRUNC|O_NOCTTY, 0666);
+  if (fd == -1)
+    unix_error (errno, (char *) "open", outputfilev);
+
+  pid = fork ();
+  if (pid == -1) {
+    const int err = errno;
+    close (fd);
+    unix_error (err, (char *) "fork", Nothing);
+  }
+
+  if (pid == 0) {               /* child - run zstdcat */
+    dup2 (fd, 1);
+    execlp (ZSTDCAT, ZSTDCAT, String_val (inputfilev), NULL);
+    perror (ZSTDCAT);
+    _exit (EXIT_FAILURE);
+  }
+
+  close (fd);
+
+  if (waitpid (pid, &status, 0) == -1)
+    unix_error (errno, (char *) "waitpid", Nothing);
+  if (!WIFEXITED (status) || WEXITSTATUS (status) != 0)
+    caml_failwith (ZSTDCAT " program failed, see earlier error messages");
+
+#endif /* !PARALLEL_ZSTDCAT */
+
+  CAMLreturn (Val_unit);
+}
+
+#if PARALLEL_ZSTDCAT
+
+#define DEBUG 0
+
+#if DEBUG
+#define debug(fs,...) fprintf (stderr, "pzstdcat: debug: " fs "\n", ## __VA_ARGS__)
+#else
+#define debug(fs,...) /* nothing */
+#endif
+
+#define ZSTD_FRAME_MAGIC          0xFD2FB528
+#define ZSTD_SKIPPABLE_MAGIC      0x184D2A50
+#define ZSTD_SKIPPABLE_MAGIC_MASK 0xFFFFFFF0
+
+/* A range of the input file which is uncompressed by one thread,
+ * normally a single frame.  If any frame does not record its
+ * uncompressed size then the offsets in the output are not known,
+ * and the whole file is a single job.
+ */
+struct job {
+  uint64_t offset;              /* compressed offset and size */
+  uint64_t size;
+  uint64_t uoffset;             /* uncompressed offset */
+};
+
+struct global_state {
+  /* The next job.  Threads update this, but it is protected by a
+   * mutex.
+   */
+  size_t next_job;
+  pthread_mutex_t next_job_mutex;
+
+  struct job *jobs;
+  size_t nr_jobs;
+
+  /* Input file, mapped into memory. */
+  const char *filename;
+  const uint8_t *data;
+
+  /* Output file.  Threads must use pwrite. */
+  const char *outputfile;
+  int ofd;
+};
+
+struct per_thread_state {
+  unsigned thread_num;
+  struct global_state *global;
+  int status;
+  uint64_t end;                 /* end of the last job in the output */
+};
+
+static uint32_t
+get_le32 (const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/* Find the frames in the file.  Skippable frames (such as the seek
+ * table at the end of files in the seekable format) are ignored.
+ * Returns the total uncompressed size, or -1 if any frame does not
+ * record its size, in which case the single job is the whole file.
+ */
+static int64_t
+find_frames (value filenamev, const uint8_t *data, uint64_t size,
+             struct job **jobs_r, size_t *nr_jobs_r)
+{
+  struct job *jobs = NULL, *p;
+  size_t nr_jobs = 0;
+  uint64_t offset = 0, uoffset = 0;
+  size_t csize;
+  unsigned long long usize;
+  uint32_t magic;
+
+  while (offset < size) {
+    if (size - offset < 4)
+      caml_invalid_argument ("input file is truncated or not a zstd file");
+    magic = get_le32 (&data[offset]);
+
+    csize = ZSTD_findFrameCompressedSize (&data[offset], size - offset);
+    if (ZSTD_isError (csize)) {
+      fprintf (stderr, "%s: %s\n",
+               String_val (filenamev), ZSTD_getErrorName (csize));
+      caml_invalid_argument ("invalid zstd frame");
+    }
+
+    if ((magic & ZSTD_SKIPPABLE_MAGIC_MASK) == ZSTD_SKIPPABLE_MAGIC) {
+      debug ("skippable frame at %" PRIu64 ", size %zu", offset, csize);
+      offset += csize;
+      continue;
+    }
+    if (magic != ZSTD_FRAME_MAGIC)
+      caml_invalid_argument ("input file is not a zstd file");
+
+    usize = ZSTD_getFrameContentSize (&data[offset], size - offset);
+    if (usize == ZSTD_CONTENTSIZE_UNKNOWN || usize == ZSTD_CONTENTSIZE_ERROR) {
+      debug ("frame at %" PRIu64 " has no content size", offset);
+      free (jobs);
+      jobs = malloc (sizeof (struct job));
+      if (jobs == NULL)
+        caml_raise_out_of_memory ();
+      jobs[0].offset = 0;
+      jobs[0].size = size;
+      jobs[0].uoffset = 0;
+      *jobs_r = jobs;
+      *nr_jobs_r = 1;
+      return -1;
+    }
+
+    debug ("frame at %" PRIu64 ", size %zu, uncompressed size %llu",
+           offset, csize, usize);
+
+    p = realloc (jobs, (nr_jobs+1) * sizeof (struct job));
+    if (p == NULL) {
+      free (jobs);
+      caml_raise_out_of_memory ();
+    }
+    jobs = p;
+    jobs[nr_jobs].offset = offset;
+    jobs[nr_jobs].size = csize;
+    jobs[nr_jobs].uoffset = uoffset;
+    nr_jobs++;
+
+    offset += csize;
+    uoffset += usize;
+  }
+
+  *jobs_r = jobs;
+  *nr_jobs_r = nr_jobs;
+  return uoffset;
+}
+
+static void iter_frames (struct global_state *global, unsigned nr_threads, uint64_t *end_r);
+
+static void
+pzstdcat (value filenamev, value outputfilev, unsigned nr_threads)
+{
+  int fd, ofd;
+  struct stat statbuf;
+  void *data;
+  struct global_state global;
+  int64_t size;
+  uint64_t end;
+
+  /* Open the file and map it into memory. */
+  fd = open (String_val (filenamev), O_RDONLY);
+  if (fd == -1)
+    unix_error (errno, (char *) "open", filenamev);
+
+  if (fstat (fd, &statbuf) == -1) {
+    const int err = errno;
+    close (fd);
+    unix_error (err, (char *) "fstat", filenamev);
+  }
+  if (statbuf.st_size == 0) {
+    close (fd);
+    caml_invalid_argument ("input file is not a zstd file");
+  }
+
+  data = mmap (NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    const int err = errno;
+    close (fd);
+    unix_error (err, (char *) "mmap", filenamev);
+  }
+  close (fd);
+
+  /* Find the frames. */
+  size = find_frames (filenamev, data, statbuf.st_size,
+                      &global.jobs, &global.nr_jobs);
+  debug ("%zu jobs, uncompressed size = %" PRIi64, global.nr_jobs, size);
+
+  /* Avoid annoying ext4 auto_da_alloc, as in pxzcat-c.c. */
+  ofd = open (String_val (outputfilev), O_WRONLY|O_CREAT|O_NOCTTY, 0644);
+  if (ofd == -1) {
+    const int err = errno;
+    munmap (data, statbuf.st_size);
+    unix_error (err, (char *) "open", outputfilev);
+  }
+
+  if (ftruncate (ofd, 1) == -1 ||
+      lseek (ofd, 0, SEEK_SET) == -1 ||
+      write (ofd, "\0", 1) == -1 ||
+      ftruncate (ofd, size >= 0 ? size : 0) == -1) {
+    const int err = errno;
+    munmap (data, statbuf.st_size);
+    close (ofd);
+    unix_error (err, (char *) "write", outputfilev);
+  }
+
+  global.next_job = 0;
+  global.filename = String_val (filenamev);
+  global.data = data;
+  global.outputfile = String_val (outputfilev);
+  global.ofd = ofd;
+
+  if (nr_threads > global.nr_jobs)
+    nr_threads = global.nr_jobs;
+  if (nr_threads == 0)
+    nr_threads = 1;
+
+  iter_frames (&global, nr_threads, &end);
+
+  free (global.jobs);
+  munmap (data, statbuf.st_size);
+
+  /* Zero blocks at the end were not written, so set the size now
+   * that it is known.
+   */
+  if (size == -1 && ftruncate (ofd, end) == -1) {
+    const int err = errno;
+    close (ofd);
+    unix_error (err, (char *) "ftruncate", outputfilev);
+  }
+
+  if (close (ofd) == -1)
+    unix_error (errno, (char *) "close", outputfilev);
+}
+
+/* Create threads to iterate over the frames and uncompress. */
+static void *worker_thread (void *vp);
+
+static void
+iter_frames (struct global_state *global, unsigned nr_threads,
+             uint64_t *end_r)
+{
+  CLEANUP_FREE struct per_thread_state *per_thread = NULL;
+  CLEANUP_FREE pthread_t *thread = NULL;
+  unsigned u, nr_errors;
+  int err;
+  void *status;
+
+  per_thread = malloc (sizeof (struct per_thread_state) * nr_threads);
+  thread = malloc (sizeof (pthread_t) * nr_threads);
+  if (per_thread == NULL || thread == NULL)
+    caml_raise_out_of_memory ();
+
+  err = pthread_mutex_init (&global->next_job_mutex, NULL);
+  if (err != 0)
+    unix_error (err, (char *) "pthread_mutex_init", Nothing);
+
+  for (u = 0; u < nr_threads; ++u) {
+    per_thread[u].thread_num = u;
+    per_thread[u].global = global;
+    per_thread[u].end = 0;
+  }
+
+  /* Start the threads. */
+  for (u = 0; u < nr_threads; ++u) {
+    err = pthread_create (&thread[u], NULL, worker_thread, &per_thread[u]);
+    if (err != 0)
+      unix_error (err, (char *) "pthread_create", Nothing);
+  }
+
+  /* Wait for the threads to exit. */
+  nr_errors = 0;
+  *end_r = 0;
+  for (u = 0; u < nr_threads; ++u) {
+    err = pthread_join (thread[u], &status);
+    if (err != 0) {
+      fprintf (stderr, "pthread_join (%u): %s\n", u, strerror (err));
+      nr_errors++;
+    }
+    if (*(int *)status == -1)
+      nr_errors++;
+    if (per_thread[u].end > *end_r)
+      *end_r = per_thread[u].end;
+  }
+
+  pthread_mutex_destroy (&global->next_job_mutex);
+
+  if (nr_errors > 0)
+    caml_invalid_argument ("some threads failed, see earlier errors");
+}
+
+static int
+xpwrite (int fd, const void *bufvp, size_t count, off_t offset)
+{
+  const char *buf = bufvp;
+  ssize_t r;
+
+  while (count > 0) {
+    r = pwrite (fd, buf, count, offset);
+    if (r == -1)
+      return -1;
+    count -= r;
+    offset += r;
+    buf += r;
+  }
+
+  return 0;
+}
+
+/* Iterate over the jobs and uncompress. */
+static void *
+worker_thread (void *vp)
+{
+  struct per_thread_state *state = vp;
+  struct global_state *global = state->global;
+  ZSTD_DStream *dstream;
+  CLEANUP_FREE uint8_t *outbuf = NULL;
+  const size_t outbuf_size = ZSTD_DStreamOutSize ();
+  const struct job *job;
+  ZSTD_inBuffer in;
+  ZSTD_outBuffer out;
+  uint64_t oposition;
+  size_t r;
+  int err;
+
+  state->status = -1;
+
+  outbuf = malloc (outbuf_size);
+  dstream = ZSTD_createDStream ();
+  if (outbuf == NULL || dstream == NULL) {
+    perror ("malloc");
+    ZSTD_freeDStream (dstream);
+    return &state->status;
+  }
+
+  for (;;) {
+    /* Get the next job. */
+    err = pthread_mutex_lock (&global->next_job_mutex);
+    if (err != 0) abort ();
+    job = NULL;
+    if (global->next_job < global->nr_jobs)
+      job = &global->jobs[global->next_job++];
+    err = pthread_mutex_unlock (&global->next_job_mutex);
+    if (err != 0) abort ();
+    if (job == NULL)
+      break;
+
+    r = ZSTD_initDStream (dstream);
+    if (ZSTD_isError (r)) {
+      fprintf (stderr, "%s: %s\n", global->filename, ZSTD_getErrorName (r));
+      goto error;
+    }
+
+    in.src = &global->data[job->offset];
+    in.size = job->size;
+    in.pos = 0;
+    oposition = job->uoffset;
+
+    /* This also handles several frames in one job.  r == 0 means a
+     * frame has been completely decoded and flushed.
+     */
+    r = 0;
+    while (in.pos < in.size) {
+      out.dst = outbuf;
+      out.size = outbuf_size;
+      out.pos = 0;
+
+      r = ZSTD_decompressStream (dstream, &out, &in);
+      if (ZSTD_isError (r)) {
+        fprintf (stderr, "%s: could not uncompress frame: %s\n",
+                 global->filename, ZSTD_getErrorName (r));
+        goto error;
+      }
+
+      /* Don't write if the block is all zero, to preserve output file
+       * sparseness.  However we have to update oposition.
+       */
+      if (!is_zero ((const char *) outbuf, out.pos)) {
+        if (xpwrite (global->ofd, outbuf, out.pos, oposition) == -1) {
+          perror (global->outputfile);
+          goto error;
+        }
+      }
+      oposition += out.pos;
+    }
+
+    /* Flush any output still held by the decoder. */
+    while (r != 0) {
+      out.dst = outbuf;
+      out.size = outbuf_size;
+      out.pos = 0;
+
+      r = ZSTD_decompressStream (dstream, &out, &in);
+      if (ZSTD_isError (r)) {
+        fprintf (stderr, "%s: could not uncompress frame: %s\n",
+                 global->filename, ZSTD_getErrorName (r));
+        goto error;
+      }
+      if (out.pos == 0) {
+        fprintf (stderr, "%s: unexpected end of file\n", global->filename);
+        goto error;
+      }
+      if (!is_zero ((const char *) outbuf, out.pos)) {
+        if (xpwrite (global->ofd, outbuf, out.pos, oposition) == -1) {
+          perror (global->outputfile);
+          goto error;
+        }
+      }
+      oposition += out.pos;
+    }
+
+    if (oposition > state->end)
+      state->end = oposition;
+  }
+
+  state->status = 0;
+ error:
+  ZSTD_freeDStream (dstream);
+  return &state->status;
+}
+
+#endif /* PARALLEL_ZSTDCAT */
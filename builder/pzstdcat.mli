@@ -0,0 +1,34 @@
+(* virt-builder
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *)
+
+(** {1 Parallel zstdcat (or fall back to regular zstdcat).}
+
+    Zstandard files made of several frames, such as those written by
+    [pzstd] or in the seekable format, can be uncompressed in
+    parallel since each frame is independent. *)
+
+val pzstdcat : string -> string -> unit
+    (** [pzstdcat input output] uncompresses the file [input] to the
+        file [output].  The input and output must both be seekable.
+
+        If libzstd was found at compile time, this uses an internal
+        implementation which uncompresses the frames in parallel.
+        Otherwise regular zstdcat is used. *)
+
+val using_parallel_zstdcat : unit -> bool
+(** Returns [true] iff the implementation uses parallel zstdcat. *)
@@ -33,7 +33,10 @@ let get_index ~downloader ~sigchecker
 
   let uri = ensure_trailing_slash uri in
 
-  let download_and_parse uri =
+  (* The files can be large (Ubuntu's is tens of MB), so only the
+   * values at [paths] are kept.
+   *)
+  let download_and_parse ~paths uri =
     let tmpfile, _ = Downloader.download downloader ~proxy uri in
     let file =
       if Sigchecker.verifying_signatures sigchecker then (
@@ -44,7 +47,7 @@ let get_index ~downloader ~sigchecker
         | Some f -> f
       ) else
         tmpfile in
-    yajl_tree_parse (read_whole_file file) in
+    yajl_parse_file ~paths file in
 
   let downloads =
     let uri_index =
@@ -52,7 +55,13 @@ let get_index ~downloader ~sigchecker
         uri ^ "streams/v1/index.sjson"
       else
         uri ^ "streams/v1/index.json" in
-    let tree = download_and_parse uri_index in
+    let tree =
+      download_and_parse
+        ~paths:[["format"];
+                ["index"; "*"; "format"];
+                ["index"; "*"; "datatype"];
+                ["index"; "*"; "path"]]
+        uri_index in
 
     let format = object_get_string "format" tree in
     if format <> "index:1.0" then
@@ -71,7 +80,15 @@ let get_index ~downloader ~sigchecker
     ) index in
 
   let scan_product_list path =
-    let tree = download_and_parse (uri ^ path) in
+    let tree =
+      download_and_parse
+        ~paths:[["format"];
+                ["products"; "*"; "arch"];
+                ["products"; "*"; "pubname"];
+                ["products"; "*"; "versions"; "*"; "pubname"];
+                ["products"; "*"; "versions"; "*"; "items"; "disk.img"];
+                ["products"; "*"; "versions"; "*"; "items"; "disk1.img"]]
+        (uri ^ path) in
 
     let format = object_get_string "format" tree in
     if format <> "products:1.0" then
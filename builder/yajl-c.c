@@ -23,10 +23,15 @@
 #include <caml/memory.h>
 #include <caml/mlvalues.h>
 
+#include <yajl/yajl_parse.h>
 #include <yajl/yajl_tree.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 
 /* GCC can't work out that the YAJL_IS_<foo> test is sufficient to
  * ensure that YAJL_GET_<foo> later doesn't return NULL.
@@ -35,9 +40,17 @@
 #pragma GCC diagnostic ignored "-Wnull-dereference"
 #endif
 
+#ifdef HAVE_CAML_UNIXSUPPORT_H
+#include <caml/unixsupport.h>
+#else
+#define Nothing ((value) 0)
+extern void unix_error (int errcode, char * cmdname, value arg) Noreturn;
+#endif
+
 #define Val_none (Val_int (0))
 
 value virt_builder_yajl_tree_parse (value stringv);
+value virt_builder_yajl_parse_file (value pathsv, value filenamev);
 
 static value
 convert_yajl_value (yajl_val val, int level)
@@ -119,3 +132,427 @@ virt_builder_yajl_tree_parse (value stringv)
 
   CAMLreturn (rv);
 }
+
+/* Parse a JSON file, keeping only some of the values.
+ *
+ * This uses the callback API of yajl, so the file is read in blocks
+ * and the values which are not kept are never stored.  The values
+ * kept are built as a yajl_val tree, the same as yajl_tree_parse
+ * builds, which is then converted by convert_yajl_value.
+ */
+
+/* Deeper trees are rejected by convert_yajl_value anyway. */
+#define MAX_DEPTH 21
+
+enum match { MATCH_NONE, MATCH_PARTIAL, MATCH_FULL };
+
+struct frame {
+  yajl_val node;                /* object or array */
+  const char *key;              /* key of node in its parent, or NULL */
+  int keep_all;                 /* the whole of node is kept */
+};
+
+struct parser {
+  char ***paths;                /* NULL-terminated list of paths */
+  yajl_val root;
+  struct frame stack[MAX_DEPTH];
+  size_t depth;
+  size_t skip_depth;            /* > 0 inside a container not kept */
+  char *key;                    /* last key seen in the current object */
+  int too_deep;
+};
+
+/* Does the path of a new value, which is the keys of the containers
+ * on the stack followed by 'key', match one of the paths?  A "*" in
+ * a path matches any key and any array element.
+ */
+static enum match
+match_path (struct parser *p, const char *key)
+{
+  enum match ret = MATCH_NONE;
+  size_t i, j;
+
+  if (p->depth == 0)
+    return MATCH_PARTIAL;
+  if (p->stack[p->depth-1].keep_all)
+    return MATCH_FULL;
+
+  for (i = 0; p->paths[i] != NULL; ++i) {
+    char **path = p->paths[i];
+
+    for (j = 0; j < p->depth && path[j] != NULL; ++j) {
+      const char *k = j < p->depth-1 ? p->stack[j+1].key : key;
+
+      if (strcmp (path[j], "*") != 0 && (k == NULL || strcmp (path[j], k) != 0))
+        break;
+    }
+    if (j == p->depth || path[j] == NULL) {
+      if (path[j] == NULL)
+        return MATCH_FULL;
+      ret = MATCH_PARTIAL;
+    }
+  }
+
+  return ret;
+}
+
+static yajl_val
+new_value (yajl_type type)
+{
+  yajl_val v = calloc (1, sizeof *v);
+
+  if (v)
+    v->type = type;
+  return v;
+}
+
+/* Add the value to the current container, or make it the root. */
+static int
+add_value (struct parser *p, yajl_val v)
+{
+  yajl_val parent;
+
+  if (p->depth == 0) {
+    p->root = v;
+    return 1;
+  }
+
+  parent = p->stack[p->depth-1].node;
+  if (YAJL_IS_OBJECT (parent)) {
+    const size_t len = parent->u.object.len;
+    const char **keys;
+    yajl_val *values;
+
+    keys = realloc (parent->u.object.keys, (len+1) * sizeof (char *));
+    if (keys == NULL)
+      return 0;
+    parent->u.object.keys = keys;
+    values = realloc (parent->u.object.values, (len+1) * sizeof (yajl_val));
+    if (values == NULL)
+      return 0;
+    parent->u.object.values = values;
+    keys[len] = p->key;
+    values[len] = v;
+    parent->u.object.len++;
+    p->key = NULL;
+  }
+  else {
+    const size_t len = parent->u.array.len;
+    yajl_val *values;
+
+    values = realloc (parent->u.array.values, (len+1) * sizeof (yajl_val));
+    if (values == NULL)
+      return 0;
+    parent->u.array.values = values;
+    values[len] = v;
+    parent->u.array.len++;
+  }
+
+  return 1;
+}
+
+/* Is the next scalar value kept?  If not, forget its key. */
+static int
+keep_scalar (struct parser *p)
+{
+  if (p->skip_depth > 0)
+    return 0;
+  if (match_path (p, p->key) == MATCH_NONE) {
+    free (p->key);
+    p->key = NULL;
+    return 0;
+  }
+  return 1;
+}
+
+static int
+add_scalar (struct parser *p, yajl_val v)
+{
+  if (v == NULL)
+    return 0;
+  if (!add_value (p, v)) {
+    yajl_tree_free (v);
+    return 0;
+  }
+  return 1;
+}
+
+static int
+start_container (struct parser *p, yajl_type type)
+{
+  enum match m;
+  yajl_val v;
+
+  if (p->skip_depth > 0) {
+    p->skip_depth++;
+    return 1;
+  }
+  m = match_path (p, p->key);
+  if (m == MATCH_NONE) {
+    free (p->key);
+    p->key = NULL;
+    p->skip_depth = 1;
+    return 1;
+  }
+
+  if (p->depth >= MAX_DEPTH) {
+    p->too_deep = 1;
+    return 0;
+  }
+  v = new_value (type);
+  if (v == NULL)
+    return 0;
+  if (!add_value (p, v)) {
+    yajl_tree_free (v);
+    return 0;
+  }
+
+  p->stack[p->depth].node = v;
+  p->stack[p->depth].key =
+    p->depth > 0 && YAJL_IS_OBJECT (p->stack[p->depth-1].node) ?
+    p->stack[p->depth-1].node->u.object.keys[p->stack[p->depth-1].node->u.object.len-1] :
+    NULL;
+  p->stack[p->depth].keep_all = m == MATCH_FULL;
+  p->depth++;
+  return 1;
+}
+
+static int
+end_container (struct parser *p)
+{
+  if (p->skip_depth > 0)
+    p->skip_depth--;
+  else
+    p->depth--;
+  return 1;
+}
+
+static int
+handle_null (void *ctx)
+{
+  if (!keep_scalar (ctx))
+    return 1;
+  return add_scalar (ctx, new_value (yajl_t_null));
+}
+
+static int
+handle_boolean (void *ctx, int b)
+{
+  if (!keep_scalar (ctx))
+    return 1;
+  return add_scalar (ctx, new_value (b ? yajl_t_true : yajl_t_false));
+}
+
+/* Numbers are parsed as yajl_tree_parse does. */
+static int
+handle_number (void *ctx, const char *s, size_t len)
+{
+  struct parser *p = ctx;
+  yajl_val v;
+  char *end;
+
+  if (!keep_scalar (p))
+    return 1;
+
+  v = new_value (yajl_t_number);
+  if (v == NULL)
+    return 0;
+  v->u.number.r = strndup (s, len);
+  if (v->u.number.r == NULL) {
+    free (v);
+    return 0;
+  }
+  errno = 0;
+  v->u.number.i = strtoll (v->u.number.r, &end, 10);
+  if (errno == 0 && *end == '\0')
+    v->u.number.flags |= YAJL_NUMBER_INT_VALID;
+  errno = 0;
+  v->u.number.d = strtod (v->u.number.r, &end);
+  if (errno == 0 && *end == '\0')
+    v->u.number.flags |= YAJL_NUMBER_DOUBLE_VALID;
+
+  return add_scalar (p, v);
+}
+
+static int
+handle_string (void *ctx, const unsigned char *s, size_t len)
+{
+  struct parser *p = ctx;
+  yajl_val v;
+
+  if (!keep_scalar (p))
+    return 1;
+
+  v = new_value (yajl_t_string);
+  if (v == NULL)
+    return 0;
+  v->u.string = strndup ((const char *) s, len);
+  if (v->u.string == NULL) {
+    free (v);
+    return 0;
+  }
+
+  return add_scalar (p, v);
+}
+
+static int
+handle_start_map (void *ctx)
+{
+  return start_container (ctx, yajl_t_object);
+}
+
+static int
+handle_map_key (void *ctx, const unsigned char *s, size_t len)
+{
+  struct parser *p = ctx;
+
+  if (p->skip_depth > 0)
+    return 1;
+  free (p->key);
+  p->key = strndup ((const char *) s, len);
+  return p->key != NULL;
+}
+
+static int
+handle_end_container (void *ctx)
+{
+  return end_container (ctx);
+}
+
+static int
+handle_start_array (void *ctx)
+{
+  return start_container (ctx, yajl_t_array);
+}
+
+static const yajl_callbacks callbacks = {
+  .yajl_null = handle_null,
+  .yajl_boolean = handle_boolean,
+  .yajl_number = handle_number,
+  .yajl_string = handle_string,
+  .yajl_start_map = handle_start_map,
+  .yajl_map_key = handle_map_key,
+  .yajl_end_map = handle_end_container,
+  .yajl_start_array = handle_start_array,
+  .yajl_end_array = handle_end_container,
+};
+
+static void
+free_paths (char ***paths)
+{
+  size_t i, j;
+
+  if (paths == NULL)
+    return;
+  for (i = 0; paths[i] != NULL; ++i) {
+    for (j = 0; paths[i][j] != NULL; ++j)
+      free (paths[i][j]);
+    free (paths[i]);
+  }
+  free (paths);
+}
+
+/* Copy the OCaml string list list. */
+static char ***
+copy_paths (value pathsv)
+{
+  char ***paths;
+  value v, w;
+  size_t i, j, n;
+
+  for (n = 0, v = pathsv; v != Val_emptylist; v = Field (v, 1))
+    n++;
+  paths = calloc (n+1, sizeof (char **));
+  if (paths == NULL)
+    return NULL;
+
+  for (i = 0, v = pathsv; v != Val_emptylist; i++, v = Field (v, 1)) {
+    for (n = 0, w = Field (v, 0); w != Val_emptylist; w = Field (w, 1))
+      n++;
+    paths[i] = calloc (n+1, sizeof (char *));
+    if (paths[i] == NULL)
+      goto error;
+    for (j = 0, w = Field (v, 0); w != Val_emptylist; j++, w = Field (w, 1)) {
+      paths[i][j] = strdup (String_val (Field (w, 0)));
+      if (paths[i][j] == NULL)
+        goto error;
+    }
+  }
+
+  return paths;
+
+ error:
+  free_paths (paths);
+  return NULL;
+}
+
+value
+virt_builder_yajl_parse_file (value pathsv, value filenamev)
+{
+  CAMLparam2 (pathsv, filenamev);
+  CAMLlocal1 (rv);
+  struct parser p = { .root = NULL };
+  yajl_handle h;
+  yajl_status status;
+  int fd;
+  ssize_t r;
+  unsigned char buf[65536];
+  char msg[256] = "";
+
+  fd = open (String_val (filenamev), O_RDONLY|O_CLOEXEC);
+  if (fd == -1)
+    unix_error (errno, (char *) "open", filenamev);
+
+  p.paths = copy_paths (pathsv);
+  h = yajl_alloc (&callbacks, NULL, &p);
+  if (p.paths == NULL || h == NULL) {
+    close (fd);
+    free_paths (p.paths);
+    if (h)
+      yajl_free (h);
+    caml_raise_out_of_memory ();
+  }
+  yajl_config (h, yajl_allow_comments, 1);
+
+  do {
+    r = read (fd, buf, sizeof buf);
+    if (r == -1) {
+      const int saved_errno = errno;
+      close (fd);
+      yajl_free (h);
+      free_paths (p.paths);
+      free (p.key);
+      yajl_tree_free (p.root);
+      unix_error (saved_errno, (char *) "read", filenamev);
+    }
+    status = r > 0 ? yajl_parse (h, buf, r) : yajl_complete_parse (h);
+  } while (r > 0 && status == yajl_status_ok);
+  close (fd);
+
+  if (status != yajl_status_ok && !p.too_deep) {
+    unsigned char *err = yajl_get_error (h, 0, NULL, 0);
+
+    if (err && strlen ((char *) err) > 0)
+      snprintf (msg, sizeof msg, "JSON parse error: %s", err);
+    else
+      snprintf (msg, sizeof msg, "unknown JSON parse error");
+    yajl_free_error (h, err);
+  }
+  yajl_free (h);
+  free_paths (p.paths);
+  free (p.key);
+
+  if (status != yajl_status_ok) {
+    yajl_tree_free (p.root);
+    if (p.too_deep)
+      caml_invalid_argument ("too many levels of object/array nesting");
+    caml_invalid_argument (msg);
+  }
+
+  if (p.root == NULL)
+    caml_invalid_argument ("unknown JSON parse error");
+  rv = convert_yajl_value (p.root, 1);
+  yajl_tree_free (p.root);
+
+  CAMLreturn (rv);
+}
@@ -29,6 +29,8 @@ type yajl_val =
 | Yajl_bool of bool
 
 external yajl_tree_parse : string -> yajl_val = "virt_builder_yajl_tree_parse"
+external yajl_parse_file : paths:string list list -> string -> yajl_val
+  = "virt_builder_yajl_parse_file"
 
 let object_find_optional key = function
   | Yajl_object o ->
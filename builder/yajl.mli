@@ -28,6 +28,17 @@ type yajl_val =
 val yajl_tree_parse : string -> yajl_val
 (** Parse the JSON string. *)
 
+val yajl_parse_file : paths:string list list -> string -> yajl_val
+(** [yajl_parse_file ~paths filename] parses the JSON file, keeping
+    only the values found at one of the [paths] (with everything
+    below them), and the objects and arrays containing them.  A path
+    is the list of keys from the top of the document, where ["*"]
+    matches any key or array element.
+
+    The file is parsed as it is read, and the values which are not
+    kept are never stored, so this needs little memory even for very
+    large files. *)
+
 val object_get_string : string -> yajl_val -> string
 (** [object_get_string key yv] gets the value of the [key] field as a string
     in the [yv] structure *)
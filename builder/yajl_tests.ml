@@ -124,6 +124,37 @@ let test_tree_parse_inspect ctx =
   assert_equal_string "second" (fst (l.(1)));
   assert_is_number 2_L (snd (l.(1)))
 
+let test_parse_file ctx =
+  let filename, chan = bracket_tmpfile ctx in
+  output_string chan "{\"format\": \"products:1.0\",
+    \"products\": {
+      \"a\": {\"arch\": \"x86_64\", \"big\": [1, 2, {\"x\": 3}],
+              \"items\": {\"disk.img\": {\"size\": 10, \"path\": \"p\"},
+                          \"root.tar.xz\": {\"size\": 20}}}}}";
+  close_out chan;
+
+  let value =
+    yajl_parse_file
+      ~paths:[["format"]; ["products"; "*"; "arch"];
+              ["products"; "*"; "items"; "disk.img"]] filename in
+  let l = get_object_list value in
+  assert_equal_int 2 (Array.length l);
+  assert_equal_string "format" (fst (l.(0)));
+  assert_is_string "products:1.0" (snd (l.(0)));
+  let l = get_object_list (snd (l.(1))) in
+  assert_equal_int 1 (Array.length l);
+  let l = get_object_list (snd (l.(0))) in
+  assert_equal_int 2 (Array.length l);
+  assert_equal_string "arch" (fst (l.(0)));
+  assert_equal_string "items" (fst (l.(1)));
+  let l = get_object_list (snd (l.(1))) in
+  assert_equal_int 1 (Array.length l);
+  assert_equal_string "disk.img" (fst (l.(0)));
+  let l = get_object_list (snd (l.(0))) in
+  assert_equal_int 2 (Array.length l);
+  assert_is_number 10_L (snd (l.(0)));
+  assert_is_string "p" (snd (l.(1)))
+
 (* Suites declaration. *)
 let suite =
   "builder Yajl" >:::
@@ -131,6 +162,7 @@ let suite =
       "tree_parse.invalid" >:: test_tree_parse_invalid;
       "tree_parse.basic" >:: test_tree_parse_basic;
       "tree_parse.inspect" >:: test_tree_parse_inspect;
+      "parse_file" >:: test_parse_file;
     ]
 
 let () =
@@ -117,6 +117,7 @@ usage (int status)
               "  --parts|--partitions Display partitions\n"
               "  --pvs|--physvols|--physical-volumes\n"
               "                       Display LVM physical volumes\n"
+              "  --sizing type        Size the appliance automatically\n"
               "  --uuid|--uuids       Add UUIDs to --long output\n"
               "  -v|--verbose         Verbose messages\n"
               "  -V|--version         Display version and exit\n"
@@ -167,6 +168,7 @@ main (int argc, char *argv[])
     { "physvols", 0, 0, 0 },
     { "pvs", 0, 0, 0 },
     { "short-options", 0, 0, 0 },
+    { "sizing", 1, 0, 0 },
     { "uuid", 0, 0, 0 },
     { "uuids", 0, 0, 0 },
     { "verbose", 0, 0, 'v' },
@@ -206,6 +208,8 @@ main (int argc, char *argv[])
         echo_keys = 1;
       } else if (STREQ (long_options[option_index].name, "format")) {
         OPTION_format;
+      } else if (STREQ (long_options[option_index].name, "sizing")) {
+        OPTION_sizing;
       } else if (STREQ (long_options[option_index].name, "all")) {
         output = OUTPUT_ALL;
       } else if (STREQ (long_options[option_index].name, "blkdevs") ||
@@ -363,6 +367,7 @@ main (int argc, char *argv[])
   exit (EXIT_SUCCESS);
 }
 
+static int do_output_storage (void);
 static void do_output_filesystems (void);
 static void do_output_lvs (void);
 static void do_output_vgs (void);
@@ -409,6 +414,12 @@ do_output_title (void)
 static void
 do_output (void)
 {
+  /* Get everything in one call if possible, otherwise fall back to
+   * the calls for each device.
+   */
+  if (do_output_storage () == 0)
+    return;
+
   /* The ordering here is trying to be most specific -> least specific,
    * although that is not required or guaranteed.
    */
@@ -431,6 +442,131 @@ do_output (void)
     do_output_blockdevs ();
 }
 
+/* Return the canonical names of the space-separated list of devices
+ * in 'parents'.  Note this must be freed.
+ */
+static char **
+canonical_parents (const char *parents)
+{
+  char **ret;
+  size_t i;
+
+  ret = guestfs_int_split_string (' ', parents);
+  if (!ret)
+    error (EXIT_FAILURE, errno, "malloc");
+
+  for (i = 0; ret[i] != NULL; ++i) {
+    char *dev = guestfs_canonical_device_name (g, ret[i]);
+    if (!dev)
+      exit (EXIT_FAILURE);
+    free (ret[i]);
+    ret[i] = dev;
+  }
+
+  return ret;
+}
+
+/* The LVM UUIDs of VGs and PVs are shown without the '-' characters,
+ * as guestfs_vgs_full and guestfs_pvs_full return them.
+ */
+static void
+strip_uuid (char *uuid, const char *lvm_uuid)
+{
+  size_t i;
+
+  for (i = 0; *lvm_uuid && i < 32; ++lvm_uuid) {
+    if (*lvm_uuid != '-')
+      uuid[i++] = *lvm_uuid;
+  }
+  uuid[i] = '\0';
+}
+
+static void
+write_storage_entry (const struct guestfs_storage_entry *e)
+{
+  CLEANUP_FREE char *dev = NULL;
+  CLEANUP_FREE_STRING_LIST char **parents = NULL;
+  char uuid[33];
+
+  if (STREQ (e->se_type, "filesystem")) {
+    /* Skip swap and unknown, unless --extra flag was given. */
+    if (!(output & OUTPUT_FILESYSTEMS_EXTRA) &&
+        (STREQ (e->se_vfs_type, "swap") || STREQ (e->se_vfs_type, "unknown")))
+      return;
+
+    dev = guestfs_canonical_device_name (g, e->se_name);
+    if (dev == NULL)
+      exit (EXIT_FAILURE);
+    parents = canonical_parents (e->se_parents);
+    write_row (dev, "filesystem",
+               e->se_vfs_type, e->se_vfs_label, -1, e->se_size, parents,
+               e->se_uuid);
+  }
+  else if (STREQ (e->se_type, "lv")) {
+    parents = canonical_parents (e->se_parents);
+    write_row (e->se_name, "lv",
+               NULL, NULL, -1, e->se_size, parents, e->se_uuid);
+  }
+  else if (STREQ (e->se_type, "vg") || STREQ (e->se_type, "pv")) {
+    dev = guestfs_canonical_device_name (g, e->se_name);
+    if (dev == NULL)
+      exit (EXIT_FAILURE);
+    parents = canonical_parents (e->se_parents);
+    strip_uuid (uuid, e->se_uuid);
+    write_row (dev, e->se_type,
+               NULL, NULL, -1, e->se_size, parents, uuid);
+  }
+  else if (STREQ (e->se_type, "partition") || STREQ (e->se_type, "device")) {
+    dev = guestfs_canonical_device_name (g, e->se_name);
+    if (dev == NULL)
+      exit (EXIT_FAILURE);
+    parents = canonical_parents (e->se_parents);
+    write_row (dev, e->se_type,
+               NULL, NULL, e->se_mbr_id, e->se_size, parents, NULL);
+  }
+}
+
+/* Write the rows using guestfs_list_storage, which returns all the
+ * attributes of everything in a single call.  Returns -1 without
+ * writing anything if the appliance could not list everything, for
+ * example because LVM is too old for guestfs_lvm_report.
+ */
+static int
+do_output_storage (void)
+{
+  static const struct {
+    int output;
+    const char *type;
+  } types[] = {
+    { OUTPUT_FILESYSTEMS, "filesystem" },
+    { OUTPUT_LVS, "lv" },
+    { OUTPUT_VGS, "vg" },
+    { OUTPUT_PVS, "pv" },
+    { OUTPUT_PARTITIONS, "partition" },
+    { OUTPUT_BLOCKDEVS, "device" },
+  };
+  CLEANUP_FREE_STORAGE_ENTRY_LIST struct guestfs_storage_entry_list *entries =
+    NULL;
+  size_t i, j;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  entries = guestfs_list_storage (g);
+  guestfs_pop_error_handler (g);
+  if (entries == NULL)
+    return -1;
+
+  for (i = 0; i < sizeof types / sizeof types[0]; ++i) {
+    if (!(output & types[i].output))
+      continue;
+    for (j = 0; j < entries->len; ++j) {
+      if (STREQ (entries->val[j].se_type, types[i].type))
+        write_storage_entry (&entries->val[j]);
+    }
+  }
+
+  return 0;
+}
+
 static void
 do_output_filesystems (void)
 {
@@ -31,6 +31,8 @@
 #include <assert.h>
 #include <time.h>
 #include <libintl.h>
+#include <limits.h>
+#include <pthread.h>
 #include <sys/sysmacros.h>
 
 #include "human.h"
@@ -108,6 +110,7 @@ usage (int status)
               "  -m|--mount dev[:mnt[:opts[:fstype]]]\n"
               "                       Mount dev on mnt (if omitted, /)\n"
               "  -R|--recursive       Recursive listing\n"
+              "  --sizing type        Size the appliance automatically\n"
               "  --times              Display file times\n"
               "  --time-days          Display file times as days before now\n"
               "  --time-relative      Display file times as seconds before now\n"
@@ -155,6 +158,7 @@ main (int argc, char *argv[])
     { "mount", 1, 0, 'm' },
     { "recursive", 0, 0, 'R' },
     { "short-options", 0, 0, 0 },
+    { "sizing", 1, 0, 0 },
     { "time", 0, 0, 0 },
     { "times", 0, 0, 0 },
     { "time-days", 0, 0, 0 },
@@ -200,6 +204,8 @@ main (int argc, char *argv[])
         echo_keys = 1;
       } else if (STREQ (long_options[option_index].name, "format")) {
         OPTION_format;
+      } else if (STREQ (long_options[option_index].name, "sizing")) {
+        OPTION_sizing;
       } else if (STREQ (long_options[option_index].name, "checksum") ||
                  STREQ (long_options[option_index].name, "checksums")) {
         if (!optarg || STREQ (optarg, ""))
@@ -430,27 +436,118 @@ do_ls_l (const char *dir)
   return 0;
 }
 
+/* The -R and -lR listings are streamed: the tree is written to a
+ * pipe by another thread, and each directory is printed as soon as
+ * it arrives, instead of after the whole tree has been fetched.
+ */
+struct fetch_tree_args {
+  const char *dir;
+  int xattrs;
+  int fd;                       /* write end of the pipe */
+  int r;
+};
+
+static void *
+fetch_tree (void *argsv)
+{
+  struct fetch_tree_args *args = argsv;
+  char dev_fd[64];
+
+  snprintf (dev_fd, sizeof dev_fd, "/dev/fd/%d", args->fd);
+  args->r = guestfs_internal_lstatns_tree (g, args->dir, INT_MAX,
+                                           args->xattrs, dev_fd);
+  close (args->fd);             /* the reader sees end of file */
+
+  return NULL;
+}
+
+/* Call 'f' on everything below 'dir' as the listing arrives.  The
+ * handle is busy until this returns, so 'f' must not use it.
+ */
 static int
-do_ls_R (const char *dir)
+stream_tree (const char *dir, int xattrs, visitor_link_function f)
 {
-  size_t i;
-  CLEANUP_FREE_STRING_LIST char **dirs = guestfs_find (g, dir);
+  struct fetch_tree_args args = { .dir = dir, .xattrs = xattrs };
+  pthread_t thread;
+  int fds[2], err, r;
+  char buf[BUFSIZ];
+  FILE *fp;
+
+  if (pipe2 (fds, O_CLOEXEC) == -1)
+    error (EXIT_FAILURE, errno, "pipe2");
+  fp = fdopen (fds[0], "r");
+  if (fp == NULL)
+    error (EXIT_FAILURE, errno, "fdopen");
+  args.fd = fds[1];
+
+  err = pthread_create (&thread, NULL, fetch_tree, &args);
+  if (err != 0)
+    error (EXIT_FAILURE, err, "pthread_create");
+
+  r = visit_records (fp, dir, xattrs, f, NULL);
+
+  /* Let the transfer finish even if the visitor stopped early. */
+  while (fread (buf, 1, sizeof buf, fp) > 0)
+    ;
+  fclose (fp);
+
+  err = pthread_join (thread, NULL);
+  if (err != 0)
+    error (EXIT_FAILURE, err, "pthread_join");
+
+  return args.r == -1 ? -1 : r;
+}
 
-  if (dirs == NULL)
-    return -1;
+/* Length of the prefix of the paths under 'dir' which is removed to
+ * make them relative, as guestfs_find returns them.
+ */
+static size_t top_len;
 
-  for (i = 0; dirs[i] != NULL; ++i)
-    puts (dirs[i]);
+static int
+print_relative_path (const char *dir, const char *name,
+                     const struct guestfs_statns *stat, const char *link,
+                     const struct guestfs_xattr_list *xattrs, void *unused)
+{
+  CLEANUP_FREE char *path = full_path (dir, name);
 
+  puts (&path[top_len]);
   return 0;
 }
 
+static int
+do_ls_R (const char *dir)
+{
+  CLEANUP_FREE char *top = full_path (dir, NULL);
+
+  top_len = strlen (top);
+  if (STRNEQ (top, "/"))
+    top_len++;
+
+  return stream_tree (dir, 0, print_relative_path);
+}
+
 static int show_file (const char *dir, const char *name, const struct guestfs_statns *stat, const struct guestfs_xattr_list *xattrs, void *unused);
+static int show_streamed_file (const char *dir, const char *name, const struct guestfs_statns *stat, const char *link, const struct guestfs_xattr_list *xattrs, void *unused);
 
 static int
 do_ls_lR (const char *dir)
 {
-  return visit (g, dir, show_file, NULL);
+  CLEANUP_FREE_STATNS struct guestfs_statns *stat = NULL;
+
+  /* Checksums are computed by calling the daemon for each file, which
+   * cannot be done while the tree is being streamed.
+   */
+  if (checksum)
+    return visit (g, dir, show_file, NULL);
+
+  /* The stream doesn't contain the top directory. */
+  stat = guestfs_lstatns (g, dir);
+  if (stat == NULL)
+    return -1;
+  if (show_file (dir, NULL, stat, NULL, NULL) == -1)
+    return -1;
+
+  return stream_tree (dir, 0, show_streamed_file);
 }
 
 /* This is the function which is called to display all files and
@@ -460,14 +557,42 @@ do_ls_lR (const char *dir)
  * need other things (eg. checksum) we may have to go back to the
  * appliance and then there can be a very large penalty.
  */
+static void show_entry (const char *dir, const char *name, const struct guestfs_statns *stat, const char *link);
+
 static int
 show_file (const char *dir, const char *name,
            const struct guestfs_statns *stat,
            const struct guestfs_xattr_list *xattrs,
            void *unused)
+{
+  CLEANUP_FREE char *path = NULL, *link = NULL;
+
+  if (is_lnk (stat->st_mode)) {
+    /* XXX Fix this for NTFS. */
+    path = full_path (dir, name);
+    link = guestfs_readlink (g, path);
+  }
+
+  show_entry (dir, name, stat, link);
+  return 0;
+}
+
+/* Called by stream_tree, which already has the target of links. */
+static int
+show_streamed_file (const char *dir, const char *name,
+                    const struct guestfs_statns *stat, const char *link,
+                    const struct guestfs_xattr_list *xattrs, void *unused)
+{
+  show_entry (dir, name, stat, link);
+  return 0;
+}
+
+static void
+show_entry (const char *dir, const char *name,
+            const struct guestfs_statns *stat, const char *link)
 {
   const char *filetype;
-  CLEANUP_FREE char *path = NULL, *csum = NULL, *link = NULL;
+  CLEANUP_FREE char *path = NULL, *csum = NULL;
 
   /* Display the basic fields. */
   output_start_line ();
@@ -533,15 +658,10 @@ show_file (const char *dir, const char *name,
 
   output_string (path);
 
-  if (is_lnk (stat->st_mode))
-    /* XXX Fix this for NTFS. */
-    link = guestfs_readlink (g, path);
   if (link)
     output_string_link (link);
 
   output_end_line ();
-
-  return 0;
 }
 
 /* Output functions.
@@ -30,9 +30,14 @@
 #include <locale.h>
 #include <assert.h>
 #include <libintl.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
 #include "getprogname.h"
 #include "ignore-value.h"
 
@@ -54,6 +59,9 @@ int inspector = 1;
 
 static int do_tail (int argc, char *argv[], struct drv *drvs, struct mp *mps);
 static time_t disk_mtime (struct drv *drvs);
+static int watch_disks (struct drv *drvs);
+static void drain_watch (int fd);
+static int wait_for_change (int fd);
 static int reopen_handle (void);
 
 static void __attribute__((noreturn))
@@ -79,6 +87,7 @@ usage (int status)
               "  --keys-from-stdin    Read passphrases from stdin\n"
               "  -m|--mount dev[:mnt[:opts[:fstype]]]\n"
               "                       Mount dev on mnt (if omitted, /)\n"
+              "  --sizing type        Size the appliance automatically\n"
               "  -v|--verbose         Verbose messages\n"
               "  -V|--version         Display version and exit\n"
               "  -x                   Trace libguestfs API calls\n"
@@ -111,6 +120,7 @@ main (int argc, char *argv[])
     { "long-options", 0, 0, 0 },
     { "mount", 1, 0, 'm' },
     { "short-options", 0, 0, 0 },
+    { "sizing", 1, 0, 0 },
     { "verbose", 0, 0, 'v' },
     { "version", 0, 0, 'V' },
     { 0, 0, 0, 0 }
@@ -145,6 +155,8 @@ main (int argc, char *argv[])
         echo_keys = 1;
       } else if (STREQ (long_options[option_index].name, "format")) {
         OPTION_format;
+      } else if (STREQ (long_options[option_index].name, "sizing")) {
+        OPTION_sizing;
       } else
         error (EXIT_FAILURE, 0,
                _("unknown long option: %s (%d)"),
@@ -249,6 +261,7 @@ do_tail (int argc, char *argv[], /* list of files in the guest */
   time_t drvt;
   int first_iteration = 1;
   int prev_file_displayed = -1;
+  int watch_fd;
   CLEANUP_FREE struct follow *file = NULL;
 
   /* Allocate storage to track each file. */
@@ -268,6 +281,8 @@ do_tail (int argc, char *argv[], /* list of files in the guest */
   if (drvt == (time_t)-1)
     return -1;
 
+  watch_fd = watch_disks (drvs);
+
   while (!quit) {
     time_t t;
     int i;
@@ -276,6 +291,10 @@ do_tail (int argc, char *argv[], /* list of files in the guest */
     CLEANUP_FREE_STRING_LIST char **roots = NULL;
     int processed;
 
+    /* Forget about changes made before the appliance sees the disk. */
+    if (watch_fd >= 0)
+      drain_watch (watch_fd);
+
     /* Add drives, inspect and mount. */
     add_drives (drvs, 'a');
 
@@ -418,16 +437,25 @@ do_tail (int argc, char *argv[], /* list of files in the guest */
      * the drive changes, always wait min. 30 seconds.  For libvirt
      * (-d) and remote sources we cannot check this so we have to use
      * a fixed (5 minute) delay instead.  Also we recheck every so
-     * often even if nothing seems to have changed.  (XXX Can we do
-     * better?)
+     * often even if nothing seems to have changed.
+     *
+     * Local disks are watched with inotify, so we only wake up when
+     * the guest writes to them.  The appliance works on a snapshot of
+     * the disk, so a change is only visible after relaunching it.
      */
-    for (i = 0; i < 10 /* 30 seconds * 10 = 5 mins */; ++i) {
-      time (&t);
-      sleep (30);
-      drvt = disk_mtime (drvs);
-      if (drvt == (time_t)-1)
+    if (watch_fd >= 0) {
+      if (wait_for_change (watch_fd) == -1)
         return -1;
-      if (drvt-t < 30) break;
+    }
+    else {
+      for (i = 0; i < 10 /* 30 seconds * 10 = 5 mins */; ++i) {
+        time (&t);
+        sleep (30);
+        drvt = disk_mtime (drvs);
+        if (drvt == (time_t)-1)
+          return -1;
+        if (drvt-t < 30) break;
+      }
     }
 
     if (reopen_handle () == -1)
@@ -472,6 +500,78 @@ disk_mtime (struct drv *drvs)
   return ret;
 }
 
+/* Watch the local drives passed on the command line for writes.
+ * Returns the inotify file descriptor, or -1 if the drives cannot be
+ * watched (eg. the guest is libvirt or remote, or inotify is not
+ * available), in which case the caller has to poll.
+ */
+static int
+watch_disks (struct drv *drvs)
+{
+#if defined(HAVE_SYS_INOTIFY_H) && defined(HAVE_INOTIFY_INIT1)
+  struct drv *drv;
+  int fd;
+
+  for (drv = drvs; drv != NULL; drv = drv->next)
+    if (drv->type != drv_a)
+      return -1;
+
+  fd = inotify_init1 (IN_NONBLOCK|IN_CLOEXEC);
+  if (fd == -1) {
+    if (verbose)
+      perror ("inotify_init1");
+    return -1;
+  }
+
+  for (drv = drvs; drv != NULL; drv = drv->next) {
+    if (inotify_add_watch (fd, drv->a.filename,
+                           IN_MODIFY|IN_CLOSE_WRITE|IN_ATTRIB) == -1) {
+      if (verbose)
+        fprintf (stderr, "inotify_add_watch: %s: %m\n", drv->a.filename);
+      close (fd);
+      return -1;
+    }
+  }
+
+  return fd;
+#else
+  return -1;
+#endif
+}
+
+/* Discard any pending events. */
+static void
+drain_watch (int fd)
+{
+  char buf[4096];
+
+  while (read (fd, buf, sizeof buf) > 0)
+    ;
+}
+
+/* Wait until one of the watched drives has been written to, but
+ * never less than 30 seconds or more than 5 minutes.  Returns 0, or
+ * -1 on error.
+ */
+static int
+wait_for_change (int fd)
+{
+  struct pollfd pfd = { .fd = fd, .events = POLLIN };
+  int r;
+
+  sleep (30);
+  if (quit)
+    return 0;
+
+  r = poll (&pfd, 1, (5 * 60 - 30) * 1000);
+  if (r == -1 && errno != EINTR) {
+    perror ("poll");
+    return -1;
+  }
+
+  return 0;
+}
+
 /* Reopen the handle.  Open the new handle first and copy some
  * settings across.  We only need to copy settings which are set
  * somewhere in the code above, eg by OPTION_v.  Settings from
@@ -494,6 +594,7 @@ reopen_handle (void)
   guestfs_set_verbose (g2, guestfs_get_verbose (g));
   guestfs_set_trace (g2, guestfs_get_trace (g));
   guestfs_set_pgroup (g2, guestfs_get_pgroup (g));
+  guestfs_set_sizing (g2, guestfs_get_sizing (g));
 
   guestfs_close (g);
   g = g2;
@@ -17,9 +17,14 @@
  */
 
 /**
- * This file contains a recursive function for visiting all files and
+ * This file contains a function for visiting all files and
  * directories in a guestfs filesystem.
  *
+ * The whole tree is fetched from the daemon in one call, as a stream
+ * of records written by C<guestfs_internal_lstatns_tree> (the format
+ * is described in F<generator/actions.ml>), rather than listing each
+ * directory separately.
+ *
  * Adapted from
  * L<https://rwmj.wordpress.com/2010/12/15/tip-audit-virtual-machine-for-setuid-files/>
  */
@@ -29,9 +34,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <limits.h>
 #include <errno.h>
-#include <assert.h>
 #include <libintl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <rpc/types.h>
+#include <rpc/xdr.h>
 
 #include "getprogname.h"
 
@@ -40,7 +50,42 @@
 
 #include "visit.h"
 
-static int _visit (guestfs_h *g, int depth, const char *dir, visitor_function f, void *opaque);
+/* Reads the records.  'mark' is the name of the next directory
+ * listing in the stream, which has been read already, or NULL at the
+ * end.
+ */
+struct tree_reader {
+  XDR xdr;
+  FILE *fp;
+  int xattrs;                   /* records contain the xattrs */
+  char *mark;
+};
+
+/* A directory entry read from the stream. */
+struct tree_entry {
+  char *name;                   /* relative to the top of the tree */
+  struct guestfs_statns stat;
+  char *link;                   /* "" if not a symbolic link */
+  struct guestfs_xattr_list *xattrs;
+};
+
+/* visit passes the entries to a visitor_function through this. */
+struct visit_args {
+  visitor_function f;
+  void *opaque;
+};
+
+static int visit_dir (struct tree_reader *r, const char *dir, visitor_link_function f, void *opaque);
+
+static int
+call_visitor (const char *dir, const char *name,
+              const struct guestfs_statns *stat, const char *link,
+              const struct guestfs_xattr_list *xattrs, void *opaque)
+{
+  struct visit_args *args = opaque;
+
+  return args->f (dir, name, stat, xattrs, args->opaque);
+}
 
 /**
  * Visit every file and directory in a guestfs filesystem, starting
@@ -68,103 +113,292 @@ static int _visit (guestfs_h *g, int depth, const char *dir, visitor_function f,
 int
 visit (guestfs_h *g, const char *dir, visitor_function f, void *opaque)
 {
-  return _visit (g, 0, dir, f, opaque);
+  CLEANUP_FREE_STATNS struct guestfs_statns *stat = NULL;
+  CLEANUP_FREE_XATTR_LIST struct guestfs_xattr_list *xattrs = NULL;
+  CLEANUP_FREE char *tmpdir = NULL, *tmpfile = NULL;
+  struct visit_args args = { .f = f, .opaque = opaque };
+  FILE *fp;
+  int fd, ret;
+
+  /* Call 'f' with the top directory.  Note that the stream does not
+   * contain it, so we have to have a special case.
+   */
+  stat = guestfs_lstatns (g, dir);
+  if (stat == NULL)
+    return -1;
+
+  xattrs = guestfs_lgetxattrs (g, dir);
+  if (xattrs == NULL)
+    return -1;
+
+  if (f (dir, NULL, stat, xattrs, opaque) == -1)
+    return -1;
+
+  /* Fetch the tree into a temporary file. */
+  tmpdir = guestfs_get_tmpdir (g);
+  if (tmpdir == NULL)
+    return -1;
+  if (asprintf (&tmpfile, "%s/visitXXXXXX", tmpdir) == -1) {
+    perror ("asprintf");
+    return -1;
+  }
+  fd = mkstemp (tmpfile);
+  if (fd == -1) {
+    perror (tmpfile);
+    return -1;
+  }
+  close (fd);
+
+  if (guestfs_internal_lstatns_tree (g, dir, INT_MAX, 1, tmpfile) == -1) {
+    unlink (tmpfile);
+    return -1;
+  }
+
+  fp = fopen (tmpfile, "r");
+  unlink (tmpfile);
+  if (fp == NULL) {
+    perror (tmpfile);
+    return -1;
+  }
+
+  ret = visit_records (fp, dir, 1, call_visitor, &args);
+  fclose (fp);
+  return ret;
 }
 
+/* Return true at the end of the stream. */
 static int
-_visit (guestfs_h *g, int depth, const char *dir,
-        visitor_function f, void *opaque)
+at_end (struct tree_reader *r)
 {
-  /* Call 'f' with the top directory.  Note that ordinary recursive
-   * visits will not otherwise do this, so we have to have a special
-   * case.
-   */
-  if (depth == 0) {
-    CLEANUP_FREE_STATNS struct guestfs_statns *stat = NULL;
-    CLEANUP_FREE_XATTR_LIST struct guestfs_xattr_list *xattrs = NULL;
-    int r;
+  int c;
 
-    stat = guestfs_lstatns (g, dir);
-    if (stat == NULL)
-      return -1;
+  c = getc (r->fp);
+  if (c == EOF)
+    return 1;
+  ungetc (c, r->fp);
+  return 0;
+}
 
-    xattrs = guestfs_lgetxattrs (g, dir);
-    if (xattrs == NULL)
-      return -1;
+/**
+ * Call C<f> on every file and directory below C<dir>, reading the
+ * records written by C<guestfs_internal_lstatns_tree> from C<fp> as
+ * they arrive.  C<xattrs> must be the same as the C<xattrs> flag of
+ * that call.  If it is false, C<f> is passed C<NULL> as the list of
+ * extended attributes.  C<f> is also passed the target of symbolic
+ * links, or C<NULL>.  Unlike C<visit>, C<f> is not called for
+ * C<dir> itself.
+ *
+ * This lets the caller run C<guestfs_internal_lstatns_tree> in
+ * another thread, writing to a pipe, so that the first entries are
+ * shown before the whole tree has been read.  The visitor function
+ * must not use the handle then.
+ *
+ * Returns C<0> if everything went OK, or C<-1> if there was an error.
+ */
+int
+visit_records (FILE *fp, const char *dir, int xattrs,
+               visitor_link_function f, void *opaque)
+{
+  struct tree_reader r = { .fp = fp, .xattrs = xattrs, .mark = NULL };
+  bool_t is_dir;
+  int ret = -1;
+
+  xdrstdio_create (&r.xdr, fp, XDR_DECODE);
+
+  /* The first record is the listing of the top directory. */
+  if (at_end (&r))
+    goto cannot_read;
+  if (!xdr_string (&r.xdr, &r.mark, ~0) || !xdr_bool (&r.xdr, &is_dir) ||
+      !is_dir || STRNEQ (r.mark, ""))
+    goto parse_error;
+  free (r.mark);
+  r.mark = NULL;
+
+  ret = visit_dir (&r, dir, f, opaque);
+  goto out;
+
+ cannot_read:
+  fprintf (stderr, _("%s: cannot read directory %s\n"), getprogname (), dir);
+  goto out;
+ parse_error:
+  fprintf (stderr, _("%s: error: cannot parse the listing of %s\n"),
+           getprogname (), dir);
+ out:
+  free (r.mark);
+  xdr_destroy (&r.xdr);
+  return ret;
+}
+
+static void
+free_tree_entries (struct tree_entry *entries, size_t nr_entries)
+{
+  size_t i;
 
-    r = f (dir, NULL, stat, xattrs, opaque);
+  for (i = 0; i < nr_entries; ++i) {
+    free (entries[i].name);
+    free (entries[i].link);
+    if (entries[i].xattrs)
+      guestfs_free_xattr_list (entries[i].xattrs);
+  }
+  free (entries);
+}
 
-    if (r == -1)
+/* Decode the XDR guestfs_int_statns into 'stat'.  The fields are all
+ * hypers, in the order of the public struct.
+ */
+static int
+read_statns (XDR *xdr, struct guestfs_statns *stat)
+{
+  int64_t *fields[] = {
+    &stat->st_dev, &stat->st_ino, &stat->st_mode, &stat->st_nlink,
+    &stat->st_uid, &stat->st_gid, &stat->st_rdev, &stat->st_size,
+    &stat->st_blksize, &stat->st_blocks,
+    &stat->st_atime_sec, &stat->st_atime_nsec,
+    &stat->st_mtime_sec, &stat->st_mtime_nsec,
+    &stat->st_ctime_sec, &stat->st_ctime_nsec,
+    &stat->st_spare1, &stat->st_spare2, &stat->st_spare3,
+    &stat->st_spare4, &stat->st_spare5, &stat->st_spare6,
+  };
+  size_t i;
+
+  for (i = 0; i < sizeof fields / sizeof fields[0]; ++i) {
+    if (!xdr_int64_t (xdr, fields[i]))
       return -1;
   }
+  return 0;
+}
 
-  size_t i, xattrp;
-  CLEANUP_FREE_STRING_LIST char **names = NULL;
-  CLEANUP_FREE_STAT_LIST struct guestfs_statns_list *stats = NULL;
-  CLEANUP_FREE_XATTR_LIST struct guestfs_xattr_list *xattrs = NULL;
+/* Decode the XDR guestfs_int_xattr_list into a new list. */
+static struct guestfs_xattr_list *
+read_xattrs (XDR *xdr)
+{
+  struct guestfs_xattr_list *xattrs;
+  u_int len, i;
 
-  names = guestfs_ls (g, dir);
-  if (names == NULL)
-    return -1;
+  if (!xdr_u_int (xdr, &len))
+    return NULL;
 
-  stats = guestfs_lstatnslist (g, dir, names);
-  if (stats == NULL)
-    return -1;
+  xattrs = malloc (sizeof *xattrs);
+  if (xattrs == NULL) {
+    perror ("malloc");
+    return NULL;
+  }
+  xattrs->len = 0;
+  xattrs->val = calloc (len, sizeof (struct guestfs_xattr));
+  if (len > 0 && xattrs->val == NULL) {
+    perror ("calloc");
+    free (xattrs);
+    return NULL;
+  }
 
-  xattrs = guestfs_lxattrlist (g, dir, names);
-  if (xattrs == NULL)
-    return -1;
+  for (i = 0; i < len; ++i) {
+    struct guestfs_xattr *x = &xattrs->val[i];
 
-  /* Call function on everything in this directory. */
-  for (i = 0, xattrp = 0; names[i] != NULL; ++i, ++xattrp) {
-    CLEANUP_FREE char *path = NULL;
-    CLEANUP_FREE char *attrval = NULL;
-    struct guestfs_xattr_list file_xattrs;
-    size_t nr_xattrs;
+    if (!xdr_string (xdr, &x->attrname, ~0))
+      goto error;
+    if (!xdr_bytes (xdr, &x->attrval, &x->attrval_len, ~0)) {
+      free (x->attrname);
+      goto error;
+    }
+    xattrs->len++;
+  }
 
-    assert (stats->len >= i);
-    assert (xattrs->len >= xattrp);
+  return xattrs;
 
-    /* Find the list of extended attributes for this file. */
-    assert (strlen (xattrs->val[xattrp].attrname) == 0);
+ error:
+  guestfs_free_xattr_list (xattrs);
+  return NULL;
+}
 
-    if (xattrs->val[xattrp].attrval_len == 0) {
-      fprintf (stderr, _("%s: error getting extended attrs for %s %s\n"),
-               getprogname (), dir, names[i]);
-      return -1;
+/* Read the listing of 'dir' up to the next mark, call 'f' on each
+ * entry, and visit the subdirectories, whose listings follow in the
+ * same order.
+ */
+static int
+visit_dir (struct tree_reader *r, const char *dir,
+           visitor_link_function f, void *opaque)
+{
+  struct tree_entry *entries = NULL;
+  size_t nr_entries = 0, i;
+  int ret = -1;
+
+  while (!at_end (r)) {
+    char *name = NULL;
+    struct tree_entry *p;
+    bool_t is_dir;
+
+    if (!xdr_string (&r->xdr, &name, ~0) || !xdr_bool (&r->xdr, &is_dir)) {
+      free (name);
+      goto parse_error;
     }
-    /* attrval is not \0-terminated. */
-    attrval = malloc (xattrs->val[xattrp].attrval_len + 1);
-    if (attrval == NULL) {
-      perror ("malloc");
-      return -1;
+    if (is_dir) {
+      r->mark = name;
+      break;
     }
-    memcpy (attrval, xattrs->val[xattrp].attrval,
-            xattrs->val[xattrp].attrval_len);
-    attrval[xattrs->val[xattrp].attrval_len] = '\0';
-    if (sscanf (attrval, "%zu", &nr_xattrs) != 1) {
-      fprintf (stderr, _("%s: error: cannot parse xattr count for %s %s\n"),
-               getprogname (), dir, names[i]);
-      return -1;
-    }
-
-    file_xattrs.len = nr_xattrs;
-    file_xattrs.val = &xattrs->val[xattrp+1];
-    xattrp += nr_xattrs;
 
-    /* Call the function. */
-    if (f (dir, names[i], &stats->val[i], &file_xattrs, opaque) == -1)
-      return -1;
+    p = realloc (entries, (nr_entries + 1) * sizeof *entries);
+    if (p == NULL) {
+      perror ("realloc");
+      free (name);
+      goto out;
+    }
+    entries = p;
+    entries[nr_entries].name = name;
+    entries[nr_entries].link = NULL;
+    entries[nr_entries].xattrs = NULL;
+    nr_entries++;
+
+    if (read_statns (&r->xdr, &entries[nr_entries-1].stat) == -1 ||
+        !xdr_string (&r->xdr, &entries[nr_entries-1].link, ~0))
+      goto parse_error;
+    if (r->xattrs) {
+      entries[nr_entries-1].xattrs = read_xattrs (&r->xdr);
+      if (entries[nr_entries-1].xattrs == NULL)
+        goto parse_error;
+    }
+  }
 
-    /* Recursively call visit, but only on directories. */
-    if (is_dir (stats->val[i].st_mode)) {
-      path = full_path (dir, names[i]);
-      if (_visit (g, depth + 1, path, f, opaque) == -1)
-        return -1;
+  /* Call function on everything in this directory. */
+  for (i = 0; i < nr_entries; ++i) {
+    const char *base = strrchr (entries[i].name, '/');
+    const char *link = entries[i].link;
+
+    base = base ? base + 1 : entries[i].name;
+    if (link && STREQ (link, ""))
+      link = NULL;
+
+    if (f (dir, base, &entries[i].stat, link, entries[i].xattrs,
+           opaque) == -1)
+      goto out;
+
+    /* Visit directories, which are the next listing in the stream
+     * unless the daemon could not read them.
+     */
+    if (is_dir (entries[i].stat.st_mode)) {
+      CLEANUP_FREE char *path = full_path (dir, base);
+
+      if (r->mark == NULL || STRNEQ (r->mark, entries[i].name)) {
+        fprintf (stderr, _("%s: cannot read directory %s\n"),
+                 getprogname (), path);
+        goto out;
+      }
+      free (r->mark);
+      r->mark = NULL;
+
+      if (visit_dir (r, path, f, opaque) == -1)
+        goto out;
     }
   }
 
-  return 0;
+  ret = 0;
+  goto out;
+
+ parse_error:
+  fprintf (stderr, _("%s: error: cannot parse the listing of %s\n"),
+           getprogname (), dir);
+ out:
+  free_tree_entries (entries, nr_entries);
+  return ret;
 }
 
 char *
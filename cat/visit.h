@@ -23,6 +23,10 @@ typedef int (*visitor_function) (const char *dir, const char *name, const struct
 
 extern int visit (guestfs_h *g, const char *dir, visitor_function f, void *opaque);
 
+typedef int (*visitor_link_function) (const char *dir, const char *name, const struct guestfs_statns *stat, const char *link, const struct guestfs_xattr_list *xattrs, void *opaque);
+
+extern int visit_records (FILE *fp, const char *dir, int xattrs, visitor_link_function f, void *opaque);
+
 extern char *full_path (const char *dir, const char *name);
 
 extern int is_reg (int64_t mode);
@@ -98,8 +98,52 @@ exec >>%s 2>&1
         error (f_"%s: command exited with an error") display
   in
 
+  (* --package-cache: the host directory, the guest's package cache
+   * directory and the command which empties it again.
+   *)
+  let package_cache =
+    match ops.flags.package_cache with
+    | None -> None
+    | Some dir ->
+      let cache =
+        match g#inspect_get_package_management root with
+        | "apt" -> Some ("/var/cache/apt/archives", "apt-get -q clean")
+        | "dnf" -> Some ("/var/cache/dnf", "dnf clean packages")
+        | "yum" -> Some ("/var/cache/yum", "yum clean packages")
+        | _ -> None in
+      match cache with
+      | None ->
+        warning (f_"--package-cache is not supported for the package manager of this guest, ignoring it");
+        None
+      | Some (guestdir, clean) ->
+        (* Packages can only be reused by the same release and arch. *)
+        let hostdir =
+          dir // sprintf "%s-%d.%d-%s"
+                         (g#inspect_get_distro root)
+                         (g#inspect_get_major_version root)
+                         (g#inspect_get_minor_version root)
+                         guest_arch in
+        Some (hostdir, guestdir, clean) in
+  let package_cache_used = ref false in
+
+  (* Copy the cached packages into the guest before the first
+   * installation.
+   *)
+  let use_package_cache () =
+    match package_cache with
+    | Some (hostdir, guestdir, _) when not !package_cache_used ->
+      package_cache_used := true;
+      let cached = hostdir // Filename.basename guestdir in
+      if is_directory cached then (
+        message (f_"Copying cached packages from %s") hostdir;
+        g#mkdir_p (Filename.dirname guestdir);
+        g#copy_in cached (Filename.dirname guestdir)
+      )
+    | _ -> ()
+  in
+
   (* http://distrowatch.com/dwres.php?resource=package-management *)
-  let rec guest_install_command packages =
+  let rec guest_install_command ?(cached = false) packages =
     let quoted_args = String.concat " " (List.map quote packages) in
     match g#inspect_get_package_management root with
     | "apk" ->
@@ -111,16 +155,16 @@ exec >>%s 2>&1
       (* http://unix.stackexchange.com/questions/22820 *)
       sprintf "
         export DEBIAN_FRONTEND=noninteractive
-        apt_opts='-q -y -o Dpkg::Options::=--force-confnew'
+        apt_opts='-q -y -o Dpkg::Options::=--force-confnew%s'
         apt-get $apt_opts update
         apt-get $apt_opts install %s
-      " quoted_args
-    | "dnf" ->    sprintf "dnf -y install %s" quoted_args
+      " (apt_keep_opt cached) quoted_args
+    | "dnf" ->    sprintf "dnf -y%s install %s" (yum_keep_opt cached) quoted_args
     | "pisi" ->   sprintf "pisi it %s" quoted_args
     | "pacman" -> sprintf "pacman -S --noconfirm %s" quoted_args
     | "urpmi" ->  sprintf "urpmi %s" quoted_args
     | "xbps" ->   sprintf "xbps-install -Sy %s" quoted_args
-    | "yum" ->    sprintf "yum -y install %s" quoted_args
+    | "yum" ->    sprintf "yum -y%s install %s" (yum_keep_opt cached) quoted_args
     | "zypper" -> sprintf "zypper -n in -l %s" quoted_args
 
     | "unknown" ->
@@ -128,7 +172,7 @@ exec >>%s 2>&1
     | pm ->
       error_unimplemented_package_manager (s_"--install") pm
 
-  and guest_update_command () =
+  and guest_update_command ?(cached = false) () =
     match g#inspect_get_package_management root with
     | "apk" ->
        "
@@ -137,18 +181,18 @@ exec >>%s 2>&1
        "
     | "apt" ->
       (* http://unix.stackexchange.com/questions/22820 *)
-      "
+      sprintf "
         export DEBIAN_FRONTEND=noninteractive
-        apt_opts='-q -y -o Dpkg::Options::=--force-confnew'
+        apt_opts='-q -y -o Dpkg::Options::=--force-confnew%s'
         apt-get $apt_opts update
         apt-get $apt_opts upgrade
-      "
-    | "dnf" ->    "dnf -y --best upgrade"
+      " (apt_keep_opt cached)
+    | "dnf" ->    sprintf "dnf -y%s --best upgrade" (yum_keep_opt cached)
     | "pisi" ->   "pisi upgrade"
     | "pacman" -> "pacman -Su"
     | "urpmi" ->  "urpmi --auto-select"
     | "xbps" ->   "xbps-install -Suy"
-    | "yum" ->    "yum -y update"
+    | "yum" ->    sprintf "yum -y%s update" (yum_keep_opt cached)
     | "zypper" -> "zypper -n update -l"
 
     | "unknown" ->
@@ -180,6 +224,14 @@ exec >>%s 2>&1
     | pm ->
       error_unimplemented_package_manager (s_"--uninstall") pm
 
+  (* Options which stop the package manager from deleting the
+   * packages it downloaded, so they can be saved by --package-cache.
+   *)
+  and apt_keep_opt cached =
+    if cached then " -o APT::Keep-Downloaded-Packages=true" else ""
+  and yum_keep_opt cached =
+    if cached then " --setopt=keepcache=1" else ""
+
   (* Windows has package_management == "unknown". *)
   and error_unknown_package_manager flag =
     error (f_"cannot use '%s' because no package manager has been detected for this guest OS.\n\nIf this guest OS is a common one with ordinary package management then this may have been caused by a failure of libguestfs inspection.\n\nFor OSes such as Windows that lack package management, this is not possible.  Try using one of the '--firstboot*' flags instead (described in the manual).") flag
@@ -201,9 +253,8 @@ exec >>%s 2>&1
     Hashtbl.replace passwords user pw
   in
 
-  (* Perform the remaining customizations in command-line order. *)
-  List.iter (
-    function
+  (* Perform one customization. *)
+  let do_op = function
     | `AppendLine (path, line) ->
        (* It's an error if it's not a single line.  This is
         * to prevent incorrect line endings being added to a file.
@@ -277,7 +328,8 @@ exec >>%s 2>&1
 
     | `InstallPackages pkgs ->
       message (f_"Installing packages: %s") (String.concat " " pkgs);
-      let cmd = guest_install_command pkgs in
+      use_package_cache ();
+      let cmd = guest_install_command ~cached:!package_cache_used pkgs in
       do_run ~display:cmd ~warn_failed_no_network:true cmd
 
     | `Link (target, links) ->
@@ -376,7 +428,8 @@ exec >>%s 2>&1
 
     | `Update ->
       message (f_"Updating packages");
-      let cmd = guest_update_command () in
+      use_package_cache ();
+      let cmd = guest_update_command ~cached:!package_cache_used () in
       do_run ~display:cmd ~warn_failed_no_network:true cmd
 
     | `Upload (path, dest) ->
@@ -407,7 +460,151 @@ exec >>%s 2>&1
     | `Write (path, content) ->
       message (f_"Writing: %s") path;
       g#write path content
-  ) ops.ops;
+  in
+
+  (* A run of consecutive --write and --upload operations is done by
+   * unpacking a single archive (see File_batch) instead of making
+   * several calls per file.  Only new files in existing directories
+   * which contain no symbolic links are batched.  Anything else is
+   * done by do_op as before, in command-line order.
+   *)
+  let do_files ops =
+    let files = List.map (
+      function
+      | `Write (path, content) as op ->
+        op, path, File_batch.Content content
+      | `Upload (path, dest) as op ->
+        let dest =
+          if g#is_dir ~followsymlinks:true dest then
+            dest ^ "/" ^ Filename.basename path
+          else
+            dest in
+        op, dest, File_batch.Local path
+      | _ -> assert false
+    ) ops in
+
+    let simple_path path =
+      String.length path > 1 && path.[0] = '/' &&
+        List.for_all (fun c -> c <> "" && c <> "." && c <> "..")
+                     (String.nsplit "/" (String.sub path 1 (String.length path - 1))) in
+    let targets = List.map (fun (_, target, _) -> target) files in
+    let targets = List.filter simple_path targets in
+
+    (* Find which targets do not exist yet, with one lstatnslist
+     * per directory.
+     *)
+    let new_files = Hashtbl.create 13 in
+    let dirs = Hashtbl.create 13 in
+    List.iter (
+      fun target ->
+        let dir = Filename.dirname target in
+        let names = try Hashtbl.find dirs dir with Not_found -> [] in
+        Hashtbl.replace dirs dir (Filename.basename target :: names)
+    ) targets;
+    Hashtbl.iter (
+      fun dir names ->
+        let names = Array.of_list names in
+        try
+          if dir = "/" || g#realpath dir = dir then (
+            let stats = g#lstatnslist dir names in
+            Array.iteri (
+              fun i { Guestfs.st_ino = ino; _ } ->
+                if ino = -1L then
+                  Hashtbl.replace new_files (dir // names.(i)) ()
+            ) stats
+          )
+        with Guestfs.Error _ -> () (* missing directory, do_op reports it *)
+    ) dirs;
+
+    let umask = g#get_umask () in
+    let files = List.map (
+      fun (op, target, source) ->
+        let file =
+          match op, source with
+          | `Upload _, File_batch.Local path ->
+            (try
+               let statbuf = stat path in
+               if statbuf.st_kind <> S_REG then None
+               else
+                 Some { File_batch.path = target; source;
+                        mode = statbuf.st_perm land 0o7777 (* sticky & set*id *);
+                        uid = statbuf.st_uid; gid = statbuf.st_gid }
+             with Unix_error _ -> None)
+          | _ ->
+            Some { File_batch.path = target; source;
+                   mode = 0o666 land lnot umask; uid = 0; gid = 0 } in
+        let file =
+          match file with
+          | Some file when Hashtbl.mem new_files target &&
+                           File_batch.representable file -> Some file
+          | _ -> None in
+        op, file
+    ) files in
+
+    (* If the same file is created twice, let do_op handle it. *)
+    let targets = filter_map (
+      function
+      | _, Some { File_batch.path = path; _ } -> Some path
+      | _, None -> None
+    ) files in
+    if List.length (sort_uniq targets) <> List.length targets then
+      List.iter (fun (op, _) -> do_op op) files
+    else (
+      let batch = ref [] in
+      let flush () =
+        if !batch <> [] then (
+          File_batch.write_files g (List.rev !batch);
+          batch := []
+        )
+      in
+      List.iter (
+        function
+        | `Write (path, _), Some file ->
+          message (f_"Writing: %s") path;
+          push_front file batch
+        | `Upload (path, dest), Some file ->
+          message (f_"Uploading: %s to %s") path dest;
+          push_front file batch
+        | op, _ ->
+          flush ();
+          do_op op
+      ) files;
+      flush ()
+    )
+  in
+
+  (* Perform the remaining customizations in command-line order. *)
+  let is_file_op = function `Write _ | `Upload _ -> true | _ -> false in
+  let rec loop = function
+    | [] -> ()
+    | op :: _ as ops when is_file_op op ->
+      let rec split acc = function
+        | op :: rest when is_file_op op -> split (op :: acc) rest
+        | rest -> List.rev acc, rest
+      in
+      let run, rest = split [] ops in
+      (match run with
+       | [op] -> do_op op
+       | run -> do_files run);
+      loop rest
+    | op :: rest ->
+      do_op op;
+      loop rest
+  in
+  loop ops.ops;
+
+  (* Save the downloaded packages for next time, and remove them
+   * from the guest.
+   *)
+  (match package_cache with
+   | Some (hostdir, guestdir, clean) when !package_cache_used ->
+     message (f_"Saving downloaded packages to %s") hostdir;
+     mkdir_p hostdir 0o755;
+     if g#is_dir guestdir then
+       g#copy_out guestdir hostdir;
+     do_run ~display:clean clean
+   | _ -> ()
+  );
 
   (* Set all the passwords at the end. *)
   if Hashtbl.length passwords > 0 then (
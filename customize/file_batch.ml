@@ -0,0 +1,136 @@
+(* virt-customize
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *)
+
+open Printf
+
+open Common_utils
+open Common_gettext.Gettext
+
+type source =
+| Content of string
+| Local of string
+
+type file = {
+  path : string;
+  source : source;
+  mode : int;
+  uid : int;
+  gid : int;
+}
+
+(* Split the path into the ustar prefix and name fields, or return
+ * None if it is too long.  No GNU extensions are used, so that any
+ * tar in the appliance can read the archive.
+ *)
+let split_name path =
+  let len = String.length path in
+  if len <= 100 then Some ("", path)
+  else (
+    let rec loop i =
+      if i < 0 then None
+      else if path.[i] = '/' && i <= 155 && len - i - 1 <= 100 then
+        Some (String.sub path 0 i, String.sub path (i+1) (len-i-1))
+      else loop (i-1)
+    in
+    loop (min 155 (len-1))
+  )
+
+(* The member name, which is relative to "/". *)
+let member_name path = String.sub path 1 (String.length path - 1)
+
+let size_of_source = function
+  | Content str -> Int64.of_int (String.length str)
+  | Local filename -> (Unix.LargeFile.stat filename).Unix.LargeFile.st_size
+
+let representable file =
+  String.length file.path > 1 && file.path.[0] = '/' &&
+    let name = member_name file.path in
+    (* tar refuses names containing "..". *)
+    not (List.mem ".." (String.nsplit "/" name)) &&
+    name.[String.length name - 1] <> '/' &&
+    split_name name <> None &&
+    file.uid >= 0 && file.uid < 0o7777777 &&
+    file.gid >= 0 && file.gid < 0o7777777 &&
+    (try size_of_source file.source < 0o77777777777L
+     with Unix.Unix_error _ -> false)
+
+(* Build the 512 byte ustar header. *)
+let header file size mtime =
+  let prefix, name =
+    match split_name (member_name file.path) with
+    | Some names -> names
+    | None -> assert false (* checked by representable *) in
+  let h = Bytes.make 512 '\000' in
+  let field offset str = String.blit str 0 h offset (String.length str) in
+  field 0 name;
+  field 100 (sprintf "%07o" file.mode);
+  field 108 (sprintf "%07o" file.uid);
+  field 116 (sprintf "%07o" file.gid);
+  field 124 (sprintf "%011Lo" size);
+  field 136 (sprintf "%011Lo" mtime);
+  field 148 "        ";               (* checksum, see below *)
+  field 156 "0";                    (* regular file *)
+  field 257 "ustar";
+  field 263 "00";
+  field 345 prefix;
+  let sum = ref 0 in
+  Bytes.iter (fun c -> sum := !sum + Char.code c) h;
+  field 148 (sprintf "%06o\000 " !sum);
+  h
+
+let write_archive chan files =
+  let mtime = Int64.of_float (Unix.time ()) in
+  let zeroes = Bytes.make 512 '\000' in
+  List.iter (
+    fun file ->
+      let size = size_of_source file.source in
+      output_bytes chan (header file size mtime);
+      (match file.source with
+      | Content str -> output_string chan str
+      | Local filename ->
+        let ichan = open_in_bin filename in
+        let buf = Bytes.create 65536 in
+        let rec copy n =
+          if n > 0L then (
+            let r = input ichan buf 0 (Int64.to_int (min n 65536L)) in
+            if r = 0 then
+              error (f_"%s: file changed size while it was being uploaded") filename;
+            output chan buf 0 r;
+            copy (n -^ Int64.of_int r)
+          )
+        in
+        copy size;
+        close_in ichan
+      );
+      (* Pad the data to a whole number of blocks. *)
+      let rem = Int64.to_int (Int64.rem size 512L) in
+      if rem > 0 then output chan zeroes 0 (512 - rem)
+  ) files;
+  (* End of archive. *)
+  output_bytes chan zeroes;
+  output_bytes chan zeroes
+
+let write_files (g : Guestfs.guestfs) files =
+  let tmpfile, chan = Filename.open_temp_file ~mode:[Open_binary]
+                                              "vcfiles" ".tar" in
+  unlink_on_exit tmpfile;
+  write_archive chan files;
+  close_out chan;
+  debug "unpacking %d files in the guest" (List.length files);
+  g#tar_in tmpfile "/";
+  Unix.unlink tmpfile
@@ -0,0 +1,46 @@
+(* virt-customize
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *)
+
+(** Create many files in the guest with a single [tar_in]. *)
+
+type source =
+| Content of string                     (** the contents of the file *)
+| Local of string                       (** a local file to copy *)
+
+type file = {
+  path : string;                        (** absolute path in the guest *)
+  source : source;
+  mode : int;                           (** permissions, including set*id *)
+  uid : int;
+  gid : int;
+}
+
+val representable : file -> bool
+(** Return true if the file can be stored in the archive.  If not,
+    the caller must create it some other way. *)
+
+val write_files : Guestfs.guestfs -> file list -> unit
+(** Create (or replace) the files, in order, with the given
+    permissions and owner.  The modification time is set to the
+    current time.
+
+    The files are packed in a tar archive on the host, which is
+    unpacked in the guest by one [tar_in] call, instead of one or
+    more calls per file.  Parent directories must already exist, and
+    existing files are replaced, not written through symbolic
+    links, so the caller should check for those first. *)
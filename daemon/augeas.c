@@ -20,11 +20,15 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
 
 #include <augeas.h>
 
+#include "read-file.h"
+
 #include "daemon.h"
 #include "actions.h"
 #include "optgroups.h"
@@ -53,6 +57,30 @@ int augeas_version;
  */
 static augeas *aug = NULL;
 
+/* Reusing the handle.
+ *
+ * Loading all the lenses and parsing the whole of /etc can take
+ * seconds, and callers often initialize Augeas several times for the
+ * same guest.  So aug_close keeps the handle as 'cached_aug', and a
+ * following aug_init or aug_init_files with the same arguments reuses
+ * it if nothing was mounted or unmounted in between.  aug_load then
+ * re-reads only the files which changed since they were loaded, and
+ * drops any unsaved changes, so the result is the same as with a new
+ * handle.
+ *
+ * This is only safe if the caller changed nothing except the file
+ * trees under /files, so any other change (variables, transforms,
+ * anything under /augeas) marks the handle as not reusable.
+ */
+static augeas *cached_aug = NULL;
+static bool aug_reusable;
+
+/* The arguments the handle was created with. */
+static char *aug_root;
+static int aug_flags;
+static char **aug_files;
+static char *aug_mounts;        /* /proc/self/mountinfo at that time */
+
 void
 aug_read_version (void)
 {
@@ -105,6 +133,10 @@ aug_finalize (void)
     aug_close (aug);
     aug = NULL;
   }
+  if (cached_aug) {
+    aug_close (cached_aug);
+    cached_aug = NULL;
+  }
 }
 
 #define NEED_AUG(errcode)						\
@@ -116,16 +148,127 @@ aug_finalize (void)
   }									\
   while (0)
 
-/* We need to rewrite the root path so it is based at /sysroot. */
-int
-do_aug_init (const char *root, int flags)
+/* Forget the handle (open or cached) and its arguments. */
+static void
+close_handle (void)
 {
-  CLEANUP_FREE char *buf = NULL;
-
   if (aug) {
     aug_close (aug);
     aug = NULL;
   }
+  if (cached_aug) {
+    aug_close (cached_aug);
+    cached_aug = NULL;
+  }
+  free (aug_root);
+  aug_root = NULL;
+  if (aug_files)
+    free_strings (aug_files);
+  aug_files = NULL;
+  free (aug_mounts);
+  aug_mounts = NULL;
+}
+
+/* Called with the path of each change to the tree. */
+static void
+aug_changed (const char *path)
+{
+  if (path == NULL || !STRPREFIX (path, "/files/"))
+    aug_reusable = false;
+}
+
+static char *
+read_mounts (void)
+{
+  size_t len;
+
+  return read_file ("/proc/self/mountinfo", &len);
+}
+
+static bool
+same_files (char *const *files1, char *const *files2)
+{
+  size_t i;
+
+  if (files1 == NULL || files2 == NULL)
+    return files1 == files2;
+
+  for (i = 0; files1[i] != NULL && files2[i] != NULL; ++i)
+    if (STRNEQ (files1[i], files2[i]))
+      return false;
+  return files1[i] == files2[i];
+}
+
+/* Augeas decides whether a file must be re-read by comparing its
+ * mtime, in seconds, with the mtime it had when it was loaded.  A file
+ * changed in the same second as it was loaded would look unchanged,
+ * so remove the recorded mtime of such files, which makes the next
+ * aug_load re-read them.
+ */
+static void
+forget_racy_mtimes (time_t load_time)
+{
+  char **matches = NULL;
+  const char *value;
+  int i, n;
+
+  n = aug_match (aug, "/augeas/files//mtime", &matches);
+  for (i = 0; i < n; ++i) {
+    if (aug_get (aug, matches[i], &value) == 1 && value &&
+        strtoll (value, NULL, 10) >= load_time)
+      aug_rm (aug, matches[i]);
+    free (matches[i]);
+  }
+  free (matches);
+}
+
+/* Build the expression matching the lenses whose 'incl' patterns
+ * match none of 'files'.  Removing these from /augeas/load before
+ * loading stops Augeas parsing any other files.  This needs
+ * Augeas >= 1.0.0 (RHBZ#975412).  See also
+ * https://bugzilla.redhat.com/show_bug.cgi?id=975412#c0
+ */
+static char *
+make_load_expression (char *const *files)
+{
+  CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (subexprs);
+  CLEANUP_FREE char *subexpr = NULL;
+  char *ret;
+  size_t i;
+
+  for (i = 0; files[i] != NULL; ++i) {
+    /*                                v NB trailing '/' after filename */
+    if (add_sprintf (&subexprs,
+                     "\"%s/\" !~ regexp('^') + glob(incl) + regexp('/.*')",
+                     files[i]) == -1)
+      return NULL;
+  }
+  if (end_stringsbuf (&subexprs) == -1)
+    return NULL;
+
+  subexpr = join_strings (" and ", subexprs.argv);
+  if (subexpr == NULL) {
+    reply_with_perror ("malloc");
+    return NULL;
+  }
+
+  if (asprintf (&ret, "/augeas/load/*[ %s ]", subexpr) == -1) {
+    reply_with_perror ("asprintf");
+    return NULL;
+  }
+
+  return ret;
+}
+
+/* Create a new handle.  If 'files' is not NULL, only those files are
+ * loaded.
+ */
+static int
+init_handle (const char *root, int flags, char *const *files)
+{
+  CLEANUP_FREE char *buf = NULL;
+  const int init_flags = files ? flags | AUG_NO_LOAD : flags;
+  const time_t load_time = time (NULL);
 
   buf = sysroot_path (root);
   if (!buf) {
@@ -134,7 +277,7 @@ do_aug_init (const char *root, int flags)
   }
 
   /* Pass AUG_NO_ERR_CLOSE so we can display detailed errors. */
-  aug = aug_init (buf, "/usr/share/guestfs/", flags | AUG_NO_ERR_CLOSE);
+  aug = aug_init (buf, "/usr/share/guestfs/", init_flags | AUG_NO_ERR_CLOSE);
 
   if (!aug) {
     reply_with_error ("augeas initialization failed");
@@ -159,6 +302,24 @@ do_aug_init (const char *root, int flags)
     }
 
     /* If aug_load was implicitly called, reload the handle. */
+    if ((init_flags & AUG_NO_LOAD) == 0) {
+      if (aug_load (aug) == -1) {
+        AUGEAS_ERROR ("aug_load");
+        return -1;
+      }
+    }
+  }
+
+  if (files) {
+    CLEANUP_FREE char *expr = make_load_expression (files);
+
+    if (expr == NULL)
+      return -1;
+    if (aug_rm (aug, expr) == -1) {
+      AUGEAS_ERROR ("aug_rm: %s", expr);
+      return -1;
+    }
+
     if ((flags & AUG_NO_LOAD) == 0) {
       if (aug_load (aug) == -1) {
         AUGEAS_ERROR ("aug_load");
@@ -167,16 +328,115 @@ do_aug_init (const char *root, int flags)
     }
   }
 
+  if ((flags & AUG_NO_LOAD) == 0)
+    forget_racy_mtimes (load_time);
+
+  return 0;
+}
+
+static int
+init_or_reuse_handle (const char *root, int flags, char *const *files)
+{
+  CLEANUP_FREE char *mounts = read_mounts ();
+
+  /* Any previous handle is closed, or kept for reuse. */
+  if (aug)
+    do_aug_close ();
+
+  if (cached_aug && mounts && aug_mounts &&
+      (flags & AUG_NO_LOAD) == 0 &&
+      STREQ (root, aug_root) && flags == aug_flags &&
+      same_files (files, aug_files) &&
+      STREQ (mounts, aug_mounts)) {
+    const time_t load_time = time (NULL);
+
+    if (verbose)
+      fprintf (stderr, "augeas: reusing the handle for %s\n", root);
+    aug = cached_aug;
+    cached_aug = NULL;
+    if (aug_load (aug) == -1) {
+      AUGEAS_ERROR ("aug_load");
+      close_handle ();
+      return -1;
+    }
+    forget_racy_mtimes (load_time);
+    return 0;
+  }
+
+  close_handle ();
+  if (init_handle (root, flags, files) == -1) {
+    close_handle ();
+    return -1;
+  }
+
+  aug_root = strdup (root);
+  if (aug_root == NULL) {
+    reply_with_perror ("strdup");
+    close_handle ();
+    return -1;
+  }
+  aug_flags = flags;
+  if (files) {
+    CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (copy);
+    size_t i;
+
+    for (i = 0; files[i] != NULL; ++i) {
+      if (add_string (&copy, files[i]) == -1) {
+        close_handle ();
+        return -1;
+      }
+    }
+    if (end_stringsbuf (&copy) == -1) {
+      close_handle ();
+      return -1;
+    }
+    aug_files = take_stringsbuf (&copy);
+  }
+  aug_mounts = mounts;
+  mounts = NULL;
+  aug_reusable = aug_mounts != NULL;
+
   return 0;
 }
 
+/* We need to rewrite the root path so it is based at /sysroot. */
+int
+do_aug_init (const char *root, int flags)
+{
+  return init_or_reuse_handle (root, flags, NULL);
+}
+
+int
+do_aug_init_files (const char *root, int flags, char *const *files)
+{
+  size_t i;
+
+  if (files[0] == NULL) {
+    reply_with_error ("list of files must not be empty");
+    return -1;
+  }
+  for (i = 0; files[i] != NULL; ++i) {
+    if (files[i][0] != '/' || strpbrk (files[i], "\"'") != NULL) {
+      reply_with_error ("%s: files must be absolute paths without quotes",
+                        files[i]);
+      return -1;
+    }
+  }
+
+  return init_or_reuse_handle (root, flags, files);
+}
+
 int
 do_aug_close (void)
 {
   NEED_AUG(-1);
 
-  aug_close (aug);
-  aug = NULL;
+  if (aug_reusable) {
+    cached_aug = aug;
+    aug = NULL;
+  }
+  else
+    close_handle ();
 
   return 0;
 }
@@ -188,6 +448,7 @@ do_aug_defvar (const char *name, const char *expr)
 
   NEED_AUG (-1);
 
+  aug_changed (NULL);
   r = aug_defvar (aug, name, expr);
   if (r == -1) {
     AUGEAS_ERROR ("aug_defvar: %s: %s", name, expr);
@@ -204,6 +465,7 @@ do_aug_defnode (const char *name, const char *expr, const char *val)
 
   NEED_AUG (NULL);
 
+  aug_changed (NULL);
   i = aug_defnode (aug, name, expr, val, &created);
   if (i == -1) {
     AUGEAS_ERROR ("aug_defnode: %s: %s: %s", name, expr, val);
@@ -267,6 +529,7 @@ do_aug_set (const char *path, const char *val)
 
   NEED_AUG (-1);
 
+  aug_changed (path);
   r = aug_set (aug, path, val);
   if (r == -1) {
     AUGEAS_ERROR ("aug_set: %s: %s", path, val);
@@ -283,6 +546,7 @@ do_aug_clear (const char *path)
 
   NEED_AUG (-1);
 
+  aug_changed (path);
   r = aug_set (aug, path, NULL);
   if (r == -1) {
     AUGEAS_ERROR ("aug_clear: %s", path);
@@ -299,6 +563,7 @@ do_aug_insert (const char *path, const char *label, int before)
 
   NEED_AUG (-1);
 
+  aug_changed (path);
   r = aug_insert (aug, path, label, before);
   if (r == -1) {
     AUGEAS_ERROR ("aug_insert: %s: %s [before=%d]", path, label, before);
@@ -315,6 +580,7 @@ do_aug_rm (const char *path)
 
   NEED_AUG (-1);
 
+  aug_changed (path);
   r = aug_rm (aug, path);
   if (r == -1) {
     AUGEAS_ERROR ("aug_rm: %s", path);
@@ -331,6 +597,8 @@ do_aug_mv (const char *src, const char *dest)
 
   NEED_AUG (-1);
 
+  aug_changed (src);
+  aug_changed (dest);
   r = aug_mv (aug, src, dest);
   if (r == -1) {
     AUGEAS_ERROR ("aug_mv: %s: %s", src, dest);
@@ -447,6 +715,7 @@ do_aug_setm (const char *base, const char *sub, const char *val)
 
   NEED_AUG (-1);
 
+  aug_changed (base);
   r = aug_setm (aug, base, sub, val);
   if (r == -1) {
     AUGEAS_ERROR ("aug_setm: %s: %s: %s", base, sub ? sub : "(null)", val);
@@ -504,6 +773,7 @@ do_aug_transform (const char *lens, const char *file, int remove)
   if (optargs_bitmask & GUESTFS_AUG_TRANSFORM_REMOVE_BITMASK)
     excl = remove;
 
+  aug_changed (NULL);
   r = aug_transform (aug, lens, file, excl);
   if (r == -1) {
     AUGEAS_ERROR ("aug_transform: %s: %s: %s", lens, file, excl ? "excl" : "incl");
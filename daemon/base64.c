@@ -23,20 +23,66 @@
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include "base64.h"
+
 #include "guestfs_protocol.h"
 #include "daemon.h"
 #include "actions.h"
 
-GUESTFSD_EXT_CMD(str_base64, base64);
+/* The data is encoded and decoded in the daemon, instead of running
+ * base64(1).  The output is the same as base64 prints: lines of 76
+ * characters, each encoding 57 bytes.
+ */
+#define BASE64_LINE_BYTES 57
+#define BASE64_LINE_CHARS 76
+
+/* Bytes read from the file for each chunk written by base64_out.
+ * This encodes to less than GUESTFS_MAX_CHUNK_SIZE.
+ */
+#define BASE64_READ_SIZE (BASE64_LINE_BYTES * 16384)
+
+/* Characters decoded at a time by base64_in. */
+#define BASE64_DECODE_SIZE 65536
+
+struct decode_data {
+  int fd;
+  struct base64_decode_context ctx;
+  char *buf;                    /* decoded data */
+  int err;                      /* set if the data is not valid base64 */
+};
 
 static int
-write_cb (void *fd_ptr, const void *buf, size_t len)
+write_cb (void *vp, const void *vbuf, size_t len)
 {
-  const int fd = *(int *)fd_ptr;
-  return xwrite (fd, buf, len);
+  struct decode_data *data = vp;
+  const char *buf = vbuf;
+
+  while (len > 0) {
+    char in[BASE64_DECODE_SIZE];
+    size_t n = 0, outlen;
+
+    /* Like 'base64 -d -i', ignore characters which are not part of
+     * the encoding, such as the newlines.
+     */
+    for (; len > 0 && n < sizeof in; ++buf, --len) {
+      if (isbase64 (*buf) || *buf == '=')
+        in[n++] = *buf;
+    }
+
+    outlen = BASE64_DECODE_SIZE;
+    if (!base64_decode_ctx (&data->ctx, in, n, data->buf, &outlen)) {
+      data->err = 1;
+      return -1;
+    }
+    if (xwrite (data->fd, data->buf, outlen) == -1)
+      return -1;
+  }
+
+  return 0;
 }
 
 /* Has one FileIn parameter. */
@@ -44,40 +90,44 @@ int
 do_base64_in (const char *file)
 {
   int err, r;
-  FILE *fp;
-  CLEANUP_FREE char *cmd = NULL;
-  int fd;
+  size_t outlen;
+  CLEANUP_FREE char *buf = NULL;
+  struct decode_data data;
 
-  if (asprintf_nowarn (&cmd, "%s -d -i > %R", str_base64, file) == -1) {
+  buf = malloc (BASE64_DECODE_SIZE);
+  if (buf == NULL) {
     err = errno;
     cancel_receive ();
     errno = err;
-    reply_with_perror ("asprintf");
+    reply_with_perror ("malloc");
     return -1;
   }
 
-  if (verbose)
-    fprintf (stderr, "%s\n", cmd);
-
-  fp = popen (cmd, "w");
-  if (fp == NULL) {
+  CHROOT_IN;
+  data.fd = open (file, O_WRONLY|O_CREAT|O_TRUNC|O_NOCTTY|O_CLOEXEC, 0666);
+  CHROOT_OUT;
+  if (data.fd == -1) {
     err = errno;
     cancel_receive ();
     errno = err;
-    reply_with_perror ("%s", cmd);
+    reply_with_perror ("%s", file);
     return -1;
   }
+  base64_decode_ctx_init (&data.ctx);
+  data.buf = buf;
+  data.err = 0;
 
-  /* The semantics of fwrite are too undefined, so write to the
-   * file descriptor directly instead.
-   */
-  fd = fileno (fp);
-
-  r = receive_file (write_cb, &fd);
+  r = receive_file (write_cb, &data);
   if (r == -1) {		/* write error */
+    err = errno;
     cancel_receive ();
-    reply_with_error ("write error on file: %s", file);
-    pclose (fp);
+    if (data.err)
+      reply_with_error ("%s: invalid base64 input", file);
+    else {
+      errno = err;
+      reply_with_perror ("write: %s", file);
+    }
+    close (data.fd);
     return -1;
   }
   if (r == -2) {		/* cancellation from library */
@@ -85,12 +135,20 @@ do_base64_in (const char *file)
      * cancel.  Nevertheless we must send an error reply here.
      */
     reply_with_error ("file upload cancelled");
-    pclose (fp);
+    close (data.fd);
+    return -1;
+  }
+
+  /* Check the input did not end in the middle of a group. */
+  outlen = 0;
+  if (!base64_decode_ctx (&data.ctx, "", 0, buf, &outlen)) {
+    reply_with_error ("%s: invalid base64 input", file);
+    close (data.fd);
     return -1;
   }
 
-  if (pclose (fp) != 0) {
-    reply_with_error ("base64 subcommand failed on file: %s", file);
+  if (close (data.fd) == -1) {
+    reply_with_perror ("close: %s", file);
     return -1;
   }
 
@@ -101,50 +159,41 @@ do_base64_in (const char *file)
 int
 do_base64_out (const char *file)
 {
-  CLEANUP_FREE char *buf = NULL;
   struct stat statbuf;
-  int r;
-  FILE *fp;
-  CLEANUP_FREE char *cmd = NULL;
-  CLEANUP_FREE char *buffer = NULL;
+  int fd;
+  ssize_t r;
+  size_t i, n, len;
+  CLEANUP_FREE char *buffer = NULL, *out = NULL;
 
-  buffer = malloc (GUESTFS_MAX_CHUNK_SIZE);
-  if (buffer == NULL) {
+  buffer = malloc (BASE64_READ_SIZE);
+  out = malloc (GUESTFS_MAX_CHUNK_SIZE);
+  if (buffer == NULL || out == NULL) {
     reply_with_perror ("malloc");
     return -1;
   }
 
-  /* Check the filename exists and is not a directory (RHBZ#908322). */
-  buf = sysroot_path (file);
-  if (buf == NULL) {
-    reply_with_perror ("malloc");
+  CHROOT_IN;
+  fd = open (file, O_RDONLY|O_CLOEXEC);
+  CHROOT_OUT;
+  if (fd == -1) {
+    reply_with_perror ("%s", file);
     return -1;
   }
 
-  if (stat (buf, &statbuf) == -1) {
+  /* Check the filename is not a directory (RHBZ#908322). */
+  if (fstat (fd, &statbuf) == -1) {
     reply_with_perror ("stat: %s", file);
+    close (fd);
     return -1;
   }
 
   if (S_ISDIR (statbuf.st_mode)) {
     reply_with_error ("%s: is a directory", file);
+    close (fd);
     return -1;
   }
 
-  /* Construct the command. */
-  if (asprintf_nowarn (&cmd, "%s %Q", str_base64, buf) == -1) {
-    reply_with_perror ("asprintf");
-    return -1;
-  }
-
-  if (verbose)
-    fprintf (stderr, "%s\n", cmd);
-
-  fp = popen (cmd, "r");
-  if (fp == NULL) {
-    reply_with_perror ("%s", cmd);
-    return -1;
-  }
+  posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
 
   /* Now we must send the reply message, before the file contents.  After
    * this there is no opportunity in the protocol to send any error
@@ -152,22 +201,45 @@ do_base64_out (const char *file)
    */
   reply (NULL, NULL);
 
-  while ((r = fread (buffer, 1, GUESTFS_MAX_CHUNK_SIZE, fp)) > 0) {
-    if (send_file_write (buffer, r) < 0) {
-      pclose (fp);
+  for (;;) {
+    /* Fill the buffer, so that only the last line is short. */
+    n = 0;
+    while (n < BASE64_READ_SIZE) {
+      r = read (fd, buffer + n, BASE64_READ_SIZE - n);
+      if (r == -1 && errno == EINTR)
+        continue;
+      if (r == -1) {
+        fprintf (stderr, "read: %s: %m\n", file);
+        send_file_end (1);	/* Cancel. */
+        close (fd);
+        return -1;
+      }
+      if (r == 0)
+        break;
+      n += r;
+    }
+    if (n == 0)
+      break;
+
+    len = 0;
+    for (i = 0; i < n; i += BASE64_LINE_BYTES) {
+      const size_t line = MIN (n - i, BASE64_LINE_BYTES);
+
+      base64_encode (buffer + i, line, out + len, BASE64_LENGTH (line));
+      len += BASE64_LENGTH (line);
+      out[len++] = '\n';
+    }
+    if (send_file_write (out, len) < 0) {
+      close (fd);
       return -1;
     }
-  }
 
-  if (ferror (fp)) {
-    fprintf (stderr, "fread: %s: %m\n", file);
-    send_file_end (1);		/* Cancel. */
-    pclose (fp);
-    return -1;
+    if (n < BASE64_READ_SIZE)
+      break;
   }
 
-  if (pclose (fp) != 0) {
-    fprintf (stderr, "pclose: %s: %m\n", file);
+  if (close (fd) == -1) {
+    fprintf (stderr, "close: %s: %m\n", file);
     send_file_end (1);		/* Cancel. */
     return -1;
   }
@@ -20,14 +20,295 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
 #include <unistd.h>
 #include <limits.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
 
+#ifdef HAVE_BLKID
+#include <blkid.h>
+#endif
+
+#include "guestfs_protocol.h"
 #include "daemon.h"
 #include "actions.h"
 #include "optgroups.h"
 
+#ifdef HAVE_BLKID
+
+/* Probe the device with libblkid, instead of running blkid.  This
+ * probes the filesystem, the partition entry and the I/O limits, as
+ * 'blkid -p -i' does.  '*r' is set to the result of
+ * blkid_do_safeprobe: 0 if something was found, 1 if nothing was
+ * found, or -2 if the result was ambivalent.  Returns NULL after
+ * replying with an error.
+ */
+static blkid_probe
+probe_device (const char *device, int *r)
+{
+  blkid_probe pr;
+
+  pr = blkid_new_probe_from_filename (device);
+  if (pr == NULL) {
+    reply_with_perror ("%s", device);
+    return NULL;
+  }
+
+  /* The I/O limits are probed first, as 'blkid -i' does. */
+  blkid_probe_enable_superblocks (pr, 0);
+  blkid_probe_enable_topology (pr, 1);
+  if (blkid_do_fullprobe (pr) < 0) {
+    reply_with_error ("%s: cannot probe I/O limits", device);
+    blkid_free_probe (pr);
+    return NULL;
+  }
+  blkid_probe_enable_topology (pr, 0);
+  blkid_probe_enable_partitions (pr, 1);
+  blkid_probe_set_partitions_flags (pr, BLKID_PARTS_ENTRY_DETAILS);
+
+  blkid_probe_enable_superblocks (pr, 1);
+  blkid_probe_set_superblocks_flags (pr,
+                                     BLKID_SUBLKS_LABEL |
+                                     BLKID_SUBLKS_UUID |
+                                     BLKID_SUBLKS_TYPE |
+                                     BLKID_SUBLKS_SECTYPE |
+                                     BLKID_SUBLKS_USAGE |
+                                     BLKID_SUBLKS_VERSION);
+
+  *r = blkid_do_safeprobe (pr);
+  if (*r == -1) {
+    reply_with_error ("%s: cannot probe device", device);
+    blkid_free_probe (pr);
+    return NULL;
+  }
+
+  return pr;
+}
+
+/* Inspection asks for the type, label and UUID of every device, so
+ * the probe results are cached for each device.  An entry is dropped
+ * by blkid_cache_invalidate, which is called by the calls which
+ * create or change filesystems and by udev_settle, or when the
+ * number of writes to the device (or to its whole disk) in
+ * /sys/dev/block/M:m/stat changes.
+ */
+struct blkid_cache_entry {
+  dev_t rdev;
+  uint64_t writes;
+  int r;                        /* result of blkid_do_safeprobe */
+  char **tags;                  /* name, value, ..., NULL */
+};
+
+static struct blkid_cache_entry *blkid_cache;
+static size_t blkid_cache_len;
+
+/* vfs_type runs in the worker threads, and udev_settle (called by
+ * luks_open) invalidates the cache from them too.  Non-reentrant
+ * calls never run alongside these, so only those paths take the lock.
+ */
+static pthread_mutex_t blkid_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Return the number of write and discard requests in a stat file
+ * from sysfs, or 0 if it cannot be read.
+ */
+static uint64_t
+read_stat_writes (const char *path)
+{
+  FILE *fp;
+  uint64_t v[12] = { 0 };
+  size_t i;
+
+  fp = fopen (path, "re");
+  if (fp == NULL)
+    return 0;
+  for (i = 0; i < sizeof v / sizeof v[0]; ++i) {
+    if (fscanf (fp, "%" SCNu64, &v[i]) != 1)
+      break;
+  }
+  fclose (fp);
+
+  return v[4] + v[11];
+}
+
+static uint64_t
+device_writes (dev_t rdev)
+{
+  char path[64];
+  uint64_t n;
+
+  snprintf (path, sizeof path, "/sys/dev/block/%u:%u/stat",
+            major (rdev), minor (rdev));
+  n = read_stat_writes (path);
+
+  /* Writes to the whole disk are only counted there. */
+  snprintf (path, sizeof path, "/sys/dev/block/%u:%u/partition",
+            major (rdev), minor (rdev));
+  if (access (path, F_OK) == 0) {
+    snprintf (path, sizeof path, "/sys/dev/block/%u:%u/../stat",
+              major (rdev), minor (rdev));
+    n += read_stat_writes (path);
+  }
+
+  return n;
+}
+
+static void
+drop_cache_entry (size_t i)
+{
+  free_strings (blkid_cache[i].tags);
+  blkid_cache[i] = blkid_cache[--blkid_cache_len];
+}
+
+/**
+ * Drop the cached probe of C<device>, or of all devices if C<device>
+ * is C<NULL>.  This must be called after anything which may change
+ * the filesystem or partition on a device.
+ */
+void
+blkid_cache_invalidate (const char *device)
+{
+  struct stat statbuf;
+  size_t i;
+
+  if (device == NULL) {
+    pthread_mutex_lock (&blkid_cache_lock);
+    while (blkid_cache_len > 0)
+      drop_cache_entry (blkid_cache_len - 1);
+    pthread_mutex_unlock (&blkid_cache_lock);
+    return;
+  }
+
+  if (stat (device, &statbuf) == -1 || !S_ISBLK (statbuf.st_mode))
+    return;
+  pthread_mutex_lock (&blkid_cache_lock);
+  for (i = 0; i < blkid_cache_len; ++i) {
+    if (blkid_cache[i].rdev == statbuf.st_rdev) {
+      drop_cache_entry (i);
+      break;
+    }
+  }
+  pthread_mutex_unlock (&blkid_cache_lock);
+}
+
+/* Return the probe result for the device, from the cache if possible.
+ * Returns NULL after replying with an error.
+ */
+static const struct blkid_cache_entry *
+get_probe (const char *device)
+{
+  static struct blkid_cache_entry uncached;
+  struct blkid_cache_entry entry = { 0 }, *p;
+  CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (tags);
+  struct stat statbuf;
+  blkid_probe pr;
+  int i, n;
+
+  if (stat (device, &statbuf) == -1) {
+    reply_with_perror ("%s", device);
+    return NULL;
+  }
+
+  if (S_ISBLK (statbuf.st_mode)) {
+    entry.rdev = statbuf.st_rdev;
+    entry.writes = device_writes (entry.rdev);
+    for (i = 0; (size_t) i < blkid_cache_len; ++i) {
+      if (blkid_cache[i].rdev == entry.rdev) {
+        if (blkid_cache[i].writes == entry.writes)
+          return &blkid_cache[i];
+        drop_cache_entry (i);
+        break;
+      }
+    }
+  }
+
+  pr = probe_device (device, &entry.r);
+  if (pr == NULL)
+    return NULL;
+
+  n = blkid_probe_numof_values (pr);
+  for (i = 0; i < n; ++i) {
+    const char *name, *data;
+
+    if (blkid_probe_get_value (pr, i, &name, &data, NULL) == -1)
+      continue;
+    if (add_string (&tags, name) == -1 ||
+        add_string (&tags, data) == -1) {
+      blkid_free_probe (pr);
+      return NULL;
+    }
+  }
+  blkid_free_probe (pr);
+  if (end_stringsbuf (&tags) == -1)
+    return NULL;
+  entry.tags = take_stringsbuf (&tags);
+
+  /* Regular files (for tests) are not cached. */
+  if (!S_ISBLK (statbuf.st_mode)) {
+    free_strings (uncached.tags);
+    uncached = entry;
+    return &uncached;
+  }
+
+  p = realloc (blkid_cache,
+               (blkid_cache_len + 1) * sizeof (struct blkid_cache_entry));
+  if (p == NULL) {
+    reply_with_perror ("realloc");
+    free_strings (entry.tags);
+    return NULL;
+  }
+  blkid_cache = p;
+  blkid_cache[blkid_cache_len] = entry;
+  return &blkid_cache[blkid_cache_len++];
+}
+
+/* Find a tag in a probe result, or return NULL. */
+static const char *
+lookup_tag (const struct blkid_cache_entry *entry, const char *tag)
+{
+  size_t i;
+
+  for (i = 0; entry->tags[i] != NULL; i += 2) {
+    if (STREQ (entry->tags[i], tag))
+      return entry->tags[i+1];
+  }
+
+  return NULL;
+}
+
+char *
+get_blkid_tag (const char *device, const char *tag)
+{
+  const struct blkid_cache_entry *entry;
+  const char *data = NULL;
+  char *ret;
+
+  pthread_mutex_lock (&blkid_cache_lock);
+  entry = get_probe (device);
+  if (entry == NULL) {
+    pthread_mutex_unlock (&blkid_cache_lock);
+    return NULL;
+  }
+
+  /* As blkid does, return "" if the UUID etc is not found, including
+   * when the result is ambivalent.
+   */
+  if (entry->r == 0)
+    data = lookup_tag (entry, tag);
+
+  ret = strdup (data ? data : "");
+  pthread_mutex_unlock (&blkid_cache_lock);
+  if (ret == NULL)
+    reply_with_perror ("strdup");
+  return ret;                   /* caller frees */
+}
+
+#else /* !HAVE_BLKID */
+
 GUESTFSD_EXT_CMD(str_blkid, blkid);
 
 char *
@@ -68,6 +349,14 @@ get_blkid_tag (const char *device, const char *tag)
   return out;                   /* caller frees */
 }
 
+void
+blkid_cache_invalidate (const char *device)
+{
+  /* Nothing is cached when blkid is run. */
+}
+
+#endif /* !HAVE_BLKID */
+
 char *
 do_vfs_type (const mountable_t *mountable)
 {
@@ -95,6 +384,146 @@ do_vfs_uuid (const mountable_t *mountable)
   return get_blkid_tag (mountable->device, "UUID");
 }
 
+#ifdef HAVE_BLKID
+
+/* Add the tags of one device to a blkid_all or blkid result. */
+static int
+add_device_tags (struct stringsbuf *ret, const char *device)
+{
+  const struct blkid_cache_entry *entry;
+  size_t i;
+
+  entry = get_probe (device);
+  if (entry == NULL)
+    return -1;
+
+  if (entry->r == -2) {
+    reply_with_error ("%s: ambivalent result (probably more filesystems on the device, use wipefs(8) to see more details)",
+                      device);
+    return -1;
+  }
+
+  /* The same keys and values as 'blkid -p -i -o export' prints. */
+  if (add_string (ret, "DEVNAME") == -1 ||
+      add_string (ret, device) == -1)
+    return -1;
+  for (i = 0; entry->tags[i] != NULL; ++i) {
+    if (add_string (ret, entry->tags[i]) == -1)
+      return -1;
+  }
+
+  return 0;
+}
+
+char **
+do_blkid (const char *device)
+{
+  CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (ret);
+
+  if (add_device_tags (&ret, device) == -1)
+    return NULL;
+
+  if (end_stringsbuf (&ret) == -1) return NULL;
+
+  return take_stringsbuf (&ret);
+}
+
+/* Move the devices returned by one of the list_* calls to 'devices'.
+ * If 'list' is NULL the call has already replied with an error.
+ */
+static int
+add_devices (struct stringsbuf *devices, char **list)
+{
+  size_t i;
+
+  if (list == NULL)
+    return -1;
+
+  for (i = 0; list[i] != NULL; ++i) {
+    if (add_string_nodup (devices, list[i]) == -1) {
+      free_strings (&list[i+1]);
+      free (list);
+      return -1;
+    }
+  }
+  free (list);
+  return 0;
+}
+
+guestfs_int_blkid_tag_list *
+do_blkid_all (void)
+{
+  CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (devices);
+  guestfs_int_blkid_tag_list *ret;
+  guestfs_int_blkid_tag *tags;
+  size_t i, j, n;
+
+  if (add_devices (&devices, do_list_devices ()) == -1 ||
+      add_devices (&devices, do_list_partitions ()) == -1 ||
+      (optgroup_mdadm_available () &&
+       add_devices (&devices, do_list_md_devices ()) == -1) ||
+      (optgroup_lvm2_available () &&
+       add_devices (&devices, do_lvs ()) == -1) ||
+      add_devices (&devices, do_list_dm_devices ()) == -1)
+    return NULL;
+
+  ret = calloc (1, sizeof *ret);
+  if (ret == NULL) {
+    reply_with_perror ("calloc");
+    return NULL;
+  }
+
+  for (i = 0; i < devices.size; ++i) {
+    const char *device = devices.argv[i];
+    const struct blkid_cache_entry *entry;
+
+    entry = get_probe (device);
+    if (entry == NULL)
+      goto error;
+
+    /* Leave out devices with more than one signature, which need to
+     * be looked at with guestfs_blkid or wipefs.
+     */
+    if (entry->r == -2)
+      continue;
+
+    for (n = 0; entry->tags[n] != NULL; n += 2)
+      ;
+    n /= 2;
+    tags = realloc (ret->guestfs_int_blkid_tag_list_val,
+                    (ret->guestfs_int_blkid_tag_list_len + n) *
+                    sizeof (guestfs_int_blkid_tag));
+    if (tags == NULL) {
+      reply_with_perror ("realloc");
+      goto error;
+    }
+    ret->guestfs_int_blkid_tag_list_val = tags;
+
+    for (j = 0; j < n; ++j) {
+      guestfs_int_blkid_tag *tag =
+        &tags[ret->guestfs_int_blkid_tag_list_len];
+
+      tag->bt_device = strdup (device);
+      tag->bt_name = strdup (entry->tags[2*j]);
+      tag->bt_value = strdup (entry->tags[2*j+1]);
+      ret->guestfs_int_blkid_tag_list_len++;
+      if (tag->bt_device == NULL || tag->bt_name == NULL ||
+          tag->bt_value == NULL) {
+        reply_with_perror ("strdup");
+        goto error;
+      }
+    }
+  }
+
+  return ret;
+
+ error:
+  xdr_free ((xdrproc_t) xdr_guestfs_int_blkid_tag_list, (char *) ret);
+  return NULL;
+}
+
+#else /* !HAVE_BLKID */
+
 /* RHEL5 blkid doesn't have the -p (low-level probing) option and the
  * -i(I/O limits) option so we must test for these options the first
  * time the function is called.
@@ -237,3 +666,11 @@ do_blkid (const char *device)
   else
     return blkid_without_p_i_opt (device);
 }
+
+guestfs_int_blkid_tag_list *
+do_blkid_all (void)
+{
+  NOT_SUPPORTED (NULL, "guestfsd was built without libblkid");
+}
+
+#endif /* !HAVE_BLKID */
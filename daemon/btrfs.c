@@ -24,7 +24,20 @@
 #include <pcre.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <assert.h>
+#include <sys/ioctl.h>
+#ifdef HAVE_ENDIAN_H
+#include <endian.h>
+#endif
+#ifdef HAVE_SYS_ENDIAN_H
+#include <sys/endian.h>
+#endif
+
+#if defined(HAVE_LINUX_BTRFS_H) && defined(HAVE_LINUX_BTRFS_TREE_H)
+#include <linux/btrfs.h>
+#include <linux/btrfs_tree.h>
+#endif
 
 #include "daemon.h"
 #include "actions.h"
@@ -2361,3 +2374,390 @@ btrfs_minimum_size (const char *path)
 
   return ret;
 }
+
+#if defined(HAVE_LINUX_BTRFS_H) && defined(HAVE_LINUX_BTRFS_TREE_H)
+
+/* btrfs_inventory reads the root tree and the quota tree directly
+ * with BTRFS_IOC_TREE_SEARCH, so that it can list every subvolume
+ * and snapshot of a filesystem in one call without running the btrfs
+ * program several times.
+ */
+struct inventory_entry {
+  uint64_t id;
+  uint64_t top_level_id;        /* 0 if there is no back reference */
+  uint64_t dirid;
+  uint64_t generation;
+  uint64_t flags;
+  char *name;                   /* name in the parent directory */
+  char *path;                   /* path from the top level, or NULL */
+  unsigned char uuid[BTRFS_UUID_SIZE];
+  unsigned char parent_uuid[BTRFS_UUID_SIZE];
+  int64_t rfer, excl;
+};
+
+struct inventory {
+  struct inventory_entry *entries;
+  size_t nr_entries;
+  uint64_t default_id;
+};
+
+typedef int (*search_fn) (const struct btrfs_ioctl_search_header *sh,
+                          const char *item, void *opaque);
+
+/* Call 'fn' for each item of one of the types between 'min_type' and
+ * 'max_type' whose objectid is between 'min_objectid' and
+ * 'max_objectid' in the tree 'tree_id'.  Returns -1 with errno set
+ * on error.
+ */
+static int
+tree_search (int fd, uint64_t tree_id,
+             uint64_t min_objectid, uint64_t max_objectid,
+             uint32_t min_type, uint32_t max_type,
+             search_fn fn, void *opaque)
+{
+  struct btrfs_ioctl_search_args args;
+  struct btrfs_ioctl_search_key *sk = &args.key;
+  struct btrfs_ioctl_search_header sh;
+  size_t off;
+  uint32_t i;
+
+  memset (&args, 0, sizeof args);
+  sk->tree_id = tree_id;
+  sk->min_objectid = min_objectid;
+  sk->max_objectid = max_objectid;
+  sk->min_type = min_type;
+  sk->max_type = max_type;
+  sk->max_offset = UINT64_MAX;
+  sk->max_transid = UINT64_MAX;
+
+  for (;;) {
+    sk->nr_items = 4096;
+    if (ioctl (fd, BTRFS_IOC_TREE_SEARCH, &args) == -1)
+      return -1;
+    if (sk->nr_items == 0)
+      return 0;
+
+    for (i = 0, off = 0; i < sk->nr_items; ++i) {
+      memcpy (&sh, args.buf + off, sizeof sh);
+      off += sizeof sh;
+      /* The search key is a range of (objectid, type, offset) tuples,
+       * so other types can be returned in the middle of it.
+       */
+      if (sh.type >= min_type && sh.type <= max_type &&
+          fn (&sh, args.buf + off, opaque) == -1)
+        return -1;
+      off += sh.len;
+
+      sk->min_objectid = sh.objectid;
+      sk->min_type = sh.type;
+      sk->min_offset = sh.offset;
+    }
+
+    /* Carry on after the last key returned. */
+    if (sk->min_offset < UINT64_MAX)
+      sk->min_offset++;
+    else if (sk->min_type < 255) {
+      sk->min_type++;
+      sk->min_offset = 0;
+    }
+    else if (sk->min_objectid < max_objectid) {
+      sk->min_objectid++;
+      sk->min_type = 0;
+      sk->min_offset = 0;
+    }
+    else
+      return 0;
+  }
+}
+
+static struct inventory_entry *
+find_entry (struct inventory *inv, uint64_t id)
+{
+  size_t lo = 0, hi = inv->nr_entries, mid;
+
+  /* The entries are added in the order of the root tree. */
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (inv->entries[mid].id == id)
+      return &inv->entries[mid];
+    if (inv->entries[mid].id < id)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return NULL;
+}
+
+static int
+add_root_item (const struct btrfs_ioctl_search_header *sh,
+               const char *item, void *opaque)
+{
+  struct inventory *inv = opaque;
+  struct inventory_entry *p, *e;
+  struct btrfs_root_item ri;
+
+  if (sh->type == BTRFS_ROOT_BACKREF_KEY) {
+    struct btrfs_root_ref ref;
+    size_t name_len;
+
+    e = find_entry (inv, sh->objectid);
+    if (e == NULL || e->name != NULL || sh->len < sizeof ref)
+      return 0;
+    memcpy (&ref, item, sizeof ref);
+    name_len = le16toh (ref.name_len);
+    if (sizeof ref + name_len > sh->len)
+      return 0;
+    e->top_level_id = sh->offset;
+    e->dirid = le64toh (ref.dirid);
+    e->name = strndup (item + sizeof ref, name_len);
+    return e->name ? 0 : -1;
+  }
+
+  /* BTRFS_ROOT_ITEM_KEY.  Older kernels wrote a shorter root item. */
+  memset (&ri, 0, sizeof ri);
+  memcpy (&ri, item, MIN (sh->len, sizeof ri));
+
+  p = realloc (inv->entries, (inv->nr_entries+1) * sizeof *p);
+  if (p == NULL)
+    return -1;
+  inv->entries = p;
+  e = &inv->entries[inv->nr_entries++];
+  memset (e, 0, sizeof *e);
+  e->id = sh->objectid;
+  e->generation = le64toh (ri.generation);
+  e->flags = le64toh (ri.flags);
+  e->rfer = e->excl = -1;
+  /* The UUIDs are only valid if generation_v2 is up to date. */
+  if (ri.generation_v2 == ri.generation) {
+    memcpy (e->uuid, ri.uuid, sizeof e->uuid);
+    memcpy (e->parent_uuid, ri.parent_uuid, sizeof e->parent_uuid);
+  }
+  return 0;
+}
+
+static int
+add_qgroup_info (const struct btrfs_ioctl_search_header *sh,
+                 const char *item, void *opaque)
+{
+  struct inventory *inv = opaque;
+  struct inventory_entry *e;
+  struct btrfs_qgroup_info_item qi;
+
+  /* Only level 0 qgroups (0/<subvolid>) belong to a subvolume. */
+  if ((sh->offset >> 48) != 0 || sh->len < sizeof qi)
+    return 0;
+  e = find_entry (inv, sh->offset);
+  if (e == NULL)
+    return 0;
+  memcpy (&qi, item, sizeof qi);
+  e->rfer = le64toh (qi.rfer);
+  e->excl = le64toh (qi.excl);
+  return 0;
+}
+
+static int
+find_default (const struct btrfs_ioctl_search_header *sh,
+              const char *item, void *opaque)
+{
+  struct inventory *inv = opaque;
+  struct btrfs_dir_item di;
+  size_t off = 0, name_len, data_len;
+
+  /* An item holds all the names with the same hash. */
+  while (off + sizeof di <= sh->len) {
+    memcpy (&di, item + off, sizeof di);
+    name_len = le16toh (di.name_len);
+    data_len = le16toh (di.data_len);
+    if (off + sizeof di + name_len > sh->len)
+      break;
+    if (name_len == 7 && memcmp (item + off + sizeof di, "default", 7) == 0)
+      inv->default_id = le64toh (di.location.objectid);
+    off += sizeof di + name_len + data_len;
+  }
+  return 0;
+}
+
+/* Resolve the path of subvolume 'e' from the top level subvolume.
+ * Returns NULL if it is not reachable (eg. being deleted).
+ */
+static const char *
+entry_path (int fd, struct inventory *inv, struct inventory_entry *e,
+            int depth)
+{
+  struct btrfs_ioctl_ino_lookup_args lookup;
+  struct inventory_entry *parent;
+  const char *parent_path = "";
+
+  if (e->path || e->name == NULL || depth > 256)
+    return e->path;
+
+  if (e->top_level_id != BTRFS_FS_TREE_OBJECTID) {
+    parent = find_entry (inv, e->top_level_id);
+    if (parent == NULL)
+      return NULL;
+    parent_path = entry_path (fd, inv, parent, depth+1);
+    if (parent_path == NULL)
+      return NULL;
+  }
+
+  /* The directory containing the subvolume, inside its parent.  This
+   * is empty or ends with '/'.
+   */
+  memset (&lookup, 0, sizeof lookup);
+  lookup.treeid = e->top_level_id;
+  lookup.objectid = e->dirid;
+  if (ioctl (fd, BTRFS_IOC_INO_LOOKUP, &lookup) == -1) {
+    perror ("BTRFS_IOC_INO_LOOKUP");
+    return NULL;
+  }
+
+  if (asprintf (&e->path, "%s%s%s%s", parent_path,
+                parent_path[0] ? "/" : "", lookup.name, e->name) == -1) {
+    e->path = NULL;
+    return NULL;
+  }
+  return e->path;
+}
+
+static char *
+format_uuid (const unsigned char *uuid)
+{
+  static const unsigned char zero[BTRFS_UUID_SIZE];
+  char *ret;
+
+  if (memcmp (uuid, zero, BTRFS_UUID_SIZE) == 0)
+    return strdup ("");
+
+  if (asprintf (&ret,
+                "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-"
+                "%02x%02x%02x%02x%02x%02x",
+                uuid[0], uuid[1], uuid[2], uuid[3], uuid[4], uuid[5],
+                uuid[6], uuid[7], uuid[8], uuid[9], uuid[10], uuid[11],
+                uuid[12], uuid[13], uuid[14], uuid[15]) == -1)
+    return NULL;
+  return ret;
+}
+
+guestfs_int_btrfsinventory_list *
+do_btrfs_inventory (const mountable_t *fs)
+{
+  struct inventory inv = { .entries = NULL };
+  guestfs_int_btrfsinventory_list *ret = NULL;
+  struct guestfs_int_btrfsinventory *this;
+  struct inventory_entry *e;
+  char *fs_buf;
+  size_t i, n;
+  int fd = -1;
+
+  fs_buf = mount (fs);
+  if (fs_buf == NULL)
+    return NULL;
+
+  fd = open (fs_buf, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+  if (fd == -1) {
+    reply_with_perror ("open: %s", fs->device);
+    goto out;
+  }
+
+  if (tree_search (fd, BTRFS_ROOT_TREE_OBJECTID,
+                   BTRFS_FIRST_FREE_OBJECTID, BTRFS_LAST_FREE_OBJECTID,
+                   BTRFS_ROOT_ITEM_KEY, BTRFS_ROOT_BACKREF_KEY,
+                   add_root_item, &inv) == -1) {
+    reply_with_perror ("BTRFS_IOC_TREE_SEARCH: %s", fs->device);
+    goto out;
+  }
+
+  /* There is no quota tree if quotas are not enabled. */
+  if (tree_search (fd, BTRFS_QUOTA_TREE_OBJECTID, 0, 0,
+                   BTRFS_QGROUP_INFO_KEY, BTRFS_QGROUP_INFO_KEY,
+                   add_qgroup_info, &inv) == -1 && errno != ENOENT) {
+    reply_with_perror ("BTRFS_IOC_TREE_SEARCH: %s", fs->device);
+    goto out;
+  }
+
+  inv.default_id = BTRFS_FS_TREE_OBJECTID;
+  if (tree_search (fd, BTRFS_ROOT_TREE_OBJECTID,
+                   BTRFS_ROOT_TREE_DIR_OBJECTID, BTRFS_ROOT_TREE_DIR_OBJECTID,
+                   BTRFS_DIR_ITEM_KEY, BTRFS_DIR_ITEM_KEY,
+                   find_default, &inv) == -1) {
+    reply_with_perror ("BTRFS_IOC_TREE_SEARCH: %s", fs->device);
+    goto out;
+  }
+
+  /* Like 'btrfs subvolume list', leave out the subvolumes which are
+   * not linked in the filesystem any more.
+   */
+  for (i = n = 0; i < inv.nr_entries; ++i) {
+    if (entry_path (fd, &inv, &inv.entries[i], 0) != NULL)
+      n++;
+  }
+
+  ret = malloc (sizeof *ret);
+  if (ret == NULL) {
+    reply_with_perror ("malloc");
+    goto out;
+  }
+  ret->guestfs_int_btrfsinventory_list_len = n;
+  ret->guestfs_int_btrfsinventory_list_val =
+    calloc (n, sizeof (struct guestfs_int_btrfsinventory));
+  if (ret->guestfs_int_btrfsinventory_list_val == NULL) {
+    reply_with_perror ("calloc");
+    free (ret);
+    ret = NULL;
+    goto out;
+  }
+
+  for (i = n = 0; i < inv.nr_entries; ++i) {
+    e = &inv.entries[i];
+    if (e->path == NULL)
+      continue;
+
+    this = &ret->guestfs_int_btrfsinventory_list_val[n++];
+    this->btrfsinventory_id = e->id;
+    this->btrfsinventory_top_level_id = e->top_level_id;
+    this->btrfsinventory_path = e->path;
+    e->path = NULL;
+    this->btrfsinventory_generation = e->generation;
+    this->btrfsinventory_uuid = format_uuid (e->uuid);
+    this->btrfsinventory_parent_uuid = format_uuid (e->parent_uuid);
+    this->btrfsinventory_readonly = (e->flags & BTRFS_ROOT_SUBVOL_RDONLY) != 0;
+    this->btrfsinventory_default = e->id == inv.default_id;
+    this->btrfsinventory_rfer = e->rfer;
+    this->btrfsinventory_excl = e->excl;
+    if (this->btrfsinventory_uuid == NULL ||
+        this->btrfsinventory_parent_uuid == NULL) {
+      reply_with_perror ("asprintf");
+      xdr_free ((xdrproc_t) xdr_guestfs_int_btrfsinventory_list,
+                (char *) ret);
+      ret = NULL;
+      goto out;
+    }
+  }
+
+ out:
+  if (fd >= 0)
+    close (fd);
+  for (i = 0; i < inv.nr_entries; ++i) {
+    free (inv.entries[i].name);
+    free (inv.entries[i].path);
+  }
+  free (inv.entries);
+  if (umount (fs_buf, fs) != 0) {
+    if (ret)
+      xdr_free ((xdrproc_t) xdr_guestfs_int_btrfsinventory_list,
+                (char *) ret);
+    return NULL;
+  }
+
+  return ret;
+}
+
+#else /* !HAVE_LINUX_BTRFS_H */
+
+guestfs_int_btrfsinventory_list *
+do_btrfs_inventory (const mountable_t *fs)
+{
+  NOT_SUPPORTED (NULL, "btrfs ioctls are not supported by this appliance");
+}
+
+#endif /* !HAVE_LINUX_BTRFS_H */
@@ -20,17 +20,27 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <fts.h>
+#include <pthread.h>
 #include <sys/stat.h>
 
+#include "c-ctype.h"
+#include "md5.h"
+#include "sha1.h"
+#include "sha256.h"
+#include "sha512.h"
+
 #include "guestfs_protocol.h"
 #include "daemon.h"
 #include "actions.h"
 
-GUESTFSD_EXT_CMD(str_find, find);
-GUESTFSD_EXT_CMD(str_xargs, xargs);
 GUESTFSD_EXT_CMD(str_cksum, cksum);
 GUESTFSD_EXT_CMD(str_md5sum, md5sum);
 GUESTFSD_EXT_CMD(str_sha1sum, sha1sum);
@@ -126,26 +136,653 @@ do_checksum_device (const char *csumtype, const char *device)
   return checksum (csumtype, fd);
 }
 
+/* Checksums of many files are computed in the daemon, by a pool of
+ * threads (one per vCPU), instead of running the external programs
+ * above.  The results are the same as the programs would print.
+ */
+
+/* Size of the buffer each thread reads files into. */
+#define CSUM_BUFFER_SIZE (1024 * 1024)
+
+/* Files queued or being checksummed at once, per thread. */
+#define JOBS_PER_THREAD 16
+
+union csum_ctx {
+  struct md5_ctx md5;
+  struct sha1_ctx sha1;
+  struct sha256_ctx sha256;
+  struct sha512_ctx sha512;
+  uint32_t crc;
+};
+
+struct csum_type {
+  const char *name;
+  void (*init) (union csum_ctx *ctx);
+  void (*process) (const void *buf, size_t len, union csum_ctx *ctx);
+  void *(*finish) (union csum_ctx *ctx, void *resbuf);
+  size_t digest_size;           /* 0 for crc */
+};
+
+#define DEFINE_HASH(name, var, process_name)                            \
+  static void                                                           \
+  csum_##name##_init (union csum_ctx *ctx)                              \
+  {                                                                     \
+    name##_init_ctx (&ctx->var);                                        \
+  }                                                                     \
+  static void                                                           \
+  csum_##name##_process (const void *buf, size_t len,                   \
+                         union csum_ctx *ctx)                           \
+  {                                                                     \
+    process_name##_process_bytes (buf, len, &ctx->var);                 \
+  }                                                                     \
+  static void *                                                         \
+  csum_##name##_finish (union csum_ctx *ctx, void *resbuf)              \
+  {                                                                     \
+    return name##_finish_ctx (&ctx->var, resbuf);                       \
+  }
+
+DEFINE_HASH(md5, md5, md5)
+DEFINE_HASH(sha1, sha1, sha1)
+DEFINE_HASH(sha224, sha256, sha256)
+DEFINE_HASH(sha256, sha256, sha256)
+DEFINE_HASH(sha384, sha512, sha512)
+DEFINE_HASH(sha512, sha512, sha512)
+
+/* The CRC used by POSIX cksum(1). */
+static uint32_t crc_table[256];
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
+
+static void
+make_crc_table (void)
+{
+  uint32_t i, j, c;
+
+  for (i = 0; i < 256; ++i) {
+    c = i << 24;
+    for (j = 0; j < 8; ++j)
+      c = c & 0x80000000 ? (c << 1) ^ 0x04c11db7 : c << 1;
+    crc_table[i] = c;
+  }
+}
+
+static void
+csum_crc_init (union csum_ctx *ctx)
+{
+  pthread_once (&crc_table_once, make_crc_table);
+  ctx->crc = 0;
+}
+
+static void
+csum_crc_process (const void *buf, size_t len, union csum_ctx *ctx)
+{
+  const unsigned char *p = buf;
+  uint32_t crc = ctx->crc;
+  size_t i;
+
+  for (i = 0; i < len; ++i)
+    crc = (crc << 8) ^ crc_table[(crc >> 24) ^ p[i]];
+  ctx->crc = crc;
+}
+
+static const struct csum_type csum_types[] = {
+  { "crc", csum_crc_init, csum_crc_process, NULL, 0 },
+  { "md5", csum_md5_init, csum_md5_process, csum_md5_finish,
+    MD5_DIGEST_SIZE },
+  { "sha1", csum_sha1_init, csum_sha1_process, csum_sha1_finish,
+    SHA1_DIGEST_SIZE },
+  { "sha224", csum_sha224_init, csum_sha224_process, csum_sha224_finish,
+    SHA224_DIGEST_SIZE },
+  { "sha256", csum_sha256_init, csum_sha256_process, csum_sha256_finish,
+    SHA256_DIGEST_SIZE },
+  { "sha384", csum_sha384_init, csum_sha384_process, csum_sha384_finish,
+    SHA384_DIGEST_SIZE },
+  { "sha512", csum_sha512_init, csum_sha512_process, csum_sha512_finish,
+    SHA512_DIGEST_SIZE },
+};
+
+static const struct csum_type *
+csum_type_of_name (const char *csumtype)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof csum_types / sizeof csum_types[0]; ++i)
+    if (STRCASEEQ (csumtype, csum_types[i].name))
+      return &csum_types[i];
+
+  reply_with_error ("unknown checksum type, expecting crc|md5|sha1|sha224|sha256|sha384|sha512");
+  return NULL;
+}
+
+/* A file, or a block of a device, to checksum.  Files are opened by
+ * the main thread (so the threads never look up paths in the guest),
+ * and the thread which checksums a file closes it.  Blocks share the
+ * file descriptor of the device, which the main thread closes.
+ *
+ * If 'fd2' is not -1, the block is compared with the same block of
+ * 'fd2' instead of being checksummed.
+ */
+struct csum_job {
+  int fd;                       /* -1 if the file could not be opened */
+  int fd2;
+  char *name;                   /* name to print, NULL for blocks */
+  int64_t offset, length;       /* block, or length -1 for a whole file */
+  int done;                     /* set when 'sum' or 'err' is set */
+  int err;                      /* errno, if reading the file failed */
+  int differs;                  /* set if compared blocks differ */
+  uint64_t size;
+  unsigned char digest[SHA512_DIGEST_SIZE];
+  char sum[2*SHA512_DIGEST_SIZE + 1];
+};
+
+/* The jobs are a ring buffer.  The main thread adds jobs at
+ * 'head + nr_jobs', the threads take them at 'next_job', and the main
+ * thread prints them in order from 'head'.
+ */
+struct csum_pool {
+  const struct csum_type *type;
+  pthread_t *threads;
+  size_t nr_threads;
+  struct csum_job *jobs;
+  size_t max_jobs, head, nr_jobs, next_job;
+  int quit;
+  pthread_mutex_t lock;
+  pthread_cond_t job_added;     /* signalled when a job is added */
+  pthread_cond_t job_done;      /* signalled when a job is done */
+
+  /* Output, which is sent in chunks of GUESTFS_MAX_CHUNK_SIZE.  NULL
+   * if the call has no FileOut parameter.
+   */
+  char *out;
+  size_t out_len;
+
+  void *data;                   /* for the print_job function */
+};
+
+static int
+checksum_job (const struct csum_type *type, char *buf, struct csum_job *job)
+{
+  union csum_ctx ctx;
+  uint64_t size = 0, n;
+  ssize_t r;
+  size_t i;
+
+  /* Tell the kernel to read ahead aggressively. */
+  if (job->length == -1)
+    posix_fadvise (job->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  type->init (&ctx);
+  for (;;) {
+    if (call_cancelled ()) {
+      errno = EINTR;
+      return -1;
+    }
+    if (job->length == -1)
+      r = read (job->fd, buf, CSUM_BUFFER_SIZE);
+    else {
+      n = job->length - size;
+      if (n == 0)
+        break;
+      if (n > CSUM_BUFFER_SIZE)
+        n = CSUM_BUFFER_SIZE;
+      r = pread (job->fd, buf, n, job->offset + size);
+    }
+    if (r == 0)
+      break;
+    if (r == -1) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    type->process (buf, r, &ctx);
+    size += r;
+  }
+
+  job->size = size;
+  if (type->digest_size == 0) {
+    /* cksum also covers the length, least significant byte first. */
+    for (n = size; n != 0; n >>= 8) {
+      const unsigned char c = n & 0xff;
+      type->process (&c, 1, &ctx);
+    }
+    snprintf (job->sum, sizeof job->sum, "%" PRIu32, ~ctx.crc);
+  }
+  else {
+    type->finish (&ctx, job->digest);
+    for (i = 0; i < type->digest_size; ++i)
+      sprintf (&job->sum[2*i], "%02x", job->digest[i]);
+  }
+
+  return 0;
+}
+
+/* Compare the block of 'fd' and 'fd2', each read into half of 'buf'. */
+static int
+compare_job (char *buf, struct csum_job *job)
+{
+  const size_t half = CSUM_BUFFER_SIZE / 2;
+  uint64_t size = 0, n;
+  ssize_t r1, r2;
+
+  while (size < (uint64_t) job->length) {
+    n = job->length - size;
+    if (n > half)
+      n = half;
+    if (call_cancelled ()) {
+      errno = EINTR;
+      return -1;
+    }
+    r1 = pread (job->fd, buf, n, job->offset + size);
+    if (r1 == -1 && errno == EINTR)
+      continue;
+    if (r1 == -1)
+      return -1;
+    r2 = pread (job->fd2, buf + half, r1, job->offset + size);
+    if (r2 == -1 && errno == EINTR)
+      continue;
+    if (r2 == -1)
+      return -1;
+    if (r1 == 0 || r2 != r1) {
+      errno = EIO;              /* device shrank */
+      return -1;
+    }
+    if (memcmp (buf, buf + half, r1) != 0) {
+      job->differs = 1;
+      break;
+    }
+    size += r1;
+  }
+
+  job->size = size;
+  return 0;
+}
+
+static void *
+csum_thread (void *vp)
+{
+  struct csum_pool *pool = vp;
+  char *buf;
+  int err;
+
+  /* Aligned, so the kernel can copy whole pages. */
+  err = posix_memalign ((void **) &buf, 4096, CSUM_BUFFER_SIZE);
+  if (err != 0)
+    buf = NULL;
+
+  for (;;) {
+    struct csum_job *job;
+
+    pthread_mutex_lock (&pool->lock);
+    while (!pool->quit && pool->next_job == pool->head + pool->nr_jobs)
+      pthread_cond_wait (&pool->job_added, &pool->lock);
+    if (pool->next_job == pool->head + pool->nr_jobs) {
+      pthread_mutex_unlock (&pool->lock);
+      break;
+    }
+    job = &pool->jobs[pool->next_job++ % pool->max_jobs];
+    pthread_mutex_unlock (&pool->lock);
+
+    if (job->fd == -1)
+      ;
+    else if (buf == NULL)
+      job->err = err;
+    else if (job->fd2 >= 0) {
+      if (compare_job (buf, job) == -1)
+        job->err = errno;
+    }
+    else if (checksum_job (pool->type, buf, job) == -1)
+      job->err = errno;
+    if (job->fd >= 0 && job->length == -1) {
+      close (job->fd);
+      job->fd = -1;
+    }
+
+    pthread_mutex_lock (&pool->lock);
+    job->done = 1;
+    pthread_cond_broadcast (&pool->job_done);
+    pthread_mutex_unlock (&pool->lock);
+  }
+
+  free (buf);
+  return NULL;
+}
+
+/* Start the threads.  This has to be called before reply (NULL, NULL)
+ * because it can fail.  'file_out' is true if the call has a FileOut
+ * parameter to write the output to.
+ */
+static struct csum_pool *
+start_pool (const struct csum_type *type, int file_out)
+{
+  struct csum_pool *pool;
+  long nr_cpus;
+  size_t i;
+  int err;
+
+  pool = calloc (1, sizeof *pool);
+  if (pool == NULL) {
+    reply_with_perror ("calloc");
+    return NULL;
+  }
+  pool->type = type;
+
+  nr_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  pool->nr_threads = nr_cpus > 0 ? nr_cpus : 1;
+  pool->max_jobs = pool->nr_threads * JOBS_PER_THREAD;
+
+  pool->threads = calloc (pool->nr_threads, sizeof (pthread_t));
+  pool->jobs = calloc (pool->max_jobs, sizeof (struct csum_job));
+  if (file_out)
+    pool->out = malloc (GUESTFS_MAX_CHUNK_SIZE);
+  if (pool->threads == NULL || pool->jobs == NULL ||
+      (file_out && pool->out == NULL)) {
+    reply_with_perror ("malloc");
+    goto error;
+  }
+
+  pthread_mutex_init (&pool->lock, NULL);
+  pthread_cond_init (&pool->job_added, NULL);
+  pthread_cond_init (&pool->job_done, NULL);
+
+  for (i = 0; i < pool->nr_threads; ++i) {
+    err = pthread_create (&pool->threads[i], NULL, csum_thread, pool);
+    if (err != 0) {
+      if (i == 0) {
+        reply_with_error_errno (err, "pthread_create");
+        goto error;
+      }
+      /* Carry on with fewer threads. */
+      pool->nr_threads = i;
+      break;
+    }
+  }
+
+  if (verbose)
+    fprintf (stderr, "checksum: started %zu threads\n", pool->nr_threads);
+
+  return pool;
+
+ error:
+  free (pool->threads);
+  free (pool->jobs);
+  free (pool->out);
+  free (pool);
+  return NULL;
+}
+
+/* Add a line to the output, sending it when the chunk is full. */
+static int
+add_output (struct csum_pool *pool, const char *line, size_t len)
+{
+  while (len > 0) {
+    size_t n = GUESTFS_MAX_CHUNK_SIZE - pool->out_len;
+
+    if (n > len)
+      n = len;
+    memcpy (pool->out + pool->out_len, line, n);
+    pool->out_len += n;
+    line += n;
+    len -= n;
+
+    if (pool->out_len == GUESTFS_MAX_CHUNK_SIZE) {
+      if (send_file_write (pool->out, pool->out_len) < 0)
+        return -1;
+      pool->out_len = 0;
+    }
+  }
+
+  return 0;
+}
+
+/* Print the line for a job, or otherwise use its result.  Returns -1
+ * to stop, eg. if the transfer was cancelled.
+ */
+typedef int (*print_job_fn) (struct csum_pool *pool, struct csum_job *job);
+
+/* Wait for the oldest job to finish, print it and remove it. */
+static int
+retire_job (struct csum_pool *pool, print_job_fn print_job)
+{
+  struct csum_job *job = &pool->jobs[pool->head % pool->max_jobs];
+  struct timespec ts;
+  int r;
+
+  /* Wake up regularly to check whether the call has been cancelled,
+   * so the threads see it.
+   */
+  pthread_mutex_lock (&pool->lock);
+  while (!job->done) {
+    clock_gettime (CLOCK_REALTIME, &ts);
+    ts.tv_nsec += 100000000;
+    if (ts.tv_nsec >= 1000000000) {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait (&pool->job_done, &pool->lock, &ts);
+    pthread_mutex_unlock (&pool->lock);
+    call_cancelled ();
+    pthread_mutex_lock (&pool->lock);
+  }
+  pthread_mutex_unlock (&pool->lock);
+
+  r = print_job (pool, job);
+  free (job->name);
+
+  pthread_mutex_lock (&pool->lock);
+  pool->head++;
+  pool->nr_jobs--;
+  pthread_mutex_unlock (&pool->lock);
+
+  return r;
+}
+
+/* Get a free job, retiring the oldest one if the queue is full.
+ * Returns NULL if that fails.
+ */
+static struct csum_job *
+get_free_job (struct csum_pool *pool, print_job_fn print_job)
+{
+  struct csum_job *job;
+
+  if (pool->nr_jobs == pool->max_jobs &&
+      retire_job (pool, print_job) == -1)
+    return NULL;
+
+  job = &pool->jobs[(pool->head + pool->nr_jobs) % pool->max_jobs];
+  memset (job, 0, sizeof *job);
+  job->fd2 = -1;
+  return job;
+}
+
+/* Hand the job from get_free_job to the threads. */
+static void
+queue_job (struct csum_pool *pool)
+{
+  pthread_mutex_lock (&pool->lock);
+  pool->nr_jobs++;
+  pthread_cond_signal (&pool->job_added);
+  pthread_mutex_unlock (&pool->lock);
+}
+
+/* Queue a file to be checksummed.  This takes ownership of 'fd' and
+ * 'name'.
+ */
+static int
+add_job (struct csum_pool *pool, int fd, char *name, print_job_fn print_job)
+{
+  struct csum_job *job;
+
+  job = get_free_job (pool, print_job);
+  if (job == NULL) {
+    if (fd >= 0)
+      close (fd);
+    free (name);
+    return -1;
+  }
+
+  job->fd = fd;
+  job->name = name;
+  job->length = -1;
+  queue_job (pool);
+  return 0;
+}
+
+/* Queue a block of the device 'fd' to be checksummed. */
+static int
+add_block_job (struct csum_pool *pool, int fd, int64_t offset, int64_t length,
+               print_job_fn print_job)
+{
+  struct csum_job *job;
+
+  job = get_free_job (pool, print_job);
+  if (job == NULL)
+    return -1;
+
+  job->fd = fd;
+  job->offset = offset;
+  job->length = length;
+  queue_job (pool);
+  return 0;
+}
+
+/* Queue a block of the devices 'fd' and 'fd2' to be compared. */
+static int
+add_compare_job (struct csum_pool *pool, int fd, int fd2,
+                 int64_t offset, int64_t length, print_job_fn print_job)
+{
+  struct csum_job *job;
+
+  job = get_free_job (pool, print_job);
+  if (job == NULL)
+    return -1;
+
+  job->fd = fd;
+  job->fd2 = fd2;
+  job->offset = offset;
+  job->length = length;
+  queue_job (pool);
+  return 0;
+}
+
+/* Print the remaining jobs (unless 'r' is -1 already), stop the
+ * threads and, if there is a FileOut parameter, send the end of the
+ * file.
+ */
+static int
+finish_pool (struct csum_pool *pool, print_job_fn print_job, int r)
+{
+  size_t i;
+
+  while (pool->nr_jobs > 0) {
+    if (r == 0)
+      r = retire_job (pool, print_job);
+    else {
+      /* Throw away the remaining jobs. */
+      struct csum_job *job = &pool->jobs[pool->head % pool->max_jobs];
+
+      pthread_mutex_lock (&pool->lock);
+      while (!job->done)
+        pthread_cond_wait (&pool->job_done, &pool->lock);
+      pool->head++;
+      pool->nr_jobs--;
+      pthread_mutex_unlock (&pool->lock);
+      free (job->name);
+    }
+  }
+
+  pthread_mutex_lock (&pool->lock);
+  pool->quit = 1;
+  pthread_cond_broadcast (&pool->job_added);
+  pthread_mutex_unlock (&pool->lock);
+  for (i = 0; i < pool->nr_threads; ++i)
+    pthread_join (pool->threads[i], NULL);
+
+  if (pool->out != NULL) {
+    if (r == 0 && pool->out_len > 0 &&
+        send_file_write (pool->out, pool->out_len) < 0)
+      r = -1;
+
+    if (r == 0) {
+      if (send_file_end (0))    /* Normal end of file. */
+        r = -1;
+    }
+    else
+      send_file_end (1);        /* Cancel. */
+  }
+
+  pthread_mutex_destroy (&pool->lock);
+  pthread_cond_destroy (&pool->job_added);
+  pthread_cond_destroy (&pool->job_done);
+  free (pool->threads);
+  free (pool->jobs);
+  free (pool->out);
+  free (pool);
+
+  return r;
+}
+
+/* Print a line in the format of md5sum etc, or cksum for crc. */
+static int
+print_tree_job (struct csum_pool *pool, struct csum_job *job)
+{
+  CLEANUP_FREE char *line = NULL;
+  int len;
+
+  if (job->err != 0) {
+    fprintf (stderr, "checksums_out: %s: %s\n", job->name, strerror (job->err));
+    return -1;
+  }
+
+  if (pool->type->digest_size == 0)
+    len = asprintf (&line, "%s %" PRIu64 " %s\n", job->sum, job->size, job->name);
+  else if (strpbrk (job->name, "\\\n") == NULL)
+    len = asprintf (&line, "%s  %s\n", job->sum, job->name);
+  else {
+    /* Like coreutils, escape backslash and newline in the name, and
+     * mark the line with a leading backslash.
+     */
+    CLEANUP_FREE char *escaped = malloc (2 * strlen (job->name) + 1);
+    const char *p;
+    char *q;
+
+    if (escaped == NULL) {
+      perror ("malloc");
+      return -1;
+    }
+    for (p = job->name, q = escaped; *p; ++p) {
+      if (*p == '\\')
+        *q++ = '\\', *q++ = '\\';
+      else if (*p == '\n')
+        *q++ = '\\', *q++ = 'n';
+      else
+        *q++ = *p;
+    }
+    *q = '\0';
+    len = asprintf (&line, "\\%s  %s\n", job->sum, escaped);
+  }
+  if (len == -1) {
+    perror ("asprintf");
+    return -1;
+  }
+
+  return add_output (pool, line, len);
+}
+
 /* Has one FileOut parameter. */
 int
 do_checksums_out (const char *csumtype, const char *dir)
 {
+  const struct csum_type *type;
+  struct csum_pool *pool;
   struct stat statbuf;
-  int r;
-  const char *program;
-  CLEANUP_FREE char *str = NULL;
   CLEANUP_FREE char *sysrootdir = NULL;
-  CLEANUP_FREE char *cmd = NULL;
-  FILE *fp;
-
-  str = malloc (GUESTFS_MAX_CHUNK_SIZE);
-  if (str == NULL) {
-    reply_with_perror ("malloc");
-    return -1;
-  }
+  char *paths[2];
+  FTS *fts;
+  FTSENT *ent;
+  size_t prefix_len;
+  int r = 0;
 
-  program = program_of_csum (csumtype);
-  if (program == NULL)
+  type = csum_type_of_name (csumtype);
+  if (type == NULL)
     return -1;
 
   sysrootdir = sysroot_path (dir);
@@ -154,8 +791,7 @@ do_checksums_out (const char *csumtype, const char *dir)
     return -1;
   }
 
-  r = stat (sysrootdir, &statbuf);
-  if (r == -1) {
+  if (stat (sysrootdir, &statbuf) == -1) {
     reply_with_perror ("%s", dir);
     return -1;
   }
@@ -164,50 +800,818 @@ do_checksums_out (const char *csumtype, const char *dir)
     return -1;
   }
 
-  cmd = NULL;
-  if (asprintf_nowarn (&cmd, "cd %Q && %s -type f -print0 | %s -0 %s",
-                       sysrootdir, str_find, str_xargs, program) == -1) {
-    reply_with_perror ("asprintf");
+  /* So that the names below the directory are easy to find. */
+  prefix_len = strlen (sysrootdir);
+  while (prefix_len > 1 && sysrootdir[prefix_len-1] == '/')
+    sysrootdir[--prefix_len] = '\0';
+
+  /* Walk the tree as 'cd dir && find -type f' does, not following
+   * symlinks except for the directory itself.
+   */
+  paths[0] = sysrootdir;
+  paths[1] = NULL;
+  fts = fts_open (paths, FTS_PHYSICAL | FTS_COMFOLLOW | FTS_NOCHDIR, NULL);
+  if (fts == NULL) {
+    reply_with_perror ("%s", dir);
     return -1;
   }
 
-  if (verbose)
-    fprintf (stderr, "%s\n", cmd);
+  pool = start_pool (type, 1);
+  if (pool == NULL) {
+    fts_close (fts);
+    return -1;
+  }
+
+  /* Now we must send the reply message, before the file contents.  After
+   * this there is no opportunity in the protocol to send any error
+   * message back.  Instead we can only cancel the transfer.
+   */
+  reply (NULL, NULL);
+
+  while (r == 0 && (ent = fts_read (fts)) != NULL) {
+    char *name;
+    int fd;
+
+    switch (ent->fts_info) {
+    case FTS_F:
+      /* Print names relative to the directory, as find prints them. */
+      if (asprintf (&name, ".%s", ent->fts_path + prefix_len) == -1) {
+        perror ("asprintf");
+        r = -1;
+        break;
+      }
+      fd = open (ent->fts_accpath, O_RDONLY|O_NOFOLLOW|O_NOCTTY|O_CLOEXEC);
+      if (fd == -1) {
+        fprintf (stderr, "checksums_out: %s: %m\n", name);
+        free (name);
+        r = -1;
+        break;
+      }
+      r = add_job (pool, fd, name, print_tree_job);
+      break;
+
+    case FTS_DNR:
+    case FTS_ERR:
+    case FTS_NS:
+      /* find(1) reports these but carries on. */
+      fprintf (stderr, "checksums_out: %s: %s\n",
+               ent->fts_path, strerror (ent->fts_errno));
+      break;
+
+    default:
+      break;
+    }
+  }
+  if (r == 0 && errno != 0 && ent == NULL) {
+    fprintf (stderr, "fts_read: %s: %m\n", dir);
+    r = -1;
+  }
+  fts_close (fts);
+
+  return finish_pool (pool, print_tree_job, r);
+}
+
+/* Print just the checksum, or an empty line if there is none. */
+static int
+print_list_job (struct csum_pool *pool, struct csum_job *job)
+{
+  CLEANUP_FREE char *line = NULL;
+  int len;
+
+  if (job->err != 0)
+    fprintf (stderr, "internal_checksums_out: %s: %s\n",
+             job->name, strerror (job->err));
+
+  len = asprintf (&line, "%s\n", job->err == 0 ? job->sum : "");
+  if (len == -1) {
+    perror ("asprintf");
+    return -1;
+  }
+
+  return add_output (pool, line, len);
+}
+
+/* Has one FileOut parameter. */
+int
+do_internal_checksums_out (const char *csumtype, char *const *paths)
+{
+  const struct csum_type *type;
+  struct csum_pool *pool;
+  size_t i;
+  int r = 0;
+
+  type = csum_type_of_name (csumtype);
+  if (type == NULL)
+    return -1;
+
+  for (i = 0; paths[i] != NULL; ++i) {
+    if (paths[i][0] != '/') {
+      reply_with_error ("%s: path must start with a / character", paths[i]);
+      return -1;
+    }
+  }
 
-  fp = popen (cmd, "r");
-  if (fp == NULL) {
-    reply_with_perror ("%s", cmd);
+  pool = start_pool (type, 1);
+  if (pool == NULL)
+    return -1;
+
+  /* Now we must send the reply message, before the file contents.
+   * Files which cannot be checksummed are written as empty lines,
+   * since we can no longer send an error for them.
+   */
+  reply (NULL, NULL);
+
+  for (i = 0; r == 0 && paths[i] != NULL; ++i) {
+    char *name;
+    int fd;
+
+    name = strdup (paths[i]);
+    if (name == NULL) {
+      perror ("strdup");
+      r = -1;
+      break;
+    }
+
+    CHROOT_IN;
+    fd = open (paths[i], O_RDONLY|O_NOCTTY|O_CLOEXEC);
+    CHROOT_OUT;
+    if (fd == -1)
+      fprintf (stderr, "internal_checksums_out: %s: %m\n", paths[i]);
+
+    r = add_job (pool, fd, name, print_list_job);
+  }
+
+  return finish_pool (pool, print_list_job, r);
+}
+
+/* Checksums of devices as a tree: the device is split into blocks
+ * which are checksummed in parallel, and the tree checksum is the
+ * checksum of the (binary) block checksums in order.
+ */
+
+#define DEFAULT_TREE_BLOCKSIZE (1024 * 1024)
+
+struct device_tree {
+  const char *device;
+  int64_t size;
+  union csum_ctx ctx;           /* checksum of the block checksums */
+};
+
+/* Open the device and check the arguments, before reply. */
+static int
+open_device_tree (const char *csumtype, const char *device,
+                  int64_t blocksize,
+                  const struct csum_type **type_r, struct device_tree *tree)
+{
+  int fd;
+
+  *type_r = csum_type_of_name (csumtype);
+  if (*type_r == NULL)
+    return -1;
+  if ((*type_r)->digest_size == 0) {
+    reply_with_error ("%s: checksum type not supported for tree checksums",
+                      csumtype);
+    return -1;
+  }
+
+  if (blocksize <= 0 || blocksize % 512 != 0) {
+    reply_with_error ("blocksize must be a positive multiple of 512");
+    return -1;
+  }
+
+  fd = open (device, O_RDONLY|O_CLOEXEC);
+  if (fd == -1) {
+    reply_with_perror ("%s", device);
+    return -1;
+  }
+
+  tree->device = device;
+  tree->size = lseek (fd, 0, SEEK_END);
+  if (tree->size == -1) {
+    reply_with_perror ("lseek: %s", device);
+    close (fd);
+    return -1;
+  }
+  posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  (*type_r)->init (&tree->ctx);
+
+  return fd;
+}
+
+/* Queue every block of the device. */
+static int
+add_device_blocks (struct csum_pool *pool, int fd, int64_t blocksize,
+                   print_job_fn print_job)
+{
+  struct device_tree *tree = pool->data;
+  int64_t offset, length;
+
+  for (offset = 0; offset < tree->size; offset += blocksize) {
+    length = tree->size - offset;
+    if (length > blocksize)
+      length = blocksize;
+    if (add_block_job (pool, fd, offset, length, print_job) == -1)
+      return -1;
+  }
+
+  return 0;
+}
+
+/* Fold the block checksum into the tree checksum. */
+static int
+add_to_tree (struct csum_pool *pool, struct csum_job *job)
+{
+  struct device_tree *tree = pool->data;
+
+  if (job->err == 0 && job->size != (uint64_t) job->length)
+    job->err = EIO;             /* device shrank */
+  if (job->err != 0)
+    return -1;
+
+  pool->type->process (job->digest, pool->type->digest_size, &tree->ctx);
+  notify_progress (job->offset + job->length, tree->size);
+  return 0;
+}
+
+static int
+tree_job (struct csum_pool *pool, struct csum_job *job)
+{
+  struct device_tree *tree = pool->data;
+
+  if (add_to_tree (pool, job) == -1) {
+    reply_with_error_errno (job->err, "%s: offset %" PRIi64,
+                            tree->device, job->offset);
+    return -1;
+  }
+  return 0;
+}
+
+/* Takes optional arguments, consult optargs_bitmask. */
+char *
+do_checksum_device_tree (const char *csumtype, const char *device,
+                         int64_t blocksize)
+{
+  const struct csum_type *type;
+  struct csum_pool *pool;
+  struct device_tree tree;
+  unsigned char digest[SHA512_DIGEST_SIZE];
+  char *ret;
+  size_t i;
+  int fd, r;
+
+  if (!(optargs_bitmask & GUESTFS_CHECKSUM_DEVICE_TREE_BLOCKSIZE_BITMASK))
+    blocksize = DEFAULT_TREE_BLOCKSIZE;
+
+  fd = open_device_tree (csumtype, device, blocksize, &type, &tree);
+  if (fd == -1)
+    return NULL;
+
+  pool = start_pool (type, 0);
+  if (pool == NULL) {
+    close (fd);
+    return NULL;
+  }
+  pool->data = &tree;
+
+  r = add_device_blocks (pool, fd, blocksize, tree_job);
+  r = finish_pool (pool, tree_job, r);
+  close (fd);
+  if (r == -1)
+    return NULL;
+
+  type->finish (&tree.ctx, digest);
+  ret = malloc (2 * type->digest_size + 1);
+  if (ret == NULL) {
+    reply_with_perror ("malloc");
+    return NULL;
+  }
+  for (i = 0; i < type->digest_size; ++i)
+    sprintf (&ret[2*i], "%02x", digest[i]);
+
+  return ret;                   /* caller frees */
+}
+
+static int
+blocks_job (struct csum_pool *pool, struct csum_job *job)
+{
+  struct device_tree *tree = pool->data;
+  char line[2*SHA512_DIGEST_SIZE + 2];
+  int len;
+
+  if (add_to_tree (pool, job) == -1) {
+    fprintf (stderr, "checksum_device_blocks: %s: offset %" PRIi64 ": %s\n",
+             tree->device, job->offset, strerror (job->err));
     return -1;
   }
 
+  len = snprintf (line, sizeof line, "%s\n", job->sum);
+  return add_output (pool, line, len);
+}
+
+/* Has one FileOut parameter. */
+/* Takes optional arguments, consult optargs_bitmask. */
+int
+do_checksum_device_blocks (const char *csumtype, const char *device,
+                           int64_t blocksize)
+{
+  const struct csum_type *type;
+  struct csum_pool *pool;
+  struct device_tree tree;
+  int fd, r;
+
+  if (!(optargs_bitmask & GUESTFS_CHECKSUM_DEVICE_BLOCKS_BLOCKSIZE_BITMASK))
+    blocksize = DEFAULT_TREE_BLOCKSIZE;
+
+  fd = open_device_tree (csumtype, device, blocksize, &type, &tree);
+  if (fd == -1)
+    return -1;
+
+  pool = start_pool (type, 1);
+  if (pool == NULL) {
+    close (fd);
+    return -1;
+  }
+  pool->data = &tree;
+
   /* Now we must send the reply message, before the file contents.  After
    * this there is no opportunity in the protocol to send any error
    * message back.  Instead we can only cancel the transfer.
    */
   reply (NULL, NULL);
 
-  while ((r = fread (str, 1, GUESTFS_MAX_CHUNK_SIZE, fp)) > 0) {
-    if (send_file_write (str, r) < 0) {
-      pclose (fp);
+  r = add_device_blocks (pool, fd, blocksize, blocks_job);
+  r = finish_pool (pool, blocks_job, r);
+  close (fd);
+
+  return r;
+}
+
+/* Changed ranges of a device, compared either with another device or
+ * with the block checksums written by checksum_device_blocks.  The
+ * ranges listed in 'zeroes' are known to read as zeroes in both, so
+ * blocks inside them are not read.
+ */
+
+struct zero_range {
+  int64_t offset, length;
+};
+
+struct changed_ranges {
+  const char *device;
+  int64_t size;                 /* size compared */
+  int64_t blocksize;
+  struct zero_range *zeroes;
+  size_t nr_zeroes, next_zero;
+  unsigned char *sums;          /* binary block checksums */
+  size_t nr_sums, sums_alloc;
+  unsigned char zero_sum[SHA512_DIGEST_SIZE]; /* of a block of zeroes */
+  guestfs_int_blockrange_list *ret;
+};
+
+static int
+compare_zero_ranges (const void *zv1, const void *zv2)
+{
+  const struct zero_range *z1 = zv1, *z2 = zv2;
+
+  return z1->offset < z2->offset ? -1 : z1->offset > z2->offset;
+}
+
+/* Parse the "offset length" strings passed by the library. */
+static int
+parse_zero_ranges (char *const *zeroes, struct changed_ranges *cr)
+{
+  size_t i, n = count_strings (zeroes);
+
+  cr->zeroes = calloc (n > 0 ? n : 1, sizeof (struct zero_range));
+  if (cr->zeroes == NULL) {
+    reply_with_perror ("calloc");
+    return -1;
+  }
+
+  for (i = 0; i < n; ++i) {
+    struct zero_range *z = &cr->zeroes[i];
+
+    if (sscanf (zeroes[i], "%" SCNi64 " %" SCNi64,
+                &z->offset, &z->length) != 2 ||
+        z->offset < 0 || z->length < 0) {
+      reply_with_error ("invalid zero range: %s", zeroes[i]);
       return -1;
     }
   }
+  cr->nr_zeroes = n;
+  qsort (cr->zeroes, n, sizeof (struct zero_range), compare_zero_ranges);
+
+  return 0;
+}
+
+/* Returns true if the block is known to read as zeroes.  The blocks
+ * must be asked about in order.
+ */
+static int
+is_zero_block (struct changed_ranges *cr, int64_t offset, int64_t length)
+{
+  while (cr->next_zero < cr->nr_zeroes) {
+    const struct zero_range *z = &cr->zeroes[cr->next_zero];
+
+    if (z->offset + z->length > offset)
+      return z->offset <= offset && offset + length <= z->offset + z->length;
+    cr->next_zero++;
+  }
+  return 0;
+}
+
+/* Add a changed range, merging it with the previous one if they
+ * touch.  The ranges may be added out of order, see
+ * sort_changed_ranges.
+ */
+static int
+add_changed_range (struct changed_ranges *cr, int64_t offset, int64_t length)
+{
+  guestfs_int_blockrange_list *ret = cr->ret;
+  guestfs_int_blockrange *v;
+  size_t n = ret->guestfs_int_blockrange_list_len;
+
+  if (n > 0) {
+    v = &ret->guestfs_int_blockrange_list_val[n-1];
+    if (v->br_start + v->br_size == offset) {
+      v->br_size += length;
+      return 0;
+    }
+  }
+
+  v = realloc (ret->guestfs_int_blockrange_list_val,
+               (n+1) * sizeof (guestfs_int_blockrange));
+  if (v == NULL) {
+    reply_with_perror ("realloc");
+    return -1;
+  }
+  ret->guestfs_int_blockrange_list_val = v;
+  v[n].br_start = offset;
+  v[n].br_size = length;
+  ret->guestfs_int_blockrange_list_len = n+1;
+  return 0;
+}
+
+static int
+compare_blockranges (const void *bv1, const void *bv2)
+{
+  const guestfs_int_blockrange *b1 = bv1, *b2 = bv2;
+
+  return b1->br_start < b2->br_start ? -1 : b1->br_start > b2->br_start;
+}
+
+/* Sort the ranges and merge the ones which touch. */
+static void
+sort_changed_ranges (struct changed_ranges *cr)
+{
+  guestfs_int_blockrange *v = cr->ret->guestfs_int_blockrange_list_val;
+  size_t i, j, n = cr->ret->guestfs_int_blockrange_list_len;
+
+  if (n == 0)
+    return;
+
+  qsort (v, n, sizeof (guestfs_int_blockrange), compare_blockranges);
+  for (i = 1, j = 0; i < n; ++i) {
+    if (v[j].br_start + v[j].br_size == v[i].br_start)
+      v[j].br_size += v[i].br_size;
+    else
+      v[++j] = v[i];
+  }
+  cr->ret->guestfs_int_blockrange_list_len = j+1;
+}
+
+static int
+open_changed_ranges (const char *device, int64_t blocksize,
+                     char *const *zeroes, struct changed_ranges *cr)
+{
+  int fd;
+
+  if (blocksize <= 0 || blocksize % 512 != 0) {
+    reply_with_error ("blocksize must be a positive multiple of 512");
+    return -1;
+  }
+  cr->device = device;
+  cr->blocksize = blocksize;
+
+  cr->ret = calloc (1, sizeof (guestfs_int_blockrange_list));
+  if (cr->ret == NULL) {
+    reply_with_perror ("calloc");
+    return -1;
+  }
+
+  if (parse_zero_ranges (zeroes, cr) == -1)
+    return -1;
+
+  fd = open (device, O_RDONLY|O_CLOEXEC);
+  if (fd == -1) {
+    reply_with_perror ("%s", device);
+    return -1;
+  }
+  cr->size = lseek (fd, 0, SEEK_END);
+  if (cr->size == -1) {
+    reply_with_perror ("lseek: %s", device);
+    close (fd);
+    return -1;
+  }
+  posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  return fd;
+}
+
+static void
+free_changed_ranges (struct changed_ranges *cr)
+{
+  free (cr->zeroes);
+  free (cr->sums);
+  if (cr->ret)
+    xdr_free ((xdrproc_t) xdr_guestfs_int_blockrange_list, (char *) cr->ret);
+}
+
+static int
+compared_job (struct csum_pool *pool, struct csum_job *job)
+{
+  struct changed_ranges *cr = pool->data;
+
+  if (job->err != 0) {
+    reply_with_error_errno (job->err, "%s: offset %" PRIi64,
+                            cr->device, job->offset);
+    return -1;
+  }
+
+  notify_progress (job->offset + job->length, cr->size);
+  if (job->differs)
+    return add_changed_range (cr, job->offset, job->length);
+  return 0;
+}
+
+guestfs_int_blockrange_list *
+do_internal_changed_ranges (const char *device1, const char *device2,
+                            int64_t blocksize, char *const *zeroes)
+{
+  struct changed_ranges cr = { .ret = NULL };
+  guestfs_int_blockrange_list *ret = NULL;
+  struct csum_pool *pool;
+  int64_t size1, size2, offset, length;
+  int fd1, fd2 = -1, r;
+
+  fd1 = open_changed_ranges (device1, blocksize, zeroes, &cr);
+  if (fd1 == -1)
+    goto out;
+  size1 = cr.size;
+
+  fd2 = open (device2, O_RDONLY|O_CLOEXEC);
+  if (fd2 == -1) {
+    reply_with_perror ("%s", device2);
+    goto out;
+  }
+  size2 = lseek (fd2, 0, SEEK_END);
+  if (size2 == -1) {
+    reply_with_perror ("lseek: %s", device2);
+    goto out;
+  }
+  posix_fadvise (fd2, 0, 0, POSIX_FADV_SEQUENTIAL);
+  cr.size = size1 < size2 ? size1 : size2;
+
+  pool = start_pool (NULL, 0);
+  if (pool == NULL)
+    goto out;
+  pool->data = &cr;
+
+  r = 0;
+  for (offset = 0; r == 0 && offset < cr.size; offset += blocksize) {
+    length = cr.size - offset;
+    if (length > blocksize)
+      length = blocksize;
+    if (!is_zero_block (&cr, offset, length))
+      r = add_compare_job (pool, fd1, fd2, offset, length, compared_job);
+  }
+  r = finish_pool (pool, compared_job, r);
+  if (r == -1)
+    goto out;
+
+  /* The end of the larger device is changed. */
+  length = (size1 > size2 ? size1 : size2) - cr.size;
+  if (length > 0 && add_changed_range (&cr, cr.size, length) == -1)
+    goto out;
+  sort_changed_ranges (&cr);
+
+  ret = cr.ret;
+  cr.ret = NULL;
 
-  if (ferror (fp)) {
-    fprintf (stderr, "fread: %s: %m\n", dir);
-    send_file_end (1);                /* Cancel. */
-    pclose (fp);
+ out:
+  if (fd1 >= 0)
+    close (fd1);
+  if (fd2 >= 0)
+    close (fd2);
+  free_changed_ranges (&cr);
+  return ret;                   /* caller frees */
+}
+
+/* Parse the lines of the sumsfile as they arrive. */
+struct sums_data {
+  struct changed_ranges *cr;
+  size_t digest_size;
+  char line[2*SHA512_DIGEST_SIZE + 1];
+  size_t line_len;
+  int bad;
+};
+
+static int
+add_sum (struct sums_data *data)
+{
+  struct changed_ranges *cr = data->cr;
+  unsigned char *sum;
+  size_t i;
+  unsigned x;
+
+  if (data->line_len != 2 * data->digest_size) {
+    data->bad = 1;
     return -1;
   }
 
-  if (pclose (fp) != 0) {
-    fprintf (stderr, "pclose: %s: %m\n", dir);
-    send_file_end (1);                /* Cancel. */
+  if (cr->nr_sums == cr->sums_alloc) {
+    cr->sums_alloc = cr->sums_alloc > 0 ? 2 * cr->sums_alloc : 1024;
+    sum = realloc (cr->sums, cr->sums_alloc * data->digest_size);
+    if (sum == NULL)
+      return -1;
+    cr->sums = sum;
+  }
+
+  sum = &cr->sums[cr->nr_sums * data->digest_size];
+  for (i = 0; i < data->digest_size; ++i) {
+    if (!c_isxdigit (data->line[2*i]) || !c_isxdigit (data->line[2*i+1]) ||
+        sscanf (&data->line[2*i], "%2x", &x) != 1) {
+      data->bad = 1;
+      return -1;
+    }
+    sum[i] = x;
+  }
+  cr->nr_sums++;
+  data->line_len = 0;
+  return 0;
+}
+
+static int
+sums_cb (void *data_vp, const void *buf, size_t len)
+{
+  struct sums_data *data = data_vp;
+  const char *p = buf;
+  size_t i;
+
+  for (i = 0; i < len; ++i) {
+    if (p[i] == '\n') {
+      if (add_sum (data) == -1)
+        return -1;
+    }
+    else if (data->line_len < sizeof data->line - 1)
+      data->line[data->line_len++] = p[i];
+    else {
+      data->bad = 1;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int
+summed_job (struct csum_pool *pool, struct csum_job *job)
+{
+  struct changed_ranges *cr = pool->data;
+  const size_t digest_size = pool->type->digest_size;
+  const size_t i = job->offset / cr->blocksize;
+
+  if (job->err == 0 && job->size != (uint64_t) job->length)
+    job->err = EIO;             /* device shrank */
+  if (job->err != 0) {
+    reply_with_error_errno (job->err, "%s: offset %" PRIi64,
+                            cr->device, job->offset);
     return -1;
   }
 
-  if (send_file_end (0))        /* Normal end of file. */
+  notify_progress (job->offset + job->length, cr->size);
+  if (memcmp (job->digest, &cr->sums[i * digest_size], digest_size) != 0)
+    return add_changed_range (cr, job->offset, job->length);
+  return 0;
+}
+
+/* Checksum a whole block of zeroes. */
+static int
+make_zero_sum (const struct csum_type *type, struct changed_ranges *cr)
+{
+  CLEANUP_FREE char *zeroes = calloc (1, CSUM_BUFFER_SIZE);
+  union csum_ctx ctx;
+  int64_t n, done;
+
+  if (zeroes == NULL) {
+    reply_with_perror ("calloc");
     return -1;
+  }
 
+  type->init (&ctx);
+  for (done = 0; done < cr->blocksize; done += n) {
+    n = cr->blocksize - done;
+    if (n > CSUM_BUFFER_SIZE)
+      n = CSUM_BUFFER_SIZE;
+    type->process (zeroes, n, &ctx);
+  }
+  type->finish (&ctx, cr->zero_sum);
   return 0;
 }
+
+/* Has one FileIn parameter. */
+guestfs_int_blockrange_list *
+do_internal_changed_ranges_sums (const char *csumtype, const char *device,
+                                 int64_t blocksize, char *const *zeroes)
+{
+  struct changed_ranges cr = { .ret = NULL };
+  struct sums_data data = { .cr = &cr };
+  guestfs_int_blockrange_list *ret = NULL;
+  const struct csum_type *type;
+  struct csum_pool *pool;
+  int64_t offset, length, end;
+  size_t i;
+  int fd = -1, err, r;
+
+  /* Read the sumsfile first, since errors cannot be sent until it
+   * has been received or cancelled.
+   */
+  type = csum_type_of_name (csumtype);
+  if (type == NULL) {
+    cancel_receive ();
+    return NULL;
+  }
+  if (type->digest_size == 0) {
+    cancel_receive ();
+    reply_with_error ("%s: checksum type not supported for tree checksums",
+                      csumtype);
+    return NULL;
+  }
+  data.digest_size = type->digest_size;
+
+  r = receive_file (sums_cb, &data);
+  if (r == -1) {
+    err = errno;
+    cancel_receive ();
+    if (data.bad)
+      reply_with_error ("sumsfile is not a list of %s checksums", csumtype);
+    else
+      reply_with_error_errno (err, "sumsfile");
+    goto out;
+  }
+  if (r == -2) {                /* cancellation from library */
+    reply_with_error ("file upload cancelled");
+    goto out;
+  }
+  if (data.line_len > 0 && add_sum (&data) == -1) {
+    reply_with_error ("sumsfile is not a list of %s checksums", csumtype);
+    goto out;
+  }
+
+  fd = open_changed_ranges (device, blocksize, zeroes, &cr);
+  if (fd == -1)
+    goto out;
+  if (make_zero_sum (type, &cr) == -1)
+    goto out;
+
+  pool = start_pool (type, 0);
+  if (pool == NULL)
+    goto out;
+  pool->data = &cr;
+
+  r = 0;
+  for (i = 0, offset = 0; r == 0 && offset < cr.size;
+       ++i, offset += blocksize) {
+    length = cr.size - offset;
+    if (length > blocksize)
+      length = blocksize;
+    if (i >= cr.nr_sums)
+      r = add_changed_range (&cr, offset, length);
+    else if (length == blocksize && is_zero_block (&cr, offset, length)) {
+      if (memcmp (cr.zero_sum, &cr.sums[i * type->digest_size],
+                  type->digest_size) != 0)
+        r = add_changed_range (&cr, offset, length);
+    }
+    else
+      r = add_block_job (pool, fd, offset, length, summed_job);
+  }
+  r = finish_pool (pool, summed_job, r);
+  if (r == -1)
+    goto out;
+
+  /* The device has shrunk since the checksums were made. */
+  end = (int64_t) cr.nr_sums * blocksize;
+  if (end > cr.size && add_changed_range (&cr, cr.size, end - cr.size) == -1)
+    goto out;
+  sort_changed_ranges (&cr);
+
+  ret = cr.ret;
+  cr.ret = NULL;
+
+ out:
+  if (fd >= 0)
+    close (fd);
+  free_changed_ranges (&cr);
+  return ret;                   /* caller frees */
+}
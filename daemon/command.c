@@ -28,6 +28,8 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
@@ -45,10 +47,118 @@ extern int verbose;
 extern const char *sysroot;
 extern size_t sysroot_len;
 
+/* In proto.c, for COMMAND_FLAG_STDOUT_TO_SEND_FILE. */
+extern ssize_t send_file_from_fd (int fd, size_t len);
+extern int send_file_end (int cancel);
+
+/* In proto.c, so that a cancelled call kills its command. */
+extern int call_cancelled (void);
+
+/* How often commandrvf checks if the call has been cancelled, while
+ * it waits for output from the command.
+ */
+#define CANCEL_CHECK_PERIOD 100000 /* microseconds */
+
 /* For improved readability dealing with pipe arrays */
 #define PIPE_READ 0
 #define PIPE_WRITE 1
 
+/* Size of reads from the command's stdout and stderr.  This is also
+ * the largest chunk sent by COMMAND_FLAG_STDOUT_TO_SEND_FILE, so it
+ * must not be larger than GUESTFS_MAX_CHUNK_SIZE.
+ */
+#define COMMAND_READ_SIZE 65536
+
+/* The number of times each external program has been run, so that
+ * 'debug forks' can show which calls still fork.
+ */
+struct fork_count {
+  char *name;
+  unsigned long count;
+};
+static struct fork_count *fork_counts;
+static size_t nr_fork_counts;
+/* Commands may be run by several threads at the same time. */
+static pthread_mutex_t fork_counts_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+count_fork (const char *name)
+{
+  struct fork_count *p;
+  const char *base;
+  size_t i;
+
+  stats_count_fork ();
+
+  base = strrchr (name, '/');
+  base = base ? base + 1 : name;
+
+  pthread_mutex_lock (&fork_counts_lock);
+
+  for (i = 0; i < nr_fork_counts; ++i) {
+    if (STREQ (fork_counts[i].name, base)) {
+      fork_counts[i].count++;
+      goto out;
+    }
+  }
+
+  /* If we run out of memory the program is simply not counted. */
+  p = realloc (fork_counts, (nr_fork_counts + 1) * sizeof (struct fork_count));
+  if (p == NULL)
+    goto out;
+  fork_counts = p;
+  fork_counts[nr_fork_counts].name = strdup (base);
+  if (fork_counts[nr_fork_counts].name == NULL)
+    goto out;
+  fork_counts[nr_fork_counts].count = 1;
+  nr_fork_counts++;
+
+ out:
+  pthread_mutex_unlock (&fork_counts_lock);
+}
+
+static int
+compare_fork_counts (const void *vp1, const void *vp2)
+{
+  const struct fork_count *c1 = vp1;
+  const struct fork_count *c2 = vp2;
+
+  if (c1->count != c2->count)
+    return c1->count < c2->count ? 1 : -1;
+  return strcmp (c1->name, c2->name);
+}
+
+/**
+ * Return a string listing how many times each external program has
+ * been run by the C<command*> functions, most often run first, one
+ * C<count name> per line.  Returns C<NULL> on error.
+ */
+char *
+command_fork_counts (void)
+{
+  char *out = NULL;
+  size_t size, i;
+  FILE *fp;
+
+  fp = open_memstream (&out, &size);
+  if (fp == NULL)
+    return NULL;
+
+  pthread_mutex_lock (&fork_counts_lock);
+  qsort (fork_counts, nr_fork_counts, sizeof (struct fork_count),
+         compare_fork_counts);
+  for (i = 0; i < nr_fork_counts; ++i)
+    fprintf (fp, "%lu %s\n", fork_counts[i].count, fork_counts[i].name);
+  pthread_mutex_unlock (&fork_counts_lock);
+
+  if (fclose (fp) == EOF) {
+    free (out);
+    return NULL;
+  }
+
+  return out;
+}
+
 /**
  * Run a command.  Optionally capture stdout and stderr as strings.
  *
@@ -170,6 +280,35 @@ commandvf (char **stdoutput, char **stderror, unsigned flags,
     return -1;
 }
 
+/**
+ * Append C<len> bytes to a buffer which is C<*size> bytes long, with
+ * C<*alloc> bytes allocated.  The allocation is grown geometrically
+ * so that commands with large output don't need one realloc per
+ * read.  Always leaves room for a terminating C<\0>.
+ */
+static int
+append_output (char **bufp, size_t *size, size_t *alloc,
+               const char *data, size_t len)
+{
+  size_t new_alloc;
+  char *p;
+
+  if (*size + len + 1 > *alloc) {
+    new_alloc = *alloc > 0 ? *alloc : 4096;
+    while (*size + len + 1 > new_alloc)
+      new_alloc *= 2;
+    p = realloc (*bufp, new_alloc);
+    if (p == NULL)
+      return -1;
+    *bufp = p;
+    *alloc = new_alloc;
+  }
+
+  memcpy (*bufp + *size, data, len);
+  *size += len;
+  return 0;
+}
+
 /**
  * This is a more sane version of L<system(3)> for running external
  * commands.  It uses fork/execvp, so we don't need to worry about
@@ -206,6 +345,15 @@ commandvf (char **stdoutput, char **stderror, unsigned flags,
  * always closed by this function.  See F<daemon/hexdump.c> for an
  * example of usage.
  *
+ * =item C<COMMAND_FLAG_STDOUT_TO_SEND_FILE>
+ *
+ * For daemon functions with a C<FileOut> parameter, send the stdout
+ * of the command as the file, as it is produced, instead of
+ * collecting it (C<stdoutput> must be C<NULL>).  The caller must
+ * have called C<reply> already.  This function ends the transfer,
+ * cancelling it if the command fails, so the caller must not call
+ * C<send_file_end>.  See C<do_ntfscat_i> in F<daemon/ntfs.c>.
+ *
  * =back
  *
  * There is also a macro C<commandrv(out,err,argv)> which calls
@@ -215,17 +363,20 @@ int
 commandrvf (char **stdoutput, char **stderror, unsigned flags,
             char const* const *argv)
 {
-  size_t so_size = 0, se_size = 0;
+  size_t so_size = 0, se_size = 0, so_alloc = 0, se_alloc = 0;
   int so_fd[2], se_fd[2];
   const unsigned flag_copy_stdin =
     flags & COMMAND_FLAG_CHROOT_COPY_FILE_TO_STDIN;
   const int flag_copy_fd = (int) (flags & COMMAND_FLAG_FD_MASK);
   const unsigned flag_out_on_err = flags & COMMAND_FLAG_FOLD_STDOUT_ON_STDERR;
+  const unsigned flag_send_file = flags & COMMAND_FLAG_STDOUT_TO_SEND_FILE;
   pid_t pid;
   int r, quit, i;
+  int send_error = 0, cancelled = 0;
+  ssize_t sr;
   fd_set rset, rset2;
-  char buf[256];
-  char *p;
+  struct timeval tv;
+  CLEANUP_FREE char *buf = NULL;
 
   if (stdoutput) *stdoutput = NULL;
   if (stderror) *stderror = NULL;
@@ -269,6 +420,14 @@ commandrvf (char **stdoutput, char **stderror, unsigned flags,
    * circumstances.
    */
 
+  count_fork (argv[0]);
+
+  buf = malloc (COMMAND_READ_SIZE);
+  if (buf == NULL) {
+    error (0, errno, "malloc");
+    abort ();
+  }
+
   if (pipe (so_fd) == -1 || pipe (se_fd) == -1) {
     error (0, errno, "pipe");
     abort ();
@@ -345,13 +504,26 @@ commandrvf (char **stdoutput, char **stderror, unsigned flags,
   while (quit < 2) {
   again:
     rset2 = rset;
+    tv.tv_sec = 0;
+    tv.tv_usec = CANCEL_CHECK_PERIOD;
     r = select (MAX (so_fd[PIPE_READ], se_fd[PIPE_READ]) + 1, &rset2,
-                NULL, NULL, NULL);
+                NULL, NULL, &tv);
     if (r == -1) {
       if (errno == EINTR)
         goto again;
 
       perror ("select");
+      goto quit;
+    }
+
+    /* If the library has cancelled the call, stop the command rather
+     * than waiting for it to finish.
+     */
+    if (call_cancelled ()) {
+      if (verbose)
+        printf ("commandrvf: call cancelled, killing %s\n", argv[0]);
+      kill (pid, SIGTERM);
+      cancelled = 1;
     quit:
       if (stdoutput) {
         free (*stdoutput);
@@ -364,38 +536,52 @@ commandrvf (char **stdoutput, char **stderror, unsigned flags,
          * Unfortunately recovery from strdup failure here is not
          * possible.
          */
-        *stderror = strdup ("error running external command, "
-                            "see debug output for details");
+        *stderror = strdup (cancelled
+                            ? "operation cancelled by user"
+                            : "error running external command, "
+                              "see debug output for details");
       }
       close (so_fd[PIPE_READ]);
       close (se_fd[PIPE_READ]);
       if (flag_copy_stdin) close (flag_copy_fd);
       waitpid (pid, NULL, 0);
+      if (flag_send_file && !send_error)
+        send_file_end (1);      /* Cancel. */
       return -1;
     }
 
     if (FD_ISSET (so_fd[PIPE_READ], &rset2)) { /* something on stdout */
-      r = read (so_fd[PIPE_READ], buf, sizeof buf);
-      if (r == -1) {
-        perror ("read");
-        goto quit;
+      if (flag_send_file) {
+        sr = send_file_from_fd (so_fd[PIPE_READ], COMMAND_READ_SIZE);
+        if (sr == -1) {
+          perror ("read");
+          goto quit;
+        }
+        if (sr == -2) {         /* Cancelled by the library. */
+          send_error = 1;
+          goto quit;
+        }
+        if (sr == 0) { FD_CLR (so_fd[PIPE_READ], &rset); quit++; }
       }
-      if (r == 0) { FD_CLR (so_fd[PIPE_READ], &rset); quit++; }
-
-      if (r > 0 && stdoutput) {
-        so_size += r;
-        p = realloc (*stdoutput, so_size);
-        if (p == NULL) {
-          perror ("realloc");
+      else {
+        r = read (so_fd[PIPE_READ], buf, COMMAND_READ_SIZE);
+        if (r == -1) {
+          perror ("read");
           goto quit;
         }
-        *stdoutput = p;
-        memcpy (*stdoutput + so_size - r, buf, r);
+        if (r == 0) { FD_CLR (so_fd[PIPE_READ], &rset); quit++; }
+
+        if (r > 0 && stdoutput) {
+          if (append_output (stdoutput, &so_size, &so_alloc, buf, r) == -1) {
+            perror ("realloc");
+            goto quit;
+          }
+        }
       }
     }
 
     if (FD_ISSET (se_fd[PIPE_READ], &rset2)) { /* something on stderr */
-      r = read (se_fd[PIPE_READ], buf, sizeof buf);
+      r = read (se_fd[PIPE_READ], buf, COMMAND_READ_SIZE);
       if (r == -1) {
         perror ("read");
         goto quit;
@@ -407,14 +593,10 @@ commandrvf (char **stdoutput, char **stderror, unsigned flags,
           ignore_value (write (STDERR_FILENO, buf, r));
 
         if (stderror) {
-          se_size += r;
-          p = realloc (*stderror, se_size);
-          if (p == NULL) {
+          if (append_output (stderror, &se_size, &se_alloc, buf, r) == -1) {
             perror ("realloc");
             goto quit;
           }
-          *stderror = p;
-          memcpy (*stderror + se_size - r, buf, r);
         }
       }
     }
@@ -425,25 +607,22 @@ commandrvf (char **stdoutput, char **stderror, unsigned flags,
 
   /* Make sure the output buffers are \0-terminated.  Also remove any
    * trailing \n characters from the error buffer (not from stdout).
+   * append_output always leaves room for the \0.
    */
   if (stdoutput) {
-    void *q = realloc (*stdoutput, so_size+1);
-    if (q == NULL) {
-      perror ("realloc");
-      free (*stdoutput);
-    }
-    *stdoutput = q;
-    if (*stdoutput)
+    if (*stdoutput == NULL)
+      *stdoutput = calloc (1, 1);
+    if (*stdoutput == NULL)
+      perror ("malloc");
+    else
       (*stdoutput)[so_size] = '\0';
   }
   if (stderror) {
-    void *q = realloc (*stderror, se_size+1);
-    if (q == NULL) {
-      perror ("realloc");
-      free (*stderror);
-    }
-    *stderror = q;
-    if (*stderror) {
+    if (*stderror == NULL)
+      *stderror = calloc (1, 1);
+    if (*stderror == NULL)
+      perror ("malloc");
+    else {
       (*stderror)[se_size] = '\0';
       while (se_size > 0 && (*stderror)[se_size-1] == '\n') {
         se_size--;
@@ -454,15 +633,25 @@ commandrvf (char **stdoutput, char **stderror, unsigned flags,
 
   if (flag_copy_stdin && close (flag_copy_fd) == -1) {
     perror ("close");
+    if (flag_send_file)
+      send_file_end (1);        /* Cancel. */
     return -1;
   }
 
   /* Get the exit status of the command. */
   if (waitpid (pid, &r, 0) != pid) {
     perror ("waitpid");
+    if (flag_send_file)
+      send_file_end (1);        /* Cancel. */
     return -1;
   }
 
+  /* End the file transfer, cancelling it if the command failed. */
+  if (flag_send_file) {
+    if (send_file_end (!WIFEXITED (r) || WEXITSTATUS (r) != 0))
+      return -1;
+  }
+
   if (WIFEXITED (r)) {
     return WEXITSTATUS (r);
   } else
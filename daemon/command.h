@@ -28,6 +28,7 @@
 #define COMMAND_FLAG_FOLD_STDOUT_ON_STDERR     0x00010000
 #define COMMAND_FLAG_CHROOT_COPY_FILE_TO_STDIN 0x00020000
 #define COMMAND_FLAG_DO_CHROOT                 0x00040000
+#define COMMAND_FLAG_STDOUT_TO_SEND_FILE       0x00080000
 
 extern int commandf (char **stdoutput, char **stderror, unsigned flags,
                      const char *name, ...) __attribute__((sentinel));
@@ -37,5 +38,9 @@ extern int commandvf (char **stdoutput, char **stderror, unsigned flags,
                       char const *const *argv);
 extern int commandrvf (char **stdoutput, char **stderror, unsigned flags,
                        char const* const *argv);
+extern char *command_fork_counts (void);
+
+/* In stats.c. */
+extern void stats_count_fork (void);
 
 #endif /* GUESTFSD_COMMAND_H */
@@ -0,0 +1,616 @@
+/* libguestfs - the guestfsd daemon
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Compress data in the daemon, using all vCPUs, and send it straight
+ * to the library.  This is used by compress_out, compress_device_out
+ * and tar_out instead of piping through the single-threaded external
+ * programs, for the compression types where the daemon was built with
+ * the library:
+ *
+ *  - gzip: the input is split into blocks which a pool of threads
+ *    compresses separately, like pigz does.  The result is a single
+ *    ordinary gzip stream.
+ *  - xz: the multi-threaded liblzma encoder.
+ *  - zstd: libzstd, with one worker per vCPU.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_LIBLZMA
+#include <lzma.h>
+#endif
+
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#include "guestfs_protocol.h"
+#include "daemon.h"
+
+int
+native_compress_available (const char *ctype)
+{
+#ifdef HAVE_ZLIB
+  if (STREQ (ctype, "gzip"))
+    return 1;
+#endif
+#ifdef HAVE_LIBLZMA
+  if (STREQ (ctype, "xz"))
+    return 1;
+#endif
+#ifdef HAVE_LIBZSTD
+  if (STREQ (ctype, "zstd"))
+    return 1;
+#endif
+  return 0;
+}
+
+#if defined(HAVE_ZLIB) || defined(HAVE_LIBLZMA) || defined(HAVE_LIBZSTD)
+
+static size_t
+get_nr_threads (void)
+{
+  const long nr_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+
+  return nr_cpus > 0 ? nr_cpus : 1;
+}
+
+/* Where the data to compress comes from. */
+struct input {
+  int fd;
+  compress_input_cb cb;         /* if not NULL, sees all the data read */
+  void *opaque;
+};
+
+/* Read until 'buf' is full or end of file.  Returns the number of
+ * bytes read, or -1 on error.
+ */
+static ssize_t
+read_full (const struct input *in, char *buf, size_t len)
+{
+  size_t n = 0;
+  ssize_t r;
+
+  while (n < len) {
+    r = read (in->fd, buf + n, len - n);
+    if (r == -1) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    if (r == 0)
+      break;
+    n += r;
+  }
+
+  if (in->cb && n > 0)
+    in->cb (in->opaque, buf, n);
+
+  return n;
+}
+
+#endif
+
+#ifdef HAVE_ZLIB
+
+/* Size of the blocks of input compressed by each thread.  Each
+ * block is compressed without the previous one as dictionary, which
+ * at this size makes very little difference to the ratio.
+ */
+#define GZIP_BLOCK_SIZE (1024 * 1024)
+
+/* Blocks queued or being compressed at once, per thread. */
+#define GZIP_JOBS_PER_THREAD 2
+
+/* A block of input.  All but the last block end with a sync flush,
+ * so the compressed blocks can simply be concatenated.
+ */
+struct gzip_job {
+  char *in;
+  size_t in_len;
+  unsigned char *out;
+  size_t out_size, out_len;
+  uLong crc;
+  int last;
+  int done;
+  int err;                      /* zlib error, or Z_MEM_ERROR */
+};
+
+/* The jobs are a ring buffer, in the same way as the checksum
+ * threads: the main thread adds jobs at 'head + nr_jobs', the
+ * threads take them at 'next_job', and the main thread sends them in
+ * order from 'head'.
+ */
+struct gzip_pool {
+  int level;
+  pthread_t *threads;
+  size_t nr_threads;
+  struct gzip_job *jobs;
+  size_t max_jobs, head, nr_jobs, next_job;
+  int quit;
+  pthread_mutex_t lock;
+  pthread_cond_t job_added;
+  pthread_cond_t job_done;
+};
+
+static int
+gzip_job (int level, struct gzip_job *job)
+{
+  z_stream strm;
+  size_t bound;
+  int r;
+
+  job->crc = crc32 (crc32 (0, Z_NULL, 0),
+                    (const Bytef *) job->in, job->in_len);
+
+  memset (&strm, 0, sizeof strm);
+  r = deflateInit2 (&strm, level, Z_DEFLATED, -15 /* raw deflate */,
+                    8, Z_DEFAULT_STRATEGY);
+  if (r != Z_OK)
+    return r;
+
+  /* Room for the block and the sync flush marker. */
+  bound = deflateBound (&strm, job->in_len) + 16;
+  if (job->out_size < bound) {
+    unsigned char *out = realloc (job->out, bound);
+    if (out == NULL) {
+      deflateEnd (&strm);
+      return Z_MEM_ERROR;
+    }
+    job->out = out;
+    job->out_size = bound;
+  }
+
+  strm.next_in = (Bytef *) job->in;
+  strm.avail_in = job->in_len;
+  strm.next_out = job->out;
+  strm.avail_out = job->out_size;
+  r = deflate (&strm, job->last ? Z_FINISH : Z_SYNC_FLUSH);
+  job->out_len = job->out_size - strm.avail_out;
+  deflateEnd (&strm);
+
+  if (job->last ? r != Z_STREAM_END : (r != Z_OK || strm.avail_in > 0))
+    return r == Z_OK ? Z_BUF_ERROR : r;
+  return Z_OK;
+}
+
+static void *
+gzip_thread (void *vp)
+{
+  struct gzip_pool *pool = vp;
+
+  for (;;) {
+    struct gzip_job *job;
+
+    pthread_mutex_lock (&pool->lock);
+    while (!pool->quit && pool->next_job == pool->head + pool->nr_jobs)
+      pthread_cond_wait (&pool->job_added, &pool->lock);
+    if (pool->next_job == pool->head + pool->nr_jobs) {
+      pthread_mutex_unlock (&pool->lock);
+      break;
+    }
+    job = &pool->jobs[pool->next_job++ % pool->max_jobs];
+    pthread_mutex_unlock (&pool->lock);
+
+    job->err = gzip_job (pool->level, job);
+
+    pthread_mutex_lock (&pool->lock);
+    job->done = 1;
+    pthread_cond_broadcast (&pool->job_done);
+    pthread_mutex_unlock (&pool->lock);
+  }
+
+  return NULL;
+}
+
+static void
+wait_for_job (struct gzip_pool *pool, struct gzip_job *job)
+{
+  pthread_mutex_lock (&pool->lock);
+  while (!job->done)
+    pthread_cond_wait (&pool->job_done, &pool->lock);
+  pthread_mutex_unlock (&pool->lock);
+}
+
+/* Send the compressed oldest job and remove it. */
+static int
+retire_gzip_job (struct gzip_pool *pool, uLong *crc, uint64_t *size)
+{
+  struct gzip_job *job = &pool->jobs[pool->head % pool->max_jobs];
+  const unsigned char *p;
+  size_t len, n;
+  int r;
+
+  wait_for_job (pool, job);
+
+  pthread_mutex_lock (&pool->lock);
+  pool->head++;
+  pool->nr_jobs--;
+  pthread_mutex_unlock (&pool->lock);
+
+  if (job->err != Z_OK) {
+    fprintf (stderr, "gzip: deflate failed: %d\n", job->err);
+    return -1;
+  }
+
+  *crc = crc32_combine (*crc, job->crc, job->in_len);
+  *size += job->in_len;
+
+  for (p = job->out, len = job->out_len; len > 0; p += n, len -= n) {
+    n = MIN (len, GUESTFS_MAX_CHUNK_SIZE);
+    r = send_file_write (p, n);
+    if (r < 0)
+      return r;
+  }
+
+  return 0;
+}
+
+static int
+send_gzip (const struct input *in, int level)
+{
+  /* Minimal gzip header: no name or time, OS = Unix. */
+  static const unsigned char header[10] =
+    { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+  unsigned char trailer[8];
+  struct gzip_pool pool;
+  struct gzip_job *job;
+  uLong crc = crc32 (0, Z_NULL, 0);
+  uint64_t size = 0;
+  ssize_t n;
+  size_t i;
+  int r = 0, err;
+
+  memset (&pool, 0, sizeof pool);
+  pool.level = level == -1 ? Z_DEFAULT_COMPRESSION : level;
+  pool.nr_threads = get_nr_threads ();
+  pool.max_jobs = pool.nr_threads * GZIP_JOBS_PER_THREAD;
+  pool.threads = calloc (pool.nr_threads, sizeof (pthread_t));
+  pool.jobs = calloc (pool.max_jobs, sizeof (struct gzip_job));
+  if (pool.threads == NULL || pool.jobs == NULL) {
+    perror ("calloc");
+    free (pool.threads);
+    free (pool.jobs);
+    return -1;
+  }
+  pthread_mutex_init (&pool.lock, NULL);
+  pthread_cond_init (&pool.job_added, NULL);
+  pthread_cond_init (&pool.job_done, NULL);
+
+  for (i = 0; i < pool.nr_threads; ++i) {
+    err = pthread_create (&pool.threads[i], NULL, gzip_thread, &pool);
+    if (err != 0) {
+      if (i == 0) {
+        errno = err;
+        perror ("pthread_create");
+        r = -1;
+      }
+      pool.nr_threads = i;
+      break;
+    }
+  }
+
+  if (r == 0 && verbose)
+    fprintf (stderr, "gzip: compressing with %zu threads\n", pool.nr_threads);
+
+  if (r == 0)
+    r = send_file_write (header, sizeof header);
+
+  while (r == 0) {
+    if (pool.nr_jobs == pool.max_jobs) {
+      r = retire_gzip_job (&pool, &crc, &size);
+      if (r != 0)
+        break;
+    }
+
+    job = &pool.jobs[(pool.head + pool.nr_jobs) % pool.max_jobs];
+    job->done = 0;
+    if (job->in == NULL) {
+      job->in = malloc (GZIP_BLOCK_SIZE);
+      if (job->in == NULL) {
+        perror ("malloc");
+        r = -1;
+        break;
+      }
+    }
+
+    n = read_full (in, job->in, GZIP_BLOCK_SIZE);
+    if (n == -1) {
+      perror ("read");
+      r = -1;
+      break;
+    }
+    job->in_len = n;
+    /* If the input is a multiple of the block size this is an empty
+     * block, which just ends the stream.
+     */
+    job->last = n < GZIP_BLOCK_SIZE;
+
+    pthread_mutex_lock (&pool.lock);
+    pool.nr_jobs++;
+    pthread_cond_signal (&pool.job_added);
+    pthread_mutex_unlock (&pool.lock);
+
+    if (job->last)
+      break;
+  }
+
+  while (pool.nr_jobs > 0) {
+    if (r == 0)
+      r = retire_gzip_job (&pool, &crc, &size);
+    else {
+      /* Throw away the remaining jobs. */
+      struct gzip_job *old_job = &pool.jobs[pool.head % pool.max_jobs];
+
+      pthread_mutex_lock (&pool.lock);
+      while (!old_job->done)
+        pthread_cond_wait (&pool.job_done, &pool.lock);
+      pool.head++;
+      pool.nr_jobs--;
+      pthread_mutex_unlock (&pool.lock);
+    }
+  }
+
+  pthread_mutex_lock (&pool.lock);
+  pool.quit = 1;
+  pthread_cond_broadcast (&pool.job_added);
+  pthread_mutex_unlock (&pool.lock);
+  for (i = 0; i < pool.nr_threads; ++i)
+    pthread_join (pool.threads[i], NULL);
+
+  for (i = 0; i < pool.max_jobs; ++i) {
+    free (pool.jobs[i].in);
+    free (pool.jobs[i].out);
+  }
+  free (pool.jobs);
+  free (pool.threads);
+  pthread_mutex_destroy (&pool.lock);
+  pthread_cond_destroy (&pool.job_added);
+  pthread_cond_destroy (&pool.job_done);
+
+  if (r != 0)
+    return r;
+
+  /* CRC-32 and size of the input modulo 2^32, little endian. */
+  for (i = 0; i < 4; ++i) {
+    trailer[i] = (crc >> (8 * i)) & 0xff;
+    trailer[4 + i] = (size >> (8 * i)) & 0xff;
+  }
+  return send_file_write (trailer, sizeof trailer);
+}
+
+#endif /* HAVE_ZLIB */
+
+#ifdef HAVE_LIBLZMA
+
+static int
+send_xz (const struct input *in, int level)
+{
+  lzma_stream strm = LZMA_STREAM_INIT;
+  CLEANUP_FREE char *inbuf = NULL;
+  CLEANUP_FREE uint8_t *outbuf = NULL;
+  lzma_action action = LZMA_RUN;
+  lzma_ret ret;
+  ssize_t n;
+  int r = 0;
+  const uint32_t preset = level == -1 ? LZMA_PRESET_DEFAULT : level;
+
+  inbuf = malloc (GUESTFS_MAX_CHUNK_SIZE);
+  outbuf = malloc (GUESTFS_MAX_CHUNK_SIZE);
+  if (inbuf == NULL || outbuf == NULL) {
+    perror ("malloc");
+    return -1;
+  }
+
+#ifdef HAVE_LZMA_STREAM_ENCODER_MT
+  lzma_mt mt;
+
+  memset (&mt, 0, sizeof mt);
+  mt.threads = get_nr_threads ();
+  mt.preset = preset;
+  mt.check = LZMA_CHECK_CRC64;
+  ret = lzma_stream_encoder_mt (&strm, &mt);
+  if (verbose && ret == LZMA_OK)
+    fprintf (stderr, "xz: compressing with %" PRIu32 " threads\n",
+             mt.threads);
+#else
+  ret = lzma_easy_encoder (&strm, preset, LZMA_CHECK_CRC64);
+#endif
+  if (ret != LZMA_OK) {
+    fprintf (stderr, "xz: cannot initialize encoder: %d\n", (int) ret);
+    return -1;
+  }
+
+  strm.next_out = outbuf;
+  strm.avail_out = GUESTFS_MAX_CHUNK_SIZE;
+
+  for (;;) {
+    if (strm.avail_in == 0 && action == LZMA_RUN) {
+      n = read_full (in, inbuf, GUESTFS_MAX_CHUNK_SIZE);
+      if (n == -1) {
+        perror ("read");
+        r = -1;
+        break;
+      }
+      strm.next_in = (const uint8_t *) inbuf;
+      strm.avail_in = n;
+      if (n < GUESTFS_MAX_CHUNK_SIZE)
+        action = LZMA_FINISH;
+    }
+
+    ret = lzma_code (&strm, action);
+
+    if (strm.avail_out == 0 || ret == LZMA_STREAM_END) {
+      const size_t len = GUESTFS_MAX_CHUNK_SIZE - strm.avail_out;
+
+      if (len > 0) {
+        r = send_file_write (outbuf, len);
+        if (r != 0)
+          break;
+      }
+      strm.next_out = outbuf;
+      strm.avail_out = GUESTFS_MAX_CHUNK_SIZE;
+    }
+
+    if (ret == LZMA_STREAM_END)
+      break;
+    if (ret != LZMA_OK) {
+      fprintf (stderr, "xz: encoder failed: %d\n", (int) ret);
+      r = -1;
+      break;
+    }
+  }
+
+  lzma_end (&strm);
+  return r;
+}
+
+#endif /* HAVE_LIBLZMA */
+
+#ifdef HAVE_LIBZSTD
+
+static int
+send_zstd (const struct input *in, int level)
+{
+  ZSTD_CCtx *cctx;
+  CLEANUP_FREE char *inbuf = NULL;
+  CLEANUP_FREE char *outbuf = NULL;
+  ZSTD_inBuffer in;
+  ZSTD_outBuffer out;
+  ZSTD_EndDirective mode = ZSTD_e_continue;
+  size_t remaining;
+  ssize_t n;
+  int r = 0;
+
+  inbuf = malloc (GUESTFS_MAX_CHUNK_SIZE);
+  outbuf = malloc (GUESTFS_MAX_CHUNK_SIZE);
+  if (inbuf == NULL || outbuf == NULL) {
+    perror ("malloc");
+    return -1;
+  }
+
+  cctx = ZSTD_createCCtx ();
+  if (cctx == NULL) {
+    perror ("ZSTD_createCCtx");
+    return -1;
+  }
+  if (level != -1)
+    ZSTD_CCtx_setParameter (cctx, ZSTD_c_compressionLevel, level);
+  /* Like the zstd program, so that corruption is detected. */
+  ZSTD_CCtx_setParameter (cctx, ZSTD_c_checksumFlag, 1);
+  /* This fails if libzstd was built without threads, in which case
+   * the data is compressed in this thread.
+   */
+  if (!ZSTD_isError (ZSTD_CCtx_setParameter (cctx, ZSTD_c_nbWorkers,
+                                             (int) get_nr_threads ())) &&
+      verbose)
+    fprintf (stderr, "zstd: compressing with %zu threads\n",
+             get_nr_threads ());
+
+  while (mode == ZSTD_e_continue) {
+    n = read_full (in, inbuf, GUESTFS_MAX_CHUNK_SIZE);
+    if (n == -1) {
+      perror ("read");
+      r = -1;
+      break;
+    }
+    if (n < GUESTFS_MAX_CHUNK_SIZE)
+      mode = ZSTD_e_end;
+
+    in.src = inbuf;
+    in.size = n;
+    in.pos = 0;
+    do {
+      out.dst = outbuf;
+      out.size = GUESTFS_MAX_CHUNK_SIZE;
+      out.pos = 0;
+      remaining = ZSTD_compressStream2 (cctx, &out, &in, mode);
+      if (ZSTD_isError (remaining)) {
+        fprintf (stderr, "zstd: %s\n", ZSTD_getErrorName (remaining));
+        r = -1;
+        goto out;
+      }
+      if (out.pos > 0) {
+        r = send_file_write (outbuf, out.pos);
+        if (r != 0)
+          goto out;
+      }
+    } while (mode == ZSTD_e_end ? remaining > 0 : in.pos < in.size);
+  }
+
+ out:
+  ZSTD_freeCCtx (cctx);
+  return r;
+}
+
+#endif /* HAVE_LIBZSTD */
+
+/* Compress everything read from 'fd' and send it.  This is called
+ * after reply (NULL, NULL), so errors are only printed, and the
+ * caller has to cancel the transfer.
+ *
+ * Returns 0 on success, -1 on error or -2 if the library cancelled
+ * the transfer.
+ */
+int
+send_compressed (int fd, const char *ctype, int level)
+{
+  return send_compressed_cb (fd, ctype, level, NULL, NULL);
+}
+
+/* The same, but 'cb' is called with the uncompressed data as it is
+ * read (in this thread), so the caller can send progress messages.
+ */
+int
+send_compressed_cb (int fd, const char *ctype, int level,
+                    compress_input_cb cb, void *opaque)
+{
+#if defined(HAVE_ZLIB) || defined(HAVE_LIBLZMA) || defined(HAVE_LIBZSTD)
+  const struct input in = { .fd = fd, .cb = cb, .opaque = opaque };
+#endif
+
+#ifdef HAVE_ZLIB
+  if (STREQ (ctype, "gzip"))
+    return send_gzip (&in, level);
+#endif
+#ifdef HAVE_LIBLZMA
+  if (STREQ (ctype, "xz"))
+    return send_xz (&in, level);
+#endif
+#ifdef HAVE_LIBZSTD
+  if (STREQ (ctype, "zstd"))
+    return send_zstd (&in, level);
+#endif
+
+  fprintf (stderr, "send_compressed: %s: compression type not supported\n",
+           ctype);
+  return -1;
+}
@@ -22,6 +22,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "guestfs_protocol.h"
 #include "daemon.h"
@@ -32,6 +34,64 @@ GUESTFSD_EXT_CMD(str_gzip, gzip);
 GUESTFSD_EXT_CMD(str_bzip2, bzip2);
 GUESTFSD_EXT_CMD(str_xz, xz);
 GUESTFSD_EXT_CMD(str_lzop, lzop);
+GUESTFSD_EXT_CMD(str_zstd, zstd);
+
+/* Has one FileOut parameter.  Compress in the daemon on all vCPUs. */
+static int
+do_compress_native_out (const char *file, const char *ctype, int level,
+                        int is_device)
+{
+  int fd, r;
+  struct stat statbuf;
+
+  if (!is_device) CHROOT_IN;
+  fd = open (file, O_RDONLY|O_CLOEXEC);
+  if (!is_device) CHROOT_OUT;
+  if (fd == -1) {
+    reply_with_perror ("%s", file);
+    return -1;
+  }
+
+  if (fstat (fd, &statbuf) == -1) {
+    reply_with_perror ("fstat: %s", file);
+    close (fd);
+    return -1;
+  }
+  if (S_ISDIR (statbuf.st_mode)) {
+    reply_with_error ("%s: is a directory", file);
+    close (fd);
+    return -1;
+  }
+
+  /* Now we must send the reply message, before the file contents.  After
+   * this there is no opportunity in the protocol to send any error
+   * message back.  Instead we can only cancel the transfer.
+   */
+  reply (NULL, NULL);
+
+  r = send_compressed (fd, ctype, level);
+  if (r == -2) {                /* Cancelled by the library. */
+    close (fd);
+    return -1;
+  }
+  if (r == -1) {
+    fprintf (stderr, "%s: compression failed\n", file);
+    send_file_end (1);		/* Cancel. */
+    close (fd);
+    return -1;
+  }
+
+  if (close (fd) == -1) {
+    fprintf (stderr, "close: %s: %m\n", file);
+    send_file_end (1);		/* Cancel. */
+    return -1;
+  }
+
+  if (send_file_end (0))	/* Normal end of file. */
+    return -1;
+
+  return 0;
+}
 
 /* Has one FileOut parameter. */
 static int
@@ -117,6 +177,10 @@ do_compressX_out (const char *file, const char *filter, int is_device)
     /* note: substring "not supported" must appear in this error */     \
     NOT_SUPPORTED (-1, "compression type %s is not supported, because external program '%s' is not available in the appliance", prog, prog);
 
+/* Check the level and make the external filter command in 'ret'.
+ * Returns 1 if the daemon compresses this type itself (and 'ret' is
+ * not used), 0 if the filter should be used, or -1 on error.
+ */
 static int
 get_filter (const char *ctype, int level, char *ret, size_t n)
 {
@@ -130,15 +194,17 @@ get_filter (const char *ctype, int level, char *ret, size_t n)
     return 0;
   }
   else if (STREQ (ctype, "gzip")) {
+    if (level != -1 && (level < 1 || level > 9)) {
+      reply_with_error ("gzip: incorrect value for level parameter");
+      return -1;
+    }
+    if (native_compress_available (ctype))
+      return 1;
     CHECK_SUPPORTED ("gzip");
     if (level == -1)
       snprintf (ret, n, "%s -c", str_gzip);
-    else if (level >= 1 && level <= 9)
+    else
       snprintf (ret, n, "%s -c -%d", str_gzip, level);
-    else {
-      reply_with_error ("gzip: incorrect value for level parameter");
-      return -1;
-    }
     return 0;
   }
   else if (STREQ (ctype, "bzip2")) {
@@ -154,15 +220,17 @@ get_filter (const char *ctype, int level, char *ret, size_t n)
     return 0;
   }
   else if (STREQ (ctype, "xz")) {
-    CHECK_SUPPORTED ("xz");
-    if (level == -1)
-      snprintf (ret, n, "%s -c", str_xz);
-    else if (level >= 0 && level <= 9)
-      snprintf (ret, n, "%s -c -%d", str_xz, level);
-    else {
+    if (level != -1 && (level < 0 || level > 9)) {
       reply_with_error ("xz: incorrect value for level parameter");
       return -1;
     }
+    if (native_compress_available (ctype))
+      return 1;
+    CHECK_SUPPORTED ("xz");
+    if (level == -1)
+      snprintf (ret, n, "%s -c -T0", str_xz);
+    else
+      snprintf (ret, n, "%s -c -T0 -%d", str_xz, level);
     return 0;
   }
   else if (STREQ (ctype, "lzop")) {
@@ -177,6 +245,20 @@ get_filter (const char *ctype, int level, char *ret, size_t n)
     }
     return 0;
   }
+  else if (STREQ (ctype, "zstd")) {
+    if (level != -1 && (level < 1 || level > 19)) {
+      reply_with_error ("zstd: incorrect value for level parameter");
+      return -1;
+    }
+    if (native_compress_available (ctype))
+      return 1;
+    CHECK_SUPPORTED ("zstd");
+    if (level == -1)
+      snprintf (ret, n, "%s -c -q -T0", str_zstd);
+    else
+      snprintf (ret, n, "%s -c -q -T0 -%d", str_zstd, level);
+    return 0;
+  }
 
   reply_with_error ("unknown compression type");
   return -1;
@@ -192,8 +274,12 @@ do_compress_out (const char *ctype, const char *file, int level)
   if (!(optargs_bitmask & GUESTFS_COMPRESS_OUT_LEVEL_BITMASK))
     level = -1;
 
-  if (get_filter (ctype, level, filter, sizeof filter) == -1)
+  switch (get_filter (ctype, level, filter, sizeof filter)) {
+  case -1:
     return -1;
+  case 1:
+    return do_compress_native_out (file, ctype, level, 0);
+  }
 
   return do_compressX_out (file, filter, 0);
 }
@@ -208,8 +294,12 @@ do_compress_device_out (const char *ctype, const char *file, int level)
   if (!(optargs_bitmask & GUESTFS_COMPRESS_DEVICE_OUT_LEVEL_BITMASK))
     level = -1;
 
-  if (get_filter (ctype, level, filter, sizeof filter) == -1)
+  switch (get_filter (ctype, level, filter, sizeof filter)) {
+  case -1:
     return -1;
+  case 1:
+    return do_compress_native_out (file, ctype, level, 1);
+  }
 
   return do_compressX_out (file, filter, 1);
 }
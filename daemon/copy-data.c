@@ -0,0 +1,453 @@
+/* libguestfs - the guestfsd daemon
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Copy data between two file descriptors, as used by copy_*_to_*,
+ * copy_size and dd.
+ *
+ * If the kernel can copy the data itself (copy_file_range between
+ * regular files) then that is used.  Otherwise a thread reads the
+ * source into one of two large aligned buffers while the calling
+ * thread writes the other one, so reads and writes overlap.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "guestfs_protocol.h"
+#include "daemon.h"
+
+/* Alignment of the buffers, and of the offsets and lengths used with
+ * O_DIRECT.
+ */
+#define COPY_ALIGN 4096
+
+/* With COPY_DATA_SPARSE, zeroes are skipped in blocks of this size. */
+#define SPARSE_BLOCK_SIZE 4096
+
+/* Runs of zeroes at least this long are punched out of the
+ * destination, instead of only being skipped.
+ */
+#define SPARSE_PUNCH_MIN (1024 * 1024)
+
+struct copy_buffer {
+  char *data;
+  size_t len;                   /* bytes read, 0 at end of file */
+  int err;                      /* errno, if the read failed */
+  int full;                     /* set by the reader, cleared by the writer */
+};
+
+struct copy_state {
+  int src_fd;
+  int64_t size;                 /* bytes left to read, or -1 */
+  size_t buffer_size;
+  int direct;                   /* source has O_DIRECT */
+  struct copy_buffer buf[2];
+  int quit;                     /* set by the writer on error */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+/* Clear O_DIRECT on a file descriptor, for the last unaligned part. */
+static void
+clear_direct (int fd)
+{
+  int fl = fcntl (fd, F_GETFL);
+
+  if (fl >= 0)
+    fcntl (fd, F_SETFL, fl & ~O_DIRECT);
+}
+
+static int
+set_direct (int fd)
+{
+  int fl = fcntl (fd, F_GETFL);
+
+  return fl >= 0 && fcntl (fd, F_SETFL, fl | O_DIRECT) == 0;
+}
+
+/* Fill a buffer, reading again after short reads so that the buffer
+ * is only short at the end of the file.
+ */
+static void
+fill_buffer (struct copy_state *state, struct copy_buffer *b)
+{
+  size_t n = state->buffer_size;
+  ssize_t r;
+
+  if (state->size >= 0 && (uint64_t) state->size < n)
+    n = state->size;
+
+  if (state->direct && n % COPY_ALIGN != 0) {
+    clear_direct (state->src_fd);
+    state->direct = 0;
+  }
+
+  b->len = 0;
+  b->err = 0;
+  while (b->len < n) {
+    r = read (state->src_fd, b->data + b->len, n - b->len);
+    if (r == -1) {
+      if (errno == EINTR)
+        continue;
+      b->err = errno;
+      break;
+    }
+    if (r == 0)
+      break;
+    b->len += r;
+    if (state->direct && b->len % COPY_ALIGN != 0) {
+      clear_direct (state->src_fd);
+      state->direct = 0;
+    }
+  }
+
+  if (state->size >= 0)
+    state->size -= b->len;
+}
+
+static void *
+reader_thread (void *vp)
+{
+  struct copy_state *state = vp;
+  size_t i;
+
+  for (i = 0; ; i ^= 1) {
+    struct copy_buffer *b = &state->buf[i];
+
+    pthread_mutex_lock (&state->lock);
+    while (!state->quit && b->full)
+      pthread_cond_wait (&state->cond, &state->lock);
+    pthread_mutex_unlock (&state->lock);
+    if (state->quit)
+      break;
+
+    fill_buffer (state, b);
+
+    pthread_mutex_lock (&state->lock);
+    b->full = 1;
+    pthread_cond_broadcast (&state->cond);
+    pthread_mutex_unlock (&state->lock);
+
+    if (b->len == 0 || b->err != 0)
+      break;
+  }
+
+  return NULL;
+}
+
+/* The run of zeroes not yet skipped in a sparse copy. */
+struct sparse_state {
+  int64_t hole;
+  int no_punch;                 /* set if punching holes failed */
+};
+
+/* Skip the pending run of zeroes, punching it out of the destination
+ * if it is long enough.  Punching is only an optimization, so if it
+ * fails we carry on by seeking.
+ */
+static int
+end_hole (int dest_fd, struct sparse_state *sp)
+{
+  if (sp->hole == 0)
+    return 0;
+
+#ifdef FALLOC_FL_PUNCH_HOLE
+  if (sp->hole >= SPARSE_PUNCH_MIN && !sp->no_punch) {
+    const off_t pos = lseek (dest_fd, 0, SEEK_CUR);
+
+    if (pos == -1 ||
+        fallocate (dest_fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,
+                   pos, sp->hole) == -1)
+      sp->no_punch = 1;
+  }
+#endif
+
+  if (lseek (dest_fd, sp->hole, SEEK_CUR) == -1)
+    return -1;
+  sp->hole = 0;
+  return 0;
+}
+
+/* Write a buffer.  If 'sp' is not NULL, runs of zero blocks are
+ * skipped instead of written.
+ */
+static int
+write_buffer (int dest_fd, const char *buf, size_t len,
+              struct sparse_state *sp)
+{
+  size_t i, j, n;
+
+  if (sp == NULL)
+    return xwrite (dest_fd, buf, len);
+
+  for (i = 0; i < len; i = j) {
+    /* Find the run of blocks which are all zero or all not zero. */
+    n = MIN (len - i, SPARSE_BLOCK_SIZE);
+    const int zero = is_zero (&buf[i], n);
+
+    for (j = i + n; j < len; j += n) {
+      n = MIN (len - j, SPARSE_BLOCK_SIZE);
+      if (is_zero (&buf[j], n) != zero)
+        break;
+    }
+
+    if (zero)
+      sp->hole += j - i;
+    else if (end_hole (dest_fd, sp) == -1 ||
+             xwrite (dest_fd, &buf[i], j - i) == -1)
+      return -1;
+  }
+
+  return 0;
+}
+
+#ifdef HAVE_COPY_FILE_RANGE
+/* Let the kernel copy the data.  Returns the number of bytes copied,
+ * which may be less than 'size' if the kernel cannot copy between
+ * these files, in which case the caller carries on with the buffers.
+ * Returns -1 on error.
+ */
+static int64_t
+copy_range (int src_fd, int dest_fd, int64_t size)
+{
+  int64_t copied = 0;
+  size_t n;
+  ssize_t r;
+
+  while (size == -1 || copied < size) {
+    n = size == -1 || size - copied > SSIZE_MAX ? SSIZE_MAX : size - copied;
+    r = copy_file_range (src_fd, NULL, dest_fd, NULL, n, 0);
+    if (r == -1) {
+      if (errno == EINTR)
+        continue;
+      if (errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+          errno == EOPNOTSUPP || errno == EBADF)
+        break;                  /* use read and write */
+      return -1;
+    }
+    if (r == 0) {
+      /* End of the source, or nothing copied: carry on with read and
+       * write, which will tell which it is.
+       */
+      break;
+    }
+    copied += r;
+    if (size != -1)
+      notify_progress ((uint64_t) copied, (uint64_t) size);
+  }
+
+  return copied;
+}
+#endif
+
+/**
+ * Copy C<size> bytes (or to the end of the source if C<size> is
+ * C<-1>) from the current position of C<src_fd> to the current
+ * position of C<dest_fd>.  Sends progress messages.
+ *
+ * C<flags> is C<COPY_DATA_SPARSE> to seek over zeroes in the
+ * destination instead of writing them (long runs of zeroes are also
+ * punched out of the destination if it supports that), and C<COPY_DATA_DIRECT> to
+ * try to bypass the page cache with C<O_DIRECT>.  For
+ * C<COPY_DATA_DIRECT> the caller must have positioned both file
+ * descriptors at offsets aligned to 4096 bytes.
+ *
+ * Returns C<0> or C<-1>.  On error, this calls C<reply_with_*> and
+ * does not close the file descriptors.
+ */
+int
+copy_data (int src_fd, const char *src_display,
+           int dest_fd, const char *dest_display,
+           int64_t size, int flags)
+{
+  struct copy_state state = {
+    .src_fd = src_fd, .size = size, .buffer_size = COPY_BUFFER_SIZE,
+  };
+  struct sparse_state sparse = { .hole = 0 };
+  struct sparse_state *sp = flags & COPY_DATA_SPARSE ? &sparse : NULL;
+  const uint64_t total = size;
+  uint64_t written = 0;
+  pthread_t thread;
+  int dest_direct = 0;
+  size_t i;
+  int err, r = -1;
+
+  if (size == -1)
+    pulse_mode_start ();
+
+#ifdef HAVE_COPY_FILE_RANGE
+  if (!(flags & COPY_DATA_SPARSE)) {
+    const int64_t copied = copy_range (src_fd, dest_fd, size);
+
+    if (copied == -1) {
+      err = errno;
+      if (size == -1)
+        pulse_mode_cancel ();
+      reply_with_error_errno (err, "copy_file_range: %s: %s",
+                              src_display, dest_display);
+      return -1;
+    }
+    written = copied;
+    if (size != -1) {
+      state.size -= copied;
+      if (state.size == 0)
+        goto done;
+    }
+  }
+#endif
+
+  if (flags & COPY_DATA_DIRECT) {
+    state.direct = set_direct (src_fd);
+    dest_direct = set_direct (dest_fd);
+  }
+
+  for (i = 0; i < 2; ++i) {
+    err = posix_memalign ((void **) &state.buf[i].data, COPY_ALIGN,
+                          state.buffer_size);
+    if (err != 0) {
+      state.buf[i].data = NULL;
+      if (size == -1)
+        pulse_mode_cancel ();
+      reply_with_error_errno (err, "posix_memalign");
+      goto out_free;
+    }
+  }
+
+  pthread_mutex_init (&state.lock, NULL);
+  pthread_cond_init (&state.cond, NULL);
+  err = pthread_create (&thread, NULL, reader_thread, &state);
+  if (err != 0) {
+    if (size == -1)
+      pulse_mode_cancel ();
+    reply_with_error_errno (err, "pthread_create");
+    goto out_destroy;
+  }
+
+  for (i = 0; ; i ^= 1) {
+    struct copy_buffer *b = &state.buf[i];
+
+    pthread_mutex_lock (&state.lock);
+    while (!b->full)
+      pthread_cond_wait (&state.cond, &state.lock);
+    pthread_mutex_unlock (&state.lock);
+
+    if (b->err != 0) {
+      if (size == -1)
+        pulse_mode_cancel ();
+      reply_with_error_errno (b->err, "read: %s", src_display);
+      goto out_join;
+    }
+    if (b->len == 0) {
+      if (size == -1 || written == total)
+        break;
+      reply_with_error ("%s: input too short", src_display);
+      goto out_join;
+    }
+
+    if (dest_direct && b->len % COPY_ALIGN != 0) {
+      clear_direct (dest_fd);
+      dest_direct = 0;
+    }
+    if (write_buffer (dest_fd, b->data, b->len, sp) == -1) {
+      err = errno;
+      if (size == -1)
+        pulse_mode_cancel ();
+      reply_with_error_errno (err, "write: %s", dest_display);
+      goto out_join;
+    }
+    written += b->len;
+    if (size != -1) {
+      notify_progress (written, total);
+      if (written == total)
+        break;
+    }
+
+    if (call_cancelled ()) {
+      if (size == -1)
+        pulse_mode_cancel ();
+      reply_with_error_errno (EINTR, "%s: operation cancelled by user",
+                              dest_display);
+      goto out_join;
+    }
+
+    pthread_mutex_lock (&state.lock);
+    b->full = 0;
+    pthread_cond_broadcast (&state.cond);
+    pthread_mutex_unlock (&state.lock);
+  }
+
+  /* If the file ends with zeroes which were skipped, extend it. */
+  if (sp != NULL) {
+    struct stat statbuf;
+    off_t end;
+
+    if (end_hole (dest_fd, sp) == -1) {
+      err = errno;
+      if (size == -1)
+        pulse_mode_cancel ();
+      reply_with_error_errno (err, "lseek: %s", dest_display);
+      goto out_join;
+    }
+    end = lseek (dest_fd, 0, SEEK_CUR);
+    if (end >= 0 && fstat (dest_fd, &statbuf) == 0 &&
+        S_ISREG (statbuf.st_mode) && statbuf.st_size < end &&
+        ftruncate (dest_fd, end) == -1) {
+      err = errno;
+      if (size == -1)
+        pulse_mode_cancel ();
+      reply_with_error_errno (err, "ftruncate: %s", dest_display);
+      goto out_join;
+    }
+  }
+  r = 0;
+
+ out_join:
+  pthread_mutex_lock (&state.lock);
+  state.quit = 1;
+  pthread_cond_broadcast (&state.cond);
+  pthread_mutex_unlock (&state.lock);
+  pthread_join (thread, NULL);
+ out_destroy:
+  pthread_mutex_destroy (&state.lock);
+  pthread_cond_destroy (&state.cond);
+ out_free:
+  free (state.buf[0].data);
+  free (state.buf[1].data);
+  if (r == -1)
+    return -1;
+
+#ifdef HAVE_COPY_FILE_RANGE
+ done:
+#endif
+  if (size == -1)
+    pulse_mode_end ();
+
+  return 0;
+}
@@ -21,8 +21,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/types.h>
 
 #include "guestfs_protocol.h"
@@ -34,6 +38,7 @@
 
 /* flags */
 #define COPY_UNLINK_DEST_ON_FAILURE 1
+#define COPY_DIRECT 2
 
 /* NB: We cheat slightly by assuming that optargs_bitmask is
  * compatible for all four of the calls.  This is true provided they
@@ -48,18 +53,8 @@ copy (const char *src, const char *src_display,
       int flags,
       int64_t srcoffset, int64_t destoffset, int64_t size, int sparse)
 {
-  const int64_t saved_size = size;
   int src_fd, dest_fd;
-  CLEANUP_FREE char *buf = NULL;
-  size_t n;
-  ssize_t r;
-  int err;
-
-  buf = malloc (BUFSIZ);
-  if (buf == NULL) {
-    reply_with_perror ("malloc");
-    return -1;
-  }
+  int copy_flags = 0;
 
   if ((optargs_bitmask & GUESTFS_COPY_DEVICE_TO_DEVICE_SRCOFFSET_BITMASK)) {
     if (srcoffset < 0) {
@@ -91,6 +86,15 @@ copy (const char *src, const char *src_display,
   if (! (optargs_bitmask & GUESTFS_COPY_DEVICE_TO_DEVICE_SPARSE_BITMASK))
     sparse = 0;
 
+  if (sparse)
+    copy_flags |= COPY_DATA_SPARSE;
+  /* Large copies between devices don't need to go through the page
+   * cache of the appliance.
+   */
+  else if ((flags & COPY_DIRECT) &&
+           srcoffset % 4096 == 0 && destoffset % 4096 == 0)
+    copy_flags |= COPY_DATA_DIRECT;
+
   /* Open source and destination. */
   src_fd = open (src, O_RDONLY|O_CLOEXEC);
   if (src_fd == -1) {
@@ -113,86 +117,12 @@ copy (const char *src, const char *src_display,
 
   if (destoffset > 0 && lseek (dest_fd, destoffset, SEEK_SET) == (off_t) -1) {
     reply_with_perror ("lseek: %s", dest_display);
-    close (src_fd);
-    close (dest_fd);
-    if (flags & COPY_UNLINK_DEST_ON_FAILURE)
-      unlink (dest);
-    return -1;
-  }
-
-  if (size == -1)
-    pulse_mode_start ();
-
-  while (size != 0) {
-    /* Calculate bytes to copy. */
-    if (size == -1 || size > BUFSIZ)
-      n = BUFSIZ;
-    else
-      n = size;
-
-    r = read (src_fd, buf, n);
-    if (r == -1) {
-      err = errno;
-      if (size == -1)
-        pulse_mode_cancel ();
-      errno = err;
-      reply_with_perror ("read: %s", src_display);
-      close (src_fd);
-      close (dest_fd);
-      if (flags & COPY_UNLINK_DEST_ON_FAILURE)
-        unlink (dest);
-      return -1;
-    }
-
-    if (r == 0) {
-      if (size == -1) /* if size == -1, this is normal end of loop */
-        break;
-      reply_with_error ("%s: input too short", src_display);
-      close (src_fd);
-      close (dest_fd);
-      if (flags & COPY_UNLINK_DEST_ON_FAILURE)
-        unlink (dest);
-      return -1;
-    }
-
-    if (sparse && is_zero (buf, r)) {
-      if (lseek (dest_fd, r, SEEK_CUR) == -1) {
-        err = errno;
-        if (size == -1)
-          pulse_mode_cancel ();
-        errno = err;
-        reply_with_perror ("%s: seek (because of sparse flag)", dest_display);
-        close (src_fd);
-        close (dest_fd);
-        if (flags & COPY_UNLINK_DEST_ON_FAILURE)
-          unlink (dest);
-        return -1;
-      }
-      goto sparse_skip;
-    }
-
-    if (xwrite (dest_fd, buf, r) == -1) {
-      err = errno;
-      if (size == -1)
-        pulse_mode_cancel ();
-      errno = err;
-      reply_with_perror ("%s: write", dest_display);
-      close (src_fd);
-      close (dest_fd);
-      if (flags & COPY_UNLINK_DEST_ON_FAILURE)
-        unlink (dest);
-      return -1;
-    }
-  sparse_skip:
-
-    if (size != -1) {
-      size -= r;
-      notify_progress ((uint64_t) (saved_size - size), (uint64_t) saved_size);
-    }
+    goto error;
   }
 
-  if (size == -1)
-    pulse_mode_end ();
+  if (copy_data (src_fd, src_display, dest_fd, dest_display,
+                 size, copy_flags) == -1)
+    goto error;
 
   if (close (src_fd) == -1) {
     reply_with_perror ("close: %s", src_display);
@@ -210,6 +140,13 @@ copy (const char *src, const char *src_display,
   }
 
   return 0;
+
+ error:
+  close (src_fd);
+  close (dest_fd);
+  if (flags & COPY_UNLINK_DEST_ON_FAILURE)
+    unlink (dest);
+  return -1;
 }
 
 int
@@ -222,7 +159,7 @@ do_copy_device_to_device (const char *src, const char *dest,
     reply_with_error ("the append flag cannot be set for this call");
     return -1;
   }
-  return copy (src, src, dest, dest, DEST_DEVICE_FLAGS, 0,
+  return copy (src, src, dest, dest, DEST_DEVICE_FLAGS, COPY_DIRECT,
                srcoffset, destoffset, size, sparse);
 }
 
@@ -301,3 +238,381 @@ do_copy_file_to_file (const char *src, const char *dest,
                COPY_UNLINK_DEST_ON_FAILURE,
                srcoffset, destoffset, size, sparse);
 }
+
+/* copy_device_to_device_multiple copies several devices at the same
+ * time, each by one thread using pread and pwrite.  The threads must
+ * not reply, so errors are saved in the jobs, and progress is sent by
+ * the request thread.
+ */
+struct copy_job {
+  const char *src, *dest;
+  int64_t size;                 /* bytes to copy */
+  guestfs_int_blockrange_list *free; /* ranges not copied, or NULL */
+  const char *failed;           /* what failed, if err != 0 */
+  int err;
+};
+
+struct copy_pool {
+  struct copy_job *jobs;
+  size_t nr_jobs;
+  size_t next_job;
+  size_t done;
+  char **buffers;               /* one per thread */
+  size_t nr_threads;
+  int sparse;
+  int quit;                     /* set when a copy fails */
+  uint64_t copied;              /* bytes copied or skipped so far */
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+};
+
+static void
+add_copied (struct copy_pool *pool, uint64_t n)
+{
+  pthread_mutex_lock (&pool->lock);
+  pool->copied += n;
+  pthread_cond_broadcast (&pool->changed);
+  pthread_mutex_unlock (&pool->lock);
+}
+
+static int
+pwrite_all (int fd, const char *buf, size_t len, int64_t offset)
+{
+  ssize_t r;
+
+  while (len > 0) {
+    r = pwrite (fd, buf, len, offset);
+    if (r == -1) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    buf += r;
+    len -= r;
+    offset += r;
+  }
+  return 0;
+}
+
+/* Write a buffer, skipping the blocks of zeroes if 'sparse'. */
+static int
+write_blocks (int fd, const char *buf, size_t len, int64_t offset,
+              int sparse)
+{
+  const size_t bs = 4096;
+  size_t i, j;
+
+  if (!sparse)
+    return pwrite_all (fd, buf, len, offset);
+
+  for (i = 0; i < len; i = j) {
+    /* Find the run of non-zero blocks starting at i. */
+    for (j = i; j < len && !is_zero (&buf[j], MIN (bs, len - j)); j += bs)
+      ;
+    if (j > len)
+      j = len;
+    if (j > i && pwrite_all (fd, &buf[i], j - i, offset + i) == -1)
+      return -1;
+    /* Skip the zero blocks. */
+    for (; j < len && is_zero (&buf[j], MIN (bs, len - j)); j += bs)
+      ;
+    if (j > len)
+      j = len;
+  }
+  return 0;
+}
+
+/* Copy the range [start, end) of the job. */
+static int
+copy_job_range (struct copy_pool *pool, struct copy_job *job,
+                int src_fd, int dest_fd, char *buf,
+                int64_t start, int64_t end)
+{
+  size_t n;
+  ssize_t r;
+
+  while (start < end) {
+    if (pool->quit || call_cancelled ())
+      return -1;
+
+    n = MIN ((uint64_t) (end - start), COPY_BUFFER_SIZE);
+    r = pread (src_fd, buf, n, start);
+    if (r == -1) {
+      if (errno == EINTR)
+        continue;
+      job->failed = "read";
+      job->err = errno;
+      return -1;
+    }
+    if (r == 0) {
+      job->failed = "read";
+      job->err = EIO;
+      return -1;
+    }
+    if (write_blocks (dest_fd, buf, r, start, pool->sparse) == -1) {
+      job->failed = "write";
+      job->err = errno;
+      return -1;
+    }
+    start += r;
+    add_copied (pool, r);
+  }
+
+  return 0;
+}
+
+static void
+run_copy_job (struct copy_pool *pool, struct copy_job *job, char *buf)
+{
+  int src_fd, dest_fd;
+  int64_t pos = 0, start, end;
+  size_t i;
+
+  src_fd = open (job->src, O_RDONLY|O_CLOEXEC);
+  if (src_fd == -1) {
+    job->failed = "open";
+    job->err = errno;
+    return;
+  }
+  dest_fd = open (job->dest, O_WRONLY|O_CLOEXEC);
+  if (dest_fd == -1) {
+    job->failed = "open";
+    job->err = errno;
+    close (src_fd);
+    return;
+  }
+
+  /* Copy the ranges between the free ranges. */
+  for (i = 0; job->free && i < job->free->guestfs_int_blockrange_list_len; ++i) {
+    start = job->free->guestfs_int_blockrange_list_val[i].br_start;
+    end = start + job->free->guestfs_int_blockrange_list_val[i].br_size;
+    if (start >= job->size)
+      break;
+    if (end > job->size)
+      end = job->size;
+    if (start > pos &&
+        copy_job_range (pool, job, src_fd, dest_fd, buf, pos, start) == -1)
+      goto out;
+    add_copied (pool, end - start);
+    pos = end;
+  }
+  if (pos < job->size)
+    copy_job_range (pool, job, src_fd, dest_fd, buf, pos, job->size);
+
+ out:
+  if (close (src_fd) == -1 && job->err == 0) {
+    job->failed = "close";
+    job->err = errno;
+  }
+  if (close (dest_fd) == -1 && job->err == 0) {
+    job->failed = "close";
+    job->err = errno;
+  }
+}
+
+static void *
+copy_thread (void *poolvp)
+{
+  struct copy_pool *pool = poolvp;
+  struct copy_job *job;
+  char *buf;
+
+  pthread_mutex_lock (&pool->lock);
+  buf = pool->buffers[pool->nr_threads++];
+
+  for (;;) {
+    if (pool->next_job >= pool->nr_jobs)
+      break;
+    job = &pool->jobs[pool->next_job++];
+    pthread_mutex_unlock (&pool->lock);
+
+    if (!pool->quit)
+      run_copy_job (pool, job, buf);
+
+    pthread_mutex_lock (&pool->lock);
+    if (job->err != 0)
+      pool->quit = 1;
+    pool->done++;
+    pthread_cond_broadcast (&pool->changed);
+  }
+
+  pthread_mutex_unlock (&pool->lock);
+  return NULL;
+}
+
+/* Takes optional arguments, consult optargs_bitmask. */
+int
+do_copy_device_to_device_multiple (char *const *srcs, char *const *dests,
+                                   int sparse, int usedonly, int maxjobs)
+{
+  const size_t n = count_strings (srcs);
+  CLEANUP_FREE struct copy_job *jobs = NULL;
+  CLEANUP_FREE pthread_t *threads = NULL;
+  CLEANUP_FREE char **buffers = NULL;
+  struct copy_pool pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .changed = PTHREAD_COND_INITIALIZER,
+  };
+  size_t i, nr_threads, nr_started;
+  uint64_t total = 0, reported;
+  struct timespec ts;
+  long nr_cpus;
+  int err, r = -1;
+
+  if (!(optargs_bitmask & GUESTFS_COPY_DEVICE_TO_DEVICE_MULTIPLE_SPARSE_BITMASK))
+    sparse = 0;
+  if (!(optargs_bitmask & GUESTFS_COPY_DEVICE_TO_DEVICE_MULTIPLE_USEDONLY_BITMASK))
+    usedonly = 0;
+  if (!(optargs_bitmask & GUESTFS_COPY_DEVICE_TO_DEVICE_MULTIPLE_MAXJOBS_BITMASK))
+    maxjobs = 0;
+  if (maxjobs < 0) {
+    reply_with_error ("maxjobs cannot be negative");
+    return -1;
+  }
+  if (count_strings (dests) != n) {
+    reply_with_error ("srcs and dests must have the same length");
+    return -1;
+  }
+
+  jobs = calloc (n, sizeof *jobs);
+  if (jobs == NULL && n > 0) {
+    reply_with_perror ("calloc");
+    return -1;
+  }
+
+  /* Work out what to copy in this thread, since these reply on error. */
+  for (i = 0; i < n; ++i) {
+    int64_t src_size, dest_size;
+
+    jobs[i].src = srcs[i];
+    jobs[i].dest = dests[i];
+    if (STREQ (srcs[i], dests[i])) {
+      reply_with_error ("%s: cannot copy a device onto itself", srcs[i]);
+      goto out;
+    }
+
+    src_size = do_blockdev_getsize64 (srcs[i]);
+    if (src_size == -1)
+      goto out;
+    dest_size = do_blockdev_getsize64 (dests[i]);
+    if (dest_size == -1)
+      goto out;
+    jobs[i].size = MIN (src_size, dest_size);
+    total += jobs[i].size;
+
+    /* The free space maps are only right if the filesystem is not
+     * being changed.
+     */
+    if (usedonly) {
+      CLEANUP_FREE char *type = NULL;
+      int mounted;
+
+      type = get_blkid_tag (srcs[i], "TYPE");
+      if (type == NULL)
+        goto out;
+      mounted = is_device_mounted (srcs[i]);
+      if (mounted == -1)
+        goto out;
+      if (!mounted && free_ranges_supported (type)) {
+        jobs[i].free = get_free_ranges (srcs[i]);
+        if (jobs[i].free == NULL)
+          goto out;
+      }
+    }
+  }
+
+  /* The copies wait for the disks most of the time, so run at least
+   * two even with one vCPU.
+   */
+  nr_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  nr_threads = maxjobs > 0 ? (size_t) maxjobs : (size_t) MAX (nr_cpus, 2);
+  nr_threads = MIN (nr_threads, n);
+  if (nr_threads == 0)
+    nr_threads = 1;
+
+  threads = calloc (nr_threads, sizeof *threads);
+  buffers = calloc (nr_threads, sizeof (char *));
+  if (threads == NULL || buffers == NULL) {
+    reply_with_perror ("calloc");
+    goto out;
+  }
+  for (i = 0; i < nr_threads; ++i) {
+    err = posix_memalign ((void **) &buffers[i], 4096, COPY_BUFFER_SIZE);
+    if (err != 0) {
+      buffers[i] = NULL;
+      reply_with_error_errno (err, "posix_memalign");
+      goto out;
+    }
+  }
+
+  pool.jobs = jobs;
+  pool.nr_jobs = n;
+  pool.buffers = buffers;
+  pool.sparse = sparse;
+
+  for (nr_started = 0; nr_started < nr_threads; ++nr_started) {
+    if (pthread_create (&threads[nr_started], NULL, copy_thread, &pool) != 0)
+      break;
+  }
+  /* If no thread could be started, copy them in this thread. */
+  if (nr_started == 0)
+    copy_thread (&pool);
+
+  /* Wake up regularly even if nothing was copied, to check whether
+   * the call has been cancelled.
+   */
+  pthread_mutex_lock (&pool.lock);
+  reported = 0;
+  while (pool.done < n) {
+    if (pool.copied == reported) {
+      clock_gettime (CLOCK_REALTIME, &ts);
+      ts.tv_nsec += 100000000;
+      if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait (&pool.changed, &pool.lock, &ts);
+    }
+    if (call_cancelled ())
+      pool.quit = 1;
+    reported = pool.copied;
+    pthread_mutex_unlock (&pool.lock);
+    if (total > 0)
+      notify_progress (reported, total);
+    pthread_mutex_lock (&pool.lock);
+  }
+  pthread_mutex_unlock (&pool.lock);
+
+  for (i = 0; i < nr_started; ++i)
+    pthread_join (threads[i], NULL);
+
+  if (call_cancelled ()) {
+    reply_with_error_errno (EINTR, "operation cancelled by user");
+    goto out;
+  }
+
+  for (i = 0; i < n; ++i) {
+    if (jobs[i].err != 0) {
+      reply_with_error_errno (jobs[i].err, "%s: %s: %s: %s",
+                              jobs[i].failed,
+                              jobs[i].src, jobs[i].dest,
+                              strerror (jobs[i].err));
+      goto out;
+    }
+  }
+
+  if (total > 0)
+    notify_progress (total, total);
+  r = 0;
+
+ out:
+  for (i = 0; i < n; ++i) {
+    if (jobs[i].free) {
+      free (jobs[i].free->guestfs_int_blockrange_list_val);
+      free (jobs[i].free);
+    }
+  }
+  for (i = 0; buffers && i < nr_threads; ++i)
+    free (buffers[i]);
+  return r;
+}
@@ -21,6 +21,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <libgen.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
 
 #include "daemon.h"
 #include "actions.h"
@@ -28,12 +35,118 @@
 GUESTFSD_EXT_CMD(str_cp, cp);
 GUESTFSD_EXT_CMD(str_mv, mv);
 
+/* Older coreutils never clone files unless asked to, newer ones try
+ * to by default.  Cloning (on btrfs, xfs etc) makes the copy share
+ * the data of the source, so copying big trees is almost instant.
+ */
+#define REFLINK_AUTO "--reflink=auto"
+
 static int cpmv_cmd (const char *cmd, const char *flags, const char *src, const char *dest);
 
+/* Copy the regular file 'src_fd' to 'dest'.  The data is shared with
+ * the source if the filesystem can clone files (FICLONE), otherwise
+ * it is copied by copy_data, which lets the kernel copy it if it can
+ * (copy_file_range) and uses large buffers if it can't.
+ */
+static int
+copy_regular_file (int src_fd, const struct stat *src_statbuf,
+                   const char *src, const char *destbuf, const char *dest)
+{
+  int dest_fd;
+
+  /* Like cp, an existing file is truncated and keeps its mode. */
+  dest_fd = open (destbuf, O_WRONLY|O_CREAT|O_TRUNC|O_NOCTTY|O_CLOEXEC,
+                  src_statbuf->st_mode & 0777);
+  if (dest_fd == -1) {
+    reply_with_perror ("%s", dest);
+    return -1;
+  }
+
+#ifdef FICLONE
+  if (ioctl (dest_fd, FICLONE, src_fd) == 0)
+    goto done;
+#endif
+
+  if (copy_data (src_fd, src, dest_fd, dest, -1, 0) == -1) {
+    close (dest_fd);
+    return -1;
+  }
+
+#ifdef FICLONE
+ done:
+#endif
+  if (close (dest_fd) == -1) {
+    reply_with_perror ("close: %s", dest);
+    return -1;
+  }
+
+  return 0;
+}
+
 int
 do_cp (const char *src, const char *dest)
 {
-  return cpmv_cmd (str_cp, NULL, src, dest);
+  CLEANUP_FREE char *srcbuf = NULL, *destbuf = NULL;
+  CLEANUP_FREE char *srccopy = NULL, *destdir = NULL;
+  struct stat src_statbuf, dest_statbuf;
+  int src_fd, r;
+
+  srcbuf = sysroot_path (src);
+  if (srcbuf == NULL) {
+    reply_with_perror ("malloc");
+    return -1;
+  }
+
+  src_fd = open (srcbuf, O_RDONLY|O_NOCTTY|O_NONBLOCK|O_CLOEXEC);
+  if (src_fd == -1) {
+    reply_with_perror ("%s", src);
+    return -1;
+  }
+  if (fstat (src_fd, &src_statbuf) == -1) {
+    reply_with_perror ("fstat: %s", src);
+    close (src_fd);
+    return -1;
+  }
+  /* Leave everything except copying regular files to cp. */
+  if (!S_ISREG (src_statbuf.st_mode)) {
+    close (src_fd);
+    return cpmv_cmd (str_cp, NULL, src, dest);
+  }
+
+  /* If the destination is a directory, copy into it. */
+  destbuf = sysroot_path (dest);
+  if (destbuf == NULL) {
+    reply_with_perror ("malloc");
+    close (src_fd);
+    return -1;
+  }
+  if (stat (destbuf, &dest_statbuf) == 0 && S_ISDIR (dest_statbuf.st_mode)) {
+    srccopy = strdup (src);
+    if (srccopy == NULL) {
+      reply_with_perror ("strdup");
+      close (src_fd);
+      return -1;
+    }
+    destdir = destbuf;
+    if (asprintf (&destbuf, "%s/%s", destdir, basename (srccopy)) == -1) {
+      destbuf = NULL;
+      reply_with_perror ("asprintf");
+      close (src_fd);
+      return -1;
+    }
+  }
+
+  if (stat (destbuf, &dest_statbuf) == 0 &&
+      dest_statbuf.st_dev == src_statbuf.st_dev &&
+      dest_statbuf.st_ino == src_statbuf.st_ino) {
+    reply_with_error ("'%s' and '%s' are the same file", src, dest);
+    close (src_fd);
+    return -1;
+  }
+
+  r = copy_regular_file (src_fd, &src_statbuf, src, destbuf, dest);
+  close (src_fd);
+  return r;
 }
 
 int
@@ -59,6 +172,9 @@ cpmv_cmd (const char *cmd, const char *flags, const char *src, const char *dest)
 {
   CLEANUP_FREE char *srcbuf = NULL, *destbuf = NULL;
   CLEANUP_FREE char *err = NULL;
+  const size_t MAX_ARGS = 8;
+  const char *argv[MAX_ARGS];
+  size_t i = 0;
   int r;
 
   srcbuf = sysroot_path (src);
@@ -73,12 +189,18 @@ cpmv_cmd (const char *cmd, const char *flags, const char *src, const char *dest)
     return -1;
   }
 
+  ADD_ARG (argv, i, cmd);
+  if (flags)
+    ADD_ARG (argv, i, flags);
+  if (cmd == str_cp)
+    ADD_ARG (argv, i, REFLINK_AUTO);
+  ADD_ARG (argv, i, srcbuf);
+  ADD_ARG (argv, i, destbuf);
+  ADD_ARG (argv, i, NULL);
+
   pulse_mode_start ();
 
-  if (flags)
-    r = command (NULL, &err, cmd, flags, srcbuf, destbuf, NULL);
-  else
-    r = command (NULL, &err, cmd, srcbuf, destbuf, NULL);
+  r = commandv (NULL, &err, (const char * const *) argv);
 
   if (r == -1) {
     pulse_mode_cancel ();
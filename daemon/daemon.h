@@ -24,6 +24,7 @@
 #include <stdint.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sys/uio.h>
 
 #include <rpc/types.h>
 #include <rpc/xdr.h>
@@ -72,6 +73,10 @@ extern int xwrite (int sock, const void *buf, size_t len)
   __attribute__((__warn_unused_result__));
 extern int xread (int sock, void *buf, size_t len)
   __attribute__((__warn_unused_result__));
+extern int xwritev (int sock, struct iovec *iov, int iovcnt)
+  __attribute__((__warn_unused_result__));
+extern int xreadv (int sock, struct iovec *iov, int iovcnt)
+  __attribute__((__warn_unused_result__));
 
 extern char *mountable_to_string (const mountable_t *mountable);
 
@@ -151,12 +156,18 @@ extern int asprintf_nowarn (char **strp, const char *fmt, ...);
 
 /*-- in names.c (auto-generated) --*/
 extern const char *function_names[];
+extern const char reentrant_functions[];
+extern const char filein_functions[];
 
 /*-- in proto.c --*/
-extern int proc_nr;
-extern int serial;
-extern uint64_t progress_hint;
-extern uint64_t optargs_bitmask;
+/* These describe the request being processed by the current thread. */
+extern __thread int proc_nr;
+extern __thread int serial;
+extern __thread uint64_t progress_hint;
+extern __thread uint64_t optargs_bitmask;
+extern size_t chunk_size;
+extern size_t nr_data_channels;
+extern size_t nr_workers;
 
 /*-- in mount.c --*/
 extern int is_root_mounted (void);
@@ -191,6 +202,10 @@ extern int64_t ext_minimum_size (const char *device);
 
 /*-- in blkid.c --*/
 extern char *get_blkid_tag (const char *device, const char *tag);
+extern void blkid_cache_invalidate (const char *device);
+
+/*-- in devsparts.c --*/
+extern void devsparts_cache_invalidate (void);
 
 /*-- in lvm.c --*/
 extern int lv_canonical (const char *device, char **ret);
@@ -199,6 +214,26 @@ extern int lv_canonical (const char *device, char **ret);
 extern void copy_lvm (void);
 extern void start_lvmetad (void);
 
+/*-- in compress-data.c --*/
+extern int native_compress_available (const char *ctype);
+extern int send_compressed (int fd, const char *ctype, int level);
+typedef void (*compress_input_cb) (void *opaque, const char *buf, size_t len);
+extern int send_compressed_cb (int fd, const char *ctype, int level, compress_input_cb cb, void *opaque);
+
+/*-- in tar-create.c --*/
+extern int send_tar (const char *path, int numericowner, const char *native_compress);
+
+/*-- in copy-data.c --*/
+/* Size of each of the two buffers used to copy data. */
+#define COPY_BUFFER_SIZE (4 * 1024 * 1024)
+#define COPY_DATA_SPARSE 1
+#define COPY_DATA_DIRECT 2
+extern int copy_data (int src_fd, const char *src_display, int dest_fd, const char *dest_display, int64_t size, int flags);
+
+/*-- in extents.c --*/
+extern int free_ranges_supported (const char *vfs_type);
+extern guestfs_int_blockrange_list *get_free_ranges (const char *device);
+
 /*-- in zero.c --*/
 extern void wipe_device_before_mkfs (const char *device);
 
@@ -226,6 +261,7 @@ extern void main_loop (int sock) __attribute__((noreturn));
 
 /*-- in xattr.c --*/
 extern int copy_xattrs (const char *src, const char *dest);
+extern void lxattrs_at (int dirfd, const char *name, guestfs_int_xattr_list *ret);
 
 /*-- in xfs.c --*/
 /* Documented in xfs_admin(8). */
@@ -256,6 +292,12 @@ extern int64_t ntfs_minimum_size (const char *device);
 extern int swap_set_uuid (const char *device, const char *uuid);
 extern int swap_set_label (const char *device, const char *label);
 
+/*-- in stats.c --*/
+extern void stats_start_call (void);
+extern void stats_end_call (void);
+extern void stats_count_settle (int64_t us);
+extern char *stats_format (int reset);
+
 /* ordinary daemon functions use these to indicate errors
  * NB: you don't need to prefix the string with the current command,
  * it is added automatically by the client-side RPC stubs.
@@ -286,9 +328,18 @@ extern int cancel_receive (void);
 
 /* daemon functions that return files (FileOut) should call
  * reply, then send_file_* for each FileOut parameter.
- * Note max write size if GUESTFS_MAX_CHUNK_SIZE.
+ * Note max write size if GUESTFS_MAX_CHUNK_SIZE.  Larger writes
+ * are split into chunks of the negotiated chunk_size.
  */
 extern int send_file_write (const void *buf, size_t len);
+/* Send up to one chunk read from fd, spliced where possible.
+ * Returns bytes sent, 0 = EOF, -1 = read error, -2 = cancelled.
+ */
+extern ssize_t send_file_from_fd (int fd, size_t len);
+/* Send a run of zero bytes without sending the data.
+ * Returns 0 = OK, -1 = error, -2 = cancelled.
+ */
+extern int send_file_hole (uint64_t len);
 extern int send_file_end (int cancel);
 
 /* only call this if there is a FileOut parameter */
@@ -300,6 +351,14 @@ extern void reply (xdrproc_t xdrp, char *ret);
  */
 extern void notify_progress (uint64_t position, uint64_t total);
 
+/* Returns true if the library has cancelled the current call (see
+ * guestfs_user_cancel).  Long-running loops should check this and
+ * fail with errno EINTR.  This function is self-rate-limiting so you
+ * can call it as often as necessary.  Calls with FileIn parameters
+ * can only be cancelled during the file transfer.
+ */
+extern int call_cancelled (void);
+
 /* Pulse mode progress messages.
  *
  * Call pulse_mode_start to start sending progress messages.
@@ -322,24 +381,6 @@ extern void pulse_mode_cancel (void);
  */
 extern void notify_progress_no_ratelimit (uint64_t position, uint64_t total, const struct timeval *now);
 
-/* Return true iff the buffer is all zero bytes.
- *
- * Note that gcc is smart enough to optimize this properly:
- * http://stackoverflow.com/questions/1493936/faster-means-of-checking-for-an-empty-buffer-in-c/1493989#1493989
- */
-static inline int
-is_zero (const char *buffer, size_t size)
-{
-  size_t i;
-
-  for (i = 0; i < size; ++i) {
-    if (buffer[i] != 0)
-      return 0;
-  }
-
-  return 1;
-}
-
 /* Helper for building up short lists of arguments.  Your code has to
  * define MAX_ARGS to a suitable value.
  */
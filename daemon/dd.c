@@ -21,132 +21,70 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <fcntl.h>
 
 #include "guestfs_protocol.h"
 #include "daemon.h"
 #include "actions.h"
 
-GUESTFSD_EXT_CMD(str_dd, dd);
-
-int
-do_dd (const char *src, const char *dest)
+/* Open 'src' and 'dest', which are devices or files in the guest. */
+static int
+open_src_dest (const char *src, const char *dest, int *src_fd, int *dest_fd)
 {
-  int src_is_dev, dest_is_dev;
-  CLEANUP_FREE char *if_arg = NULL, *of_arg = NULL;
-  CLEANUP_FREE char *err = NULL;
-  int r;
-
-  src_is_dev = STRPREFIX (src, "/dev/");
-
-  if (src_is_dev)
-    r = asprintf (&if_arg, "if=%s", src);
-  else
-    r = asprintf (&if_arg, "if=%s%s", sysroot, src);
-  if (r == -1) {
-    reply_with_perror ("asprintf");
-    return -1;
-  }
-
-  dest_is_dev = STRPREFIX (dest, "/dev/");
-
-  if (dest_is_dev)
-    r = asprintf (&of_arg, "of=%s", dest);
-  else
-    r = asprintf (&of_arg, "of=%s%s", sysroot, dest);
-  if (r == -1) {
-    reply_with_perror ("asprintf");
-    return -1;
-  }
-
-  r = command (NULL, &err, str_dd, "bs=1024K", if_arg, of_arg, NULL);
-  if (r == -1) {
-    reply_with_error ("%s: %s: %s", src, dest, err);
-    return -1;
-  }
-
-  return 0;
-}
-
-int
-do_copy_size (const char *src, const char *dest, int64_t ssize)
-{
-  int src_fd, dest_fd;
-
   if (STRPREFIX (src, "/dev/"))
-    src_fd = open (src, O_RDONLY | O_CLOEXEC);
+    *src_fd = open (src, O_RDONLY | O_CLOEXEC);
   else {
     CLEANUP_FREE char *buf = sysroot_path (src);
     if (!buf) {
       reply_with_perror ("malloc");
       return -1;
     }
-    src_fd = open (buf, O_RDONLY | O_CLOEXEC);
+    *src_fd = open (buf, O_RDONLY | O_CLOEXEC);
   }
-  if (src_fd == -1) {
+  if (*src_fd == -1) {
     reply_with_perror ("%s", src);
     return -1;
   }
 
   if (STRPREFIX (dest, "/dev/"))
-    dest_fd = open (dest, O_WRONLY | O_CLOEXEC);
+    *dest_fd = open (dest, O_WRONLY | O_CLOEXEC);
   else {
     CLEANUP_FREE char *buf = sysroot_path (dest);
     if (!buf) {
       reply_with_perror ("malloc");
-      close (src_fd);
+      close (*src_fd);
       return -1;
     }
-    dest_fd = open (buf, O_WRONLY|O_CREAT|O_TRUNC|O_NOCTTY|O_CLOEXEC, 0666);
+    *dest_fd = open (buf, O_WRONLY|O_CREAT|O_TRUNC|O_NOCTTY|O_CLOEXEC, 0666);
   }
-  if (dest_fd == -1) {
+  if (*dest_fd == -1) {
     reply_with_perror ("%s", dest);
-    close (src_fd);
+    close (*src_fd);
     return -1;
   }
 
-  uint64_t position = 0, size = (uint64_t) ssize;
-  CLEANUP_FREE char *buf = NULL;
-  buf = malloc (BUFSIZ);
-  if (buf == NULL) {
-    reply_with_perror ("malloc");
-    close (src_fd);
-    close (dest_fd);
-    return -1;
-  }
+  return 0;
+}
 
-  while (position < size) {
-    /* Calculate bytes to copy. */
-    uint64_t n64 = size - position;
-    size_t n;
-    if (n64 > BUFSIZ)
-      n = BUFSIZ;
-    else
-      n = (size_t) n64; /* safe because of if condition */
+/* Copy 'size' bytes, or everything if 'size' is -1, and close the
+ * files.
+ */
+static int
+copy_src_dest (const char *src, const char *dest, int64_t size)
+{
+  int src_fd, dest_fd, flags = 0;
 
-    ssize_t r = read (src_fd, buf, n);
-    if (r == -1) {
-      reply_with_perror ("%s: read", src);
-      close (src_fd);
-      close (dest_fd);
-      return -1;
-    }
-    if (r == 0) {
-      reply_with_error ("%s: input file too short", src);
-      close (src_fd);
-      close (dest_fd);
-      return -1;
-    }
+  if (open_src_dest (src, dest, &src_fd, &dest_fd) == -1)
+    return -1;
 
-    if (xwrite (dest_fd, buf, r) == -1) {
-      reply_with_perror ("%s: write", dest);
-      close (src_fd);
-      close (dest_fd);
-      return -1;
-    }
+  if (STRPREFIX (src, "/dev/") && STRPREFIX (dest, "/dev/"))
+    flags |= COPY_DATA_DIRECT;
 
-    position += r;
-    notify_progress ((uint64_t) position, (uint64_t) size);
+  if (copy_data (src_fd, src, dest_fd, dest, size, flags) == -1) {
+    close (src_fd);
+    close (dest_fd);
+    return -1;
   }
 
   if (close (src_fd) == -1) {
@@ -161,3 +99,20 @@ do_copy_size (const char *src, const char *dest, int64_t ssize)
 
   return 0;
 }
+
+int
+do_dd (const char *src, const char *dest)
+{
+  return copy_src_dest (src, dest, -1);
+}
+
+int
+do_copy_size (const char *src, const char *dest, int64_t ssize)
+{
+  if (ssize < 0) {
+    reply_with_error ("size is negative");
+    return -1;
+  }
+
+  return copy_src_dest (src, dest, ssize);
+}
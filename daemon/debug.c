@@ -68,6 +68,7 @@ static char *debug_device_speed (const char *subcmd, size_t argc, char *const *c
 static char *debug_env (const char *subcmd, size_t argc, char *const *const argv);
 static char *debug_error (const char *subcmd, size_t argc, char *const *const argv);
 static char *debug_fds (const char *subcmd, size_t argc, char *const *const argv);
+static char *debug_forks (const char *subcmd, size_t argc, char *const *const argv);
 static char *debug_ldd (const char *subcmd, size_t argc, char *const *const argv);
 static char *debug_ls (const char *subcmd, size_t argc, char *const *const argv);
 static char *debug_ll (const char *subcmd, size_t argc, char *const *const argv);
@@ -78,6 +79,7 @@ static char *debug_segv (const char *subcmd, size_t argc, char *const *const arg
 static char *debug_setenv (const char *subcmd, size_t argc, char *const *const argv);
 static char *debug_sh (const char *subcmd, size_t argc, char *const *const argv);
 static char *debug_spew (const char *subcmd, size_t argc, char *const *const argv);
+static char *debug_stats (const char *subcmd, size_t argc, char *const *const argv);
 static void deliberately_cause_a_segfault (void);
 
 static struct cmd cmds[] = {
@@ -91,6 +93,7 @@ static struct cmd cmds[] = {
   { "env", debug_env },
   { "error", debug_error },
   { "fds", debug_fds },
+  { "forks", debug_forks },
   { "ldd", debug_ldd },
   { "ls", debug_ls },
   { "ll", debug_ll },
@@ -101,6 +104,7 @@ static struct cmd cmds[] = {
   { "setenv", debug_setenv },
   { "sh", debug_sh },
   { "spew", debug_spew },
+  { "stats", debug_stats },
   { NULL, NULL }
 };
 
@@ -151,6 +155,45 @@ debug_help (const char *subcmd, size_t argc, char *const *const argv)
   return r;
 }
 
+/* Show how many times each external program has been run. */
+static char *
+debug_forks (const char *subcmd, size_t argc, char *const *const argv)
+{
+  char *out;
+
+  out = command_fork_counts ();
+  if (out == NULL) {
+    reply_with_perror ("command_fork_counts");
+    return NULL;
+  }
+
+  return out;
+}
+
+/* Show the time, CPU, block I/O, forks and udev settle time used by
+ * each procedure (see stats.c).  'debug stats reset' also clears the
+ * counters.
+ */
+static char *
+debug_stats (const char *subcmd, size_t argc, char *const *const argv)
+{
+  char *out;
+  int reset = argc >= 1 && STREQ (argv[0], "reset");
+
+  if (argc >= 1 && !reset && STRNEQ (argv[0], "")) {
+    reply_with_error ("stats: unknown argument: %s", argv[0]);
+    return NULL;
+  }
+
+  out = stats_format (reset);
+  if (out == NULL) {
+    reply_with_perror ("stats_format");
+    return NULL;
+  }
+
+  return out;
+}
+
 /* Show open FDs. */
 static char *
 debug_fds (const char *subcmd, size_t argc, char *const *const argv)
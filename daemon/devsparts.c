@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <inttypes.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <dirent.h>
@@ -33,23 +34,188 @@
 #include "daemon.h"
 #include "actions.h"
 
-typedef int (*block_dev_func_t) (const char *dev, struct stringsbuf *r);
+/* The block device topology.
+ *
+ * Inspection and the virt tools call list_devices, list_partitions
+ * etc. many times, and each call used to scan /sys/block and open
+ * every device.  Instead the result of one scan is kept here until
+ * devsparts_cache_invalidate is called (by udev_settle, after the
+ * daemon adds, removes or partitions devices) or until the kernel
+ * sends a uevent, which catches changes made in any other way.
+ */
+struct topology_part {
+  char *name;                   /* eg. "sda1" */
+  int partnum;
+  int64_t size;
+};
+
+struct topology_dev {
+  char *name;                   /* eg. "sda" */
+  bool is_md;
+  int64_t size;
+  size_t nr_parts;
+  struct topology_part *parts;  /* sorted by partition number */
+};
+
+static struct topology_dev *topology;
+static size_t topology_len;
+static bool topology_valid;
+static char topology_seqnum[32];
+
+/**
+ * Drop the cached block device topology.  This must be called after
+ * anything which adds, removes or repartitions devices.
+ */
+void
+devsparts_cache_invalidate (void)
+{
+  size_t i, j;
+
+  for (i = 0; i < topology_len; ++i) {
+    for (j = 0; j < topology[i].nr_parts; ++j)
+      free (topology[i].parts[j].name);
+    free (topology[i].parts);
+    free (topology[i].name);
+  }
+  free (topology);
+  topology = NULL;
+  topology_len = 0;
+  topology_valid = false;
+}
 
-/* Execute a given function for each discovered block device */
-static char **
-foreach_block_device (block_dev_func_t func, bool return_md)
+/* Read the uevent sequence number, which the kernel increments for
+ * every uevent.  Returns false if it cannot be read.
+ */
+static bool
+read_uevent_seqnum (char *buf, size_t len)
+{
+  FILE *fp;
+  bool r;
+
+  fp = fopen ("/sys/kernel/uevent_seqnum", "re");
+  if (fp == NULL)
+    return false;
+  r = fgets (buf, len, fp) != NULL;
+  fclose (fp);
+  return r;
+}
+
+/* Read a number from a file in sysfs, or return -1. */
+static int64_t
+read_sysfs_int (const char *path)
+{
+  FILE *fp;
+  int64_t r;
+
+  fp = fopen (path, "re");
+  if (fp == NULL)
+    return -1;
+  if (fscanf (fp, "%" SCNi64, &r) != 1)
+    r = -1;
+  fclose (fp);
+  return r;
+}
+
+static int
+compare_devs (const void *vp1, const void *vp2)
+{
+  const struct topology_dev *d1 = vp1;
+  const struct topology_dev *d2 = vp2;
+  return compare_device_names (d1->name, d2->name);
+}
+
+static int
+compare_parts (const void *vp1, const void *vp2)
+{
+  const struct topology_part *p1 = vp1;
+  const struct topology_part *p2 = vp2;
+  return p1->partnum - p2->partnum;
+}
+
+/* Find the partitions of the device by looking in /sys/block/<device>/
+ * for entries starting with <device>, eg. /sys/block/sda/sda1
+ */
+static int
+scan_partitions (struct topology_dev *dev)
+{
+  char devdir[256], path[PATH_MAX];
+  struct topology_part *p;
+  struct dirent *d;
+  DIR *dir;
+
+  snprintf (devdir, sizeof devdir, "/sys/block/%s", dev->name);
+
+  dir = opendir (devdir);
+  if (!dir) {
+    reply_with_perror ("opendir: %s", devdir);
+    return -1;
+  }
+
+  errno = 0;
+  while ((d = readdir (dir)) != NULL) {
+    if (!STREQLEN (d->d_name, dev->name, strlen (dev->name)))
+      continue;
+
+    p = realloc (dev->parts, (dev->nr_parts+1) * sizeof (struct topology_part));
+    if (p == NULL) {
+      reply_with_perror ("realloc");
+      closedir (dir);
+      return -1;
+    }
+    dev->parts = p;
+    p = &dev->parts[dev->nr_parts];
+    p->name = strdup (d->d_name);
+    if (p->name == NULL) {
+      reply_with_perror ("strdup");
+      closedir (dir);
+      return -1;
+    }
+    dev->nr_parts++;
+
+    snprintf (path, sizeof path, "%s/%s/partition", devdir, d->d_name);
+    p->partnum = read_sysfs_int (path);
+    snprintf (path, sizeof path, "%s/%s/size", devdir, d->d_name);
+    p->size = read_sysfs_int (path);
+    if (p->size >= 0)
+      p->size *= 512;
+    errno = 0;
+  }
+
+  /* Check if readdir failed */
+  if (0 != errno) {
+    reply_with_perror ("readdir: %s", devdir);
+    closedir (dir);
+    return -1;
+  }
+
+  /* Close the directory handle */
+  if (closedir (dir) == -1) {
+    reply_with_perror ("closedir: %s", devdir);
+    return -1;
+  }
+
+  if (dev->nr_parts > 0)
+    qsort (dev->parts, dev->nr_parts, sizeof (struct topology_part),
+           compare_parts);
+
+  return 0;
+}
+
+/* Scan /sys/block for the devices and their partitions. */
+static int
+scan_topology (void)
 {
-  CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (r);
   DIR *dir;
-  int err = 0;
   struct dirent *d;
-  char dev_path[256];
+  char dev_path[256], path[PATH_MAX];
+  struct topology_dev *dev;
+  bool is_md;
   int fd;
 
   dir = opendir ("/sys/block");
   if (!dir) {
     reply_with_perror ("opendir: /sys/block");
-    return NULL;
+    return -1;
   }
 
   for (;;) {
@@ -57,75 +223,107 @@ foreach_block_device (block_dev_func_t func, bool return_md)
     d = readdir (dir);
     if (!d) break;
 
-    if (STREQLEN (d->d_name, "sd", 2) ||
-        STREQLEN (d->d_name, "hd", 2) ||
-        STREQLEN (d->d_name, "ubd", 3) ||
-        STREQLEN (d->d_name, "vd", 2) ||
-        STREQLEN (d->d_name, "sr", 2) ||
-        (return_md &&
-         STREQLEN (d->d_name, "md", 2) && c_isdigit (d->d_name[2]))) {
-      snprintf (dev_path, sizeof dev_path, "/dev/%s", d->d_name);
-
-      /* Ignore the root device. */
-      if (is_root_device (dev_path))
-        continue;
-
-      /* RHBZ#514505: Some versions of qemu <= 0.10 add a
-       * CD-ROM device even though we didn't request it.  Try to
-       * detect this by seeing if the device contains media.
-       */
-      fd = open (dev_path, O_RDONLY|O_CLOEXEC);
-      if (fd == -1) {
-        perror (dev_path);
-        continue;
-      }
-      close (fd);
-
-      /* Call the map function for this device */
-      if ((*func)(d->d_name, &r) != 0) {
-        err = 1;
-        break;
-      }
+    is_md = STREQLEN (d->d_name, "md", 2) && c_isdigit (d->d_name[2]);
+    if (!STREQLEN (d->d_name, "sd", 2) &&
+        !STREQLEN (d->d_name, "hd", 2) &&
+        !STREQLEN (d->d_name, "ubd", 3) &&
+        !STREQLEN (d->d_name, "vd", 2) &&
+        !STREQLEN (d->d_name, "sr", 2) &&
+        !is_md)
+      continue;
+
+    snprintf (dev_path, sizeof dev_path, "/dev/%s", d->d_name);
+
+    /* Ignore the root device. */
+    if (is_root_device (dev_path))
+      continue;
+
+    /* RHBZ#514505: Some versions of qemu <= 0.10 add a
+     * CD-ROM device even though we didn't request it.  Try to
+     * detect this by seeing if the device contains media.
+     */
+    fd = open (dev_path, O_RDONLY|O_CLOEXEC);
+    if (fd == -1) {
+      perror (dev_path);
+      continue;
+    }
+    close (fd);
+
+    dev = realloc (topology, (topology_len+1) * sizeof (struct topology_dev));
+    if (dev == NULL) {
+      reply_with_perror ("realloc");
+      goto error;
+    }
+    topology = dev;
+    dev = &topology[topology_len];
+    memset (dev, 0, sizeof *dev);
+    dev->name = strdup (d->d_name);
+    if (dev->name == NULL) {
+      reply_with_perror ("strdup");
+      goto error;
     }
+    topology_len++;
+    dev->is_md = is_md;
+
+    snprintf (path, sizeof path, "/sys/block/%s/size", d->d_name);
+    dev->size = read_sysfs_int (path);
+    if (dev->size >= 0)
+      dev->size *= 512;
+
+    if (scan_partitions (dev) == -1)
+      goto error;
   }
 
   /* Check readdir didn't fail */
   if (errno != 0) {
     reply_with_perror ("readdir: /sys/block");
-    closedir (dir);
-    return NULL;
+    goto error;
   }
 
   /* Close the directory handle */
   if (closedir (dir) == -1) {
     reply_with_perror ("closedir: /sys/block");
-    return NULL;
+    dir = NULL;
+    goto error;
   }
 
-  if (err)
-    return NULL;
-
   /* Sort the devices. */
-  if (r.size > 0)
-    sort_device_names (r.argv, r.size);
+  if (topology_len > 0)
+    qsort (topology, topology_len, sizeof (struct topology_dev), compare_devs);
 
-  /* NULL terminate the list */
-  if (end_stringsbuf (&r) == -1) {
-    return NULL;
-  }
+  return 0;
 
-  return take_stringsbuf (&r);
+ error:
+  if (dir)
+    closedir (dir);
+  devsparts_cache_invalidate ();
+  return -1;
 }
 
-/* Add a device to the list of devices */
+/* Make sure the topology is up to date, scanning /sys/block if
+ * necessary.  Returns -1 after replying with an error.
+ */
 static int
-add_device (const char *device, struct stringsbuf *r)
+get_topology (void)
 {
-  char dev_path[256];
-  snprintf (dev_path, sizeof dev_path, "/dev/%s", device);
+  char seqnum[sizeof topology_seqnum];
+  bool have_seqnum;
+
+  have_seqnum = read_uevent_seqnum (seqnum, sizeof seqnum);
 
-  if (add_string (r, dev_path) == -1) {
+  if (topology_valid && have_seqnum && STREQ (seqnum, topology_seqnum))
+    return 0;
+
+  devsparts_cache_invalidate ();
+  if (scan_topology () == -1)
     return -1;
+
+  /* Without uevent_seqnum we cannot tell if anything changed, so
+   * don't cache the result.
+   */
+  if (have_seqnum) {
+    strcpy (topology_seqnum, seqnum);
+    topology_valid = true;
   }
 
   return 0;
@@ -134,6 +332,12 @@ add_device (const char *device, struct stringsbuf *r)
 char **
 do_list_devices (void)
 {
+  CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (r);
+  size_t i;
+
+  if (get_topology () == -1)
+    return NULL;
+
   /* For backwards compatibility, don't return MD devices in the list
    * returned by guestfs_list_devices.  This is because most API users
    * expect that this list is effectively the same as the list of
@@ -143,60 +347,156 @@ do_list_devices (void)
    * by QEMU, and there is a special API for them,
    * guestfs_list_md_devices.
    */
-  return foreach_block_device (add_device, false);
+  for (i = 0; i < topology_len; ++i) {
+    if (topology[i].is_md)
+      continue;
+    if (add_sprintf (&r, "/dev/%s", topology[i].name) == -1)
+      return NULL;
+  }
+
+  if (end_stringsbuf (&r) == -1)
+    return NULL;
+
+  return take_stringsbuf (&r);
 }
 
-static int
-add_partitions (const char *device, struct stringsbuf *r)
+char **
+do_list_partitions (void)
 {
-  char devdir[256];
-
-  /* Open the device's directory under /sys/block */
-  snprintf (devdir, sizeof devdir, "/sys/block/%s", device);
+  CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (r);
+  size_t i, j;
 
-  DIR *dir = opendir (devdir);
-  if (!dir) {
-    reply_with_perror ("opendir: %s", devdir);
-    return -1;
-  }
+  if (get_topology () == -1)
+    return NULL;
 
-  /* Look in /sys/block/<device>/ for entries starting with <device>
-   * e.g. /sys/block/sda/sda1
-   */
-  errno = 0;
-  struct dirent *d;
-  while ((d = readdir (dir)) != NULL) {
-    if (STREQLEN (d->d_name, device, strlen (device))) {
-      char part[256];
-      snprintf (part, sizeof part, "/dev/%s", d->d_name);
-
-      if (add_string (r, part) == -1) {
-        closedir (dir);
-        return -1;
-      }
+  for (i = 0; i < topology_len; ++i) {
+    for (j = 0; j < topology[i].nr_parts; ++j) {
+      if (add_sprintf (&r, "/dev/%s", topology[i].parts[j].name) == -1)
+        return NULL;
     }
   }
 
-  /* Check if readdir failed */
-  if (0 != errno) {
-    reply_with_perror ("readdir: %s", devdir);
-    closedir (dir);
+  /* Sort the partitions. */
+  if (r.size > 0)
+    sort_device_names (r.argv, r.size);
+
+  if (end_stringsbuf (&r) == -1)
+    return NULL;
+
+  return take_stringsbuf (&r);
+}
+
+/* Fill in one entry of the list_block_devices result.  The filesystem
+ * fields come from the blkid cache.
+ */
+static int
+set_block_device (guestfs_int_block_device *bd, const char *name,
+                  const char *parent, int partnum, int64_t size)
+{
+  if (asprintf (&bd->bd_device, "/dev/%s", name) == -1) {
+    reply_with_perror ("asprintf");
+    bd->bd_device = NULL;
     return -1;
   }
+  if (parent) {
+    if (asprintf (&bd->bd_parent, "/dev/%s", parent) == -1) {
+      reply_with_perror ("asprintf");
+      bd->bd_parent = NULL;
+      return -1;
+    }
+  }
+  else {
+    bd->bd_parent = strdup ("");
+    if (bd->bd_parent == NULL) {
+      reply_with_perror ("strdup");
+      return -1;
+    }
+  }
+  bd->bd_partnum = partnum;
+  bd->bd_size = size;
 
-  /* Close the directory handle */
-  if (closedir (dir) == -1) {
-    reply_with_perror ("closedir: /sys/block/%s", device);
+  bd->bd_vfs_type = get_blkid_tag (bd->bd_device, "TYPE");
+  if (bd->bd_vfs_type == NULL)
+    return -1;
+  bd->bd_vfs_label = get_blkid_tag (bd->bd_device, "LABEL");
+  if (bd->bd_vfs_label == NULL)
+    return -1;
+  bd->bd_vfs_uuid = get_blkid_tag (bd->bd_device, "UUID");
+  if (bd->bd_vfs_uuid == NULL)
     return -1;
-  }
 
   return 0;
 }
 
-char **
-do_list_partitions (void)
+static void
+free_block_device_list (guestfs_int_block_device_list *r)
+{
+  size_t i;
+
+  for (i = 0; i < r->guestfs_int_block_device_list_len; ++i) {
+    guestfs_int_block_device *bd = &r->guestfs_int_block_device_list_val[i];
+    free (bd->bd_device);
+    free (bd->bd_parent);
+    free (bd->bd_vfs_type);
+    free (bd->bd_vfs_label);
+    free (bd->bd_vfs_uuid);
+  }
+  free (r->guestfs_int_block_device_list_val);
+  free (r);
+}
+
+guestfs_int_block_device_list *
+do_list_block_devices (void)
 {
-  return foreach_block_device (add_partitions, true);
+  guestfs_int_block_device_list *r;
+  size_t i, j, n;
+
+  if (get_topology () == -1)
+    return NULL;
+
+  n = 0;
+  for (i = 0; i < topology_len; ++i)
+    n += 1 + topology[i].nr_parts;
+
+  r = malloc (sizeof *r);
+  if (r == NULL) {
+    reply_with_perror ("malloc");
+    return NULL;
+  }
+  r->guestfs_int_block_device_list_len = 0;
+  r->guestfs_int_block_device_list_val =
+    calloc (n, sizeof (guestfs_int_block_device));
+  if (r->guestfs_int_block_device_list_val == NULL) {
+    reply_with_perror ("calloc");
+    free (r);
+    return NULL;
+  }
+  r->guestfs_int_block_device_list_len = n;
+
+  /* Each device is followed by its partitions. */
+  n = 0;
+  for (i = 0; i < topology_len; ++i) {
+    const struct topology_dev *dev = &topology[i];
+
+    if (set_block_device (&r->guestfs_int_block_device_list_val[n++],
+                          dev->name, NULL, 0, dev->size) == -1)
+      goto error;
+
+    for (j = 0; j < dev->nr_parts; ++j) {
+      const struct topology_part *part = &dev->parts[j];
+
+      if (set_block_device (&r->guestfs_int_block_device_list_val[n++],
+                            part->name, dev->name,
+                            part->partnum, part->size) == -1)
+        goto error;
+    }
+  }
+
+  return r;
+
+ error:
+  free_block_device_list (r);
+  return NULL;
 }
 
 char *
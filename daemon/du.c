@@ -23,19 +23,50 @@
 #include <string.h>
 #include <unistd.h>
 #include <inttypes.h>
+#include <errno.h>
+#include <fts.h>
+#include <sys/stat.h>
 
 #include "guestfs_protocol.h"
 #include "daemon.h"
 #include "actions.h"
 
-GUESTFSD_EXT_CMD(str_du, du);
+/* A file with more than one link, which must only be counted once. */
+struct du_link {
+  dev_t dev;
+  ino_t ino;
+  blkcnt_t blocks;
+};
 
+static int
+compare_links (const void *vp1, const void *vp2)
+{
+  const struct du_link *l1 = vp1;
+  const struct du_link *l2 = vp2;
+
+  if (l1->dev != l2->dev)
+    return l1->dev < l2->dev ? -1 : 1;
+  if (l1->ino != l2->ino)
+    return l1->ino < l2->ino ? -1 : 1;
+  return 0;
+}
+
+/* This is the same as 'du -s', but walks the tree in the daemon
+ * instead of running du.  As du does, it counts the blocks of every
+ * file, directory and symlink, counts files with several hard links
+ * once, and does not follow symlinks.
+ */
 int64_t
 do_du (const char *path)
 {
-  int r;
-  int64_t rv;
-  CLEANUP_FREE char *out = NULL, *err = NULL, *buf = NULL;
+  CLEANUP_FREE char *buf = NULL;
+  CLEANUP_FREE struct du_link *links = NULL;
+  size_t nr_links = 0, alloc_links = 0, i;
+  char *paths[2];
+  FTS *fts;
+  FTSENT *ent;
+  uint64_t blocks = 0;
+  int err = 0;
 
   /* Make the path relative to /sysroot. */
   buf = sysroot_path (path);
@@ -46,20 +77,75 @@ do_du (const char *path)
 
   pulse_mode_start ();
 
-  r = command (&out, &err, str_du, "-s", buf, NULL);
-  if (r == -1) {
+  paths[0] = buf;
+  paths[1] = NULL;
+  fts = fts_open (paths, FTS_PHYSICAL | FTS_NOCHDIR, NULL);
+  if (fts == NULL) {
     pulse_mode_cancel ();
-    reply_with_error ("%s: %s", path, err);
+    reply_with_perror ("%s", path);
     return -1;
   }
 
-  if (sscanf (out, "%"SCNi64, &rv) != 1) {
+  errno = 0;
+  while ((ent = fts_read (fts)) != NULL) {
+    const struct stat *st = ent->fts_statp;
+
+    switch (ent->fts_info) {
+    case FTS_DNR:
+    case FTS_ERR:
+    case FTS_NS:
+      err = ent->fts_errno;
+      break;
+
+    case FTS_DP:
+      /* Directories were counted in preorder. */
+      break;
+
+    default:
+      if (!S_ISDIR (st->st_mode) && st->st_nlink > 1) {
+        if (nr_links == alloc_links) {
+          struct du_link *p;
+
+          alloc_links = alloc_links ? alloc_links * 2 : 64;
+          p = realloc (links, alloc_links * sizeof (struct du_link));
+          if (p == NULL) {
+            err = errno;
+            goto out;
+          }
+          links = p;
+        }
+        links[nr_links].dev = st->st_dev;
+        links[nr_links].ino = st->st_ino;
+        links[nr_links].blocks = st->st_blocks;
+        nr_links++;
+      }
+      else
+        blocks += st->st_blocks;
+    }
+    if (err != 0)
+      break;
+    errno = 0;
+  }
+  if (err == 0 && ent == NULL && errno != 0)
+    err = errno;
+ out:
+  fts_close (fts);
+
+  if (err != 0) {
     pulse_mode_cancel ();
-    reply_with_error ("%s: could not read output: %s", path, out);
+    reply_with_perror_errno (err, "%s", path);
     return -1;
   }
 
+  /* Add the hard linked files, once each. */
+  qsort (links, nr_links, sizeof (struct du_link), compare_links);
+  for (i = 0; i < nr_links; ++i) {
+    if (i == 0 || compare_links (&links[i-1], &links[i]) != 0)
+      blocks += links[i].blocks;
+  }
+
   pulse_mode_end ();
 
-  return rv;
+  /* st_blocks is in 512 byte units, and du rounds up to 1K blocks. */
+  return (blocks + 1) / 2;
 }
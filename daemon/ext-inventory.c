@@ -0,0 +1,602 @@
+/* libguestfs - the guestfsd daemon
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+
+#include "guestfs_protocol.h"
+#include "daemon.h"
+#include "actions.h"
+#include "optgroups.h"
+
+#ifdef HAVE_LIBEXT2FS
+
+#include <ext2fs/ext2fs.h>
+#include <et/com_err.h>
+
+int
+optgroup_libext2fs_available (void)
+{
+  return 1;
+}
+
+/* Number of inode table blocks read at a time by the inode scan. */
+#define SCAN_BUFFER_BLOCKS 256
+
+/* Number of block groups whose inode tables are prefetched ahead of
+ * the inode scan.
+ */
+#define READAHEAD_GROUPS 8
+
+/* The parts of an inode we need, for each inode in use. */
+struct inode_info {
+  ext2_ino_t ino;
+  uint16_t mode;
+  uint64_t size;
+  int64_t atime, mtime, ctime;
+  size_t name;                  /* for directories, the entry naming it */
+  char *path;                   /* for directories, once computed */
+};
+
+/* A directory entry. */
+struct name_entry {
+  ext2_ino_t ino;
+  ext2_ino_t parent;
+  size_t name;                  /* offset in the names buffer */
+  size_t len;
+};
+
+#define NO_NAME ((size_t) -1)
+
+struct inventory {
+  ext2_filsys fs;
+
+  /* Inodes in use, in inode number order. */
+  struct inode_info *inodes;
+  size_t nr_inodes, inodes_alloc;
+
+  /* Directory entries, in the order of the directory blocks on disk. */
+  struct name_entry *entries;
+  size_t nr_entries, entries_alloc;
+  char *names;
+  size_t names_len, names_alloc;
+
+  /* Directories with inline data, which have no blocks to list. */
+  ext2_ino_t *inline_dirs;
+  size_t nr_inline_dirs, inline_dirs_alloc;
+
+  /* The inode returned by the scan, see stashed_read_inode. */
+  ext2_ino_t stashed_ino;
+  struct ext2_inode *stashed_inode;
+
+  /* Set if a libext2fs callback ran out of memory. */
+  int nomem;
+
+  /* Output buffer. */
+  char *out;
+  size_t out_len;
+};
+
+/* Grow an array to hold at least one more element. */
+static int
+grow (void *arrayp, size_t *alloc, size_t nr, size_t size)
+{
+  void **array = arrayp;
+  void *p;
+  size_t n;
+
+  if (nr < *alloc)
+    return 0;
+  n = *alloc > 0 ? 2 * *alloc : 1024;
+  p = realloc (*array, n * size);
+  if (p == NULL)
+    return -1;
+  *array = p;
+  *alloc = n;
+  return 0;
+}
+
+/* Inode times are 32 bit signed seconds, extended by two epoch bits
+ * in the large inodes of ext4.
+ */
+static int64_t
+inode_time (uint32_t t, const struct ext2_inode_large *large,
+            size_t extra_offset, size_t inode_size)
+{
+  int64_t r = (int32_t) t;
+  uint32_t extra;
+
+  if (inode_size > EXT2_GOOD_OLD_INODE_SIZE &&
+      (size_t) EXT2_GOOD_OLD_INODE_SIZE + large->i_extra_isize >=
+      extra_offset + sizeof extra) {
+    memcpy (&extra, (const char *) large + extra_offset, sizeof extra);
+    r += (int64_t) (extra & 3) << 32;
+  }
+  return r;
+}
+
+/* Make libext2fs use the inode we already have from the inode scan
+ * when block_iterate asks for it, instead of reading it again.  This
+ * is the same trick that e2fsck uses.
+ */
+static struct inventory *stashed_inventory;
+
+static errcode_t
+stashed_read_inode (ext2_filsys fs, ext2_ino_t ino, struct ext2_inode *inode)
+{
+  struct inventory *inv = stashed_inventory;
+
+  if (inv == NULL || ino != inv->stashed_ino)
+    return EXT2_ET_CALLBACK_NOTHANDLED;
+  memcpy (inode, inv->stashed_inode, sizeof *inode);
+  return 0;
+}
+
+static int
+add_dir_block (ext2_filsys fs, blk64_t *blocknr, e2_blkcnt_t blockcnt,
+               blk64_t ref_blk, int ref_offset, void *priv)
+{
+  struct inventory *inv = priv;
+  errcode_t err;
+
+  if (blockcnt < 0)
+    return 0;
+  err = ext2fs_add_dir_block2 (fs->dblist, inv->stashed_ino,
+                               *blocknr, blockcnt);
+  if (err) {
+    inv->nomem = 1;
+    return BLOCK_ABORT;
+  }
+  return 0;
+}
+
+/* Prefetch the inode tables of the groups ahead of the scan. */
+static errcode_t
+scan_done_group (ext2_filsys fs, ext2_inode_scan scan, dgrp_t group,
+                 void *priv)
+{
+#ifdef HAVE_EXT2FS_READAHEAD
+  if (group + READAHEAD_GROUPS < fs->group_desc_count)
+    ext2fs_readahead (fs, EXT2_READA_ITABLE, group + READAHEAD_GROUPS, 1);
+#endif
+  return 0;
+}
+
+/* Read every inode table in order, remembering the inodes in use and
+ * listing the blocks of the directories.
+ */
+static int
+scan_inodes (struct inventory *inv)
+{
+  ext2_filsys fs = inv->fs;
+  const size_t inode_size = EXT2_INODE_SIZE (fs->super);
+  ext2_inode_scan scan;
+  CLEANUP_FREE struct ext2_inode_large *large = NULL;
+  struct ext2_inode *inode;
+  struct inode_info *info;
+  ext2_ino_t ino;
+  errcode_t err;
+
+  large = calloc (1, MAX (inode_size, sizeof *large));
+  if (large == NULL) {
+    reply_with_perror ("calloc");
+    return -1;
+  }
+  inode = (struct ext2_inode *) large;
+
+  err = ext2fs_init_dblist (fs, NULL);
+  if (err) {
+    reply_with_error ("ext2fs_init_dblist: %s", error_message (err));
+    return -1;
+  }
+
+  err = ext2fs_open_inode_scan (fs, SCAN_BUFFER_BLOCKS, &scan);
+  if (err) {
+    reply_with_error ("ext2fs_open_inode_scan: %s", error_message (err));
+    return -1;
+  }
+  ext2fs_inode_scan_flags (scan, EXT2_SF_SKIP_MISSING_ITABLE, 0);
+  ext2fs_set_inode_callback (scan, scan_done_group, inv);
+#ifdef HAVE_EXT2FS_READAHEAD
+  ext2fs_readahead (fs, EXT2_READA_ITABLE, 0,
+                    MIN (READAHEAD_GROUPS, fs->group_desc_count));
+#endif
+
+  inv->stashed_inode = inode;
+  stashed_inventory = inv;
+  fs->read_inode = stashed_read_inode;
+
+  for (;;) {
+    err = ext2fs_get_next_inode_full (scan, &ino, inode, inode_size);
+    if (err == EXT2_ET_BAD_BLOCK_IN_INODE_TABLE)
+      continue;
+    if (err) {
+      reply_with_error ("ext2fs_get_next_inode: %s", error_message (err));
+      goto error;
+    }
+    if (ino == 0)
+      break;
+
+    if (inode->i_links_count == 0 || inode->i_dtime != 0)
+      continue;
+    if (ino < EXT2_FIRST_INODE (fs->super) && ino != EXT2_ROOT_INO)
+      continue;
+
+    if (grow (&inv->inodes, &inv->inodes_alloc, inv->nr_inodes,
+              sizeof *inv->inodes) == -1) {
+      reply_with_perror ("realloc");
+      goto error;
+    }
+    info = &inv->inodes[inv->nr_inodes++];
+    info->ino = ino;
+    info->mode = inode->i_mode;
+    info->size = EXT2_I_SIZE (inode);
+    info->atime = inode_time (inode->i_atime, large,
+                              offsetof (struct ext2_inode_large, i_atime_extra),
+                              inode_size);
+    info->mtime = inode_time (inode->i_mtime, large,
+                              offsetof (struct ext2_inode_large, i_mtime_extra),
+                              inode_size);
+    info->ctime = inode_time (inode->i_ctime, large,
+                              offsetof (struct ext2_inode_large, i_ctime_extra),
+                              inode_size);
+    info->name = NO_NAME;
+    info->path = NULL;
+
+    if (!LINUX_S_ISDIR (inode->i_mode))
+      continue;
+
+    inv->stashed_ino = ino;
+#ifdef EXT4_INLINE_DATA_FL
+    if (inode->i_flags & EXT4_INLINE_DATA_FL) {
+      if (grow (&inv->inline_dirs, &inv->inline_dirs_alloc,
+                inv->nr_inline_dirs, sizeof *inv->inline_dirs) == -1) {
+        reply_with_perror ("realloc");
+        goto error;
+      }
+      inv->inline_dirs[inv->nr_inline_dirs++] = ino;
+      continue;
+    }
+#endif
+    if (!ext2fs_inode_has_valid_blocks2 (fs, inode))
+      continue;
+    err = ext2fs_block_iterate3 (fs, ino,
+                                 BLOCK_FLAG_READ_ONLY|BLOCK_FLAG_DATA_ONLY,
+                                 NULL, add_dir_block, inv);
+    if (err == 0 && inv->nomem)
+      err = EXT2_ET_NO_MEMORY;
+    if (err) {
+      reply_with_error ("ext2fs_block_iterate: inode %" PRIu32 ": %s",
+                        (uint32_t) ino, error_message (err));
+      goto error;
+    }
+  }
+
+  fs->read_inode = NULL;
+  stashed_inventory = NULL;
+  ext2fs_close_inode_scan (scan);
+  return 0;
+
+ error:
+  fs->read_inode = NULL;
+  stashed_inventory = NULL;
+  ext2fs_close_inode_scan (scan);
+  return -1;
+}
+
+static int
+compare_ino (const void *inop, const void *infop)
+{
+  const ext2_ino_t ino = *(const ext2_ino_t *) inop;
+  const struct inode_info *info = infop;
+
+  return ino < info->ino ? -1 : ino > info->ino ? 1 : 0;
+}
+
+static struct inode_info *
+lookup_inode (struct inventory *inv, ext2_ino_t ino)
+{
+  return bsearch (&ino, inv->inodes, inv->nr_inodes, sizeof *inv->inodes,
+                  compare_ino);
+}
+
+static int
+add_entry (ext2_ino_t dir, int entry, struct ext2_dir_entry *dirent,
+           int offset, int blocksize, char *buf, void *priv)
+{
+  struct inventory *inv = priv;
+  struct name_entry *e;
+  struct inode_info *info;
+  const size_t len = ext2fs_dirent_name_len (dirent);
+
+  if (entry == DIRENT_DOT_FILE || entry == DIRENT_DOT_DOT_FILE ||
+      dirent->inode == 0)
+    return 0;
+
+  if (grow (&inv->entries, &inv->entries_alloc, inv->nr_entries,
+            sizeof *inv->entries) == -1)
+    goto nomem;
+  while (inv->names_len + len > inv->names_alloc) {
+    if (grow (&inv->names, &inv->names_alloc, inv->names_alloc, 1) == -1)
+      goto nomem;
+  }
+
+  e = &inv->entries[inv->nr_entries];
+  e->ino = dirent->inode;
+  e->parent = dir;
+  e->name = inv->names_len;
+  e->len = len;
+  memcpy (&inv->names[inv->names_len], dirent->name, len);
+  inv->names_len += len;
+
+  /* A directory has only one name (apart from "." and ".."). */
+  info = lookup_inode (inv, dirent->inode);
+  if (info && LINUX_S_ISDIR (info->mode))
+    info->name = inv->nr_entries;
+
+  inv->nr_entries++;
+  return 0;
+
+ nomem:
+  inv->nomem = 1;
+  return DIRENT_ABORT;
+}
+
+/* Read every directory block, sorted by block number, so the disk is
+ * read (mostly) sequentially.
+ */
+static int
+scan_directories (struct inventory *inv)
+{
+  ext2_filsys fs = inv->fs;
+  errcode_t err;
+  size_t i;
+
+  ext2fs_dblist_sort2 (fs->dblist, NULL);
+
+  err = ext2fs_dblist_dir_iterate (fs->dblist, 0, NULL, add_entry, inv);
+  if (err == 0 && inv->nomem)
+    err = EXT2_ET_NO_MEMORY;
+  if (err) {
+    reply_with_error ("ext2fs_dblist_dir_iterate: %s", error_message (err));
+    return -1;
+  }
+
+  for (i = 0; i < inv->nr_inline_dirs; ++i) {
+    err = ext2fs_dir_iterate2 (fs, inv->inline_dirs[i], 0, NULL,
+                               add_entry, inv);
+    if (err == 0 && inv->nomem)
+      err = EXT2_ET_NO_MEMORY;
+    if (err) {
+      reply_with_error ("ext2fs_dir_iterate: inode %" PRIu32 ": %s",
+                        (uint32_t) inv->inline_dirs[i], error_message (err));
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/* Return the path of a directory, or NULL if it is not reachable from
+ * the root directory.  The root directory is "" so that every path
+ * is the parent path followed by "/name".
+ */
+static const char *
+dir_path (struct inventory *inv, ext2_ino_t ino, int depth)
+{
+  struct inode_info *info;
+  const struct name_entry *e;
+  const char *parent;
+
+  info = lookup_inode (inv, ino);
+  if (info == NULL)
+    return NULL;
+  if (info->path)
+    return info->path;
+
+  if (ino == EXT2_ROOT_INO)
+    info->path = strdup ("");
+  else {
+    /* The depth limit stops loops in a corrupt filesystem. */
+    if (info->name == NO_NAME || depth > 4096)
+      return NULL;
+    e = &inv->entries[info->name];
+    parent = dir_path (inv, e->parent, depth+1);
+    if (parent == NULL)
+      return NULL;
+    if (asprintf (&info->path, "%s/%.*s",
+                  parent, (int) e->len, &inv->names[e->name]) == -1)
+      info->path = NULL;
+  }
+  if (info->path == NULL)
+    errno = ENOMEM;
+  return info->path;
+}
+
+static int
+add_output (struct inventory *inv, const char *str, size_t len)
+{
+  size_t n;
+  int r;
+
+  while (len > 0) {
+    n = MIN (len, GUESTFS_MAX_CHUNK_SIZE - inv->out_len);
+    memcpy (inv->out + inv->out_len, str, n);
+    inv->out_len += n;
+    str += n;
+    len -= n;
+
+    if (inv->out_len == GUESTFS_MAX_CHUNK_SIZE) {
+      r = send_file_write (inv->out, inv->out_len);
+      if (r < 0)
+        return r;
+      inv->out_len = 0;
+    }
+  }
+
+  return 0;
+}
+
+/* Send one record: the path, followed by the inode fields. */
+static int
+send_record (struct inventory *inv, const char *dir,
+             const char *name, size_t len, const struct inode_info *info)
+{
+  char numbers[6 * 21];
+  int n, r;
+
+  r = add_output (inv, dir, strlen (dir));
+  if (r == 0)
+    r = add_output (inv, "/", 1);
+  if (r == 0)
+    r = add_output (inv, name, len);
+  if (r == 0)
+    r = add_output (inv, "", 1);
+  if (r < 0)
+    return r;
+
+  n = snprintf (numbers, sizeof numbers,
+                "%" PRIu32 "%c%" PRIu16 "%c%" PRIu64 "%c"
+                "%" PRIi64 "%c%" PRIi64 "%c%" PRIi64 "%c",
+                (uint32_t) info->ino, 0, info->mode, 0, info->size, 0,
+                info->atime, 0, info->mtime, 0, info->ctime, 0);
+  return add_output (inv, numbers, n);
+}
+
+static int
+send_inventory (struct inventory *inv)
+{
+  const struct name_entry *e;
+  const struct inode_info *info;
+  const char *dir;
+  size_t i;
+  int r;
+
+  info = lookup_inode (inv, EXT2_ROOT_INO);
+  if (info) {
+    r = send_record (inv, "", "", 0, info);
+    if (r < 0)
+      return r;
+  }
+
+  for (i = 0; i < inv->nr_entries; ++i) {
+    e = &inv->entries[i];
+
+    /* Skip entries in directories which cannot be reached from the
+     * root, and entries pointing to unused inodes.
+     */
+    errno = 0;
+    dir = dir_path (inv, e->parent, 0);
+    if (dir == NULL) {
+      if (errno == ENOMEM)
+        return -1;
+      continue;
+    }
+    info = lookup_inode (inv, e->ino);
+    if (info == NULL)
+      continue;
+
+    r = send_record (inv, dir, &inv->names[e->name], e->len, info);
+    if (r < 0)
+      return r;
+  }
+
+  if (inv->out_len > 0)
+    return send_file_write (inv->out, inv->out_len);
+  return 0;
+}
+
+static void
+free_inventory (struct inventory *inv)
+{
+  size_t i;
+
+  for (i = 0; i < inv->nr_inodes; ++i)
+    free (inv->inodes[i].path);
+  free (inv->inodes);
+  free (inv->entries);
+  free (inv->names);
+  free (inv->inline_dirs);
+  free (inv->out);
+  if (inv->fs)
+    ext2fs_close_free (&inv->fs);
+}
+
+int
+do_ext_inventory (const char *device)
+{
+  struct inventory inv = { .fs = NULL };
+  errcode_t err;
+  int r;
+
+  /* Open read-only, so the journal is not replayed. */
+  err = ext2fs_open2 (device, NULL, EXT2_FLAG_64BITS, 0, 0,
+                      unix_io_manager, &inv.fs);
+  if (err) {
+    reply_with_error ("%s: %s", device, error_message (err));
+    return -1;
+  }
+
+  inv.out = malloc (GUESTFS_MAX_CHUNK_SIZE);
+  if (inv.out == NULL) {
+    reply_with_perror ("malloc");
+    goto error;
+  }
+
+  if (scan_inodes (&inv) == -1 || scan_directories (&inv) == -1)
+    goto error;
+
+  /* Now we must send the reply message, before the file contents.  After
+   * this there is no opportunity in the protocol to send any error
+   * message back.  Instead we can only cancel the transfer.
+   */
+  reply (NULL, NULL);
+
+  r = send_inventory (&inv);
+  free_inventory (&inv);
+
+  if (r == -2)                  /* Cancelled by the library. */
+    return -1;
+
+  if (r == -1) {
+    fprintf (stderr, "ext_inventory: %s: %m\n", device);
+    send_file_end (1);          /* Cancel. */
+    return -1;
+  }
+
+  if (send_file_end (0))        /* Normal end of file. */
+    return -1;
+
+  return 0;
+
+ error:
+  free_inventory (&inv);
+  return -1;
+}
+
+#else /* !HAVE_LIBEXT2FS */
+
+OPTGROUP_LIBEXT2FS_NOT_AVAILABLE
+
+#endif /* !HAVE_LIBEXT2FS */
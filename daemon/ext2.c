@@ -136,6 +136,8 @@ do_set_e2label (const char *device, const char *label)
     return -1;
   }
 
+  blkid_cache_invalidate (device);
+
   r = command (NULL, &err, str_e2label, device, label, NULL);
   if (r == -1) {
     reply_with_error ("%s", err);
@@ -162,6 +164,8 @@ do_set_e2uuid (const char *device, const char *uuid)
   int r;
   CLEANUP_FREE char *err = NULL;
 
+  blkid_cache_invalidate (device);
+
   r = command (NULL, &err, str_tune2fs, "-U", uuid, device, NULL);
   if (r == -1) {
     reply_with_error ("%s", err);
@@ -727,6 +731,8 @@ do_tune2fs (const char *device, /* only required parameter */
   ADD_ARG (argv, i, device);
   ADD_ARG (argv, i, NULL);
 
+  blkid_cache_invalidate (device);
+
   r = commandv (NULL, &err, argv);
   if (r == -1) {
     reply_with_error ("%s: %s", device, err);
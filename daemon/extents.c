@@ -0,0 +1,548 @@
+/* libguestfs - the guestfsd daemon
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+
+#ifdef HAVE_LINUX_FS_H
+#include <linux/fs.h>
+#endif
+
+#ifdef HAVE_LINUX_FIEMAP_H
+#include <linux/fiemap.h>
+#endif
+
+#include "daemon.h"
+#include "actions.h"
+
+GUESTFSD_EXT_CMD(str_dumpe2fs, dumpe2fs);
+GUESTFSD_EXT_CMD(str_xfs_db, xfs_db);
+GUESTFSD_EXT_CMD(str_ntfscat, ntfscat);
+
+#if defined(HAVE_LINUX_FIEMAP_H) && defined(FS_IOC_FIEMAP)
+
+/* Number of extents fetched by each FIEMAP ioctl. */
+#define FIEMAP_BATCH 512
+
+guestfs_int_file_extent_list *
+do_file_extents (const char *path)
+{
+  int fd;
+  CLEANUP_FREE struct fiemap *fm = NULL;
+  guestfs_int_file_extent_list *ret = NULL;
+  guestfs_int_file_extent *v;
+  uint64_t start = 0;
+  int last = 0;
+  size_t i, n;
+
+  CHROOT_IN;
+  fd = open (path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+  CHROOT_OUT;
+  if (fd == -1) {
+    reply_with_perror ("open: %s", path);
+    return NULL;
+  }
+
+  fm = malloc (sizeof *fm + FIEMAP_BATCH * sizeof (struct fiemap_extent));
+  ret = calloc (1, sizeof *ret);
+  if (fm == NULL || ret == NULL) {
+    reply_with_perror ("malloc");
+    goto error;
+  }
+
+  while (!last) {
+    memset (fm, 0, sizeof *fm);
+    fm->fm_start = start;
+    fm->fm_length = FIEMAP_MAX_OFFSET - start;
+    fm->fm_flags = FIEMAP_FLAG_SYNC;
+    fm->fm_extent_count = FIEMAP_BATCH;
+
+    if (ioctl (fd, FS_IOC_FIEMAP, fm) == -1) {
+      reply_with_perror ("%s: FIEMAP", path);
+      goto error;
+    }
+    if (fm->fm_mapped_extents == 0)
+      break;
+
+    n = ret->guestfs_int_file_extent_list_len;
+    v = realloc (ret->guestfs_int_file_extent_list_val,
+                 (n + fm->fm_mapped_extents) * sizeof (guestfs_int_file_extent));
+    if (v == NULL) {
+      reply_with_perror ("realloc");
+      goto error;
+    }
+    ret->guestfs_int_file_extent_list_val = v;
+
+    for (i = 0; i < fm->fm_mapped_extents; ++i) {
+      const struct fiemap_extent *fe = &fm->fm_extents[i];
+
+      v[n+i].fe_logical = fe->fe_logical;
+      v[n+i].fe_physical = fe->fe_physical;
+      v[n+i].fe_length = fe->fe_length;
+      v[n+i].fe_flags = fe->fe_flags;
+      if (fe->fe_flags & FIEMAP_EXTENT_LAST)
+        last = 1;
+    }
+    ret->guestfs_int_file_extent_list_len = n + fm->fm_mapped_extents;
+
+    start = v[n+i-1].fe_logical + v[n+i-1].fe_length;
+  }
+
+  if (close (fd) == -1) {
+    fd = -1;
+    reply_with_perror ("close: %s", path);
+    goto error;
+  }
+
+  return ret;
+
+ error:
+  if (fd >= 0)
+    close (fd);
+  if (ret) {
+    free (ret->guestfs_int_file_extent_list_val);
+    free (ret);
+  }
+  return NULL;
+}
+
+#else /* !FS_IOC_FIEMAP */
+
+guestfs_int_file_extent_list *
+do_file_extents (const char *path)
+{
+  NOT_SUPPORTED (NULL, "FIEMAP is not available");
+}
+
+#endif /* !FS_IOC_FIEMAP */
+
+static int
+add_free_range (guestfs_int_blockrange_list *ret,
+                int64_t start, int64_t size)
+{
+  guestfs_int_blockrange *v;
+  size_t n = ret->guestfs_int_blockrange_list_len;
+
+  v = realloc (ret->guestfs_int_blockrange_list_val,
+               (n+1) * sizeof (guestfs_int_blockrange));
+  if (v == NULL) {
+    reply_with_perror ("realloc");
+    return -1;
+  }
+  ret->guestfs_int_blockrange_list_val = v;
+  v[n].br_start = start;
+  v[n].br_size = size;
+  ret->guestfs_int_blockrange_list_len = n+1;
+  return 0;
+}
+
+static int
+compare_blockranges (const void *bv1, const void *bv2)
+{
+  const guestfs_int_blockrange *b1 = bv1, *b2 = bv2;
+
+  return b1->br_start < b2->br_start ? -1 : b1->br_start > b2->br_start;
+}
+
+/* Sort the ranges and merge the ones which touch. */
+static void
+sort_free_ranges (guestfs_int_blockrange_list *ret)
+{
+  guestfs_int_blockrange *v = ret->guestfs_int_blockrange_list_val;
+  size_t i, j, n = ret->guestfs_int_blockrange_list_len;
+
+  if (n == 0)
+    return;
+
+  qsort (v, n, sizeof (guestfs_int_blockrange), compare_blockranges);
+  for (i = 1, j = 0; i < n; ++i) {
+    if (v[j].br_start + v[j].br_size == v[i].br_start)
+      v[j].br_size += v[i].br_size;
+    else
+      v[++j] = v[i];
+  }
+  ret->guestfs_int_blockrange_list_len = j+1;
+}
+
+/* Parse the "Free blocks:" lines of each group printed by dumpe2fs,
+ * which list the ranges free in the block bitmap, eg:
+ *
+ *   Free blocks: 1234-2047, 3000, 3002-4095
+ */
+static int
+ext2_free_ranges (const char *device, guestfs_int_blockrange_list *ret)
+{
+  CLEANUP_FREE char *out = NULL, *err = NULL;
+  CLEANUP_FREE_STRING_LIST char **lines = NULL;
+  int64_t blocksize = 0;
+  size_t i;
+  int r;
+
+  r = command (&out, &err, str_dumpe2fs, device, NULL);
+  if (r == -1) {
+    reply_with_error ("%s: %s", device, err);
+    return -1;
+  }
+
+  lines = split_lines (out);
+  if (lines == NULL)
+    return -1;
+
+  for (i = 0; lines[i] != NULL; ++i) {
+    const char *p;
+    int64_t first, last;
+    int n;
+
+    if (STRPREFIX (lines[i], "Block size:")) {
+      if (sscanf (lines[i] + 11, "%" SCNi64, &blocksize) != 1)
+        blocksize = 0;
+      continue;
+    }
+
+    /* The group lines are indented, unlike the free blocks count in
+     * the superblock.
+     */
+    p = lines[i] + strspn (lines[i], " ");
+    if (p == lines[i] || !STRPREFIX (p, "Free blocks:"))
+      continue;
+
+    if (blocksize <= 0) {
+      reply_with_error ("%s: could not read the block size from dumpe2fs",
+                        device);
+      return -1;
+    }
+
+    p += 12;
+    for (;;) {
+      p += strspn (p, " ,");
+      if (*p == '\0')
+        break;
+      if (sscanf (p, "%" SCNi64 "-%" SCNi64 "%n", &first, &last, &n) == 2)
+        ;
+      else if (sscanf (p, "%" SCNi64 "%n", &first, &n) == 1)
+        last = first;
+      else {
+        reply_with_error ("%s: cannot parse dumpe2fs output: %s",
+                          device, lines[i]);
+        return -1;
+      }
+      p += n;
+
+      if (add_free_range (ret, first * blocksize,
+                          (last - first + 1) * blocksize) == -1)
+        return -1;
+    }
+  }
+
+  return 0;
+}
+
+/* Parse the free extents printed by 'xfs_db freesp -d', which are
+ * "agno agbno len" triples in filesystem blocks.  The histogram
+ * printed after them has more columns and is skipped.
+ */
+static int
+xfs_free_ranges (const char *device, guestfs_int_blockrange_list *ret)
+{
+  CLEANUP_FREE char *out = NULL, *err = NULL;
+  CLEANUP_FREE_STRING_LIST char **lines = NULL;
+  int64_t blocksize = 0, agblocks = 0;
+  size_t i;
+  int r;
+
+  r = command (&out, &err, str_xfs_db, "-r",
+               "-c", "sb 0", "-c", "print blocksize agblocks",
+               "-c", "freesp -d", device, NULL);
+  if (r == -1) {
+    reply_with_error ("%s: %s", device, err);
+    return -1;
+  }
+
+  lines = split_lines (out);
+  if (lines == NULL)
+    return -1;
+
+  for (i = 0; lines[i] != NULL; ++i) {
+    int64_t agno, agbno, len;
+    int n;
+
+    if (sscanf (lines[i], "blocksize = %" SCNi64, &blocksize) == 1 ||
+        sscanf (lines[i], "agblocks = %" SCNi64, &agblocks) == 1)
+      continue;
+
+    if (sscanf (lines[i], "%" SCNi64 " %" SCNi64 " %" SCNi64 " %n",
+                &agno, &agbno, &len, &n) != 3 ||
+        lines[i][n] != '\0')
+      continue;
+
+    if (blocksize <= 0 || agblocks <= 0) {
+      reply_with_error ("%s: could not read the geometry from xfs_db",
+                        device);
+      return -1;
+    }
+
+    if (add_free_range (ret, (agno * agblocks + agbno) * blocksize,
+                        len * blocksize) == -1)
+      return -1;
+  }
+
+  return 0;
+}
+
+/* Read the cluster bitmap of an NTFS filesystem, which is the
+ * contents of the $Bitmap metadata file (inode 6).  Bit N (least
+ * significant bit first) is set if cluster N is in use.  The cluster
+ * size and the size of the volume are read from the boot sector.
+ */
+static int
+ntfs_free_ranges (const char *device, guestfs_int_blockrange_list *ret)
+{
+  unsigned char bs[512];
+  unsigned char buf[BUFSIZ];
+  uint64_t bytes_per_sector, sectors_per_cluster, cluster_size;
+  uint64_t nr_clusters, cluster = 0, free_start = 0;
+  int fd, in_free = 0, err;
+  size_t n, i;
+  unsigned bit;
+  FILE *fp;
+  CLEANUP_FREE char *cmd = NULL;
+
+  fd = open (device, O_RDONLY|O_CLOEXEC);
+  if (fd == -1) {
+    reply_with_perror ("open: %s", device);
+    return -1;
+  }
+  if (pread (fd, bs, sizeof bs, 0) != sizeof bs) {
+    reply_with_perror ("pread: %s", device);
+    close (fd);
+    return -1;
+  }
+  close (fd);
+
+  if (memcmp (&bs[3], "NTFS    ", 8) != 0) {
+    reply_with_error ("%s: NTFS boot sector not found", device);
+    return -1;
+  }
+  bytes_per_sector = bs[11] | (bs[12] << 8);
+  /* Values above 0x80 are a negative power of 2. */
+  sectors_per_cluster = bs[13] <= 0x80 ? bs[13] : UINT64_C(1) << (256 - bs[13]);
+  cluster_size = bytes_per_sector * sectors_per_cluster;
+  nr_clusters = 0;
+  for (i = 0; i < 8; ++i)
+    nr_clusters |= (uint64_t) bs[40+i] << (i*8);
+  if (cluster_size == 0 || sectors_per_cluster == 0) {
+    reply_with_error ("%s: invalid NTFS boot sector", device);
+    return -1;
+  }
+  nr_clusters /= sectors_per_cluster;
+
+  if (asprintf (&cmd, "%s -i 6 %s", str_ntfscat, device) == -1) {
+    reply_with_perror ("asprintf");
+    return -1;
+  }
+  if (verbose)
+    fprintf (stderr, "%s\n", cmd);
+
+  fp = popen (cmd, "r");
+  if (fp == NULL) {
+    reply_with_perror ("%s", cmd);
+    return -1;
+  }
+
+  while (cluster < nr_clusters &&
+         (n = fread (buf, 1, sizeof buf, fp)) > 0) {
+    for (i = 0; i < n && cluster < nr_clusters; ++i) {
+      for (bit = 0; bit < 8 && cluster < nr_clusters; ++bit, ++cluster) {
+        const int used = buf[i] & (1 << bit);
+
+        if (!used && !in_free) {
+          free_start = cluster;
+          in_free = 1;
+        }
+        else if (used && in_free) {
+          in_free = 0;
+          if (add_free_range (ret, free_start * cluster_size,
+                              (cluster - free_start) * cluster_size) == -1) {
+            pclose (fp);
+            return -1;
+          }
+        }
+      }
+    }
+  }
+  /* The bitmap is not read to the end if it is longer than the
+   * volume, so don't check the exit status of ntfscat in that case.
+   */
+  err = ferror (fp);
+  if (pclose (fp) != 0 && cluster < nr_clusters)
+    err = 1;
+  if (err) {
+    reply_with_error ("%s: could not read the NTFS cluster bitmap", device);
+    return -1;
+  }
+
+  if (in_free &&
+      add_free_range (ret, free_start * cluster_size,
+                      (cluster - free_start) * cluster_size) == -1)
+    return -1;
+
+  return 0;
+}
+
+/**
+ * Return true if the free ranges of filesystems of type C<vfs_type>
+ * (as returned by blkid) can be read.
+ */
+int
+free_ranges_supported (const char *vfs_type)
+{
+  return STREQ (vfs_type, "ext2") || STREQ (vfs_type, "ext3") ||
+    STREQ (vfs_type, "ext4") || STREQ (vfs_type, "xfs") ||
+    STREQ (vfs_type, "ntfs");
+}
+
+/**
+ * Return the sorted free ranges of the filesystem on C<device>.  On
+ * error this replies with an error and returns C<NULL>.
+ */
+guestfs_int_blockrange_list *
+get_free_ranges (const char *device)
+{
+  CLEANUP_FREE char *type = NULL;
+  guestfs_int_blockrange_list *ret;
+  int r;
+
+  type = get_blkid_tag (device, "TYPE");
+  if (type == NULL)
+    return NULL;
+
+  ret = calloc (1, sizeof *ret);
+  if (ret == NULL) {
+    reply_with_perror ("calloc");
+    return NULL;
+  }
+
+  /* The free space maps are read from the device, so make sure the
+   * filesystem has written them if it is mounted.
+   */
+  sync_disks ();
+
+  if (STREQ (type, "ext2") || STREQ (type, "ext3") || STREQ (type, "ext4"))
+    r = ext2_free_ranges (device, ret);
+  else if (STREQ (type, "xfs"))
+    r = xfs_free_ranges (device, ret);
+  else if (STREQ (type, "ntfs"))
+    r = ntfs_free_ranges (device, ret);
+  else {
+    free (ret);
+    NOT_SUPPORTED (NULL, "%s: free ranges of %s filesystems are not supported",
+                   device, type[0] ? type : "unknown");
+  }
+
+  if (r == -1) {
+    free (ret->guestfs_int_blockrange_list_val);
+    free (ret);
+    return NULL;
+  }
+
+  sort_free_ranges (ret);
+  return ret;
+}
+
+guestfs_int_blockrange_list *
+do_filesystem_free_ranges (const char *device)
+{
+  return get_free_ranges (device);
+}
+
+#ifdef BLKDISCARD
+
+int64_t
+do_discard_free_ranges (const char *device)
+{
+  guestfs_int_blockrange_list *ranges;
+  uint64_t range[2];
+  int64_t discarded = 0;
+  size_t i;
+  int fd, r;
+
+  /* Blocks written by a mounted filesystem may not be in the free
+   * space maps yet, and we would discard them.
+   */
+  r = is_device_mounted (device);
+  if (r == -1)
+    return -1;
+  if (r) {
+    reply_with_error ("%s: device is mounted", device);
+    return -1;
+  }
+
+  ranges = get_free_ranges (device);
+  if (ranges == NULL)
+    return -1;
+
+  fd = open (device, O_WRONLY|O_CLOEXEC);
+  if (fd == -1) {
+    reply_with_perror ("open: %s", device);
+    goto error;
+  }
+
+  for (i = 0; i < ranges->guestfs_int_blockrange_list_len; ++i) {
+    range[0] = ranges->guestfs_int_blockrange_list_val[i].br_start;
+    range[1] = ranges->guestfs_int_blockrange_list_val[i].br_size;
+    if (ioctl (fd, BLKDISCARD, range) == -1) {
+      reply_with_perror ("ioctl: %s: BLKDISCARD", device);
+      close (fd);
+      goto error;
+    }
+    discarded += range[1];
+  }
+
+  if (close (fd) == -1) {
+    reply_with_perror ("close: %s", device);
+    goto error;
+  }
+
+  free (ranges->guestfs_int_blockrange_list_val);
+  free (ranges);
+  return discarded;
+
+ error:
+  free (ranges->guestfs_int_blockrange_list_val);
+  free (ranges);
+  return -1;
+}
+
+#else /* !BLKDISCARD */
+
+int64_t
+do_discard_free_ranges (const char *device)
+{
+  NOT_SUPPORTED (-1, "BLKDISCARD ioctl is not available");
+}
+
+#endif /* !BLKDISCARD */
@@ -24,80 +24,323 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fnmatch.h>
 #include <sys/stat.h>
 
 #include "guestfs_protocol.h"
 #include "daemon.h"
 #include "actions.h"
 
-GUESTFSD_EXT_CMD(str_find, find);
+/* The paths are packed into chunks of GUESTFS_MAX_CHUNK_SIZE, and a
+ * path may be split across chunks, so there is no limit on the length
+ * of paths.
+ */
+struct find_state {
+  char *out;                    /* output chunk */
+  size_t out_len;
+  char *path;                   /* current path, relative to the top */
+  size_t path_len, path_alloc;
+
+  /* Filters, from the optional arguments. */
+  const char *dir;              /* the directory, as given */
+  const char *glob;             /* NULL if not set */
+  const char *types;            /* NULL if not set */
+  int64_t minsize, maxsize;     /* -1 if not set */
+  int64_t minmtime, maxmtime;
+  int has_mtime;
+  int maxdepth;                 /* -1 if not set */
+  char *const *prune;           /* NULL if not set */
+};
+
+/* The letter for the file type, as in find -type. */
+static char
+type_of_mode (mode_t mode)
+{
+  if (S_ISREG (mode)) return 'f';
+  if (S_ISDIR (mode)) return 'd';
+  if (S_ISLNK (mode)) return 'l';
+  if (S_ISBLK (mode)) return 'b';
+  if (S_ISCHR (mode)) return 'c';
+  if (S_ISFIFO (mode)) return 'p';
+  if (S_ISSOCK (mode)) return 's';
+  return '?';
+}
+
+static char
+type_of_dirent (const struct dirent *d)
+{
+  switch (d->d_type) {
+  case DT_REG: return 'f';
+  case DT_DIR: return 'd';
+  case DT_LNK: return 'l';
+  case DT_BLK: return 'b';
+  case DT_CHR: return 'c';
+  case DT_FIFO: return 'p';
+  case DT_SOCK: return 's';
+  default: return '?';
+  }
+}
+
+/* Is the current path one of the directories to prune? */
+static int
+is_pruned (const struct find_state *st)
+{
+  const size_t dirlen = strlen (st->dir);
+  size_t i;
+
+  for (i = 0; st->prune[i] != NULL; ++i) {
+    const char *p = st->prune[i];
+
+    /* The absolute path is the directory followed by the path. */
+    if (STREQLEN (p, st->dir, dirlen) && STREQ (&p[dirlen], st->path))
+      return 1;
+  }
+
+  return 0;
+}
+
+static int
+add_output (struct find_state *st, const char *str, size_t len)
+{
+  size_t n;
+  int r;
+
+  while (len > 0) {
+    n = MIN (len, GUESTFS_MAX_CHUNK_SIZE - st->out_len);
+    memcpy (st->out + st->out_len, str, n);
+    st->out_len += n;
+    str += n;
+    len -= n;
+
+    if (st->out_len == GUESTFS_MAX_CHUNK_SIZE) {
+      r = send_file_write (st->out, st->out_len);
+      if (r < 0)
+        return r;
+      st->out_len = 0;
+    }
+  }
+
+  return 0;
+}
 
+/* Append "/name" (or just "name" if 'sep' is false) to the path. */
 static int
-input_to_nul (FILE *fp, char *buf, size_t maxlen)
+push_path (struct find_state *st, int sep, const char *name)
 {
-  size_t i = 0;
-  int c;
+  const size_t len = strlen (name);
+  const size_t needed = st->path_len + (sep ? 1 : 0) + len + 1;
+
+  if (needed > st->path_alloc) {
+    size_t alloc = st->path_alloc ? st->path_alloc : 256;
+    char *path;
+
+    while (alloc < needed)
+      alloc *= 2;
+    path = realloc (st->path, alloc);
+    if (path == NULL)
+      return -1;
+    st->path = path;
+    st->path_alloc = alloc;
+  }
+
+  if (sep)
+    st->path[st->path_len++] = '/';
+  memcpy (&st->path[st->path_len], name, len + 1);
+  st->path_len += len;
+  return 0;
+}
+
+/* List the directory 'fd' (which is closed) recursively, in the same
+ * order as find(1).  'sep' is false if the names of the entries are
+ * not preceded by a slash, which is only the case for the top
+ * directory if its path ends with a slash.  'depth' is the depth of
+ * the entries, starting at 1.
+ *
+ * Returns 0 on success, -1 on error (with errno set) or -2 if the
+ * library cancelled the transfer.
+ */
+static int
+find_dir (struct find_state *st, int fd, int sep, int depth)
+{
+  DIR *dir;
+  struct dirent *d;
+  struct stat statbuf;
+  size_t len;
+  char type;
+  int match, subfd, r = 0;
+  const int need_stat =
+    st->minsize >= 0 || st->maxsize >= 0 || st->has_mtime;
+
+  dir = fdopendir (fd);
+  if (dir == NULL) {
+    close (fd);
+    return -1;
+  }
+
+  for (;;) {
+    if (call_cancelled ()) {
+      errno = EINTR;
+      r = -1;
+      break;
+    }
+    errno = 0;
+    d = readdir (dir);
+    if (d == NULL) {
+      if (errno != 0)
+        r = -1;
+      break;
+    }
+    if (STREQ (d->d_name, ".") || STREQ (d->d_name, ".."))
+      continue;
+
+    len = st->path_len;
+    if (push_path (st, sep, d->d_name) == -1) {
+      r = -1;
+      break;
+    }
+
+    /* Don't follow symbolic links, like find -P. */
+    type = type_of_dirent (d);
+    if (type == '?' || need_stat) {
+      if (fstatat (dirfd (dir), d->d_name, &statbuf,
+                   AT_SYMLINK_NOFOLLOW) == -1) {
+        fprintf (stderr, "find0: %s: %m\n", st->path);
+        r = -1;
+        break;
+      }
+      type = type_of_mode (statbuf.st_mode);
+    }
 
-  while (i < maxlen) {
-    c = fgetc (fp);
-    if (c == EOF)
-      return 0;
-    buf[i++] = c;
-    if (c == '\0')
-      return i;
+    if (type == 'd' && st->prune && is_pruned (st)) {
+      st->path_len = len;
+      continue;
+    }
+
+    match =
+      (st->glob == NULL || fnmatch (st->glob, d->d_name, 0) == 0) &&
+      (st->types == NULL || strchr (st->types, type) != NULL) &&
+      (st->minsize < 0 || statbuf.st_size >= st->minsize) &&
+      (st->maxsize < 0 || statbuf.st_size <= st->maxsize) &&
+      (!st->has_mtime ||
+       (statbuf.st_mtime >= st->minmtime &&
+        statbuf.st_mtime <= st->maxmtime));
+    if (match) {
+      r = add_output (st, st->path, st->path_len + 1 /* with \0 */);
+      if (r != 0)
+        break;
+    }
+
+    if (type == 'd' && (st->maxdepth < 0 || depth < st->maxdepth)) {
+      subfd = openat (dirfd (dir), d->d_name,
+                      O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+      if (subfd == -1) {
+        fprintf (stderr, "find0: %s: %m\n", st->path);
+        r = -1;
+        break;
+      }
+      r = find_dir (st, subfd, 1, depth + 1);
+      if (r != 0)
+        break;
+    }
+
+    st->path_len = len;
   }
 
-  reply_with_error ("input_to_nul: input string too long");
-  return -1;
+  closedir (dir);
+  return r;
 }
 
 /* Has one FileOut parameter. */
+/* Takes optional arguments, consult optargs_bitmask. */
 int
-do_find0 (const char *dir)
+do_find0 (const char *dir, const char *glob, const char *types,
+          int64_t minsize, int64_t maxsize,
+          int64_t minmtime, int64_t maxmtime,
+          int maxdepth, char *const *prune)
 {
-  struct stat statbuf;
-  int r;
-  FILE *fp;
-  CLEANUP_FREE char *cmd = NULL;
+  int fd, r;
+  size_t i;
   CLEANUP_FREE char *sysrootdir = NULL;
-  size_t sysrootdirlen;
-  CLEANUP_FREE char *str = NULL;
+  CLEANUP_FREE char *out = NULL;
+  struct find_state st = { .dir = dir };
 
-  str = malloc (GUESTFS_MAX_CHUNK_SIZE);
-  if (str == NULL) {
-    reply_with_perror ("malloc");
-    return -1;
+  st.glob = optargs_bitmask & GUESTFS_FIND0_GLOB_BITMASK ? glob : NULL;
+  st.types = optargs_bitmask & GUESTFS_FIND0_TYPES_BITMASK ? types : NULL;
+  if (st.types) {
+    if (strspn (st.types, "fdlbcps") != strlen (st.types)) {
+      reply_with_error ("types: unknown file type in '%s'", st.types);
+      return -1;
+    }
   }
 
-  sysrootdir = sysroot_path (dir);
-  if (!sysrootdir) {
-    reply_with_perror ("malloc");
-    return -1;
+  st.minsize = -1;
+  if (optargs_bitmask & GUESTFS_FIND0_MINSIZE_BITMASK) {
+    if (minsize < 0) {
+      reply_with_error ("minsize cannot be negative");
+      return -1;
+    }
+    st.minsize = minsize;
+  }
+  st.maxsize = -1;
+  if (optargs_bitmask & GUESTFS_FIND0_MAXSIZE_BITMASK) {
+    if (maxsize < 0) {
+      reply_with_error ("maxsize cannot be negative");
+      return -1;
+    }
+    st.maxsize = maxsize;
   }
 
-  r = stat (sysrootdir, &statbuf);
-  if (r == -1) {
-    reply_with_perror ("%s", dir);
-    return -1;
+  st.minmtime = INT64_MIN;
+  st.maxmtime = INT64_MAX;
+  if (optargs_bitmask & GUESTFS_FIND0_MINMTIME_BITMASK) {
+    st.minmtime = minmtime;
+    st.has_mtime = 1;
   }
-  if (!S_ISDIR (statbuf.st_mode)) {
-    reply_with_error ("%s: not a directory", dir);
-    return -1;
+  if (optargs_bitmask & GUESTFS_FIND0_MAXMTIME_BITMASK) {
+    st.maxmtime = maxmtime;
+    st.has_mtime = 1;
   }
 
-  sysrootdirlen = strlen (sysrootdir);
+  st.maxdepth = -1;
+  if (optargs_bitmask & GUESTFS_FIND0_MAXDEPTH_BITMASK) {
+    if (maxdepth < 0) {
+      reply_with_error ("maxdepth cannot be negative");
+      return -1;
+    }
+    st.maxdepth = maxdepth;
+  }
 
-  if (asprintf_nowarn (&cmd, "%s %Q -print0", str_find, sysrootdir) == -1) {
-    reply_with_perror ("asprintf");
+  if (optargs_bitmask & GUESTFS_FIND0_PRUNE_BITMASK) {
+    for (i = 0; prune[i] != NULL; ++i) {
+      if (prune[i][0] != '/') {
+        reply_with_error ("prune: %s: path must start with / character",
+                          prune[i]);
+        return -1;
+      }
+    }
+    st.prune = prune;
+  }
+
+  out = malloc (GUESTFS_MAX_CHUNK_SIZE);
+  if (out == NULL) {
+    reply_with_perror ("malloc");
     return -1;
   }
 
-  if (verbose)
-    fprintf (stderr, "%s\n", cmd);
+  sysrootdir = sysroot_path (dir);
+  if (!sysrootdir) {
+    reply_with_perror ("malloc");
+    return -1;
+  }
 
-  fp = popen (cmd, "r");
-  if (fp == NULL) {
-    reply_with_perror ("%s", cmd);
+  fd = open (sysrootdir, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+  if (fd == -1) {
+    if (errno == ENOTDIR)
+      reply_with_error ("%s: not a directory", dir);
+    else
+      reply_with_perror ("%s", dir);
     return -1;
   }
 
@@ -107,32 +350,33 @@ do_find0 (const char *dir)
    */
   reply (NULL, NULL);
 
-  /* The code below assumes each path returned can fit into a protocol
-   * chunk (if not you'll get a runtime protocol error).  If this
-   * turns out not to be a problem at some point in the future then
-   * we'll need to modify the code to handle it.  XXX
+  /* The paths are sent without the directory part, so they start
+   * with a slash unless the directory ended with one (eg. "/").
    */
-  while ((r = input_to_nul (fp, str, GUESTFS_MAX_CHUNK_SIZE)) > 0) {
-    const size_t len = strlen (str);
-    if (len <= sysrootdirlen)
-      continue;
-
-    /* Remove the directory part of the path before sending it. */
-    if (send_file_write (str + sysrootdirlen, r - sysrootdirlen) < 0) {
-      pclose (fp);
-      return -1;
-    }
+  st.out = out;
+  st.path = strdup ("");
+  st.path_alloc = 1;
+  if (st.path == NULL) {
+    close (fd);
+    r = -1;
   }
+  else if (st.maxdepth == 0) {
+    close (fd);
+    r = 0;
+  }
+  else
+    r = find_dir (&st, fd, sysrootdir[strlen (sysrootdir) - 1] != '/', 1);
 
-  if (ferror (fp)) {
-    fprintf (stderr, "fgetc: %s: %m\n", dir);
-    send_file_end (1);                /* Cancel. */
-    pclose (fp);
+  if (r == 0 && st.out_len > 0)
+    r = send_file_write (st.out, st.out_len);
+
+  free (st.path);
+
+  if (r == -2)                  /* Cancelled by the library. */
     return -1;
-  }
 
-  if (pclose (fp) != 0) {
-    fprintf (stderr, "pclose: %s: %m\n", dir);
+  if (r == -1) {
+    fprintf (stderr, "find0: %s: %m\n", dir);
     send_file_end (1);                /* Cancel. */
     return -1;
   }
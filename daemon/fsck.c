@@ -20,13 +20,23 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
 
+#include "guestfs_protocol.h"
 #include "daemon.h"
 #include "actions.h"
 
 GUESTFSD_EXT_CMD(str_fsck, fsck);
+GUESTFSD_EXT_CMD(str_e2fsck, e2fsck);
+GUESTFSD_EXT_CMD(str_xfs_repair, xfs_repair);
 
 int
 do_fsck (const char *fstype, const char *device)
@@ -42,3 +52,351 @@ do_fsck (const char *fstype, const char *device)
 
   return r;
 }
+
+/* fsck_multiple checks several filesystems at the same time.  The
+ * checkers spend most of their time waiting for reads, so they are
+ * run concurrently, but not more than one at a time on the same disk
+ * so that they do not make each other seek.
+ */
+
+/* Only this much of the output of each checker is returned. */
+#define MAX_FSCK_OUTPUT 4096
+
+struct fsck_job {
+  const char *device;
+  char *vfs_type;
+  char *disk;                   /* the disk it is on, for scheduling */
+  int started;
+  int status;
+  char *output;
+};
+
+struct fsck_pool {
+  struct fsck_job *jobs;
+  size_t nr_jobs;
+  char **busy_disks;            /* disks being checked, by thread */
+  size_t nr_threads;
+  size_t done;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+};
+
+/* Return the name of the disk holding 'device', following the
+ * partitions to their disk and device mapper devices to the device
+ * below them, if there is only one.  Returns NULL if unknown.
+ */
+static char *
+device_disk (const char *device, int depth)
+{
+  struct stat statbuf;
+  char sysdir[64];
+  CLEANUP_FREE char *path = NULL, *slaves = NULL, *partfile = NULL;
+  char *p, *slave = NULL, *ret;
+  struct dirent *d;
+  size_t n = 0;
+  DIR *dir;
+
+  if (stat (device, &statbuf) == -1 || !S_ISBLK (statbuf.st_mode))
+    return NULL;
+
+  snprintf (sysdir, sizeof sysdir, "/sys/dev/block/%u:%u",
+            major (statbuf.st_rdev), minor (statbuf.st_rdev));
+  path = realpath (sysdir, NULL);
+  if (path == NULL)
+    return NULL;
+
+  if (asprintf (&partfile, "%s/partition", path) == -1)
+    return NULL;
+  if (access (partfile, F_OK) == 0) {
+    p = strrchr (path, '/');
+    if (p == NULL || p == path)
+      return NULL;
+    *p = '\0';
+  }
+
+  if (depth < 8 && asprintf (&slaves, "%s/slaves", path) != -1) {
+    dir = opendir (slaves);
+    if (dir) {
+      while ((d = readdir (dir)) != NULL) {
+        if (d->d_name[0] == '.')
+          continue;
+        n++;
+        free (slave);
+        slave = strdup (d->d_name);
+      }
+      closedir (dir);
+    }
+    if (n == 1 && slave) {
+      CLEANUP_FREE char *slavedev = NULL;
+
+      if (asprintf (&slavedev, "/dev/%s", slave) != -1) {
+        free (slave);
+        ret = device_disk (slavedev, depth+1);
+        if (ret)
+          return ret;
+        slave = NULL;
+      }
+    }
+    free (slave);
+  }
+
+  p = strrchr (path, '/');
+  return strdup (p ? p+1 : path);
+}
+
+static bool
+disk_is_busy (struct fsck_pool *pool, const char *disk)
+{
+  size_t i;
+
+  if (disk == NULL)
+    return false;
+  for (i = 0; i < pool->nr_threads; ++i)
+    if (pool->busy_disks[i] && STREQ (pool->busy_disks[i], disk))
+      return true;
+  return false;
+}
+
+static void
+run_fsck_job (struct fsck_job *job)
+{
+  const size_t MAX_ARGS = 16;
+  const char *argv[MAX_ARGS];
+  size_t i = 0;
+  CLEANUP_FREE char *out = NULL, *err = NULL;
+  size_t len;
+  int r;
+
+  if (STREQ (job->vfs_type, "")) {
+    job->status = -1;
+    job->output = strdup ("unknown filesystem type");
+    return;
+  }
+
+  /* The filesystems are only checked, never changed. */
+  if (STRPREFIX (job->vfs_type, "ext")) {
+    ADD_ARG (argv, i, str_e2fsck);
+    ADD_ARG (argv, i, "-n");
+    ADD_ARG (argv, i, "-f");
+  }
+  else if (STREQ (job->vfs_type, "xfs")) {
+    ADD_ARG (argv, i, str_xfs_repair);
+    ADD_ARG (argv, i, "-n");
+  }
+  else {
+    ADD_ARG (argv, i, str_fsck);
+    ADD_ARG (argv, i, "-n");
+    ADD_ARG (argv, i, "-t");
+    ADD_ARG (argv, i, job->vfs_type);
+  }
+  ADD_ARG (argv, i, job->device);
+  ADD_ARG (argv, i, NULL);
+
+  r = commandrvf (&out, &err, COMMAND_FLAG_FOLD_STDOUT_ON_STDERR, argv);
+  job->status = r;
+
+  /* Keep the end of the output, where the summary is. */
+  if (err == NULL)
+    err = strdup ("");
+  if (err == NULL)
+    return;
+  len = strlen (err);
+  if (len > MAX_FSCK_OUTPUT)
+    job->output = strdup (&err[len - MAX_FSCK_OUTPUT]);
+  else {
+    job->output = err;
+    err = NULL;
+  }
+}
+
+static void *
+fsck_thread (void *poolvp)
+{
+  struct fsck_pool *pool = poolvp;
+  struct fsck_job *job;
+  size_t me, i;
+
+  pthread_mutex_lock (&pool->lock);
+  me = pool->nr_threads++;
+
+  for (;;) {
+    /* Take the first job on a disk which is not being checked. */
+    job = NULL;
+    for (i = 0; i < pool->nr_jobs; ++i) {
+      if (!pool->jobs[i].started && !disk_is_busy (pool, pool->jobs[i].disk)) {
+        job = &pool->jobs[i];
+        break;
+      }
+    }
+    if (job == NULL) {
+      for (i = 0; i < pool->nr_jobs; ++i)
+        if (!pool->jobs[i].started)
+          break;
+      if (i == pool->nr_jobs)
+        break;
+      /* All the remaining jobs are on busy disks. */
+      pthread_cond_wait (&pool->changed, &pool->lock);
+      continue;
+    }
+
+    job->started = 1;
+    pool->busy_disks[me] = job->disk;
+    pthread_mutex_unlock (&pool->lock);
+
+    run_fsck_job (job);
+
+    pthread_mutex_lock (&pool->lock);
+    pool->busy_disks[me] = NULL;
+    pool->done++;
+    pthread_cond_broadcast (&pool->changed);
+  }
+
+  pthread_mutex_unlock (&pool->lock);
+  return NULL;
+}
+
+/* Takes optional arguments, consult optargs_bitmask. */
+guestfs_int_fsck_result_list *
+do_fsck_multiple (char *const *devices, int maxjobs)
+{
+  const size_t n = count_strings (devices);
+  CLEANUP_FREE struct fsck_job *jobs = NULL;
+  CLEANUP_FREE pthread_t *threads = NULL;
+  CLEANUP_FREE char **busy_disks = NULL;
+  CLEANUP_FREE_STRING_LIST char **disks = NULL;
+  struct fsck_pool pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .changed = PTHREAD_COND_INITIALIZER,
+  };
+  guestfs_int_fsck_result_list *ret = NULL;
+  size_t i, j, nr_disks, nr_threads, nr_started, reported;
+  const char *disk;
+  long nr_cpus;
+
+  if (!(optargs_bitmask & GUESTFS_FSCK_MULTIPLE_MAXJOBS_BITMASK))
+    maxjobs = 0;
+  if (maxjobs < 0) {
+    reply_with_error ("maxjobs cannot be negative");
+    return NULL;
+  }
+
+  jobs = calloc (n, sizeof *jobs);
+  disks = calloc (n+1, sizeof (char *));
+  if ((jobs == NULL || disks == NULL) && n > 0) {
+    reply_with_perror ("calloc");
+    return NULL;
+  }
+
+  /* Find the filesystem types and disks in this thread, because
+   * get_blkid_tag may reply with an error.
+   */
+  nr_disks = 0;
+  for (i = 0; i < n; ++i) {
+    jobs[i].device = devices[i];
+    jobs[i].vfs_type = get_blkid_tag (devices[i], "TYPE");
+    if (jobs[i].vfs_type == NULL)
+      goto out;
+    jobs[i].disk = device_disk (devices[i], 0);
+    disk = jobs[i].disk ? jobs[i].disk : devices[i];
+    for (j = 0; j < nr_disks; ++j)
+      if (STREQ (disks[j], disk))
+        break;
+    if (j == nr_disks) {
+      disks[nr_disks] = strdup (disk);
+      if (disks[nr_disks] == NULL) {
+        reply_with_perror ("strdup");
+        goto out;
+      }
+      nr_disks++;
+    }
+  }
+
+  /* By default, one checker per vCPU but no more than the disks,
+   * since only one runs on each disk at a time.
+   */
+  nr_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  if (nr_cpus < 1)
+    nr_cpus = 1;
+  nr_threads = maxjobs > 0 ? (size_t) maxjobs : MIN ((size_t) nr_cpus, nr_disks);
+  nr_threads = MIN (nr_threads, n);
+  if (nr_threads == 0)
+    nr_threads = 1;
+
+  threads = calloc (nr_threads, sizeof *threads);
+  busy_disks = calloc (nr_threads, sizeof (char *));
+  if (threads == NULL || busy_disks == NULL) {
+    reply_with_perror ("calloc");
+    goto out;
+  }
+  pool.jobs = jobs;
+  pool.nr_jobs = n;
+  pool.busy_disks = busy_disks;
+
+  if (verbose)
+    fprintf (stderr, "fsck_multiple: %zu filesystems on %zu disks, "
+             "%zu threads\n", n, nr_disks, nr_threads);
+
+  for (nr_started = 0; nr_started < nr_threads; ++nr_started) {
+    if (pthread_create (&threads[nr_started], NULL, fsck_thread, &pool) != 0)
+      break;
+  }
+  /* If no thread could be started, check them in this thread. */
+  if (nr_started == 0)
+    fsck_thread (&pool);
+
+  /* Progress is sent from this thread, as each filesystem finishes. */
+  reported = 0;
+  pthread_mutex_lock (&pool.lock);
+  while (reported < n) {
+    while (pool.done == reported)
+      pthread_cond_wait (&pool.changed, &pool.lock);
+    reported = pool.done;
+    pthread_mutex_unlock (&pool.lock);
+    notify_progress (reported, n);
+    pthread_mutex_lock (&pool.lock);
+  }
+  pthread_mutex_unlock (&pool.lock);
+
+  for (i = 0; i < nr_started; ++i)
+    pthread_join (threads[i], NULL);
+
+  ret = malloc (sizeof *ret);
+  if (ret == NULL) {
+    reply_with_perror ("malloc");
+    goto out;
+  }
+  ret->guestfs_int_fsck_result_list_len = n;
+  ret->guestfs_int_fsck_result_list_val =
+    calloc (n, sizeof (guestfs_int_fsck_result));
+  if (ret->guestfs_int_fsck_result_list_val == NULL && n > 0) {
+    reply_with_perror ("calloc");
+    free (ret);
+    ret = NULL;
+    goto out;
+  }
+
+  for (i = 0; i < n; ++i) {
+    guestfs_int_fsck_result *r = &ret->guestfs_int_fsck_result_list_val[i];
+
+    r->fr_device = strdup (jobs[i].device);
+    r->fr_vfs_type = jobs[i].vfs_type;
+    jobs[i].vfs_type = NULL;
+    r->fr_status = jobs[i].status;
+    r->fr_output = jobs[i].output ? jobs[i].output : strdup ("");
+    jobs[i].output = NULL;
+    if (r->fr_device == NULL || r->fr_output == NULL) {
+      reply_with_perror ("strdup");
+      xdr_free ((xdrproc_t) xdr_guestfs_int_fsck_result_list, (char *) ret);
+      ret = NULL;
+      goto out;
+    }
+  }
+
+ out:
+  for (i = 0; i < n; ++i) {
+    free (jobs[i].vfs_type);
+    free (jobs[i].disk);
+    free (jobs[i].output);
+  }
+  return ret;
+}
@@ -22,6 +22,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+
+#ifdef HAVE_LINUX_FS_H
+#include <linux/fs.h>
+#endif
 
 #include "guestfs_protocol.h"
 #include "daemon.h"
@@ -120,3 +129,162 @@ do_fstrim (const char *path,
 
   return 0;
 }
+
+#ifdef FITRIM
+
+/* Each filesystem is trimmed by its own thread.  The kernel spends
+ * most of the time issuing discards to the underlying device, so
+ * filesystems on different devices are trimmed concurrently.
+ */
+struct fstrim_job {
+  char *path;                   /* path of the mountpoint in sysroot */
+  int err;                      /* errno if the trim failed, else 0 */
+  struct fstrim_state *state;
+};
+
+struct fstrim_state {
+  pthread_mutex_t lock;
+  pthread_cond_t job_done;
+  size_t done;                  /* number of jobs finished */
+};
+
+static void *
+fstrim_thread (void *jobvp)
+{
+  struct fstrim_job *job = jobvp;
+  struct fstrim_state *state = job->state;
+  struct fstrim_range range = { .start = 0, .len = UINT64_MAX, .minlen = 0 };
+  int fd;
+
+  fd = open (job->path, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+  if (fd == -1)
+    job->err = errno;
+  else {
+    if (ioctl (fd, FITRIM, &range) == -1)
+      job->err = errno;
+    close (fd);
+  }
+
+  pthread_mutex_lock (&state->lock);
+  state->done++;
+  pthread_cond_signal (&state->job_done);
+  pthread_mutex_unlock (&state->lock);
+
+  return NULL;
+}
+
+char **
+do_fstrim_multiple (char *const *mountpoints)
+{
+  DECLARE_STRINGSBUF (ret);
+  const size_t n = count_strings (mountpoints);
+  CLEANUP_FREE struct fstrim_job *jobs = NULL;
+  CLEANUP_FREE pthread_t *threads = NULL;
+  CLEANUP_FREE int *started = NULL;
+  struct fstrim_state state = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .job_done = PTHREAD_COND_INITIALIZER,
+    .done = 0,
+  };
+  size_t i, reported;
+  int r = 0;
+
+  for (i = 0; i < n; ++i) {
+    if (mountpoints[i][0] != '/') {
+      reply_with_error ("%s: mountpoint must be an absolute path",
+                        mountpoints[i]);
+      return NULL;
+    }
+  }
+
+  jobs = calloc (n, sizeof *jobs);
+  threads = calloc (n, sizeof *threads);
+  started = calloc (n, sizeof *started);
+  if ((jobs == NULL || threads == NULL || started == NULL) && n > 0) {
+    reply_with_perror ("calloc");
+    return NULL;
+  }
+
+  for (i = 0; i < n; ++i) {
+    jobs[i].state = &state;
+    jobs[i].path = sysroot_path (mountpoints[i]);
+    if (jobs[i].path == NULL) {
+      reply_with_perror ("malloc");
+      r = -1;
+      goto out;
+    }
+  }
+
+  /* See do_fstrim above. */
+  sync_disks ();
+
+  for (i = 0; i < n; ++i) {
+    int err = pthread_create (&threads[i], NULL, fstrim_thread, &jobs[i]);
+    if (err == 0)
+      started[i] = 1;
+    else
+      /* Could not start a thread, so trim this one in the request
+       * thread.
+       */
+      fstrim_thread (&jobs[i]);
+  }
+
+  /* Progress is sent from this thread, as each filesystem finishes. */
+  reported = 0;
+  pthread_mutex_lock (&state.lock);
+  while (reported < n) {
+    while (state.done == reported)
+      pthread_cond_wait (&state.job_done, &state.lock);
+    reported = state.done;
+    pthread_mutex_unlock (&state.lock);
+    notify_progress (reported, n);
+    pthread_mutex_lock (&state.lock);
+  }
+  pthread_mutex_unlock (&state.lock);
+
+  for (i = 0; i < n; ++i) {
+    if (started[i])
+      pthread_join (threads[i], NULL);
+  }
+
+  for (i = 0; i < n; ++i) {
+    if (jobs[i].err == 0)
+      continue;
+    /* The filesystem does not support discard. */
+    if (jobs[i].err == EOPNOTSUPP || jobs[i].err == ENOTTY) {
+      if (add_string (&ret, mountpoints[i]) == -1) {
+        r = -1;                 /* add_string freed the buffer */
+        goto out;
+      }
+    }
+    else {
+      reply_with_error_errno (jobs[i].err, "%s: FITRIM: %s",
+                              mountpoints[i], strerror (jobs[i].err));
+      free_stringsbuf (&ret);
+      r = -1;
+      goto out;
+    }
+  }
+
+  if (end_stringsbuf (&ret) == -1)
+    r = -1;
+
+ out:
+  for (i = 0; i < n; ++i)
+    free (jobs[i].path);
+
+  if (r == -1)
+    return NULL;
+
+  return take_stringsbuf (&ret);
+}
+
+#else /* !FITRIM */
+
+char **
+do_fstrim_multiple (char *const *mountpoints)
+{
+  NOT_SUPPORTED (NULL, "FITRIM ioctl is not available");
+}
+
+#endif /* !FITRIM */
@@ -20,8 +20,16 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <fnmatch.h>
 #include <glob.h>
+#include <sys/stat.h>
 
+#include "guestfs_protocol.h"
 #include "daemon.h"
 #include "actions.h"
 
@@ -69,3 +77,442 @@ do_glob_expand (const char *pattern, int directoryslash)
    */
   return buf.gl_pathv;
 }
+
+struct rm_globs_data {
+  char *const *exclude;         /* NULL if there are no exclusions */
+  int onlyfiles;
+  int norecurse;
+  int count;                    /* number of files removed */
+  int err;                      /* errno and path of the first error */
+  char *err_path;
+};
+
+static int
+is_excluded (char *const *exclude, const char *path)
+{
+  size_t i;
+
+  if (exclude == NULL)
+    return 0;
+
+  for (i = 0; exclude[i] != NULL; ++i) {
+    if (fnmatch (exclude[i], path, 0) == 0)
+      return 1;
+  }
+
+  return 0;
+}
+
+static void
+save_error (struct rm_globs_data *data, const char *path)
+{
+  if (data->err_path == NULL) {
+    data->err = errno;
+    data->err_path = strdup (path);
+  }
+}
+
+/* Remove path recursively.  This is called inside the chroot, so it
+ * cannot reply with an error.  Instead the first error is saved in
+ * 'data', and the other files are still removed.  Since the current
+ * directory is outside the chroot, only absolute paths are used.
+ */
+static void
+rm_path (struct rm_globs_data *data, const char *path)
+{
+  struct stat statbuf;
+
+  if (is_excluded (data->exclude, path))
+    return;
+
+  if (lstat (path, &statbuf) == -1) {
+    if (errno != ENOENT)
+      save_error (data, path);
+    return;
+  }
+
+  if (S_ISDIR (statbuf.st_mode)) {
+    DIR *dir;
+    struct dirent *d;
+    const char *sep = path[strlen (path) - 1] == '/' ? "" : "/";
+
+    if (data->norecurse)
+      return;
+
+    dir = opendir (path);
+    if (dir == NULL) {
+      save_error (data, path);
+      return;
+    }
+
+    for (;;) {
+      CLEANUP_FREE char *child = NULL;
+
+      errno = 0;
+      d = readdir (dir);
+      if (d == NULL) {
+        if (errno != 0)
+          save_error (data, path);
+        break;
+      }
+      if (STREQ (d->d_name, ".") || STREQ (d->d_name, ".."))
+        continue;
+
+      if (asprintf (&child, "%s%s%s", path, sep, d->d_name) == -1) {
+        save_error (data, path);
+        break;
+      }
+      rm_path (data, child);
+    }
+    closedir (dir);
+
+    if (data->onlyfiles)
+      return;
+
+    if (rmdir (path) == -1) {
+      /* ENOTEMPTY: the directory still contains excluded files, or
+       * ones which could not be removed.
+       */
+      if (errno != ENOTEMPTY && errno != EEXIST && errno != ENOENT)
+        save_error (data, path);
+      return;
+    }
+    data->count++;
+    return;
+  }
+
+  if (data->onlyfiles && !S_ISREG (statbuf.st_mode))
+    return;
+
+  if (unlink (path) == -1) {
+    if (errno != ENOENT)
+      save_error (data, path);
+    return;
+  }
+  data->count++;
+}
+
+/* Takes optional arguments, consult optargs_bitmask. */
+int
+do_rm_globs (char *const *patterns, char *const *exclude,
+             int onlyfiles, int norecurse)
+{
+  struct rm_globs_data data = { .exclude = NULL };
+  size_t i, j;
+  int r;
+
+  if (optargs_bitmask & GUESTFS_RM_GLOBS_EXCLUDE_BITMASK)
+    data.exclude = exclude;
+  if (optargs_bitmask & GUESTFS_RM_GLOBS_ONLYFILES_BITMASK)
+    data.onlyfiles = onlyfiles;
+  if (optargs_bitmask & GUESTFS_RM_GLOBS_NORECURSE_BITMASK)
+    data.norecurse = norecurse;
+
+  for (i = 0; patterns[i] != NULL; ++i) {
+    if (patterns[i][0] != '/') {
+      reply_with_error ("%s: pattern must be an absolute path", patterns[i]);
+      return -1;
+    }
+  }
+
+  for (i = 0; patterns[i] != NULL; ++i) {
+    glob_t buf = { .gl_pathc = 0, .gl_pathv = NULL, .gl_offs = 0 };
+
+    CHROOT_IN;
+    r = glob (patterns[i], GLOB_BRACE, NULL, &buf);
+    if (r == 0) {
+      for (j = 0; j < buf.gl_pathc; ++j)
+        rm_path (&data, buf.gl_pathv[j]);
+    }
+    CHROOT_OUT;
+    globfree (&buf);
+
+    if (r != 0 && r != GLOB_NOMATCH) {
+      reply_with_error ("glob failed: %s", patterns[i]);
+      free (data.err_path);
+      return -1;
+    }
+  }
+
+  if (data.err_path != NULL) {
+    errno = data.err;
+    reply_with_perror ("%s", data.err_path);
+    free (data.err_path);
+    return -1;
+  }
+
+  return data.count;
+}
+
+char **
+do_globs_matching (char *const *patterns)
+{
+  CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (ret);
+  size_t i;
+  int r;
+
+  for (i = 0; patterns[i] != NULL; ++i) {
+    glob_t buf = { .gl_pathc = 0, .gl_pathv = NULL, .gl_offs = 0 };
+
+    if (patterns[i][0] != '/') {
+      reply_with_error ("%s: pattern must be an absolute path", patterns[i]);
+      return NULL;
+    }
+
+    CHROOT_IN;
+    r = glob (patterns[i], GLOB_BRACE|GLOB_NOSORT, NULL, &buf);
+    CHROOT_OUT;
+    globfree (&buf);
+
+    if (r == 0) {
+      if (add_string (&ret, patterns[i]) == -1)
+        return NULL;
+    }
+    else if (r != GLOB_NOMATCH) {
+      reply_with_error ("glob failed: %s", patterns[i]);
+      return NULL;
+    }
+  }
+
+  if (end_stringsbuf (&ret) == -1)
+    return NULL;
+
+  return take_stringsbuf (&ret);
+}
+
+/* Expand the absolute wildcards 'patterns'.  Wildcards which match
+ * nothing are returned unchanged (GLOB_NOCHECK), so that the caller
+ * reports an error for them, or creates them in the case of touch.
+ */
+static char **
+expand_globs (char *const *patterns)
+{
+  CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (ret);
+  size_t i, j;
+  int r;
+
+  for (i = 0; patterns[i] != NULL; ++i) {
+    glob_t buf = { .gl_pathc = 0, .gl_pathv = NULL, .gl_offs = 0 };
+
+    if (patterns[i][0] != '/') {
+      reply_with_error ("%s: pattern must be an absolute path", patterns[i]);
+      return NULL;
+    }
+
+    CHROOT_IN;
+    r = glob (patterns[i], GLOB_BRACE|GLOB_NOCHECK, NULL, &buf);
+    CHROOT_OUT;
+
+    if (r != 0) {
+      globfree (&buf);
+      reply_with_error ("glob failed: %s", patterns[i]);
+      return NULL;
+    }
+
+    for (j = 0; j < buf.gl_pathc; ++j) {
+      if (add_string (&ret, buf.gl_pathv[j]) == -1) {
+        globfree (&buf);
+        return NULL;
+      }
+    }
+    globfree (&buf);
+  }
+
+  if (end_stringsbuf (&ret) == -1)
+    return NULL;
+
+  return take_stringsbuf (&ret);
+}
+
+/* Call 'fn' on each path matching 'patterns', inside the chroot.
+ * 'fn' returns -1 and sets errno on error.  As in rm_globs the
+ * remaining paths are still processed, and the first error is
+ * returned at the end.
+ */
+static int
+apply_globs (char *const *patterns,
+             int (*fn) (const char *path, void *opaque), void *opaque)
+{
+  CLEANUP_FREE_STRING_LIST char **paths = NULL;
+  const char *err_path = NULL;
+  int err = 0, count = 0;
+  size_t i;
+
+  paths = expand_globs (patterns);
+  if (paths == NULL)
+    return -1;
+
+  CHROOT_IN;
+  for (i = 0; paths[i] != NULL; ++i) {
+    if (fn (paths[i], opaque) == -1) {
+      if (err_path == NULL) {
+        err = errno;
+        err_path = paths[i];
+      }
+    }
+    else
+      count++;
+  }
+  CHROOT_OUT;
+
+  if (err_path != NULL) {
+    errno = err;
+    reply_with_perror ("%s", err_path);
+    return -1;
+  }
+
+  return count;
+}
+
+static int
+chmod_path (const char *path, void *modep)
+{
+  return chmod (path, *(int *) modep);
+}
+
+int
+do_chmod_globs (int mode, char *const *patterns)
+{
+  if (mode < 0) {
+    reply_with_error ("mode is negative");
+    return -1;
+  }
+
+  return apply_globs (patterns, chmod_path, &mode);
+}
+
+struct owner {
+  int owner, group;
+};
+
+static int
+chown_path (const char *path, void *ownerp)
+{
+  const struct owner *o = ownerp;
+
+  return chown (path, o->owner, o->group);
+}
+
+int
+do_chown_globs (int owner, int group, char *const *patterns)
+{
+  struct owner o = { .owner = owner, .group = group };
+
+  return apply_globs (patterns, chown_path, &o);
+}
+
+/* See do_touch in file.c. */
+static int
+touch_path (const char *path, void *unused)
+{
+  struct stat statbuf;
+  int fd;
+
+  if (lstat (path, &statbuf) == -1) {
+    if (errno != ENOENT)
+      return -1;
+  }
+  else if (!S_ISREG (statbuf.st_mode)) {
+    errno = EINVAL;             /* touch is only for regular files */
+    return -1;
+  }
+
+  fd = open (path, O_WRONLY|O_CREAT|O_NOCTTY|O_CLOEXEC, 0666);
+  if (fd == -1)
+    return -1;
+  if (futimens (fd, NULL) == -1) {
+    const int saved_errno = errno;
+    close (fd);
+    errno = saved_errno;
+    return -1;
+  }
+  return close (fd);
+}
+
+int
+do_touch_globs (char *const *patterns)
+{
+  return apply_globs (patterns, touch_path, NULL);
+}
+
+static int
+open_for_cat (const char *path)
+{
+  struct stat statbuf;
+  int fd;
+
+  CHROOT_IN;
+  fd = open (path, O_RDONLY|O_CLOEXEC);
+  CHROOT_OUT;
+  if (fd == -1)
+    return -1;
+
+  if (fstat (fd, &statbuf) == -1) {
+    const int saved_errno = errno;
+    close (fd);
+    errno = saved_errno;
+    return -1;
+  }
+  /* Prevent RHBZ#908321, see check_not_directory in upload.c. */
+  if (S_ISDIR (statbuf.st_mode)) {
+    close (fd);
+    errno = EISDIR;
+    return -1;
+  }
+
+  return fd;
+}
+
+/* Has one FileOut parameter. */
+int
+do_cat_globs (char *const *patterns)
+{
+  CLEANUP_FREE_STRING_LIST char **paths = NULL;
+  size_t i;
+  ssize_t r;
+  int fd;
+
+  paths = expand_globs (patterns);
+  if (paths == NULL)
+    return -1;
+
+  /* Once the reply has been sent only the transfer can be cancelled,
+   * so check that all the files can be read first.
+   */
+  for (i = 0; paths[i] != NULL; ++i) {
+    fd = open_for_cat (paths[i]);
+    if (fd == -1) {
+      reply_with_perror ("%s", paths[i]);
+      return -1;
+    }
+    close (fd);
+  }
+
+  reply (NULL, NULL);
+
+  for (i = 0; paths[i] != NULL; ++i) {
+    fd = open_for_cat (paths[i]);
+    if (fd == -1) {
+      fprintf (stderr, "open: %s: %m\n", paths[i]);
+      send_file_end (1);        /* Cancel. */
+      return -1;
+    }
+
+    while ((r = send_file_from_fd (fd, GUESTFS_MAX_CHUNK_SIZE)) > 0)
+      ;
+    close (fd);
+
+    if (r == -2)                /* Cancelled by the library. */
+      return -1;
+    if (r == -1) {
+      fprintf (stderr, "read: %s: %m\n", paths[i]);
+      send_file_end (1);        /* Cancel. */
+      return -1;
+    }
+  }
+
+  if (send_file_end (0))        /* Normal end of file. */
+    return -1;
+
+  return 0;
+}
@@ -23,6 +23,10 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <fts.h>
+#include <regex.h>
+#include <pthread.h>
 
 #include "guestfs_protocol.h"
 #include "daemon.h"
@@ -169,3 +173,467 @@ do_zfgrepi (const char *regex, const char *path)
 {
   return grep (regex, path, 0, 1, 1, 1);
 }
+
+/* grep_out searches all the regular files below a directory, using a
+ * thread for each vCPU.  The main thread walks the tree and queues
+ * the files, and sends the matches of each file in the order the
+ * files were found.
+ */
+
+/* Files queued or being searched at once, per thread. */
+#define GREP_JOBS_PER_THREAD 16
+
+struct grep_job {
+  int fd;
+  char *name;                   /* name to print */
+  int done;                     /* set when 'out' or 'err' is set */
+  int err;                      /* errno, if reading the file failed */
+  char *out;                    /* the matching lines, "name:line\n" */
+  size_t out_len, out_alloc;
+};
+
+/* The jobs are a ring buffer, as in checksum.c.  The main thread adds
+ * jobs at 'head + nr_jobs', the threads take them at 'next_job', and
+ * the main thread sends them in order from 'head'.
+ */
+struct grep_pool {
+  const char *regex;
+  int extended, fixed, insensitive;
+  pthread_t *threads;
+  size_t nr_threads;
+  struct grep_job *jobs;
+  size_t max_jobs, head, nr_jobs, next_job;
+  int quit;
+  pthread_mutex_t lock;
+  pthread_cond_t job_added;     /* signalled when a job is added */
+  pthread_cond_t job_done;      /* signalled when a job is done */
+
+  char *out;                    /* chunk of GUESTFS_MAX_CHUNK_SIZE */
+  size_t out_len;
+};
+
+static int
+add_match (struct grep_job *job, const char *line, size_t len)
+{
+  const size_t name_len = strlen (job->name);
+  const size_t n = name_len + 1 + len + 1;
+
+  if (job->out_len + n > job->out_alloc) {
+    size_t alloc = job->out_alloc ? job->out_alloc * 2 : 4096;
+    char *p;
+
+    while (job->out_len + n > alloc)
+      alloc *= 2;
+    p = realloc (job->out, alloc);
+    if (p == NULL)
+      return -1;
+    job->out = p;
+    job->out_alloc = alloc;
+  }
+
+  memcpy (job->out + job->out_len, job->name, name_len);
+  job->out_len += name_len;
+  job->out[job->out_len++] = ':';
+  memcpy (job->out + job->out_len, line, len);
+  job->out_len += len;
+  job->out[job->out_len++] = '\n';
+  return 0;
+}
+
+/* Search one file.  Files containing a NUL byte are treated as
+ * binary and skipped, as 'grep -I' does.
+ */
+static int
+grep_job (const struct grep_pool *pool, const regex_t *re, struct grep_job *job)
+{
+  FILE *fp;
+  CLEANUP_FREE char *line = NULL;
+  size_t allocsize = 0;
+  ssize_t len;
+  int matched;
+
+  fp = fdopen (job->fd, "r");
+  if (fp == NULL)
+    return -1;
+  job->fd = -1;
+  posix_fadvise (fileno (fp), 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  errno = 0;
+  while ((len = getline (&line, &allocsize, fp)) != -1) {
+    if (len > 0 && line[len-1] == '\n')
+      line[--len] = '\0';
+    if (memchr (line, '\0', len) != NULL) {
+      job->out_len = 0;
+      break;
+    }
+
+    if (pool->fixed)
+      matched =
+        (pool->insensitive ? strcasestr (line, pool->regex)
+         : strstr (line, pool->regex)) != NULL;
+    else
+      matched = regexec (re, line, 0, NULL, 0) == 0;
+
+    if (matched && add_match (job, line, len) == -1) {
+      fclose (fp);
+      return -1;
+    }
+  }
+  if (ferror (fp)) {
+    fclose (fp);
+    return -1;
+  }
+
+  fclose (fp);
+  return 0;
+}
+
+static void *
+grep_thread (void *vp)
+{
+  struct grep_pool *pool = vp;
+  regex_t re;
+  int err = 0;
+
+  /* regexec is thread-safe, but compiling the regex for each thread
+   * avoids any contention on it.  The regex was checked before the
+   * threads were started.
+   */
+  if (!pool->fixed &&
+      regcomp (&re, pool->regex,
+               REG_NOSUB |
+               (pool->extended ? REG_EXTENDED : 0) |
+               (pool->insensitive ? REG_ICASE : 0)) != 0)
+    err = ENOMEM;
+
+  for (;;) {
+    struct grep_job *job;
+
+    pthread_mutex_lock (&pool->lock);
+    while (!pool->quit && pool->next_job == pool->head + pool->nr_jobs)
+      pthread_cond_wait (&pool->job_added, &pool->lock);
+    if (pool->next_job == pool->head + pool->nr_jobs) {
+      pthread_mutex_unlock (&pool->lock);
+      break;
+    }
+    job = &pool->jobs[pool->next_job++ % pool->max_jobs];
+    pthread_mutex_unlock (&pool->lock);
+
+    if (err != 0)
+      job->err = err;
+    else if (grep_job (pool, &re, job) == -1)
+      job->err = errno ? errno : ENOMEM;
+    if (job->fd >= 0) {
+      close (job->fd);
+      job->fd = -1;
+    }
+
+    pthread_mutex_lock (&pool->lock);
+    job->done = 1;
+    pthread_cond_broadcast (&pool->job_done);
+    pthread_mutex_unlock (&pool->lock);
+  }
+
+  if (!pool->fixed && err == 0)
+    regfree (&re);
+  return NULL;
+}
+
+/* Start the threads.  This has to be called before reply (NULL, NULL)
+ * because it can fail.
+ */
+static struct grep_pool *
+start_grep_pool (const char *regex, int extended, int fixed, int insensitive)
+{
+  struct grep_pool *pool;
+  long nr_cpus;
+  size_t i;
+  int err;
+
+  pool = calloc (1, sizeof *pool);
+  if (pool == NULL) {
+    reply_with_perror ("calloc");
+    return NULL;
+  }
+  pool->regex = regex;
+  pool->extended = extended;
+  pool->fixed = fixed;
+  pool->insensitive = insensitive;
+
+  nr_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  pool->nr_threads = nr_cpus > 0 ? nr_cpus : 1;
+  pool->max_jobs = pool->nr_threads * GREP_JOBS_PER_THREAD;
+
+  pool->threads = calloc (pool->nr_threads, sizeof (pthread_t));
+  pool->jobs = calloc (pool->max_jobs, sizeof (struct grep_job));
+  pool->out = malloc (GUESTFS_MAX_CHUNK_SIZE);
+  if (pool->threads == NULL || pool->jobs == NULL || pool->out == NULL) {
+    reply_with_perror ("malloc");
+    goto error;
+  }
+
+  pthread_mutex_init (&pool->lock, NULL);
+  pthread_cond_init (&pool->job_added, NULL);
+  pthread_cond_init (&pool->job_done, NULL);
+
+  for (i = 0; i < pool->nr_threads; ++i) {
+    err = pthread_create (&pool->threads[i], NULL, grep_thread, pool);
+    if (err != 0) {
+      if (i == 0) {
+        reply_with_error_errno (err, "pthread_create");
+        goto error;
+      }
+      /* Carry on with fewer threads. */
+      pool->nr_threads = i;
+      break;
+    }
+  }
+
+  if (verbose)
+    fprintf (stderr, "grep_out: started %zu threads\n", pool->nr_threads);
+
+  return pool;
+
+ error:
+  free (pool->threads);
+  free (pool->jobs);
+  free (pool->out);
+  free (pool);
+  return NULL;
+}
+
+/* Wait for the oldest job to finish, send its matches (unless 'send'
+ * is false) and remove it.  Returns -1 if the transfer was cancelled.
+ */
+static int
+retire_grep_job (struct grep_pool *pool, int send)
+{
+  struct grep_job *job = &pool->jobs[pool->head % pool->max_jobs];
+  const char *p;
+  size_t len;
+  int r = 0;
+
+  pthread_mutex_lock (&pool->lock);
+  while (!job->done)
+    pthread_cond_wait (&pool->job_done, &pool->lock);
+  pthread_mutex_unlock (&pool->lock);
+
+  if (send && job->err != 0)
+    /* grep(1) reports unreadable files but carries on. */
+    fprintf (stderr, "grep_out: %s: %s\n", job->name, strerror (job->err));
+  else if (send) {
+    p = job->out;
+    len = job->out_len;
+    while (r == 0 && len > 0) {
+      size_t n = GUESTFS_MAX_CHUNK_SIZE - pool->out_len;
+
+      if (n > len)
+        n = len;
+      memcpy (pool->out + pool->out_len, p, n);
+      pool->out_len += n;
+      p += n;
+      len -= n;
+
+      if (pool->out_len == GUESTFS_MAX_CHUNK_SIZE) {
+        if (send_file_write (pool->out, pool->out_len) < 0)
+          r = -1;
+        pool->out_len = 0;
+      }
+    }
+  }
+  free (job->name);
+  free (job->out);
+
+  pthread_mutex_lock (&pool->lock);
+  pool->head++;
+  pool->nr_jobs--;
+  pthread_mutex_unlock (&pool->lock);
+
+  return r;
+}
+
+/* Queue a file to be searched.  This takes ownership of 'fd' and
+ * 'name'.
+ */
+static int
+add_grep_job (struct grep_pool *pool, int fd, char *name)
+{
+  struct grep_job *job;
+
+  if (pool->nr_jobs == pool->max_jobs &&
+      retire_grep_job (pool, 1) == -1) {
+    close (fd);
+    free (name);
+    return -1;
+  }
+
+  job = &pool->jobs[(pool->head + pool->nr_jobs) % pool->max_jobs];
+  memset (job, 0, sizeof *job);
+  job->fd = fd;
+  job->name = name;
+
+  pthread_mutex_lock (&pool->lock);
+  pool->nr_jobs++;
+  pthread_cond_signal (&pool->job_added);
+  pthread_mutex_unlock (&pool->lock);
+  return 0;
+}
+
+/* Send the remaining jobs (unless 'r' is -1 already), stop the
+ * threads and send the end of the file.
+ */
+static int
+finish_grep_pool (struct grep_pool *pool, int r)
+{
+  size_t i;
+
+  while (pool->nr_jobs > 0) {
+    if (retire_grep_job (pool, r == 0) == -1)
+      r = -1;
+  }
+
+  pthread_mutex_lock (&pool->lock);
+  pool->quit = 1;
+  pthread_cond_broadcast (&pool->job_added);
+  pthread_mutex_unlock (&pool->lock);
+  for (i = 0; i < pool->nr_threads; ++i)
+    pthread_join (pool->threads[i], NULL);
+
+  if (r == 0 && pool->out_len > 0 &&
+      send_file_write (pool->out, pool->out_len) < 0)
+    r = -1;
+
+  if (r == 0) {
+    if (send_file_end (0))      /* Normal end of file. */
+      r = -1;
+  }
+  else
+    send_file_end (1);          /* Cancel. */
+
+  pthread_mutex_destroy (&pool->lock);
+  pthread_cond_destroy (&pool->job_added);
+  pthread_cond_destroy (&pool->job_done);
+  free (pool->threads);
+  free (pool->jobs);
+  free (pool->out);
+  free (pool);
+
+  return r;
+}
+
+/* Takes optional arguments, consult optargs_bitmask.
+ * Has one FileOut parameter.
+ */
+int
+do_grep_out (const char *regex, const char *path,
+             int extended, int fixed, int insensitive)
+{
+  struct grep_pool *pool;
+  CLEANUP_FREE char *sysrootpath = NULL;
+  char *paths[2];
+  FTS *fts;
+  FTSENT *ent;
+  size_t prefix_len;
+  regex_t re;
+  int err, r = 0;
+
+  if (!(optargs_bitmask & GUESTFS_GREP_OUT_EXTENDED_BITMASK))
+    extended = 0;
+  if (!(optargs_bitmask & GUESTFS_GREP_OUT_FIXED_BITMASK))
+    fixed = 0;
+  if (!(optargs_bitmask & GUESTFS_GREP_OUT_INSENSITIVE_BITMASK))
+    insensitive = 0;
+
+  if (extended && fixed) {
+    reply_with_error ("can't use 'extended' and 'fixed' flags at the same time");
+    return -1;
+  }
+
+  /* Check the regex here, so the error can be sent in the reply. */
+  if (!fixed) {
+    err = regcomp (&re, regex,
+                   REG_NOSUB |
+                   (extended ? REG_EXTENDED : 0) |
+                   (insensitive ? REG_ICASE : 0));
+    if (err != 0) {
+      char msg[256];
+
+      regerror (err, &re, msg, sizeof msg);
+      reply_with_error ("%s: %s", regex, msg);
+      return -1;
+    }
+    regfree (&re);
+  }
+
+  /* Resolve symlinks in the path within the sysroot (RHBZ#579608). */
+  sysrootpath = sysroot_realpath (path);
+  if (!sysrootpath) {
+    reply_with_perror ("%s", path);
+    return -1;
+  }
+
+  /* The names printed are the paths in the guest. */
+  prefix_len = sysroot_len;
+
+  paths[0] = sysrootpath;
+  paths[1] = NULL;
+  fts = fts_open (paths, FTS_PHYSICAL | FTS_COMFOLLOW | FTS_NOCHDIR, NULL);
+  if (fts == NULL) {
+    reply_with_perror ("%s", path);
+    return -1;
+  }
+
+  pool = start_grep_pool (regex, extended, fixed, insensitive);
+  if (pool == NULL) {
+    fts_close (fts);
+    return -1;
+  }
+
+  /* Now we must send the reply message, before the file contents.  After
+   * this there is no opportunity in the protocol to send any error
+   * message back.  Instead we can only cancel the transfer.
+   */
+  reply (NULL, NULL);
+
+  errno = 0;
+  while (r == 0 && (ent = fts_read (fts)) != NULL) {
+    char *name;
+    int fd;
+
+    switch (ent->fts_info) {
+    case FTS_F:
+      name = strdup (ent->fts_path + prefix_len);
+      if (name == NULL) {
+        perror ("strdup");
+        r = -1;
+        break;
+      }
+      fd = open (ent->fts_accpath, O_RDONLY|O_NOFOLLOW|O_NOCTTY|O_CLOEXEC);
+      if (fd == -1) {
+        fprintf (stderr, "grep_out: %s: %m\n", name);
+        free (name);
+        break;
+      }
+      r = add_grep_job (pool, fd, name);
+      break;
+
+    case FTS_DNR:
+    case FTS_ERR:
+    case FTS_NS:
+      fprintf (stderr, "grep_out: %s: %s\n",
+               ent->fts_path + prefix_len, strerror (ent->fts_errno));
+      break;
+
+    default:
+      break;
+    }
+    errno = 0;
+  }
+  if (r == 0 && errno != 0 && ent == NULL) {
+    fprintf (stderr, "fts_read: %s: %m\n", path);
+    r = -1;
+  }
+  fts_close (fts);
+
+  return finish_grep_pool (pool, r);
+}
@@ -38,6 +38,8 @@
 #include <sys/param.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <netdb.h>
@@ -49,6 +51,12 @@
 #include <error.h>
 #include <assert.h>
 #include <termios.h>
+#include <poll.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <linux/netlink.h>
+#include <sched.h>
+#include <sys/mount.h>
 
 #ifdef HAVE_PRINTF_H
 # include <printf.h>
@@ -85,6 +93,7 @@ int verbose = 0;
 int enable_network = 0;
 
 static void makeraw (const char *channel, int fd);
+static int accept_sessions (int lsock);
 static int print_shell_quote (FILE *stream, const struct printf_info *info, const void *const *args);
 static int print_sysroot_shell_quote (FILE *stream, const struct printf_info *info, const void *const *args);
 #ifdef HAVE_REGISTER_PRINTF_SPECIFIER
@@ -132,25 +141,28 @@ static void
 usage (void)
 {
   fprintf (stderr,
-	   "guestfsd [-r] [-v|--verbose]\n");
+	   "guestfsd [-r] [-l|--listen [-s|--sessions]] [-v|--verbose] [-w|--workers N]\n");
 }
 
 int
 main (int argc, char *argv[])
 {
-  static const char options[] = "c:lnrtv?";
+  static const char options[] = "c:lnrstvw:?";
   static const struct option long_options[] = {
     { "help", 0, 0, '?' },
     { "channel", 1, 0, 'c' },
     { "listen", 0, 0, 'l' },
     { "network", 0, 0, 'n' },
+    { "sessions", 0, 0, 's' },
     { "test", 0, 0, 't' },
     { "verbose", 0, 0, 'v' },
+    { "workers", 1, 0, 'w' },
     { 0, 0, 0, 0 }
   };
   int c;
   const char *channel = NULL;
   int listen_mode = 0;
+  int sessions = 0;
 
   ignore_value (chdir ("/"));
 
@@ -210,6 +222,10 @@ main (int argc, char *argv[])
       autosync_umount = 0;
       break;
 
+    case 's':
+      sessions = 1;
+      break;
+
       /* Undocumented --test option used for testing guestfsd. */
     case 't':
       test_mode = 1;
@@ -219,6 +235,11 @@ main (int argc, char *argv[])
       verbose = 1;
       break;
 
+    case 'w':
+      if (sscanf (optarg, "%zu", &nr_workers) != 1)
+        error (EXIT_FAILURE, 0, "cannot parse --workers %s", optarg);
+      break;
+
     case '?':
       usage ();
       exit (EXIT_SUCCESS);
@@ -234,6 +255,9 @@ main (int argc, char *argv[])
     exit (EXIT_FAILURE);
   }
 
+  if (sessions && !listen_mode)
+    error (EXIT_FAILURE, 0, "--sessions can only be used with --listen");
+
 #ifndef WIN32
   /* Make sure SIGPIPE doesn't kill us. */
   struct sigaction sa;
@@ -323,12 +347,17 @@ main (int argc, char *argv[])
     if (bind (sock, (struct sockaddr *) &addr, sizeof addr) == -1)
       error (EXIT_FAILURE, errno, "bind: %s", channel);
 
-    if (listen (sock, 4) == -1)
+    if (listen (sock, sessions ? SOMAXCONN : 4) == -1)
       error (EXIT_FAILURE, errno, "listen");
 
-    sock = accept4 (sock, NULL, NULL, SOCK_CLOEXEC);
-    if (sock == -1)
-      error (EXIT_FAILURE, errno, "accept");
+    if (sessions)
+      /* Only returns in the session process. */
+      sock = accept_sessions (sock);
+    else {
+      sock = accept4 (sock, NULL, NULL, SOCK_CLOEXEC);
+      if (sock == -1)
+        error (EXIT_FAILURE, errno, "accept");
+    }
   }
 
   /* If it's a serial-port like device then it probably has echoing
@@ -369,6 +398,81 @@ main (int argc, char *argv[])
 }
 
 /* Try to make the socket raw, but don't fail if it's not possible. */
+/* Reap session processes which have exited. */
+static void
+sigchld_handler (int sig)
+{
+  int saved_errno = errno;
+
+  while (waitpid (-1, NULL, WNOHANG) > 0)
+    ;
+
+  errno = saved_errno;
+}
+
+/**
+ * Accept connections on the listening socket C<lsock> for ever,
+ * forking a session process for each one (guestfsd --sessions).
+ *
+ * The function only returns in the session process, and returns the
+ * connected socket.  Each session has all of the daemon state (open
+ * augeas and hivex handles, inotify and so on) to itself because it
+ * is a separate process, and it runs in its own mount namespace, so
+ * filesystems it mounts on the sysroot are not seen by other sessions
+ * and disappear when it exits.  Devices are shared by all sessions.
+ */
+static int
+accept_sessions (int lsock)
+{
+  struct sigaction sa;
+  int sock;
+  pid_t pid;
+
+  memset (&sa, 0, sizeof sa);
+  sa.sa_handler = sigchld_handler;
+  sa.sa_flags = SA_RESTART;
+  if (sigaction (SIGCHLD, &sa, NULL) == -1)
+    error (EXIT_FAILURE, errno, "sigaction SIGCHLD");
+
+  for (;;) {
+    sock = accept4 (lsock, NULL, NULL, SOCK_CLOEXEC);
+    if (sock == -1) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      error (EXIT_FAILURE, errno, "accept");
+    }
+
+    pid = fork ();
+    if (pid == -1) {
+      perror ("fork");
+      close (sock);
+      continue;
+    }
+    if (pid == 0)
+      break;
+
+    if (verbose)
+      fprintf (stderr, "guestfsd: started session %d\n", (int) pid);
+    close (sock);
+  }
+
+  /* In the session process.  The daemon runs commands and waits for
+   * them, so it must not reap children itself.
+   */
+  close (lsock);
+  sa.sa_handler = SIG_DFL;
+  sa.sa_flags = 0;
+  sigaction (SIGCHLD, &sa, NULL);
+
+  if (unshare (CLONE_NEWNS) == -1)
+    error (EXIT_FAILURE, errno, "unshare");
+  /* Stop mounts propagating back to the parent namespace. */
+  if (mount (NULL, "/", NULL, MS_REC|MS_PRIVATE, NULL) == -1)
+    error (EXIT_FAILURE, errno, "mount: make / private");
+
+  return sock;
+}
+
 static void
 makeraw (const char *channel, int fd)
 {
@@ -499,20 +603,84 @@ xread (int sock, void *v_buf, size_t len)
   return 0;
 }
 
+/* Skip over the first 'n' bytes of the iovec array, which have been
+ * read or written.  Returns the number of iovecs left.
+ */
+static int
+advance_iov (struct iovec **iov, int iovcnt, size_t n)
+{
+  while (iovcnt > 0 && n >= (*iov)->iov_len) {
+    n -= (*iov)->iov_len;
+    (*iov)++;
+    iovcnt--;
+  }
+  if (iovcnt > 0) {
+    (*iov)->iov_base = (char *) (*iov)->iov_base + n;
+    (*iov)->iov_len -= n;
+  }
+  return iovcnt;
+}
+
+/* Like xwrite and xread, for a scatter/gather array.  Note that the
+ * array is modified.
+ */
+int
+xwritev (int sock, struct iovec *iov, int iovcnt)
+{
+  ssize_t r;
+
+  while (iovcnt > 0) {
+    r = writev (sock, iov, iovcnt);
+    if (r == -1) {
+      perror ("writev");
+      return -1;
+    }
+    iovcnt = advance_iov (&iov, iovcnt, r);
+  }
+
+  return 0;
+}
+
+int
+xreadv (int sock, struct iovec *iov, int iovcnt)
+{
+  ssize_t r;
+
+  while (iovcnt > 0) {
+    r = readv (sock, iov, iovcnt);
+    if (r == -1) {
+      perror ("readv");
+      return -1;
+    }
+    if (r == 0) {
+      fprintf (stderr, "readv: unexpected end of file on fd %d\n", sock);
+      return -1;
+    }
+    iovcnt = advance_iov (&iov, iovcnt, r);
+  }
+
+  return 0;
+}
+
 int
 add_string_nodup (struct stringsbuf *sb, char *str)
 {
   char **new_argv;
+  size_t new_alloc;
 
   if (sb->size >= sb->alloc) {
-    sb->alloc += 64;
-    new_argv = realloc (sb->argv, sb->alloc * sizeof (char *));
+    /* Grow geometrically, so that building a list of n strings does
+     * O(log n) reallocs instead of O(n).
+     */
+    new_alloc = sb->alloc > 0 ? sb->alloc * 2 : 64;
+    new_argv = realloc (sb->argv, new_alloc * sizeof (char *));
     if (new_argv == NULL) {
       reply_with_perror ("realloc");
       free (str);
       return -1;
     }
     sb->argv = new_argv;
+    sb->alloc = new_alloc;
   }
 
   sb->argv[sb->size] = str;
@@ -805,6 +973,7 @@ split_lines_sb (char *str)
   DECLARE_STRINGSBUF (lines);
   DECLARE_STRINGSBUF (null);
   char *p, *pend;
+  size_t n;
 
   if (STREQ (str, "")) {
     /* No need to check the return value, as the stringsbuf will be
@@ -814,6 +983,19 @@ split_lines_sb (char *str)
     return lines;
   }
 
+  /* Allocate the list once, with room for every line and the final
+   * NULL, instead of growing it as the lines are added.
+   */
+  n = 2;
+  for (p = str; (p = strchr (p, '\n')) != NULL; ++p)
+    n++;
+  lines.argv = malloc (n * sizeof (char *));
+  if (lines.argv == NULL) {
+    reply_with_perror ("malloc");
+    return null;
+  }
+  lines.alloc = n;
+
   p = str;
   while (p) {
     /* Empty last line? */
@@ -1203,17 +1385,182 @@ random_name (char *template)
   return 0;
 }
 
-/**
- * LVM and other commands aren't synchronous, especially when udev is
- * involved.  eg. You can create or remove some device, but the
- * C</dev> device node won't appear until some time later.  This means
- * that you get an error if you run one command followed by another.
- *
- * Use C<udevadm settle> after certain commands, but don't be too
- * fussed if it fails.
+/* udevd sends every event it has finished processing to the netlink
+ * multicast group 2 ("udev"), prefixed with this header.  See
+ * libudev-monitor.c in systemd.
  */
-void
-udev_settle (void)
+#define UDEV_MONITOR_UDEV 2
+#define UDEV_MONITOR_MAGIC 0xfeedcafe
+
+struct udev_monitor_header {
+  char prefix[8];               /* "libudev" */
+  uint32_t magic;               /* UDEV_MONITOR_MAGIC, network order */
+  uint32_t header_size;
+  uint32_t properties_off;
+  uint32_t properties_len;
+  uint32_t filter_subsystem_hash;
+  uint32_t filter_devtype_hash;
+  uint32_t filter_tag_bloom_hi;
+  uint32_t filter_tag_bloom_lo;
+};
+
+/* How long to wait for the events in-process before giving up and
+ * running 'udevadm settle' instead.
+ */
+#define SETTLE_TIMEOUT_MS 10000
+
+/* Only one thread at a time settles (luks_open runs in the worker
+ * threads).  The other fields are protected by this lock too.
+ */
+static pthread_mutex_t settle_lock = PTHREAD_MUTEX_INITIALIZER;
+static int udev_monitor_fd = -1;
+/* Every uevent up to this sequence number has been processed. */
+static uint64_t settled_seqnum;
+/* The highest sequence number udevd has told us about. */
+static uint64_t processed_seqnum;
+
+/* Read the sequence number of the last uevent sent by the kernel, or
+ * return 0 if it cannot be read.
+ */
+static uint64_t
+read_kernel_seqnum (void)
+{
+  FILE *fp;
+  uint64_t r;
+
+  fp = fopen ("/sys/kernel/uevent_seqnum", "re");
+  if (fp == NULL)
+    return 0;
+  if (fscanf (fp, "%" SCNu64, &r) != 1)
+    r = 0;
+  fclose (fp);
+  return r;
+}
+
+static void
+open_udev_monitor (void)
+{
+  struct sockaddr_nl addr = { .nl_family = AF_NETLINK,
+                              .nl_groups = UDEV_MONITOR_UDEV };
+  const int bufsize = 1024 * 1024;
+  int fd;
+
+  fd = socket (AF_NETLINK, SOCK_RAW|SOCK_CLOEXEC|SOCK_NONBLOCK,
+               NETLINK_KOBJECT_UEVENT);
+  if (fd == -1) {
+    perror ("socket: NETLINK_KOBJECT_UEVENT");
+    return;
+  }
+  /* Partitioning a disk with many partitions sends a burst of
+   * events, don't lose them.
+   */
+  if (setsockopt (fd, SOL_SOCKET, SO_RCVBUFFORCE,
+                  &bufsize, sizeof bufsize) == -1)
+    ignore_value (setsockopt (fd, SOL_SOCKET, SO_RCVBUF,
+                              &bufsize, sizeof bufsize));
+  if (bind (fd, (struct sockaddr *) &addr, sizeof addr) == -1) {
+    perror ("bind: NETLINK_KOBJECT_UEVENT");
+    close (fd);
+    return;
+  }
+  udev_monitor_fd = fd;
+}
+
+/* Read the pending messages from udevd and update processed_seqnum.
+ * Returns -1 if events may have been lost.
+ */
+static int
+read_udev_monitor (void)
+{
+  char buf[8192];
+  const struct udev_monitor_header *h = (void *) buf;
+  struct sockaddr_nl addr;
+  socklen_t addrlen;
+  ssize_t r;
+  size_t off, end;
+  uint64_t seqnum;
+
+  for (;;) {
+    addrlen = sizeof addr;
+    r = recvfrom (udev_monitor_fd, buf, sizeof buf - 1, 0,
+                  (struct sockaddr *) &addr, &addrlen);
+    if (r == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return 0;
+      if (errno == EINTR)
+        continue;
+      return -1;                /* eg. ENOBUFS */
+    }
+    buf[r] = '\0';
+
+    /* Ignore messages which are not from udevd. */
+    if (addr.nl_pid == 0 ||
+        (size_t) r < sizeof *h || STRNEQ (h->prefix, "libudev") ||
+        ntohl (h->magic) != UDEV_MONITOR_MAGIC)
+      continue;
+    off = h->properties_off;
+    end = off + h->properties_len;
+    if (off >= (size_t) r || end > (size_t) r)
+      continue;
+
+    /* The properties are "KEY=value" strings separated by \0. */
+    while (off < end) {
+      if (STRPREFIX (&buf[off], "SEQNUM=")) {
+        if (sscanf (&buf[off+7], "%" SCNu64, &seqnum) == 1 &&
+            seqnum > processed_seqnum)
+          processed_seqnum = seqnum;
+        break;
+      }
+      off += strlen (&buf[off]) + 1;
+    }
+  }
+}
+
+/* Wait until udevd has processed every event up to 'seqnum'.  udevd
+ * reads the events from the kernel in order, so once it has finished
+ * 'seqnum' it has queued all the earlier ones, and when its queue
+ * file has gone they are finished too.  Returns -1 on timeout or if
+ * events were lost.
+ */
+static int
+wait_for_udev (uint64_t seqnum)
+{
+  struct pollfd pfd = { .fd = udev_monitor_fd, .events = POLLIN };
+  struct timeval start_t, now_t;
+  int64_t elapsed_ms;
+  int timeout_ms;
+
+  gettimeofday (&start_t, NULL);
+
+  for (;;) {
+    if (read_udev_monitor () == -1)
+      return -1;
+
+    timeout_ms = -1;
+    if (processed_seqnum >= seqnum) {
+      if (access ("/run/udev/queue", F_OK) == -1)
+        return 0;
+      /* udevd removes the queue file just after sending the last
+       * event, so look again shortly even if nothing arrives.
+       */
+      timeout_ms = 10;
+    }
+
+    gettimeofday (&now_t, NULL);
+    elapsed_ms = (int64_t) (now_t.tv_sec - start_t.tv_sec) * 1000 +
+      (now_t.tv_usec - start_t.tv_usec) / 1000;
+    if (elapsed_ms >= SETTLE_TIMEOUT_MS)
+      return -1;
+    if (timeout_ms == -1 || timeout_ms > SETTLE_TIMEOUT_MS - elapsed_ms)
+      timeout_ms = SETTLE_TIMEOUT_MS - elapsed_ms;
+
+    if (poll (&pfd, 1, timeout_ms) == -1 && errno != EINTR)
+      return -1;
+  }
+}
+
+static void
+run_udevadm_settle (void)
 {
   char cmd[80];
   int r;
@@ -1229,6 +1576,79 @@ udev_settle (void)
     fprintf (stderr, "warning: udevadm command failed\n");
 }
 
+/**
+ * LVM and other commands aren't synchronous, especially when udev is
+ * involved.  eg. You can create or remove some device, but the
+ * C</dev> device node won't appear until some time later.  This means
+ * that you get an error if you run one command followed by another.
+ *
+ * Call this after certain commands, but don't be too fussed if it
+ * fails.  It waits until udevd has processed the uevents sent by the
+ * kernel so far, which are the events for the devices that the
+ * command changed.  If there have been no uevents since the last
+ * call (eg. when two commands which call this before and after run
+ * back to back), it returns at once.
+ *
+ * Instead of running C<udevadm settle>, which waits for the whole udev
+ * queue in a subprocess, this listens for the events udevd sends when
+ * it has finished with a device.  C<udevadm settle> is still used the
+ * first time, and if events are lost or take too long.
+ */
+void
+udev_settle (void)
+{
+  struct timeval start_t, end_t;
+  uint64_t seqnum;
+
+  pthread_mutex_lock (&settle_lock);
+
+  /* This is called after devices are added, removed or partitioned,
+   * so forget the devices and what blkid found on them.
+   */
+  blkid_cache_invalidate (NULL);
+  devsparts_cache_invalidate ();
+
+  gettimeofday (&start_t, NULL);
+
+  /* udevd is not running in the minimal appliance profile, so there
+   * is nothing to wait for.
+   */
+  if (access ("/run/udev/control", F_OK) == -1)
+    goto out;
+
+  seqnum = read_kernel_seqnum ();
+  if (seqnum > 0 && seqnum == settled_seqnum)
+    goto out;
+
+  if (udev_monitor_fd == -1) {
+    /* We don't know which of the earlier events have been processed,
+     * so the first time wait for all of them.
+     */
+    open_udev_monitor ();
+    run_udevadm_settle ();
+  }
+  else if (seqnum == 0 || wait_for_udev (seqnum) == -1) {
+    if (verbose)
+      fprintf (stderr, "udev_settle: falling back to udevadm settle\n");
+    run_udevadm_settle ();
+  }
+
+  /* Discard the messages for the events just waited for. */
+  if (udev_monitor_fd >= 0)
+    ignore_value (read_udev_monitor ());
+  if (processed_seqnum < seqnum)
+    processed_seqnum = seqnum;
+  settled_seqnum = seqnum;
+
+ out:
+  gettimeofday (&end_t, NULL);
+
+  stats_count_settle ((int64_t) (end_t.tv_sec - start_t.tv_sec) * 1000000 +
+                      (end_t.tv_usec - start_t.tv_usec));
+
+  pthread_mutex_unlock (&settle_lock);
+}
+
 char *
 get_random_uuid (void)
 {
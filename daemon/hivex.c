@@ -22,6 +22,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <errno.h>
+#include <endian.h>
+#include <fnmatch.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -413,6 +416,641 @@ do_hivex_node_set_value (int64_t nodeh,
   return 0;
 }
 
+/* Append every value of 'node' to the hivex_query result list. */
+static int
+query_add_values (guestfs_int_hivex_query_value_list *ret,
+                  hive_node_h node, const char *path)
+{
+  CLEANUP_FREE hive_value_h *values = NULL;
+  guestfs_int_hivex_query_value *v;
+  size_t i, n;
+
+  values = hivex_node_values (h, node);
+  if (values == NULL) {
+    reply_with_perror ("%s", path);
+    return -1;
+  }
+
+  for (n = 0; values[n] != 0; ++n)
+    ;
+  if (n == 0)
+    return 0;
+
+  v = realloc (ret->guestfs_int_hivex_query_value_list_val,
+               (ret->guestfs_int_hivex_query_value_list_len + n) *
+               sizeof (guestfs_int_hivex_query_value));
+  if (v == NULL) {
+    reply_with_perror ("realloc");
+    return -1;
+  }
+  ret->guestfs_int_hivex_query_value_list_val = v;
+
+  for (i = 0; i < n; ++i) {
+    hive_type t;
+    size_t len;
+
+    v = &ret->guestfs_int_hivex_query_value_list_val[ret->guestfs_int_hivex_query_value_list_len];
+    memset (v, 0, sizeof *v);
+    ret->guestfs_int_hivex_query_value_list_len++;
+
+    v->hivex_query_path = strdup (path);
+    if (v->hivex_query_path == NULL) {
+      reply_with_perror ("strdup");
+      return -1;
+    }
+    v->hivex_query_key = hivex_value_key (h, values[i]);
+    if (v->hivex_query_key == NULL) {
+      reply_with_perror ("%s: hivex_value_key", path);
+      return -1;
+    }
+    v->hivex_query_value.hivex_query_value_val =
+      hivex_value_value (h, values[i], &t, &len);
+    if (v->hivex_query_value.hivex_query_value_val == NULL) {
+      reply_with_perror ("%s\\%s: hivex_value_value",
+                         path, v->hivex_query_key);
+      return -1;
+    }
+    v->hivex_query_value.hivex_query_value_len = len;
+    v->hivex_query_type = t;
+  }
+
+  return 0;
+}
+
+/* Match the remaining 'n' path elements against the children of
+ * 'node', recursively.  'path' is the name of 'node' relative to the
+ * root of the hive ("" for the root itself).
+ */
+static int
+query_node (guestfs_int_hivex_query_value_list *ret,
+            hive_node_h node, const char *path, char *const *elems, size_t n)
+{
+  CLEANUP_FREE hive_node_h *children = NULL;
+  size_t i;
+
+  if (n == 0)
+    return query_add_values (ret, node, path);
+
+  /* Fast path for elements which are not globs. */
+  if (strpbrk (elems[0], "*?[") == NULL) {
+    CLEANUP_FREE char *name = NULL, *child_path = NULL;
+    hive_node_h child;
+
+    errno = 0;
+    child = hivex_node_get_child (h, node, elems[0]);
+    if (child == 0) {
+      if (errno == 0)
+        return 0;
+      reply_with_perror ("%s: hivex_node_get_child", path);
+      return -1;
+    }
+    name = hivex_node_name (h, child);
+    if (name == NULL) {
+      reply_with_perror ("%s: hivex_node_name", path);
+      return -1;
+    }
+    if (asprintf (&child_path, "%s%s%s",
+                  path, path[0] ? "\\" : "", name) == -1) {
+      reply_with_perror ("asprintf");
+      return -1;
+    }
+    return query_node (ret, child, child_path, &elems[1], n-1);
+  }
+
+  children = hivex_node_children (h, node);
+  if (children == NULL) {
+    reply_with_perror ("%s: hivex_node_children", path);
+    return -1;
+  }
+
+  for (i = 0; children[i] != 0; ++i) {
+    CLEANUP_FREE char *name = NULL, *child_path = NULL;
+
+    name = hivex_node_name (h, children[i]);
+    if (name == NULL) {
+      reply_with_perror ("%s: hivex_node_name", path);
+      return -1;
+    }
+    /* Registry key names are case insensitive. */
+    if (fnmatch (elems[0], name, FNM_CASEFOLD) != 0)
+      continue;
+
+    if (asprintf (&child_path, "%s%s%s",
+                  path, path[0] ? "\\" : "", name) == -1) {
+      reply_with_perror ("asprintf");
+      return -1;
+    }
+    if (query_node (ret, children[i], child_path, &elems[1], n-1) == -1)
+      return -1;
+  }
+
+  return 0;
+}
+
+guestfs_int_hivex_query_value_list *
+do_hivex_query (char *const *paths)
+{
+  guestfs_int_hivex_query_value_list *ret;
+  hive_node_h root;
+  size_t i;
+
+  NEED_HANDLE (NULL);
+
+  root = hivex_root (h);
+  if (root == 0) {
+    reply_with_perror ("hivex_root");
+    return NULL;
+  }
+
+  ret = calloc (1, sizeof *ret);
+  if (ret == NULL) {
+    reply_with_perror ("calloc");
+    return NULL;
+  }
+
+  for (i = 0; paths[i] != NULL; ++i) {
+    CLEANUP_FREE char *copy = NULL;
+    CLEANUP_FREE char **elems = NULL;
+    char *p, *saveptr;
+    size_t n = 0;
+
+    /* Split the path into elements at backslashes, ignoring empty
+     * elements, so "\\Microsoft\\Windows" and "Microsoft\\Windows" are
+     * the same.
+     */
+    copy = strdup (paths[i]);
+    elems = malloc ((strlen (paths[i]) + 1) * sizeof (char *));
+    if (copy == NULL || elems == NULL) {
+      reply_with_perror ("malloc");
+      goto error;
+    }
+    for (p = strtok_r (copy, "\\", &saveptr); p != NULL;
+         p = strtok_r (NULL, "\\", &saveptr))
+      elems[n++] = p;
+
+    if (query_node (ret, root, "", elems, n) == -1)
+      goto error;
+  }
+
+  return ret;
+
+ error:
+  xdr_free ((xdrproc_t) xdr_guestfs_int_hivex_query_value_list, (char *) ret);
+  free (ret);
+  return NULL;
+}
+
+/* Append every value of 'node' to 'sb' as a pair of strings:
+ * "<prefix>\<key>" and "<type>:<data as hex>".  The data is returned
+ * raw because iconv does not work in the appliance, so UTF-16
+ * conversion has to be done by the library.
+ */
+static int
+add_node_values (struct stringsbuf *sb, hive_h *hh, hive_node_h node,
+                 const char *prefix)
+{
+  CLEANUP_FREE hive_value_h *values = NULL;
+  size_t i, j, k;
+
+  values = hivex_node_values (hh, node);
+  if (values == NULL) {
+    reply_with_perror ("hivex_node_values: %s", prefix);
+    return -1;
+  }
+
+  for (i = 0; values[i] != 0; ++i) {
+    CLEANUP_FREE char *key = NULL;
+    CLEANUP_FREE unsigned char *data = NULL;
+    hive_type t;
+    size_t len;
+    char *str;
+
+    key = hivex_value_key (hh, values[i]);
+    if (key == NULL) {
+      reply_with_perror ("hivex_value_key: %s", prefix);
+      return -1;
+    }
+    data = (unsigned char *) hivex_value_value (hh, values[i], &t, &len);
+    if (data == NULL) {
+      reply_with_perror ("hivex_value_value: %s\\%s", prefix, key);
+      return -1;
+    }
+
+    if (add_sprintf (sb, "%s\\%s", prefix, key) == -1)
+      return -1;
+
+    /* Enough for a 10 digit type, ':', two hex digits per byte, '\0'. */
+    str = malloc (12 + 2*len);
+    if (str == NULL) {
+      reply_with_perror ("malloc");
+      return -1;
+    }
+    j = sprintf (str, "%d:", (int) t);
+    for (k = 0; k < len; ++k)
+      j += sprintf (&str[j], "%02x", data[k]);
+    if (add_string_nodup (sb, str) == -1)
+      return -1;
+  }
+
+  return 0;
+}
+
+static hive_node_h
+get_node (hive_h *hh, hive_node_h node, const char *const *path, size_t n)
+{
+  size_t i;
+
+  for (i = 0; node > 0 && i < n; ++i) {
+    errno = 0;
+    node = hivex_node_get_child (hh, node, path[i]);
+    if (node == 0 && errno != 0)
+      return 0;
+  }
+
+  if (node == 0 && errno == 0)
+    errno = ENOENT;
+  return node;
+}
+
+/* Open 'filename' with a private hivex handle, so this does not
+ * disturb the handle used by the public hivex_* calls.  Returns NULL
+ * and sets 'missing' if 'filename' is NULL or the hive does not exist.
+ */
+static hive_h *
+open_hive (const char *filename, int *missing)
+{
+  CLEANUP_FREE char *buf = NULL;
+  struct stat statbuf;
+  hive_h *hh;
+
+  *missing = 0;
+
+  if (filename == NULL) {
+    *missing = 1;
+    return NULL;
+  }
+
+  buf = sysroot_path (filename);
+  if (!buf) {
+    reply_with_perror ("malloc");
+    return NULL;
+  }
+
+  if (stat (buf, &statbuf) == -1 || !S_ISREG (statbuf.st_mode)) {
+    *missing = 1;
+    return NULL;
+  }
+
+  hh = hivex_open (buf, verbose ? HIVEX_OPEN_VERBOSE : 0);
+  if (!hh)
+    reply_with_perror ("hivex failed to open %s", filename);
+  return hh;
+}
+
+static int
+windows_software_info (struct stringsbuf *sb, const char *software)
+{
+  static const char *const hivepath[] =
+    { "Microsoft", "Windows NT", "CurrentVersion" };
+  hive_h *hh;
+  hive_node_h node;
+  int missing, r;
+
+  hh = open_hive (software, &missing);
+  if (hh == NULL)
+    return missing ? 0 : -1;
+
+  node = get_node (hh, hivex_root (hh),
+                   hivepath, sizeof hivepath / sizeof hivepath[0]);
+  if (node == 0) {
+    reply_with_perror ("hivex: cannot locate HKLM\\SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion");
+    hivex_close (hh);
+    return -1;
+  }
+
+  r = add_node_values (sb, hh, node, "CurrentVersion");
+  hivex_close (hh);
+  return r;
+}
+
+static int
+windows_system_info (struct stringsbuf *sb, const char *system)
+{
+  const char *hivepath[] =
+    { NULL /* current control set */, "Services", "Tcpip", "Parameters" };
+  char control_set[32];
+  hive_h *hh;
+  hive_node_h root, node;
+  hive_value_h value;
+  hive_type t;
+  size_t len;
+  CLEANUP_FREE char *buf = NULL;
+  int32_t dword;
+  int missing;
+
+  hh = open_hive (system, &missing);
+  if (hh == NULL)
+    return missing ? 0 : -1;
+
+  root = hivex_root (hh);
+  if (root == 0) {
+    reply_with_perror ("hivex_root: %s", system);
+    goto error;
+  }
+
+  /* Get the CurrentControlSet. */
+  errno = 0;
+  node = hivex_node_get_child (hh, root, "Select");
+  if (node == 0) {
+    if (errno != 0)
+      reply_with_perror ("hivex_node_get_child");
+    else
+      reply_with_error ("hivex: could not locate HKLM\\SYSTEM\\Select");
+    goto error;
+  }
+  if (add_node_values (sb, hh, node, "Select") == -1)
+    goto error;
+
+  errno = 0;
+  value = hivex_node_get_value (hh, node, "Current");
+  if (value == 0) {
+    if (errno != 0)
+      reply_with_perror ("hivex_node_get_value");
+    else
+      reply_with_error ("hivex: HKLM\\System\\Select Default entry not found");
+    goto error;
+  }
+  buf = hivex_value_value (hh, value, &t, &len);
+  if (buf == NULL || len != 4) {
+    reply_with_error ("hivex: HKLM\\System\\Select\\Current expected to be DWORD");
+    goto error;
+  }
+  memcpy (&dword, buf, 4);
+  snprintf (control_set, sizeof control_set,
+            "ControlSet%03d", (int) le32toh (dword));
+
+  /* Get the drive mappings.  This is optional (RHBZ#803664). */
+  errno = 0;
+  node = hivex_node_get_child (hh, root, "MountedDevices");
+  if (node == 0 && errno != 0) {
+    reply_with_perror ("hivex_node_get_child");
+    goto error;
+  }
+  if (node != 0 && add_node_values (sb, hh, node, "MountedDevices") == -1)
+    goto error;
+
+  /* Get the hostname. */
+  hivepath[0] = control_set;
+  node = get_node (hh, root, hivepath, sizeof hivepath / sizeof hivepath[0]);
+  if (node == 0) {
+    reply_with_perror ("hivex: cannot locate HKLM\\SYSTEM\\%s\\Services\\Tcpip\\Parameters",
+                       control_set);
+    goto error;
+  }
+  if (add_node_values (sb, hh, node, "Parameters") == -1)
+    goto error;
+
+  hivex_close (hh);
+  return 0;
+
+ error:
+  hivex_close (hh);
+  return -1;
+}
+
+char **
+do_internal_hivex_windows_info (const char *software, const char *system)
+{
+  DECLARE_STRINGSBUF (ret);
+
+  /* There is no "OptPathname" in the generator, so we have to do the
+   * pathname checks explicitly here.
+   */
+  if (software) {
+    ABS_PATH (software, , return NULL);
+  }
+  if (system) {
+    ABS_PATH (system, , return NULL);
+  }
+  NEED_ROOT (, return NULL);
+
+  if (windows_software_info (&ret, software) == -1 ||
+      windows_system_info (&ret, system) == -1) {
+    free_stringsbuf (&ret);
+    return NULL;
+  }
+
+  if (end_stringsbuf (&ret) == -1)
+    return NULL;
+
+  return take_stringsbuf (&ret);
+}
+
+/* Helpers for parsing the packed data passed to hivex_import. */
+static int
+get_u32 (const char **p, size_t *len, uint32_t *ret)
+{
+  if (*len < 4) {
+    reply_with_error ("packed data is truncated");
+    return -1;
+  }
+  memcpy (ret, *p, 4);
+  *ret = le32toh (*ret);
+  *p += 4;
+  *len -= 4;
+  return 0;
+}
+
+/* The strings are not \0-terminated in the packed data, so this
+ * returns a copy.
+ */
+static char *
+get_string (const char **p, size_t *len, size_t *size_ret)
+{
+  uint32_t n;
+  char *ret;
+
+  if (get_u32 (p, len, &n) == -1)
+    return NULL;
+  if (*len < n) {
+    reply_with_error ("packed data is truncated");
+    return NULL;
+  }
+  ret = malloc (n + 1);
+  if (ret == NULL) {
+    reply_with_perror ("malloc");
+    return NULL;
+  }
+  memcpy (ret, *p, n);
+  ret[n] = '\0';
+  *p += n;
+  *len -= n;
+  if (size_ret)
+    *size_ret = n;
+  return ret;
+}
+
+/* Set the 'nr_new' values on 'node' with a single
+ * hivex_node_set_values call.  hivex_node_set_values replaces all the
+ * values of the node, so the existing values which are not being
+ * replaced have to be passed to it too.
+ */
+static int
+import_values (hive_node_h node, const hive_set_value *new_values,
+               size_t nr_new)
+{
+  CLEANUP_FREE hive_value_h *old = NULL;
+  CLEANUP_FREE hive_set_value *values = NULL;
+  size_t i, j, nr_old, nr = 0;
+  int r = -1;
+
+  old = hivex_node_values (h, node);
+  if (old == NULL) {
+    reply_with_perror ("hivex_node_values");
+    return -1;
+  }
+  for (nr_old = 0; old[nr_old] != 0; ++nr_old)
+    ;
+
+  values = calloc (nr_old + nr_new, sizeof *values);
+  if (values == NULL) {
+    reply_with_perror ("calloc");
+    return -1;
+  }
+
+  for (i = 0; i < nr_old; ++i) {
+    hive_set_value *v = &values[nr];
+    hive_type t;
+
+    v->key = hivex_value_key (h, old[i]);
+    if (v->key == NULL) {
+      reply_with_perror ("hivex_value_key");
+      goto out;
+    }
+    nr++;
+
+    /* Value names are case insensitive. */
+    for (j = 0; j < nr_new; ++j)
+      if (STRCASEEQ (v->key, new_values[j].key))
+        break;
+    if (j < nr_new) {           /* replaced */
+      free (v->key);
+      v->key = NULL;
+      nr--;
+      continue;
+    }
+
+    v->value = hivex_value_value (h, old[i], &t, &v->len);
+    if (v->value == NULL) {
+      reply_with_perror ("hivex_value_value: %s", v->key);
+      goto out;
+    }
+    v->t = t;
+  }
+
+  memcpy (&values[nr], new_values, nr_new * sizeof *values);
+
+  if (hivex_node_set_values (h, node, nr + nr_new, &values[0], 0) == -1) {
+    reply_with_perror ("hivex_node_set_values");
+    goto out;
+  }
+  r = 0;
+
+ out:
+  for (i = 0; i < nr; ++i) {
+    free (values[i].key);
+    free (values[i].value);
+  }
+  return r;
+}
+
+/* Import one key from the packed data, advancing 'p' and 'len'. */
+static int
+import_key (hive_node_h root, const char **p, size_t *len)
+{
+  hive_node_h node = root;
+  hive_set_value *values = NULL;
+  uint32_t i, n, nr_values = 0;
+  int r = -1;
+
+  /* Find or create the node. */
+  if (get_u32 (p, len, &n) == -1)
+    return -1;
+  for (i = 0; i < n; ++i) {
+    CLEANUP_FREE char *name = get_string (p, len, NULL);
+    hive_node_h child;
+
+    if (name == NULL)
+      return -1;
+    errno = 0;
+    child = hivex_node_get_child (h, node, name);
+    if (child == 0) {
+      if (errno != 0) {
+        reply_with_perror ("hivex_node_get_child: %s", name);
+        return -1;
+      }
+      child = hivex_node_add_child (h, node, name);
+      if (child == 0) {
+        reply_with_perror ("hivex_node_add_child: %s", name);
+        return -1;
+      }
+    }
+    node = child;
+  }
+
+  if (get_u32 (p, len, &nr_values) == -1)
+    return -1;
+  if (nr_values == 0)
+    return 0;
+  /* Each value takes at least 12 bytes, so this stops a bogus count
+   * from allocating a huge array.
+   */
+  if (nr_values > *len / 12) {
+    reply_with_error ("packed data is truncated");
+    return -1;
+  }
+
+  values = calloc (nr_values, sizeof *values);
+  if (values == NULL) {
+    reply_with_perror ("calloc");
+    return -1;
+  }
+  for (i = 0; i < nr_values; ++i) {
+    uint32_t t;
+
+    values[i].key = get_string (p, len, NULL);
+    if (values[i].key == NULL || get_u32 (p, len, &t) == -1)
+      goto out;
+    values[i].t = t;
+    values[i].value = get_string (p, len, &values[i].len);
+    if (values[i].value == NULL)
+      goto out;
+  }
+
+  r = import_values (node, values, nr_values);
+
+ out:
+  for (i = 0; i < nr_values; ++i) {
+    free (values[i].key);
+    free (values[i].value);
+  }
+  free (values);
+  return r;
+}
+
+int
+do_hivex_import (int64_t nodeh, const char *data, size_t data_size)
+{
+  NEED_HANDLE (-1);
+
+  while (data_size > 0) {
+    if (import_key (nodeh, &data, &data_size) == -1)
+      return -1;
+  }
+
+  return 0;
+}
+
 #else /* !HAVE_HIVEX */
 
 OPTGROUP_HIVEX_NOT_AVAILABLE
@@ -20,15 +20,27 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
 #include <unistd.h>
 #include <errno.h>
 #include <time.h>
 #include <string.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+#include "ignore-value.h"
 
 #include "guestfs_protocol.h"
 #include "daemon.h"
 #include "actions.h"
 
+GUESTFSD_EXT_CMD(str_mdadm, mdadm);
+GUESTFSD_EXT_CMD(str_lvm, lvm);
+GUESTFSD_EXT_CMD(str_ldmtool, ldmtool);
+
 #define HOT_ADD_TIMEOUT 30 /* seconds */
 #define HOT_REMOVE_TIMEOUT HOT_ADD_TIMEOUT
 
@@ -42,48 +54,177 @@ hotplug_error (const char *op, const char *path, const char *verb,
                     op, path, verb, timeout);
 }
 
-/* Wait for /dev/disk/guestfs/<label> to appear.  Timeout (and error)
- * if it doesn't appear after a reasonable length of time.
+/* How often to look for the devices even if no uevent arrives.  The
+ * uevents for the drive may have been sent before we started to
+ * listen.
  */
-int
-do_internal_hot_add_drive (const char *label)
+#define HOTPLUG_POLL_INTERVAL 100 /* milliseconds */
+
+/* Open a socket which receives kernel uevents, so we can look for
+ * the devices as soon as something changes instead of sleeping.
+ * Returns -1 if this is not possible, and then the caller just
+ * polls.
+ */
+static int
+open_uevent_socket (void)
 {
-  CLEANUP_FREE char *path = NULL;
-  time_t start_t, now_t;
-  int r;
+  struct sockaddr_nl addr;
+  int sock;
 
-  if (asprintf (&path, "/dev/disk/guestfs/%s", label) == -1) {
-    reply_with_perror ("asprintf");
+  sock = socket (AF_NETLINK, SOCK_DGRAM|SOCK_CLOEXEC|SOCK_NONBLOCK,
+                 NETLINK_KOBJECT_UEVENT);
+  if (sock == -1) {
+    if (verbose)
+      perror ("socket: NETLINK_KOBJECT_UEVENT");
     return -1;
   }
 
-  time (&start_t);
+  memset (&addr, 0, sizeof addr);
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = 1;           /* kernel uevents */
+  if (bind (sock, (struct sockaddr *) &addr, sizeof addr) == -1) {
+    if (verbose)
+      perror ("bind: NETLINK_KOBJECT_UEVENT");
+    close (sock);
+    return -1;
+  }
 
-  while (time (&now_t) - start_t <= HOT_ADD_TIMEOUT) {
-    udev_settle ();
+  return sock;
+}
+
+/* Wait until a uevent arrives or HOTPLUG_POLL_INTERVAL has passed,
+ * and discard any queued uevents.  We don't care what the events
+ * are, only that udev may have something new for us.
+ */
+static void
+wait_for_uevent (int sock)
+{
+  struct pollfd fds;
+  char buf[4096];
+
+  if (sock == -1) {
+    usleep (HOTPLUG_POLL_INTERVAL * 1000);
+    return;
+  }
+
+  fds.fd = sock;
+  fds.events = POLLIN;
+  fds.revents = 0;
+  if (poll (&fds, 1, HOTPLUG_POLL_INTERVAL) > 0) {
+    while (recv (sock, buf, sizeof buf, 0) > 0)
+      ;
+  }
+}
+
+static int64_t
+elapsed_ms (const struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+  return (now.tv_sec - start->tv_sec) * INT64_C(1000) +
+    (now.tv_usec - start->tv_usec) / 1000;
+}
 
-    r = access (path, F_OK);
-    if (r == -1 && errno != ENOENT) {
-      reply_with_perror ("%s", path);
+/* Wait until /dev/disk/guestfs/<label> exists for all labels (if
+ * 'appear') or for none of them (if '!appear').  Timeout (and error)
+ * if that doesn't happen after a reasonable length of time.
+ */
+static int
+wait_for_labels (char *const *labels, bool appear)
+{
+  const char *op = appear ? "hot-add" : "hot-remove";
+  const int timeout = appear ? HOT_ADD_TIMEOUT : HOT_REMOVE_TIMEOUT;
+  const size_t nr = count_strings (labels);
+  CLEANUP_FREE_STRING_LIST char **paths = NULL;
+  struct timeval start;
+  size_t i, done;
+  int sock, r;
+
+  paths = calloc (nr + 1, sizeof (char *));
+  if (paths == NULL) {
+    reply_with_perror ("calloc");
+    return -1;
+  }
+  for (i = 0; i < nr; ++i) {
+    if (asprintf (&paths[i], "/dev/disk/guestfs/%s", labels[i]) == -1) {
+      reply_with_perror ("asprintf");
       return -1;
     }
-    if (r == 0)
-      return 0;
+  }
+
+  gettimeofday (&start, NULL);
+
+  /* Open the socket before looking, so we can't miss an event. */
+  sock = open_uevent_socket ();
 
-    sleep (1);
+  /* Paths before 'done' are known to be in the wanted state. */
+  done = 0;
+  for (;;) {
+    udev_settle ();
+
+    while (done < nr) {
+      r = access (paths[done], F_OK);
+      if (r == -1 && errno != ENOENT) {
+        reply_with_perror ("%s", paths[done]);
+        goto error;
+      }
+      if ((r == 0) != appear)
+        break;
+      done++;
+    }
+    if (done == nr)
+      break;
+
+    if (elapsed_ms (&start) > timeout * INT64_C(1000)) {
+      hotplug_error (op, paths[done],
+                     appear ? "appear" : "disappear", timeout);
+      goto error;
+    }
+
+    wait_for_uevent (sock);
   }
 
-  hotplug_error ("hot-add", path, "appear", HOT_ADD_TIMEOUT);
+  if (sock >= 0)
+    close (sock);
+
+  if (verbose)
+    fprintf (stderr, "%s: %zu drive(s) took %" PRIi64 " ms\n",
+             op, nr, elapsed_ms (&start));
+
+  return 0;
+
+ error:
+  if (sock >= 0)
+    close (sock);
   return -1;
 }
 
+/* Wait for /dev/disk/guestfs/<label> to appear. */
+int
+do_internal_hot_add_drive (const char *label)
+{
+  char *labels[] = { (char *) label, NULL };
+
+  return wait_for_labels (labels, true);
+}
+
+int
+do_internal_hot_add_drives (char *const *labels)
+{
+  return wait_for_labels (labels, true);
+}
+
 GUESTFSD_EXT_CMD(str_fuser, fuser);
 
-/* This function is called before a drive is hot-unplugged. */
+/* This function is called before drives are hot-unplugged. */
 int
-do_internal_hot_remove_drive_precheck (const char *label)
+do_internal_hot_remove_drives_precheck (char *const *labels)
 {
-  CLEANUP_FREE char *path = NULL;
+  const size_t nr = count_strings (labels);
+  CLEANUP_FREE_STRING_LIST char **paths = NULL;
+  CLEANUP_FREE const char **argv = NULL;
+  size_t i;
   int r;
   CLEANUP_FREE char *out = NULL, *err = NULL;
 
@@ -91,14 +232,26 @@ do_internal_hot_remove_drive_precheck (const char *label)
   udev_settle ();
   sync_disks ();
 
-  if (asprintf (&path, "/dev/disk/guestfs/%s", label) == -1) {
-    reply_with_perror ("asprintf");
+  paths = calloc (nr + 1, sizeof (char *));
+  argv = calloc (nr + 4, sizeof (char *));
+  if (paths == NULL || argv == NULL) {
+    reply_with_perror ("calloc");
     return -1;
   }
+  argv[0] = str_fuser;
+  argv[1] = "-v";
+  argv[2] = "-m";
+  for (i = 0; i < nr; ++i) {
+    if (asprintf (&paths[i], "/dev/disk/guestfs/%s", labels[i]) == -1) {
+      reply_with_perror ("asprintf");
+      return -1;
+    }
+    argv[i+3] = paths[i];
+  }
 
-  r = commandr (&out, &err, str_fuser, "-v", "-m", path, NULL);
+  r = commandrv (&out, &err, argv);
   if (r == -1) {
-    reply_with_error ("fuser: %s: %s", path, err);
+    reply_with_error ("fuser: %s", err);
     return -1;
   }
 
@@ -107,8 +260,13 @@ do_internal_hot_remove_drive_precheck (const char *label)
    * access has been found, fuser returns zero."
    */
   if (r == 0) {
-    reply_with_error ("disk with label '%s' is in use "
-                      "(eg. mounted or belongs to a volume group)", label);
+    if (nr == 1)
+      reply_with_error ("disk with label '%s' is in use "
+                        "(eg. mounted or belongs to a volume group)",
+                        labels[0]);
+    else
+      reply_with_error ("one of the disks is in use "
+                        "(eg. mounted or belongs to a volume group)");
 
     /* Useful for debugging when a drive cannot be unplugged. */
     if (verbose)
@@ -120,41 +278,85 @@ do_internal_hot_remove_drive_precheck (const char *label)
   return 0;
 }
 
-/* This function is called after a drive is hot-unplugged.  It checks
- * that it has really gone and udev has finished processing the
+int
+do_internal_hot_remove_drive_precheck (const char *label)
+{
+  char *labels[] = { (char *) label, NULL };
+
+  return do_internal_hot_remove_drives_precheck (labels);
+}
+
+/* This function is called after drives are hot-unplugged.  It checks
+ * that they have really gone and udev has finished processing the
  * events, in case the user immediately hotplugs a drive with an
  * identical label.
  */
 int
 do_internal_hot_remove_drive (const char *label)
 {
-  CLEANUP_FREE char *path = NULL;
+  char *labels[] = { (char *) label, NULL };
+
+  return wait_for_labels (labels, false);
+}
+
+int
+do_internal_hot_remove_drives (char *const *labels)
+{
+  return wait_for_labels (labels, false);
+}
+
+/* Wait until the appliance can see 'nr' devices.  This is used after
+ * restoring the appliance from a snapshot, when the library adds the
+ * drives one at a time and waits for each so that they get device
+ * names in the same order as at boot.
+ */
+int
+do_internal_wait_for_devices (int nr, int scan)
+{
   time_t start_t, now_t;
-  int r;
+  size_t n;
 
-  if (asprintf (&path, "/dev/disk/guestfs/%s", label) == -1) {
-    reply_with_perror ("asprintf");
+  if (nr < 0) {
+    reply_with_error ("nr cannot be negative");
     return -1;
   }
 
   time (&start_t);
 
-  while (time (&now_t) - start_t <= HOT_REMOVE_TIMEOUT) {
+  for (;;) {
+    CLEANUP_FREE_STRING_LIST char **devices = NULL;
+
     udev_settle ();
 
-    r = access (path, F_OK);
-    if (r == -1) {
-      if (errno != ENOENT) {
-        reply_with_perror ("%s", path);
-        return -1;
-      }
-      /* else udev has removed the file, so we can return */
-      return 0;
+    devices = do_list_devices ();
+    if (devices == NULL)
+      return -1;
+    n = count_strings (devices);
+    if (n >= (size_t) nr)
+      break;
+
+    if (time (&now_t) - start_t > HOT_ADD_TIMEOUT) {
+      reply_with_error ("hot-add drive: only %zu of %d devices appeared "
+                        "after %d seconds: this could mean that "
+                        "virtio-scsi (in qemu or kernel) or udev is not "
+                        "working",
+                        n, nr, HOT_ADD_TIMEOUT);
+      return -1;
     }
 
-    sleep (1);
+    usleep (10000);
   }
 
-  hotplug_error ("hot-remove", path, "disappear", HOT_REMOVE_TIMEOUT);
-  return -1;
+  /* These are the same scans that appliance/init does at boot. */
+  if (scan) {
+    ignore_value (command (NULL, NULL, str_mdadm,
+                           "-As", "--auto=yes", "--run", NULL));
+    ignore_value (command (NULL, NULL, str_lvm,
+                           "vgchange", "-aay", "--sysinit", NULL));
+    if (prog_exists (str_ldmtool))
+      ignore_value (command (NULL, NULL, str_ldmtool, "create", "all", NULL));
+    udev_settle ();
+  }
+
+  return 0;
 }
@@ -21,11 +21,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <limits.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <elf.h>
 
 #include "guestfs_protocol.h"
 #include "daemon.h"
@@ -33,6 +35,8 @@
 
 GUESTFSD_EXT_CMD(str_zcat, zcat);
 GUESTFSD_EXT_CMD(str_cpio, cpio);
+GUESTFSD_EXT_CMD(str_bzcat, bzcat);
+GUESTFSD_EXT_CMD(str_xzcat, xzcat);
 
 char **
 do_initrd_list (const char *path)
@@ -214,3 +218,206 @@ do_initrd_cat (const char *path, const char *filename, size_t *size_r)
 
   return ret;
 }
+
+#ifndef EM_486
+#define EM_486 6
+#endif
+#ifndef EM_RISCV
+#define EM_RISCV 243
+#endif
+
+/* Binaries in the initrd which tell us its architecture. */
+static const char *initrd_binaries[] = {
+  "bin/ls",
+  "bin/rm",
+  "bin/modprobe",
+  "sbin/modprobe",
+  "bin/sh",
+  "bin/bash",
+  "bin/dash",
+  "bin/nash",
+  NULL
+};
+
+/* Return the canonical architecture of an ELF header, or NULL. */
+static const char *
+elf_arch (const unsigned char *hdr)
+{
+  const int is64 = hdr[EI_CLASS] == ELFCLASS64;
+  const int msb = hdr[EI_DATA] == ELFDATA2MSB;
+  const unsigned machine = msb ? hdr[18] << 8 | hdr[19] : hdr[19] << 8 | hdr[18];
+
+  switch (machine) {
+  case EM_386: case EM_486: return "i386";
+  case EM_X86_64:       return "x86_64";
+  case EM_SPARC: case EM_SPARC32PLUS: return "sparc";
+  case EM_SPARCV9:      return "sparc64";
+  case EM_IA_64:        return "ia64";
+  case EM_PPC:          return "ppc";
+  case EM_PPC64:        return msb ? "ppc64" : "ppc64le";
+  case EM_ARM:          return "arm";
+  case EM_AARCH64:      return "aarch64";
+  case EM_RISCV:        return is64 ? "riscv64" : "riscv32";
+  case EM_S390:         return is64 ? "s390x" : "s390";
+  default:              return NULL;
+  }
+}
+
+/* Read and discard 'n' bytes from the stream. */
+static int
+skip_bytes (FILE *fp, uint64_t n)
+{
+  char buf[BUFSIZ];
+  size_t r;
+
+  while (n > 0) {
+    r = fread (buf, 1, n < sizeof buf ? n : sizeof buf, fp);
+    if (r == 0)
+      return -1;
+    n -= r;
+  }
+  return 0;
+}
+
+/* Parse one hex field of a "newc" cpio header. */
+static uint64_t
+cpio_field (const char *hdr, size_t i)
+{
+  char buf[9];
+
+  memcpy (buf, &hdr[6 + i*8], 8);
+  buf[8] = '\0';
+  return strtoull (buf, NULL, 16);
+}
+
+/* Walk through the cpio archive on 'fp' and return the architecture
+ * of the first of initrd_binaries found in it.  Only the headers of
+ * the binaries are read, everything else is skipped.  Returns NULL
+ * (without replying) if there is none.
+ */
+static const char *
+cpio_arch (FILE *fp)
+{
+  char hdr[110];
+  CLEANUP_FREE char *name = NULL;
+  unsigned char elf[EI_NIDENT + 4];
+  uint64_t mode, filesize, namesize;
+  const char *p, *arch;
+  size_t i;
+
+  for (;;) {
+    if (fread (hdr, 1, sizeof hdr, fp) != sizeof hdr ||
+        (memcmp (hdr, "070701", 6) != 0 && memcmp (hdr, "070702", 6) != 0))
+      return NULL;
+    mode = cpio_field (hdr, 1);
+    filesize = cpio_field (hdr, 6);
+    namesize = cpio_field (hdr, 11);
+    if (namesize == 0 || namesize > PATH_MAX)
+      return NULL;
+
+    free (name);
+    name = malloc (namesize);
+    if (name == NULL)
+      return NULL;
+    /* The name is padded so that the data starts on a 4 byte boundary. */
+    if (fread (name, 1, namesize, fp) != namesize ||
+        skip_bytes (fp, (4 - (sizeof hdr + namesize) % 4) % 4) == -1)
+      return NULL;
+    name[namesize-1] = '\0';
+    if (STREQ (name, "TRAILER!!!"))
+      return NULL;
+
+    p = name;
+    while (STRPREFIX (p, "./"))
+      p += 2;
+    while (*p == '/')
+      p++;
+
+    if (S_ISREG (mode) && filesize >= sizeof elf) {
+      for (i = 0; initrd_binaries[i] != NULL; ++i) {
+        if (STREQ (p, initrd_binaries[i]))
+          break;
+      }
+      if (initrd_binaries[i] != NULL) {
+        if (fread (elf, 1, sizeof elf, fp) != sizeof elf)
+          return NULL;
+        if (memcmp (elf, ELFMAG, SELFMAG) == 0 &&
+            (arch = elf_arch (elf)) != NULL)
+          return arch;
+        filesize -= sizeof elf;
+      }
+    }
+
+    if (skip_bytes (fp, filesize + (4 - filesize % 4) % 4) == -1)
+      return NULL;
+  }
+}
+
+char *
+do_internal_initrd_arch (const char *path)
+{
+  CLEANUP_FREE char *buf = NULL, *cmd = NULL;
+  unsigned char magic[6];
+  const char *method = "cat";
+  const char *arch;
+  FILE *fp;
+  int fd;
+  char *ret;
+
+  buf = sysroot_path (path);
+  if (!buf) {
+    reply_with_perror ("malloc");
+    return NULL;
+  }
+
+  /* Find out how the initrd is compressed. */
+  fd = open (buf, O_RDONLY|O_CLOEXEC);
+  if (fd == -1) {
+    reply_with_perror ("open: %s", path);
+    return NULL;
+  }
+  if (xread (fd, magic, sizeof magic) == -1) {
+    reply_with_perror ("read: %s", path);
+    close (fd);
+    return NULL;
+  }
+  close (fd);
+  if (memcmp (magic, "\x1f\x8b", 2) == 0)
+    method = str_zcat;
+  else if (memcmp (magic, "BZh", 3) == 0)
+    method = str_bzcat;
+  else if (memcmp (magic, "\xfd" "7zXZ\0", 6) == 0)
+    method = str_xzcat;
+
+  /* "zcat /sysroot/<path>", but path must be quoted. */
+  if (asprintf_nowarn (&cmd, "%s %R", method, path) == -1) {
+    reply_with_perror ("asprintf");
+    return NULL;
+  }
+
+  if (verbose)
+    fprintf (stderr, "%s\n", cmd);
+
+  fp = popen (cmd, "r");
+  if (fp == NULL) {
+    reply_with_perror ("popen: %s", cmd);
+    return NULL;
+  }
+
+  arch = cpio_arch (fp);
+
+  /* This usually stops reading before the end, so the decompressor
+   * is killed by SIGPIPE and its exit status is meaningless.
+   */
+  pclose (fp);
+  if (arch == NULL) {
+    reply_with_error ("%s: could not determine architecture of cpio archive",
+                      path);
+    return NULL;
+  }
+
+  ret = strdup (arch);
+  if (ret == NULL)
+    reply_with_perror ("strdup");
+  return ret;
+}
@@ -24,6 +24,8 @@
 #include <inttypes.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
 
 #ifdef HAVE_SYS_INOTIFY_H
 #include <sys/inotify.h>
@@ -35,17 +37,62 @@
 #include "optgroups.h"
 
 #ifdef HAVE_SYS_INOTIFY_H
-GUESTFSD_EXT_CMD(str_sort, sort);
-
 /* Currently open inotify handle, or -1 if not opened. */
 static int inotify_fd = -1;
 
+/* The path which was passed to inotify_add_watch for each watch
+ * descriptor, so that inotify_wait can return full paths.
+ */
+struct watch {
+  int wd;
+  char *path;
+};
+static struct watch *watches = NULL;
+static size_t nr_watches = 0;
+
 static char inotify_buf[64*1024*1024];	/* Event buffer, [0..posn-1] is valid */
 static size_t inotify_posn = 0;
 
 /* Because of use of arbitrary offsets within inotify_buf. */
 #pragma GCC diagnostic ignored "-Wcast-align"
 
+static void
+free_watches (void)
+{
+  size_t i;
+
+  for (i = 0; i < nr_watches; ++i)
+    free (watches[i].path);
+  free (watches);
+  watches = NULL;
+  nr_watches = 0;
+}
+
+static void
+forget_watch (int wd)
+{
+  size_t i;
+
+  for (i = 0; i < nr_watches; ++i) {
+    if (watches[i].wd == wd) {
+      free (watches[i].path);
+      watches[i] = watches[--nr_watches];
+      return;
+    }
+  }
+}
+
+static const char *
+watch_path (int wd)
+{
+  size_t i;
+
+  for (i = 0; i < nr_watches; ++i)
+    if (watches[i].wd == wd)
+      return watches[i].path;
+  return NULL;
+}
+
 /* Clean up the inotify handle on daemon exit. */
 static void inotify_finalize (void) __attribute__((destructor));
 static void
@@ -55,6 +102,7 @@ inotify_finalize (void)
     close (inotify_fd);
     inotify_fd = -1;
   }
+  free_watches ();
 }
 
 int
@@ -146,6 +194,7 @@ do_inotify_close (void)
 
   inotify_fd = -1;
   inotify_posn = 0;
+  free_watches ();
 
   return 0;
 }
@@ -170,6 +219,29 @@ do_inotify_add_watch (const char *path, int mask)
     return -1;
   }
 
+  /* Adding a watch for an inode which is already watched returns the
+   * same descriptor again.
+   */
+  if (watch_path (r) == NULL) {
+    struct watch *nw;
+    char *p;
+
+    p = strdup (path);
+    nw = realloc (watches, (nr_watches+1) * sizeof (struct watch));
+    if (p == NULL || nw == NULL) {
+      reply_with_perror ("malloc");
+      free (p);
+      if (nw)
+        watches = nw;
+      inotify_rm_watch (inotify_fd, r);
+      return -1;
+    }
+    watches = nw;
+    watches[nr_watches].wd = r;
+    watches[nr_watches].path = p;
+    nr_watches++;
+  }
+
   return r;
 }
 
@@ -182,18 +254,38 @@ do_inotify_rm_watch (int wd)
     reply_with_perror ("%d", wd);
     return -1;
   }
+  forget_watch (wd);
 
   return 0;
 }
 
-guestfs_int_inotify_event_list *
-do_inotify_read (void)
+/* Return the name to put in the event.  If 'fullpaths' is set this is
+ * the path of the watch joined to the name in the event.
+ */
+static char *
+event_name (const struct inotify_event *event, int fullpaths)
+{
+  const char *path;
+  char *ret;
+
+  path = fullpaths ? watch_path (event->wd) : NULL;
+  if (path == NULL)
+    return strdup (event->len > 0 ? event->name : "");
+  if (event->len == 0 || event->name[0] == '\0')
+    return strdup (path);
+
+  if (asprintf (&ret, "%s%s%s", path, STREQ (path, "/") ? "" : "/",
+                event->name) == -1)
+    return NULL;
+  return ret;
+}
+
+static guestfs_int_inotify_event_list *
+read_events (int fullpaths)
 {
   int space;
   guestfs_int_inotify_event_list *ret;
 
-  NEED_INOTIFY (NULL);
-
   ret = malloc (sizeof *ret);
   if (ret == NULL) {
     reply_with_perror ("malloc");
@@ -268,15 +360,17 @@ do_inotify_read (void)
       in->in_mask = event->mask;
       in->in_cookie = event->cookie;
 
-      if (event->len > 0)
-        in->in_name = strdup (event->name);
-      else
-        in->in_name = strdup (""); /* Should have optional string fields XXX. */
+      /* Should have optional string fields XXX. */
+      in->in_name = event_name (event, fullpaths);
       if (in->in_name == NULL) {
         reply_with_perror ("strdup");
         goto error;
       }
 
+      /* The watch was removed, or the filesystem was unmounted. */
+      if (event->mask & IN_IGNORED)
+        forget_watch (event->wd);
+
       /* Estimate space used by this event in the message. */
       space -= 16 + 4 + strlen (in->in_name) + 4;
 
@@ -304,38 +398,72 @@ do_inotify_read (void)
   return NULL;
 }
 
-char **
-do_inotify_files (void)
+guestfs_int_inotify_event_list *
+do_inotify_read (void)
 {
-  CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (ret);
-  unsigned int i;
-  FILE *fp = NULL;
-  guestfs_int_inotify_event_list *events;
-  char buf[PATH_MAX];
-  char tempfile[] = "/tmp/inotifyXXXXXX";
-  int fd;
-  char cmd[64];
+  NEED_INOTIFY (NULL);
+
+  return read_events (0);
+}
+
+/* Takes optional arguments, consult optargs_bitmask. */
+guestfs_int_inotify_event_list *
+do_inotify_wait (int timeout, int settle, int fullpaths)
+{
+  struct pollfd pfd;
+  int r;
 
   NEED_INOTIFY (NULL);
 
-  fd = mkstemp (tempfile);
-  if (fd == -1) {
-    reply_with_perror ("mkstemp");
+  if (!(optargs_bitmask & GUESTFS_INOTIFY_WAIT_TIMEOUT_BITMASK))
+    timeout = -1;
+  if (!(optargs_bitmask & GUESTFS_INOTIFY_WAIT_SETTLE_BITMASK))
+    settle = 0;
+  if (!(optargs_bitmask & GUESTFS_INOTIFY_WAIT_FULLPATHS_BITMASK))
+    fullpaths = 0;
+
+  if (timeout < -1) {
+    reply_with_error ("timeout < -1");
+    return NULL;
+  }
+  if (settle < 0) {
+    reply_with_error ("settle < 0");
     return NULL;
   }
 
-  snprintf (cmd, sizeof cmd, "%s -u > %s", str_sort, tempfile);
-
-  fp = popen (cmd, "w");
-  if (fp == NULL) {
-    reply_with_perror ("sort");
+  pfd.fd = inotify_fd;
+  pfd.events = POLLIN;
+  do
+    r = poll (&pfd, 1, timeout);
+  while (r == -1 && errno == EINTR);
+  if (r == -1) {
+    reply_with_perror ("poll");
     return NULL;
   }
 
+  /* Give related events (eg. a burst of writes to a log file) a chance
+   * to arrive so they are returned together.
+   */
+  if (r > 0 && settle > 0)
+    poll (NULL, 0, settle);
+
+  return read_events (fullpaths);
+}
+
+char **
+do_inotify_files (void)
+{
+  CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (ret);
+  unsigned int i;
+  size_t j, n;
+  guestfs_int_inotify_event_list *events;
+
+  NEED_INOTIFY (NULL);
+
   while (1) {
-    events = do_inotify_read ();
+    events = read_events (0);
     if (events == NULL)
-      goto error;
+      return NULL;
 
     if (events->guestfs_int_inotify_event_list_len == 0) {
       free (events);
@@ -345,49 +473,32 @@ do_inotify_files (void)
     for (i = 0; i < events->guestfs_int_inotify_event_list_len; ++i) {
       const char *name = events->guestfs_int_inotify_event_list_val[i].in_name;
 
-      if (name[0] != '\0')
-        fprintf (fp, "%s\n", name);
+      if (name[0] != '\0' && add_string (&ret, name) == -1) {
+        xdr_free ((xdrproc_t) xdr_guestfs_int_inotify_event_list,
+                  (char *) events);
+        free (events);
+        return NULL;
+      }
     }
 
     xdr_free ((xdrproc_t) xdr_guestfs_int_inotify_event_list, (char *) events);
     free (events);
   }
 
-  pclose (fp);
-
-  fp = fdopen (fd, "r");
-  if (fp == NULL) {
-    reply_with_perror ("%s", tempfile);
-    unlink (tempfile);
-    close (fd);
-    return NULL;
+  /* Sort and remove duplicates. */
+  sort_strings (ret.argv, ret.size);
+  for (j = n = 0; j < ret.size; ++j) {
+    if (n > 0 && STREQ (ret.argv[n-1], ret.argv[j]))
+      free (ret.argv[j]);
+    else
+      ret.argv[n++] = ret.argv[j];
   }
-
-  while (fgets (buf, sizeof buf, fp) != NULL) {
-    const size_t len = strlen (buf);
-
-    if (len > 0 && buf[len-1] == '\n')
-      buf[len-1] = '\0';
-
-    if (add_string (&ret, buf) == -1)
-      goto error;
-  }
-
-  fclose (fp); /* implicitly closes fd */
-  fp = NULL;
+  ret.size = n;
 
   if (end_stringsbuf (&ret) == -1)
-    goto error;
+    return NULL;
 
-  unlink (tempfile);
   return take_stringsbuf (&ret);
-
- error:
-  if (fp != NULL)
-    fclose (fp);
-
-  unlink (tempfile);
-  return NULL;
 }
 
 #else /* !HAVE_SYS_INOTIFY_H */
@@ -161,3 +161,65 @@ get_mode (const char *path, mode_t *mode, int followsymlinks)
     *mode = buf.st_mode;
   return 1;
 }
+
+/* Like the calls above, but for many paths in a single round trip.
+ * Errors (other than the path not existing) are not fatal: the error
+ * bit is set so the library can repeat the single call to get the
+ * error message.
+ */
+char *
+do_internal_probe_paths (char *const *paths, size_t *size_r)
+{
+  const size_t n = count_strings (paths);
+  char *ret;
+  struct stat buf;
+  size_t i;
+  int r;
+
+  ret = calloc (n > 0 ? n : 1, 1);
+  if (ret == NULL) {
+    reply_with_perror ("calloc");
+    return NULL;
+  }
+
+  for (i = 0; i < n; ++i) {
+    if (paths[i][0] != '/') {
+      reply_with_error ("%s: path must start with a / character", paths[i]);
+      free (ret);
+      return NULL;
+    }
+
+    CHROOT_IN;
+    r = lstat (paths[i], &buf);
+    CHROOT_OUT;
+    if (r == -1) {
+      if (errno != ENOENT && errno != ENOTDIR)
+        ret[i] = PROBE_ERROR;
+      continue;
+    }
+
+    ret[i] = PROBE_EXISTS;
+    if (S_ISREG (buf.st_mode))
+      ret[i] |= PROBE_IS_FILE | PROBE_FOLLOW_IS_FILE;
+    else if (S_ISDIR (buf.st_mode))
+      ret[i] |= PROBE_IS_DIR | PROBE_FOLLOW_IS_DIR;
+    else if (S_ISLNK (buf.st_mode)) {
+      ret[i] |= PROBE_IS_SYMLINK;
+
+      CHROOT_IN;
+      r = stat (paths[i], &buf);
+      CHROOT_OUT;
+      if (r == -1) {
+        if (errno != ENOENT && errno != ENOTDIR)
+          ret[i] |= PROBE_ERROR;
+      }
+      else if (S_ISREG (buf.st_mode))
+        ret[i] |= PROBE_FOLLOW_IS_FILE;
+      else if (S_ISDIR (buf.st_mode))
+        ret[i] |= PROBE_FOLLOW_IS_DIR;
+    }
+  }
+
+  *size_r = n;
+  return ret;                   /* caller frees */
+}
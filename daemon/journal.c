@@ -186,6 +186,198 @@ do_internal_journal_get (void)
   return 0;
 }
 
+/* Send one field in the private length-prefixed format used by
+ * internal_journal_get and journal_export.
+ */
+static int
+send_journal_field (const void *data, size_t len)
+{
+  uint64_t len_be;
+
+  len_be = htobe64 ((uint64_t) len);
+  if (send_file_write (&len_be, sizeof (len_be)) < 0)
+    return -1;
+  if (len > 0 && send_file_write (data, len) < 0)
+    return -1;
+  return 0;
+}
+
+static int
+field_is_wanted (const void *data, size_t len, char *const *fields)
+{
+  const char *eq;
+  size_t i, n;
+
+  eq = memchr (data, '=', len);
+  if (eq == NULL)
+    return 0;
+  n = eq - (const char *) data;
+
+  for (i = 0; fields[i] != NULL; ++i) {
+    if (strlen (fields[i]) == n && memcmp (fields[i], data, n) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+/* Send the current entry, followed by a zero length terminator.  The
+ * return value is like sd_journal_enumerate_data: -errno on journal
+ * errors.  If sending the file fails this returns -EIO, but the
+ * transfer is then already broken so the caller must not cancel.
+ */
+static int
+send_journal_entry (char *const *fields, int *send_failed)
+{
+  CLEANUP_FREE char *cursor = NULL;
+  char *field;
+  const void *data;
+  size_t len;
+  uint64_t usec;
+  int r;
+
+  /* The cursor and timestamp are sent as pseudo-fields, the same way
+   * that journalctl -o export does, so that the caller can resume
+   * from this entry or filter on time.
+   */
+  r = sd_journal_get_cursor (j, &cursor);
+  if (r < 0)
+    return r;
+  r = sd_journal_get_realtime_usec (j, &usec);
+  if (r < 0)
+    return r;
+
+  if (asprintf (&field, "__CURSOR=%s", cursor) == -1)
+    return -errno;
+  r = send_journal_field (field, strlen (field));
+  free (field);
+  if (r == -1)
+    goto send_error;
+
+  if (asprintf (&field, "__REALTIME_TIMESTAMP=%" PRIu64, usec) == -1)
+    return -errno;
+  r = send_journal_field (field, strlen (field));
+  free (field);
+  if (r == -1)
+    goto send_error;
+
+  sd_journal_restart_data (j);
+  while ((r = sd_journal_enumerate_data (j, &data, &len)) > 0) {
+    if (fields && !field_is_wanted (data, len, fields))
+      continue;
+    if (send_journal_field (data, len) == -1)
+      goto send_error;
+  }
+  if (r < 0)
+    return r;
+
+  /* End of entry. */
+  if (send_journal_field (NULL, 0) == -1)
+    goto send_error;
+  return 0;
+
+ send_error:
+  *send_failed = 1;
+  return -EIO;
+}
+
+/* Has one FileOut parameter. */
+/* Takes optional arguments, consult optargs_bitmask. */
+int
+do_journal_export (int64_t maxentries, const char *cursor,
+                   int64_t since, int64_t until, char *const *fields)
+{
+  int64_t n = 0;
+  int send_failed = 0;
+  int r;
+
+  NEED_HANDLE (-1);
+
+  if (!(optargs_bitmask & GUESTFS_JOURNAL_EXPORT_MAXENTRIES_BITMASK))
+    maxentries = -1;
+  if (!(optargs_bitmask & GUESTFS_JOURNAL_EXPORT_UNTIL_BITMASK))
+    until = -1;
+  if (!(optargs_bitmask & GUESTFS_JOURNAL_EXPORT_FIELDS_BITMASK))
+    fields = NULL;
+
+  /* Seeking has to happen before the reply so that errors can be
+   * reported normally.
+   */
+  if ((optargs_bitmask & GUESTFS_JOURNAL_EXPORT_CURSOR_BITMASK)) {
+    r = sd_journal_seek_cursor (j, cursor);
+    if (r < 0) {
+      reply_with_perror_errno (-r, "sd_journal_seek_cursor: %s", cursor);
+      return -1;
+    }
+    /* Position on the entry with the cursor, so that the export
+     * starts after it.  If the entry has gone, the journal is
+     * positioned on the next entry, and that must be exported.
+     */
+    r = sd_journal_next (j);
+    if (r > 0 && sd_journal_test_cursor (j, cursor) <= 0)
+      sd_journal_previous (j);
+  }
+  else if ((optargs_bitmask & GUESTFS_JOURNAL_EXPORT_SINCE_BITMASK)) {
+    if (since < 0) {
+      reply_with_error ("since cannot be negative");
+      return -1;
+    }
+    r = sd_journal_seek_realtime_usec (j, (uint64_t) since);
+    if (r < 0) {
+      reply_with_perror_errno (-r, "sd_journal_seek_realtime_usec");
+      return -1;
+    }
+  }
+
+  /* Now we must send the reply message, before the file.  After
+   * this there is no opportunity in the protocol to send any error
+   * message back.  Instead we can only cancel the transfer.
+   */
+  reply (NULL, NULL);
+
+  r = 0;
+  while (maxentries < 0 || n < maxentries) {
+    r = sd_journal_next (j);
+    if (r <= 0)
+      break;
+
+    if (until >= 0) {
+      uint64_t usec;
+
+      r = sd_journal_get_realtime_usec (j, &usec);
+      if (r < 0)
+        break;
+      if (usec > (uint64_t) until) {
+        /* Leave the journal on the previous entry, so that a later
+         * call sees this entry again.
+         */
+        sd_journal_previous (j);
+        r = 0;
+        break;
+      }
+    }
+
+    r = send_journal_entry (fields, &send_failed);
+    if (r < 0)
+      break;
+    n++;
+  }
+
+  if (send_failed)
+    return -1;
+
+  if (r < 0) {
+    send_file_end (1);          /* Cancel. */
+    errno = -r;
+    perror ("journal_export");
+    return -1;
+  }
+
+  /* Normal end of file. */
+  if (send_file_end (0))
+    return -1;
+  return 0;
+}
+
 int64_t
 do_journal_get_data_threshold (void)
 {
@@ -92,5 +92,7 @@ do_set_label (const mountable_t *mountable, const char *label)
     NOT_SUPPORTED (-1, "don't know how to set the label for '%s' filesystems",
                    vfs_type);
 
+  blkid_cache_invalidate (mountable->device);
+
   return r;
 }
@@ -24,7 +24,14 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <dirent.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <time.h>
+#include <pwd.h>
+#include <grp.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <errno.h>
 
 #include "daemon.h"
@@ -95,14 +102,219 @@ do_ls0 (const char *path)
   return 0;
 }
 
+/* An entry printed by ll. */
+struct ll_entry {
+  char *name;
+  struct stat st;
+  char *link;                   /* target, if it is a symlink */
+};
+
+static int
+compare_ll_entries (const void *vp1, const void *vp2)
+{
+  const struct ll_entry *e1 = vp1;
+  const struct ll_entry *e2 = vp2;
+
+  return strcmp (e1->name, e2->name);
+}
+
+static void
+free_ll_entries (struct ll_entry *entries, size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < n; ++i) {
+    free (entries[i].name);
+    free (entries[i].link);
+  }
+  free (entries);
+}
+
+/* Format the mode as 'ls -l' does, eg. "drwxr-xr-x". */
+static void
+format_mode (mode_t mode, char *buf)
+{
+  buf[0] =
+    S_ISDIR (mode) ? 'd' : S_ISLNK (mode) ? 'l' : S_ISCHR (mode) ? 'c' :
+    S_ISBLK (mode) ? 'b' : S_ISFIFO (mode) ? 'p' : S_ISSOCK (mode) ? 's' :
+    S_ISREG (mode) ? '-' : '?';
+  buf[1] = mode & S_IRUSR ? 'r' : '-';
+  buf[2] = mode & S_IWUSR ? 'w' : '-';
+  buf[3] = mode & S_ISUID ? (mode & S_IXUSR ? 's' : 'S') : mode & S_IXUSR ? 'x' : '-';
+  buf[4] = mode & S_IRGRP ? 'r' : '-';
+  buf[5] = mode & S_IWGRP ? 'w' : '-';
+  buf[6] = mode & S_ISGID ? (mode & S_IXGRP ? 's' : 'S') : mode & S_IXGRP ? 'x' : '-';
+  buf[7] = mode & S_IROTH ? 'r' : '-';
+  buf[8] = mode & S_IWOTH ? 'w' : '-';
+  buf[9] = mode & S_ISVTX ? (mode & S_IXOTH ? 't' : 'T') : mode & S_IXOTH ? 'x' : '-';
+  buf[10] = '\0';
+}
+
+/* The owner and group are looked up in the appliance, as ls did. */
+static void
+format_user (uid_t uid, char *buf, size_t len)
+{
+  const struct passwd *pw = getpwuid (uid);
+
+  if (pw)
+    snprintf (buf, len, "%s", pw->pw_name);
+  else
+    snprintf (buf, len, "%ju", (uintmax_t) uid);
+}
+
+static void
+format_group (gid_t gid, char *buf, size_t len)
+{
+  const struct group *gr = getgrgid (gid);
+
+  if (gr)
+    snprintf (buf, len, "%s", gr->gr_name);
+  else
+    snprintf (buf, len, "%ju", (uintmax_t) gid);
+}
+
+/* Devices show the major and minor numbers, each lined up. */
+static void
+format_size (const struct stat *st, int major_width, int minor_width,
+             char *buf, size_t len)
+{
+  if (S_ISCHR (st->st_mode) || S_ISBLK (st->st_mode))
+    snprintf (buf, len, "%*u, %*u",
+              major_width, major (st->st_rdev),
+              minor_width, minor (st->st_rdev));
+  else
+    snprintf (buf, len, "%ju", (uintmax_t) st->st_size);
+}
+
+/* Like ls, show the time for files changed in the last six months,
+ * and the year for older files or files in the future.
+ */
+static void
+format_time (time_t t, time_t now, char *buf, size_t len)
+{
+  const time_t six_months = 31556952 / 2;
+  struct tm tm;
+
+  localtime_r (&t, &tm);
+  if (t > now - six_months && t <= now)
+    strftime (buf, len, "%b %e %H:%M", &tm);
+  else
+    strftime (buf, len, "%b %e  %Y", &tm);
+}
+
+/* Format the entries in the same way as 'ls -la', without running
+ * ls.  'total' is printed if the path is a directory.
+ */
+static char *
+format_ll_entries (struct ll_entry *entries, size_t n, int total)
+{
+  int nlink_width = 0, owner_width = 0, group_width = 0, size_width = 0;
+  int major_width = 0, minor_width = 0;
+  char buf[64];
+  uint64_t blocks = 0;
+  time_t now = time (NULL);
+  char *out = NULL;
+  size_t size, i;
+  FILE *fp;
+
+  for (i = 0; i < n; ++i) {
+    const struct stat *st = &entries[i].st;
+
+    if (S_ISCHR (st->st_mode) || S_ISBLK (st->st_mode)) {
+      major_width = MAX (major_width,
+                         snprintf (buf, sizeof buf, "%u", major (st->st_rdev)));
+      minor_width = MAX (minor_width,
+                         snprintf (buf, sizeof buf, "%u", minor (st->st_rdev)));
+    }
+  }
+
+  for (i = 0; i < n; ++i) {
+    const struct stat *st = &entries[i].st;
+    int w;
+
+    w = snprintf (buf, sizeof buf, "%ju", (uintmax_t) st->st_nlink);
+    nlink_width = MAX (nlink_width, w);
+    format_user (st->st_uid, buf, sizeof buf);
+    owner_width = MAX (owner_width, (int) strlen (buf));
+    format_group (st->st_gid, buf, sizeof buf);
+    group_width = MAX (group_width, (int) strlen (buf));
+    format_size (st, major_width, minor_width, buf, sizeof buf);
+    size_width = MAX (size_width, (int) strlen (buf));
+    blocks += st->st_blocks;
+  }
+
+  fp = open_memstream (&out, &size);
+  if (fp == NULL) {
+    reply_with_perror ("open_memstream");
+    return NULL;
+  }
+
+  /* st_blocks is in 512 byte units, and ls rounds up to 1K blocks. */
+  if (total)
+    fprintf (fp, "total %" PRIu64 "\n", (blocks + 1) / 2);
+
+  for (i = 0; i < n; ++i) {
+    const struct stat *st = &entries[i].st;
+    char mode[11];
+
+    format_mode (st->st_mode, mode);
+    fprintf (fp, "%s %*ju ", mode, nlink_width, (uintmax_t) st->st_nlink);
+    format_user (st->st_uid, buf, sizeof buf);
+    fprintf (fp, "%-*s ", owner_width, buf);
+    format_group (st->st_gid, buf, sizeof buf);
+    fprintf (fp, "%-*s ", group_width, buf);
+    format_size (st, major_width, minor_width, buf, sizeof buf);
+    fprintf (fp, "%*s ", size_width, buf);
+    format_time (st->st_mtime, now, buf, sizeof buf);
+    fprintf (fp, "%s %s", buf, entries[i].name);
+    if (entries[i].link)
+      fprintf (fp, " -> %s", entries[i].link);
+    fputc ('\n', fp);
+  }
+
+  if (fclose (fp) == EOF) {
+    reply_with_perror ("fclose");
+    free (out);
+    return NULL;
+  }
+
+  return out;                   /* caller frees */
+}
+
+/* Read the target of a symlink, or return NULL. */
+static char *
+read_link (int dirfd, const char *name, const struct stat *st)
+{
+  char *link;
+  ssize_t r;
+
+  if (!S_ISLNK (st->st_mode))
+    return NULL;
+
+  link = malloc (st->st_size > 0 ? st->st_size + 1 : PATH_MAX);
+  if (link == NULL)
+    return NULL;
+  r = readlinkat (dirfd, name, link, st->st_size > 0 ? st->st_size : PATH_MAX - 1);
+  if (r == -1) {
+    free (link);
+    return NULL;
+  }
+  link[r] = '\0';
+  return link;
+}
+
 char *
 do_ll (const char *path)
 {
-  int r;
-  char *out;
-  CLEANUP_FREE char *err = NULL;
   CLEANUP_FREE char *rpath = NULL;
   CLEANUP_FREE char *spath = NULL;
+  struct ll_entry *entries = NULL;
+  size_t nr_entries = 0, alloc_entries = 0;
+  struct stat statbuf;
+  struct dirent *d;
+  DIR *dir;
+  int fd;
+  char *out;
 
   CHROOT_IN;
   rpath = realpath (path, NULL);
@@ -118,14 +330,81 @@ do_ll (const char *path)
     return NULL;
   }
 
-  r = command (&out, &err, str_ls, "-la", spath, NULL);
-  if (r == -1) {
-    reply_with_error ("%s", err);
-    free (out);
+  fd = open (spath, O_RDONLY|O_NOCTTY|O_NONBLOCK|O_CLOEXEC);
+  if (fd == -1) {
+    reply_with_perror ("%s", path);
+    return NULL;
+  }
+  if (fstat (fd, &statbuf) == -1) {
+    reply_with_perror ("stat: %s", path);
+    close (fd);
     return NULL;
   }
 
-  return out;			/* caller frees */
+  if (!S_ISDIR (statbuf.st_mode)) {
+    struct ll_entry entry = { .name = (char *) path, .st = statbuf };
+
+    close (fd);
+    return format_ll_entries (&entry, 1, 0);
+  }
+
+  dir = fdopendir (fd);
+  if (dir == NULL) {
+    reply_with_perror ("opendir: %s", path);
+    close (fd);
+    return NULL;
+  }
+
+  for (;;) {
+    struct ll_entry *entry;
+
+    errno = 0;
+    d = readdir (dir);
+    if (d == NULL)
+      break;
+
+    if (nr_entries == alloc_entries) {
+      struct ll_entry *p;
+
+      alloc_entries = alloc_entries ? alloc_entries * 2 : 64;
+      p = realloc (entries, alloc_entries * sizeof (struct ll_entry));
+      if (p == NULL) {
+        reply_with_perror ("realloc");
+        goto error;
+      }
+      entries = p;
+    }
+
+    entry = &entries[nr_entries];
+    if (fstatat (dirfd (dir), d->d_name, &entry->st,
+                 AT_SYMLINK_NOFOLLOW) == -1) {
+      /* ls prints these with question marks, just leave them out. */
+      fprintf (stderr, "ll: %s/%s: %m\n", path, d->d_name);
+      continue;
+    }
+    entry->name = strdup (d->d_name);
+    if (entry->name == NULL) {
+      reply_with_perror ("strdup");
+      goto error;
+    }
+    entry->link = read_link (dirfd (dir), d->d_name, &entry->st);
+    nr_entries++;
+  }
+  if (errno != 0) {
+    reply_with_perror ("readdir: %s", path);
+    goto error;
+  }
+  closedir (dir);
+
+  qsort (entries, nr_entries, sizeof (struct ll_entry), compare_ll_entries);
+  out = format_ll_entries (entries, nr_entries, 1);
+  free_ll_entries (entries, nr_entries);
+  return out;                   /* caller frees */
+
+ error:
+  free_ll_entries (entries, nr_entries);
+  closedir (dir);
+  return NULL;
 }
 
 char *
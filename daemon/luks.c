@@ -22,6 +22,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "c-ctype.h"
+
 #include "daemon.h"
 #include "actions.h"
 #include "optgroups.h"
@@ -38,11 +40,10 @@ optgroup_luks_available (void)
 
 /* Callers must also call remove_temp (tempfile). */
 static char *
-write_key_to_temp (const char *key)
+write_key_to_temp_len (const char *key, size_t len)
 {
   char *tempfile;
   int fd;
-  size_t len;
 
   tempfile = strdup ("/tmp/luksXXXXXX");
   if (!tempfile) {
@@ -56,7 +57,6 @@ write_key_to_temp (const char *key)
     goto error;
   }
 
-  len = strlen (key);
   if (xwrite (fd, key, len) == -1) {
     reply_with_perror ("write");
     close (fd);
@@ -76,6 +76,56 @@ write_key_to_temp (const char *key)
   return NULL;
 }
 
+static char *
+write_key_to_temp (const char *key)
+{
+  return write_key_to_temp_len (key, strlen (key));
+}
+
+/* Decode a volume key written in hex, as printed by
+ * 'cryptsetup luksDump --dump-master-key' (spaces, newlines and
+ * colons between the digits are ignored), and write it to a temporary
+ * file.  Callers must also call remove_temp (tempfile).
+ */
+static char *
+write_volume_key_to_temp (const char *hexkey)
+{
+  CLEANUP_FREE char *buf = NULL;
+  size_t len = 0;
+  int nibble = -1;
+  const char *p;
+
+  buf = malloc (strlen (hexkey) / 2 + 1);
+  if (buf == NULL) {
+    reply_with_perror ("malloc");
+    return NULL;
+  }
+
+  for (p = hexkey; *p; ++p) {
+    int v;
+
+    if (c_isspace (*p) || *p == ':')
+      continue;
+    if (!c_isxdigit (*p)) {
+      reply_with_error ("volume key must be written in hexadecimal");
+      return NULL;
+    }
+    v = c_isdigit (*p) ? *p - '0' : c_tolower (*p) - 'a' + 10;
+    if (nibble == -1)
+      nibble = v;
+    else {
+      buf[len++] = nibble << 4 | v;
+      nibble = -1;
+    }
+  }
+  if (nibble != -1 || len == 0) {
+    reply_with_error ("volume key must be an even, non-zero number of hex digits");
+    return NULL;
+  }
+
+  return write_key_to_temp_len (buf, len);
+}
+
 static void
 remove_temp (char *tempfile)
 {
@@ -83,9 +133,12 @@ remove_temp (char *tempfile)
   free (tempfile);
 }
 
+/* If 'volume_key' is true, 'key' is the volume (master) key of the
+ * device in hex, instead of a passphrase.
+ */
 static int
 luks_open (const char *device, const char *key, const char *mapname,
-           int readonly)
+           int readonly, int volume_key)
 {
   /* Sanity check: /dev/mapper/mapname must not exist already.  Note
    * that the device-mapper control device (/dev/mapper/control) is
@@ -101,7 +154,8 @@ luks_open (const char *device, const char *key, const char *mapname,
     return -1;
   }
 
-  char *tempfile = write_key_to_temp (key);
+  char *tempfile =
+    volume_key ? write_volume_key_to_temp (key) : write_key_to_temp (key);
   if (!tempfile)
     return -1;
 
@@ -109,7 +163,10 @@ luks_open (const char *device, const char *key, const char *mapname,
   size_t i = 0;
 
   ADD_ARG (argv, i, str_cryptsetup);
-  ADD_ARG (argv, i, "-d");
+  /* With the volume key, no key slot has to be unlocked, so the slow
+   * key derivation is skipped.
+   */
+  ADD_ARG (argv, i, volume_key ? "--master-key-file" : "-d");
   ADD_ARG (argv, i, tempfile);
   if (readonly) ADD_ARG (argv, i, "--readonly");
   ADD_ARG (argv, i, "luksOpen");
@@ -134,13 +191,20 @@ luks_open (const char *device, const char *key, const char *mapname,
 int
 do_luks_open (const char *device, const char *key, const char *mapname)
 {
-  return luks_open (device, key, mapname, 0);
+  return luks_open (device, key, mapname, 0, 0);
 }
 
 int
 do_luks_open_ro (const char *device, const char *key, const char *mapname)
 {
-  return luks_open (device, key, mapname, 1);
+  return luks_open (device, key, mapname, 1, 0);
+}
+
+int
+do_luks_open_volume_key (const char *device, const char *volumekey,
+                         const char *mapname)
+{
+  return luks_open (device, volumekey, mapname, 0, 1);
 }
 
 int
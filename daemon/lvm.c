@@ -27,6 +27,8 @@
 #include <sys/stat.h>
 #include <dirent.h>
 
+#include <yajl/yajl_tree.h>
+
 #include "daemon.h"
 #include "c-ctype.h"
 #include "actions.h"
@@ -1119,3 +1121,213 @@ do_vgchange_uuid_all (void)
 
   return 0;
 }
+
+/* Return the string value of 'key' in a JSON object from lvm
+ * fullreport, or "" if it is missing.  LVM prints every value as a
+ * string.
+ */
+static const char *
+report_field (yajl_val obj, const char *key)
+{
+  const char *path[] = { key, NULL };
+  yajl_val v;
+
+  v = yajl_tree_get (obj, path, yajl_t_string);
+  if (v == NULL)
+    return "";
+  return YAJL_GET_STRING (v);
+}
+
+static int64_t
+report_size (yajl_val obj, const char *key)
+{
+  const char *str = report_field (obj, key);
+  int64_t r;
+
+  if (sscanf (str, "%" SCNi64, &r) != 1)
+    return 0;
+  return r;
+}
+
+static yajl_val
+report_array (yajl_val obj, const char *key)
+{
+  const char *path[] = { key, NULL };
+
+  return yajl_tree_get (obj, path, yajl_t_array);
+}
+
+static int
+add_lvm_object (guestfs_int_lvm_object_list *ret, const char *type,
+                const char *name, const char *uuid, const char *attr,
+                int64_t size, int64_t free_,
+                const char *vg_name, const char *vg_uuid)
+{
+  guestfs_int_lvm_object *p;
+  guestfs_int_lvm_object *obj;
+
+  p = realloc (ret->guestfs_int_lvm_object_list_val,
+               sizeof (guestfs_int_lvm_object) *
+               (ret->guestfs_int_lvm_object_list_len + 1));
+  if (p == NULL) {
+    reply_with_perror ("realloc");
+    return -1;
+  }
+  ret->guestfs_int_lvm_object_list_val = p;
+  obj = &p[ret->guestfs_int_lvm_object_list_len];
+  memset (obj, 0, sizeof *obj);
+  ret->guestfs_int_lvm_object_list_len++;
+
+  obj->lo_size = size;
+  obj->lo_free = free_;
+  if ((obj->lo_type = strdup (type)) == NULL ||
+      (obj->lo_name = strdup (name)) == NULL ||
+      (obj->lo_uuid = strdup (uuid)) == NULL ||
+      (obj->lo_attr = strdup (attr)) == NULL ||
+      (obj->lo_vg_name = strdup (vg_name)) == NULL ||
+      (obj->lo_vg_uuid = strdup (vg_uuid)) == NULL) {
+    reply_with_perror ("strdup");
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Add the objects in one element of the "report" array.  Each
+ * element is one VG with its PVs and LVs, or the orphan PVs.
+ */
+static int
+add_report_item (guestfs_int_lvm_object_list *ret, yajl_val item)
+{
+  yajl_val vgs, pvs, lvs;
+  const char *vg_name = "", *vg_uuid = "";
+  size_t i;
+
+  vgs = report_array (item, "vg");
+  if (vgs && YAJL_GET_ARRAY (vgs)->len > 0) {
+    yajl_val vg = YAJL_GET_ARRAY (vgs)->values[0];
+
+    /* Orphan PVs may be reported in a "#orphans" VG. */
+    if (report_field (vg, "vg_name")[0] != '#') {
+      vg_name = report_field (vg, "vg_name");
+      vg_uuid = report_field (vg, "vg_uuid");
+    }
+    if (STRNEQ (vg_name, "") &&
+        add_lvm_object (ret, "vg", vg_name, vg_uuid,
+                        report_field (vg, "vg_attr"),
+                        report_size (vg, "vg_size"),
+                        report_size (vg, "vg_free"),
+                        vg_name, vg_uuid) == -1)
+      return -1;
+  }
+
+  pvs = report_array (item, "pv");
+  for (i = 0; pvs && i < YAJL_GET_ARRAY (pvs)->len; ++i) {
+    yajl_val pv = YAJL_GET_ARRAY (pvs)->values[i];
+    const char *pv_name = report_field (pv, "pv_name");
+
+    /* Missing PVs (RHBZ#1054761). */
+    if (STREQ (pv_name, "") ||
+        STRPREFIX (pv_name, "unknown device") ||
+        STREQ (pv_name, "[unknown]"))
+      continue;
+
+    if (add_lvm_object (ret, "pv", pv_name,
+                        report_field (pv, "pv_uuid"),
+                        report_field (pv, "pv_attr"),
+                        report_size (pv, "pv_size"),
+                        report_size (pv, "pv_free"),
+                        vg_name, vg_uuid) == -1)
+      return -1;
+  }
+
+  lvs = report_array (item, "lv");
+  for (i = 0; lvs && i < YAJL_GET_ARRAY (lvs)->len; ++i) {
+    yajl_val lv = YAJL_GET_ARRAY (lvs)->values[i];
+    const char *skip = report_field (lv, "lv_skip_activation");
+    CLEANUP_FREE char *lv_path = NULL;
+
+    /* The same LVs as do_lvs returns. */
+    if (strstr (report_field (lv, "lv_role"), "public") == NULL ||
+        (STRNEQ (skip, "") && STRNEQ (skip, "0")))
+      continue;
+
+    if (asprintf (&lv_path, "/dev/%s/%s",
+                  vg_name, report_field (lv, "lv_name")) == -1) {
+      reply_with_perror ("asprintf");
+      return -1;
+    }
+
+    if (add_lvm_object (ret, "lv", lv_path,
+                        report_field (lv, "lv_uuid"),
+                        report_field (lv, "lv_attr"),
+                        report_size (lv, "lv_size"),
+                        0,
+                        vg_name, vg_uuid) == -1)
+      return -1;
+  }
+
+  return 0;
+}
+
+guestfs_int_lvm_object_list *
+do_lvm_report (void)
+{
+  CLEANUP_FREE char *out = NULL, *err = NULL;
+  const char *report_path[] = { "report", NULL };
+  char parse_error[1024];
+  yajl_val tree, report;
+  guestfs_int_lvm_object_list *ret;
+  size_t i;
+  int r;
+
+  r = command (&out, &err,
+               str_lvm, "fullreport",
+               "--reportformat", "json",
+               "--units", "b", "--nosuffix",
+               "--configreport", "vg",
+               "-o", "vg_name,vg_uuid,vg_attr,vg_size,vg_free",
+               "--configreport", "pv",
+               "-o", "pv_name,pv_uuid,pv_attr,pv_size,pv_free",
+               "--configreport", "lv",
+               "-o", "lv_name,lv_uuid,lv_attr,lv_size,"
+               "lv_role,lv_skip_activation",
+               NULL);
+  if (r == -1) {
+    reply_with_error ("%s", err);
+    return NULL;
+  }
+
+  tree = yajl_tree_parse (out, parse_error, sizeof parse_error);
+  if (tree == NULL) {
+    reply_with_error ("parse error: %s",
+                      strlen (parse_error) ? parse_error : "unknown error");
+    return NULL;
+  }
+
+  report = yajl_tree_get (tree, report_path, yajl_t_array);
+  if (report == NULL) {
+    reply_with_error ("no report in the output of lvm fullreport");
+    yajl_tree_free (tree);
+    return NULL;
+  }
+
+  ret = calloc (1, sizeof *ret);
+  if (ret == NULL) {
+    reply_with_perror ("calloc");
+    yajl_tree_free (tree);
+    return NULL;
+  }
+
+  for (i = 0; i < YAJL_GET_ARRAY (report)->len; ++i) {
+    if (add_report_item (ret, YAJL_GET_ARRAY (report)->values[i]) == -1) {
+      yajl_tree_free (tree);
+      xdr_free ((xdrproc_t) xdr_guestfs_int_lvm_object_list, (char *) ret);
+      free (ret);
+      return NULL;
+    }
+  }
+
+  yajl_tree_free (tree);
+  return ret;
+}
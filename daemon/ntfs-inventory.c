@@ -0,0 +1,774 @@
+/* libguestfs - the guestfsd daemon
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* List the files of an NTFS filesystem by reading the $MFT (master
+ * file table) directly, without ntfs-3g.  Only the parts of the
+ * on-disk format needed for this are parsed.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <endian.h>
+
+#include "guestfs_protocol.h"
+#include "daemon.h"
+#include "actions.h"
+
+/* Size of the reads of the $MFT. */
+#define READ_SIZE (1024 * 1024)
+
+/* MFT record numbers. */
+#define MFT_RECORD_ROOT 5
+#define MFT_FIRST_USER_RECORD 16
+
+/* MFT record header flags. */
+#define MFT_RECORD_IN_USE 0x01
+#define MFT_RECORD_IS_DIRECTORY 0x02
+
+/* Attribute types. */
+#define AT_STANDARD_INFORMATION 0x10
+#define AT_FILE_NAME 0x30
+#define AT_DATA 0x80
+#define AT_END 0xffffffff
+
+/* The update sequence protects every 512 bytes of a record,
+ * whatever the sector size.
+ */
+#define USA_STRIDE 512
+
+#define FILE_NAME_DOS 2
+#define FILE_ATTRIBUTE_DIRECTORY 0x10
+
+/* Seconds between 1601-01-01 (the NTFS epoch) and 1970-01-01. */
+#define NTFS_TIME_OFFSET INT64_C(11644473600)
+
+#define MREF(r) ((r) & UINT64_C(0xffffffffffff))
+#define MSEQ(r) ((uint16_t) ((r) >> 48))
+
+struct record_info {
+  uint16_t seq;
+  uint16_t flags;               /* 0 if unused */
+  uint32_t attributes;
+  uint64_t size;
+  int64_t crtime, mtime, atime;
+  size_t name;                  /* first name of the file */
+  char *path;                   /* for directories, once computed */
+};
+
+/* A $FILE_NAME attribute, ie. a link to the file from a directory. */
+struct name_entry {
+  uint64_t record;
+  uint64_t parent;              /* including the sequence number */
+  size_t name;                  /* offset in the names buffer */
+  size_t len;
+  size_t next;                  /* next name of the same file */
+};
+
+#define NO_NAME ((size_t) -1)
+
+/* A run of the $MFT data. */
+struct run {
+  uint64_t lcn;
+  uint64_t length;
+};
+
+struct inventory {
+  int fd;
+  uint64_t cluster_size;
+  uint32_t record_size;
+  uint32_t sector_size;
+
+  struct run *runs;
+  size_t nr_runs;
+
+  struct record_info *records;
+  uint64_t nr_records;
+
+  struct name_entry *names;
+  size_t nr_names, names_alloc;
+  char *strings;
+  size_t strings_len, strings_alloc;
+
+  /* Output buffer. */
+  char *out;
+  size_t out_len;
+};
+
+static inline uint16_t
+get16 (const unsigned char *p)
+{
+  uint16_t v;
+  memcpy (&v, p, sizeof v);
+  return le16toh (v);
+}
+
+static inline uint32_t
+get32 (const unsigned char *p)
+{
+  uint32_t v;
+  memcpy (&v, p, sizeof v);
+  return le32toh (v);
+}
+
+static inline uint64_t
+get64 (const unsigned char *p)
+{
+  uint64_t v;
+  memcpy (&v, p, sizeof v);
+  return le64toh (v);
+}
+
+static int64_t
+ntfs_time (uint64_t t)
+{
+  return (int64_t) (t / 10000000) - NTFS_TIME_OFFSET;
+}
+
+/* Check the signature of a record and undo the update sequence
+ * ("fixups") which protects it against torn writes.  Returns false if
+ * the record is not valid.
+ */
+static int
+fixup_record (struct inventory *inv, unsigned char *rec)
+{
+  uint16_t usa_offset, usa_count, usn;
+  size_t i;
+
+  if (memcmp (rec, "FILE", 4) != 0)
+    return 0;
+  usa_offset = get16 (&rec[4]);
+  usa_count = get16 (&rec[6]);
+  if (usa_count == 0 ||
+      (uint32_t) (usa_count - 1) * USA_STRIDE != inv->record_size ||
+      (uint32_t) usa_offset + 2 * usa_count > inv->record_size)
+    return 0;
+
+  usn = get16 (&rec[usa_offset]);
+  for (i = 1; i < usa_count; ++i) {
+    unsigned char *end = &rec[i * USA_STRIDE - 2];
+
+    if (get16 (end) != usn)
+      return 0;
+    memcpy (end, &rec[usa_offset + 2*i], 2);
+  }
+  return 1;
+}
+
+/* Iterate over the attributes of a record.  Returns a pointer to the
+ * next attribute and its length, or NULL at the end.
+ */
+static const unsigned char *
+next_attribute (struct inventory *inv, const unsigned char *rec,
+                size_t *offset, uint32_t *type, uint32_t *len)
+{
+  const unsigned char *attr;
+
+  if (*offset + 8 > inv->record_size)
+    return NULL;
+  attr = &rec[*offset];
+  *type = get32 (attr);
+  if (*type == AT_END)
+    return NULL;
+  *len = get32 (&attr[4]);
+  if (*len < 24 || *offset + *len > inv->record_size)
+    return NULL;
+  *offset += *len;
+  return attr;
+}
+
+/* Return the value of a resident attribute, or NULL. */
+static const unsigned char *
+resident_value (const unsigned char *attr, uint32_t len, uint32_t *vlen)
+{
+  uint16_t voffset;
+
+  if (attr[8] != 0)             /* non-resident */
+    return NULL;
+  *vlen = get32 (&attr[0x10]);
+  voffset = get16 (&attr[0x14]);
+  if (*vlen > len || voffset > len - *vlen)
+    return NULL;
+  return &attr[voffset];
+}
+
+/* Decode the runlist (mapping pairs) of the unnamed $DATA attribute
+ * of the $MFT.
+ */
+static int
+decode_mft_runs (struct inventory *inv, const unsigned char *attr,
+                 uint32_t len)
+{
+  const unsigned char *p = &attr[get16 (&attr[0x20])];
+  const unsigned char *end = &attr[len];
+  int64_t lcn = 0;
+
+  while (p < end && *p != 0) {
+    const size_t lsize = *p & 0xf, osize = *p >> 4;
+    uint64_t length = 0;
+    int64_t offset = 0;
+    struct run *r;
+    size_t i;
+
+    if (lsize == 0 || lsize > 8 || osize == 0 || osize > 8 ||
+        p + 1 + lsize + osize > end) {
+      reply_with_error ("$MFT: invalid runlist");
+      return -1;
+    }
+    for (i = 0; i < lsize; ++i)
+      length |= (uint64_t) p[1+i] << (8*i);
+    for (i = 0; i < osize; ++i)
+      offset |= (uint64_t) p[1+lsize+i] << (8*i);
+    /* The offset is signed. */
+    if (osize < 8 && (p[lsize+osize] & 0x80))
+      offset |= -((int64_t) 1 << (8*osize));
+    lcn += offset;
+    p += 1 + lsize + osize;
+
+    r = realloc (inv->runs, (inv->nr_runs+1) * sizeof *r);
+    if (r == NULL) {
+      reply_with_perror ("realloc");
+      return -1;
+    }
+    inv->runs = r;
+    inv->runs[inv->nr_runs].lcn = lcn;
+    inv->runs[inv->nr_runs].length = length;
+    inv->nr_runs++;
+  }
+
+  return 0;
+}
+
+/* Read the boot sector and the first record of the $MFT, to find
+ * where the rest of the $MFT is.
+ */
+static int
+read_boot_sector (struct inventory *inv, const char *device)
+{
+  unsigned char boot[512];
+  CLEANUP_FREE unsigned char *rec = NULL;
+  const unsigned char *attr;
+  uint8_t spc;
+  int8_t cpr;
+  uint64_t mft_lcn, data_size = 0, clusters = 0;
+  uint32_t type, len;
+  size_t offset, i;
+
+  if (pread (inv->fd, boot, sizeof boot, 0) != sizeof boot) {
+    reply_with_perror ("read: %s", device);
+    return -1;
+  }
+  if (memcmp (&boot[3], "NTFS    ", 8) != 0) {
+    reply_with_error ("%s: not an NTFS filesystem", device);
+    return -1;
+  }
+
+  inv->sector_size = get16 (&boot[0x0b]);
+  spc = boot[0x0d];
+  if (spc > 0x80)
+    inv->cluster_size = (uint64_t) 1 << (256 - spc);
+  else
+    inv->cluster_size = (uint64_t) spc * inv->sector_size;
+  mft_lcn = get64 (&boot[0x30]);
+  cpr = (int8_t) boot[0x40];
+  if (cpr < 0)
+    inv->record_size = cpr >= -31 ? UINT32_C(1) << -cpr : 0;
+  else
+    inv->record_size = cpr * inv->cluster_size;
+
+  if (inv->sector_size < 256 || inv->sector_size > 4096 ||
+      inv->cluster_size == 0 || inv->cluster_size > 2*1024*1024 ||
+      inv->record_size < inv->sector_size ||
+      inv->record_size > 64*1024 ||
+      inv->record_size % USA_STRIDE != 0) {
+    reply_with_error ("%s: invalid NTFS boot sector", device);
+    return -1;
+  }
+
+  rec = malloc (inv->record_size);
+  if (rec == NULL) {
+    reply_with_perror ("malloc");
+    return -1;
+  }
+  if (pread (inv->fd, rec, inv->record_size, mft_lcn * inv->cluster_size)
+      != (ssize_t) inv->record_size) {
+    reply_with_perror ("read: %s: $MFT", device);
+    return -1;
+  }
+  if (!fixup_record (inv, rec)) {
+    reply_with_error ("%s: $MFT record is corrupt", device);
+    return -1;
+  }
+
+  offset = get16 (&rec[0x14]);
+  while ((attr = next_attribute (inv, rec, &offset, &type, &len)) != NULL) {
+    if (type != AT_DATA || attr[9] != 0 /* named */ || attr[8] == 0)
+      continue;
+    if (len < 0x40) {
+      reply_with_error ("%s: $MFT data attribute is corrupt", device);
+      return -1;
+    }
+    data_size = get64 (&attr[0x30]);
+    if (decode_mft_runs (inv, attr, len) == -1)
+      return -1;
+    break;
+  }
+
+  /* If the $MFT is so fragmented that its runlist continues in
+   * another record, give up rather than listing only part of it.
+   */
+  for (i = 0; i < inv->nr_runs; ++i)
+    clusters += inv->runs[i].length;
+  if (data_size == 0 || clusters * inv->cluster_size < data_size) {
+    reply_with_error ("%s: the $MFT is too fragmented", device);
+    return -1;
+  }
+
+  inv->nr_records = data_size / inv->record_size;
+  inv->records = calloc (inv->nr_records, sizeof *inv->records);
+  if (inv->records == NULL) {
+    reply_with_perror ("calloc");
+    return -1;
+  }
+  for (i = 0; i < inv->nr_records; ++i)
+    inv->records[i].name = NO_NAME;
+
+  return 0;
+}
+
+/* Convert a UTF-16LE name to UTF-8 and add it to the names buffer.
+ * iconv does not work in the appliance, so this is done by hand.
+ */
+static int
+add_utf16_name (struct inventory *inv, const unsigned char *name, size_t n,
+                size_t *len_ret)
+{
+  size_t i, start = inv->strings_len;
+  uint32_t c, c2;
+  char *p;
+
+  /* Each UTF-16 code unit becomes at most 3 bytes of UTF-8. */
+  if (inv->strings_len + 3*n > inv->strings_alloc) {
+    size_t alloc = MAX (2 * inv->strings_alloc, inv->strings_len + 3*n);
+
+    p = realloc (inv->strings, alloc);
+    if (p == NULL)
+      return -1;
+    inv->strings = p;
+    inv->strings_alloc = alloc;
+  }
+  p = &inv->strings[inv->strings_len];
+
+  for (i = 0; i < n; ++i) {
+    c = get16 (&name[2*i]);
+    if (c >= 0xd800 && c < 0xdc00 && i+1 < n &&
+        (c2 = get16 (&name[2*i+2])) >= 0xdc00 && c2 < 0xe000) {
+      c = 0x10000 + ((c - 0xd800) << 10) + (c2 - 0xdc00);
+      i++;
+    }
+    else if (c >= 0xd800 && c < 0xe000)
+      c = 0xfffd;               /* unpaired surrogate */
+
+    if (c < 0x80)
+      *p++ = c;
+    else if (c < 0x800) {
+      *p++ = 0xc0 | (c >> 6);
+      *p++ = 0x80 | (c & 0x3f);
+    }
+    else if (c < 0x10000) {
+      *p++ = 0xe0 | (c >> 12);
+      *p++ = 0x80 | ((c >> 6) & 0x3f);
+      *p++ = 0x80 | (c & 0x3f);
+    }
+    else {
+      *p++ = 0xf0 | (c >> 18);
+      *p++ = 0x80 | ((c >> 12) & 0x3f);
+      *p++ = 0x80 | ((c >> 6) & 0x3f);
+      *p++ = 0x80 | (c & 0x3f);
+    }
+  }
+
+  inv->strings_len = p - inv->strings;
+  *len_ret = inv->strings_len - start;
+  return 0;
+}
+
+static int
+add_file_name (struct inventory *inv, uint64_t record,
+               const unsigned char *fn, uint32_t vlen)
+{
+  struct record_info *ri = &inv->records[record];
+  struct name_entry *e;
+  size_t n;
+
+  if (vlen < 0x42)
+    return 0;
+  n = fn[0x40];
+  if (fn[0x41] == FILE_NAME_DOS || 0x42 + 2*n > vlen)
+    return 0;
+
+  if (inv->nr_names == inv->names_alloc) {
+    size_t alloc = inv->names_alloc > 0 ? 2 * inv->names_alloc : 1024;
+
+    e = realloc (inv->names, alloc * sizeof *e);
+    if (e == NULL)
+      return -1;
+    inv->names = e;
+    inv->names_alloc = alloc;
+  }
+  e = &inv->names[inv->nr_names];
+  e->record = record;
+  e->parent = get64 (fn);
+  e->name = inv->strings_len;
+  if (add_utf16_name (inv, &fn[0x42], n, &e->len) == -1)
+    return -1;
+
+  /* Keep the names of each file in the order they are found. */
+  e->next = NO_NAME;
+  if (ri->name == NO_NAME)
+    ri->name = inv->nr_names;
+  else {
+    size_t i = ri->name;
+
+    while (inv->names[i].next != NO_NAME)
+      i = inv->names[i].next;
+    inv->names[i].next = inv->nr_names;
+  }
+  inv->nr_names++;
+  return 0;
+}
+
+/* Parse one record of the $MFT.  Extension records, which hold
+ * attributes which did not fit in the base record of a file, are
+ * merged into the base record.
+ */
+static int
+parse_record (struct inventory *inv, uint64_t nr, unsigned char *rec)
+{
+  const unsigned char *attr, *value;
+  struct record_info *ri;
+  uint64_t base;
+  uint32_t type, len, vlen;
+  uint16_t flags;
+  size_t offset;
+
+  if (!fixup_record (inv, rec))
+    return 0;
+  flags = get16 (&rec[0x16]);
+  if (!(flags & MFT_RECORD_IN_USE))
+    return 0;
+
+  base = MREF (get64 (&rec[0x20]));
+  if (base == 0) {
+    ri = &inv->records[nr];
+    ri->seq = get16 (&rec[0x10]);
+    ri->flags = flags;
+    if (flags & MFT_RECORD_IS_DIRECTORY)
+      ri->attributes |= FILE_ATTRIBUTE_DIRECTORY;
+  }
+  else if (base < inv->nr_records) {
+    nr = base;
+    ri = &inv->records[nr];
+  }
+  else
+    return 0;
+
+  offset = get16 (&rec[0x14]);
+  while ((attr = next_attribute (inv, rec, &offset, &type, &len)) != NULL) {
+    switch (type) {
+    case AT_STANDARD_INFORMATION:
+      value = resident_value (attr, len, &vlen);
+      if (value == NULL || vlen < 0x24)
+        break;
+      ri->crtime = ntfs_time (get64 (&value[0]));
+      ri->mtime = ntfs_time (get64 (&value[8]));
+      ri->atime = ntfs_time (get64 (&value[24]));
+      ri->attributes |= get32 (&value[32]);
+      break;
+
+    case AT_FILE_NAME:
+      value = resident_value (attr, len, &vlen);
+      if (value && add_file_name (inv, nr, value, vlen) == -1) {
+        reply_with_perror ("realloc");
+        return -1;
+      }
+      break;
+
+    case AT_DATA:
+      if (attr[9] != 0)         /* named stream */
+        break;
+      if (attr[8] == 0) {
+        if (resident_value (attr, len, &vlen))
+          ri->size = vlen;
+      }
+      else if (len >= 0x38 && get64 (&attr[0x10]) == 0 /* first extent */)
+        ri->size = get64 (&attr[0x30]);
+      break;
+    }
+  }
+
+  return 0;
+}
+
+/* Read the whole $MFT in order, with large reads. */
+static int
+read_mft (struct inventory *inv, const char *device)
+{
+  CLEANUP_FREE unsigned char *buf = NULL;
+  const size_t buf_size = READ_SIZE - READ_SIZE % inv->record_size;
+  uint64_t nr = 0;
+  size_t i;
+
+  buf = malloc (buf_size);
+  if (buf == NULL) {
+    reply_with_perror ("malloc");
+    return -1;
+  }
+
+  posix_fadvise (inv->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  for (i = 0; i < inv->nr_runs && nr < inv->nr_records; ++i) {
+    uint64_t pos = inv->runs[i].lcn * inv->cluster_size;
+    uint64_t left = inv->runs[i].length * inv->cluster_size;
+
+    while (left >= inv->record_size && nr < inv->nr_records) {
+      size_t n = MIN (left, buf_size);
+      size_t j;
+
+      n = MIN (n - n % inv->record_size,
+               (inv->nr_records - nr) * inv->record_size);
+      if (pread (inv->fd, buf, n, pos) != (ssize_t) n) {
+        reply_with_perror ("read: %s: $MFT", device);
+        return -1;
+      }
+      for (j = 0; j < n; j += inv->record_size) {
+        if (parse_record (inv, nr++, &buf[j]) == -1)
+          return -1;
+      }
+      pos += n;
+      left -= n;
+    }
+  }
+
+  return 0;
+}
+
+/* Return the path of a directory, or NULL if it cannot be reached
+ * from the root directory.  The root directory is "".
+ */
+static const char *
+dir_path (struct inventory *inv, uint64_t ref, int depth)
+{
+  const uint64_t nr = MREF (ref);
+  struct record_info *ri;
+  const struct name_entry *e;
+  const char *parent;
+
+  if (nr >= inv->nr_records)
+    return NULL;
+  ri = &inv->records[nr];
+  if (!(ri->flags & MFT_RECORD_IS_DIRECTORY) || ri->seq != MSEQ (ref))
+    return NULL;
+  if (ri->path)
+    return ri->path;
+
+  if (nr == MFT_RECORD_ROOT)
+    ri->path = strdup ("");
+  else {
+    /* The metadata files and $Extend are not listed.  The depth
+     * limit stops loops in a corrupt filesystem.
+     */
+    if (nr < MFT_FIRST_USER_RECORD || ri->name == NO_NAME || depth > 4096)
+      return NULL;
+    e = &inv->names[ri->name];
+    parent = dir_path (inv, e->parent, depth+1);
+    if (parent == NULL)
+      return NULL;
+    if (asprintf (&ri->path, "%s/%.*s",
+                  parent, (int) e->len, &inv->strings[e->name]) == -1)
+      ri->path = NULL;
+  }
+  if (ri->path == NULL)
+    errno = ENOMEM;
+  return ri->path;
+}
+
+static int
+add_output (struct inventory *inv, const char *str, size_t len)
+{
+  size_t n;
+  int r;
+
+  while (len > 0) {
+    n = MIN (len, GUESTFS_MAX_CHUNK_SIZE - inv->out_len);
+    memcpy (inv->out + inv->out_len, str, n);
+    inv->out_len += n;
+    str += n;
+    len -= n;
+
+    if (inv->out_len == GUESTFS_MAX_CHUNK_SIZE) {
+      r = send_file_write (inv->out, inv->out_len);
+      if (r < 0)
+        return r;
+      inv->out_len = 0;
+    }
+  }
+
+  return 0;
+}
+
+static int
+send_record (struct inventory *inv, const char *dir,
+             const char *name, size_t len, uint64_t nr)
+{
+  const struct record_info *ri = &inv->records[nr];
+  char numbers[6 * 21];
+  int n, r;
+
+  r = add_output (inv, dir, strlen (dir));
+  if (r == 0)
+    r = add_output (inv, "/", 1);
+  if (r == 0)
+    r = add_output (inv, name, len);
+  if (r == 0)
+    r = add_output (inv, "", 1);
+  if (r < 0)
+    return r;
+
+  n = snprintf (numbers, sizeof numbers,
+                "%" PRIu64 "%c%" PRIu32 "%c%" PRIu64 "%c"
+                "%" PRIi64 "%c%" PRIi64 "%c%" PRIi64 "%c",
+                nr, 0, ri->attributes, 0, ri->size, 0,
+                ri->crtime, 0, ri->mtime, 0, ri->atime, 0);
+  return add_output (inv, numbers, n);
+}
+
+static int
+send_inventory (struct inventory *inv)
+{
+  const struct name_entry *e;
+  const char *dir;
+  uint64_t nr;
+  size_t i;
+  int r;
+
+  if (MFT_RECORD_ROOT < inv->nr_records &&
+      inv->records[MFT_RECORD_ROOT].flags & MFT_RECORD_IS_DIRECTORY) {
+    r = send_record (inv, "", "", 0, MFT_RECORD_ROOT);
+    if (r < 0)
+      return r;
+  }
+
+  for (nr = MFT_FIRST_USER_RECORD; nr < inv->nr_records; ++nr) {
+    if (!(inv->records[nr].flags & MFT_RECORD_IN_USE))
+      continue;
+    for (i = inv->records[nr].name; i != NO_NAME; i = e->next) {
+      e = &inv->names[i];
+
+      errno = 0;
+      dir = dir_path (inv, e->parent, 0);
+      if (dir == NULL) {
+        if (errno == ENOMEM)
+          return -1;
+        continue;
+      }
+
+      r = send_record (inv, dir, &inv->strings[e->name], e->len, nr);
+      if (r < 0)
+        return r;
+    }
+  }
+
+  if (inv->out_len > 0)
+    return send_file_write (inv->out, inv->out_len);
+  return 0;
+}
+
+static void
+free_inventory (struct inventory *inv)
+{
+  uint64_t i;
+
+  if (inv->records) {
+    for (i = 0; i < inv->nr_records; ++i)
+      free (inv->records[i].path);
+  }
+  free (inv->records);
+  free (inv->runs);
+  free (inv->names);
+  free (inv->strings);
+  free (inv->out);
+  if (inv->fd >= 0)
+    close (inv->fd);
+}
+
+int
+do_ntfs_inventory (const char *device)
+{
+  struct inventory inv = { .fd = -1 };
+  int r;
+
+  inv.fd = open (device, O_RDONLY|O_CLOEXEC);
+  if (inv.fd == -1) {
+    reply_with_perror ("open: %s", device);
+    return -1;
+  }
+
+  inv.out = malloc (GUESTFS_MAX_CHUNK_SIZE);
+  if (inv.out == NULL) {
+    reply_with_perror ("malloc");
+    goto error;
+  }
+
+  if (read_boot_sector (&inv, device) == -1 ||
+      read_mft (&inv, device) == -1)
+    goto error;
+
+  /* Now we must send the reply message, before the file contents.  After
+   * this there is no opportunity in the protocol to send any error
+   * message back.  Instead we can only cancel the transfer.
+   */
+  reply (NULL, NULL);
+
+  r = send_inventory (&inv);
+  free_inventory (&inv);
+
+  if (r == -2)                  /* Cancelled by the library. */
+    return -1;
+
+  if (r == -1) {
+    fprintf (stderr, "ntfs_inventory: %s: %m\n", device);
+    send_file_end (1);          /* Cancel. */
+    return -1;
+  }
+
+  if (send_file_end (0))        /* Normal end of file. */
+    return -1;
+
+  return 0;
+
+ error:
+  free_inventory (&inv);
+  return -1;
+}
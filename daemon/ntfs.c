@@ -35,6 +35,7 @@ GUESTFSD_EXT_CMD(str_ntfs3g_probe, ntfs-3g.probe);
 GUESTFSD_EXT_CMD(str_ntfsresize, ntfsresize);
 GUESTFSD_EXT_CMD(str_ntfsfix, ntfsfix);
 GUESTFSD_EXT_CMD(str_ntfslabel, ntfslabel);
+GUESTFSD_EXT_CMD(str_ntfscat, ntfscat);
 
 int
 optgroup_ntfs3g_available (void)
@@ -271,15 +272,8 @@ int
 do_ntfscat_i (const mountable_t *mountable, int64_t inode)
 {
   int r;
-  FILE *fp;
-  CLEANUP_FREE char *cmd = NULL;
-  CLEANUP_FREE char *buffer = NULL;
-
-  buffer = malloc (GUESTFS_MAX_CHUNK_SIZE);
-  if (buffer == NULL) {
-    reply_with_perror ("malloc");
-    return -1;
-  }
+  char inode_str[32];
+  CLEANUP_FREE char *err = NULL;
 
   /* Inode must be greater than 0 */
   if (inode < 0) {
@@ -287,50 +281,21 @@ do_ntfscat_i (const mountable_t *mountable, int64_t inode)
     return -1;
   }
 
-  /* Construct the command. */
-  if (asprintf (&cmd, "ntfscat -i %" PRIi64 " %s",
-                inode, mountable->device) == -1) {
-    reply_with_perror ("asprintf");
-    return -1;
-  }
-
-  if (verbose)
-    fprintf (stderr, "%s\n", cmd);
-
-  fp = popen (cmd, "r");
-  if (fp == NULL) {
-    reply_with_perror ("%s", cmd);
-    return -1;
-  }
+  snprintf (inode_str, sizeof inode_str, "%" PRIi64, inode);
 
   /* Now we must send the reply message, before the file contents.  After
    * this there is no opportunity in the protocol to send any error
-   * message back.  Instead we can only cancel the transfer.
+   * message back.  Instead we can only cancel the transfer, which
+   * commandf does if ntfscat fails.
    */
   reply (NULL, NULL);
 
-  while ((r = fread (buffer, 1, GUESTFS_MAX_CHUNK_SIZE, fp)) > 0) {
-    if (send_file_write (buffer, r) < 0) {
-      pclose (fp);
-      return -1;
-    }
-  }
-
-  if (ferror (fp)) {
-    fprintf (stderr, "fread: %" PRIi64 ": %m\n", inode);
-    send_file_end (1);		/* Cancel. */
-    pclose (fp);
-    return -1;
-  }
-
-  if (pclose (fp) != 0) {
-    fprintf (stderr, "pclose: %" PRIi64 ": %m\n", inode);
-    send_file_end (1);		/* Cancel. */
+  r = commandf (NULL, &err, COMMAND_FLAG_STDOUT_TO_SEND_FILE,
+                str_ntfscat, "-i", inode_str, mountable->device, NULL);
+  if (r == -1) {
+    fprintf (stderr, "ntfscat: %" PRIi64 ": %s\n", inode, err);
     return -1;
   }
 
-  if (send_file_end (0))	/* Normal end of file. */
-    return -1;
-
   return 0;
 }
@@ -25,6 +25,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <error.h>
+#include <endian.h>
 
 #include "read-file.h"
 
@@ -33,6 +34,135 @@
 #include "optgroups.h"
 
 GUESTFSD_EXT_CMD(str_ntfsclone, ntfsclone);
+GUESTFSD_EXT_CMD(str_compress, compress);
+GUESTFSD_EXT_CMD(str_gzip, gzip);
+GUESTFSD_EXT_CMD(str_bzip2, bzip2);
+GUESTFSD_EXT_CMD(str_xz, xz);
+GUESTFSD_EXT_CMD(str_lzop, lzop);
+GUESTFSD_EXT_CMD(str_zstd, zstd);
+
+/* ntfsclone --save-image starts the image with this header (the
+ * fields are little endian and not aligned).  It gives the number of
+ * clusters in use, which is what the rest of the image mostly
+ * consists of, so it is used to estimate the size of the image for
+ * progress messages.
+ */
+#define IMAGE_MAGIC "\0ntfsclone-image"
+#define IMAGE_MAGIC_SIZE 16
+#define IMAGE_HDR_CLUSTER_SIZE 18
+#define IMAGE_HDR_INUSE 38
+#define IMAGE_HDR_OFFSET_TO_DATA 46
+#define IMAGE_HDR_SIZE 50
+
+struct image_progress {
+  unsigned char hdr[IMAGE_HDR_SIZE];
+  uint64_t position;            /* bytes of the image read so far */
+  uint64_t total;               /* estimated size, or 0 if unknown */
+};
+
+static void
+parse_image_header (struct image_progress *p)
+{
+  uint32_t cluster_size, offset;
+  uint64_t inuse;
+
+  if (memcmp (p->hdr, IMAGE_MAGIC, IMAGE_MAGIC_SIZE) != 0)
+    return;
+
+  memcpy (&cluster_size, &p->hdr[IMAGE_HDR_CLUSTER_SIZE], 4);
+  memcpy (&inuse, &p->hdr[IMAGE_HDR_INUSE], 8);
+  memcpy (&offset, &p->hdr[IMAGE_HDR_OFFSET_TO_DATA], 4);
+  cluster_size = le32toh (cluster_size);
+  inuse = le64toh (inuse);
+  offset = le32toh (offset);
+
+  /* Each cluster in use is preceded by a one byte command.  The runs
+   * of unused clusters in between take a few bytes each, which are
+   * not counted.
+   */
+  p->total = offset + inuse * (cluster_size + 1);
+
+  if (verbose)
+    fprintf (stderr, "ntfsclone: %" PRIu64 " clusters of %" PRIu32 " bytes in use\n",
+             inuse, cluster_size);
+}
+
+/* Called with the image data as it is read from ntfsclone. */
+static void
+image_progress_cb (void *vp, const char *buf, size_t len)
+{
+  struct image_progress *p = vp;
+
+  if (p->position < IMAGE_HDR_SIZE) {
+    const size_t n = MIN (len, IMAGE_HDR_SIZE - p->position);
+
+    memcpy (&p->hdr[p->position], buf, n);
+    if (p->position + n == IMAGE_HDR_SIZE)
+      parse_image_header (p);
+  }
+  p->position += len;
+
+  if (p->total > 0)
+    notify_progress (MIN (p->position, p->total), p->total);
+}
+
+/* Make the external command which compresses or decompresses the
+ * image in 'ret'.  Returns -1 if the compression type is not known or
+ * the program is not in the appliance, without replying.
+ */
+static int
+get_filter (const char *compress, int decompress, char *ret, size_t n)
+{
+  const char *prog, *flags;
+
+  if (STREQ (compress, "compress")) {
+    prog = str_compress;
+    flags = decompress ? " -dc" : " -c";
+  }
+  else if (STREQ (compress, "gzip")) {
+    prog = str_gzip;
+    flags = decompress ? " -dc" : " -c";
+  }
+  else if (STREQ (compress, "bzip2")) {
+    prog = str_bzip2;
+    flags = decompress ? " -dc" : " -c";
+  }
+  else if (STREQ (compress, "xz")) {
+    prog = str_xz;
+    flags = decompress ? " -dc -T0" : " -c -T0";
+  }
+  else if (STREQ (compress, "lzop")) {
+    prog = str_lzop;
+    flags = decompress ? " -dc" : " -c";
+  }
+  else if (STREQ (compress, "zstd")) {
+    prog = str_zstd;
+    flags = decompress ? " -dc -q" : " -c -q -T0";
+  }
+  else {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (!prog_exists (prog)) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  snprintf (ret, n, "%s%s", prog, flags);
+  return 0;
+}
+
+/* Reply with the error from get_filter. */
+static void
+reply_with_filter_error (int err, const char *compress)
+{
+  if (err == ENOENT)
+    /* note: substring "not supported" must appear in this error */
+    reply_with_error_errno (ENOTSUP, "compression type %s is not supported, because the external program is not available in the appliance", compress);
+  else
+    reply_with_error ("unknown compression type: %s", compress);
+}
 
 /* Read the error file.  Returns a string that the caller must free. */
 static char *
@@ -56,34 +186,72 @@ read_error_file (char *error_file)
   return str;                   /* caller frees */
 }
 
+struct write_cb_data {
+  int fd;
+  uint64_t written;
+};
+
 static int
-write_cb (void *fd_ptr, const void *buf, size_t len)
+write_cb (void *data_vp, const void *buf, size_t len)
 {
-  const int fd = *(int *)fd_ptr;
-  return xwrite (fd, buf, len);
+  struct write_cb_data *data = data_vp;
+
+  if (xwrite (data->fd, buf, len) == -1)
+    return -1;
+
+  data->written += len;
+
+  if (progress_hint > 0)
+    notify_progress (data->written, progress_hint);
+
+  return 0;
 }
 
 /* Has one FileIn parameter. */
+/* Takes optional arguments, consult optargs_bitmask. */
 int
-do_ntfsclone_in (const char *device)
+do_ntfsclone_in (const char *device, const char *compress)
 {
   int err, r;
   FILE *fp;
   CLEANUP_FREE char *cmd = NULL;
   char error_file[] = "/tmp/ntfscloneXXXXXX";
+  char filter[64];
+  struct write_cb_data data = { .written = 0 };
   int fd;
 
+  if (!(optargs_bitmask & GUESTFS_NTFSCLONE_IN_COMPRESS_BITMASK))
+    compress = NULL;
+
+  if (compress && get_filter (compress, 1, filter, sizeof filter) == -1) {
+    err = errno;
+    r = cancel_receive ();
+    reply_with_filter_error (err, compress);
+    return -1;
+  }
+
   fd = mkstemp (error_file);
   if (fd == -1) {
+    err = errno;
+    r = cancel_receive ();
+    errno = err;
     reply_with_perror ("mkstemp");
     return -1;
   }
 
   close (fd);
 
-  /* Construct the command. */
-  if (asprintf (&cmd, "%s -O %s --restore-image - 2> %s",
-                str_ntfsclone, device, error_file) == -1) {
+  /* Construct the command.  The image is decompressed by a separate
+   * process, so it runs in parallel with ntfsclone writing to the
+   * device.
+   */
+  if (compress)
+    r = asprintf (&cmd, "(%s | %s -O %s --restore-image -) 2> %s",
+                  filter, str_ntfsclone, device, error_file);
+  else
+    r = asprintf (&cmd, "%s -O %s --restore-image - 2> %s",
+                  str_ntfsclone, device, error_file);
+  if (r == -1) {
     err = errno;
     r = cancel_receive ();
     errno = err;
@@ -108,9 +276,9 @@ do_ntfsclone_in (const char *device)
   /* The semantics of fwrite are too undefined, so write to the
    * file descriptor directly instead.
    */
-  fd = fileno (fp);
+  data.fd = fileno (fp);
 
-  r = receive_file (write_cb, &fd);
+  r = receive_file (write_cb, &data);
   if (r == -1) {		/* write error */
     cancel_receive ();
     CLEANUP_FREE char *errstr = read_error_file (error_file);
@@ -147,12 +315,30 @@ do_ntfsclone_in (const char *device)
 int
 do_ntfsclone_out (const char *device,
                   int metadataonly, int rescue, int ignorefscheck,
-                  int preservetimestamps, int force)
+                  int preservetimestamps, int force, const char *compress)
 {
   int r;
   FILE *fp;
   CLEANUP_FREE char *cmd = NULL;
   CLEANUP_FREE char *buf = NULL;
+  const char *native_compress = NULL;
+  char filter[64] = "";
+  struct image_progress progress = { .position = 0, .total = 0 };
+
+  if (!(optargs_bitmask & GUESTFS_NTFSCLONE_OUT_METADATAONLY_BITMASK))
+    metadataonly = 0;
+
+  if ((optargs_bitmask & GUESTFS_NTFSCLONE_OUT_COMPRESS_BITMASK)) {
+    /* Where the daemon can compress the image itself on all vCPUs,
+     * ntfsclone writes it uncompressed.
+     */
+    if (native_compress_available (compress))
+      native_compress = compress;
+    else if (get_filter (compress, 0, filter, sizeof filter) == -1) {
+      reply_with_filter_error (errno, compress);
+      return -1;
+    }
+  }
 
   buf = malloc (GUESTFS_MAX_CHUNK_SIZE);
   if (buf == NULL) {
@@ -161,14 +347,15 @@ do_ntfsclone_out (const char *device,
   }
 
   /* Construct the ntfsclone command. */
-  if (asprintf (&cmd, "%s -o - --save-image%s%s%s%s%s %s",
+  if (asprintf (&cmd, "%s -o - --save-image%s%s%s%s%s %s%s%s",
                 str_ntfsclone,
-                (optargs_bitmask & GUESTFS_NTFSCLONE_OUT_METADATAONLY_BITMASK) && metadataonly ? " --metadata" : "",
+                metadataonly ? " --metadata" : "",
                 (optargs_bitmask & GUESTFS_NTFSCLONE_OUT_RESCUE_BITMASK) && rescue ? " --rescue" : "",
                 (optargs_bitmask & GUESTFS_NTFSCLONE_OUT_IGNOREFSCHECK_BITMASK) && ignorefscheck ? " --ignore-fs-check" : "",
                 (optargs_bitmask & GUESTFS_NTFSCLONE_OUT_PRESERVETIMESTAMPS_BITMASK) && preservetimestamps ? " --preserve-timestamps" : "",
                 (optargs_bitmask & GUESTFS_NTFSCLONE_OUT_FORCE_BITMASK) && force ? " --force" : "",
-                device) == -1) {
+                device,
+                filter[0] ? " | " : "", filter) == -1) {
     reply_with_perror ("asprintf");
     return -1;
   }
@@ -188,18 +375,42 @@ do_ntfsclone_out (const char *device,
    */
   reply (NULL, NULL);
 
-  while ((r = fread (buf, 1, GUESTFS_MAX_CHUNK_SIZE, fp)) > 0) {
-    if (send_file_write (buf, r) < 0) {
+  /* Progress messages need the uncompressed image, so there are none
+   * when an external program compresses it.  With metadataonly the
+   * image is much smaller than the clusters in use, so the estimate
+   * would be useless.
+   */
+  if (native_compress) {
+    r = send_compressed_cb (fileno (fp), native_compress, -1,
+                            metadataonly ? NULL : image_progress_cb,
+                            &progress);
+    if (r == -2) {              /* Cancelled by the library. */
+      pclose (fp);
+      return -1;
+    }
+    if (r == -1) {
+      fprintf (stderr, "%s: compression failed\n", device);
+      send_file_end (1);        /* Cancel. */
       pclose (fp);
       return -1;
     }
   }
+  else {
+    while ((r = fread (buf, 1, GUESTFS_MAX_CHUNK_SIZE, fp)) > 0) {
+      if (!filter[0] && !metadataonly)
+        image_progress_cb (&progress, buf, r);
+      if (send_file_write (buf, r) < 0) {
+        pclose (fp);
+        return -1;
+      }
+    }
 
-  if (ferror (fp)) {
-    fprintf (stderr, "fread: %s: %m\n", device);
-    send_file_end (1);		/* Cancel. */
-    pclose (fp);
-    return -1;
+    if (ferror (fp)) {
+      fprintf (stderr, "fread: %s: %m\n", device);
+      send_file_end (1);		/* Cancel. */
+      pclose (fp);
+      return -1;
+    }
   }
 
   if (pclose (fp) != 0) {
@@ -208,6 +419,9 @@ do_ntfsclone_out (const char *device,
     return -1;
   }
 
+  if (progress.total > 0)
+    notify_progress (progress.total, progress.total);
+
   if (send_file_end (0))	/* Normal end of file. */
     return -1;
 
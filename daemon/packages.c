@@ -0,0 +1,594 @@
+/* libguestfs - the guestfsd daemon
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Read the guest package database inside the appliance, so that only
+ * the fields needed by inspect_list_applications2 are sent back to
+ * the library instead of the whole database.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <endian.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "guestfs_protocol.h"
+#include "daemon.h"
+#include "actions.h"
+
+#define MAX_PKG_DB_SIZE (300 * 1000 * 1000)
+
+static int
+add_package (struct stringsbuf *ret,
+             const char *name, const char *epoch, const char *version,
+             const char *release, const char *arch,
+             const char *url, const char *description)
+{
+  if (add_string (ret, name) == -1 ||
+      add_string (ret, epoch ? : "0") == -1 ||
+      add_string (ret, version) == -1 ||
+      add_string (ret, release ? : "") == -1 ||
+      add_string (ret, arch ? : "") == -1 ||
+      add_string (ret, url ? : "") == -1 ||
+      add_string (ret, description ? : "") == -1)
+    return -1;
+  return 0;
+}
+
+/* Split "[epoch:]version[-release]" in place. */
+static void
+split_evr (char *evr, char **epoch, char **version, char **release)
+{
+  char *p;
+
+  p = strchr (evr, ':');
+  if (p) {
+    *p++ = '\0';
+    *epoch = evr;
+  } else {
+    p = evr;
+    *epoch = NULL;
+  }
+  *version = p;
+  p = strchr (p, '-');
+  if (p) {
+    *p++ = '\0';
+    *release = p;
+  }
+  else
+    *release = NULL;
+}
+
+static FILE *
+open_in_sysroot (const char *path)
+{
+  FILE *fp;
+
+  CHROOT_IN;
+  fp = fopen (path, "re");
+  CHROOT_OUT;
+
+  if (fp == NULL)
+    reply_with_perror ("fopen: %s", path);
+  return fp;
+}
+
+static int
+list_packages_deb (struct stringsbuf *ret)
+{
+  FILE *fp;
+  CLEANUP_FREE char *line = NULL;
+  size_t allocsize = 0;
+  ssize_t len;
+  CLEANUP_FREE char *name = NULL, *evr = NULL, *arch = NULL;
+  bool installed = false;
+  char *epoch, *version, *release;
+  int r = 0;
+
+  fp = open_in_sysroot ("/var/lib/dpkg/status");
+  if (fp == NULL)
+    return -1;
+
+  /* See list_applications_deb in the library. */
+  while ((len = getline (&line, &allocsize, fp)) != -1) {
+    if (len > 0 && line[len-1] == '\n')
+      line[--len] = '\0';
+
+    if (STRPREFIX (line, "Package: ")) {
+      free (name);
+      name = strdup (&line[9]);
+    }
+    else if (STRPREFIX (line, "Status: "))
+      installed = strstr (&line[8], "installed") != NULL;
+    else if (STRPREFIX (line, "Version: ")) {
+      free (evr);
+      evr = strdup (&line[9]);
+    }
+    else if (STRPREFIX (line, "Architecture: ")) {
+      free (arch);
+      arch = strdup (&line[14]);
+    }
+
+    if (len == 0) {
+      if (installed && name && evr) {
+        split_evr (evr, &epoch, &version, &release);
+        if (add_package (ret, name, epoch, version, release, arch,
+                         NULL, NULL) == -1) {
+          r = -1;
+          break;
+        }
+      }
+      free (name);
+      free (evr);
+      free (arch);
+      name = evr = arch = NULL;
+      installed = false;
+    }
+  }
+
+  fclose (fp);
+  return r;
+}
+
+static int
+list_packages_apk (struct stringsbuf *ret)
+{
+  FILE *fp;
+  CLEANUP_FREE char *line = NULL;
+  size_t allocsize = 0;
+  ssize_t len;
+  CLEANUP_FREE char *name = NULL, *evr = NULL, *arch = NULL,
+    *url = NULL, *description = NULL;
+  char *epoch, *version, *release, **field;
+  int r = 0;
+
+  fp = open_in_sysroot ("/lib/apk/db/installed");
+  if (fp == NULL)
+    return -1;
+
+  /* See list_applications_apk in the library. */
+  while ((len = getline (&line, &allocsize, fp)) != -1) {
+    if (len > 0 && line[len-1] == '\n')
+      line[--len] = '\0';
+
+    if (len == 0) {
+      if (name && evr) {
+        split_evr (evr, &epoch, &version, &release);
+        /* Skip the leading 'r' in revisions. */
+        if (release && release[0] == 'r')
+          ++release;
+        if (add_package (ret, name, epoch, version, release, arch,
+                         url, description) == -1) {
+          r = -1;
+          break;
+        }
+      }
+      free (name);
+      free (evr);
+      free (arch);
+      free (url);
+      free (description);
+      name = evr = arch = url = description = NULL;
+      continue;
+    }
+
+    if (len < 2 || line[1] != ':')
+      continue;
+
+    switch (line[0]) {
+    case 'A': field = &arch; break;
+    case 'P': field = &name; break;
+    case 'T': field = &description; break;
+    case 'U': field = &url; break;
+    case 'V': field = &evr; break;
+    default: continue;
+    }
+    free (*field);
+    *field = strdup (&line[2]);
+  }
+
+  fclose (fp);
+  return r;
+}
+
+static int
+list_packages_pacman (struct stringsbuf *ret)
+{
+  DIR *dir;
+  struct dirent *d;
+  CLEANUP_FREE char *line = NULL;
+  size_t allocsize = 0;
+  ssize_t len;
+  int r = 0;
+
+  CHROOT_IN;
+  dir = opendir ("/var/lib/pacman/local");
+  CHROOT_OUT;
+  if (dir == NULL) {
+    reply_with_perror ("opendir: /var/lib/pacman/local");
+    return -1;
+  }
+
+  while (r == 0 && (d = readdir (dir)) != NULL) {
+    CLEANUP_FREE char *path = NULL;
+    CLEANUP_FREE char *name = NULL, *evr = NULL, *arch = NULL,
+      *url = NULL, *description = NULL;
+    char *epoch, *version, *release, **field = NULL;
+    FILE *fp;
+
+    if (STREQ (d->d_name, ".") || STREQ (d->d_name, ".."))
+      continue;
+
+    if (asprintf (&path, "/var/lib/pacman/local/%s/desc", d->d_name) == -1) {
+      reply_with_perror ("asprintf");
+      r = -1;
+      break;
+    }
+
+    /* As in the library, skip packages with a missing desc file. */
+    CHROOT_IN;
+    fp = fopen (path, "re");
+    CHROOT_OUT;
+    if (fp == NULL)
+      continue;
+
+    /* See list_applications_pacman in the library. */
+    while ((len = getline (&line, &allocsize, fp)) != -1) {
+      if (len > 0 && line[len-1] == '\n')
+        line[--len] = '\0';
+
+      if (len == 0) {
+        field = NULL;
+        continue;
+      }
+
+      if (field != NULL) {
+        free (*field);
+        *field = strdup (line);
+        field = NULL;
+        continue;
+      }
+
+      if (STREQ (line, "%NAME%"))
+        field = &name;
+      else if (STREQ (line, "%VERSION%"))
+        field = &evr;
+      else if (STREQ (line, "%DESC%"))
+        field = &description;
+      else if (STREQ (line, "%URL%"))
+        field = &url;
+      else if (STREQ (line, "%ARCH%"))
+        field = &arch;
+    }
+    fclose (fp);
+
+    /* Name, version, release and arch are mandatory. */
+    if (name == NULL || evr == NULL || arch == NULL)
+      continue;
+    split_evr (evr, &epoch, &version, &release);
+    if (version[0] == '\0' || release == NULL || release[0] == '\0')
+      continue;
+
+    r = add_package (ret, name, epoch, version, release, arch,
+                     url, description);
+  }
+
+  closedir (dir);
+  return r;
+}
+
+/* Just enough of the Berkeley DB hash format to walk the RPM Packages
+ * database.  The library has a more general reader in src/dbdump.c.
+ */
+#define DB_HASHMAGIC     0x061561
+#define P_HASH_UNSORTED  2
+#define P_OVERFLOW       7
+#define P_HASH           13
+#define H_KEYDATA        1
+#define H_OFFPAGE        3
+#define SIZEOF_PAGE      26
+
+struct db {
+  const unsigned char *map;
+  uint32_t pagesize;
+  uint32_t nr_pages;
+  bool swapped;
+};
+
+static uint16_t
+get16 (const struct db *db, const unsigned char *p)
+{
+  uint16_t v;
+
+  memcpy (&v, p, sizeof v);
+  return db->swapped ? __builtin_bswap16 (v) : v;
+}
+
+static uint32_t
+get32 (const struct db *db, const unsigned char *p)
+{
+  uint32_t v;
+
+  memcpy (&v, p, sizeof v);
+  return db->swapped ? __builtin_bswap32 (v) : v;
+}
+
+/* Reassemble an overflow item.  Returns NULL if the chain is corrupt. */
+static unsigned char *
+read_overflow (const struct db *db, uint32_t pgno, uint32_t tlen)
+{
+  unsigned char *ret;
+  const unsigned char *pg;
+  size_t len = 0;
+  uint32_t n;
+
+  if (tlen > MAX_PKG_DB_SIZE)
+    return NULL;
+  ret = malloc (tlen > 0 ? tlen : 1);
+  if (ret == NULL)
+    return NULL;
+
+  while (len < tlen) {
+    if (pgno >= db->nr_pages)
+      goto corrupt;
+    pg = db->map + (size_t) pgno * db->pagesize;
+    if (pg[25] != P_OVERFLOW)
+      goto corrupt;
+    n = get16 (db, pg + 22);
+    if (n == 0 || n > db->pagesize - SIZEOF_PAGE || n > tlen - len)
+      goto corrupt;
+    memcpy (ret + len, pg + SIZEOF_PAGE, n);
+    len += n;
+    pgno = get32 (db, pg + 16);
+  }
+
+  return ret;
+
+ corrupt:
+  free (ret);
+  return NULL;
+}
+
+/* RPM header tags, see rpmtag.h. */
+#define RPMTAG_NAME     1000
+#define RPMTAG_VERSION  1001
+#define RPMTAG_RELEASE  1002
+#define RPMTAG_EPOCH    1003
+#define RPMTAG_ARCH     1022
+
+/* Return a pointer into the header store for the string or int32
+ * value of 'tag', or NULL if it is missing.  '*max_len' is set to the
+ * number of bytes that may be read from the returned pointer.
+ */
+static const char *
+get_rpm_header_tag (const unsigned char *h, size_t hlen, uint32_t tag,
+                    size_t *max_len)
+{
+  uint32_t nr, i, offset, v;
+  const unsigned char *store;
+
+  if (hlen < 8)
+    return NULL;
+  memcpy (&v, h, 4);
+  nr = be32toh (v);
+  if (nr > (hlen - 8) / 16)
+    return NULL;
+  store = h + 8 + 16 * (size_t) nr;
+
+  for (i = 0; i < nr; ++i) {
+    const unsigned char *entry = h + 8 + 16 * (size_t) i;
+
+    memcpy (&v, entry, 4);
+    if (be32toh (v) != tag)
+      continue;
+    memcpy (&v, entry + 8, 4);
+    offset = be32toh (v);
+    if (offset >= (size_t) (h + hlen - store))
+      return NULL;
+    *max_len = h + hlen - (store + offset);
+    return (const char *) (store + offset);
+  }
+
+  return NULL;
+}
+
+static int
+add_rpm_package (struct stringsbuf *ret, const unsigned char *h, size_t hlen)
+{
+  const char *p;
+  size_t max_len;
+  CLEANUP_FREE char *name = NULL, *version = NULL, *release = NULL,
+    *arch = NULL, *epoch = NULL;
+
+  /* Ignore bogus entries. */
+  if ((p = get_rpm_header_tag (h, hlen, RPMTAG_NAME, &max_len)) == NULL)
+    return 0;
+  name = strndup (p, max_len);
+  if ((p = get_rpm_header_tag (h, hlen, RPMTAG_VERSION, &max_len)) == NULL)
+    return 0;
+  version = strndup (p, max_len);
+  if ((p = get_rpm_header_tag (h, hlen, RPMTAG_RELEASE, &max_len)) == NULL)
+    return 0;
+  release = strndup (p, max_len);
+  if ((p = get_rpm_header_tag (h, hlen, RPMTAG_ARCH, &max_len)) != NULL)
+    arch = strndup (p, max_len);
+  if ((p = get_rpm_header_tag (h, hlen, RPMTAG_EPOCH, &max_len)) != NULL &&
+      max_len >= 4) {
+    uint32_t v;
+
+    memcpy (&v, p, 4);
+    if (asprintf (&epoch, "%" PRIi32, (int32_t) be32toh (v)) == -1)
+      epoch = NULL;
+  }
+
+  if (name == NULL || version == NULL || release == NULL) {
+    reply_with_perror ("strndup");
+    return -1;
+  }
+
+  return add_package (ret, name, epoch, version, release, arch, NULL, NULL);
+}
+
+static int
+list_packages_rpm (struct stringsbuf *ret)
+{
+  int fd;
+  struct stat statbuf;
+  void *map;
+  struct db db;
+  uint32_t magic, pgno;
+  int r = 0;
+
+  CHROOT_IN;
+  fd = open ("/var/lib/rpm/Packages", O_RDONLY|O_CLOEXEC);
+  CHROOT_OUT;
+  if (fd == -1) {
+    reply_with_perror ("open: /var/lib/rpm/Packages");
+    return -1;
+  }
+  if (fstat (fd, &statbuf) == -1) {
+    reply_with_perror ("fstat: /var/lib/rpm/Packages");
+    close (fd);
+    return -1;
+  }
+  if (statbuf.st_size < 512 || statbuf.st_size > MAX_PKG_DB_SIZE) {
+    reply_with_error_errno (ENOTSUP, "/var/lib/rpm/Packages: "
+                            "unexpected size %" PRIi64,
+                            (int64_t) statbuf.st_size);
+    close (fd);
+    return -1;
+  }
+  map = mmap (NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (map == MAP_FAILED) {
+    reply_with_perror ("mmap: /var/lib/rpm/Packages");
+    return -1;
+  }
+
+  db.map = map;
+  memcpy (&magic, db.map + 12, sizeof magic);
+  db.swapped = magic != DB_HASHMAGIC;
+  magic = get32 (&db, db.map + 12);
+  db.pagesize = get32 (&db, db.map + 20);
+
+  /* The library falls back to downloading the database on ENOTSUP. */
+  if (magic != DB_HASHMAGIC ||
+      db.pagesize < 512 || db.pagesize > 65536 ||
+      (db.pagesize & (db.pagesize - 1)) != 0 ||
+      db.map[24] != 0 || (db.map[26] & 1) != 0) {
+    reply_with_error_errno (ENOTSUP, "/var/lib/rpm/Packages: "
+                            "unsupported Berkeley DB format");
+    r = -1;
+    goto out;
+  }
+  db.nr_pages = statbuf.st_size / db.pagesize;
+
+  for (pgno = 1; r == 0 && pgno < db.nr_pages; ++pgno) {
+    const unsigned char *pg = db.map + (size_t) pgno * db.pagesize;
+    uint16_t entries, i, offset, end;
+
+    if (pg[25] != P_HASH && pg[25] != P_HASH_UNSORTED)
+      continue;
+
+    entries = get16 (&db, pg + 20);
+    if (SIZEOF_PAGE + 2 * (size_t) entries > db.pagesize)
+      goto corrupt;
+
+    /* Items are (key, value) pairs; we only need the values. */
+    for (i = 1; r == 0 && i < entries; i += 2) {
+      const unsigned char *item;
+      CLEANUP_FREE unsigned char *buf = NULL;
+
+      offset = get16 (&db, pg + SIZEOF_PAGE + 2*i);
+      end = get16 (&db, pg + SIZEOF_PAGE + 2*(i-1));
+      if (offset < SIZEOF_PAGE + 2 * entries || offset >= end ||
+          end > db.pagesize)
+        goto corrupt;
+      item = pg + offset;
+
+      switch (item[0]) {
+      case H_KEYDATA:
+        r = add_rpm_package (ret, item + 1, end - offset - 1);
+        break;
+      case H_OFFPAGE:
+        if (offset + 12 > end)
+          goto corrupt;
+        buf = read_overflow (&db, get32 (&db, item + 4),
+                             get32 (&db, item + 8));
+        if (buf == NULL)
+          goto corrupt;
+        r = add_rpm_package (ret, buf, get32 (&db, item + 8));
+        break;
+      default:
+        reply_with_error_errno (ENOTSUP, "/var/lib/rpm/Packages: "
+                                "unsupported hash item type %d", item[0]);
+        r = -1;
+      }
+    }
+  }
+
+ out:
+  munmap (map, statbuf.st_size);
+  return r;
+
+ corrupt:
+  reply_with_error_errno (ENOTSUP, "/var/lib/rpm/Packages: "
+                          "corrupt page %" PRIu32, pgno);
+  r = -1;
+  goto out;
+}
+
+char **
+do_internal_list_packages_raw (const char *format)
+{
+  DECLARE_STRINGSBUF (ret);
+  int r;
+
+  if (STREQ (format, "rpm"))
+    r = list_packages_rpm (&ret);
+  else if (STREQ (format, "deb"))
+    r = list_packages_deb (&ret);
+  else if (STREQ (format, "pacman"))
+    r = list_packages_pacman (&ret);
+  else if (STREQ (format, "apk"))
+    r = list_packages_apk (&ret);
+  else {
+    reply_with_error_errno (ENOTSUP, "%s: unknown package format", format);
+    r = -1;
+  }
+
+  if (r == -1) {
+    free_stringsbuf (&ret);
+    return NULL;
+  }
+
+  if (end_stringsbuf (&ret) == -1)
+    return NULL;
+
+  return take_stringsbuf (&ret);
+}
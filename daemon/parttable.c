@@ -0,0 +1,788 @@
+/* libguestfs - the guestfsd daemon
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Reading and editing a whole partition table at once.
+ *
+ * The part_get_* and part_set_* calls in parted.c run parted, sfdisk
+ * or sgdisk for each field of each partition.  Here we read the whole
+ * table from one 'sfdisk --dump', and write all the edits back by
+ * feeding the modified dump to one run of sfdisk.
+ *
+ * A dump looks like this:
+ *
+ *   label: gpt
+ *   label-id: 6A3B1B1E-5B0B-4E3F-9A56-3E4A0D1C1C0A
+ *   device: /dev/sda
+ *   unit: sectors
+ *   first-lba: 34
+ *   last-lba: 2097118
+ *
+ *   /dev/sda1 : start=2048, size=409600, type=C12A7328-F81F-11D2-BA4B-00A0C93EC93B, uuid=19AEC5FE-D63A-4A15-9D37-6FCBFB873DC0, name="EFI System Partition", attrs="LegacyBIOSBootable"
+ *
+ * For MBR, the label is "dos", the type is the partition ID byte in
+ * hex, and bootable partitions have a "bootable" flag.  Fields we do
+ * not know about are kept and written back unchanged.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#include "c-ctype.h"
+
+#include "daemon.h"
+#include "actions.h"
+
+GUESTFSD_EXT_CMD(str_sfdisk, sfdisk);
+GUESTFSD_EXT_CMD(str_blockdev, blockdev);
+
+/* One partition line of the dump. */
+struct pt_entry {
+  char *device;                 /* eg. "/dev/sda1" */
+  int partnum;
+  size_t nr_fields;
+  char **keys;
+  char **values;                /* NULL for flags, eg. "bootable" */
+};
+
+struct pt_table {
+  char **header;                /* lines before the partitions */
+  bool gpt;
+  size_t nr_entries;
+  struct pt_entry *entries;
+};
+
+/* GPT attribute bits which sfdisk knows by name.  The other bits it
+ * accepts are 48-63 as "GUID:<bit>".
+ */
+static const char *gpt_attr_names[] = {
+  "RequiredPartition",          /* bit 0 */
+  "NoBlockIOProtocol",          /* bit 1 */
+  "LegacyBIOSBootable",         /* bit 2 */
+};
+#define NR_GPT_ATTR_NAMES \
+  (sizeof gpt_attr_names / sizeof gpt_attr_names[0])
+
+static void
+free_table (struct pt_table *t)
+{
+  size_t i, j;
+
+  if (t->header)
+    free_strings (t->header);
+  for (i = 0; i < t->nr_entries; ++i) {
+    struct pt_entry *e = &t->entries[i];
+
+    free (e->device);
+    for (j = 0; j < e->nr_fields; ++j) {
+      free (e->keys[j]);
+      free (e->values[j]);
+    }
+    free (e->keys);
+    free (e->values);
+  }
+  free (t->entries);
+}
+
+static const char *
+get_field (const struct pt_entry *e, const char *key)
+{
+  size_t i;
+
+  for (i = 0; i < e->nr_fields; ++i)
+    if (STREQ (e->keys[i], key))
+      return e->values[i] ? e->values[i] : "";
+  return NULL;
+}
+
+static bool
+has_field (const struct pt_entry *e, const char *key)
+{
+  return get_field (e, key) != NULL;
+}
+
+/* Add or replace a field.  If 'value' is NULL, the field is a flag.
+ * Returns -1 after replying with an error.
+ */
+static int
+set_field (struct pt_entry *e, const char *key, const char *value)
+{
+  char **p;
+  char *k, *v = NULL;
+  size_t i;
+
+  if (value) {
+    v = strdup (value);
+    if (v == NULL) {
+      reply_with_perror ("strdup");
+      return -1;
+    }
+  }
+
+  for (i = 0; i < e->nr_fields; ++i) {
+    if (STREQ (e->keys[i], key)) {
+      free (e->values[i]);
+      e->values[i] = v;
+      return 0;
+    }
+  }
+
+  k = strdup (key);
+  if (k == NULL) {
+    reply_with_perror ("strdup");
+    free (v);
+    return -1;
+  }
+  p = realloc (e->keys, (e->nr_fields+1) * sizeof (char *));
+  if (p == NULL)
+    goto error;
+  e->keys = p;
+  p = realloc (e->values, (e->nr_fields+1) * sizeof (char *));
+  if (p == NULL)
+    goto error;
+  e->values = p;
+  e->keys[e->nr_fields] = k;
+  e->values[e->nr_fields] = v;
+  e->nr_fields++;
+  return 0;
+
+ error:
+  reply_with_perror ("realloc");
+  free (k);
+  free (v);
+  return -1;
+}
+
+static void
+delete_field (struct pt_entry *e, const char *key)
+{
+  size_t i;
+
+  for (i = 0; i < e->nr_fields; ++i) {
+    if (STREQ (e->keys[i], key)) {
+      free (e->keys[i]);
+      free (e->values[i]);
+      memmove (&e->keys[i], &e->keys[i+1],
+               (e->nr_fields-i-1) * sizeof (char *));
+      memmove (&e->values[i], &e->values[i+1],
+               (e->nr_fields-i-1) * sizeof (char *));
+      e->nr_fields--;
+      return;
+    }
+  }
+}
+
+/* Parse 'key=value, key="quoted value", flag' after the colon of a
+ * partition line.
+ */
+static int
+parse_fields (struct pt_entry *e, const char *p)
+{
+  CLEANUP_FREE char *key = NULL, *value = NULL;
+  size_t len;
+
+  for (;;) {
+    p += strspn (p, " \t,");
+    if (*p == '\0')
+      return 0;
+
+    len = strcspn (p, "=, \t");
+    free (key);
+    key = strndup (p, len);
+    if (key == NULL) {
+      reply_with_perror ("strndup");
+      return -1;
+    }
+    p += len;
+    p += strspn (p, " \t");
+
+    free (value);
+    value = NULL;
+    if (*p == '=') {
+      p++;
+      p += strspn (p, " \t");
+      if (*p == '"') {
+        p++;
+        len = strcspn (p, "\"");
+        value = strndup (p, len);
+        p += len;
+        if (*p == '"')
+          p++;
+      }
+      else {
+        len = strcspn (p, ", \t");
+        value = strndup (p, len);
+        p += len;
+      }
+      if (value == NULL) {
+        reply_with_perror ("strndup");
+        return -1;
+      }
+    }
+
+    if (set_field (e, key, value) == -1)
+      return -1;
+  }
+}
+
+/* Read the partition table of 'device'.  Returns -1 after replying
+ * with an error.
+ */
+static int
+read_table (const char *device, struct pt_table *t)
+{
+  CLEANUP_FREE char *out = NULL, *err = NULL;
+  CLEANUP_FREE_STRING_LIST char **lines = NULL;
+  CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (header);
+  struct pt_entry *e;
+  size_t i, n;
+  char *colon;
+  int r;
+
+  memset (t, 0, sizeof *t);
+
+  r = command (&out, &err, str_sfdisk, "--dump", device, NULL);
+  if (r == -1) {
+    reply_with_error ("sfdisk --dump: %s: %s", device, err);
+    return -1;
+  }
+
+  lines = split_lines (out);
+  if (lines == NULL)
+    return -1;
+
+  for (i = 0; lines[i] != NULL; ++i) {
+    if (STREQ (lines[i], ""))
+      continue;
+
+    if (!STRPREFIX (lines[i], "/dev/")) {
+      if (STREQ (lines[i], "label: gpt"))
+        t->gpt = true;
+      if (add_string (&header, lines[i]) == -1)
+        goto error;
+      continue;
+    }
+
+    colon = strstr (lines[i], " : ");
+    if (colon == NULL) {
+      reply_with_error ("sfdisk --dump: cannot parse line: %s", lines[i]);
+      goto error;
+    }
+
+    e = realloc (t->entries, (t->nr_entries+1) * sizeof (struct pt_entry));
+    if (e == NULL) {
+      reply_with_perror ("realloc");
+      goto error;
+    }
+    t->entries = e;
+    e = &t->entries[t->nr_entries];
+    memset (e, 0, sizeof *e);
+    t->nr_entries++;
+
+    e->device = strndup (lines[i], colon - lines[i]);
+    if (e->device == NULL) {
+      reply_with_perror ("strndup");
+      goto error;
+    }
+    n = strlen (e->device);
+    while (n > 0 && c_isdigit (e->device[n-1]))
+      n--;
+    if (sscanf (&e->device[n], "%d", &e->partnum) != 1) {
+      reply_with_error ("sfdisk --dump: cannot parse partition name: %s",
+                        e->device);
+      goto error;
+    }
+
+    if (parse_fields (e, colon + 3) == -1)
+      goto error;
+  }
+
+  if (end_stringsbuf (&header) == -1)
+    goto error;
+  t->header = take_stringsbuf (&header);
+  return 0;
+
+ error:
+  free_table (t);
+  return -1;
+}
+
+/* Write the edited table back with one run of sfdisk. */
+static int
+write_table (const char *device, const struct pt_table *t)
+{
+  char tmpfile[] = "/tmp/parttableXXXXXX";
+  CLEANUP_FREE char *err = NULL;
+  FILE *fp;
+  int fd, r;
+  size_t i, j;
+
+  fd = mkstemp (tmpfile);
+  if (fd == -1) {
+    reply_with_perror ("mkstemp");
+    return -1;
+  }
+  unlink (tmpfile);
+
+  fp = fdopen (dup (fd), "w");
+  if (fp == NULL) {
+    reply_with_perror ("fdopen");
+    close (fd);
+    return -1;
+  }
+  for (i = 0; t->header[i] != NULL; ++i)
+    fprintf (fp, "%s\n", t->header[i]);
+  fprintf (fp, "\n");
+  for (i = 0; i < t->nr_entries; ++i) {
+    const struct pt_entry *e = &t->entries[i];
+
+    fprintf (fp, "%s :", e->device);
+    for (j = 0; j < e->nr_fields; ++j) {
+      fprintf (fp, "%s %s", j > 0 ? "," : "", e->keys[j]);
+      if (e->values[j] == NULL)
+        continue;
+      if (STREQ (e->keys[j], "name") || STREQ (e->keys[j], "attrs"))
+        fprintf (fp, "=\"%s\"", e->values[j]);
+      else
+        fprintf (fp, "=%s", e->values[j]);
+    }
+    fprintf (fp, "\n");
+  }
+  if (fclose (fp) == EOF) {
+    reply_with_perror ("write: %s", tmpfile);
+    close (fd);
+    return -1;
+  }
+  if (lseek (fd, 0, SEEK_SET) == -1) {
+    reply_with_perror ("lseek");
+    close (fd);
+    return -1;
+  }
+
+  udev_settle ();
+
+  /* --no-reread stops sfdisk refusing to write the table when a
+   * partition is in use.  As in sfdisk.c, we reread the partition
+   * table ourselves afterwards.  The temporary file is passed as
+   * stdin, and commandf closes it.
+   */
+  r = commandf (NULL, &err,
+                COMMAND_FLAG_CHROOT_COPY_FILE_TO_STDIN | fd,
+                str_sfdisk, "--no-reread", device, NULL);
+  if (r == -1) {
+    reply_with_error ("sfdisk: %s: %s", device, err);
+    return -1;
+  }
+
+  (void) command (NULL, NULL, str_blockdev, "--rereadpt", device, NULL);
+
+  udev_settle ();
+
+  return 0;
+}
+
+static int
+get_sector_size (const char *device)
+{
+  int fd, ss;
+
+  fd = open (device, O_RDONLY|O_CLOEXEC);
+  if (fd == -1) {
+    reply_with_perror ("open: %s", device);
+    return -1;
+  }
+  if (ioctl (fd, BLKSSZGET, &ss) == -1) {
+    reply_with_perror ("ioctl: BLKSSZGET: %s", device);
+    close (fd);
+    return -1;
+  }
+  close (fd);
+  return ss;
+}
+
+static int64_t
+parse_gpt_attributes (const char *attrs)
+{
+  int64_t r = 0;
+  size_t len, i;
+  int bit, n;
+
+  while (*attrs) {
+    attrs += strspn (attrs, " ,");
+    len = strcspn (attrs, " ");
+    if (len == 0)
+      break;
+
+    if (STRPREFIX (attrs, "GUID:")) {
+      const char *p = attrs + 5;
+
+      while (sscanf (p, "%d%n", &bit, &n) == 1) {
+        if (bit >= 0 && bit < 64)
+          r |= UINT64_C(1) << bit;
+        p += n;
+        if (*p != ',')
+          break;
+        p++;
+      }
+    }
+    else {
+      for (i = 0; i < NR_GPT_ATTR_NAMES; ++i) {
+        if (strlen (gpt_attr_names[i]) == len &&
+            STREQLEN (attrs, gpt_attr_names[i], len))
+          r |= UINT64_C(1) << i;
+      }
+    }
+    attrs += len;
+  }
+
+  return r;
+}
+
+/* Format GPT attributes as sfdisk wants them.  Caller frees. */
+static char *
+format_gpt_attributes (uint64_t attrs)
+{
+  CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (words);
+  char *guid = NULL, *p;
+  size_t i;
+  int bit;
+
+  if (attrs & UINT64_C(0x0000fffffffffff8)) {
+    reply_with_error ("GPT attribute bits 3-47 cannot be set");
+    return NULL;
+  }
+
+  for (i = 0; i < NR_GPT_ATTR_NAMES; ++i) {
+    if (attrs & (UINT64_C(1) << i)) {
+      if (add_string (&words, gpt_attr_names[i]) == -1)
+        return NULL;
+    }
+  }
+  for (bit = 48; bit < 64; ++bit) {
+    if (attrs & (UINT64_C(1) << bit)) {
+      if (asprintf (&p, "%s%s%d", guid ? guid : "GUID:",
+                    guid ? "," : "", bit) == -1) {
+        reply_with_perror ("asprintf");
+        free (guid);
+        return NULL;
+      }
+      free (guid);
+      guid = p;
+    }
+  }
+  if (guid && add_string_nodup (&words, guid) == -1)
+    return NULL;
+  if (end_stringsbuf (&words) == -1)
+    return NULL;
+
+  p = join_strings (" ", words.argv);
+  if (p == NULL)
+    reply_with_perror ("malloc");
+  return p;
+}
+
+static int
+set_partition_info (guestfs_int_partition_info *pi, const struct pt_table *t,
+                    const struct pt_entry *e, int ss)
+{
+  const char *start_str, *size_str, *type, *str;
+  int64_t start, size;
+  unsigned id;
+
+  start_str = get_field (e, "start");
+  size_str = get_field (e, "size");
+  /* Older versions of sfdisk call the type "Id". */
+  type = get_field (e, "type");
+  if (type == NULL)
+    type = get_field (e, "Id");
+  if (start_str == NULL || size_str == NULL || type == NULL ||
+      sscanf (start_str, "%" SCNi64, &start) != 1 ||
+      sscanf (size_str, "%" SCNi64, &size) != 1) {
+    reply_with_error ("sfdisk --dump: missing fields for %s", e->device);
+    return -1;
+  }
+
+  pi->pi_num = e->partnum;
+  pi->pi_start = start * ss;
+  pi->pi_size = size * ss;
+  pi->pi_end = pi->pi_start + pi->pi_size - 1;
+
+  if (t->gpt) {
+    pi->pi_mbr_part_type = strdup ("primary");
+    pi->pi_mbr_id = -1;
+    pi->pi_gpt_type = strdup (type);
+    str = get_field (e, "uuid");
+    pi->pi_gpt_guid = strdup (str ? str : "");
+    str = get_field (e, "attrs");
+    pi->pi_gpt_attributes = str ? parse_gpt_attributes (str) : 0;
+    str = get_field (e, "name");
+    pi->pi_name = strdup (str ? str : "");
+    /* The same bit as parted's "legacy_boot" flag. */
+    pi->pi_bootable = (pi->pi_gpt_attributes & 4) != 0;
+  }
+  else {
+    if (sscanf (type, "%x", &id) != 1) {
+      reply_with_error ("sfdisk --dump: cannot parse type of %s: %s",
+                        e->device, type);
+      return -1;
+    }
+    pi->pi_mbr_id = id;
+    if (e->partnum >= 5)
+      str = "logical";
+    else if (id == 0x05 || id == 0x0f || id == 0x85)
+      str = "extended";
+    else
+      str = "primary";
+    pi->pi_mbr_part_type = strdup (str);
+    pi->pi_gpt_type = strdup ("");
+    pi->pi_gpt_guid = strdup ("");
+    pi->pi_gpt_attributes = 0;
+    pi->pi_name = strdup ("");
+    pi->pi_bootable = has_field (e, "bootable");
+  }
+
+  if (pi->pi_mbr_part_type == NULL || pi->pi_gpt_type == NULL ||
+      pi->pi_gpt_guid == NULL || pi->pi_name == NULL) {
+    reply_with_perror ("strdup");
+    return -1;
+  }
+
+  return 0;
+}
+
+static void
+free_partition_info_list (guestfs_int_partition_info_list *r)
+{
+  size_t i;
+
+  for (i = 0; i < r->guestfs_int_partition_info_list_len; ++i) {
+    guestfs_int_partition_info *pi = &r->guestfs_int_partition_info_list_val[i];
+    free (pi->pi_mbr_part_type);
+    free (pi->pi_gpt_type);
+    free (pi->pi_gpt_guid);
+    free (pi->pi_name);
+  }
+  free (r->guestfs_int_partition_info_list_val);
+  free (r);
+}
+
+guestfs_int_partition_info_list *
+do_part_list_full (const char *device)
+{
+  struct pt_table t;
+  guestfs_int_partition_info_list *r;
+  size_t i;
+  int ss;
+
+  ss = get_sector_size (device);
+  if (ss == -1)
+    return NULL;
+
+  if (read_table (device, &t) == -1)
+    return NULL;
+
+  r = malloc (sizeof *r);
+  if (r == NULL) {
+    reply_with_perror ("malloc");
+    free_table (&t);
+    return NULL;
+  }
+  r->guestfs_int_partition_info_list_len = t.nr_entries;
+  r->guestfs_int_partition_info_list_val =
+    calloc (t.nr_entries, sizeof (guestfs_int_partition_info));
+  if (r->guestfs_int_partition_info_list_val == NULL) {
+    reply_with_perror ("calloc");
+    free (r);
+    free_table (&t);
+    return NULL;
+  }
+
+  for (i = 0; i < t.nr_entries; ++i) {
+    if (set_partition_info (&r->guestfs_int_partition_info_list_val[i],
+                            &t, &t.entries[i], ss) == -1) {
+      free_partition_info_list (r);
+      free_table (&t);
+      return NULL;
+    }
+  }
+
+  free_table (&t);
+  return r;
+}
+
+/* Apply one edit "partnum:field=value" to the table in memory. */
+static int
+apply_edit (struct pt_table *t, const char *edit)
+{
+  CLEANUP_FREE char *field = NULL;
+  const char *value;
+  struct pt_entry *e = NULL;
+  char *end;
+  size_t i, len;
+  long partnum;
+
+  errno = 0;
+  partnum = strtol (edit, &end, 10);
+  if (errno != 0 || end == edit || *end != ':' || partnum <= 0) {
+    reply_with_error ("%s: edit must start with \"partnum:\"", edit);
+    return -1;
+  }
+  len = strcspn (end + 1, "=");
+  if (end[1+len] != '=') {
+    reply_with_error ("%s: edit must be \"partnum:field=value\"", edit);
+    return -1;
+  }
+  field = strndup (end + 1, len);
+  if (field == NULL) {
+    reply_with_perror ("strndup");
+    return -1;
+  }
+  value = &end[1+len+1];
+
+  for (i = 0; i < t->nr_entries; ++i) {
+    if (t->entries[i].partnum == partnum) {
+      e = &t->entries[i];
+      break;
+    }
+  }
+  if (e == NULL) {
+    reply_with_error ("%s: partition number %ld not found", edit, partnum);
+    return -1;
+  }
+
+  if (STREQ (field, "bootable")) {
+    if (t->gpt) {
+      reply_with_error ("%s: use gpt_attributes on GUID Partition Tables",
+                        edit);
+      return -1;
+    }
+    if (STREQ (value, "true") || STREQ (value, "1"))
+      return set_field (e, "bootable", NULL);
+    else if (STREQ (value, "false") || STREQ (value, "0")) {
+      delete_field (e, "bootable");
+      return 0;
+    }
+    reply_with_error ("%s: bootable must be true or false", edit);
+    return -1;
+  }
+  else if (STREQ (field, "mbr_id")) {
+    char idstr[16];
+    unsigned id;
+    int n;
+
+    if (t->gpt) {
+      reply_with_error ("%s: mbr_id can only be set on MBR partitions", edit);
+      return -1;
+    }
+    if (sscanf (value, "%x%n", &id, &n) != 1 ||
+        value[n] != '\0' || id > 0xff) {
+      reply_with_error ("%s: mbr_id must be a hex byte", edit);
+      return -1;
+    }
+    snprintf (idstr, sizeof idstr, "%x", id);
+    delete_field (e, "Id");
+    return set_field (e, "type", idstr);
+  }
+  else if (STREQ (field, "gpt_type") || STREQ (field, "gpt_guid")) {
+    if (!t->gpt) {
+      reply_with_error ("%s: %s can only be set on GPT partitions",
+                        edit, field);
+      return -1;
+    }
+    if (strlen (value) != 36 ||
+        strspn (value, "-0123456789abcdefABCDEF") != 36) {
+      reply_with_error ("%s: not a GUID", edit);
+      return -1;
+    }
+    return set_field (e, STREQ (field, "gpt_type") ? "type" : "uuid", value);
+  }
+  else if (STREQ (field, "name")) {
+    if (!t->gpt) {
+      reply_with_error ("%s: names can only be set on GPT partitions", edit);
+      return -1;
+    }
+    if (strpbrk (value, "\"\n") != NULL) {
+      reply_with_error ("%s: name cannot contain quotes or newlines", edit);
+      return -1;
+    }
+    return set_field (e, "name", value);
+  }
+  else if (STREQ (field, "gpt_attributes")) {
+    CLEANUP_FREE char *attrs = NULL;
+    int64_t v;
+    int n;
+
+    if (!t->gpt) {
+      reply_with_error ("%s: gpt_attributes can only be set on GPT partitions",
+                        edit);
+      return -1;
+    }
+    if (sscanf (value, "%" SCNi64 "%n", &v, &n) != 1 ||
+        value[n] != '\0') {
+      reply_with_error ("%s: gpt_attributes must be a number", edit);
+      return -1;
+    }
+    attrs = format_gpt_attributes (v);
+    if (attrs == NULL)
+      return -1;
+    if (STREQ (attrs, "")) {
+      delete_field (e, "attrs");
+      return 0;
+    }
+    return set_field (e, "attrs", attrs);
+  }
+
+  reply_with_error ("%s: unknown field \"%s\"", edit, field);
+  return -1;
+}
+
+int
+do_part_edit_batch (const char *device, char *const *edits)
+{
+  struct pt_table t;
+  size_t i;
+  int r;
+
+  if (read_table (device, &t) == -1)
+    return -1;
+
+  /* Nothing is written unless every edit is valid. */
+  for (i = 0; edits[i] != NULL; ++i) {
+    if (apply_edit (&t, edits[i]) == -1) {
+      free_table (&t);
+      return -1;
+    }
+  }
+
+  r = 0;
+  if (i > 0)
+    r = write_table (device, &t);
+
+  free_table (&t);
+  return r;
+}
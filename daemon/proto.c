@@ -27,6 +27,8 @@
 #include <unistd.h>
 #include <errno.h>
 #include <error.h>
+#include <pthread.h>
+#include <fcntl.h>
 #include <sys/param.h>		/* defines MIN */
 #include <sys/select.h>
 #include <sys/time.h>
@@ -37,15 +39,24 @@
 #include <windows.h>
 #endif
 
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
 #include "c-ctype.h"
+#include "ignore-value.h"
 
 #include "daemon.h"
+#include "actions.h"
 #include "guestfs_protocol.h"
 #include "errnostring.h"
 
-/* The message currently being processed. */
-int proc_nr;
-int serial;
+/* The message currently being processed.  When worker threads are
+ * used each thread has its own copy of these and the other request
+ * variables below.
+ */
+__thread int proc_nr;
+__thread int serial;
 
 /* Hint for implementing progress messages for uploaded/incoming data.
  * The caller sets this to a value > 0 if it knows or can estimate how
@@ -53,7 +64,7 @@ int serial;
  * coming from a pipe).  If this is known then we can emit progress
  * messages as we write the data.
  */
-uint64_t progress_hint;
+__thread uint64_t progress_hint;
 
 /* Optional arguments bitmask.  Caller sets this to indicate which
  * optional arguments in the guestfs_<foo>_args structure are
@@ -62,20 +73,313 @@ uint64_t progress_hint;
  * bitmask has bits set that the daemon doesn't understand, then the
  * whole call is rejected early in processing.
  */
-uint64_t optargs_bitmask;
+__thread uint64_t optargs_bitmask;
+
+/* Maximum size of FileIn/FileOut chunks that we send to the library.
+ * This starts off at the default (which any library version can
+ * decode) and may be raised by the library calling
+ * internal_set_chunk_size after launch.
+ */
+size_t chunk_size = GUESTFS_DEFAULT_CHUNK_SIZE;
+
+/* Chunk codecs (GUESTFS_CODEC_*) agreed with the library by
+ * internal_set_chunk_codec.  Until then only plain chunks (and holes
+ * in downloads) are sent.
+ */
+static int chunk_codecs;
+
+#ifdef HAVE_LIBZSTD
+/* Chunks are compressed quickly, since the aim is to save network
+ * bandwidth to a remote appliance rather than space.
+ */
+#define CHUNK_ZSTD_LEVEL 1
+static ZSTD_CCtx *zstd_cctx;
+static ZSTD_DCtx *zstd_dctx;
+#endif
 
 /* Time at which we received the current request. */
-static struct timeval start_t;
+static __thread struct timeval start_t;
 
 /* Time at which the last progress notification was sent. */
-static struct timeval last_progress_t;
+static __thread struct timeval last_progress_t;
 
 /* Counts the number of progress notifications sent during this call. */
-static size_t count_progress;
+static __thread size_t count_progress;
 
 /* The daemon communications socket. */
 static int sock;
 
+/* Extra virtio-serial channels which file transfers are striped
+ * across (see do_internal_set_data_channels).  data_socks[0] is the
+ * daemon communications socket.  Chunk N of a transfer is sent on
+ * channel N % nr_data_channels.
+ */
+#define DATA_CHANNEL_PATH "/dev/virtio-ports/org.libguestfs.channel.%zu"
+static int data_socks[GUESTFS_MAX_DATA_CHANNELS];
+size_t nr_data_channels = 1;
+static size_t next_in_channel, next_out_channel;
+
+/* Serializes writes to the socket, so that messages sent by worker
+ * threads are not interleaved.
+ */
+static pthread_mutex_t sock_write_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Number of worker threads (guestfsd --workers).  If this is 0 then
+ * every request is dispatched synchronously from the main loop.
+ */
+size_t nr_workers = 0;
+
+/* Set in worker threads. */
+static __thread int in_worker;
+
+/* Set when the library cancels the calls in progress (see
+ * call_cancelled).  It is cleared before each synchronous call, and
+ * when the last worker job finishes.
+ */
+static volatile int cancel_requested;
+
+/* Set in the thread running a synchronous call, if call_cancelled may
+ * read cancellation flags from the socket itself.  This is not safe
+ * for calls with FileIn parameters, where the socket carries the file.
+ */
+static __thread int poll_for_cancel;
+static __thread struct timeval last_cancel_poll_t;
+
+/* If call_cancelled reads a length word which is not a cancellation
+ * flag, it is the start of the next request, which the main loop
+ * must use instead of reading it again.
+ */
+static int have_next_lenbuf;
+static char next_lenbuf[4];
+
+/* Buffers which are reused for every message, instead of being
+ * allocated and freed on each request.  They only ever grow.
+ */
+struct reusable_buffer {
+  char *buf;
+  size_t size;
+};
+static struct reusable_buffer request_buf;  /* incoming requests */
+static __thread struct reusable_buffer reply_buf; /* outgoing replies */
+static struct reusable_buffer chunk_in_buf; /* incoming file chunks */
+static struct reusable_buffer chunk_out_buf; /* outgoing file chunks */
+static struct reusable_buffer codec_in_buf; /* decoded incoming chunks */
+static struct reusable_buffer codec_out_buf; /* encoded outgoing chunks */
+
+/* Make sure the buffer is at least 'size' bytes.  Returns NULL (and
+ * sets errno) if the allocation fails.
+ */
+static char *
+grow_buffer (struct reusable_buffer *rb, size_t size)
+{
+  char *p;
+
+  if (size == 0)
+    size = 1;
+
+  if (rb->size < size) {
+    p = realloc (rb->buf, size);
+    if (p == NULL)
+      return NULL;
+    rb->buf = p;
+    rb->size = size;
+  }
+
+  return rb->buf;
+}
+
+/* Write a length word followed by a message body to 'fd'. */
+static int
+write_message (int fd, const char *lenbuf, const char *buf, size_t len)
+{
+  int r;
+
+  pthread_mutex_lock (&sock_write_lock);
+  r = xwrite (fd, lenbuf, 4) == 0 && xwrite (fd, buf, len) == 0 ? 0 : -1;
+  pthread_mutex_unlock (&sock_write_lock);
+
+  return r;
+}
+
+/* In verbose mode, display the time taken to run each command. */
+static void
+print_elapsed_time (void)
+{
+  struct timeval end_t;
+  int64_t start_us, end_us, elapsed_us;
+
+  gettimeofday (&end_t, NULL);
+
+  start_us = (int64_t) start_t.tv_sec * 1000000 + start_t.tv_usec;
+  end_us = (int64_t) end_t.tv_sec * 1000000 + end_t.tv_usec;
+  elapsed_us = end_us - start_us;
+
+  fprintf (stderr,
+           "guestfsd: main_loop: proc %d (%s) took %d.%02d seconds\n",
+           proc_nr,
+           proc_nr >= 0 && proc_nr <= GUESTFS_MAX_PROC_NR
+           ? function_names[proc_nr] : "UNKNOWN PROCEDURE",
+           (int) (elapsed_us / 1000000),
+           (int) ((elapsed_us / 10000) % 100));
+}
+
+/* Worker threads.
+ *
+ * Calls which the generator marks as reentrant are copied into a job
+ * and queued for the worker threads, so that several of these calls
+ * can run concurrently.  Each worker sends its own reply, which
+ * carries the serial number of the request, and the library matches
+ * replies to calls by serial number.
+ *
+ * Any other call waits until all queued and running jobs are
+ * finished, and then runs in the main thread exactly as before.  This
+ * means that non-reentrant calls (which may use CHROOT_IN, pulse mode
+ * or modify the appliance) never overlap with anything else.
+ */
+struct job {
+  struct job *next;
+  char *buf;                    /* copy of the request */
+  uint32_t len;
+  u_int pos;                    /* position of the args after the header */
+  int proc_nr;
+  int serial;
+  uint64_t progress_hint;
+  uint64_t optargs_bitmask;
+  struct timeval start_t;
+};
+
+static pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobs_available = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t jobs_finished = PTHREAD_COND_INITIALIZER;
+static struct job *jobs_head = NULL, **jobs_tail = &jobs_head;
+static size_t jobs_in_flight = 0; /* queued + running */
+
+static void
+run_job (struct job *job)
+{
+  XDR xdr;
+
+  proc_nr = job->proc_nr;
+  serial = job->serial;
+  progress_hint = job->progress_hint;
+  optargs_bitmask = job->optargs_bitmask;
+  start_t = job->start_t;
+  last_progress_t = start_t;
+  count_progress = 0;
+
+  xdrmem_create (&xdr, job->buf, job->len, XDR_DECODE);
+  xdr_setpos (&xdr, job->pos);
+
+  errno = 0;
+  stats_start_call ();
+  dispatch_incoming_message (&xdr);
+  stats_end_call ();
+
+  if (verbose)
+    print_elapsed_time ();
+
+  xdr_destroy (&xdr);
+}
+
+static void *
+worker_thread (void *arg)
+{
+  struct job *job;
+
+  in_worker = 1;
+
+  for (;;) {
+    pthread_mutex_lock (&jobs_lock);
+    while (jobs_head == NULL)
+      pthread_cond_wait (&jobs_available, &jobs_lock);
+    job = jobs_head;
+    jobs_head = job->next;
+    if (jobs_head == NULL)
+      jobs_tail = &jobs_head;
+    pthread_mutex_unlock (&jobs_lock);
+
+    run_job (job);
+    free (job->buf);
+    free (job);
+
+    pthread_mutex_lock (&jobs_lock);
+    jobs_in_flight--;
+    if (jobs_in_flight == 0) {
+      cancel_requested = 0;
+      pthread_cond_broadcast (&jobs_finished);
+    }
+    pthread_mutex_unlock (&jobs_lock);
+  }
+
+  /*NOTREACHED*/
+  return NULL;
+}
+
+static void
+start_workers (void)
+{
+  size_t i;
+  pthread_t thread;
+  int err;
+
+  for (i = 0; i < nr_workers; ++i) {
+    err = pthread_create (&thread, NULL, worker_thread, NULL);
+    if (err != 0)
+      error (EXIT_FAILURE, err, "pthread_create");
+    pthread_detach (thread);
+  }
+
+  if (verbose)
+    fprintf (stderr, "guestfsd: started %zu worker threads\n", nr_workers);
+}
+
+/* Queue the current request for the worker threads.  Returns -1 if
+ * the request could not be queued, in which case the caller should
+ * run it synchronously.
+ */
+static int
+queue_job (const char *buf, uint32_t len, u_int pos)
+{
+  struct job *job;
+
+  job = malloc (sizeof *job);
+  if (job == NULL)
+    return -1;
+  job->buf = malloc (len);
+  if (job->buf == NULL) {
+    free (job);
+    return -1;
+  }
+  memcpy (job->buf, buf, len);
+  job->len = len;
+  job->pos = pos;
+  job->next = NULL;
+  job->proc_nr = proc_nr;
+  job->serial = serial;
+  job->progress_hint = progress_hint;
+  job->optargs_bitmask = optargs_bitmask;
+  job->start_t = start_t;
+
+  pthread_mutex_lock (&jobs_lock);
+  *jobs_tail = job;
+  jobs_tail = &job->next;
+  jobs_in_flight++;
+  pthread_cond_signal (&jobs_available);
+  pthread_mutex_unlock (&jobs_lock);
+
+  return 0;
+}
+
+/* Wait until all queued and running jobs have finished. */
+static void
+wait_for_workers (void)
+{
+  pthread_mutex_lock (&jobs_lock);
+  while (jobs_in_flight > 0)
+    pthread_cond_wait (&jobs_finished, &jobs_lock);
+  pthread_mutex_unlock (&jobs_lock);
+}
+
 void
 main_loop (int _sock)
 {
@@ -86,10 +390,18 @@ main_loop (int _sock)
   struct guestfs_message_header hdr;
 
   sock = _sock;
+  data_socks[0] = sock;
+
+  if (nr_workers > 0)
+    start_workers ();
 
   for (;;) {
     /* Read the length word. */
-    if (xread (sock, lenbuf, 4) == -1)
+    if (have_next_lenbuf) {
+      memcpy (lenbuf, next_lenbuf, 4);
+      have_next_lenbuf = 0;
+    }
+    else if (xread (sock, lenbuf, 4) == -1)
       exit (EXIT_FAILURE);
 
     xdrmem_create (&xdr, lenbuf, 4, XDR_DECODE);
@@ -101,16 +413,23 @@ main_loop (int _sock)
 	       "guestfsd: main_loop: new request, len 0x%" PRIx32 "\n",
 	       len);
 
-    /* Cancellation sent from the library and received after the
-     * previous request has finished processing.  Just ignore it.
+    /* Cancellation sent from the library.  If worker threads are
+     * running calls, they see it through call_cancelled.  Otherwise
+     * it was received after the previous request finished processing,
+     * so just ignore it.
      */
-    if (len == GUESTFS_CANCEL_FLAG)
+    if (len == GUESTFS_CANCEL_FLAG) {
+      pthread_mutex_lock (&jobs_lock);
+      if (jobs_in_flight > 0)
+        cancel_requested = 1;
+      pthread_mutex_unlock (&jobs_lock);
       continue;
+    }
 
     if (len > GUESTFS_MESSAGE_MAX)
       error (EXIT_FAILURE, 0, "incoming message is too long (%u bytes)", len);
 
-    buf = malloc (len);
+    buf = grow_buffer (&request_buf, len);
     if (!buf) {
       reply_with_perror ("malloc");
       continue;
@@ -175,6 +494,20 @@ main_loop (int _sock)
     progress_hint = hdr.progress_hint;
     optargs_bitmask = hdr.optargs_bitmask;
 
+    /* Reentrant calls can be handed to a worker thread.  Everything
+     * else must wait for the workers to become idle.
+     */
+    if (nr_workers > 0) {
+      if (proc_nr >= 0 && proc_nr <= GUESTFS_MAX_PROC_NR &&
+          reentrant_functions[proc_nr] &&
+          queue_job (buf, len, xdr_getpos (&xdr)) == 0)
+        goto cont;
+      wait_for_workers ();
+    }
+
+    /* Each file transfer starts on the first channel. */
+    next_in_channel = next_out_channel = 0;
+
     /* Clear errors before we call the stub functions.  This is just
      * to ensure that we can accurately report errors in cases where
      * error handling paths don't set errno correctly.
@@ -185,32 +518,25 @@ main_loop (int _sock)
     WSASetLastError (0);
 #endif
 
+    /* Let the call notice if the library cancels it. */
+    cancel_requested = 0;
+    poll_for_cancel =
+      proc_nr >= 0 && proc_nr <= GUESTFS_MAX_PROC_NR &&
+      !filein_functions[proc_nr];
+    last_cancel_poll_t = start_t;
+
     /* Now start to process this message. */
+    stats_start_call ();
     dispatch_incoming_message (&xdr);
     /* Note that dispatch_incoming_message will also send a reply. */
+    stats_end_call ();
+    poll_for_cancel = 0;
 
-    /* In verbose mode, display the time taken to run each command. */
-    if (verbose) {
-      struct timeval end_t;
-      gettimeofday (&end_t, NULL);
-
-      int64_t start_us, end_us, elapsed_us;
-      start_us = (int64_t) start_t.tv_sec * 1000000 + start_t.tv_usec;
-      end_us = (int64_t) end_t.tv_sec * 1000000 + end_t.tv_usec;
-      elapsed_us = end_us - start_us;
-
-      fprintf (stderr,
-	       "guestfsd: main_loop: proc %d (%s) took %d.%02d seconds\n",
-               proc_nr,
-               proc_nr >= 0 && proc_nr <= GUESTFS_MAX_PROC_NR
-               ? function_names[proc_nr] : "UNKNOWN PROCEDURE",
-               (int) (elapsed_us / 1000000),
-               (int) ((elapsed_us / 10000) % 100));
-    }
+    if (verbose)
+      print_elapsed_time ();
 
   cont:
     xdr_destroy (&xdr);
-    free (buf);
   }
 }
 
@@ -230,6 +556,12 @@ reply_with_error_errno (int err, const char *fs, ...)
   if (r == -1)
     error (EXIT_FAILURE, errno, "vasprintf");
 
+  /* Errors in a cancelled call are most likely caused by the
+   * cancellation (eg. a command killed by call_cancelled).
+   */
+  if (err == 0 && cancel_requested)
+    err = EINTR;
+
   send_error (err, buf);
 }
 
@@ -311,9 +643,7 @@ send_error (int errnum, char *msg)
   xdr_u_int (&xdr, &len);
   xdr_destroy (&xdr);
 
-  if (xwrite (sock, lenbuf, 4) == -1)
-    error (EXIT_FAILURE, 0, "xwrite failed");
-  if (xwrite (sock, buf, len) == -1)
+  if (write_message (sock, lenbuf, buf, len) == -1)
     error (EXIT_FAILURE, 0, "xwrite failed");
 }
 
@@ -321,12 +651,12 @@ void
 reply (xdrproc_t xdrp, char *ret)
 {
   XDR xdr;
-  CLEANUP_FREE char *buf = NULL;
+  char *buf;
   char lenbuf[4];
   struct guestfs_message_header hdr;
   uint32_t len;
 
-  buf = malloc (GUESTFS_MESSAGE_MAX);
+  buf = grow_buffer (&reply_buf, GUESTFS_MESSAGE_MAX);
   if (!buf)
     error (EXIT_FAILURE, errno, "malloc");
   xdrmem_create (&xdr, buf, GUESTFS_MESSAGE_MAX, XDR_ENCODE);
@@ -361,30 +691,93 @@ reply (xdrproc_t xdrp, char *ret)
   xdr_u_int (&xdr, &len);
   xdr_destroy (&xdr);
 
-  if (xwrite (sock, lenbuf, 4) == -1)
-    error (EXIT_FAILURE, 0, "xwrite failed");
-  if (xwrite (sock, buf, (size_t) len) == -1)
+  if (write_message (sock, lenbuf, buf, (size_t) len) == -1)
     error (EXIT_FAILURE, 0, "xwrite failed");
 }
 
-/* Receive file chunks, repeatedly calling 'cb'. */
+/* Decode a hole or zstd chunk sent by the library (see
+ * do_internal_set_chunk_codec) and pass the data to 'cb'.  Returns
+ * the callback's return value, or -1 if the chunk is invalid.
+ */
+static int
+receive_coded_chunk (int type, char *data, uint32_t data_len,
+                     receive_cb cb, void *opaque)
+{
+  char *out;
+
+  if (type == GUESTFS_CHUNK_HOLE) {
+    uint64_t len;
+    XDR xdr;
+
+    if (data_len != 8)
+      return -1;
+    xdrmem_create (&xdr, data, data_len, XDR_DECODE);
+    xdr_uint64_t (&xdr, &len);
+    xdr_destroy (&xdr);
+
+    /* The library only sends a hole in place of a single chunk. */
+    if (len == 0 || len > GUESTFS_MAX_CHUNK_SIZE)
+      return -1;
+    out = grow_buffer (&codec_in_buf, len);
+    if (out == NULL) {
+      perror ("malloc");
+      return -1;
+    }
+    memset (out, 0, len);
+    return cb (opaque, out, len);
+  }
+
+#ifdef HAVE_LIBZSTD
+  if (type == GUESTFS_CHUNK_ZSTD) {
+    const unsigned long long len = ZSTD_getFrameContentSize (data, data_len);
+    size_t r;
+
+    if (len == ZSTD_CONTENTSIZE_UNKNOWN || len == ZSTD_CONTENTSIZE_ERROR ||
+        len == 0 || len > GUESTFS_MAX_CHUNK_SIZE)
+      return -1;
+    out = grow_buffer (&codec_in_buf, len);
+    if (out == NULL) {
+      perror ("malloc");
+      return -1;
+    }
+    r = ZSTD_decompressDCtx (zstd_dctx, out, len, data, data_len);
+    if (ZSTD_isError (r) || r != len) {
+      fprintf (stderr, "guestfsd: receive_file: zstd chunk: %s\n",
+               ZSTD_isError (r) ? ZSTD_getErrorName (r) : "wrong length");
+      return -1;
+    }
+    return cb (opaque, out, len);
+  }
+#endif
+
+  return -1;
+}
+
+/* Receive file chunks, repeatedly calling 'cb'.
+ *
+ * A chunk is the length word, two XDR words (cancel and the data
+ * length), the data and up to 3 bytes of padding.  Rather than
+ * decoding it with xdr_guestfs_chunk, which would copy the data again,
+ * the header and data are read straight into place with readv.
+ */
 int
 receive_file (receive_cb cb, void *opaque)
 {
-  guestfs_chunk chunk;
-  char lenbuf[4];
+  char lenbuf[4], hdr[8];
+  struct iovec iov[2];
   XDR xdr;
-  int r;
-  uint32_t len;
+  int r, cancel;
+  uint32_t len, data_len;
 
   for (;;) {
-    CLEANUP_FREE char *buf = NULL;
+    char *buf;
+    const int fd = data_socks[next_in_channel];
 
     if (verbose)
       fprintf (stderr, "guestfsd: receive_file: reading length word\n");
 
     /* Read the length word. */
-    if (xread (sock, lenbuf, 4) == -1)
+    if (xread (fd, lenbuf, 4) == -1)
       exit (EXIT_FAILURE);
 
     xdrmem_create (&xdr, lenbuf, 4, XDR_DECODE);
@@ -396,59 +789,75 @@ receive_file (receive_cb cb, void *opaque)
 
     if (len > GUESTFS_MESSAGE_MAX)
       error (EXIT_FAILURE, 0, "incoming message is too long (%u bytes)", len);
+    if (len < sizeof hdr)
+      error (EXIT_FAILURE, 0, "incoming file chunk is too short (%u bytes)", len);
 
-    buf = malloc (len);
+    buf = grow_buffer (&chunk_in_buf, len - sizeof hdr);
     if (!buf) {
       perror ("malloc");
       return -1;
     }
 
-    if (xread (sock, buf, len) == -1)
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = sizeof hdr;
+    iov[1].iov_base = buf;
+    iov[1].iov_len = len - sizeof hdr;
+    if (xreadv (fd, iov, 2) == -1)
       exit (EXIT_FAILURE);
 
-    xdrmem_create (&xdr, buf, len, XDR_DECODE);
-    memset (&chunk, 0, sizeof chunk);
-    if (!xdr_guestfs_chunk (&xdr, &chunk)) {
-      xdr_destroy (&xdr);
-      return -1;
-    }
+    next_in_channel = (next_in_channel + 1) % nr_data_channels;
+
+    xdrmem_create (&xdr, hdr, sizeof hdr, XDR_DECODE);
+    xdr_int (&xdr, &cancel);
+    xdr_u_int (&xdr, &data_len);
     xdr_destroy (&xdr);
 
+    if (data_len > len - sizeof hdr ||
+        len - sizeof hdr - data_len != ((4 - (data_len & 3)) & 3))
+      return -1;
+
     if (verbose)
       fprintf (stderr,
                "guestfsd: receive_file: got chunk: cancel = 0x%x, len = %u, buf = %p\n",
-               (unsigned) chunk.cancel,
-               chunk.data.data_len, chunk.data.data_val);
+               (unsigned) cancel, data_len, buf);
 
-    if (chunk.cancel != 0 && chunk.cancel != 1) {
+    if (cancel != 0 && cancel != 1 &&
+        !(cancel == GUESTFS_CHUNK_HOLE && (chunk_codecs & GUESTFS_CODEC_ZERO)) &&
+        !(cancel == GUESTFS_CHUNK_ZSTD && (chunk_codecs & GUESTFS_CODEC_ZSTD))) {
       fprintf (stderr,
                "guestfsd: receive_file: chunk.cancel != [0|1] ... "
                "continuing even though we have probably lost synchronization with the library\n");
       return -1;
     }
 
-    if (chunk.cancel) {
+    if (cancel == GUESTFS_CHUNK_HOLE || cancel == GUESTFS_CHUNK_ZSTD) {
+      if (cb && receive_coded_chunk (cancel, buf, data_len, cb, opaque) == -1) {
+        if (verbose)
+          fprintf (stderr, "guestfsd: receive_file: write error\n");
+        return -1;
+      }
+      continue;
+    }
+
+    if (cancel) {
       if (verbose)
         fprintf (stderr,
 		 "guestfsd: receive_file: received cancellation from library\n");
-      xdr_free ((xdrproc_t) xdr_guestfs_chunk, (char *) &chunk);
       return -2;
     }
-    if (chunk.data.data_len == 0) {
+    if (data_len == 0) {
       if (verbose)
         fprintf (stderr,
 		 "guestfsd: receive_file: end of file, leaving function\n");
-      xdr_free ((xdrproc_t) xdr_guestfs_chunk, (char *) &chunk);
       return 0;			/* end of file */
     }
 
     /* Note that the callback can generate progress messages. */
     if (cb)
-      r = cb (opaque, chunk.data.data_val, chunk.data.data_len);
+      r = cb (opaque, buf, data_len);
     else
       r = 0;
 
-    xdr_free ((xdrproc_t) xdr_guestfs_chunk, (char *) &chunk);
     if (r == -1) {		/* write error */
       if (verbose)
         fprintf (stderr, "guestfsd: receive_file: write error\n");
@@ -480,13 +889,38 @@ cancel_receive (void)
 
 static int check_for_library_cancellation (void);
 static int send_chunk (const guestfs_chunk *);
+static int send_data_chunk (const char *buf, size_t n);
+
+/* Size of the length word, cancel flag and data length which come
+ * before the data of a chunk.
+ */
+#define CHUNK_HEADER_SIZE 12
 
-/* Also check if the library sends us a cancellation message. */
+static void
+encode_chunk_header (char *hdr, int cancel, uint32_t data_len)
+{
+  XDR xdr;
+  uint32_t len = 8 + data_len + ((4 - (data_len & 3)) & 3);
+
+  xdrmem_create (&xdr, hdr, CHUNK_HEADER_SIZE, XDR_ENCODE);
+  xdr_u_int (&xdr, &len);
+  xdr_int (&xdr, &cancel);
+  xdr_u_int (&xdr, &data_len);
+  xdr_destroy (&xdr);
+}
+
+/* Also check if the library sends us a cancellation message.
+ *
+ * Buffers larger than the negotiated chunk size are split into
+ * several chunks.
+ */
 int
-send_file_write (const void *buf, size_t len)
+send_file_write (const void *v_buf, size_t len)
 {
+  const char *buf = v_buf;
   guestfs_chunk chunk;
   int cancel;
+  size_t n;
 
   if (len > GUESTFS_MAX_CHUNK_SIZE) {
     fprintf (stderr, "guestfsd: send_file_write: len (%zu) > GUESTFS_MAX_CHUNK_SIZE (%d)\n",
@@ -494,23 +928,171 @@ send_file_write (const void *buf, size_t len)
     return -1;
   }
 
-  cancel = check_for_library_cancellation ();
+  do {
+    n = MIN (len, chunk_size);
+
+    cancel = check_for_library_cancellation ();
+
+    if (cancel) {
+      chunk.cancel = 1;
+      chunk.data.data_len = 0;
+      chunk.data.data_val = NULL;
+      if (send_chunk (&chunk) == -1)
+        return -1;
+    }
+    else if (send_data_chunk (buf, n) == -1)
+      return -1;
+
+    if (cancel) return -2;
+
+    buf += n;
+    len -= n;
+  } while (len > 0);
+
+  return 0;
+}
+
+#ifdef HAVE_SPLICE
+/* Pipe used by send_file_from_fd to splice file data to the socket.
+ * If the kernel or the file doesn't support splice then no_splice is
+ * set and we copy through a buffer instead.
+ */
+static int splice_pipe[2] = { -1, -1 };
+static int no_splice;
+
+/* Splice up to 'len' bytes from 'fd' into splice_pipe and from there
+ * to the socket as the data of a single chunk.  Returns the number of
+ * bytes sent, 0 at end of file, -1 on read error, or -3 if splice
+ * can't be used (nothing has been sent in that case).
+ */
+static ssize_t
+send_chunk_spliced (int fd, size_t len)
+{
+  static const char pad[4];
+  char hdr[CHUNK_HEADER_SIZE];
+  char *buf;
+  ssize_t r, n;
+  size_t remaining, padlen;
+  int sock_out;
+
+  if (splice_pipe[0] == -1) {
+    if (pipe2 (splice_pipe, O_CLOEXEC) == -1) {
+      perror ("pipe2");
+      return -3;
+    }
+#ifdef F_SETPIPE_SZ
+    /* Try to make the pipe large enough to hold a whole chunk. */
+    ignore_value (fcntl (splice_pipe[1], F_SETPIPE_SZ, (int) chunk_size));
+#endif
+  }
+
+  /* The pipe is always empty here, so the return value is the length
+   * of the chunk we are going to send.
+   */
+ again:
+  r = splice (fd, NULL, splice_pipe[1], NULL, len, SPLICE_F_MOVE);
+  if (r == -1) {
+    if (errno == EINTR)
+      goto again;
+    if (errno == EINVAL)
+      return -3;
+    return -1;
+  }
+  if (r == 0)
+    return 0;
+
+  padlen = (4 - (r & 3)) & 3;
+  encode_chunk_header (hdr, 0, r);
+
+  sock_out = data_socks[next_out_channel];
+  next_out_channel = (next_out_channel + 1) % nr_data_channels;
 
-  if (cancel) {
-    chunk.cancel = 1;
-    chunk.data.data_len = 0;
-    chunk.data.data_val = NULL;
-  } else {
-    chunk.cancel = 0;
-    chunk.data.data_len = len;
-    chunk.data.data_val = (char *) buf;
+  pthread_mutex_lock (&sock_write_lock);
+  if (xwrite (sock_out, hdr, sizeof hdr) == -1)
+    goto write_error;
+
+  remaining = r;
+  while (remaining > 0) {
+    n = splice (splice_pipe[0], NULL, sock_out, NULL, remaining,
+                SPLICE_F_MOVE);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n == -1 && errno == EINVAL) {
+      /* The socket doesn't support splice, copy the rest. */
+      buf = grow_buffer (&chunk_out_buf, remaining);
+      if (buf == NULL) {
+        perror ("malloc");
+        goto write_error;
+      }
+      if (xread (splice_pipe[0], buf, remaining) == -1 ||
+          xwrite (sock_out, buf, remaining) == -1)
+        goto write_error;
+      break;
+    }
+    if (n <= 0)
+      goto write_error;
+    remaining -= n;
   }
 
-  if (send_chunk (&chunk) == -1)
+  if (padlen > 0 && xwrite (sock_out, pad, padlen) == -1)
+    goto write_error;
+  pthread_mutex_unlock (&sock_write_lock);
+
+  return r;
+
+ write_error:
+  pthread_mutex_unlock (&sock_write_lock);
+  error (EXIT_FAILURE, 0, "send_file_from_fd: write failed");
+  abort ();
+}
+#endif /* HAVE_SPLICE */
+
+/* Read up to 'len' bytes from 'fd' and send them as a single chunk.
+ * Where possible the data is spliced from the file to the socket so
+ * it is never copied through the daemon.
+ *
+ * Returns the number of bytes sent, 0 at end of file, -1 on read
+ * error (errno is set, and the caller should call send_file_end (1)),
+ * or -2 if the library cancelled the transfer.
+ */
+ssize_t
+send_file_from_fd (int fd, size_t len)
+{
+  char *buf;
+  ssize_t r;
+
+  len = MIN (len, chunk_size);
+
+  if (check_for_library_cancellation ()) {
+    if (send_file_end (1) == -1)
+      return -1;
+    return -2;
+  }
+
+#ifdef HAVE_SPLICE
+  /* Chunk codecs need the data in our own buffer. */
+  if (!no_splice && !chunk_codecs) {
+    r = send_chunk_spliced (fd, len);
+    if (r != -3)
+      return r;
+    no_splice = 1;
+  }
+#endif
+
+  buf = grow_buffer (&chunk_out_buf, len);
+  if (buf == NULL)
     return -1;
 
-  if (cancel) return -2;
-  return 0;
+  do
+    r = read (fd, buf, len);
+  while (r == -1 && errno == EINTR);
+  if (r <= 0)
+    return r;
+
+  if (send_data_chunk (buf, r) == -1)
+    return -1;
+
+  return r;
 }
 
 static int
@@ -523,6 +1105,14 @@ check_for_library_cancellation (void)
   uint32_t flag;
   XDR xdr;
 
+  /* call_cancelled may have read the flag already. */
+  if (cancel_requested)
+    return 1;
+
+  /* The next request is already arriving (see call_cancelled). */
+  if (have_next_lenbuf)
+    return 0;
+
   FD_ZERO (&rset);
   FD_SET (sock, &rset);
   tv.tv_sec = 0;
@@ -550,9 +1140,107 @@ check_for_library_cancellation (void)
     return 0;
   }
 
+  cancel_requested = 1;
+  return 1;
+}
+
+/* Minimum time between checks of the socket in call_cancelled. */
+#define CANCEL_POLL_PERIOD 10000 /* microseconds */
+
+/* Returns true if the library has cancelled the current call.  This
+ * is self-rate-limiting, so loops can call it as often as necessary.
+ */
+int
+call_cancelled (void)
+{
+  struct timeval now_t;
+  int64_t last_us, now_us;
+  fd_set rset;
+  struct timeval tv;
+  char buf[4];
+  uint32_t flag;
+  XDR xdr;
+
+  if (cancel_requested)
+    return 1;
+
+  /* With worker threads the main loop reads the socket instead.
+   * Other threads (eg. started by a call) only see the flag.
+   */
+  if (!poll_for_cancel || have_next_lenbuf)
+    return 0;
+
+  gettimeofday (&now_t, NULL);
+  last_us =
+    (int64_t) last_cancel_poll_t.tv_sec * 1000000 + last_cancel_poll_t.tv_usec;
+  now_us = (int64_t) now_t.tv_sec * 1000000 + now_t.tv_usec;
+  if (now_us - last_us < CANCEL_POLL_PERIOD)
+    return 0;
+  last_cancel_poll_t = now_t;
+
+  FD_ZERO (&rset);
+  FD_SET (sock, &rset);
+  tv.tv_sec = 0;
+  tv.tv_usec = 0;
+  if (select (sock+1, &rset, NULL, NULL, &tv) <= 0)
+    return 0;
+
+  if (xread (sock, buf, sizeof buf) == -1)
+    exit (EXIT_FAILURE);
+
+  xdrmem_create (&xdr, buf, sizeof buf, XDR_DECODE);
+  xdr_u_int (&xdr, &flag);
+  xdr_destroy (&xdr);
+
+  if (flag != GUESTFS_CANCEL_FLAG) {
+    memcpy (next_lenbuf, buf, sizeof buf);
+    have_next_lenbuf = 1;
+    return 0;
+  }
+
+  if (verbose)
+    fprintf (stderr, "guestfsd: call_cancelled: cancelled by the library\n");
+  cancel_requested = 1;
   return 1;
 }
 
+/* Send a hole of 'len' zero bytes.  The library seeks over it when
+ * it is writing to a regular file, so no data has to be sent.
+ *
+ * Returns 0 on success, -1 on error, or -2 if the library cancelled
+ * the transfer (in which case the cancellation has been sent).
+ */
+static int send_hole_chunk (uint64_t len);
+
+int
+send_file_hole (uint64_t len)
+{
+  if (check_for_library_cancellation ()) {
+    if (send_file_end (1) == -1)
+      return -1;
+    return -2;
+  }
+
+  return send_hole_chunk (len);
+}
+
+static int
+send_hole_chunk (uint64_t len)
+{
+  guestfs_chunk chunk;
+  char buf[8];
+  XDR xdr;
+
+  xdrmem_create (&xdr, buf, sizeof buf, XDR_ENCODE);
+  xdr_uint64_t (&xdr, &len);
+  xdr_destroy (&xdr);
+
+  chunk.cancel = GUESTFS_CHUNK_HOLE;
+  chunk.data.data_len = sizeof buf;
+  chunk.data.data_val = buf;
+  return send_chunk (&chunk);
+}
+
 int
 send_file_end (int cancel)
 {
@@ -564,41 +1252,162 @@ send_file_end (int cancel)
   return send_chunk (&chunk);
 }
 
+/* Send 'n' bytes of file data as a single chunk.  If the
+ * library has agreed to it, a chunk of zeroes is sent as a hole and
+ * other chunks are compressed, when that makes them smaller.
+ */
+static int
+send_data_chunk (const char *buf, size_t n)
+{
+  guestfs_chunk chunk;
+
+  if (n > 0 && (chunk_codecs & GUESTFS_CODEC_ZERO) && is_zero (buf, n))
+    return send_hole_chunk (n);
+
+#ifdef HAVE_LIBZSTD
+  if (chunk_codecs & GUESTFS_CODEC_ZSTD) {
+    const size_t bound = ZSTD_compressBound (n);
+    char *out;
+    size_t r;
+
+    out = grow_buffer (&codec_out_buf, bound);
+    if (out == NULL) {
+      perror ("malloc");
+      return -1;
+    }
+    r = ZSTD_compressCCtx (zstd_cctx, out, bound, buf, n, CHUNK_ZSTD_LEVEL);
+    if (!ZSTD_isError (r) && r < n) {
+      chunk.cancel = GUESTFS_CHUNK_ZSTD;
+      chunk.data.data_len = r;
+      chunk.data.data_val = out;
+      return send_chunk (&chunk);
+    }
+  }
+#endif
+
+  chunk.cancel = 0;
+  chunk.data.data_len = n;
+  chunk.data.data_val = (char *) buf;
+  return send_chunk (&chunk);
+}
+
+/* The chunk data is written straight from the caller's buffer, after
+ * the header, instead of being copied into an XDR buffer first.
+ */
 static int
 send_chunk (const guestfs_chunk *chunk)
 {
-  const size_t buf_len = GUESTFS_MAX_CHUNK_SIZE + 48;
-  CLEANUP_FREE char *buf = NULL;
-  char lenbuf[4];
-  XDR xdr;
-  uint32_t len;
+  static const char pad[4];
+  const uint32_t data_len = chunk->data.data_len;
+  char hdr[CHUNK_HEADER_SIZE];
+  struct iovec iov[3];
+  int fd, r;
+
+  encode_chunk_header (hdr, chunk->cancel, data_len);
+
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = sizeof hdr;
+  iov[1].iov_base = chunk->data.data_val;
+  iov[1].iov_len = data_len;
+  iov[2].iov_base = (char *) pad;
+  iov[2].iov_len = (4 - (data_len & 3)) & 3;
+
+  fd = data_socks[next_out_channel];
+  next_out_channel = (next_out_channel + 1) % nr_data_channels;
+
+  pthread_mutex_lock (&sock_write_lock);
+  r = xwritev (fd, iov, 3);
+  pthread_mutex_unlock (&sock_write_lock);
+  if (r == -1)
+    error (EXIT_FAILURE, 0, "send_chunk: write failed");
+
+  return r;
+}
 
-  buf = malloc (buf_len);
-  if (buf == NULL) {
-    perror ("malloc");
+/* Called by the library after launch to negotiate a larger chunk size. */
+int
+do_internal_set_chunk_size (int size)
+{
+  if (size < GUESTFS_DEFAULT_CHUNK_SIZE) {
+    reply_with_error ("chunk size must be at least %d bytes",
+                      GUESTFS_DEFAULT_CHUNK_SIZE);
     return -1;
   }
 
-  xdrmem_create (&xdr, buf, buf_len, XDR_ENCODE);
-  if (!xdr_guestfs_chunk (&xdr, (guestfs_chunk *) chunk)) {
-    fprintf (stderr, "guestfsd: send_chunk: failed to encode chunk\n");
-    xdr_destroy (&xdr);
+  chunk_size = MIN ((size_t) size, GUESTFS_MAX_CHUNK_SIZE);
+
+  if (verbose)
+    fprintf (stderr, "guestfsd: file transfer chunk size is %zu bytes\n",
+             chunk_size);
+
+  return (int) chunk_size;
+}
+
+/* Called by the library after launch, if the appliance is remote,
+ * to agree which chunk codecs both sides may use.  We return the
+ * subset of 'codecs' that we support.
+ */
+int
+do_internal_set_chunk_codec (int codecs)
+{
+  int supported = GUESTFS_CODEC_ZERO;
+
+#ifdef HAVE_LIBZSTD
+  if (zstd_cctx == NULL)
+    zstd_cctx = ZSTD_createCCtx ();
+  if (zstd_dctx == NULL)
+    zstd_dctx = ZSTD_createDCtx ();
+  if (zstd_cctx && zstd_dctx)
+    supported |= GUESTFS_CODEC_ZSTD;
+#endif
+
+  chunk_codecs = codecs & supported;
+
+  if (verbose)
+    fprintf (stderr, "guestfsd: file transfer chunk codecs are 0x%x\n",
+             (unsigned) chunk_codecs);
+
+  return chunk_codecs;
+}
+
+/* Called by the library after launch if the appliance has extra
+ * virtio-serial channels for file transfers.  We open as many of
+ * them as we can and return the number of channels (including the
+ * main channel) that we will stripe transfers across.
+ */
+int
+do_internal_set_data_channels (int n)
+{
+  size_t i;
+
+  if (n < 1) {
+    reply_with_error ("number of channels must be >= 1");
     return -1;
   }
+  if (n > GUESTFS_MAX_DATA_CHANNELS)
+    n = GUESTFS_MAX_DATA_CHANNELS;
 
-  len = xdr_getpos (&xdr);
-  xdr_destroy (&xdr);
+  /* Only allow this to be set once. */
+  if (nr_data_channels > 1)
+    return (int) nr_data_channels;
 
-  xdrmem_create (&xdr, lenbuf, 4, XDR_ENCODE);
-  xdr_u_int (&xdr, &len);
-  xdr_destroy (&xdr);
+  for (i = 1; i < (size_t) n; ++i) {
+    char path[64];
 
-  const int err = (xwrite (sock, lenbuf, 4) == 0
-                   && xwrite (sock, buf, len) == 0 ? 0 : -1);
-  if (err)
-    error (EXIT_FAILURE, 0, "send_chunk: write failed");
+    snprintf (path, sizeof path, DATA_CHANNEL_PATH, i);
+    data_socks[i] = open (path, O_RDWR|O_CLOEXEC);
+    if (data_socks[i] == -1) {
+      perror (path);
+      break;
+    }
+  }
+  nr_data_channels = i;
+
+  if (verbose)
+    fprintf (stderr, "guestfsd: striping file transfers across %zu channels\n",
+             nr_data_channels);
 
-  return err;
+  return (int) nr_data_channels;
 }
 
 /* Initial delay before sending notification messages, and
@@ -608,6 +1417,33 @@ send_chunk (const guestfs_chunk *chunk)
 #define NOTIFICATION_INITIAL_DELAY 2000000
 #define NOTIFICATION_PERIOD         333333
 
+/* The period actually used, which the library may make longer by
+ * calling internal_set_progress_interval.
+ */
+static int notification_period = NOTIFICATION_PERIOD;
+
+/* Called by the library to reduce the rate of progress messages. */
+int
+do_internal_set_progress_interval (int interval)
+{
+  if (interval < 0) {
+    reply_with_error ("interval must be >= 0");
+    return -1;
+  }
+
+  /* Limit to an hour, so the period in microseconds fits in an int. */
+  if (interval > 3600000)
+    interval = 3600000;
+
+  notification_period = MAX (interval * 1000, NOTIFICATION_PERIOD);
+
+  if (verbose)
+    fprintf (stderr, "guestfsd: progress notification period is %d us\n",
+             notification_period);
+
+  return 0;
+}
+
 void
 notify_progress (uint64_t position, uint64_t total)
 {
@@ -635,7 +1471,7 @@ notify_progress (uint64_t position, uint64_t total)
 
   /* Rate limit. */
   if ((count_progress == 0 && elapsed_us < NOTIFICATION_INITIAL_DELAY) ||
-      (count_progress > 0 && elapsed_us < NOTIFICATION_PERIOD))
+      (count_progress > 0 && elapsed_us < notification_period))
     return;
 
   notify_progress_no_ratelimit (position, total, &now_t);
@@ -646,6 +1482,7 @@ notify_progress_no_ratelimit (uint64_t position, uint64_t total,
                               const struct timeval *now_t)
 {
   XDR xdr;
+  char flagbuf[4];
   char buf[128];
   uint32_t i;
   size_t len;
@@ -654,15 +1491,12 @@ notify_progress_no_ratelimit (uint64_t position, uint64_t total,
   count_progress++;
   last_progress_t = *now_t;
 
-  /* Send the header word. */
+  /* The header word. */
   i = GUESTFS_PROGRESS_FLAG;
-  xdrmem_create (&xdr, buf, 4, XDR_ENCODE);
+  xdrmem_create (&xdr, flagbuf, 4, XDR_ENCODE);
   xdr_u_int (&xdr, &i);
   xdr_destroy (&xdr);
 
-  if (xwrite (sock, buf, 4) == -1)
-    error (EXIT_FAILURE, 0, "xwrite failed");
-
   message.proc = proc_nr;
   message.serial = serial;
   message.position = position;
@@ -677,7 +1511,7 @@ notify_progress_no_ratelimit (uint64_t position, uint64_t total,
   len = xdr_getpos (&xdr);
   xdr_destroy (&xdr);
 
-  if (xwrite (sock, buf, len) == -1)
+  if (write_message (sock, flagbuf, buf, len) == -1)
     error (EXIT_FAILURE, 0, "xwrite failed");
 }
 
@@ -687,12 +1521,18 @@ notify_progress_no_ratelimit (uint64_t position, uint64_t total,
 
 static void async_safe_send_pulse (int sig);
 
+/* The itimer and SIGALRM handler are process-wide, so pulse mode is
+ * not available to calls running in worker threads.
+ */
 void
 pulse_mode_start (void)
 {
   struct sigaction act;
   struct itimerval it;
 
+  if (in_worker)
+    return;
+
   memset (&act, 0, sizeof act);
   act.sa_handler = async_safe_send_pulse;
   act.sa_flags = SA_RESTART;
@@ -704,8 +1544,8 @@ pulse_mode_start (void)
 
   it.it_value.tv_sec = NOTIFICATION_INITIAL_DELAY / 1000000;
   it.it_value.tv_usec = NOTIFICATION_INITIAL_DELAY % 1000000;
-  it.it_interval.tv_sec = NOTIFICATION_PERIOD / 1000000;
-  it.it_interval.tv_usec = NOTIFICATION_PERIOD % 1000000;
+  it.it_interval.tv_sec = notification_period / 1000000;
+  it.it_interval.tv_usec = notification_period % 1000000;
 
   if (setitimer (ITIMER_REAL, &it, NULL) == -1)
     perror ("pulse_mode_start: setitimer");
@@ -714,6 +1554,9 @@ pulse_mode_start (void)
 void
 pulse_mode_end (void)
 {
+  if (in_worker)
+    return;
+
   pulse_mode_cancel ();         /* Cancel the itimer. */
 
   notify_progress (1, 1);
@@ -726,6 +1569,9 @@ pulse_mode_cancel (void)
   struct itimerval it;
   struct sigaction act;
 
+  if (in_worker)
+    return;
+
   /* Setting it_value to zero cancels the itimer. */
   it.it_value.tv_sec = 0;
   it.it_value.tv_usec = 0;
@@ -22,71 +22,59 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 #include <dirent.h>
+#include <rpc/types.h>
+#include <rpc/xdr.h>
 
+#include "guestfs_protocol.h"
 #include "daemon.h"
 #include "actions.h"
 
-static void
-free_int_dirent_list (guestfs_int_dirent *p, size_t len)
+/* Has one FileOut parameter. */
+int
+do_internal_readdir (const char *path)
 {
-  size_t i;
-
-  for (i = 0; i < len; ++i) {
-    free (p[i].name);
-  }
-  free (p);
-}
-
-guestfs_int_dirent_list *
-do_readdir (const char *path)
-{
-  guestfs_int_dirent_list *ret;
-  guestfs_int_dirent v;
   DIR *dir;
   struct dirent *d;
-  size_t i;
+  guestfs_int_dirent v;
+  CLEANUP_FREE char *buf = NULL;
+  XDR xdr;
+  u_int pos;
 
-  ret = malloc (sizeof *ret);
-  if (ret == NULL) {
+  buf = malloc (GUESTFS_MAX_CHUNK_SIZE);
+  if (buf == NULL) {
     reply_with_perror ("malloc");
-    return NULL;
+    return -1;
   }
 
-  ret->guestfs_int_dirent_list_len = 0;
-  ret->guestfs_int_dirent_list_val = NULL;
-
   CHROOT_IN;
   dir = opendir (path);
   CHROOT_OUT;
 
   if (dir == NULL) {
     reply_with_perror ("opendir: %s", path);
-    free (ret);
-    return NULL;
+    return -1;
   }
 
-  i = 0;
-  while ((d = readdir (dir)) != NULL) {
-    guestfs_int_dirent *p;
-
-    p = realloc (ret->guestfs_int_dirent_list_val,
-                 sizeof (guestfs_int_dirent) * (i+1));
-    v.name = strdup (d->d_name);
-    if (!p || !v.name) {
-      reply_with_perror ("allocate");
-      if (p) {
-        free_int_dirent_list (p, i);
-      } else {
-        free_int_dirent_list (ret->guestfs_int_dirent_list_val, i);
-      }
-      free (v.name);
-      free (ret);
-      closedir (dir);
-      return NULL;
-    }
-    ret->guestfs_int_dirent_list_val = p;
+  /* Now we must send the reply message, before the entries.  After
+   * this there is no opportunity in the protocol to send any error
+   * message back.  Instead we can only cancel the transfer.
+   */
+  reply (NULL, NULL);
 
+  /* The entries are XDR-encoded into buf, which is sent whenever it
+   * fills up.  So the daemon never holds more than one chunk however
+   * large the directory is.
+   */
+  xdrmem_create (&xdr, buf, GUESTFS_MAX_CHUNK_SIZE, XDR_ENCODE);
+
+  while (1) {
+    errno = 0;
+    d = readdir (dir);
+    if (d == NULL) break;
+
+    v.name = d->d_name;
     v.ino = d->d_ino;
 #ifdef HAVE_STRUCT_DIRENT_D_TYPE
     switch (d->d_type) {
@@ -104,19 +92,49 @@ do_readdir (const char *path)
     v.ftyp = 'u';
 #endif
 
-    ret->guestfs_int_dirent_list_val[i] = v;
+    pos = xdr_getpos (&xdr);
+    if (!xdr_guestfs_int_dirent (&xdr, &v)) {
+      /* The buffer is full.  Send what is in it and start again. */
+      if (send_file_write (buf, pos) < 0) {
+        xdr_destroy (&xdr);
+        closedir (dir);
+        return -1;
+      }
+      xdr_setpos (&xdr, 0);
+      if (!xdr_guestfs_int_dirent (&xdr, &v)) {
+        fprintf (stderr, "xdr_guestfs_int_dirent: %s: failed to encode %s\n",
+                 path, d->d_name);
+        goto cancel;
+      }
+    }
+  }
 
-    i++;
+  if (errno != 0) {
+    fprintf (stderr, "readdir: %s: %m\n", path);
+    goto cancel;
   }
 
-  ret->guestfs_int_dirent_list_len = i;
+  pos = xdr_getpos (&xdr);
+  xdr_destroy (&xdr);
+  if (pos > 0 && send_file_write (buf, pos) < 0) {
+    closedir (dir);
+    return -1;
+  }
 
   if (closedir (dir) == -1) {
-    reply_with_perror ("closedir");
-    free (ret->guestfs_int_dirent_list_val);
-    free (ret);
-    return NULL;
+    fprintf (stderr, "closedir: %s: %m\n", path);
+    send_file_end (1);          /* Cancel. */
+    return -1;
   }
 
-  return ret;
+  if (send_file_end (0))	/* Normal end of file. */
+    return -1;
+
+  return 0;
+
+ cancel:
+  xdr_destroy (&xdr);
+  send_file_end (1);            /* Cancel. */
+  closedir (dir);
+  return -1;
 }
@@ -20,11 +20,16 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <time.h>
+#include <errno.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <dirent.h>
 
 #include "cloexec.h"
@@ -49,18 +54,247 @@ do_realpath (const char *path)
   return ret;			/* caller frees */
 }
 
-static int find_path_element (int fd_cwd, int is_end, const char *name, char **name_ret);
+/* Windows guests need many paths under the same few directories
+ * (eg. system32, system32/drivers) resolved case insensitively, and
+ * each path element means reading a whole directory.  So the names in
+ * the last few directories read are kept here.  An entry is used only
+ * while the directory's mtime and ctime are unchanged, which catches
+ * any files added, removed or renamed in it.  Directories which
+ * changed in the last few seconds are not cached, in case a change
+ * fell within the granularity of the timestamps (2 seconds on FAT).
+ */
+#define DIR_CACHE_SIZE 32
+#define DIR_CACHE_RACY_SECS 2
+
+struct dir_listing {
+  dev_t dev;
+  ino_t ino;
+  struct timespec mtime, ctime;
+  uint64_t last_used;
+  size_t nr_names;
+  char **names;                 /* in readdir order */
+};
+
+static struct dir_listing dir_cache[DIR_CACHE_SIZE];
+static uint64_t dir_cache_clock;
+
+/* Errors are collected here rather than replied to immediately, since
+ * case_sensitive_paths carries on with the next path.
+ */
+struct resolve_error {
+  int errnum;                   /* errno, or 0 if there is none */
+  char msg[256];
+};
 
-char *
-do_case_sensitive_path (const char *path)
+static void
+set_error (struct resolve_error *err, int errnum, const char *fs, ...)
+  __attribute__((format (printf,3,4)));
+
+static void
+set_error (struct resolve_error *err, int errnum, const char *fs, ...)
+{
+  va_list args;
+
+  err->errnum = errnum;
+  va_start (args, fs);
+  vsnprintf (err->msg, sizeof err->msg, fs, args);
+  va_end (args);
+}
+
+static void
+free_listing (struct dir_listing *l)
+{
+  size_t i;
+
+  for (i = 0; i < l->nr_names; ++i)
+    free (l->names[i]);
+  free (l->names);
+  memset (l, 0, sizeof *l);
+}
+
+static int
+timespec_eq (const struct timespec *t1, const struct timespec *t2)
+{
+  return t1->tv_sec == t2->tv_sec && t1->tv_nsec == t2->tv_nsec;
+}
+
+/* Read the names in the directory 'fd_dir' into 'l'.  Returns -1 on
+ * error.
+ */
+static int
+read_listing (int fd_dir, struct dir_listing *l, struct resolve_error *err)
+{
+  int fd2;
+  DIR *dir;
+  struct dirent *d;
+  size_t alloc = 0;
+  char **names;
+
+  fd2 = dup_cloexec (fd_dir); /* because closedir will close it */
+  if (fd2 == -1) {
+    set_error (err, errno, "dup");
+    return -1;
+  }
+  dir = fdopendir (fd2);
+  if (dir == NULL) {
+    set_error (err, errno, "opendir");
+    close (fd2);
+    return -1;
+  }
+
+  for (;;) {
+    errno = 0;
+    d = readdir (dir);
+    if (d == NULL)
+      break;
+    if (l->nr_names == alloc) {
+      alloc = alloc ? alloc * 2 : 64;
+      names = realloc (l->names, alloc * sizeof (char *));
+      if (names == NULL)
+        goto error;
+      l->names = names;
+    }
+    l->names[l->nr_names] = strdup (d->d_name);
+    if (l->names[l->nr_names] == NULL)
+      goto error;
+    l->nr_names++;
+  }
+  if (errno != 0) {
+    set_error (err, errno, "readdir");
+    closedir (dir);
+    free_listing (l);
+    return -1;
+  }
+
+  if (closedir (dir) == -1) {
+    set_error (err, errno, "closedir");
+    free_listing (l);
+    return -1;
+  }
+  return 0;
+
+ error:
+  set_error (err, errno, "malloc");
+  closedir (dir);
+  free_listing (l);
+  return -1;
+}
+
+/* Return the names in the directory 'fd_dir', from the cache if
+ * possible.  If the listing is not cached, it is returned in
+ * '*uncached' and the caller must free it.  Returns NULL on error.
+ */
+static const struct dir_listing *
+get_listing (int fd_dir, struct dir_listing *uncached,
+             struct resolve_error *err)
+{
+  struct stat statbuf;
+  struct dir_listing *l, *victim = &dir_cache[0];
+  time_t now;
+  size_t i;
+
+  if (fstat (fd_dir, &statbuf) == -1) {
+    set_error (err, errno, "fstat");
+    return NULL;
+  }
+
+  for (i = 0; i < DIR_CACHE_SIZE; ++i) {
+    l = &dir_cache[i];
+    if (l->names != NULL &&
+        l->dev == statbuf.st_dev && l->ino == statbuf.st_ino) {
+      if (timespec_eq (&l->mtime, &statbuf.st_mtim) &&
+          timespec_eq (&l->ctime, &statbuf.st_ctim)) {
+        l->last_used = ++dir_cache_clock;
+        return l;
+      }
+      free_listing (l);
+    }
+    if (l->last_used < victim->last_used)
+      victim = l;
+  }
+
+  now = time (NULL);
+  if (statbuf.st_mtim.tv_sec >= now - DIR_CACHE_RACY_SECS ||
+      statbuf.st_ctim.tv_sec >= now - DIR_CACHE_RACY_SECS) {
+    memset (uncached, 0, sizeof *uncached);
+    if (read_listing (fd_dir, uncached, err) == -1)
+      return NULL;
+    return uncached;
+  }
+
+  free_listing (victim);
+  if (read_listing (fd_dir, victim, err) == -1)
+    return NULL;
+  victim->dev = statbuf.st_dev;
+  victim->ino = statbuf.st_ino;
+  victim->mtime = statbuf.st_mtim;
+  victim->ctime = statbuf.st_ctim;
+  victim->last_used = ++dir_cache_clock;
+  return victim;
+}
+
+/* 'fd_cwd' is a file descriptor pointing to an open directory.
+ * 'name' is the path element to search for.  'is_end' is a flag
+ * indicating if this is the last path element.
+ *
+ * We search the directory looking for a path element that case
+ * insensitively matches 'name', returning the actual name in '*name_ret'.
+ *
+ * If this is successful, return 0.  If it fails, fill in 'err' and
+ * return -1.
+ */
+static int
+find_path_element (int fd_cwd, int is_end, const char *name, char **name_ret,
+                   struct resolve_error *err)
+{
+  struct dir_listing uncached = { 0 };
+  const struct dir_listing *l;
+  const char *found = NULL;
+  size_t i;
+
+  l = get_listing (fd_cwd, &uncached, err);
+  if (l == NULL)
+    return -1;
+
+  for (i = 0; i < l->nr_names; ++i) {
+    if (STRCASEEQ (l->names[i], name)) {
+      found = l->names[i];
+      break;
+    }
+  }
+
+  if (found == NULL && !is_end) {
+    set_error (err, 0, "%s: no file or directory found with this name", name);
+    free_listing (&uncached);
+    return -1;
+  }
+
+  /* Last path element not found: return it as-is, assuming that the
+   * user will create a new file or directory (RHBZ#840115).
+   */
+  *name_ret = strdup (found ? found : name);
+  free_listing (&uncached);
+  if (*name_ret == NULL) {
+    set_error (err, errno, "strdup");
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Resolve 'path' case insensitively, starting from 'fd_root' (the
+ * sysroot).  Returns NULL and fills in 'err' on error.
+ */
+static char *
+resolve_path (int fd_root, const char *path, struct resolve_error *err)
 {
   size_t next;
-  int fd_cwd, fd2, err, is_end;
+  int fd_cwd, fd2, errnum, is_end;
   char *ret;
 
   ret = strdup ("/");
   if (ret == NULL) {
-    reply_with_perror ("strdup");
+    set_error (err, errno, "strdup");
     return NULL;
   }
   next = 1; /* next position in 'ret' buffer */
@@ -68,9 +302,9 @@ do_case_sensitive_path (const char *path)
   /* 'fd_cwd' here is a surrogate for the current working directory, so
    * that we don't have to actually call chdir(2).
    */
-  fd_cwd = open (sysroot, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+  fd_cwd = dup_cloexec (fd_root);
   if (fd_cwd == -1) {
-    reply_with_perror ("%s", sysroot);
+    set_error (err, errno, "dup");
     goto error;
   }
 
@@ -90,13 +324,13 @@ do_case_sensitive_path (const char *path)
 
     if ((i == 1 && path[0] == '.') ||
         (i == 2 && path[0] == '.' && path[1] == '.')) {
-      reply_with_error ("path contained . or .. elements");
+      set_error (err, 0, "path contained . or .. elements");
       goto error;
     }
 
     name_in = strndup (path, i);
     if (name_in == NULL) {
-      reply_with_perror ("strdup");
+      set_error (err, errno, "strdup");
       goto error;
     }
 
@@ -108,7 +342,7 @@ do_case_sensitive_path (const char *path)
      * this element of the path.  This replaces 'name' with the
      * correct case version.
      */
-    if (find_path_element (fd_cwd, is_end, name_in, &name_out) == -1)
+    if (find_path_element (fd_cwd, is_end, name_in, &name_out, err) == -1)
       goto error;
     len = strlen (name_out);
 
@@ -118,7 +352,7 @@ do_case_sensitive_path (const char *path)
 
     t = realloc (ret, next+len+1);
     if (t == NULL) {
-      reply_with_perror ("realloc");
+      set_error (err, errno, "realloc");
       goto error;
     }
     ret = t;
@@ -128,16 +362,15 @@ do_case_sensitive_path (const char *path)
 
     /* Is it a directory?  Try going into it. */
     fd2 = openat (fd_cwd, name_out, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
-    err = errno;
+    errnum = errno;
     close (fd_cwd);
     fd_cwd = fd2;
-    errno = err;
     if (fd_cwd == -1) {
       /* Some errors are OK provided we've reached the end of the path. */
-      if (is_end && (errno == ENOTDIR || errno == ENOENT))
+      if (is_end && (errnum == ENOTDIR || errnum == ENOENT))
         break;
 
-      reply_with_perror ("openat: %s", name_out);
+      set_error (err, errnum, "openat: %s", name_out);
       goto error;
     }
   }
@@ -155,83 +388,77 @@ do_case_sensitive_path (const char *path)
   return NULL;
 }
 
-/* 'fd_cwd' is a file descriptor pointing to an open directory.
- * 'name' is the path element to search for.  'is_end' is a flag
- * indicating if this is the last path element.
- *
- * We search the directory looking for a path element that case
- * insensitively matches 'name', returning the actual name in '*name_ret'.
- *
- * If this is successful, return 0.  If it fails, reply with an error
- * and return -1.
- */
-static int
-find_path_element (int fd_cwd, int is_end, const char *name, char **name_ret)
+static void
+reply_with_resolve_error (const struct resolve_error *err)
 {
-  int fd2;
-  DIR *dir;
-  struct dirent *d;
-
-  fd2 = dup_cloexec (fd_cwd); /* because closedir will close it */
-  if (fd2 == -1) {
-    reply_with_perror ("dup");
-    return -1;
-  }
-  dir = fdopendir (fd2);
-  if (dir == NULL) {
-    reply_with_perror ("opendir");
-    close (fd2);
-    return -1;
+  if (err->errnum != 0) {
+    errno = err->errnum;
+    reply_with_perror ("%s", err->msg);
   }
+  else
+    reply_with_error ("%s", err->msg);
+}
 
-  for (;;) {
-    errno = 0;
-    d = readdir (dir);
-    if (d == NULL)
-      break;
-    if (STRCASEEQ (d->d_name, name))
-      break;
-  }
+char *
+do_case_sensitive_path (const char *path)
+{
+  struct resolve_error err;
+  int fd_root;
+  char *ret;
 
-  if (d == NULL && errno != 0) {
-    reply_with_perror ("readdir");
-    closedir (dir);
-    return -1;
+  fd_root = open (sysroot, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+  if (fd_root == -1) {
+    reply_with_perror ("%s", sysroot);
+    return NULL;
   }
 
-  if (d == NULL && is_end) {
-    /* Last path element: return it as-is, assuming that the user will
-     * create a new file or directory (RHBZ#840115).
-     */
-    closedir (dir);
-    *name_ret = strdup (name);
-    if (*name_ret == NULL) {
-      reply_with_perror ("strdup");
-      return -1;
+  ret = resolve_path (fd_root, path, &err);
+  close (fd_root);
+  if (ret == NULL)
+    reply_with_resolve_error (&err);
+
+  return ret;                   /* caller frees */
+}
+
+char **
+do_case_sensitive_paths (char *const *paths)
+{
+  CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (ret);
+  struct resolve_error err;
+  int fd_root;
+  size_t i;
+
+  for (i = 0; paths[i] != NULL; ++i) {
+    if (paths[i][0] != '/') {
+      reply_with_error ("%s: path must start with a / character", paths[i]);
+      return NULL;
     }
-    return 0;
   }
 
-  if (d == NULL) {
-    reply_with_error ("%s: no file or directory found with this name", name);
-    closedir (dir);
-    return -1;
+  fd_root = open (sysroot, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+  if (fd_root == -1) {
+    reply_with_perror ("%s", sysroot);
+    return NULL;
   }
 
-  *name_ret = strdup (d->d_name);
-  if (*name_ret == NULL) {
-    reply_with_perror ("strdup");
-    closedir (dir);
-    return -1;
-  }
+  for (i = 0; paths[i] != NULL; ++i) {
+    char *rpath = resolve_path (fd_root, paths[i], &err);
 
-  /* NB: closedir frees the structure associated with 'd', so we must
-   * do this last.
-   */
-  if (closedir (dir) == -1) {
-    reply_with_perror ("closedir");
-    return -1;
+    /* Paths which cannot be resolved are returned as "". */
+    if (rpath == NULL && (rpath = strdup ("")) == NULL) {
+      reply_with_perror ("strdup");
+      close (fd_root);
+      return NULL;
+    }
+    if (add_string_nodup (&ret, rpath) == -1) {
+      close (fd_root);
+      return NULL;
+    }
   }
+  close (fd_root);
 
-  return 0;
+  if (end_stringsbuf (&ret) == -1)
+    return NULL;
+
+  return take_stringsbuf (&ret);
 }
@@ -20,7 +20,23 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined(HAVE_LIBSELINUX)
+#include <selinux/selinux.h>
+#include <selinux/label.h>
+#include <selinux/context.h>
+#endif
+
+#include "ignore-value.h"
 
 #include "guestfs_protocol.h"
 #include "daemon.h"
@@ -29,7 +45,17 @@
 
 GUESTFSD_EXT_CMD(str_setfiles, setfiles);
 
-#define MAX_ARGS 64
+/* Directories that should never be relabelled in ordinary Linux
+ * guests.  These won't be mounted anyway.
+ */
+static const char *excluded_dirs[] = { "/dev", "/proc", "/selinux", "/sys" };
+#define NR_EXCLUDED_DIRS (sizeof excluded_dirs / sizeof excluded_dirs[0])
+
+struct relabel {
+  char *specfile;               /* these are all sysroot paths */
+  char *excludes[NR_EXCLUDED_DIRS];
+  int force;
+};
 
 int
 optgroup_selinuxrelabel_available (void)
@@ -37,64 +63,433 @@ optgroup_selinuxrelabel_available (void)
   return prog_exists (str_setfiles);
 }
 
-/* Takes optional arguments, consult optargs_bitmask. */
-int
-do_selinux_relabel (const char *specfile, const char *path,
-                    int force)
+/* Test if setfiles can relabel using several threads (-T option,
+ * policycoreutils >= 3.2).
+ */
+static int
+setfiles_has_threads (void)
 {
-  const char *argv[MAX_ARGS];
-  CLEANUP_FREE char *s_dev = NULL, *s_proc = NULL, *s_selinux = NULL,
-    *s_sys = NULL, *s_specfile = NULL, *s_path = NULL;
-  CLEANUP_FREE char *err = NULL;
-  size_t i = 0;
+  static int tested = -1;
+  CLEANUP_FREE char *out = NULL, *err = NULL;
 
-  s_dev = sysroot_path ("/dev");
-  if (!s_dev) {
-  malloc_error:
-    reply_with_perror ("malloc");
-    return -1;
-  }
-  s_proc = sysroot_path ("/proc");       if (!s_proc) goto malloc_error;
-  s_selinux = sysroot_path ("/selinux"); if (!s_selinux) goto malloc_error;
-  s_sys = sysroot_path ("/sys");         if (!s_sys) goto malloc_error;
-  s_specfile = sysroot_path (specfile);  if (!s_specfile) goto malloc_error;
-  s_path = sysroot_path (path);          if (!s_path) goto malloc_error;
+  if (tested != -1)
+    return tested;
 
-  /* Default settings if not selected. */
-  if (!(optargs_bitmask & GUESTFS_SELINUX_RELABEL_FORCE_BITMASK))
-    force = 0;
+  /* This fails, printing the usage. */
+  ignore_value (command (&out, &err, str_setfiles, NULL));
+  tested = (out && strstr (out, "-T nthreads") != NULL) ||
+    (err && strstr (err, "-T nthreads") != NULL);
+  return tested;
+}
 
-  ADD_ARG (argv, i, str_setfiles);
-  if (force)
-    ADD_ARG (argv, i, "-F");
+/* Build the setfiles command line to relabel 'path' (a sysroot
+ * path), skipping also the directories in 'skip' (may be NULL).  On
+ * error this replies with an error and returns -1.
+ */
+static int
+make_setfiles_argv (struct stringsbuf *argv, const struct relabel *rl,
+                    const char *path, char *const *skip,
+                    const char *nthreads)
+{
+  size_t i;
+
+  if (add_string (argv, str_setfiles) == -1)
+    return -1;
+  if (rl->force && add_string (argv, "-F") == -1)
+    return -1;
 
-  /* Exclude some directories that should never be relabelled in
-   * ordinary Linux guests.  These won't be mounted anyway.  We have
-   * to prefix all these with the sysroot path.
+  /* We have to prefix all the excluded directories with the sysroot
+   * path.
    */
-  ADD_ARG (argv, i, "-e"); ADD_ARG (argv, i, s_dev);
-  ADD_ARG (argv, i, "-e"); ADD_ARG (argv, i, s_proc);
-  ADD_ARG (argv, i, "-e"); ADD_ARG (argv, i, s_selinux);
-  ADD_ARG (argv, i, "-e"); ADD_ARG (argv, i, s_sys);
+  for (i = 0; i < NR_EXCLUDED_DIRS; ++i) {
+    if (add_string (argv, "-e") == -1 ||
+        add_string (argv, rl->excludes[i]) == -1)
+      return -1;
+  }
+  for (i = 0; skip && skip[i] != NULL; ++i) {
+    if (add_string (argv, "-e") == -1 ||
+        add_string (argv, skip[i]) == -1)
+      return -1;
+  }
 
   /* Relabelling in a chroot. */
   if (STRNEQ (sysroot, "/")) {
-    ADD_ARG (argv, i, "-r");
-    ADD_ARG (argv, i, sysroot);
+    if (add_string (argv, "-r") == -1 ||
+        add_string (argv, sysroot) == -1)
+      return -1;
+  }
+
+  if (nthreads) {
+    if (add_string (argv, "-T") == -1 ||
+        add_string (argv, nthreads) == -1)
+      return -1;
   }
 
   /* Suppress non-error output. */
-  ADD_ARG (argv, i, "-q");
+  if (add_string (argv, "-q") == -1 ||
+      add_string (argv, rl->specfile) == -1 ||
+      add_string (argv, path) == -1 ||
+      end_stringsbuf (argv) == -1)
+    return -1;
+
+  return 0;
+}
+
+static int
+run_setfiles (const struct relabel *rl, const char *path,
+              const char *nthreads)
+{
+  CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (argv);
+  CLEANUP_FREE char *err = NULL;
 
-  /* Add parameters. */
-  ADD_ARG (argv, i, s_specfile);
-  ADD_ARG (argv, i, s_path);
-  ADD_ARG (argv, i, NULL);
+  if (make_setfiles_argv (&argv, rl, path, NULL, nthreads) == -1)
+    return -1;
 
-  if (commandv (NULL, &err, argv) == -1) {
+  if (commandv (NULL, &err, (const char * const *) argv.argv) == -1) {
     reply_with_error ("%s", err);
     return -1;
   }
 
   return 0;
 }
+
+/* Relabelling the top level directories of a large guest in parallel
+ * is much faster than one setfiles, which uses only one vCPU.  Each
+ * job runs setfiles on one directory under the path, and a last job
+ * relabels the path itself, skipping those directories.  The command
+ * lines are built beforehand because the threads must not reply.
+ */
+struct relabel_job {
+  struct stringsbuf argv;
+  int r;
+  char *err;
+};
+
+struct relabel_pool {
+  struct relabel_job *jobs;
+  size_t nr_jobs;
+  size_t next_job;
+  pthread_mutex_t lock;
+};
+
+static void *
+relabel_thread (void *poolvp)
+{
+  struct relabel_pool *pool = poolvp;
+  struct relabel_job *job;
+  size_t i;
+
+  for (;;) {
+    pthread_mutex_lock (&pool->lock);
+    i = pool->next_job++;
+    pthread_mutex_unlock (&pool->lock);
+    if (i >= pool->nr_jobs)
+      break;
+
+    job = &pool->jobs[i];
+    job->r = commandv (NULL, &job->err,
+                       (const char * const *) job->argv.argv);
+  }
+
+  return NULL;
+}
+
+static bool
+is_excluded (const struct relabel *rl, const char *path)
+{
+  size_t i;
+
+  for (i = 0; i < NR_EXCLUDED_DIRS; ++i)
+    if (STREQ (path, rl->excludes[i]))
+      return true;
+  return false;
+}
+
+static int
+relabel_parallel (const struct relabel *rl, const char *path, long nr_cpus)
+{
+  CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (dirs);
+  CLEANUP_FREE struct relabel_job *jobs = NULL;
+  CLEANUP_FREE pthread_t *threads = NULL;
+  struct relabel_pool pool = { .lock = PTHREAD_MUTEX_INITIALIZER };
+  size_t i, nr_threads, nr_started;
+  struct dirent *d;
+  struct stat statbuf;
+  DIR *dir;
+  int r = 0;
+
+  dir = opendir (path);
+  if (dir == NULL) {
+    reply_with_perror ("opendir: %s", path);
+    return -1;
+  }
+  for (;;) {
+    CLEANUP_FREE char *subdir = NULL;
+
+    errno = 0;
+    d = readdir (dir);
+    if (d == NULL)
+      break;
+    if (STREQ (d->d_name, ".") || STREQ (d->d_name, ".."))
+      continue;
+    if (asprintf (&subdir, "%s%s%s", path,
+                  path[strlen (path)-1] == '/' ? "" : "/", d->d_name) == -1) {
+      reply_with_perror ("asprintf");
+      closedir (dir);
+      return -1;
+    }
+    if (lstat (subdir, &statbuf) == -1 || !S_ISDIR (statbuf.st_mode) ||
+        is_excluded (rl, subdir))
+      continue;
+    if (add_string (&dirs, subdir) == -1) {
+      closedir (dir);
+      return -1;
+    }
+  }
+  if (errno != 0) {
+    reply_with_perror ("readdir: %s", path);
+    closedir (dir);
+    return -1;
+  }
+  closedir (dir);
+
+  if (end_stringsbuf (&dirs) == -1)
+    return -1;
+
+  /* One job per directory, and the last one for the rest. */
+  pool.nr_jobs = dirs.size;
+  jobs = calloc (pool.nr_jobs, sizeof (struct relabel_job));
+  if (jobs == NULL) {
+    reply_with_perror ("calloc");
+    return -1;
+  }
+  pool.jobs = jobs;
+  for (i = 0; i < pool.nr_jobs; ++i) {
+    if (i < pool.nr_jobs-1)
+      r = make_setfiles_argv (&jobs[i].argv, rl, dirs.argv[i], NULL, NULL);
+    else
+      r = make_setfiles_argv (&jobs[i].argv, rl, path, dirs.argv, NULL);
+    if (r == -1)
+      goto out;
+  }
+
+  nr_threads = MIN ((size_t) nr_cpus, pool.nr_jobs);
+  threads = calloc (nr_threads, sizeof (pthread_t));
+  if (threads == NULL) {
+    reply_with_perror ("calloc");
+    r = -1;
+    goto out;
+  }
+
+  if (verbose)
+    fprintf (stderr, "selinux-relabel: %zu jobs in %zu threads\n",
+             pool.nr_jobs, nr_threads);
+
+  for (nr_started = 0; nr_started < nr_threads; ++nr_started) {
+    if (pthread_create (&threads[nr_started], NULL,
+                        relabel_thread, &pool) != 0)
+      break;
+  }
+  /* If no thread could be started, run the jobs in this thread. */
+  if (nr_started == 0)
+    relabel_thread (&pool);
+  for (i = 0; i < nr_started; ++i)
+    pthread_join (threads[i], NULL);
+
+  for (i = 0; i < pool.nr_jobs; ++i) {
+    if (jobs[i].r == -1 && r == 0) {
+      reply_with_error ("%s", jobs[i].err ? jobs[i].err : "setfiles failed");
+      r = -1;
+    }
+  }
+
+ out:
+  for (i = 0; i < pool.nr_jobs; ++i) {
+    free_stringsbuf (&jobs[i].argv);
+    free (jobs[i].err);
+  }
+  return r;
+}
+
+#if defined(HAVE_LIBSELINUX)
+
+/* Incremental relabelling.  Only the files whose inode changed since
+ * a given time (eg. by virt-customize) need to be relabelled, but
+ * setfiles always relabels whole directory trees, so here we walk the
+ * filesystem and label each changed file ourselves.  The state is
+ * passed to the nftw callback in these variables.
+ */
+static const struct relabel *since_rl;
+static struct selabel_handle *since_hnd;
+static time_t since_time;
+static char *since_err;
+
+static int
+relabel_file (const char *fpath, const struct stat *sb, int typeflag,
+              struct FTW *ftwbuf)
+{
+  const char *guestpath;
+  char *con = NULL, *oldcon = NULL;
+  const char *newcon;
+  context_t oldctx = NULL, newctx = NULL;
+  int r = FTW_CONTINUE;
+
+  if (typeflag == FTW_D && is_excluded (since_rl, fpath))
+    return FTW_SKIP_SUBTREE;
+  if (typeflag == FTW_NS || sb->st_ctime < since_time)
+    return FTW_CONTINUE;
+
+  /* The path as seen in the guest, to look it up in file_contexts. */
+  guestpath = fpath + sysroot_len;
+  if (*guestpath == '\0')
+    guestpath = "/";
+
+  if (selabel_lookup_raw (since_hnd, &con, guestpath, sb->st_mode) == -1) {
+    if (errno == ENOENT)        /* <<none>> in file_contexts */
+      return FTW_CONTINUE;
+    if (asprintf (&since_err, "selabel_lookup: %s: %m", guestpath) == -1)
+      since_err = NULL;
+    return FTW_STOP;
+  }
+
+  newcon = con;
+  if (lgetfilecon_raw (fpath, &oldcon) == -1)
+    oldcon = NULL;
+
+  /* Without force, only the type is changed, as setfiles does. */
+  if (oldcon && !since_rl->force) {
+    oldctx = context_new (oldcon);
+    newctx = context_new (con);
+    if (oldctx && newctx) {
+      if (STREQ (context_type_get (oldctx), context_type_get (newctx)))
+        goto out;
+      context_type_set (oldctx, context_type_get (newctx));
+      newcon = context_str (oldctx);
+    }
+  }
+
+  if (oldcon && STREQ (oldcon, newcon))
+    goto out;
+
+  if (lsetfilecon_raw (fpath, newcon) == -1) {
+    if (asprintf (&since_err, "lsetfilecon: %s: %m", guestpath) == -1)
+      since_err = NULL;
+    r = FTW_STOP;
+  }
+
+ out:
+  if (oldctx)
+    context_free (oldctx);
+  if (newctx)
+    context_free (newctx);
+  freecon (oldcon);
+  freecon (con);
+  return r;
+}
+
+static int
+relabel_since (const struct relabel *rl, const char *path, int64_t since)
+{
+  struct selinux_opt opts[] = {
+    { .type = SELABEL_OPT_PATH, .value = rl->specfile },
+  };
+  int r;
+
+  since_hnd = selabel_open (SELABEL_CTX_FILE, opts, 1);
+  if (since_hnd == NULL) {
+    reply_with_perror ("selabel_open: %s", rl->specfile);
+    return -1;
+  }
+
+  since_rl = rl;
+  since_time = since;
+  since_err = NULL;
+  r = nftw (path, relabel_file, 20, FTW_PHYS|FTW_ACTIONRETVAL);
+  selabel_close (since_hnd);
+  since_hnd = NULL;
+
+  if (since_err) {
+    reply_with_error ("%s", since_err);
+    free (since_err);
+    since_err = NULL;
+    return -1;
+  }
+  if (r == -1) {
+    reply_with_perror ("nftw: %s", path);
+    return -1;
+  }
+
+  return 0;
+}
+
+#else /* !HAVE_LIBSELINUX */
+
+static int
+relabel_since (const struct relabel *rl, const char *path, int64_t since)
+{
+  reply_with_error_errno (ENOTSUP,
+                          "the since parameter needs libselinux in the appliance");
+  return -1;
+}
+
+#endif /* !HAVE_LIBSELINUX */
+
+/* Takes optional arguments, consult optargs_bitmask. */
+int
+do_selinux_relabel (const char *specfile, const char *path,
+                    int force, int64_t since)
+{
+  struct relabel rl = { .specfile = NULL };
+  CLEANUP_FREE char *s_path = NULL;
+  struct stat statbuf;
+  long nr_cpus;
+  size_t i;
+  int r = -1;
+
+  /* Default settings if not selected. */
+  if (!(optargs_bitmask & GUESTFS_SELINUX_RELABEL_FORCE_BITMASK))
+    force = 0;
+  if (!(optargs_bitmask & GUESTFS_SELINUX_RELABEL_SINCE_BITMASK))
+    since = -1;
+  rl.force = force;
+
+  rl.specfile = sysroot_path (specfile);
+  s_path = sysroot_path (path);
+  if (rl.specfile == NULL || s_path == NULL) {
+    reply_with_perror ("malloc");
+    goto out;
+  }
+  /* nftw and the exclusions need paths without a trailing slash. */
+  for (i = strlen (s_path); i > 1 && s_path[i-1] == '/'; --i)
+    s_path[i-1] = '\0';
+  for (i = 0; i < NR_EXCLUDED_DIRS; ++i) {
+    rl.excludes[i] = sysroot_path (excluded_dirs[i]);
+    if (rl.excludes[i] == NULL) {
+      reply_with_perror ("malloc");
+      goto out;
+    }
+  }
+
+  if (since >= 0) {
+    r = relabel_since (&rl, s_path, since);
+    goto out;
+  }
+
+  /* Use all the vCPUs of the appliance, by threads in setfiles if
+   * it can, else by running several setfiles.
+   */
+  nr_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  if (nr_cpus > 1 && setfiles_has_threads () > 0)
+    r = run_setfiles (&rl, s_path, "0");
+  else if (nr_cpus > 1 &&
+           stat (s_path, &statbuf) == 0 && S_ISDIR (statbuf.st_mode))
+    r = relabel_parallel (&rl, s_path, nr_cpus);
+  else
+    r = run_setfiles (&rl, s_path, NULL);
+
+ out:
+  free (rl.specfile);
+  for (i = 0; i < NR_EXCLUDED_DIRS; ++i)
+    free (rl.excludes[i]);
+  return r;
+}
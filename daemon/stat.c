@@ -20,11 +20,18 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <rpc/types.h>
+#include <rpc/xdr.h>
 
 #include "guestfs_protocol.h"
 #include "daemon.h"
@@ -120,28 +127,71 @@ do_lstatns (const char *path)
   return stat_to_statns (NULL, &statbuf);
 }
 
-guestfs_int_statns_list *
-do_internal_lstatnslist (const char *path, char *const *names)
+/* The fields of guestfs_int_statns, in the order they are packed
+ * by internal_lstatnslist_packed.
+ */
+static const size_t statns_fields[] = {
+  offsetof (guestfs_int_statns, st_dev),
+  offsetof (guestfs_int_statns, st_ino),
+  offsetof (guestfs_int_statns, st_mode),
+  offsetof (guestfs_int_statns, st_nlink),
+  offsetof (guestfs_int_statns, st_uid),
+  offsetof (guestfs_int_statns, st_gid),
+  offsetof (guestfs_int_statns, st_rdev),
+  offsetof (guestfs_int_statns, st_size),
+  offsetof (guestfs_int_statns, st_blksize),
+  offsetof (guestfs_int_statns, st_blocks),
+  offsetof (guestfs_int_statns, st_atime_sec),
+  offsetof (guestfs_int_statns, st_atime_nsec),
+  offsetof (guestfs_int_statns, st_mtime_sec),
+  offsetof (guestfs_int_statns, st_mtime_nsec),
+  offsetof (guestfs_int_statns, st_ctime_sec),
+  offsetof (guestfs_int_statns, st_ctime_nsec),
+  offsetof (guestfs_int_statns, st_spare1),
+  offsetof (guestfs_int_statns, st_spare2),
+  offsetof (guestfs_int_statns, st_spare3),
+  offsetof (guestfs_int_statns, st_spare4),
+  offsetof (guestfs_int_statns, st_spare5),
+  offsetof (guestfs_int_statns, st_spare6),
+};
+
+#define NR_STATNS_FIELDS (sizeof statns_fields / sizeof statns_fields[0])
+
+/* The longest encoding of a 64 bit integer by pack_int64. */
+#define MAX_PACKED_INT64 10
+
+/* Append 'v' to 'p' zigzag encoded, 7 bits per byte starting with
+ * the lowest bits, with the top bit set if more bytes follow.
+ * Returns the new end of the buffer.
+ */
+static unsigned char *
+pack_int64 (unsigned char *p, int64_t v)
+{
+  uint64_t u = ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+
+  while (u >= 0x80) {
+    *p++ = (u & 0x7f) | 0x80;
+    u >>= 7;
+  }
+  *p++ = u;
+  return p;
+}
+
+char *
+do_internal_lstatnslist_packed (const char *path, char *const *names,
+                                size_t *size_r)
 {
   int path_fd;
-  guestfs_int_statns_list *ret;
-  size_t i, nr_names;
+  unsigned char *buf, *p;
+  size_t i, j, nr_names;
 
   nr_names = count_strings (names);
 
-  ret = malloc (sizeof *ret);
-  if (!ret) {
+  buf = malloc (nr_names * NR_STATNS_FIELDS * MAX_PACKED_INT64 + 1);
+  if (buf == NULL) {
     reply_with_perror ("malloc");
     return NULL;
   }
-  ret->guestfs_int_statns_list_len = nr_names;
-  ret->guestfs_int_statns_list_val =
-    calloc (nr_names, sizeof (guestfs_int_statns));
-  if (ret->guestfs_int_statns_list_val == NULL) {
-    reply_with_perror ("calloc");
-    free (ret);
-    return NULL;
-  }
 
   CHROOT_IN;
   path_fd = open (path, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
@@ -149,28 +199,278 @@ do_internal_lstatnslist (const char *path, char *const *names)
 
   if (path_fd == -1) {
     reply_with_perror ("%s", path);
-    free (ret->guestfs_int_statns_list_val);
-    free (ret);
+    free (buf);
     return NULL;
   }
 
+  p = buf;
   for (i = 0; names[i] != NULL; ++i) {
-    int r;
+    guestfs_int_statns st;
     struct stat statbuf;
 
-    r = fstatat (path_fd, names[i], &statbuf, AT_SYMLINK_NOFOLLOW);
-    if (r == -1)
-      ret->guestfs_int_statns_list_val[i].st_ino = -1;
+    if (fstatat (path_fd, names[i], &statbuf, AT_SYMLINK_NOFOLLOW) == -1) {
+      memset (&st, 0, sizeof st);
+      st.st_ino = -1;
+    }
     else
-      stat_to_statns (&ret->guestfs_int_statns_list_val[i], &statbuf);
+      stat_to_statns (&st, &statbuf);
+
+    for (j = 0; j < NR_STATNS_FIELDS; ++j)
+      p = pack_int64 (p, *(int64_t *) ((char *) &st + statns_fields[j]));
   }
 
   if (close (path_fd) == -1) {
     reply_with_perror ("close: %s", path);
-    free (ret->guestfs_int_statns_list_val);
-    free (ret);
+    free (buf);
     return NULL;
   }
 
-  return ret;
+  *size_r = p - buf;
+  return (char *) buf;          /* caller frees */
+}
+
+/* State of do_internal_lstatns_tree.  Records are encoded into 'buf'
+ * and sent when it is full, so that a large tree is sent in a few
+ * big chunks rather than a chunk per file.
+ */
+struct lstatns_tree {
+  int depth;
+  bool_t xattrs;                /* Send the xattrs of each entry. */
+  char *buf;                    /* GUESTFS_MAX_CHUNK_SIZE bytes */
+  XDR xdr;
+};
+
+/* An entry of the directory being listed. */
+struct lstatns_tree_entry {
+  char *name;
+  struct stat statbuf;
+};
+
+static int
+lstatns_tree_flush (struct lstatns_tree *t)
+{
+  const size_t len = xdr_getpos (&t->xdr);
+
+  if (len == 0)
+    return 0;
+  if (send_file_write (t->buf, len) < 0)
+    return -1;
+  xdr_setpos (&t->xdr, 0);
+  return 0;
+}
+
+/* Append one record.  If it doesn't fit in the buffer, send the
+ * buffer and try again.  Returns -1 on error.  Nothing can be
+ * replied at this point, so errors are printed.
+ */
+static int
+lstatns_tree_send (struct lstatns_tree *t, const char *name, bool_t is_dir,
+                   const struct stat *statbuf, const char *link,
+                   guestfs_int_xattr_list *xattrs)
+{
+  char *n = (char *) name, *l = (char *) link;
+  guestfs_int_statns st;
+  int pass;
+
+  if (!is_dir)
+    stat_to_statns (&st, statbuf);
+
+  for (pass = 0; pass < 2; ++pass) {
+    const u_int pos = xdr_getpos (&t->xdr);
+
+    if (xdr_string (&t->xdr, &n, GUESTFS_MAX_CHUNK_SIZE) &&
+        xdr_bool (&t->xdr, &is_dir) &&
+        (is_dir ||
+         (xdr_guestfs_int_statns (&t->xdr, &st) &&
+          xdr_string (&t->xdr, &l, GUESTFS_MAX_CHUNK_SIZE) &&
+          (!t->xattrs || xdr_guestfs_int_xattr_list (&t->xdr, xattrs)))))
+      return 0;
+
+    xdr_setpos (&t->xdr, pos);
+    if (pass == 0 && lstatns_tree_flush (t) == -1)
+      return -1;
+  }
+
+  fprintf (stderr, "lstatns_tree: %s: record too large\n", name);
+  return -1;
+}
+
+static int
+compare_entries (const void *e1, const void *e2)
+{
+  const struct lstatns_tree_entry *ent1 = e1, *ent2 = e2;
+
+  return strcmp (ent1->name, ent2->name);
+}
+
+/* List the directory open on 'fd' (which this closes), whose name
+ * relative to the top of the tree is 'prefix', then recurse into its
+ * subdirectories.  The entries are sorted by name, like guestfs_ls.
+ */
+static int
+lstatns_tree_walk (struct lstatns_tree *t, int fd, const char *prefix,
+                   int level)
+{
+  DIR *dir;
+  struct dirent *d;
+  struct lstatns_tree_entry *entries = NULL;
+  size_t nr_entries = 0, i;
+  int r = -1;
+
+  dir = fdopendir (fd);
+  if (dir == NULL) {
+    perror (prefix);
+    close (fd);
+    return 0;                   /* skip this directory */
+  }
+
+  while (errno = 0, (d = readdir (dir)) != NULL) {
+    struct lstatns_tree_entry *p;
+
+    if (STREQ (d->d_name, ".") || STREQ (d->d_name, ".."))
+      continue;
+
+    p = realloc (entries, (nr_entries + 1) * sizeof *entries);
+    if (p == NULL) {
+      perror ("realloc");
+      goto out;
+    }
+    entries = p;
+
+    if (fstatat (dirfd (dir), d->d_name, &entries[nr_entries].statbuf,
+                 AT_SYMLINK_NOFOLLOW) == -1)
+      continue;
+    entries[nr_entries].name = strdup (d->d_name);
+    if (entries[nr_entries].name == NULL) {
+      perror ("strdup");
+      goto out;
+    }
+    nr_entries++;
+  }
+  if (errno != 0) {
+    perror (prefix);
+    goto out;
+  }
+
+  if (nr_entries > 0)
+    qsort (entries, nr_entries, sizeof *entries, compare_entries);
+
+  if (lstatns_tree_send (t, prefix, 1, NULL, NULL, NULL) == -1)
+    goto out;
+
+  for (i = 0; i < nr_entries; ++i) {
+    CLEANUP_FREE char *name = NULL;
+    guestfs_int_xattr_list xattrs = { 0, NULL };
+    char link[PATH_MAX];
+    ssize_t len;
+    int sr;
+
+    link[0] = '\0';
+    if (S_ISLNK (entries[i].statbuf.st_mode)) {
+      len = readlinkat (dirfd (dir), entries[i].name, link, sizeof link - 1);
+      if (len >= 0)
+        link[len] = '\0';
+      else
+        link[0] = '\0';
+    }
+
+    if (t->xattrs)
+      lxattrs_at (dirfd (dir), entries[i].name, &xattrs);
+
+    if (prefix[0] == '\0')
+      name = strdup (entries[i].name);
+    else if (asprintf (&name, "%s/%s", prefix, entries[i].name) == -1)
+      name = NULL;
+    if (name == NULL) {
+      perror ("strdup");
+      xdr_free ((xdrproc_t) xdr_guestfs_int_xattr_list, (char *) &xattrs);
+      goto out;
+    }
+
+    sr = lstatns_tree_send (t, name, 0, &entries[i].statbuf, link, &xattrs);
+    xdr_free ((xdrproc_t) xdr_guestfs_int_xattr_list, (char *) &xattrs);
+    if (sr == -1)
+      goto out;
+  }
+
+  /* Recurse into the subdirectories, in the same order. */
+  for (i = 0; i < nr_entries; ++i) {
+    CLEANUP_FREE char *name = NULL;
+    int subfd;
+
+    if (!S_ISDIR (entries[i].statbuf.st_mode) || level + 1 >= t->depth)
+      continue;
+
+    if (prefix[0] == '\0')
+      name = strdup (entries[i].name);
+    else if (asprintf (&name, "%s/%s", prefix, entries[i].name) == -1)
+      name = NULL;
+    if (name == NULL) {
+      perror ("strdup");
+      goto out;
+    }
+
+    subfd = openat (dirfd (dir), entries[i].name,
+                    O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+    if (subfd == -1)
+      continue;
+    if (lstatns_tree_walk (t, subfd, name, level + 1) == -1)
+      goto out;
+  }
+
+  r = 0;
+ out:
+  for (i = 0; i < nr_entries; ++i)
+    free (entries[i].name);
+  free (entries);
+  closedir (dir);
+  return r;
+}
+
+/* Has one FileOut parameter. */
+int
+do_internal_lstatns_tree (const char *path, int depth, int xattrs)
+{
+  struct lstatns_tree t = { .depth = depth, .xattrs = xattrs };
+  int fd, r;
+
+  if (depth < 1) {
+    reply_with_error ("depth must be at least 1");
+    return -1;
+  }
+
+  t.buf = malloc (GUESTFS_MAX_CHUNK_SIZE);
+  if (t.buf == NULL) {
+    reply_with_perror ("malloc");
+    return -1;
+  }
+
+  CHROOT_IN;
+  fd = open (path, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+  CHROOT_OUT;
+
+  if (fd == -1) {
+    reply_with_perror ("%s", path);
+    free (t.buf);
+    return -1;
+  }
+
+  /* Now we must send the reply message, before the file contents. */
+  reply (NULL, NULL);
+
+  xdrmem_create (&t.xdr, t.buf, GUESTFS_MAX_CHUNK_SIZE, XDR_ENCODE);
+  r = lstatns_tree_walk (&t, fd, "", 0);
+  if (r == 0)
+    r = lstatns_tree_flush (&t);
+  xdr_destroy (&t.xdr);
+  free (t.buf);
+
+  if (r == -1) {
+    send_file_end (1);          /* Cancel. */
+    return -1;
+  }
+  if (send_file_end (0))        /* Normal end of file. */
+    return -1;
+
+  return 0;
 }
@@ -0,0 +1,225 @@
+/* libguestfs - the guestfsd daemon
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Per-procedure statistics, shown by 'debug stats'.
+ *
+ * For every call we record the wall time, the CPU time and the block
+ * I/O of the daemon thread running the call and of the external
+ * commands it waited for (from getrusage(2)), the number of external
+ * commands it ran, and the time it spent in udev_settle.  When worker
+ * threads are used, commands run by concurrent calls may be counted
+ * against the wrong call, but the totals are still right.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "guestfs_protocol.h"
+#include "daemon.h"
+
+struct proc_stats {
+  uint64_t calls;
+  uint64_t wall_us;
+  uint64_t cpu_us;
+  uint64_t read_bytes;
+  uint64_t write_bytes;
+  uint64_t forks;
+  uint64_t settles;
+  uint64_t settle_us;
+};
+
+static struct proc_stats stats[GUESTFS_MAX_PROC_NR+1];
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The call being run by this thread. */
+static __thread struct timeval call_start_t;
+static __thread struct proc_stats call_start;
+static __thread uint64_t call_forks, call_settles, call_settle_us;
+
+static int64_t
+tv_us (const struct timeval *tv)
+{
+  return (int64_t) tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+/* Read the CPU time and block I/O used so far by this thread and by
+ * the children which have been waited for.
+ */
+static void
+get_usage (struct proc_stats *ps)
+{
+  struct rusage self, children;
+
+#ifdef RUSAGE_THREAD
+  if (getrusage (RUSAGE_THREAD, &self) == -1)
+#endif
+    getrusage (RUSAGE_SELF, &self);
+  getrusage (RUSAGE_CHILDREN, &children);
+
+  ps->cpu_us =
+    tv_us (&self.ru_utime) + tv_us (&self.ru_stime) +
+    tv_us (&children.ru_utime) + tv_us (&children.ru_stime);
+  /* ru_inblock and ru_oublock are in 512 byte units. */
+  ps->read_bytes = (uint64_t) (self.ru_inblock + children.ru_inblock) * 512;
+  ps->write_bytes = (uint64_t) (self.ru_oublock + children.ru_oublock) * 512;
+}
+
+/**
+ * Called before dispatching each request.
+ */
+void
+stats_start_call (void)
+{
+  call_forks = call_settles = call_settle_us = 0;
+  get_usage (&call_start);
+  gettimeofday (&call_start_t, NULL);
+}
+
+/**
+ * Called after the reply to the current request (C<proc_nr>) has
+ * been sent.
+ */
+void
+stats_end_call (void)
+{
+  struct timeval end_t;
+  struct proc_stats end;
+  struct proc_stats *ps;
+
+  if (proc_nr < 0 || proc_nr > GUESTFS_MAX_PROC_NR)
+    return;
+
+  gettimeofday (&end_t, NULL);
+  get_usage (&end);
+
+  pthread_mutex_lock (&stats_lock);
+  ps = &stats[proc_nr];
+  ps->calls++;
+  ps->wall_us += tv_us (&end_t) - tv_us (&call_start_t);
+  ps->cpu_us += end.cpu_us - call_start.cpu_us;
+  ps->read_bytes += end.read_bytes - call_start.read_bytes;
+  ps->write_bytes += end.write_bytes - call_start.write_bytes;
+  ps->forks += call_forks;
+  ps->settles += call_settles;
+  ps->settle_us += call_settle_us;
+  pthread_mutex_unlock (&stats_lock);
+}
+
+/**
+ * Called by the C<command*> functions each time an external command
+ * is run.
+ */
+void
+stats_count_fork (void)
+{
+  call_forks++;
+}
+
+/**
+ * Called by C<udev_settle> with the time it took.
+ */
+void
+stats_count_settle (int64_t us)
+{
+  call_settles++;
+  call_settle_us += us;
+}
+
+static int
+compare_wall_time (const void *vp1, const void *vp2)
+{
+  const int p1 = * (const int *) vp1;
+  const int p2 = * (const int *) vp2;
+
+  if (stats[p1].wall_us != stats[p2].wall_us)
+    return stats[p1].wall_us < stats[p2].wall_us ? 1 : -1;
+  return p1 - p2;
+}
+
+/**
+ * Return the statistics as a table, one line per procedure which has
+ * been called, the slowest first.  If C<reset> is true, the counters
+ * are cleared afterwards.  Returns C<NULL> on error.
+ */
+char *
+stats_format (int reset)
+{
+  char *out = NULL;
+  size_t size, i, n = 0;
+  int procs[GUESTFS_MAX_PROC_NR+1];
+  struct proc_stats total;
+  FILE *fp;
+
+  fp = open_memstream (&out, &size);
+  if (fp == NULL)
+    return NULL;
+
+  pthread_mutex_lock (&stats_lock);
+
+  memset (&total, 0, sizeof total);
+  for (i = 0; i <= GUESTFS_MAX_PROC_NR; ++i) {
+    if (stats[i].calls == 0)
+      continue;
+    procs[n++] = i;
+    total.calls += stats[i].calls;
+    total.wall_us += stats[i].wall_us;
+    total.cpu_us += stats[i].cpu_us;
+    total.read_bytes += stats[i].read_bytes;
+    total.write_bytes += stats[i].write_bytes;
+    total.forks += stats[i].forks;
+    total.settles += stats[i].settles;
+    total.settle_us += stats[i].settle_us;
+  }
+  qsort (procs, n, sizeof (int), compare_wall_time);
+
+  fprintf (fp, "%-24s %8s %10s %10s %10s %10s %6s %7s %10s\n",
+           "proc", "calls", "wall_ms", "cpu_ms", "read_kb", "write_kb",
+           "forks", "settles", "settle_ms");
+  for (i = 0; i <= n; ++i) {
+    const struct proc_stats *ps = i < n ? &stats[procs[i]] : &total;
+    const char *name = i < n ? function_names[procs[i]] : "TOTAL";
+
+    fprintf (fp,
+             "%-24s %8" PRIu64 " %10" PRIu64 " %10" PRIu64
+             " %10" PRIu64 " %10" PRIu64 " %6" PRIu64 " %7" PRIu64
+             " %10" PRIu64 "\n",
+             name ? name : "UNKNOWN PROCEDURE",
+             ps->calls, ps->wall_us / 1000, ps->cpu_us / 1000,
+             ps->read_bytes / 1024, ps->write_bytes / 1024,
+             ps->forks, ps->settles, ps->settle_us / 1000);
+  }
+
+  if (reset)
+    memset (stats, 0, sizeof stats);
+
+  pthread_mutex_unlock (&stats_lock);
+
+  if (fclose (fp) == EOF) {
+    free (out);
+    return NULL;
+  }
+
+  return out;
+}
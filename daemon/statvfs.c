@@ -29,6 +29,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <endian.h>
 
 #ifdef HAVE_SYS_STATVFS_H
 #include <sys/statvfs.h>
@@ -182,3 +183,367 @@ do_statvfs (const char *path)
 #  endif /* !WIN32 */
 #endif /* !HAVE_STATVFS */
 }
+
+/* Read 'len' bytes at 'offset' of the device.  Returns 0 if that
+ * worked, 1 if the device is too short, or -1 on error (with the
+ * error reply sent).
+ */
+static int
+read_device (int fd, const char *device, off_t offset, void *buf, size_t len)
+{
+  ssize_t r;
+
+  r = pread (fd, buf, len, offset);
+  if (r == -1) {
+    reply_with_perror ("pread: %s", device);
+    return -1;
+  }
+  return (size_t) r == len ? 0 : 1;
+}
+
+static inline uint16_t
+get_le16 (const unsigned char *p)
+{
+  uint16_t v;
+  memcpy (&v, p, sizeof v);
+  return le16toh (v);
+}
+
+static inline uint32_t
+get_le32 (const unsigned char *p)
+{
+  uint32_t v;
+  memcpy (&v, p, sizeof v);
+  return le32toh (v);
+}
+
+static inline uint64_t
+get_le64 (const unsigned char *p)
+{
+  uint64_t v;
+  memcpy (&v, p, sizeof v);
+  return le64toh (v);
+}
+
+static inline uint16_t
+get_be16 (const unsigned char *p)
+{
+  uint16_t v;
+  memcpy (&v, p, sizeof v);
+  return be16toh (v);
+}
+
+static inline uint32_t
+get_be32 (const unsigned char *p)
+{
+  uint32_t v;
+  memcpy (&v, p, sizeof v);
+  return be32toh (v);
+}
+
+static inline uint64_t
+get_be64 (const unsigned char *p)
+{
+  uint64_t v;
+  memcpy (&v, p, sizeof v);
+  return be64toh (v);
+}
+
+/* Is 'n' a power of 'b'? */
+static int
+is_power_of (uint64_t n, uint64_t b)
+{
+  while (n > 1 && n % b == 0)
+    n /= b;
+  return n == 1;
+}
+
+/* The ext2/3/4 superblock, at offset 1024. */
+#define EXT_SB_OFFSET 1024
+#define EXT_SB_SIZE 1024
+#define EXT_SB_MAGIC 0xef53
+
+#define EXT_COMPAT_HAS_JOURNAL 0x4
+#define EXT_COMPAT_SPARSE_SUPER2 0x200
+#define EXT_INCOMPAT_META_BG 0x10
+#define EXT_INCOMPAT_EXTENTS 0x40
+#define EXT_INCOMPAT_64BIT 0x80
+#define EXT_RO_COMPAT_SPARSE_SUPER 0x1
+#define EXT_RO_COMPAT_BIGALLOC 0x200
+
+static int
+ext_has_super (const unsigned char *sb, uint64_t group)
+{
+  const uint32_t compat = get_le32 (sb + 0x5c);
+  const uint32_t ro_compat = get_le32 (sb + 0x64);
+
+  if (group == 0)
+    return 1;
+  if (compat & EXT_COMPAT_SPARSE_SUPER2)
+    return group == get_le32 (sb + 0x24c) || group == get_le32 (sb + 0x250);
+  if (!(ro_compat & EXT_RO_COMPAT_SPARSE_SUPER))
+    return 1;
+  return group == 1 ||
+    is_power_of (group, 3) || is_power_of (group, 5) || is_power_of (group, 7);
+}
+
+/* Fill in 'ret' from the superblock 'sb', as statfs in the kernel
+ * does.  Returns 0 if the superblock has features we don't handle.
+ */
+static int
+ext_statvfs (const unsigned char *sb, guestfs_int_statvfs *ret)
+{
+  const uint32_t incompat = get_le32 (sb + 0x60);
+  const uint32_t ro_compat = get_le32 (sb + 0x64);
+  const uint32_t log_block_size = get_le32 (sb + 0x18);
+  uint64_t block_size, blocks, r_blocks, free_blocks, first_data_block;
+  uint64_t overhead, resv, bfree, bavail;
+
+  if (log_block_size > 6 || (ro_compat & EXT_RO_COMPAT_BIGALLOC))
+    return 0;
+
+  block_size = UINT64_C (1024) << log_block_size;
+  blocks = get_le32 (sb + 0x4);
+  r_blocks = get_le32 (sb + 0x8);
+  free_blocks = get_le32 (sb + 0xc);
+  if (incompat & EXT_INCOMPAT_64BIT) {
+    blocks |= (uint64_t) get_le32 (sb + 0x150) << 32;
+    r_blocks |= (uint64_t) get_le32 (sb + 0x154) << 32;
+    free_blocks |= (uint64_t) get_le32 (sb + 0x158) << 32;
+  }
+  first_data_block = get_le32 (sb + 0x14);
+
+  /* The metadata blocks are not counted in f_blocks.  mke2fs doesn't
+   * usually record how many there are, so count them like the kernel.
+   */
+  overhead = get_le32 (sb + 0x248);
+  if (overhead == 0) {
+    const uint64_t blocks_per_group = get_le32 (sb + 0x20);
+    const uint64_t inodes_per_group = get_le32 (sb + 0x28);
+    const uint64_t inode_size =
+      get_le32 (sb + 0x4c) >= 1 ? get_le16 (sb + 0x58) : 128;
+    uint64_t desc_size = 32;
+    uint64_t groups, gdb_count, itb_per_group, group;
+
+    if (incompat & EXT_INCOMPAT_META_BG)
+      return 0;
+    if (incompat & EXT_INCOMPAT_64BIT && get_le16 (sb + 0xfe) >= 32)
+      desc_size = get_le16 (sb + 0xfe);
+    if (blocks_per_group == 0 || blocks <= first_data_block)
+      return 0;
+
+    groups = (blocks - first_data_block + blocks_per_group - 1)
+      / blocks_per_group;
+    gdb_count = (groups + block_size / desc_size - 1) / (block_size / desc_size);
+    itb_per_group = (inodes_per_group * inode_size + block_size - 1)
+      / block_size;
+
+    overhead = first_data_block;
+    for (group = 0; group < groups; ++group) {
+      if (ext_has_super (sb, group))
+        overhead += 1 + gdb_count;
+      overhead += itb_per_group + 2;
+    }
+
+    /* The internal journal, whose size is saved in s_jnl_blocks. */
+    if ((get_le32 (sb + 0x5c) & EXT_COMPAT_HAS_JOURNAL) &&
+        get_le32 (sb + 0xe0) != 0 && sb[0xfd] == 1) {
+      const uint64_t journal_size =
+        (uint64_t) get_le32 (sb + 0x10c + 15*4) << 32 |
+        get_le32 (sb + 0x10c + 16*4);
+      overhead += journal_size / block_size;
+    }
+  }
+  if (overhead > blocks)
+    overhead = blocks;
+
+  /* Blocks reserved for the filesystem itself (see
+   * ext4_calculate_resv_clusters) are free but not available.
+   */
+  resv = 0;
+  if (incompat & EXT_INCOMPAT_EXTENTS) {
+    resv = blocks / 50;
+    if (resv > 4096)
+      resv = 4096;
+  }
+  bfree = free_blocks;
+  bavail = bfree > r_blocks + resv ? bfree - (r_blocks + resv) : 0;
+
+  ret->bsize = block_size;
+  ret->frsize = block_size;
+  ret->blocks = blocks - overhead;
+  ret->bfree = bfree;
+  ret->bavail = bavail;
+  ret->files = get_le32 (sb + 0x0);
+  ret->ffree = get_le32 (sb + 0x10);
+  ret->favail = ret->ffree;
+  /* The kernel makes up f_fsid from the UUID like this. */
+  ret->fsid = (int64_t) (get_le64 (sb + 0x68) ^ get_le64 (sb + 0x70));
+  ret->flag = -1;
+  ret->namemax = 255;
+  return 1;
+}
+
+/* The XFS superblock, at offset 0. */
+#define XFS_SB_SIZE 512
+#define XFS_SB_VERSION2_LAZYSBCOUNTBIT 0x2
+
+/* Fill in 'ret' from the XFS superblock 'sb'.  With lazy superblock
+ * counters (the default) the counters in the superblock are only
+ * written when the filesystem is unmounted, so, like the kernel when
+ * it mounts the filesystem, add up the counters in the AG headers
+ * instead.  Returns 1 if that worked, 0 if we don't understand the
+ * filesystem, or -1 on error.
+ */
+static int
+xfs_statvfs (int fd, const char *device, const unsigned char *sb,
+             guestfs_int_statvfs *ret)
+{
+  const uint64_t block_size = get_be32 (sb + 4);
+  const uint64_t dblocks = get_be64 (sb + 8);
+  const uint64_t logstart = get_be64 (sb + 48);
+  const uint64_t agblocks = get_be32 (sb + 84);
+  const uint64_t agcount = get_be32 (sb + 88);
+  const uint64_t logblocks = get_be32 (sb + 96);
+  const uint64_t sectsize = get_be16 (sb + 102);
+  const unsigned inopblog = sb[123];
+  const unsigned imax_pct = sb[127];
+  const uint32_t features2 = get_be32 (sb + 200);
+  uint64_t icount, ifree, fdblocks, set_aside, bfree, files, maxicount;
+
+  if (block_size == 0 || sectsize < 512 || agcount == 0 ||
+      inopblog > 16)
+    return 0;
+
+  if (features2 & XFS_SB_VERSION2_LAZYSBCOUNTBIT) {
+    unsigned char hdr[64];
+    uint64_t ag;
+    int r;
+
+    icount = ifree = fdblocks = 0;
+    for (ag = 0; ag < agcount; ++ag) {
+      const off_t base = ag * agblocks * block_size;
+
+      r = read_device (fd, device, base + sectsize, hdr, sizeof hdr);
+      if (r != 0)
+        return r == -1 ? -1 : 0;
+      if (memcmp (hdr, "XAGF", 4) != 0)
+        return 0;
+      /* agf_freeblks + agf_flcount + agf_btreeblks */
+      fdblocks += get_be32 (hdr + 52) + get_be32 (hdr + 48) +
+        get_be32 (hdr + 60);
+
+      r = read_device (fd, device, base + 2 * sectsize, hdr, sizeof hdr);
+      if (r != 0)
+        return r == -1 ? -1 : 0;
+      if (memcmp (hdr, "XAGI", 4) != 0)
+        return 0;
+      icount += get_be32 (hdr + 16);  /* agi_count */
+      ifree += get_be32 (hdr + 28);   /* agi_freecount */
+    }
+  }
+  else {
+    icount = get_be64 (sb + 128);
+    ifree = get_be64 (sb + 136);
+    fdblocks = get_be64 (sb + 144);
+  }
+
+  /* Blocks the kernel keeps back for splitting free space btrees,
+   * and its default reserve pool (see xfs_default_resblks).
+   */
+  set_aside = agcount * 8;
+  set_aside += dblocks / 20 < 8192 ? dblocks / 20 : 8192;
+  bfree = fdblocks > set_aside ? fdblocks - set_aside : 0;
+
+  /* XFS allocates inodes dynamically, so the number of inodes is the
+   * number which would fit in the free space, within the limit.
+   */
+  files = icount + (bfree << inopblog);
+  if (imax_pct > 0) {
+    maxicount = (dblocks * imax_pct / 100) << inopblog;
+    if (files > maxicount)
+      files = maxicount > icount ? maxicount : icount;
+  }
+  if (ifree > icount)
+    ifree = icount;
+
+  ret->bsize = block_size;
+  ret->frsize = block_size;
+  ret->blocks = dblocks - (logstart != 0 ? logblocks : 0);
+  ret->bfree = bfree;
+  ret->bavail = bfree;
+  ret->files = files;
+  ret->ffree = files - (icount - ifree);
+  ret->favail = ret->ffree;
+  ret->fsid = -1;
+  ret->flag = -1;
+  ret->namemax = 255;
+  return 1;
+}
+
+guestfs_int_statvfs *
+do_vfs_statvfs (const mountable_t *mountable)
+{
+  const char *device = mountable->device;
+  unsigned char sb[EXT_SB_SIZE];
+  CLEANUP_FREE guestfs_int_statvfs *ret = NULL;
+  guestfs_int_statvfs *r_ret;
+  int fd, r;
+
+  if (mountable->type != MOUNTABLE_DEVICE) {
+    NOT_SUPPORTED (NULL, "%s: only filesystems on devices are supported",
+                   device);
+  }
+
+  ret = malloc (sizeof *ret);
+  if (ret == NULL) {
+    reply_with_perror ("malloc");
+    return NULL;
+  }
+
+  fd = open (device, O_RDONLY|O_CLOEXEC);
+  if (fd == -1) {
+    reply_with_perror ("open: %s", device);
+    return NULL;
+  }
+
+  /* XFS */
+  r = read_device (fd, device, 0, sb, XFS_SB_SIZE);
+  if (r == -1)
+    goto error;
+  if (r == 0 && memcmp (sb, "XFSB", 4) == 0) {
+    r = xfs_statvfs (fd, device, sb, ret);
+    if (r == -1)
+      goto error;
+    if (r == 1)
+      goto done;
+    goto not_supported;
+  }
+
+  /* ext2/3/4 */
+  r = read_device (fd, device, EXT_SB_OFFSET, sb, EXT_SB_SIZE);
+  if (r == -1)
+    goto error;
+  if (r == 0 && get_le16 (sb + 0x38) == EXT_SB_MAGIC) {
+    if (ext_statvfs (sb, ret))
+      goto done;
+  }
+
+ not_supported:
+  close (fd);
+  NOT_SUPPORTED (NULL, "%s: cannot read filesystem statistics "
+                 "from the superblock", device);
+
+ done:
+  if (close (fd) == -1) {
+    reply_with_perror ("close: %s", device);
+    return NULL;
+  }
+  r_ret = ret;
+  ret = NULL;
+  return r_ret;
+
+ error:
+  close (fd);
+  return NULL;
+}
@@ -0,0 +1,477 @@
+/* libguestfs - the guestfsd daemon
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#include "c-ctype.h"
+
+#include "guestfs_protocol.h"
+#include "daemon.h"
+#include "actions.h"
+#include "optgroups.h"
+
+/* list_storage collects what virt-filesystems --long used to get
+ * with several calls for every device.  Devices are only probed once
+ * since get_blkid_tag caches the results.
+ */
+
+static int
+add_entry (guestfs_int_storage_entry_list *ret,
+           const char *name, const char *type,
+           const char *vfs_type, const char *vfs_label, const char *uuid,
+           int mbr_id, int64_t size, const char *parents)
+{
+  guestfs_int_storage_entry *entries, *e;
+
+  entries = realloc (ret->guestfs_int_storage_entry_list_val,
+                     (ret->guestfs_int_storage_entry_list_len + 1) *
+                     sizeof (guestfs_int_storage_entry));
+  if (entries == NULL) {
+    reply_with_perror ("realloc");
+    return -1;
+  }
+  ret->guestfs_int_storage_entry_list_val = entries;
+  e = &entries[ret->guestfs_int_storage_entry_list_len++];
+  memset (e, 0, sizeof *e);
+
+  e->se_mbr_id = mbr_id;
+  e->se_size = size;
+  if ((e->se_name = strdup (name)) == NULL ||
+      (e->se_type = strdup (type)) == NULL ||
+      (e->se_vfs_type = strdup (vfs_type)) == NULL ||
+      (e->se_vfs_label = strdup (vfs_label)) == NULL ||
+      (e->se_uuid = strdup (uuid)) == NULL ||
+      (e->se_parents = strdup (parents)) == NULL) {
+    reply_with_perror ("strdup");
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Get the size of a block device without running blockdev(8). */
+static int64_t
+get_size (const char *device)
+{
+  CLEANUP_CLOSE int fd = -1;
+  uint64_t size;
+
+  fd = open (device, O_RDONLY|O_CLOEXEC);
+  if (fd == -1) {
+    reply_with_perror ("open: %s", device);
+    return -1;
+  }
+  if (ioctl (fd, BLKGETSIZE64, &size) == -1) {
+    reply_with_perror ("ioctl: %s: BLKGETSIZE64", device);
+    return -1;
+  }
+
+  return (int64_t) size;
+}
+
+static int
+is_md (const char *device)
+{
+  const char *p;
+
+  if (!STRPREFIX (device, "/dev/md") || device[7] == '\0')
+    return 0;
+
+  for (p = &device[7]; *p; ++p) {
+    if (!c_isdigit (*p))
+      return 0;
+  }
+
+  return 1;
+}
+
+/* Return the members of an MD device as a space-separated list, or
+ * an empty string for other devices.
+ */
+static char *
+get_parents (const char *device)
+{
+  CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (members);
+  guestfs_int_mdstat_list *stats;
+  char *ret;
+  size_t i;
+
+  if (is_md (device)) {
+    stats = do_md_stat (device);
+    if (stats == NULL)
+      return NULL;
+    for (i = 0; i < stats->guestfs_int_mdstat_list_len; ++i) {
+      if (add_string (&members,
+                      stats->guestfs_int_mdstat_list_val[i].mdstat_device) == -1) {
+        xdr_free ((xdrproc_t) xdr_guestfs_int_mdstat_list, (char *) stats);
+        free (stats);
+        return NULL;
+      }
+    }
+    xdr_free ((xdrproc_t) xdr_guestfs_int_mdstat_list, (char *) stats);
+    free (stats);
+  }
+  if (end_stringsbuf (&members) == -1)
+    return NULL;
+
+  ret = join_strings (" ", members.argv);
+  if (ret == NULL)
+    reply_with_perror ("malloc");
+  return ret;
+}
+
+/* Set '*mbr_id' to the MBR partition type byte of 'partition' on
+ * 'device', or -1 if the partition table is not MBR.  libblkid has
+ * already read the partition entry, otherwise ask sfdisk.
+ */
+static int
+get_mbr_id (const char *partition, const char *device, int *mbr_id)
+{
+  CLEANUP_FREE char *scheme = NULL, *type = NULL, *parttype = NULL;
+  unsigned id;
+  int partnum;
+
+  *mbr_id = -1;
+
+  scheme = get_blkid_tag (partition, "PART_ENTRY_SCHEME");
+  if (scheme == NULL)
+    return -1;
+
+  if (STREQ (scheme, "dos")) {
+    type = get_blkid_tag (partition, "PART_ENTRY_TYPE");
+    if (type == NULL)
+      return -1;
+    if (sscanf (type, "%x", &id) == 1) {
+      *mbr_id = id;
+      return 0;
+    }
+  }
+  else if (STRNEQ (scheme, ""))
+    return 0;
+
+  parttype = do_part_get_parttype (device);
+  if (parttype == NULL)
+    return -1;
+  if (STREQ (parttype, "msdos")) {
+    partnum = do_part_to_partnum (partition);
+    if (partnum == -1)
+      return -1;
+    *mbr_id = do_part_get_mbr_id (device, partnum);
+    if (*mbr_id == -1)
+      return -1;
+  }
+
+  return 0;
+}
+
+/* Add the btrfs subvolumes apart from the default one, which is
+ * the filesystem on the device itself.
+ */
+static int
+add_btrfs_subvolumes (guestfs_int_storage_entry_list *ret,
+                      const mountable_t *mountable,
+                      const char *vfs_label, const char *uuid,
+                      const char *parents)
+{
+  guestfs_int_btrfsinventory_list *inv;
+  size_t i;
+  int r = 0;
+
+  inv = do_btrfs_inventory (mountable);
+  if (inv == NULL)
+    return -1;
+
+  for (i = 0; r == 0 && i < inv->guestfs_int_btrfsinventory_list_len; ++i) {
+    const guestfs_int_btrfsinventory *this =
+      &inv->guestfs_int_btrfsinventory_list_val[i];
+    char *name;
+
+    if (this->btrfsinventory_default)
+      continue;
+
+    if (asprintf (&name, "btrfsvol:%s/%s",
+                  mountable->device, this->btrfsinventory_path) == -1) {
+      reply_with_perror ("asprintf");
+      r = -1;
+      break;
+    }
+    r = add_entry (ret, name, "filesystem", "btrfs", vfs_label, uuid,
+                   -1, -1, parents);
+    free (name);
+  }
+
+  xdr_free ((xdrproc_t) xdr_guestfs_int_btrfsinventory_list, (char *) inv);
+  free (inv);
+  return r;
+}
+
+/* Add the filesystem on 'device', like check_with_vfs_type in
+ * src/listfs.c.  Any btrfs subvolumes are added before it.
+ */
+static int
+add_filesystem (guestfs_int_storage_entry_list *ret, const char *device)
+{
+  CLEANUP_FREE char *vfs_type = NULL, *vfs_label = NULL, *uuid = NULL;
+  CLEANUP_FREE char *parents = NULL;
+  mountable_t mountable = { .type = MOUNTABLE_DEVICE,
+                            .device = (char *) device };
+  const char *v;
+  size_t n;
+  int64_t size;
+
+  vfs_type = get_blkid_tag (device, "TYPE");
+  if (vfs_type == NULL)
+    return -1;
+
+  /* Ignore RAID and LVM members and LUKS containers. */
+  n = strlen (vfs_type);
+  if ((n >= 7 && STREQ (&vfs_type[n-7], "_member")) ||
+      STREQ (vfs_type, "crypto_LUKS"))
+    return 0;
+  v = STREQ (vfs_type, "") ? "unknown" : vfs_type;
+
+  vfs_label = do_vfs_label (&mountable);
+  if (vfs_label == NULL)
+    return -1;
+  uuid = get_blkid_tag (device, "UUID");
+  if (uuid == NULL)
+    return -1;
+  size = get_size (device);
+  if (size == -1)
+    return -1;
+  parents = get_parents (device);
+  if (parents == NULL)
+    return -1;
+
+  if (STREQ (v, "btrfs") && optgroup_btrfs_available () &&
+      add_btrfs_subvolumes (ret, &mountable, vfs_label, uuid, parents) == -1)
+    return -1;
+
+  return add_entry (ret, device, "filesystem", v, vfs_label, uuid,
+                    -1, size, parents);
+}
+
+static int
+add_filesystems (guestfs_int_storage_entry_list *ret, char **list)
+{
+  size_t i;
+
+  if (list == NULL)
+    return -1;
+
+  for (i = 0; list[i] != NULL; ++i) {
+    if (add_filesystem (ret, list[i]) == -1) {
+      free_strings (list);
+      return -1;
+    }
+  }
+  free_strings (list);
+  return 0;
+}
+
+/* Add the LVs, VGs and PVs, in that order. */
+static int
+add_lvm_objects (guestfs_int_storage_entry_list *ret,
+                 const guestfs_int_lvm_object_list *lvm)
+{
+  size_t i, j;
+
+  for (i = 0; i < lvm->guestfs_int_lvm_object_list_len; ++i) {
+    const guestfs_int_lvm_object *lv = &lvm->guestfs_int_lvm_object_list_val[i];
+    CLEANUP_FREE char *vg = NULL;
+
+    if (STRNEQ (lv->lo_type, "lv"))
+      continue;
+    if (asprintf (&vg, "/dev/%s", lv->lo_vg_name) == -1) {
+      reply_with_perror ("asprintf");
+      return -1;
+    }
+    if (add_entry (ret, lv->lo_name, "lv", "", "", lv->lo_uuid,
+                   -1, lv->lo_size, vg) == -1)
+      return -1;
+  }
+
+  for (i = 0; i < lvm->guestfs_int_lvm_object_list_len; ++i) {
+    const guestfs_int_lvm_object *vg = &lvm->guestfs_int_lvm_object_list_val[i];
+    CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (pvs);
+    CLEANUP_FREE char *name = NULL, *parents = NULL;
+
+    if (STRNEQ (vg->lo_type, "vg"))
+      continue;
+    for (j = 0; j < lvm->guestfs_int_lvm_object_list_len; ++j) {
+      const guestfs_int_lvm_object *pv =
+        &lvm->guestfs_int_lvm_object_list_val[j];
+
+      if (STREQ (pv->lo_type, "pv") && STREQ (pv->lo_vg_name, vg->lo_name) &&
+          add_string (&pvs, pv->lo_name) == -1)
+        return -1;
+    }
+    if (end_stringsbuf (&pvs) == -1)
+      return -1;
+    parents = join_strings (" ", pvs.argv);
+    if (parents == NULL) {
+      reply_with_perror ("malloc");
+      return -1;
+    }
+    if (asprintf (&name, "/dev/%s", vg->lo_name) == -1) {
+      reply_with_perror ("asprintf");
+      return -1;
+    }
+    if (add_entry (ret, name, "vg", "", "", vg->lo_uuid,
+                   -1, vg->lo_size, parents) == -1)
+      return -1;
+  }
+
+  for (i = 0; i < lvm->guestfs_int_lvm_object_list_len; ++i) {
+    const guestfs_int_lvm_object *pv = &lvm->guestfs_int_lvm_object_list_val[i];
+
+    if (STRNEQ (pv->lo_type, "pv"))
+      continue;
+    if (add_entry (ret, pv->lo_name, "pv", "", "", pv->lo_uuid,
+                   -1, pv->lo_size, "") == -1)
+      return -1;
+  }
+
+  return 0;
+}
+
+guestfs_int_storage_entry_list *
+do_list_storage (void)
+{
+  CLEANUP_FREE_STRING_LIST char **devices = NULL;
+  CLEANUP_FREE_STRING_LIST char **partitions = NULL;
+  CLEANUP_FREE_STRING_LIST char **part_devs = NULL;
+  CLEANUP_FREE int *mbr_ids = NULL;
+  guestfs_int_lvm_object_list *lvm = NULL;
+  guestfs_int_storage_entry_list *ret;
+  const int has_ldm = optgroup_ldm_available ();
+  size_t i, j, nr_parts;
+  int64_t size;
+
+  ret = calloc (1, sizeof *ret);
+  if (ret == NULL) {
+    reply_with_perror ("calloc");
+    return NULL;
+  }
+
+  devices = do_list_devices ();
+  if (devices == NULL)
+    goto error;
+  partitions = do_list_partitions ();
+  if (partitions == NULL)
+    goto error;
+  if (optgroup_lvm2_available ()) {
+    lvm = do_lvm_report ();
+    if (lvm == NULL)
+      goto error;
+  }
+
+  /* The device and MBR type byte of each partition. */
+  nr_parts = count_strings (partitions);
+  part_devs = calloc (nr_parts + 1, sizeof (char *));
+  mbr_ids = calloc (nr_parts, sizeof (int));
+  if (part_devs == NULL || mbr_ids == NULL) {
+    reply_with_perror ("calloc");
+    goto error;
+  }
+  for (i = 0; i < nr_parts; ++i) {
+    part_devs[i] = do_part_to_dev (partitions[i]);
+    if (part_devs[i] == NULL)
+      goto error;
+    if (get_mbr_id (partitions[i], part_devs[i], &mbr_ids[i]) == -1)
+      goto error;
+  }
+
+  /* Filesystems, in the same order as guestfs_list_filesystems.
+   * Devices which contain partitions are not filesystems, and with
+   * ldm the partitions with MBR type 0x42 are members of a Windows
+   * dynamic disk group.
+   */
+  for (i = 0; devices[i] != NULL; ++i) {
+    for (j = 0; j < nr_parts; ++j) {
+      if (STREQ (devices[i], part_devs[j]))
+        break;
+    }
+    if (j == nr_parts && add_filesystem (ret, devices[i]) == -1)
+      goto error;
+  }
+  for (i = 0; i < nr_parts; ++i) {
+    if (has_ldm && mbr_ids[i] == 0x42)
+      continue;
+    if (add_filesystem (ret, partitions[i]) == -1)
+      goto error;
+  }
+  if (add_filesystems (ret, do_list_md_devices ()) == -1)
+    goto error;
+  if (lvm) {
+    for (i = 0; i < lvm->guestfs_int_lvm_object_list_len; ++i) {
+      const guestfs_int_lvm_object *lv =
+        &lvm->guestfs_int_lvm_object_list_val[i];
+
+      if (STREQ (lv->lo_type, "lv") && add_filesystem (ret, lv->lo_name) == -1)
+        goto error;
+    }
+  }
+  if (has_ldm &&
+      (add_filesystems (ret, do_list_ldm_volumes ()) == -1 ||
+       add_filesystems (ret, do_list_ldm_partitions ()) == -1))
+    goto error;
+
+  if (lvm && add_lvm_objects (ret, lvm) == -1)
+    goto error;
+
+  for (i = 0; i < nr_parts; ++i) {
+    size = get_size (partitions[i]);
+    if (size == -1 ||
+        add_entry (ret, partitions[i], "partition", "", "", "",
+                   mbr_ids[i], size, part_devs[i]) == -1)
+      goto error;
+  }
+
+  for (i = 0; devices[i] != NULL; ++i) {
+    size = get_size (devices[i]);
+    if (size == -1 ||
+        add_entry (ret, devices[i], "device", "", "", "",
+                   -1, size, "") == -1)
+      goto error;
+  }
+
+  if (lvm) {
+    xdr_free ((xdrproc_t) xdr_guestfs_int_lvm_object_list, (char *) lvm);
+    free (lvm);
+  }
+  return ret;
+
+ error:
+  if (lvm) {
+    xdr_free ((xdrproc_t) xdr_guestfs_int_lvm_object_list, (char *) lvm);
+    free (lvm);
+  }
+  xdr_free ((xdrproc_t) xdr_guestfs_int_storage_entry_list, (char *) ret);
+  free (ret);
+  return NULL;
+}
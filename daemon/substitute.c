@@ -0,0 +1,307 @@
+/* libguestfs - the guestfsd daemon
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pcre.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "guestfs_protocol.h"
+#include "daemon.h"
+#include "actions.h"
+#include "optgroups.h"
+
+/* Groups \0 to \9 can be used in the replacement. */
+#define MAX_GROUPS 10
+
+/* Check that the back references in the replacement refer to groups
+ * which exist in the regular expression.
+ */
+static int
+check_replacement (const char *replacement, int ngroups)
+{
+  const char *p;
+
+  for (p = replacement; *p; ++p) {
+    if (*p != '\\' || p[1] == '\0')
+      continue;
+    ++p;
+    if (*p >= '0' && *p <= '9' && *p - '0' > ngroups) {
+      reply_with_error ("replacement refers to group \\%c, but the regular expression only has %d groups",
+                        *p, ngroups);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/* Write the replacement for one match to 'out'. */
+static void
+write_replacement (FILE *out, const char *replacement,
+                   const char *line, const int *ovector, int nmatched)
+{
+  const char *p;
+  int n;
+
+  for (p = replacement; *p; ++p) {
+    if (*p != '\\' || p[1] == '\0') {
+      putc (*p, out);
+      continue;
+    }
+    ++p;
+    if (*p >= '0' && *p <= '9') {
+      n = *p - '0';
+      /* Groups which did not take part in the match are empty. */
+      if (n < nmatched && ovector[2*n] >= 0)
+        fwrite (&line[ovector[2*n]], 1, ovector[2*n+1] - ovector[2*n], out);
+    }
+    else
+      putc (*p, out);
+  }
+}
+
+/* Substitute the matches in one line and write it to 'out'.  Returns
+ * the number of replacements, or -1 on error (without replying).
+ * Empty matches are handled as in Perl, so that globally replacing
+ * "x*" with "-" turns "abc" into "-a-b-c-".
+ */
+static int
+substitute_line (const pcre *re, const pcre_extra *extra,
+                 const char *line, size_t len,
+                 const char *replacement, int global, FILE *out)
+{
+  int ovector[3*MAX_GROUPS];
+  int r, count = 0;
+  int offset = 0, copied = 0, options = 0;
+
+  while ((size_t) offset <= len) {
+    r = pcre_exec (re, extra, line, len, offset, options,
+                   ovector, sizeof ovector / sizeof ovector[0]);
+    if (r == PCRE_ERROR_NOMATCH)
+      break;
+    if (r < 0) {
+      errno = EINVAL;
+      return -1;
+    }
+    if (r == 0)                 /* more groups than ovector can hold */
+      r = MAX_GROUPS;
+
+    fwrite (&line[copied], 1, ovector[0] - copied, out);
+    write_replacement (out, replacement, line, ovector, r);
+    copied = ovector[1];
+    count++;
+
+    if (!global)
+      break;
+
+    /* After an empty match, look for a non-empty match at the same
+     * place before moving on.
+     */
+    offset = ovector[1];
+    options = ovector[0] == ovector[1] ? PCRE_NOTEMPTY_ATSTART : 0;
+  }
+
+  fwrite (&line[copied], 1, len - copied, out);
+  return count;
+}
+
+/* Takes optional arguments, consult optargs_bitmask. */
+int
+do_file_substitute (const char *path, const char *regex,
+                    const char *replacement,
+                    int global, int caseless, const char *backupextension)
+{
+  CLEANUP_FREE char *rpath = NULL, *buf = NULL, *tmpbuf = NULL;
+  CLEANUP_FREE char *backupbuf = NULL, *line = NULL;
+  const char *tmppath;
+  pcre *re = NULL;
+  pcre_extra *extra = NULL;
+  const char *err;
+  int offset, ngroups, r, fd = -1;
+  FILE *in = NULL, *out = NULL;
+  struct stat statbuf;
+  size_t allocsize = 0;
+  ssize_t len;
+  int count = 0;
+
+  if (!(optargs_bitmask & GUESTFS_FILE_SUBSTITUTE_GLOBAL_BITMASK))
+    global = 0;
+  if (!(optargs_bitmask & GUESTFS_FILE_SUBSTITUTE_CASELESS_BITMASK))
+    caseless = 0;
+  if (!(optargs_bitmask & GUESTFS_FILE_SUBSTITUTE_BACKUPEXTENSION_BITMASK))
+    backupextension = NULL;
+
+  if (backupextension &&
+      (STREQ (backupextension, "") || strchr (backupextension, '/'))) {
+    reply_with_error ("backupextension must not be empty or contain '/'");
+    return -1;
+  }
+
+  re = pcre_compile (regex, caseless ? PCRE_CASELESS : 0, &err, &offset, NULL);
+  if (re == NULL) {
+    reply_with_error ("%s: at offset %d: %s", regex, offset, err);
+    return -1;
+  }
+  extra = pcre_study (re, 0, &err);
+  if (pcre_fullinfo (re, extra, PCRE_INFO_CAPTURECOUNT, &ngroups) != 0) {
+    reply_with_error ("pcre_fullinfo: %s", regex);
+    goto error;
+  }
+  if (check_replacement (replacement, ngroups) == -1)
+    goto error;
+
+  /* Edit the file that a symbolic link points to, rather than
+   * replacing the link with a regular file.
+   */
+  CHROOT_IN;
+  rpath = realpath (path, NULL);
+  CHROOT_OUT;
+  if (rpath == NULL) {
+    reply_with_perror ("%s", path);
+    goto error;
+  }
+
+  buf = sysroot_path (rpath);
+  if (!buf) {
+    reply_with_perror ("malloc");
+    goto error;
+  }
+
+  in = fopen (buf, "re");
+  if (in == NULL) {
+    reply_with_perror ("open: %s", path);
+    goto error;
+  }
+  if (fstat (fileno (in), &statbuf) == -1) {
+    reply_with_perror ("fstat: %s", path);
+    goto error;
+  }
+  if (!S_ISREG (statbuf.st_mode)) {
+    reply_with_error ("%s: not a regular file", path);
+    goto error;
+  }
+
+  /* Write the new content to a temporary file in the same directory,
+   * so the rename at the end is atomic.
+   */
+  if (asprintf (&tmpbuf, "%s.guestfsXXXXXX", buf) == -1) {
+    reply_with_perror ("asprintf");
+    goto error;
+  }
+  tmppath = &tmpbuf[sysroot_len];
+  fd = mkostemp (tmpbuf, O_CLOEXEC);
+  if (fd == -1) {
+    reply_with_perror ("mkstemp: %s", tmppath);
+    tmpbuf[0] = '\0';
+    goto error;
+  }
+  out = fdopen (fd, "w");
+  if (out == NULL) {
+    reply_with_perror ("fdopen: %s", tmppath);
+    goto error;
+  }
+  fd = -1;
+
+  while ((len = getline (&line, &allocsize, in)) != -1) {
+    r = substitute_line (re, extra, line, len, replacement, global, out);
+    if (r == -1) {
+      reply_with_error ("%s: error matching regular expression", path);
+      goto error;
+    }
+    count += r;
+  }
+  if (ferror (in)) {
+    reply_with_perror ("read: %s", path);
+    goto error;
+  }
+  fclose (in);
+  in = NULL;
+
+  /* If nothing changed, leave the original file alone, unless a
+   * backup was asked for.
+   */
+  if (count == 0 && !backupextension) {
+    fclose (out);
+    unlink (tmpbuf);
+    goto out;
+  }
+
+  /* Give the new file the attributes of the original.  chown must
+   * come before chmod because it clears the setuid and setgid bits.
+   */
+  if (fchown (fileno (out), statbuf.st_uid, statbuf.st_gid) == -1) {
+    reply_with_perror ("fchown: %s", tmppath);
+    goto error;
+  }
+  if (fchmod (fileno (out), statbuf.st_mode & 07777) == -1) {
+    reply_with_perror ("fchmod: %s", tmppath);
+    goto error;
+  }
+  if (fclose (out) == EOF) {
+    out = NULL;
+    reply_with_perror ("close: %s", tmppath);
+    goto error;
+  }
+  out = NULL;
+
+  /* This copies the SELinux context too. */
+  if (optgroup_linuxxattrs_available () && !copy_xattrs (rpath, tmppath))
+    /* copy_xattrs replies with an error already. */
+    goto error;
+
+  if (backupextension) {
+    if (asprintf (&backupbuf, "%s%s", buf, backupextension) == -1) {
+      reply_with_perror ("asprintf");
+      goto error;
+    }
+    if (rename (buf, backupbuf) == -1) {
+      reply_with_perror ("rename: %s", path);
+      goto error;
+    }
+  }
+  if (rename (tmpbuf, buf) == -1) {
+    reply_with_perror ("rename: %s", path);
+    goto error;
+  }
+
+ out:
+  pcre_free_study (extra);
+  pcre_free (re);
+  return count;
+
+ error:
+  if (in)
+    fclose (in);
+  if (out)
+    fclose (out);
+  if (fd >= 0)
+    close (fd);
+  if (tmpbuf && tmpbuf[0])
+    unlink (tmpbuf);
+  pcre_free_study (extra);
+  pcre_free (re);
+  return -1;
+}
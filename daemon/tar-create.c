@@ -0,0 +1,661 @@
+/* libguestfs - the guestfsd daemon
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Create a tar archive of a directory in the daemon and send it
+ * straight to the library, instead of reading the output of
+ * "tar -cf -" through a pipe.  This is used by tar_out when none of
+ * the options which need GNU tar (excludes, xattrs, SELinux labels,
+ * ACLs, or an external compression program) were given.
+ *
+ * The archive is the same as GNU tar's default format: ustar headers
+ * with the GNU magic, ././@LongLink entries for long names and link
+ * targets, and base-256 numbers where the octal fields are too small.
+ * Holes in sparse files are found with SEEK_DATA/SEEK_HOLE and sent
+ * to the library as holes, so they are neither read nor transferred.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pwd.h>
+#include <grp.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "hash.h"
+
+#include "guestfs_protocol.h"
+#include "daemon.h"
+
+#define BLOCKSIZE 512
+
+/* GNU tar pads the archive to a multiple of this (-b 20). */
+#define RECORDSIZE (20 * BLOCKSIZE)
+
+/* Runs of zeroes at least this long are sent as holes. */
+#define TAR_HOLE_MIN (64 * 1024)
+
+/* A file with more than one link which has been stored already. */
+struct tar_link {
+  dev_t dev;
+  ino_t ino;
+  char *name;
+};
+
+struct tar_out {
+  int numericowner;
+  int fd;                       /* Output, or -1 to send to the library. */
+
+  char *buf;                    /* Output buffer. */
+  size_t len;
+  uint64_t offset;              /* Bytes output so far. */
+
+  Hash_table *links;
+
+  /* Last user and group names looked up. */
+  uid_t uid;
+  gid_t gid;
+  char uname[32];
+  char gname[32];
+  bool have_uname, have_gname;
+};
+
+static size_t
+link_hasher (void const *x, size_t table_size)
+{
+  const struct tar_link *l = x;
+
+  return ((uint64_t) l->ino ^ (uint64_t) l->dev) % table_size;
+}
+
+static bool
+link_comparator (void const *x, void const *y)
+{
+  const struct tar_link *a = x, *b = y;
+
+  return a->dev == b->dev && a->ino == b->ino;
+}
+
+static void
+link_free (void *x)
+{
+  struct tar_link *l = x;
+
+  if (l) {
+    free (l->name);
+    free (l);
+  }
+}
+
+/* Send or write the buffered output.  Returns 0, -1 on error or -2
+ * if the library cancelled the transfer.
+ */
+static int
+flush_output (struct tar_out *t)
+{
+  int r;
+
+  if (t->len == 0)
+    return 0;
+
+  if (t->fd == -1)
+    r = send_file_write (t->buf, t->len);
+  else {
+    r = xwrite (t->fd, t->buf, t->len);
+    if (r == -1)
+      perror ("tar-out: write");
+  }
+  t->len = 0;
+  return r;
+}
+
+/* Return a pointer to 'n' zeroed bytes at the end of the output
+ * buffer, flushing it first if there is not enough space.
+ */
+static int
+reserve_output (struct tar_out *t, size_t n, char **p)
+{
+  int r;
+
+  if (t->len + n > GUESTFS_MAX_CHUNK_SIZE) {
+    r = flush_output (t);
+    if (r != 0)
+      return r;
+  }
+
+  *p = &t->buf[t->len];
+  memset (*p, 0, n);
+  t->len += n;
+  t->offset += n;
+  return 0;
+}
+
+static int
+output_zeroes (struct tar_out *t, uint64_t n)
+{
+  char *p;
+  size_t m;
+  int r;
+
+  if (t->fd == -1 && n >= TAR_HOLE_MIN) {
+    r = flush_output (t);
+    if (r != 0)
+      return r;
+    r = send_file_hole (n);
+    if (r != 0)
+      return r;
+    t->offset += n;
+    return 0;
+  }
+
+  while (n > 0) {
+    m = MIN (n, GUESTFS_MAX_CHUNK_SIZE / 2);
+    r = reserve_output (t, m, &p);
+    if (r != 0)
+      return r;
+    n -= m;
+  }
+  return 0;
+}
+
+/* Store a number in a header field.  Numbers are octal followed by a
+ * NUL, or GNU base-256 if they are too large for the field.
+ */
+static void
+put_number (char *field, size_t len, uint64_t v)
+{
+  size_t i;
+
+  if ((len-1) * 3 < 64 && (v >> ((len-1) * 3)) != 0) {
+    memset (field, 0, len);
+    for (i = len-1; i > 0; --i) {
+      field[i] = v & 0xff;
+      v >>= 8;
+    }
+    field[0] = (char) 0x80;
+    return;
+  }
+
+  field[len-1] = '\0';
+  for (i = len-1; i > 0; --i) {
+    field[i-1] = '0' + (v & 7);
+    v >>= 3;
+  }
+}
+
+/* Look up the user and group names, as GNU tar does unless
+ * --numeric-owner is used.  The previous lookup is cached since
+ * most files in a directory tend to have the same owner.
+ */
+static void
+put_owner_names (struct tar_out *t, const struct stat *st, char *h)
+{
+  struct passwd *pw;
+  struct group *gr;
+
+  if (!t->have_uname || t->uid != st->st_uid) {
+    t->uid = st->st_uid;
+    t->have_uname = true;
+    pw = getpwuid (st->st_uid);
+    if (pw && strlen (pw->pw_name) < sizeof t->uname)
+      strcpy (t->uname, pw->pw_name);
+    else
+      t->uname[0] = '\0';
+  }
+  if (!t->have_gname || t->gid != st->st_gid) {
+    t->gid = st->st_gid;
+    t->have_gname = true;
+    gr = getgrgid (st->st_gid);
+    if (gr && strlen (gr->gr_name) < sizeof t->gname)
+      strcpy (t->gname, gr->gr_name);
+    else
+      t->gname[0] = '\0';
+  }
+
+  memcpy (&h[265], t->uname, strlen (t->uname));
+  memcpy (&h[297], t->gname, strlen (t->gname));
+}
+
+static int output_header (struct tar_out *t, const char *name, const struct stat *st, char type, uint64_t size, const char *linkname);
+
+/* GNU extension for a name or link target longer than 100 bytes. */
+static int
+output_long_name (struct tar_out *t, char type, const char *str)
+{
+  const size_t len = strlen (str) + 1;
+  const struct stat st = { .st_mode = 0 };
+  char *p;
+  int r;
+
+  r = output_header (t, "././@LongLink", &st, type, len, NULL);
+  if (r != 0)
+    return r;
+
+  /* Names are at most PATH_MAX, well below the buffer size. */
+  r = reserve_output (t, (len + BLOCKSIZE - 1) & ~(BLOCKSIZE - 1), &p);
+  if (r != 0)
+    return r;
+  memcpy (p, str, len);
+  return 0;
+}
+
+static int
+output_header (struct tar_out *t, const char *name, const struct stat *st,
+               char type, uint64_t size, const char *linkname)
+{
+  char *h;
+  unsigned sum = 0;
+  size_t i;
+  int r;
+
+  if (strlen (name) > 100) {
+    r = output_long_name (t, 'L', name);
+    if (r != 0)
+      return r;
+  }
+  if (linkname && strlen (linkname) > 100) {
+    r = output_long_name (t, 'K', linkname);
+    if (r != 0)
+      return r;
+  }
+
+  r = reserve_output (t, BLOCKSIZE, &h);
+  if (r != 0)
+    return r;
+  strncpy (&h[0], name, 100);
+  put_number (&h[100], 8, st->st_mode & 07777);
+  put_number (&h[108], 8, st->st_uid);
+  put_number (&h[116], 8, st->st_gid);
+  put_number (&h[124], 12, size);
+  put_number (&h[136], 12, st->st_mtime > 0 ? st->st_mtime : 0);
+  h[156] = type;
+  if (linkname)
+    strncpy (&h[157], linkname, 100);
+  memcpy (&h[257], "ustar  ", 8); /* GNU magic and version */
+  if (type != 'L' && type != 'K' && !t->numericowner)
+    put_owner_names (t, st, h);
+  if (type == '3' || type == '4') {
+    put_number (&h[329], 8, major (st->st_rdev));
+    put_number (&h[337], 8, minor (st->st_rdev));
+  }
+
+  /* The checksum is calculated with the checksum field as spaces. */
+  memset (&h[148], ' ', 8);
+  for (i = 0; i < BLOCKSIZE; ++i)
+    sum += (unsigned char) h[i];
+  snprintf (&h[148], 8, "%06o", sum);
+
+  return 0;
+}
+
+/* Output the contents of a regular file, followed by the padding to
+ * the next block.  Holes are skipped using SEEK_DATA and SEEK_HOLE.
+ */
+static int
+output_file_data (struct tar_out *t, int fd, const char *name,
+                  uint64_t size)
+{
+  uint64_t offset = 0, padding;
+  off_t data, hole;
+  bool seek_holes = true;
+  size_t n;
+  ssize_t r;
+  int ret;
+
+  while (offset < size) {
+    data = offset;
+    hole = size;
+    if (seek_holes) {
+      data = lseek (fd, offset, SEEK_DATA);
+      if (data == -1 && errno == ENXIO)
+        data = size;            /* The rest of the file is a hole. */
+      else if (data == -1) {
+        seek_holes = false;     /* Not supported by this filesystem. */
+        data = offset;
+      }
+      else if ((uint64_t) data > size)
+        data = size;
+    }
+    if ((uint64_t) data > offset) {
+      ret = output_zeroes (t, data - offset);
+      if (ret != 0)
+        return ret;
+      offset = data;
+      continue;
+    }
+    if (seek_holes) {
+      hole = lseek (fd, offset, SEEK_HOLE);
+      if (hole == -1 || (uint64_t) hole > size)
+        hole = size;
+    }
+
+    while (offset < (uint64_t) hole) {
+      if (t->len == GUESTFS_MAX_CHUNK_SIZE) {
+        ret = flush_output (t);
+        if (ret != 0)
+          return ret;
+      }
+      n = MIN (GUESTFS_MAX_CHUNK_SIZE - t->len, (uint64_t) hole - offset);
+      r = pread (fd, &t->buf[t->len], n, offset);
+      if (r == -1) {
+        if (errno == EINTR)
+          continue;
+        fprintf (stderr, "tar-out: read: %s: %m\n", name);
+        return -1;
+      }
+      if (r == 0) {
+        /* The file shrank.  Pad it with zeroes to the size in the
+         * header, as GNU tar does.
+         */
+        fprintf (stderr, "tar-out: %s: file shrank by %" PRIu64 " bytes; "
+                 "padding with zeros\n", name, size - offset);
+        ret = output_zeroes (t, size - offset);
+        if (ret != 0)
+          return ret;
+        offset = size;
+        break;
+      }
+      t->len += r;
+      t->offset += r;
+      offset += r;
+    }
+  }
+
+  padding = (BLOCKSIZE - size % BLOCKSIZE) % BLOCKSIZE;
+  return output_zeroes (t, padding);
+}
+
+static int output_directory (struct tar_out *t, int dirfd, const char *name);
+
+/* Add the entry 'd_name' in the directory 'dirfd' to the archive as
+ * 'name'.
+ */
+static int
+output_entry (struct tar_out *t, int dirfd, const char *d_name,
+              const char *name, const struct stat *st)
+{
+  CLEANUP_FREE char *dirname = NULL;
+  CLEANUP_FREE char *link = NULL;
+  struct tar_link key, *l;
+  ssize_t len;
+  int fd, r;
+
+  if (!S_ISDIR (st->st_mode) && st->st_nlink > 1) {
+    key.dev = st->st_dev;
+    key.ino = st->st_ino;
+    l = hash_lookup (t->links, &key);
+    if (l)
+      return output_header (t, name, st, '1', 0, l->name);
+
+    l = malloc (sizeof *l);
+    if (l == NULL) {
+      perror ("malloc");
+      return -1;
+    }
+    l->dev = st->st_dev;
+    l->ino = st->st_ino;
+    l->name = strdup (name);
+    if (l->name == NULL || hash_insert (t->links, l) == NULL) {
+      perror ("malloc");
+      link_free (l);
+      return -1;
+    }
+  }
+
+  switch (st->st_mode & S_IFMT) {
+  case S_IFREG:
+    fd = openat (dirfd, d_name, O_RDONLY|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW);
+    if (fd == -1) {
+      fprintf (stderr, "tar-out: open: %s: %m\n", name);
+      return -1;
+    }
+    posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    r = output_header (t, name, st, '0', st->st_size, NULL);
+    if (r == 0)
+      r = output_file_data (t, fd, name, st->st_size);
+    close (fd);
+    return r;
+
+  case S_IFDIR:
+    if (asprintf (&dirname, "%s/", name) == -1) {
+      perror ("asprintf");
+      return -1;
+    }
+    r = output_header (t, dirname, st, '5', 0, NULL);
+    if (r != 0)
+      return r;
+    fd = openat (dirfd, d_name,
+                 O_RDONLY|O_CLOEXEC|O_DIRECTORY|O_NOFOLLOW);
+    if (fd == -1) {
+      fprintf (stderr, "tar-out: open: %s: %m\n", name);
+      return -1;
+    }
+    return output_directory (t, fd, name);
+
+  case S_IFLNK:
+    link = malloc (st->st_size + 1);
+    if (link == NULL) {
+      perror ("malloc");
+      return -1;
+    }
+    len = readlinkat (dirfd, d_name, link, st->st_size + 1);
+    if (len == -1) {
+      fprintf (stderr, "tar-out: readlink: %s: %m\n", name);
+      return -1;
+    }
+    if (len > st->st_size) {
+      fprintf (stderr, "tar-out: %s: symbolic link changed as we read it\n",
+               name);
+      return -1;
+    }
+    link[len] = '\0';
+    return output_header (t, name, st, '2', 0, link);
+
+  case S_IFCHR:
+    return output_header (t, name, st, '3', 0, NULL);
+
+  case S_IFBLK:
+    return output_header (t, name, st, '4', 0, NULL);
+
+  case S_IFIFO:
+    return output_header (t, name, st, '6', 0, NULL);
+
+  default:
+    if (verbose)
+      fprintf (stderr, "tar-out: %s: socket ignored\n", name);
+    return 0;
+  }
+}
+
+/* Add the contents of the directory 'dirfd' (which this closes) to
+ * the archive, with 'name' as the prefix of their names.
+ */
+static int
+output_directory (struct tar_out *t, int dirfd, const char *name)
+{
+  DIR *dir;
+  struct dirent *d;
+  struct stat st;
+  int r = 0;
+
+  dir = fdopendir (dirfd);
+  if (dir == NULL) {
+    fprintf (stderr, "tar-out: fdopendir: %s: %m\n", name);
+    close (dirfd);
+    return -1;
+  }
+
+  for (;;) {
+    CLEANUP_FREE char *entry = NULL;
+
+    errno = 0;
+    d = readdir (dir);
+    if (d == NULL) {
+      if (errno != 0) {
+        fprintf (stderr, "tar-out: readdir: %s: %m\n", name);
+        r = -1;
+      }
+      break;
+    }
+    if (STREQ (d->d_name, ".") || STREQ (d->d_name, ".."))
+      continue;
+
+    if (fstatat (dirfd, d->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+      fprintf (stderr, "tar-out: stat: %s/%s: %m\n", name, d->d_name);
+      r = -1;
+      break;
+    }
+    if (asprintf (&entry, "%s/%s", name, d->d_name) == -1) {
+      perror ("asprintf");
+      r = -1;
+      break;
+    }
+    r = output_entry (t, dirfd, d->d_name, entry, &st);
+    if (r != 0)
+      break;
+  }
+
+  closedir (dir);
+  return r;
+}
+
+/* Write the archive of 'path' to 't->fd', or send it if that is -1. */
+static int
+write_tar (const char *path, int numericowner, int fd)
+{
+  struct tar_out t = { .numericowner = numericowner, .fd = fd };
+  struct stat st;
+  int dirfd, r;
+
+  t.buf = malloc (GUESTFS_MAX_CHUNK_SIZE);
+  if (t.buf == NULL) {
+    perror ("malloc");
+    return -1;
+  }
+  t.links = hash_initialize (16, NULL, link_hasher, link_comparator,
+                             link_free);
+  if (t.links == NULL) {
+    perror ("hash_initialize");
+    free (t.buf);
+    return -1;
+  }
+
+  dirfd = open (path, O_RDONLY|O_CLOEXEC|O_DIRECTORY);
+  if (dirfd == -1 || fstat (dirfd, &st) == -1) {
+    fprintf (stderr, "tar-out: %s: %m\n", path);
+    if (dirfd >= 0)
+      close (dirfd);
+    r = -1;
+    goto out;
+  }
+
+  /* Names are relative to the directory, as with "tar -C path -cf - .". */
+  r = output_header (&t, "./", &st, '5', 0, NULL);
+  if (r == 0)
+    r = output_directory (&t, dirfd, ".");
+  else
+    close (dirfd);
+
+  /* Two zero blocks mark the end of the archive, which is then padded
+   * to the end of the record.
+   */
+  if (r == 0)
+    r = output_zeroes (&t, 2 * BLOCKSIZE);
+  if (r == 0)
+    r = output_zeroes (&t, (RECORDSIZE - t.offset % RECORDSIZE) % RECORDSIZE);
+  if (r == 0)
+    r = flush_output (&t);
+
+ out:
+  hash_free (t.links);
+  free (t.buf);
+  return r;
+}
+
+struct tar_thread {
+  const char *path;
+  int numericowner;
+  int fd;
+  int r;
+};
+
+static void *
+tar_thread (void *vp)
+{
+  struct tar_thread *tt = vp;
+
+  tt->r = write_tar (tt->path, tt->numericowner, tt->fd);
+  close (tt->fd);
+  return NULL;
+}
+
+/* Send a tar archive of the directory 'path' (which must already
+ * include the sysroot).  If 'native_compress' is not NULL the archive
+ * is written by a second thread into a pipe which send_compressed
+ * reads.  This is called after reply (NULL, NULL), so errors are only
+ * printed, and the caller has to cancel the transfer.
+ *
+ * Returns 0 on success, -1 on error or -2 if the library cancelled
+ * the transfer.
+ */
+int
+send_tar (const char *path, int numericowner, const char *native_compress)
+{
+  struct tar_thread tt = { .path = path, .numericowner = numericowner };
+  pthread_t thread;
+  int fd[2];
+  int err, r;
+
+  if (native_compress == NULL)
+    return write_tar (path, numericowner, -1);
+
+  if (pipe2 (fd, O_CLOEXEC) == -1) {
+    perror ("pipe2");
+    return -1;
+  }
+  tt.fd = fd[1];
+  err = pthread_create (&thread, NULL, tar_thread, &tt);
+  if (err != 0) {
+    errno = err;
+    perror ("pthread_create");
+    close (fd[0]);
+    close (fd[1]);
+    return -1;
+  }
+
+  r = send_compressed (fd[0], native_compress, -1);
+
+  /* If compression stopped early the writer gets EPIPE and exits. */
+  close (fd[0]);
+  pthread_join (thread, NULL);
+
+  if (r == 0 && tt.r != 0)
+    r = -1;
+  return r;
+}
@@ -158,6 +158,8 @@ do_tar_in (const char *dir, const char *compress, int xattrs, int selinux, int a
       filter = " --xz";
     else if (STREQ (compress, "lzop"))
       filter = " --lzop";
+    else if (STREQ (compress, "zstd"))
+      filter = " --use-compress-program=zstd";
     else {
       reply_with_error ("unknown compression type: %s", compress);
       return -1;
@@ -333,6 +335,7 @@ do_tar_out (const char *dir, const char *compress, int numericowner,
   CLEANUP_FREE char *buf = NULL;
   struct stat statbuf;
   const char *filter;
+  const char *native_compress = NULL;
   int r;
   FILE *fp;
   CLEANUP_UNLINK_FREE char *exclude_from_file = NULL;
@@ -346,7 +349,14 @@ do_tar_out (const char *dir, const char *compress, int numericowner,
   }
 
   if ((optargs_bitmask & GUESTFS_TAR_OUT_COMPRESS_BITMASK)) {
-    if (STREQ (compress, "compress"))
+    /* Where the daemon can compress the tarball itself on all vCPUs,
+     * tar writes it uncompressed.
+     */
+    if (native_compress_available (compress)) {
+      native_compress = compress;
+      filter = "";
+    }
+    else if (STREQ (compress, "compress"))
       filter = " --compress";
     else if (STREQ (compress, "gzip"))
       filter = " --gzip";
@@ -356,6 +366,8 @@ do_tar_out (const char *dir, const char *compress, int numericowner,
       filter = " --xz";
     else if (STREQ (compress, "lzop"))
       filter = " --lzop";
+    else if (STREQ (compress, "zstd"))
+      filter = " --use-compress-program=zstd";
     else {
       reply_with_error ("unknown compression type: %s", compress);
       return -1;
@@ -398,6 +410,32 @@ do_tar_out (const char *dir, const char *compress, int numericowner,
     return -1;
   }
 
+  /* Unless one of the options which only GNU tar implements was
+   * used, create the archive in the daemon.
+   */
+  if (STREQ (filter, "") && !exclude_from_file &&
+      !xattrs && !selinux && !acls) {
+    if (verbose)
+      fprintf (stderr, "tar-out: creating archive of %s in the daemon\n",
+               dir);
+
+    reply (NULL, NULL);
+
+    r = send_tar (buf, numericowner, native_compress);
+    if (r == -2)                /* Cancelled by the library. */
+      return -1;
+    if (r == -1) {
+      fprintf (stderr, "%s: could not create tar archive\n", dir);
+      send_file_end (1);        /* Cancel. */
+      return -1;
+    }
+
+    if (send_file_end (0))      /* Normal end of file. */
+      return -1;
+
+    return 0;
+  }
+
   /* "tar -C /sysroot%s -cf - ." but we have to quote the dir. */
   if (asprintf_nowarn (&cmd, "%s -C %Q%s%s%s%s%s%s%s -cf - .",
                        str_tar,
@@ -427,11 +465,26 @@ do_tar_out (const char *dir, const char *compress, int numericowner,
    */
   reply (NULL, NULL);
 
-  while ((r = fread (buffer, 1, GUESTFS_MAX_CHUNK_SIZE, fp)) > 0) {
-    if (send_file_write (buffer, r) < 0) {
+  if (native_compress) {
+    r = send_compressed (fileno (fp), native_compress, -1);
+    if (r == -2) {              /* Cancelled by the library. */
       pclose (fp);
       return -1;
     }
+    if (r == -1) {
+      fprintf (stderr, "%s: compression failed\n", dir);
+      send_file_end (1);        /* Cancel. */
+      pclose (fp);
+      return -1;
+    }
+  }
+  else {
+    while ((r = fread (buffer, 1, GUESTFS_MAX_CHUNK_SIZE, fp)) > 0) {
+      if (send_file_write (buffer, r) < 0) {
+        pclose (fp);
+        return -1;
+      }
+    }
   }
 
   if (ferror (fp)) {
@@ -22,8 +22,10 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -31,18 +33,208 @@
 #include "daemon.h"
 #include "actions.h"
 
+/* Uploads to files and devices are written by a pool of threads,
+ * each chunk with pwrite at its own offset, so that writing to
+ * storage overlaps with receiving the following chunks (which are
+ * striped across the data channels).
+ */
+#define MAX_WRITERS 8
+
+/* Chunks received but not yet written. */
+#define MAX_QUEUED_CHUNKS 16
+
+struct write_job {
+  struct write_job *next;
+  uint64_t offset;
+  size_t len;
+  char data[];
+};
+
+struct writer_pool {
+  int fd;
+  struct write_job *head, *tail;
+  size_t queued;                /* jobs queued or being written */
+  int done;                     /* no more jobs will be queued */
+  int err;                      /* errno of the first failed write */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  size_t nr_threads;
+  pthread_t threads[MAX_WRITERS];
+};
+
 struct write_cb_data {
   int fd;                       /* file descriptor */
-  uint64_t written;             /* bytes written so far */
+  uint64_t offset;              /* offset of the start of the upload */
+  uint64_t written;             /* bytes written (or queued) so far */
+  struct writer_pool *pool;     /* NULL to write sequentially */
 };
 
+static int
+pwrite_all (int fd, const char *buf, size_t len, uint64_t offset)
+{
+  ssize_t r;
+
+  while (len > 0) {
+    r = pwrite (fd, buf, len, offset);
+    if (r == -1) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    buf += r;
+    len -= r;
+    offset += r;
+  }
+
+  return 0;
+}
+
+static void *
+writer_thread (void *poolv)
+{
+  struct writer_pool *pool = poolv;
+  struct write_job *job;
+  int r, err;
+
+  pthread_mutex_lock (&pool->lock);
+  for (;;) {
+    while (pool->head == NULL && !pool->done)
+      pthread_cond_wait (&pool->cond, &pool->lock);
+    job = pool->head;
+    if (job == NULL)
+      break;
+    pool->head = job->next;
+    if (pool->head == NULL)
+      pool->tail = NULL;
+
+    /* After an error the rest of the jobs are just thrown away. */
+    r = 0;
+    err = 0;
+    if (!pool->err) {
+      pthread_mutex_unlock (&pool->lock);
+      r = pwrite_all (pool->fd, job->data, job->len, job->offset);
+      err = errno;
+      pthread_mutex_lock (&pool->lock);
+    }
+    if (r == -1 && !pool->err)
+      pool->err = err;
+    pool->queued--;
+    pthread_cond_broadcast (&pool->cond);
+    free (job);
+  }
+  pthread_mutex_unlock (&pool->lock);
+
+  return NULL;
+}
+
+/* Start the writer threads.  Returns -1 if the file can't be written
+ * with pwrite, or the threads can't be started, in which case the
+ * upload is written sequentially.
+ */
+static int
+start_writers (struct writer_pool *pool, int fd)
+{
+  size_t i, n;
+  int err;
+
+  if (lseek (fd, 0, SEEK_CUR) == -1)
+    return -1;
+
+  memset (pool, 0, sizeof *pool);
+  pool->fd = fd;
+  pthread_mutex_init (&pool->lock, NULL);
+  pthread_cond_init (&pool->cond, NULL);
+
+  n = MIN (MAX (nr_data_channels, 2), MAX_WRITERS);
+  for (i = 0; i < n; ++i) {
+    err = pthread_create (&pool->threads[i], NULL, writer_thread, pool);
+    if (err != 0)
+      break;
+    pool->nr_threads++;
+  }
+  if (pool->nr_threads == 0) {
+    pthread_mutex_destroy (&pool->lock);
+    pthread_cond_destroy (&pool->cond);
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Wait for the queued chunks to be written and stop the threads.
+ * Returns -1 (setting errno) if any write failed.
+ */
+static int
+stop_writers (struct writer_pool *pool)
+{
+  size_t i;
+
+  pthread_mutex_lock (&pool->lock);
+  pool->done = 1;
+  pthread_cond_broadcast (&pool->cond);
+  pthread_mutex_unlock (&pool->lock);
+
+  for (i = 0; i < pool->nr_threads; ++i)
+    pthread_join (pool->threads[i], NULL);
+
+  pthread_mutex_destroy (&pool->lock);
+  pthread_cond_destroy (&pool->cond);
+
+  if (pool->err) {
+    errno = pool->err;
+    return -1;
+  }
+  return 0;
+}
+
+static int
+queue_write (struct writer_pool *pool, const void *buf, size_t len,
+             uint64_t offset)
+{
+  struct write_job *job;
+
+  /* The chunk buffer is reused as soon as this returns, so the data
+   * must be copied.
+   */
+  job = malloc (sizeof *job + len);
+  if (job == NULL)
+    return -1;
+  job->next = NULL;
+  job->offset = offset;
+  job->len = len;
+  memcpy (job->data, buf, len);
+
+  pthread_mutex_lock (&pool->lock);
+  while (pool->queued >= MAX_QUEUED_CHUNKS && !pool->err)
+    pthread_cond_wait (&pool->cond, &pool->lock);
+  if (pool->err) {
+    errno = pool->err;
+    pthread_mutex_unlock (&pool->lock);
+    free (job);
+    return -1;
+  }
+  if (pool->tail)
+    pool->tail->next = job;
+  else
+    pool->head = job;
+  pool->tail = job;
+  pool->queued++;
+  pthread_cond_signal (&pool->cond);
+  pthread_mutex_unlock (&pool->lock);
+
+  return 0;
+}
+
 static int
 write_cb (void *data_vp, const void *buf, size_t len)
 {
   struct write_cb_data *data = data_vp;
   int r;
 
-  r = xwrite (data->fd, buf, len);
+  if (data->pool)
+    r = queue_write (data->pool, buf, len, data->offset + data->written);
+  else
+    r = xwrite (data->fd, buf, len);
   if (r == -1)
     return -1;
 
@@ -58,10 +250,13 @@ write_cb (void *data_vp, const void *buf, size_t len)
 static int
 upload (const char *filename, int flags, int64_t offset)
 {
-  struct write_cb_data data = { .written = 0 };
+  struct write_cb_data data = { .offset = offset, .written = 0 };
+  struct writer_pool pool;
   int err, r, is_dev;
 
   is_dev = STRPREFIX (filename, "/dev/");
+  if (is_dev)
+    blkid_cache_invalidate (filename);
 
   if (!is_dev) CHROOT_IN;
   data.fd = open (filename, flags, 0666);
@@ -84,7 +279,15 @@ upload (const char *filename, int flags, int64_t offset)
     }
   }
 
+  if (start_writers (&pool, data.fd) == 0)
+    data.pool = &pool;
+
   r = receive_file (write_cb, &data);
+  if (data.pool && stop_writers (data.pool) == -1 && r == 0) {
+    reply_with_perror ("write: %s", filename);
+    close (data.fd);
+    return -1;
+  }
   if (r == -1) {		/* write error */
     err = errno;
     r = cancel_receive ();
@@ -147,19 +350,145 @@ check_not_directory (const char *filename, int fd)
   return 0;
 }
 
-/* Has one FileOut parameter. */
-int
-do_download (const char *filename)
+/* Send the rest of the file, reading until end of file.
+ * Returns 0 = EOF, -1 = read error, -2 = cancelled.
+ */
+static int
+send_file_data (int fd, uint64_t *sent, uint64_t total)
+{
+  ssize_t r;
+
+  while ((r = send_file_from_fd (fd, GUESTFS_MAX_CHUNK_SIZE)) > 0) {
+    *sent += r;
+    notify_progress (*sent, total);
+  }
+
+  return r;
+}
+
+/* Send a regular file, sending the holes found by SEEK_DATA and
+ * SEEK_HOLE as holes instead of reading them.
+ */
+static int
+send_file_extents (int fd, uint64_t *sent, uint64_t total)
+{
+  off_t data, hole;
+  ssize_t r;
+  size_t n;
+
+  while (*sent < total) {
+    data = lseek (fd, *sent, SEEK_DATA);
+    if (data == -1) {
+      if (errno != ENXIO)       /* SEEK_DATA not supported */
+        break;
+      data = total;             /* the rest of the file is a hole */
+    }
+    if ((uint64_t) data > total)
+      data = total;
+
+    if ((uint64_t) data > *sent) {
+      r = send_file_hole (data - *sent);
+      if (r != 0)
+        return r;
+      *sent = data;
+      notify_progress (*sent, total);
+      continue;
+    }
+
+    hole = lseek (fd, *sent, SEEK_HOLE);
+    if (hole == -1)
+      break;
+    if ((uint64_t) hole > total)
+      hole = total;
+
+    if (lseek (fd, *sent, SEEK_SET) == -1)
+      return -1;
+    while (*sent < (uint64_t) hole) {
+      n = MIN ((uint64_t) hole - *sent, GUESTFS_MAX_CHUNK_SIZE);
+      r = send_file_from_fd (fd, n);
+      if (r <= 0)               /* error, cancelled or file shrank */
+        return r;
+      *sent += r;
+      notify_progress (*sent, total);
+    }
+  }
+
+  /* Send anything left, or anything added since we started. */
+  if (lseek (fd, *sent, SEEK_SET) == -1)
+    return -1;
+  return send_file_data (fd, sent, total);
+}
+
+/* Send a device, sending runs of zero blocks as holes.  Block
+ * devices don't support SEEK_DATA, but reading the unallocated parts
+ * of a disk image is cheap for qemu, while sending them is not.
+ */
+static int
+send_device_sparse (int fd, uint64_t *sent, uint64_t total)
 {
-  int fd, r, is_dev;
   CLEANUP_FREE char *buf = NULL;
+  uint64_t hole = 0;
+  ssize_t r;
+  size_t i, j, n;
+  int err;
 
   buf = malloc (GUESTFS_MAX_CHUNK_SIZE);
-  if (buf == NULL) {
-    reply_with_perror ("malloc");
+  if (buf == NULL)
     return -1;
+
+  for (;;) {
+    do
+      r = read (fd, buf, GUESTFS_MAX_CHUNK_SIZE);
+    while (r == -1 && errno == EINTR);
+    if (r == -1)
+      return -1;
+    if (r == 0)
+      break;
+
+    for (i = 0; i < (size_t) r; i = j) {
+      n = MIN ((size_t) r - i, chunk_size);
+      if (is_zero (&buf[i], n)) {
+        hole += n;
+        j = i + n;
+        continue;
+      }
+
+      /* Find the end of the run of non-zero blocks. */
+      for (j = i + n; j < (size_t) r; j += n) {
+        n = MIN ((size_t) r - j, chunk_size);
+        if (is_zero (&buf[j], n))
+          break;
+      }
+
+      if (hole > 0) {
+        err = send_file_hole (hole);
+        if (err != 0)
+          return err;
+        hole = 0;
+      }
+      err = send_file_write (&buf[i], j - i);
+      if (err != 0)
+        return err;
+    }
+
+    *sent += r;
+    notify_progress (*sent, total);
   }
 
+  if (hole > 0)
+    return send_file_hole (hole);
+
+  return 0;
+}
+
+/* Has one FileOut parameter. */
+int
+do_download (const char *filename)
+{
+  int fd, is_dev;
+  int r;
+  struct stat statbuf;
+
   is_dev = STRPREFIX (filename, "/dev/");
 
   if (!is_dev) CHROOT_IN;
@@ -175,10 +504,14 @@ do_download (const char *filename)
     return -1;
   }
 
+  /* Read ahead, so the next chunk is usually ready by the time the
+   * library has taken the previous one.
+   */
+  posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
   /* Calculate the size of the file or device for notification messages. */
   uint64_t total, sent = 0;
   if (!is_dev) {
-    struct stat statbuf;
     if (fstat (fd, &statbuf) == -1) {
       reply_with_perror ("%s", filename);
       close (fd);
@@ -201,14 +534,19 @@ do_download (const char *filename)
    */
   reply (NULL, NULL);
 
-  while ((r = read (fd, buf, GUESTFS_MAX_CHUNK_SIZE)) > 0) {
-    if (send_file_write (buf, r) < 0) {
-      close (fd);
-      return -1;
-    }
-
-    sent += r;
-    notify_progress (sent, total);
+  /* Holes and zeroes are sent as holes, so that downloading a mostly
+   * empty disk doesn't send all of it.
+   */
+  if (is_dev)
+    r = send_device_sparse (fd, &sent, total);
+  else if (S_ISREG (statbuf.st_mode))
+    r = send_file_extents (fd, &sent, total);
+  else
+    r = send_file_data (fd, &sent, total);
+
+  if (r == -2) {                /* Cancelled by the library. */
+    close (fd);
+    return -1;
   }
 
   if (r == -1) {
@@ -234,14 +572,8 @@ do_download (const char *filename)
 int
 do_download_offset (const char *filename, int64_t offset, int64_t size)
 {
-  int fd, r, is_dev;
-  CLEANUP_FREE char *buf = NULL;
-
-  buf = malloc (GUESTFS_MAX_CHUNK_SIZE);
-  if (buf == NULL) {
-    reply_with_perror ("malloc");
-    return -1;
-  }
+  int fd, is_dev;
+  ssize_t r;
 
   if (offset < 0) {
     reply_with_perror ("%s: offset in file is negative", filename);
@@ -277,6 +609,11 @@ do_download_offset (const char *filename, int64_t offset, int64_t size)
     }
   }
 
+  /* Read ahead, so the next chunk is usually ready by the time the
+   * library has taken the previous one.
+   */
+  posix_fadvise (fd, offset, size, POSIX_FADV_SEQUENTIAL);
+
   uint64_t total = usize, sent = 0;
 
   /* Now we must send the reply message, before the file contents.  After
@@ -286,8 +623,14 @@ do_download_offset (const char *filename, int64_t offset, int64_t size)
   reply (NULL, NULL);
 
   while (usize > 0) {
-    r = read (fd, buf,
-              usize > GUESTFS_MAX_CHUNK_SIZE ? GUESTFS_MAX_CHUNK_SIZE : usize);
+    r = send_file_from_fd (fd,
+                           usize > GUESTFS_MAX_CHUNK_SIZE ?
+                           GUESTFS_MAX_CHUNK_SIZE : usize);
+    if (r == -2) {              /* Cancelled by the library. */
+      close (fd);
+      return -1;
+    }
+
     if (r == -1) {
       fprintf (stderr, "read: %s: %m\n", filename);
       send_file_end (1);        /* Cancel. */
@@ -301,11 +644,6 @@ do_download_offset (const char *filename, int64_t offset, int64_t size)
        */
       break;
 
-    if (send_file_write (buf, r) < 0) {
-      close (fd);
-      return -1;
-    }
-
     sent += r;
     usize -= r;
     notify_progress (sent, total);
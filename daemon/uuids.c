@@ -81,6 +81,8 @@ do_set_uuid (const char *device, const char *uuid)
     NOT_SUPPORTED (-1, "don't know how to set the UUID for '%s' filesystems",
 		   vfs_type);
 
+  blkid_cache_invalidate (device);
+
   return r;
 }
 
@@ -113,5 +115,7 @@ do_set_uuid_random (const char *device)
   else
     NOT_SUPPORTED (-1, "don't know how to set the random UUID for '%s' filesystems",
 		   vfs_type);
+  blkid_cache_invalidate (device);
+
   return r;
 }
@@ -19,8 +19,12 @@
 #include <config.h>
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <limits.h>
 #include <unistd.h>
+#include <fcntl.h>
 
 #include "guestfs_protocol.h"
 #include "daemon.h"
@@ -283,6 +287,19 @@ do_internal_lxattrlist (const char *path, char *const *names)
   size_t i, j;
   size_t k, m, nr_attrs;
   ssize_t len, vlen;
+  int dirfd;
+
+  /* The directory is opened once, and the files are reached through
+   * its /proc/self/fd link, so the path is not looked up again for
+   * every name.
+   */
+  CHROOT_IN;
+  dirfd = open (path, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+  CHROOT_OUT;
+  if (dirfd == -1) {
+    reply_with_perror ("%s", path);
+    return NULL;
+  }
 
   ret = malloc (sizeof (*ret));
   if (ret == NULL) {
@@ -304,11 +321,8 @@ do_internal_lxattrlist (const char *path, char *const *names)
      * outgoing struct list.
      */
 
-    /* XXX This would be easier if the kernel had lgetxattrat.  In the
-     * meantime we use the 'pathname' buffer to store the whole path
-     * name.
-     */
-    if (asprintf (&pathname, "%s/%s", path, names[k]) == -1) {
+    /* XXX This would be easier if the kernel had lgetxattrat. */
+    if (asprintf (&pathname, "/proc/self/fd/%d/%s", dirfd, names[k]) == -1) {
       reply_with_perror ("asprintf");
       goto error;
     }
@@ -336,9 +350,7 @@ do_internal_lxattrlist (const char *path, char *const *names)
       goto error;
     }
 
-    CHROOT_IN;
     len = llistxattr (pathname, NULL, 0);
-    CHROOT_OUT;
     if (len == -1)
       continue; /* not fatal */
 
@@ -348,9 +360,7 @@ do_internal_lxattrlist (const char *path, char *const *names)
       goto error;
     }
 
-    CHROOT_IN;
     len = llistxattr (pathname, buf, len);
-    CHROOT_OUT;
     if (len == -1)
       continue; /* not fatal */
 
@@ -383,9 +393,7 @@ do_internal_lxattrlist (const char *path, char *const *names)
     }
 
     for (i = 0, j = 0; i < (size_t) len; i += strlen (&buf[i]) + 1, ++j) {
-      CHROOT_IN;
       vlen = lgetxattr (pathname, &buf[i], NULL, 0);
-      CHROOT_OUT;
       if (vlen == -1) {
         reply_with_perror ("getxattr");
         goto error;
@@ -406,10 +414,8 @@ do_internal_lxattrlist (const char *path, char *const *names)
         goto error;
       }
 
-      CHROOT_IN;
       vlen = lgetxattr (pathname, &buf[i],
                         entry[j+1].attrval.attrval_val, vlen);
-      CHROOT_OUT;
       if (vlen == -1) {
         reply_with_perror ("getxattr");
         goto error;
@@ -430,9 +436,11 @@ do_internal_lxattrlist (const char *path, char *const *names)
     qsort (&entry[1], nr_attrs, sizeof (guestfs_int_xattr), compare_xattrs);
   }
 
+  close (dirfd);
   return ret;
 
  error:
+  close (dirfd);
   if (ret) {
     if (ret->guestfs_int_xattr_list_val) {
       for (k = 0; k < ret->guestfs_int_xattr_list_len; ++k) {
@@ -572,10 +580,101 @@ copy_xattrs (const char *src, const char *dest)
   return 0;
 }
 
+/**
+ * Get the extended attributes of C<name> in the directory open on
+ * C<dirfd> into C<ret>, sorted and without following symbolic links
+ * as in C<do_lgetxattrs>.
+ *
+ * This is used by C<do_internal_lstatns_tree>, which walks the tree
+ * outside the chroot and after it has replied, so errors are only
+ * printed, and leave the list empty or missing some attributes.
+ * Free the list with C<xdr_free>.
+ */
+void
+lxattrs_at (int dirfd, const char *name, guestfs_int_xattr_list *ret)
+{
+  CLEANUP_FREE char *path = NULL, *buf = NULL;
+  ssize_t len, vlen;
+  size_t i, n;
+
+  ret->guestfs_int_xattr_list_len = 0;
+  ret->guestfs_int_xattr_list_val = NULL;
+
+  /* There is no llistxattrat, but the /proc/self/fd link gets to the
+   * directory without looking up its path again.
+   */
+  if (asprintf (&path, "/proc/self/fd/%d/%s", dirfd, name) == -1) {
+    perror ("asprintf");
+    return;
+  }
+
+  len = llistxattr (path, NULL, 0);
+  if (len <= 0) {
+    if (len == -1 && errno != ENOTSUP)
+      perror (path);
+    return;
+  }
+  buf = malloc (len);
+  if (buf == NULL) {
+    perror ("malloc");
+    return;
+  }
+  len = llistxattr (path, buf, len);
+  if (len == -1) {
+    perror (path);
+    return;
+  }
+
+  for (i = 0, n = 0; i < (size_t) len; i += strlen (&buf[i]) + 1)
+    n++;
+  ret->guestfs_int_xattr_list_val = calloc (n, sizeof (guestfs_int_xattr));
+  if (ret->guestfs_int_xattr_list_val == NULL) {
+    perror ("calloc");
+    return;
+  }
+
+  for (i = 0; i < (size_t) len; i += strlen (&buf[i]) + 1) {
+    guestfs_int_xattr *x =
+      &ret->guestfs_int_xattr_list_val[ret->guestfs_int_xattr_list_len];
+
+    vlen = lgetxattr (path, &buf[i], NULL, 0);
+    if (vlen == -1 || vlen > XATTR_SIZE_MAX)
+      continue;
+    x->attrname = strdup (&buf[i]);
+    x->attrval.attrval_val = malloc (vlen);
+    if (x->attrname == NULL || x->attrval.attrval_val == NULL) {
+      perror ("malloc");
+      free (x->attrname);
+      free (x->attrval.attrval_val);
+      break;
+    }
+    vlen = lgetxattr (path, &buf[i], x->attrval.attrval_val, vlen);
+    if (vlen == -1) {
+      free (x->attrname);
+      free (x->attrval.attrval_val);
+      continue;
+    }
+    x->attrval.attrval_len = vlen;
+    ret->guestfs_int_xattr_list_len++;
+  }
+
+  qsort (ret->guestfs_int_xattr_list_val,
+         (size_t) ret->guestfs_int_xattr_list_len,
+         sizeof (guestfs_int_xattr),
+         compare_xattrs);
+}
+
 #else /* no HAVE_LINUX_XATTRS */
 
 OPTGROUP_LINUXXATTRS_NOT_AVAILABLE
 
+void
+lxattrs_at (int dirfd, const char *name, guestfs_int_xattr_list *ret)
+{
+  ret->guestfs_int_xattr_list_len = 0;
+  ret->guestfs_int_xattr_list_val = NULL;
+}
+
 int
 copy_xattrs (const char *src, const char *dest)
 {
@@ -537,6 +537,8 @@ do_xfs_admin (const char *device,
   ADD_ARG (argv, i, device);
   ADD_ARG (argv, i, NULL);
 
+  blkid_cache_invalidate (device);
+
   r = commandvf (NULL, &err, COMMAND_FLAG_FOLD_STDOUT_ON_STDERR, argv);
   if (r == -1) {
     reply_with_error ("%s: %s", device, err);
@@ -24,7 +24,21 @@
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
 #include <sys/statvfs.h>
+#include <sys/vfs.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/sysmacros.h>
+#include <pthread.h>
+
+#ifdef HAVE_LINUX_FS_H
+#include <linux/fs.h>
+#endif
+
+#ifdef HAVE_LINUX_FIEMAP_H
+#include <linux/fiemap.h>
+#endif
 
 #include "ignore-value.h"
 
@@ -43,6 +57,8 @@ do_zero (const char *device)
   int fd;
   size_t i, offset;
 
+  blkid_cache_invalidate (device);
+
   fd = open (device, O_RDWR|O_CLOEXEC);
   if (fd == -1) {
     reply_with_perror ("%s", device);
@@ -125,6 +141,8 @@ do_wipefs (const char *device)
   ADD_ARG (argv, i, device);
   ADD_ARG (argv, i, NULL);
 
+  blkid_cache_invalidate (device);
+
   r = commandv (NULL, &err, argv);
   if (r == -1) {
     reply_with_error ("%s", err);
@@ -134,6 +152,215 @@ do_wipefs (const char *device)
   return 0;
 }
 
+/* Write zeroes over the parts of 'buf' (read from 'pos') which are
+ * not already zero, in units of 'zero_buf', so that blocks which are
+ * already zero are not allocated on thin provisioned devices.
+ */
+static int
+zero_nonzero_blocks (int fd, const char *device,
+                     const char *buf, size_t len, uint64_t pos,
+                     const char *zeroes)
+{
+  size_t i = 0, j, n;
+
+  while (i < len) {
+    /* Skip zero blocks. */
+    n = len - i < sizeof zero_buf ? len - i : sizeof zero_buf;
+    if (is_zero (&buf[i], n)) {
+      i += n;
+      continue;
+    }
+
+    /* Find the end of the run of non-zero blocks. */
+    for (j = i + n; j < len; j += n) {
+      n = len - j < sizeof zero_buf ? len - j : sizeof zero_buf;
+      if (is_zero (&buf[j], n))
+        break;
+    }
+
+    if (pwrite (fd, zeroes, j - i, pos + i) != (ssize_t) (j - i)) {
+      reply_with_perror ("pwrite: %s at offset %" PRIu64, device, pos + i);
+      return -1;
+    }
+    i = j;
+  }
+
+  return 0;
+}
+
+/* Size of each request when zeroing a device using the kernel, so
+ * that progress messages are still sent for large devices.
+ */
+#define ZERO_CHUNK_SIZE (1024 * 1024 * 1024)
+
+/* Ways of asking the kernel (and so qemu) to zero part of a device,
+ * in the order they are tried.
+ */
+enum zero_method {
+  ZERO_PUNCH_HOLE,   /* fallocate: unmap, fails if it cannot zero cheaply */
+  ZERO_BLKZEROOUT,   /* WRITE ZEROES / WRITE SAME */
+  ZERO_BLKDISCARD,   /* only if discarded blocks read as zeroes */
+  ZERO_NO_METHOD
+};
+
+/* Return true if the device has a real "write zeroes" command.
+ * Otherwise the kernel implements BLKZEROOUT by writing zero pages,
+ * which would allocate every block on a thin provisioned device.
+ * The sysfs queue directory of a partition is the one of its parent.
+ */
+static int
+has_write_zeroes (int fd)
+{
+  struct stat statbuf;
+  CLEANUP_FREE char *path = NULL;
+  FILE *fp;
+  uint64_t max_bytes = 0;
+
+  if (fstat (fd, &statbuf) == -1 || !S_ISBLK (statbuf.st_mode))
+    return 0;
+
+  if (asprintf (&path, "/sys/dev/block/%u:%u/queue/write_zeroes_max_bytes",
+                major (statbuf.st_rdev), minor (statbuf.st_rdev)) == -1)
+    return 0;
+  fp = fopen (path, "r");
+  if (fp == NULL) {
+    free (path);
+    if (asprintf (&path,
+                  "/sys/dev/block/%u:%u/../queue/write_zeroes_max_bytes",
+                  major (statbuf.st_rdev), minor (statbuf.st_rdev)) == -1) {
+      path = NULL;
+      return 0;
+    }
+    fp = fopen (path, "r");
+    if (fp == NULL)
+      return 0;
+  }
+  if (fscanf (fp, "%" SCNu64, &max_bytes) != 1)
+    max_bytes = 0;
+  fclose (fp);
+
+  return max_bytes > 0;
+}
+
+/* Return true if the method might work on this device. */
+static int
+zero_method_possible (int fd, enum zero_method method)
+{
+  switch (method) {
+  case ZERO_PUNCH_HOLE:
+#ifdef FALLOC_FL_PUNCH_HOLE
+    return 1;
+#else
+    return 0;
+#endif
+
+  case ZERO_BLKZEROOUT:
+#ifdef BLKZEROOUT
+    return has_write_zeroes (fd);
+#else
+    return 0;
+#endif
+
+  case ZERO_BLKDISCARD:
+#if defined(BLKDISCARD) && defined(BLKDISCARDZEROES)
+    {
+      unsigned int arg;
+
+      return ioctl (fd, BLKDISCARDZEROES, &arg) == 0 && arg != 0;
+    }
+#else
+    return 0;
+#endif
+
+  case ZERO_NO_METHOD: ;
+  }
+
+  return 0;
+}
+
+static int
+zero_range (int fd, enum zero_method method, uint64_t offset, uint64_t len)
+{
+  uint64_t range[2] = { offset, len };
+
+  switch (method) {
+  case ZERO_PUNCH_HOLE:
+#ifdef FALLOC_FL_PUNCH_HOLE
+    return fallocate (fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,
+                      offset, len);
+#else
+    break;
+#endif
+
+  case ZERO_BLKZEROOUT:
+#ifdef BLKZEROOUT
+    return ioctl (fd, BLKZEROOUT, range);
+#else
+    break;
+#endif
+
+  case ZERO_BLKDISCARD:
+#ifdef BLKDISCARD
+    return ioctl (fd, BLKDISCARD, range);
+#else
+    break;
+#endif
+
+  case ZERO_NO_METHOD: ;
+  }
+
+  errno = EOPNOTSUPP;
+  return -1;
+}
+
+/* Zero the device from '*pos' to 'size' without writing zero pages,
+ * updating '*pos'.  Returns 0 if the whole device was zeroed, 1 if
+ * none of the methods are supported from '*pos' onwards, or -1 on
+ * error (with errno set, and no reply sent, so that this can be
+ * called from other threads).  Progress messages are only sent if
+ * 'notify' is true.
+ */
+static int
+zero_device_in_kernel (int fd, const char *device,
+                       uint64_t *pos, uint64_t size, int notify)
+{
+  enum zero_method method = 0;
+
+  while (method < ZERO_NO_METHOD && !zero_method_possible (fd, method))
+    method++;
+
+  while (*pos < size && method < ZERO_NO_METHOD) {
+    uint64_t n = size - *pos;
+    if (n > ZERO_CHUNK_SIZE)
+      n = ZERO_CHUNK_SIZE;
+
+    if (call_cancelled ()) {
+      errno = EINTR;
+      return -1;
+    }
+
+    if (zero_range (fd, method, *pos, n) == -1) {
+      if (errno != EOPNOTSUPP && errno != ENOTTY && errno != EINVAL &&
+          errno != ENODEV)
+        return -1;
+      /* Try the next method from the same offset. */
+      if (verbose)
+        fprintf (stderr, "%s: zeroing method %d not supported: %m\n",
+                 device, (int) method);
+      do
+        method++;
+      while (method < ZERO_NO_METHOD && !zero_method_possible (fd, method));
+      continue;
+    }
+    *pos += n;
+
+    if (notify)
+      notify_progress (*pos, size);
+  }
+
+  return *pos < size ? 1 : 0;
+}
+
 int
 do_zero_device (const char *device)
 {
@@ -141,6 +368,16 @@ do_zero_device (const char *device)
   if (ssize == -1)
     return -1;
   uint64_t size = (uint64_t) ssize;
+  CLEANUP_FREE char *buf = NULL, *zeroes = NULL;
+
+  buf = malloc (COPY_BUFFER_SIZE);
+  zeroes = calloc (1, COPY_BUFFER_SIZE);
+  if (buf == NULL || zeroes == NULL) {
+    reply_with_perror ("malloc");
+    return -1;
+  }
+
+  blkid_cache_invalidate (device);
 
   int fd = open (device, O_RDWR|O_CLOEXEC);
   if (fd == -1) {
@@ -148,19 +385,41 @@ do_zero_device (const char *device)
     return -1;
   }
 
-  char buf[sizeof zero_buf];
-
   uint64_t pos = 0;
 
+  /* Let the kernel zero the device if it can do it without writing
+   * zero pages, and only fall back to reading the device if not.
+   */
+  switch (zero_device_in_kernel (fd, device, &pos, size, 1)) {
+  case -1:
+    reply_with_perror ("%s: zero at offset %" PRIu64, device, pos);
+    close (fd);
+    return -1;
+  case 0:
+    break;
+  case 1:
+    if (verbose)
+      fprintf (stderr, "%s: zeroing by writing from offset %" PRIu64 "\n",
+               device, pos);
+    break;
+  }
+
   while (pos < size) {
     uint64_t n64 = size - pos;
     size_t n;
-    if (n64 > sizeof buf)
-      n = sizeof buf;
+    if (n64 > COPY_BUFFER_SIZE)
+      n = COPY_BUFFER_SIZE;
     else
       n = (size_t) n64; /* safe because of if condition */
 
-    /* Check if the block is already zero before overwriting it. */
+    if (call_cancelled ()) {
+      reply_with_error_errno (EINTR, "%s: operation cancelled by user",
+                              device);
+      close (fd);
+      return -1;
+    }
+
+    /* Check which blocks are already zero before overwriting them. */
     ssize_t r;
     r = pread (fd, buf, n, pos);
     if (r == -1) {
@@ -168,19 +427,18 @@ do_zero_device (const char *device)
       close (fd);
       return -1;
     }
+    if (r == 0) {
+      reply_with_error ("%s: unexpected end of device at offset %" PRIu64,
+                        device, pos);
+      close (fd);
+      return -1;
+    }
 
-    if (!is_zero (buf, sizeof buf)) {
-      r = pwrite (fd, zero_buf, n, pos);
-      if (r == -1) {
-        reply_with_perror ("pwrite: %s (with %" PRIu64 " bytes left to write)",
-                           device, size);
-        close (fd);
-        return -1;
-      }
-      pos += r;
+    if (zero_nonzero_blocks (fd, device, buf, r, pos, zeroes) == -1) {
+      close (fd);
+      return -1;
     }
-    else
-      pos += n;
+    pos += r;
 
     notify_progress (pos, size);
   }
@@ -193,6 +451,173 @@ do_zero_device (const char *device)
   return 0;
 }
 
+/* For zero_devices: one thread per device zeroes it in the kernel,
+ * while the main thread sends progress messages for all of them.
+ */
+struct zero_job {
+  const char *device;
+  int fd;
+  uint64_t size;
+  pthread_t thread;
+  int started;
+  /* The fields below are protected by zero_jobs_lock. */
+  uint64_t pos;
+  int done;
+  int r;                        /* as for zero_device_in_kernel */
+  int err;                      /* errno if r == -1 */
+};
+
+static pthread_mutex_t zero_jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t zero_jobs_cond = PTHREAD_COND_INITIALIZER;
+
+static void *
+zero_device_thread (void *jobv)
+{
+  struct zero_job *job = jobv;
+  uint64_t pos = 0, end;
+  int r = 0, err = 0;
+
+  while (pos < job->size) {
+    end = job->size - pos > ZERO_CHUNK_SIZE ? pos + ZERO_CHUNK_SIZE : job->size;
+    r = zero_device_in_kernel (job->fd, job->device, &pos, end, 0);
+    if (r == -1)
+      err = errno;
+    if (r != 0)
+      break;
+
+    pthread_mutex_lock (&zero_jobs_lock);
+    job->pos = pos;
+    pthread_mutex_unlock (&zero_jobs_lock);
+  }
+
+  if (verbose)
+    fprintf (stderr, "%s: zeroed %" PRIu64 " of %" PRIu64 " bytes in the kernel\n",
+             job->device, pos, job->size);
+
+  pthread_mutex_lock (&zero_jobs_lock);
+  job->pos = pos;
+  job->r = r;
+  job->err = err;
+  job->done = 1;
+  pthread_cond_signal (&zero_jobs_cond);
+  pthread_mutex_unlock (&zero_jobs_lock);
+
+  return NULL;
+}
+
+int
+do_zero_devices (char *const *devices)
+{
+  const size_t n = count_strings (devices);
+  CLEANUP_FREE struct zero_job *jobs = NULL;
+  uint64_t total = 0, pos;
+  size_t i, nr_done;
+  struct timespec ts;
+  int ret = -1, err;
+
+  jobs = calloc (n, sizeof *jobs);
+  if (jobs == NULL) {
+    reply_with_perror ("calloc");
+    return -1;
+  }
+
+  for (i = 0; i < n; ++i) {
+    const int64_t size = do_blockdev_getsize64 (devices[i]);
+    if (size == -1)
+      goto out;
+    jobs[i].device = devices[i];
+    jobs[i].size = size;
+    jobs[i].fd = -1;
+    total += size;
+  }
+
+  for (i = 0; i < n; ++i) {
+    blkid_cache_invalidate (devices[i]);
+    jobs[i].fd = open (devices[i], O_RDWR|O_CLOEXEC);
+    if (jobs[i].fd == -1) {
+      reply_with_perror ("%s", devices[i]);
+      goto out;
+    }
+  }
+
+  for (i = 0; i < n; ++i) {
+    err = pthread_create (&jobs[i].thread, NULL, zero_device_thread, &jobs[i]);
+    if (err == 0)
+      jobs[i].started = 1;
+    else {
+      /* Zero this one afterwards, in this thread. */
+      jobs[i].done = 1;
+      jobs[i].r = 1;
+    }
+  }
+
+  /* Wait for the threads, sending progress messages as we go. */
+  pthread_mutex_lock (&zero_jobs_lock);
+  for (;;) {
+    nr_done = 0;
+    pos = 0;
+    for (i = 0; i < n; ++i) {
+      if (jobs[i].done)
+        nr_done++;
+      pos += jobs[i].pos;
+    }
+    if (nr_done == n)
+      break;
+
+    pthread_mutex_unlock (&zero_jobs_lock);
+    notify_progress (pos, total);
+    /* The threads see this too, and stop early. */
+    call_cancelled ();
+    pthread_mutex_lock (&zero_jobs_lock);
+
+    clock_gettime (CLOCK_REALTIME, &ts);
+    ts.tv_nsec += 100000000;
+    if (ts.tv_nsec >= 1000000000) {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait (&zero_jobs_cond, &zero_jobs_lock, &ts);
+  }
+  pthread_mutex_unlock (&zero_jobs_lock);
+
+  for (i = 0; i < n; ++i) {
+    if (jobs[i].started)
+      pthread_join (jobs[i].thread, NULL);
+  }
+
+  for (i = 0; i < n; ++i) {
+    if (jobs[i].r == -1) {
+      reply_with_error_errno (jobs[i].err,
+                              "%s: zero at offset %" PRIu64 ": %s",
+                              jobs[i].device, jobs[i].pos,
+                              strerror (jobs[i].err));
+      goto out;
+    }
+  }
+
+  /* The devices which the kernel could not zero are done one at a
+   * time, by reading them and writing zeroes where needed.
+   */
+  for (i = 0; i < n; ++i) {
+    if (jobs[i].r == 1) {
+      if (do_zero_device (jobs[i].device) == -1)
+        goto out;
+    }
+  }
+
+  notify_progress (total, total);
+  ret = 0;
+
+ out:
+  for (i = 0; i < n; ++i) {
+    if (jobs[i].fd >= 0 && close (jobs[i].fd) == -1 && ret == 0) {
+      reply_with_perror ("close: %s", jobs[i].device);
+      ret = -1;
+    }
+  }
+  return ret;
+}
+
 int
 do_is_zero (const char *path)
 {
@@ -200,7 +625,7 @@ do_is_zero (const char *path)
   CLEANUP_FREE char *buf = NULL;
   ssize_t r;
 
-  buf = malloc (BUFSIZ);
+  buf = malloc (COPY_BUFFER_SIZE);
   if (buf == NULL) {
     reply_with_perror ("malloc");
     return -1;
@@ -215,7 +640,7 @@ do_is_zero (const char *path)
     return -1;
   }
 
-  while ((r = read (fd, buf, BUFSIZ)) > 0) {
+  while ((r = read (fd, buf, COPY_BUFFER_SIZE)) > 0) {
     if (!is_zero (buf, r)) {
       close (fd);
       return 0;
@@ -243,7 +668,7 @@ do_is_zero_device (const char *device)
   CLEANUP_FREE char *buf = NULL;
   ssize_t r;
 
-  buf = malloc (BUFSIZ);
+  buf = malloc (COPY_BUFFER_SIZE);
   if (buf == NULL) {
     reply_with_perror ("malloc");
     return -1;
@@ -255,7 +680,7 @@ do_is_zero_device (const char *device)
     return -1;
   }
 
-  while ((r = read (fd, buf, BUFSIZ)) > 0) {
+  while ((r = read (fd, buf, COPY_BUFFER_SIZE)) > 0) {
     if (!is_zero (buf, r)) {
       close (fd);
       return 0;
@@ -276,9 +701,196 @@ do_is_zero_device (const char *device)
   return 1;
 }
 
-/* Current implementation is to create a file of all zeroes, then
- * delete it.  The description of this function is left open in order
- * to allow better implementations in future, including
+#if defined(HAVE_LINUX_FIEMAP_H) && defined(FS_IOC_FIEMAP)
+
+/* Number of extents fetched by each FIEMAP ioctl. */
+#define FIEMAP_BATCH 512
+
+/* Filesystems where the physical offsets returned by FIEMAP are
+ * offsets in the (single) device the filesystem is mounted from.
+ */
+#define EXT4_SUPER_MAGIC 0xEF53 /* also ext2 and ext3 */
+#define XFS_SUPER_MAGIC 0x58465342
+
+/* Open the block device 'dev' read-write.  Returns -1 if this is not
+ * possible, without replying.
+ */
+static int
+open_block_device (dev_t dev, char **device_ret)
+{
+  char sysdir[64];
+  CLEANUP_FREE char *path = NULL;
+  char *p;
+  int fd;
+
+  snprintf (sysdir, sizeof sysdir, "/sys/dev/block/%u:%u",
+            major (dev), minor (dev));
+  path = realpath (sysdir, NULL);
+  if (path == NULL)
+    return -1;
+  p = strrchr (path, '/');
+  if (p == NULL || asprintf (device_ret, "/dev/%s", p+1) == -1)
+    return -1;
+
+  fd = open (*device_ret, O_RDWR|O_CLOEXEC);
+  if (fd == -1) {
+    free (*device_ret);
+    *device_ret = NULL;
+  }
+  return fd;
+}
+
+/* Zero the free space of the filesystem that 'fd' (an empty file
+ * which will be deleted afterwards) is on, without writing zero
+ * pages.  The free space is allocated to the file as unwritten
+ * extents with fallocate, which is quick, then FIEMAP tells where
+ * they are on the device, and these ranges of the device are zeroed
+ * using the first of the zero_methods the device supports (punch
+ * hole, WRITE ZEROES or discard).  Nothing in the filesystem reads
+ * them, since unwritten extents read as zeroes anyway.
+ *
+ * Returns 0 if the free space was zeroed, 1 if it could not be done
+ * this way (the caller falls back to writing zeroes), or -1 on error
+ * (with the reply already sent).
+ */
+static int
+zero_free_space_in_kernel (int fd, const char *filename)
+{
+  struct statfs statfsbuf;
+  struct stat statbuf;
+  CLEANUP_FREE char *device = NULL;
+  CLEANUP_FREE struct fiemap *fm = NULL;
+  enum zero_method method = 0;
+  uint64_t chunk = ZERO_CHUNK_SIZE, size = 0, zeroed = 0, start = 0;
+  int dev_fd, last = 0;
+  size_t i;
+
+  if (fstatfs (fd, &statfsbuf) == -1 ||
+      (statfsbuf.f_type != EXT4_SUPER_MAGIC &&
+       statfsbuf.f_type != XFS_SUPER_MAGIC))
+    return 1;
+  if (fstat (fd, &statbuf) == -1)
+    return 1;
+
+  dev_fd = open_block_device (statbuf.st_dev, &device);
+  if (dev_fd == -1)
+    return 1;
+
+  /* Only methods which zero the device without writing to it are
+   * worth it; otherwise writing the file is just as good.
+   */
+  while (method < ZERO_NO_METHOD && !zero_method_possible (dev_fd, method))
+    method++;
+  if (method == ZERO_NO_METHOD)
+    goto not_possible;
+
+  /* Allocate all the free space to the file, in smaller pieces as the
+   * filesystem fills up.
+   */
+  while (chunk >= (uint64_t) statbuf.st_blksize) {
+    if (fallocate (fd, 0, size, chunk) == 0) {
+      size += chunk;
+      continue;
+    }
+    if (errno == EOPNOTSUPP || errno == ENOSYS) /* eg. ext2, ext3 */
+      goto not_possible;
+    if (errno != ENOSPC) {
+      reply_with_perror ("fallocate: %s", filename);
+      goto error;
+    }
+    chunk /= 2;
+  }
+
+  fm = malloc (sizeof *fm + FIEMAP_BATCH * sizeof (struct fiemap_extent));
+  if (fm == NULL) {
+    reply_with_perror ("malloc");
+    goto error;
+  }
+
+  while (!last) {
+    memset (fm, 0, sizeof *fm);
+    fm->fm_start = start;
+    fm->fm_length = FIEMAP_MAX_OFFSET - start;
+    fm->fm_flags = FIEMAP_FLAG_SYNC;
+    fm->fm_extent_count = FIEMAP_BATCH;
+
+    if (ioctl (fd, FS_IOC_FIEMAP, fm) == -1) {
+      reply_with_perror ("%s: FIEMAP", filename);
+      goto error;
+    }
+    if (fm->fm_mapped_extents == 0)
+      break;
+
+    for (i = 0; i < fm->fm_mapped_extents; ++i) {
+      const struct fiemap_extent *fe = &fm->fm_extents[i];
+      uint64_t pos = fe->fe_physical, end = pos + fe->fe_length;
+
+      if (fe->fe_flags & (FIEMAP_EXTENT_UNKNOWN|FIEMAP_EXTENT_ENCODED|
+                          FIEMAP_EXTENT_NOT_ALIGNED|
+                          FIEMAP_EXTENT_DATA_INLINE)) {
+        /* The caller writes zeroes to the rest. */
+        if (verbose)
+          fprintf (stderr, "%s: extent flags 0x%x, not zeroing in kernel\n",
+                   filename, fe->fe_flags);
+        goto not_possible;
+      }
+
+      while (pos < end) {
+        const uint64_t n = MIN (end - pos, ZERO_CHUNK_SIZE);
+
+        if (zero_range (dev_fd, method, pos, n) == -1) {
+          if (errno == EOPNOTSUPP || errno == ENOTTY || errno == EINVAL ||
+              errno == ENODEV)
+            goto not_possible;
+          reply_with_perror ("%s: zero %" PRIu64 " bytes at offset %" PRIu64,
+                             device, n, pos);
+          goto error;
+        }
+        pos += n;
+        zeroed += n;
+        notify_progress (MIN (zeroed, size), size);
+      }
+
+      if (fe->fe_flags & FIEMAP_EXTENT_LAST)
+        last = 1;
+      start = fe->fe_logical + fe->fe_length;
+    }
+  }
+
+  if (close (dev_fd) == -1) {
+    reply_with_perror ("close: %s", device);
+    return -1;
+  }
+  return 0;
+
+ not_possible:
+  close (dev_fd);
+  /* Give the space back for the fallback. */
+  if (ftruncate (fd, 0) == -1) {
+    reply_with_perror ("ftruncate: %s", filename);
+    return -1;
+  }
+  return 1;
+
+ error:
+  close (dev_fd);
+  return -1;
+}
+
+#else /* !FS_IOC_FIEMAP */
+
+static int
+zero_free_space_in_kernel (int fd, const char *filename)
+{
+  return 1;
+}
+
+#endif /* !FS_IOC_FIEMAP */
+
+/* Zero the free space in the kernel if possible (see
+ * zero_free_space_in_kernel), otherwise create a file of all zeroes,
+ * then delete it.  The description of this function is left open in
+ * order to allow better implementations in future, including
  * sparsification.
  */
 /* XXX This function really should be cancellable (for the benefit of
@@ -327,6 +939,20 @@ do_zero_free_space (const char *dir)
   }
   bfree_initial = statbuf.f_bfree;
 
+  switch (zero_free_space_in_kernel (fd, filename)) {
+  case -1:
+    close (fd);
+    unlink (filename);
+    return -1;
+  case 0:
+    close (fd);
+    goto out;
+  case 1:
+    if (verbose)
+      fprintf (stderr, "%s: zeroing free space by writing\n", dir);
+    break;
+  }
+
   for (;;) {
     if (write (fd, zero_buf, sizeof zero_buf) == -1) {
       if (errno == ENOSPC)      /* expected error */
@@ -349,6 +975,7 @@ do_zero_free_space (const char *dir)
 
   notify_progress (bfree_initial, bfree_initial);
 
+ out:
   /* Remove the file. */
   if (unlink (filename) == -1) {
     reply_with_perror ("unlink: %s", filename);
@@ -375,6 +1002,8 @@ wipe_device_before_mkfs (const char *device)
   const char *argv[MAX_ARGS];
   size_t i = 0;
 
+  blkid_cache_invalidate (device);
+
   force = wipefs_has_force_option ();
   if (force == -1)
     return;
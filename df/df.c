@@ -63,12 +63,15 @@ df_on_handle (guestfs_h *g, const char *name, const char *uuid, FILE *fp)
       if (verbose)
         fprintf (stderr, "df_on_handle: %s dev %s\n", name, dev);
 
-      /* Try mounting and stating the device.  This might reasonably
-       * fail, so don't show errors.
+      /* Try reading the statistics from the superblock, which is
+       * much quicker than mounting the filesystem.  If that is not
+       * supported for this filesystem, try mounting and stating the
+       * device.  This might reasonably fail, so don't show errors.
        */
       guestfs_push_error_handler (g, NULL, NULL);
 
-      if (guestfs_mount_ro (g, dev, "/") == 0) {
+      stat = guestfs_vfs_statvfs (g, dev);
+      if (stat == NULL && guestfs_mount_ro (g, dev, "/") == 0) {
         stat = guestfs_statvfs (g, "/");
         guestfs_umount_all (g);
       }
@@ -94,19 +97,11 @@ df_on_handle (guestfs_h *g, const char *name, const char *uuid, FILE *fp)
 int
 df_work (guestfs_h *g, size_t i, FILE *fp)
 {
-  struct guestfs_add_libvirt_dom_argv optargs;
-
-  optargs.bitmask =
-    GUESTFS_ADD_LIBVIRT_DOM_READONLY_BITMASK |
-    GUESTFS_ADD_LIBVIRT_DOM_READONLYDISK_BITMASK;
-  optargs.readonly = 1;
-  optargs.readonlydisk = "read";
-
   /* Traditionally we have ignored errors from adding disks in virt-df. */
-  if (guestfs_add_libvirt_dom_argv (g, domains[i].dom, &optargs) == -1)
+  if (add_domain_disks (g, i) == -1)
     return 0;
 
-  if (guestfs_launch (g) == -1)
+  if (launch_domain_handle (g) == -1)
     return -1;
 
   return df_on_handle (g, domains[i].name, domains[i].uuid, fp);
@@ -21,63 +21,104 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <error.h>
-#include <errno.h>
+#include <unistd.h>
 #include <libintl.h>
 
 #include "guestfs.h"
 #include "guestfs-internal-frontend.h"
 #include "estimate-max-threads.h"
 
-static char *read_line_from (const char *cmd);
+/* Memory used by each appliance on top of its RAM: the qemu process
+ * itself, its page tables and I/O buffers, and the qcow2 overlays of
+ * the (read-only) guest disks, which live in $TMPDIR and so may be in
+ * memory too.
+ */
+#define OVERHEAD_MBYTES_PER_THREAD 150
 
-/* The actual overhead is likely much smaller than this, but err on
- * the safe side.
+/* Each appliance has one vCPU, which is idle while it waits for the
+ * disks, so run a couple of them per host CPU.
  */
-#define MBYTES_PER_THREAD 650
+#define THREADS_PER_CPU 2
+
+static int get_available_mbytes (size_t *mbytes);
 
 /**
- * This function uses the output of C<free -m> to estimate how many
- * libguestfs appliances could be safely started in parallel.  Note
- * that it always returns E<ge> 1.
+ * This function estimates how many libguestfs appliances could be
+ * safely and usefully started in parallel, from the memory available
+ * on the host (see L<proc(5)>), the memory size of each appliance
+ * (L<guestfs(3)/guestfs_get_memsize> of C<g>, or of a new handle if
+ * C<g> is C<NULL>) and the number of online CPUs.  Note that it
+ * always returns E<ge> 1.
  */
 size_t
-estimate_max_threads (void)
+estimate_max_threads (guestfs_h *g)
 {
-  CLEANUP_FREE char *mbytes_str = NULL;
-  size_t mbytes;
+  size_t mbytes, mbytes_per_thread, threads;
+  int memsize;
+  long cpus;
 
-  /* Choose the number of threads based on the amount of free memory. */
-  mbytes_str = read_line_from ("LANG=C free -m | "
-                               "grep '^Mem' | awk '{print $4+$6+$7}'");
-  if (mbytes_str == NULL)
+  if (get_available_mbytes (&mbytes) == -1)
     return 1;
 
-  if (sscanf (mbytes_str, "%zu", &mbytes) != 1)
+  if (g != NULL)
+    memsize = guestfs_get_memsize (g);
+  else {
+    /* A new handle picks up $LIBGUESTFS_MEMSIZE. */
+    guestfs_h *g2 = guestfs_create ();
+    if (g2 == NULL)
+      return 1;
+    memsize = guestfs_get_memsize (g2);
+    guestfs_close (g2);
+  }
+  if (memsize <= 0)
     return 1;
 
-  return MAX (1, mbytes / MBYTES_PER_THREAD);
+  mbytes_per_thread = memsize + OVERHEAD_MBYTES_PER_THREAD;
+  threads = mbytes / mbytes_per_thread;
+
+  /* More appliances than the CPUs can run just slow each other down. */
+  cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  if (cpus > 0)
+    threads = MIN (threads, (size_t) cpus * THREADS_PER_CPU);
+
+  return MAX (1, threads);
 }
 
 /**
- * Run external command and read the first line of output.
+ * Read the memory which is available for new processes without
+ * swapping from F</proc/meminfo>.  Before Linux 3.14 there is no
+ * C<MemAvailable> field, so it is approximated as free memory plus
+ * the page cache.
  */
-static char *
-read_line_from (const char *cmd)
+static int
+get_available_mbytes (size_t *mbytes)
 {
-  FILE *pp;
-  char *ret = NULL;
-  size_t allocsize = 0;
+  FILE *fp;
+  char line[256];
+  unsigned long long kb, available = 0, memfree = 0, buffers = 0, cached = 0;
+  int have_available = 0;
 
-  pp = popen (cmd, "r");
-  if (pp == NULL)
-    error (EXIT_FAILURE, errno, "%s: external command failed", cmd);
+  fp = fopen ("/proc/meminfo", "r");
+  if (fp == NULL)
+    return -1;
 
-  if (getline (&ret, &allocsize, pp) == -1)
-    error (EXIT_FAILURE, errno, "could not read line from external command");
+  while (fgets (line, sizeof line, fp) != NULL) {
+    if (sscanf (line, "MemAvailable: %llu kB", &kb) == 1) {
+      available = kb;
+      have_available = 1;
+    }
+    else if (sscanf (line, "MemFree: %llu kB", &kb) == 1)
+      memfree = kb;
+    else if (sscanf (line, "Buffers: %llu kB", &kb) == 1)
+      buffers = kb;
+    else if (sscanf (line, "Cached: %llu kB", &kb) == 1)
+      cached = kb;
+  }
+  fclose (fp);
 
-  if (pclose (pp) == -1)
-    error (EXIT_FAILURE, errno, "pclose");
+  if (!have_available)
+    available = memfree + buffers + cached;
 
-  return ret;
+  *mbytes = available / 1024;
+  return 0;
 }
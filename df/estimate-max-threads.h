@@ -19,6 +19,6 @@
 #ifndef GUESTFS_ESTIMATE_MAX_THREADS_H_
 #define GUESTFS_ESTIMATE_MAX_THREADS_H_
 
-extern size_t estimate_max_threads (void);
+extern size_t estimate_max_threads (guestfs_h *g);
 
 #endif /* GUESTFS_ESTIMATE_MAX_THREADS_H_ */
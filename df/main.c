@@ -61,6 +61,9 @@ int human = 0;                  /* --human-readable|-h */
 int inodes = 0;                 /* --inodes */
 int uuid = 0;                   /* --uuid */
 
+static int unordered = 0;       /* --unordered */
+static unsigned timeout = 0;    /* --timeout */
+
 static char *make_display_name (struct drv *drvs);
 
 static void __attribute__((noreturn))
@@ -86,6 +89,9 @@ usage (int status)
               "  -i|--inodes          Display inodes\n"
               "  --one-per-guest      Separate appliance per guest\n"
               "  -P nr_threads        Use at most nr_threads\n"
+              "  --sizing type        Size the appliance automatically\n"
+              "  --timeout secs       Give up on a guest after secs seconds\n"
+              "  --unordered          Print each guest as soon as it is done\n"
               "  --uuid               Print UUIDs instead of names\n"
               "  -v|--verbose         Verbose messages\n"
               "  -V|--version         Display version and exit\n"
@@ -119,6 +125,9 @@ main (int argc, char *argv[])
     { "long-options", 0, 0, 0 },
     { "one-per-guest", 0, 0, 0 },
     { "short-options", 0, 0, 0 },
+    { "sizing", 1, 0, 0 },
+    { "timeout", 1, 0, 0 },
+    { "unordered", 0, 0, 0 },
     { "uuid", 0, 0, 0 },
     { "verbose", 0, 0, 'v' },
     { "version", 0, 0, 'V' },
@@ -149,10 +158,17 @@ main (int argc, char *argv[])
         display_short_options (options);
       else if (STREQ (long_options[option_index].name, "format")) {
         OPTION_format;
+      } else if (STREQ (long_options[option_index].name, "sizing")) {
+        OPTION_sizing;
       } else if (STREQ (long_options[option_index].name, "csv")) {
         csv = 1;
       } else if (STREQ (long_options[option_index].name, "one-per-guest")) {
         /* nothing - left for backwards compatibility */
+      } else if (STREQ (long_options[option_index].name, "timeout")) {
+        if (sscanf (optarg, "%u", &timeout) != 1)
+          error (EXIT_FAILURE, 0, _("--timeout option is not numeric"));
+      } else if (STREQ (long_options[option_index].name, "unordered")) {
+        unordered = 1;
       } else if (STREQ (long_options[option_index].name, "uuid")) {
         uuid = 1;
       } else
@@ -265,7 +281,7 @@ main (int argc, char *argv[])
 #if defined(HAVE_LIBVIRT)
     get_all_libvirt_domains (libvirt_uri);
     print_title ();
-    err = start_threads (max_threads, g, df_work);
+    err = start_threads (max_threads, g, df_work, unordered, timeout);
     free_domains ();
 #else
     error (EXIT_FAILURE, 0,
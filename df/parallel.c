@@ -23,7 +23,28 @@
  *
  * It implements a multithreaded work queue.  In addition it reorders
  * the output so the output still appears in the same order as the
- * input (ie. still ordered alphabetically).
+ * input (ie. still ordered alphabetically), unless the caller asks
+ * for the output of each domain as soon as it is ready.  Domains can
+ * be given a time limit, so that one hung appliance does not hold up
+ * the rest.
+ *
+ * A thread which finishes a domain before the domains ahead of it
+ * leaves the output in a buffer and goes on to the next domain,
+ * instead of waiting for its turn to print.  Only when the buffered
+ * output would be more than C<MAX_BUFFERED_OUTPUT> does it wait, so
+ * that a slow domain cannot make the output of all the others pile
+ * up in memory.
+ *
+ * Booting the appliance is most of the cost of a small work item, so
+ * when the backend can hotplug drives each thread keeps its handle
+ * running from one domain to the next, unplugging the disks of the
+ * last domain and plugging in the disks of the next one.
+ *
+ * On hosts with more than one NUMA node, each appliance is placed on
+ * a node (see the C<numa_node> backend setting in L<guestfs(3)>).
+ * This is the node that the disks of its first domain are attached
+ * to, if we can find that out, otherwise the threads are spread
+ * evenly across the nodes.
  */
 
 #include <config.h>
@@ -32,12 +53,22 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <signal.h>
+#include <time.h>
 #include <libintl.h>
 #include <errno.h>
 #include <error.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
 
 #include <pthread.h>
 
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+#include <libxml/xpath.h>
+
 #ifdef HAVE_LIBVIRT
 #include <libvirt/libvirt.h>
 #include <libvirt/virterror.h>
@@ -57,18 +88,29 @@
 
 /* Maximum number of threads we would ever run.  Note this should not
  * be > 20, unless libvirt is modified to increase the maximum number
- * of clients.
+ * of clients.  Below that, estimate_max_threads decides based on the
+ * memory and CPUs of the host.
+ */
+#define MAX_THREADS 20
+
+/* Maximum total size of the output of domains which are finished but
+ * cannot be printed yet.
  */
-#define MAX_THREADS 12
+#define MAX_BUFFERED_OUTPUT (64 * 1024 * 1024)
 
 /* The worker threads take domains off the 'domains' global list until
  * 'next_domain_to_take' is 'nr_threads'.
  *
- * The worker threads retire domains in numerical order, using the
- * 'next_domain_to_retire' number.
+ * Domains are retired (their output is printed) in numerical order,
+ * using the 'next_domain_to_retire' number, or in any order if
+ * 'unordered' is set.  Whichever thread finishes the domain at the
+ * head of the queue, or times it out, also prints the finished
+ * domains after it.  A domain which has timed out counts as retired.
  *
  * 'next_domain_to_take' is protected just by a mutex.
- * 'next_domain_to_retire' is protected by a mutex and condition.
+ * 'next_domain_to_retire', 'domain_status', 'nr_domains_done',
+ * 'buffered_output', 'nr_threads_running' and the 'pid' and 'exited'
+ * fields of the thread data are protected by a mutex and condition.
  */
 static size_t next_domain_to_take = 0;
 static pthread_mutex_t take_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -77,16 +119,57 @@ static size_t next_domain_to_retire = 0;
 static pthread_mutex_t retire_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t retire_cond = PTHREAD_COND_INITIALIZER;
 
-static void thread_failure (const char *fn, int err);
-static void *worker_thread (void *arg);
+enum domain_state {
+  DOMAIN_WAITING = 0,           /* Not taken by a thread yet. */
+  DOMAIN_RUNNING,               /* The work function is running. */
+  DOMAIN_DONE,                  /* The work function has returned. */
+  DOMAIN_FINISHED,              /* Finished, output waiting to be printed. */
+  DOMAIN_RETIRED,               /* Output printed. */
+  DOMAIN_TIMED_OUT,             /* Gave up on it. */
+};
+
+struct domain_status {
+  enum domain_state state;
+  time_t deadline;              /* If running and there is a timeout. */
+  size_t thread_num;            /* Thread working on it. */
+  char *output;                 /* If finished, the output. */
+  size_t output_len;
+};
+
+static struct domain_status *domain_status;
+static size_t nr_domains_done;  /* Retired or timed out. */
+static size_t buffered_output;  /* Total output_len of finished domains. */
+static size_t nr_threads_running;
+
+static int unordered;
+static unsigned timeout;
+
+/* The NUMA nodes of the host, if there is more than one. */
+static int *numa_nodes;
+static size_t nr_numa_nodes;
 
 struct thread_data {
   size_t thread_num;            /* Thread number. */
   int trace, verbose;           /* Flags from the options_handle. */
   work_fn work;
   int r;                        /* Used to store the error status. */
+  int hotplug_failed;           /* Set by add_domain_disks, see there. */
+  pid_t pid;                    /* Appliance PID, if the backend has one. */
+  int in_work;                  /* Set while running the work function, */
+  size_t domain;                /* ... on this domain. */
+  int exited;                   /* Set when the thread exits. */
+  int detached;                 /* Left behind by start_threads. */
 };
 
+static void thread_failure (const char *fn, int err);
+static void *worker_thread (void *arg);
+static void check_timeouts (struct thread_data *thread_data);
+static void retire_domains (void);
+static void get_numa_nodes (void);
+
+/* Key of the thread_data in the private data of the worker handles. */
+#define THREAD_DATA_KEY "parallel_thread_data"
+
 /**
  * Run the threads and work through the global list of libvirt
  * domains.
@@ -104,19 +187,33 @@ struct thread_data {
  * the supplied C<FILE *>.  The work function should return C<0> on
  * success or C<-1> on error.
  *
+ * If C<option_unordered> is true, the output of each domain is
+ * printed as soon as the work function returns, instead of in the
+ * order of the domains.
+ *
+ * If C<option_timeout> is greater than C<0>, then a domain whose work
+ * function is still running after that many seconds is given up, and
+ * counts as an error.  Where the backend lets us know the PID of the
+ * appliance, the appliance is killed, which makes the work function
+ * fail.  Otherwise the thread is left behind, and C<start_threads>
+ * returns without waiting for it, so the caller should exit soon
+ * afterwards.
+ *
  * The C<start_threads> function returns C<0> if all work items
  * completed successfully, or C<-1> if there was an error.
  */
 int
-start_threads (size_t option_P, guestfs_h *options_handle, work_fn work)
+start_threads (size_t option_P, guestfs_h *options_handle, work_fn work,
+               int option_unordered, unsigned option_timeout)
 {
   const int trace = options_handle ? guestfs_get_trace (options_handle) : 0;
   const int verbose = options_handle ? guestfs_get_verbose (options_handle) : 0;
   size_t i, nr_threads;
   int err, errors;
   void *status;
-  CLEANUP_FREE struct thread_data *thread_data = NULL;
+  struct thread_data *thread_data = NULL;
   CLEANUP_FREE pthread_t *threads = NULL;
+  bool left_behind = false;
 
   if (nr_domains == 0)          /* Nothing to do. */
     return 0;
@@ -125,21 +222,35 @@ start_threads (size_t option_P, guestfs_h *options_handle, work_fn work)
   if (option_P > 0)
     nr_threads = MIN (nr_domains, option_P);
   else
-    nr_threads = MIN (nr_domains, MIN (MAX_THREADS, estimate_max_threads ()));
+    nr_threads = MIN (nr_domains, MIN (MAX_THREADS, estimate_max_threads (options_handle)));
 
   if (verbose)
     fprintf (stderr, "parallel: creating %zu threads\n", nr_threads);
 
   thread_data = malloc (sizeof (struct thread_data) * nr_threads);
   threads = malloc (sizeof (pthread_t) * nr_threads);
-  if (thread_data == NULL || threads == NULL)
+  domain_status = calloc (nr_domains, sizeof (struct domain_status));
+  if (thread_data == NULL || threads == NULL || domain_status == NULL)
     error (EXIT_FAILURE, errno, "malloc");
 
+  unordered = option_unordered;
+  timeout = option_timeout;
+  nr_threads_running = nr_threads;
+
+  get_numa_nodes ();
+  if (verbose && nr_numa_nodes > 1)
+    fprintf (stderr, "parallel: placing appliances on %zu NUMA nodes\n",
+             nr_numa_nodes);
+
   for (i = 0; i < nr_threads; ++i) {
     thread_data[i].thread_num = i;
     thread_data[i].trace = trace;
     thread_data[i].verbose = verbose;
     thread_data[i].work = work;
+    thread_data[i].pid = 0;
+    thread_data[i].in_work = 0;
+    thread_data[i].exited = 0;
+    thread_data[i].detached = 0;
   }
 
   /* Start the worker threads. */
@@ -149,9 +260,56 @@ start_threads (size_t option_P, guestfs_h *options_handle, work_fn work)
       error (EXIT_FAILURE, err, "pthread_create [%zu]", i);
   }
 
-  /* Wait for the threads to exit. */
   errors = 0;
+
+  /* Act as the watchdog until every domain is retired or has timed
+   * out.
+   */
+  if (timeout > 0) {
+    err = pthread_mutex_lock (&retire_mutex);
+    if (err != 0)
+      error (EXIT_FAILURE, err, "pthread_mutex_lock");
+    while (nr_domains_done < nr_domains && nr_threads_running > 0) {
+      struct timespec ts;
+
+      check_timeouts (thread_data);
+
+      clock_gettime (CLOCK_REALTIME, &ts);
+      ts.tv_sec++;
+      err = pthread_cond_timedwait (&retire_cond, &retire_mutex, &ts);
+      if (err != 0 && err != ETIMEDOUT)
+        error (EXIT_FAILURE, err, "pthread_cond_timedwait");
+    }
+
+    /* Timed out domains are errors. */
+    for (i = 0; i < nr_domains; ++i) {
+      if (domain_status[i].state == DOMAIN_TIMED_OUT)
+        errors++;
+    }
+
+    /* A thread which is still stuck on a domain that timed out,
+     * without an appliance we could kill, can't be joined.  It
+     * still refers to its thread data, so that is not freed.
+     */
+    for (i = 0; i < nr_threads; ++i) {
+      if (!thread_data[i].exited && thread_data[i].in_work &&
+          thread_data[i].pid <= 0 &&
+          domain_status[thread_data[i].domain].state == DOMAIN_TIMED_OUT) {
+        if (verbose)
+          fprintf (stderr, "parallel: leaving thread %zu behind\n", i);
+        ignore_value (pthread_detach (threads[i]));
+        thread_data[i].detached = 1;
+        left_behind = true;
+      }
+    }
+
+    ignore_value (pthread_mutex_unlock (&retire_mutex));
+  }
+
+  /* Wait for the threads to exit. */
   for (i = 0; i < nr_threads; ++i) {
+    if (thread_data[i].detached)
+      continue;
     err = pthread_join (threads[i], &status);
     if (err != 0) {
       error (0, err, "pthread_join [%zu]", i);
@@ -161,13 +319,427 @@ start_threads (size_t option_P, guestfs_h *options_handle, work_fn work)
       errors++;
   }
 
+  if (!left_behind) {
+    for (i = 0; i < nr_domains; ++i)
+      free (domain_status[i].output);
+    free (thread_data);
+    free (domain_status);
+    domain_status = NULL;
+    free (numa_nodes);
+    numa_nodes = NULL;
+  }
+
   return errors == 0 ? 0 : -1;
 }
 
+/* Give up on running domains which are past their deadline.  This is
+ * called with 'retire_mutex' held.
+ */
+static void
+check_timeouts (struct thread_data *thread_data)
+{
+  const time_t now = time (NULL);
+  size_t i;
+
+  for (i = 0; i < nr_domains; ++i) {
+    struct domain_status *ds = &domain_status[i];
+    pid_t pid;
+
+    if (ds->state != DOMAIN_RUNNING || now < ds->deadline)
+      continue;
+
+    fprintf (stderr, _("%s: %s: timed out after %u seconds\n"),
+             getprogname (), domains[i].name, timeout);
+    ds->state = DOMAIN_TIMED_OUT;
+    nr_domains_done++;
+
+    /* Killing the appliance makes the work function return. */
+    pid = thread_data[ds->thread_num].pid;
+    if (pid > 0) {
+      if (thread_data[ds->thread_num].verbose)
+        fprintf (stderr, "parallel: killing appliance %d of thread %zu\n",
+                 (int) pid, ds->thread_num);
+      ignore_value (kill (pid, SIGKILL));
+    }
+  }
+
+  retire_domains ();
+  pthread_cond_broadcast (&retire_cond);
+}
+
+/* Move 'next_domain_to_retire' past the domains which are already
+ * retired or have timed out, printing the output of the finished
+ * domains on the way.  This is called with 'retire_mutex' held.
+ */
+static void
+retire_domains (void)
+{
+  while (next_domain_to_retire < nr_domains) {
+    struct domain_status *ds = &domain_status[next_domain_to_retire];
+
+    if (ds->state == DOMAIN_FINISHED) {
+      printf ("%s", ds->output);
+      free (ds->output);
+      ds->output = NULL;
+      buffered_output -= ds->output_len;
+      ds->state = DOMAIN_RETIRED;
+      nr_domains_done++;
+    }
+    else if (ds->state != DOMAIN_RETIRED && ds->state != DOMAIN_TIMED_OUT)
+      break;
+
+    next_domain_to_retire++;
+  }
+}
+
+/**
+ * Add the disks of domain C<i> read-only to C<g>.
+ *
+ * The work function must use this and C<launch_domain_handle>
+ * instead of calling L<guestfs(3)/guestfs_add_libvirt_dom> and
+ * L<guestfs(3)/guestfs_launch> itself, because C<g> may already be
+ * running, left over from the previous domain, in which case the
+ * disks are hotplugged.  If hotplugging fails, the work function is
+ * called again for the same domain with a new handle, and anything
+ * it printed the first time is discarded.
+ *
+ * Returns C<-1> on error, with the error in the handle.
+ */
+int
+add_domain_disks (guestfs_h *g, size_t i)
+{
+  struct thread_data *thread_data = guestfs_get_private (g, THREAD_DATA_KEY);
+  struct guestfs_add_libvirt_dom_argv optargs;
+  const int hotplug = !guestfs_is_config (g);
+  int r;
+
+  /* The disks are labelled so they can be hot-unplugged afterwards. */
+  optargs.bitmask =
+    GUESTFS_ADD_LIBVIRT_DOM_READONLY_BITMASK |
+    GUESTFS_ADD_LIBVIRT_DOM_READONLYDISK_BITMASK |
+    GUESTFS_ADD_LIBVIRT_DOM_LABELS_BITMASK;
+  optargs.readonly = 1;
+  optargs.readonlydisk = "read";
+  optargs.labels = 1;
+
+  if (!hotplug || thread_data == NULL)
+    return guestfs_add_libvirt_dom_argv (g, domains[i].dom, &optargs);
+
+  /* The error is not reported, since the domain is retried. */
+  guestfs_push_error_handler (g, NULL, NULL);
+  r = guestfs_add_libvirt_dom_argv (g, domains[i].dom, &optargs);
+  guestfs_pop_error_handler (g);
+  if (r == -1) {
+    if (thread_data->verbose)
+      fprintf (stderr, "parallel: thread %zu could not hotplug domain %zu: "
+               "%s\n", thread_data->thread_num, i, guestfs_last_error (g));
+    thread_data->hotplug_failed = 1;
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Launch C<g>, unless it is already running (see
+ * C<add_domain_disks>).
+ */
+int
+launch_domain_handle (guestfs_h *g)
+{
+  struct thread_data *thread_data = guestfs_get_private (g, THREAD_DATA_KEY);
+  pid_t pid;
+
+  if (!guestfs_is_config (g))
+    return 0;
+  if (guestfs_launch (g) == -1)
+    return -1;
+
+  /* Remember the appliance PID so a timed out domain can be killed.
+   * Not all backends support this.
+   */
+  if (thread_data != NULL && timeout > 0) {
+    guestfs_push_error_handler (g, NULL, NULL);
+    pid = guestfs_get_pid (g);
+    guestfs_pop_error_handler (g);
+    if (pid > 0) {
+      ignore_value (pthread_mutex_lock (&retire_mutex));
+      thread_data->pid = pid;
+      ignore_value (pthread_mutex_unlock (&retire_mutex));
+    }
+  }
+
+  return 0;
+}
+
+static int
+compare_int (const void *p1, const void *p2)
+{
+  const int i1 = *(const int *) p1;
+  const int i2 = *(const int *) p2;
+
+  return i1 < i2 ? -1 : i1 > i2;
+}
+
+/* Find the NUMA nodes of the host, which are the F<nodeN>
+ * directories in sysfs.  There are none if the kernel was built
+ * without NUMA support.
+ */
+static void
+get_numa_nodes (void)
+{
+  DIR *dir;
+  struct dirent *d;
+  int node, *p;
+  char c;
+
+  nr_numa_nodes = 0;
+  dir = opendir ("/sys/devices/system/node");
+  if (dir == NULL)
+    return;
+
+  while ((d = readdir (dir)) != NULL) {
+    if (sscanf (d->d_name, "node%d%c", &node, &c) != 1 || node < 0)
+      continue;
+    p = realloc (numa_nodes, sizeof (int) * (nr_numa_nodes + 1));
+    if (p == NULL)
+      error (EXIT_FAILURE, errno, "realloc");
+    numa_nodes = p;
+    numa_nodes[nr_numa_nodes++] = node;
+  }
+  closedir (dir);
+
+  qsort (numa_nodes, nr_numa_nodes, sizeof (int), compare_int);
+
+  /* libxml2 must be initialized before it is used from threads. */
+  if (nr_numa_nodes > 1)
+    xmlInitParser ();
+}
+
+/* Return the NUMA node that the host block device holding C<path>
+ * is attached to, or C<-1> if we don't know.  The sysfs directory of
+ * a block device (or partition) is below the directory of its
+ * controller, for example a PCI NVMe drive or HBA, which has the
+ * F<numa_node> file, so walk up until we find one.  Logical volumes,
+ * network disks and so on have no node.
+ */
+static int
+get_path_numa_node (const char *path)
+{
+  struct stat statbuf;
+  dev_t dev;
+  char sysfs[64];
+  char dir[PATH_MAX];
+  char *p;
+  FILE *fp;
+  int node;
+
+  if (stat (path, &statbuf) == -1)
+    return -1;
+  dev = S_ISBLK (statbuf.st_mode) ? statbuf.st_rdev : statbuf.st_dev;
+
+  snprintf (sysfs, sizeof sysfs, "/sys/dev/block/%u:%u",
+            major (dev), minor (dev));
+  if (realpath (sysfs, dir) == NULL)
+    return -1;
+
+  while (STRPREFIX (dir, "/sys/devices/")) {
+    p = strrchr (dir, '/');
+    *p = '\0';
+    if (strlen (dir) + sizeof "/numa_node" > sizeof dir)
+      break;
+    strcat (dir, "/numa_node");
+    fp = fopen (dir, "r");
+    *p = '\0';
+    if (fp != NULL) {
+      if (fscanf (fp, "%d", &node) != 1)
+        node = -1;
+      fclose (fp);
+      return node;
+    }
+  }
+
+  return -1;
+}
+
+/* Return the NUMA node that the local disks of domain C<i> are
+ * attached to, or C<-1>.  If they are on several nodes, the first
+ * disk wins.
+ */
+static int
+get_domain_numa_node (size_t i)
+{
+  CLEANUP_FREE char *xml = NULL;
+  CLEANUP_XMLFREEDOC xmlDocPtr doc = NULL;
+  CLEANUP_XMLXPATHFREECONTEXT xmlXPathContextPtr xpathCtx = NULL;
+  CLEANUP_XMLXPATHFREEOBJECT xmlXPathObjectPtr xpathObj = NULL;
+  xmlNodeSetPtr nodes;
+  int j, node = -1;
+
+  xml = virDomainGetXMLDesc (domains[i].dom, 0);
+  if (xml == NULL)
+    return -1;
+  doc = xmlReadMemory (xml, strlen (xml), NULL, NULL, XML_PARSE_NONET);
+  if (doc == NULL)
+    return -1;
+  xpathCtx = xmlXPathNewContext (doc);
+  if (xpathCtx == NULL)
+    return -1;
+  xpathObj = xmlXPathEvalExpression (BAD_CAST
+                                     "//devices/disk/source/@file | "
+                                     "//devices/disk/source/@dev",
+                                     xpathCtx);
+  if (xpathObj == NULL)
+    return -1;
+
+  nodes = xpathObj->nodesetval;
+  for (j = 0; nodes != NULL && j < nodes->nodeNr && node == -1; ++j) {
+    CLEANUP_FREE char *path =
+      (char *) xmlNodeListGetString (doc, nodes->nodeTab[j]->children, 1);
+
+    if (path)
+      node = get_path_numa_node (path);
+  }
+
+  return node;
+}
+
+/* Choose the NUMA node for the appliance of the thread, which is
+ * about to work on domain C<i>, unless the user already chose where
+ * appliances should run.
+ */
+static void
+set_numa_node (guestfs_h *g, struct thread_data *thread_data, size_t i)
+{
+  CLEANUP_FREE char *numa_node = NULL, *cpuset = NULL;
+  int node;
+  size_t j;
+  char str[32];
+
+  if (nr_numa_nodes <= 1)
+    return;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  numa_node = guestfs_get_backend_setting (g, "numa_node");
+  cpuset = guestfs_get_backend_setting (g, "cpuset");
+  guestfs_pop_error_handler (g);
+  if (numa_node || cpuset)
+    return;
+
+  node = get_domain_numa_node (i);
+  if (node >= 0) {
+    /* Devices can report a node which is not online. */
+    for (j = 0; j < nr_numa_nodes; ++j)
+      if (numa_nodes[j] == node)
+        break;
+    if (j == nr_numa_nodes)
+      node = -1;
+  }
+  if (node == -1)
+    node = numa_nodes[thread_data->thread_num % nr_numa_nodes];
+
+  if (thread_data->verbose)
+    fprintf (stderr, "parallel: thread %zu using NUMA node %d\n",
+             thread_data->thread_num, node);
+
+  snprintf (str, sizeof str, "%d", node);
+  guestfs_set_backend_setting (g, "numa_node", str);
+}
+
+static guestfs_h *
+create_worker_handle (struct thread_data *thread_data, size_t i)
+{
+  guestfs_h *g;
+
+  g = guestfs_create ();
+  if (g == NULL) {
+    perror ("guestfs_create");
+    return NULL;
+  }
+
+  /* Copy some settings from the options guestfs handle. */
+  guestfs_set_trace (g, thread_data->trace);
+  guestfs_set_verbose (g, thread_data->verbose);
+  if (sizing)
+    guestfs_set_sizing (g, sizing);
+  set_numa_node (g, thread_data, i);
+
+  guestfs_set_private (g, THREAD_DATA_KEY, thread_data);
+
+  return g;
+}
+
+static void
+close_worker_handle (struct thread_data *thread_data, guestfs_h *g)
+{
+  guestfs_close (g);
+
+  ignore_value (pthread_mutex_lock (&retire_mutex));
+  thread_data->pid = 0;
+  ignore_value (pthread_mutex_unlock (&retire_mutex));
+}
+
+/* Only the libvirt backend can hotplug and unplug drives. */
+static int
+can_reuse_handle (guestfs_h *g)
+{
+  CLEANUP_FREE char *backend = guestfs_get_backend (g);
+
+  return backend &&
+    (STREQ (backend, "libvirt") || STRPREFIX (backend, "libvirt:"));
+}
+
+/* Make a running handle ready for the next domain by unmounting
+ * everything and hot-unplugging the disks of the last domain.
+ * Returns C<-1> if that fails, eg. because a disk is still in use,
+ * in which case the handle must not be reused.
+ */
+static int
+reset_handle (guestfs_h *g)
+{
+  const char *lvm2[] = { "lvm2", NULL };
+  CLEANUP_FREE_STRING_LIST char **labels = NULL;
+  CLEANUP_FREE_STRING_LIST char **devices = NULL;
+  size_t j;
+  int r = -1;
+
+  if (!guestfs_is_ready (g))
+    return -1;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+
+  if (guestfs_umount_all (g) == -1)
+    goto out;
+  /* Logical volumes hold their physical volumes open. */
+  if (guestfs_feature_available (g, (char **) lvm2) == 1 &&
+      guestfs_vg_activate_all (g, 0) == -1)
+    goto out;
+
+  labels = guestfs_list_disk_labels (g);
+  if (labels == NULL)
+    goto out;
+  for (j = 0; labels[j] != NULL; j += 2) {
+    if (guestfs_remove_drive (g, labels[j]) == -1)
+      goto out;
+  }
+
+  /* Check that no unlabelled disk was left behind. */
+  devices = guestfs_list_devices (g);
+  if (devices == NULL || devices[0] != NULL)
+    goto out;
+
+  r = 0;
+ out:
+  guestfs_pop_error_handler (g);
+  return r;
+}
+
 static void *
 worker_thread (void *thread_data_vp)
 {
   struct thread_data *thread_data = thread_data_vp;
+  guestfs_h *g = NULL;          /* Kept from one domain to the next. */
+  int reuse = -1;
 
   thread_data->r = 0;
 
@@ -180,8 +752,7 @@ worker_thread (void *thread_data_vp)
     FILE *fp;
     CLEANUP_FREE char *output = NULL;
     size_t output_len = 0;
-    guestfs_h *g;
-    int err;
+    int err, r, timed_out;
     char id[64];
 
     /* Take the next domain from the list. */
@@ -193,14 +764,14 @@ worker_thread (void *thread_data_vp)
     if (err != 0) {
       thread_failure ("pthread_mutex_lock", err);
       thread_data->r = -1;
-      return &thread_data->r;
+      goto out;
     }
     i = next_domain_to_take++;
     err = pthread_mutex_unlock (&take_mutex);
     if (err != 0) {
       thread_failure ("pthread_mutex_unlock", err);
       thread_data->r = -1;
-      return &thread_data->r;
+      goto out;
     }
 
     if (i >= nr_domains)        /* Work finished. */
@@ -210,32 +781,77 @@ worker_thread (void *thread_data_vp)
       fprintf (stderr, "parallel: thread %zu taking domain %zu\n",
                thread_data->thread_num, i);
 
-    fp = open_memstream (&output, &output_len);
-    if (fp == NULL) {
-      perror ("open_memstream");
-      thread_data->r = -1;
-      return &thread_data->r;
-    }
+    ignore_value (pthread_mutex_lock (&retire_mutex));
+    domain_status[i].state = DOMAIN_RUNNING;
+    domain_status[i].deadline = timeout > 0 ? time (NULL) + timeout : 0;
+    domain_status[i].thread_num = thread_data->thread_num;
+    thread_data->domain = i;
+    thread_data->in_work = 1;
+    ignore_value (pthread_mutex_unlock (&retire_mutex));
+
+    for (;;) {
+      fp = open_memstream (&output, &output_len);
+      if (fp == NULL) {
+        perror ("open_memstream");
+        thread_data->r = -1;
+        goto out;
+      }
 
-    /* Create a guestfs handle. */
-    g = guestfs_create ();
-    if (g == NULL) {
-      perror ("guestfs_create");
-      thread_data->r = -1;
-      return &thread_data->r;
+      /* Create a guestfs handle, or reuse the one from the last domain. */
+      if (g == NULL) {
+        g = create_worker_handle (thread_data, i);
+        if (g == NULL) {
+          fclose (fp);
+          thread_data->r = -1;
+          goto out;
+        }
+        if (reuse == -1)
+          reuse = can_reuse_handle (g);
+      }
+
+      /* Set the handle identifier so we can tell threads apart. */
+      snprintf (id, sizeof id, "thread_%zu_domain_%zu",
+                thread_data->thread_num, i);
+      guestfs_set_identifier (g, id);
+
+      /* Do work. */
+      thread_data->hotplug_failed = 0;
+      r = thread_data->work (g, i, fp);
+      fclose (fp);
+
+      if (!thread_data->hotplug_failed)
+        break;
+
+      /* Try again with a new handle (which goes through the normal
+       * launch, so it does not come back here).
+       */
+      free (output);
+      output = NULL;
+      output_len = 0;
+      close_worker_handle (thread_data, g);
+      g = NULL;
     }
 
-    /* Set the handle identifier so we can tell threads apart. */
-    snprintf (id, sizeof id, "thread_%zu_domain_%zu",
-              thread_data->thread_num, i);
-    guestfs_set_identifier (g, id);
+    ignore_value (pthread_mutex_lock (&retire_mutex));
+    thread_data->in_work = 0;
+    timed_out = domain_status[i].state == DOMAIN_TIMED_OUT;
+    if (!timed_out)
+      domain_status[i].state = DOMAIN_DONE;
+    ignore_value (pthread_mutex_unlock (&retire_mutex));
 
-    /* Copy some settings from the options guestfs handle. */
-    guestfs_set_trace (g, thread_data->trace);
-    guestfs_set_verbose (g, thread_data->verbose);
+    /* The domain has already been reported and counted as retired,
+     * so just drop the output.  The handle is probably not usable.
+     */
+    if (timed_out) {
+      if (thread_data->verbose)
+        fprintf (stderr, "parallel: thread %zu dropping domain %zu\n",
+                 thread_data->thread_num, i);
+      close_worker_handle (thread_data, g);
+      g = NULL;
+      continue;
+    }
 
-    /* Do work. */
-    if (thread_data->work (g, i, fp) == -1) {
+    if (r == -1) {
       thread_data->r = -1;
 
       if (thread_data->verbose)
@@ -244,47 +860,65 @@ worker_thread (void *thread_data_vp)
                  thread_data->thread_num);
     }
 
-    fclose (fp);
-    guestfs_close (g);
+    if (!reuse || reset_handle (g) == -1) {
+      close_worker_handle (thread_data, g);
+      g = NULL;
+    }
 
-    /* Retire this domain.  We have to retire domains in order, which
-     * may mean waiting for another thread to finish here.
+    /* Retire this domain.  If the output is ordered and the domains
+     * before it are not all finished, the output is kept for later,
+     * but if too much output is being kept already, we have to wait
+     * here for another thread to print some of it first.
      */
-    if (thread_data->verbose)
-      fprintf (stderr, "parallel: thread %zu waiting to retire domain %zu\n",
-               thread_data->thread_num, i);
-
     err = pthread_mutex_lock (&retire_mutex);
     if (err != 0) {
       thread_failure ("pthread_mutex_lock", err);
       thread_data->r = -1;
-      return &thread_data->r;
+      goto out;
     }
-    while (next_domain_to_retire != i) {
+    while (!unordered && next_domain_to_retire != i &&
+           buffered_output > 0 &&
+           buffered_output + output_len > MAX_BUFFERED_OUTPUT) {
+      if (thread_data->verbose)
+        fprintf (stderr, "parallel: thread %zu waiting to retire domain %zu\n",
+                 thread_data->thread_num, i);
       err = pthread_cond_wait (&retire_cond, &retire_mutex);
       if (err != 0) {
         thread_failure ("pthread_cond_wait", err);
         thread_data->r = -1;
         ignore_value (pthread_mutex_unlock (&retire_mutex));
-        return &thread_data->r;
+        goto out;
       }
     }
 
-    if (thread_data->verbose)
-      fprintf (stderr, "parallel: thread %zu retiring domain %zu\n",
-               thread_data->thread_num, i);
-
-    /* Retire domain. */
-    printf ("%s", output);
+    if (unordered) {
+      if (thread_data->verbose)
+        fprintf (stderr, "parallel: thread %zu retiring domain %zu\n",
+                 thread_data->thread_num, i);
+      printf ("%s", output);
+      fflush (stdout);
+      domain_status[i].state = DOMAIN_RETIRED;
+      nr_domains_done++;
+    }
+    else {
+      if (thread_data->verbose)
+        fprintf (stderr, "parallel: thread %zu finished domain %zu\n",
+                 thread_data->thread_num, i);
+      domain_status[i].state = DOMAIN_FINISHED;
+      domain_status[i].output = output;
+      domain_status[i].output_len = output_len;
+      output = NULL;
+      buffered_output += output_len;
+    }
 
-    /* Update next_domain_to_retire and tell other threads. */
-    next_domain_to_retire = i+1;
+    /* Print whatever can be printed now and tell other threads. */
+    retire_domains ();
     pthread_cond_broadcast (&retire_cond);
     err = pthread_mutex_unlock (&retire_mutex);
     if (err != 0) {
       thread_failure ("pthread_mutex_unlock", err);
       thread_data->r = -1;
-      return &thread_data->r;
+      goto out;
     }
   }
 
@@ -292,6 +926,16 @@ worker_thread (void *thread_data_vp)
     fprintf (stderr, "parallel: thread %zu exiting (r = %d)\n",
              thread_data->thread_num, thread_data->r);
 
+ out:
+  if (g)
+    close_worker_handle (thread_data, g);
+
+  ignore_value (pthread_mutex_lock (&retire_mutex));
+  thread_data->exited = 1;
+  nr_threads_running--;
+  pthread_cond_broadcast (&retire_cond);
+  ignore_value (pthread_mutex_unlock (&retire_mutex));
+
   return &thread_data->r;
 }
 
@@ -1,4 +1,4 @@
-/* virt-df & virt-alignment-scan parallel appliances code.
+/* virt-df, virt-alignment-scan & virt-inspector parallel appliances code.
  * Copyright (C) 2013 Red Hat Inc.
  *
  * This program is free software; you can redistribute it and/or modify
@@ -25,7 +25,11 @@
 
 typedef int (*work_fn) (guestfs_h *g, size_t i, FILE *fp);
 
-extern int start_threads (size_t option_P, guestfs_h *options_handle, work_fn work);
+extern int start_threads (size_t option_P, guestfs_h *options_handle,
+                          work_fn work,
+                          int option_unordered, unsigned option_timeout);
+extern int add_domain_disks (guestfs_h *g, size_t i);
+extern int launch_domain_handle (guestfs_h *g);
 
 #endif /* HAVE_LIBVIRT */
 
@@ -42,6 +42,7 @@ type cmdline = {
   root_label : string option;
   install_type : string;
   image_cache : string option;
+  layer_cache : string option;
   compressed : bool;
   qemu_img_options : string option;
   mkfs_options : string option;
@@ -136,6 +137,9 @@ read the man page virt-dib(1).
   let image_cache = ref None in
   let set_image_cache arg = image_cache := Some arg in
 
+  let layer_cache = ref None in
+  let set_layer_cache arg = layer_cache := Some arg in
+
   let compressed = ref true in
 
   let delete_on_failure = ref true in
@@ -169,6 +173,7 @@ read the man page virt-dib(1).
     [ L"root-label" ], Getopt.String ("label", set_root_label), s_"Label for the root fs";
     [ L"install-type" ], Getopt.Set_string ("type", install_type),  s_"Installation type";
     [ L"image-cache" ], Getopt.String ("directory", set_image_cache), s_"Location for cached images";
+    [ L"layer-cache" ], Getopt.String ("directory", set_layer_cache), s_"Reuse intermediate images from this directory";
     [ S 'u' ],           Getopt.Clear compressed,      "Do not compress the qcow2 image";
     [ L"qemu-img-options" ], Getopt.String ("option", set_qemu_img_options),
                                               s_"Add qemu-img options";
@@ -225,6 +230,7 @@ read the man page virt-dib(1).
   let root_label = !root_label in
   let install_type = !install_type in
   let image_cache = !image_cache in
+  let layer_cache = !layer_cache in
   let compressed = !compressed in
   let delete_on_failure = !delete_on_failure in
   let is_ramdisk = !is_ramdisk in
@@ -260,7 +266,8 @@ read the man page virt-dib(1).
     excluded_scripts = excluded_scripts; use_base = use_base; drive = drive;
     drive_format = drive_format; image_name = image_name; fs_type = fs_type;
     size = size; root_label = root_label; install_type = install_type;
-    image_cache = image_cache; compressed = compressed;
+    image_cache = image_cache; layer_cache = layer_cache;
+    compressed = compressed;
     qemu_img_options = qemu_img_options; mkfs_options = mkfs_options;
     is_ramdisk = is_ramdisk; ramdisk_element = ramdisk_element;
     extra_packages = extra_packages; memsize = memsize; network = network;
@@ -34,6 +34,7 @@ type cmdline = {
   root_label : string option;
   install_type : string;
   image_cache : string option;
+  layer_cache : string option;
   compressed : bool;
   qemu_img_options : string option;
   mkfs_options : string option;
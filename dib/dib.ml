@@ -465,6 +465,94 @@ let run_install_packages ~debug ~blockdev ~log_file
   flush_all ();
   out
 
+(* With --layer-cache, the image is saved after the root.d phase and
+ * again after the post-install.d phase, so that a later build with
+ * the same inputs can skip those phases.  The first layer is a qcow2
+ * copy of the disk, and the second one a qcow2 overlay on top of it.
+ * Each layer is named by a hash of everything which can affect it.
+ *)
+type layer = Layer_root | Layer_install
+
+(* The hooks which run after each layer is saved. *)
+let hooks_after_root = [ "extra-data.d"; "pre-install.d"; "install.d";
+                         "post-install.d"; "finalise.d"; "cleanup.d" ]
+let hooks_after_install = [ "finalise.d"; "cleanup.d" ]
+
+(* A hash of the names, permissions and contents of the files under
+ * dir, skipping the top level entries in exclude.
+ *)
+let rec digest_dir ?(exclude = []) dir =
+  let entries = Array.to_list (Sys.readdir dir) in
+  let entries = List.filter (not_in_list exclude) entries in
+  let entries = List.sort compare entries in
+  let buf = Buffer.create 1024 in
+  List.iter (
+    fun name ->
+      let path = dir // name in
+      let st = Unix.lstat path in
+      bprintf buf "%s\000%o\000" name st.Unix.st_perm;
+      (match st.Unix.st_kind with
+      | Unix.S_DIR -> Buffer.add_string buf (digest_dir path)
+      | Unix.S_REG -> Buffer.add_string buf (Digest.file path)
+      | Unix.S_LNK -> Buffer.add_string buf (Unix.readlink path)
+      | _ -> ()
+      );
+      Buffer.add_char buf '\000'
+  ) entries;
+  Digest.string (Buffer.contents buf)
+
+(* The names of the root and install layers.  [inputs] covers the
+ * options and the environment of the build.
+ *)
+let layer_keys ~inputs ~basepath hooks_dir =
+  let hash xs = Digest.to_hex (Digest.string (String.concat "\000" xs)) in
+  let root_key =
+    hash [ "virt-dib layer 1"; inputs; digest_dir basepath;
+           digest_dir ~exclude:hooks_after_root hooks_dir ] in
+  let install_key =
+    hash [ root_key; digest_dir ~exclude:hooks_after_install hooks_dir ] in
+  root_key, install_key
+
+let layer_filename layer_cache key = layer_cache // key ^ ".qcow2"
+let layer_uuid_filename layer_cache key = layer_cache // key ^ ".uuid"
+
+(* Find the latest layer of this build which is in the cache.  The
+ * install layer needs the root layer as its backing file.
+ *)
+let find_layer layer_cache (root_key, install_key) =
+  if Sys.file_exists (layer_filename layer_cache root_key) &&
+     Sys.file_exists (layer_uuid_filename layer_cache root_key) then (
+    if Sys.file_exists (layer_filename layer_cache install_key) then
+      Some Layer_install
+    else
+      Some Layer_root
+  )
+  else None
+
+(* Save the raw disk as a layer.  The file is renamed into place only
+ * when it is complete, so an interrupted build doesn't leave a broken
+ * layer behind.
+ *)
+let save_layer layer_cache ?backing key disk =
+  message (f_"Saving the image in the layer cache");
+  let tmp = Filename.temp_file ~temp_dir:layer_cache "layer." ".qcow2" in
+  let cmd = [ "qemu-img"; "convert"; "-f"; "raw"; disk; "-O"; "qcow2" ] @
+    (match backing with
+    | None -> []
+    | Some b -> [ "-B"; layer_filename layer_cache b;
+                  "-o"; "backing_fmt=qcow2" ]) @
+    [ tmp ] in
+  if run_command cmd <> 0 then (
+    (try Unix.unlink tmp with _ -> ());
+    exit 1
+  );
+  Unix.rename tmp (layer_filename layer_cache key)
+
+let restore_layer layer_cache key disk =
+  let cmd = [ "qemu-img"; "convert"; "-f"; "qcow2";
+              layer_filename layer_cache key; "-O"; "raw"; disk ] in
+  if run_command cmd <> 0 then exit 1
+
 let main () =
   let cmdline = parse_cmdline () in
   let debug = cmdline.debug in
@@ -580,13 +668,49 @@ let main () =
       | _ -> "cloudimg-rootfs")
     | Some label -> label in
 
+  let is_ramdisk_build =
+    cmdline.is_ramdisk || StringSet.mem "ironic-agent" all_elements in
+
   let image_cache =
     match cmdline.image_cache with
     | None -> Sys.getenv "HOME" // ".cache" // "image-create"
     | Some dir -> dir in
   do_mkdir image_cache;
 
-  let rootfs_uuid = uuidgen () in
+  let layer_cache =
+    match cmdline.layer_cache with
+    | None -> None
+    | Some _ when Hashtbl.mem final_hooks "block-device.d" ->
+      (* Those scripts set up the disk, and would have to be run again
+       * on a restored image.
+       *)
+      warning (f_"--layer-cache cannot be used with elements which have block-device.d scripts, ignoring it");
+      None
+    | Some dir ->
+      require_tool "qemu-img";
+      do_mkdir dir;
+      let dir = absolute_path dir in
+      let inputs =
+        String.concat "\n" ([
+          String.concat " " (StringSet.elements all_elements);
+          arch; cmdline.fs_type; Int64.to_string cmdline.size; root_label;
+          (match cmdline.mkfs_options with None -> "" | Some o -> o);
+          cmdline.install_type; string_of_bool is_ramdisk_build;
+          String.concat "," cmdline.extra_packages;
+          dib_vars ] @
+          List.map (fun (var, value) -> var ^ "=" ^ value) envvars) in
+      Some (dir, layer_keys ~inputs ~basepath:cmdline.basepath hookstmpdir) in
+  let cached_layer =
+    match layer_cache with
+    | None -> None
+    | Some (dir, keys) -> find_layer dir keys in
+
+  (* A restored image already has a filesystem, with this UUID. *)
+  let rootfs_uuid =
+    match layer_cache, cached_layer with
+    | Some (dir, (root_key, _)), Some _ ->
+      String.trim (read_whole_file (layer_uuid_filename dir root_key))
+    | _ -> uuidgen () in
 
   let formats_img, formats_archive = List.partition (
     function
@@ -644,9 +768,6 @@ let main () =
 
   message (f_"Opening the disks");
 
-  let is_ramdisk_build =
-    cmdline.is_ramdisk || StringSet.mem "ironic-agent" all_elements in
-
   let g, tmpdisk, tmpdiskfmt, drive_partition =
     let g = open_guestfs () in
     may g#set_memsize cmdline.memsize;
@@ -665,7 +786,17 @@ let main () =
         Filename.temp_file ~temp_dir:tmpdir "image." "" in
     let fn = output_filename fn fmt in
     (* Produce the output image. *)
-    g#disk_create fn fmt cmdline.size;
+    (match layer_cache, cached_layer with
+    | Some (dir, (root_key, install_key)), Some layer ->
+      let key, hook =
+        match layer with
+        | Layer_root -> root_key, "root.d"
+        | Layer_install -> install_key, "post-install.d" in
+      message (f_"Reusing the cached image after the %s phase") hook;
+      restore_layer dir key fn
+    | _ ->
+      g#disk_create fn fmt cmdline.size
+    );
     g#add_drive ~readonly:false ~format:fmt fn;
 
     (* Helper drive for elements and binaries. *)
@@ -781,68 +912,101 @@ let main () =
   checked_umount_all ();
   flush_all ();
 
-  message (f_"Setting up the destination root");
-
-  (* Create and mount the target filesystem. *)
-  let mkfs_options =
-    match cmdline.mkfs_options with
-    | None -> []
-    | Some o -> [ o ] in
-  let mkfs_options =
-    (match cmdline.fs_type with
-    | "ext4" ->
-      (* Very conservative to handle images being resized a lot
-       * Without -J option specified, default journal size will be set to 32M
-       * and online resize will be failed with error of needs too many credits.
-       *)
-      [ "-i"; "4096"; "-J"; "size=64" ]
-    | _ -> []
-    ) @ mkfs_options @ [ "-t"; cmdline.fs_type; blockdev ] in
-  ignore (g#debug "sh" (Array.of_list ([ "mkfs" ] @ mkfs_options)));
-  g#set_label blockdev root_label;
-  if String.is_prefix cmdline.fs_type "ext" then
-    g#set_uuid blockdev rootfs_uuid;
-  g#mount blockdev "/";
-  g#mkmountpoint "/tmp";
-  mount_aux ();
-  g#mkdir "/subroot";
+  let save_layer_if_enabled layer =
+    match layer_cache with
+    | None -> ()
+    | Some (dir, (root_key, install_key)) ->
+      match layer with
+      | Layer_root ->
+        write_script (layer_uuid_filename dir root_key) (rootfs_uuid ^ "\n");
+        save_layer dir root_key tmpdisk
+      | Layer_install ->
+        save_layer dir ~backing:root_key install_key tmpdisk in
+
+  if cached_layer = None then (
+    message (f_"Setting up the destination root");
+
+    (* Create and mount the target filesystem. *)
+    let mkfs_options =
+      match cmdline.mkfs_options with
+      | None -> []
+      | Some o -> [ o ] in
+    let mkfs_options =
+      (match cmdline.fs_type with
+      | "ext4" ->
+        (* Very conservative to handle images being resized a lot
+         * Without -J option specified, default journal size will be set to 32M
+         * and online resize will be failed with error of needs too many credits.
+         *)
+        [ "-i"; "4096"; "-J"; "size=64" ]
+      | _ -> []
+      ) @ mkfs_options @ [ "-t"; cmdline.fs_type; blockdev ] in
+    ignore (g#debug "sh" (Array.of_list ([ "mkfs" ] @ mkfs_options)));
+    g#set_label blockdev root_label;
+    if String.is_prefix cmdline.fs_type "ext" then
+      g#set_uuid blockdev rootfs_uuid;
+    g#mount blockdev "/";
+    g#mkmountpoint "/tmp";
+    mount_aux ();
+    g#mkdir "/subroot";
+
+    run_hook_subroot "root.d";
+
+    g#sync ();
+    g#umount "/tmp/aux/perm";
+    g#umount "/tmp/aux";
+    g#rm_rf "/tmp";
+    let subroot_items =
+      let l = Array.to_list (g#ls "/subroot") in
+      let l_lost_plus_found, l = List.partition ((=) "lost+found") l in
+      if l_lost_plus_found <> [] then (
+        g#rm_rf "/subroot/lost+found";
+      );
+      l in
+    List.iter (fun x -> g#mv ("/subroot/" ^ x) ("/" ^ x)) subroot_items;
+    g#rmdir "/subroot";
 
-  run_hook_subroot "root.d";
+    if layer_cache <> None then (
+      g#sync ();
+      checked_umount_all ();
+      flush_all ();
+      save_layer_if_enabled Layer_root;
+      g#mount blockdev "/"
+    )
+  )
+  else
+    g#mount blockdev "/";
 
-  g#sync ();
-  g#umount "/tmp/aux/perm";
-  g#umount "/tmp/aux";
-  g#rm_rf "/tmp";
-  let subroot_items =
-    let l = Array.to_list (g#ls "/subroot") in
-    let l_lost_plus_found, l = List.partition ((=) "lost+found") l in
-    if l_lost_plus_found <> [] then (
-      g#rm_rf "/subroot/lost+found";
-    );
-    l in
-  List.iter (fun x -> g#mv ("/subroot/" ^ x) ("/" ^ x)) subroot_items;
-  g#rmdir "/subroot";
   (* Check /tmp exists already. *)
   ignore (g#is_dir "/tmp");
   mount_aux ();
-  g#ln_s "aux/hooks" "/tmp/in_target.d";
+  (* The image from the install layer has the link already. *)
+  if not (g#is_symlink "/tmp/in_target.d") then
+    g#ln_s "aux/hooks" "/tmp/in_target.d";
 
+  (* This runs even if the install layer is restored, since it puts
+   * data in the auxiliary disk for the later phases.
+   *)
   run_hook_host "extra-data.d";
 
-  run_hook_in "pre-install.d";
+  if cached_layer <> Some Layer_install then (
+    run_hook_in "pre-install.d";
 
-  if cmdline.extra_packages <> [] then
-    ignore (run_install_packages ~debug ~blockdev ~log_file g
-                                 cmdline.extra_packages);
+    if cmdline.extra_packages <> [] then
+      ignore (run_install_packages ~debug ~blockdev ~log_file g
+                                   cmdline.extra_packages);
 
-  run_hook_in "install.d";
+    run_hook_in "install.d";
 
-  run_hook_in "post-install.d";
+    run_hook_in "post-install.d"
+  );
 
   (* Unmount and remount the image, as d-i-b does at this point too. *)
   g#sync ();
   checked_umount_all ();
   flush_all ();
+  if cached_layer <> Some Layer_install then
+    save_layer_if_enabled Layer_install;
   g#mount blockdev "/";
   (* Check /tmp/aux still exists. *)
   ignore (g#is_dir "/tmp/aux");
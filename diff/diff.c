@@ -31,8 +31,8 @@
 #include <assert.h>
 #include <time.h>
 #include <libintl.h>
-#include <sys/wait.h>
 #include <sys/sysmacros.h>
+#include <pthread.h>
 
 #include "c-ctype.h"
 #include "human.h"
@@ -43,12 +43,13 @@
 #include "options.h"
 #include "display-options.h"
 #include "visit.h"
+#include "udiff.h"
 
-/* Internal tree structure built for each guest. */
-struct tree;
-static struct tree *visit_guest (guestfs_h *g);
-static int diff_guests (struct tree *t1, struct tree *t2);
-static void free_tree (struct tree *);
+/* Internal structure holding the entries read from each guest. */
+struct guest;
+static struct guest *start_guest (guestfs_h *g);
+static int finish_guest (struct guest *t);
+static int diff_guests (struct guest *t1, struct guest *t2);
 
 /* Libguestfs handles for two source guests. */
 guestfs_h *g, *g2;
@@ -66,6 +67,7 @@ static int csv = 0;
 static int dir_links = 0;
 static int dir_times = 0;
 static int human = 0;
+static int lazy_checksum = 0;
 static int enable_extra_stats = 0;
 static int enable_times = 0;
 static int enable_uids = 0;
@@ -119,6 +121,8 @@ usage (int status)
               "  --help               Display brief help\n"
               "  -h|--human-readable  Human-readable sizes in output\n"
               "  --keys-from-stdin    Read passphrases from stdin\n"
+              "  --lazy-checksum[=..] Checksum only files with the same stats\n"
+              "  --sizing type        Size the appliance automatically\n"
               "  --times              Display file times\n"
               "  --time-days          Display file times as days before now\n"
               "  --time-relative      Display file times as seconds before now\n"
@@ -169,9 +173,12 @@ main (int argc, char *argv[])
     { "format", 2, 0, 0 },
     { "help", 0, 0, HELP_OPTION },
     { "human-readable", 0, 0, 'h' },
+    { "lazy-checksum", 2, 0, 0 },
+    { "lazy-checksums", 2, 0, 0 },
     { "long-options", 0, 0, 0 },
     { "keys-from-stdin", 0, 0, 0 },
     { "short-options", 0, 0, 0 },
+    { "sizing", 1, 0, 0 },
     { "time", 0, 0, 0 },
     { "times", 0, 0, 0 },
     { "time-days", 0, 0, 0 },
@@ -191,7 +198,7 @@ main (int argc, char *argv[])
   bool format_consumed = true;
   int c;
   int option_index;
-  struct tree *tree1, *tree2;
+  struct guest *guest1, *guest2;
 
   g = guestfs_create ();
   if (g == NULL)
@@ -217,6 +224,11 @@ main (int argc, char *argv[])
         echo_keys = 1;
       } else if (STREQ (long_options[option_index].name, "format")) {
         OPTION_format;
+      } else if (STREQ (long_options[option_index].name, "sizing")) {
+        /* OPTION_sizing; */
+        option_sizing (optarg);
+        if (guestfs_set_sizing (g2, optarg) == -1)
+          exit (EXIT_FAILURE);
       } else if (STREQ (long_options[option_index].name, "all")) {
         enable_extra_stats = enable_times = enable_uids = enable_xattrs = 1;
       } else if (STREQ (long_options[option_index].name, "atime")) {
@@ -229,6 +241,13 @@ main (int argc, char *argv[])
           checksum = "md5";
         else
           checksum = optarg;
+      } else if (STREQ (long_options[option_index].name, "lazy-checksum") ||
+                 STREQ (long_options[option_index].name, "lazy-checksums")) {
+        lazy_checksum = 1;
+        if (optarg && STRNEQ (optarg, ""))
+          checksum = optarg;
+        else if (!checksum)
+          checksum = "md5";
       } else if (STREQ (long_options[option_index].name, "dir-link") ||
                  STREQ (long_options[option_index].name, "dir-links") ||
                  STREQ (long_options[option_index].name, "dir-nlink") ||
@@ -360,9 +379,6 @@ main (int argc, char *argv[])
 
   inspect_mount ();
 
-  if ((tree1 = visit_guest (g)) == NULL)
-    errors++;
-
   /* Mount up second guest. */
   add_drives_handle (g2, drvs2, 'a');
 
@@ -371,16 +387,19 @@ main (int argc, char *argv[])
 
   inspect_mount_handle (g2);
 
-  if ((tree2 = visit_guest (g2)) == NULL)
-    errors++;
+  /* The two handles are independent, so walk both guests at the
+   * same time, comparing the entries as they arrive.
+   */
+  guest1 = start_guest (g);
+  guest2 = start_guest (g2);
 
-  if (errors == 0) {
-    if (diff_guests (tree1, tree2) == -1)
-      errors++;
-  }
+  if (diff_guests (guest1, guest2) == -1)
+    errors++;
 
-  free_tree (tree1);
-  free_tree (tree2);
+  if (finish_guest (guest1) == -1)
+    errors++;
+  if (finish_guest (guest2) == -1)
+    errors++;
 
   free_drives (drvs);
   free_drives (drvs2);
@@ -391,72 +410,176 @@ main (int argc, char *argv[])
   exit (errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
 }
 
-struct tree {
-  /* We store the handle here in case we need to go and dig into
-   * the disk to get file content.
-   */
-  guestfs_h *g;
-
-  /* List of files found, sorted by path. */
-  struct file *files;
-  size_t nr_files, allocated;
-};
-
 struct file {
   char *path;
   struct guestfs_statns *stat;
   struct guestfs_xattr_list *xattrs;
   char *csum;                  /* Checksum. If NULL, use file times and size. */
+  char *link;                  /* Symlink target, if a symlink. */
+};
+
+/* Number of entries from each guest which may be waiting for
+ * diff_guests.  When the queue is full the thread walking the guest
+ * waits, so this bounds the memory used however large the guests
+ * are.
+ */
+#define QUEUE_SIZE 1024
+
+struct guest {
+  /* We store the handle here in case we need to go and dig into
+   * the disk to get file content.  'handle_lock' is held by the
+   * thread which is using the handle.  The thread walking the guest
+   * drops it only while it waits for room in the queue.
+   */
+  guestfs_h *g;
+  pthread_mutex_t handle_lock;
+
+  pthread_t thread;
+  size_t nr_files;             /* Entries read from the guest so far. */
+
+  /* Entries not yet compared, in the order the visitor returned
+   * them.  These fields are protected by 'queue_lock'.
+   */
+  struct file files[QUEUE_SIZE];
+  size_t head, count;
+  int done;                    /* Set when the thread has finished. */
+  int r;                       /* Result of visit. */
 };
 
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
+/* Set (protected by 'queue_lock') if walking either guest failed, to
+ * stop the other thread and diff_guests early.
+ */
+static int quit = 0;
+
 static void
-free_tree (struct tree *t)
+lock (pthread_mutex_t *mutex)
 {
-  size_t i;
+  const int err = pthread_mutex_lock (mutex);
+  if (err != 0)
+    error (EXIT_FAILURE, err, "pthread_mutex_lock");
+}
 
-  for (i = 0; i < t->nr_files; ++i) {
-    free (t->files[i].path);
-    guestfs_free_statns (t->files[i].stat);
-    guestfs_free_xattr_list (t->files[i].xattrs);
-    free (t->files[i].csum);
-  }
+static void
+unlock (pthread_mutex_t *mutex)
+{
+  const int err = pthread_mutex_unlock (mutex);
+  if (err != 0)
+    error (EXIT_FAILURE, err, "pthread_mutex_unlock");
+}
+
+static void
+wait_queue (void)
+{
+  const int err = pthread_cond_wait (&queue_cond, &queue_lock);
+  if (err != 0)
+    error (EXIT_FAILURE, err, "pthread_cond_wait");
+}
 
-  free (t->files);
+static void
+wake_queue (void)
+{
+  const int err = pthread_cond_broadcast (&queue_cond);
+  if (err != 0)
+    error (EXIT_FAILURE, err, "pthread_cond_broadcast");
+}
 
-  free (t);
+static void
+free_file (struct file *file)
+{
+  free (file->path);
+  guestfs_free_statns (file->stat);
+  guestfs_free_xattr_list (file->xattrs);
+  free (file->csum);
+  free (file->link);
 }
 
+static void *visit_guest (void *vt);
 static int visit_entry (const char *dir, const char *name, const struct guestfs_statns *stat, const struct guestfs_xattr_list *xattrs, void *vt);
 
-static struct tree *
-visit_guest (guestfs_h *g)
+/* Start a thread walking the guest in handle 'g'. */
+static struct guest *
+start_guest (guestfs_h *g)
 {
-  struct tree *t = malloc (sizeof *t);
+  struct guest *t = malloc (sizeof *t);
+  int err;
 
-  if (t == NULL) {
-    perror ("malloc");
-    return NULL;
-  }
+  if (t == NULL)
+    error (EXIT_FAILURE, errno, "malloc");
 
   t->g = g;
-  t->files = NULL;
-  t->nr_files = t->allocated = 0;
+  t->nr_files = 0;
+  t->head = t->count = 0;
+  t->done = 0;
+  t->r = -1;
+
+  err = pthread_mutex_init (&t->handle_lock, NULL);
+  if (err != 0)
+    error (EXIT_FAILURE, err, "pthread_mutex_init");
+
+  err = pthread_create (&t->thread, NULL, visit_guest, t);
+  if (err != 0)
+    error (EXIT_FAILURE, err, "pthread_create");
 
-  if (visit (g, "/", visit_entry, t) == -1) {
-    free_tree (t);
-    return NULL;
+  return t;
+}
+
+/* Wait for the thread to finish and free the remaining entries.
+ * Returns the result of visiting the guest.
+ */
+static int
+finish_guest (struct guest *t)
+{
+  const int err = pthread_join (t->thread, NULL);
+  int r;
+
+  if (err != 0)
+    error (EXIT_FAILURE, err, "pthread_join");
+
+  /* Entries are only left behind if we stopped early. */
+  while (t->count > 0) {
+    free_file (&t->files[t->head]);
+    t->head = (t->head + 1) % QUEUE_SIZE;
+    t->count--;
   }
 
-  if (verbose)
+  pthread_mutex_destroy (&t->handle_lock);
+
+  r = t->r;
+  free (t);
+  return r;
+}
+
+static void *
+visit_guest (void *vt)
+{
+  struct guest *t = vt;
+  int r;
+
+  lock (&t->handle_lock);
+  r = visit (t->g, "/", visit_entry, t);
+  unlock (&t->handle_lock);
+
+  if (r == 0 && verbose)
     fprintf (stderr, "read %zu entries from guest\n", t->nr_files);
 
-  return t;
+  lock (&queue_lock);
+  t->done = 1;
+  t->r = r;
+  if (r == -1)
+    quit = 1;
+  wake_queue ();
+  unlock (&queue_lock);
+
+  return NULL;
 }
 
-/* Visit each directory/file/etc entry in the tree.  This just stores
- * the data in the tree.  Note we don't store file content, but we
- * keep the guestfs handle open so we can pull that out later if we
- * need to.
+/* Visit each directory/file/etc entry in the tree.  This just queues
+ * the data for diff_guests.  Note we don't store file content, but
+ * we keep the guestfs handle open so we can pull that out later if
+ * we need to.
  */
 static int
 visit_entry (const char *dir, const char *name,
@@ -464,163 +587,429 @@ visit_entry (const char *dir, const char *name,
              const struct guestfs_xattr_list *xattrs_orig,
              void *vt)
 {
-  struct tree *t = vt;
-  char *path = NULL, *csum = NULL;
-  struct guestfs_statns *stat = NULL;
-  struct guestfs_xattr_list *xattrs = NULL;
-  size_t i;
+  struct guest *t = vt;
+  struct file file = { .path = NULL };
+  int waited = 0, stopped;
 
-  path = full_path (dir, name);
+  file.path = full_path (dir, name);
 
   /* Copy the stats and xattrs because the visit function will
    * free them after we return.
    */
-  stat = guestfs_copy_statns (stat_orig);
-  if (stat == NULL) {
+  file.stat = guestfs_copy_statns (stat_orig);
+  if (file.stat == NULL) {
     perror ("guestfs_copy_stat");
     goto error;
   }
-  xattrs = guestfs_copy_xattr_list (xattrs_orig);
-  if (xattrs == NULL) {
+  file.xattrs = guestfs_copy_xattr_list (xattrs_orig);
+  if (file.xattrs == NULL) {
     perror ("guestfs_copy_xattr_list");
     goto error;
   }
 
-  if (checksum && is_reg (stat->st_mode)) {
-    csum = guestfs_checksum (t->g, checksum, path);
-    if (!csum)
+  /* With --lazy-checksum, diff_guests gets the checksums later, only
+   * for the files which need them.
+   */
+  if (checksum && !lazy_checksum && is_reg (file.stat->st_mode)) {
+    file.csum = guestfs_checksum (t->g, checksum, file.path);
+    if (!file.csum)
       goto error;
   }
 
+  /* Read the link now, while we have the handle, so that displaying
+   * the entry doesn't need it.
+   *
+   * XXX Fix this for NTFS.
+   */
+  if (is_lnk (file.stat->st_mode))
+    file.link = guestfs_readlink (t->g, file.path);
+
   /* If --atime option was NOT passed, flatten the atime field. */
   if (!atime)
-    stat->st_atime_sec = stat->st_atime_nsec = 0;
+    file.stat->st_atime_sec = file.stat->st_atime_nsec = 0;
 
   /* If --dir-links option was NOT passed, flatten nlink field in
    * directories.
    */
-  if (!dir_links && is_dir (stat->st_mode))
-    stat->st_nlink = 0;
+  if (!dir_links && is_dir (file.stat->st_mode))
+    file.stat->st_nlink = 0;
 
   /* If --dir-times option was NOT passed, flatten time fields in
    * directories.
    */
-  if (!dir_times && is_dir (stat->st_mode))
-    stat->st_atime_sec = stat->st_mtime_sec = stat->st_ctime_sec =
-      stat->st_atime_nsec = stat->st_mtime_nsec = stat->st_ctime_nsec = 0;
-
-  /* Add the pathname and stats to the list. */
-  i = t->nr_files++;
-  if (i >= t->allocated) {
-    struct file *old_files = t->files;
-    const size_t old_allocated = t->allocated;
-
-    /* Number of entries in an F15 guest was 111524, and in a
-     * Windows guest was 10709.
-     */
-    if (old_allocated == 0)
-      t->allocated = 1024;
-    else
-      t->allocated = old_allocated * 2;
-
-    t->files = realloc (old_files, t->allocated * sizeof (struct file));
-    if (t->files == NULL) {
-      perror ("realloc");
-      t->files = old_files;
-      t->allocated = old_allocated;
-      goto error;
-    }
+  if (!dir_times && is_dir (file.stat->st_mode))
+    file.stat->st_atime_sec = file.stat->st_mtime_sec =
+      file.stat->st_ctime_sec = file.stat->st_atime_nsec =
+      file.stat->st_mtime_nsec = file.stat->st_ctime_nsec = 0;
+
+  /* Add the entry to the queue, waiting for diff_guests to make
+   * room if necessary.  diff_guests may need our handle to make
+   * progress, so let it have the handle while we wait.
+   */
+  lock (&queue_lock);
+  if (t->count == QUEUE_SIZE && !quit) {
+    unlock (&t->handle_lock);
+    waited = 1;
+    while (t->count == QUEUE_SIZE && !quit)
+      wait_queue ();
+  }
+  stopped = quit;
+  if (!stopped) {
+    t->files[(t->head + t->count) % QUEUE_SIZE] = file;
+    t->count++;
+    t->nr_files++;
+    wake_queue ();
   }
+  unlock (&queue_lock);
 
-  t->files[i].path = path;
-  t->files[i].stat = stat;
-  t->files[i].xattrs = xattrs;
-  t->files[i].csum = csum;
+  if (waited)
+    lock (&t->handle_lock);
+  if (stopped)
+    goto error;
 
   return 0;
 
  error:
-  free (path);
-  free (csum);
-  guestfs_free_statns (stat);
-  guestfs_free_xattr_list (xattrs);
+  free_file (&file);
   return -1;
 }
 
-static void deleted (guestfs_h *, struct file *);
-static void added (guestfs_h *, struct file *);
+/* Get the next entry from the guest, waiting for the thread to read
+ * it if necessary.  Sets '*file_r' to NULL at the end of the guest.
+ * Returns -1 if walking either guest failed.
+ */
+static int
+peek_file (struct guest *t, struct file **file_r)
+{
+  int r = 0;
+
+  lock (&queue_lock);
+  while (!quit && t->count == 0 && !t->done)
+    wait_queue ();
+  if (quit)
+    r = -1;
+  *file_r = t->count > 0 ? &t->files[t->head] : NULL;
+  unlock (&queue_lock);
+
+  return r;
+}
+
+/* Remove the entry returned by peek_file from the queue, and
+ * return it in '*file'.  The caller must free it.
+ */
+static void
+take_file (struct guest *t, struct file *file)
+{
+  lock (&queue_lock);
+  assert (t->count > 0);
+  *file = t->files[t->head];
+  t->head = (t->head + 1) % QUEUE_SIZE;
+  t->count--;
+  wake_queue ();
+  unlock (&queue_lock);
+}
+
+/* Make the threads stop early when diff_guests fails. */
+static void
+stop_guests (void)
+{
+  lock (&queue_lock);
+  quit = 1;
+  wake_queue ();
+  unlock (&queue_lock);
+}
+
+static void deleted (struct file *);
+static void added (struct file *);
 static int compare_stats (struct file *, struct file *);
-static void changed (guestfs_h *, struct file *, guestfs_h *, struct file *, int st, int cst);
-static void diff (struct file *, guestfs_h *, struct file *, guestfs_h *);
-static void output_file (guestfs_h *, struct file *);
+static void changed (struct guest *, struct file *, struct guest *, struct file *, int st, int cst);
+static void diff (struct file *, struct guest *, struct file *, struct guest *);
+static void output_file (struct file *);
+
+/* The result of comparing the next entries from each guest. */
+enum result_type {
+  RESULT_DELETED,              /* 'file1' is only in the first guest. */
+  RESULT_ADDED,                /* 'file2' is only in the second guest. */
+  RESULT_SAME_PATH,            /* Both guests have the path. */
+};
 
+struct result {
+  enum result_type type;
+  struct file file1, file2;
+  int st;                      /* compare_stats, if RESULT_SAME_PATH. */
+};
+
+/* With --lazy-checksum, results are held here until we have the
+ * checksums of the files which need them, so that they are still
+ * printed in order.  The checksums are fetched from each guest in
+ * one call to the daemon when CHECKSUM_BATCH files need them, or when
+ * MAX_PENDING results are waiting.
+ */
+#define MAX_PENDING 1024
+#define CHECKSUM_BATCH 256
+
+static struct result pending[MAX_PENDING];
+static size_t nr_pending = 0, nr_need_checksum = 0;
+
+static int add_result (struct guest *t1, struct guest *t2, struct result *result);
+static int flush_results (struct guest *t1, struct guest *t2);
+static void discard_results (void);
+
+/* Merge the entries from the two guests as the threads read them.
+ * Each thread returns the entries in the same order, so we only ever
+ * need the next entry from each guest.
+ */
 static int
-diff_guests (struct tree *t1, struct tree *t2)
+diff_guests (struct guest *t1, struct guest *t2)
 {
-  struct file *i1 = &t1->files[0];
-  struct file *i2 = &t2->files[0];
-  struct file *end1 = &t1->files[t1->nr_files];
-  struct file *end2 = &t2->files[t2->nr_files];
+  struct file *i1, *i2;
+
+  for (;;) {
+    struct result result = { .st = 0 };
+
+    if (peek_file (t1, &i1) == -1 || peek_file (t2, &i2) == -1) {
+      discard_results ();
+      return -1;
+    }
+    if (i1 == NULL && i2 == NULL)
+      break;
 
-  while (i1 < end1 || i2 < end2) {
-    if (i1 < end1 && i2 < end2) {
+    if (i1 && i2) {
       const int comp = strcmp (i1->path, i2->path);
 
       /* i1->path < i2->path.  i1 catches up with i2 (files deleted) */
       if (comp < 0) {
-        deleted (t1->g, i1);
-        i1++;
+        result.type = RESULT_DELETED;
+        take_file (t1, &result.file1);
       }
       /* i1->path > i2->path.  i2 catches up with i1 (files added) */
       else if (comp > 0) {
-        added (t2->g, i2);
-        i2++;
+        result.type = RESULT_ADDED;
+        take_file (t2, &result.file2);
       }
       /* Otherwise i1->path == i2->path, compare in detail. */
       else {
-        const int st = compare_stats (i1, i2);
-        if (st != 0)
-          changed (t1->g, i1, t2->g, i2, st, 0);
-        else if (i1->csum && i2->csum) {
-          const int cst = strcmp (i1->csum, i2->csum);
-          changed (t1->g, i1, t2->g, i2, 0, cst);
-        }
-        i1++;
-        i2++;
+        result.type = RESULT_SAME_PATH;
+        take_file (t1, &result.file1);
+        take_file (t2, &result.file2);
+        result.st = compare_stats (&result.file1, &result.file2);
       }
     }
     /* Reached end of i2 list (files deleted). */
-    else if (i1 < end1) {
-      deleted (t1->g, i1);
-      i1++;
+    else if (i1) {
+      result.type = RESULT_DELETED;
+      take_file (t1, &result.file1);
     }
     /* Reached end of i1 list (files added). */
     else {
-      added (t2->g, i2);
-      i2++;
+      result.type = RESULT_ADDED;
+      take_file (t2, &result.file2);
+    }
+
+    if (add_result (t1, t2, &result) == -1) {
+      stop_guests ();
+      return -1;
     }
   }
 
+  if (flush_results (t1, t2) == -1) {
+    stop_guests ();
+    return -1;
+  }
+
   output_flush ();
 
   return 0;
 }
 
 static void
-deleted (guestfs_h *g, struct file *file)
+print_result (struct guest *t1, struct guest *t2, struct result *result)
+{
+  switch (result->type) {
+  case RESULT_DELETED:
+    deleted (&result->file1);
+    break;
+
+  case RESULT_ADDED:
+    added (&result->file2);
+    break;
+
+  case RESULT_SAME_PATH:
+    if (result->st != 0)
+      changed (t1, &result->file1, t2, &result->file2, result->st, 0);
+    else if (result->file1.csum && result->file2.csum) {
+      const int cst = strcmp (result->file1.csum, result->file2.csum);
+      changed (t1, &result->file1, t2, &result->file2, 0, cst);
+    }
+    break;
+  }
+}
+
+static void
+free_result (struct result *result)
+{
+  if (result->type != RESULT_ADDED)
+    free_file (&result->file1);
+  if (result->type != RESULT_DELETED)
+    free_file (&result->file2);
+}
+
+/* Only regular files with the same stats need their checksums
+ * compared.
+ */
+static int
+needs_checksum (const struct result *result)
+{
+  return result->type == RESULT_SAME_PATH && result->st == 0 &&
+    is_reg (result->file1.stat->st_mode);
+}
+
+/* Print the result now, or with --lazy-checksum, add it to the
+ * pending results.
+ */
+static int
+add_result (struct guest *t1, struct guest *t2, struct result *result)
+{
+  if (!lazy_checksum) {
+    print_result (t1, t2, result);
+    free_result (result);
+    return 0;
+  }
+
+  pending[nr_pending++] = *result;
+  if (needs_checksum (result))
+    nr_need_checksum++;
+
+  if (nr_pending == MAX_PENDING || nr_need_checksum == CHECKSUM_BATCH)
+    return flush_results (t1, t2);
+
+  return 0;
+}
+
+/* Get the checksums from guest 't' of the files in the pending
+ * results which need them.  'which' is 1 or 2, selecting 'file1' or
+ * 'file2' of each result.
+ */
+static int
+get_checksums (struct guest *t, int which)
+{
+  CLEANUP_FREE char *tmpdir = NULL, *tmpfile = NULL, *line = NULL;
+  CLEANUP_FREE char **paths = NULL;
+  size_t i, j, allocated = 0;
+  FILE *fp;
+  int fd, r;
+
+  paths = malloc ((nr_need_checksum + 1) * sizeof (char *));
+  if (paths == NULL)
+    error (EXIT_FAILURE, errno, "malloc");
+  for (i = j = 0; i < nr_pending; ++i) {
+    if (needs_checksum (&pending[i]))
+      paths[j++] = which == 1 ? pending[i].file1.path : pending[i].file2.path;
+  }
+  paths[j] = NULL;
+
+  lock (&t->handle_lock);
+
+  tmpdir = guestfs_get_tmpdir (t->g);
+  if (tmpdir == NULL) {
+    unlock (&t->handle_lock);
+    return -1;
+  }
+  if (asprintf (&tmpfile, "%s/virtdiffXXXXXX", tmpdir) < 0)
+    error (EXIT_FAILURE, errno, "asprintf");
+  fd = mkstemp (tmpfile);
+  if (fd == -1)
+    error (EXIT_FAILURE, errno, "mkstemp: %s", tmpfile);
+  close (fd);
+
+  r = guestfs_internal_checksums_out (t->g, checksum, paths, tmpfile);
+
+  unlock (&t->handle_lock);
+
+  if (r == -1) {
+    unlink (tmpfile);
+    return -1;
+  }
+
+  fp = fopen (tmpfile, "r");
+  if (fp == NULL)
+    error (EXIT_FAILURE, errno, "fopen: %s", tmpfile);
+  unlink (tmpfile);
+
+  /* There is one line for each file, in the same order. */
+  for (i = 0; i < nr_pending; ++i) {
+    struct file *file;
+    ssize_t len;
+
+    if (!needs_checksum (&pending[i]))
+      continue;
+    file = which == 1 ? &pending[i].file1 : &pending[i].file2;
+
+    len = getline (&line, &allocated, fp);
+    if (len > 0 && line[len-1] == '\n')
+      line[--len] = '\0';
+    if (len <= 0) {
+      fprintf (stderr, _("%s: cannot compute the checksum of %s\n"),
+               getprogname (), file->path);
+      fclose (fp);
+      return -1;
+    }
+
+    file->csum = strdup (line);
+    if (file->csum == NULL)
+      error (EXIT_FAILURE, errno, "strdup");
+  }
+
+  fclose (fp);
+  return 0;
+}
+
+/* Get the checksums needed by the pending results, and print them. */
+static int
+flush_results (struct guest *t1, struct guest *t2)
+{
+  size_t i;
+
+  if (nr_need_checksum > 0 &&
+      (get_checksums (t1, 1) == -1 || get_checksums (t2, 2) == -1)) {
+    discard_results ();
+    return -1;
+  }
+
+  for (i = 0; i < nr_pending; ++i) {
+    print_result (t1, t2, &pending[i]);
+    free_result (&pending[i]);
+  }
+  nr_pending = nr_need_checksum = 0;
+
+  return 0;
+}
+
+static void
+discard_results (void)
+{
+  size_t i;
+
+  for (i = 0; i < nr_pending; ++i)
+    free_result (&pending[i]);
+  nr_pending = nr_need_checksum = 0;
+}
+
+static void
+deleted (struct file *file)
 {
   output_start_line ();
   output_string ("-");
-  output_file (g, file);
+  output_file (file);
   output_end_line ();
 }
 
 static void
-added (guestfs_h *g, struct file *file)
+added (struct file *file)
 {
   output_start_line ();
   output_string ("+");
-  output_file (g, file);
+  output_file (file);
   output_end_line ();
 }
 
@@ -641,8 +1030,8 @@ compare_stats (struct file *file1, struct file *file2)
 }
 
 static void
-changed (guestfs_h *g1, struct file *file1,
-         guestfs_h *g2, struct file *file2,
+changed (struct guest *t1, struct file *file1,
+         struct guest *t2, struct file *file2,
          int st, int cst)
 {
   /* Did file content change? */
@@ -653,13 +1042,13 @@ changed (guestfs_h *g1, struct file *file1,
         file1->stat->st_size != file2->stat->st_size))) {
     output_start_line ();
     output_string ("=");
-    output_file (g1, file1);
+    output_file (file1);
     output_end_line ();
 
     if (!csv) {
       /* Display file changes. */
       output_flush ();
-      diff (file1, g1, file2, g2);
+      diff (file1, t1, file2, t2);
     }
   }
 
@@ -667,11 +1056,11 @@ changed (guestfs_h *g1, struct file *file1,
   else if (st != 0) {
     output_start_line ();
     output_string ("-");
-    output_file (g1, file1);
+    output_file (file1);
     output_end_line ();
     output_start_line ();
     output_string ("+");
-    output_file (g2, file2);
+    output_file (file2);
     output_end_line ();
 
     /* Display stats fields that changed. */
@@ -700,59 +1089,54 @@ changed (guestfs_h *g1, struct file *file1,
   }
 }
 
+/* Files larger than this are reported as differing without being
+ * compared line by line.
+ */
+#define MAX_DIFF_SIZE (1024 * 1024)
+
 /* Run a diff on two files. */
 static void
-diff (struct file *file1, guestfs_h *g1, struct file *file2, guestfs_h *g2)
+diff (struct file *file1, struct guest *t1, struct file *file2, struct guest *t2)
 {
-  CLEANUP_FREE char *tmpdir = guestfs_get_tmpdir (g1);
-  CLEANUP_FREE char *tmpd, *tmpda = NULL, *tmpdb = NULL, *cmd = NULL;
-  int r;
+  CLEANUP_FREE char *buf1 = NULL, *buf2 = NULL;
+  size_t size1, size2;
 
   assert (is_reg (file1->stat->st_mode));
   assert (is_reg (file2->stat->st_mode));
 
-  if (asprintf (&tmpd, "%s/virtdiffXXXXXX", tmpdir) < 0)
-    error (EXIT_FAILURE, errno, "asprintf");
-  if (mkdtemp (tmpd) == NULL)
-    error (EXIT_FAILURE, errno, "mkdtemp");
-
-  if (asprintf (&tmpda, "%s/a", tmpd) < 0 ||
-      asprintf (&tmpdb, "%s/b", tmpd) < 0)
-    error (EXIT_FAILURE, errno, "asprintf");
-
-  if (guestfs_download (g1, file1->path, tmpda) == -1)
-    goto out;
-  if (guestfs_download (g2, file2->path, tmpdb) == -1)
-    goto out;
-
-  /* Note that the tmpdir is safe, and the rest of the path
-   * should not need quoting.
-   */
-  if (asprintf (&cmd, "diff -u '%s' '%s' | tail -n +3", tmpda, tmpdb) < 0)
-    error (EXIT_FAILURE, errno, "asprintf");
-
-  if (verbose)
-    fprintf (stderr, "%s\n", cmd);
-  r = system (cmd);
-  if (!WIFEXITED (r) || WEXITSTATUS (r) != 0) {
-    fprintf (stderr, _("%s: external diff command failed\n"), getprogname ());
-    goto out;
+  if (file1->stat->st_size > MAX_DIFF_SIZE ||
+      file2->stat->st_size > MAX_DIFF_SIZE) {
+    printf ("@@ %s @@\n", _("Large files differ"));
+    goto end;
   }
 
-  printf ("@@ %s @@\n", _("End of diff"));
+  /* The threads may still be using the handles. */
+  lock (&t1->handle_lock);
+  buf1 = guestfs_read_file (t1->g, file1->path, &size1);
+  unlock (&t1->handle_lock);
+  if (buf1 == NULL)
+    return;
+  lock (&t2->handle_lock);
+  buf2 = guestfs_read_file (t2->g, file2->path, &size2);
+  unlock (&t2->handle_lock);
+  if (buf2 == NULL)
+    return;
+
+  /* Like diff(1), treat files containing NUL bytes as binary. */
+  if (memchr (buf1, 0, size1) != NULL || memchr (buf2, 0, size2) != NULL)
+    printf ("@@ %s @@\n", _("Binary files differ"));
+  else
+    print_unified_diff (buf1, size1, buf2, size2);
 
- out:
-  unlink (tmpda);
-  unlink (tmpdb);
-  rmdir (tmpd);
+ end:
+  printf ("@@ %s @@\n", _("End of diff"));
 }
 
 static void
-output_file (guestfs_h *g, struct file *file)
+output_file (struct file *file)
 {
   const char *filetype;
   size_t i;
-  CLEANUP_FREE char *link = NULL;
 
   if (is_reg (file->stat->st_mode))
     filetype = "-";
@@ -802,12 +1186,8 @@ output_file (guestfs_h *g, struct file *file)
 
   output_string (file->path);
 
-  if (is_lnk (file->stat->st_mode)) {
-    /* XXX Fix this for NTFS. */
-    link = guestfs_readlink (g, file->path);
-    if (link)
-      output_string_link (link);
-  }
+  if (file->link)
+    output_string_link (file->link);
 
   if (enable_xattrs) {
     for (i = 0; i < file->xattrs->len; ++i) {
@@ -0,0 +1,381 @@
+/* virt-diff
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * This file prints the differences between two files held in memory
+ * as unified diff hunks, in the same format as S<C<diff -u>> (without
+ * the two header lines).
+ *
+ * The differences are found using the linear space variant of the
+ * algorithm in Eugene W. Myers, "An O(ND) Difference Algorithm and
+ * Its Variations", Algorithmica 1(2), 1986.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <error.h>
+#include <sys/types.h>
+
+#include "udiff.h"
+
+/* Number of lines of context around each change. */
+#define CONTEXT 3
+
+/* Limit on the number of differences we search for when splitting a
+ * range.  This bounds the time taken on very different files, at the
+ * cost of the diff perhaps not being minimal.
+ */
+#define MAX_COST 1024
+
+struct line {
+  const char *p;
+  size_t len;                   /* Length, including any final \n. */
+  uint64_t hash;
+};
+
+struct file {
+  struct line *lines;
+  size_t nr_lines;
+  char *changed;                /* Set for lines deleted or inserted. */
+};
+
+struct context {
+  struct file a, b;
+  ssize_t *v;                   /* Scratch space for the split. */
+};
+
+static void
+split_lines (struct file *f, const char *buf, size_t len)
+{
+  size_t i, n = 0;
+  const char *p, *end = buf + len;
+
+  for (p = buf; p < end; ++p)
+    if (*p == '\n')
+      n++;
+  if (len > 0 && buf[len-1] != '\n')
+    n++;
+
+  f->lines = malloc ((n + 1) * sizeof (struct line));
+  f->changed = calloc (n + 1, 1);
+  if (f->lines == NULL || f->changed == NULL)
+    error (EXIT_FAILURE, errno, "malloc");
+  f->nr_lines = n;
+
+  for (i = 0, p = buf; i < n; ++i) {
+    const char *nl = memchr (p, '\n', end - p);
+    const char *q = nl ? nl + 1 : end;
+    uint64_t hash = 14695981039346656037ULL; /* FNV-1a */
+    const char *r;
+
+    for (r = p; r < q; ++r)
+      hash = (hash ^ (unsigned char) *r) * 1099511628211ULL;
+
+    f->lines[i].p = p;
+    f->lines[i].len = q - p;
+    f->lines[i].hash = hash;
+    p = q;
+  }
+}
+
+static int
+equal (const struct context *c, size_t i, size_t j)
+{
+  const struct line *a = &c->a.lines[i];
+  const struct line *b = &c->b.lines[j];
+
+  return a->hash == b->hash && a->len == b->len &&
+    memcmp (a->p, b->p, a->len) == 0;
+}
+
+static void
+mark_changed (struct file *f, size_t off, size_t lim)
+{
+  memset (&f->changed[off], 1, lim - off);
+}
+
+/* Find the point to split a[off1..lim1) and b[off2..lim2) at, by
+ * searching forward from the start and backward from the end at the
+ * same time until the two searches meet (the "middle snake").
+ *
+ * If the ranges differ by more than MAX_COST, we give up and split at
+ * the furthest point the forward search reached.  This is always on
+ * some path from the start, so the result is still correct.
+ */
+static void
+split (struct context *c, size_t off1, size_t lim1, size_t off2, size_t lim2,
+       size_t *x_r, size_t *y_r)
+{
+  const ssize_t n = lim1 - off1, m = lim2 - off2;
+  const ssize_t delta = n - m;
+  const int odd = delta & 1;
+  ssize_t max_d = (n + m + 1) / 2;
+  ssize_t *v1, *v2, d, k, v_length;
+  ssize_t k1start = 0, k1end = 0, k2start = 0, k2end = 0;
+  ssize_t best_x = 0, best_y = 0;
+
+  if (max_d > MAX_COST)
+    max_d = MAX_COST;
+
+  /* v1[k] is the furthest x reached by the forward search on the
+   * diagonal k = x - y.  v2 is the same for the backward search,
+   * counting from the ends of the ranges.  Both are indexed from
+   * -max_d.
+   */
+  v_length = 2*max_d + 2;
+  v1 = c->v;
+  v2 = c->v + v_length;
+  for (k = 0; k < v_length; ++k)
+    v1[k] = v2[k] = -1;
+  v1 += max_d;
+  v2 += max_d;
+  v1[1] = v2[1] = 0;
+
+  for (d = 0; d < max_d; ++d) {
+    for (k = -d + k1start; k <= d - k1end; k += 2) {
+      ssize_t x, y;
+
+      if (k == -d || (k != d && v1[k-1] < v1[k+1]))
+        x = v1[k+1];
+      else
+        x = v1[k-1] + 1;
+      y = x - k;
+      while (x < n && y < m && equal (c, off1+x, off2+y))
+        x++, y++;
+      v1[k] = x;
+
+      if (x > n)                /* Ran off the right of the grid. */
+        k1end += 2;
+      else if (y > m)           /* Ran off the bottom of the grid. */
+        k1start += 2;
+      else {
+        if (x + y > best_x + best_y) {
+          best_x = x;
+          best_y = y;
+        }
+        if (odd && delta - k >= -max_d && delta - k < max_d + 2 &&
+            v2[delta-k] != -1 && x >= n - v2[delta-k]) {
+          *x_r = off1 + x;
+          *y_r = off2 + y;
+          return;
+        }
+      }
+    }
+
+    for (k = -d + k2start; k <= d - k2end; k += 2) {
+      ssize_t x, y;
+
+      if (k == -d || (k != d && v2[k-1] < v2[k+1]))
+        x = v2[k+1];
+      else
+        x = v2[k-1] + 1;
+      y = x - k;
+      while (x < n && y < m && equal (c, lim1-x-1, lim2-y-1))
+        x++, y++;
+      v2[k] = x;
+
+      if (x > n)
+        k2end += 2;
+      else if (y > m)
+        k2start += 2;
+      else if (!odd && delta - k >= -max_d && delta - k < max_d + 2 &&
+               v1[delta-k] != -1 && v1[delta-k] >= n - x) {
+        /* Split at the end of the forward search on this diagonal. */
+        *x_r = off1 + v1[delta-k];
+        *y_r = off2 + v1[delta-k] - (delta-k);
+        return;
+      }
+    }
+  }
+
+  *x_r = off1 + best_x;
+  *y_r = off2 + best_y;
+}
+
+/* Mark the lines which differ between a[off1..lim1) and
+ * b[off2..lim2).
+ */
+static void
+compare (struct context *c, size_t off1, size_t lim1, size_t off2, size_t lim2)
+{
+  size_t x, y;
+
+  /* Skip the common prefix and suffix. */
+  while (off1 < lim1 && off2 < lim2 && equal (c, off1, off2))
+    off1++, off2++;
+  while (off1 < lim1 && off2 < lim2 && equal (c, lim1-1, lim2-1))
+    lim1--, lim2--;
+
+  if (off1 == lim1)
+    mark_changed (&c->b, off2, lim2);
+  else if (off2 == lim2)
+    mark_changed (&c->a, off1, lim1);
+  else {
+    split (c, off1, lim1, off2, lim2, &x, &y);
+    if ((x == off1 && y == off2) || (x == lim1 && y == lim2)) {
+      /* Shouldn't happen, but make sure we don't loop. */
+      mark_changed (&c->a, off1, lim1);
+      mark_changed (&c->b, off2, lim2);
+    }
+    else {
+      compare (c, off1, x, off2, y);
+      compare (c, x, lim1, y, lim2);
+    }
+  }
+}
+
+static void
+print_range (size_t start, size_t count)
+{
+  int r;
+
+  if (count == 0)
+    r = printf ("%zu,0", start);
+  else if (count == 1)
+    r = printf ("%zu", start + 1);
+  else
+    r = printf ("%zu,%zu", start + 1, count);
+  if (r < 0)
+    error (EXIT_FAILURE, errno, "printf");
+}
+
+static void
+print_line (char prefix, const struct line *line)
+{
+  if (putchar (prefix) == EOF ||
+      fwrite (line->p, 1, line->len, stdout) != line->len)
+    error (EXIT_FAILURE, errno, "fwrite");
+  if (line->len == 0 || line->p[line->len-1] != '\n') {
+    if (printf ("\n\\ No newline at end of file\n") < 0)
+      error (EXIT_FAILURE, errno, "printf");
+  }
+}
+
+/* Print the hunk covering a[start1..end1) and b[start2..end2). */
+static void
+print_hunk (const struct context *c,
+            size_t start1, size_t end1, size_t start2, size_t end2)
+{
+  size_t i = start1, j = start2;
+
+  if (printf ("@@ -") < 0)
+    error (EXIT_FAILURE, errno, "printf");
+  print_range (start1, end1 - start1);
+  if (printf (" +") < 0)
+    error (EXIT_FAILURE, errno, "printf");
+  print_range (start2, end2 - start2);
+  if (printf (" @@\n") < 0)
+    error (EXIT_FAILURE, errno, "printf");
+
+  while (i < end1 || j < end2) {
+    if ((i < end1 && c->a.changed[i]) || (j < end2 && c->b.changed[j])) {
+      while (i < end1 && c->a.changed[i])
+        print_line ('-', &c->a.lines[i++]);
+      while (j < end2 && c->b.changed[j])
+        print_line ('+', &c->b.lines[j++]);
+    }
+    else {
+      print_line (' ', &c->a.lines[i]);
+      i++, j++;
+    }
+  }
+}
+
+/* Group the changes into hunks, joining changes which are separated
+ * by no more than 2*CONTEXT unchanged lines, and print them.
+ */
+static void
+print_hunks (const struct context *c)
+{
+  const size_t n = c->a.nr_lines, m = c->b.nr_lines;
+  size_t i = 0, j = 0;
+  int in_hunk = 0;
+  size_t start1 = 0, start2 = 0, last1 = 0, last2 = 0;
+
+  for (;;) {
+    size_t i0, j0;
+
+    /* Skip unchanged lines, which are in step in both files. */
+    while (i < n && j < m && !c->a.changed[i] && !c->b.changed[j])
+      i++, j++;
+    if (i == n && j == m)
+      break;
+
+    /* Start of a change. */
+    i0 = i;
+    j0 = j;
+    while (i < n && c->a.changed[i])
+      i++;
+    while (j < m && c->b.changed[j])
+      j++;
+
+    if (in_hunk && i0 - last1 > 2*CONTEXT) {
+      print_hunk (c, start1, last1 + CONTEXT, start2, last2 + CONTEXT);
+      in_hunk = 0;
+    }
+    if (!in_hunk) {
+      const size_t before = i0 < CONTEXT ? i0 : CONTEXT;
+      start1 = i0 - before;
+      start2 = j0 - before;
+      in_hunk = 1;
+    }
+    last1 = i;
+    last2 = j;
+  }
+
+  if (in_hunk) {
+    const size_t after1 = n - last1 < CONTEXT ? n - last1 : CONTEXT;
+    print_hunk (c, start1, last1 + after1, start2, last2 + after1);
+  }
+}
+
+/**
+ * Print the differences between the buffers C<a> and C<b> (of
+ * lengths C<alen> and C<blen>) to stdout as unified diff hunks.
+ * Nothing is printed if they are the same.
+ */
+void
+print_unified_diff (const char *a, size_t alen, const char *b, size_t blen)
+{
+  struct context c;
+  size_t cost;
+
+  split_lines (&c.a, a, alen);
+  split_lines (&c.b, b, blen);
+
+  cost = (c.a.nr_lines + c.b.nr_lines + 1) / 2;
+  if (cost > MAX_COST)
+    cost = MAX_COST;
+  c.v = malloc ((4*cost + 4) * sizeof (ssize_t));
+  if (c.v == NULL)
+    error (EXIT_FAILURE, errno, "malloc");
+
+  compare (&c, 0, c.a.nr_lines, 0, c.b.nr_lines);
+  print_hunks (&c);
+
+  free (c.v);
+  free (c.a.lines);
+  free (c.a.changed);
+  free (c.b.lines);
+  free (c.b.changed);
+}
@@ -83,6 +83,7 @@ usage (int status)
               "  --keys-from-stdin     Read passphrases from stdin\n"
               "  -m|--mount dev[:mnt[:opts[:fstype]]]\n"
               "                        Mount dev on mnt (if omitted, /)\n"
+              "  --sizing type         Size the appliance automatically\n"
               "  -v|--verbose          Verbose messages\n"
               "  -V|--version          Display version and exit\n"
               "  -x                    Trace libguestfs API calls\n"
@@ -120,6 +121,7 @@ main (int argc, char *argv[])
     { "long-options", 0, 0, 0 },
     { "mount", 1, 0, 'm' },
     { "short-options", 0, 0, 0 },
+    { "sizing", 1, 0, 0 },
     { "verbose", 0, 0, 'v' },
     { "version", 0, 0, 'V' },
     { 0, 0, 0, 0 }
@@ -154,6 +156,8 @@ main (int argc, char *argv[])
         echo_keys = 1;
       } else if (STREQ (long_options[option_index].name, "format")) {
         OPTION_format;
+      } else if (STREQ (long_options[option_index].name, "sizing")) {
+        OPTION_sizing;
       } else
         error (EXIT_FAILURE, 0,
                _("unknown long option: %s (%d)"),
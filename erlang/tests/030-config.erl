@@ -38,4 +38,24 @@ main(_) ->
 
     ok = guestfs:add_drive(G, "/dev/null"),
 
-    ok = guestfs:close(G).
+    % Asynchronous calls.
+    Ref = guestfs:set_verbose_async(G, true),
+    receive {guestfs, Ref, ok} -> ok end,
+    true = guestfs:get_verbose(G),
+
+    ok = guestfs:close(G),
+
+    % A pool of two handles.
+    {ok, Pool} = guestfs:create_pool(2),
+    {ok, G1} = guestfs:checkout(Pool),
+    {ok, G2} = guestfs:checkout(Pool),
+    true = G1 /= G2,
+    Ref2 = guestfs:checkout_async(Pool),
+    ok = guestfs:set_trace(G1, true),
+    ok = guestfs:checkin(Pool, G1),
+    receive {guestfs_pool, Ref2, {ok, G1}} -> ok end,
+    true = guestfs:get_trace(G1),
+    ok = guestfs:checkin(Pool, G1),
+    ok = guestfs:checkin(Pool, G2),
+    true = guestfs:with_handle(Pool, fun(G3) -> guestfs:get_autosync(G3) end),
+    ok = guestfs:close_pool(Pool).
@@ -27,6 +27,9 @@ struct command_entry {
   const char *help;             /* Online help. */
   const char *synopsis;         /* Synopsis. */
 
+  /* Can be submitted without waiting for the reply (--pipeline). */
+  int pipeline;
+
   /* The run_* function. */
   int (*run) (const char *cmd, size_t argc, char *argv[]);
 };
@@ -52,15 +52,16 @@ run_copy_in (const char *cmd, size_t argc, char *argv[])
 
   const int nr_locals = argc-1;
 
-  /* Upload each local one at a time using copy-in. */
-  int i;
-  for (i = 0; i < nr_locals; ++i) {
-    int r = guestfs_copy_in (g, argv[i], remote);
-    if (r == -1)
-      return -1;
+  /* Upload all the locals in a single tar stream. */
+  CLEANUP_FREE char **locals = malloc ((nr_locals+1) * sizeof (char *));
+  if (locals == NULL) {
+    perror ("malloc");
+    return -1;
   }
+  memcpy (locals, argv, nr_locals * sizeof (char *));
+  locals[nr_locals] = NULL;
 
-  return 0;
+  return guestfs_copy_in_multiple (g, locals, remote);
 }
 
 int
@@ -66,6 +66,10 @@ make_mapname (const char *device, char *mapname, size_t len)
  * partitions and decrypt them, then rescan for VGs.  This only works
  * for Fedora whole-disk encryption.  WIP to make this work for other
  * encryption schemes.
+ *
+ * The keys are read first (they may have to be typed in).  Then all
+ * the devices are opened at the same time, so the slow key
+ * derivation of each device runs in parallel in the daemon.
  */
 void
 inspect_do_decrypt (guestfs_h *g)
@@ -74,8 +78,14 @@ inspect_do_decrypt (guestfs_h *g)
   if (partitions == NULL)
     exit (EXIT_FAILURE);
 
-  int need_rescan = 0;
-  size_t i;
+  const size_t nr_partitions = guestfs_int_count_strings (partitions);
+  CLEANUP_FREE int *serials = malloc ((nr_partitions+1) * sizeof (int));
+  if (serials == NULL) {
+    perror ("malloc");
+    exit (EXIT_FAILURE);
+  }
+
+  size_t i, n = 0;
   for (i = 0; partitions[i] != NULL; ++i) {
     CLEANUP_FREE char *type = guestfs_vfs_type (g, partitions[i]);
     if (type && STREQ (type, "crypto_LUKS")) {
@@ -86,14 +96,19 @@ inspect_do_decrypt (guestfs_h *g)
       /* XXX Should we call guestfs_luks_open_ro if readonly flag
        * is set?  This might break 'mount_ro'.
        */
-      if (guestfs_luks_open (g, partitions[i], key, mapname) == -1)
+      serials[n] = guestfs_submit_luks_open (g, partitions[i], key, mapname);
+      if (serials[n] == -1)
         exit (EXIT_FAILURE);
-
-      need_rescan = 1;
+      n++;
     }
   }
 
-  if (need_rescan) {
+  for (i = 0; i < n; ++i) {
+    if (guestfs_wait_luks_open (g, serials[i]) == -1)
+      exit (EXIT_FAILURE);
+  }
+
+  if (n > 0) {
     if (guestfs_vgscan (g) == -1)
       exit (EXIT_FAILURE);
     if (guestfs_vg_activate_all (g, 1) == -1)
@@ -23,6 +23,15 @@
  *
  * It contains the code for both interactive-(editor-)based editing
  * and non-interactive editing using Perl snippets.
+ *
+ * Two things avoid copying whole files across the appliance channel.
+ * Perl snippets which are just a substitution (C<s/regex/repl/>) are
+ * done in the appliance by L<guestfs(3)/guestfs_file_substitute>.
+ * After interactive editing of large files, only the changes are
+ * uploaded: like L<rsync(1)>, the file is split into blocks whose
+ * checksums are saved before editing, the edited file is searched
+ * for those blocks, and the new file is built in the appliance from
+ * the blocks of the old file and the data which was not found.
  */
 
 #include <config.h>
@@ -31,9 +40,12 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <locale.h>
 #include <langinfo.h>
 #include <libintl.h>
@@ -42,12 +54,61 @@
 #include <assert.h>
 #include <utime.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+
+#include "c-ctype.h"
+#include "sha256.h"
 
 #include "guestfs-internal-frontend.h"
 
+/* Files smaller than this are always uploaded in full. */
+#define DELTA_MIN_SIZE (256 * 1024)
+
+/* Give up on the delta if it needs more calls than this, or if more
+ * than half of the new file has to be uploaded anyway.
+ */
+#define DELTA_MAX_OPS 1000
+
+/* Checksums of the blocks of the file before editing. */
+struct block_sum {
+  uint32_t weak;                /* rolling checksum, as in rsync */
+  unsigned char strong[32];     /* SHA-256 */
+  size_t next;                  /* next block in the same hash bucket */
+};
+
+struct signatures {
+  size_t block_size;
+  size_t nr_blocks;
+  struct block_sum *blocks;
+  size_t hash_size;             /* a power of 2 */
+  size_t *hash;                 /* first block in each bucket */
+};
+
+#define NO_BLOCK ((size_t) -1)
+
+static void free_signatures (struct signatures *sigs);
+
+#ifdef HAVE_ATTRIBUTE_CLEANUP
+#define CLEANUP_FREE_SIGNATURES __attribute__((cleanup(cleanup_free_signatures)))
+
+static void
+cleanup_free_signatures (void *ptr)
+{
+  free_signatures (* (struct signatures **) ptr);
+}
+
+#else
+#define CLEANUP_FREE_SIGNATURES
+#endif
+
 static int do_download (guestfs_h *g, const char *filename, char **tempfile);
 static int do_upload (guestfs_h *g, const char *filename, const char *tempfile,
+                      const struct signatures *sigs,
                       const char *backup_extension);
+static struct signatures *make_signatures (const char *tempfile);
+static bool parse_substitution (const char *expr, char **regex_rtn,
+                                char **replacement_rtn,
+                                int *global, int *caseless);
 static char *generate_random_name (const char *filename);
 static char *generate_backup_name (const char *filename,
                                    const char *backup_extension);
@@ -72,6 +133,7 @@ edit_file_editor (guestfs_h *g, const char *filename, const char *editor,
 {
   CLEANUP_UNLINK_FREE char *tmpfilename = NULL;
   CLEANUP_FREE char *cmd = NULL;
+  CLEANUP_FREE_SIGNATURES struct signatures *sigs = NULL;
   struct stat oldstat, newstat;
   int r;
   struct utimbuf times;
@@ -86,6 +148,11 @@ edit_file_editor (guestfs_h *g, const char *filename, const char *editor,
   if (do_download (g, filename, &tmpfilename) == -1)
     return -1;
 
+  /* Remember the blocks of the original, so that only the changes
+   * need to be uploaded.  If this fails, the whole file is uploaded.
+   */
+  sigs = make_signatures (tmpfilename);
+
   /* Set the time back a few seconds on the original file.  This is so
    * that if the user is very fast at editing, or if EDITOR is an
    * automatic editor, then the edit might happen within the 1 second
@@ -135,7 +202,7 @@ edit_file_editor (guestfs_h *g, const char *filename, const char *editor,
       oldstat.st_size == newstat.st_size)
     return 1;
 
-  if (do_upload (g, filename, tmpfilename, backup_extension) == -1)
+  if (do_upload (g, filename, tmpfilename, sigs, backup_extension) == -1)
     return -1;
 
   return 0;
@@ -147,6 +214,9 @@ edit_file_editor (guestfs_h *g, const char *filename, const char *editor,
  * If C<backup_extension> is not null, then a copy of C<filename> is
  * saved with C<backup_extension> appended to its file name.
  *
+ * If C<perl_expr> is a simple substitution, it is done in the
+ * appliance without running Perl.
+ *
  * Returns C<-1> for failure, C<0> on success.
  */
 int
@@ -156,8 +226,41 @@ edit_file_perl (guestfs_h *g, const char *filename, const char *perl_expr,
   CLEANUP_UNLINK_FREE char *tmpfilename = NULL;
   CLEANUP_FREE char *cmd = NULL;
   CLEANUP_FREE char *outfile = NULL;
+  CLEANUP_FREE char *regex = NULL, *replacement = NULL;
+  int global, caseless;
   int r;
 
+  /* guestfs_file_substitute only accepts backup extensions which
+   * cannot move the backup to another directory.
+   */
+  if ((backup_extension == NULL ||
+       (STRNEQ (backup_extension, "") &&
+        strchr (backup_extension, '/') == NULL)) &&
+      parse_substitution (perl_expr, &regex, &replacement,
+                          &global, &caseless)) {
+    struct guestfs_file_substitute_argv optargs = {
+      .bitmask = GUESTFS_FILE_SUBSTITUTE_GLOBAL_BITMASK |
+                 GUESTFS_FILE_SUBSTITUTE_CASELESS_BITMASK,
+      .global = global,
+      .caseless = caseless,
+    };
+
+    if (backup_extension) {
+      optargs.bitmask |= GUESTFS_FILE_SUBSTITUTE_BACKUPEXTENSION_BITMASK;
+      optargs.backupextension = backup_extension;
+    }
+
+    if (verbose)
+      fprintf (stderr, "file-substitute %s %s %s global:%d caseless:%d\n",
+               filename, regex, replacement, global, caseless);
+
+    if (guestfs_file_substitute_argv (g, filename, regex, replacement,
+                                      &optargs) == -1)
+      return -1;
+
+    return 0;
+  }
+
   /* Download the file and write it to a temporary. */
   if (do_download (g, filename, &tmpfilename) == -1)
     return -1;
@@ -202,7 +305,7 @@ edit_file_perl (guestfs_h *g, const char *filename, const char *perl_expr,
     return -1;
   }
 
-  if (do_upload (g, filename, tmpfilename, backup_extension) == -1)
+  if (do_upload (g, filename, tmpfilename, NULL, backup_extension) == -1)
     return -1;
 
   return 0;
@@ -247,12 +350,21 @@ do_download (guestfs_h *g, const char *filename, char **tempfile)
   return 0;
 }
 
+static int upload_delta (guestfs_h *g, const char *filename,
+                         const char *newname, const char *tempfile,
+                         const struct signatures *sigs);
+
+/* If C<sigs> is not C<NULL>, it contains the checksums of the
+ * original file, and only the changes are uploaded if that is worth
+ * it.
+ */
 static int
 do_upload (guestfs_h *g, const char *fn, const char *tempfile,
-           const char *backup_extension)
+           const struct signatures *sigs, const char *backup_extension)
 {
   CLEANUP_FREE char *filename = NULL;
   CLEANUP_FREE char *newname = NULL;
+  int r;
 
   /* Resolve the file name and write to the actual target, since
    * that is the file it was opened earlier; otherwise, if it is
@@ -276,7 +388,10 @@ do_upload (guestfs_h *g, const char *fn, const char *tempfile,
     return -1;
 
   /* Write new content. */
-  if (guestfs_upload (g, tempfile, newname) == -1)
+  r = sigs ? upload_delta (g, filename, newname, tempfile, sigs) : 1;
+  if (r == -1)
+    return -1;
+  if (r == 1 && guestfs_upload (g, tempfile, newname) == -1)
     return -1;
 
   /* Set the permissions, UID, GID and SELinux context of the new
@@ -351,3 +466,458 @@ generate_backup_name (const char *filename, const char *backup_extension)
 
   return ret; /* caller will free */
 }
+
+/* The bucket of the hash table for a weak checksum. */
+static size_t
+bucket (const struct signatures *sigs, uint32_t weak)
+{
+  return ((uint64_t) weak * UINT64_C (0x9E3779B97F4A7C15) >> 32) &
+    (sigs->hash_size - 1);
+}
+
+/* The rolling checksum of rsync, split into its two halves. */
+static void
+weak_sum (const unsigned char *buf, size_t len, uint32_t *a_rtn, uint32_t *b_rtn)
+{
+  uint32_t a = 0, b = 0;
+  size_t i;
+
+  for (i = 0; i < len; ++i) {
+    a += buf[i];
+    b += (len - i) * buf[i];
+  }
+
+  *a_rtn = a & 0xffff;
+  *b_rtn = b & 0xffff;
+}
+
+/* Read the checksums of the blocks of C<tempfile>, before it is
+ * edited.  Returns C<NULL> if the file is too small to be worth it,
+ * or on error.
+ */
+static struct signatures *
+make_signatures (const char *tempfile)
+{
+  struct signatures *sigs = NULL;
+  CLEANUP_FREE unsigned char *buf = NULL;
+  struct stat statbuf;
+  FILE *fp;
+  size_t i, h, bs;
+  uint32_t a, b;
+
+  fp = fopen (tempfile, "r");
+  if (fp == NULL)
+    return NULL;
+
+  if (fstat (fileno (fp), &statbuf) == -1 ||
+      statbuf.st_size < DELTA_MIN_SIZE)
+    goto error;
+
+  /* Like rsync, use blocks of about the square root of the file size. */
+  for (bs = 2048; bs < 128*1024 && bs * bs < (size_t) statbuf.st_size; bs *= 2)
+    ;
+
+  sigs = calloc (1, sizeof *sigs);
+  if (sigs == NULL)
+    goto error;
+  sigs->block_size = bs;
+  sigs->nr_blocks = statbuf.st_size / bs;
+  for (sigs->hash_size = 1; sigs->hash_size < 2 * sigs->nr_blocks;
+       sigs->hash_size *= 2)
+    ;
+  sigs->blocks = malloc (sigs->nr_blocks * sizeof (struct block_sum));
+  sigs->hash = malloc (sigs->hash_size * sizeof (size_t));
+  buf = malloc (bs);
+  if (sigs->blocks == NULL || sigs->hash == NULL || buf == NULL)
+    goto error;
+
+  for (h = 0; h < sigs->hash_size; ++h)
+    sigs->hash[h] = NO_BLOCK;
+
+  for (i = 0; i < sigs->nr_blocks; ++i) {
+    struct block_sum *blk = &sigs->blocks[i];
+
+    if (fread (buf, 1, bs, fp) != bs)
+      goto error;
+    weak_sum (buf, bs, &a, &b);
+    blk->weak = a | b << 16;
+    sha256_buffer ((const char *) buf, bs, blk->strong);
+
+    h = bucket (sigs, blk->weak);
+    blk->next = sigs->hash[h];
+    sigs->hash[h] = i;
+  }
+
+  fclose (fp);
+  return sigs;
+
+ error:
+  fclose (fp);
+  free_signatures (sigs);
+  return NULL;
+}
+
+static void
+free_signatures (struct signatures *sigs)
+{
+  if (sigs) {
+    free (sigs->blocks);
+    free (sigs->hash);
+    free (sigs);
+  }
+}
+
+/* Find a block of the original file with the same content as the
+ * block at C<buf>.  The C<preferred> block (the one after the last
+ * match) is tried first, so that runs of blocks are copied by one
+ * call.  Returns C<NO_BLOCK> if there is none.
+ */
+static size_t
+find_block (const struct signatures *sigs, uint32_t weak,
+            const unsigned char *buf, size_t preferred)
+{
+  unsigned char strong[32];
+  bool have_strong = false;
+  size_t i;
+
+  if (preferred < sigs->nr_blocks && sigs->blocks[preferred].weak == weak) {
+    sha256_buffer ((const char *) buf, sigs->block_size, strong);
+    have_strong = true;
+    if (memcmp (strong, sigs->blocks[preferred].strong, sizeof strong) == 0)
+      return preferred;
+  }
+
+  for (i = sigs->hash[bucket (sigs, weak)]; i != NO_BLOCK;
+       i = sigs->blocks[i].next) {
+    if (sigs->blocks[i].weak != weak)
+      continue;
+    if (!have_strong) {
+      sha256_buffer ((const char *) buf, sigs->block_size, strong);
+      have_strong = true;
+    }
+    if (memcmp (strong, sigs->blocks[i].strong, sizeof strong) == 0)
+      return i;
+  }
+
+  return NO_BLOCK;
+}
+
+/* The new file is built from a list of these. */
+struct delta_op {
+  bool copy;           /* true: copy from the old file, false: upload */
+  uint64_t offset;     /* offset in the old file or in the new file */
+  uint64_t size;
+};
+
+struct delta {
+  struct delta_op *ops;
+  size_t nr_ops;
+  uint64_t upload_size;         /* total size of the uploads */
+};
+
+static int
+add_op (struct delta *delta, bool copy, uint64_t offset, uint64_t size)
+{
+  struct delta_op *op;
+
+  if (size == 0)
+    return 0;
+
+  if (!copy)
+    delta->upload_size += size;
+
+  /* Extend the previous operation if this follows on from it. */
+  if (delta->nr_ops > 0) {
+    op = &delta->ops[delta->nr_ops-1];
+    if (op->copy == copy && op->offset + op->size == offset) {
+      op->size += size;
+      return 0;
+    }
+  }
+
+  op = realloc (delta->ops, (delta->nr_ops+1) * sizeof (struct delta_op));
+  if (op == NULL) {
+    perror ("realloc");
+    return -1;
+  }
+  delta->ops = op;
+  op = &delta->ops[delta->nr_ops++];
+  op->copy = copy;
+  op->offset = offset;
+  op->size = size;
+  return 0;
+}
+
+/* Write C<tempfile> to C<newname> in the guest, copying the blocks
+ * which are the same as in the original C<filename> in the appliance
+ * and uploading only the rest.
+ *
+ * Returns C<0> on success, C<-1> on error, or C<1> if the file should
+ * be uploaded in full instead.
+ */
+static int
+upload_delta (guestfs_h *g, const char *filename, const char *newname,
+              const char *tempfile, const struct signatures *sigs)
+{
+  const size_t bs = sigs->block_size;
+  struct delta delta = { .ops = NULL, .nr_ops = 0, .upload_size = 0 };
+  unsigned char *data = MAP_FAILED;
+  struct stat statbuf;
+  size_t i, size = 0, pos, lit, blk, preferred = NO_BLOCK;
+  uint32_t a = 0, b = 0;
+  bool need_sum = true;
+  int64_t newsize;
+  int fd, ret = 1;
+
+  fd = open (tempfile, O_RDONLY|O_CLOEXEC);
+  if (fd == -1) {
+    perror (tempfile);
+    return -1;
+  }
+  if (fstat (fd, &statbuf) == -1) {
+    perror (tempfile);
+    goto error;
+  }
+  size = statbuf.st_size;
+  if (size < DELTA_MIN_SIZE)
+    goto out;
+  data = mmap (NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED)
+    goto out;
+
+  /* Look for the old blocks at every offset in the new file.  The
+   * data between the matches has to be uploaded.
+   */
+  pos = lit = 0;
+  while (pos + bs <= size) {
+    if (need_sum) {
+      weak_sum (&data[pos], bs, &a, &b);
+      need_sum = false;
+    }
+
+    blk = find_block (sigs, a | b << 16, &data[pos], preferred);
+    if (blk != NO_BLOCK) {
+      if (add_op (&delta, false, lit, pos - lit) == -1 ||
+          add_op (&delta, true, (uint64_t) blk * bs, bs) == -1)
+        goto error;
+      if (delta.nr_ops > DELTA_MAX_OPS)
+        goto out;
+      pos += bs;
+      lit = pos;
+      preferred = blk + 1;
+      need_sum = true;
+      continue;
+    }
+
+    if (pos + bs < size) {
+      a = (a - data[pos] + data[pos+bs]) & 0xffff;
+      b = (b - bs * data[pos] + a) & 0xffff;
+    }
+    pos++;
+  }
+  if (add_op (&delta, false, lit, size - lit) == -1)
+    goto error;
+
+  if (delta.nr_ops > DELTA_MAX_OPS || delta.upload_size > size / 2)
+    goto out;
+
+  /* Build the new file by appending each piece in turn. */
+  if (guestfs_write (g, newname, "", 0) == -1)
+    goto error;
+
+  for (i = 0; i < delta.nr_ops; ++i) {
+    const struct delta_op *op = &delta.ops[i];
+
+    if (op->copy) {
+      struct guestfs_copy_file_to_file_argv optargs = {
+        .bitmask = GUESTFS_COPY_FILE_TO_FILE_SRCOFFSET_BITMASK |
+                   GUESTFS_COPY_FILE_TO_FILE_SIZE_BITMASK |
+                   GUESTFS_COPY_FILE_TO_FILE_APPEND_BITMASK,
+        .srcoffset = op->offset,
+        .size = op->size,
+        .append = 1,
+      };
+
+      if (guestfs_copy_file_to_file_argv (g, filename, newname,
+                                          &optargs) == -1)
+        goto error;
+    }
+    else {
+      if (guestfs_write_append (g, newname, (const char *) &data[op->offset],
+                                op->size) == -1)
+        goto error;
+    }
+  }
+
+  /* If the original file changed since it was downloaded, the
+   * copied blocks may be short.
+   */
+  newsize = guestfs_filesize (g, newname);
+  if (newsize == -1)
+    goto error;
+  if ((uint64_t) newsize != size) {
+    fprintf (stderr, _("%s: file changed while it was being edited\n"),
+             filename);
+    goto error;
+  }
+
+  ret = 0;
+  goto out;
+
+ error:
+  ret = -1;
+ out:
+  if (data != MAP_FAILED)
+    munmap (data, size);
+  close (fd);
+  free (delta.ops);
+  return ret;
+}
+
+/* Variables which Perl would interpolate start with one of these
+ * after the C<$> or C<@>.
+ */
+static bool
+is_perl_variable (char c)
+{
+  return c_isalnum (c) || c == '_' || c == '{' || c == '$' || c == ':';
+}
+
+/**
+ * If C<expr> is a plain substitution C<s/regex/replacement/flags>
+ * which L<guestfs(3)/guestfs_file_substitute> can do, return true and
+ * its arguments.  The caller must free C<*regex_rtn> and
+ * C<*replacement_rtn>.
+ *
+ * Anything else, such as other statements, Perl variables, case
+ * modifiers and flags other than C<g> and C<i>, returns false, and
+ * the expression has to be run by Perl.
+ */
+static bool
+parse_substitution (const char *expr, char **regex_rtn, char **replacement_rtn,
+                    int *global, int *caseless)
+{
+  CLEANUP_FREE char *regex = NULL, *replacement = NULL;
+  const char *p = expr;
+  char delim;
+  size_t i;
+
+  while (c_isspace (*p))
+    p++;
+  if (*p++ != 's')
+    return false;
+  delim = *p++;
+  /* Bracketing and quote delimiters have special rules in Perl. */
+  if (delim == '\0' || strchr ("/#!,:%|", delim) == NULL)
+    return false;
+
+  regex = malloc (strlen (p) + 1);
+  replacement = malloc (2 * strlen (p) + 1);
+  if (regex == NULL || replacement == NULL) {
+    perror ("malloc");
+    return false;
+  }
+
+  /* The regular expression is passed to PCRE as it is. */
+  for (i = 0; *p != delim; p++) {
+    if (*p == '\0')
+      return false;
+    if (*p == '\\') {
+      /* Perl removes the backslash from an escaped delimiter, which
+       * may then be a metacharacter.
+       */
+      if (p[1] == '\0' || (p[1] == delim && delim != '/'))
+        return false;
+      regex[i++] = *p++;
+    }
+    else if (*p == '$') {
+      if (p[1] != delim && p[1] != ')' && p[1] != '|')
+        return false;
+    }
+    else if (*p == '@') {
+      if (is_perl_variable (p[1]))
+        return false;
+    }
+    else if (STRPREFIX (p, "(?{") || STRPREFIX (p, "(??{"))
+      return false;
+    regex[i++] = *p;
+  }
+  regex[i] = '\0';
+  p++;
+
+  /* Turn the replacement into the syntax of guestfs_file_substitute,
+   * where only \N and \\ are special.
+   */
+  for (i = 0; *p != delim; p++) {
+    if (*p == '\0')
+      return false;
+    if (*p == '\\') {
+      p++;
+      if (*p == '\0')
+        return false;
+      else if (*p == 'n')
+        replacement[i++] = '\n';
+      else if (*p == 't')
+        replacement[i++] = '\t';
+      else if (c_isdigit (*p)) {        /* \1 is an old way to write $1 */
+        replacement[i++] = '\\';
+        replacement[i++] = *p;
+      }
+      else if (c_isalpha (*p))          /* \u, \L, \x etc. */
+        return false;
+      else {
+        if (*p == '\\')
+          replacement[i++] = '\\';
+        replacement[i++] = *p;
+      }
+    }
+    else if (*p == '$') {
+      if (c_isdigit (p[1]) && !c_isdigit (p[2])) {
+        replacement[i++] = '\\';
+        replacement[i++] = p[1];
+        p++;
+      }
+      else if (p[1] == '{' && c_isdigit (p[2]) && p[3] == '}') {
+        replacement[i++] = '\\';
+        replacement[i++] = p[2];
+        p += 3;
+      }
+      else if (p[1] == '&') {
+        replacement[i++] = '\\';
+        replacement[i++] = '0';
+        p++;
+      }
+      else
+        return false;
+    }
+    else if (*p == '@' && is_perl_variable (p[1]))
+      return false;
+    else
+      replacement[i++] = *p;
+  }
+  replacement[i] = '\0';
+  p++;
+
+  *global = *caseless = 0;
+  for (; c_isalpha (*p); p++) {
+    if (*p == 'g')
+      *global = 1;
+    else if (*p == 'i')
+      *caseless = 1;
+    else
+      return false;
+  }
+  while (c_isspace (*p))
+    p++;
+  if (*p == ';')
+    p++;
+  while (c_isspace (*p))
+    p++;
+  if (*p != '\0')
+    return false;
+
+  *regex_rtn = regex;
+  *replacement_rtn = replacement;
+  regex = replacement = NULL;
+  return true;
+}
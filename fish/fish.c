@@ -141,11 +141,13 @@ usage (int status)
               "  -n|--no-sync         Don't autosync\n"
               "  --no-dest-paths      Don't tab-complete paths from guest fs\n"
               "  --pipe-error         Pipe commands can detect write errors\n"
+              "  --pipeline           Don't wait for commands which print nothing\n"
               "  --progress-bars      Enable progress bars even when not interactive\n"
               "  --no-progress-bars   Disable progress bars\n"
               "  --remote[=pid]       Send commands to remote %s\n"
               "  -r|--ro              Mount read-only\n"
               "  --selinux            For backwards compat only, does nothing\n"
+              "  --sizing type        Size the appliance automatically\n"
               "  -v|--verbose         Verbose messages\n"
               "  -V|--version         Display version and exit\n"
               "  -w|--rw              Mount read-write\n"
@@ -207,6 +209,7 @@ main (int argc, char *argv[])
     { "no-dest-paths", 0, 0, 0 },
     { "no-sync", 0, 0, 'n' },
     { "pipe-error", 0, 0, 0 },
+    { "pipeline", 0, 0, 0 },
     { "progress-bars", 0, 0, 0 },
     { "no-progress-bars", 0, 0, 0 },
     { "remote", 2, 0, 0 },
@@ -214,6 +217,7 @@ main (int argc, char *argv[])
     { "rw", 0, 0, 'w' },
     { "selinux", 0, 0, 0 },
     { "short-options", 0, 0, 0 },
+    { "sizing", 1, 0, 0 },
     { "verbose", 0, 0, 'v' },
     { "version", 0, 0, 'V' },
     { 0, 0, 0, 0 }
@@ -281,12 +285,16 @@ main (int argc, char *argv[])
         echo_keys = 1;
       } else if (STREQ (long_options[option_index].name, "format")) {
         OPTION_format;
+      } else if (STREQ (long_options[option_index].name, "sizing")) {
+        OPTION_sizing;
       } else if (STREQ (long_options[option_index].name, "csh")) {
         remote_control_csh = 1;
       } else if (STREQ (long_options[option_index].name, "live")) {
         live = 1;
       } else if (STREQ (long_options[option_index].name, "pipe-error")) {
         pipe_error = 1;
+      } else if (STREQ (long_options[option_index].name, "pipeline")) {
+        pipeline = 1;
       } else if (STREQ (long_options[option_index].name, "network")) {
         if (guestfs_set_network (g, 1) == -1)
           exit (EXIT_FAILURE);
@@ -520,6 +528,12 @@ main (int argc, char *argv[])
       error (EXIT_FAILURE, errno, "open: %s", file);
   }
 
+  /* Pipelining only makes sense for scripts, where nobody is waiting
+   * to see the result of each command.
+   */
+  if (is_interactive)
+    pipeline = 0;
+
   /* Get the name of the input file, for error messages, and replace
    * the default error handler.
    */
@@ -557,6 +571,8 @@ main (int argc, char *argv[])
   else
     cmdline (argv, optind, argc);
 
+  pipeline_flush ();
+
   if (guestfs_shutdown (g) == -1)
     exit (EXIT_FAILURE);
 
@@ -1159,6 +1175,9 @@ issue_command (const char *cmd, char *argv[], const char *pipecmd,
   for (argc = 0; argv[argc] != NULL; ++argc)
     ;
 
+  if (pipeline && !remote_control)
+    pipeline_begin_command (cmd, rc_exit_on_error_flag);
+
   /* If --remote was set, then send this command to a remote process. */
   if (remote_control)
     r = rc_remote (remote_control, cmd, argc, argv, rc_exit_on_error_flag);
@@ -93,6 +93,12 @@ extern void prepare_drive (const char *filename, prep_data *data,
 extern void prep_error (prep_data *data, const char *filename, const char *fs, ...) __attribute__((noreturn, format (printf,3,4)));
 extern void free_prep_data (void *data);
 
+/* in pipeline.c */
+extern int pipeline;
+extern int pipeline_flush (void);
+extern void pipeline_begin_command (const char *cmd, int exit_on_error);
+extern void pipeline_add (int serial, int (*wait) (guestfs_h *g, int serial));
+
 /* in prep_lv.c */
 extern int vg_lv_parse (const char *device, char **vg, char **lv);
 
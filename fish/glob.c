@@ -27,9 +27,12 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
 #include <fnmatch.h>
 #include <libintl.h>
 
+#include "xstrtol.h"
+
 #include "fish.h"
 
 /* A bit tricky because in the case where there are multiple
@@ -42,6 +45,7 @@ static int add_strings_matching (char **pp, const char *glob, char ***ret, size_
 static int add_string (const char *str, char ***ret, size_t *size_r);
 static char **single_element_list (const char *element);
 static int glob_issue (char *cmd, size_t argc, char ***globs, size_t *posn, size_t *count, int *r);
+static int glob_in_daemon (const char *cmd, size_t argc, char *argv[], int *r);
 
 int
 run_glob (const char *cmd, size_t argc, char *argv[])
@@ -75,6 +79,9 @@ run_glob (const char *cmd, size_t argc, char *argv[])
     return -1;
   }
 
+  if (glob_in_daemon (argv[0], argc, argv, &r))
+    return r;
+
   /* This array will record the current execution position
    * in the Cartesian product.
    * NB. globs[0], posn[0], count[0] are ignored.
@@ -132,6 +139,59 @@ run_glob (const char *cmd, size_t argc, char *argv[])
   return r;
 }
 
+/**
+ * Some common commands have a variant which takes wildcards and does
+ * the work on all the matches in the daemon, which is a single round
+ * trip instead of one for every match.  If C<cmd> is one of those,
+ * and its path argument is a pathname, run the variant, set C<*r> to
+ * the result and return true.
+ *
+ * As with the other commands, a wildcard which matches nothing is
+ * used as a path unchanged, except by C<rm-f> and C<rm-rf>, which
+ * ignore it in either case.
+ */
+static int
+glob_in_daemon (const char *cmd, size_t argc, char *argv[], int *r)
+{
+  char *patterns[2];
+  long long mode, owner, group;
+  int n = 0;
+
+  /* All the commands here take exactly one path, which is the last
+   * argument.  Other arguments are passed through unexpanded.
+   */
+  if (argc < 2 || argv[argc-1][0] != '/' || STRPREFIX (argv[argc-1], "/dev/"))
+    return 0;
+  patterns[0] = argv[argc-1];
+  patterns[1] = NULL;
+
+  if (argc == 2 && STREQ (cmd, "rm-rf"))
+    n = guestfs_rm_globs (g, patterns, -1);
+  else if (argc == 2 && STREQ (cmd, "rm-f"))
+    n = guestfs_rm_globs (g, patterns, GUESTFS_RM_GLOBS_NORECURSE, 1, -1);
+  else if (argc == 2 && STREQ (cmd, "touch"))
+    n = guestfs_touch_globs (g, patterns);
+  else if (argc == 2 && STREQ (cmd, "cat")) {
+    fflush (stdout);
+    n = guestfs_cat_globs (g, patterns, "/dev/stdout");
+  }
+  else if (argc == 3 && STREQ (cmd, "chmod") &&
+           xstrtoll (argv[1], NULL, 0, &mode, "") == LONGINT_OK &&
+           mode >= 0 && mode <= INT_MAX)
+    n = guestfs_chmod_globs (g, (int) mode, patterns);
+  else if (argc == 4 && STREQ (cmd, "chown") &&
+           xstrtoll (argv[1], NULL, 0, &owner, "") == LONGINT_OK &&
+           xstrtoll (argv[2], NULL, 0, &group, "") == LONGINT_OK &&
+           owner >= INT_MIN && owner <= INT_MAX &&
+           group >= INT_MIN && group <= INT_MAX)
+    n = guestfs_chown_globs (g, (int) owner, (int) group, patterns);
+  else
+    return 0;
+
+  *r = n == -1 ? -1 : 0;
+  return 1;
+}
+
 static char **
 expand_pathname (guestfs_h *g, const char *path)
 {
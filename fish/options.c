@@ -110,6 +110,24 @@ option_d (const char *arg, struct drv **drvsp)
   *drvsp = drv;
 }
 
+/**
+ * The value of the I<--sizing> option, or C<NULL> if it was not
+ * given.  Tools which create more handles pass it on to them.
+ */
+const char *sizing = NULL;
+
+/**
+ * Handle the I<--sizing> option on the command line.  See
+ * L<guestfs(3)/guestfs_set_sizing>.
+ */
+void
+option_sizing (const char *arg)
+{
+  if (guestfs_set_sizing (g, arg) == -1)
+    exit (EXIT_FAILURE);
+  sizing = arg;
+}
+
 char
 add_drives_handle (guestfs_h *g, struct drv *drv, char next_drive)
 {
@@ -34,6 +34,7 @@ extern int inspector;
 extern int keys_from_stdin;
 extern int echo_keys;
 extern const char *libvirt_uri;
+extern const char *sizing;
 
 /* List of drives added via -a, -d or -N options.  NB: Unused fields
  * in this struct MUST be zeroed, ie. use calloc, not malloc.
@@ -132,6 +133,7 @@ extern char *read_key (const char *param);
 /* in options.c */
 extern void option_a (const char *arg, const char *format, struct drv **drvsp);
 extern void option_d (const char *arg, struct drv **drvsp);
+extern void option_sizing (const char *arg);
 extern char add_drives_handle (guestfs_h *g, struct drv *drv, char next_drive);
 #define add_drives(drv, next_drive) add_drives_handle (g, drv, next_drive)
 extern void mount_mps (struct mp *mp);
@@ -206,6 +208,9 @@ extern void free_mps (struct mp *mp);
 #define OPTION_r                                \
   read_only = 1
 
+#define OPTION_sizing                           \
+  option_sizing (optarg)
+
 #define OPTION_v                                \
   verbose++;                                    \
   guestfs_set_verbose (g, verbose)
@@ -0,0 +1,137 @@
+/* guestfish - guest filesystem shell
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Implements the guestfish I<--pipeline> option.
+ *
+ * Commands which don't print anything (such as C<write>, C<chmod>,
+ * C<ln-s>) are sent to the daemon with the C<guestfs_submit_*>
+ * functions and guestfish goes on to the next command without waiting
+ * for the reply.  The replies are collected in order, either when too
+ * many are outstanding or before any other command runs, and errors
+ * are reported against the script line of the command which failed.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "guestfs.h"
+
+#include "fish.h"
+#include "cmds-gperf.h"
+
+/* Collect the oldest reply when this many calls are outstanding. */
+#define MAX_PIPELINE_DEPTH 256
+
+/* A command which has been submitted, but whose reply has not been
+ * collected.
+ */
+struct pending_command {
+  int serial;
+  int (*wait) (guestfs_h *g, int serial);
+  int lineno;                   /* Script line, for error messages. */
+  int exit_on_error;
+};
+
+int pipeline = 0;
+
+static struct pending_command pending[MAX_PIPELINE_DEPTH];
+static size_t first_pending = 0, nr_pending = 0;
+
+/* exit_on_error of the command currently being run. */
+static int command_exit_on_error;
+
+/* Collect the reply to the oldest outstanding command. */
+static int
+collect_one (void)
+{
+  struct pending_command *p = &pending[first_pending];
+  const int saved_lineno = input_lineno;
+  int r;
+
+  first_pending = (first_pending + 1) % MAX_PIPELINE_DEPTH;
+  nr_pending--;
+
+  /* So that errors are reported against the right line. */
+  input_lineno = p->lineno;
+  r = p->wait (g, p->serial);
+  input_lineno = saved_lineno;
+
+  if (r == -1 && p->exit_on_error)
+    exit (EXIT_FAILURE);
+
+  return r;
+}
+
+/**
+ * Wait for all outstanding commands to finish.  Returns C<-1> if any
+ * of them failed (their errors have been printed already).
+ */
+int
+pipeline_flush (void)
+{
+  int ret = 0;
+
+  while (nr_pending > 0) {
+    if (collect_one () == -1)
+      ret = -1;
+  }
+
+  return ret;
+}
+
+/**
+ * Called by C<issue_command> before each command.  Unless the command
+ * can be pipelined this waits for the outstanding commands first, so
+ * the output of commands and the errors from earlier ones appear in
+ * the order of the script.
+ */
+void
+pipeline_begin_command (const char *cmd, int exit_on_error)
+{
+  const struct command_table *ct;
+
+  command_exit_on_error = exit_on_error;
+
+  ct = lookup_fish_command (cmd, strlen (cmd));
+  if (ct == NULL || !ct->entry->pipeline)
+    pipeline_flush ();
+}
+
+/**
+ * Called by the generated C<run_*> functions after submitting a
+ * command with C<guestfs_submit_*>.
+ */
+void
+pipeline_add (int serial, int (*wait) (guestfs_h *g, int serial))
+{
+  struct pending_command *p;
+
+  if (nr_pending == MAX_PIPELINE_DEPTH)
+    collect_one ();
+
+  p = &pending[(first_pending + nr_pending) % MAX_PIPELINE_DEPTH];
+  p->serial = serial;
+  p->wait = wait;
+  p->lineno = input_lineno;
+  p->exit_on_error = command_exit_on_error;
+  nr_pending++;
+}
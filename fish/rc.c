@@ -350,24 +350,47 @@ rc_listen (void)
   /* This returns to 'fish.c', where it jumps to global cleanups and exits. */
 }
 
-/**
- * The remote control client (ie. C<guestfish --remote>).
+/* The client keeps its connection to the server open, so that
+ * scripts which send many commands (eg. "guestfish --remote < script")
+ * only connect once.  Because the server writes to the stdout which
+ * was sent when connecting, we reconnect if stdout changes, which
+ * happens when a command is piped into a shell command.
  */
-int
-rc_remote (int pid, const char *cmd, size_t argc, char *argv[],
-           int exit_on_error)
+static int rc_pid = -1;
+static FILE *rc_in = NULL, *rc_out = NULL;
+static struct stat rc_stdout;
+
+static void
+rc_disconnect (void)
+{
+  if (rc_in)
+    fclose (rc_in);
+  if (rc_out)
+    fclose (rc_out);
+  rc_in = rc_out = NULL;
+  rc_pid = -1;
+}
+
+static int
+stdout_changed (void)
+{
+  struct stat statbuf;
+
+  if (fstat (STDOUT_FILENO, &statbuf) == -1)
+    return 1;
+  return statbuf.st_dev != rc_stdout.st_dev ||
+    statbuf.st_ino != rc_stdout.st_ino;
+}
+
+static int
+rc_connect (int pid)
 {
   guestfish_hello hello;
-  guestfish_call call;
-  guestfish_reply reply;
   char sockpath[UNIX_PATH_MAX];
   struct sockaddr_un addr;
-  int sock;
-  FILE *fp;
+  int sock, sock2;
   XDR xdr;
 
-  memset (&reply, 0, sizeof reply);
-
   /* This is fine as long as we never try to xdr_free this struct. */
   hello.vers = (char *) PACKAGE_VERSION;
 
@@ -393,45 +416,91 @@ rc_remote (int pid, const char *cmd, size_t argc, char *argv[],
   }
 
   send_stdout(sock);
+  if (fstat (STDOUT_FILENO, &rc_stdout) == -1)
+    memset (&rc_stdout, 0, sizeof rc_stdout);
 
-  /* Send the greeting. */
-  fp = fdopen (sock, "r+");
-  xdrstdio_create (&xdr, fp, XDR_ENCODE);
+  /* Separate streams for each direction, since a single stdio stream
+   * cannot switch from reading to writing without seeking.
+   */
+  sock2 = dup (sock);
+  if (sock2 == -1) {
+    perror ("dup");
+    close (sock);
+    return -1;
+  }
+  rc_in = fdopen (sock, "r");
+  rc_out = fdopen (sock2, "w");
+  if (rc_in == NULL || rc_out == NULL) {
+    perror ("fdopen");
+    if (rc_in == NULL)
+      close (sock);
+    if (rc_out == NULL)
+      close (sock2);
+    rc_disconnect ();
+    return -1;
+  }
+  rc_pid = pid;
 
+  /* Send the greeting. */
+  xdrstdio_create (&xdr, rc_out, XDR_ENCODE);
   if (!xdr_guestfish_hello (&xdr, &hello)) {
     fprintf (stderr, _("guestfish: protocol error: could not send initial greeting to server\n"));
     xdr_destroy (&xdr);
-    fclose (fp);
+    rc_disconnect ();
     return -1;
   }
+  xdr_destroy (&xdr);
 
-  /* Send the command.  The server supports reading multiple commands
-   * per connection, but this code only ever sends one command.
-   */
+  return 0;
+}
+
+/**
+ * The remote control client (ie. C<guestfish --remote>).
+ */
+int
+rc_remote (int pid, const char *cmd, size_t argc, char *argv[],
+           int exit_on_error)
+{
+  guestfish_call call;
+  guestfish_reply reply;
+  XDR xdr;
+
+  memset (&reply, 0, sizeof reply);
+
+  if (rc_in != NULL && (rc_pid != pid || stdout_changed ()))
+    rc_disconnect ();
+  if (rc_in == NULL && rc_connect (pid) == -1)
+    return -1;
+
+  /* Send the command. */
   call.cmd = (char *) cmd;
   call.args.args_len = argc;
   call.args.args_val = argv;
   call.exit_on_error = exit_on_error;
-  if (!xdr_guestfish_call (&xdr, &call)) {
-    fprintf (stderr, _("guestfish: protocol error: could not send initial greeting to server\n"));
+  xdrstdio_create (&xdr, rc_out, XDR_ENCODE);
+  if (!xdr_guestfish_call (&xdr, &call) || fflush (rc_out) == EOF) {
+    fprintf (stderr, _("guestfish: protocol error: could not send command to server\n"));
     xdr_destroy (&xdr);
-    fclose (fp);
+    rc_disconnect ();
     return -1;
   }
   xdr_destroy (&xdr);
 
   /* Wait for the reply. */
-  xdrstdio_create (&xdr, fp, XDR_DECODE);
+  xdrstdio_create (&xdr, rc_in, XDR_DECODE);
 
   if (!xdr_guestfish_reply (&xdr, &reply)) {
     fprintf (stderr, _("guestfish: protocol error: could not decode reply from server\n"));
     xdr_destroy (&xdr);
-    fclose (fp);
+    rc_disconnect ();
     return -1;
   }
 
   xdr_destroy (&xdr);
-  fclose (fp);
+
+  /* After 'quit' the server closes the connection. */
+  if (quit)
+    rc_disconnect ();
 
   return reply.r;
 }
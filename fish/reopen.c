@@ -83,6 +83,10 @@ run_reopen (const char *cmd, size_t argc, char *argv[])
   if (r >= 0)
     guestfs_set_pgroup (g2, r);
 
+  p = guestfs_get_sizing (g);
+  if (p)
+    guestfs_set_sizing (g2, p);
+
   if (progress_bars)
     guestfs_set_event_callback (g2, progress_callback,
                                 GUESTFS_EVENT_PROGRESS, 0, NULL);
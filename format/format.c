@@ -84,6 +84,7 @@ usage (int status)
               "  --label=..           Set filesystem label\n"
               "  --lvm=..             Create Linux LVM2 logical volume\n"
               "  --partition=..       Create / set partition type\n"
+              "  --sizing type        Size the appliance automatically\n"
               "  -v|--verbose         Verbose messages\n"
               "  -V|--version         Display version and exit\n"
               "  --wipe               Write zeroes over whole disk\n"
@@ -118,6 +119,7 @@ main (int argc, char *argv[])
     { "lvm", 2, 0, 0 },
     { "partition", 2, 0, 0 },
     { "short-options", 0, 0, 0 },
+    { "sizing", 1, 0, 0 },
     { "verbose", 0, 0, 'v' },
     { "version", 0, 0, 'V' },
     { "wipe", 0, 0, 0 },
@@ -146,6 +148,8 @@ main (int argc, char *argv[])
         display_short_options (options);
       else if (STREQ (long_options[option_index].name, "format")) {
         OPTION_format;
+      } else if (STREQ (long_options[option_index].name, "sizing")) {
+        OPTION_sizing;
       } else if (STREQ (long_options[option_index].name, "filesystem")) {
         if (STREQ (optarg, "none"))
           filesystem = NULL;
@@ -267,6 +271,7 @@ main (int argc, char *argv[])
       g2 = guestfs_create ();
       guestfs_set_verbose (g2, guestfs_get_verbose (g));
       guestfs_set_trace (g2, guestfs_get_trace (g));
+      guestfs_set_sizing (g2, guestfs_get_sizing (g));
 
       if (guestfs_shutdown (g) == -1)
         exit (EXIT_FAILURE);
@@ -341,10 +346,9 @@ do_format (void)
     }
   }
   else /* wipe */ {
-    for (i = 0; devices[i] != NULL; ++i) {
-      if (guestfs_zero_device (g, devices[i]) == -1)
-        exit (EXIT_FAILURE);
-    }
+    /* Zero all the disks at the same time. */
+    if (guestfs_zero_devices (g, devices) == -1)
+      exit (EXIT_FAILURE);
   }
 
   /* Send TRIM/UNMAP to all block devices, to give back the space to
@@ -120,15 +120,19 @@ usage (int status)
               "  --keys-from-stdin    Read passphrases from stdin\n"
               "  --live               Connect to a live virtual machine\n"
               "  -m|--mount dev[:mnt[:opts[:fstype]] Mount dev on mnt (if omitted, /)\n"
+              "  --multithreaded      Handle FUSE requests in several threads\n"
               "  --no-fork            Don't daemonize\n"
               "  -n|--no-sync         Don't autosync\n"
               "  -o|--option opt      Pass extra option to FUSE\n"
               "  --pid-file filename  Write PID to filename\n"
+              "  --prefetch-depth N   Prefetch N levels of directories\n"
               "  -r|--ro              Mount read-only\n"
               "  --selinux            For backwards compat only, does nothing\n"
+              "  --sizing type        Size the appliance automatically\n"
               "  -v|--verbose         Verbose messages\n"
               "  -V|--version         Display version and exit\n"
               "  -w|--rw              Mount read-write\n"
+              "  --writeback          Coalesce writes to files\n"
               "  -x|--trace           Trace guestfs API calls\n"
               ),
             getprogname (), getprogname (),
@@ -167,17 +171,21 @@ main (int argc, char *argv[])
     { "live", 0, 0, 0 },
     { "long-options", 0, 0, 0 },
     { "mount", 1, 0, 'm' },
+    { "multithreaded", 0, 0, 0 },
     { "no-fork", 0, 0, 0 },
     { "no-sync", 0, 0, 'n' },
     { "option", 1, 0, 'o' },
     { "pid-file", 1, 0, 0 },
+    { "prefetch-depth", 1, 0, 0 },
     { "ro", 0, 0, 'r' },
     { "rw", 0, 0, 'w' },
     { "selinux", 0, 0, 0 },
     { "short-options", 0, 0, 0 },
+    { "sizing", 1, 0, 0 },
     { "trace", 0, 0, 'x' },
     { "verbose", 0, 0, 'v' },
     { "version", 0, 0, 'V' },
+    { "writeback", 0, 0, 0 },
     { 0, 0, 0, 0 }
   };
 
@@ -193,6 +201,9 @@ main (int argc, char *argv[])
 
   int debug_calls = 0;
   int dir_cache_timeout = -1;
+  int writeback = 0;
+  int multithreaded = 0;
+  int prefetch_depth = 0;
   int do_fork = 1;
   char *fuse_options = NULL;
   char *pid_file = NULL;
@@ -226,10 +237,18 @@ main (int argc, char *argv[])
         dir_cache_timeout = atoi (optarg);
       else if (STREQ (long_options[option_index].name, "fuse-help"))
         fuse_help ();
+      else if (STREQ (long_options[option_index].name, "writeback"))
+        writeback = 1;
+      else if (STREQ (long_options[option_index].name, "multithreaded"))
+        multithreaded = 1;
+      else if (STREQ (long_options[option_index].name, "prefetch-depth"))
+        prefetch_depth = atoi (optarg);
       else if (STREQ (long_options[option_index].name, "selinux")) {
         /* nothing */
       } else if (STREQ (long_options[option_index].name, "format")) {
         OPTION_format;
+      } else if (STREQ (long_options[option_index].name, "sizing")) {
+        OPTION_sizing;
       } else if (STREQ (long_options[option_index].name, "keys-from-stdin")) {
         keys_from_stdin = 1;
       } else if (STREQ (long_options[option_index].name, "echo-keys")) {
@@ -389,6 +408,18 @@ main (int argc, char *argv[])
     optargs.bitmask |= GUESTFS_MOUNT_LOCAL_OPTIONS_BITMASK;
     optargs.options = fuse_options;
   }
+  if (writeback) {
+    optargs.bitmask |= GUESTFS_MOUNT_LOCAL_WRITEBACK_BITMASK;
+    optargs.writeback = 1;
+  }
+  if (multithreaded) {
+    optargs.bitmask |= GUESTFS_MOUNT_LOCAL_MULTITHREADED_BITMASK;
+    optargs.multithreaded = 1;
+  }
+  if (prefetch_depth > 0) {
+    optargs.bitmask |= GUESTFS_MOUNT_LOCAL_PREFETCHDEPTH_BITMASK;
+    optargs.prefetchdepth = prefetch_depth;
+  }
 
   if (guestfs_mount_local_argv (g, argv[optind], &optargs) == -1)
     exit (EXIT_FAILURE);
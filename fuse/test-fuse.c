@@ -73,7 +73,7 @@ main (int argc, char *argv[])
   const char *s;
   const char *acl_group[] = { "acl", NULL };
   const char *linuxxattrs_group[] = { "linuxxattrs", NULL };
-  int debug_calls, r, res;
+  int debug_calls, writeback, multithreaded, r, res;
   pid_t pid;
   struct sigaction sa;
   char cmd[128];
@@ -115,10 +115,19 @@ main (int argc, char *argv[])
   if (mkdtemp (mountpoint) == NULL)
     exit (EXIT_FAILURE);
 
-  /* Mount the filesystem on the host using FUSE. */
+  /* Mount the filesystem on the host using FUSE.  The same tests are
+   * run in write-back mode by test-fuse-writeback.sh, and in
+   * multi-threaded mode by test-fuse-multithreaded.sh.
+   */
   debug_calls = guestfs_get_trace (g);
+  s = getenv ("TEST_FUSE_WRITEBACK");
+  writeback = s && STRNEQ (s, "");
+  s = getenv ("TEST_FUSE_MULTITHREADED");
+  multithreaded = s && STRNEQ (s, "");
   if (guestfs_mount_local (g, mountpoint,
                            GUESTFS_MOUNT_LOCAL_DEBUGCALLS, debug_calls,
+                           GUESTFS_MOUNT_LOCAL_WRITEBACK, writeback,
+                           GUESTFS_MOUNT_LOCAL_MULTITHREADED, multithreaded,
                            -1) == -1)
     exit (EXIT_FAILURE);
 
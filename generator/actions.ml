@@ -35,7 +35,8 @@ let defaults = { name = "";
                  deprecated_by = None; optional = None;
                  progress = false; camel_name = "";
                  cancellable = false; config_only = false;
-                 once_had_no_optargs = false; blocking = true; wrapper = true;
+                 once_had_no_optargs = false; blocking = true; reentrant = false;
+                 wrapper = true;
                  c_name = ""; c_function = ""; c_optarg_prefix = "";
                  non_c_aliases = [] }
 
@@ -972,7 +973,8 @@ initrd or kernel module(s) instead.
 
   { defaults with
     name = "inspect_os"; added = (1, 5, 3);
-    style = RStringList "roots", [], [];
+    style = RStringList "roots", [], [OBool "defer"];
+    once_had_no_optargs = true;
     shortdesc = "inspect disk and return list of operating systems found";
     longdesc = "\
 This function uses other libguestfs functions and certain
@@ -1003,6 +1005,20 @@ This function cannot decrypt encrypted disks.  The caller
 must do that first (supplying the necessary keys) if the
 disk is encrypted.
 
+If the optional C<defer> flag is true, then the more expensive
+checks are not done here.  The architecture, hostname and
+(for Windows) drive mappings and current control set of each
+operating system are only found when
+C<guestfs_inspect_get_arch>, C<guestfs_inspect_get_hostname>,
+C<guestfs_inspect_get_drive_mappings> or
+C<guestfs_inspect_get_windows_current_control_set> is first
+called for that root.  That call mounts the root filesystem
+read-only if nothing is mounted.  If you have mounted
+filesystems by then, the root filesystem must be the one
+mounted on F</>, otherwise the call fails.  This is
+useful if you only need a few fields, such as the type and
+distro of each operating system.
+
 Please read L<guestfs(3)/INSPECTION> for more details.
 
 See also C<guestfs_list_filesystems>." };
@@ -1804,8 +1820,7 @@ C<guestfs_add_drive_opts>." };
 
   { defaults with
     name = "add_libvirt_dom"; added = (1, 29, 14);
-    style = RInt "nrdisks", [Pointer ("virDomainPtr", "dom")], [OBool "readonly"; OString "iface"; OBool "live"; OString "readonlydisk"; OString "cachemode"; OString "discard"; OBool "copyonread"];
-    config_only = true;
+    style = RInt "nrdisks", [Pointer ("virDomainPtr", "dom")], [OBool "readonly"; OString "iface"; OBool "live"; OString "readonlydisk"; OString "cachemode"; OString "discard"; OBool "copyonread"; OBool "labels"];
     shortdesc = "add the disk(s) from a libvirt domain";
     longdesc = "\
 This function adds the disk(s) attached to the libvirt domain C<dom>.
@@ -1838,6 +1853,14 @@ The optional C<readonlydisk> parameter controls what we do for
 disks which are marked E<lt>readonly/E<gt> in the libvirt XML.
 See C<guestfs_add_domain> for possible values.
 
+If the optional C<labels> flag is true, then each disk is given a
+label (see C<guestfs_add_drive_opts>) which is not used by any other
+drive in the handle, so that it can be removed again with
+C<guestfs_remove_drive>.  C<guestfs_list_disk_labels> returns the
+labels.  The flag is required if the handle has already been launched,
+in which case the disks are hotplugged (see
+L<guestfs(3)/HOTPLUGGING>).
+
 The other optional parameters are passed directly through to
 C<guestfs_add_drive_opts>." };
 
@@ -2353,10 +2376,9 @@ required size.
 
 =item *
 
-Extracting icons from Windows guests requires the external
-C<wrestool> program from the C<icoutils> package, and
-several programs (C<bmptopnm>, C<pnmtopng>, C<pamcut>)
-from the C<netpbm> package.  These must be installed separately.
+Extracting icons from CirrOS guests requires the external
+C<pbmtext> and C<pnmtopng> programs from the C<netpbm> package.
+These must be installed separately.
 
 =item *
 
@@ -2414,7 +2436,7 @@ This returns the number of virtual CPUs assigned to the appliance." };
 
   { defaults with
     name = "mount_local"; added = (1, 17, 22);
-    style = RErr, [String "localmountpoint"], [OBool "readonly"; OString "options"; OInt "cachetimeout"; OBool "debugcalls"];
+    style = RErr, [String "localmountpoint"], [OBool "readonly"; OString "options"; OInt "cachetimeout"; OBool "debugcalls"; OBool "writeback"; OBool "multithreaded"; OInt "prefetchdepth"];
     shortdesc = "mount on the local filesystem";
     longdesc = "\
 This call exports the libguestfs-accessible filesystem to
@@ -2423,18 +2445,44 @@ Ordinary reads and writes to files and directories under
 C<localmountpoint> are redirected through libguestfs.
 
 If the optional C<readonly> flag is set to true, then
-writes to the filesystem return error C<EROFS>.
+writes to the filesystem return error C<EROFS>.  The kernel is
+then allowed to keep the contents and attributes of files in its
+caches (for C<cachetimeout> seconds in the case of the attributes),
+so reading the same files again is served by the host page cache.
+For read-write mounts, the cached contents of a file are dropped
+when it is opened if it has been changed.
 
 C<options> is a comma-separated list of mount options.
 See L<guestmount(1)> for some useful options.
 
 C<cachetimeout> sets the timeout (in seconds) for cached directory
-entries.  The default is 60 seconds.  See L<guestmount(1)>
-for further information.
+entries and file contents.  The default is 60 seconds.  See
+L<guestmount(1)> for further information.
 
 If C<debugcalls> is set to true, then additional debugging
 information is generated for every FUSE call.
 
+If C<writeback> is set to true, then adjacent writes to the same
+open file are coalesced, and written to the appliance when the file
+is flushed or closed, or when more than 2 MB or 5 seconds of writes
+are pending.  This greatly speeds up copying files into the mounted
+filesystem, but errors writing the data are only reported by
+L<close(2)> or L<fsync(2)>.
+
+If C<multithreaded> is set to true, then FUSE requests are handled
+by several threads.  The requests still go to the appliance over
+the one connection, but a thread waiting for a reply no longer
+stops the others from sending their requests or being answered
+from the caches, so several processes reading the filesystem at
+the same time are not serialised behind each other.
+
+If C<prefetchdepth> is greater than C<0>, then reading a directory
+fetches the attributes and listings of the whole tree below it, down
+to that many levels, in a single call to the appliance.  Walking the
+tree afterwards (eg. with L<find(1)> or L<rsync(1)>) is then served
+from the cache.  The default is C<0> (only fetch the directory being
+read).
+
 When C<guestfs_mount_local> returns, the filesystem is ready,
 but is not processing requests (access to it will block).  You
 have to call C<guestfs_mount_local_run> to run the main loop.
@@ -3158,6 +3206,13 @@ L</guestfs_last_errno>) is set to C<EINTR>, so you can test for this
 to find out if the operation was cancelled or failed because of
 another error.
 
+Long-running calls which do not transfer files, such as
+L</guestfs_copy_device_to_device>, L</guestfs_zero_device>,
+L</guestfs_checksums_out>, L</guestfs_find> and calls which run
+external commands, can be cancelled in the same way.  They also fail
+with errno C<EINTR>.  Calls with an upload (C<FileIn>) parameter can
+only be cancelled while the file is being uploaded.
+
 No cleanup is performed: for example, if a file was being uploaded
 then after cancellation there may be a partially uploaded file.  It is
 the caller's responsibility to clean up if necessary.
@@ -3756,714 +3811,750 @@ Searches all the entries associated with the given inode.
 For each entry, a C<tsk_dirent> structure is returned.
 See C<filesystem_walk> for more information about C<tsk_dirent> structures." };
 
-]
+  { defaults with
+    name = "device_changed_ranges"; added = (1, 35, 20);
+    style = RStructList ("ranges", "blockrange"), [Device "device1"; Device "device2"], [OInt64 "blocksize"];
+    progress = true;
+    shortdesc = "list the ranges which differ between two devices";
+    longdesc = "\
+Compare the devices C<device1> and C<device2> block by block,
+and return the byte ranges which differ, as a sorted list of
+C<blockrange> structures.  Adjacent changed blocks are merged
+into one range.
 
-(* daemon_functions are any functions which cause some action
- * to take place in the daemon.
- *)
+Blocks are C<blocksize> bytes (default 1 MiB, which must be a
+multiple of 512).  If the devices are different sizes, the end
+of the larger device is also returned as changed.
+
+The blocks are compared inside the appliance, in parallel, so
+nothing is copied to the library.  If C<device1> and C<device2>
+are whole disks added from local files, the regions which read
+as zeroes in both disks (eg. unallocated clusters of a qcow2
+image) are found with L<qemu-img(1)> C<map> and are not read.
+
+To compare a device with an earlier state which is no longer
+available, see C<guestfs_device_changed_ranges_sums>." };
 
-let daemon_functions = [
   { defaults with
-    name = "mount"; added = (0, 0, 3);
-    style = RErr, [Mountable "mountable"; String "mountpoint"], [];
-    proc_nr = Some 1;
-    tests = [
-      InitEmpty, Always, TestResultString (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["mkfs"; "ext2"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
-         ["mount"; "/dev/sda1"; "/"];
-         ["write"; "/new"; "new file contents"];
-         ["cat"; "/new"]], "new file contents"), []
-    ];
-    shortdesc = "mount a guest disk at a position in the filesystem";
+    name = "device_changed_ranges_sums"; added = (1, 35, 20);
+    style = RStructList ("ranges", "blockrange"), [String "csumtype"; Device "device"; String "sumsfile"], [OInt64 "blocksize"];
+    progress = true; cancellable = true;
+    shortdesc = "list the ranges of a device which differ from block checksums";
     longdesc = "\
-Mount a guest disk at a position in the filesystem.  Block devices
-are named F</dev/sda>, F</dev/sdb> and so on, as they were added to
-the guest.  If those block devices contain partitions, they will have
-the usual names (eg. F</dev/sda1>).  Also LVM F</dev/VG/LV>-style
-names can be used, or 'mountable' strings returned by
-C<guestfs_list_filesystems> or C<guestfs_inspect_get_mountpoints>.
+Compare the device C<device> with the block checksums in the
+local file C<sumsfile>, as written earlier by
+C<guestfs_checksum_device_blocks> with the same C<csumtype>
+and C<blocksize>, and return the byte ranges which have
+changed, as for C<guestfs_device_changed_ranges>.
 
-The rules are the same as for L<mount(2)>:  A filesystem must
-first be mounted on F</> before others can be mounted.  Other
-filesystems can only be mounted on directories which already
-exist.
+If C<device> is a whole disk added from a local file, blocks
+which read as zeroes are compared without being read." };
 
-The mounted filesystem is writable, if we have sufficient permissions
-on the underlying device.
+  { defaults with
+    name = "remove_drives"; added = (1, 35, 20);
+    style = RErr, [StringList "labels"], [];
+    blocking = false;
+    shortdesc = "remove several disk images";
+    longdesc = "\
+This removes each drive that was previously added with a label
+in the list C<labels>, as C<guestfs_remove_drive> does.
 
-Before libguestfs 1.13.16, this call implicitly added the options
-C<sync> and C<noatime>.  The C<sync> option greatly slowed
-writes and caused many problems for users.  If your program
-might need to work with older versions of libguestfs, use
-C<guestfs_mount_options> instead (using an empty string for the
-first parameter if you don't want any options)." };
+If called after launch, the drives are hot unplugged together,
+waiting once for all of them to disappear from the appliance,
+which is faster than calling C<guestfs_remove_drive> for each
+drive.  None of the disks may be in use.  If one of the labels
+is not found, or one of the disks is in use, no drive is
+removed." };
 
   { defaults with
-    name = "sync"; added = (0, 0, 3);
-    style = RErr, [], [];
-    proc_nr = Some 2;
-    tests = [
-      InitEmpty, Always, TestRun [["sync"]], []
-    ];
-    shortdesc = "sync disks, writes are flushed through to the disk image";
+    name = "get_launch_stats"; added = (1, 35, 20);
+    style = RHashtable "stats", [], [];
+    blocking = false;
+    shortdesc = "get the times taken by the last launch";
     longdesc = "\
-This syncs the disk, so that any writes are flushed through to the
-underlying disk image.
+This returns the time at which the last call to C<guestfs_launch>
+reached each phase of launching the appliance, in milliseconds
+since launch started.  The keys of the hash are the names of the
+phases:
 
-You should always call this if you have modified a disk image, before
-closing the handle." };
+=over 4
+
+=item C<start>
+
+C<guestfs_launch> was called (always C<0>).
+
+=item C<appliance>
+
+The appliance was built or found.
+
+=item C<hypervisor>
+
+qemu, or the libvirt domain, was started.
+
+=item C<kernel>
+
+The appliance kernel started.  This is only seen when verbose
+messages are enabled, as otherwise the kernel is quiet.
+
+=item C<init>
+
+The appliance C</init> script started.
+
+=item C<udev>
+
+udev finished setting up the devices in the appliance.
+
+=item C<daemon>
+
+The daemon is ready and C<guestfs_launch> returns.
+
+=back
+
+Phases which were not seen, for example because the appliance was
+restored from a snapshot or the launch failed, are not returned.
+Before the handle is launched this returns an empty list.
+
+The same times are also sent as C<GUESTFS_EVENT_LAUNCH_PHASE>
+events while launching, see L<guestfs(3)/EVENTS>." };
 
   { defaults with
-    name = "touch"; added = (0, 0, 3);
-    style = RErr, [Pathname "path"], [];
-    proc_nr = Some 3;
+    name = "set_rpc_stats"; added = (1, 35, 20);
+    style = RErr, [Bool "enable"], [];
+    blocking = false;
     tests = [
-      InitScratchFS, Always, TestResultTrue (
-        [["touch"; "/touch"];
-         ["exists"; "/touch"]]), []
+      InitNone, Always, TestRun (
+        [["set_rpc_stats"; "true"];
+         ["get_rpc_stats"];
+         ["set_rpc_stats"; "false"]]), []
     ];
-    shortdesc = "update file timestamps or create a new file";
+    shortdesc = "enable or disable RPC statistics";
     longdesc = "\
-Touch acts like the L<touch(1)> command.  It can be used to
-update the timestamps on a file, or, if the file does not exist,
-to create a new zero-length file.
+If C<enable> is true, then libguestfs starts collecting statistics
+about each call made to the appliance: the number of calls, the
+number of bytes sent and received, and a histogram of how long the
+calls took.  Use C<guestfs_get_rpc_stats> to read them.
 
-This command only works on regular files, and will fail on other
-file types such as directories, symbolic links, block special etc." };
+Enabling statistics when they are already enabled resets all the
+counters to zero.  Disabling them discards the statistics.
+
+Statistics are disabled by default.  When disabled they have no
+overhead." };
 
   { defaults with
-    name = "ll"; added = (0, 0, 4);
-    style = RString "listing", [Pathname "directory"], [];
-    proc_nr = Some 5;
-    test_excuse = "tricky to test because it depends on the exact format of the 'ls -l' command, which changed between Fedora 10 and Fedora 11";
-    shortdesc = "list the files in a directory (long format)";
+    name = "get_rpc_stats"; added = (1, 35, 20);
+    style = RHashtable "stats", [], [];
+    blocking = false;
+    shortdesc = "get RPC statistics";
     longdesc = "\
-List the files in F<directory> (relative to the root directory,
-there is no cwd) in the format of 'ls -la'.
+Return the statistics collected since C<guestfs_set_rpc_stats>
+was called.  It is an error to call this if statistics are not
+enabled.
 
-This command is mostly useful for interactive sessions.  It
-is I<not> intended that you try to parse the output string." };
+For each API call which was made to the appliance at least once,
+the following keys are returned, where C<I<name>> is the name of
+the call (for example C<mount>):
+
+=over 4
+
+=item C<I<name>.calls>
+
+Number of replies received.
+
+=item C<I<name>.errors>
+
+Number of those replies which were errors.
+
+=item C<I<name>.bytes_sent>
+
+=item C<I<name>.bytes_received>
+
+Total size of the call and reply messages in bytes.
+
+=item C<I<name>.file_bytes>
+
+Total bytes of C<FileIn> or C<FileOut> data transferred, if any.
+Divide this by C<I<name>.total_us> to get the throughput.
+
+=item C<I<name>.total_us>
+
+=item C<I<name>.max_us>
+
+Total and maximum time from sending the call to receiving the
+reply, in microseconds.  For C<FileIn> calls this includes sending
+the file.  For C<FileOut> calls receiving the file is not included.
+
+=item C<I<name>.p50_us>
+
+=item C<I<name>.p99_us>
+
+Approximate median and 99th percentile latency in microseconds.
+These are the upper bounds of the histogram bucket containing the
+percentile.
+
+=item C<I<name>.latency_us.I<N>>
+
+The latency histogram.  The value is the number of calls which took
+less than C<I<N>> microseconds, but at least C<I<N>/2>.  C<I<N>> is
+a power of 2, and buckets which are empty are not returned.
+
+=back
+
+Internal calls such as those made by inspection are included." };
 
   { defaults with
-    name = "list_devices"; added = (0, 0, 4);
-    style = RStringList "devices", [], [];
-    proc_nr = Some 7;
-    tests = [
-      InitEmpty, Always, TestResult (
-        [["list_devices"]],
-        "is_device_list (ret, 4, \"/dev/sda\", \"/dev/sdb\", \"/dev/sdc\", \"/dev/sdd\")"), []
-    ];
-    shortdesc = "list the block devices";
+    name = "journal_get_entries"; added = (1, 35, 20);
+    style = RStructList ("fields", "xattr"), [], [OInt64 "maxentries"; OString "cursor"; OInt64 "since"; OInt64 "until"; OStringList "fields"];
+    optional = Some "journal";
+    test_excuse = "tests in tests/journal subdirectory";
+    shortdesc = "read the next journal entries";
+    longdesc = "\
+Read the entries after the current journal entry, and move the
+journal position to the last entry returned.  Call this in a loop
+until it returns an empty list to read the whole journal with one
+round trip to the appliance for each batch of entries, instead of
+one C<guestfs_journal_next> and one C<guestfs_journal_get> for each
+entry.
+
+The fields of all the entries are returned as a single list of
+C<(attrname, attrval)> pairs as in C<guestfs_journal_get>.  Each
+entry starts with the C<__CURSOR> field, followed by
+C<__REALTIME_TIMESTAMP> (the timestamp in microseconds as a decimal
+string) and then the data fields of the entry.
+
+C<maxentries> is the maximum number of entries to return in this
+batch, by default 1000.  The other optional arguments are the same
+as for C<guestfs_journal_export>.  Note that C<cursor> and
+C<since> seek the journal, so they should only be passed on the
+first call." };
+
+  { defaults with
+    name = "filesystem_walk0"; added = (1, 35, 20);
+    style = RErr, [Mountable "device"; String "filename"], [];
+    optional = Some "libtsk";
+    progress = true; cancellable = true;
+    shortdesc = "walk through the filesystem content to a local file";
+    longdesc = "\
+This is the same as C<guestfs_filesystem_walk>, except that the
+entries are written to the local file C<filename> as they are
+received from the appliance, instead of being returned as a list.
+Use this on filesystems with millions of files, where the list
+would need a lot of memory.
+
+Each entry is written as the fields of the C<tsk_dirent> structure
+in order (C<tsk_inode>, C<tsk_type>, C<tsk_size>, C<tsk_name>,
+C<tsk_flags>, C<tsk_atime_sec>, C<tsk_atime_nsec>,
+C<tsk_mtime_sec>, C<tsk_mtime_nsec>, C<tsk_ctime_sec>,
+C<tsk_ctime_nsec>, C<tsk_crtime_sec>, C<tsk_crtime_nsec>,
+C<tsk_nlink>, C<tsk_link>, C<tsk_spare1>).  Numbers are written
+in decimal, and C<tsk_type> as a single character.  Every field is
+followed by an ASCII NUL character, so each entry is exactly 16
+NUL-terminated strings." };
+
+  { defaults with
+    name = "copy_in_multiple"; added = (1, 35, 20);
+    style = RErr, [StringList "localpaths"; Pathname "remotedir"], [];
+    visibility = VPublicNoFish;
+    cancellable = true;
+    shortdesc = "copy several local files or directories into an image";
     longdesc = "\
-List all the block devices.
+This is the same as calling C<guestfs_copy_in> for each of
+C<localpaths>, placing them in the directory C<remotedir> (which
+must exist), except that all of them are sent to the appliance in
+a single transfer.
 
-The full block device names are returned, eg. F</dev/sda>.
+The files are packed into a tar stream by the library itself,
+so no external L<tar(1)> process is needed.  Regular files,
+directories, symbolic links, hard links, devices and FIFOs are
+copied.  Sockets are skipped.
 
-See also C<guestfs_list_filesystems>." };
+Wildcards cannot be used." };
 
   { defaults with
-    name = "list_partitions"; added = (0, 0, 4);
-    style = RStringList "partitions", [], [];
-    proc_nr = Some 8;
-    tests = [
-      InitBasicFS, Always, TestResult (
-        [["list_partitions"]],
-        "is_device_list (ret, 2, \"/dev/sda1\", \"/dev/sdb1\")"), [];
-      InitEmpty, Always, TestResult (
-        [["part_init"; "/dev/sda"; "mbr"];
-         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
-         ["part_add"; "/dev/sda"; "p"; "204800"; "409599"];
-         ["part_add"; "/dev/sda"; "p"; "409600"; "-64"];
-         ["list_partitions"]],
-        "is_device_list (ret, 4, \"/dev/sda1\", \"/dev/sda2\", \"/dev/sda3\", \"/dev/sdb1\")"), []
-    ];
-    shortdesc = "list the partitions";
+    name = "set_progress_interval"; added = (1, 35, 20);
+    style = RErr, [Int "interval"], [];
+    fish_alias = ["progress-interval"];
+    blocking = false;
+    shortdesc = "set the minimum interval between progress messages";
     longdesc = "\
-List all the partitions detected on all block devices.
+Set the minimum time in milliseconds between two progress messages
+(C<GUESTFS_EVENT_PROGRESS> events) for the same call.  Progress
+messages which arrive sooner are dropped by the library, except that
+the first and the final (100%) message of each call are always
+delivered.  Use this to avoid calling a progress callback, perhaps in
+another language, more often than the program can use it.
 
-The full partition device names are returned, eg. F</dev/sda1>
+If the appliance is running, the daemon is also asked not to send
+progress messages more often than this.
 
-This does not return logical volumes.  For that you will need to
-call C<guestfs_lvs>.
+The default is C<0>, meaning the library passes on every progress
+message that the daemon sends (about three per second).
 
-See also C<guestfs_list_filesystems>." };
+See also C<guestfs_set_progress_delta> and
+L<guestfs(3)/GUESTFS_EVENT_PROGRESS>." };
 
   { defaults with
-    name = "pvs"; added = (0, 0, 4);
-    style = RStringList "physvols", [], [];
-    proc_nr = Some 9;
-    optional = Some "lvm2";
+    name = "get_progress_interval"; added = (1, 35, 20);
+    style = RInt "interval", [], [];
+    blocking = false;
     tests = [
-      InitBasicFSonLVM, Always, TestResult (
-        [["pvs"]], "is_device_list (ret, 1, \"/dev/sda1\")"), [];
-      InitEmpty, Always, TestResult (
-        [["part_init"; "/dev/sda"; "mbr"];
-         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
-         ["part_add"; "/dev/sda"; "p"; "204800"; "409599"];
-         ["part_add"; "/dev/sda"; "p"; "409600"; "-64"];
-         ["pvcreate"; "/dev/sda1"];
-         ["pvcreate"; "/dev/sda2"];
-         ["pvcreate"; "/dev/sda3"];
-         ["pvs"]],
-        "is_device_list (ret, 3, \"/dev/sda1\", \"/dev/sda2\", \"/dev/sda3\")"), []
+      InitNone, Always, TestResult (
+        [["set_progress_interval"; "2000"];
+         ["get_progress_interval"]], "ret == 2000"), []
     ];
-    shortdesc = "list the LVM physical volumes (PVs)";
+    shortdesc = "get the minimum interval between progress messages";
     longdesc = "\
-List all the physical volumes detected.  This is the equivalent
-of the L<pvs(8)> command.
+Return the minimum interval between progress messages in
+milliseconds, as set by C<guestfs_set_progress_interval>." };
 
-This returns a list of just the device names that contain
-PVs (eg. F</dev/sda2>).
+  { defaults with
+    name = "set_progress_delta"; added = (1, 35, 20);
+    style = RErr, [Int "delta"], [];
+    fish_alias = ["progress-delta"];
+    blocking = false;
+    shortdesc = "set the minimum change between progress messages";
+    longdesc = "\
+Set the minimum change in position between two progress messages
+for the same call, in thousandths of the total.  For example
+C<10> means that a progress message is only delivered when the
+operation has advanced by at least 1% since the last one.  As with
+C<guestfs_set_progress_interval>, the first and the final message of
+each call are always delivered.  Messages sent in pulse mode (see
+L<guestfs(3)/GUESTFS_EVENT_PROGRESS>) are not affected.
 
-See also C<guestfs_pvs_full>." };
+The default is C<0>, meaning there is no minimum." };
 
   { defaults with
-    name = "vgs"; added = (0, 0, 4);
-    style = RStringList "volgroups", [], [];
-    proc_nr = Some 10;
-    optional = Some "lvm2";
+    name = "get_progress_delta"; added = (1, 35, 20);
+    style = RInt "delta", [], [];
+    blocking = false;
     tests = [
-      InitBasicFSonLVM, Always, TestResult (
-        [["vgs"]], "is_string_list (ret, 1, \"VG\")"), [];
-      InitEmpty, Always, TestResult (
-        [["part_init"; "/dev/sda"; "mbr"];
-         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
-         ["part_add"; "/dev/sda"; "p"; "204800"; "409599"];
-         ["part_add"; "/dev/sda"; "p"; "409600"; "-64"];
-         ["pvcreate"; "/dev/sda1"];
-         ["pvcreate"; "/dev/sda2"];
-         ["pvcreate"; "/dev/sda3"];
-         ["vgcreate"; "VG1"; "/dev/sda1 /dev/sda2"];
-         ["vgcreate"; "VG2"; "/dev/sda3"];
-         ["vgs"]],
-        "is_string_list (ret, 2, \"VG1\", \"VG2\")"), []
+      InitNone, Always, TestResult (
+        [["set_progress_delta"; "10"];
+         ["get_progress_delta"]], "ret == 10"), []
     ];
-    shortdesc = "list the LVM volume groups (VGs)";
+    shortdesc = "get the minimum change between progress messages";
     longdesc = "\
-List all the volumes groups detected.  This is the equivalent
-of the L<vgs(8)> command.
+Return the minimum change in position between progress messages in
+thousandths of the total, as set by C<guestfs_set_progress_delta>." };
 
-This returns a list of just the volume group names that were
-detected (eg. C<VolGroup00>).
+  { defaults with
+    name = "set_iothread"; added = (1, 35, 20);
+    style = RErr, [Bool "iothread"], [];
+    fish_alias = ["iothread"]; config_only = true;
+    blocking = false;
+    shortdesc = "run the appliance disk controllers in I/O threads";
+    longdesc = "\
+If C<iothread> is true, the hypervisor runs the disk controllers
+of the appliance in dedicated I/O threads instead of its main
+loop.  This can improve the speed of copying between fast disks.
+It needs qemu E<ge> 2.4 (and libvirt E<ge> 1.3.5 for the libvirt
+backend), and is ignored with older versions.  The default is
+false.
 
-See also C<guestfs_vgs_full>." };
+When the appliance has more than one virtual CPU (see
+C<guestfs_set_smp>), the disk controllers are always given one
+queue per virtual CPU, whatever this setting is.
+
+This function must be called before C<guestfs_launch>." };
 
   { defaults with
-    name = "lvs"; added = (0, 0, 4);
-    style = RStringList "logvols", [], [];
-    proc_nr = Some 11;
-    optional = Some "lvm2";
+    name = "get_iothread"; added = (1, 35, 20);
+    style = RBool "iothread", [], [];
+    blocking = false;
     tests = [
-      InitBasicFSonLVM, Always, TestResult (
-        [["lvs"]],
-        "is_string_list (ret, 1, \"/dev/VG/LV\")"), [];
-      InitEmpty, Always, TestResult (
-        [["part_init"; "/dev/sda"; "mbr"];
-         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
-         ["part_add"; "/dev/sda"; "p"; "204800"; "409599"];
-         ["part_add"; "/dev/sda"; "p"; "409600"; "-64"];
-         ["pvcreate"; "/dev/sda1"];
-         ["pvcreate"; "/dev/sda2"];
-         ["pvcreate"; "/dev/sda3"];
-         ["vgcreate"; "VG1"; "/dev/sda1 /dev/sda2"];
-         ["vgcreate"; "VG2"; "/dev/sda3"];
-         ["lvcreate"; "LV1"; "VG1"; "50"];
-         ["lvcreate"; "LV2"; "VG1"; "50"];
-         ["lvcreate"; "LV3"; "VG2"; "50"];
-         ["lvs"]],
-        "is_string_list (ret, 3, \"/dev/VG1/LV1\", \"/dev/VG1/LV2\", \"/dev/VG2/LV3\")"), []
+      InitNone, Always, TestResultTrue (
+        [["set_iothread"; "true"];
+         ["get_iothread"]]), []
     ];
-    shortdesc = "list the LVM logical volumes (LVs)";
+    shortdesc = "get the I/O threads flag";
     longdesc = "\
-List all the logical volumes detected.  This is the equivalent
-of the L<lvs(8)> command.
-
-This returns a list of the logical volume device names
-(eg. F</dev/VolGroup00/LogVol00>).
-
-See also C<guestfs_lvs_full>, C<guestfs_list_filesystems>." };
+Return the flag set by C<guestfs_set_iothread>." };
 
   { defaults with
-    name = "pvs_full"; added = (0, 0, 4);
-    style = RStructList ("physvols", "lvm_pv"), [], [];
-    proc_nr = Some 12;
-    optional = Some "lvm2";
-    shortdesc = "list the LVM physical volumes (PVs)";
+    name = "set_aio"; added = (1, 35, 20);
+    style = RErr, [String "aio"], [];
+    fish_alias = ["aio"]; config_only = true;
+    blocking = false;
+    shortdesc = "set the asynchronous I/O mode for host block devices";
     longdesc = "\
-List all the physical volumes detected.  This is the equivalent
-of the L<pvs(8)> command.  The \"full\" version includes all fields." };
+Set how the hypervisor submits I/O to raw format drives which are
+host block devices (eg. C</dev/nvme0n1>).  Other drives always use
+the default mode of the hypervisor.  C<aio> can be:
 
-  { defaults with
-    name = "vgs_full"; added = (0, 0, 4);
-    style = RStructList ("volgroups", "lvm_vg"), [], [];
-    proc_nr = Some 13;
-    optional = Some "lvm2";
-    shortdesc = "list the LVM volume groups (VGs)";
-    longdesc = "\
-List all the volumes groups detected.  This is the equivalent
-of the L<vgs(8)> command.  The \"full\" version includes all fields." };
+=over 4
 
-  { defaults with
-    name = "lvs_full"; added = (0, 0, 4);
-    style = RStructList ("logvols", "lvm_lv"), [], [];
-    proc_nr = Some 14;
-    optional = Some "lvm2";
-    shortdesc = "list the LVM logical volumes (LVs)";
-    longdesc = "\
-List all the logical volumes detected.  This is the equivalent
-of the L<lvs(8)> command.  The \"full\" version includes all fields." };
+=item C<\"\">
+
+=item C<threads>
+
+Use a pool of threads in the hypervisor.  This is the default.
+
+=item C<native>
+
+Use Linux native AIO.  As the hypervisor requires, the host
+page cache is bypassed for these drives.
+
+=item C<io_uring>
+
+Use L<io_uring(7)>.  This needs qemu E<ge> 5.0 (and libvirt
+E<ge> 6.3 for the libvirt backend), otherwise the default is used.
+
+=back
+
+This function must be called before C<guestfs_launch>." };
 
   { defaults with
-    name = "aug_init"; added = (0, 0, 7);
-    style = RErr, [Pathname "root"; Int "flags"], [];
-    proc_nr = Some 16;
+    name = "get_aio"; added = (1, 35, 20);
+    style = RConstString "aio", [], [];
+    blocking = false;
     tests = [
-      InitBasicFS, Always, TestResultString (
-        [["mkdir"; "/etc"];
-         ["write"; "/etc/hostname"; "test.example.org"];
-         ["aug_init"; "/"; "0"];
-         ["aug_get"; "/files/etc/hostname/hostname"]], "test.example.org"), [["aug_close"]]
+      InitNone, Always, TestResultString (
+        [["set_aio"; "native"];
+         ["get_aio"]], "native"), []
     ];
-    shortdesc = "create a new Augeas handle";
+    shortdesc = "get the asynchronous I/O mode for host block devices";
     longdesc = "\
-Create a new Augeas handle for editing configuration files.
-If there was any previous Augeas handle associated with this
-guestfs session, then it is closed.
+Return the mode set by C<guestfs_set_aio>.  The default is
+C<threads>." };
 
-You must call this before using any other C<guestfs_aug_*>
-commands.
+  { defaults with
+    name = "set_appliance_profile"; added = (1, 35, 20);
+    style = RErr, [String "profile"], [];
+    fish_alias = ["appliance-profile"]; config_only = true;
+    blocking = false;
+    shortdesc = "choose how the appliance boots";
+    longdesc = "\
+Choose how the appliance is started.  C<profile> can be:
 
-C<root> is the filesystem root.  C<root> must not be NULL,
-use F</> instead.
+=over 4
 
-The flags are the same as the flags defined in
-E<lt>augeas.hE<gt>, the logical I<or> of the following
-integers:
+=item C<default>
 
-=over 4
+The appliance starts udev, which loads the modules for all the
+devices it finds and waits for them to be set up.
 
-=item C<AUG_SAVE_BACKUP> = 1
+=item C<minimal>
 
-Keep the original file with a C<.augsave> extension.
+The appliance does not run udev.  The kernel creates the device
+nodes, the modules are only loaded when they are needed, and the
+appliance names the virtio-serial channel itself.  This makes
+launching noticeably faster.
 
-=item C<AUG_SAVE_NEWFILE> = 2
+This is only used by the C<direct> backend, and only when no
+drive was added with a C<label> (which needs the udev rules).
+Other backends and handles with labelled drives use
+the default profile.  As udev is not running, calls which wait
+for it, such as C<guestfs_hot_add_drive>, do not work.
 
-Save changes into a file with extension C<.augnew>, and
-do not overwrite original.  Overrides C<AUG_SAVE_BACKUP>.
+=back
 
-=item C<AUG_TYPE_CHECK> = 4
+This function must be called before C<guestfs_launch>." };
 
-Typecheck lenses.
+  { defaults with
+    name = "get_appliance_profile"; added = (1, 35, 20);
+    style = RConstString "profile", [], [];
+    blocking = false;
+    tests = [
+      InitNone, Always, TestResultString (
+        [["set_appliance_profile"; "minimal"];
+         ["get_appliance_profile"]], "minimal"), []
+    ];
+    shortdesc = "get the appliance profile";
+    longdesc = "\
+Return the profile set by C<guestfs_set_appliance_profile>.  The
+default is C<default>." };
 
-This option is only useful when debugging Augeas lenses.  Use
-of this option may require additional memory for the libguestfs
-appliance.  You may need to set the C<LIBGUESTFS_MEMSIZE>
-environment variable or call C<guestfs_set_memsize>.
+  { defaults with
+    name = "set_sizing"; added = (1, 35, 20);
+    style = RErr, [String "sizing"], [];
+    fish_alias = ["sizing"]; config_only = true;
+    blocking = false;
+    shortdesc = "choose the number of vCPUs and memory automatically";
+    longdesc = "\
+Choose how the number of virtual CPUs and the memory size of the
+appliance are set.  C<sizing> can be:
 
-=item C<AUG_NO_STDINC> = 8
+=over 4
 
-Do not use standard load path for modules.
+=item C<manual>
 
-=item C<AUG_SAVE_NOOP> = 16
+The appliance has one vCPU and the default memory size, unless
+they are changed with C<guestfs_set_smp> and C<guestfs_set_memsize>.
 
-Make save a no-op, just record what would have been changed.
+=item C<auto>
 
-=item C<AUG_NO_LOAD> = 32
+=item C<metadata>
 
-Do not load the tree in C<guestfs_aug_init>.
+=item C<bulk>
+
+When the handle is launched, the number of vCPUs and the memory
+size are chosen from the number of host CPUs and the amount of
+host memory.  The host CPUs are shared out between all the
+appliances running in the same process.
+
+The value is a hint about the work that will be done.  C<metadata>
+is for work which is mostly reading metadata, such as inspection or
+listing files, and uses at most 2 vCPUs.  C<bulk> is for work which
+reads or writes a lot of data, such as compression, checksums,
+copying or checking filesystems, and uses up to 16 vCPUs with
+some more memory for each one.  C<auto> is in between, with up to
+4 vCPUs.
+
+A number of vCPUs or memory size set with C<guestfs_set_smp>,
+C<guestfs_set_memsize> or C<LIBGUESTFS_MEMSIZE> is used as it is.
+After launch, C<guestfs_get_smp> and C<guestfs_get_memsize> return
+the values which were chosen.
 
 =back
 
-To close the handle, you can call C<guestfs_aug_close>.
+You can also change this by setting the environment variable
+C<LIBGUESTFS_SIZING> before the handle is created.
 
-To find out more about Augeas, see L<http://augeas.net/>." };
+This function must be called before C<guestfs_launch>." };
 
   { defaults with
-    name = "aug_close"; added = (0, 0, 7);
-    style = RErr, [], [];
-    proc_nr = Some 26;
-    shortdesc = "close the current Augeas handle";
+    name = "get_sizing"; added = (1, 35, 20);
+    style = RConstString "sizing", [], [];
+    blocking = false;
+    tests = [
+      InitNone, Always, TestResultString (
+        [["set_sizing"; "bulk"];
+         ["get_sizing"]], "bulk"), []
+    ];
+    shortdesc = "get the appliance sizing";
     longdesc = "\
-Close the current Augeas handle and free up any resources
-used by it.  After calling this, you have to call
-C<guestfs_aug_init> again before you can use any other
-Augeas functions." };
+Return the sizing set by C<guestfs_set_sizing>.  The default is
+C<manual>." };
 
   { defaults with
-    name = "aug_defvar"; added = (0, 0, 7);
-    style = RInt "nrnodes", [String "name"; OptString "expr"], [];
-    proc_nr = Some 17;
-    shortdesc = "define an Augeas variable";
+    name = "readdir"; added = (1, 0, 55);
+    style = RStructList ("entries", "dirent"), [Pathname "dir"], [];
+    shortdesc = "read directories entries";
     longdesc = "\
-Defines an Augeas variable C<name> whose value is the result
-of evaluating C<expr>.  If C<expr> is NULL, then C<name> is
-undefined.
+This returns the list of directory entries in directory C<dir>.
 
-On success this returns the number of nodes in C<expr>, or
-C<0> if C<expr> evaluates to something which is not a nodeset." };
+All entries in the directory are returned, including C<.> and
+C<..>.  The entries are I<not> sorted, but returned in the same
+order as the underlying filesystem.
 
-  { defaults with
-    name = "aug_defnode"; added = (0, 0, 7);
-    style = RStruct ("nrnodescreated", "int_bool"), [String "name"; String "expr"; String "val"], [];
-    proc_nr = Some 18;
-    shortdesc = "define an Augeas node";
-    longdesc = "\
-Defines a variable C<name> whose value is the result of
-evaluating C<expr>.
+Also this call returns basic file type information about each
+file.  The C<ftyp> field will contain one of the following characters:
 
-If C<expr> evaluates to an empty nodeset, a node is created,
-equivalent to calling C<guestfs_aug_set> C<expr>, C<value>.
-C<name> will be the nodeset containing that single node.
+=over 4
 
-On success this returns a pair containing the
-number of nodes in the nodeset, and a boolean flag
-if a node was created." };
+=item 'b'
 
-  { defaults with
-    name = "aug_get"; added = (0, 0, 7);
-    style = RString "val", [String "augpath"], [];
-    proc_nr = Some 19;
-    shortdesc = "look up the value of an Augeas path";
-    longdesc = "\
-Look up the value associated with C<path>.  If C<path>
-matches exactly one node, the C<value> is returned." };
+Block special
 
-  { defaults with
-    name = "aug_set"; added = (0, 0, 7);
-    style = RErr, [String "augpath"; String "val"], [];
-    proc_nr = Some 20;
-    tests = [
-      InitBasicFS, Always, TestResultString (
-        [["mkdir"; "/etc"];
-         ["write"; "/etc/hostname"; "test.example.org"];
-         ["aug_init"; "/"; "0"];
-         ["aug_set"; "/files/etc/hostname/hostname"; "replace.example.com"];
-         ["aug_get"; "/files/etc/hostname/hostname"]], "replace.example.com"), [["aug_close"]]
-    ];
-    shortdesc = "set Augeas path to value";
-    longdesc = "\
-Set the value associated with C<path> to C<val>.
+=item 'c'
 
-In the Augeas API, it is possible to clear a node by setting
-the value to NULL.  Due to an oversight in the libguestfs API
-you cannot do that with this call.  Instead you must use the
-C<guestfs_aug_clear> call." };
+Char special
 
-  { defaults with
-    name = "aug_insert"; added = (0, 0, 7);
-    style = RErr, [String "augpath"; String "label"; Bool "before"], [];
-    proc_nr = Some 21;
-    tests = [
-      InitBasicFS, Always, TestResultString (
-        [["mkdir"; "/etc"];
-         ["write"; "/etc/hosts"; ""];
-         ["aug_init"; "/"; "0"];
-         ["aug_insert"; "/files/etc/hosts"; "1"; "false"];
-         ["aug_set"; "/files/etc/hosts/1/ipaddr"; "127.0.0.1"];
-         ["aug_set"; "/files/etc/hosts/1/canonical"; "foobar"];
-         ["aug_clear"; "/files/etc/hosts/1/canonical"];
-         ["aug_set"; "/files/etc/hosts/1/canonical"; "localhost"];
-         ["aug_save"];
-         ["cat"; "/etc/hosts"]], "\n127.0.0.1\tlocalhost\n"), [["aug_close"]]
-    ];
-    shortdesc = "insert a sibling Augeas node";
-    longdesc = "\
-Create a new sibling C<label> for C<path>, inserting it into
-the tree before or after C<path> (depending on the boolean
-flag C<before>).
+=item 'd'
 
-C<path> must match exactly one existing node in the tree, and
-C<label> must be a label, ie. not contain F</>, C<*> or end
-with a bracketed index C<[N]>." };
+Directory
 
-  { defaults with
-    name = "aug_rm"; added = (0, 0, 7);
-    style = RInt "nrnodes", [String "augpath"], [];
-    proc_nr = Some 22;
-    shortdesc = "remove an Augeas path";
-    longdesc = "\
-Remove C<path> and all of its children.
+=item 'f'
 
-On success this returns the number of entries which were removed." };
+FIFO (named pipe)
 
-  { defaults with
-    name = "aug_mv"; added = (0, 0, 7);
-    style = RErr, [String "src"; String "dest"], [];
-    proc_nr = Some 23;
-    shortdesc = "move Augeas node";
-    longdesc = "\
-Move the node C<src> to C<dest>.  C<src> must match exactly
-one node.  C<dest> is overwritten if it exists." };
+=item 'l'
 
-  { defaults with
-    name = "aug_match"; added = (0, 0, 7);
-    style = RStringList "matches", [String "augpath"], [];
-    proc_nr = Some 24;
-    shortdesc = "return Augeas nodes which match augpath";
-    longdesc = "\
-Returns a list of paths which match the path expression C<path>.
-The returned paths are sufficiently qualified so that they match
-exactly one node in the current tree." };
+Symbolic link
 
-  { defaults with
-    name = "aug_save"; added = (0, 0, 7);
-    style = RErr, [], [];
-    proc_nr = Some 25;
-    shortdesc = "write all pending Augeas changes to disk";
-    longdesc = "\
-This writes all pending changes to disk.
+=item 'r'
 
-The flags which were passed to C<guestfs_aug_init> affect exactly
-how files are saved." };
+Regular file
 
-  { defaults with
-    name = "aug_load"; added = (0, 0, 7);
-    style = RErr, [], [];
-    proc_nr = Some 27;
-    shortdesc = "load files into the tree";
-    longdesc = "\
-Load files into the tree.
+=item 's'
 
-See C<aug_load> in the Augeas documentation for the full gory
-details." };
+Socket
+
+=item 'u'
+
+Unknown file type
+
+=item '?'
+
+The L<readdir(3)> call returned a C<d_type> field with an
+unexpected value
+
+=back
+
+This function is primarily intended for use by programs.  To
+get a simple list of names, use C<guestfs_ls>.  To get a printable
+directory for human consumption, use C<guestfs_ll>." };
+
+]
+
+(* daemon_functions are any functions which cause some action
+ * to take place in the daemon.
+ *)
 
+let daemon_functions = [
   { defaults with
-    name = "aug_ls"; added = (0, 0, 8);
-    style = RStringList "matches", [String "augpath"], [];
-    proc_nr = Some 28;
+    name = "mount"; added = (0, 0, 3);
+    style = RErr, [Mountable "mountable"; String "mountpoint"], [];
+    proc_nr = Some 1;
     tests = [
-      InitBasicFS, Always, TestResult (
-        [["mkdir"; "/etc"];
-         ["write"; "/etc/hosts"; "127.0.0.1 localhost"];
-         ["aug_init"; "/"; "0"];
-         ["aug_ls"; "/files/etc/hosts/1"]],
-        "is_string_list (ret, 2, \"/files/etc/hosts/1/canonical\", \"/files/etc/hosts/1/ipaddr\")"), [["aug_close"]]
+      InitEmpty, Always, TestResultString (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["mkfs"; "ext2"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["mount"; "/dev/sda1"; "/"];
+         ["write"; "/new"; "new file contents"];
+         ["cat"; "/new"]], "new file contents"), []
     ];
-    shortdesc = "list Augeas nodes under augpath";
+    shortdesc = "mount a guest disk at a position in the filesystem";
     longdesc = "\
-This is just a shortcut for listing C<guestfs_aug_match>
-C<path/*> and sorting the resulting nodes into alphabetical order." };
+Mount a guest disk at a position in the filesystem.  Block devices
+are named F</dev/sda>, F</dev/sdb> and so on, as they were added to
+the guest.  If those block devices contain partitions, they will have
+the usual names (eg. F</dev/sda1>).  Also LVM F</dev/VG/LV>-style
+names can be used, or 'mountable' strings returned by
+C<guestfs_list_filesystems> or C<guestfs_inspect_get_mountpoints>.
+
+The rules are the same as for L<mount(2)>:  A filesystem must
+first be mounted on F</> before others can be mounted.  Other
+filesystems can only be mounted on directories which already
+exist.
+
+The mounted filesystem is writable, if we have sufficient permissions
+on the underlying device.
+
+Before libguestfs 1.13.16, this call implicitly added the options
+C<sync> and C<noatime>.  The C<sync> option greatly slowed
+writes and caused many problems for users.  If your program
+might need to work with older versions of libguestfs, use
+C<guestfs_mount_options> instead (using an empty string for the
+first parameter if you don't want any options)." };
 
   { defaults with
-    name = "rm"; added = (0, 0, 8);
-    style = RErr, [Pathname "path"], [];
-    proc_nr = Some 29;
+    name = "sync"; added = (0, 0, 3);
+    style = RErr, [], [];
+    proc_nr = Some 2;
     tests = [
-      InitScratchFS, Always, TestRun
-        [["mkdir"; "/rm"];
-         ["touch"; "/rm/new"];
-         ["rm"; "/rm/new"]], [];
-      InitScratchFS, Always, TestLastFail
-        [["rm"; "/nosuchfile"]], [];
-      InitScratchFS, Always, TestLastFail
-        [["mkdir"; "/rm2"];
-         ["rm"; "/rm2"]], []
+      InitEmpty, Always, TestRun [["sync"]], []
     ];
-    shortdesc = "remove a file";
+    shortdesc = "sync disks, writes are flushed through to the disk image";
     longdesc = "\
-Remove the single file C<path>." };
+This syncs the disk, so that any writes are flushed through to the
+underlying disk image.
+
+You should always call this if you have modified a disk image, before
+closing the handle." };
 
   { defaults with
-    name = "rmdir"; added = (0, 0, 8);
+    name = "touch"; added = (0, 0, 3);
     style = RErr, [Pathname "path"], [];
-    proc_nr = Some 30;
+    proc_nr = Some 3;
     tests = [
-      InitScratchFS, Always, TestRun
-        [["mkdir"; "/rmdir"];
-         ["rmdir"; "/rmdir"]], [];
-      InitScratchFS, Always, TestLastFail
-        [["rmdir"; "/rmdir2"]], [];
-      InitScratchFS, Always, TestLastFail
-        [["mkdir"; "/rmdir3"];
-         ["touch"; "/rmdir3/new"];
-         ["rmdir"; "/rmdir3/new"]], []
+      InitScratchFS, Always, TestResultTrue (
+        [["touch"; "/touch"];
+         ["exists"; "/touch"]]), []
     ];
-    shortdesc = "remove a directory";
+    shortdesc = "update file timestamps or create a new file";
     longdesc = "\
-Remove the single directory C<path>." };
+Touch acts like the L<touch(1)> command.  It can be used to
+update the timestamps on a file, or, if the file does not exist,
+to create a new zero-length file.
+
+This command only works on regular files, and will fail on other
+file types such as directories, symbolic links, block special etc." };
 
   { defaults with
-    name = "rm_rf"; added = (0, 0, 8);
-    style = RErr, [Pathname "path"], [];
-    proc_nr = Some 31;
-    tests = [
-      InitScratchFS, Always, TestResultFalse
-        [["mkdir"; "/rm_rf"];
-         ["mkdir"; "/rm_rf/foo"];
-         ["touch"; "/rm_rf/foo/bar"];
-         ["rm_rf"; "/rm_rf"];
-         ["exists"; "/rm_rf"]], []
-    ];
-    shortdesc = "remove a file or directory recursively";
+    name = "ll"; added = (0, 0, 4);
+    style = RString "listing", [Pathname "directory"], [];
+    proc_nr = Some 5;
+    test_excuse = "tricky to test because it depends on the exact format of the 'ls -l' command, which changed between Fedora 10 and Fedora 11";
+    shortdesc = "list the files in a directory (long format)";
     longdesc = "\
-Remove the file or directory C<path>, recursively removing the
-contents if its a directory.  This is like the C<rm -rf> shell
-command." };
+List the files in F<directory> (relative to the root directory,
+there is no cwd) in the format of 'ls -la'.
+
+This command is mostly useful for interactive sessions.  It
+is I<not> intended that you try to parse the output string." };
 
   { defaults with
-    name = "mkdir"; added = (0, 0, 8);
-    style = RErr, [Pathname "path"], [];
-    proc_nr = Some 32;
+    name = "list_devices"; added = (0, 0, 4);
+    style = RStringList "devices", [], [];
+    proc_nr = Some 7;
     tests = [
-      InitScratchFS, Always, TestResultTrue
-        [["mkdir"; "/mkdir"];
-         ["is_dir"; "/mkdir"; ""]], [];
-      InitScratchFS, Always, TestLastFail
-        [["mkdir"; "/mkdir2/foo/bar"]], []
+      InitEmpty, Always, TestResult (
+        [["list_devices"]],
+        "is_device_list (ret, 4, \"/dev/sda\", \"/dev/sdb\", \"/dev/sdc\", \"/dev/sdd\")"), []
     ];
-    shortdesc = "create a directory";
+    shortdesc = "list the block devices";
     longdesc = "\
-Create a directory named C<path>." };
+List all the block devices.
+
+The full block device names are returned, eg. F</dev/sda>.
+
+See also C<guestfs_list_filesystems>." };
 
   { defaults with
-    name = "mkdir_p"; added = (0, 0, 8);
-    style = RErr, [Pathname "path"], [];
-    proc_nr = Some 33;
+    name = "list_partitions"; added = (0, 0, 4);
+    style = RStringList "partitions", [], [];
+    proc_nr = Some 8;
     tests = [
-      InitScratchFS, Always, TestResultTrue
-        [["mkdir_p"; "/mkdir_p/foo/bar"];
-         ["is_dir"; "/mkdir_p/foo/bar"; ""]], [];
-      InitScratchFS, Always, TestResultTrue
-        [["mkdir_p"; "/mkdir_p2/foo/bar"];
-         ["is_dir"; "/mkdir_p2/foo"; ""]], [];
-      InitScratchFS, Always, TestResultTrue
-        [["mkdir_p"; "/mkdir_p3/foo/bar"];
-         ["is_dir"; "/mkdir_p3"; ""]], [];
-      (* Regression tests for RHBZ#503133: *)
-      InitScratchFS, Always, TestRun
-        [["mkdir"; "/mkdir_p4"];
-         ["mkdir_p"; "/mkdir_p4"]], [];
-      InitScratchFS, Always, TestLastFail
-        [["touch"; "/mkdir_p5"];
-         ["mkdir_p"; "/mkdir_p5"]], []
+      InitBasicFS, Always, TestResult (
+        [["list_partitions"]],
+        "is_device_list (ret, 2, \"/dev/sda1\", \"/dev/sdb1\")"), [];
+      InitEmpty, Always, TestResult (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
+         ["part_add"; "/dev/sda"; "p"; "204800"; "409599"];
+         ["part_add"; "/dev/sda"; "p"; "409600"; "-64"];
+         ["list_partitions"]],
+        "is_device_list (ret, 4, \"/dev/sda1\", \"/dev/sda2\", \"/dev/sda3\", \"/dev/sdb1\")"), []
     ];
-    shortdesc = "create a directory and parents";
+    shortdesc = "list the partitions";
     longdesc = "\
-Create a directory named C<path>, creating any parent directories
-as necessary.  This is like the C<mkdir -p> shell command." };
+List all the partitions detected on all block devices.
 
-  { defaults with
-    name = "chmod"; added = (0, 0, 8);
-    style = RErr, [Int "mode"; Pathname "path"], [];
-    proc_nr = Some 34;
-    shortdesc = "change file mode";
-    longdesc = "\
-Change the mode (permissions) of C<path> to C<mode>.  Only
-numeric modes are supported.
+The full partition device names are returned, eg. F</dev/sda1>
 
-I<Note>: When using this command from guestfish, C<mode>
-by default would be decimal, unless you prefix it with
-C<0> to get octal, ie. use C<0700> not C<700>.
+This does not return logical volumes.  For that you will need to
+call C<guestfs_lvs>.
 
-The mode actually set is affected by the umask." };
+See also C<guestfs_list_filesystems>." };
 
   { defaults with
-    name = "chown"; added = (0, 0, 8);
-    style = RErr, [Int "owner"; Int "group"; Pathname "path"], [];
-    proc_nr = Some 35;
-    shortdesc = "change file owner and group";
+    name = "pvs"; added = (0, 0, 4);
+    style = RStringList "physvols", [], [];
+    proc_nr = Some 9;
+    optional = Some "lvm2";
+    tests = [
+      InitBasicFSonLVM, Always, TestResult (
+        [["pvs"]], "is_device_list (ret, 1, \"/dev/sda1\")"), [];
+      InitEmpty, Always, TestResult (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
+         ["part_add"; "/dev/sda"; "p"; "204800"; "409599"];
+         ["part_add"; "/dev/sda"; "p"; "409600"; "-64"];
+         ["pvcreate"; "/dev/sda1"];
+         ["pvcreate"; "/dev/sda2"];
+         ["pvcreate"; "/dev/sda3"];
+         ["pvs"]],
+        "is_device_list (ret, 3, \"/dev/sda1\", \"/dev/sda2\", \"/dev/sda3\")"), []
+    ];
+    shortdesc = "list the LVM physical volumes (PVs)";
     longdesc = "\
-Change the file owner to C<owner> and group to C<group>.
+List all the physical volumes detected.  This is the equivalent
+of the L<pvs(8)> command.
 
-Only numeric uid and gid are supported.  If you want to use
-names, you will need to locate and parse the password file
-yourself (Augeas support makes this relatively easy)." };
+This returns a list of just the device names that contain
+PVs (eg. F</dev/sda2>).
+
+See also C<guestfs_pvs_full>." };
 
   { defaults with
-    name = "exists"; added = (0, 0, 8);
-    style = RBool "existsflag", [Pathname "path"], [];
-    proc_nr = Some 36;
-    tests = [
-      InitISOFS, Always, TestResultTrue (
-        [["exists"; "/empty"]]), [];
-      InitISOFS, Always, TestResultTrue (
-        [["exists"; "/directory"]]), []
-    ];
-    shortdesc = "test if file or directory exists";
-    longdesc = "\
-This returns C<true> if and only if there is a file, directory
-(or anything) with the given C<path> name.
-
-See also C<guestfs_is_file>, C<guestfs_is_dir>, C<guestfs_stat>." };
-
-  { defaults with
-    name = "is_file"; added = (0, 0, 8);
-    style = RBool "fileflag", [Pathname "path"], [OBool "followsymlinks"];
-    proc_nr = Some 37;
-    once_had_no_optargs = true;
-    tests = [
-      InitISOFS, Always, TestResultTrue (
-        [["is_file"; "/known-1"; ""]]), [];
-      InitISOFS, Always, TestResultFalse (
-        [["is_file"; "/directory"; ""]]), [];
-      InitISOFS, Always, TestResultTrue (
-        [["is_file"; "/abssymlink"; "true"]]), []
-    ];
-    shortdesc = "test if a regular file";
-    longdesc = "\
-This returns C<true> if and only if there is a regular file
-with the given C<path> name.  Note that it returns false for
-other objects like directories.
-
-If the optional flag C<followsymlinks> is true, then a symlink
-(or chain of symlinks) that ends with a file also causes the
-function to return true.
-
-See also C<guestfs_stat>." };
-
-  { defaults with
-    name = "is_dir"; added = (0, 0, 8);
-    style = RBool "dirflag", [Pathname "path"], [OBool "followsymlinks"];
-    proc_nr = Some 38;
-    once_had_no_optargs = true;
-    tests = [
-      InitISOFS, Always, TestResultFalse (
-        [["is_dir"; "/known-3"; ""]]), [];
-      InitISOFS, Always, TestResultTrue (
-        [["is_dir"; "/directory"; ""]]), []
-    ];
-    shortdesc = "test if a directory";
-    longdesc = "\
-This returns C<true> if and only if there is a directory
-with the given C<path> name.  Note that it returns false for
-other objects like files.
-
-If the optional flag C<followsymlinks> is true, then a symlink
-(or chain of symlinks) that ends with a directory also causes the
-function to return true.
-
-See also C<guestfs_stat>." };
-
-  { defaults with
-    name = "pvcreate"; added = (0, 0, 8);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 39;
-    optional = Some "lvm2";
-    tests = [
-      InitEmpty, Always, TestResult (
-        [["part_init"; "/dev/sda"; "mbr"];
-         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
-         ["part_add"; "/dev/sda"; "p"; "204800"; "409599"];
-         ["part_add"; "/dev/sda"; "p"; "409600"; "-64"];
-         ["pvcreate"; "/dev/sda1"];
-         ["pvcreate"; "/dev/sda2"];
-         ["pvcreate"; "/dev/sda3"];
-         ["pvs"]],
-        "is_device_list (ret, 3, \"/dev/sda1\", \"/dev/sda2\", \"/dev/sda3\")"), []
-    ];
-    shortdesc = "create an LVM physical volume";
-    longdesc = "\
-This creates an LVM physical volume on the named C<device>,
-where C<device> should usually be a partition name such
-as F</dev/sda1>." };
-
-  { defaults with
-    name = "vgcreate"; added = (0, 0, 8);
-    style = RErr, [String "volgroup"; DeviceList "physvols"], [];
-    proc_nr = Some 40;
-    optional = Some "lvm2";
+    name = "vgs"; added = (0, 0, 4);
+    style = RStringList "volgroups", [], [];
+    proc_nr = Some 10;
+    optional = Some "lvm2";
     tests = [
+      InitBasicFSonLVM, Always, TestResult (
+        [["vgs"]], "is_string_list (ret, 1, \"VG\")"), [];
       InitEmpty, Always, TestResult (
         [["part_init"; "/dev/sda"; "mbr"];
          ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
@@ -4475,28 +4566,27 @@ as F</dev/sda1>." };
          ["vgcreate"; "VG1"; "/dev/sda1 /dev/sda2"];
          ["vgcreate"; "VG2"; "/dev/sda3"];
          ["vgs"]],
-        "is_string_list (ret, 2, \"VG1\", \"VG2\")"), [];
-      InitEmpty, Always, TestLastFail (
-        [["part_init"; "/dev/sda"; "mbr"];
-         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
-         ["part_add"; "/dev/sda"; "p"; "204800"; "409599"];
-         ["part_add"; "/dev/sda"; "p"; "409600"; "-64"];
-         ["pvcreate"; "/dev/sda1"];
-         ["pvcreate"; "/dev/sda2"];
-         ["pvcreate"; "/dev/sda3"];
-         ["vgcreate"; "VG1"; "/foo/bar /dev/sda2"]]), [];
+        "is_string_list (ret, 2, \"VG1\", \"VG2\")"), []
     ];
-    shortdesc = "create an LVM volume group";
+    shortdesc = "list the LVM volume groups (VGs)";
     longdesc = "\
-This creates an LVM volume group called C<volgroup>
-from the non-empty list of physical volumes C<physvols>." };
+List all the volumes groups detected.  This is the equivalent
+of the L<vgs(8)> command.
+
+This returns a list of just the volume group names that were
+detected (eg. C<VolGroup00>).
+
+See also C<guestfs_vgs_full>." };
 
   { defaults with
-    name = "lvcreate"; added = (0, 0, 8);
-    style = RErr, [String "logvol"; String "volgroup"; Int "mbytes"], [];
-    proc_nr = Some 41;
+    name = "lvs"; added = (0, 0, 4);
+    style = RStringList "logvols", [], [];
+    proc_nr = Some 11;
     optional = Some "lvm2";
     tests = [
+      InitBasicFSonLVM, Always, TestResult (
+        [["lvs"]],
+        "is_string_list (ret, 1, \"/dev/VG/LV\")"), [];
       InitEmpty, Always, TestResult (
         [["part_init"; "/dev/sda"; "mbr"];
          ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
@@ -4510,294 +4600,833 @@ from the non-empty list of physical volumes C<physvols>." };
          ["lvcreate"; "LV1"; "VG1"; "50"];
          ["lvcreate"; "LV2"; "VG1"; "50"];
          ["lvcreate"; "LV3"; "VG2"; "50"];
-         ["lvcreate"; "LV4"; "VG2"; "50"];
-         ["lvcreate"; "LV5"; "VG2"; "50"];
          ["lvs"]],
-        "is_string_list (ret, 5, \"/dev/VG1/LV1\", \"/dev/VG1/LV2\", \"/dev/VG2/LV3\", \"/dev/VG2/LV4\", \"/dev/VG2/LV5\")"), []
+        "is_string_list (ret, 3, \"/dev/VG1/LV1\", \"/dev/VG1/LV2\", \"/dev/VG2/LV3\")"), []
     ];
-    shortdesc = "create an LVM logical volume";
-    longdesc = "\
-This creates an LVM logical volume called C<logvol>
-on the volume group C<volgroup>, with C<size> megabytes." };
-
-  { defaults with
-    name = "sfdisk"; added = (0, 0, 8);
-    style = RErr, [Device "device";
-                   Int "cyls"; Int "heads"; Int "sectors";
-                   StringList "lines"], [];
-    proc_nr = Some 43;
-    deprecated_by = Some "part_add";
-    shortdesc = "create partitions on a block device";
+    shortdesc = "list the LVM logical volumes (LVs)";
     longdesc = "\
-This is a direct interface to the L<sfdisk(8)> program for creating
-partitions on block devices.
-
-C<device> should be a block device, for example F</dev/sda>.
-
-C<cyls>, C<heads> and C<sectors> are the number of cylinders, heads
-and sectors on the device, which are passed directly to sfdisk as
-the I<-C>, I<-H> and I<-S> parameters.  If you pass C<0> for any
-of these, then the corresponding parameter is omitted.  Usually for
-'large' disks, you can just pass C<0> for these, but for small
-(floppy-sized) disks, sfdisk (or rather, the kernel) cannot work
-out the right geometry and you will need to tell it.
-
-C<lines> is a list of lines that we feed to C<sfdisk>.  For more
-information refer to the L<sfdisk(8)> manpage.
+List all the logical volumes detected.  This is the equivalent
+of the L<lvs(8)> command.
 
-To create a single partition occupying the whole disk, you would
-pass C<lines> as a single element list, when the single element being
-the string C<,> (comma).
+This returns a list of the logical volume device names
+(eg. F</dev/VolGroup00/LogVol00>).
 
-See also: C<guestfs_sfdisk_l>, C<guestfs_sfdisk_N>,
-C<guestfs_part_init>" };
+See also C<guestfs_lvs_full>, C<guestfs_list_filesystems>." };
 
   { defaults with
-    name = "write_file"; added = (0, 0, 8);
-    style = RErr, [Pathname "path"; String "content"; Int "size"], [];
-    proc_nr = Some 44;
-    protocol_limit_warning = true; deprecated_by = Some "write";
-    (* Regression test for RHBZ#597135. *)
-    tests = [
-      InitScratchFS, Always, TestLastFail
-        [["write_file"; "/write_file"; "abc"; "10000"]], []
-    ];
-    shortdesc = "create a file";
+    name = "pvs_full"; added = (0, 0, 4);
+    style = RStructList ("physvols", "lvm_pv"), [], [];
+    proc_nr = Some 12;
+    optional = Some "lvm2";
+    shortdesc = "list the LVM physical volumes (PVs)";
     longdesc = "\
-This call creates a file called C<path>.  The contents of the
-file is the string C<content> (which can contain any 8 bit data),
-with length C<size>.
-
-As a special case, if C<size> is C<0>
-then the length is calculated using C<strlen> (so in this case
-the content cannot contain embedded ASCII NULs).
+List all the physical volumes detected.  This is the equivalent
+of the L<pvs(8)> command.  The \"full\" version includes all fields." };
 
-I<NB.> Owing to a bug, writing content containing ASCII NUL
-characters does I<not> work, even if the length is specified." };
+  { defaults with
+    name = "vgs_full"; added = (0, 0, 4);
+    style = RStructList ("volgroups", "lvm_vg"), [], [];
+    proc_nr = Some 13;
+    optional = Some "lvm2";
+    shortdesc = "list the LVM volume groups (VGs)";
+    longdesc = "\
+List all the volumes groups detected.  This is the equivalent
+of the L<vgs(8)> command.  The \"full\" version includes all fields." };
 
   { defaults with
-    name = "umount"; added = (0, 0, 8);
-    style = RErr, [Dev_or_Path "pathordevice"], [OBool "force"; OBool "lazyunmount"];
-    proc_nr = Some 45;
-    fish_alias = ["unmount"];
-    once_had_no_optargs = true;
-    tests = [
-      InitEmpty, Always, TestResult (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["mkfs"; "ext2"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
-         ["mount"; "/dev/sda1"; "/"];
-         ["mounts"]], "is_device_list (ret, 1, \"/dev/sda1\")"), [];
-      InitEmpty, Always, TestResult (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["mkfs"; "ext2"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
-         ["mount"; "/dev/sda1"; "/"];
-         ["umount"; "/"; "false"; "false"];
-         ["mounts"]], "is_string_list (ret, 0)"), []
-    ];
-    shortdesc = "unmount a filesystem";
+    name = "lvs_full"; added = (0, 0, 4);
+    style = RStructList ("logvols", "lvm_lv"), [], [];
+    proc_nr = Some 14;
+    optional = Some "lvm2";
+    shortdesc = "list the LVM logical volumes (LVs)";
     longdesc = "\
-This unmounts the given filesystem.  The filesystem may be
-specified either by its mountpoint (path) or the device which
-contains the filesystem." };
+List all the logical volumes detected.  This is the equivalent
+of the L<lvs(8)> command.  The \"full\" version includes all fields." };
 
   { defaults with
-    name = "mounts"; added = (0, 0, 8);
-    style = RStringList "devices", [], [];
-    proc_nr = Some 46;
+    name = "aug_init"; added = (0, 0, 7);
+    style = RErr, [Pathname "root"; Int "flags"], [];
+    proc_nr = Some 16;
     tests = [
-      InitScratchFS, Always, TestResult (
-        [["mounts"]], "is_device_list (ret, 1, \"/dev/sdb1\")"), []
+      InitBasicFS, Always, TestResultString (
+        [["mkdir"; "/etc"];
+         ["write"; "/etc/hostname"; "test.example.org"];
+         ["aug_init"; "/"; "0"];
+         ["aug_get"; "/files/etc/hostname/hostname"]], "test.example.org"), [["aug_close"]]
     ];
-    shortdesc = "show mounted filesystems";
+    shortdesc = "create a new Augeas handle";
     longdesc = "\
-This returns the list of currently mounted filesystems.  It returns
-the list of devices (eg. F</dev/sda1>, F</dev/VG/LV>).
+Create a new Augeas handle for editing configuration files.
+If there was any previous Augeas handle associated with this
+guestfs session, then it is closed.
 
-Some internal mounts are not shown.
+You must call this before using any other C<guestfs_aug_*>
+commands.
 
-See also: C<guestfs_mountpoints>" };
+C<root> is the filesystem root.  C<root> must not be NULL,
+use F</> instead.
 
-  { defaults with
-    name = "umount_all"; added = (0, 0, 8);
-    style = RErr, [], [];
-    proc_nr = Some 47;
-    fish_alias = ["unmount-all"];
-    tests = [
-      InitScratchFS, Always, TestResult (
-        [["umount_all"];
-         ["mounts"]], "is_string_list (ret, 0)"), [];
-      (* check that umount_all can unmount nested mounts correctly: *)
-      InitEmpty, Always, TestResult (
-        [["part_init"; "/dev/sda"; "mbr"];
-         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
-         ["part_add"; "/dev/sda"; "p"; "204800"; "409599"];
-         ["part_add"; "/dev/sda"; "p"; "409600"; "-64"];
-         ["mkfs"; "ext2"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
-         ["mkfs"; "ext2"; "/dev/sda2"; ""; "NOARG"; ""; ""; "NOARG"];
-         ["mkfs"; "ext2"; "/dev/sda3"; ""; "NOARG"; ""; ""; "NOARG"];
-         ["mount"; "/dev/sda1"; "/"];
-         ["mkdir"; "/mp1"];
-         ["mount"; "/dev/sda2"; "/mp1"];
-         ["mkdir"; "/mp1/mp2"];
-         ["mount"; "/dev/sda3"; "/mp1/mp2"];
-         ["mkdir"; "/mp1/mp2/mp3"];
-         ["umount_all"];
-         ["mounts"]], "is_string_list (ret, 0)"), []
-    ];
-    shortdesc = "unmount all filesystems";
-    longdesc = "\
-This unmounts all mounted filesystems.
+The flags are the same as the flags defined in
+E<lt>augeas.hE<gt>, the logical I<or> of the following
+integers:
 
-Some internal mounts are not unmounted by this call." };
+=over 4
+
+=item C<AUG_SAVE_BACKUP> = 1
+
+Keep the original file with a C<.augsave> extension.
+
+=item C<AUG_SAVE_NEWFILE> = 2
+
+Save changes into a file with extension C<.augnew>, and
+do not overwrite original.  Overrides C<AUG_SAVE_BACKUP>.
+
+=item C<AUG_TYPE_CHECK> = 4
+
+Typecheck lenses.
+
+This option is only useful when debugging Augeas lenses.  Use
+of this option may require additional memory for the libguestfs
+appliance.  You may need to set the C<LIBGUESTFS_MEMSIZE>
+environment variable or call C<guestfs_set_memsize>.
+
+=item C<AUG_NO_STDINC> = 8
+
+Do not use standard load path for modules.
+
+=item C<AUG_SAVE_NOOP> = 16
+
+Make save a no-op, just record what would have been changed.
+
+=item C<AUG_NO_LOAD> = 32
+
+Do not load the tree in C<guestfs_aug_init>.
+
+=back
+
+To close the handle, you can call C<guestfs_aug_close>.
+
+To find out more about Augeas, see L<http://augeas.net/>." };
 
   { defaults with
-    name = "lvm_remove_all"; added = (0, 0, 8);
+    name = "aug_close"; added = (0, 0, 7);
     style = RErr, [], [];
-    proc_nr = Some 48;
-    optional = Some "lvm2";
-    shortdesc = "remove all LVM LVs, VGs and PVs";
+    proc_nr = Some 26;
+    shortdesc = "close the current Augeas handle";
     longdesc = "\
-This command removes all LVM logical volumes, volume groups
-and physical volumes." };
+Close the current Augeas handle and free up any resources
+used by it.  After calling this, you have to call
+C<guestfs_aug_init> again before you can use any other
+Augeas functions." };
 
   { defaults with
-    name = "file"; added = (1, 9, 1);
-    style = RString "description", [Dev_or_Path "path"], [];
-    proc_nr = Some 49;
-    tests = [
-      InitISOFS, Always, TestResultString (
-        [["file"; "/empty"]], "empty"), [];
-      InitISOFS, Always, TestResultString (
-        [["file"; "/known-1"]], "ASCII text"), [];
-      InitISOFS, Always, TestLastFail (
-        [["file"; "/notexists"]]), [];
-      InitISOFS, Always, TestResultString (
-        [["file"; "/abssymlink"]], "symbolic link"), [];
-      InitISOFS, Always, TestResultString (
-        [["file"; "/directory"]], "directory"), []
-    ];
-    shortdesc = "determine file type";
+    name = "aug_defvar"; added = (0, 0, 7);
+    style = RInt "nrnodes", [String "name"; OptString "expr"], [];
+    proc_nr = Some 17;
+    shortdesc = "define an Augeas variable";
     longdesc = "\
-This call uses the standard L<file(1)> command to determine
-the type or contents of the file.
+Defines an Augeas variable C<name> whose value is the result
+of evaluating C<expr>.  If C<expr> is NULL, then C<name> is
+undefined.
 
-This call will also transparently look inside various types
-of compressed file.
+On success this returns the number of nodes in C<expr>, or
+C<0> if C<expr> evaluates to something which is not a nodeset." };
 
-The exact command which runs is C<file -zb path>.  Note in
-particular that the filename is not prepended to the output
-(the I<-b> option).
+  { defaults with
+    name = "aug_defnode"; added = (0, 0, 7);
+    style = RStruct ("nrnodescreated", "int_bool"), [String "name"; String "expr"; String "val"], [];
+    proc_nr = Some 18;
+    shortdesc = "define an Augeas node";
+    longdesc = "\
+Defines a variable C<name> whose value is the result of
+evaluating C<expr>.
 
-The output depends on the output of the underlying L<file(1)>
-command and it can change in future in ways beyond our control.
-In other words, the output is not guaranteed by the ABI.
+If C<expr> evaluates to an empty nodeset, a node is created,
+equivalent to calling C<guestfs_aug_set> C<expr>, C<value>.
+C<name> will be the nodeset containing that single node.
 
-See also: L<file(1)>, C<guestfs_vfs_type>, C<guestfs_lstat>,
-C<guestfs_is_file>, C<guestfs_is_blockdev> (etc), C<guestfs_is_zero>." };
+On success this returns a pair containing the
+number of nodes in the nodeset, and a boolean flag
+if a node was created." };
 
   { defaults with
-    name = "command"; added = (1, 9, 1);
-    style = RString "output", [StringList "arguments"], [];
-    proc_nr = Some 50;
-    protocol_limit_warning = true;
+    name = "aug_get"; added = (0, 0, 7);
+    style = RString "val", [String "augpath"], [];
+    proc_nr = Some 19;
+    shortdesc = "look up the value of an Augeas path";
+    longdesc = "\
+Look up the value associated with C<path>.  If C<path>
+matches exactly one node, the C<value> is returned." };
+
+  { defaults with
+    name = "aug_set"; added = (0, 0, 7);
+    style = RErr, [String "augpath"; String "val"], [];
+    proc_nr = Some 20;
     tests = [
-      InitScratchFS, IfNotCrossAppliance, TestResultString (
-        [["mkdir"; "/command"];
-         ["upload"; "test-command"; "/command/test-command"];
-         ["chmod"; "0o755"; "/command/test-command"];
-         ["command"; "/command/test-command 1"]], "Result1"), [];
-      InitScratchFS, IfNotCrossAppliance, TestResultString (
-        [["mkdir"; "/command2"];
-         ["upload"; "test-command"; "/command2/test-command"];
-         ["chmod"; "0o755"; "/command2/test-command"];
-         ["command"; "/command2/test-command 2"]], "Result2\n"), [];
-      InitScratchFS, IfNotCrossAppliance, TestResultString (
-        [["mkdir"; "/command3"];
-         ["upload"; "test-command"; "/command3/test-command"];
-         ["chmod"; "0o755"; "/command3/test-command"];
-         ["command"; "/command3/test-command 3"]], "\nResult3"), [];
-      InitScratchFS, IfNotCrossAppliance, TestResultString (
-        [["mkdir"; "/command4"];
-         ["upload"; "test-command"; "/command4/test-command"];
-         ["chmod"; "0o755"; "/command4/test-command"];
-         ["command"; "/command4/test-command 4"]], "\nResult4\n"), [];
-      InitScratchFS, IfNotCrossAppliance, TestResultString (
-        [["mkdir"; "/command5"];
-         ["upload"; "test-command"; "/command5/test-command"];
-         ["chmod"; "0o755"; "/command5/test-command"];
-         ["command"; "/command5/test-command 5"]], "\nResult5\n\n"), [];
-      InitScratchFS, IfNotCrossAppliance, TestResultString (
-        [["mkdir"; "/command6"];
-         ["upload"; "test-command"; "/command6/test-command"];
-         ["chmod"; "0o755"; "/command6/test-command"];
-         ["command"; "/command6/test-command 6"]], "\n\nResult6\n\n"), [];
-      InitScratchFS, IfNotCrossAppliance, TestResultString (
-        [["mkdir"; "/command7"];
-         ["upload"; "test-command"; "/command7/test-command"];
-         ["chmod"; "0o755"; "/command7/test-command"];
-         ["command"; "/command7/test-command 7"]], ""), [];
-      InitScratchFS, IfNotCrossAppliance, TestResultString (
-        [["mkdir"; "/command8"];
-         ["upload"; "test-command"; "/command8/test-command"];
-         ["chmod"; "0o755"; "/command8/test-command"];
-         ["command"; "/command8/test-command 8"]], "\n"), [];
-      InitScratchFS, IfNotCrossAppliance, TestResultString (
-        [["mkdir"; "/command9"];
-         ["upload"; "test-command"; "/command9/test-command"];
-         ["chmod"; "0o755"; "/command9/test-command"];
-         ["command"; "/command9/test-command 9"]], "\n\n"), [];
-      InitScratchFS, IfNotCrossAppliance, TestResultString (
-        [["mkdir"; "/command10"];
-         ["upload"; "test-command"; "/command10/test-command"];
-         ["chmod"; "0o755"; "/command10/test-command"];
-         ["command"; "/command10/test-command 10"]], "Result10-1\nResult10-2\n"), [];
-      InitScratchFS, IfNotCrossAppliance, TestResultString (
-        [["mkdir"; "/command11"];
-         ["upload"; "test-command"; "/command11/test-command"];
-         ["chmod"; "0o755"; "/command11/test-command"];
-         ["command"; "/command11/test-command 11"]], "Result11-1\nResult11-2"), [];
-      InitScratchFS, IfNotCrossAppliance, TestLastFail (
-        [["mkdir"; "/command12"];
-         ["upload"; "test-command"; "/command12/test-command"];
-         ["chmod"; "0o755"; "/command12/test-command"];
-         ["command"; "/command12/test-command"]]), [];
-      InitScratchFS, IfNotCrossAppliance, TestResultString (
-        [["mkdir"; "/pwd"];
-         ["upload"; "test-pwd"; "/pwd/test-pwd"];
-         ["chmod"; "0o755"; "/pwd/test-pwd"];
-         ["command"; "/pwd/test-pwd"]], "/"), [];
+      InitBasicFS, Always, TestResultString (
+        [["mkdir"; "/etc"];
+         ["write"; "/etc/hostname"; "test.example.org"];
+         ["aug_init"; "/"; "0"];
+         ["aug_set"; "/files/etc/hostname/hostname"; "replace.example.com"];
+         ["aug_get"; "/files/etc/hostname/hostname"]], "replace.example.com"), [["aug_close"]]
     ];
-    shortdesc = "run a command from the guest filesystem";
+    shortdesc = "set Augeas path to value";
     longdesc = "\
-This call runs a command from the guest filesystem.  The
-filesystem must be mounted, and must contain a compatible
-operating system (ie. something Linux, with the same
-or compatible processor architecture).
-
-The single parameter is an argv-style list of arguments.
-The first element is the name of the program to run.
-Subsequent elements are parameters.  The list must be
-non-empty (ie. must contain a program name).  Note that
-the command runs directly, and is I<not> invoked via
-the shell (see C<guestfs_sh>).
-
-The return value is anything printed to I<stdout> by
-the command.
-
-If the command returns a non-zero exit status, then
-this function returns an error message.  The error message
-string is the content of I<stderr> from the command.
-
-The C<$PATH> environment variable will contain at least
-F</usr/bin> and F</bin>.  If you require a program from
-another location, you should provide the full path in the
-first parameter.
+Set the value associated with C<path> to C<val>.
 
-Shared libraries and data files required by the program
-must be available on filesystems which are mounted in the
-correct places.  It is the caller's responsibility to ensure
-all filesystems that are needed are mounted at the right
-locations." };
+In the Augeas API, it is possible to clear a node by setting
+the value to NULL.  Due to an oversight in the libguestfs API
+you cannot do that with this call.  Instead you must use the
+C<guestfs_aug_clear> call." };
+
+  { defaults with
+    name = "aug_insert"; added = (0, 0, 7);
+    style = RErr, [String "augpath"; String "label"; Bool "before"], [];
+    proc_nr = Some 21;
+    tests = [
+      InitBasicFS, Always, TestResultString (
+        [["mkdir"; "/etc"];
+         ["write"; "/etc/hosts"; ""];
+         ["aug_init"; "/"; "0"];
+         ["aug_insert"; "/files/etc/hosts"; "1"; "false"];
+         ["aug_set"; "/files/etc/hosts/1/ipaddr"; "127.0.0.1"];
+         ["aug_set"; "/files/etc/hosts/1/canonical"; "foobar"];
+         ["aug_clear"; "/files/etc/hosts/1/canonical"];
+         ["aug_set"; "/files/etc/hosts/1/canonical"; "localhost"];
+         ["aug_save"];
+         ["cat"; "/etc/hosts"]], "\n127.0.0.1\tlocalhost\n"), [["aug_close"]]
+    ];
+    shortdesc = "insert a sibling Augeas node";
+    longdesc = "\
+Create a new sibling C<label> for C<path>, inserting it into
+the tree before or after C<path> (depending on the boolean
+flag C<before>).
+
+C<path> must match exactly one existing node in the tree, and
+C<label> must be a label, ie. not contain F</>, C<*> or end
+with a bracketed index C<[N]>." };
+
+  { defaults with
+    name = "aug_rm"; added = (0, 0, 7);
+    style = RInt "nrnodes", [String "augpath"], [];
+    proc_nr = Some 22;
+    shortdesc = "remove an Augeas path";
+    longdesc = "\
+Remove C<path> and all of its children.
+
+On success this returns the number of entries which were removed." };
+
+  { defaults with
+    name = "aug_mv"; added = (0, 0, 7);
+    style = RErr, [String "src"; String "dest"], [];
+    proc_nr = Some 23;
+    shortdesc = "move Augeas node";
+    longdesc = "\
+Move the node C<src> to C<dest>.  C<src> must match exactly
+one node.  C<dest> is overwritten if it exists." };
+
+  { defaults with
+    name = "aug_match"; added = (0, 0, 7);
+    style = RStringList "matches", [String "augpath"], [];
+    proc_nr = Some 24;
+    shortdesc = "return Augeas nodes which match augpath";
+    longdesc = "\
+Returns a list of paths which match the path expression C<path>.
+The returned paths are sufficiently qualified so that they match
+exactly one node in the current tree." };
+
+  { defaults with
+    name = "aug_save"; added = (0, 0, 7);
+    style = RErr, [], [];
+    proc_nr = Some 25;
+    shortdesc = "write all pending Augeas changes to disk";
+    longdesc = "\
+This writes all pending changes to disk.
+
+The flags which were passed to C<guestfs_aug_init> affect exactly
+how files are saved." };
+
+  { defaults with
+    name = "aug_load"; added = (0, 0, 7);
+    style = RErr, [], [];
+    proc_nr = Some 27;
+    shortdesc = "load files into the tree";
+    longdesc = "\
+Load files into the tree.
+
+See C<aug_load> in the Augeas documentation for the full gory
+details." };
+
+  { defaults with
+    name = "aug_ls"; added = (0, 0, 8);
+    style = RStringList "matches", [String "augpath"], [];
+    proc_nr = Some 28;
+    tests = [
+      InitBasicFS, Always, TestResult (
+        [["mkdir"; "/etc"];
+         ["write"; "/etc/hosts"; "127.0.0.1 localhost"];
+         ["aug_init"; "/"; "0"];
+         ["aug_ls"; "/files/etc/hosts/1"]],
+        "is_string_list (ret, 2, \"/files/etc/hosts/1/canonical\", \"/files/etc/hosts/1/ipaddr\")"), [["aug_close"]]
+    ];
+    shortdesc = "list Augeas nodes under augpath";
+    longdesc = "\
+This is just a shortcut for listing C<guestfs_aug_match>
+C<path/*> and sorting the resulting nodes into alphabetical order." };
+
+  { defaults with
+    name = "rm"; added = (0, 0, 8);
+    style = RErr, [Pathname "path"], [];
+    proc_nr = Some 29;
+    tests = [
+      InitScratchFS, Always, TestRun
+        [["mkdir"; "/rm"];
+         ["touch"; "/rm/new"];
+         ["rm"; "/rm/new"]], [];
+      InitScratchFS, Always, TestLastFail
+        [["rm"; "/nosuchfile"]], [];
+      InitScratchFS, Always, TestLastFail
+        [["mkdir"; "/rm2"];
+         ["rm"; "/rm2"]], []
+    ];
+    shortdesc = "remove a file";
+    longdesc = "\
+Remove the single file C<path>." };
+
+  { defaults with
+    name = "rmdir"; added = (0, 0, 8);
+    style = RErr, [Pathname "path"], [];
+    proc_nr = Some 30;
+    tests = [
+      InitScratchFS, Always, TestRun
+        [["mkdir"; "/rmdir"];
+         ["rmdir"; "/rmdir"]], [];
+      InitScratchFS, Always, TestLastFail
+        [["rmdir"; "/rmdir2"]], [];
+      InitScratchFS, Always, TestLastFail
+        [["mkdir"; "/rmdir3"];
+         ["touch"; "/rmdir3/new"];
+         ["rmdir"; "/rmdir3/new"]], []
+    ];
+    shortdesc = "remove a directory";
+    longdesc = "\
+Remove the single directory C<path>." };
+
+  { defaults with
+    name = "rm_rf"; added = (0, 0, 8);
+    style = RErr, [Pathname "path"], [];
+    proc_nr = Some 31;
+    tests = [
+      InitScratchFS, Always, TestResultFalse
+        [["mkdir"; "/rm_rf"];
+         ["mkdir"; "/rm_rf/foo"];
+         ["touch"; "/rm_rf/foo/bar"];
+         ["rm_rf"; "/rm_rf"];
+         ["exists"; "/rm_rf"]], []
+    ];
+    shortdesc = "remove a file or directory recursively";
+    longdesc = "\
+Remove the file or directory C<path>, recursively removing the
+contents if its a directory.  This is like the C<rm -rf> shell
+command." };
+
+  { defaults with
+    name = "mkdir"; added = (0, 0, 8);
+    style = RErr, [Pathname "path"], [];
+    proc_nr = Some 32;
+    tests = [
+      InitScratchFS, Always, TestResultTrue
+        [["mkdir"; "/mkdir"];
+         ["is_dir"; "/mkdir"; ""]], [];
+      InitScratchFS, Always, TestLastFail
+        [["mkdir"; "/mkdir2/foo/bar"]], []
+    ];
+    shortdesc = "create a directory";
+    longdesc = "\
+Create a directory named C<path>." };
+
+  { defaults with
+    name = "mkdir_p"; added = (0, 0, 8);
+    style = RErr, [Pathname "path"], [];
+    proc_nr = Some 33;
+    tests = [
+      InitScratchFS, Always, TestResultTrue
+        [["mkdir_p"; "/mkdir_p/foo/bar"];
+         ["is_dir"; "/mkdir_p/foo/bar"; ""]], [];
+      InitScratchFS, Always, TestResultTrue
+        [["mkdir_p"; "/mkdir_p2/foo/bar"];
+         ["is_dir"; "/mkdir_p2/foo"; ""]], [];
+      InitScratchFS, Always, TestResultTrue
+        [["mkdir_p"; "/mkdir_p3/foo/bar"];
+         ["is_dir"; "/mkdir_p3"; ""]], [];
+      (* Regression tests for RHBZ#503133: *)
+      InitScratchFS, Always, TestRun
+        [["mkdir"; "/mkdir_p4"];
+         ["mkdir_p"; "/mkdir_p4"]], [];
+      InitScratchFS, Always, TestLastFail
+        [["touch"; "/mkdir_p5"];
+         ["mkdir_p"; "/mkdir_p5"]], []
+    ];
+    shortdesc = "create a directory and parents";
+    longdesc = "\
+Create a directory named C<path>, creating any parent directories
+as necessary.  This is like the C<mkdir -p> shell command." };
+
+  { defaults with
+    name = "chmod"; added = (0, 0, 8);
+    style = RErr, [Int "mode"; Pathname "path"], [];
+    proc_nr = Some 34;
+    shortdesc = "change file mode";
+    longdesc = "\
+Change the mode (permissions) of C<path> to C<mode>.  Only
+numeric modes are supported.
+
+I<Note>: When using this command from guestfish, C<mode>
+by default would be decimal, unless you prefix it with
+C<0> to get octal, ie. use C<0700> not C<700>.
+
+The mode actually set is affected by the umask." };
+
+  { defaults with
+    name = "chown"; added = (0, 0, 8);
+    style = RErr, [Int "owner"; Int "group"; Pathname "path"], [];
+    proc_nr = Some 35;
+    shortdesc = "change file owner and group";
+    longdesc = "\
+Change the file owner to C<owner> and group to C<group>.
+
+Only numeric uid and gid are supported.  If you want to use
+names, you will need to locate and parse the password file
+yourself (Augeas support makes this relatively easy)." };
+
+  { defaults with
+    name = "exists"; added = (0, 0, 8);
+    style = RBool "existsflag", [Pathname "path"], [];
+    proc_nr = Some 36;
+    tests = [
+      InitISOFS, Always, TestResultTrue (
+        [["exists"; "/empty"]]), [];
+      InitISOFS, Always, TestResultTrue (
+        [["exists"; "/directory"]]), []
+    ];
+    shortdesc = "test if file or directory exists";
+    longdesc = "\
+This returns C<true> if and only if there is a file, directory
+(or anything) with the given C<path> name.
+
+See also C<guestfs_is_file>, C<guestfs_is_dir>, C<guestfs_stat>." };
+
+  { defaults with
+    name = "is_file"; added = (0, 0, 8);
+    style = RBool "fileflag", [Pathname "path"], [OBool "followsymlinks"];
+    proc_nr = Some 37;
+    once_had_no_optargs = true;
+    tests = [
+      InitISOFS, Always, TestResultTrue (
+        [["is_file"; "/known-1"; ""]]), [];
+      InitISOFS, Always, TestResultFalse (
+        [["is_file"; "/directory"; ""]]), [];
+      InitISOFS, Always, TestResultTrue (
+        [["is_file"; "/abssymlink"; "true"]]), []
+    ];
+    shortdesc = "test if a regular file";
+    longdesc = "\
+This returns C<true> if and only if there is a regular file
+with the given C<path> name.  Note that it returns false for
+other objects like directories.
+
+If the optional flag C<followsymlinks> is true, then a symlink
+(or chain of symlinks) that ends with a file also causes the
+function to return true.
+
+See also C<guestfs_stat>." };
+
+  { defaults with
+    name = "is_dir"; added = (0, 0, 8);
+    style = RBool "dirflag", [Pathname "path"], [OBool "followsymlinks"];
+    proc_nr = Some 38;
+    once_had_no_optargs = true;
+    tests = [
+      InitISOFS, Always, TestResultFalse (
+        [["is_dir"; "/known-3"; ""]]), [];
+      InitISOFS, Always, TestResultTrue (
+        [["is_dir"; "/directory"; ""]]), []
+    ];
+    shortdesc = "test if a directory";
+    longdesc = "\
+This returns C<true> if and only if there is a directory
+with the given C<path> name.  Note that it returns false for
+other objects like files.
+
+If the optional flag C<followsymlinks> is true, then a symlink
+(or chain of symlinks) that ends with a directory also causes the
+function to return true.
+
+See also C<guestfs_stat>." };
+
+  { defaults with
+    name = "pvcreate"; added = (0, 0, 8);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 39;
+    optional = Some "lvm2";
+    tests = [
+      InitEmpty, Always, TestResult (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
+         ["part_add"; "/dev/sda"; "p"; "204800"; "409599"];
+         ["part_add"; "/dev/sda"; "p"; "409600"; "-64"];
+         ["pvcreate"; "/dev/sda1"];
+         ["pvcreate"; "/dev/sda2"];
+         ["pvcreate"; "/dev/sda3"];
+         ["pvs"]],
+        "is_device_list (ret, 3, \"/dev/sda1\", \"/dev/sda2\", \"/dev/sda3\")"), []
+    ];
+    shortdesc = "create an LVM physical volume";
+    longdesc = "\
+This creates an LVM physical volume on the named C<device>,
+where C<device> should usually be a partition name such
+as F</dev/sda1>." };
+
+  { defaults with
+    name = "vgcreate"; added = (0, 0, 8);
+    style = RErr, [String "volgroup"; DeviceList "physvols"], [];
+    proc_nr = Some 40;
+    optional = Some "lvm2";
+    tests = [
+      InitEmpty, Always, TestResult (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
+         ["part_add"; "/dev/sda"; "p"; "204800"; "409599"];
+         ["part_add"; "/dev/sda"; "p"; "409600"; "-64"];
+         ["pvcreate"; "/dev/sda1"];
+         ["pvcreate"; "/dev/sda2"];
+         ["pvcreate"; "/dev/sda3"];
+         ["vgcreate"; "VG1"; "/dev/sda1 /dev/sda2"];
+         ["vgcreate"; "VG2"; "/dev/sda3"];
+         ["vgs"]],
+        "is_string_list (ret, 2, \"VG1\", \"VG2\")"), [];
+      InitEmpty, Always, TestLastFail (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
+         ["part_add"; "/dev/sda"; "p"; "204800"; "409599"];
+         ["part_add"; "/dev/sda"; "p"; "409600"; "-64"];
+         ["pvcreate"; "/dev/sda1"];
+         ["pvcreate"; "/dev/sda2"];
+         ["pvcreate"; "/dev/sda3"];
+         ["vgcreate"; "VG1"; "/foo/bar /dev/sda2"]]), [];
+    ];
+    shortdesc = "create an LVM volume group";
+    longdesc = "\
+This creates an LVM volume group called C<volgroup>
+from the non-empty list of physical volumes C<physvols>." };
+
+  { defaults with
+    name = "lvcreate"; added = (0, 0, 8);
+    style = RErr, [String "logvol"; String "volgroup"; Int "mbytes"], [];
+    proc_nr = Some 41;
+    optional = Some "lvm2";
+    tests = [
+      InitEmpty, Always, TestResult (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
+         ["part_add"; "/dev/sda"; "p"; "204800"; "409599"];
+         ["part_add"; "/dev/sda"; "p"; "409600"; "-64"];
+         ["pvcreate"; "/dev/sda1"];
+         ["pvcreate"; "/dev/sda2"];
+         ["pvcreate"; "/dev/sda3"];
+         ["vgcreate"; "VG1"; "/dev/sda1 /dev/sda2"];
+         ["vgcreate"; "VG2"; "/dev/sda3"];
+         ["lvcreate"; "LV1"; "VG1"; "50"];
+         ["lvcreate"; "LV2"; "VG1"; "50"];
+         ["lvcreate"; "LV3"; "VG2"; "50"];
+         ["lvcreate"; "LV4"; "VG2"; "50"];
+         ["lvcreate"; "LV5"; "VG2"; "50"];
+         ["lvs"]],
+        "is_string_list (ret, 5, \"/dev/VG1/LV1\", \"/dev/VG1/LV2\", \"/dev/VG2/LV3\", \"/dev/VG2/LV4\", \"/dev/VG2/LV5\")"), []
+    ];
+    shortdesc = "create an LVM logical volume";
+    longdesc = "\
+This creates an LVM logical volume called C<logvol>
+on the volume group C<volgroup>, with C<size> megabytes." };
+
+  { defaults with
+    name = "sfdisk"; added = (0, 0, 8);
+    style = RErr, [Device "device";
+                   Int "cyls"; Int "heads"; Int "sectors";
+                   StringList "lines"], [];
+    proc_nr = Some 43;
+    deprecated_by = Some "part_add";
+    shortdesc = "create partitions on a block device";
+    longdesc = "\
+This is a direct interface to the L<sfdisk(8)> program for creating
+partitions on block devices.
+
+C<device> should be a block device, for example F</dev/sda>.
+
+C<cyls>, C<heads> and C<sectors> are the number of cylinders, heads
+and sectors on the device, which are passed directly to sfdisk as
+the I<-C>, I<-H> and I<-S> parameters.  If you pass C<0> for any
+of these, then the corresponding parameter is omitted.  Usually for
+'large' disks, you can just pass C<0> for these, but for small
+(floppy-sized) disks, sfdisk (or rather, the kernel) cannot work
+out the right geometry and you will need to tell it.
+
+C<lines> is a list of lines that we feed to C<sfdisk>.  For more
+information refer to the L<sfdisk(8)> manpage.
+
+To create a single partition occupying the whole disk, you would
+pass C<lines> as a single element list, when the single element being
+the string C<,> (comma).
+
+See also: C<guestfs_sfdisk_l>, C<guestfs_sfdisk_N>,
+C<guestfs_part_init>" };
+
+  { defaults with
+    name = "write_file"; added = (0, 0, 8);
+    style = RErr, [Pathname "path"; String "content"; Int "size"], [];
+    proc_nr = Some 44;
+    protocol_limit_warning = true; deprecated_by = Some "write";
+    (* Regression test for RHBZ#597135. *)
+    tests = [
+      InitScratchFS, Always, TestLastFail
+        [["write_file"; "/write_file"; "abc"; "10000"]], []
+    ];
+    shortdesc = "create a file";
+    longdesc = "\
+This call creates a file called C<path>.  The contents of the
+file is the string C<content> (which can contain any 8 bit data),
+with length C<size>.
+
+As a special case, if C<size> is C<0>
+then the length is calculated using C<strlen> (so in this case
+the content cannot contain embedded ASCII NULs).
+
+I<NB.> Owing to a bug, writing content containing ASCII NUL
+characters does I<not> work, even if the length is specified." };
+
+  { defaults with
+    name = "umount"; added = (0, 0, 8);
+    style = RErr, [Dev_or_Path "pathordevice"], [OBool "force"; OBool "lazyunmount"];
+    proc_nr = Some 45;
+    fish_alias = ["unmount"];
+    once_had_no_optargs = true;
+    tests = [
+      InitEmpty, Always, TestResult (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["mkfs"; "ext2"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["mount"; "/dev/sda1"; "/"];
+         ["mounts"]], "is_device_list (ret, 1, \"/dev/sda1\")"), [];
+      InitEmpty, Always, TestResult (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["mkfs"; "ext2"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["mount"; "/dev/sda1"; "/"];
+         ["umount"; "/"; "false"; "false"];
+         ["mounts"]], "is_string_list (ret, 0)"), []
+    ];
+    shortdesc = "unmount a filesystem";
+    longdesc = "\
+This unmounts the given filesystem.  The filesystem may be
+specified either by its mountpoint (path) or the device which
+contains the filesystem." };
+
+  { defaults with
+    name = "mounts"; added = (0, 0, 8);
+    style = RStringList "devices", [], [];
+    proc_nr = Some 46;
+    tests = [
+      InitScratchFS, Always, TestResult (
+        [["mounts"]], "is_device_list (ret, 1, \"/dev/sdb1\")"), []
+    ];
+    shortdesc = "show mounted filesystems";
+    longdesc = "\
+This returns the list of currently mounted filesystems.  It returns
+the list of devices (eg. F</dev/sda1>, F</dev/VG/LV>).
+
+Some internal mounts are not shown.
+
+See also: C<guestfs_mountpoints>" };
+
+  { defaults with
+    name = "umount_all"; added = (0, 0, 8);
+    style = RErr, [], [];
+    proc_nr = Some 47;
+    fish_alias = ["unmount-all"];
+    tests = [
+      InitScratchFS, Always, TestResult (
+        [["umount_all"];
+         ["mounts"]], "is_string_list (ret, 0)"), [];
+      (* check that umount_all can unmount nested mounts correctly: *)
+      InitEmpty, Always, TestResult (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
+         ["part_add"; "/dev/sda"; "p"; "204800"; "409599"];
+         ["part_add"; "/dev/sda"; "p"; "409600"; "-64"];
+         ["mkfs"; "ext2"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["mkfs"; "ext2"; "/dev/sda2"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["mkfs"; "ext2"; "/dev/sda3"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["mount"; "/dev/sda1"; "/"];
+         ["mkdir"; "/mp1"];
+         ["mount"; "/dev/sda2"; "/mp1"];
+         ["mkdir"; "/mp1/mp2"];
+         ["mount"; "/dev/sda3"; "/mp1/mp2"];
+         ["mkdir"; "/mp1/mp2/mp3"];
+         ["umount_all"];
+         ["mounts"]], "is_string_list (ret, 0)"), []
+    ];
+    shortdesc = "unmount all filesystems";
+    longdesc = "\
+This unmounts all mounted filesystems.
+
+Some internal mounts are not unmounted by this call." };
+
+  { defaults with
+    name = "lvm_remove_all"; added = (0, 0, 8);
+    style = RErr, [], [];
+    proc_nr = Some 48;
+    optional = Some "lvm2";
+    shortdesc = "remove all LVM LVs, VGs and PVs";
+    longdesc = "\
+This command removes all LVM logical volumes, volume groups
+and physical volumes." };
+
+  { defaults with
+    name = "file"; added = (1, 9, 1);
+    style = RString "description", [Dev_or_Path "path"], [];
+    proc_nr = Some 49;
+    tests = [
+      InitISOFS, Always, TestResultString (
+        [["file"; "/empty"]], "empty"), [];
+      InitISOFS, Always, TestResultString (
+        [["file"; "/known-1"]], "ASCII text"), [];
+      InitISOFS, Always, TestLastFail (
+        [["file"; "/notexists"]]), [];
+      InitISOFS, Always, TestResultString (
+        [["file"; "/abssymlink"]], "symbolic link"), [];
+      InitISOFS, Always, TestResultString (
+        [["file"; "/directory"]], "directory"), []
+    ];
+    shortdesc = "determine file type";
+    longdesc = "\
+This call uses the standard L<file(1)> command to determine
+the type or contents of the file.
+
+This call will also transparently look inside various types
+of compressed file.
+
+The exact command which runs is C<file -zb path>.  Note in
+particular that the filename is not prepended to the output
+(the I<-b> option).
+
+The output depends on the output of the underlying L<file(1)>
+command and it can change in future in ways beyond our control.
+In other words, the output is not guaranteed by the ABI.
+
+See also: L<file(1)>, C<guestfs_vfs_type>, C<guestfs_lstat>,
+C<guestfs_is_file>, C<guestfs_is_blockdev> (etc), C<guestfs_is_zero>." };
+
+  { defaults with
+    name = "command"; added = (1, 9, 1);
+    style = RString "output", [StringList "arguments"], [];
+    proc_nr = Some 50;
+    protocol_limit_warning = true;
+    tests = [
+      InitScratchFS, IfNotCrossAppliance, TestResultString (
+        [["mkdir"; "/command"];
+         ["upload"; "test-command"; "/command/test-command"];
+         ["chmod"; "0o755"; "/command/test-command"];
+         ["command"; "/command/test-command 1"]], "Result1"), [];
+      InitScratchFS, IfNotCrossAppliance, TestResultString (
+        [["mkdir"; "/command2"];
+         ["upload"; "test-command"; "/command2/test-command"];
+         ["chmod"; "0o755"; "/command2/test-command"];
+         ["command"; "/command2/test-command 2"]], "Result2\n"), [];
+      InitScratchFS, IfNotCrossAppliance, TestResultString (
+        [["mkdir"; "/command3"];
+         ["upload"; "test-command"; "/command3/test-command"];
+         ["chmod"; "0o755"; "/command3/test-command"];
+         ["command"; "/command3/test-command 3"]], "\nResult3"), [];
+      InitScratchFS, IfNotCrossAppliance, TestResultString (
+        [["mkdir"; "/command4"];
+         ["upload"; "test-command"; "/command4/test-command"];
+         ["chmod"; "0o755"; "/command4/test-command"];
+         ["command"; "/command4/test-command 4"]], "\nResult4\n"), [];
+      InitScratchFS, IfNotCrossAppliance, TestResultString (
+        [["mkdir"; "/command5"];
+         ["upload"; "test-command"; "/command5/test-command"];
+         ["chmod"; "0o755"; "/command5/test-command"];
+         ["command"; "/command5/test-command 5"]], "\nResult5\n\n"), [];
+      InitScratchFS, IfNotCrossAppliance, TestResultString (
+        [["mkdir"; "/command6"];
+         ["upload"; "test-command"; "/command6/test-command"];
+         ["chmod"; "0o755"; "/command6/test-command"];
+         ["command"; "/command6/test-command 6"]], "\n\nResult6\n\n"), [];
+      InitScratchFS, IfNotCrossAppliance, TestResultString (
+        [["mkdir"; "/command7"];
+         ["upload"; "test-command"; "/command7/test-command"];
+         ["chmod"; "0o755"; "/command7/test-command"];
+         ["command"; "/command7/test-command 7"]], ""), [];
+      InitScratchFS, IfNotCrossAppliance, TestResultString (
+        [["mkdir"; "/command8"];
+         ["upload"; "test-command"; "/command8/test-command"];
+         ["chmod"; "0o755"; "/command8/test-command"];
+         ["command"; "/command8/test-command 8"]], "\n"), [];
+      InitScratchFS, IfNotCrossAppliance, TestResultString (
+        [["mkdir"; "/command9"];
+         ["upload"; "test-command"; "/command9/test-command"];
+         ["chmod"; "0o755"; "/command9/test-command"];
+         ["command"; "/command9/test-command 9"]], "\n\n"), [];
+      InitScratchFS, IfNotCrossAppliance, TestResultString (
+        [["mkdir"; "/command10"];
+         ["upload"; "test-command"; "/command10/test-command"];
+         ["chmod"; "0o755"; "/command10/test-command"];
+         ["command"; "/command10/test-command 10"]], "Result10-1\nResult10-2\n"), [];
+      InitScratchFS, IfNotCrossAppliance, TestResultString (
+        [["mkdir"; "/command11"];
+         ["upload"; "test-command"; "/command11/test-command"];
+         ["chmod"; "0o755"; "/command11/test-command"];
+         ["command"; "/command11/test-command 11"]], "Result11-1\nResult11-2"), [];
+      InitScratchFS, IfNotCrossAppliance, TestLastFail (
+        [["mkdir"; "/command12"];
+         ["upload"; "test-command"; "/command12/test-command"];
+         ["chmod"; "0o755"; "/command12/test-command"];
+         ["command"; "/command12/test-command"]]), [];
+      InitScratchFS, IfNotCrossAppliance, TestResultString (
+        [["mkdir"; "/pwd"];
+         ["upload"; "test-pwd"; "/pwd/test-pwd"];
+         ["chmod"; "0o755"; "/pwd/test-pwd"];
+         ["command"; "/pwd/test-pwd"]], "/"), [];
+    ];
+    shortdesc = "run a command from the guest filesystem";
+    longdesc = "\
+This call runs a command from the guest filesystem.  The
+filesystem must be mounted, and must contain a compatible
+operating system (ie. something Linux, with the same
+or compatible processor architecture).
+
+The single parameter is an argv-style list of arguments.
+The first element is the name of the program to run.
+Subsequent elements are parameters.  The list must be
+non-empty (ie. must contain a program name).  Note that
+the command runs directly, and is I<not> invoked via
+the shell (see C<guestfs_sh>).
+
+The return value is anything printed to I<stdout> by
+the command.
+
+If the command returns a non-zero exit status, then
+this function returns an error message.  The error message
+string is the content of I<stderr> from the command.
+
+The C<$PATH> environment variable will contain at least
+F</usr/bin> and F</bin>.  If you require a program from
+another location, you should provide the full path in the
+first parameter.
+
+Shared libraries and data files required by the program
+must be available on filesystems which are mounted in the
+correct places.  It is the caller's responsibility to ensure
+all filesystems that are needed are mounted at the right
+locations." };
 
   { defaults with
     name = "command_lines"; added = (1, 9, 1);
@@ -4805,7393 +5434,8264 @@ locations." };
     proc_nr = Some 51;
     protocol_limit_warning = true;
     tests = [
-      InitScratchFS, IfNotCrossAppliance, TestResult (
-        [["mkdir"; "/command_lines"];
-         ["upload"; "test-command"; "/command_lines/test-command"];
-         ["chmod"; "0o755"; "/command_lines/test-command"];
-         ["command_lines"; "/command_lines/test-command 1"]],
-        "is_string_list (ret, 1, \"Result1\")"), [];
-      InitScratchFS, IfNotCrossAppliance, TestResult (
-        [["mkdir"; "/command_lines2"];
-         ["upload"; "test-command"; "/command_lines2/test-command"];
-         ["chmod"; "0o755"; "/command_lines2/test-command"];
-         ["command_lines"; "/command_lines2/test-command 2"]],
-        "is_string_list (ret, 1, \"Result2\")"), [];
-      InitScratchFS, IfNotCrossAppliance, TestResult (
-        [["mkdir"; "/command_lines3"];
-         ["upload"; "test-command"; "/command_lines3/test-command"];
-         ["chmod"; "0o755"; "/command_lines3/test-command"];
-         ["command_lines"; "/command_lines3/test-command 3"]],
-        "is_string_list (ret, 2, \"\", \"Result3\")"), [];
-      InitScratchFS, IfNotCrossAppliance, TestResult (
-        [["mkdir"; "/command_lines4"];
-         ["upload"; "test-command"; "/command_lines4/test-command"];
-         ["chmod"; "0o755"; "/command_lines4/test-command"];
-         ["command_lines"; "/command_lines4/test-command 4"]],
-        "is_string_list (ret, 2, \"\", \"Result4\")"), [];
-      InitScratchFS, IfNotCrossAppliance, TestResult (
-        [["mkdir"; "/command_lines5"];
-         ["upload"; "test-command"; "/command_lines5/test-command"];
-         ["chmod"; "0o755"; "/command_lines5/test-command"];
-         ["command_lines"; "/command_lines5/test-command 5"]],
-        "is_string_list (ret, 3, \"\", \"Result5\", \"\")"), [];
-      InitScratchFS, IfNotCrossAppliance, TestResult (
-        [["mkdir"; "/command_lines6"];
-         ["upload"; "test-command"; "/command_lines6/test-command"];
-         ["chmod"; "0o755"; "/command_lines6/test-command"];
-         ["command_lines"; "/command_lines6/test-command 6"]],
-        "is_string_list (ret, 4, \"\", \"\", \"Result6\", \"\")"), [];
-      InitScratchFS, IfNotCrossAppliance, TestResult (
-        [["mkdir"; "/command_lines7"];
-         ["upload"; "test-command"; "/command_lines7/test-command"];
-         ["chmod"; "0o755"; "/command_lines7/test-command"];
-         ["command_lines"; "/command_lines7/test-command 7"]],
+      InitScratchFS, IfNotCrossAppliance, TestResult (
+        [["mkdir"; "/command_lines"];
+         ["upload"; "test-command"; "/command_lines/test-command"];
+         ["chmod"; "0o755"; "/command_lines/test-command"];
+         ["command_lines"; "/command_lines/test-command 1"]],
+        "is_string_list (ret, 1, \"Result1\")"), [];
+      InitScratchFS, IfNotCrossAppliance, TestResult (
+        [["mkdir"; "/command_lines2"];
+         ["upload"; "test-command"; "/command_lines2/test-command"];
+         ["chmod"; "0o755"; "/command_lines2/test-command"];
+         ["command_lines"; "/command_lines2/test-command 2"]],
+        "is_string_list (ret, 1, \"Result2\")"), [];
+      InitScratchFS, IfNotCrossAppliance, TestResult (
+        [["mkdir"; "/command_lines3"];
+         ["upload"; "test-command"; "/command_lines3/test-command"];
+         ["chmod"; "0o755"; "/command_lines3/test-command"];
+         ["command_lines"; "/command_lines3/test-command 3"]],
+        "is_string_list (ret, 2, \"\", \"Result3\")"), [];
+      InitScratchFS, IfNotCrossAppliance, TestResult (
+        [["mkdir"; "/command_lines4"];
+         ["upload"; "test-command"; "/command_lines4/test-command"];
+         ["chmod"; "0o755"; "/command_lines4/test-command"];
+         ["command_lines"; "/command_lines4/test-command 4"]],
+        "is_string_list (ret, 2, \"\", \"Result4\")"), [];
+      InitScratchFS, IfNotCrossAppliance, TestResult (
+        [["mkdir"; "/command_lines5"];
+         ["upload"; "test-command"; "/command_lines5/test-command"];
+         ["chmod"; "0o755"; "/command_lines5/test-command"];
+         ["command_lines"; "/command_lines5/test-command 5"]],
+        "is_string_list (ret, 3, \"\", \"Result5\", \"\")"), [];
+      InitScratchFS, IfNotCrossAppliance, TestResult (
+        [["mkdir"; "/command_lines6"];
+         ["upload"; "test-command"; "/command_lines6/test-command"];
+         ["chmod"; "0o755"; "/command_lines6/test-command"];
+         ["command_lines"; "/command_lines6/test-command 6"]],
+        "is_string_list (ret, 4, \"\", \"\", \"Result6\", \"\")"), [];
+      InitScratchFS, IfNotCrossAppliance, TestResult (
+        [["mkdir"; "/command_lines7"];
+         ["upload"; "test-command"; "/command_lines7/test-command"];
+         ["chmod"; "0o755"; "/command_lines7/test-command"];
+         ["command_lines"; "/command_lines7/test-command 7"]],
+        "is_string_list (ret, 0)"), [];
+      InitScratchFS, IfNotCrossAppliance, TestResult (
+        [["mkdir"; "/command_lines8"];
+         ["upload"; "test-command"; "/command_lines8/test-command"];
+         ["chmod"; "0o755"; "/command_lines8/test-command"];
+         ["command_lines"; "/command_lines8/test-command 8"]],
+        "is_string_list (ret, 1, \"\")"), [];
+      InitScratchFS, IfNotCrossAppliance, TestResult (
+        [["mkdir"; "/command_lines9"];
+         ["upload"; "test-command"; "/command_lines9/test-command"];
+         ["chmod"; "0o755"; "/command_lines9/test-command"];
+         ["command_lines"; "/command_lines9/test-command 9"]],
+        "is_string_list (ret, 2, \"\", \"\")"), [];
+      InitScratchFS, IfNotCrossAppliance, TestResult (
+        [["mkdir"; "/command_lines10"];
+         ["upload"; "test-command"; "/command_lines10/test-command"];
+         ["chmod"; "0o755"; "/command_lines10/test-command"];
+         ["command_lines"; "/command_lines10/test-command 10"]],
+        "is_string_list (ret, 2, \"Result10-1\", \"Result10-2\")"), [];
+      InitScratchFS, IfNotCrossAppliance, TestResult (
+        [["mkdir"; "/command_lines11"];
+         ["upload"; "test-command"; "/command_lines11/test-command"];
+         ["chmod"; "0o755"; "/command_lines11/test-command"];
+         ["command_lines"; "/command_lines11/test-command 11"]],
+        "is_string_list (ret, 2, \"Result11-1\", \"Result11-2\")"), []
+    ];
+    shortdesc = "run a command, returning lines";
+    longdesc = "\
+This is the same as C<guestfs_command>, but splits the
+result into a list of lines.
+
+See also: C<guestfs_sh_lines>" };
+
+  { defaults with
+    name = "statvfs"; added = (1, 9, 2);
+    style = RStruct ("statbuf", "statvfs"), [Pathname "path"], [];
+    proc_nr = Some 54;
+    tests = [
+      InitISOFS, Always, TestResult (
+        [["statvfs"; "/"]], "ret->namemax == 255"), []
+    ];
+    shortdesc = "get file system statistics";
+    longdesc = "\
+Returns file system statistics for any mounted file system.
+C<path> should be a file or directory in the mounted file system
+(typically it is the mount point itself, but it doesn't need to be).
+
+This is the same as the L<statvfs(2)> system call." };
+
+  { defaults with
+    name = "tune2fs_l"; added = (1, 9, 2);
+    style = RHashtable "superblock", [Device "device"], [];
+    proc_nr = Some 55;
+    tests = [
+      InitScratchFS, Always, TestResult (
+        [["tune2fs_l"; "/dev/sdb1"]],
+        "check_hash (ret, \"Filesystem magic number\", \"0xEF53\") == 0 && "^
+          "check_hash (ret, \"Filesystem OS type\", \"Linux\") == 0"), [];
+    ];
+    shortdesc = "get ext2/ext3/ext4 superblock details";
+    longdesc = "\
+This returns the contents of the ext2, ext3 or ext4 filesystem
+superblock on C<device>.
+
+It is the same as running C<tune2fs -l device>.  See L<tune2fs(8)>
+manpage for more details.  The list of fields returned isn't
+clearly defined, and depends on both the version of C<tune2fs>
+that libguestfs was built against, and the filesystem itself." };
+
+  { defaults with
+    name = "blockdev_setro"; added = (1, 9, 3);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 56;
+    tests = [
+      InitEmpty, Always, TestResultTrue (
+        [["blockdev_setro"; "/dev/sda"];
+         ["blockdev_getro"; "/dev/sda"]]), []
+    ];
+    shortdesc = "set block device to read-only";
+    longdesc = "\
+Sets the block device named C<device> to read-only.
+
+This uses the L<blockdev(8)> command." };
+
+  { defaults with
+    name = "blockdev_setrw"; added = (1, 9, 3);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 57;
+    tests = [
+      InitEmpty, Always, TestResultFalse (
+        [["blockdev_setrw"; "/dev/sda"];
+         ["blockdev_getro"; "/dev/sda"]]), []
+    ];
+    shortdesc = "set block device to read-write";
+    longdesc = "\
+Sets the block device named C<device> to read-write.
+
+This uses the L<blockdev(8)> command." };
+
+  { defaults with
+    name = "blockdev_getro"; added = (1, 9, 3);
+    style = RBool "ro", [Device "device"], [];
+    proc_nr = Some 58;
+    reentrant = true;
+    tests = [
+      InitEmpty, Always, TestResultTrue (
+        [["blockdev_setro"; "/dev/sda"];
+         ["blockdev_getro"; "/dev/sda"]]), []
+    ];
+    shortdesc = "is block device set to read-only";
+    longdesc = "\
+Returns a boolean indicating if the block device is read-only
+(true if read-only, false if not).
+
+This uses the L<blockdev(8)> command." };
+
+  { defaults with
+    name = "blockdev_getss"; added = (1, 9, 3);
+    style = RInt "sectorsize", [Device "device"], [];
+    proc_nr = Some 59;
+    reentrant = true;
+    tests = [
+      InitEmpty, Always, TestResult (
+        [["blockdev_getss"; "/dev/sda"]], "ret == 512"), []
+    ];
+    shortdesc = "get sectorsize of block device";
+    longdesc = "\
+This returns the size of sectors on a block device.
+Usually 512, but can be larger for modern devices.
+
+(Note, this is not the size in sectors, use C<guestfs_blockdev_getsz>
+for that).
+
+This uses the L<blockdev(8)> command." };
+
+  { defaults with
+    name = "blockdev_getbsz"; added = (1, 9, 3);
+    style = RInt "blocksize", [Device "device"], [];
+    proc_nr = Some 60;
+    reentrant = true;
+    test_excuse = "cannot be tested because output differs depending on page size";
+    shortdesc = "get blocksize of block device";
+    longdesc = "\
+This returns the block size of a device.
+
+Note: this is different from both I<size in blocks> and
+I<filesystem block size>.  Also this setting is not really
+used by anything.  You should probably not use it for
+anything.  Filesystems have their own idea about what
+block size to choose.
+
+This uses the L<blockdev(8)> command." };
+
+  { defaults with
+    name = "blockdev_setbsz"; added = (1, 9, 3);
+    style = RErr, [Device "device"; Int "blocksize"], [];
+    proc_nr = Some 61;
+    deprecated_by = Some "mkfs";
+    shortdesc = "set blocksize of block device";
+    longdesc = "\
+This call does nothing and has never done anything
+because of a bug in blockdev.  B<Do not use it.>
+
+If you need to set the filesystem block size, use the
+C<blocksize> option of C<guestfs_mkfs>." };
+
+  { defaults with
+    name = "blockdev_getsz"; added = (1, 9, 3);
+    style = RInt64 "sizeinsectors", [Device "device"], [];
+    proc_nr = Some 62;
+    reentrant = true;
+    tests = [
+      InitEmpty, Always, TestResult (
+        [["blockdev_getsz"; "/dev/sda"]],
+          "ret == INT64_C(2)*1024*1024*1024/512"), []
+    ];
+    shortdesc = "get total size of device in 512-byte sectors";
+    longdesc = "\
+This returns the size of the device in units of 512-byte sectors
+(even if the sectorsize isn't 512 bytes ... weird).
+
+See also C<guestfs_blockdev_getss> for the real sector size of
+the device, and C<guestfs_blockdev_getsize64> for the more
+useful I<size in bytes>.
+
+This uses the L<blockdev(8)> command." };
+
+  { defaults with
+    name = "blockdev_getsize64"; added = (1, 9, 3);
+    style = RInt64 "sizeinbytes", [Device "device"], [];
+    proc_nr = Some 63;
+    reentrant = true;
+    tests = [
+      InitEmpty, Always, TestResult (
+        [["blockdev_getsize64"; "/dev/sda"]],
+          "ret == INT64_C(2)*1024*1024*1024"), []
+    ];
+    shortdesc = "get total size of device in bytes";
+    longdesc = "\
+This returns the size of the device in bytes.
+
+See also C<guestfs_blockdev_getsz>.
+
+This uses the L<blockdev(8)> command." };
+
+  { defaults with
+    name = "blockdev_flushbufs"; added = (1, 9, 3);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 64;
+    tests = [
+      InitEmpty, Always, TestRun
+        [["blockdev_flushbufs"; "/dev/sda"]], []
+    ];
+    shortdesc = "flush device buffers";
+    longdesc = "\
+This tells the kernel to flush internal buffers associated
+with C<device>.
+
+This uses the L<blockdev(8)> command." };
+
+  { defaults with
+    name = "blockdev_rereadpt"; added = (1, 9, 3);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 65;
+    tests = [
+      InitEmpty, Always, TestRun
+        [["blockdev_rereadpt"; "/dev/sda"]], []
+    ];
+    shortdesc = "reread partition table";
+    longdesc = "\
+Reread the partition table on C<device>.
+
+This uses the L<blockdev(8)> command." };
+
+  { defaults with
+    name = "upload"; added = (1, 0, 2);
+    style = RErr, [FileIn "filename"; Dev_or_Path "remotefilename"], [];
+    proc_nr = Some 66;
+    progress = true; cancellable = true;
+    tests = [
+      InitScratchFS, Always, TestResultString (
+        (* Pick a file from cwd which isn't likely to change. *)
+        [["mkdir"; "/upload"];
+         ["upload"; "$srcdir/../../COPYING.LIB"; "/upload/COPYING.LIB"];
+         ["checksum"; "md5"; "/upload/COPYING.LIB"]],
+        Digest.to_hex (Digest.file "COPYING.LIB")), []
+    ];
+    shortdesc = "upload a file from the local machine";
+    longdesc = "\
+Upload local file F<filename> to F<remotefilename> on the
+filesystem.
+
+F<filename> can also be a named pipe.
+
+See also C<guestfs_download>." };
+
+  { defaults with
+    name = "download"; added = (1, 0, 2);
+    style = RErr, [Dev_or_Path "remotefilename"; FileOut "filename"], [];
+    proc_nr = Some 67;
+    progress = true; cancellable = true;
+    tests = [
+      InitScratchFS, Always, TestResultString (
+        (* Pick a file from cwd which isn't likely to change. *)
+        [["mkdir"; "/download"];
+         ["upload"; "$srcdir/../../COPYING.LIB"; "/download/COPYING.LIB"];
+         ["download"; "/download/COPYING.LIB"; "testdownload.tmp"];
+         ["upload"; "testdownload.tmp"; "/download/upload"];
+         ["checksum"; "md5"; "/download/upload"]],
+        Digest.to_hex (Digest.file "COPYING.LIB")), []
+    ];
+    shortdesc = "download a file to the local machine";
+    longdesc = "\
+Download file F<remotefilename> and save it as F<filename>
+on the local machine.
+
+F<filename> can also be a named pipe.
+
+Holes in F<remotefilename>, and blocks of zeroes if it is a device,
+are not transferred.  If F<filename> is a regular file they are
+left as holes, so it is sparse.
+
+See also C<guestfs_upload>, C<guestfs_cat>." };
+
+  { defaults with
+    name = "checksum"; added = (1, 0, 2);
+    style = RString "checksum", [String "csumtype"; Pathname "path"], [];
+    proc_nr = Some 68;
+    tests = [
+      InitISOFS, Always, TestResultString (
+        [["checksum"; "crc"; "/known-3"]], "2891671662"), [];
+      InitISOFS, Always, TestLastFail (
+        [["checksum"; "crc"; "/notexists"]]), [];
+      InitISOFS, Always, TestResultString (
+        [["checksum"; "md5"; "/known-3"]], "46d6ca27ee07cdc6fa99c2e138cc522c"), [];
+      InitISOFS, Always, TestResultString (
+        [["checksum"; "sha1"; "/known-3"]], "b7ebccc3ee418311091c3eda0a45b83c0a770f15"), [];
+      InitISOFS, Always, TestResultString (
+        [["checksum"; "sha224"; "/known-3"]], "d2cd1774b28f3659c14116be0a6dc2bb5c4b350ce9cd5defac707741"), [];
+      InitISOFS, Always, TestResultString (
+        [["checksum"; "sha256"; "/known-3"]], "75bb71b90cd20cb13f86d2bea8dad63ac7194e7517c3b52b8d06ff52d3487d30"), [];
+      InitISOFS, Always, TestResultString (
+        [["checksum"; "sha384"; "/known-3"]], "5fa7883430f357b5d7b7271d3a1d2872b51d73cba72731de6863d3dea55f30646af2799bef44d5ea776a5ec7941ac640"), [];
+      InitISOFS, Always, TestResultString (
+        [["checksum"; "sha512"; "/known-3"]], "2794062c328c6b216dca90443b7f7134c5f40e56bd0ed7853123275a09982a6f992e6ca682f9d2fba34a4c5e870d8fe077694ff831e3032a004ee077e00603f6"), [];
+      (* Test for RHBZ#579608, absolute symbolic links. *)
+      InitISOFS, Always, TestResultString (
+        [["checksum"; "sha512"; "/abssymlink"]], "5f57d0639bc95081c53afc63a449403883818edc64da48930ad6b1a4fb49be90404686877743fbcd7c99811f3def7df7bc22635c885c6a8cf79c806b43451c1a"), []
+    ];
+    shortdesc = "compute MD5, SHAx or CRC checksum of file";
+    longdesc = "\
+This call computes the MD5, SHAx or CRC checksum of the
+file named C<path>.
+
+The type of checksum to compute is given by the C<csumtype>
+parameter which must have one of the following values:
+
+=over 4
+
+=item C<crc>
+
+Compute the cyclic redundancy check (CRC) specified by POSIX
+for the C<cksum> command.
+
+=item C<md5>
+
+Compute the MD5 hash (using the C<md5sum> program).
+
+=item C<sha1>
+
+Compute the SHA1 hash (using the C<sha1sum> program).
+
+=item C<sha224>
+
+Compute the SHA224 hash (using the C<sha224sum> program).
+
+=item C<sha256>
+
+Compute the SHA256 hash (using the C<sha256sum> program).
+
+=item C<sha384>
+
+Compute the SHA384 hash (using the C<sha384sum> program).
+
+=item C<sha512>
+
+Compute the SHA512 hash (using the C<sha512sum> program).
+
+=back
+
+The checksum is returned as a printable string.
+
+To get the checksum for a device, use C<guestfs_checksum_device>.
+
+To get the checksums for many files, use C<guestfs_checksums_out>." };
+
+  { defaults with
+    name = "tar_in"; added = (1, 0, 3);
+    style = RErr, [FileIn "tarfile"; Pathname "directory"], [OString "compress"; OBool "xattrs"; OBool "selinux"; OBool "acls"];
+    proc_nr = Some 69;
+    once_had_no_optargs = true;
+    cancellable = true;
+    tests = [
+      InitScratchFS, Always, TestResultString (
+        [["mkdir"; "/tar_in"];
+         ["tar_in"; "$srcdir/../../test-data/files/helloworld.tar"; "/tar_in"; "NOARG"; ""; ""; ""];
+         ["cat"; "/tar_in/hello"]], "hello\n"), [];
+      InitScratchFS, Always, TestResultString (
+        [["mkdir"; "/tar_in_gz"];
+         ["tar_in"; "$srcdir/../../test-data/files/helloworld.tar.gz"; "/tar_in_gz"; "gzip"; ""; ""; ""];
+         ["cat"; "/tar_in_gz/hello"]], "hello\n"), [];
+      InitScratchFS, IfAvailable "xz", TestResultString (
+        [["mkdir"; "/tar_in_xz"];
+         ["tar_in"; "$srcdir/../../test-data/files/helloworld.tar.xz"; "/tar_in_xz"; "xz"; ""; ""; ""];
+         ["cat"; "/tar_in_xz/hello"]], "hello\n"), []
+    ];
+    shortdesc = "unpack tarfile to directory";
+    longdesc = "\
+This command uploads and unpacks local file C<tarfile> into F<directory>.
+
+The optional C<compress> flag controls compression.  If not given,
+then the input should be an uncompressed tar file.  Otherwise one
+of the following strings may be given to select the compression
+type of the input file: C<compress>, C<gzip>, C<bzip2>, C<xz>, C<lzop>,
+C<zstd>.
+(Note that not all builds of libguestfs will support all of these
+compression types).
+
+The other optional arguments are:
+
+=over 4
+
+=item C<xattrs>
+
+If set to true, extended attributes are restored from the tar file.
+
+=item C<selinux>
+
+If set to true, SELinux contexts are restored from the tar file.
+
+=item C<acls>
+
+If set to true, POSIX ACLs are restored from the tar file.
+
+=back" };
+
+  { defaults with
+    name = "tar_out"; added = (1, 0, 3);
+    style = RErr, [String "directory"; FileOut "tarfile"], [OString "compress"; OBool "numericowner"; OStringList "excludes"; OBool "xattrs"; OBool "selinux"; OBool "acls"];
+    proc_nr = Some 70;
+    once_had_no_optargs = true;
+    cancellable = true;
+    shortdesc = "pack directory into tarfile";
+    longdesc = "\
+This command packs the contents of F<directory> and downloads
+it to local file C<tarfile>.
+
+The optional C<compress> flag controls compression.  If not given,
+then the output will be an uncompressed tar file.  Otherwise one
+of the following strings may be given to select the compression
+type of the output file: C<compress>, C<gzip>, C<bzip2>, C<xz>, C<lzop>,
+C<zstd>.
+(Note that not all builds of libguestfs will support all of these
+compression types).
+
+The other optional arguments are:
+
+=over 4
+
+=item C<excludes>
+
+A list of wildcards.  Files are excluded if they match any of the
+wildcards.
+
+=item C<numericowner>
+
+If set to true, the output tar file will contain UID/GID numbers
+instead of user/group names.
+
+=item C<xattrs>
+
+If set to true, extended attributes are saved in the output tar.
+
+=item C<selinux>
+
+If set to true, SELinux contexts are saved in the output tar.
+
+=item C<acls>
+
+If set to true, POSIX ACLs are saved in the output tar.
+
+=back" };
+
+  { defaults with
+    name = "tgz_in"; added = (1, 0, 3);
+    style = RErr, [FileIn "tarball"; Pathname "directory"], [];
+    proc_nr = Some 71;
+    deprecated_by = Some "tar_in";
+    cancellable = true;
+    tests = [
+      InitScratchFS, Always, TestResultString (
+        [["mkdir"; "/tgz_in"];
+         ["tgz_in"; "$srcdir/../../test-data/files/helloworld.tar.gz"; "/tgz_in"];
+         ["cat"; "/tgz_in/hello"]], "hello\n"), []
+    ];
+    shortdesc = "unpack compressed tarball to directory";
+    longdesc = "\
+This command uploads and unpacks local file C<tarball> (a
+I<gzip compressed> tar file) into F<directory>." };
+
+  { defaults with
+    name = "tgz_out"; added = (1, 0, 3);
+    style = RErr, [Pathname "directory"; FileOut "tarball"], [];
+    proc_nr = Some 72;
+    deprecated_by = Some "tar_out";
+    cancellable = true;
+    shortdesc = "pack directory into compressed tarball";
+    longdesc = "\
+This command packs the contents of F<directory> and downloads
+it to local file C<tarball>." };
+
+  { defaults with
+    name = "mount_ro"; added = (1, 0, 10);
+    style = RErr, [Mountable "mountable"; String "mountpoint"], [];
+    proc_nr = Some 73;
+    tests = [
+      InitBasicFS, Always, TestLastFail (
+        [["umount"; "/"; "false"; "false"];
+         ["mount_ro"; "/dev/sda1"; "/"];
+         ["touch"; "/new"]]), [];
+      InitBasicFS, Always, TestResultString (
+        [["write"; "/new"; "data"];
+         ["umount"; "/"; "false"; "false"];
+         ["mount_ro"; "/dev/sda1"; "/"];
+         ["cat"; "/new"]], "data"), []
+    ];
+    shortdesc = "mount a guest disk, read-only";
+    longdesc = "\
+This is the same as the C<guestfs_mount> command, but it
+mounts the filesystem with the read-only (I<-o ro>) flag." };
+
+  { defaults with
+    name = "mount_options"; added = (1, 0, 10);
+    style = RErr, [String "options"; Mountable "mountable"; String "mountpoint"], [];
+    proc_nr = Some 74;
+    shortdesc = "mount a guest disk with mount options";
+    longdesc = "\
+This is the same as the C<guestfs_mount> command, but it
+allows you to set the mount options as for the
+L<mount(8)> I<-o> flag.
+
+If the C<options> parameter is an empty string, then
+no options are passed (all options default to whatever
+the filesystem uses)." };
+
+  { defaults with
+    name = "mount_vfs"; added = (1, 0, 10);
+    style = RErr, [String "options"; String "vfstype"; Mountable "mountable"; String "mountpoint"], [];
+    proc_nr = Some 75;
+    shortdesc = "mount a guest disk with mount options and vfstype";
+    longdesc = "\
+This is the same as the C<guestfs_mount> command, but it
+allows you to set both the mount options and the vfstype
+as for the L<mount(8)> I<-o> and I<-t> flags." };
+
+  { defaults with
+    name = "debug"; added = (1, 0, 11);
+    style = RString "result", [String "subcmd"; StringList "extraargs"], [];
+    proc_nr = Some 76;
+    visibility = VDebug;
+    shortdesc = "debugging and internals";
+    longdesc = "\
+The C<guestfs_debug> command exposes some internals of
+C<guestfsd> (the guestfs daemon) that runs inside the
+hypervisor.
+
+There is no comprehensive help for this command.  You have
+to look at the file F<daemon/debug.c> in the libguestfs source
+to find out what you can do." };
+
+  { defaults with
+    name = "lvremove"; added = (1, 0, 13);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 77;
+    optional = Some "lvm2";
+    tests = [
+      InitEmpty, Always, TestResult (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["pvcreate"; "/dev/sda1"];
+         ["vgcreate"; "VG"; "/dev/sda1"];
+         ["lvcreate"; "LV1"; "VG"; "50"];
+         ["lvcreate"; "LV2"; "VG"; "50"];
+         ["lvremove"; "/dev/VG/LV1"];
+         ["lvs"]],
+        "is_string_list (ret, 1, \"/dev/VG/LV2\")"), [];
+      InitEmpty, Always, TestResult (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["pvcreate"; "/dev/sda1"];
+         ["vgcreate"; "VG"; "/dev/sda1"];
+         ["lvcreate"; "LV1"; "VG"; "50"];
+         ["lvcreate"; "LV2"; "VG"; "50"];
+         ["lvremove"; "/dev/VG"];
+         ["lvs"]],
         "is_string_list (ret, 0)"), [];
-      InitScratchFS, IfNotCrossAppliance, TestResult (
-        [["mkdir"; "/command_lines8"];
-         ["upload"; "test-command"; "/command_lines8/test-command"];
-         ["chmod"; "0o755"; "/command_lines8/test-command"];
-         ["command_lines"; "/command_lines8/test-command 8"]],
-        "is_string_list (ret, 1, \"\")"), [];
-      InitScratchFS, IfNotCrossAppliance, TestResult (
-        [["mkdir"; "/command_lines9"];
-         ["upload"; "test-command"; "/command_lines9/test-command"];
-         ["chmod"; "0o755"; "/command_lines9/test-command"];
-         ["command_lines"; "/command_lines9/test-command 9"]],
-        "is_string_list (ret, 2, \"\", \"\")"), [];
-      InitScratchFS, IfNotCrossAppliance, TestResult (
-        [["mkdir"; "/command_lines10"];
-         ["upload"; "test-command"; "/command_lines10/test-command"];
-         ["chmod"; "0o755"; "/command_lines10/test-command"];
-         ["command_lines"; "/command_lines10/test-command 10"]],
-        "is_string_list (ret, 2, \"Result10-1\", \"Result10-2\")"), [];
-      InitScratchFS, IfNotCrossAppliance, TestResult (
-        [["mkdir"; "/command_lines11"];
-         ["upload"; "test-command"; "/command_lines11/test-command"];
-         ["chmod"; "0o755"; "/command_lines11/test-command"];
-         ["command_lines"; "/command_lines11/test-command 11"]],
-        "is_string_list (ret, 2, \"Result11-1\", \"Result11-2\")"), []
+      InitEmpty, Always, TestResult (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["pvcreate"; "/dev/sda1"];
+         ["vgcreate"; "VG"; "/dev/sda1"];
+         ["lvcreate"; "LV1"; "VG"; "50"];
+         ["lvcreate"; "LV2"; "VG"; "50"];
+         ["lvremove"; "/dev/VG"];
+         ["vgs"]],
+        "is_string_list (ret, 1, \"VG\")"), []
+    ];
+    shortdesc = "remove an LVM logical volume";
+    longdesc = "\
+Remove an LVM logical volume C<device>, where C<device> is
+the path to the LV, such as F</dev/VG/LV>.
+
+You can also remove all LVs in a volume group by specifying
+the VG name, F</dev/VG>." };
+
+  { defaults with
+    name = "vgremove"; added = (1, 0, 13);
+    style = RErr, [String "vgname"], [];
+    proc_nr = Some 78;
+    optional = Some "lvm2";
+    tests = [
+      InitEmpty, Always, TestResult (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["pvcreate"; "/dev/sda1"];
+         ["vgcreate"; "VG"; "/dev/sda1"];
+         ["lvcreate"; "LV1"; "VG"; "50"];
+         ["lvcreate"; "LV2"; "VG"; "50"];
+         ["vgremove"; "VG"];
+         ["lvs"]],
+        "is_string_list (ret, 0)"), [];
+      InitEmpty, Always, TestResult (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["pvcreate"; "/dev/sda1"];
+         ["vgcreate"; "VG"; "/dev/sda1"];
+         ["lvcreate"; "LV1"; "VG"; "50"];
+         ["lvcreate"; "LV2"; "VG"; "50"];
+         ["vgremove"; "VG"];
+         ["vgs"]],
+        "is_string_list (ret, 0)"), []
+    ];
+    shortdesc = "remove an LVM volume group";
+    longdesc = "\
+Remove an LVM volume group C<vgname>, (for example C<VG>).
+
+This also forcibly removes all logical volumes in the volume
+group (if any)." };
+
+  { defaults with
+    name = "pvremove"; added = (1, 0, 13);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 79;
+    optional = Some "lvm2";
+    tests = [
+      InitEmpty, Always, TestResult (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["pvcreate"; "/dev/sda1"];
+         ["vgcreate"; "VG"; "/dev/sda1"];
+         ["lvcreate"; "LV1"; "VG"; "50"];
+         ["lvcreate"; "LV2"; "VG"; "50"];
+         ["vgremove"; "VG"];
+         ["pvremove"; "/dev/sda1"];
+         ["lvs"]],
+        "is_string_list (ret, 0)"), [];
+      InitEmpty, Always, TestResult (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["pvcreate"; "/dev/sda1"];
+         ["vgcreate"; "VG"; "/dev/sda1"];
+         ["lvcreate"; "LV1"; "VG"; "50"];
+         ["lvcreate"; "LV2"; "VG"; "50"];
+         ["vgremove"; "VG"];
+         ["pvremove"; "/dev/sda1"];
+         ["vgs"]],
+        "is_string_list (ret, 0)"), [];
+      InitEmpty, Always, TestResult (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["pvcreate"; "/dev/sda1"];
+         ["vgcreate"; "VG"; "/dev/sda1"];
+         ["lvcreate"; "LV1"; "VG"; "50"];
+         ["lvcreate"; "LV2"; "VG"; "50"];
+         ["vgremove"; "VG"];
+         ["pvremove"; "/dev/sda1"];
+         ["pvs"]],
+        "is_string_list (ret, 0)"), []
     ];
-    shortdesc = "run a command, returning lines";
+    shortdesc = "remove an LVM physical volume";
     longdesc = "\
-This is the same as C<guestfs_command>, but splits the
-result into a list of lines.
+This wipes a physical volume C<device> so that LVM will no longer
+recognise it.
 
-See also: C<guestfs_sh_lines>" };
+The implementation uses the C<pvremove> command which refuses to
+wipe physical volumes that contain any volume groups, so you have
+to remove those first." };
 
   { defaults with
-    name = "statvfs"; added = (1, 9, 2);
-    style = RStruct ("statbuf", "statvfs"), [Pathname "path"], [];
-    proc_nr = Some 54;
+    name = "set_e2label"; added = (1, 0, 15);
+    style = RErr, [Device "device"; String "label"], [];
+    proc_nr = Some 80;
+    deprecated_by = Some "set_label";
     tests = [
-      InitISOFS, Always, TestResult (
-        [["statvfs"; "/"]], "ret->namemax == 255"), []
+      InitBasicFS, Always, TestResultString (
+        [["set_e2label"; "/dev/sda1"; "testlabel"];
+         ["get_e2label"; "/dev/sda1"]], "testlabel"), []
     ];
-    shortdesc = "get file system statistics";
+    shortdesc = "set the ext2/3/4 filesystem label";
     longdesc = "\
-Returns file system statistics for any mounted file system.
-C<path> should be a file or directory in the mounted file system
-(typically it is the mount point itself, but it doesn't need to be).
+This sets the ext2/3/4 filesystem label of the filesystem on
+C<device> to C<label>.  Filesystem labels are limited to
+16 characters.
 
-This is the same as the L<statvfs(2)> system call." };
+You can use either C<guestfs_tune2fs_l> or C<guestfs_get_e2label>
+to return the existing label on a filesystem." };
 
   { defaults with
-    name = "tune2fs_l"; added = (1, 9, 2);
-    style = RHashtable "superblock", [Device "device"], [];
-    proc_nr = Some 55;
-    tests = [
-      InitScratchFS, Always, TestResult (
-        [["tune2fs_l"; "/dev/sdb1"]],
-        "check_hash (ret, \"Filesystem magic number\", \"0xEF53\") == 0 && "^
-          "check_hash (ret, \"Filesystem OS type\", \"Linux\") == 0"), [];
-    ];
-    shortdesc = "get ext2/ext3/ext4 superblock details";
+    name = "get_e2label"; added = (1, 0, 15);
+    style = RString "label", [Device "device"], [];
+    proc_nr = Some 81;
+    deprecated_by = Some "vfs_label";
+    shortdesc = "get the ext2/3/4 filesystem label";
     longdesc = "\
-This returns the contents of the ext2, ext3 or ext4 filesystem
-superblock on C<device>.
+This returns the ext2/3/4 filesystem label of the filesystem on
+C<device>." };
 
-It is the same as running C<tune2fs -l device>.  See L<tune2fs(8)>
-manpage for more details.  The list of fields returned isn't
-clearly defined, and depends on both the version of C<tune2fs>
-that libguestfs was built against, and the filesystem itself." };
+  { defaults with
+    name = "set_e2uuid"; added = (1, 0, 15);
+    style = RErr, [Device "device"; String "uuid"], [];
+    proc_nr = Some 82;
+    deprecated_by = Some "set_uuid";
+    tests =
+      (let uuid = uuidgen () in [
+        InitBasicFS, Always, TestResultString (
+          [["set_e2uuid"; "/dev/sda1"; uuid];
+           ["get_e2uuid"; "/dev/sda1"]], uuid), [];
+        InitBasicFS, Always, TestResultString (
+          [["set_e2uuid"; "/dev/sda1"; "clear"];
+           ["get_e2uuid"; "/dev/sda1"]], ""), [];
+        (* We can't predict what UUIDs will be, so just check
+           the commands run. *)
+        InitBasicFS, Always, TestRun (
+          [["set_e2uuid"; "/dev/sda1"; "random"]]), [];
+        InitBasicFS, Always, TestRun (
+          [["set_e2uuid"; "/dev/sda1"; "time"]]), []
+      ]);
+    shortdesc = "set the ext2/3/4 filesystem UUID";
+    longdesc = "\
+This sets the ext2/3/4 filesystem UUID of the filesystem on
+C<device> to C<uuid>.  The format of the UUID and alternatives
+such as C<clear>, C<random> and C<time> are described in the
+L<tune2fs(8)> manpage.
+
+You can use C<guestfs_vfs_uuid> to return the existing UUID
+of a filesystem." };
 
   { defaults with
-    name = "blockdev_setro"; added = (1, 9, 3);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 56;
+    name = "get_e2uuid"; added = (1, 0, 15);
+    style = RString "uuid", [Device "device"], [];
+    proc_nr = Some 83;
+    deprecated_by = Some "vfs_uuid";
     tests = [
-      InitEmpty, Always, TestResultTrue (
-        [["blockdev_setro"; "/dev/sda"];
-         ["blockdev_getro"; "/dev/sda"]]), []
+      (* We can't predict what UUID will be, so just check
+         the command run; regression test for RHBZ#597112. *)
+      InitNone, Always, TestRun (
+        [["mke2journal"; "1024"; "/dev/sdc"];
+         ["get_e2uuid"; "/dev/sdc"]]), []
     ];
-    shortdesc = "set block device to read-only";
+    shortdesc = "get the ext2/3/4 filesystem UUID";
     longdesc = "\
-Sets the block device named C<device> to read-only.
-
-This uses the L<blockdev(8)> command." };
+This returns the ext2/3/4 filesystem UUID of the filesystem on
+C<device>." };
 
   { defaults with
-    name = "blockdev_setrw"; added = (1, 9, 3);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 57;
+    name = "fsck"; added = (1, 0, 16);
+    style = RInt "status", [String "fstype"; Device "device"], [];
+    proc_nr = Some 84;
+    fish_output = Some FishOutputHexadecimal;
     tests = [
-      InitEmpty, Always, TestResultFalse (
-        [["blockdev_setrw"; "/dev/sda"];
-         ["blockdev_getro"; "/dev/sda"]]), []
+      InitBasicFS, Always, TestResult (
+        [["umount"; "/dev/sda1"; "false"; "false"];
+         ["fsck"; "ext2"; "/dev/sda1"]], "ret == 0"), [];
+      InitBasicFS, Always, TestResult (
+        [["umount"; "/dev/sda1"; "false"; "false"];
+         ["zero"; "/dev/sda1"];
+         ["fsck"; "ext2"; "/dev/sda1"]], "ret == 8"), []
     ];
-    shortdesc = "set block device to read-write";
+    shortdesc = "run the filesystem checker";
     longdesc = "\
-Sets the block device named C<device> to read-write.
+This runs the filesystem checker (fsck) on C<device> which
+should have filesystem type C<fstype>.
 
-This uses the L<blockdev(8)> command." };
+The returned integer is the status.  See L<fsck(8)> for the
+list of status codes from C<fsck>.
+
+Notes:
+
+=over 4
+
+=item *
+
+Multiple status codes can be summed together.
+
+=item *
+
+A non-zero return code can mean \"success\", for example if
+errors have been corrected on the filesystem.
+
+=item *
+
+Checking or repairing NTFS volumes is not supported
+(by linux-ntfs).
+
+=back
+
+This command is entirely equivalent to running C<fsck -a -t fstype device>." };
 
   { defaults with
-    name = "blockdev_getro"; added = (1, 9, 3);
-    style = RBool "ro", [Device "device"], [];
-    proc_nr = Some 58;
+    name = "zero"; added = (1, 0, 16);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 85;
+    progress = true;
     tests = [
-      InitEmpty, Always, TestResultTrue (
-        [["blockdev_setro"; "/dev/sda"];
-         ["blockdev_getro"; "/dev/sda"]]), []
+      InitBasicFS, Always, TestRun (
+        [["umount"; "/dev/sda1"; "false"; "false"];
+         ["zero"; "/dev/sda1"]]), []
     ];
-    shortdesc = "is block device set to read-only";
+    shortdesc = "write zeroes to the device";
     longdesc = "\
-Returns a boolean indicating if the block device is read-only
-(true if read-only, false if not).
+This command writes zeroes over the first few blocks of C<device>.
 
-This uses the L<blockdev(8)> command." };
+How many blocks are zeroed isn't specified (but it's I<not> enough
+to securely wipe the device).  It should be sufficient to remove
+any partition tables, filesystem superblocks and so on.
+
+If blocks are already zero, then this command avoids writing
+zeroes.  This prevents the underlying device from becoming non-sparse
+or growing unnecessarily.
+
+See also: C<guestfs_zero_device>, C<guestfs_scrub_device>,
+C<guestfs_is_zero_device>" };
 
   { defaults with
-    name = "blockdev_getss"; added = (1, 9, 3);
-    style = RInt "sectorsize", [Device "device"], [];
-    proc_nr = Some 59;
+    name = "grub_install"; added = (1, 0, 17);
+    style = RErr, [Pathname "root"; Device "device"], [];
+    proc_nr = Some 86;
+    optional = Some "grub";
+    (* See:
+     * https://bugzilla.redhat.com/show_bug.cgi?id=484986
+     * https://bugzilla.redhat.com/show_bug.cgi?id=479760
+     *)
     tests = [
-      InitEmpty, Always, TestResult (
-        [["blockdev_getss"; "/dev/sda"]], "ret == 512"), []
+      InitBasicFS, Always, TestResultTrue (
+        [["mkdir_p"; "/boot/grub"];
+         ["write"; "/boot/grub/device.map"; "(hd0) /dev/sda"];
+         ["grub_install"; "/"; "/dev/sda"];
+         ["is_dir"; "/boot"; ""]]), []
     ];
-    shortdesc = "get sectorsize of block device";
+    shortdesc = "install GRUB 1";
     longdesc = "\
-This returns the size of sectors on a block device.
-Usually 512, but can be larger for modern devices.
+This command installs GRUB 1 (the Grand Unified Bootloader) on
+C<device>, with the root directory being C<root>.
+
+Notes:
+
+=over 4
+
+=item *
+
+There is currently no way in the API to install grub2, which
+is used by most modern Linux guests.  It is possible to run
+the grub2 command from the guest, although see the
+caveats in L<guestfs(3)/RUNNING COMMANDS>.
+
+=item *
+
+This uses C<grub-install> from the host.  Unfortunately grub is
+not always compatible with itself, so this only works in rather
+narrow circumstances.  Careful testing with each guest version
+is advisable.
 
-(Note, this is not the size in sectors, use C<guestfs_blockdev_getsz>
-for that).
+=item *
 
-This uses the L<blockdev(8)> command." };
+If grub-install reports the error
+\"No suitable drive was found in the generated device map.\"
+it may be that you need to create a F</boot/grub/device.map>
+file first that contains the mapping between grub device names
+and Linux device names.  It is usually sufficient to create
+a file containing:
 
-  { defaults with
-    name = "blockdev_getbsz"; added = (1, 9, 3);
-    style = RInt "blocksize", [Device "device"], [];
-    proc_nr = Some 60;
-    test_excuse = "cannot be tested because output differs depending on page size";
-    shortdesc = "get blocksize of block device";
-    longdesc = "\
-This returns the block size of a device.
+ (hd0) /dev/vda
 
-Note: this is different from both I<size in blocks> and
-I<filesystem block size>.  Also this setting is not really
-used by anything.  You should probably not use it for
-anything.  Filesystems have their own idea about what
-block size to choose.
+replacing F</dev/vda> with the name of the installation device.
 
-This uses the L<blockdev(8)> command." };
+=back" };
 
   { defaults with
-    name = "blockdev_setbsz"; added = (1, 9, 3);
-    style = RErr, [Device "device"; Int "blocksize"], [];
-    proc_nr = Some 61;
-    deprecated_by = Some "mkfs";
-    shortdesc = "set blocksize of block device";
+    name = "cp"; added = (1, 0, 18);
+    style = RErr, [Pathname "src"; Pathname "dest"], [];
+    proc_nr = Some 87;
+    tests = [
+      InitScratchFS, Always, TestResultString (
+        [["mkdir"; "/cp"];
+         ["write"; "/cp/old"; "file content"];
+         ["cp"; "/cp/old"; "/cp/new"];
+         ["cat"; "/cp/new"]], "file content"), [];
+      InitScratchFS, Always, TestResultTrue (
+        [["mkdir"; "/cp2"];
+         ["write"; "/cp2/old"; "file content"];
+         ["cp"; "/cp2/old"; "/cp2/new"];
+         ["is_file"; "/cp2/old"; ""]]), [];
+      InitScratchFS, Always, TestResultString (
+        [["mkdir"; "/cp3"];
+         ["write"; "/cp3/old"; "file content"];
+         ["mkdir"; "/cp3/dir"];
+         ["cp"; "/cp3/old"; "/cp3/dir/new"];
+         ["cat"; "/cp3/dir/new"]], "file content"), []
+    ];
+    shortdesc = "copy a file";
     longdesc = "\
-This call does nothing and has never done anything
-because of a bug in blockdev.  B<Do not use it.>
-
-If you need to set the filesystem block size, use the
-C<blocksize> option of C<guestfs_mkfs>." };
+This copies a file from C<src> to C<dest> where C<dest> is
+either a destination filename or destination directory." };
 
   { defaults with
-    name = "blockdev_getsz"; added = (1, 9, 3);
-    style = RInt64 "sizeinsectors", [Device "device"], [];
-    proc_nr = Some 62;
+    name = "cp_a"; added = (1, 0, 18);
+    style = RErr, [Pathname "src"; Pathname "dest"], [];
+    proc_nr = Some 88;
     tests = [
-      InitEmpty, Always, TestResult (
-        [["blockdev_getsz"; "/dev/sda"]],
-          "ret == INT64_C(2)*1024*1024*1024/512"), []
+      InitScratchFS, Always, TestResultString (
+        [["mkdir"; "/cp_a1"];
+         ["mkdir"; "/cp_a2"];
+         ["write"; "/cp_a1/file"; "file content"];
+         ["cp_a"; "/cp_a1"; "/cp_a2"];
+         ["cat"; "/cp_a2/cp_a1/file"]], "file content"), []
     ];
-    shortdesc = "get total size of device in 512-byte sectors";
+    shortdesc = "copy a file or directory recursively";
     longdesc = "\
-This returns the size of the device in units of 512-byte sectors
-(even if the sectorsize isn't 512 bytes ... weird).
-
-See also C<guestfs_blockdev_getss> for the real sector size of
-the device, and C<guestfs_blockdev_getsize64> for the more
-useful I<size in bytes>.
-
-This uses the L<blockdev(8)> command." };
+This copies a file or directory from C<src> to C<dest>
+recursively using the C<cp -a> command." };
 
   { defaults with
-    name = "blockdev_getsize64"; added = (1, 9, 3);
-    style = RInt64 "sizeinbytes", [Device "device"], [];
-    proc_nr = Some 63;
+    name = "mv"; added = (1, 0, 18);
+    style = RErr, [Pathname "src"; Pathname "dest"], [];
+    proc_nr = Some 89;
     tests = [
-      InitEmpty, Always, TestResult (
-        [["blockdev_getsize64"; "/dev/sda"]],
-          "ret == INT64_C(2)*1024*1024*1024"), []
+      InitScratchFS, Always, TestResultString (
+        [["mkdir"; "/mv"];
+         ["write"; "/mv/old"; "file content"];
+         ["mv"; "/mv/old"; "/mv/new"];
+         ["cat"; "/mv/new"]], "file content"), [];
+      InitScratchFS, Always, TestResultFalse (
+        [["mkdir"; "/mv2"];
+         ["write"; "/mv2/old"; "file content"];
+         ["mv"; "/mv2/old"; "/mv2/new"];
+         ["is_file"; "/mv2/old"; ""]]), []
     ];
-    shortdesc = "get total size of device in bytes";
+    shortdesc = "move a file";
     longdesc = "\
-This returns the size of the device in bytes.
-
-See also C<guestfs_blockdev_getsz>.
+This moves a file from C<src> to C<dest> where C<dest> is
+either a destination filename or destination directory.
 
-This uses the L<blockdev(8)> command." };
+See also: C<guestfs_rename>." };
 
   { defaults with
-    name = "blockdev_flushbufs"; added = (1, 9, 3);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 64;
+    name = "drop_caches"; added = (1, 0, 18);
+    style = RErr, [Int "whattodrop"], [];
+    proc_nr = Some 90;
     tests = [
-      InitEmpty, Always, TestRun
-        [["blockdev_flushbufs"; "/dev/sda"]], []
+      InitEmpty, Always, TestRun (
+        [["drop_caches"; "3"]]), []
     ];
-    shortdesc = "flush device buffers";
+    shortdesc = "drop kernel page cache, dentries and inodes";
     longdesc = "\
-This tells the kernel to flush internal buffers associated
-with C<device>.
+This instructs the guest kernel to drop its page cache,
+and/or dentries and inode caches.  The parameter C<whattodrop>
+tells the kernel what precisely to drop, see
+L<http://linux-mm.org/Drop_Caches>
 
-This uses the L<blockdev(8)> command." };
+Setting C<whattodrop> to 3 should drop everything.
+
+This automatically calls L<sync(2)> before the operation,
+so that the maximum guest memory is freed." };
 
   { defaults with
-    name = "blockdev_rereadpt"; added = (1, 9, 3);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 65;
+    name = "dmesg"; added = (1, 0, 18);
+    style = RString "kmsgs", [], [];
+    proc_nr = Some 91;
     tests = [
-      InitEmpty, Always, TestRun
-        [["blockdev_rereadpt"; "/dev/sda"]], []
+      InitEmpty, Always, TestRun (
+        [["dmesg"]]), []
     ];
-    shortdesc = "reread partition table";
+    shortdesc = "return kernel messages";
     longdesc = "\
-Reread the partition table on C<device>.
+This returns the kernel messages (C<dmesg> output) from
+the guest kernel.  This is sometimes useful for extended
+debugging of problems.
 
-This uses the L<blockdev(8)> command." };
+Another way to get the same information is to enable
+verbose messages with C<guestfs_set_verbose> or by setting
+the environment variable C<LIBGUESTFS_DEBUG=1> before
+running the program." };
 
   { defaults with
-    name = "upload"; added = (1, 0, 2);
-    style = RErr, [FileIn "filename"; Dev_or_Path "remotefilename"], [];
-    proc_nr = Some 66;
-    progress = true; cancellable = true;
+    name = "ping_daemon"; added = (1, 0, 18);
+    style = RErr, [], [];
+    proc_nr = Some 92;
+    reentrant = true;
     tests = [
-      InitScratchFS, Always, TestResultString (
-        (* Pick a file from cwd which isn't likely to change. *)
-        [["mkdir"; "/upload"];
-         ["upload"; "$srcdir/../../COPYING.LIB"; "/upload/COPYING.LIB"];
-         ["checksum"; "md5"; "/upload/COPYING.LIB"]],
-        Digest.to_hex (Digest.file "COPYING.LIB")), []
+      InitEmpty, Always, TestRun (
+        [["ping_daemon"]]), []
     ];
-    shortdesc = "upload a file from the local machine";
+    shortdesc = "ping the guest daemon";
     longdesc = "\
-Upload local file F<filename> to F<remotefilename> on the
-filesystem.
-
-F<filename> can also be a named pipe.
-
-See also C<guestfs_download>." };
+This is a test probe into the guestfs daemon running inside
+the libguestfs appliance.  Calling this function checks that the
+daemon responds to the ping message, without affecting the daemon
+or attached block device(s) in any other way." };
 
   { defaults with
-    name = "download"; added = (1, 0, 2);
-    style = RErr, [Dev_or_Path "remotefilename"; FileOut "filename"], [];
-    proc_nr = Some 67;
-    progress = true; cancellable = true;
+    name = "equal"; added = (1, 0, 18);
+    style = RBool "equality", [Pathname "file1"; Pathname "file2"], [];
+    proc_nr = Some 93;
     tests = [
-      InitScratchFS, Always, TestResultString (
-        (* Pick a file from cwd which isn't likely to change. *)
-        [["mkdir"; "/download"];
-         ["upload"; "$srcdir/../../COPYING.LIB"; "/download/COPYING.LIB"];
-         ["download"; "/download/COPYING.LIB"; "testdownload.tmp"];
-         ["upload"; "testdownload.tmp"; "/download/upload"];
-         ["checksum"; "md5"; "/download/upload"]],
-        Digest.to_hex (Digest.file "COPYING.LIB")), []
+      InitScratchFS, Always, TestResultTrue (
+        [["mkdir"; "/equal"];
+         ["write"; "/equal/file1"; "contents of a file"];
+         ["cp"; "/equal/file1"; "/equal/file2"];
+         ["equal"; "/equal/file1"; "/equal/file2"]]), [];
+      InitScratchFS, Always, TestResultFalse (
+        [["mkdir"; "/equal2"];
+         ["write"; "/equal2/file1"; "contents of a file"];
+         ["write"; "/equal2/file2"; "contents of another file"];
+         ["equal"; "/equal2/file1"; "/equal2/file2"]]), [];
+      InitScratchFS, Always, TestLastFail (
+        [["mkdir"; "/equal3"];
+         ["equal"; "/equal3/file1"; "/equal3/file2"]]), []
     ];
-    shortdesc = "download a file to the local machine";
+    shortdesc = "test if two files have equal contents";
     longdesc = "\
-Download file F<remotefilename> and save it as F<filename>
-on the local machine.
-
-F<filename> can also be a named pipe.
+This compares the two files F<file1> and F<file2> and returns
+true if their content is exactly equal, or false otherwise.
 
-See also C<guestfs_upload>, C<guestfs_cat>." };
+The external L<cmp(1)> program is used for the comparison." };
 
   { defaults with
-    name = "checksum"; added = (1, 0, 2);
-    style = RString "checksum", [String "csumtype"; Pathname "path"], [];
-    proc_nr = Some 68;
+    name = "strings"; added = (1, 0, 22);
+    style = RStringList "stringsout", [Pathname "path"], [];
+    proc_nr = Some 94;
+    protocol_limit_warning = true;
     tests = [
-      InitISOFS, Always, TestResultString (
-        [["checksum"; "crc"; "/known-3"]], "2891671662"), [];
-      InitISOFS, Always, TestLastFail (
-        [["checksum"; "crc"; "/notexists"]]), [];
-      InitISOFS, Always, TestResultString (
-        [["checksum"; "md5"; "/known-3"]], "46d6ca27ee07cdc6fa99c2e138cc522c"), [];
-      InitISOFS, Always, TestResultString (
-        [["checksum"; "sha1"; "/known-3"]], "b7ebccc3ee418311091c3eda0a45b83c0a770f15"), [];
-      InitISOFS, Always, TestResultString (
-        [["checksum"; "sha224"; "/known-3"]], "d2cd1774b28f3659c14116be0a6dc2bb5c4b350ce9cd5defac707741"), [];
-      InitISOFS, Always, TestResultString (
-        [["checksum"; "sha256"; "/known-3"]], "75bb71b90cd20cb13f86d2bea8dad63ac7194e7517c3b52b8d06ff52d3487d30"), [];
-      InitISOFS, Always, TestResultString (
-        [["checksum"; "sha384"; "/known-3"]], "5fa7883430f357b5d7b7271d3a1d2872b51d73cba72731de6863d3dea55f30646af2799bef44d5ea776a5ec7941ac640"), [];
-      InitISOFS, Always, TestResultString (
-        [["checksum"; "sha512"; "/known-3"]], "2794062c328c6b216dca90443b7f7134c5f40e56bd0ed7853123275a09982a6f992e6ca682f9d2fba34a4c5e870d8fe077694ff831e3032a004ee077e00603f6"), [];
+      InitISOFS, Always, TestResult (
+        [["strings"; "/known-5"]],
+        "is_string_list (ret, 2, \"abcdefghi\", \"jklmnopqr\")"), [];
+      InitISOFS, Always, TestResult (
+        [["strings"; "/empty"]],
+        "is_string_list (ret, 0)"), [];
       (* Test for RHBZ#579608, absolute symbolic links. *)
-      InitISOFS, Always, TestResultString (
-        [["checksum"; "sha512"; "/abssymlink"]], "5f57d0639bc95081c53afc63a449403883818edc64da48930ad6b1a4fb49be90404686877743fbcd7c99811f3def7df7bc22635c885c6a8cf79c806b43451c1a"), []
+      InitISOFS, Always, TestRun (
+        [["strings"; "/abssymlink"]]), []
     ];
-    shortdesc = "compute MD5, SHAx or CRC checksum of file";
+    shortdesc = "print the printable strings in a file";
     longdesc = "\
-This call computes the MD5, SHAx or CRC checksum of the
-file named C<path>.
+This runs the L<strings(1)> command on a file and returns
+the list of printable strings found.
 
-The type of checksum to compute is given by the C<csumtype>
-parameter which must have one of the following values:
+The C<strings> command has, in the past, had problems with
+parsing untrusted files.  These are mitigated in the current
+version of libguestfs, but see L<guestfs(3)/CVE-2014-8484>." };
 
-=over 4
+  { defaults with
+    name = "strings_e"; added = (1, 0, 22);
+    style = RStringList "stringsout", [String "encoding"; Pathname "path"], [];
+    proc_nr = Some 95;
+    protocol_limit_warning = true;
+    tests = [
+      InitISOFS, Always, TestResult (
+        [["strings_e"; "b"; "/known-5"]],
+        "is_string_list (ret, 0)"), [];
+      InitScratchFS, Always, TestResult (
+        [["write"; "/strings_e"; "\000h\000e\000l\000l\000o\000\n\000w\000o\000r\000l\000d\000\n"];
+         ["strings_e"; "b"; "/strings_e"]],
+        "is_string_list (ret, 2, \"hello\", \"world\")"), []
+    ];
+    shortdesc = "print the printable strings in a file";
+    longdesc = "\
+This is like the C<guestfs_strings> command, but allows you to
+specify the encoding of strings that are looked for in
+the source file C<path>.
 
-=item C<crc>
+Allowed encodings are:
 
-Compute the cyclic redundancy check (CRC) specified by POSIX
-for the C<cksum> command.
+=over 4
 
-=item C<md5>
+=item s
 
-Compute the MD5 hash (using the C<md5sum> program).
+Single 7-bit-byte characters like ASCII and the ASCII-compatible
+parts of ISO-8859-X (this is what C<guestfs_strings> uses).
 
-=item C<sha1>
+=item S
 
-Compute the SHA1 hash (using the C<sha1sum> program).
+Single 8-bit-byte characters.
 
-=item C<sha224>
+=item b
 
-Compute the SHA224 hash (using the C<sha224sum> program).
+16-bit big endian strings such as those encoded in
+UTF-16BE or UCS-2BE.
 
-=item C<sha256>
+=item l (lower case letter L)
 
-Compute the SHA256 hash (using the C<sha256sum> program).
+16-bit little endian such as UTF-16LE and UCS-2LE.
+This is useful for examining binaries in Windows guests.
 
-=item C<sha384>
+=item B
 
-Compute the SHA384 hash (using the C<sha384sum> program).
+32-bit big endian such as UCS-4BE.
 
-=item C<sha512>
+=item L
 
-Compute the SHA512 hash (using the C<sha512sum> program).
+32-bit little endian such as UCS-4LE.
 
 =back
 
-The checksum is returned as a printable string.
-
-To get the checksum for a device, use C<guestfs_checksum_device>.
+The returned strings are transcoded to UTF-8.
 
-To get the checksums for many files, use C<guestfs_checksums_out>." };
+The C<strings> command has, in the past, had problems with
+parsing untrusted files.  These are mitigated in the current
+version of libguestfs, but see L<guestfs(3)/CVE-2014-8484>." };
 
   { defaults with
-    name = "tar_in"; added = (1, 0, 3);
-    style = RErr, [FileIn "tarfile"; Pathname "directory"], [OString "compress"; OBool "xattrs"; OBool "selinux"; OBool "acls"];
-    proc_nr = Some 69;
-    once_had_no_optargs = true;
-    cancellable = true;
+    name = "hexdump"; added = (1, 0, 22);
+    style = RString "dump", [Pathname "path"], [];
+    proc_nr = Some 96;
+    protocol_limit_warning = true;
     tests = [
-      InitScratchFS, Always, TestResultString (
-        [["mkdir"; "/tar_in"];
-         ["tar_in"; "$srcdir/../../test-data/files/helloworld.tar"; "/tar_in"; "NOARG"; ""; ""; ""];
-         ["cat"; "/tar_in/hello"]], "hello\n"), [];
-      InitScratchFS, Always, TestResultString (
-        [["mkdir"; "/tar_in_gz"];
-         ["tar_in"; "$srcdir/../../test-data/files/helloworld.tar.gz"; "/tar_in_gz"; "gzip"; ""; ""; ""];
-         ["cat"; "/tar_in_gz/hello"]], "hello\n"), [];
-      InitScratchFS, IfAvailable "xz", TestResultString (
-        [["mkdir"; "/tar_in_xz"];
-         ["tar_in"; "$srcdir/../../test-data/files/helloworld.tar.xz"; "/tar_in_xz"; "xz"; ""; ""; ""];
-         ["cat"; "/tar_in_xz/hello"]], "hello\n"), []
+      InitISOFS, Always, TestResultString (
+        [["hexdump"; "/known-4"]], "00000000  61 62 63 0a 64 65 66 0a  67 68 69                 |abc.def.ghi|\n0000000b\n"), [];
+      (* Test for RHBZ#501888c2 regression which caused large hexdump
+       * commands to segfault.
+       *)
+      InitISOFS, Always, TestRun (
+        [["hexdump"; "/100krandom"]]), [];
+      (* Test for RHBZ#579608, absolute symbolic links. *)
+      InitISOFS, Always, TestRun (
+        [["hexdump"; "/abssymlink"]]), []
     ];
-    shortdesc = "unpack tarfile to directory";
+    shortdesc = "dump a file in hexadecimal";
     longdesc = "\
-This command uploads and unpacks local file C<tarfile> into F<directory>.
-
-The optional C<compress> flag controls compression.  If not given,
-then the input should be an uncompressed tar file.  Otherwise one
-of the following strings may be given to select the compression
-type of the input file: C<compress>, C<gzip>, C<bzip2>, C<xz>, C<lzop>.
-(Note that not all builds of libguestfs will support all of these
-compression types).
-
-The other optional arguments are:
-
-=over 4
-
-=item C<xattrs>
-
-If set to true, extended attributes are restored from the tar file.
-
-=item C<selinux>
-
-If set to true, SELinux contexts are restored from the tar file.
-
-=item C<acls>
-
-If set to true, POSIX ACLs are restored from the tar file.
-
-=back" };
+This runs C<hexdump -C> on the given C<path>.  The result is
+the human-readable, canonical hex dump of the file." };
 
   { defaults with
-    name = "tar_out"; added = (1, 0, 3);
-    style = RErr, [String "directory"; FileOut "tarfile"], [OString "compress"; OBool "numericowner"; OStringList "excludes"; OBool "xattrs"; OBool "selinux"; OBool "acls"];
-    proc_nr = Some 70;
-    once_had_no_optargs = true;
-    cancellable = true;
-    shortdesc = "pack directory into tarfile";
+    name = "zerofree"; added = (1, 0, 26);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 97;
+    optional = Some "zerofree";
+    tests = [
+      InitNone, Always, TestResultString (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["mkfs"; "ext3"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["mount"; "/dev/sda1"; "/"];
+         ["write"; "/new"; "test file"];
+         ["umount"; "/dev/sda1"; "false"; "false"];
+         ["zerofree"; "/dev/sda1"];
+         ["mount"; "/dev/sda1"; "/"];
+         ["cat"; "/new"]], "test file"), []
+    ];
+    shortdesc = "zero unused inodes and disk blocks on ext2/3 filesystem";
     longdesc = "\
-This command packs the contents of F<directory> and downloads
-it to local file C<tarfile>.
-
-The optional C<compress> flag controls compression.  If not given,
-then the output will be an uncompressed tar file.  Otherwise one
-of the following strings may be given to select the compression
-type of the output file: C<compress>, C<gzip>, C<bzip2>, C<xz>, C<lzop>.
-(Note that not all builds of libguestfs will support all of these
-compression types).
-
-The other optional arguments are:
-
-=over 4
-
-=item C<excludes>
-
-A list of wildcards.  Files are excluded if they match any of the
-wildcards.
-
-=item C<numericowner>
-
-If set to true, the output tar file will contain UID/GID numbers
-instead of user/group names.
-
-=item C<xattrs>
-
-If set to true, extended attributes are saved in the output tar.
-
-=item C<selinux>
-
-If set to true, SELinux contexts are saved in the output tar.
-
-=item C<acls>
+This runs the I<zerofree> program on C<device>.  This program
+claims to zero unused inodes and disk blocks on an ext2/3
+filesystem, thus making it possible to compress the filesystem
+more effectively.
 
-If set to true, POSIX ACLs are saved in the output tar.
+You should B<not> run this program if the filesystem is
+mounted.
 
-=back" };
+It is possible that using this program can damage the filesystem
+or data on the filesystem." };
 
   { defaults with
-    name = "tgz_in"; added = (1, 0, 3);
-    style = RErr, [FileIn "tarball"; Pathname "directory"], [];
-    proc_nr = Some 71;
-    deprecated_by = Some "tar_in";
-    cancellable = true;
-    tests = [
-      InitScratchFS, Always, TestResultString (
-        [["mkdir"; "/tgz_in"];
-         ["tgz_in"; "$srcdir/../../test-data/files/helloworld.tar.gz"; "/tgz_in"];
-         ["cat"; "/tgz_in/hello"]], "hello\n"), []
-    ];
-    shortdesc = "unpack compressed tarball to directory";
+    name = "pvresize"; added = (1, 0, 26);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 98;
+    optional = Some "lvm2";
+    shortdesc = "resize an LVM physical volume";
     longdesc = "\
-This command uploads and unpacks local file C<tarball> (a
-I<gzip compressed> tar file) into F<directory>." };
+This resizes (expands or shrinks) an existing LVM physical
+volume to match the new size of the underlying device." };
 
   { defaults with
-    name = "tgz_out"; added = (1, 0, 3);
-    style = RErr, [Pathname "directory"; FileOut "tarball"], [];
-    proc_nr = Some 72;
-    deprecated_by = Some "tar_out";
-    cancellable = true;
-    shortdesc = "pack directory into compressed tarball";
+    name = "sfdisk_N"; added = (1, 0, 26);
+    style = RErr, [Device "device"; Int "partnum";
+                   Int "cyls"; Int "heads"; Int "sectors";
+                   String "line"], [];
+    proc_nr = Some 99;
+    deprecated_by = Some "part_add";
+    shortdesc = "modify a single partition on a block device";
     longdesc = "\
-This command packs the contents of F<directory> and downloads
-it to local file C<tarball>." };
+This runs L<sfdisk(8)> option to modify just the single
+partition C<n> (note: C<n> counts from 1).
 
-  { defaults with
-    name = "mount_ro"; added = (1, 0, 10);
-    style = RErr, [Mountable "mountable"; String "mountpoint"], [];
-    proc_nr = Some 73;
-    tests = [
-      InitBasicFS, Always, TestLastFail (
-        [["umount"; "/"; "false"; "false"];
-         ["mount_ro"; "/dev/sda1"; "/"];
-         ["touch"; "/new"]]), [];
-      InitBasicFS, Always, TestResultString (
-        [["write"; "/new"; "data"];
-         ["umount"; "/"; "false"; "false"];
-         ["mount_ro"; "/dev/sda1"; "/"];
-         ["cat"; "/new"]], "data"), []
-    ];
-    shortdesc = "mount a guest disk, read-only";
-    longdesc = "\
-This is the same as the C<guestfs_mount> command, but it
-mounts the filesystem with the read-only (I<-o ro>) flag." };
+For other parameters, see C<guestfs_sfdisk>.  You should usually
+pass C<0> for the cyls/heads/sectors parameters.
+
+See also: C<guestfs_part_add>" };
 
   { defaults with
-    name = "mount_options"; added = (1, 0, 10);
-    style = RErr, [String "options"; Mountable "mountable"; String "mountpoint"], [];
-    proc_nr = Some 74;
-    shortdesc = "mount a guest disk with mount options";
+    name = "sfdisk_l"; added = (1, 0, 26);
+    style = RString "partitions", [Device "device"], [];
+    proc_nr = Some 100;
+    deprecated_by = Some "part_list";
+    shortdesc = "display the partition table";
     longdesc = "\
-This is the same as the C<guestfs_mount> command, but it
-allows you to set the mount options as for the
-L<mount(8)> I<-o> flag.
+This displays the partition table on C<device>, in the
+human-readable output of the L<sfdisk(8)> command.  It is
+not intended to be parsed.
 
-If the C<options> parameter is an empty string, then
-no options are passed (all options default to whatever
-the filesystem uses)." };
+See also: C<guestfs_part_list>" };
 
   { defaults with
-    name = "mount_vfs"; added = (1, 0, 10);
-    style = RErr, [String "options"; String "vfstype"; Mountable "mountable"; String "mountpoint"], [];
-    proc_nr = Some 75;
-    shortdesc = "mount a guest disk with mount options and vfstype";
+    name = "sfdisk_kernel_geometry"; added = (1, 0, 26);
+    style = RString "partitions", [Device "device"], [];
+    proc_nr = Some 101;
+    shortdesc = "display the kernel geometry";
     longdesc = "\
-This is the same as the C<guestfs_mount> command, but it
-allows you to set both the mount options and the vfstype
-as for the L<mount(8)> I<-o> and I<-t> flags." };
+This displays the kernel's idea of the geometry of C<device>.
+
+The result is in human-readable format, and not designed to
+be parsed." };
 
   { defaults with
-    name = "debug"; added = (1, 0, 11);
-    style = RString "result", [String "subcmd"; StringList "extraargs"], [];
-    proc_nr = Some 76;
-    visibility = VDebug;
-    shortdesc = "debugging and internals";
+    name = "sfdisk_disk_geometry"; added = (1, 0, 26);
+    style = RString "partitions", [Device "device"], [];
+    proc_nr = Some 102;
+    shortdesc = "display the disk geometry from the partition table";
     longdesc = "\
-The C<guestfs_debug> command exposes some internals of
-C<guestfsd> (the guestfs daemon) that runs inside the
-hypervisor.
+This displays the disk geometry of C<device> read from the
+partition table.  Especially in the case where the underlying
+block device has been resized, this can be different from the
+kernel's idea of the geometry (see C<guestfs_sfdisk_kernel_geometry>).
 
-There is no comprehensive help for this command.  You have
-to look at the file F<daemon/debug.c> in the libguestfs source
-to find out what you can do." };
+The result is in human-readable format, and not designed to
+be parsed." };
 
   { defaults with
-    name = "lvremove"; added = (1, 0, 13);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 77;
+    name = "vg_activate_all"; added = (1, 0, 26);
+    style = RErr, [Bool "activate"], [];
+    proc_nr = Some 103;
     optional = Some "lvm2";
-    tests = [
-      InitEmpty, Always, TestResult (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["pvcreate"; "/dev/sda1"];
-         ["vgcreate"; "VG"; "/dev/sda1"];
-         ["lvcreate"; "LV1"; "VG"; "50"];
-         ["lvcreate"; "LV2"; "VG"; "50"];
-         ["lvremove"; "/dev/VG/LV1"];
-         ["lvs"]],
-        "is_string_list (ret, 1, \"/dev/VG/LV2\")"), [];
-      InitEmpty, Always, TestResult (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["pvcreate"; "/dev/sda1"];
-         ["vgcreate"; "VG"; "/dev/sda1"];
-         ["lvcreate"; "LV1"; "VG"; "50"];
-         ["lvcreate"; "LV2"; "VG"; "50"];
-         ["lvremove"; "/dev/VG"];
-         ["lvs"]],
-        "is_string_list (ret, 0)"), [];
-      InitEmpty, Always, TestResult (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["pvcreate"; "/dev/sda1"];
-         ["vgcreate"; "VG"; "/dev/sda1"];
-         ["lvcreate"; "LV1"; "VG"; "50"];
-         ["lvcreate"; "LV2"; "VG"; "50"];
-         ["lvremove"; "/dev/VG"];
-         ["vgs"]],
-        "is_string_list (ret, 1, \"VG\")"), []
-    ];
-    shortdesc = "remove an LVM logical volume";
+    shortdesc = "activate or deactivate all volume groups";
     longdesc = "\
-Remove an LVM logical volume C<device>, where C<device> is
-the path to the LV, such as F</dev/VG/LV>.
+This command activates or (if C<activate> is false) deactivates
+all logical volumes in all volume groups.
 
-You can also remove all LVs in a volume group by specifying
-the VG name, F</dev/VG>." };
+This command is the same as running C<vgchange -a y|n>" };
 
   { defaults with
-    name = "vgremove"; added = (1, 0, 13);
-    style = RErr, [String "vgname"], [];
-    proc_nr = Some 78;
+    name = "vg_activate"; added = (1, 0, 26);
+    style = RErr, [Bool "activate"; StringList "volgroups"], [];
+    proc_nr = Some 104;
     optional = Some "lvm2";
-    tests = [
-      InitEmpty, Always, TestResult (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["pvcreate"; "/dev/sda1"];
-         ["vgcreate"; "VG"; "/dev/sda1"];
-         ["lvcreate"; "LV1"; "VG"; "50"];
-         ["lvcreate"; "LV2"; "VG"; "50"];
-         ["vgremove"; "VG"];
-         ["lvs"]],
-        "is_string_list (ret, 0)"), [];
-      InitEmpty, Always, TestResult (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["pvcreate"; "/dev/sda1"];
-         ["vgcreate"; "VG"; "/dev/sda1"];
-         ["lvcreate"; "LV1"; "VG"; "50"];
-         ["lvcreate"; "LV2"; "VG"; "50"];
-         ["vgremove"; "VG"];
-         ["vgs"]],
-        "is_string_list (ret, 0)"), []
-    ];
-    shortdesc = "remove an LVM volume group";
+    shortdesc = "activate or deactivate some volume groups";
     longdesc = "\
-Remove an LVM volume group C<vgname>, (for example C<VG>).
+This command activates or (if C<activate> is false) deactivates
+all logical volumes in the listed volume groups C<volgroups>.
 
-This also forcibly removes all logical volumes in the volume
-group (if any)." };
+This command is the same as running C<vgchange -a y|n volgroups...>
+
+Note that if C<volgroups> is an empty list then B<all> volume groups
+are activated or deactivated." };
 
   { defaults with
-    name = "pvremove"; added = (1, 0, 13);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 79;
+    name = "lvresize"; added = (1, 0, 27);
+    style = RErr, [Device "device"; Int "mbytes"], [];
+    proc_nr = Some 105;
     optional = Some "lvm2";
     tests = [
-      InitEmpty, Always, TestResult (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["pvcreate"; "/dev/sda1"];
-         ["vgcreate"; "VG"; "/dev/sda1"];
-         ["lvcreate"; "LV1"; "VG"; "50"];
-         ["lvcreate"; "LV2"; "VG"; "50"];
-         ["vgremove"; "VG"];
-         ["pvremove"; "/dev/sda1"];
-         ["lvs"]],
-        "is_string_list (ret, 0)"), [];
-      InitEmpty, Always, TestResult (
+      InitNone, Always, TestResultString (
         [["part_disk"; "/dev/sda"; "mbr"];
          ["pvcreate"; "/dev/sda1"];
          ["vgcreate"; "VG"; "/dev/sda1"];
-         ["lvcreate"; "LV1"; "VG"; "50"];
-         ["lvcreate"; "LV2"; "VG"; "50"];
-         ["vgremove"; "VG"];
-         ["pvremove"; "/dev/sda1"];
-         ["vgs"]],
-        "is_string_list (ret, 0)"), [];
-      InitEmpty, Always, TestResult (
+         ["lvcreate"; "LV"; "VG"; "10"];
+         ["mkfs"; "ext2"; "/dev/VG/LV"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["mount"; "/dev/VG/LV"; "/"];
+         ["write"; "/new"; "test content"];
+         ["umount"; "/"; "false"; "false"];
+         ["lvresize"; "/dev/VG/LV"; "20"];
+         ["e2fsck_f"; "/dev/VG/LV"];
+         ["e2fsck"; "/dev/VG/LV"; "true"; "false"];
+         ["e2fsck"; "/dev/VG/LV"; "false"; "true"];
+         ["resize2fs"; "/dev/VG/LV"];
+         ["mount"; "/dev/VG/LV"; "/"];
+         ["cat"; "/new"]], "test content"), [];
+      InitNone, Always, TestRun (
+        (* Make an LV smaller to test RHBZ#587484. *)
         [["part_disk"; "/dev/sda"; "mbr"];
          ["pvcreate"; "/dev/sda1"];
          ["vgcreate"; "VG"; "/dev/sda1"];
-         ["lvcreate"; "LV1"; "VG"; "50"];
-         ["lvcreate"; "LV2"; "VG"; "50"];
-         ["vgremove"; "VG"];
-         ["pvremove"; "/dev/sda1"];
-         ["pvs"]],
-        "is_string_list (ret, 0)"), []
+         ["lvcreate"; "LV"; "VG"; "20"];
+         ["lvresize"; "/dev/VG/LV"; "10"]]), []
     ];
-    shortdesc = "remove an LVM physical volume";
+    shortdesc = "resize an LVM logical volume";
     longdesc = "\
-This wipes a physical volume C<device> so that LVM will no longer
-recognise it.
-
-The implementation uses the C<pvremove> command which refuses to
-wipe physical volumes that contain any volume groups, so you have
-to remove those first." };
+This resizes (expands or shrinks) an existing LVM logical
+volume to C<mbytes>.  When reducing, data in the reduced part
+is lost." };
 
   { defaults with
-    name = "set_e2label"; added = (1, 0, 15);
-    style = RErr, [Device "device"; String "label"], [];
-    proc_nr = Some 80;
-    deprecated_by = Some "set_label";
-    tests = [
-      InitBasicFS, Always, TestResultString (
-        [["set_e2label"; "/dev/sda1"; "testlabel"];
-         ["get_e2label"; "/dev/sda1"]], "testlabel"), []
-    ];
-    shortdesc = "set the ext2/3/4 filesystem label";
+    name = "resize2fs"; added = (1, 0, 27);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 106;
+    shortdesc = "resize an ext2, ext3 or ext4 filesystem";
     longdesc = "\
-This sets the ext2/3/4 filesystem label of the filesystem on
-C<device> to C<label>.  Filesystem labels are limited to
-16 characters.
-
-You can use either C<guestfs_tune2fs_l> or C<guestfs_get_e2label>
-to return the existing label on a filesystem." };
+This resizes an ext2, ext3 or ext4 filesystem to match the size of
+the underlying device.
 
-  { defaults with
-    name = "get_e2label"; added = (1, 0, 15);
-    style = RString "label", [Device "device"], [];
-    proc_nr = Some 81;
-    deprecated_by = Some "vfs_label";
-    shortdesc = "get the ext2/3/4 filesystem label";
-    longdesc = "\
-This returns the ext2/3/4 filesystem label of the filesystem on
-C<device>." };
+See also L<guestfs(3)/RESIZE2FS ERRORS>." };
 
   { defaults with
-    name = "set_e2uuid"; added = (1, 0, 15);
-    style = RErr, [Device "device"; String "uuid"], [];
-    proc_nr = Some 82;
-    deprecated_by = Some "set_uuid";
-    tests =
-      (let uuid = uuidgen () in [
-        InitBasicFS, Always, TestResultString (
-          [["set_e2uuid"; "/dev/sda1"; uuid];
-           ["get_e2uuid"; "/dev/sda1"]], uuid), [];
-        InitBasicFS, Always, TestResultString (
-          [["set_e2uuid"; "/dev/sda1"; "clear"];
-           ["get_e2uuid"; "/dev/sda1"]], ""), [];
-        (* We can't predict what UUIDs will be, so just check
-           the commands run. *)
-        InitBasicFS, Always, TestRun (
-          [["set_e2uuid"; "/dev/sda1"; "random"]]), [];
-        InitBasicFS, Always, TestRun (
-          [["set_e2uuid"; "/dev/sda1"; "time"]]), []
-      ]);
-    shortdesc = "set the ext2/3/4 filesystem UUID";
-    longdesc = "\
-This sets the ext2/3/4 filesystem UUID of the filesystem on
-C<device> to C<uuid>.  The format of the UUID and alternatives
-such as C<clear>, C<random> and C<time> are described in the
-L<tune2fs(8)> manpage.
-
-You can use C<guestfs_vfs_uuid> to return the existing UUID
-of a filesystem." };
+    name = "e2fsck_f"; added = (1, 0, 29);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 108;
+    deprecated_by = Some "e2fsck";
+    shortdesc = "check an ext2/ext3 filesystem";
+    longdesc = "\
+This runs C<e2fsck -p -f device>, ie. runs the ext2/ext3
+filesystem checker on C<device>, noninteractively (I<-p>),
+even if the filesystem appears to be clean (I<-f>)." };
 
   { defaults with
-    name = "get_e2uuid"; added = (1, 0, 15);
-    style = RString "uuid", [Device "device"], [];
-    proc_nr = Some 83;
-    deprecated_by = Some "vfs_uuid";
+    name = "sleep"; added = (1, 0, 41);
+    style = RErr, [Int "secs"], [];
+    proc_nr = Some 109;
     tests = [
-      (* We can't predict what UUID will be, so just check
-         the command run; regression test for RHBZ#597112. *)
       InitNone, Always, TestRun (
-        [["mke2journal"; "1024"; "/dev/sdc"];
-         ["get_e2uuid"; "/dev/sdc"]]), []
+        [["sleep"; "1"]]), []
     ];
-    shortdesc = "get the ext2/3/4 filesystem UUID";
+    shortdesc = "sleep for some seconds";
     longdesc = "\
-This returns the ext2/3/4 filesystem UUID of the filesystem on
-C<device>." };
+Sleep for C<secs> seconds." };
 
   { defaults with
-    name = "fsck"; added = (1, 0, 16);
-    style = RInt "status", [String "fstype"; Device "device"], [];
-    proc_nr = Some 84;
-    fish_output = Some FishOutputHexadecimal;
+    name = "ntfs_3g_probe"; added = (1, 0, 43);
+    style = RInt "status", [Bool "rw"; Device "device"], [];
+    proc_nr = Some 110;
+    optional = Some "ntfs3g";
     tests = [
-      InitBasicFS, Always, TestResult (
-        [["umount"; "/dev/sda1"; "false"; "false"];
-         ["fsck"; "ext2"; "/dev/sda1"]], "ret == 0"), [];
-      InitBasicFS, Always, TestResult (
-        [["umount"; "/dev/sda1"; "false"; "false"];
-         ["zero"; "/dev/sda1"];
-         ["fsck"; "ext2"; "/dev/sda1"]], "ret == 8"), []
+      InitNone, Always, TestResult (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["mkfs"; "ntfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["ntfs_3g_probe"; "true"; "/dev/sda1"]], "ret == 0"), [];
+      InitNone, Always, TestResult (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["mkfs"; "ext2"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["ntfs_3g_probe"; "true"; "/dev/sda1"]], "ret == 12"), []
     ];
-    shortdesc = "run the filesystem checker";
+    shortdesc = "probe NTFS volume";
     longdesc = "\
-This runs the filesystem checker (fsck) on C<device> which
-should have filesystem type C<fstype>.
-
-The returned integer is the status.  See L<fsck(8)> for the
-list of status codes from C<fsck>.
-
-Notes:
-
-=over 4
-
-=item *
+This command runs the L<ntfs-3g.probe(8)> command which probes
+an NTFS C<device> for mountability.  (Not all NTFS volumes can
+be mounted read-write, and some cannot be mounted at all).
 
-Multiple status codes can be summed together.
+C<rw> is a boolean flag.  Set it to true if you want to test
+if the volume can be mounted read-write.  Set it to false if
+you want to test if the volume can be mounted read-only.
 
-=item *
+The return value is an integer which C<0> if the operation
+would succeed, or some non-zero value documented in the
+L<ntfs-3g.probe(8)> manual page." };
 
-A non-zero return code can mean \"success\", for example if
-errors have been corrected on the filesystem.
+  { defaults with
+    name = "sh"; added = (1, 0, 50);
+    style = RString "output", [String "command"], [];
+    proc_nr = Some 111;
+    shortdesc = "run a command via the shell";
+    longdesc = "\
+This call runs a command from the guest filesystem via the
+guest's F</bin/sh>.
 
-=item *
+This is like C<guestfs_command>, but passes the command to:
 
-Checking or repairing NTFS volumes is not supported
-(by linux-ntfs).
+ /bin/sh -c \"command\"
 
-=back
+Depending on the guest's shell, this usually results in
+wildcards being expanded, shell expressions being interpolated
+and so on.
 
-This command is entirely equivalent to running C<fsck -a -t fstype device>." };
+All the provisos about C<guestfs_command> apply to this call." };
 
   { defaults with
-    name = "zero"; added = (1, 0, 16);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 85;
-    progress = true;
-    tests = [
-      InitBasicFS, Always, TestRun (
-        [["umount"; "/dev/sda1"; "false"; "false"];
-         ["zero"; "/dev/sda1"]]), []
-    ];
-    shortdesc = "write zeroes to the device";
+    name = "sh_lines"; added = (1, 0, 50);
+    style = RStringList "lines", [String "command"], [];
+    proc_nr = Some 112;
+    shortdesc = "run a command via the shell returning lines";
     longdesc = "\
-This command writes zeroes over the first few blocks of C<device>.
-
-How many blocks are zeroed isn't specified (but it's I<not> enough
-to securely wipe the device).  It should be sufficient to remove
-any partition tables, filesystem superblocks and so on.
-
-If blocks are already zero, then this command avoids writing
-zeroes.  This prevents the underlying device from becoming non-sparse
-or growing unnecessarily.
+This is the same as C<guestfs_sh>, but splits the result
+into a list of lines.
 
-See also: C<guestfs_zero_device>, C<guestfs_scrub_device>,
-C<guestfs_is_zero_device>" };
+See also: C<guestfs_command_lines>" };
 
   { defaults with
-    name = "grub_install"; added = (1, 0, 17);
-    style = RErr, [Pathname "root"; Device "device"], [];
-    proc_nr = Some 86;
-    optional = Some "grub";
-    (* See:
-     * https://bugzilla.redhat.com/show_bug.cgi?id=484986
-     * https://bugzilla.redhat.com/show_bug.cgi?id=479760
+    name = "glob_expand"; added = (1, 0, 50);
+    (* Use Pathname here, and hence ABS_PATH (pattern,...) in
+     * generated code in stubs.c, since all valid glob patterns must
+     * start with "/".  There is no concept of "cwd" in libguestfs,
+     * hence no "."-relative names.
      *)
+    style = RStringList "paths", [Pathname "pattern"], [OBool "directoryslash"];
+    proc_nr = Some 113;
+    once_had_no_optargs = true;
     tests = [
-      InitBasicFS, Always, TestResultTrue (
-        [["mkdir_p"; "/boot/grub"];
-         ["write"; "/boot/grub/device.map"; "(hd0) /dev/sda"];
-         ["grub_install"; "/"; "/dev/sda"];
-         ["is_dir"; "/boot"; ""]]), []
+      InitScratchFS, Always, TestResult (
+        [["mkdir_p"; "/glob_expand/b/c"];
+         ["touch"; "/glob_expand/b/c/d"];
+         ["touch"; "/glob_expand/b/c/e"];
+         ["glob_expand"; "/glob_expand/b/c/*"; ""]],
+        "is_string_list (ret, 2, \"/glob_expand/b/c/d\", \"/glob_expand/b/c/e\")"), [];
+      InitScratchFS, Always, TestResult (
+        [["mkdir_p"; "/glob_expand2/b/c"];
+         ["touch"; "/glob_expand2/b/c/d"];
+         ["touch"; "/glob_expand2/b/c/e"];
+         ["glob_expand"; "/glob_expand2/*/c/*"; ""]],
+        "is_string_list (ret, 2, \"/glob_expand2/b/c/d\", \"/glob_expand2/b/c/e\")"), [];
+      InitScratchFS, Always, TestResult (
+        [["mkdir_p"; "/glob_expand3/b/c"];
+         ["touch"; "/glob_expand3/b/c/d"];
+         ["touch"; "/glob_expand3/b/c/e"];
+         ["glob_expand"; "/glob_expand3/*/x/*"; ""]],
+        "is_string_list (ret, 0)"), [];
+      InitScratchFS, Always, TestResult (
+        [["mkdir_p"; "/glob_expand4/b/c"];
+         ["touch"; "/glob_expand4/b1"];
+         ["touch"; "/glob_expand4/c1"];
+         ["glob_expand"; "/glob_expand4/b*"; "false"]],
+        "is_string_list (ret, 2, \"/glob_expand4/b\", \"/glob_expand4/b1\")"), [];
     ];
-    shortdesc = "install GRUB 1";
+    shortdesc = "expand a wildcard path";
     longdesc = "\
-This command installs GRUB 1 (the Grand Unified Bootloader) on
-C<device>, with the root directory being C<root>.
-
-Notes:
-
-=over 4
-
-=item *
-
-There is currently no way in the API to install grub2, which
-is used by most modern Linux guests.  It is possible to run
-the grub2 command from the guest, although see the
-caveats in L<guestfs(3)/RUNNING COMMANDS>.
-
-=item *
-
-This uses C<grub-install> from the host.  Unfortunately grub is
-not always compatible with itself, so this only works in rather
-narrow circumstances.  Careful testing with each guest version
-is advisable.
-
-=item *
-
-If grub-install reports the error
-\"No suitable drive was found in the generated device map.\"
-it may be that you need to create a F</boot/grub/device.map>
-file first that contains the mapping between grub device names
-and Linux device names.  It is usually sufficient to create
-a file containing:
-
- (hd0) /dev/vda
+This command searches for all the pathnames matching
+C<pattern> according to the wildcard expansion rules
+used by the shell.
 
-replacing F</dev/vda> with the name of the installation device.
+If no paths match, then this returns an empty list
+(note: not an error).
 
-=back" };
+It is just a wrapper around the C L<glob(3)> function
+with flags C<GLOB_MARK|GLOB_BRACE>.
+See that manual page for more details.
 
-  { defaults with
-    name = "cp"; added = (1, 0, 18);
-    style = RErr, [Pathname "src"; Pathname "dest"], [];
-    proc_nr = Some 87;
-    tests = [
-      InitScratchFS, Always, TestResultString (
-        [["mkdir"; "/cp"];
-         ["write"; "/cp/old"; "file content"];
-         ["cp"; "/cp/old"; "/cp/new"];
-         ["cat"; "/cp/new"]], "file content"), [];
-      InitScratchFS, Always, TestResultTrue (
-        [["mkdir"; "/cp2"];
-         ["write"; "/cp2/old"; "file content"];
-         ["cp"; "/cp2/old"; "/cp2/new"];
-         ["is_file"; "/cp2/old"; ""]]), [];
-      InitScratchFS, Always, TestResultString (
-        [["mkdir"; "/cp3"];
-         ["write"; "/cp3/old"; "file content"];
-         ["mkdir"; "/cp3/dir"];
-         ["cp"; "/cp3/old"; "/cp3/dir/new"];
-         ["cat"; "/cp3/dir/new"]], "file content"), []
-    ];
-    shortdesc = "copy a file";
-    longdesc = "\
-This copies a file from C<src> to C<dest> where C<dest> is
-either a destination filename or destination directory." };
+C<directoryslash> controls whether use the C<GLOB_MARK> flag for
+L<glob(3)>, and it defaults to true.  It can be explicitly set as
+off to return no trailing slashes in filenames of directories.
 
-  { defaults with
-    name = "cp_a"; added = (1, 0, 18);
-    style = RErr, [Pathname "src"; Pathname "dest"], [];
-    proc_nr = Some 88;
-    tests = [
-      InitScratchFS, Always, TestResultString (
-        [["mkdir"; "/cp_a1"];
-         ["mkdir"; "/cp_a2"];
-         ["write"; "/cp_a1/file"; "file content"];
-         ["cp_a"; "/cp_a1"; "/cp_a2"];
-         ["cat"; "/cp_a2/cp_a1/file"]], "file content"), []
-    ];
-    shortdesc = "copy a file or directory recursively";
-    longdesc = "\
-This copies a file or directory from C<src> to C<dest>
-recursively using the C<cp -a> command." };
+Notice that there is no equivalent command for expanding a device
+name (eg. F</dev/sd*>).  Use C<guestfs_list_devices>,
+C<guestfs_list_partitions> etc functions instead." };
 
   { defaults with
-    name = "mv"; added = (1, 0, 18);
-    style = RErr, [Pathname "src"; Pathname "dest"], [];
-    proc_nr = Some 89;
+    name = "scrub_device"; added = (1, 0, 52);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 114;
+    optional = Some "scrub";
     tests = [
-      InitScratchFS, Always, TestResultString (
-        [["mkdir"; "/mv"];
-         ["write"; "/mv/old"; "file content"];
-         ["mv"; "/mv/old"; "/mv/new"];
-         ["cat"; "/mv/new"]], "file content"), [];
-      InitScratchFS, Always, TestResultFalse (
-        [["mkdir"; "/mv2"];
-         ["write"; "/mv2/old"; "file content"];
-         ["mv"; "/mv2/old"; "/mv2/new"];
-         ["is_file"; "/mv2/old"; ""]]), []
+      InitNone, Always, TestRun (	(* use /dev/sdc because it's smaller *)
+        [["scrub_device"; "/dev/sdc"]]), []
     ];
-    shortdesc = "move a file";
+    shortdesc = "scrub (securely wipe) a device";
     longdesc = "\
-This moves a file from C<src> to C<dest> where C<dest> is
-either a destination filename or destination directory.
+This command writes patterns over C<device> to make data retrieval
+more difficult.
 
-See also: C<guestfs_rename>." };
+It is an interface to the L<scrub(1)> program.  See that
+manual page for more details." };
 
   { defaults with
-    name = "drop_caches"; added = (1, 0, 18);
-    style = RErr, [Int "whattodrop"], [];
-    proc_nr = Some 90;
+    name = "scrub_file"; added = (1, 0, 52);
+    style = RErr, [Pathname "file"], [];
+    proc_nr = Some 115;
+    optional = Some "scrub";
     tests = [
-      InitEmpty, Always, TestRun (
-        [["drop_caches"; "3"]]), []
+      InitScratchFS, Always, TestRun (
+        [["write"; "/scrub_file"; "content"];
+         ["scrub_file"; "/scrub_file"]]), [];
+      InitScratchFS, Always, TestRun (
+        [["write"; "/scrub_file_2"; "content"];
+         ["ln_s"; "/scrub_file_2"; "/scrub_file_2_link"];
+         ["scrub_file"; "/scrub_file_2_link"]]), [];
+      InitScratchFS, Always, TestLastFail (
+        [["ln_s"; "/scrub_file_3_notexisting"; "/scrub_file_3_link"];
+         ["scrub_file"; "/scrub_file_3_link"]]), [];
+      InitScratchFS, Always, TestLastFail (
+        [["write"; "/scrub_file_4"; "content"];
+         ["ln_s"; "../sysroot/scrub_file_4"; "/scrub_file_4_link"];
+         ["scrub_file"; "/scrub_file_4_link"]]), [];
     ];
-    shortdesc = "drop kernel page cache, dentries and inodes";
+    shortdesc = "scrub (securely wipe) a file";
     longdesc = "\
-This instructs the guest kernel to drop its page cache,
-and/or dentries and inode caches.  The parameter C<whattodrop>
-tells the kernel what precisely to drop, see
-L<http://linux-mm.org/Drop_Caches>
+This command writes patterns over a file to make data retrieval
+more difficult.
 
-Setting C<whattodrop> to 3 should drop everything.
+The file is I<removed> after scrubbing.
 
-This automatically calls L<sync(2)> before the operation,
-so that the maximum guest memory is freed." };
+It is an interface to the L<scrub(1)> program.  See that
+manual page for more details." };
 
   { defaults with
-    name = "dmesg"; added = (1, 0, 18);
-    style = RString "kmsgs", [], [];
-    proc_nr = Some 91;
-    tests = [
-      InitEmpty, Always, TestRun (
-        [["dmesg"]]), []
-    ];
-    shortdesc = "return kernel messages";
+    name = "scrub_freespace"; added = (1, 0, 52);
+    style = RErr, [Pathname "dir"], [];
+    proc_nr = Some 116;
+    optional = Some "scrub";
+    tests = [] (* XXX needs testing *);
+    shortdesc = "scrub (securely wipe) free space";
     longdesc = "\
-This returns the kernel messages (C<dmesg> output) from
-the guest kernel.  This is sometimes useful for extended
-debugging of problems.
+This command creates the directory C<dir> and then fills it
+with files until the filesystem is full, and scrubs the files
+as for C<guestfs_scrub_file>, and deletes them.
+The intention is to scrub any free space on the partition
+containing C<dir>.
 
-Another way to get the same information is to enable
-verbose messages with C<guestfs_set_verbose> or by setting
-the environment variable C<LIBGUESTFS_DEBUG=1> before
-running the program." };
+It is an interface to the L<scrub(1)> program.  See that
+manual page for more details." };
 
   { defaults with
-    name = "ping_daemon"; added = (1, 0, 18);
-    style = RErr, [], [];
-    proc_nr = Some 92;
+    name = "mkdtemp"; added = (1, 0, 54);
+    style = RString "dir", [Pathname "tmpl"], [];
+    proc_nr = Some 117;
     tests = [
-      InitEmpty, Always, TestRun (
-        [["ping_daemon"]]), []
+      InitScratchFS, Always, TestRun (
+        [["mkdir"; "/mkdtemp"];
+         ["mkdtemp"; "/mkdtemp/tmpXXXXXX"]]), []
     ];
-    shortdesc = "ping the guest daemon";
+    shortdesc = "create a temporary directory";
     longdesc = "\
-This is a test probe into the guestfs daemon running inside
-the libguestfs appliance.  Calling this function checks that the
-daemon responds to the ping message, without affecting the daemon
-or attached block device(s) in any other way." };
+This command creates a temporary directory.  The
+C<tmpl> parameter should be a full pathname for the
+temporary directory name with the final six characters being
+\"XXXXXX\".
+
+For example: \"/tmp/myprogXXXXXX\" or \"/Temp/myprogXXXXXX\",
+the second one being suitable for Windows filesystems.
+
+The name of the temporary directory that was created
+is returned.
+
+The temporary directory is created with mode 0700
+and is owned by root.
+
+The caller is responsible for deleting the temporary
+directory and its contents after use.
+
+See also: L<mkdtemp(3)>" };
 
   { defaults with
-    name = "equal"; added = (1, 0, 18);
-    style = RBool "equality", [Pathname "file1"; Pathname "file2"], [];
-    proc_nr = Some 93;
+    name = "wc_l"; added = (1, 0, 54);
+    style = RInt "lines", [Pathname "path"], [];
+    proc_nr = Some 118;
     tests = [
-      InitScratchFS, Always, TestResultTrue (
-        [["mkdir"; "/equal"];
-         ["write"; "/equal/file1"; "contents of a file"];
-         ["cp"; "/equal/file1"; "/equal/file2"];
-         ["equal"; "/equal/file1"; "/equal/file2"]]), [];
-      InitScratchFS, Always, TestResultFalse (
-        [["mkdir"; "/equal2"];
-         ["write"; "/equal2/file1"; "contents of a file"];
-         ["write"; "/equal2/file2"; "contents of another file"];
-         ["equal"; "/equal2/file1"; "/equal2/file2"]]), [];
-      InitScratchFS, Always, TestLastFail (
-        [["mkdir"; "/equal3"];
-         ["equal"; "/equal3/file1"; "/equal3/file2"]]), []
+      InitISOFS, Always, TestResult (
+        [["wc_l"; "/10klines"]], "ret == 10000"), [];
+      (* Test for RHBZ#579608, absolute symbolic links. *)
+      InitISOFS, Always, TestResult (
+        [["wc_l"; "/abssymlink"]], "ret == 10000"), []
     ];
-    shortdesc = "test if two files have equal contents";
+    shortdesc = "count lines in a file";
     longdesc = "\
-This compares the two files F<file1> and F<file2> and returns
-true if their content is exactly equal, or false otherwise.
-
-The external L<cmp(1)> program is used for the comparison." };
+This command counts the lines in a file, in the same way
+as the C<wc -l> command." };
 
   { defaults with
-    name = "strings"; added = (1, 0, 22);
-    style = RStringList "stringsout", [Pathname "path"], [];
-    proc_nr = Some 94;
-    protocol_limit_warning = true;
+    name = "wc_w"; added = (1, 0, 54);
+    style = RInt "words", [Pathname "path"], [];
+    proc_nr = Some 119;
     tests = [
       InitISOFS, Always, TestResult (
-        [["strings"; "/known-5"]],
-        "is_string_list (ret, 2, \"abcdefghi\", \"jklmnopqr\")"), [];
-      InitISOFS, Always, TestResult (
-        [["strings"; "/empty"]],
-        "is_string_list (ret, 0)"), [];
-      (* Test for RHBZ#579608, absolute symbolic links. *)
-      InitISOFS, Always, TestRun (
-        [["strings"; "/abssymlink"]]), []
+        [["wc_w"; "/10klines"]], "ret == 10000"), []
     ];
-    shortdesc = "print the printable strings in a file";
+    shortdesc = "count words in a file";
     longdesc = "\
-This runs the L<strings(1)> command on a file and returns
-the list of printable strings found.
-
-The C<strings> command has, in the past, had problems with
-parsing untrusted files.  These are mitigated in the current
-version of libguestfs, but see L<guestfs(3)/CVE-2014-8484>." };
+This command counts the words in a file, in the same way
+as the C<wc -w> command." };
 
   { defaults with
-    name = "strings_e"; added = (1, 0, 22);
-    style = RStringList "stringsout", [String "encoding"; Pathname "path"], [];
-    proc_nr = Some 95;
-    protocol_limit_warning = true;
+    name = "wc_c"; added = (1, 0, 54);
+    style = RInt "chars", [Pathname "path"], [];
+    proc_nr = Some 120;
     tests = [
       InitISOFS, Always, TestResult (
-        [["strings_e"; "b"; "/known-5"]],
-        "is_string_list (ret, 0)"), [];
-      InitScratchFS, Always, TestResult (
-        [["write"; "/strings_e"; "\000h\000e\000l\000l\000o\000\n\000w\000o\000r\000l\000d\000\n"];
-         ["strings_e"; "b"; "/strings_e"]],
-        "is_string_list (ret, 2, \"hello\", \"world\")"), []
+        [["wc_c"; "/100kallspaces"]], "ret == 102400"), []
     ];
-    shortdesc = "print the printable strings in a file";
+    shortdesc = "count characters in a file";
     longdesc = "\
-This is like the C<guestfs_strings> command, but allows you to
-specify the encoding of strings that are looked for in
-the source file C<path>.
-
-Allowed encodings are:
-
-=over 4
-
-=item s
-
-Single 7-bit-byte characters like ASCII and the ASCII-compatible
-parts of ISO-8859-X (this is what C<guestfs_strings> uses).
-
-=item S
-
-Single 8-bit-byte characters.
-
-=item b
-
-16-bit big endian strings such as those encoded in
-UTF-16BE or UCS-2BE.
-
-=item l (lower case letter L)
-
-16-bit little endian such as UTF-16LE and UCS-2LE.
-This is useful for examining binaries in Windows guests.
-
-=item B
-
-32-bit big endian such as UCS-4BE.
-
-=item L
-
-32-bit little endian such as UCS-4LE.
-
-=back
-
-The returned strings are transcoded to UTF-8.
-
-The C<strings> command has, in the past, had problems with
-parsing untrusted files.  These are mitigated in the current
-version of libguestfs, but see L<guestfs(3)/CVE-2014-8484>." };
+This command counts the characters in a file, in the same way
+as the C<wc -c> command." };
 
   { defaults with
-    name = "hexdump"; added = (1, 0, 22);
-    style = RString "dump", [Pathname "path"], [];
-    proc_nr = Some 96;
-    protocol_limit_warning = true;
-    tests = [
-      InitISOFS, Always, TestResultString (
-        [["hexdump"; "/known-4"]], "00000000  61 62 63 0a 64 65 66 0a  67 68 69                 |abc.def.ghi|\n0000000b\n"), [];
-      (* Test for RHBZ#501888c2 regression which caused large hexdump
-       * commands to segfault.
-       *)
-      InitISOFS, Always, TestRun (
-        [["hexdump"; "/100krandom"]]), [];
+    name = "head"; added = (1, 0, 54);
+    style = RStringList "lines", [Pathname "path"], [];
+    proc_nr = Some 121;
+    protocol_limit_warning = true;
+    tests = [
+      InitISOFS, Always, TestResult (
+        [["head"; "/10klines"]],
+        "is_string_list (ret, 10, \"0abcdefghijklmnopqrstuvwxyz\", \"1abcdefghijklmnopqrstuvwxyz\", \"2abcdefghijklmnopqrstuvwxyz\", \"3abcdefghijklmnopqrstuvwxyz\", \"4abcdefghijklmnopqrstuvwxyz\", \"5abcdefghijklmnopqrstuvwxyz\", \"6abcdefghijklmnopqrstuvwxyz\", \"7abcdefghijklmnopqrstuvwxyz\", \"8abcdefghijklmnopqrstuvwxyz\", \"9abcdefghijklmnopqrstuvwxyz\")"), [];
       (* Test for RHBZ#579608, absolute symbolic links. *)
-      InitISOFS, Always, TestRun (
-        [["hexdump"; "/abssymlink"]]), []
+      InitISOFS, Always, TestResult (
+        [["head"; "/abssymlink"]],
+        "is_string_list (ret, 10, \"0abcdefghijklmnopqrstuvwxyz\", \"1abcdefghijklmnopqrstuvwxyz\", \"2abcdefghijklmnopqrstuvwxyz\", \"3abcdefghijklmnopqrstuvwxyz\", \"4abcdefghijklmnopqrstuvwxyz\", \"5abcdefghijklmnopqrstuvwxyz\", \"6abcdefghijklmnopqrstuvwxyz\", \"7abcdefghijklmnopqrstuvwxyz\", \"8abcdefghijklmnopqrstuvwxyz\", \"9abcdefghijklmnopqrstuvwxyz\")"), []
     ];
-    shortdesc = "dump a file in hexadecimal";
+    shortdesc = "return first 10 lines of a file";
     longdesc = "\
-This runs C<hexdump -C> on the given C<path>.  The result is
-the human-readable, canonical hex dump of the file." };
+This command returns up to the first 10 lines of a file as
+a list of strings." };
 
   { defaults with
-    name = "zerofree"; added = (1, 0, 26);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 97;
-    optional = Some "zerofree";
+    name = "head_n"; added = (1, 0, 54);
+    style = RStringList "lines", [Int "nrlines"; Pathname "path"], [];
+    proc_nr = Some 122;
+    protocol_limit_warning = true;
     tests = [
-      InitNone, Always, TestResultString (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["mkfs"; "ext3"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
-         ["mount"; "/dev/sda1"; "/"];
-         ["write"; "/new"; "test file"];
-         ["umount"; "/dev/sda1"; "false"; "false"];
-         ["zerofree"; "/dev/sda1"];
-         ["mount"; "/dev/sda1"; "/"];
-         ["cat"; "/new"]], "test file"), []
+      InitISOFS, Always, TestResult (
+        [["head_n"; "3"; "/10klines"]],
+        "is_string_list (ret, 3, \"0abcdefghijklmnopqrstuvwxyz\", \"1abcdefghijklmnopqrstuvwxyz\", \"2abcdefghijklmnopqrstuvwxyz\")"), [];
+      InitISOFS, Always, TestResult (
+        [["head_n"; "-9997"; "/10klines"]],
+        "is_string_list (ret, 3, \"0abcdefghijklmnopqrstuvwxyz\", \"1abcdefghijklmnopqrstuvwxyz\", \"2abcdefghijklmnopqrstuvwxyz\")"), [];
+      InitISOFS, Always, TestResult (
+        [["head_n"; "0"; "/10klines"]],
+        "is_string_list (ret, 0)"), []
     ];
-    shortdesc = "zero unused inodes and disk blocks on ext2/3 filesystem";
+    shortdesc = "return first N lines of a file";
     longdesc = "\
-This runs the I<zerofree> program on C<device>.  This program
-claims to zero unused inodes and disk blocks on an ext2/3
-filesystem, thus making it possible to compress the filesystem
-more effectively.
+If the parameter C<nrlines> is a positive number, this returns the first
+C<nrlines> lines of the file C<path>.
 
-You should B<not> run this program if the filesystem is
-mounted.
+If the parameter C<nrlines> is a negative number, this returns lines
+from the file C<path>, excluding the last C<nrlines> lines.
 
-It is possible that using this program can damage the filesystem
-or data on the filesystem." };
+If the parameter C<nrlines> is zero, this returns an empty list." };
 
   { defaults with
-    name = "pvresize"; added = (1, 0, 26);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 98;
-    optional = Some "lvm2";
-    shortdesc = "resize an LVM physical volume";
+    name = "tail"; added = (1, 0, 54);
+    style = RStringList "lines", [Pathname "path"], [];
+    proc_nr = Some 123;
+    protocol_limit_warning = true;
+    tests = [
+      InitISOFS, Always, TestResult (
+        [["tail"; "/10klines"]],
+        "is_string_list (ret, 10, \"9990abcdefghijklmnopqrstuvwxyz\", \"9991abcdefghijklmnopqrstuvwxyz\", \"9992abcdefghijklmnopqrstuvwxyz\", \"9993abcdefghijklmnopqrstuvwxyz\", \"9994abcdefghijklmnopqrstuvwxyz\", \"9995abcdefghijklmnopqrstuvwxyz\", \"9996abcdefghijklmnopqrstuvwxyz\", \"9997abcdefghijklmnopqrstuvwxyz\", \"9998abcdefghijklmnopqrstuvwxyz\", \"9999abcdefghijklmnopqrstuvwxyz\")"), []
+    ];
+    shortdesc = "return last 10 lines of a file";
     longdesc = "\
-This resizes (expands or shrinks) an existing LVM physical
-volume to match the new size of the underlying device." };
+This command returns up to the last 10 lines of a file as
+a list of strings." };
 
   { defaults with
-    name = "sfdisk_N"; added = (1, 0, 26);
-    style = RErr, [Device "device"; Int "partnum";
-                   Int "cyls"; Int "heads"; Int "sectors";
-                   String "line"], [];
-    proc_nr = Some 99;
-    deprecated_by = Some "part_add";
-    shortdesc = "modify a single partition on a block device";
+    name = "tail_n"; added = (1, 0, 54);
+    style = RStringList "lines", [Int "nrlines"; Pathname "path"], [];
+    proc_nr = Some 124;
+    protocol_limit_warning = true;
+    tests = [
+      InitISOFS, Always, TestResult (
+        [["tail_n"; "3"; "/10klines"]],
+        "is_string_list (ret, 3, \"9997abcdefghijklmnopqrstuvwxyz\", \"9998abcdefghijklmnopqrstuvwxyz\", \"9999abcdefghijklmnopqrstuvwxyz\")"), [];
+      InitISOFS, Always, TestResult (
+        [["tail_n"; "-9998"; "/10klines"]],
+        "is_string_list (ret, 3, \"9997abcdefghijklmnopqrstuvwxyz\", \"9998abcdefghijklmnopqrstuvwxyz\", \"9999abcdefghijklmnopqrstuvwxyz\")"), [];
+      InitISOFS, Always, TestResult (
+        [["tail_n"; "0"; "/10klines"]],
+        "is_string_list (ret, 0)"), []
+    ];
+    shortdesc = "return last N lines of a file";
     longdesc = "\
-This runs L<sfdisk(8)> option to modify just the single
-partition C<n> (note: C<n> counts from 1).
+If the parameter C<nrlines> is a positive number, this returns the last
+C<nrlines> lines of the file C<path>.
 
-For other parameters, see C<guestfs_sfdisk>.  You should usually
-pass C<0> for the cyls/heads/sectors parameters.
+If the parameter C<nrlines> is a negative number, this returns lines
+from the file C<path>, starting with the C<-nrlines>th line.
 
-See also: C<guestfs_part_add>" };
+If the parameter C<nrlines> is zero, this returns an empty list." };
 
   { defaults with
-    name = "sfdisk_l"; added = (1, 0, 26);
-    style = RString "partitions", [Device "device"], [];
-    proc_nr = Some 100;
-    deprecated_by = Some "part_list";
-    shortdesc = "display the partition table";
+    name = "df"; added = (1, 0, 54);
+    style = RString "output", [], [];
+    proc_nr = Some 125;
+    test_excuse = "tricky to test because it depends on the exact format of the 'df' command and other imponderables";
+    shortdesc = "report file system disk space usage";
     longdesc = "\
-This displays the partition table on C<device>, in the
-human-readable output of the L<sfdisk(8)> command.  It is
-not intended to be parsed.
+This command runs the C<df> command to report disk space used.
 
-See also: C<guestfs_part_list>" };
+This command is mostly useful for interactive sessions.  It
+is I<not> intended that you try to parse the output string.
+Use C<guestfs_statvfs> from programs." };
 
   { defaults with
-    name = "sfdisk_kernel_geometry"; added = (1, 0, 26);
-    style = RString "partitions", [Device "device"], [];
-    proc_nr = Some 101;
-    shortdesc = "display the kernel geometry";
+    name = "df_h"; added = (1, 0, 54);
+    style = RString "output", [], [];
+    proc_nr = Some 126;
+    test_excuse = "tricky to test because it depends on the exact format of the 'df' command and other imponderables";
+    shortdesc = "report file system disk space usage (human readable)";
     longdesc = "\
-This displays the kernel's idea of the geometry of C<device>.
+This command runs the C<df -h> command to report disk space used
+in human-readable format.
 
-The result is in human-readable format, and not designed to
-be parsed." };
+This command is mostly useful for interactive sessions.  It
+is I<not> intended that you try to parse the output string.
+Use C<guestfs_statvfs> from programs." };
 
   { defaults with
-    name = "sfdisk_disk_geometry"; added = (1, 0, 26);
-    style = RString "partitions", [Device "device"], [];
-    proc_nr = Some 102;
-    shortdesc = "display the disk geometry from the partition table";
+    name = "du"; added = (1, 0, 54);
+    style = RInt64 "sizekb", [Pathname "path"], [];
+    proc_nr = Some 127;
+    reentrant = true;
+    progress = true;
+    tests = [
+      InitISOFS, Always, TestResult (
+        [["du"; "/directory"]], "ret == 2" (* ISO fs blocksize is 2K *)), []
+    ];
+    shortdesc = "estimate file space usage";
     longdesc = "\
-This displays the disk geometry of C<device> read from the
-partition table.  Especially in the case where the underlying
-block device has been resized, this can be different from the
-kernel's idea of the geometry (see C<guestfs_sfdisk_kernel_geometry>).
+This command estimates file space usage for C<path>, in the
+same way as the C<du -s> command.
 
-The result is in human-readable format, and not designed to
-be parsed." };
+C<path> can be a file or a directory.  If C<path> is a directory
+then the estimate includes the contents of the directory and all
+subdirectories (recursively).
+
+The result is the estimated size in I<kilobytes>
+(ie. units of 1024 bytes)." };
 
   { defaults with
-    name = "vg_activate_all"; added = (1, 0, 26);
-    style = RErr, [Bool "activate"], [];
-    proc_nr = Some 103;
-    optional = Some "lvm2";
-    shortdesc = "activate or deactivate all volume groups";
+    name = "initrd_list"; added = (1, 0, 54);
+    style = RStringList "filenames", [Pathname "path"], [];
+    proc_nr = Some 128;
+    tests = [
+      InitISOFS, Always, TestResult (
+        [["initrd_list"; "/initrd"]],
+        "is_string_list (ret, 6, \"empty\", \"known-1\", \"known-2\", \"known-3\", \"known-4\", \"known-5\")"), []
+    ];
+    shortdesc = "list files in an initrd";
     longdesc = "\
-This command activates or (if C<activate> is false) deactivates
-all logical volumes in all volume groups.
+This command lists out files contained in an initrd.
 
-This command is the same as running C<vgchange -a y|n>" };
+The files are listed without any initial F</> character.  The
+files are listed in the order they appear (not necessarily
+alphabetical).  Directory names are listed as separate items.
+
+Old Linux kernels (2.4 and earlier) used a compressed ext2
+filesystem as initrd.  We I<only> support the newer initramfs
+format (compressed cpio files)." };
 
   { defaults with
-    name = "vg_activate"; added = (1, 0, 26);
-    style = RErr, [Bool "activate"; StringList "volgroups"], [];
-    proc_nr = Some 104;
-    optional = Some "lvm2";
-    shortdesc = "activate or deactivate some volume groups";
+    name = "mount_loop"; added = (1, 0, 54);
+    style = RErr, [Pathname "file"; Pathname "mountpoint"], [];
+    proc_nr = Some 129;
+    shortdesc = "mount a file using the loop device";
     longdesc = "\
-This command activates or (if C<activate> is false) deactivates
-all logical volumes in the listed volume groups C<volgroups>.
-
-This command is the same as running C<vgchange -a y|n volgroups...>
-
-Note that if C<volgroups> is an empty list then B<all> volume groups
-are activated or deactivated." };
+This command lets you mount F<file> (a filesystem image
+in a file) on a mount point.  It is entirely equivalent to
+the command C<mount -o loop file mountpoint>." };
 
   { defaults with
-    name = "lvresize"; added = (1, 0, 27);
-    style = RErr, [Device "device"; Int "mbytes"], [];
-    proc_nr = Some 105;
-    optional = Some "lvm2";
-    tests = [
-      InitNone, Always, TestResultString (
+    name = "mkswap"; added = (1, 0, 55);
+    style = RErr, [Device "device"], [OString "label"; OString "uuid"];
+    proc_nr = Some 130;
+    once_had_no_optargs = true;
+    tests = (let uuid = uuidgen () in [
+      InitEmpty, Always, TestRun (
         [["part_disk"; "/dev/sda"; "mbr"];
-         ["pvcreate"; "/dev/sda1"];
-         ["vgcreate"; "VG"; "/dev/sda1"];
-         ["lvcreate"; "LV"; "VG"; "10"];
-         ["mkfs"; "ext2"; "/dev/VG/LV"; ""; "NOARG"; ""; ""; "NOARG"];
-         ["mount"; "/dev/VG/LV"; "/"];
-         ["write"; "/new"; "test content"];
-         ["umount"; "/"; "false"; "false"];
-         ["lvresize"; "/dev/VG/LV"; "20"];
-         ["e2fsck_f"; "/dev/VG/LV"];
-         ["e2fsck"; "/dev/VG/LV"; "true"; "false"];
-         ["e2fsck"; "/dev/VG/LV"; "false"; "true"];
-         ["resize2fs"; "/dev/VG/LV"];
-         ["mount"; "/dev/VG/LV"; "/"];
-         ["cat"; "/new"]], "test content"), [];
-      InitNone, Always, TestRun (
-        (* Make an LV smaller to test RHBZ#587484. *)
+         ["mkswap"; "/dev/sda1"; "NOARG"; "NOARG"]]), [];
+      InitEmpty, Always, TestRun (
         [["part_disk"; "/dev/sda"; "mbr"];
-         ["pvcreate"; "/dev/sda1"];
-         ["vgcreate"; "VG"; "/dev/sda1"];
-         ["lvcreate"; "LV"; "VG"; "20"];
-         ["lvresize"; "/dev/VG/LV"; "10"]]), []
-    ];
-    shortdesc = "resize an LVM logical volume";
+         ["mkswap"; "/dev/sda1"; "hello"; "NOARG"]]), [];
+      InitEmpty, Always, TestResultString (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["mkswap"; "/dev/sda1"; "NOARG"; uuid];
+         ["vfs_uuid"; "/dev/sda1"]], uuid), [];
+      InitEmpty, Always, TestResultString (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["mkswap"; "/dev/sda1"; "hello"; uuid];
+         ["vfs_label"; "/dev/sda1"]], "hello"), []
+    ]);
+    shortdesc = "create a swap partition";
     longdesc = "\
-This resizes (expands or shrinks) an existing LVM logical
-volume to C<mbytes>.  When reducing, data in the reduced part
-is lost." };
+Create a Linux swap partition on C<device>.
+
+The option arguments C<label> and C<uuid> allow you to set the
+label and/or UUID of the new swap partition." };
 
   { defaults with
-    name = "resize2fs"; added = (1, 0, 27);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 106;
-    shortdesc = "resize an ext2, ext3 or ext4 filesystem";
+    name = "mkswap_L"; added = (1, 0, 55);
+    style = RErr, [String "label"; Device "device"], [];
+    proc_nr = Some 131;
+    deprecated_by = Some "mkswap";
+    tests = [
+      InitEmpty, Always, TestRun (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["mkswap_L"; "hello"; "/dev/sda1"]]), []
+    ];
+    shortdesc = "create a swap partition with a label";
     longdesc = "\
-This resizes an ext2, ext3 or ext4 filesystem to match the size of
-the underlying device.
+Create a swap partition on C<device> with label C<label>.
 
-See also L<guestfs(3)/RESIZE2FS ERRORS>." };
+Note that you cannot attach a swap label to a block device
+(eg. F</dev/sda>), just to a partition.  This appears to be
+a limitation of the kernel or swap tools." };
 
   { defaults with
-    name = "e2fsck_f"; added = (1, 0, 29);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 108;
-    deprecated_by = Some "e2fsck";
-    shortdesc = "check an ext2/ext3 filesystem";
+    name = "mkswap_U"; added = (1, 0, 55);
+    style = RErr, [String "uuid"; Device "device"], [];
+    proc_nr = Some 132;
+    deprecated_by = Some "mkswap";
+    optional = Some "linuxfsuuid";
+    tests =
+      (let uuid = uuidgen () in [
+        InitEmpty, Always, TestRun (
+          [["part_disk"; "/dev/sda"; "mbr"];
+           ["mkswap_U"; uuid; "/dev/sda1"]]), []
+      ]);
+    shortdesc = "create a swap partition with an explicit UUID";
     longdesc = "\
-This runs C<e2fsck -p -f device>, ie. runs the ext2/ext3
-filesystem checker on C<device>, noninteractively (I<-p>),
-even if the filesystem appears to be clean (I<-f>)." };
+Create a swap partition on C<device> with UUID C<uuid>." };
 
   { defaults with
-    name = "sleep"; added = (1, 0, 41);
-    style = RErr, [Int "secs"], [];
-    proc_nr = Some 109;
+    name = "mknod"; added = (1, 0, 55);
+    style = RErr, [Int "mode"; Int "devmajor"; Int "devminor"; Pathname "path"], [];
+    proc_nr = Some 133;
+    optional = Some "mknod";
     tests = [
-      InitNone, Always, TestRun (
-        [["sleep"; "1"]]), []
+      InitScratchFS, Always, TestResult (
+        [["mknod"; "0o10777"; "0"; "0"; "/mknod"];
+         (* NB: default umask 022 means 0777 -> 0755 in these tests *)
+         ["stat"; "/mknod"]],
+        "S_ISFIFO (ret->mode) && (ret->mode & 0777) == 0755"), [];
+      InitScratchFS, Always, TestResult (
+        [["mknod"; "0o60777"; "66"; "99"; "/mknod2"];
+         ["stat"; "/mknod2"]],
+        "S_ISBLK (ret->mode) && (ret->mode & 0777) == 0755"), []
     ];
-    shortdesc = "sleep for some seconds";
+    shortdesc = "make block, character or FIFO devices";
     longdesc = "\
-Sleep for C<secs> seconds." };
+This call creates block or character special devices, or
+named pipes (FIFOs).
+
+The C<mode> parameter should be the mode, using the standard
+constants.  C<devmajor> and C<devminor> are the
+device major and minor numbers, only used when creating block
+and character special devices.
+
+Note that, just like L<mknod(2)>, the mode must be bitwise
+OR'd with S_IFBLK, S_IFCHR, S_IFIFO or S_IFSOCK (otherwise this call
+just creates a regular file).  These constants are
+available in the standard Linux header files, or you can use
+C<guestfs_mknod_b>, C<guestfs_mknod_c> or C<guestfs_mkfifo>
+which are wrappers around this command which bitwise OR
+in the appropriate constant for you.
+
+The mode actually set is affected by the umask." };
 
   { defaults with
-    name = "ntfs_3g_probe"; added = (1, 0, 43);
-    style = RInt "status", [Bool "rw"; Device "device"], [];
-    proc_nr = Some 110;
-    optional = Some "ntfs3g";
+    name = "mkfifo"; added = (1, 0, 55);
+    style = RErr, [Int "mode"; Pathname "path"], [];
+    proc_nr = Some 134;
+    optional = Some "mknod";
     tests = [
-      InitNone, Always, TestResult (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["mkfs"; "ntfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
-         ["ntfs_3g_probe"; "true"; "/dev/sda1"]], "ret == 0"), [];
-      InitNone, Always, TestResult (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["mkfs"; "ext2"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
-         ["ntfs_3g_probe"; "true"; "/dev/sda1"]], "ret == 12"), []
+      InitScratchFS, Always, TestResult (
+        [["mkfifo"; "0o777"; "/mkfifo"];
+         ["stat"; "/mkfifo"]],
+        "S_ISFIFO (ret->mode) && (ret->mode & 0777) == 0755"), [];
+      InitScratchFS, Always, TestLastFail (
+        [["mkfifo"; "0o20777"; "/mkfifo-2"]]), [];
     ];
-    shortdesc = "probe NTFS volume";
+    shortdesc = "make FIFO (named pipe)";
     longdesc = "\
-This command runs the L<ntfs-3g.probe(8)> command which probes
-an NTFS C<device> for mountability.  (Not all NTFS volumes can
-be mounted read-write, and some cannot be mounted at all).
+This call creates a FIFO (named pipe) called C<path> with
+mode C<mode>.  It is just a convenient wrapper around
+C<guestfs_mknod>.
 
-C<rw> is a boolean flag.  Set it to true if you want to test
-if the volume can be mounted read-write.  Set it to false if
-you want to test if the volume can be mounted read-only.
+Unlike with C<guestfs_mknod>, C<mode> B<must> contain only permissions
+bits.
 
-The return value is an integer which C<0> if the operation
-would succeed, or some non-zero value documented in the
-L<ntfs-3g.probe(8)> manual page." };
+The mode actually set is affected by the umask." };
 
   { defaults with
-    name = "sh"; added = (1, 0, 50);
-    style = RString "output", [String "command"], [];
-    proc_nr = Some 111;
-    shortdesc = "run a command via the shell";
+    name = "mknod_b"; added = (1, 0, 55);
+    style = RErr, [Int "mode"; Int "devmajor"; Int "devminor"; Pathname "path"], [];
+    proc_nr = Some 135;
+    optional = Some "mknod";
+    tests = [
+      InitScratchFS, Always, TestResult (
+        [["mknod_b"; "0o777"; "99"; "66"; "/mknod_b"];
+         ["stat"; "/mknod_b"]],
+        "S_ISBLK (ret->mode) && (ret->mode & 0777) == 0755"), [];
+      InitScratchFS, Always, TestLastFail (
+        [["mknod_b"; "0o10777"; "99"; "66"; "/mknod_b-2"]]), [];
+    ];
+    shortdesc = "make block device node";
     longdesc = "\
-This call runs a command from the guest filesystem via the
-guest's F</bin/sh>.
-
-This is like C<guestfs_command>, but passes the command to:
-
- /bin/sh -c \"command\"
+This call creates a block device node called C<path> with
+mode C<mode> and device major/minor C<devmajor> and C<devminor>.
+It is just a convenient wrapper around C<guestfs_mknod>.
 
-Depending on the guest's shell, this usually results in
-wildcards being expanded, shell expressions being interpolated
-and so on.
+Unlike with C<guestfs_mknod>, C<mode> B<must> contain only permissions
+bits.
 
-All the provisos about C<guestfs_command> apply to this call." };
+The mode actually set is affected by the umask." };
 
   { defaults with
-    name = "sh_lines"; added = (1, 0, 50);
-    style = RStringList "lines", [String "command"], [];
-    proc_nr = Some 112;
-    shortdesc = "run a command via the shell returning lines";
+    name = "mknod_c"; added = (1, 0, 55);
+    style = RErr, [Int "mode"; Int "devmajor"; Int "devminor"; Pathname "path"], [];
+    proc_nr = Some 136;
+    optional = Some "mknod";
+    tests = [
+      InitScratchFS, Always, TestResult (
+        [["mknod_c"; "0o777"; "99"; "66"; "/mknod_c"];
+         ["stat"; "/mknod_c"]],
+        "S_ISCHR (ret->mode) && (ret->mode & 0777) == 0755"), [];
+      InitScratchFS, Always, TestLastFail (
+        [["mknod_c"; "0o20777"; "99"; "66"; "/mknod_c-2"]]), [];
+    ];
+    shortdesc = "make char device node";
     longdesc = "\
-This is the same as C<guestfs_sh>, but splits the result
-into a list of lines.
+This call creates a char device node called C<path> with
+mode C<mode> and device major/minor C<devmajor> and C<devminor>.
+It is just a convenient wrapper around C<guestfs_mknod>.
 
-See also: C<guestfs_command_lines>" };
+Unlike with C<guestfs_mknod>, C<mode> B<must> contain only permissions
+bits.
+
+The mode actually set is affected by the umask." };
 
   { defaults with
-    name = "glob_expand"; added = (1, 0, 50);
-    (* Use Pathname here, and hence ABS_PATH (pattern,...) in
-     * generated code in stubs.c, since all valid glob patterns must
-     * start with "/".  There is no concept of "cwd" in libguestfs,
-     * hence no "."-relative names.
-     *)
-    style = RStringList "paths", [Pathname "pattern"], [OBool "directoryslash"];
-    proc_nr = Some 113;
-    once_had_no_optargs = true;
+    name = "umask"; added = (1, 0, 55);
+    style = RInt "oldmask", [Int "mask"], [];
+    proc_nr = Some 137;
+    fish_output = Some FishOutputOctal;
     tests = [
-      InitScratchFS, Always, TestResult (
-        [["mkdir_p"; "/glob_expand/b/c"];
-         ["touch"; "/glob_expand/b/c/d"];
-         ["touch"; "/glob_expand/b/c/e"];
-         ["glob_expand"; "/glob_expand/b/c/*"; ""]],
-        "is_string_list (ret, 2, \"/glob_expand/b/c/d\", \"/glob_expand/b/c/e\")"), [];
-      InitScratchFS, Always, TestResult (
-        [["mkdir_p"; "/glob_expand2/b/c"];
-         ["touch"; "/glob_expand2/b/c/d"];
-         ["touch"; "/glob_expand2/b/c/e"];
-         ["glob_expand"; "/glob_expand2/*/c/*"; ""]],
-        "is_string_list (ret, 2, \"/glob_expand2/b/c/d\", \"/glob_expand2/b/c/e\")"), [];
-      InitScratchFS, Always, TestResult (
-        [["mkdir_p"; "/glob_expand3/b/c"];
-         ["touch"; "/glob_expand3/b/c/d"];
-         ["touch"; "/glob_expand3/b/c/e"];
-         ["glob_expand"; "/glob_expand3/*/x/*"; ""]],
-        "is_string_list (ret, 0)"), [];
-      InitScratchFS, Always, TestResult (
-        [["mkdir_p"; "/glob_expand4/b/c"];
-         ["touch"; "/glob_expand4/b1"];
-         ["touch"; "/glob_expand4/c1"];
-         ["glob_expand"; "/glob_expand4/b*"; "false"]],
-        "is_string_list (ret, 2, \"/glob_expand4/b\", \"/glob_expand4/b1\")"), [];
+      InitEmpty, Always, TestResult (
+        [["umask"; "0o22"]], "ret == 022"), []
     ];
-    shortdesc = "expand a wildcard path";
+    shortdesc = "set file mode creation mask (umask)";
     longdesc = "\
-This command searches for all the pathnames matching
-C<pattern> according to the wildcard expansion rules
-used by the shell.
-
-If no paths match, then this returns an empty list
-(note: not an error).
+This function sets the mask used for creating new files and
+device nodes to C<mask & 0777>.
 
-It is just a wrapper around the C L<glob(3)> function
-with flags C<GLOB_MARK|GLOB_BRACE>.
-See that manual page for more details.
+Typical umask values would be C<022> which creates new files
+with permissions like \"-rw-r--r--\" or \"-rwxr-xr-x\", and
+C<002> which creates new files with permissions like
+\"-rw-rw-r--\" or \"-rwxrwxr-x\".
 
-C<directoryslash> controls whether use the C<GLOB_MARK> flag for
-L<glob(3)>, and it defaults to true.  It can be explicitly set as
-off to return no trailing slashes in filenames of directories.
+The default umask is C<022>.  This is important because it
+means that directories and device nodes will be created with
+C<0644> or C<0755> mode even if you specify C<0777>.
 
-Notice that there is no equivalent command for expanding a device
-name (eg. F</dev/sd*>).  Use C<guestfs_list_devices>,
-C<guestfs_list_partitions> etc functions instead." };
+See also C<guestfs_get_umask>,
+L<umask(2)>, C<guestfs_mknod>, C<guestfs_mkdir>.
+
+This call returns the previous umask." };
 
   { defaults with
-    name = "scrub_device"; added = (1, 0, 52);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 114;
-    optional = Some "scrub";
-    tests = [
-      InitNone, Always, TestRun (	(* use /dev/sdc because it's smaller *)
-        [["scrub_device"; "/dev/sdc"]]), []
-    ];
-    shortdesc = "scrub (securely wipe) a device";
+    name = "sfdiskM"; added = (1, 0, 55);
+    style = RErr, [Device "device"; StringList "lines"], [];
+    proc_nr = Some 139;
+    deprecated_by = Some "part_add";
+    shortdesc = "create partitions on a block device";
     longdesc = "\
-This command writes patterns over C<device> to make data retrieval
-more difficult.
+This is a simplified interface to the C<guestfs_sfdisk>
+command, where partition sizes are specified in megabytes
+only (rounded to the nearest cylinder) and you don't need
+to specify the cyls, heads and sectors parameters which
+were rarely if ever used anyway.
 
-It is an interface to the L<scrub(1)> program.  See that
-manual page for more details." };
+See also: C<guestfs_sfdisk>, the L<sfdisk(8)> manpage
+and C<guestfs_part_disk>" };
 
   { defaults with
-    name = "scrub_file"; added = (1, 0, 52);
-    style = RErr, [Pathname "file"], [];
-    proc_nr = Some 115;
-    optional = Some "scrub";
-    tests = [
-      InitScratchFS, Always, TestRun (
-        [["write"; "/scrub_file"; "content"];
-         ["scrub_file"; "/scrub_file"]]), [];
-      InitScratchFS, Always, TestRun (
-        [["write"; "/scrub_file_2"; "content"];
-         ["ln_s"; "/scrub_file_2"; "/scrub_file_2_link"];
-         ["scrub_file"; "/scrub_file_2_link"]]), [];
-      InitScratchFS, Always, TestLastFail (
-        [["ln_s"; "/scrub_file_3_notexisting"; "/scrub_file_3_link"];
-         ["scrub_file"; "/scrub_file_3_link"]]), [];
-      InitScratchFS, Always, TestLastFail (
-        [["write"; "/scrub_file_4"; "content"];
-         ["ln_s"; "../sysroot/scrub_file_4"; "/scrub_file_4_link"];
-         ["scrub_file"; "/scrub_file_4_link"]]), [];
-    ];
-    shortdesc = "scrub (securely wipe) a file";
+    name = "zfile"; added = (1, 0, 59);
+    style = RString "description", [String "meth"; Pathname "path"], [];
+    proc_nr = Some 140;
+    deprecated_by = Some "file";
+    shortdesc = "determine file type inside a compressed file";
     longdesc = "\
-This command writes patterns over a file to make data retrieval
-more difficult.
+This command runs F<file> after first decompressing C<path>
+using C<method>.
 
-The file is I<removed> after scrubbing.
+C<method> must be one of C<gzip>, C<compress> or C<bzip2>.
 
-It is an interface to the L<scrub(1)> program.  See that
-manual page for more details." };
+Since 1.0.63, use C<guestfs_file> instead which can now
+process compressed files." };
 
   { defaults with
-    name = "scrub_freespace"; added = (1, 0, 52);
-    style = RErr, [Pathname "dir"], [];
-    proc_nr = Some 116;
-    optional = Some "scrub";
-    tests = [] (* XXX needs testing *);
-    shortdesc = "scrub (securely wipe) free space";
+    name = "getxattrs"; added = (1, 0, 59);
+    style = RStructList ("xattrs", "xattr"), [Pathname "path"], [];
+    proc_nr = Some 141;
+    optional = Some "linuxxattrs";
+    shortdesc = "list extended attributes of a file or directory";
     longdesc = "\
-This command creates the directory C<dir> and then fills it
-with files until the filesystem is full, and scrubs the files
-as for C<guestfs_scrub_file>, and deletes them.
-The intention is to scrub any free space on the partition
-containing C<dir>.
+This call lists the extended attributes of the file or directory
+C<path>.
 
-It is an interface to the L<scrub(1)> program.  See that
-manual page for more details." };
+At the system call level, this is a combination of the
+L<listxattr(2)> and L<getxattr(2)> calls.
+
+See also: C<guestfs_lgetxattrs>, L<attr(5)>." };
 
   { defaults with
-    name = "mkdtemp"; added = (1, 0, 54);
-    style = RString "dir", [Pathname "tmpl"], [];
-    proc_nr = Some 117;
-    tests = [
-      InitScratchFS, Always, TestRun (
-        [["mkdir"; "/mkdtemp"];
-         ["mkdtemp"; "/mkdtemp/tmpXXXXXX"]]), []
-    ];
-    shortdesc = "create a temporary directory";
+    name = "lgetxattrs"; added = (1, 0, 59);
+    style = RStructList ("xattrs", "xattr"), [Pathname "path"], [];
+    proc_nr = Some 142;
+    optional = Some "linuxxattrs";
+    shortdesc = "list extended attributes of a file or directory";
     longdesc = "\
-This command creates a temporary directory.  The
-C<tmpl> parameter should be a full pathname for the
-temporary directory name with the final six characters being
-\"XXXXXX\".
-
-For example: \"/tmp/myprogXXXXXX\" or \"/Temp/myprogXXXXXX\",
-the second one being suitable for Windows filesystems.
-
-The name of the temporary directory that was created
-is returned.
-
-The temporary directory is created with mode 0700
-and is owned by root.
+This is the same as C<guestfs_getxattrs>, but if C<path>
+is a symbolic link, then it returns the extended attributes
+of the link itself." };
 
-The caller is responsible for deleting the temporary
-directory and its contents after use.
+  { defaults with
+    name = "setxattr"; added = (1, 0, 59);
+    style = RErr, [String "xattr";
+                   String "val"; Int "vallen"; (* will be BufferIn *)
+                   Pathname "path"], [];
+    proc_nr = Some 143;
+    optional = Some "linuxxattrs";
+    shortdesc = "set extended attribute of a file or directory";
+    longdesc = "\
+This call sets the extended attribute named C<xattr>
+of the file C<path> to the value C<val> (of length C<vallen>).
+The value is arbitrary 8 bit data.
 
-See also: L<mkdtemp(3)>" };
+See also: C<guestfs_lsetxattr>, L<attr(5)>." };
 
   { defaults with
-    name = "wc_l"; added = (1, 0, 54);
-    style = RInt "lines", [Pathname "path"], [];
-    proc_nr = Some 118;
-    tests = [
-      InitISOFS, Always, TestResult (
-        [["wc_l"; "/10klines"]], "ret == 10000"), [];
-      (* Test for RHBZ#579608, absolute symbolic links. *)
-      InitISOFS, Always, TestResult (
-        [["wc_l"; "/abssymlink"]], "ret == 10000"), []
-    ];
-    shortdesc = "count lines in a file";
+    name = "lsetxattr"; added = (1, 0, 59);
+    style = RErr, [String "xattr";
+                   String "val"; Int "vallen"; (* will be BufferIn *)
+                   Pathname "path"], [];
+    proc_nr = Some 144;
+    optional = Some "linuxxattrs";
+    shortdesc = "set extended attribute of a file or directory";
     longdesc = "\
-This command counts the lines in a file, using the
-C<wc -l> external command." };
+This is the same as C<guestfs_setxattr>, but if C<path>
+is a symbolic link, then it sets an extended attribute
+of the link itself." };
 
   { defaults with
-    name = "wc_w"; added = (1, 0, 54);
-    style = RInt "words", [Pathname "path"], [];
-    proc_nr = Some 119;
-    tests = [
-      InitISOFS, Always, TestResult (
-        [["wc_w"; "/10klines"]], "ret == 10000"), []
-    ];
-    shortdesc = "count words in a file";
+    name = "removexattr"; added = (1, 0, 59);
+    style = RErr, [String "xattr"; Pathname "path"], [];
+    proc_nr = Some 145;
+    optional = Some "linuxxattrs";
+    shortdesc = "remove extended attribute of a file or directory";
     longdesc = "\
-This command counts the words in a file, using the
-C<wc -w> external command." };
+This call removes the extended attribute named C<xattr>
+of the file C<path>.
+
+See also: C<guestfs_lremovexattr>, L<attr(5)>." };
 
   { defaults with
-    name = "wc_c"; added = (1, 0, 54);
-    style = RInt "chars", [Pathname "path"], [];
-    proc_nr = Some 120;
-    tests = [
-      InitISOFS, Always, TestResult (
-        [["wc_c"; "/100kallspaces"]], "ret == 102400"), []
-    ];
-    shortdesc = "count characters in a file";
+    name = "lremovexattr"; added = (1, 0, 59);
+    style = RErr, [String "xattr"; Pathname "path"], [];
+    proc_nr = Some 146;
+    optional = Some "linuxxattrs";
+    shortdesc = "remove extended attribute of a file or directory";
     longdesc = "\
-This command counts the characters in a file, using the
-C<wc -c> external command." };
+This is the same as C<guestfs_removexattr>, but if C<path>
+is a symbolic link, then it removes an extended attribute
+of the link itself." };
 
   { defaults with
-    name = "head"; added = (1, 0, 54);
-    style = RStringList "lines", [Pathname "path"], [];
-    proc_nr = Some 121;
-    protocol_limit_warning = true;
-    tests = [
-      InitISOFS, Always, TestResult (
-        [["head"; "/10klines"]],
-        "is_string_list (ret, 10, \"0abcdefghijklmnopqrstuvwxyz\", \"1abcdefghijklmnopqrstuvwxyz\", \"2abcdefghijklmnopqrstuvwxyz\", \"3abcdefghijklmnopqrstuvwxyz\", \"4abcdefghijklmnopqrstuvwxyz\", \"5abcdefghijklmnopqrstuvwxyz\", \"6abcdefghijklmnopqrstuvwxyz\", \"7abcdefghijklmnopqrstuvwxyz\", \"8abcdefghijklmnopqrstuvwxyz\", \"9abcdefghijklmnopqrstuvwxyz\")"), [];
-      (* Test for RHBZ#579608, absolute symbolic links. *)
-      InitISOFS, Always, TestResult (
-        [["head"; "/abssymlink"]],
-        "is_string_list (ret, 10, \"0abcdefghijklmnopqrstuvwxyz\", \"1abcdefghijklmnopqrstuvwxyz\", \"2abcdefghijklmnopqrstuvwxyz\", \"3abcdefghijklmnopqrstuvwxyz\", \"4abcdefghijklmnopqrstuvwxyz\", \"5abcdefghijklmnopqrstuvwxyz\", \"6abcdefghijklmnopqrstuvwxyz\", \"7abcdefghijklmnopqrstuvwxyz\", \"8abcdefghijklmnopqrstuvwxyz\", \"9abcdefghijklmnopqrstuvwxyz\")"), []
-    ];
-    shortdesc = "return first 10 lines of a file";
+    name = "mountpoints"; added = (1, 0, 62);
+    style = RHashtable "mps", [], [];
+    proc_nr = Some 147;
+    shortdesc = "show mountpoints";
     longdesc = "\
-This command returns up to the first 10 lines of a file as
-a list of strings." };
+This call is similar to C<guestfs_mounts>.  That call returns
+a list of devices.  This one returns a hash table (map) of
+device name to directory where the device is mounted." };
 
   { defaults with
-    name = "head_n"; added = (1, 0, 54);
-    style = RStringList "lines", [Int "nrlines"; Pathname "path"], [];
-    proc_nr = Some 122;
-    protocol_limit_warning = true;
-    tests = [
-      InitISOFS, Always, TestResult (
-        [["head_n"; "3"; "/10klines"]],
-        "is_string_list (ret, 3, \"0abcdefghijklmnopqrstuvwxyz\", \"1abcdefghijklmnopqrstuvwxyz\", \"2abcdefghijklmnopqrstuvwxyz\")"), [];
-      InitISOFS, Always, TestResult (
-        [["head_n"; "-9997"; "/10klines"]],
-        "is_string_list (ret, 3, \"0abcdefghijklmnopqrstuvwxyz\", \"1abcdefghijklmnopqrstuvwxyz\", \"2abcdefghijklmnopqrstuvwxyz\")"), [];
-      InitISOFS, Always, TestResult (
-        [["head_n"; "0"; "/10klines"]],
-        "is_string_list (ret, 0)"), []
-    ];
-    shortdesc = "return first N lines of a file";
+    name = "mkmountpoint"; added = (1, 0, 62);
+    (* This is a special case: while you would expect a parameter
+     * of type "Pathname", that doesn't work, because it implies
+     * NEED_ROOT in the generated calling code in stubs.c, and
+     * this function cannot use NEED_ROOT.
+     *)
+    style = RErr, [String "exemptpath"], [];
+    proc_nr = Some 148;
+    shortdesc = "create a mountpoint";
     longdesc = "\
-If the parameter C<nrlines> is a positive number, this returns the first
-C<nrlines> lines of the file C<path>.
+C<guestfs_mkmountpoint> and C<guestfs_rmmountpoint> are
+specialized calls that can be used to create extra mountpoints
+before mounting the first filesystem.
+
+These calls are I<only> necessary in some very limited circumstances,
+mainly the case where you want to mount a mix of unrelated and/or
+read-only filesystems together.
+
+For example, live CDs often contain a \"Russian doll\" nest of
+filesystems, an ISO outer layer, with a squashfs image inside, with
+an ext2/3 image inside that.  You can unpack this as follows
+in guestfish:
+
+ add-ro Fedora-11-i686-Live.iso
+ run
+ mkmountpoint /cd
+ mkmountpoint /sqsh
+ mkmountpoint /ext3fs
+ mount /dev/sda /cd
+ mount-loop /cd/LiveOS/squashfs.img /sqsh
+ mount-loop /sqsh/LiveOS/ext3fs.img /ext3fs
 
-If the parameter C<nrlines> is a negative number, this returns lines
-from the file C<path>, excluding the last C<nrlines> lines.
+The inner filesystem is now unpacked under the /ext3fs mountpoint.
 
-If the parameter C<nrlines> is zero, this returns an empty list." };
+C<guestfs_mkmountpoint> is not compatible with C<guestfs_umount_all>.
+You may get unexpected errors if you try to mix these calls.  It is
+safest to manually unmount filesystems and remove mountpoints after use.
+
+C<guestfs_umount_all> unmounts filesystems by sorting the paths
+longest first, so for this to work for manual mountpoints, you
+must ensure that the innermost mountpoints have the longest
+pathnames, as in the example code above.
+
+For more details see L<https://bugzilla.redhat.com/show_bug.cgi?id=599503>
+
+Autosync [see C<guestfs_set_autosync>, this is set by default on
+handles] can cause C<guestfs_umount_all> to be called when the handle
+is closed which can also trigger these issues." };
 
   { defaults with
-    name = "tail"; added = (1, 0, 54);
-    style = RStringList "lines", [Pathname "path"], [];
-    proc_nr = Some 123;
-    protocol_limit_warning = true;
-    tests = [
-      InitISOFS, Always, TestResult (
-        [["tail"; "/10klines"]],
-        "is_string_list (ret, 10, \"9990abcdefghijklmnopqrstuvwxyz\", \"9991abcdefghijklmnopqrstuvwxyz\", \"9992abcdefghijklmnopqrstuvwxyz\", \"9993abcdefghijklmnopqrstuvwxyz\", \"9994abcdefghijklmnopqrstuvwxyz\", \"9995abcdefghijklmnopqrstuvwxyz\", \"9996abcdefghijklmnopqrstuvwxyz\", \"9997abcdefghijklmnopqrstuvwxyz\", \"9998abcdefghijklmnopqrstuvwxyz\", \"9999abcdefghijklmnopqrstuvwxyz\")"), []
-    ];
-    shortdesc = "return last 10 lines of a file";
+    name = "rmmountpoint"; added = (1, 0, 62);
+    style = RErr, [String "exemptpath"], [];
+    proc_nr = Some 149;
+    shortdesc = "remove a mountpoint";
     longdesc = "\
-This command returns up to the last 10 lines of a file as
-a list of strings." };
+This calls removes a mountpoint that was previously created
+with C<guestfs_mkmountpoint>.  See C<guestfs_mkmountpoint>
+for full details." };
 
   { defaults with
-    name = "tail_n"; added = (1, 0, 54);
-    style = RStringList "lines", [Int "nrlines"; Pathname "path"], [];
-    proc_nr = Some 124;
-    protocol_limit_warning = true;
+    name = "grep"; added = (1, 0, 66);
+    style = RStringList "lines", [String "regex"; Pathname "path"], [OBool "extended"; OBool "fixed"; OBool "insensitive"; OBool "compressed"];
+    proc_nr = Some 151;
+    protocol_limit_warning = true; once_had_no_optargs = true;
     tests = [
       InitISOFS, Always, TestResult (
-        [["tail_n"; "3"; "/10klines"]],
-        "is_string_list (ret, 3, \"9997abcdefghijklmnopqrstuvwxyz\", \"9998abcdefghijklmnopqrstuvwxyz\", \"9999abcdefghijklmnopqrstuvwxyz\")"), [];
+        [["grep"; "abc"; "/test-grep.txt"; ""; ""; ""; ""]],
+        "is_string_list (ret, 2, \"abc\", \"abc123\")"), [];
       InitISOFS, Always, TestResult (
-        [["tail_n"; "-9998"; "/10klines"]],
-        "is_string_list (ret, 3, \"9997abcdefghijklmnopqrstuvwxyz\", \"9998abcdefghijklmnopqrstuvwxyz\", \"9999abcdefghijklmnopqrstuvwxyz\")"), [];
+        [["grep"; "nomatch"; "/test-grep.txt"; ""; ""; ""; ""]],
+        "is_string_list (ret, 0)"), [];
+      (* Test for RHBZ#579608, absolute symbolic links. *)
       InitISOFS, Always, TestResult (
-        [["tail_n"; "0"; "/10klines"]],
-        "is_string_list (ret, 0)"), []
+        [["grep"; "nomatch"; "/abssymlink"; ""; ""; ""; ""]],
+        "is_string_list (ret, 0)"), [];
+      InitISOFS, Always, TestResult (
+        [["grep"; "abc"; "/test-grep.txt"; "true"; ""; ""; ""]],
+        "is_string_list (ret, 2, \"abc\", \"abc123\")"), [];
+      InitISOFS, Always, TestResult (
+        [["grep"; "abc"; "/test-grep.txt"; ""; "true"; ""; ""]],
+        "is_string_list (ret, 2, \"abc\", \"abc123\")"), [];
+      InitISOFS, Always, TestResult (
+        [["grep"; "abc"; "/test-grep.txt"; ""; ""; "true"; ""]],
+        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), [];
+      InitISOFS, Always, TestResult (
+        [["grep"; "abc"; "/test-grep.txt"; "true"; ""; "true"; ""]],
+        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), [];
+      InitISOFS, Always, TestResult (
+        [["grep"; "abc"; "/test-grep.txt"; ""; "true"; "true"; ""]],
+        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), [];
+      InitISOFS, Always, TestResult (
+        [["grep"; "abc"; "/test-grep.txt.gz"; ""; ""; ""; "true"]],
+        "is_string_list (ret, 2, \"abc\", \"abc123\")"), [];
+      InitISOFS, Always, TestResult (
+        [["grep"; "abc"; "/test-grep.txt.gz"; "true"; ""; ""; "true"]],
+        "is_string_list (ret, 2, \"abc\", \"abc123\")"), [];
+      InitISOFS, Always, TestResult (
+        [["grep"; "abc"; "/test-grep.txt.gz"; ""; "true"; ""; "true"]],
+        "is_string_list (ret, 2, \"abc\", \"abc123\")"), [];
+      InitISOFS, Always, TestResult (
+        [["grep"; "abc"; "/test-grep.txt.gz"; ""; ""; "true"; "true"]],
+        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), [];
+      InitISOFS, Always, TestResult (
+        [["grep"; "abc"; "/test-grep.txt.gz"; "true"; ""; "true"; "true"]],
+        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), [];
+      InitISOFS, Always, TestResult (
+        [["grep"; "abc"; "/test-grep.txt.gz"; ""; "true"; "true"; "true"]],
+        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), []
     ];
-    shortdesc = "return last N lines of a file";
-    longdesc = "\
-If the parameter C<nrlines> is a positive number, this returns the last
-C<nrlines> lines of the file C<path>.
-
-If the parameter C<nrlines> is a negative number, this returns lines
-from the file C<path>, starting with the C<-nrlines>th line.
-
-If the parameter C<nrlines> is zero, this returns an empty list." };
-
-  { defaults with
-    name = "df"; added = (1, 0, 54);
-    style = RString "output", [], [];
-    proc_nr = Some 125;
-    test_excuse = "tricky to test because it depends on the exact format of the 'df' command and other imponderables";
-    shortdesc = "report file system disk space usage";
+    shortdesc = "return lines matching a pattern";
     longdesc = "\
-This command runs the C<df> command to report disk space used.
-
-This command is mostly useful for interactive sessions.  It
-is I<not> intended that you try to parse the output string.
-Use C<guestfs_statvfs> from programs." };
+This calls the external C<grep> program and returns the
+matching lines.
 
-  { defaults with
-    name = "df_h"; added = (1, 0, 54);
-    style = RString "output", [], [];
-    proc_nr = Some 126;
-    test_excuse = "tricky to test because it depends on the exact format of the 'df' command and other imponderables";
-    shortdesc = "report file system disk space usage (human readable)";
-    longdesc = "\
-This command runs the C<df -h> command to report disk space used
-in human-readable format.
+The optional flags are:
 
-This command is mostly useful for interactive sessions.  It
-is I<not> intended that you try to parse the output string.
-Use C<guestfs_statvfs> from programs." };
+=over 4
 
-  { defaults with
-    name = "du"; added = (1, 0, 54);
-    style = RInt64 "sizekb", [Pathname "path"], [];
-    proc_nr = Some 127;
-    progress = true;
-    tests = [
-      InitISOFS, Always, TestResult (
-        [["du"; "/directory"]], "ret == 2" (* ISO fs blocksize is 2K *)), []
-    ];
-    shortdesc = "estimate file space usage";
-    longdesc = "\
-This command runs the C<du -s> command to estimate file space
-usage for C<path>.
+=item C<extended>
 
-C<path> can be a file or a directory.  If C<path> is a directory
-then the estimate includes the contents of the directory and all
-subdirectories (recursively).
+Use extended regular expressions.
+This is the same as using the I<-E> flag.
 
-The result is the estimated size in I<kilobytes>
-(ie. units of 1024 bytes)." };
+=item C<fixed>
 
-  { defaults with
-    name = "initrd_list"; added = (1, 0, 54);
-    style = RStringList "filenames", [Pathname "path"], [];
-    proc_nr = Some 128;
-    tests = [
-      InitISOFS, Always, TestResult (
-        [["initrd_list"; "/initrd"]],
-        "is_string_list (ret, 6, \"empty\", \"known-1\", \"known-2\", \"known-3\", \"known-4\", \"known-5\")"), []
-    ];
-    shortdesc = "list files in an initrd";
-    longdesc = "\
-This command lists out files contained in an initrd.
+Match fixed (don't use regular expressions).
+This is the same as using the I<-F> flag.
 
-The files are listed without any initial F</> character.  The
-files are listed in the order they appear (not necessarily
-alphabetical).  Directory names are listed as separate items.
+=item C<insensitive>
 
-Old Linux kernels (2.4 and earlier) used a compressed ext2
-filesystem as initrd.  We I<only> support the newer initramfs
-format (compressed cpio files)." };
+Match case-insensitive.  This is the same as using the I<-i> flag.
 
-  { defaults with
-    name = "mount_loop"; added = (1, 0, 54);
-    style = RErr, [Pathname "file"; Pathname "mountpoint"], [];
-    proc_nr = Some 129;
-    shortdesc = "mount a file using the loop device";
-    longdesc = "\
-This command lets you mount F<file> (a filesystem image
-in a file) on a mount point.  It is entirely equivalent to
-the command C<mount -o loop file mountpoint>." };
+=item C<compressed>
 
-  { defaults with
-    name = "mkswap"; added = (1, 0, 55);
-    style = RErr, [Device "device"], [OString "label"; OString "uuid"];
-    proc_nr = Some 130;
-    once_had_no_optargs = true;
-    tests = (let uuid = uuidgen () in [
-      InitEmpty, Always, TestRun (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["mkswap"; "/dev/sda1"; "NOARG"; "NOARG"]]), [];
-      InitEmpty, Always, TestRun (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["mkswap"; "/dev/sda1"; "hello"; "NOARG"]]), [];
-      InitEmpty, Always, TestResultString (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["mkswap"; "/dev/sda1"; "NOARG"; uuid];
-         ["vfs_uuid"; "/dev/sda1"]], uuid), [];
-      InitEmpty, Always, TestResultString (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["mkswap"; "/dev/sda1"; "hello"; uuid];
-         ["vfs_label"; "/dev/sda1"]], "hello"), []
-    ]);
-    shortdesc = "create a swap partition";
-    longdesc = "\
-Create a Linux swap partition on C<device>.
+Use C<zgrep> instead of C<grep>.  This allows the input to be
+compress- or gzip-compressed.
 
-The option arguments C<label> and C<uuid> allow you to set the
-label and/or UUID of the new swap partition." };
+=back" };
 
   { defaults with
-    name = "mkswap_L"; added = (1, 0, 55);
-    style = RErr, [String "label"; Device "device"], [];
-    proc_nr = Some 131;
-    deprecated_by = Some "mkswap";
+    name = "egrep"; added = (1, 0, 66);
+    style = RStringList "lines", [String "regex"; Pathname "path"], [];
+    proc_nr = Some 152;
+    protocol_limit_warning = true;
+    deprecated_by = Some "grep";
     tests = [
-      InitEmpty, Always, TestRun (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["mkswap_L"; "hello"; "/dev/sda1"]]), []
+      InitISOFS, Always, TestResult (
+        [["egrep"; "abc"; "/test-grep.txt"]],
+        "is_string_list (ret, 2, \"abc\", \"abc123\")"), []
     ];
-    shortdesc = "create a swap partition with a label";
+    shortdesc = "return lines matching a pattern";
     longdesc = "\
-Create a swap partition on C<device> with label C<label>.
-
-Note that you cannot attach a swap label to a block device
-(eg. F</dev/sda>), just to a partition.  This appears to be
-a limitation of the kernel or swap tools." };
+This calls the external C<egrep> program and returns the
+matching lines." };
 
   { defaults with
-    name = "mkswap_U"; added = (1, 0, 55);
-    style = RErr, [String "uuid"; Device "device"], [];
-    proc_nr = Some 132;
-    deprecated_by = Some "mkswap";
-    optional = Some "linuxfsuuid";
-    tests =
-      (let uuid = uuidgen () in [
-        InitEmpty, Always, TestRun (
-          [["part_disk"; "/dev/sda"; "mbr"];
-           ["mkswap_U"; uuid; "/dev/sda1"]]), []
-      ]);
-    shortdesc = "create a swap partition with an explicit UUID";
+    name = "fgrep"; added = (1, 0, 66);
+    style = RStringList "lines", [String "pattern"; Pathname "path"], [];
+    proc_nr = Some 153;
+    protocol_limit_warning = true;
+    deprecated_by = Some "grep";
+    tests = [
+      InitISOFS, Always, TestResult (
+        [["fgrep"; "abc"; "/test-grep.txt"]],
+        "is_string_list (ret, 2, \"abc\", \"abc123\")"), []
+    ];
+    shortdesc = "return lines matching a pattern";
     longdesc = "\
-Create a swap partition on C<device> with UUID C<uuid>." };
+This calls the external C<fgrep> program and returns the
+matching lines." };
 
   { defaults with
-    name = "mknod"; added = (1, 0, 55);
-    style = RErr, [Int "mode"; Int "devmajor"; Int "devminor"; Pathname "path"], [];
-    proc_nr = Some 133;
-    optional = Some "mknod";
+    name = "grepi"; added = (1, 0, 66);
+    style = RStringList "lines", [String "regex"; Pathname "path"], [];
+    proc_nr = Some 154;
+    protocol_limit_warning = true;
+    deprecated_by = Some "grep";
     tests = [
-      InitScratchFS, Always, TestResult (
-        [["mknod"; "0o10777"; "0"; "0"; "/mknod"];
-         (* NB: default umask 022 means 0777 -> 0755 in these tests *)
-         ["stat"; "/mknod"]],
-        "S_ISFIFO (ret->mode) && (ret->mode & 0777) == 0755"), [];
-      InitScratchFS, Always, TestResult (
-        [["mknod"; "0o60777"; "66"; "99"; "/mknod2"];
-         ["stat"; "/mknod2"]],
-        "S_ISBLK (ret->mode) && (ret->mode & 0777) == 0755"), []
+      InitISOFS, Always, TestResult (
+        [["grepi"; "abc"; "/test-grep.txt"]],
+        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), []
     ];
-    shortdesc = "make block, character or FIFO devices";
+    shortdesc = "return lines matching a pattern";
     longdesc = "\
-This call creates block or character special devices, or
-named pipes (FIFOs).
-
-The C<mode> parameter should be the mode, using the standard
-constants.  C<devmajor> and C<devminor> are the
-device major and minor numbers, only used when creating block
-and character special devices.
-
-Note that, just like L<mknod(2)>, the mode must be bitwise
-OR'd with S_IFBLK, S_IFCHR, S_IFIFO or S_IFSOCK (otherwise this call
-just creates a regular file).  These constants are
-available in the standard Linux header files, or you can use
-C<guestfs_mknod_b>, C<guestfs_mknod_c> or C<guestfs_mkfifo>
-which are wrappers around this command which bitwise OR
-in the appropriate constant for you.
-
-The mode actually set is affected by the umask." };
+This calls the external C<grep -i> program and returns the
+matching lines." };
 
   { defaults with
-    name = "mkfifo"; added = (1, 0, 55);
-    style = RErr, [Int "mode"; Pathname "path"], [];
-    proc_nr = Some 134;
-    optional = Some "mknod";
+    name = "egrepi"; added = (1, 0, 66);
+    style = RStringList "lines", [String "regex"; Pathname "path"], [];
+    proc_nr = Some 155;
+    protocol_limit_warning = true;
+    deprecated_by = Some "grep";
     tests = [
-      InitScratchFS, Always, TestResult (
-        [["mkfifo"; "0o777"; "/mkfifo"];
-         ["stat"; "/mkfifo"]],
-        "S_ISFIFO (ret->mode) && (ret->mode & 0777) == 0755"), [];
-      InitScratchFS, Always, TestLastFail (
-        [["mkfifo"; "0o20777"; "/mkfifo-2"]]), [];
+      InitISOFS, Always, TestResult (
+        [["egrepi"; "abc"; "/test-grep.txt"]],
+        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), []
     ];
-    shortdesc = "make FIFO (named pipe)";
+    shortdesc = "return lines matching a pattern";
     longdesc = "\
-This call creates a FIFO (named pipe) called C<path> with
-mode C<mode>.  It is just a convenient wrapper around
-C<guestfs_mknod>.
-
-Unlike with C<guestfs_mknod>, C<mode> B<must> contain only permissions
-bits.
-
-The mode actually set is affected by the umask." };
+This calls the external C<egrep -i> program and returns the
+matching lines." };
 
   { defaults with
-    name = "mknod_b"; added = (1, 0, 55);
-    style = RErr, [Int "mode"; Int "devmajor"; Int "devminor"; Pathname "path"], [];
-    proc_nr = Some 135;
-    optional = Some "mknod";
+    name = "fgrepi"; added = (1, 0, 66);
+    style = RStringList "lines", [String "pattern"; Pathname "path"], [];
+    proc_nr = Some 156;
+    protocol_limit_warning = true;
+    deprecated_by = Some "grep";
     tests = [
-      InitScratchFS, Always, TestResult (
-        [["mknod_b"; "0o777"; "99"; "66"; "/mknod_b"];
-         ["stat"; "/mknod_b"]],
-        "S_ISBLK (ret->mode) && (ret->mode & 0777) == 0755"), [];
-      InitScratchFS, Always, TestLastFail (
-        [["mknod_b"; "0o10777"; "99"; "66"; "/mknod_b-2"]]), [];
+      InitISOFS, Always, TestResult (
+        [["fgrepi"; "abc"; "/test-grep.txt"]],
+        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), []
     ];
-    shortdesc = "make block device node";
+    shortdesc = "return lines matching a pattern";
     longdesc = "\
-This call creates a block device node called C<path> with
-mode C<mode> and device major/minor C<devmajor> and C<devminor>.
-It is just a convenient wrapper around C<guestfs_mknod>.
-
-Unlike with C<guestfs_mknod>, C<mode> B<must> contain only permissions
-bits.
-
-The mode actually set is affected by the umask." };
+This calls the external C<fgrep -i> program and returns the
+matching lines." };
 
   { defaults with
-    name = "mknod_c"; added = (1, 0, 55);
-    style = RErr, [Int "mode"; Int "devmajor"; Int "devminor"; Pathname "path"], [];
-    proc_nr = Some 136;
-    optional = Some "mknod";
+    name = "zgrep"; added = (1, 0, 66);
+    style = RStringList "lines", [String "regex"; Pathname "path"], [];
+    proc_nr = Some 157;
+    protocol_limit_warning = true;
+    deprecated_by = Some "grep";
     tests = [
-      InitScratchFS, Always, TestResult (
-        [["mknod_c"; "0o777"; "99"; "66"; "/mknod_c"];
-         ["stat"; "/mknod_c"]],
-        "S_ISCHR (ret->mode) && (ret->mode & 0777) == 0755"), [];
-      InitScratchFS, Always, TestLastFail (
-        [["mknod_c"; "0o20777"; "99"; "66"; "/mknod_c-2"]]), [];
+      InitISOFS, Always, TestResult (
+        [["zgrep"; "abc"; "/test-grep.txt.gz"]],
+        "is_string_list (ret, 2, \"abc\", \"abc123\")"), []
     ];
-    shortdesc = "make char device node";
+    shortdesc = "return lines matching a pattern";
     longdesc = "\
-This call creates a char device node called C<path> with
-mode C<mode> and device major/minor C<devmajor> and C<devminor>.
-It is just a convenient wrapper around C<guestfs_mknod>.
-
-Unlike with C<guestfs_mknod>, C<mode> B<must> contain only permissions
-bits.
-
-The mode actually set is affected by the umask." };
+This calls the external C<zgrep> program and returns the
+matching lines." };
 
   { defaults with
-    name = "umask"; added = (1, 0, 55);
-    style = RInt "oldmask", [Int "mask"], [];
-    proc_nr = Some 137;
-    fish_output = Some FishOutputOctal;
+    name = "zegrep"; added = (1, 0, 66);
+    style = RStringList "lines", [String "regex"; Pathname "path"], [];
+    proc_nr = Some 158;
+    protocol_limit_warning = true;
+    deprecated_by = Some "grep";
     tests = [
-      InitEmpty, Always, TestResult (
-        [["umask"; "0o22"]], "ret == 022"), []
+      InitISOFS, Always, TestResult (
+        [["zegrep"; "abc"; "/test-grep.txt.gz"]],
+        "is_string_list (ret, 2, \"abc\", \"abc123\")"), []
     ];
-    shortdesc = "set file mode creation mask (umask)";
+    shortdesc = "return lines matching a pattern";
     longdesc = "\
-This function sets the mask used for creating new files and
-device nodes to C<mask & 0777>.
-
-Typical umask values would be C<022> which creates new files
-with permissions like \"-rw-r--r--\" or \"-rwxr-xr-x\", and
-C<002> which creates new files with permissions like
-\"-rw-rw-r--\" or \"-rwxrwxr-x\".
-
-The default umask is C<022>.  This is important because it
-means that directories and device nodes will be created with
-C<0644> or C<0755> mode even if you specify C<0777>.
-
-See also C<guestfs_get_umask>,
-L<umask(2)>, C<guestfs_mknod>, C<guestfs_mkdir>.
-
-This call returns the previous umask." };
+This calls the external C<zegrep> program and returns the
+matching lines." };
 
   { defaults with
-    name = "readdir"; added = (1, 0, 55);
-    style = RStructList ("entries", "dirent"), [Pathname "dir"], [];
-    proc_nr = Some 138;
+    name = "zfgrep"; added = (1, 0, 66);
+    style = RStringList "lines", [String "pattern"; Pathname "path"], [];
+    proc_nr = Some 159;
     protocol_limit_warning = true;
-    shortdesc = "read directories entries";
+    deprecated_by = Some "grep";
+    tests = [
+      InitISOFS, Always, TestResult (
+        [["zfgrep"; "abc"; "/test-grep.txt.gz"]],
+        "is_string_list (ret, 2, \"abc\", \"abc123\")"), []
+    ];
+    shortdesc = "return lines matching a pattern";
     longdesc = "\
-This returns the list of directory entries in directory C<dir>.
-
-All entries in the directory are returned, including C<.> and
-C<..>.  The entries are I<not> sorted, but returned in the same
-order as the underlying filesystem.
-
-Also this call returns basic file type information about each
-file.  The C<ftyp> field will contain one of the following characters:
-
-=over 4
-
-=item 'b'
-
-Block special
-
-=item 'c'
-
-Char special
-
-=item 'd'
-
-Directory
-
-=item 'f'
-
-FIFO (named pipe)
-
-=item 'l'
-
-Symbolic link
-
-=item 'r'
-
-Regular file
-
-=item 's'
-
-Socket
-
-=item 'u'
-
-Unknown file type
-
-=item '?'
-
-The L<readdir(3)> call returned a C<d_type> field with an
-unexpected value
-
-=back
-
-This function is primarily intended for use by programs.  To
-get a simple list of names, use C<guestfs_ls>.  To get a printable
-directory for human consumption, use C<guestfs_ll>." };
+This calls the external C<zfgrep> program and returns the
+matching lines." };
 
   { defaults with
-    name = "sfdiskM"; added = (1, 0, 55);
-    style = RErr, [Device "device"; StringList "lines"], [];
-    proc_nr = Some 139;
-    deprecated_by = Some "part_add";
-    shortdesc = "create partitions on a block device";
+    name = "zgrepi"; added = (1, 0, 66);
+    style = RStringList "lines", [String "regex"; Pathname "path"], [];
+    proc_nr = Some 160;
+    protocol_limit_warning = true;
+    deprecated_by = Some "grep";
+    tests = [
+      InitISOFS, Always, TestResult (
+        [["zgrepi"; "abc"; "/test-grep.txt.gz"]],
+        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), []
+    ];
+    shortdesc = "return lines matching a pattern";
     longdesc = "\
-This is a simplified interface to the C<guestfs_sfdisk>
-command, where partition sizes are specified in megabytes
-only (rounded to the nearest cylinder) and you don't need
-to specify the cyls, heads and sectors parameters which
-were rarely if ever used anyway.
-
-See also: C<guestfs_sfdisk>, the L<sfdisk(8)> manpage
-and C<guestfs_part_disk>" };
+This calls the external C<zgrep -i> program and returns the
+matching lines." };
 
   { defaults with
-    name = "zfile"; added = (1, 0, 59);
-    style = RString "description", [String "meth"; Pathname "path"], [];
-    proc_nr = Some 140;
-    deprecated_by = Some "file";
-    shortdesc = "determine file type inside a compressed file";
+    name = "zegrepi"; added = (1, 0, 66);
+    style = RStringList "lines", [String "regex"; Pathname "path"], [];
+    proc_nr = Some 161;
+    protocol_limit_warning = true;
+    deprecated_by = Some "grep";
+    tests = [
+      InitISOFS, Always, TestResult (
+        [["zegrepi"; "abc"; "/test-grep.txt.gz"]],
+        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), []
+    ];
+    shortdesc = "return lines matching a pattern";
     longdesc = "\
-This command runs F<file> after first decompressing C<path>
-using C<method>.
-
-C<method> must be one of C<gzip>, C<compress> or C<bzip2>.
-
-Since 1.0.63, use C<guestfs_file> instead which can now
-process compressed files." };
+This calls the external C<zegrep -i> program and returns the
+matching lines." };
 
   { defaults with
-    name = "getxattrs"; added = (1, 0, 59);
-    style = RStructList ("xattrs", "xattr"), [Pathname "path"], [];
-    proc_nr = Some 141;
-    optional = Some "linuxxattrs";
-    shortdesc = "list extended attributes of a file or directory";
+    name = "zfgrepi"; added = (1, 0, 66);
+    style = RStringList "lines", [String "pattern"; Pathname "path"], [];
+    proc_nr = Some 162;
+    protocol_limit_warning = true;
+    deprecated_by = Some "grep";
+    tests = [
+      InitISOFS, Always, TestResult (
+        [["zfgrepi"; "abc"; "/test-grep.txt.gz"]],
+        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), []
+    ];
+    shortdesc = "return lines matching a pattern";
     longdesc = "\
-This call lists the extended attributes of the file or directory
-C<path>.
-
-At the system call level, this is a combination of the
-L<listxattr(2)> and L<getxattr(2)> calls.
-
-See also: C<guestfs_lgetxattrs>, L<attr(5)>." };
+This calls the external C<zfgrep -i> program and returns the
+matching lines." };
 
   { defaults with
-    name = "lgetxattrs"; added = (1, 0, 59);
-    style = RStructList ("xattrs", "xattr"), [Pathname "path"], [];
-    proc_nr = Some 142;
-    optional = Some "linuxxattrs";
-    shortdesc = "list extended attributes of a file or directory";
+    name = "realpath"; added = (1, 0, 66);
+    style = RString "rpath", [Pathname "path"], [];
+    proc_nr = Some 163;
+    tests = [
+      InitISOFS, Always, TestResultString (
+        [["realpath"; "/../directory"]], "/directory"), []
+    ];
+    shortdesc = "canonicalized absolute pathname";
     longdesc = "\
-This is the same as C<guestfs_getxattrs>, but if C<path>
-is a symbolic link, then it returns the extended attributes
-of the link itself." };
+Return the canonicalized absolute pathname of C<path>.  The
+returned path has no C<.>, C<..> or symbolic link path elements." };
 
   { defaults with
-    name = "setxattr"; added = (1, 0, 59);
-    style = RErr, [String "xattr";
-                   String "val"; Int "vallen"; (* will be BufferIn *)
-                   Pathname "path"], [];
-    proc_nr = Some 143;
-    optional = Some "linuxxattrs";
-    shortdesc = "set extended attribute of a file or directory";
+    name = "ln"; added = (1, 0, 66);
+    style = RErr, [String "target"; Pathname "linkname"], [];
+    proc_nr = Some 164;
+    tests = [
+      InitScratchFS, Always, TestResult (
+        [["mkdir"; "/ln"];
+         ["touch"; "/ln/a"];
+         ["ln"; "/ln/a"; "/ln/b"];
+         ["stat"; "/ln/b"]], "ret->nlink == 2"), []
+    ];
+    shortdesc = "create a hard link";
     longdesc = "\
-This call sets the extended attribute named C<xattr>
-of the file C<path> to the value C<val> (of length C<vallen>).
-The value is arbitrary 8 bit data.
-
-See also: C<guestfs_lsetxattr>, L<attr(5)>." };
+This command creates a hard link using the C<ln> command." };
 
   { defaults with
-    name = "lsetxattr"; added = (1, 0, 59);
-    style = RErr, [String "xattr";
-                   String "val"; Int "vallen"; (* will be BufferIn *)
-                   Pathname "path"], [];
-    proc_nr = Some 144;
-    optional = Some "linuxxattrs";
-    shortdesc = "set extended attribute of a file or directory";
+    name = "ln_f"; added = (1, 0, 66);
+    style = RErr, [String "target"; Pathname "linkname"], [];
+    proc_nr = Some 165;
+    tests = [
+      InitScratchFS, Always, TestResult (
+        [["mkdir"; "/ln_f"];
+         ["touch"; "/ln_f/a"];
+         ["touch"; "/ln_f/b"];
+         ["ln_f"; "/ln_f/a"; "/ln_f/b"];
+         ["stat"; "/ln_f/b"]], "ret->nlink == 2"), []
+    ];
+    shortdesc = "create a hard link";
     longdesc = "\
-This is the same as C<guestfs_setxattr>, but if C<path>
-is a symbolic link, then it sets an extended attribute
-of the link itself." };
+This command creates a hard link using the C<ln -f> command.
+The I<-f> option removes the link (C<linkname>) if it exists already." };
 
   { defaults with
-    name = "removexattr"; added = (1, 0, 59);
-    style = RErr, [String "xattr"; Pathname "path"], [];
-    proc_nr = Some 145;
-    optional = Some "linuxxattrs";
-    shortdesc = "remove extended attribute of a file or directory";
+    name = "ln_s"; added = (1, 0, 66);
+    style = RErr, [String "target"; Pathname "linkname"], [];
+    proc_nr = Some 166;
+    tests = [
+      InitScratchFS, Always, TestResult (
+        [["mkdir"; "/ln_s"];
+         ["touch"; "/ln_s/a"];
+         ["ln_s"; "a"; "/ln_s/b"];
+         ["lstat"; "/ln_s/b"]],
+        "S_ISLNK (ret->mode) && (ret->mode & 0777) == 0777"), []
+    ];
+    shortdesc = "create a symbolic link";
     longdesc = "\
-This call removes the extended attribute named C<xattr>
-of the file C<path>.
-
-See also: C<guestfs_lremovexattr>, L<attr(5)>." };
+This command creates a symbolic link using the C<ln -s> command." };
 
   { defaults with
-    name = "lremovexattr"; added = (1, 0, 59);
-    style = RErr, [String "xattr"; Pathname "path"], [];
-    proc_nr = Some 146;
-    optional = Some "linuxxattrs";
-    shortdesc = "remove extended attribute of a file or directory";
+    name = "ln_sf"; added = (1, 0, 66);
+    style = RErr, [String "target"; Pathname "linkname"], [];
+    proc_nr = Some 167;
+    tests = [
+      InitScratchFS, Always, TestResultString (
+        [["mkdir_p"; "/ln_sf/b"];
+         ["touch"; "/ln_sf/b/c"];
+         ["ln_sf"; "../d"; "/ln_sf/b/c"];
+         ["readlink"; "/ln_sf/b/c"]], "../d"), []
+    ];
+    shortdesc = "create a symbolic link";
     longdesc = "\
-This is the same as C<guestfs_removexattr>, but if C<path>
-is a symbolic link, then it removes an extended attribute
-of the link itself." };
+This command creates a symbolic link using the C<ln -sf> command,
+The I<-f> option removes the link (C<linkname>) if it exists already." };
 
   { defaults with
-    name = "mountpoints"; added = (1, 0, 62);
-    style = RHashtable "mps", [], [];
-    proc_nr = Some 147;
-    shortdesc = "show mountpoints";
+    name = "readlink"; added = (1, 0, 66);
+    style = RString "link", [Pathname "path"], [];
+    proc_nr = Some 168;
+    shortdesc = "read the target of a symbolic link";
     longdesc = "\
-This call is similar to C<guestfs_mounts>.  That call returns
-a list of devices.  This one returns a hash table (map) of
-device name to directory where the device is mounted." };
+This command reads the target of a symbolic link." };
 
   { defaults with
-    name = "mkmountpoint"; added = (1, 0, 62);
-    (* This is a special case: while you would expect a parameter
-     * of type "Pathname", that doesn't work, because it implies
-     * NEED_ROOT in the generated calling code in stubs.c, and
-     * this function cannot use NEED_ROOT.
-     *)
-    style = RErr, [String "exemptpath"], [];
-    proc_nr = Some 148;
-    shortdesc = "create a mountpoint";
+    name = "fallocate"; added = (1, 0, 66);
+    style = RErr, [Pathname "path"; Int "len"], [];
+    proc_nr = Some 169;
+    deprecated_by = Some "fallocate64";
+    tests = [
+      InitScratchFS, Always, TestResult (
+        [["fallocate"; "/fallocate"; "1000000"];
+         ["stat"; "/fallocate"]], "ret->size == 1000000"), []
+    ];
+    shortdesc = "preallocate a file in the guest filesystem";
     longdesc = "\
-C<guestfs_mkmountpoint> and C<guestfs_rmmountpoint> are
-specialized calls that can be used to create extra mountpoints
-before mounting the first filesystem.
-
-These calls are I<only> necessary in some very limited circumstances,
-mainly the case where you want to mount a mix of unrelated and/or
-read-only filesystems together.
-
-For example, live CDs often contain a \"Russian doll\" nest of
-filesystems, an ISO outer layer, with a squashfs image inside, with
-an ext2/3 image inside that.  You can unpack this as follows
-in guestfish:
-
- add-ro Fedora-11-i686-Live.iso
- run
- mkmountpoint /cd
- mkmountpoint /sqsh
- mkmountpoint /ext3fs
- mount /dev/sda /cd
- mount-loop /cd/LiveOS/squashfs.img /sqsh
- mount-loop /sqsh/LiveOS/ext3fs.img /ext3fs
+This command preallocates a file (containing zero bytes) named
+C<path> of size C<len> bytes.  If the file exists already, it
+is overwritten.
 
-The inner filesystem is now unpacked under the /ext3fs mountpoint.
+Do not confuse this with the guestfish-specific
+C<alloc> command which allocates a file in the host and
+attaches it as a device." };
 
-C<guestfs_mkmountpoint> is not compatible with C<guestfs_umount_all>.
-You may get unexpected errors if you try to mix these calls.  It is
-safest to manually unmount filesystems and remove mountpoints after use.
+  { defaults with
+    name = "swapon_device"; added = (1, 0, 66);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 170;
+    tests = [
+      InitPartition, Always, TestRun (
+        [["mkswap"; "/dev/sda1"; "NOARG"; "NOARG"];
+         ["swapon_device"; "/dev/sda1"];
+         ["swapoff_device"; "/dev/sda1"]]), []
+    ];
+    shortdesc = "enable swap on device";
+    longdesc = "\
+This command enables the libguestfs appliance to use the
+swap device or partition named C<device>.  The increased
+memory is made available for all commands, for example
+those run using C<guestfs_command> or C<guestfs_sh>.
 
-C<guestfs_umount_all> unmounts filesystems by sorting the paths
-longest first, so for this to work for manual mountpoints, you
-must ensure that the innermost mountpoints have the longest
-pathnames, as in the example code above.
+Note that you should not swap to existing guest swap
+partitions unless you know what you are doing.  They may
+contain hibernation information, or other information that
+the guest doesn't want you to trash.  You also risk leaking
+information about the host to the guest this way.  Instead,
+attach a new host device to the guest and swap on that." };
 
-For more details see L<https://bugzilla.redhat.com/show_bug.cgi?id=599503>
+  { defaults with
+    name = "swapoff_device"; added = (1, 0, 66);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 171;
+    shortdesc = "disable swap on device";
+    longdesc = "\
+This command disables the libguestfs appliance swap
+device or partition named C<device>.
+See C<guestfs_swapon_device>." };
 
-Autosync [see C<guestfs_set_autosync>, this is set by default on
-handles] can cause C<guestfs_umount_all> to be called when the handle
-is closed which can also trigger these issues." };
+  { defaults with
+    name = "swapon_file"; added = (1, 0, 66);
+    style = RErr, [Pathname "file"], [];
+    proc_nr = Some 172;
+    tests = [
+      InitScratchFS, Always, TestRun (
+        [["fallocate"; "/swapon_file"; "8388608"];
+         ["mkswap_file"; "/swapon_file"];
+         ["swapon_file"; "/swapon_file"];
+         ["swapoff_file"; "/swapon_file"];
+         ["rm"; "/swapon_file"]]), []
+    ];
+    shortdesc = "enable swap on file";
+    longdesc = "\
+This command enables swap to a file.
+See C<guestfs_swapon_device> for other notes." };
 
   { defaults with
-    name = "rmmountpoint"; added = (1, 0, 62);
-    style = RErr, [String "exemptpath"], [];
-    proc_nr = Some 149;
-    shortdesc = "remove a mountpoint";
+    name = "swapoff_file"; added = (1, 0, 66);
+    style = RErr, [Pathname "file"], [];
+    proc_nr = Some 173;
+    shortdesc = "disable swap on file";
     longdesc = "\
-This calls removes a mountpoint that was previously created
-with C<guestfs_mkmountpoint>.  See C<guestfs_mkmountpoint>
-for full details." };
+This command disables the libguestfs appliance swap on file." };
 
   { defaults with
-    name = "grep"; added = (1, 0, 66);
-    style = RStringList "lines", [String "regex"; Pathname "path"], [OBool "extended"; OBool "fixed"; OBool "insensitive"; OBool "compressed"];
-    proc_nr = Some 151;
-    protocol_limit_warning = true; once_had_no_optargs = true;
+    name = "swapon_label"; added = (1, 0, 66);
+    style = RErr, [String "label"], [];
+    proc_nr = Some 174;
     tests = [
-      InitISOFS, Always, TestResult (
-        [["grep"; "abc"; "/test-grep.txt"; ""; ""; ""; ""]],
-        "is_string_list (ret, 2, \"abc\", \"abc123\")"), [];
-      InitISOFS, Always, TestResult (
-        [["grep"; "nomatch"; "/test-grep.txt"; ""; ""; ""; ""]],
-        "is_string_list (ret, 0)"), [];
-      (* Test for RHBZ#579608, absolute symbolic links. *)
-      InitISOFS, Always, TestResult (
-        [["grep"; "nomatch"; "/abssymlink"; ""; ""; ""; ""]],
-        "is_string_list (ret, 0)"), [];
-      InitISOFS, Always, TestResult (
-        [["grep"; "abc"; "/test-grep.txt"; "true"; ""; ""; ""]],
-        "is_string_list (ret, 2, \"abc\", \"abc123\")"), [];
-      InitISOFS, Always, TestResult (
-        [["grep"; "abc"; "/test-grep.txt"; ""; "true"; ""; ""]],
-        "is_string_list (ret, 2, \"abc\", \"abc123\")"), [];
-      InitISOFS, Always, TestResult (
-        [["grep"; "abc"; "/test-grep.txt"; ""; ""; "true"; ""]],
-        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), [];
-      InitISOFS, Always, TestResult (
-        [["grep"; "abc"; "/test-grep.txt"; "true"; ""; "true"; ""]],
-        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), [];
-      InitISOFS, Always, TestResult (
-        [["grep"; "abc"; "/test-grep.txt"; ""; "true"; "true"; ""]],
-        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), [];
-      InitISOFS, Always, TestResult (
-        [["grep"; "abc"; "/test-grep.txt.gz"; ""; ""; ""; "true"]],
-        "is_string_list (ret, 2, \"abc\", \"abc123\")"), [];
-      InitISOFS, Always, TestResult (
-        [["grep"; "abc"; "/test-grep.txt.gz"; "true"; ""; ""; "true"]],
-        "is_string_list (ret, 2, \"abc\", \"abc123\")"), [];
-      InitISOFS, Always, TestResult (
-        [["grep"; "abc"; "/test-grep.txt.gz"; ""; "true"; ""; "true"]],
-        "is_string_list (ret, 2, \"abc\", \"abc123\")"), [];
-      InitISOFS, Always, TestResult (
-        [["grep"; "abc"; "/test-grep.txt.gz"; ""; ""; "true"; "true"]],
-        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), [];
-      InitISOFS, Always, TestResult (
-        [["grep"; "abc"; "/test-grep.txt.gz"; "true"; ""; "true"; "true"]],
-        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), [];
-      InitISOFS, Always, TestResult (
-        [["grep"; "abc"; "/test-grep.txt.gz"; ""; "true"; "true"; "true"]],
-        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), []
+      InitEmpty, Always, TestRun (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["mkswap"; "/dev/sda1"; "swapit"; "NOARG"];
+         ["swapon_label"; "swapit"];
+         ["swapoff_label"; "swapit"];
+         ["zero"; "/dev/sda"];
+         ["blockdev_rereadpt"; "/dev/sda"]]), []
     ];
-    shortdesc = "return lines matching a pattern";
+    shortdesc = "enable swap on labeled swap partition";
     longdesc = "\
-This calls the external C<grep> program and returns the
-matching lines.
+This command enables swap to a labeled swap partition.
+See C<guestfs_swapon_device> for other notes." };
 
-The optional flags are:
+  { defaults with
+    name = "swapoff_label"; added = (1, 0, 66);
+    style = RErr, [String "label"], [];
+    proc_nr = Some 175;
+    shortdesc = "disable swap on labeled swap partition";
+    longdesc = "\
+This command disables the libguestfs appliance swap on
+labeled swap partition." };
 
-=over 4
+  { defaults with
+    name = "swapon_uuid"; added = (1, 0, 66);
+    style = RErr, [String "uuid"], [];
+    proc_nr = Some 176;
+    optional = Some "linuxfsuuid";
+    tests =
+      (let uuid = uuidgen () in [
+        InitEmpty, Always, TestRun (
+          [["mkswap"; "/dev/sdc"; "NOARG"; uuid];
+           ["swapon_uuid"; uuid];
+           ["swapoff_uuid"; uuid]]), []
+      ]);
+    shortdesc = "enable swap on swap partition by UUID";
+    longdesc = "\
+This command enables swap to a swap partition with the given UUID.
+See C<guestfs_swapon_device> for other notes." };
 
-=item C<extended>
+  { defaults with
+    name = "swapoff_uuid"; added = (1, 0, 66);
+    style = RErr, [String "uuid"], [];
+    proc_nr = Some 177;
+    optional = Some "linuxfsuuid";
+    shortdesc = "disable swap on swap partition by UUID";
+    longdesc = "\
+This command disables the libguestfs appliance swap partition
+with the given UUID." };
 
-Use extended regular expressions.
-This is the same as using the I<-E> flag.
+  { defaults with
+    name = "mkswap_file"; added = (1, 0, 66);
+    style = RErr, [Pathname "path"], [];
+    proc_nr = Some 178;
+    tests = [
+      InitScratchFS, Always, TestRun (
+        [["fallocate"; "/mkswap_file"; "8388608"];
+         ["mkswap_file"; "/mkswap_file"];
+         ["rm"; "/mkswap_file"]]), []
+    ];
+    shortdesc = "create a swap file";
+    longdesc = "\
+Create a swap file.
 
-=item C<fixed>
+This command just writes a swap file signature to an existing
+file.  To create the file itself, use something like C<guestfs_fallocate>." };
 
-Match fixed (don't use regular expressions).
-This is the same as using the I<-F> flag.
+  { defaults with
+    name = "inotify_init"; added = (1, 0, 66);
+    style = RErr, [Int "maxevents"], [];
+    proc_nr = Some 179;
+    optional = Some "inotify";
+    tests = [
+      InitISOFS, Always, TestRun (
+        [["inotify_init"; "0"]]), []
+    ];
+    shortdesc = "create an inotify handle";
+    longdesc = "\
+This command creates a new inotify handle.
+The inotify subsystem can be used to notify events which happen to
+objects in the guest filesystem.
 
-=item C<insensitive>
+C<maxevents> is the maximum number of events which will be
+queued up between calls to C<guestfs_inotify_read> or
+C<guestfs_inotify_files>.
+If this is passed as C<0>, then the kernel (or previously set)
+default is used.  For Linux 2.6.29 the default was 16384 events.
+Beyond this limit, the kernel throws away events, but records
+the fact that it threw them away by setting a flag
+C<IN_Q_OVERFLOW> in the returned structure list (see
+C<guestfs_inotify_read>).
 
-Match case-insensitive.  This is the same as using the I<-i> flag.
+Before any events are generated, you have to add some
+watches to the internal watch list.  See: C<guestfs_inotify_add_watch> and
+C<guestfs_inotify_rm_watch>.
 
-=item C<compressed>
+Queued up events should be read periodically by calling
+C<guestfs_inotify_read>
+(or C<guestfs_inotify_files> which is just a helpful
+wrapper around C<guestfs_inotify_read>).  If you don't
+read the events out often enough then you risk the internal
+queue overflowing.
 
-Use C<zgrep> instead of C<grep>.  This allows the input to be
-compress- or gzip-compressed.
+The handle should be closed after use by calling
+C<guestfs_inotify_close>.  This also removes any
+watches automatically.
 
-=back" };
+See also L<inotify(7)> for an overview of the inotify interface
+as exposed by the Linux kernel, which is roughly what we expose
+via libguestfs.  Note that there is one global inotify handle
+per libguestfs instance." };
 
   { defaults with
-    name = "egrep"; added = (1, 0, 66);
-    style = RStringList "lines", [String "regex"; Pathname "path"], [];
-    proc_nr = Some 152;
-    protocol_limit_warning = true;
-    deprecated_by = Some "grep";
+    name = "inotify_add_watch"; added = (1, 0, 66);
+    style = RInt64 "wd", [Pathname "path"; Int "mask"], [];
+    proc_nr = Some 180;
+    optional = Some "inotify";
     tests = [
-      InitISOFS, Always, TestResult (
-        [["egrep"; "abc"; "/test-grep.txt"]],
-        "is_string_list (ret, 2, \"abc\", \"abc123\")"), []
+      InitScratchFS, Always, TestResult (
+        [["mkdir"; "/inotify_add_watch"];
+         ["inotify_init"; "0"];
+         ["inotify_add_watch"; "/inotify_add_watch"; "4095"];
+         ["touch"; "/inotify_add_watch/a"];
+         ["touch"; "/inotify_add_watch/b"];
+         ["inotify_files"]],
+        "is_string_list (ret, 2, \"a\", \"b\")"), []
     ];
-    shortdesc = "return lines matching a pattern";
+    shortdesc = "add an inotify watch";
     longdesc = "\
-This calls the external C<egrep> program and returns the
-matching lines." };
+Watch C<path> for the events listed in C<mask>.
+
+Note that if C<path> is a directory then events within that
+directory are watched, but this does I<not> happen recursively
+(in subdirectories).
+
+Note for non-C or non-Linux callers: the inotify events are
+defined by the Linux kernel ABI and are listed in
+F</usr/include/sys/inotify.h>." };
 
   { defaults with
-    name = "fgrep"; added = (1, 0, 66);
-    style = RStringList "lines", [String "pattern"; Pathname "path"], [];
-    proc_nr = Some 153;
-    protocol_limit_warning = true;
-    deprecated_by = Some "grep";
-    tests = [
-      InitISOFS, Always, TestResult (
-        [["fgrep"; "abc"; "/test-grep.txt"]],
-        "is_string_list (ret, 2, \"abc\", \"abc123\")"), []
-    ];
-    shortdesc = "return lines matching a pattern";
+    name = "inotify_rm_watch"; added = (1, 0, 66);
+    style = RErr, [Int(*XXX64*) "wd"], [];
+    proc_nr = Some 181;
+    optional = Some "inotify";
+    shortdesc = "remove an inotify watch";
     longdesc = "\
-This calls the external C<fgrep> program and returns the
-matching lines." };
+Remove a previously defined inotify watch.
+See C<guestfs_inotify_add_watch>." };
 
   { defaults with
-    name = "grepi"; added = (1, 0, 66);
-    style = RStringList "lines", [String "regex"; Pathname "path"], [];
-    proc_nr = Some 154;
-    protocol_limit_warning = true;
-    deprecated_by = Some "grep";
-    tests = [
-      InitISOFS, Always, TestResult (
-        [["grepi"; "abc"; "/test-grep.txt"]],
-        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), []
-    ];
-    shortdesc = "return lines matching a pattern";
+    name = "inotify_read"; added = (1, 0, 66);
+    style = RStructList ("events", "inotify_event"), [], [];
+    proc_nr = Some 182;
+    optional = Some "inotify";
+    shortdesc = "return list of inotify events";
     longdesc = "\
-This calls the external C<grep -i> program and returns the
-matching lines." };
+Return the complete queue of events that have happened
+since the previous read call.
+
+If no events have happened, this returns an empty list.
+
+I<Note>: In order to make sure that all events have been
+read, you must call this function repeatedly until it
+returns an empty list.  The reason is that the call will
+read events up to the maximum appliance-to-host message
+size and leave remaining events in the queue." };
 
   { defaults with
-    name = "egrepi"; added = (1, 0, 66);
-    style = RStringList "lines", [String "regex"; Pathname "path"], [];
-    proc_nr = Some 155;
-    protocol_limit_warning = true;
-    deprecated_by = Some "grep";
-    tests = [
-      InitISOFS, Always, TestResult (
-        [["egrepi"; "abc"; "/test-grep.txt"]],
-        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), []
-    ];
-    shortdesc = "return lines matching a pattern";
+    name = "inotify_files"; added = (1, 0, 66);
+    style = RStringList "paths", [], [];
+    proc_nr = Some 183;
+    optional = Some "inotify";
+    shortdesc = "return list of watched files that had events";
     longdesc = "\
-This calls the external C<egrep -i> program and returns the
-matching lines." };
+This function is a helpful wrapper around C<guestfs_inotify_read>
+which just returns a list of pathnames of objects that were
+touched.  The returned pathnames are sorted and deduplicated." };
 
   { defaults with
-    name = "fgrepi"; added = (1, 0, 66);
-    style = RStringList "lines", [String "pattern"; Pathname "path"], [];
-    proc_nr = Some 156;
-    protocol_limit_warning = true;
-    deprecated_by = Some "grep";
-    tests = [
-      InitISOFS, Always, TestResult (
-        [["fgrepi"; "abc"; "/test-grep.txt"]],
-        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), []
-    ];
-    shortdesc = "return lines matching a pattern";
+    name = "inotify_close"; added = (1, 0, 66);
+    style = RErr, [], [];
+    proc_nr = Some 184;
+    optional = Some "inotify";
+    shortdesc = "close the inotify handle";
     longdesc = "\
-This calls the external C<fgrep -i> program and returns the
-matching lines." };
+This closes the inotify handle which was previously
+opened by inotify_init.  It removes all watches, throws
+away any pending events, and deallocates all resources." };
 
   { defaults with
-    name = "zgrep"; added = (1, 0, 66);
-    style = RStringList "lines", [String "regex"; Pathname "path"], [];
-    proc_nr = Some 157;
-    protocol_limit_warning = true;
-    deprecated_by = Some "grep";
-    tests = [
-      InitISOFS, Always, TestResult (
-        [["zgrep"; "abc"; "/test-grep.txt.gz"]],
-        "is_string_list (ret, 2, \"abc\", \"abc123\")"), []
-    ];
-    shortdesc = "return lines matching a pattern";
+    name = "setcon"; added = (1, 0, 67);
+    style = RErr, [String "context"], [];
+    proc_nr = Some 185;
+    optional = Some "selinux";
+    deprecated_by = Some "selinux_relabel";
+    shortdesc = "set SELinux security context";
     longdesc = "\
-This calls the external C<zgrep> program and returns the
-matching lines." };
+This sets the SELinux security context of the daemon
+to the string C<context>.
+
+See the documentation about SELINUX in L<guestfs(3)>." };
 
   { defaults with
-    name = "zegrep"; added = (1, 0, 66);
-    style = RStringList "lines", [String "regex"; Pathname "path"], [];
-    proc_nr = Some 158;
-    protocol_limit_warning = true;
-    deprecated_by = Some "grep";
-    tests = [
-      InitISOFS, Always, TestResult (
-        [["zegrep"; "abc"; "/test-grep.txt.gz"]],
-        "is_string_list (ret, 2, \"abc\", \"abc123\")"), []
-    ];
-    shortdesc = "return lines matching a pattern";
+    name = "getcon"; added = (1, 0, 67);
+    style = RString "context", [], [];
+    proc_nr = Some 186;
+    optional = Some "selinux";
+    deprecated_by = Some "selinux_relabel";
+    shortdesc = "get SELinux security context";
     longdesc = "\
-This calls the external C<zegrep> program and returns the
-matching lines." };
+This gets the SELinux security context of the daemon.
+
+See the documentation about SELINUX in L<guestfs(3)>,
+and C<guestfs_setcon>" };
 
   { defaults with
-    name = "zfgrep"; added = (1, 0, 66);
-    style = RStringList "lines", [String "pattern"; Pathname "path"], [];
-    proc_nr = Some 159;
-    protocol_limit_warning = true;
-    deprecated_by = Some "grep";
+    name = "mkfs_b"; added = (1, 0, 68);
+    style = RErr, [String "fstype"; Int "blocksize"; Device "device"], [];
+    proc_nr = Some 187;
+    deprecated_by = Some "mkfs";
     tests = [
-      InitISOFS, Always, TestResult (
-        [["zfgrep"; "abc"; "/test-grep.txt.gz"]],
-        "is_string_list (ret, 2, \"abc\", \"abc123\")"), []
+      InitEmpty, Always, TestResultString (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["mkfs_b"; "ext2"; "4096"; "/dev/sda1"];
+         ["mount"; "/dev/sda1"; "/"];
+         ["write"; "/new"; "new file contents"];
+         ["cat"; "/new"]], "new file contents"), [];
+      InitEmpty, Always, TestRun (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
+         ["mkfs_b"; "vfat"; "32768"; "/dev/sda1"]]), [];
+      InitEmpty, Always, TestLastFail (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
+         ["mkfs_b"; "vfat"; "32769"; "/dev/sda1"]]), [];
+      InitEmpty, Always, TestLastFail (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
+         ["mkfs_b"; "vfat"; "33280"; "/dev/sda1"]]), [];
+      InitEmpty, IfAvailable "ntfsprogs", TestRun (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["mkfs_b"; "ntfs"; "32768"; "/dev/sda1"]]), []
     ];
-    shortdesc = "return lines matching a pattern";
+    shortdesc = "make a filesystem with block size";
     longdesc = "\
-This calls the external C<zfgrep> program and returns the
-matching lines." };
+This call is similar to C<guestfs_mkfs>, but it allows you to
+control the block size of the resulting filesystem.  Supported
+block sizes depend on the filesystem type, but typically they
+are C<1024>, C<2048> or C<4096> only.
+
+For VFAT and NTFS the C<blocksize> parameter is treated as
+the requested cluster size." };
 
   { defaults with
-    name = "zgrepi"; added = (1, 0, 66);
-    style = RStringList "lines", [String "regex"; Pathname "path"], [];
-    proc_nr = Some 160;
-    protocol_limit_warning = true;
-    deprecated_by = Some "grep";
+    name = "mke2journal"; added = (1, 0, 68);
+    style = RErr, [Int "blocksize"; Device "device"], [];
+    proc_nr = Some 188;
+    deprecated_by = Some "mke2fs";
     tests = [
-      InitISOFS, Always, TestResult (
-        [["zgrepi"; "abc"; "/test-grep.txt.gz"]],
-        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), []
+      InitEmpty, Always, TestResultString (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
+         ["part_add"; "/dev/sda"; "p"; "204800"; "-64"];
+         ["mke2journal"; "4096"; "/dev/sda1"];
+         ["mke2fs_J"; "ext2"; "4096"; "/dev/sda2"; "/dev/sda1"];
+         ["mount"; "/dev/sda2"; "/"];
+         ["write"; "/new"; "new file contents"];
+         ["cat"; "/new"]], "new file contents"), []
     ];
-    shortdesc = "return lines matching a pattern";
+    shortdesc = "make ext2/3/4 external journal";
     longdesc = "\
-This calls the external C<zgrep -i> program and returns the
-matching lines." };
+This creates an ext2 external journal on C<device>.  It is equivalent
+to the command:
+
+ mke2fs -O journal_dev -b blocksize device" };
 
   { defaults with
-    name = "zegrepi"; added = (1, 0, 66);
-    style = RStringList "lines", [String "regex"; Pathname "path"], [];
-    proc_nr = Some 161;
-    protocol_limit_warning = true;
-    deprecated_by = Some "grep";
+    name = "mke2journal_L"; added = (1, 0, 68);
+    style = RErr, [Int "blocksize"; String "label"; Device "device"], [];
+    proc_nr = Some 189;
+    deprecated_by = Some "mke2fs";
     tests = [
-      InitISOFS, Always, TestResult (
-        [["zegrepi"; "abc"; "/test-grep.txt.gz"]],
-        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), []
+      InitEmpty, Always, TestResultString (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
+         ["part_add"; "/dev/sda"; "p"; "204800"; "-64"];
+         ["mke2journal_L"; "4096"; "JOURNAL"; "/dev/sda1"];
+         ["mke2fs_JL"; "ext2"; "4096"; "/dev/sda2"; "JOURNAL"];
+         ["mount"; "/dev/sda2"; "/"];
+         ["write"; "/new"; "new file contents"];
+         ["cat"; "/new"]], "new file contents"), []
     ];
-    shortdesc = "return lines matching a pattern";
+    shortdesc = "make ext2/3/4 external journal with label";
     longdesc = "\
-This calls the external C<zegrep -i> program and returns the
-matching lines." };
+This creates an ext2 external journal on C<device> with label C<label>." };
 
   { defaults with
-    name = "zfgrepi"; added = (1, 0, 66);
-    style = RStringList "lines", [String "pattern"; Pathname "path"], [];
-    proc_nr = Some 162;
-    protocol_limit_warning = true;
-    deprecated_by = Some "grep";
-    tests = [
-      InitISOFS, Always, TestResult (
-        [["zfgrepi"; "abc"; "/test-grep.txt.gz"]],
-        "is_string_list (ret, 3, \"abc\", \"abc123\", \"ABC\")"), []
-    ];
-    shortdesc = "return lines matching a pattern";
+    name = "mke2journal_U"; added = (1, 0, 68);
+    style = RErr, [Int "blocksize"; String "uuid"; Device "device"], [];
+    proc_nr = Some 190;
+    deprecated_by = Some "mke2fs";
+    optional = Some "linuxfsuuid";
+    tests =
+      (let uuid = uuidgen () in [
+        InitEmpty, Always, TestResultString (
+          [["part_init"; "/dev/sda"; "mbr"];
+           ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
+           ["part_add"; "/dev/sda"; "p"; "204800"; "-64"];
+           ["mke2journal_U"; "4096"; uuid; "/dev/sda1"];
+           ["mke2fs_JU"; "ext2"; "4096"; "/dev/sda2"; uuid];
+           ["mount"; "/dev/sda2"; "/"];
+           ["write"; "/new"; "new file contents"];
+           ["cat"; "/new"]], "new file contents"), []
+      ]);
+    shortdesc = "make ext2/3/4 external journal with UUID";
+    longdesc = "\
+This creates an ext2 external journal on C<device> with UUID C<uuid>." };
+
+  { defaults with
+    name = "mke2fs_J"; added = (1, 0, 68);
+    style = RErr, [String "fstype"; Int "blocksize"; Device "device"; Device "journal"], [];
+    proc_nr = Some 191;
+    deprecated_by = Some "mke2fs";
+    shortdesc = "make ext2/3/4 filesystem with external journal";
     longdesc = "\
-This calls the external C<zfgrep -i> program and returns the
-matching lines." };
+This creates an ext2/3/4 filesystem on C<device> with
+an external journal on C<journal>.  It is equivalent
+to the command:
 
-  { defaults with
-    name = "realpath"; added = (1, 0, 66);
-    style = RString "rpath", [Pathname "path"], [];
-    proc_nr = Some 163;
-    tests = [
-      InitISOFS, Always, TestResultString (
-        [["realpath"; "/../directory"]], "/directory"), []
-    ];
-    shortdesc = "canonicalized absolute pathname";
-    longdesc = "\
-Return the canonicalized absolute pathname of C<path>.  The
-returned path has no C<.>, C<..> or symbolic link path elements." };
+ mke2fs -t fstype -b blocksize -J device=<journal> <device>
+
+See also C<guestfs_mke2journal>." };
 
   { defaults with
-    name = "ln"; added = (1, 0, 66);
-    style = RErr, [String "target"; Pathname "linkname"], [];
-    proc_nr = Some 164;
-    tests = [
-      InitScratchFS, Always, TestResult (
-        [["mkdir"; "/ln"];
-         ["touch"; "/ln/a"];
-         ["ln"; "/ln/a"; "/ln/b"];
-         ["stat"; "/ln/b"]], "ret->nlink == 2"), []
-    ];
-    shortdesc = "create a hard link";
+    name = "mke2fs_JL"; added = (1, 0, 68);
+    style = RErr, [String "fstype"; Int "blocksize"; Device "device"; String "label"], [];
+    proc_nr = Some 192;
+    deprecated_by = Some "mke2fs";
+    shortdesc = "make ext2/3/4 filesystem with external journal";
     longdesc = "\
-This command creates a hard link using the C<ln> command." };
+This creates an ext2/3/4 filesystem on C<device> with
+an external journal on the journal labeled C<label>.
+
+See also C<guestfs_mke2journal_L>." };
 
   { defaults with
-    name = "ln_f"; added = (1, 0, 66);
-    style = RErr, [String "target"; Pathname "linkname"], [];
-    proc_nr = Some 165;
-    tests = [
-      InitScratchFS, Always, TestResult (
-        [["mkdir"; "/ln_f"];
-         ["touch"; "/ln_f/a"];
-         ["touch"; "/ln_f/b"];
-         ["ln_f"; "/ln_f/a"; "/ln_f/b"];
-         ["stat"; "/ln_f/b"]], "ret->nlink == 2"), []
-    ];
-    shortdesc = "create a hard link";
+    name = "mke2fs_JU"; added = (1, 0, 68);
+    style = RErr, [String "fstype"; Int "blocksize"; Device "device"; String "uuid"], [];
+    proc_nr = Some 193;
+    deprecated_by = Some "mke2fs";
+    optional = Some "linuxfsuuid";
+    shortdesc = "make ext2/3/4 filesystem with external journal";
     longdesc = "\
-This command creates a hard link using the C<ln -f> command.
-The I<-f> option removes the link (C<linkname>) if it exists already." };
+This creates an ext2/3/4 filesystem on C<device> with
+an external journal on the journal with UUID C<uuid>.
+
+See also C<guestfs_mke2journal_U>." };
 
   { defaults with
-    name = "ln_s"; added = (1, 0, 66);
-    style = RErr, [String "target"; Pathname "linkname"], [];
-    proc_nr = Some 166;
+    name = "modprobe"; added = (1, 0, 68);
+    style = RErr, [String "modulename"], [];
+    proc_nr = Some 194;
+    optional = Some "linuxmodules";
     tests = [
-      InitScratchFS, Always, TestResult (
-        [["mkdir"; "/ln_s"];
-         ["touch"; "/ln_s/a"];
-         ["ln_s"; "a"; "/ln_s/b"];
-         ["lstat"; "/ln_s/b"]],
-        "S_ISLNK (ret->mode) && (ret->mode & 0777) == 0777"), []
+      InitNone, Always, TestRun [["modprobe"; "fat"]], []
     ];
-    shortdesc = "create a symbolic link";
+    shortdesc = "load a kernel module";
     longdesc = "\
-This command creates a symbolic link using the C<ln -s> command." };
+This loads a kernel module in the appliance." };
 
   { defaults with
-    name = "ln_sf"; added = (1, 0, 66);
-    style = RErr, [String "target"; Pathname "linkname"], [];
-    proc_nr = Some 167;
+    name = "echo_daemon"; added = (1, 0, 69);
+    style = RString "output", [StringList "words"], [];
+    proc_nr = Some 195;
+    reentrant = true;
     tests = [
-      InitScratchFS, Always, TestResultString (
-        [["mkdir_p"; "/ln_sf/b"];
-         ["touch"; "/ln_sf/b/c"];
-         ["ln_sf"; "../d"; "/ln_sf/b/c"];
-         ["readlink"; "/ln_sf/b/c"]], "../d"), []
+      InitNone, Always, TestResultString (
+        [["echo_daemon"; "This is a test"]], "This is a test"), [];
+      InitNone, Always, TestResultString (
+        [["echo_daemon"; ""]], ""), [];
     ];
-    shortdesc = "create a symbolic link";
+    shortdesc = "echo arguments back to the client";
     longdesc = "\
-This command creates a symbolic link using the C<ln -sf> command,
-The I<-f> option removes the link (C<linkname>) if it exists already." };
+This command concatenates the list of C<words> passed with single spaces
+between them and returns the resulting string.
 
-  { defaults with
-    name = "readlink"; added = (1, 0, 66);
-    style = RString "link", [Pathname "path"], [];
-    proc_nr = Some 168;
-    shortdesc = "read the target of a symbolic link";
-    longdesc = "\
-This command reads the target of a symbolic link." };
+You can use this command to test the connection through to the daemon.
+
+See also C<guestfs_ping_daemon>." };
 
   { defaults with
-    name = "fallocate"; added = (1, 0, 66);
-    style = RErr, [Pathname "path"; Int "len"], [];
-    proc_nr = Some 169;
-    deprecated_by = Some "fallocate64";
-    tests = [
-      InitScratchFS, Always, TestResult (
-        [["fallocate"; "/fallocate"; "1000000"];
-         ["stat"; "/fallocate"]], "ret->size == 1000000"), []
-    ];
-    shortdesc = "preallocate a file in the guest filesystem";
+    name = "find0"; added = (1, 0, 74);
+    style = RErr, [Pathname "directory"; FileOut "files"], [OString "glob"; OString "types"; OInt64 "minsize"; OInt64 "maxsize"; OInt64 "minmtime"; OInt64 "maxmtime"; OInt "maxdepth"; OStringList "prune"];
+    proc_nr = Some 196;
+    once_had_no_optargs = true;
+    cancellable = true;
+    test_excuse = "there is a regression test for this";
+    shortdesc = "find all files and directories, returning NUL-separated list";
     longdesc = "\
-This command preallocates a file (containing zero bytes) named
-C<path> of size C<len> bytes.  If the file exists already, it
-is overwritten.
+This command lists out all files and directories, recursively,
+starting at F<directory>, placing the resulting list in the
+external file called F<files>.
 
-Do not confuse this with the guestfish-specific
-C<alloc> command which allocates a file in the host and
-attaches it as a device." };
+This command works the same way as C<guestfs_find> with the
+following exceptions:
+
+=over 4
+
+=item *
+
+The resulting list is written to an external file.
+
+=item *
+
+Items (filenames) in the result are separated
+by C<\\0> characters.  See L<find(1)> option I<-print0>.
+
+=item *
+
+The result list is not sorted.
+
+=back
+
+The optional arguments select which files are listed.  The files
+are filtered in the appliance, so only the matching names are
+transferred.  A file is listed only if it matches all of the
+arguments given:
+
+=over 4
+
+=item C<glob>
+
+The name of the file (without the directory part) matches
+this glob pattern, as in L<find(1)> I<-name>.
+
+=item C<types>
+
+The type of the file is one of the letters in this string:
+C<f> (regular file), C<d> (directory), C<l> (symbolic link),
+C<b> (block device), C<c> (character device), C<p> (FIFO)
+or C<s> (socket), as in L<find(1)> I<-type>.  Symbolic links
+are not followed.
+
+=item C<minsize>
+
+=item C<maxsize>
+
+The size of the file in bytes is at least C<minsize> and
+at most C<maxsize>.
+
+=item C<minmtime>
+
+=item C<maxmtime>
+
+The modification time of the file, in seconds since the epoch,
+is at least C<minmtime> and at most C<maxmtime>.
+
+=item C<maxdepth>
+
+The file is at most C<maxdepth> levels below F<directory>.
+Files directly in F<directory> are at level 1.  Deeper
+directories are not read at all.
+
+=item C<prune>
+
+A list of absolute paths of directories (for example
+F</proc>) which are not listed and not descended into.
+
+=back" };
 
   { defaults with
-    name = "swapon_device"; added = (1, 0, 66);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 170;
+    name = "case_sensitive_path"; added = (1, 0, 75);
+    style = RString "rpath", [Pathname "path"], [];
+    proc_nr = Some 197;
     tests = [
-      InitPartition, Always, TestRun (
-        [["mkswap"; "/dev/sda1"; "NOARG"; "NOARG"];
-         ["swapon_device"; "/dev/sda1"];
-         ["swapoff_device"; "/dev/sda1"]]), []
+      InitISOFS, Always, TestResultString (
+        [["case_sensitive_path"; "/DIRECTORY"]], "/directory"), [];
+      InitISOFS, Always, TestResultString (
+        [["case_sensitive_path"; "/DIRECTORY/"]], "/directory"), [];
+      InitISOFS, Always, TestResultString (
+        [["case_sensitive_path"; "/Known-1"]], "/known-1"), [];
+      InitISOFS, Always, TestLastFail (
+        [["case_sensitive_path"; "/Known-1/"]]), [];
+      InitScratchFS, Always, TestResultString (
+        [["mkdir"; "/case_sensitive_path"];
+         ["mkdir"; "/case_sensitive_path/bbb"];
+         ["touch"; "/case_sensitive_path/bbb/c"];
+         ["case_sensitive_path"; "/CASE_SENSITIVE_path/bbB/C"]], "/case_sensitive_path/bbb/c"), [];
+      InitScratchFS, Always, TestResultString (
+        [["mkdir"; "/case_sensitive_path2"];
+         ["mkdir"; "/case_sensitive_path2/bbb"];
+         ["touch"; "/case_sensitive_path2/bbb/c"];
+         ["case_sensitive_path"; "/case_sensitive_PATH2////bbB/C"]], "/case_sensitive_path2/bbb/c"), [];
+      InitScratchFS, Always, TestLastFail (
+        [["mkdir"; "/case_sensitive_path3"];
+         ["mkdir"; "/case_sensitive_path3/bbb"];
+         ["touch"; "/case_sensitive_path3/bbb/c"];
+         ["case_sensitive_path"; "/case_SENSITIVE_path3/bbb/../bbb/C"]]), [];
+      InitScratchFS, Always, TestResultString (
+        [["mkdir"; "/case_sensitive_path4"];
+         ["case_sensitive_path"; "/case_SENSITIVE_path4/new_file"]], "/case_sensitive_path4/new_file"), []
     ];
-    shortdesc = "enable swap on device";
+    shortdesc = "return true path on case-insensitive filesystem";
     longdesc = "\
-This command enables the libguestfs appliance to use the
-swap device or partition named C<device>.  The increased
-memory is made available for all commands, for example
-those run using C<guestfs_command> or C<guestfs_sh>.
+This can be used to resolve case insensitive paths on
+a filesystem which is case sensitive.  The use case is
+to resolve paths which you have read from Windows configuration
+files or the Windows Registry, to the true path.
+
+The command handles a peculiarity of the Linux ntfs-3g
+filesystem driver (and probably others), which is that although
+the underlying filesystem is case-insensitive, the driver
+exports the filesystem to Linux as case-sensitive.
+
+One consequence of this is that special directories such
+as F<C:\\windows> may appear as F</WINDOWS> or F</windows>
+(or other things) depending on the precise details of how
+they were created.  In Windows itself this would not be
+a problem.
+
+Bug or feature?  You decide:
+L<http://www.tuxera.com/community/ntfs-3g-faq/#posixfilenames1>
+
+C<guestfs_case_sensitive_path> attempts to resolve the true case of
+each element in the path. It will return a resolved path if either the
+full path or its parent directory exists. If the parent directory
+exists but the full path does not, the case of the parent directory
+will be correctly resolved, and the remainder appended unmodified. For
+example, if the file C<\"/Windows/System32/netkvm.sys\"> exists:
+
+=over 4
+
+=item C<guestfs_case_sensitive_path> (\"/windows/system32/netkvm.sys\")
+
+\"Windows/System32/netkvm.sys\"
+
+=item C<guestfs_case_sensitive_path> (\"/windows/system32/NoSuchFile\")
+
+\"Windows/System32/NoSuchFile\"
+
+=item C<guestfs_case_sensitive_path> (\"/windows/system33/netkvm.sys\")
 
-Note that you should not swap to existing guest swap
-partitions unless you know what you are doing.  They may
-contain hibernation information, or other information that
-the guest doesn't want you to trash.  You also risk leaking
-information about the host to the guest this way.  Instead,
-attach a new host device to the guest and swap on that." };
+I<ERROR>
 
-  { defaults with
-    name = "swapoff_device"; added = (1, 0, 66);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 171;
-    shortdesc = "disable swap on device";
-    longdesc = "\
-This command disables the libguestfs appliance swap
-device or partition named C<device>.
-See C<guestfs_swapon_device>." };
+=back
 
-  { defaults with
-    name = "swapon_file"; added = (1, 0, 66);
-    style = RErr, [Pathname "file"], [];
-    proc_nr = Some 172;
-    tests = [
-      InitScratchFS, Always, TestRun (
-        [["fallocate"; "/swapon_file"; "8388608"];
-         ["mkswap_file"; "/swapon_file"];
-         ["swapon_file"; "/swapon_file"];
-         ["swapoff_file"; "/swapon_file"];
-         ["rm"; "/swapon_file"]]), []
-    ];
-    shortdesc = "enable swap on file";
-    longdesc = "\
-This command enables swap to a file.
-See C<guestfs_swapon_device> for other notes." };
+I<Note>:
+Because of the above behaviour, C<guestfs_case_sensitive_path> cannot
+be used to check for the existence of a file.
 
-  { defaults with
-    name = "swapoff_file"; added = (1, 0, 66);
-    style = RErr, [Pathname "file"], [];
-    proc_nr = Some 173;
-    shortdesc = "disable swap on file";
-    longdesc = "\
-This command disables the libguestfs appliance swap on file." };
+I<Note>:
+This function does not handle drive names, backslashes etc.
+
+See also C<guestfs_realpath>." };
 
   { defaults with
-    name = "swapon_label"; added = (1, 0, 66);
-    style = RErr, [String "label"], [];
-    proc_nr = Some 174;
+    name = "vfs_type"; added = (1, 0, 75);
+    style = RString "fstype", [Mountable "mountable"], [];
+    proc_nr = Some 198;
+    reentrant = true;
     tests = [
-      InitEmpty, Always, TestRun (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["mkswap"; "/dev/sda1"; "swapit"; "NOARG"];
-         ["swapon_label"; "swapit"];
-         ["swapoff_label"; "swapit"];
-         ["zero"; "/dev/sda"];
-         ["blockdev_rereadpt"; "/dev/sda"]]), []
+      InitScratchFS, Always, TestResultString (
+        [["vfs_type"; "/dev/sdb1"]], "ext2"), []
     ];
-    shortdesc = "enable swap on labeled swap partition";
-    longdesc = "\
-This command enables swap to a labeled swap partition.
-See C<guestfs_swapon_device> for other notes." };
-
-  { defaults with
-    name = "swapoff_label"; added = (1, 0, 66);
-    style = RErr, [String "label"], [];
-    proc_nr = Some 175;
-    shortdesc = "disable swap on labeled swap partition";
-    longdesc = "\
-This command disables the libguestfs appliance swap on
-labeled swap partition." };
-
-  { defaults with
-    name = "swapon_uuid"; added = (1, 0, 66);
-    style = RErr, [String "uuid"], [];
-    proc_nr = Some 176;
-    optional = Some "linuxfsuuid";
-    tests =
-      (let uuid = uuidgen () in [
-        InitEmpty, Always, TestRun (
-          [["mkswap"; "/dev/sdc"; "NOARG"; uuid];
-           ["swapon_uuid"; uuid];
-           ["swapoff_uuid"; uuid]]), []
-      ]);
-    shortdesc = "enable swap on swap partition by UUID";
+    shortdesc = "get the Linux VFS type corresponding to a mounted device";
     longdesc = "\
-This command enables swap to a swap partition with the given UUID.
-See C<guestfs_swapon_device> for other notes." };
+This command gets the filesystem type corresponding to
+the filesystem on C<mountable>.
 
-  { defaults with
-    name = "swapoff_uuid"; added = (1, 0, 66);
-    style = RErr, [String "uuid"], [];
-    proc_nr = Some 177;
-    optional = Some "linuxfsuuid";
-    shortdesc = "disable swap on swap partition by UUID";
-    longdesc = "\
-This command disables the libguestfs appliance swap partition
-with the given UUID." };
+For most filesystems, the result is the name of the Linux
+VFS module which would be used to mount this filesystem
+if you mounted it without specifying the filesystem type.
+For example a string such as C<ext3> or C<ntfs>." };
 
   { defaults with
-    name = "mkswap_file"; added = (1, 0, 66);
+    name = "truncate"; added = (1, 0, 77);
     style = RErr, [Pathname "path"], [];
-    proc_nr = Some 178;
+    proc_nr = Some 199;
     tests = [
-      InitScratchFS, Always, TestRun (
-        [["fallocate"; "/mkswap_file"; "8388608"];
-         ["mkswap_file"; "/mkswap_file"];
-         ["rm"; "/mkswap_file"]]), []
+      InitScratchFS, Always, TestResult (
+        [["write"; "/truncate"; "some stuff so size is not zero"];
+         ["truncate"; "/truncate"];
+         ["stat"; "/truncate"]], "ret->size == 0"), []
     ];
-    shortdesc = "create a swap file";
+    shortdesc = "truncate a file to zero size";
     longdesc = "\
-Create a swap file.
-
-This command just writes a swap file signature to an existing
-file.  To create the file itself, use something like C<guestfs_fallocate>." };
+This command truncates C<path> to a zero-length file.  The
+file must exist already." };
 
   { defaults with
-    name = "inotify_init"; added = (1, 0, 66);
-    style = RErr, [Int "maxevents"], [];
-    proc_nr = Some 179;
-    optional = Some "inotify";
+    name = "truncate_size"; added = (1, 0, 77);
+    style = RErr, [Pathname "path"; Int64 "size"], [];
+    proc_nr = Some 200;
     tests = [
-      InitISOFS, Always, TestRun (
-        [["inotify_init"; "0"]]), []
+      InitScratchFS, Always, TestResult (
+        [["touch"; "/truncate_size"];
+         ["truncate_size"; "/truncate_size"; "1000"];
+         ["stat"; "/truncate_size"]], "ret->size == 1000"), []
     ];
-    shortdesc = "create an inotify handle";
+    shortdesc = "truncate a file to a particular size";
     longdesc = "\
-This command creates a new inotify handle.
-The inotify subsystem can be used to notify events which happen to
-objects in the guest filesystem.
-
-C<maxevents> is the maximum number of events which will be
-queued up between calls to C<guestfs_inotify_read> or
-C<guestfs_inotify_files>.
-If this is passed as C<0>, then the kernel (or previously set)
-default is used.  For Linux 2.6.29 the default was 16384 events.
-Beyond this limit, the kernel throws away events, but records
-the fact that it threw them away by setting a flag
-C<IN_Q_OVERFLOW> in the returned structure list (see
-C<guestfs_inotify_read>).
-
-Before any events are generated, you have to add some
-watches to the internal watch list.  See: C<guestfs_inotify_add_watch> and
-C<guestfs_inotify_rm_watch>.
-
-Queued up events should be read periodically by calling
-C<guestfs_inotify_read>
-(or C<guestfs_inotify_files> which is just a helpful
-wrapper around C<guestfs_inotify_read>).  If you don't
-read the events out often enough then you risk the internal
-queue overflowing.
-
-The handle should be closed after use by calling
-C<guestfs_inotify_close>.  This also removes any
-watches automatically.
+This command truncates C<path> to size C<size> bytes.  The file
+must exist already.
 
-See also L<inotify(7)> for an overview of the inotify interface
-as exposed by the Linux kernel, which is roughly what we expose
-via libguestfs.  Note that there is one global inotify handle
-per libguestfs instance." };
+If the current file size is less than C<size> then
+the file is extended to the required size with zero bytes.
+This creates a sparse file (ie. disk blocks are not allocated
+for the file until you write to it).  To create a non-sparse
+file of zeroes, use C<guestfs_fallocate64> instead." };
 
   { defaults with
-    name = "inotify_add_watch"; added = (1, 0, 66);
-    style = RInt64 "wd", [Pathname "path"; Int "mask"], [];
-    proc_nr = Some 180;
-    optional = Some "inotify";
+    name = "utimens"; added = (1, 0, 77);
+    style = RErr, [Pathname "path"; Int64 "atsecs"; Int64 "atnsecs"; Int64 "mtsecs"; Int64 "mtnsecs"], [];
+    proc_nr = Some 201;
+    (* Test directories, named pipes etc (RHBZ#761451, RHBZ#761460) *)
     tests = [
       InitScratchFS, Always, TestResult (
-        [["mkdir"; "/inotify_add_watch"];
-         ["inotify_init"; "0"];
-         ["inotify_add_watch"; "/inotify_add_watch"; "4095"];
-         ["touch"; "/inotify_add_watch/a"];
-         ["touch"; "/inotify_add_watch/b"];
-         ["inotify_files"]],
-        "is_string_list (ret, 2, \"a\", \"b\")"), []
+        [["touch"; "/utimens-file"];
+         ["utimens"; "/utimens-file"; "12345"; "67890"; "9876"; "5432"];
+         ["stat"; "/utimens-file"]], "ret->mtime == 9876"), [];
+      InitScratchFS, Always, TestResult (
+        [["mkdir"; "/utimens-dir"];
+         ["utimens"; "/utimens-dir"; "12345"; "67890"; "9876"; "5432"];
+         ["stat"; "/utimens-dir"]], "ret->mtime == 9876"), [];
+      InitScratchFS, Always, TestResult (
+        [["mkfifo"; "0o644"; "/utimens-fifo"];
+         ["utimens"; "/utimens-fifo"; "12345"; "67890"; "9876"; "5432"];
+         ["stat"; "/utimens-fifo"]], "ret->mtime == 9876"), [];
+      InitScratchFS, Always, TestResult (
+        [["ln_sf"; "/utimens-file"; "/utimens-link"];
+         ["utimens"; "/utimens-link"; "12345"; "67890"; "9876"; "5432"];
+         ["stat"; "/utimens-link"]], "ret->mtime == 9876"), [];
+      InitScratchFS, Always, TestResult (
+        [["mknod_b"; "0o644"; "8"; "0"; "/utimens-block"];
+         ["utimens"; "/utimens-block"; "12345"; "67890"; "9876"; "5432"];
+         ["stat"; "/utimens-block"]], "ret->mtime == 9876"), [];
+      InitScratchFS, Always, TestResult (
+        [["mknod_c"; "0o644"; "1"; "3"; "/utimens-char"];
+         ["utimens"; "/utimens-char"; "12345"; "67890"; "9876"; "5432"];
+         ["stat"; "/utimens-char"]], "ret->mtime == 9876"), []
     ];
-    shortdesc = "add an inotify watch";
+    shortdesc = "set timestamp of a file with nanosecond precision";
     longdesc = "\
-Watch C<path> for the events listed in C<mask>.
+This command sets the timestamps of a file with nanosecond
+precision.
 
-Note that if C<path> is a directory then events within that
-directory are watched, but this does I<not> happen recursively
-(in subdirectories).
+C<atsecs, atnsecs> are the last access time (atime) in secs and
+nanoseconds from the epoch.
 
-Note for non-C or non-Linux callers: the inotify events are
-defined by the Linux kernel ABI and are listed in
-F</usr/include/sys/inotify.h>." };
+C<mtsecs, mtnsecs> are the last modification time (mtime) in
+secs and nanoseconds from the epoch.
 
-  { defaults with
-    name = "inotify_rm_watch"; added = (1, 0, 66);
-    style = RErr, [Int(*XXX64*) "wd"], [];
-    proc_nr = Some 181;
-    optional = Some "inotify";
-    shortdesc = "remove an inotify watch";
-    longdesc = "\
-Remove a previously defined inotify watch.
-See C<guestfs_inotify_add_watch>." };
+If the C<*nsecs> field contains the special value C<-1> then
+the corresponding timestamp is set to the current time.  (The
+C<*secs> field is ignored in this case).
+
+If the C<*nsecs> field contains the special value C<-2> then
+the corresponding timestamp is left unchanged.  (The
+C<*secs> field is ignored in this case)." };
 
   { defaults with
-    name = "inotify_read"; added = (1, 0, 66);
-    style = RStructList ("events", "inotify_event"), [], [];
-    proc_nr = Some 182;
-    optional = Some "inotify";
-    shortdesc = "return list of inotify events";
+    name = "mkdir_mode"; added = (1, 0, 77);
+    style = RErr, [Pathname "path"; Int "mode"], [];
+    proc_nr = Some 202;
+    tests = [
+      InitScratchFS, Always, TestResult (
+        [["mkdir_mode"; "/mkdir_mode"; "0o111"];
+         ["stat"; "/mkdir_mode"]],
+        "S_ISDIR (ret->mode) && (ret->mode & 0777) == 0111"), []
+    ];
+    shortdesc = "create a directory with a particular mode";
     longdesc = "\
-Return the complete queue of events that have happened
-since the previous read call.
+This command creates a directory, setting the initial permissions
+of the directory to C<mode>.
 
-If no events have happened, this returns an empty list.
+For common Linux filesystems, the actual mode which is set will
+be C<mode & ~umask & 01777>.  Non-native-Linux filesystems may
+interpret the mode in other ways.
 
-I<Note>: In order to make sure that all events have been
-read, you must call this function repeatedly until it
-returns an empty list.  The reason is that the call will
-read events up to the maximum appliance-to-host message
-size and leave remaining events in the queue." };
+See also C<guestfs_mkdir>, C<guestfs_umask>" };
 
   { defaults with
-    name = "inotify_files"; added = (1, 0, 66);
-    style = RStringList "paths", [], [];
-    proc_nr = Some 183;
-    optional = Some "inotify";
-    shortdesc = "return list of watched files that had events";
+    name = "lchown"; added = (1, 0, 77);
+    style = RErr, [Int "owner"; Int "group"; Pathname "path"], [];
+    proc_nr = Some 203;
+    shortdesc = "change file owner and group";
     longdesc = "\
-This function is a helpful wrapper around C<guestfs_inotify_read>
-which just returns a list of pathnames of objects that were
-touched.  The returned pathnames are sorted and deduplicated." };
+Change the file owner to C<owner> and group to C<group>.
+This is like C<guestfs_chown> but if C<path> is a symlink then
+the link itself is changed, not the target.
 
-  { defaults with
-    name = "inotify_close"; added = (1, 0, 66);
-    style = RErr, [], [];
-    proc_nr = Some 184;
-    optional = Some "inotify";
-    shortdesc = "close the inotify handle";
-    longdesc = "\
-This closes the inotify handle which was previously
-opened by inotify_init.  It removes all watches, throws
-away any pending events, and deallocates all resources." };
+Only numeric uid and gid are supported.  If you want to use
+names, you will need to locate and parse the password file
+yourself (Augeas support makes this relatively easy)." };
 
   { defaults with
-    name = "setcon"; added = (1, 0, 67);
-    style = RErr, [String "context"], [];
-    proc_nr = Some 185;
-    optional = Some "selinux";
-    deprecated_by = Some "selinux_relabel";
-    shortdesc = "set SELinux security context";
+    name = "internal_lxattrlist"; added = (1, 19, 32);
+    style = RStructList ("xattrs", "xattr"), [Pathname "path"; FilenameList "names"], [];
+    proc_nr = Some 205;
+    visibility = VInternal;
+    optional = Some "linuxxattrs";
+    shortdesc = "lgetxattr on multiple files";
     longdesc = "\
-This sets the SELinux security context of the daemon
-to the string C<context>.
+This call allows you to get the extended attributes
+of multiple files, where all files are in the directory C<path>.
+C<names> is the list of files from this directory.
 
-See the documentation about SELINUX in L<guestfs(3)>." };
+On return you get a flat list of xattr structs which must be
+interpreted sequentially.  The first xattr struct always has a zero-length
+C<attrname>.  C<attrval> in this struct is zero-length
+to indicate there was an error doing C<lgetxattr> for this
+file, I<or> is a C string which is a decimal number
+(the number of following attributes for this file, which could
+be C<\"0\">).  Then after the first xattr struct are the
+zero or more attributes for the first named file.
+This repeats for the second and subsequent files.
+
+This call is intended for programs that want to efficiently
+list a directory contents without making many round-trips.
+See also C<guestfs_lstatlist> for a similarly efficient call
+for getting standard stats.  Very long directory listings
+might cause the protocol message size to be exceeded, causing
+this call to fail.  The caller must split up such requests
+into smaller groups of names." };
 
   { defaults with
-    name = "getcon"; added = (1, 0, 67);
-    style = RString "context", [], [];
-    proc_nr = Some 186;
-    optional = Some "selinux";
-    deprecated_by = Some "selinux_relabel";
-    shortdesc = "get SELinux security context";
+    name = "internal_readlinklist"; added = (1, 19, 32);
+    style = RStringList "links", [Pathname "path"; FilenameList "names"], [];
+    proc_nr = Some 206;
+    visibility = VInternal;
+    shortdesc = "readlink on multiple files";
     longdesc = "\
-This gets the SELinux security context of the daemon.
+This call allows you to do a C<readlink> operation
+on multiple files, where all files are in the directory C<path>.
+C<names> is the list of files from this directory.
 
-See the documentation about SELINUX in L<guestfs(3)>,
-and C<guestfs_setcon>" };
+On return you get a list of strings, with a one-to-one
+correspondence to the C<names> list.  Each string is the
+value of the symbolic link.
 
-  { defaults with
-    name = "mkfs_b"; added = (1, 0, 68);
-    style = RErr, [String "fstype"; Int "blocksize"; Device "device"], [];
-    proc_nr = Some 187;
-    deprecated_by = Some "mkfs";
-    tests = [
-      InitEmpty, Always, TestResultString (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["mkfs_b"; "ext2"; "4096"; "/dev/sda1"];
-         ["mount"; "/dev/sda1"; "/"];
-         ["write"; "/new"; "new file contents"];
-         ["cat"; "/new"]], "new file contents"), [];
-      InitEmpty, Always, TestRun (
-        [["part_init"; "/dev/sda"; "mbr"];
-         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
-         ["mkfs_b"; "vfat"; "32768"; "/dev/sda1"]]), [];
-      InitEmpty, Always, TestLastFail (
-        [["part_init"; "/dev/sda"; "mbr"];
-         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
-         ["mkfs_b"; "vfat"; "32769"; "/dev/sda1"]]), [];
-      InitEmpty, Always, TestLastFail (
-        [["part_init"; "/dev/sda"; "mbr"];
-         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
-         ["mkfs_b"; "vfat"; "33280"; "/dev/sda1"]]), [];
-      InitEmpty, IfAvailable "ntfsprogs", TestRun (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["mkfs_b"; "ntfs"; "32768"; "/dev/sda1"]]), []
-    ];
-    shortdesc = "make a filesystem with block size";
-    longdesc = "\
-This call is similar to C<guestfs_mkfs>, but it allows you to
-control the block size of the resulting filesystem.  Supported
-block sizes depend on the filesystem type, but typically they
-are C<1024>, C<2048> or C<4096> only.
+If the L<readlink(2)> operation fails on any name, then
+the corresponding result string is the empty string C<\"\">.
+However the whole operation is completed even if there
+were L<readlink(2)> errors, and so you can call this
+function with names where you don't know if they are
+symbolic links already (albeit slightly less efficient).
 
-For VFAT and NTFS the C<blocksize> parameter is treated as
-the requested cluster size." };
+This call is intended for programs that want to efficiently
+list a directory contents without making many round-trips.
+Very long directory listings might cause the protocol
+message size to be exceeded, causing
+this call to fail.  The caller must split up such requests
+into smaller groups of names." };
 
   { defaults with
-    name = "mke2journal"; added = (1, 0, 68);
-    style = RErr, [Int "blocksize"; Device "device"], [];
-    proc_nr = Some 188;
-    deprecated_by = Some "mke2fs";
+    name = "pread"; added = (1, 0, 77);
+    style = RBufferOut "content", [Pathname "path"; Int "count"; Int64 "offset"], [];
+    proc_nr = Some 207;
+    protocol_limit_warning = true;
     tests = [
-      InitEmpty, Always, TestResultString (
-        [["part_init"; "/dev/sda"; "mbr"];
-         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
-         ["part_add"; "/dev/sda"; "p"; "204800"; "-64"];
-         ["mke2journal"; "4096"; "/dev/sda1"];
-         ["mke2fs_J"; "ext2"; "4096"; "/dev/sda2"; "/dev/sda1"];
-         ["mount"; "/dev/sda2"; "/"];
-         ["write"; "/new"; "new file contents"];
-         ["cat"; "/new"]], "new file contents"), []
+      InitISOFS, Always, TestResult (
+        [["pread"; "/known-4"; "1"; "3"]],
+        "compare_buffers (ret, size, \"\\n\", 1) == 0"), [];
+      InitISOFS, Always, TestResult (
+        [["pread"; "/empty"; "0"; "100"]],
+        "compare_buffers (ret, size, NULL, 0) == 0"), []
     ];
-    shortdesc = "make ext2/3/4 external journal";
+    shortdesc = "read part of a file";
     longdesc = "\
-This creates an ext2 external journal on C<device>.  It is equivalent
-to the command:
+This command lets you read part of a file.  It reads C<count>
+bytes of the file, starting at C<offset>, from file C<path>.
 
- mke2fs -O journal_dev -b blocksize device" };
+This may read fewer bytes than requested.  For further details
+see the L<pread(2)> system call.
+
+See also C<guestfs_pwrite>, C<guestfs_pread_device>." };
 
   { defaults with
-    name = "mke2journal_L"; added = (1, 0, 68);
-    style = RErr, [Int "blocksize"; String "label"; Device "device"], [];
-    proc_nr = Some 189;
-    deprecated_by = Some "mke2fs";
+    name = "part_init"; added = (1, 0, 78);
+    style = RErr, [Device "device"; String "parttype"], [];
+    proc_nr = Some 208;
     tests = [
-      InitEmpty, Always, TestResultString (
-        [["part_init"; "/dev/sda"; "mbr"];
-         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
-         ["part_add"; "/dev/sda"; "p"; "204800"; "-64"];
-         ["mke2journal_L"; "4096"; "JOURNAL"; "/dev/sda1"];
-         ["mke2fs_JL"; "ext2"; "4096"; "/dev/sda2"; "JOURNAL"];
-         ["mount"; "/dev/sda2"; "/"];
-         ["write"; "/new"; "new file contents"];
-         ["cat"; "/new"]], "new file contents"), []
+      InitEmpty, Always, TestRun (
+        [["part_init"; "/dev/sda"; "gpt"]]), []
     ];
-    shortdesc = "make ext2/3/4 external journal with label";
+    shortdesc = "create an empty partition table";
     longdesc = "\
-This creates an ext2 external journal on C<device> with label C<label>." };
+This creates an empty partition table on C<device> of one of the
+partition types listed below.  Usually C<parttype> should be
+either C<msdos> or C<gpt> (for large disks).
 
-  { defaults with
-    name = "mke2journal_U"; added = (1, 0, 68);
-    style = RErr, [Int "blocksize"; String "uuid"; Device "device"], [];
-    proc_nr = Some 190;
-    deprecated_by = Some "mke2fs";
-    optional = Some "linuxfsuuid";
-    tests =
-      (let uuid = uuidgen () in [
-        InitEmpty, Always, TestResultString (
-          [["part_init"; "/dev/sda"; "mbr"];
-           ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
-           ["part_add"; "/dev/sda"; "p"; "204800"; "-64"];
-           ["mke2journal_U"; "4096"; uuid; "/dev/sda1"];
-           ["mke2fs_JU"; "ext2"; "4096"; "/dev/sda2"; uuid];
-           ["mount"; "/dev/sda2"; "/"];
-           ["write"; "/new"; "new file contents"];
-           ["cat"; "/new"]], "new file contents"), []
-      ]);
-    shortdesc = "make ext2/3/4 external journal with UUID";
-    longdesc = "\
-This creates an ext2 external journal on C<device> with UUID C<uuid>." };
+Initially there are no partitions.  Following this, you should
+call C<guestfs_part_add> for each partition required.
+
+Possible values for C<parttype> are:
+
+=over 4
+
+=item B<efi>
+
+=item B<gpt>
+
+Intel EFI / GPT partition table.
+
+This is recommended for >= 2 TB partitions that will be accessed
+from Linux and Intel-based Mac OS X.  It also has limited backwards
+compatibility with the C<mbr> format.
+
+=item B<mbr>
+
+=item B<msdos>
+
+The standard PC \"Master Boot Record\" (MBR) format used
+by MS-DOS and Windows.  This partition type will B<only> work
+for device sizes up to 2 TB.  For large disks we recommend
+using C<gpt>.
 
-  { defaults with
-    name = "mke2fs_J"; added = (1, 0, 68);
-    style = RErr, [String "fstype"; Int "blocksize"; Device "device"; Device "journal"], [];
-    proc_nr = Some 191;
-    deprecated_by = Some "mke2fs";
-    shortdesc = "make ext2/3/4 filesystem with external journal";
-    longdesc = "\
-This creates an ext2/3/4 filesystem on C<device> with
-an external journal on C<journal>.  It is equivalent
-to the command:
+=back
 
- mke2fs -t fstype -b blocksize -J device=<journal> <device>
+Other partition table types that may work but are not
+supported include:
 
-See also C<guestfs_mke2journal>." };
+=over 4
 
-  { defaults with
-    name = "mke2fs_JL"; added = (1, 0, 68);
-    style = RErr, [String "fstype"; Int "blocksize"; Device "device"; String "label"], [];
-    proc_nr = Some 192;
-    deprecated_by = Some "mke2fs";
-    shortdesc = "make ext2/3/4 filesystem with external journal";
-    longdesc = "\
-This creates an ext2/3/4 filesystem on C<device> with
-an external journal on the journal labeled C<label>.
+=item B<aix>
 
-See also C<guestfs_mke2journal_L>." };
+AIX disk labels.
 
-  { defaults with
-    name = "mke2fs_JU"; added = (1, 0, 68);
-    style = RErr, [String "fstype"; Int "blocksize"; Device "device"; String "uuid"], [];
-    proc_nr = Some 193;
-    deprecated_by = Some "mke2fs";
-    optional = Some "linuxfsuuid";
-    shortdesc = "make ext2/3/4 filesystem with external journal";
-    longdesc = "\
-This creates an ext2/3/4 filesystem on C<device> with
-an external journal on the journal with UUID C<uuid>.
+=item B<amiga>
 
-See also C<guestfs_mke2journal_U>." };
+=item B<rdb>
 
-  { defaults with
-    name = "modprobe"; added = (1, 0, 68);
-    style = RErr, [String "modulename"], [];
-    proc_nr = Some 194;
-    optional = Some "linuxmodules";
-    tests = [
-      InitNone, Always, TestRun [["modprobe"; "fat"]], []
-    ];
-    shortdesc = "load a kernel module";
-    longdesc = "\
-This loads a kernel module in the appliance." };
+Amiga \"Rigid Disk Block\" format.
 
-  { defaults with
-    name = "echo_daemon"; added = (1, 0, 69);
-    style = RString "output", [StringList "words"], [];
-    proc_nr = Some 195;
-    tests = [
-      InitNone, Always, TestResultString (
-        [["echo_daemon"; "This is a test"]], "This is a test"), [];
-      InitNone, Always, TestResultString (
-        [["echo_daemon"; ""]], ""), [];
-    ];
-    shortdesc = "echo arguments back to the client";
-    longdesc = "\
-This command concatenates the list of C<words> passed with single spaces
-between them and returns the resulting string.
+=item B<bsd>
 
-You can use this command to test the connection through to the daemon.
+BSD disk labels.
 
-See also C<guestfs_ping_daemon>." };
+=item B<dasd>
 
-  { defaults with
-    name = "find0"; added = (1, 0, 74);
-    style = RErr, [Pathname "directory"; FileOut "files"], [];
-    proc_nr = Some 196;
-    cancellable = true;
-    test_excuse = "there is a regression test for this";
-    shortdesc = "find all files and directories, returning NUL-separated list";
-    longdesc = "\
-This command lists out all files and directories, recursively,
-starting at F<directory>, placing the resulting list in the
-external file called F<files>.
+DASD, used on IBM mainframes.
 
-This command works the same way as C<guestfs_find> with the
-following exceptions:
+=item B<dvh>
 
-=over 4
+MIPS/SGI volumes.
 
-=item *
+=item B<mac>
 
-The resulting list is written to an external file.
+Old Mac partition format.  Modern Macs use C<gpt>.
 
-=item *
+=item B<pc98>
 
-Items (filenames) in the result are separated
-by C<\\0> characters.  See L<find(1)> option I<-print0>.
+NEC PC-98 format, common in Japan apparently.
 
-=item *
+=item B<sun>
 
-The result list is not sorted.
+Sun disk labels.
 
 =back" };
 
   { defaults with
-    name = "case_sensitive_path"; added = (1, 0, 75);
-    style = RString "rpath", [Pathname "path"], [];
-    proc_nr = Some 197;
+    name = "part_add"; added = (1, 0, 78);
+    style = RErr, [Device "device"; String "prlogex"; Int64 "startsect"; Int64 "endsect"], [];
+    proc_nr = Some 209;
     tests = [
-      InitISOFS, Always, TestResultString (
-        [["case_sensitive_path"; "/DIRECTORY"]], "/directory"), [];
-      InitISOFS, Always, TestResultString (
-        [["case_sensitive_path"; "/DIRECTORY/"]], "/directory"), [];
-      InitISOFS, Always, TestResultString (
-        [["case_sensitive_path"; "/Known-1"]], "/known-1"), [];
-      InitISOFS, Always, TestLastFail (
-        [["case_sensitive_path"; "/Known-1/"]]), [];
-      InitScratchFS, Always, TestResultString (
-        [["mkdir"; "/case_sensitive_path"];
-         ["mkdir"; "/case_sensitive_path/bbb"];
-         ["touch"; "/case_sensitive_path/bbb/c"];
-         ["case_sensitive_path"; "/CASE_SENSITIVE_path/bbB/C"]], "/case_sensitive_path/bbb/c"), [];
-      InitScratchFS, Always, TestResultString (
-        [["mkdir"; "/case_sensitive_path2"];
-         ["mkdir"; "/case_sensitive_path2/bbb"];
-         ["touch"; "/case_sensitive_path2/bbb/c"];
-         ["case_sensitive_path"; "/case_sensitive_PATH2////bbB/C"]], "/case_sensitive_path2/bbb/c"), [];
-      InitScratchFS, Always, TestLastFail (
-        [["mkdir"; "/case_sensitive_path3"];
-         ["mkdir"; "/case_sensitive_path3/bbb"];
-         ["touch"; "/case_sensitive_path3/bbb/c"];
-         ["case_sensitive_path"; "/case_SENSITIVE_path3/bbb/../bbb/C"]]), [];
-      InitScratchFS, Always, TestResultString (
-        [["mkdir"; "/case_sensitive_path4"];
-         ["case_sensitive_path"; "/case_SENSITIVE_path4/new_file"]], "/case_sensitive_path4/new_file"), []
+      InitEmpty, Always, TestRun (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "primary"; "1"; "-1"]]), [];
+      InitEmpty, Always, TestRun (
+        [["part_init"; "/dev/sda"; "gpt"];
+         ["part_add"; "/dev/sda"; "primary"; "34"; "127"];
+         ["part_add"; "/dev/sda"; "primary"; "128"; "-34"]]), [];
+      InitEmpty, Always, TestRun (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "primary"; "32"; "127"];
+         ["part_add"; "/dev/sda"; "primary"; "128"; "255"];
+         ["part_add"; "/dev/sda"; "primary"; "256"; "511"];
+         ["part_add"; "/dev/sda"; "primary"; "512"; "-1"]]), []
     ];
-    shortdesc = "return true path on case-insensitive filesystem";
+    shortdesc = "add a partition to the device";
     longdesc = "\
-This can be used to resolve case insensitive paths on
-a filesystem which is case sensitive.  The use case is
-to resolve paths which you have read from Windows configuration
-files or the Windows Registry, to the true path.
+This command adds a partition to C<device>.  If there is no partition
+table on the device, call C<guestfs_part_init> first.
 
-The command handles a peculiarity of the Linux ntfs-3g
-filesystem driver (and probably others), which is that although
-the underlying filesystem is case-insensitive, the driver
-exports the filesystem to Linux as case-sensitive.
+The C<prlogex> parameter is the type of partition.  Normally you
+should pass C<p> or C<primary> here, but MBR partition tables also
+support C<l> (or C<logical>) and C<e> (or C<extended>) partition
+types.
 
-One consequence of this is that special directories such
-as F<C:\\windows> may appear as F</WINDOWS> or F</windows>
-(or other things) depending on the precise details of how
-they were created.  In Windows itself this would not be
-a problem.
+C<startsect> and C<endsect> are the start and end of the partition
+in I<sectors>.  C<endsect> may be negative, which means it counts
+backwards from the end of the disk (C<-1> is the last sector).
 
-Bug or feature?  You decide:
-L<http://www.tuxera.com/community/ntfs-3g-faq/#posixfilenames1>
+Creating a partition which covers the whole disk is not so easy.
+Use C<guestfs_part_disk> to do that." };
 
-C<guestfs_case_sensitive_path> attempts to resolve the true case of
-each element in the path. It will return a resolved path if either the
-full path or its parent directory exists. If the parent directory
-exists but the full path does not, the case of the parent directory
-will be correctly resolved, and the remainder appended unmodified. For
-example, if the file C<\"/Windows/System32/netkvm.sys\"> exists:
+  { defaults with
+    name = "part_disk"; added = (1, 0, 78);
+    style = RErr, [Device "device"; String "parttype"], [];
+    proc_nr = Some 210;
+    tests = [
+      InitEmpty, Always, TestRun (
+        [["part_disk"; "/dev/sda"; "mbr"]]), [];
+      InitEmpty, Always, TestRun (
+        [["part_disk"; "/dev/sda"; "gpt"]]), []
+    ];
+    shortdesc = "partition whole disk with a single primary partition";
+    longdesc = "\
+This command is simply a combination of C<guestfs_part_init>
+followed by C<guestfs_part_add> to create a single primary partition
+covering the whole disk.
 
-=over 4
+C<parttype> is the partition table type, usually C<mbr> or C<gpt>,
+but other possible values are described in C<guestfs_part_init>." };
 
-=item C<guestfs_case_sensitive_path> (\"/windows/system32/netkvm.sys\")
+  { defaults with
+    name = "part_set_bootable"; added = (1, 0, 78);
+    style = RErr, [Device "device"; Int "partnum"; Bool "bootable"], [];
+    proc_nr = Some 211;
+    tests = [
+      InitEmpty, Always, TestRun (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["part_set_bootable"; "/dev/sda"; "1"; "true"]]), []
+    ];
+    shortdesc = "make a partition bootable";
+    longdesc = "\
+This sets the bootable flag on partition numbered C<partnum> on
+device C<device>.  Note that partitions are numbered from 1.
 
-\"Windows/System32/netkvm.sys\"
+The bootable flag is used by some operating systems (notably
+Windows) to determine which partition to boot from.  It is by
+no means universally recognized." };
 
-=item C<guestfs_case_sensitive_path> (\"/windows/system32/NoSuchFile\")
+  { defaults with
+    name = "part_set_name"; added = (1, 0, 78);
+    style = RErr, [Device "device"; Int "partnum"; String "name"], [];
+    proc_nr = Some 212;
+    tests = [
+      InitEmpty, Always, TestRun (
+        [["part_disk"; "/dev/sda"; "gpt"];
+         ["part_set_name"; "/dev/sda"; "1"; "thepartname"]]), []
+    ];
+    shortdesc = "set partition name";
+    longdesc = "\
+This sets the partition name on partition numbered C<partnum> on
+device C<device>.  Note that partitions are numbered from 1.
 
-\"Windows/System32/NoSuchFile\"
+The partition name can only be set on certain types of partition
+table.  This works on C<gpt> but not on C<mbr> partitions." };
 
-=item C<guestfs_case_sensitive_path> (\"/windows/system33/netkvm.sys\")
+  { defaults with
+    name = "part_list"; added = (1, 0, 78);
+    style = RStructList ("partitions", "partition"), [Device "device"], [];
+    proc_nr = Some 213;
+    tests = [] (* XXX Add a regression test for this. *);
+    shortdesc = "list partitions on a device";
+    longdesc = "\
+This command parses the partition table on C<device> and
+returns the list of partitions found.
 
-I<ERROR>
+The fields in the returned structure are:
+
+=over 4
+
+=item B<part_num>
+
+Partition number, counting from 1.
+
+=item B<part_start>
 
-=back
+Start of the partition I<in bytes>.  To get sectors you have to
+divide by the device's sector size, see C<guestfs_blockdev_getss>.
 
-I<Note>:
-Because of the above behaviour, C<guestfs_case_sensitive_path> cannot
-be used to check for the existence of a file.
+=item B<part_end>
 
-I<Note>:
-This function does not handle drive names, backslashes etc.
+End of the partition in bytes.
 
-See also C<guestfs_realpath>." };
+=item B<part_size>
 
-  { defaults with
-    name = "vfs_type"; added = (1, 0, 75);
-    style = RString "fstype", [Mountable "mountable"], [];
-    proc_nr = Some 198;
-    tests = [
-      InitScratchFS, Always, TestResultString (
-        [["vfs_type"; "/dev/sdb1"]], "ext2"), []
-    ];
-    shortdesc = "get the Linux VFS type corresponding to a mounted device";
-    longdesc = "\
-This command gets the filesystem type corresponding to
-the filesystem on C<mountable>.
+Size of the partition in bytes.
 
-For most filesystems, the result is the name of the Linux
-VFS module which would be used to mount this filesystem
-if you mounted it without specifying the filesystem type.
-For example a string such as C<ext3> or C<ntfs>." };
+=back" };
 
   { defaults with
-    name = "truncate"; added = (1, 0, 77);
-    style = RErr, [Pathname "path"], [];
-    proc_nr = Some 199;
+    name = "part_get_parttype"; added = (1, 0, 78);
+    style = RString "parttype", [Device "device"], [];
+    proc_nr = Some 214;
     tests = [
-      InitScratchFS, Always, TestResult (
-        [["write"; "/truncate"; "some stuff so size is not zero"];
-         ["truncate"; "/truncate"];
-         ["stat"; "/truncate"]], "ret->size == 0"), []
+      InitEmpty, Always, TestResultString (
+        [["part_disk"; "/dev/sda"; "gpt"];
+         ["part_get_parttype"; "/dev/sda"]], "gpt"), []
     ];
-    shortdesc = "truncate a file to zero size";
+    shortdesc = "get the partition table type";
     longdesc = "\
-This command truncates C<path> to a zero-length file.  The
-file must exist already." };
+This command examines the partition table on C<device> and
+returns the partition table type (format) being used.
+
+Common return values include: C<msdos> (a DOS/Windows style MBR
+partition table), C<gpt> (a GPT/EFI-style partition table).  Other
+values are possible, although unusual.  See C<guestfs_part_init>
+for a full list." };
 
   { defaults with
-    name = "truncate_size"; added = (1, 0, 77);
-    style = RErr, [Pathname "path"; Int64 "size"], [];
-    proc_nr = Some 200;
+    name = "fill"; added = (1, 0, 79);
+    style = RErr, [Int "c"; Int "len"; Pathname "path"], [];
+    proc_nr = Some 215;
+    progress = true;
     tests = [
       InitScratchFS, Always, TestResult (
-        [["touch"; "/truncate_size"];
-         ["truncate_size"; "/truncate_size"; "1000"];
-         ["stat"; "/truncate_size"]], "ret->size == 1000"), []
+        [["fill"; "0x63"; "10"; "/fill"];
+         ["read_file"; "/fill"]],
+        "compare_buffers (ret, size, \"cccccccccc\", 10) == 0"), []
     ];
-    shortdesc = "truncate a file to a particular size";
+    shortdesc = "fill a file with octets";
     longdesc = "\
-This command truncates C<path> to size C<size> bytes.  The file
-must exist already.
+This command creates a new file called C<path>.  The initial
+content of the file is C<len> octets of C<c>, where C<c>
+must be a number in the range C<[0..255]>.
 
-If the current file size is less than C<size> then
-the file is extended to the required size with zero bytes.
-This creates a sparse file (ie. disk blocks are not allocated
-for the file until you write to it).  To create a non-sparse
-file of zeroes, use C<guestfs_fallocate64> instead." };
+To fill a file with zero bytes (sparsely), it is
+much more efficient to use C<guestfs_truncate_size>.
+To create a file with a pattern of repeating bytes
+use C<guestfs_fill_pattern>." };
 
   { defaults with
-    name = "utimens"; added = (1, 0, 77);
-    style = RErr, [Pathname "path"; Int64 "atsecs"; Int64 "atnsecs"; Int64 "mtsecs"; Int64 "mtnsecs"], [];
-    proc_nr = Some 201;
-    (* Test directories, named pipes etc (RHBZ#761451, RHBZ#761460) *)
+    name = "dd"; added = (1, 0, 80);
+    style = RErr, [Dev_or_Path "src"; Dev_or_Path "dest"], [];
+    proc_nr = Some 217;
+    deprecated_by = Some "copy_device_to_device";
     tests = [
       InitScratchFS, Always, TestResult (
-        [["touch"; "/utimens-file"];
-         ["utimens"; "/utimens-file"; "12345"; "67890"; "9876"; "5432"];
-         ["stat"; "/utimens-file"]], "ret->mtime == 9876"), [];
-      InitScratchFS, Always, TestResult (
-        [["mkdir"; "/utimens-dir"];
-         ["utimens"; "/utimens-dir"; "12345"; "67890"; "9876"; "5432"];
-         ["stat"; "/utimens-dir"]], "ret->mtime == 9876"), [];
-      InitScratchFS, Always, TestResult (
-        [["mkfifo"; "0o644"; "/utimens-fifo"];
-         ["utimens"; "/utimens-fifo"; "12345"; "67890"; "9876"; "5432"];
-         ["stat"; "/utimens-fifo"]], "ret->mtime == 9876"), [];
-      InitScratchFS, Always, TestResult (
-        [["ln_sf"; "/utimens-file"; "/utimens-link"];
-         ["utimens"; "/utimens-link"; "12345"; "67890"; "9876"; "5432"];
-         ["stat"; "/utimens-link"]], "ret->mtime == 9876"), [];
-      InitScratchFS, Always, TestResult (
-        [["mknod_b"; "0o644"; "8"; "0"; "/utimens-block"];
-         ["utimens"; "/utimens-block"; "12345"; "67890"; "9876"; "5432"];
-         ["stat"; "/utimens-block"]], "ret->mtime == 9876"), [];
-      InitScratchFS, Always, TestResult (
-        [["mknod_c"; "0o644"; "1"; "3"; "/utimens-char"];
-         ["utimens"; "/utimens-char"; "12345"; "67890"; "9876"; "5432"];
-         ["stat"; "/utimens-char"]], "ret->mtime == 9876"), []
+        [["mkdir"; "/dd"];
+         ["write"; "/dd/src"; "hello, world"];
+         ["dd"; "/dd/src"; "/dd/dest"];
+         ["read_file"; "/dd/dest"]],
+        "compare_buffers (ret, size, \"hello, world\", 12) == 0"), []
     ];
-    shortdesc = "set timestamp of a file with nanosecond precision";
+    shortdesc = "copy from source to destination using dd";
     longdesc = "\
-This command sets the timestamps of a file with nanosecond
-precision.
-
-C<atsecs, atnsecs> are the last access time (atime) in secs and
-nanoseconds from the epoch.
-
-C<mtsecs, mtnsecs> are the last modification time (mtime) in
-secs and nanoseconds from the epoch.
-
-If the C<*nsecs> field contains the special value C<-1> then
-the corresponding timestamp is set to the current time.  (The
-C<*secs> field is ignored in this case).
+This command copies from one source device or file C<src>
+to another destination device or file C<dest>.  Normally you
+would use this to copy to or from a device or partition, for
+example to duplicate a filesystem.
 
-If the C<*nsecs> field contains the special value C<-2> then
-the corresponding timestamp is left unchanged.  (The
-C<*secs> field is ignored in this case)." };
+If the destination is a device, it must be as large or larger
+than the source file or device, otherwise the copy will fail.
+This command cannot do partial copies
+(see C<guestfs_copy_device_to_device>)." };
 
   { defaults with
-    name = "mkdir_mode"; added = (1, 0, 77);
-    style = RErr, [Pathname "path"; Int "mode"], [];
-    proc_nr = Some 202;
+    name = "filesize"; added = (1, 0, 82);
+    style = RInt64 "size", [Pathname "file"], [];
+    proc_nr = Some 218;
     tests = [
       InitScratchFS, Always, TestResult (
-        [["mkdir_mode"; "/mkdir_mode"; "0o111"];
-         ["stat"; "/mkdir_mode"]],
-        "S_ISDIR (ret->mode) && (ret->mode & 0777) == 0111"), []
+        [["write"; "/filesize"; "hello, world"];
+         ["filesize"; "/filesize"]], "ret == 12"), []
     ];
-    shortdesc = "create a directory with a particular mode";
-    longdesc = "\
-This command creates a directory, setting the initial permissions
-of the directory to C<mode>.
-
-For common Linux filesystems, the actual mode which is set will
-be C<mode & ~umask & 01777>.  Non-native-Linux filesystems may
-interpret the mode in other ways.
-
-See also C<guestfs_mkdir>, C<guestfs_umask>" };
-
-  { defaults with
-    name = "lchown"; added = (1, 0, 77);
-    style = RErr, [Int "owner"; Int "group"; Pathname "path"], [];
-    proc_nr = Some 203;
-    shortdesc = "change file owner and group";
-    longdesc = "\
-Change the file owner to C<owner> and group to C<group>.
-This is like C<guestfs_chown> but if C<path> is a symlink then
-the link itself is changed, not the target.
-
-Only numeric uid and gid are supported.  If you want to use
-names, you will need to locate and parse the password file
-yourself (Augeas support makes this relatively easy)." };
-
-  { defaults with
-    name = "internal_lxattrlist"; added = (1, 19, 32);
-    style = RStructList ("xattrs", "xattr"), [Pathname "path"; FilenameList "names"], [];
-    proc_nr = Some 205;
-    visibility = VInternal;
-    optional = Some "linuxxattrs";
-    shortdesc = "lgetxattr on multiple files";
-    longdesc = "\
-This call allows you to get the extended attributes
-of multiple files, where all files are in the directory C<path>.
-C<names> is the list of files from this directory.
-
-On return you get a flat list of xattr structs which must be
-interpreted sequentially.  The first xattr struct always has a zero-length
-C<attrname>.  C<attrval> in this struct is zero-length
-to indicate there was an error doing C<lgetxattr> for this
-file, I<or> is a C string which is a decimal number
-(the number of following attributes for this file, which could
-be C<\"0\">).  Then after the first xattr struct are the
-zero or more attributes for the first named file.
-This repeats for the second and subsequent files.
-
-This call is intended for programs that want to efficiently
-list a directory contents without making many round-trips.
-See also C<guestfs_lstatlist> for a similarly efficient call
-for getting standard stats.  Very long directory listings
-might cause the protocol message size to be exceeded, causing
-this call to fail.  The caller must split up such requests
-into smaller groups of names." };
-
-  { defaults with
-    name = "internal_readlinklist"; added = (1, 19, 32);
-    style = RStringList "links", [Pathname "path"; FilenameList "names"], [];
-    proc_nr = Some 206;
-    visibility = VInternal;
-    shortdesc = "readlink on multiple files";
+    shortdesc = "return the size of the file in bytes";
     longdesc = "\
-This call allows you to do a C<readlink> operation
-on multiple files, where all files are in the directory C<path>.
-C<names> is the list of files from this directory.
-
-On return you get a list of strings, with a one-to-one
-correspondence to the C<names> list.  Each string is the
-value of the symbolic link.
-
-If the L<readlink(2)> operation fails on any name, then
-the corresponding result string is the empty string C<\"\">.
-However the whole operation is completed even if there
-were L<readlink(2)> errors, and so you can call this
-function with names where you don't know if they are
-symbolic links already (albeit slightly less efficient).
+This command returns the size of F<file> in bytes.
 
-This call is intended for programs that want to efficiently
-list a directory contents without making many round-trips.
-Very long directory listings might cause the protocol
-message size to be exceeded, causing
-this call to fail.  The caller must split up such requests
-into smaller groups of names." };
+To get other stats about a file, use C<guestfs_stat>, C<guestfs_lstat>,
+C<guestfs_is_dir>, C<guestfs_is_file> etc.
+To get the size of block devices, use C<guestfs_blockdev_getsize64>." };
 
   { defaults with
-    name = "pread"; added = (1, 0, 77);
-    style = RBufferOut "content", [Pathname "path"; Int "count"; Int64 "offset"], [];
-    proc_nr = Some 207;
-    protocol_limit_warning = true;
+    name = "lvrename"; added = (1, 0, 83);
+    style = RErr, [String "logvol"; String "newlogvol"], [];
+    proc_nr = Some 219;
     tests = [
-      InitISOFS, Always, TestResult (
-        [["pread"; "/known-4"; "1"; "3"]],
-        "compare_buffers (ret, size, \"\\n\", 1) == 0"), [];
-      InitISOFS, Always, TestResult (
-        [["pread"; "/empty"; "0"; "100"]],
-        "compare_buffers (ret, size, NULL, 0) == 0"), []
+      InitBasicFSonLVM, Always, TestResult (
+        [["lvrename"; "/dev/VG/LV"; "/dev/VG/LV2"];
+         ["lvs"]],
+        "is_string_list (ret, 1, \"/dev/VG/LV2\")"), []
     ];
-    shortdesc = "read part of a file";
+    shortdesc = "rename an LVM logical volume";
     longdesc = "\
-This command lets you read part of a file.  It reads C<count>
-bytes of the file, starting at C<offset>, from file C<path>.
-
-This may read fewer bytes than requested.  For further details
-see the L<pread(2)> system call.
-
-See also C<guestfs_pwrite>, C<guestfs_pread_device>." };
+Rename a logical volume C<logvol> with the new name C<newlogvol>." };
 
   { defaults with
-    name = "part_init"; added = (1, 0, 78);
-    style = RErr, [Device "device"; String "parttype"], [];
-    proc_nr = Some 208;
+    name = "vgrename"; added = (1, 0, 83);
+    style = RErr, [String "volgroup"; String "newvolgroup"], [];
+    proc_nr = Some 220;
     tests = [
-      InitEmpty, Always, TestRun (
-        [["part_init"; "/dev/sda"; "gpt"]]), []
+      InitBasicFSonLVM, Always, TestResult (
+        [["umount"; "/"; "false"; "false"];
+         ["vg_activate"; "false"; "VG"];
+         ["vgrename"; "VG"; "VG2"];
+         ["vg_activate"; "true"; "VG2"];
+         ["mount"; "/dev/VG2/LV"; "/"];
+         ["vgs"]],
+        "is_string_list (ret, 1, \"VG2\")"), []
     ];
-    shortdesc = "create an empty partition table";
+    shortdesc = "rename an LVM volume group";
     longdesc = "\
-This creates an empty partition table on C<device> of one of the
-partition types listed below.  Usually C<parttype> should be
-either C<msdos> or C<gpt> (for large disks).
-
-Initially there are no partitions.  Following this, you should
-call C<guestfs_part_add> for each partition required.
-
-Possible values for C<parttype> are:
-
-=over 4
+Rename a volume group C<volgroup> with the new name C<newvolgroup>." };
 
-=item B<efi>
+  { defaults with
+    name = "initrd_cat"; added = (1, 0, 84);
+    style = RBufferOut "content", [Pathname "initrdpath"; String "filename"], [];
+    proc_nr = Some 221;
+    protocol_limit_warning = true;
+    tests = [
+      InitISOFS, Always, TestResult (
+        [["initrd_cat"; "/initrd"; "known-4"]],
+        "compare_buffers (ret, size, \"abc\\ndef\\nghi\", 11) == 0"), []
+    ];
+    shortdesc = "list the contents of a single file in an initrd";
+    longdesc = "\
+This command unpacks the file F<filename> from the initrd file
+called F<initrdpath>.  The filename must be given I<without> the
+initial F</> character.
 
-=item B<gpt>
+For example, in guestfish you could use the following command
+to examine the boot script (usually called F</init>)
+contained in a Linux initrd or initramfs image:
 
-Intel EFI / GPT partition table.
+ initrd-cat /boot/initrd-<version>.img init
 
-This is recommended for >= 2 TB partitions that will be accessed
-from Linux and Intel-based Mac OS X.  It also has limited backwards
-compatibility with the C<mbr> format.
+See also C<guestfs_initrd_list>." };
 
-=item B<mbr>
+  { defaults with
+    name = "pvuuid"; added = (1, 0, 87);
+    style = RString "uuid", [Device "device"], [];
+    proc_nr = Some 222;
+    shortdesc = "get the UUID of a physical volume";
+    longdesc = "\
+This command returns the UUID of the LVM PV C<device>." };
 
-=item B<msdos>
+  { defaults with
+    name = "vguuid"; added = (1, 0, 87);
+    style = RString "uuid", [String "vgname"], [];
+    proc_nr = Some 223;
+    shortdesc = "get the UUID of a volume group";
+    longdesc = "\
+This command returns the UUID of the LVM VG named C<vgname>." };
 
-The standard PC \"Master Boot Record\" (MBR) format used
-by MS-DOS and Windows.  This partition type will B<only> work
-for device sizes up to 2 TB.  For large disks we recommend
-using C<gpt>.
+  { defaults with
+    name = "lvuuid"; added = (1, 0, 87);
+    style = RString "uuid", [Device "device"], [];
+    proc_nr = Some 224;
+    shortdesc = "get the UUID of a logical volume";
+    longdesc = "\
+This command returns the UUID of the LVM LV C<device>." };
 
-=back
+  { defaults with
+    name = "vgpvuuids"; added = (1, 0, 87);
+    style = RStringList "uuids", [String "vgname"], [];
+    proc_nr = Some 225;
+    shortdesc = "get the PV UUIDs containing the volume group";
+    longdesc = "\
+Given a VG called C<vgname>, this returns the UUIDs of all
+the physical volumes that this volume group resides on.
 
-Other partition table types that may work but are not
-supported include:
+You can use this along with C<guestfs_pvs> and C<guestfs_pvuuid>
+calls to associate physical volumes and volume groups.
 
-=over 4
+See also C<guestfs_vglvuuids>." };
 
-=item B<aix>
+  { defaults with
+    name = "vglvuuids"; added = (1, 0, 87);
+    style = RStringList "uuids", [String "vgname"], [];
+    proc_nr = Some 226;
+    shortdesc = "get the LV UUIDs of all LVs in the volume group";
+    longdesc = "\
+Given a VG called C<vgname>, this returns the UUIDs of all
+the logical volumes created in this volume group.
 
-AIX disk labels.
+You can use this along with C<guestfs_lvs> and C<guestfs_lvuuid>
+calls to associate logical volumes and volume groups.
 
-=item B<amiga>
+See also C<guestfs_vgpvuuids>." };
 
-=item B<rdb>
+  { defaults with
+    name = "copy_size"; added = (1, 0, 87);
+    style = RErr, [Dev_or_Path "src"; Dev_or_Path "dest"; Int64 "size"], [];
+    proc_nr = Some 227;
+    progress = true; deprecated_by = Some "copy_device_to_device";
+    tests = [
+      InitScratchFS, Always, TestResult (
+        [["mkdir"; "/copy_size"];
+         ["write"; "/copy_size/src"; "hello, world"];
+         ["copy_size"; "/copy_size/src"; "/copy_size/dest"; "5"];
+         ["read_file"; "/copy_size/dest"]],
+        "compare_buffers (ret, size, \"hello\", 5) == 0"), []
+    ];
+    shortdesc = "copy size bytes from source to destination using dd";
+    longdesc = "\
+This command copies exactly C<size> bytes from one source device
+or file C<src> to another destination device or file C<dest>.
 
-Amiga \"Rigid Disk Block\" format.
+Note this will fail if the source is too short or if the destination
+is not large enough." };
 
-=item B<bsd>
+  { defaults with
+    name = "zero_device"; added = (1, 3, 1);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 228;
+    progress = true;
+    tests = [
+      InitBasicFSonLVM, Always, TestRun (
+        [["zero_device"; "/dev/VG/LV"]]), []
+    ];
+    shortdesc = "write zeroes to an entire device";
+    longdesc = "\
+This command writes zeroes over the entire C<device>.  Compare
+with C<guestfs_zero> which just zeroes the first few blocks of
+a device.
 
-BSD disk labels.
+Where the device supports it, the blocks are zeroed by discarding
+them or using a \"write zeroes\" request, so nothing has to be read
+or written.  Otherwise if blocks are already zero, then this command
+avoids writing zeroes.  This prevents the underlying device from
+becoming non-sparse or growing unnecessarily." };
 
-=item B<dasd>
+  { defaults with
+    name = "txz_in"; added = (1, 3, 2);
+    style = RErr, [FileIn "tarball"; Pathname "directory"], [];
+    proc_nr = Some 229;
+    deprecated_by = Some "tar_in";
+    optional = Some "xz"; cancellable = true;
+    tests = [
+      InitScratchFS, Always, TestResultString (
+        [["mkdir"; "/txz_in"];
+         ["txz_in"; "$srcdir/../../test-data/files/helloworld.tar.xz"; "/txz_in"];
+         ["cat"; "/txz_in/hello"]], "hello\n"), []
+    ];
+    shortdesc = "unpack compressed tarball to directory";
+    longdesc = "\
+This command uploads and unpacks local file C<tarball> (an
+I<xz compressed> tar file) into F<directory>." };
 
-DASD, used on IBM mainframes.
+  { defaults with
+    name = "txz_out"; added = (1, 3, 2);
+    style = RErr, [Pathname "directory"; FileOut "tarball"], [];
+    proc_nr = Some 230;
+    deprecated_by = Some "tar_out";
+    optional = Some "xz"; cancellable = true;
+    shortdesc = "pack directory into compressed tarball";
+    longdesc = "\
+This command packs the contents of F<directory> and downloads
+it to local file C<tarball> (as an xz compressed tar archive)." };
 
-=item B<dvh>
+  { defaults with
+    name = "vgscan"; added = (1, 3, 2);
+    style = RErr, [], [];
+    proc_nr = Some 232;
+    tests = [
+      InitEmpty, Always, TestRun (
+        [["vgscan"]]), []
+    ];
+    shortdesc = "rescan for LVM physical volumes, volume groups and logical volumes";
+    longdesc = "\
+This rescans all block devices and rebuilds the list of LVM
+physical volumes, volume groups and logical volumes." };
 
-MIPS/SGI volumes.
+  { defaults with
+    name = "part_del"; added = (1, 3, 2);
+    style = RErr, [Device "device"; Int "partnum"], [];
+    proc_nr = Some 233;
+    tests = [
+      InitEmpty, Always, TestRun (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "primary"; "1"; "-1"];
+         ["part_del"; "/dev/sda"; "1"]]), []
+    ];
+    shortdesc = "delete a partition";
+    longdesc = "\
+This command deletes the partition numbered C<partnum> on C<device>.
 
-=item B<mac>
+Note that in the case of MBR partitioning, deleting an
+extended partition also deletes any logical partitions
+it contains." };
 
-Old Mac partition format.  Modern Macs use C<gpt>.
+  { defaults with
+    name = "part_get_bootable"; added = (1, 3, 2);
+    style = RBool "bootable", [Device "device"; Int "partnum"], [];
+    proc_nr = Some 234;
+    tests = [
+      InitEmpty, Always, TestResultTrue (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "primary"; "1"; "-1"];
+         ["part_set_bootable"; "/dev/sda"; "1"; "true"];
+         ["part_get_bootable"; "/dev/sda"; "1"]]), []
+    ];
+    shortdesc = "return true if a partition is bootable";
+    longdesc = "\
+This command returns true if the partition C<partnum> on
+C<device> has the bootable flag set.
 
-=item B<pc98>
+See also C<guestfs_part_set_bootable>." };
 
-NEC PC-98 format, common in Japan apparently.
+  { defaults with
+    name = "part_get_mbr_id"; added = (1, 3, 2);
+    style = RInt "idbyte", [Device "device"; Int "partnum"], [];
+    proc_nr = Some 235;
+    fish_output = Some FishOutputHexadecimal;
+    tests = [
+      InitEmpty, Always, TestResult (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "primary"; "1"; "-1"];
+         ["part_set_mbr_id"; "/dev/sda"; "1"; "0x7f"];
+         ["part_get_mbr_id"; "/dev/sda"; "1"]], "ret == 0x7f"), []
+    ];
+    shortdesc = "get the MBR type byte (ID byte) from a partition";
+    longdesc = "\
+Returns the MBR type byte (also known as the ID byte) from
+the numbered partition C<partnum>.
 
-=item B<sun>
+Note that only MBR (old DOS-style) partitions have type bytes.
+You will get undefined results for other partition table
+types (see C<guestfs_part_get_parttype>)." };
 
-Sun disk labels.
+  { defaults with
+    name = "part_set_mbr_id"; added = (1, 3, 2);
+    style = RErr, [Device "device"; Int "partnum"; Int "idbyte"], [];
+    proc_nr = Some 236;
+    shortdesc = "set the MBR type byte (ID byte) of a partition";
+    longdesc = "\
+Sets the MBR type byte (also known as the ID byte) of
+the numbered partition C<partnum> to C<idbyte>.  Note
+that the type bytes quoted in most documentation are
+in fact hexadecimal numbers, but usually documented
+without any leading \"0x\" which might be confusing.
 
-=back" };
+Note that only MBR (old DOS-style) partitions have type bytes.
+You will get undefined results for other partition table
+types (see C<guestfs_part_get_parttype>)." };
 
   { defaults with
-    name = "part_add"; added = (1, 0, 78);
-    style = RErr, [Device "device"; String "prlogex"; Int64 "startsect"; Int64 "endsect"], [];
-    proc_nr = Some 209;
+    name = "checksum_device"; added = (1, 3, 2);
+    style = RString "checksum", [String "csumtype"; Device "device"], [];
+    proc_nr = Some 237;
+    reentrant = true;
     tests = [
-      InitEmpty, Always, TestRun (
-        [["part_init"; "/dev/sda"; "mbr"];
-         ["part_add"; "/dev/sda"; "primary"; "1"; "-1"]]), [];
-      InitEmpty, Always, TestRun (
-        [["part_init"; "/dev/sda"; "gpt"];
-         ["part_add"; "/dev/sda"; "primary"; "34"; "127"];
-         ["part_add"; "/dev/sda"; "primary"; "128"; "-34"]]), [];
-      InitEmpty, Always, TestRun (
-        [["part_init"; "/dev/sda"; "mbr"];
-         ["part_add"; "/dev/sda"; "primary"; "32"; "127"];
-         ["part_add"; "/dev/sda"; "primary"; "128"; "255"];
-         ["part_add"; "/dev/sda"; "primary"; "256"; "511"];
-         ["part_add"; "/dev/sda"; "primary"; "512"; "-1"]]), []
+      InitISOFS, Always, TestResult (
+        [["checksum_device"; "md5"; "/dev/sdd"]],
+        "check_file_md5 (ret, \"../../test-data/test.iso\") == 0"), []
     ];
-    shortdesc = "add a partition to the device";
+    shortdesc = "compute MD5, SHAx or CRC checksum of the contents of a device";
     longdesc = "\
-This command adds a partition to C<device>.  If there is no partition
-table on the device, call C<guestfs_part_init> first.
-
-The C<prlogex> parameter is the type of partition.  Normally you
-should pass C<p> or C<primary> here, but MBR partition tables also
-support C<l> (or C<logical>) and C<e> (or C<extended>) partition
-types.
-
-C<startsect> and C<endsect> are the start and end of the partition
-in I<sectors>.  C<endsect> may be negative, which means it counts
-backwards from the end of the disk (C<-1> is the last sector).
-
-Creating a partition which covers the whole disk is not so easy.
-Use C<guestfs_part_disk> to do that." };
+This call computes the MD5, SHAx or CRC checksum of the
+contents of the device named C<device>.  For the types of
+checksums supported see the C<guestfs_checksum> command." };
 
   { defaults with
-    name = "part_disk"; added = (1, 0, 78);
-    style = RErr, [Device "device"; String "parttype"], [];
-    proc_nr = Some 210;
+    name = "lvresize_free"; added = (1, 3, 3);
+    style = RErr, [Device "lv"; Int "percent"], [];
+    proc_nr = Some 238;
+    optional = Some "lvm2";
     tests = [
-      InitEmpty, Always, TestRun (
-        [["part_disk"; "/dev/sda"; "mbr"]]), [];
-      InitEmpty, Always, TestRun (
-        [["part_disk"; "/dev/sda"; "gpt"]]), []
+      InitNone, Always, TestRun (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["pvcreate"; "/dev/sda1"];
+         ["vgcreate"; "VG"; "/dev/sda1"];
+         ["lvcreate"; "LV"; "VG"; "10"];
+         ["lvresize_free"; "/dev/VG/LV"; "100"]]), []
     ];
-    shortdesc = "partition whole disk with a single primary partition";
+    shortdesc = "expand an LV to fill free space";
     longdesc = "\
-This command is simply a combination of C<guestfs_part_init>
-followed by C<guestfs_part_add> to create a single primary partition
-covering the whole disk.
+This expands an existing logical volume C<lv> so that it fills
+C<pc>% of the remaining free space in the volume group.  Commonly
+you would call this with pc = 100 which expands the logical volume
+as much as possible, using all remaining free space in the volume
+group." };
 
-C<parttype> is the partition table type, usually C<mbr> or C<gpt>,
-but other possible values are described in C<guestfs_part_init>." };
+  { defaults with
+    name = "aug_clear"; added = (1, 3, 4);
+    style = RErr, [String "augpath"], [];
+    proc_nr = Some 239;
+    shortdesc = "clear Augeas path";
+    longdesc = "\
+Set the value associated with C<path> to C<NULL>.  This
+is the same as the L<augtool(1)> C<clear> command." };
 
   { defaults with
-    name = "part_set_bootable"; added = (1, 0, 78);
-    style = RErr, [Device "device"; Int "partnum"; Bool "bootable"], [];
-    proc_nr = Some 211;
+    name = "get_umask"; added = (1, 3, 4);
+    style = RInt "mask", [], [];
+    proc_nr = Some 240;
+    fish_output = Some FishOutputOctal;
     tests = [
-      InitEmpty, Always, TestRun (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["part_set_bootable"; "/dev/sda"; "1"; "true"]]), []
+      InitEmpty, Always, TestResult (
+        [["get_umask"]], "ret == 022"), []
     ];
-    shortdesc = "make a partition bootable";
+    shortdesc = "get the current umask";
     longdesc = "\
-This sets the bootable flag on partition numbered C<partnum> on
-device C<device>.  Note that partitions are numbered from 1.
+Return the current umask.  By default the umask is C<022>
+unless it has been set by calling C<guestfs_umask>." };
 
-The bootable flag is used by some operating systems (notably
-Windows) to determine which partition to boot from.  It is by
-no means universally recognized." };
+  { defaults with
+    name = "debug_upload"; added = (1, 3, 5);
+    style = RErr, [FileIn "filename"; String "tmpname"; Int "mode"], [];
+    proc_nr = Some 241;
+    visibility = VDebug;
+    cancellable = true;
+    shortdesc = "upload a file to the appliance (internal use only)";
+    longdesc = "\
+The C<guestfs_debug_upload> command uploads a file to
+the libguestfs appliance.
+
+There is no comprehensive help for this command.  You have
+to look at the file F<daemon/debug.c> in the libguestfs source
+to find out what it is for." };
 
   { defaults with
-    name = "part_set_name"; added = (1, 0, 78);
-    style = RErr, [Device "device"; Int "partnum"; String "name"], [];
-    proc_nr = Some 212;
+    name = "base64_in"; added = (1, 3, 5);
+    style = RErr, [FileIn "base64file"; Pathname "filename"], [];
+    proc_nr = Some 242;
+    cancellable = true;
     tests = [
-      InitEmpty, Always, TestRun (
-        [["part_disk"; "/dev/sda"; "gpt"];
-         ["part_set_name"; "/dev/sda"; "1"; "thepartname"]]), []
+      InitScratchFS, Always, TestResultString (
+        [["base64_in"; "../../test-data/files/hello.b64"; "/base64_in"];
+         ["cat"; "/base64_in"]], "hello\n"), []
     ];
-    shortdesc = "set partition name";
+    shortdesc = "upload base64-encoded data to file";
     longdesc = "\
-This sets the partition name on partition numbered C<partnum> on
-device C<device>.  Note that partitions are numbered from 1.
+This command uploads base64-encoded data from C<base64file>
+to F<filename>." };
 
-The partition name can only be set on certain types of partition
-table.  This works on C<gpt> but not on C<mbr> partitions." };
+  { defaults with
+    name = "base64_out"; added = (1, 3, 5);
+    style = RErr, [Pathname "filename"; FileOut "base64file"], [];
+    proc_nr = Some 243;
+    cancellable = true;
+    shortdesc = "download file and encode as base64";
+    longdesc = "\
+This command downloads the contents of F<filename>, writing
+it out to local file C<base64file> encoded as base64." };
 
   { defaults with
-    name = "part_list"; added = (1, 0, 78);
-    style = RStructList ("partitions", "partition"), [Device "device"], [];
-    proc_nr = Some 213;
-    tests = [] (* XXX Add a regression test for this. *);
-    shortdesc = "list partitions on a device";
+    name = "checksums_out"; added = (1, 3, 7);
+    style = RErr, [String "csumtype"; Pathname "directory"; FileOut "sumsfile"], [];
+    proc_nr = Some 244;
+    cancellable = true;
+    shortdesc = "compute MD5, SHAx or CRC checksum of files in a directory";
     longdesc = "\
-This command parses the partition table on C<device> and
-returns the list of partitions found.
+This command computes the checksums of all regular files in
+F<directory> and then emits a list of those checksums to
+the local output file C<sumsfile>.
 
-The fields in the returned structure are:
+This can be used for verifying the integrity of a virtual
+machine.  However to be properly secure you should pay
+attention to the output format, which is the same as the
+checksum commands from GNU coreutils print.  In particular
+when the filename contains a backslash or newline character,
+coreutils uses a special backslash syntax.  For more
+information, see the GNU coreutils info file.
 
-=over 4
+The checksums are computed in parallel, using as many
+threads as the appliance has vCPUs (see C<guestfs_set_smp>)." };
 
-=item B<part_num>
+  { defaults with
+    name = "fill_pattern"; added = (1, 3, 12);
+    style = RErr, [String "pattern"; Int "len"; Pathname "path"], [];
+    proc_nr = Some 245;
+    progress = true;
+    tests = [
+      InitScratchFS, Always, TestResult (
+        [["fill_pattern"; "abcdefghijklmnopqrstuvwxyz"; "28"; "/fill_pattern"];
+         ["read_file"; "/fill_pattern"]],
+        "compare_buffers (ret, size, \"abcdefghijklmnopqrstuvwxyzab\", 28) == 0"), []
+    ];
+    shortdesc = "fill a file with a repeating pattern of bytes";
+    longdesc = "\
+This function is like C<guestfs_fill> except that it creates
+a new file of length C<len> containing the repeating pattern
+of bytes in C<pattern>.  The pattern is truncated if necessary
+to ensure the length of the file is exactly C<len> bytes." };
 
-Partition number, counting from 1.
+  { defaults with
+    name = "internal_write"; added = (1, 19, 32);
+    style = RErr, [Pathname "path"; BufferIn "content"], [];
+    proc_nr = Some 246;
+    visibility = VInternal;
+    protocol_limit_warning = true;
+    tests = [
+      InitScratchFS, Always, TestResultString (
+        [["internal_write"; "/internal_write"; "new file contents"];
+         ["cat"; "/internal_write"]], "new file contents"), [];
+      InitScratchFS, Always, TestResultString (
+        [["internal_write"; "/internal_write2"; "\nnew file contents\n"];
+         ["cat"; "/internal_write2"]], "\nnew file contents\n"), [];
+      InitScratchFS, Always, TestResultString (
+        [["internal_write"; "/internal_write3"; "\n\n"];
+         ["cat"; "/internal_write3"]], "\n\n"), [];
+      InitScratchFS, Always, TestResultString (
+        [["internal_write"; "/internal_write4"; ""];
+         ["cat"; "/internal_write4"]], ""), [];
+      InitScratchFS, Always, TestResultString (
+        [["internal_write"; "/internal_write5"; "\n\n\n"];
+         ["cat"; "/internal_write5"]], "\n\n\n"), [];
+      InitScratchFS, Always, TestResultString (
+        [["internal_write"; "/internal_write6"; "\n"];
+         ["cat"; "/internal_write6"]], "\n"), []
+    ];
+    shortdesc = "create a new file";
+    longdesc = "\
+This call creates a file called C<path>.  The content of the
+file is the string C<content> (which can contain any 8 bit data).
 
-=item B<part_start>
+See also C<guestfs_write_append>." };
 
-Start of the partition I<in bytes>.  To get sectors you have to
-divide by the device's sector size, see C<guestfs_blockdev_getss>.
+  { defaults with
+    name = "pwrite"; added = (1, 3, 14);
+    style = RInt "nbytes", [Pathname "path"; BufferIn "content"; Int64 "offset"], [];
+    proc_nr = Some 247;
+    protocol_limit_warning = true;
+    tests = [
+      InitScratchFS, Always, TestResultString (
+        [["write"; "/pwrite"; "new file contents"];
+         ["pwrite"; "/pwrite"; "data"; "4"];
+         ["cat"; "/pwrite"]], "new data contents"), [];
+      InitScratchFS, Always, TestResultString (
+        [["write"; "/pwrite2"; "new file contents"];
+         ["pwrite"; "/pwrite2"; "is extended"; "9"];
+         ["cat"; "/pwrite2"]], "new file is extended"), [];
+      InitScratchFS, Always, TestResultString (
+        [["write"; "/pwrite3"; "new file contents"];
+         ["pwrite"; "/pwrite3"; ""; "4"];
+         ["cat"; "/pwrite3"]], "new file contents"), []
+    ];
+    shortdesc = "write to part of a file";
+    longdesc = "\
+This command writes to part of a file.  It writes the data
+buffer C<content> to the file C<path> starting at offset C<offset>.
 
-=item B<part_end>
+This command implements the L<pwrite(2)> system call, and like
+that system call it may not write the full data requested.  The
+return value is the number of bytes that were actually written
+to the file.  This could even be 0, although short writes are
+unlikely for regular files in ordinary circumstances.
 
-End of the partition in bytes.
+See also C<guestfs_pread>, C<guestfs_pwrite_device>." };
 
-=item B<part_size>
+  { defaults with
+    name = "resize2fs_size"; added = (1, 3, 14);
+    style = RErr, [Device "device"; Int64 "size"], [];
+    proc_nr = Some 248;
+    shortdesc = "resize an ext2, ext3 or ext4 filesystem (with size)";
+    longdesc = "\
+This command is the same as C<guestfs_resize2fs> except that it
+allows you to specify the new size (in bytes) explicitly.
 
-Size of the partition in bytes.
+See also L<guestfs(3)/RESIZE2FS ERRORS>." };
 
-=back" };
+  { defaults with
+    name = "pvresize_size"; added = (1, 3, 14);
+    style = RErr, [Device "device"; Int64 "size"], [];
+    proc_nr = Some 249;
+    optional = Some "lvm2";
+    shortdesc = "resize an LVM physical volume (with size)";
+    longdesc = "\
+This command is the same as C<guestfs_pvresize> except that it
+allows you to specify the new size (in bytes) explicitly." };
 
   { defaults with
-    name = "part_get_parttype"; added = (1, 0, 78);
-    style = RString "parttype", [Device "device"], [];
-    proc_nr = Some 214;
+    name = "ntfsresize_size"; added = (1, 3, 14);
+    style = RErr, [Device "device"; Int64 "size"], [];
+    proc_nr = Some 250;
+    optional = Some "ntfsprogs"; deprecated_by = Some "ntfsresize";
+    shortdesc = "resize an NTFS filesystem (with size)";
+    longdesc = "\
+This command is the same as C<guestfs_ntfsresize> except that it
+allows you to specify the new size (in bytes) explicitly." };
+
+  { defaults with
+    name = "available_all_groups"; added = (1, 3, 15);
+    style = RStringList "groups", [], [];
+    proc_nr = Some 251;
     tests = [
-      InitEmpty, Always, TestResultString (
-        [["part_disk"; "/dev/sda"; "gpt"];
-         ["part_get_parttype"; "/dev/sda"]], "gpt"), []
+      InitNone, Always, TestRun [["available_all_groups"]], []
     ];
-    shortdesc = "get the partition table type";
+    shortdesc = "return a list of all optional groups";
     longdesc = "\
-This command examines the partition table on C<device> and
-returns the partition table type (format) being used.
+This command returns a list of all optional groups that this
+daemon knows about.  Note this returns both supported and unsupported
+groups.  To find out which ones the daemon can actually support
+you have to call C<guestfs_available> / C<guestfs_feature_available>
+on each member of the returned list.
 
-Common return values include: C<msdos> (a DOS/Windows style MBR
-partition table), C<gpt> (a GPT/EFI-style partition table).  Other
-values are possible, although unusual.  See C<guestfs_part_init>
-for a full list." };
+See also C<guestfs_available>, C<guestfs_feature_available>
+and L<guestfs(3)/AVAILABILITY>." };
 
   { defaults with
-    name = "fill"; added = (1, 0, 79);
-    style = RErr, [Int "c"; Int "len"; Pathname "path"], [];
-    proc_nr = Some 215;
-    progress = true;
+    name = "fallocate64"; added = (1, 3, 17);
+    style = RErr, [Pathname "path"; Int64 "len"], [];
+    proc_nr = Some 252;
     tests = [
       InitScratchFS, Always, TestResult (
-        [["fill"; "0x63"; "10"; "/fill"];
-         ["read_file"; "/fill"]],
-        "compare_buffers (ret, size, \"cccccccccc\", 10) == 0"), []
+        [["fallocate64"; "/fallocate64"; "1000000"];
+         ["stat"; "/fallocate64"]], "ret->size == 1000000"), []
     ];
-    shortdesc = "fill a file with octets";
+    shortdesc = "preallocate a file in the guest filesystem";
     longdesc = "\
-This command creates a new file called C<path>.  The initial
-content of the file is C<len> octets of C<c>, where C<c>
-must be a number in the range C<[0..255]>.
+This command preallocates a file (containing zero bytes) named
+C<path> of size C<len> bytes.  If the file exists already, it
+is overwritten.
 
-To fill a file with zero bytes (sparsely), it is
-much more efficient to use C<guestfs_truncate_size>.
-To create a file with a pattern of repeating bytes
-use C<guestfs_fill_pattern>." };
+Note that this call allocates disk blocks for the file.
+To create a sparse file use C<guestfs_truncate_size> instead.
+
+The deprecated call C<guestfs_fallocate> does the same,
+but owing to an oversight it only allowed 30 bit lengths
+to be specified, effectively limiting the maximum size
+of files created through that call to 1GB.
+
+Do not confuse this with the guestfish-specific
+C<alloc> and C<sparse> commands which create
+a file in the host and attach it as a device." };
 
   { defaults with
-    name = "dd"; added = (1, 0, 80);
-    style = RErr, [Dev_or_Path "src"; Dev_or_Path "dest"], [];
-    proc_nr = Some 217;
-    deprecated_by = Some "copy_device_to_device";
+    name = "vfs_label"; added = (1, 3, 18);
+    style = RString "label", [Mountable "mountable"], [];
+    proc_nr = Some 253;
     tests = [
-      InitScratchFS, Always, TestResult (
-        [["mkdir"; "/dd"];
-         ["write"; "/dd/src"; "hello, world"];
-         ["dd"; "/dd/src"; "/dd/dest"];
-         ["read_file"; "/dd/dest"]],
-        "compare_buffers (ret, size, \"hello, world\", 12) == 0"), []
+      InitBasicFS, Always, TestResultString (
+        [["set_label"; "/dev/sda1"; "LTEST"];
+         ["vfs_label"; "/dev/sda1"]], "LTEST"), [];
+      InitEmpty, Always, TestResultString (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["mkfs"; "ext2"; "/dev/sda1"; ""; "NOARG"; ""; ""; "test-label"];
+         ["vfs_label"; "/dev/sda1"]], "test-label"), [];
+      InitEmpty, IfAvailable "btrfs", TestResultString (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["mkfs"; "btrfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; ""];
+         ["set_label"; "/dev/sda1"; "test-label-btrfs"];
+         ["vfs_label"; "/dev/sda1"]], "test-label-btrfs"), [];
     ];
-    shortdesc = "copy from source to destination using dd";
+    shortdesc = "get the filesystem label";
     longdesc = "\
-This command copies from one source device or file C<src>
-to another destination device or file C<dest>.  Normally you
-would use this to copy to or from a device or partition, for
-example to duplicate a filesystem.
+This returns the label of the filesystem on C<mountable>.
 
-If the destination is a device, it must be as large or larger
-than the source file or device, otherwise the copy will fail.
-This command cannot do partial copies
-(see C<guestfs_copy_device_to_device>)." };
+If the filesystem is unlabeled, this returns the empty string.
+
+To find a filesystem from the label, use C<guestfs_findfs_label>." };
 
   { defaults with
-    name = "filesize"; added = (1, 0, 82);
-    style = RInt64 "size", [Pathname "file"], [];
-    proc_nr = Some 218;
-    tests = [
-      InitScratchFS, Always, TestResult (
-        [["write"; "/filesize"; "hello, world"];
-         ["filesize"; "/filesize"]], "ret == 12"), []
-    ];
-    shortdesc = "return the size of the file in bytes";
+    name = "vfs_uuid"; added = (1, 3, 18);
+    style = RString "uuid", [Mountable "mountable"], [];
+    fish_alias = ["get-uuid"];
+    proc_nr = Some 254;
+    tests =
+      (let uuid = uuidgen () in [
+        InitBasicFS, Always, TestResultString (
+          [["set_e2uuid"; "/dev/sda1"; uuid];
+           ["vfs_uuid"; "/dev/sda1"]], uuid), []
+      ]);
+    shortdesc = "get the filesystem UUID";
     longdesc = "\
-This command returns the size of F<file> in bytes.
+This returns the filesystem UUID of the filesystem on C<mountable>.
 
-To get other stats about a file, use C<guestfs_stat>, C<guestfs_lstat>,
-C<guestfs_is_dir>, C<guestfs_is_file> etc.
-To get the size of block devices, use C<guestfs_blockdev_getsize64>." };
+If the filesystem does not have a UUID, this returns the empty string.
+
+To find a filesystem from the UUID, use C<guestfs_findfs_uuid>." };
 
   { defaults with
-    name = "lvrename"; added = (1, 0, 83);
-    style = RErr, [String "logvol"; String "newlogvol"], [];
-    proc_nr = Some 219;
-    tests = [
-      InitBasicFSonLVM, Always, TestResult (
-        [["lvrename"; "/dev/VG/LV"; "/dev/VG/LV2"];
-         ["lvs"]],
-        "is_string_list (ret, 1, \"/dev/VG/LV2\")"), []
-    ];
-    shortdesc = "rename an LVM logical volume";
+    name = "lvm_set_filter"; added = (1, 5, 1);
+    style = RErr, [DeviceList "devices"], [];
+    proc_nr = Some 255;
+    optional = Some "lvm2";
+    test_excuse = "cannot be tested with the current framework because the VG is being used by the mounted filesystem, so the 'vgchange -an' command we do first will fail";
+    shortdesc = "set LVM device filter";
     longdesc = "\
-Rename a logical volume C<logvol> with the new name C<newlogvol>." };
+This sets the LVM device filter so that LVM will only be
+able to \"see\" the block devices in the list C<devices>,
+and will ignore all other attached block devices.
+
+Where disk image(s) contain duplicate PVs or VGs, this
+command is useful to get LVM to ignore the duplicates, otherwise
+LVM can get confused.  Note also there are two types
+of duplication possible: either cloned PVs/VGs which have
+identical UUIDs; or VGs that are not cloned but just happen
+to have the same name.  In normal operation you cannot
+create this situation, but you can do it outside LVM, eg.
+by cloning disk images or by bit twiddling inside the LVM
+metadata.
+
+This command also clears the LVM cache and performs a volume
+group scan.
+
+You can filter whole block devices or individual partitions.
+
+You cannot use this if any VG is currently in use (eg.
+contains a mounted filesystem), even if you are not
+filtering out that VG." };
 
   { defaults with
-    name = "vgrename"; added = (1, 0, 83);
-    style = RErr, [String "volgroup"; String "newvolgroup"], [];
-    proc_nr = Some 220;
-    tests = [
-      InitBasicFSonLVM, Always, TestResult (
-        [["umount"; "/"; "false"; "false"];
-         ["vg_activate"; "false"; "VG"];
-         ["vgrename"; "VG"; "VG2"];
-         ["vg_activate"; "true"; "VG2"];
-         ["mount"; "/dev/VG2/LV"; "/"];
-         ["vgs"]],
-        "is_string_list (ret, 1, \"VG2\")"), []
-    ];
-    shortdesc = "rename an LVM volume group";
+    name = "lvm_clear_filter"; added = (1, 5, 1);
+    style = RErr, [], [];
+    proc_nr = Some 256;
+    test_excuse = "cannot be tested with the current framework because the VG is being used by the mounted filesystem, so the 'vgchange -an' command we do first will fail";
+    shortdesc = "clear LVM device filter";
     longdesc = "\
-Rename a volume group C<volgroup> with the new name C<newvolgroup>." };
+This undoes the effect of C<guestfs_lvm_set_filter>.  LVM
+will be able to see every block device.
+
+This command also clears the LVM cache and performs a volume
+group scan." };
 
   { defaults with
-    name = "initrd_cat"; added = (1, 0, 84);
-    style = RBufferOut "content", [Pathname "initrdpath"; String "filename"], [];
-    proc_nr = Some 221;
-    protocol_limit_warning = true;
-    tests = [
-      InitISOFS, Always, TestResult (
-        [["initrd_cat"; "/initrd"; "known-4"]],
-        "compare_buffers (ret, size, \"abc\\ndef\\nghi\", 11) == 0"), []
-    ];
-    shortdesc = "list the contents of a single file in an initrd";
+    name = "luks_open"; added = (1, 5, 1);
+    style = RErr, [Device "device"; Key "key"; String "mapname"], [];
+    proc_nr = Some 257;
+    optional = Some "luks";
+    reentrant = true;
+    shortdesc = "open a LUKS-encrypted block device";
     longdesc = "\
-This command unpacks the file F<filename> from the initrd file
-called F<initrdpath>.  The filename must be given I<without> the
-initial F</> character.
+This command opens a block device which has been encrypted
+according to the Linux Unified Key Setup (LUKS) standard.
 
-For example, in guestfish you could use the following command
-to examine the boot script (usually called F</init>)
-contained in a Linux initrd or initramfs image:
+C<device> is the encrypted block device or partition.
+
+The caller must supply one of the keys associated with the
+LUKS block device, in the C<key> parameter.
 
- initrd-cat /boot/initrd-<version>.img init
+This creates a new block device called F</dev/mapper/mapname>.
+Reads and writes to this block device are decrypted from and
+encrypted to the underlying C<device> respectively.
 
-See also C<guestfs_initrd_list>." };
+If this block device contains LVM volume groups, then
+calling C<guestfs_vgscan> followed by C<guestfs_vg_activate_all>
+will make them visible.
 
-  { defaults with
-    name = "pvuuid"; added = (1, 0, 87);
-    style = RString "uuid", [Device "device"], [];
-    proc_nr = Some 222;
-    shortdesc = "get the UUID of a physical volume";
-    longdesc = "\
-This command returns the UUID of the LVM PV C<device>." };
+Use C<guestfs_list_dm_devices> to list all device mapper
+devices.
+
+Different devices can be opened concurrently, using
+C<guestfs_submit_luks_open> (see L<guestfs(3)/ASYNCHRONOUS CALLS>).
+To skip the key derivation altogether, see
+C<guestfs_luks_open_volume_key>." };
 
   { defaults with
-    name = "vguuid"; added = (1, 0, 87);
-    style = RString "uuid", [String "vgname"], [];
-    proc_nr = Some 223;
-    shortdesc = "get the UUID of a volume group";
+    name = "luks_open_ro"; added = (1, 5, 1);
+    style = RErr, [Device "device"; Key "key"; String "mapname"], [];
+    proc_nr = Some 258;
+    optional = Some "luks";
+    reentrant = true;
+    shortdesc = "open a LUKS-encrypted block device read-only";
     longdesc = "\
-This command returns the UUID of the LVM VG named C<vgname>." };
+This is the same as C<guestfs_luks_open> except that a read-only
+mapping is created." };
 
   { defaults with
-    name = "lvuuid"; added = (1, 0, 87);
-    style = RString "uuid", [Device "device"], [];
-    proc_nr = Some 224;
-    shortdesc = "get the UUID of a logical volume";
+    name = "luks_close"; added = (1, 5, 1);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 259;
+    optional = Some "luks";
+    shortdesc = "close a LUKS device";
     longdesc = "\
-This command returns the UUID of the LVM LV C<device>." };
+This closes a LUKS device that was created earlier by
+C<guestfs_luks_open> or C<guestfs_luks_open_ro>.  The
+C<device> parameter must be the name of the LUKS mapping
+device (ie. F</dev/mapper/mapname>) and I<not> the name
+of the underlying block device." };
 
   { defaults with
-    name = "vgpvuuids"; added = (1, 0, 87);
-    style = RStringList "uuids", [String "vgname"], [];
-    proc_nr = Some 225;
-    shortdesc = "get the PV UUIDs containing the volume group";
+    name = "luks_format"; added = (1, 5, 2);
+    style = RErr, [Device "device"; Key "key"; Int "keyslot"], [];
+    proc_nr = Some 260;
+    optional = Some "luks";
+    shortdesc = "format a block device as a LUKS encrypted device";
     longdesc = "\
-Given a VG called C<vgname>, this returns the UUIDs of all
-the physical volumes that this volume group resides on.
-
-You can use this along with C<guestfs_pvs> and C<guestfs_pvuuid>
-calls to associate physical volumes and volume groups.
-
-See also C<guestfs_vglvuuids>." };
+This command erases existing data on C<device> and formats
+the device as a LUKS encrypted device.  C<key> is the
+initial key, which is added to key slot C<slot>.  (LUKS
+supports 8 key slots, numbered 0-7)." };
 
   { defaults with
-    name = "vglvuuids"; added = (1, 0, 87);
-    style = RStringList "uuids", [String "vgname"], [];
-    proc_nr = Some 226;
-    shortdesc = "get the LV UUIDs of all LVs in the volume group";
+    name = "luks_format_cipher"; added = (1, 5, 2);
+    style = RErr, [Device "device"; Key "key"; Int "keyslot"; String "cipher"], [];
+    proc_nr = Some 261;
+    optional = Some "luks";
+    shortdesc = "format a block device as a LUKS encrypted device";
     longdesc = "\
-Given a VG called C<vgname>, this returns the UUIDs of all
-the logical volumes created in this volume group.
-
-You can use this along with C<guestfs_lvs> and C<guestfs_lvuuid>
-calls to associate logical volumes and volume groups.
-
-See also C<guestfs_vgpvuuids>." };
+This command is the same as C<guestfs_luks_format> but
+it also allows you to set the C<cipher> used." };
 
   { defaults with
-    name = "copy_size"; added = (1, 0, 87);
-    style = RErr, [Dev_or_Path "src"; Dev_or_Path "dest"; Int64 "size"], [];
-    proc_nr = Some 227;
-    progress = true; deprecated_by = Some "copy_device_to_device";
-    tests = [
-      InitScratchFS, Always, TestResult (
-        [["mkdir"; "/copy_size"];
-         ["write"; "/copy_size/src"; "hello, world"];
-         ["copy_size"; "/copy_size/src"; "/copy_size/dest"; "5"];
-         ["read_file"; "/copy_size/dest"]],
-        "compare_buffers (ret, size, \"hello\", 5) == 0"), []
-    ];
-    shortdesc = "copy size bytes from source to destination using dd";
+    name = "luks_add_key"; added = (1, 5, 2);
+    style = RErr, [Device "device"; Key "key"; Key "newkey"; Int "keyslot"], [];
+    proc_nr = Some 262;
+    optional = Some "luks";
+    shortdesc = "add a key on a LUKS encrypted device";
     longdesc = "\
-This command copies exactly C<size> bytes from one source device
-or file C<src> to another destination device or file C<dest>.
+This command adds a new key on LUKS device C<device>.
+C<key> is any existing key, and is used to access the device.
+C<newkey> is the new key to add.  C<keyslot> is the key slot
+that will be replaced.
 
-Note this will fail if the source is too short or if the destination
-is not large enough." };
+Note that if C<keyslot> already contains a key, then this
+command will fail.  You have to use C<guestfs_luks_kill_slot>
+first to remove that key." };
 
   { defaults with
-    name = "zero_device"; added = (1, 3, 1);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 228;
-    progress = true;
-    tests = [
-      InitBasicFSonLVM, Always, TestRun (
-        [["zero_device"; "/dev/VG/LV"]]), []
-    ];
-    shortdesc = "write zeroes to an entire device";
+    name = "luks_kill_slot"; added = (1, 5, 2);
+    style = RErr, [Device "device"; Key "key"; Int "keyslot"], [];
+    proc_nr = Some 263;
+    optional = Some "luks";
+    shortdesc = "remove a key from a LUKS encrypted device";
     longdesc = "\
-This command writes zeroes over the entire C<device>.  Compare
-with C<guestfs_zero> which just zeroes the first few blocks of
-a device.
-
-If blocks are already zero, then this command avoids writing
-zeroes.  This prevents the underlying device from becoming non-sparse
-or growing unnecessarily." };
+This command deletes the key in key slot C<keyslot> from the
+encrypted LUKS device C<device>.  C<key> must be one of the
+I<other> keys." };
 
   { defaults with
-    name = "txz_in"; added = (1, 3, 2);
-    style = RErr, [FileIn "tarball"; Pathname "directory"], [];
-    proc_nr = Some 229;
-    deprecated_by = Some "tar_in";
-    optional = Some "xz"; cancellable = true;
+    name = "is_lv"; added = (1, 5, 3);
+    style = RBool "lvflag", [Mountable "mountable"], [];
+    proc_nr = Some 264;
     tests = [
-      InitScratchFS, Always, TestResultString (
-        [["mkdir"; "/txz_in"];
-         ["txz_in"; "$srcdir/../../test-data/files/helloworld.tar.xz"; "/txz_in"];
-         ["cat"; "/txz_in/hello"]], "hello\n"), []
+      InitBasicFSonLVM, Always, TestResultTrue (
+        [["is_lv"; "/dev/VG/LV"]]), [];
+      InitBasicFSonLVM, Always, TestResultFalse (
+        [["is_lv"; "/dev/sda1"]]), []
     ];
-    shortdesc = "unpack compressed tarball to directory";
+    shortdesc = "test if mountable is a logical volume";
     longdesc = "\
-This command uploads and unpacks local file C<tarball> (an
-I<xz compressed> tar file) into F<directory>." };
+This command tests whether C<mountable> is a logical volume, and
+returns true iff this is the case." };
 
   { defaults with
-    name = "txz_out"; added = (1, 3, 2);
-    style = RErr, [Pathname "directory"; FileOut "tarball"], [];
-    proc_nr = Some 230;
-    deprecated_by = Some "tar_out";
-    optional = Some "xz"; cancellable = true;
-    shortdesc = "pack directory into compressed tarball";
+    name = "findfs_uuid"; added = (1, 5, 3);
+    style = RString "device", [String "uuid"], [];
+    proc_nr = Some 265;
+    shortdesc = "find a filesystem by UUID";
     longdesc = "\
-This command packs the contents of F<directory> and downloads
-it to local file C<tarball> (as an xz compressed tar archive)." };
+This command searches the filesystems and returns the one
+which has the given UUID.  An error is returned if no such
+filesystem can be found.
 
-  { defaults with
-    name = "vgscan"; added = (1, 3, 2);
-    style = RErr, [], [];
-    proc_nr = Some 232;
-    tests = [
-      InitEmpty, Always, TestRun (
-        [["vgscan"]]), []
-    ];
-    shortdesc = "rescan for LVM physical volumes, volume groups and logical volumes";
-    longdesc = "\
-This rescans all block devices and rebuilds the list of LVM
-physical volumes, volume groups and logical volumes." };
+To find the UUID of a filesystem, use C<guestfs_vfs_uuid>." };
 
   { defaults with
-    name = "part_del"; added = (1, 3, 2);
-    style = RErr, [Device "device"; Int "partnum"], [];
-    proc_nr = Some 233;
-    tests = [
-      InitEmpty, Always, TestRun (
-        [["part_init"; "/dev/sda"; "mbr"];
-         ["part_add"; "/dev/sda"; "primary"; "1"; "-1"];
-         ["part_del"; "/dev/sda"; "1"]]), []
-    ];
-    shortdesc = "delete a partition";
+    name = "findfs_label"; added = (1, 5, 3);
+    style = RString "device", [String "label"], [];
+    proc_nr = Some 266;
+    shortdesc = "find a filesystem by label";
     longdesc = "\
-This command deletes the partition numbered C<partnum> on C<device>.
+This command searches the filesystems and returns the one
+which has the given label.  An error is returned if no such
+filesystem can be found.
 
-Note that in the case of MBR partitioning, deleting an
-extended partition also deletes any logical partitions
-it contains." };
+To find the label of a filesystem, use C<guestfs_vfs_label>." };
 
   { defaults with
-    name = "part_get_bootable"; added = (1, 3, 2);
-    style = RBool "bootable", [Device "device"; Int "partnum"], [];
-    proc_nr = Some 234;
+    name = "is_chardev"; added = (1, 5, 10);
+    style = RBool "flag", [Pathname "path"], [OBool "followsymlinks"];
+    proc_nr = Some 267;
+    once_had_no_optargs = true;
     tests = [
-      InitEmpty, Always, TestResultTrue (
-        [["part_init"; "/dev/sda"; "mbr"];
-         ["part_add"; "/dev/sda"; "primary"; "1"; "-1"];
-         ["part_set_bootable"; "/dev/sda"; "1"; "true"];
-         ["part_get_bootable"; "/dev/sda"; "1"]]), []
+      InitISOFS, Always, TestResultFalse (
+        [["is_chardev"; "/directory"; ""]]), [];
+      InitScratchFS, Always, TestResultTrue (
+        [["mknod_c"; "0o777"; "99"; "66"; "/is_chardev"];
+         ["is_chardev"; "/is_chardev"; ""]]), []
     ];
-    shortdesc = "return true if a partition is bootable";
+    shortdesc = "test if character device";
     longdesc = "\
-This command returns true if the partition C<partnum> on
-C<device> has the bootable flag set.
+This returns C<true> if and only if there is a character device
+with the given C<path> name.
 
-See also C<guestfs_part_set_bootable>." };
+If the optional flag C<followsymlinks> is true, then a symlink
+(or chain of symlinks) that ends with a chardev also causes the
+function to return true.
+
+See also C<guestfs_stat>." };
 
   { defaults with
-    name = "part_get_mbr_id"; added = (1, 3, 2);
-    style = RInt "idbyte", [Device "device"; Int "partnum"], [];
-    proc_nr = Some 235;
-    fish_output = Some FishOutputHexadecimal;
+    name = "is_blockdev"; added = (1, 5, 10);
+    style = RBool "flag", [Pathname "path"], [OBool "followsymlinks"];
+    proc_nr = Some 268;
+    once_had_no_optargs = true;
     tests = [
-      InitEmpty, Always, TestResult (
-        [["part_init"; "/dev/sda"; "mbr"];
-         ["part_add"; "/dev/sda"; "primary"; "1"; "-1"];
-         ["part_set_mbr_id"; "/dev/sda"; "1"; "0x7f"];
-         ["part_get_mbr_id"; "/dev/sda"; "1"]], "ret == 0x7f"), []
+      InitISOFS, Always, TestResultFalse (
+        [["is_blockdev"; "/directory"; ""]]), [];
+      InitScratchFS, Always, TestResultTrue (
+        [["mknod_b"; "0o777"; "99"; "66"; "/is_blockdev"];
+         ["is_blockdev"; "/is_blockdev"; ""]]), []
     ];
-    shortdesc = "get the MBR type byte (ID byte) from a partition";
+    shortdesc = "test if block device";
     longdesc = "\
-Returns the MBR type byte (also known as the ID byte) from
-the numbered partition C<partnum>.
+This returns C<true> if and only if there is a block device
+with the given C<path> name.
 
-Note that only MBR (old DOS-style) partitions have type bytes.
-You will get undefined results for other partition table
-types (see C<guestfs_part_get_parttype>)." };
+If the optional flag C<followsymlinks> is true, then a symlink
+(or chain of symlinks) that ends with a block device also causes the
+function to return true.
 
-  { defaults with
-    name = "part_set_mbr_id"; added = (1, 3, 2);
-    style = RErr, [Device "device"; Int "partnum"; Int "idbyte"], [];
-    proc_nr = Some 236;
-    shortdesc = "set the MBR type byte (ID byte) of a partition";
-    longdesc = "\
-Sets the MBR type byte (also known as the ID byte) of
-the numbered partition C<partnum> to C<idbyte>.  Note
-that the type bytes quoted in most documentation are
-in fact hexadecimal numbers, but usually documented
-without any leading \"0x\" which might be confusing.
+This call only looks at files within the guest filesystem.  Libguestfs
+partitions and block devices (eg. F</dev/sda>) cannot be used as the
+C<path> parameter of this call.
 
-Note that only MBR (old DOS-style) partitions have type bytes.
-You will get undefined results for other partition table
-types (see C<guestfs_part_get_parttype>)." };
+See also C<guestfs_stat>." };
 
   { defaults with
-    name = "checksum_device"; added = (1, 3, 2);
-    style = RString "checksum", [String "csumtype"; Device "device"], [];
-    proc_nr = Some 237;
+    name = "is_fifo"; added = (1, 5, 10);
+    style = RBool "flag", [Pathname "path"], [OBool "followsymlinks"];
+    proc_nr = Some 269;
+    once_had_no_optargs = true;
     tests = [
-      InitISOFS, Always, TestResult (
-        [["checksum_device"; "md5"; "/dev/sdd"]],
-        "check_file_md5 (ret, \"../../test-data/test.iso\") == 0"), []
+      InitISOFS, Always, TestResultFalse (
+        [["is_fifo"; "/directory"; ""]]), [];
+      InitScratchFS, Always, TestResultTrue (
+        [["mkfifo"; "0o777"; "/is_fifo"];
+         ["is_fifo"; "/is_fifo"; ""]]), []
     ];
-    shortdesc = "compute MD5, SHAx or CRC checksum of the contents of a device";
+    shortdesc = "test if FIFO (named pipe)";
     longdesc = "\
-This call computes the MD5, SHAx or CRC checksum of the
-contents of the device named C<device>.  For the types of
-checksums supported see the C<guestfs_checksum> command." };
+This returns C<true> if and only if there is a FIFO (named pipe)
+with the given C<path> name.
+
+If the optional flag C<followsymlinks> is true, then a symlink
+(or chain of symlinks) that ends with a FIFO also causes the
+function to return true.
+
+See also C<guestfs_stat>." };
 
   { defaults with
-    name = "lvresize_free"; added = (1, 3, 3);
-    style = RErr, [Device "lv"; Int "percent"], [];
-    proc_nr = Some 238;
-    optional = Some "lvm2";
+    name = "is_symlink"; added = (1, 5, 10);
+    style = RBool "flag", [Pathname "path"], [];
+    proc_nr = Some 270;
     tests = [
-      InitNone, Always, TestRun (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["pvcreate"; "/dev/sda1"];
-         ["vgcreate"; "VG"; "/dev/sda1"];
-         ["lvcreate"; "LV"; "VG"; "10"];
-         ["lvresize_free"; "/dev/VG/LV"; "100"]]), []
+      InitISOFS, Always, TestResultFalse (
+        [["is_symlink"; "/directory"]]), [];
+      InitISOFS, Always, TestResultTrue (
+        [["is_symlink"; "/abssymlink"]]), []
     ];
-    shortdesc = "expand an LV to fill free space";
+    shortdesc = "test if symbolic link";
     longdesc = "\
-This expands an existing logical volume C<lv> so that it fills
-C<pc>% of the remaining free space in the volume group.  Commonly
-you would call this with pc = 100 which expands the logical volume
-as much as possible, using all remaining free space in the volume
-group." };
+This returns C<true> if and only if there is a symbolic link
+with the given C<path> name.
 
-  { defaults with
-    name = "aug_clear"; added = (1, 3, 4);
-    style = RErr, [String "augpath"], [];
-    proc_nr = Some 239;
-    shortdesc = "clear Augeas path";
-    longdesc = "\
-Set the value associated with C<path> to C<NULL>.  This
-is the same as the L<augtool(1)> C<clear> command." };
+See also C<guestfs_stat>." };
 
   { defaults with
-    name = "get_umask"; added = (1, 3, 4);
-    style = RInt "mask", [], [];
-    proc_nr = Some 240;
-    fish_output = Some FishOutputOctal;
+    name = "is_socket"; added = (1, 5, 10);
+    style = RBool "flag", [Pathname "path"], [OBool "followsymlinks"];
+    proc_nr = Some 271;
+    once_had_no_optargs = true;
+    (* XXX Need a positive test for sockets. *)
     tests = [
-      InitEmpty, Always, TestResult (
-        [["get_umask"]], "ret == 022"), []
+      InitISOFS, Always, TestResultFalse (
+        [["is_socket"; "/directory"; ""]]), []
     ];
-    shortdesc = "get the current umask";
+    shortdesc = "test if socket";
     longdesc = "\
-Return the current umask.  By default the umask is C<022>
-unless it has been set by calling C<guestfs_umask>." };
+This returns C<true> if and only if there is a Unix domain socket
+with the given C<path> name.
 
-  { defaults with
-    name = "debug_upload"; added = (1, 3, 5);
-    style = RErr, [FileIn "filename"; String "tmpname"; Int "mode"], [];
-    proc_nr = Some 241;
-    visibility = VDebug;
-    cancellable = true;
-    shortdesc = "upload a file to the appliance (internal use only)";
-    longdesc = "\
-The C<guestfs_debug_upload> command uploads a file to
-the libguestfs appliance.
+If the optional flag C<followsymlinks> is true, then a symlink
+(or chain of symlinks) that ends with a socket also causes the
+function to return true.
 
-There is no comprehensive help for this command.  You have
-to look at the file F<daemon/debug.c> in the libguestfs source
-to find out what it is for." };
+See also C<guestfs_stat>." };
 
   { defaults with
-    name = "base64_in"; added = (1, 3, 5);
-    style = RErr, [FileIn "base64file"; Pathname "filename"], [];
-    proc_nr = Some 242;
-    cancellable = true;
+    name = "part_to_dev"; added = (1, 5, 15);
+    style = RString "device", [Device "partition"], [];
+    proc_nr = Some 272;
     tests = [
-      InitScratchFS, Always, TestResultString (
-        [["base64_in"; "../../test-data/files/hello.b64"; "/base64_in"];
-         ["cat"; "/base64_in"]], "hello\n"), []
+      InitPartition, Always, TestResultDevice (
+        [["part_to_dev"; "/dev/sda1"]], "/dev/sda"), [];
+      InitEmpty, Always, TestLastFail (
+        [["part_to_dev"; "/dev/sda"]]), []
     ];
-    shortdesc = "upload base64-encoded data to file";
+    shortdesc = "convert partition name to device name";
     longdesc = "\
-This command uploads base64-encoded data from C<base64file>
-to F<filename>." };
+This function takes a partition name (eg. \"/dev/sdb1\") and
+removes the partition number, returning the device name
+(eg. \"/dev/sdb\").
 
-  { defaults with
-    name = "base64_out"; added = (1, 3, 5);
-    style = RErr, [Pathname "filename"; FileOut "base64file"], [];
-    proc_nr = Some 243;
-    cancellable = true;
-    shortdesc = "download file and encode as base64";
-    longdesc = "\
-This command downloads the contents of F<filename>, writing
-it out to local file C<base64file> encoded as base64." };
+The named partition must exist, for example as a string returned
+from C<guestfs_list_partitions>.
+
+See also C<guestfs_part_to_partnum>, C<guestfs_device_index>." };
 
   { defaults with
-    name = "checksums_out"; added = (1, 3, 7);
-    style = RErr, [String "csumtype"; Pathname "directory"; FileOut "sumsfile"], [];
-    proc_nr = Some 244;
-    cancellable = true;
-    shortdesc = "compute MD5, SHAx or CRC checksum of files in a directory";
+    name = "upload_offset"; added = (1, 5, 17);
+    style = RErr, [FileIn "filename"; Dev_or_Path "remotefilename"; Int64 "offset"], [];
+    proc_nr = Some 273;
+    progress = true; cancellable = true;
+    tests =
+      (let md5 = Digest.to_hex (Digest.file "COPYING.LIB") in [
+        InitScratchFS, Always, TestResultString (
+          [["upload_offset"; "$srcdir/../../COPYING.LIB"; "/upload_offset"; "0"];
+           ["checksum"; "md5"; "/upload_offset"]], md5), []
+      ]);
+    shortdesc = "upload a file from the local machine with offset";
     longdesc = "\
-This command computes the checksums of all regular files in
-F<directory> and then emits a list of those checksums to
-the local output file C<sumsfile>.
+Upload local file F<filename> to F<remotefilename> on the
+filesystem.
 
-This can be used for verifying the integrity of a virtual
-machine.  However to be properly secure you should pay
-attention to the output of the checksum command (it uses
-the ones from GNU coreutils).  In particular when the
-filename is not printable, coreutils uses a special
-backslash syntax.  For more information, see the GNU
-coreutils info file." };
+F<remotefilename> is overwritten starting at the byte C<offset>
+specified.  The intention is to overwrite parts of existing
+files or devices, although if a non-existent file is specified
+then it is created with a \"hole\" before C<offset>.  The
+size of the data written is implicit in the size of the
+source F<filename>.
 
-  { defaults with
-    name = "fill_pattern"; added = (1, 3, 12);
-    style = RErr, [String "pattern"; Int "len"; Pathname "path"], [];
-    proc_nr = Some 245;
-    progress = true;
-    tests = [
-      InitScratchFS, Always, TestResult (
-        [["fill_pattern"; "abcdefghijklmnopqrstuvwxyz"; "28"; "/fill_pattern"];
-         ["read_file"; "/fill_pattern"]],
-        "compare_buffers (ret, size, \"abcdefghijklmnopqrstuvwxyzab\", 28) == 0"), []
-    ];
-    shortdesc = "fill a file with a repeating pattern of bytes";
-    longdesc = "\
-This function is like C<guestfs_fill> except that it creates
-a new file of length C<len> containing the repeating pattern
-of bytes in C<pattern>.  The pattern is truncated if necessary
-to ensure the length of the file is exactly C<len> bytes." };
+Note that there is no limit on the amount of data that
+can be uploaded with this call, unlike with C<guestfs_pwrite>,
+and this call always writes the full amount unless an
+error occurs.
+
+See also C<guestfs_upload>, C<guestfs_pwrite>." };
 
   { defaults with
-    name = "internal_write"; added = (1, 19, 32);
-    style = RErr, [Pathname "path"; BufferIn "content"], [];
-    proc_nr = Some 246;
-    visibility = VInternal;
-    protocol_limit_warning = true;
-    tests = [
-      InitScratchFS, Always, TestResultString (
-        [["internal_write"; "/internal_write"; "new file contents"];
-         ["cat"; "/internal_write"]], "new file contents"), [];
-      InitScratchFS, Always, TestResultString (
-        [["internal_write"; "/internal_write2"; "\nnew file contents\n"];
-         ["cat"; "/internal_write2"]], "\nnew file contents\n"), [];
-      InitScratchFS, Always, TestResultString (
-        [["internal_write"; "/internal_write3"; "\n\n"];
-         ["cat"; "/internal_write3"]], "\n\n"), [];
-      InitScratchFS, Always, TestResultString (
-        [["internal_write"; "/internal_write4"; ""];
-         ["cat"; "/internal_write4"]], ""), [];
-      InitScratchFS, Always, TestResultString (
-        [["internal_write"; "/internal_write5"; "\n\n\n"];
-         ["cat"; "/internal_write5"]], "\n\n\n"), [];
-      InitScratchFS, Always, TestResultString (
-        [["internal_write"; "/internal_write6"; "\n"];
-         ["cat"; "/internal_write6"]], "\n"), []
-    ];
-    shortdesc = "create a new file";
+    name = "download_offset"; added = (1, 5, 17);
+    style = RErr, [Dev_or_Path "remotefilename"; FileOut "filename"; Int64 "offset"; Int64 "size"], [];
+    proc_nr = Some 274;
+    progress = true; cancellable = true;
+    tests =
+      (let md5 = Digest.to_hex (Digest.file "COPYING.LIB") in
+       let offset = string_of_int 100 in
+       let size = string_of_int ((Unix.stat "COPYING.LIB").Unix.st_size - 100) in
+       [
+         InitScratchFS, Always, TestResultString (
+           (* Pick a file from cwd which isn't likely to change. *)
+           [["mkdir"; "/download_offset"];
+            ["upload"; "$srcdir/../../COPYING.LIB"; "/download_offset/COPYING.LIB"];
+            ["download_offset"; "/download_offset/COPYING.LIB"; "testdownload.tmp"; offset; size];
+            ["upload_offset"; "testdownload.tmp"; "/download_offset/COPYING.LIB"; offset];
+            ["checksum"; "md5"; "/download_offset/COPYING.LIB"]], md5), []
+       ]);
+    shortdesc = "download a file to the local machine with offset and size";
     longdesc = "\
-This call creates a file called C<path>.  The content of the
-file is the string C<content> (which can contain any 8 bit data).
+Download file F<remotefilename> and save it as F<filename>
+on the local machine.
 
-See also C<guestfs_write_append>." };
+F<remotefilename> is read for C<size> bytes starting at C<offset>
+(this region must be within the file or device).
+
+Note that there is no limit on the amount of data that
+can be downloaded with this call, unlike with C<guestfs_pread>,
+and this call always reads the full amount unless an
+error occurs.
+
+See also C<guestfs_download>, C<guestfs_pread>." };
 
   { defaults with
-    name = "pwrite"; added = (1, 3, 14);
-    style = RInt "nbytes", [Pathname "path"; BufferIn "content"; Int64 "offset"], [];
-    proc_nr = Some 247;
+    name = "pwrite_device"; added = (1, 5, 20);
+    style = RInt "nbytes", [Device "device"; BufferIn "content"; Int64 "offset"], [];
+    proc_nr = Some 275;
     protocol_limit_warning = true;
     tests = [
-      InitScratchFS, Always, TestResultString (
-        [["write"; "/pwrite"; "new file contents"];
-         ["pwrite"; "/pwrite"; "data"; "4"];
-         ["cat"; "/pwrite"]], "new data contents"), [];
-      InitScratchFS, Always, TestResultString (
-        [["write"; "/pwrite2"; "new file contents"];
-         ["pwrite"; "/pwrite2"; "is extended"; "9"];
-         ["cat"; "/pwrite2"]], "new file is extended"), [];
-      InitScratchFS, Always, TestResultString (
-        [["write"; "/pwrite3"; "new file contents"];
-         ["pwrite"; "/pwrite3"; ""; "4"];
-         ["cat"; "/pwrite3"]], "new file contents"), []
+      InitPartition, Always, TestResult (
+        [["pwrite_device"; "/dev/sda"; "\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"; "446"];
+         ["blockdev_rereadpt"; "/dev/sda"];
+         ["list_partitions"]],
+        "is_device_list (ret, 1, \"/dev/sdb1\")"), []
     ];
-    shortdesc = "write to part of a file";
+    shortdesc = "write to part of a device";
     longdesc = "\
-This command writes to part of a file.  It writes the data
-buffer C<content> to the file C<path> starting at offset C<offset>.
+This command writes to part of a device.  It writes the data
+buffer C<content> to C<device> starting at offset C<offset>.
 
 This command implements the L<pwrite(2)> system call, and like
-that system call it may not write the full data requested.  The
-return value is the number of bytes that were actually written
-to the file.  This could even be 0, although short writes are
-unlikely for regular files in ordinary circumstances.
-
-See also C<guestfs_pread>, C<guestfs_pwrite_device>." };
-
-  { defaults with
-    name = "resize2fs_size"; added = (1, 3, 14);
-    style = RErr, [Device "device"; Int64 "size"], [];
-    proc_nr = Some 248;
-    shortdesc = "resize an ext2, ext3 or ext4 filesystem (with size)";
-    longdesc = "\
-This command is the same as C<guestfs_resize2fs> except that it
-allows you to specify the new size (in bytes) explicitly.
-
-See also L<guestfs(3)/RESIZE2FS ERRORS>." };
-
-  { defaults with
-    name = "pvresize_size"; added = (1, 3, 14);
-    style = RErr, [Device "device"; Int64 "size"], [];
-    proc_nr = Some 249;
-    optional = Some "lvm2";
-    shortdesc = "resize an LVM physical volume (with size)";
-    longdesc = "\
-This command is the same as C<guestfs_pvresize> except that it
-allows you to specify the new size (in bytes) explicitly." };
+that system call it may not write the full data requested
+(although short writes to disk devices and partitions are
+probably impossible with standard Linux kernels).
 
-  { defaults with
-    name = "ntfsresize_size"; added = (1, 3, 14);
-    style = RErr, [Device "device"; Int64 "size"], [];
-    proc_nr = Some 250;
-    optional = Some "ntfsprogs"; deprecated_by = Some "ntfsresize";
-    shortdesc = "resize an NTFS filesystem (with size)";
-    longdesc = "\
-This command is the same as C<guestfs_ntfsresize> except that it
-allows you to specify the new size (in bytes) explicitly." };
+See also C<guestfs_pwrite>." };
 
   { defaults with
-    name = "available_all_groups"; added = (1, 3, 15);
-    style = RStringList "groups", [], [];
-    proc_nr = Some 251;
+    name = "pread_device"; added = (1, 5, 21);
+    style = RBufferOut "content", [Device "device"; Int "count"; Int64 "offset"], [];
+    proc_nr = Some 276;
+    protocol_limit_warning = true;
     tests = [
-      InitNone, Always, TestRun [["available_all_groups"]], []
+      InitEmpty, Always, TestResult (
+        [["pread_device"; "/dev/sdd"; "8"; "32768"]],
+        "compare_buffers (ret, size, \"\\1CD001\\1\\0\", 8) == 0"), []
     ];
-    shortdesc = "return a list of all optional groups";
+    shortdesc = "read part of a device";
     longdesc = "\
-This command returns a list of all optional groups that this
-daemon knows about.  Note this returns both supported and unsupported
-groups.  To find out which ones the daemon can actually support
-you have to call C<guestfs_available> / C<guestfs_feature_available>
-on each member of the returned list.
+This command lets you read part of a block device.  It reads C<count>
+bytes of C<device>, starting at C<offset>.
 
-See also C<guestfs_available>, C<guestfs_feature_available>
-and L<guestfs(3)/AVAILABILITY>." };
+This may read fewer bytes than requested.  For further details
+see the L<pread(2)> system call.
+
+See also C<guestfs_pread>." };
 
   { defaults with
-    name = "fallocate64"; added = (1, 3, 17);
-    style = RErr, [Pathname "path"; Int64 "len"], [];
-    proc_nr = Some 252;
+    name = "lvm_canonical_lv_name"; added = (1, 5, 24);
+    style = RString "lv", [Device "lvname"], [];
+    proc_nr = Some 277;
     tests = [
-      InitScratchFS, Always, TestResult (
-        [["fallocate64"; "/fallocate64"; "1000000"];
-         ["stat"; "/fallocate64"]], "ret->size == 1000000"), []
+      InitBasicFSonLVM, IfAvailable "lvm2", TestResultString (
+        [["lvm_canonical_lv_name"; "/dev/mapper/VG-LV"]], "/dev/VG/LV"), [];
+      InitBasicFSonLVM, IfAvailable "lvm2", TestResultString (
+        [["lvm_canonical_lv_name"; "/dev/VG/LV"]], "/dev/VG/LV"), []
     ];
-    shortdesc = "preallocate a file in the guest filesystem";
+    shortdesc = "get canonical name of an LV";
     longdesc = "\
-This command preallocates a file (containing zero bytes) named
-C<path> of size C<len> bytes.  If the file exists already, it
-is overwritten.
-
-Note that this call allocates disk blocks for the file.
-To create a sparse file use C<guestfs_truncate_size> instead.
+This converts alternative naming schemes for LVs that you
+might find to the canonical name.  For example, F</dev/mapper/VG-LV>
+is converted to F</dev/VG/LV>.
 
-The deprecated call C<guestfs_fallocate> does the same,
-but owing to an oversight it only allowed 30 bit lengths
-to be specified, effectively limiting the maximum size
-of files created through that call to 1GB.
+This command returns an error if the C<lvname> parameter does
+not refer to a logical volume.
 
-Do not confuse this with the guestfish-specific
-C<alloc> and C<sparse> commands which create
-a file in the host and attach it as a device." };
+See also C<guestfs_is_lv>, C<guestfs_canonical_device_name>." };
 
   { defaults with
-    name = "vfs_label"; added = (1, 3, 18);
-    style = RString "label", [Mountable "mountable"], [];
-    proc_nr = Some 253;
+    name = "mkfs"; added = (0, 0, 8);
+    style = RErr, [String "fstype"; Device "device"], [OInt "blocksize"; OString "features"; OInt "inode"; OInt "sectorsize"; OString "label"];
+    proc_nr = Some 278;
+    once_had_no_optargs = true;
     tests = [
-      InitBasicFS, Always, TestResultString (
-        [["set_label"; "/dev/sda1"; "LTEST"];
-         ["vfs_label"; "/dev/sda1"]], "LTEST"), [];
       InitEmpty, Always, TestResultString (
         [["part_disk"; "/dev/sda"; "mbr"];
-         ["mkfs"; "ext2"; "/dev/sda1"; ""; "NOARG"; ""; ""; "test-label"];
-         ["vfs_label"; "/dev/sda1"]], "test-label"), [];
-      InitEmpty, IfAvailable "btrfs", TestResultString (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["mkfs"; "btrfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; ""];
-         ["set_label"; "/dev/sda1"; "test-label-btrfs"];
-         ["vfs_label"; "/dev/sda1"]], "test-label-btrfs"), [];
+         ["mkfs"; "ext2"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["mount"; "/dev/sda1"; "/"];
+         ["write"; "/new"; "new file contents"];
+         ["cat"; "/new"]], "new file contents"), []
     ];
-    shortdesc = "get the filesystem label";
+    shortdesc = "make a filesystem";
     longdesc = "\
-This returns the label of the filesystem on C<mountable>.
+This function creates a filesystem on C<device>.  The filesystem
+type is C<fstype>, for example C<ext3>.
 
-If the filesystem is unlabeled, this returns the empty string.
+The optional arguments are:
 
-To find a filesystem from the label, use C<guestfs_findfs_label>." };
+=over 4
 
-  { defaults with
-    name = "vfs_uuid"; added = (1, 3, 18);
-    style = RString "uuid", [Mountable "mountable"], [];
-    fish_alias = ["get-uuid"];
-    proc_nr = Some 254;
-    tests =
-      (let uuid = uuidgen () in [
-        InitBasicFS, Always, TestResultString (
-          [["set_e2uuid"; "/dev/sda1"; uuid];
-           ["vfs_uuid"; "/dev/sda1"]], uuid), []
-      ]);
-    shortdesc = "get the filesystem UUID";
-    longdesc = "\
-This returns the filesystem UUID of the filesystem on C<mountable>.
+=item C<blocksize>
 
-If the filesystem does not have a UUID, this returns the empty string.
+The filesystem block size.  Supported block sizes depend on the
+filesystem type, but typically they are C<1024>, C<2048> or C<4096>
+for Linux ext2/3 filesystems.
 
-To find a filesystem from the UUID, use C<guestfs_findfs_uuid>." };
+For VFAT and NTFS the C<blocksize> parameter is treated as
+the requested cluster size.
 
-  { defaults with
-    name = "lvm_set_filter"; added = (1, 5, 1);
-    style = RErr, [DeviceList "devices"], [];
-    proc_nr = Some 255;
-    optional = Some "lvm2";
-    test_excuse = "cannot be tested with the current framework because the VG is being used by the mounted filesystem, so the 'vgchange -an' command we do first will fail";
-    shortdesc = "set LVM device filter";
-    longdesc = "\
-This sets the LVM device filter so that LVM will only be
-able to \"see\" the block devices in the list C<devices>,
-and will ignore all other attached block devices.
+For UFS block sizes, please see L<mkfs.ufs(8)>.
 
-Where disk image(s) contain duplicate PVs or VGs, this
-command is useful to get LVM to ignore the duplicates, otherwise
-LVM can get confused.  Note also there are two types
-of duplication possible: either cloned PVs/VGs which have
-identical UUIDs; or VGs that are not cloned but just happen
-to have the same name.  In normal operation you cannot
-create this situation, but you can do it outside LVM, eg.
-by cloning disk images or by bit twiddling inside the LVM
-metadata.
+=item C<features>
 
-This command also clears the LVM cache and performs a volume
-group scan.
+This passes the I<-O> parameter to the external mkfs program.
 
-You can filter whole block devices or individual partitions.
+For certain filesystem types, this allows extra filesystem
+features to be selected.  See L<mke2fs(8)> and L<mkfs.ufs(8)>
+for more details.
 
-You cannot use this if any VG is currently in use (eg.
-contains a mounted filesystem), even if you are not
-filtering out that VG." };
+You cannot use this optional parameter with the C<gfs> or
+C<gfs2> filesystem type.
 
-  { defaults with
-    name = "lvm_clear_filter"; added = (1, 5, 1);
-    style = RErr, [], [];
-    proc_nr = Some 256;
-    test_excuse = "cannot be tested with the current framework because the VG is being used by the mounted filesystem, so the 'vgchange -an' command we do first will fail";
-    shortdesc = "clear LVM device filter";
-    longdesc = "\
-This undoes the effect of C<guestfs_lvm_set_filter>.  LVM
-will be able to see every block device.
+=item C<inode>
 
-This command also clears the LVM cache and performs a volume
-group scan." };
+This passes the I<-I> parameter to the external L<mke2fs(8)> program
+which sets the inode size (only for ext2/3/4 filesystems at present).
 
-  { defaults with
-    name = "luks_open"; added = (1, 5, 1);
-    style = RErr, [Device "device"; Key "key"; String "mapname"], [];
-    proc_nr = Some 257;
-    optional = Some "luks";
-    shortdesc = "open a LUKS-encrypted block device";
-    longdesc = "\
-This command opens a block device which has been encrypted
-according to the Linux Unified Key Setup (LUKS) standard.
+=item C<sectorsize>
+
+This passes the I<-S> parameter to external L<mkfs.ufs(8)> program,
+which sets sector size for ufs filesystem.
 
-C<device> is the encrypted block device or partition.
+=back" };
 
-The caller must supply one of the keys associated with the
-LUKS block device, in the C<key> parameter.
+  { defaults with
+    name = "getxattr"; added = (1, 7, 24);
+    style = RBufferOut "xattr", [Pathname "path"; String "name"], [];
+    proc_nr = Some 279;
+    optional = Some "linuxxattrs";
+    shortdesc = "get a single extended attribute";
+    longdesc = "\
+Get a single extended attribute from file C<path> named C<name>.
+This call follows symlinks.  If you want to lookup an extended
+attribute for the symlink itself, use C<guestfs_lgetxattr>.
 
-This creates a new block device called F</dev/mapper/mapname>.
-Reads and writes to this block device are decrypted from and
-encrypted to the underlying C<device> respectively.
+Normally it is better to get all extended attributes from a file
+in one go by calling C<guestfs_getxattrs>.  However some Linux
+filesystem implementations are buggy and do not provide a way to
+list out attributes.  For these filesystems (notably ntfs-3g)
+you have to know the names of the extended attributes you want
+in advance and call this function.
 
-If this block device contains LVM volume groups, then
-calling C<guestfs_vgscan> followed by C<guestfs_vg_activate_all>
-will make them visible.
+Extended attribute values are blobs of binary data.  If there
+is no extended attribute named C<name>, this returns an error.
 
-Use C<guestfs_list_dm_devices> to list all device mapper
-devices." };
+See also: C<guestfs_getxattrs>, C<guestfs_lgetxattr>, L<attr(5)>." };
 
   { defaults with
-    name = "luks_open_ro"; added = (1, 5, 1);
-    style = RErr, [Device "device"; Key "key"; String "mapname"], [];
-    proc_nr = Some 258;
-    optional = Some "luks";
-    shortdesc = "open a LUKS-encrypted block device read-only";
+    name = "lgetxattr"; added = (1, 7, 24);
+    style = RBufferOut "xattr", [Pathname "path"; String "name"], [];
+    proc_nr = Some 280;
+    optional = Some "linuxxattrs";
+    shortdesc = "get a single extended attribute";
     longdesc = "\
-This is the same as C<guestfs_luks_open> except that a read-only
-mapping is created." };
+Get a single extended attribute from file C<path> named C<name>.
+If C<path> is a symlink, then this call returns an extended
+attribute from the symlink.
+
+Normally it is better to get all extended attributes from a file
+in one go by calling C<guestfs_getxattrs>.  However some Linux
+filesystem implementations are buggy and do not provide a way to
+list out attributes.  For these filesystems (notably ntfs-3g)
+you have to know the names of the extended attributes you want
+in advance and call this function.
+
+Extended attribute values are blobs of binary data.  If there
+is no extended attribute named C<name>, this returns an error.
+
+See also: C<guestfs_lgetxattrs>, C<guestfs_getxattr>, L<attr(5)>." };
 
   { defaults with
-    name = "luks_close"; added = (1, 5, 1);
+    name = "resize2fs_M"; added = (1, 9, 4);
     style = RErr, [Device "device"], [];
-    proc_nr = Some 259;
-    optional = Some "luks";
-    shortdesc = "close a LUKS device";
+    proc_nr = Some 281;
+    shortdesc = "resize an ext2, ext3 or ext4 filesystem to the minimum size";
     longdesc = "\
-This closes a LUKS device that was created earlier by
-C<guestfs_luks_open> or C<guestfs_luks_open_ro>.  The
-C<device> parameter must be the name of the LUKS mapping
-device (ie. F</dev/mapper/mapname>) and I<not> the name
-of the underlying block device." };
+This command is the same as C<guestfs_resize2fs>, but the filesystem
+is resized to its minimum size.  This works like the I<-M> option
+to the C<resize2fs> command.
+
+To get the resulting size of the filesystem you should call
+C<guestfs_tune2fs_l> and read the C<Block size> and C<Block count>
+values.  These two numbers, multiplied together, give the
+resulting size of the minimal filesystem in bytes.
+
+See also L<guestfs(3)/RESIZE2FS ERRORS>." };
 
   { defaults with
-    name = "luks_format"; added = (1, 5, 2);
-    style = RErr, [Device "device"; Key "key"; Int "keyslot"], [];
-    proc_nr = Some 260;
-    optional = Some "luks";
-    shortdesc = "format a block device as a LUKS encrypted device";
+    name = "internal_autosync"; added = (1, 9, 7);
+    style = RErr, [], [];
+    proc_nr = Some 282;
+    visibility = VInternal;
+    shortdesc = "internal autosync operation";
     longdesc = "\
-This command erases existing data on C<device> and formats
-the device as a LUKS encrypted device.  C<key> is the
-initial key, which is added to key slot C<slot>.  (LUKS
-supports 8 key slots, numbered 0-7)." };
+This command performs the autosync operation just before the
+handle is closed.  You should not call this command directly.
+Instead, use the autosync flag (C<guestfs_set_autosync>) to
+control whether or not this operation is performed when the
+handle is closed." };
 
   { defaults with
-    name = "luks_format_cipher"; added = (1, 5, 2);
-    style = RErr, [Device "device"; Key "key"; Int "keyslot"; String "cipher"], [];
-    proc_nr = Some 261;
-    optional = Some "luks";
-    shortdesc = "format a block device as a LUKS encrypted device";
+    name = "is_zero"; added = (1, 11, 8);
+    style = RBool "zeroflag", [Pathname "path"], [];
+    proc_nr = Some 283;
+    tests = [
+      InitISOFS, Always, TestResultTrue (
+        [["is_zero"; "/100kallzeroes"]]), [];
+      InitISOFS, Always, TestResultFalse (
+        [["is_zero"; "/100kallspaces"]]), []
+    ];
+    shortdesc = "test if a file contains all zero bytes";
     longdesc = "\
-This command is the same as C<guestfs_luks_format> but
-it also allows you to set the C<cipher> used." };
+This returns true iff the file exists and the file is empty or
+it contains all zero bytes." };
 
   { defaults with
-    name = "luks_add_key"; added = (1, 5, 2);
-    style = RErr, [Device "device"; Key "key"; Key "newkey"; Int "keyslot"], [];
-    proc_nr = Some 262;
-    optional = Some "luks";
-    shortdesc = "add a key on a LUKS encrypted device";
+    name = "is_zero_device"; added = (1, 11, 8);
+    style = RBool "zeroflag", [Device "device"], [];
+    proc_nr = Some 284;
+    tests = [
+      InitBasicFS, Always, TestResultTrue (
+        [["umount"; "/dev/sda1"; "false"; "false"];
+         ["zero_device"; "/dev/sda1"];
+         ["is_zero_device"; "/dev/sda1"]]), [];
+      InitBasicFS, Always, TestResultFalse (
+        [["is_zero_device"; "/dev/sda1"]]), []
+    ];
+    shortdesc = "test if a device contains all zero bytes";
     longdesc = "\
-This command adds a new key on LUKS device C<device>.
-C<key> is any existing key, and is used to access the device.
-C<newkey> is the new key to add.  C<keyslot> is the key slot
-that will be replaced.
+This returns true iff the device exists and contains all zero bytes.
 
-Note that if C<keyslot> already contains a key, then this
-command will fail.  You have to use C<guestfs_luks_kill_slot>
-first to remove that key." };
+Note that for large devices this can take a long time to run." };
 
   { defaults with
-    name = "luks_kill_slot"; added = (1, 5, 2);
-    style = RErr, [Device "device"; Key "key"; Int "keyslot"], [];
-    proc_nr = Some 263;
-    optional = Some "luks";
-    shortdesc = "remove a key from a LUKS encrypted device";
+    name = "list_9p"; added = (1, 11, 12);
+    style = RStringList "mounttags", [], [];
+    proc_nr = Some 285;
+    shortdesc = "list 9p filesystems";
     longdesc = "\
-This command deletes the key in key slot C<keyslot> from the
-encrypted LUKS device C<device>.  C<key> must be one of the
-I<other> keys." };
+List all 9p filesystems attached to the guest.  A list of
+mount tags is returned." };
 
   { defaults with
-    name = "is_lv"; added = (1, 5, 3);
-    style = RBool "lvflag", [Mountable "mountable"], [];
-    proc_nr = Some 264;
-    tests = [
-      InitBasicFSonLVM, Always, TestResultTrue (
-        [["is_lv"; "/dev/VG/LV"]]), [];
-      InitBasicFSonLVM, Always, TestResultFalse (
-        [["is_lv"; "/dev/sda1"]]), []
-    ];
-    shortdesc = "test if mountable is a logical volume";
+    name = "mount_9p"; added = (1, 11, 12);
+    style = RErr, [String "mounttag"; String "mountpoint"], [OString "options"];
+    proc_nr = Some 286;
+    camel_name = "Mount9P";
+    shortdesc = "mount 9p filesystem";
     longdesc = "\
-This command tests whether C<mountable> is a logical volume, and
-returns true iff this is the case." };
+Mount the virtio-9p filesystem with the tag C<mounttag> on the
+directory C<mountpoint>.
+
+If required, C<trans=virtio> will be automatically added to the options.
+Any other options required can be passed in the optional C<options>
+parameter." };
 
   { defaults with
-    name = "findfs_uuid"; added = (1, 5, 3);
-    style = RString "device", [String "uuid"], [];
-    proc_nr = Some 265;
-    shortdesc = "find a filesystem by UUID";
+    name = "list_dm_devices"; added = (1, 11, 15);
+    style = RStringList "devices", [], [];
+    proc_nr = Some 287;
+    shortdesc = "list device mapper devices";
     longdesc = "\
-This command searches the filesystems and returns the one
-which has the given UUID.  An error is returned if no such
-filesystem can be found.
+List all device mapper devices.
 
-To find the UUID of a filesystem, use C<guestfs_vfs_uuid>." };
+The returned list contains F</dev/mapper/*> devices, eg. ones created
+by a previous call to C<guestfs_luks_open>.
+
+Device mapper devices which correspond to logical volumes are I<not>
+returned in this list.  Call C<guestfs_lvs> if you want to list logical
+volumes." };
 
   { defaults with
-    name = "findfs_label"; added = (1, 5, 3);
-    style = RString "device", [String "label"], [];
-    proc_nr = Some 266;
-    shortdesc = "find a filesystem by label";
+    name = "ntfsresize"; added = (1, 3, 2);
+    style = RErr, [Device "device"], [OInt64 "size"; OBool "force"];
+    once_had_no_optargs = true;
+    proc_nr = Some 288;
+    optional = Some "ntfsprogs"; camel_name = "NTFSResizeOpts";
+    shortdesc = "resize an NTFS filesystem";
     longdesc = "\
-This command searches the filesystems and returns the one
-which has the given label.  An error is returned if no such
-filesystem can be found.
+This command resizes an NTFS filesystem, expanding or
+shrinking it to the size of the underlying device.
 
-To find the label of a filesystem, use C<guestfs_vfs_label>." };
+The optional parameters are:
+
+=over 4
+
+=item C<size>
+
+The new size (in bytes) of the filesystem.  If omitted, the filesystem
+is resized to fit the container (eg. partition).
+
+=item C<force>
+
+If this option is true, then force the resize of the filesystem
+even if the filesystem is marked as requiring a consistency check.
+
+After the resize operation, the filesystem is always marked
+as requiring a consistency check (for safety).  You have to boot
+into Windows to perform this check and clear this condition.
+If you I<don't> set the C<force> option then it is not
+possible to call C<guestfs_ntfsresize> multiple times on a
+single filesystem without booting into Windows between each resize.
+
+=back
+
+See also L<ntfsresize(8)>." };
 
   { defaults with
-    name = "is_chardev"; added = (1, 5, 10);
-    style = RBool "flag", [Pathname "path"], [OBool "followsymlinks"];
-    proc_nr = Some 267;
-    once_had_no_optargs = true;
-    tests = [
-      InitISOFS, Always, TestResultFalse (
-        [["is_chardev"; "/directory"; ""]]), [];
-      InitScratchFS, Always, TestResultTrue (
-        [["mknod_c"; "0o777"; "99"; "66"; "/is_chardev"];
-         ["is_chardev"; "/is_chardev"; ""]]), []
-    ];
-    shortdesc = "test if character device";
+    name = "btrfs_filesystem_resize"; added = (1, 11, 17);
+    style = RErr, [Pathname "mountpoint"], [OInt64 "size"];
+    proc_nr = Some 289;
+    optional = Some "btrfs"; camel_name = "BTRFSFilesystemResize";
+    shortdesc = "resize a btrfs filesystem";
     longdesc = "\
-This returns C<true> if and only if there is a character device
-with the given C<path> name.
+This command resizes a btrfs filesystem.
 
-If the optional flag C<followsymlinks> is true, then a symlink
-(or chain of symlinks) that ends with a chardev also causes the
-function to return true.
+Note that unlike other resize calls, the filesystem has to be
+mounted and the parameter is the mountpoint not the device
+(this is a requirement of btrfs itself).
 
-See also C<guestfs_stat>." };
+The optional parameters are:
 
-  { defaults with
-    name = "is_blockdev"; added = (1, 5, 10);
-    style = RBool "flag", [Pathname "path"], [OBool "followsymlinks"];
-    proc_nr = Some 268;
-    once_had_no_optargs = true;
-    tests = [
-      InitISOFS, Always, TestResultFalse (
-        [["is_blockdev"; "/directory"; ""]]), [];
-      InitScratchFS, Always, TestResultTrue (
-        [["mknod_b"; "0o777"; "99"; "66"; "/is_blockdev"];
-         ["is_blockdev"; "/is_blockdev"; ""]]), []
-    ];
-    shortdesc = "test if block device";
-    longdesc = "\
-This returns C<true> if and only if there is a block device
-with the given C<path> name.
+=over 4
 
-If the optional flag C<followsymlinks> is true, then a symlink
-(or chain of symlinks) that ends with a block device also causes the
-function to return true.
+=item C<size>
 
-This call only looks at files within the guest filesystem.  Libguestfs
-partitions and block devices (eg. F</dev/sda>) cannot be used as the
-C<path> parameter of this call.
+The new size (in bytes) of the filesystem.  If omitted, the filesystem
+is resized to the maximum size.
 
-See also C<guestfs_stat>." };
+=back
+
+See also L<btrfs(8)>." };
 
   { defaults with
-    name = "is_fifo"; added = (1, 5, 10);
-    style = RBool "flag", [Pathname "path"], [OBool "followsymlinks"];
-    proc_nr = Some 269;
-    once_had_no_optargs = true;
+    name = "internal_write_append"; added = (1, 19, 32);
+    style = RErr, [Pathname "path"; BufferIn "content"], [];
+    proc_nr = Some 290;
+    visibility = VInternal;
+    protocol_limit_warning = true;
     tests = [
-      InitISOFS, Always, TestResultFalse (
-        [["is_fifo"; "/directory"; ""]]), [];
-      InitScratchFS, Always, TestResultTrue (
-        [["mkfifo"; "0o777"; "/is_fifo"];
-         ["is_fifo"; "/is_fifo"; ""]]), []
+      InitScratchFS, Always, TestResultString (
+        [["write"; "/internal_write_append"; "line1\n"];
+         ["internal_write_append"; "/internal_write_append"; "line2\n"];
+         ["internal_write_append"; "/internal_write_append"; "line3a"];
+         ["internal_write_append"; "/internal_write_append"; "line3b\n"];
+         ["cat"; "/internal_write_append"]], "line1\nline2\nline3aline3b\n"), []
     ];
-    shortdesc = "test if FIFO (named pipe)";
+    shortdesc = "append content to end of file";
     longdesc = "\
-This returns C<true> if and only if there is a FIFO (named pipe)
-with the given C<path> name.
-
-If the optional flag C<followsymlinks> is true, then a symlink
-(or chain of symlinks) that ends with a FIFO also causes the
-function to return true.
+This call appends C<content> to the end of file C<path>.  If
+C<path> does not exist, then a new file is created.
 
-See also C<guestfs_stat>." };
+See also C<guestfs_write>." };
 
   { defaults with
-    name = "is_symlink"; added = (1, 5, 10);
-    style = RBool "flag", [Pathname "path"], [];
-    proc_nr = Some 270;
-    tests = [
-      InitISOFS, Always, TestResultFalse (
-        [["is_symlink"; "/directory"]]), [];
-      InitISOFS, Always, TestResultTrue (
-        [["is_symlink"; "/abssymlink"]]), []
-    ];
-    shortdesc = "test if symbolic link";
+    name = "compress_out"; added = (1, 13, 15);
+    style = RErr, [String "ctype"; Pathname "file"; FileOut "zfile"], [OInt "level"];
+    proc_nr = Some 291;
+    cancellable = true;
+    shortdesc = "output compressed file";
     longdesc = "\
-This returns C<true> if and only if there is a symbolic link
-with the given C<path> name.
+This command compresses F<file> and writes it out to the local
+file F<zfile>.
 
-See also C<guestfs_stat>." };
+The compression program used is controlled by the C<ctype> parameter.
+Currently this includes: C<compress>, C<gzip>, C<bzip2>, C<xz>, C<lzop>
+or C<zstd>.
+Some compression types may not be supported by particular builds of
+libguestfs, in which case you will get an error containing the
+substring \"not supported\".
+
+C<gzip>, C<xz> and C<zstd> compression uses all the vCPUs of the
+appliance (see C<guestfs_set_smp>).
+
+The optional C<level> parameter controls compression level.  The
+meaning and default for this parameter depends on the compression
+program being used." };
 
   { defaults with
-    name = "is_socket"; added = (1, 5, 10);
-    style = RBool "flag", [Pathname "path"], [OBool "followsymlinks"];
-    proc_nr = Some 271;
-    once_had_no_optargs = true;
-    (* XXX Need a positive test for sockets. *)
-    tests = [
-      InitISOFS, Always, TestResultFalse (
-        [["is_socket"; "/directory"; ""]]), []
-    ];
-    shortdesc = "test if socket";
+    name = "compress_device_out"; added = (1, 13, 15);
+    style = RErr, [String "ctype"; Device "device"; FileOut "zdevice"], [OInt "level"];
+    proc_nr = Some 292;
+    cancellable = true;
+    shortdesc = "output compressed device";
     longdesc = "\
-This returns C<true> if and only if there is a Unix domain socket
-with the given C<path> name.
-
-If the optional flag C<followsymlinks> is true, then a symlink
-(or chain of symlinks) that ends with a socket also causes the
-function to return true.
+This command compresses C<device> and writes it out to the local
+file C<zdevice>.
 
-See also C<guestfs_stat>." };
+The C<ctype> and optional C<level> parameters have the same meaning
+as in C<guestfs_compress_out>." };
 
   { defaults with
-    name = "part_to_dev"; added = (1, 5, 15);
-    style = RString "device", [Device "partition"], [];
-    proc_nr = Some 272;
+    name = "part_to_partnum"; added = (1, 13, 25);
+    style = RInt "partnum", [Device "partition"], [];
+    proc_nr = Some 293;
     tests = [
-      InitPartition, Always, TestResultDevice (
-        [["part_to_dev"; "/dev/sda1"]], "/dev/sda"), [];
+      InitPartition, Always, TestResult (
+        [["part_to_partnum"; "/dev/sda1"]], "ret == 1"), [];
       InitEmpty, Always, TestLastFail (
-        [["part_to_dev"; "/dev/sda"]]), []
+        [["part_to_partnum"; "/dev/sda"]]), []
     ];
-    shortdesc = "convert partition name to device name";
+    shortdesc = "convert partition name to partition number";
     longdesc = "\
 This function takes a partition name (eg. \"/dev/sdb1\") and
-removes the partition number, returning the device name
-(eg. \"/dev/sdb\").
+returns the partition number (eg. C<1>).
 
 The named partition must exist, for example as a string returned
 from C<guestfs_list_partitions>.
 
-See also C<guestfs_part_to_partnum>, C<guestfs_device_index>." };
-
-  { defaults with
-    name = "upload_offset"; added = (1, 5, 17);
-    style = RErr, [FileIn "filename"; Dev_or_Path "remotefilename"; Int64 "offset"], [];
-    proc_nr = Some 273;
-    progress = true; cancellable = true;
-    tests =
-      (let md5 = Digest.to_hex (Digest.file "COPYING.LIB") in [
-        InitScratchFS, Always, TestResultString (
-          [["upload_offset"; "$srcdir/../../COPYING.LIB"; "/upload_offset"; "0"];
-           ["checksum"; "md5"; "/upload_offset"]], md5), []
-      ]);
-    shortdesc = "upload a file from the local machine with offset";
-    longdesc = "\
-Upload local file F<filename> to F<remotefilename> on the
-filesystem.
-
-F<remotefilename> is overwritten starting at the byte C<offset>
-specified.  The intention is to overwrite parts of existing
-files or devices, although if a non-existent file is specified
-then it is created with a \"hole\" before C<offset>.  The
-size of the data written is implicit in the size of the
-source F<filename>.
-
-Note that there is no limit on the amount of data that
-can be uploaded with this call, unlike with C<guestfs_pwrite>,
-and this call always writes the full amount unless an
-error occurs.
-
-See also C<guestfs_upload>, C<guestfs_pwrite>." };
+See also C<guestfs_part_to_dev>." };
 
   { defaults with
-    name = "download_offset"; added = (1, 5, 17);
-    style = RErr, [Dev_or_Path "remotefilename"; FileOut "filename"; Int64 "offset"; Int64 "size"], [];
-    proc_nr = Some 274;
-    progress = true; cancellable = true;
-    tests =
-      (let md5 = Digest.to_hex (Digest.file "COPYING.LIB") in
-       let offset = string_of_int 100 in
-       let size = string_of_int ((Unix.stat "COPYING.LIB").Unix.st_size - 100) in
-       [
-         InitScratchFS, Always, TestResultString (
-           (* Pick a file from cwd which isn't likely to change. *)
-           [["mkdir"; "/download_offset"];
-            ["upload"; "$srcdir/../../COPYING.LIB"; "/download_offset/COPYING.LIB"];
-            ["download_offset"; "/download_offset/COPYING.LIB"; "testdownload.tmp"; offset; size];
-            ["upload_offset"; "testdownload.tmp"; "/download_offset/COPYING.LIB"; offset];
-            ["checksum"; "md5"; "/download_offset/COPYING.LIB"]], md5), []
-       ]);
-    shortdesc = "download a file to the local machine with offset and size";
+    name = "copy_device_to_device"; added = (1, 13, 25);
+    style = RErr, [Device "src"; Device "dest"], [OInt64 "srcoffset"; OInt64 "destoffset"; OInt64 "size"; OBool "sparse"; OBool "append"];
+    proc_nr = Some 294;
+    progress = true;
+    shortdesc = "copy from source device to destination device";
     longdesc = "\
-Download file F<remotefilename> and save it as F<filename>
-on the local machine.
-
-F<remotefilename> is read for C<size> bytes starting at C<offset>
-(this region must be within the file or device).
+The four calls C<guestfs_copy_device_to_device>,
+C<guestfs_copy_device_to_file>,
+C<guestfs_copy_file_to_device>, and
+C<guestfs_copy_file_to_file>
+let you copy from a source (device|file) to a destination
+(device|file).
 
-Note that there is no limit on the amount of data that
-can be downloaded with this call, unlike with C<guestfs_pread>,
-and this call always reads the full amount unless an
-error occurs.
+Partial copies can be made since you can specify optionally
+the source offset, destination offset and size to copy.  These
+values are all specified in bytes.  If not given, the offsets
+both default to zero, and the size defaults to copying as much
+as possible until we hit the end of the source.
 
-See also C<guestfs_download>, C<guestfs_pread>." };
+The source and destination may be the same object.  However
+overlapping regions may not be copied correctly.
 
-  { defaults with
-    name = "pwrite_device"; added = (1, 5, 20);
-    style = RInt "nbytes", [Device "device"; BufferIn "content"; Int64 "offset"], [];
-    proc_nr = Some 275;
-    protocol_limit_warning = true;
-    tests = [
-      InitPartition, Always, TestResult (
-        [["pwrite_device"; "/dev/sda"; "\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000"; "446"];
-         ["blockdev_rereadpt"; "/dev/sda"];
-         ["list_partitions"]],
-        "is_device_list (ret, 1, \"/dev/sdb1\")"), []
-    ];
-    shortdesc = "write to part of a device";
-    longdesc = "\
-This command writes to part of a device.  It writes the data
-buffer C<content> to C<device> starting at offset C<offset>.
+If the destination is a file, it is created if required.  If
+the destination file is not large enough, it is extended.
 
-This command implements the L<pwrite(2)> system call, and like
-that system call it may not write the full data requested
-(although short writes to disk devices and partitions are
-probably impossible with standard Linux kernels).
+If the destination is a file and the C<append> flag is not set,
+then the destination file is truncated.  If the C<append> flag is
+set, then the copy appends to the destination file.  The C<append>
+flag currently cannot be set for devices.
 
-See also C<guestfs_pwrite>." };
+If the C<sparse> flag is true then the call avoids writing
+blocks that contain only zeroes, which can help in some situations
+where the backing disk is thin-provisioned.  Note that unless
+the target is already zeroed, using this option will result
+in incorrect copying." };
 
   { defaults with
-    name = "pread_device"; added = (1, 5, 21);
-    style = RBufferOut "content", [Device "device"; Int "count"; Int64 "offset"], [];
-    proc_nr = Some 276;
-    protocol_limit_warning = true;
-    tests = [
-      InitEmpty, Always, TestResult (
-        [["pread_device"; "/dev/sdd"; "8"; "32768"]],
-        "compare_buffers (ret, size, \"\\1CD001\\1\\0\", 8) == 0"), []
-    ];
-    shortdesc = "read part of a device";
+    name = "copy_device_to_file"; added = (1, 13, 25);
+    style = RErr, [Device "src"; Pathname "dest"], [OInt64 "srcoffset"; OInt64 "destoffset"; OInt64 "size"; OBool "sparse"; OBool "append"];
+    proc_nr = Some 295;
+    progress = true;
+    shortdesc = "copy from source device to destination file";
     longdesc = "\
-This command lets you read part of a block device.  It reads C<count>
-bytes of C<device>, starting at C<offset>.
-
-This may read fewer bytes than requested.  For further details
-see the L<pread(2)> system call.
+See C<guestfs_copy_device_to_device> for a general overview
+of this call." };
 
-See also C<guestfs_pread>." };
+  { defaults with
+    name = "copy_file_to_device"; added = (1, 13, 25);
+    style = RErr, [Pathname "src"; Device "dest"], [OInt64 "srcoffset"; OInt64 "destoffset"; OInt64 "size"; OBool "sparse"; OBool "append"];
+    proc_nr = Some 296;
+    progress = true;
+    shortdesc = "copy from source file to destination device";
+    longdesc = "\
+See C<guestfs_copy_device_to_device> for a general overview
+of this call." };
 
   { defaults with
-    name = "lvm_canonical_lv_name"; added = (1, 5, 24);
-    style = RString "lv", [Device "lvname"], [];
-    proc_nr = Some 277;
+    name = "copy_file_to_file"; added = (1, 13, 25);
+    style = RErr, [Pathname "src"; Pathname "dest"], [OInt64 "srcoffset"; OInt64 "destoffset"; OInt64 "size"; OBool "sparse"; OBool "append"];
+    proc_nr = Some 297;
+    progress = true;
     tests = [
-      InitBasicFSonLVM, IfAvailable "lvm2", TestResultString (
-        [["lvm_canonical_lv_name"; "/dev/mapper/VG-LV"]], "/dev/VG/LV"), [];
-      InitBasicFSonLVM, IfAvailable "lvm2", TestResultString (
-        [["lvm_canonical_lv_name"; "/dev/VG/LV"]], "/dev/VG/LV"), []
+      InitScratchFS, Always, TestResult (
+        [["mkdir"; "/copyff"];
+         ["write"; "/copyff/src"; "hello, world"];
+         ["copy_file_to_file"; "/copyff/src"; "/copyff/dest"; ""; ""; ""; ""; "false"];
+         ["read_file"; "/copyff/dest"]],
+        "compare_buffers (ret, size, \"hello, world\", 12) == 0"), [];
+      InitScratchFS, Always, TestResultTrue (
+        let size = 1024 * 1024 in
+        [["mkdir"; "/copyff2"];
+         ["fill"; "0"; string_of_int size; "/copyff2/src"];
+         ["touch"; "/copyff2/dest"];
+         ["truncate_size"; "/copyff2/dest"; string_of_int size];
+         ["copy_file_to_file"; "/copyff2/src"; "/copyff2/dest"; ""; ""; ""; "true"; "false"];
+         ["is_zero"; "/copyff2/dest"]]), [];
+      InitScratchFS, Always, TestResult (
+        [["mkdir"; "/copyff3"];
+         ["write"; "/copyff3/src"; "hello, world"];
+         ["copy_file_to_file"; "/copyff3/src"; "/copyff3/dest"; ""; ""; ""; ""; "true"];
+         ["copy_file_to_file"; "/copyff3/src"; "/copyff3/dest"; ""; ""; ""; ""; "true"];
+         ["copy_file_to_file"; "/copyff3/src"; "/copyff3/dest"; ""; ""; ""; ""; "true"];
+         ["read_file"; "/copyff3/dest"]],
+        "compare_buffers (ret, size, \"hello, worldhello, worldhello, world\", 12*3) == 0"), [];
     ];
-    shortdesc = "get canonical name of an LV";
+    shortdesc = "copy from source file to destination file";
     longdesc = "\
-This converts alternative naming schemes for LVs that you
-might find to the canonical name.  For example, F</dev/mapper/VG-LV>
-is converted to F</dev/VG/LV>.
-
-This command returns an error if the C<lvname> parameter does
-not refer to a logical volume.
+See C<guestfs_copy_device_to_device> for a general overview
+of this call.
 
-See also C<guestfs_is_lv>, C<guestfs_canonical_device_name>." };
+This is B<not> the function you want for copying files.  This
+is for copying blocks within existing files.  See C<guestfs_cp>,
+C<guestfs_cp_a> and C<guestfs_mv> for general file copying and
+moving functions." };
 
   { defaults with
-    name = "mkfs"; added = (0, 0, 8);
-    style = RErr, [String "fstype"; Device "device"], [OInt "blocksize"; OString "features"; OInt "inode"; OInt "sectorsize"; OString "label"];
-    proc_nr = Some 278;
-    once_had_no_optargs = true;
+    name = "tune2fs"; added = (1, 15, 4);
+    style = RErr, [Device "device"], [OBool "force"; OInt "maxmountcount"; OInt "mountcount"; OString "errorbehavior"; OInt64 "group"; OInt "intervalbetweenchecks"; OInt "reservedblockspercentage"; OString "lastmounteddirectory"; OInt64 "reservedblockscount"; OInt64 "user"];
+    proc_nr = Some 298;
+    camel_name = "Tune2FS";
     tests = [
-      InitEmpty, Always, TestResultString (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["mkfs"; "ext2"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
-         ["mount"; "/dev/sda1"; "/"];
-         ["write"; "/new"; "new file contents"];
-         ["cat"; "/new"]], "new file contents"), []
+      InitScratchFS, Always, TestResult (
+        [["tune2fs"; "/dev/sdb1"; "false"; "0"; ""; "NOARG"; ""; "0"; ""; "NOARG"; ""; ""];
+         ["tune2fs_l"; "/dev/sdb1"]],
+        "check_hash (ret, \"Check interval\", \"0 (<none>)\") == 0 && "^
+          "check_hash (ret, \"Maximum mount count\", \"-1\") == 0"), [];
+      InitScratchFS, Always, TestResult (
+        [["tune2fs"; "/dev/sdb1"; "false"; "0"; ""; "NOARG"; ""; "86400"; ""; "NOARG"; ""; ""];
+         ["tune2fs_l"; "/dev/sdb1"]],
+        "check_hash (ret, \"Check interval\", \"86400 (1 day)\") == 0 && "^
+          "check_hash (ret, \"Maximum mount count\", \"-1\") == 0"), [];
+      InitScratchFS, Always, TestResult (
+        [["tune2fs"; "/dev/sdb1"; "false"; ""; ""; "NOARG"; "1"; ""; ""; "NOARG"; ""; "1"];
+         ["tune2fs_l"; "/dev/sdb1"]],
+        "match_re (get_key (ret, \"Reserved blocks uid\"), \"\\\\d+ \\\\(user \\\\S+\\\\)\") && "^
+          "match_re (get_key (ret, \"Reserved blocks gid\"), \"\\\\d+ \\\\(group \\\\S+\\\\)\")"), [];
+      InitScratchFS, Always, TestResult (
+        [["tune2fs"; "/dev/sdb1"; "false"; ""; ""; "NOARG"; "0"; ""; ""; "NOARG"; ""; "0"];
+         ["tune2fs_l"; "/dev/sdb1"]],
+        "match_re (get_key (ret, \"Reserved blocks uid\"), \"\\\\d+ \\\\(user \\\\S+\\\\)\") && "^
+          "match_re (get_key (ret, \"Reserved blocks gid\"), \"\\\\d+ \\\\(group \\\\S+\\\\)\")"), [];
     ];
-    shortdesc = "make a filesystem";
+    shortdesc = "adjust ext2/ext3/ext4 filesystem parameters";
     longdesc = "\
-This function creates a filesystem on C<device>.  The filesystem
-type is C<fstype>, for example C<ext3>.
+This call allows you to adjust various filesystem parameters of
+an ext2/ext3/ext4 filesystem called C<device>.
 
-The optional arguments are:
+The optional parameters are:
 
 =over 4
 
-=item C<blocksize>
+=item C<force>
 
-The filesystem block size.  Supported block sizes depend on the
-filesystem type, but typically they are C<1024>, C<2048> or C<4096>
-for Linux ext2/3 filesystems.
+Force tune2fs to complete the operation even in the face of errors.
+This is the same as the tune2fs C<-f> option.
 
-For VFAT and NTFS the C<blocksize> parameter is treated as
-the requested cluster size.
+=item C<maxmountcount>
 
-For UFS block sizes, please see L<mkfs.ufs(8)>.
+Set the number of mounts after which the filesystem is checked
+by L<e2fsck(8)>.  If this is C<0> then the number of mounts is
+disregarded.  This is the same as the tune2fs C<-c> option.
 
-=item C<features>
+=item C<mountcount>
 
-This passes the I<-O> parameter to the external mkfs program.
+Set the number of times the filesystem has been mounted.
+This is the same as the tune2fs C<-C> option.
 
-For certain filesystem types, this allows extra filesystem
-features to be selected.  See L<mke2fs(8)> and L<mkfs.ufs(8)>
-for more details.
+=item C<errorbehavior>
 
-You cannot use this optional parameter with the C<gfs> or
-C<gfs2> filesystem type.
+Change the behavior of the kernel code when errors are detected.
+Possible values currently are: C<continue>, C<remount-ro>, C<panic>.
+In practice these options don't really make any difference,
+particularly for write errors.
 
-=item C<inode>
+This is the same as the tune2fs C<-e> option.
 
-This passes the I<-I> parameter to the external L<mke2fs(8)> program
-which sets the inode size (only for ext2/3/4 filesystems at present).
+=item C<group>
 
-=item C<sectorsize>
+Set the group which can use reserved filesystem blocks.
+This is the same as the tune2fs C<-g> option except that it
+can only be specified as a number.
 
-This passes the I<-S> parameter to external L<mkfs.ufs(8)> program,
-which sets sector size for ufs filesystem.
+=item C<intervalbetweenchecks>
 
-=back" };
+Adjust the maximal time between two filesystem checks
+(in seconds).  If the option is passed as C<0> then
+time-dependent checking is disabled.
 
-  { defaults with
-    name = "getxattr"; added = (1, 7, 24);
-    style = RBufferOut "xattr", [Pathname "path"; String "name"], [];
-    proc_nr = Some 279;
-    optional = Some "linuxxattrs";
-    shortdesc = "get a single extended attribute";
-    longdesc = "\
-Get a single extended attribute from file C<path> named C<name>.
-This call follows symlinks.  If you want to lookup an extended
-attribute for the symlink itself, use C<guestfs_lgetxattr>.
+This is the same as the tune2fs C<-i> option.
 
-Normally it is better to get all extended attributes from a file
-in one go by calling C<guestfs_getxattrs>.  However some Linux
-filesystem implementations are buggy and do not provide a way to
-list out attributes.  For these filesystems (notably ntfs-3g)
-you have to know the names of the extended attributes you want
-in advance and call this function.
+=item C<reservedblockspercentage>
 
-Extended attribute values are blobs of binary data.  If there
-is no extended attribute named C<name>, this returns an error.
+Set the percentage of the filesystem which may only be allocated
+by privileged processes.
+This is the same as the tune2fs C<-m> option.
 
-See also: C<guestfs_getxattrs>, C<guestfs_lgetxattr>, L<attr(5)>." };
+=item C<lastmounteddirectory>
+
+Set the last mounted directory.
+This is the same as the tune2fs C<-M> option.
+
+=item C<reservedblockscount>
+Set the number of reserved filesystem blocks.
+This is the same as the tune2fs C<-r> option.
+
+=item C<user>
+
+Set the user who can use the reserved filesystem blocks.
+This is the same as the tune2fs C<-u> option except that it
+can only be specified as a number.
+
+=back
+
+To get the current values of filesystem parameters, see
+C<guestfs_tune2fs_l>.  For precise details of how tune2fs
+works, see the L<tune2fs(8)> man page." };
 
   { defaults with
-    name = "lgetxattr"; added = (1, 7, 24);
-    style = RBufferOut "xattr", [Pathname "path"; String "name"], [];
-    proc_nr = Some 280;
-    optional = Some "linuxxattrs";
-    shortdesc = "get a single extended attribute";
+    name = "md_create"; added = (1, 15, 6);
+    style = RErr, [String "name"; DeviceList "devices"], [OInt64 "missingbitmap"; OInt "nrdevices"; OInt "spare"; OInt64 "chunk"; OString "level"];
+    proc_nr = Some 299;
+    optional = Some "mdadm"; camel_name = "MDCreate";
+    shortdesc = "create a Linux md (RAID) device";
     longdesc = "\
-Get a single extended attribute from file C<path> named C<name>.
-If C<path> is a symlink, then this call returns an extended
-attribute from the symlink.
+Create a Linux md (RAID) device named C<name> on the devices
+in the list C<devices>.
 
-Normally it is better to get all extended attributes from a file
-in one go by calling C<guestfs_getxattrs>.  However some Linux
-filesystem implementations are buggy and do not provide a way to
-list out attributes.  For these filesystems (notably ntfs-3g)
-you have to know the names of the extended attributes you want
-in advance and call this function.
+The optional parameters are:
+
+=over 4
+
+=item C<missingbitmap>
+
+A bitmap of missing devices.  If a bit is set it means that a
+missing device is added to the array.  The least significant bit
+corresponds to the first device in the array.
+
+As examples:
+
+If C<devices = [\"/dev/sda\"]> and C<missingbitmap = 0x1> then
+the resulting array would be C<[E<lt>missingE<gt>, \"/dev/sda\"]>.
+
+If C<devices = [\"/dev/sda\"]> and C<missingbitmap = 0x2> then
+the resulting array would be C<[\"/dev/sda\", E<lt>missingE<gt>]>.
+
+This defaults to C<0> (no missing devices).
+
+The length of C<devices> + the number of bits set in
+C<missingbitmap> must equal C<nrdevices> + C<spare>.
+
+=item C<nrdevices>
 
-Extended attribute values are blobs of binary data.  If there
-is no extended attribute named C<name>, this returns an error.
+The number of active RAID devices.
 
-See also: C<guestfs_lgetxattrs>, C<guestfs_getxattr>, L<attr(5)>." };
+If not set, this defaults to the length of C<devices> plus
+the number of bits set in C<missingbitmap>.
 
-  { defaults with
-    name = "resize2fs_M"; added = (1, 9, 4);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 281;
-    shortdesc = "resize an ext2, ext3 or ext4 filesystem to the minimum size";
-    longdesc = "\
-This command is the same as C<guestfs_resize2fs>, but the filesystem
-is resized to its minimum size.  This works like the I<-M> option
-to the C<resize2fs> command.
+=item C<spare>
 
-To get the resulting size of the filesystem you should call
-C<guestfs_tune2fs_l> and read the C<Block size> and C<Block count>
-values.  These two numbers, multiplied together, give the
-resulting size of the minimal filesystem in bytes.
+The number of spare devices.
 
-See also L<guestfs(3)/RESIZE2FS ERRORS>." };
+If not set, this defaults to C<0>.
 
-  { defaults with
-    name = "internal_autosync"; added = (1, 9, 7);
-    style = RErr, [], [];
-    proc_nr = Some 282;
-    visibility = VInternal;
-    shortdesc = "internal autosync operation";
-    longdesc = "\
-This command performs the autosync operation just before the
-handle is closed.  You should not call this command directly.
-Instead, use the autosync flag (C<guestfs_set_autosync>) to
-control whether or not this operation is performed when the
-handle is closed." };
+=item C<chunk>
 
-  { defaults with
-    name = "is_zero"; added = (1, 11, 8);
-    style = RBool "zeroflag", [Pathname "path"], [];
-    proc_nr = Some 283;
-    tests = [
-      InitISOFS, Always, TestResultTrue (
-        [["is_zero"; "/100kallzeroes"]]), [];
-      InitISOFS, Always, TestResultFalse (
-        [["is_zero"; "/100kallspaces"]]), []
-    ];
-    shortdesc = "test if a file contains all zero bytes";
-    longdesc = "\
-This returns true iff the file exists and the file is empty or
-it contains all zero bytes." };
+The chunk size in bytes.
 
-  { defaults with
-    name = "is_zero_device"; added = (1, 11, 8);
-    style = RBool "zeroflag", [Device "device"], [];
-    proc_nr = Some 284;
-    tests = [
-      InitBasicFS, Always, TestResultTrue (
-        [["umount"; "/dev/sda1"; "false"; "false"];
-         ["zero_device"; "/dev/sda1"];
-         ["is_zero_device"; "/dev/sda1"]]), [];
-      InitBasicFS, Always, TestResultFalse (
-        [["is_zero_device"; "/dev/sda1"]]), []
-    ];
-    shortdesc = "test if a device contains all zero bytes";
-    longdesc = "\
-This returns true iff the device exists and contains all zero bytes.
+=item C<level>
 
-Note that for large devices this can take a long time to run." };
+The RAID level, which can be one of:
+I<linear>, I<raid0>, I<0>, I<stripe>, I<raid1>, I<1>, I<mirror>,
+I<raid4>, I<4>, I<raid5>, I<5>, I<raid6>, I<6>, I<raid10>, I<10>.
+Some of these are synonymous, and more levels may be added in future.
 
-  { defaults with
-    name = "list_9p"; added = (1, 11, 12);
-    style = RStringList "mounttags", [], [];
-    proc_nr = Some 285;
-    shortdesc = "list 9p filesystems";
-    longdesc = "\
-List all 9p filesystems attached to the guest.  A list of
-mount tags is returned." };
+If not set, this defaults to C<raid1>.
+
+=back" };
 
   { defaults with
-    name = "mount_9p"; added = (1, 11, 12);
-    style = RErr, [String "mounttag"; String "mountpoint"], [OString "options"];
-    proc_nr = Some 286;
-    camel_name = "Mount9P";
-    shortdesc = "mount 9p filesystem";
+    name = "list_md_devices"; added = (1, 15, 4);
+    style = RStringList "devices", [], [];
+    proc_nr = Some 300;
+    shortdesc = "list Linux md (RAID) devices";
     longdesc = "\
-Mount the virtio-9p filesystem with the tag C<mounttag> on the
-directory C<mountpoint>.
-
-If required, C<trans=virtio> will be automatically added to the options.
-Any other options required can be passed in the optional C<options>
-parameter." };
+List all Linux md devices." };
 
   { defaults with
-    name = "list_dm_devices"; added = (1, 11, 15);
-    style = RStringList "devices", [], [];
-    proc_nr = Some 287;
-    shortdesc = "list device mapper devices";
+    name = "md_detail"; added = (1, 15, 6);
+    style = RHashtable "info", [Device "md"], [];
+    proc_nr = Some 301;
+    optional = Some "mdadm";
+    shortdesc = "obtain metadata for an MD device";
     longdesc = "\
-List all device mapper devices.
+This command exposes the output of 'mdadm -DY E<lt>mdE<gt>'.
+The following fields are usually present in the returned hash.
+Other fields may also be present.
 
-The returned list contains F</dev/mapper/*> devices, eg. ones created
-by a previous call to C<guestfs_luks_open>.
+=over
 
-Device mapper devices which correspond to logical volumes are I<not>
-returned in this list.  Call C<guestfs_lvs> if you want to list logical
-volumes." };
+=item C<level>
 
-  { defaults with
-    name = "ntfsresize"; added = (1, 3, 2);
-    style = RErr, [Device "device"], [OInt64 "size"; OBool "force"];
-    once_had_no_optargs = true;
-    proc_nr = Some 288;
-    optional = Some "ntfsprogs"; camel_name = "NTFSResizeOpts";
-    shortdesc = "resize an NTFS filesystem";
-    longdesc = "\
-This command resizes an NTFS filesystem, expanding or
-shrinking it to the size of the underlying device.
+The raid level of the MD device.
 
-The optional parameters are:
+=item C<devices>
 
-=over 4
+The number of underlying devices in the MD device.
 
-=item C<size>
+=item C<metadata>
 
-The new size (in bytes) of the filesystem.  If omitted, the filesystem
-is resized to fit the container (eg. partition).
+The metadata version used.
 
-=item C<force>
+=item C<uuid>
 
-If this option is true, then force the resize of the filesystem
-even if the filesystem is marked as requiring a consistency check.
+The UUID of the MD device.
 
-After the resize operation, the filesystem is always marked
-as requiring a consistency check (for safety).  You have to boot
-into Windows to perform this check and clear this condition.
-If you I<don't> set the C<force> option then it is not
-possible to call C<guestfs_ntfsresize> multiple times on a
-single filesystem without booting into Windows between each resize.
+=item C<name>
 
-=back
+The name of the MD device.
 
-See also L<ntfsresize(8)>." };
+=back" };
 
   { defaults with
-    name = "btrfs_filesystem_resize"; added = (1, 11, 17);
-    style = RErr, [Pathname "mountpoint"], [OInt64 "size"];
-    proc_nr = Some 289;
-    optional = Some "btrfs"; camel_name = "BTRFSFilesystemResize";
-    shortdesc = "resize a btrfs filesystem";
+    name = "md_stop"; added = (1, 15, 6);
+    style = RErr, [Device "md"], [];
+    proc_nr = Some 302;
+    optional = Some "mdadm";
+    shortdesc = "stop a Linux md (RAID) device";
     longdesc = "\
-This command resizes a btrfs filesystem.
+This command deactivates the MD array named C<md>.  The
+device is stopped, but it is not destroyed or zeroed." };
 
-Note that unlike other resize calls, the filesystem has to be
-mounted and the parameter is the mountpoint not the device
-(this is a requirement of btrfs itself).
+  { defaults with
+    name = "blkid"; added = (1, 15, 9);
+    style = RHashtable "info", [Device "device"], [];
+    proc_nr = Some 303;
+    tests = [
+      InitScratchFS, Always, TestResult (
+        [["blkid"; "/dev/sdb1"]],
+        "check_hash (ret, \"TYPE\", \"ext2\") == 0 && "^
+          "check_hash (ret, \"USAGE\", \"filesystem\") == 0 && "^
+          "check_hash (ret, \"PART_ENTRY_NUMBER\", \"1\") == 0 && "^
+          "check_hash (ret, \"PART_ENTRY_TYPE\", \"0x83\") == 0 && "^
+          "check_hash (ret, \"PART_ENTRY_OFFSET\", \"128\") == 0 && "^
+          "check_hash (ret, \"PART_ENTRY_SIZE\", \"4194049\") == 0"), [];
+    ];
+    shortdesc = "print block device attributes";
+    longdesc = "\
+This command returns block device attributes for C<device>. The following fields are
+usually present in the returned hash. Other fields may also be present.
 
-The optional parameters are:
+=over
 
-=over 4
+=item C<UUID>
 
-=item C<size>
+The uuid of this device.
 
-The new size (in bytes) of the filesystem.  If omitted, the filesystem
-is resized to the maximum size.
+=item C<LABEL>
 
-=back
+The label of this device.
 
-See also L<btrfs(8)>." };
+=item C<VERSION>
 
-  { defaults with
-    name = "internal_write_append"; added = (1, 19, 32);
-    style = RErr, [Pathname "path"; BufferIn "content"], [];
-    proc_nr = Some 290;
-    visibility = VInternal;
-    protocol_limit_warning = true;
-    tests = [
-      InitScratchFS, Always, TestResultString (
-        [["write"; "/internal_write_append"; "line1\n"];
-         ["internal_write_append"; "/internal_write_append"; "line2\n"];
-         ["internal_write_append"; "/internal_write_append"; "line3a"];
-         ["internal_write_append"; "/internal_write_append"; "line3b\n"];
-         ["cat"; "/internal_write_append"]], "line1\nline2\nline3aline3b\n"), []
-    ];
-    shortdesc = "append content to end of file";
-    longdesc = "\
-This call appends C<content> to the end of file C<path>.  If
-C<path> does not exist, then a new file is created.
+The version of blkid command.
 
-See also C<guestfs_write>." };
+=item C<TYPE>
+
+The filesystem type or RAID of this device.
+
+=item C<USAGE>
+
+The usage of this device, for example C<filesystem> or C<raid>.
+
+=back" };
 
   { defaults with
-    name = "compress_out"; added = (1, 13, 15);
-    style = RErr, [String "ctype"; Pathname "file"; FileOut "zfile"], [OInt "level"];
-    proc_nr = Some 291;
-    cancellable = true;
-    shortdesc = "output compressed file";
+    name = "e2fsck"; added = (1, 15, 17);
+    style = RErr, [Device "device"], [OBool "correct"; OBool "forceall"];
+    proc_nr = Some 304;
+    shortdesc = "check an ext2/ext3 filesystem";
     longdesc = "\
-This command compresses F<file> and writes it out to the local
-file F<zfile>.
+This runs the ext2/ext3 filesystem checker on C<device>.
+It can take the following optional arguments:
+
+=over 4
+
+=item C<correct>
+
+Automatically repair the file system. This option will cause e2fsck
+to automatically fix any filesystem problems that can be safely
+fixed without human intervention.
+
+This option may not be specified at the same time as the C<forceall> option.
+
+=item C<forceall>
 
-The compression program used is controlled by the C<ctype> parameter.
-Currently this includes: C<compress>, C<gzip>, C<bzip2>, C<xz> or C<lzop>.
-Some compression types may not be supported by particular builds of
-libguestfs, in which case you will get an error containing the
-substring \"not supported\".
+Assume an answer of 'yes' to all questions; allows e2fsck to be used
+non-interactively.
 
-The optional C<level> parameter controls compression level.  The
-meaning and default for this parameter depends on the compression
-program being used." };
+This option may not be specified at the same time as the C<correct> option.
+
+=back" };
 
   { defaults with
-    name = "compress_device_out"; added = (1, 13, 15);
-    style = RErr, [String "ctype"; Device "device"; FileOut "zdevice"], [OInt "level"];
-    proc_nr = Some 292;
-    cancellable = true;
-    shortdesc = "output compressed device";
+    name = "llz"; added = (1, 17, 6);
+    style = RString "listing", [Pathname "directory"], [];
+    proc_nr = Some 305;
+    deprecated_by = Some "lgetxattrs";
+    shortdesc = "list the files in a directory (long format with SELinux contexts)";
     longdesc = "\
-This command compresses C<device> and writes it out to the local
-file C<zdevice>.
+List the files in F<directory> in the format of 'ls -laZ'.
 
-The C<ctype> and optional C<level> parameters have the same meaning
-as in C<guestfs_compress_out>." };
+This command is mostly useful for interactive sessions.  It
+is I<not> intended that you try to parse the output string." };
 
   { defaults with
-    name = "part_to_partnum"; added = (1, 13, 25);
-    style = RInt "partnum", [Device "partition"], [];
-    proc_nr = Some 293;
+    name = "wipefs"; added = (1, 17, 6);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 306;
+    optional = Some "wipefs";
     tests = [
-      InitPartition, Always, TestResult (
-        [["part_to_partnum"; "/dev/sda1"]], "ret == 1"), [];
-      InitEmpty, Always, TestLastFail (
-        [["part_to_partnum"; "/dev/sda"]]), []
+      InitBasicFSonLVM, Always, TestRun (
+        [["umount"; "/dev/VG/LV"; ""; ""];
+         ["wipefs"; "/dev/VG/LV"]]), []
     ];
-    shortdesc = "convert partition name to partition number";
+    shortdesc = "wipe a filesystem signature from a device";
     longdesc = "\
-This function takes a partition name (eg. \"/dev/sdb1\") and
-returns the partition number (eg. C<1>).
+This command erases filesystem or RAID signatures from
+the specified C<device> to make the filesystem invisible to libblkid.
 
-The named partition must exist, for example as a string returned
-from C<guestfs_list_partitions>.
+This does not erase the filesystem itself nor any other data from the
+C<device>.
 
-See also C<guestfs_part_to_dev>." };
+Compare with C<guestfs_zero> which zeroes the first few blocks of a
+device." };
 
   { defaults with
-    name = "copy_device_to_device"; added = (1, 13, 25);
-    style = RErr, [Device "src"; Device "dest"], [OInt64 "srcoffset"; OInt64 "destoffset"; OInt64 "size"; OBool "sparse"; OBool "append"];
-    proc_nr = Some 294;
-    progress = true;
-    shortdesc = "copy from source device to destination device";
+    name = "ntfsfix"; added = (1, 17, 9);
+    style = RErr, [Device "device"], [OBool "clearbadsectors"];
+    proc_nr = Some 307;
+    optional = Some "ntfs3g";
+    tests = [
+      InitPartition, Always, TestRun (
+        [["mkfs"; "ntfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["ntfsfix"; "/dev/sda1"; "false"]]), []
+    ];
+    shortdesc = "fix common errors and force Windows to check NTFS";
     longdesc = "\
-The four calls C<guestfs_copy_device_to_device>,
-C<guestfs_copy_device_to_file>,
-C<guestfs_copy_file_to_device>, and
-C<guestfs_copy_file_to_file>
-let you copy from a source (device|file) to a destination
-(device|file).
+This command repairs some fundamental NTFS inconsistencies,
+resets the NTFS journal file, and schedules an NTFS consistency
+check for the first boot into Windows.
 
-Partial copies can be made since you can specify optionally
-the source offset, destination offset and size to copy.  These
-values are all specified in bytes.  If not given, the offsets
-both default to zero, and the size defaults to copying as much
-as possible until we hit the end of the source.
+This is I<not> an equivalent of Windows C<chkdsk>.  It does I<not>
+scan the filesystem for inconsistencies.
 
-The source and destination may be the same object.  However
-overlapping regions may not be copied correctly.
+The optional C<clearbadsectors> flag clears the list of bad sectors.
+This is useful after cloning a disk with bad sectors to a new disk." };
 
-If the destination is a file, it is created if required.  If
-the destination file is not large enough, it is extended.
+  { defaults with
+    name = "ntfsclone_out"; added = (1, 17, 9);
+    style = RErr, [Device "device"; FileOut "backupfile"], [OBool "metadataonly"; OBool "rescue"; OBool "ignorefscheck"; OBool "preservetimestamps"; OBool "force"; OString "compress"];
+    proc_nr = Some 308;
+    optional = Some "ntfs3g"; cancellable = true;
+    test_excuse = "tested in tests/ntfsclone";
+    shortdesc = "save NTFS to backup file";
+    longdesc = "\
+Stream the NTFS filesystem C<device> to the local file
+C<backupfile>.  The format used for the backup file is a
+special format used by the L<ntfsclone(8)> tool.
 
-If the destination is a file and the C<append> flag is not set,
-then the destination file is truncated.  If the C<append> flag is
-set, then the copy appends to the destination file.  The C<append>
-flag currently cannot be set for devices.
+If the optional C<metadataonly> flag is true, then I<only> the
+metadata is saved, losing all the user data (this is useful
+for diagnosing some filesystem problems).
 
-If the C<sparse> flag is true then the call avoids writing
-blocks that contain only zeroes, which can help in some situations
-where the backing disk is thin-provisioned.  Note that unless
-the target is already zeroed, using this option will result
-in incorrect copying." };
+The optional C<rescue>, C<ignorefscheck>, C<preservetimestamps>
+and C<force> flags have precise meanings detailed in the
+L<ntfsclone(8)> man page.
 
-  { defaults with
-    name = "copy_device_to_file"; added = (1, 13, 25);
-    style = RErr, [Device "src"; Pathname "dest"], [OInt64 "srcoffset"; OInt64 "destoffset"; OInt64 "size"; OBool "sparse"; OBool "append"];
-    proc_nr = Some 295;
-    progress = true;
-    shortdesc = "copy from source device to destination file";
-    longdesc = "\
-See C<guestfs_copy_device_to_device> for a general overview
-of this call." };
+The optional C<compress> flag compresses the backup file in the
+appliance, so that less data has to be transferred.  It can be
+one of: C<compress>, C<gzip>, C<bzip2>, C<xz>, C<lzop>, C<zstd>.
+(Note that not all builds of libguestfs will support all of these
+compression types).  C<gzip>, C<xz> and C<zstd> are usually
+compressed on all the vCPUs of the appliance, so it can help to
+give the appliance more vCPUs (see C<guestfs_set_smp>).
 
-  { defaults with
-    name = "copy_file_to_device"; added = (1, 13, 25);
-    style = RErr, [Pathname "src"; Device "dest"], [OInt64 "srcoffset"; OInt64 "destoffset"; OInt64 "size"; OBool "sparse"; OBool "append"];
-    proc_nr = Some 296;
-    progress = true;
-    shortdesc = "copy from source file to destination device";
-    longdesc = "\
-See C<guestfs_copy_device_to_device> for a general overview
-of this call." };
+Progress messages are sent while saving, estimated from the
+number of clusters in use in the filesystem, except when
+C<metadataonly> is given or the compression type is
+compressed by an external program.
+
+Use C<guestfs_ntfsclone_in> to restore the file back to a
+libguestfs device." };
 
   { defaults with
-    name = "copy_file_to_file"; added = (1, 13, 25);
-    style = RErr, [Pathname "src"; Pathname "dest"], [OInt64 "srcoffset"; OInt64 "destoffset"; OInt64 "size"; OBool "sparse"; OBool "append"];
-    proc_nr = Some 297;
-    progress = true;
-    tests = [
-      InitScratchFS, Always, TestResult (
-        [["mkdir"; "/copyff"];
-         ["write"; "/copyff/src"; "hello, world"];
-         ["copy_file_to_file"; "/copyff/src"; "/copyff/dest"; ""; ""; ""; ""; "false"];
-         ["read_file"; "/copyff/dest"]],
-        "compare_buffers (ret, size, \"hello, world\", 12) == 0"), [];
-      InitScratchFS, Always, TestResultTrue (
-        let size = 1024 * 1024 in
-        [["mkdir"; "/copyff2"];
-         ["fill"; "0"; string_of_int size; "/copyff2/src"];
-         ["touch"; "/copyff2/dest"];
-         ["truncate_size"; "/copyff2/dest"; string_of_int size];
-         ["copy_file_to_file"; "/copyff2/src"; "/copyff2/dest"; ""; ""; ""; "true"; "false"];
-         ["is_zero"; "/copyff2/dest"]]), [];
-      InitScratchFS, Always, TestResult (
-        [["mkdir"; "/copyff3"];
-         ["write"; "/copyff3/src"; "hello, world"];
-         ["copy_file_to_file"; "/copyff3/src"; "/copyff3/dest"; ""; ""; ""; ""; "true"];
-         ["copy_file_to_file"; "/copyff3/src"; "/copyff3/dest"; ""; ""; ""; ""; "true"];
-         ["copy_file_to_file"; "/copyff3/src"; "/copyff3/dest"; ""; ""; ""; ""; "true"];
-         ["read_file"; "/copyff3/dest"]],
-        "compare_buffers (ret, size, \"hello, worldhello, worldhello, world\", 12*3) == 0"), [];
-    ];
-    shortdesc = "copy from source file to destination file";
+    name = "ntfsclone_in"; added = (1, 17, 9);
+    style = RErr, [FileIn "backupfile"; Device "device"], [OString "compress"];
+    proc_nr = Some 309;
+    once_had_no_optargs = true;
+    optional = Some "ntfs3g"; cancellable = true;
+    test_excuse = "tested in tests/ntfsclone";
+    shortdesc = "restore NTFS from backup file";
     longdesc = "\
-See C<guestfs_copy_device_to_device> for a general overview
-of this call.
+Restore the C<backupfile> (from a previous call to
+C<guestfs_ntfsclone_out>) to C<device>, overwriting
+any existing contents of this device.
 
-This is B<not> the function you want for copying files.  This
-is for copying blocks within existing files.  See C<guestfs_cp>,
-C<guestfs_cp_a> and C<guestfs_mv> for general file copying and
-moving functions." };
+If the backup file was compressed, the optional C<compress> flag
+must give the same compression type as was used for
+C<guestfs_ntfsclone_out>.  The backup file is decompressed in
+the appliance, in parallel with writing it to the device." };
 
   { defaults with
-    name = "tune2fs"; added = (1, 15, 4);
-    style = RErr, [Device "device"], [OBool "force"; OInt "maxmountcount"; OInt "mountcount"; OString "errorbehavior"; OInt64 "group"; OInt "intervalbetweenchecks"; OInt "reservedblockspercentage"; OString "lastmounteddirectory"; OInt64 "reservedblockscount"; OInt64 "user"];
-    proc_nr = Some 298;
-    camel_name = "Tune2FS";
+    name = "set_label"; added = (1, 17, 9);
+    style = RErr, [Mountable "mountable"; String "label"], [];
+    proc_nr = Some 310;
     tests = [
-      InitScratchFS, Always, TestResult (
-        [["tune2fs"; "/dev/sdb1"; "false"; "0"; ""; "NOARG"; ""; "0"; ""; "NOARG"; ""; ""];
-         ["tune2fs_l"; "/dev/sdb1"]],
-        "check_hash (ret, \"Check interval\", \"0 (<none>)\") == 0 && "^
-          "check_hash (ret, \"Maximum mount count\", \"-1\") == 0"), [];
-      InitScratchFS, Always, TestResult (
-        [["tune2fs"; "/dev/sdb1"; "false"; "0"; ""; "NOARG"; ""; "86400"; ""; "NOARG"; ""; ""];
-         ["tune2fs_l"; "/dev/sdb1"]],
-        "check_hash (ret, \"Check interval\", \"86400 (1 day)\") == 0 && "^
-          "check_hash (ret, \"Maximum mount count\", \"-1\") == 0"), [];
-      InitScratchFS, Always, TestResult (
-        [["tune2fs"; "/dev/sdb1"; "false"; ""; ""; "NOARG"; "1"; ""; ""; "NOARG"; ""; "1"];
-         ["tune2fs_l"; "/dev/sdb1"]],
-        "match_re (get_key (ret, \"Reserved blocks uid\"), \"\\\\d+ \\\\(user \\\\S+\\\\)\") && "^
-          "match_re (get_key (ret, \"Reserved blocks gid\"), \"\\\\d+ \\\\(group \\\\S+\\\\)\")"), [];
-      InitScratchFS, Always, TestResult (
-        [["tune2fs"; "/dev/sdb1"; "false"; ""; ""; "NOARG"; "0"; ""; ""; "NOARG"; ""; "0"];
-         ["tune2fs_l"; "/dev/sdb1"]],
-        "match_re (get_key (ret, \"Reserved blocks uid\"), \"\\\\d+ \\\\(user \\\\S+\\\\)\") && "^
-          "match_re (get_key (ret, \"Reserved blocks gid\"), \"\\\\d+ \\\\(group \\\\S+\\\\)\")"), [];
+      InitBasicFS, Always, TestResultString (
+        [["set_label"; "/dev/sda1"; "testlabel"];
+         ["vfs_label"; "/dev/sda1"]], "testlabel"), [];
+      InitPartition, IfAvailable "ntfs3g", TestResultString (
+        [["mkfs"; "ntfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["set_label"; "/dev/sda1"; "testlabel2"];
+         ["vfs_label"; "/dev/sda1"]], "testlabel2"), [];
+      InitPartition, Always, TestLastFail (
+        [["zero"; "/dev/sda1"];
+         ["set_label"; "/dev/sda1"; "testlabel2"]]), []
     ];
-    shortdesc = "adjust ext2/ext3/ext4 filesystem parameters";
+    shortdesc = "set filesystem label";
     longdesc = "\
-This call allows you to adjust various filesystem parameters of
-an ext2/ext3/ext4 filesystem called C<device>.
+Set the filesystem label on C<mountable> to C<label>.
 
-The optional parameters are:
+Only some filesystem types support labels, and libguestfs supports
+setting labels on only a subset of these.
 
 =over 4
 
-=item C<force>
+=item ext2, ext3, ext4
 
-Force tune2fs to complete the operation even in the face of errors.
-This is the same as the tune2fs C<-f> option.
+Labels are limited to 16 bytes.
 
-=item C<maxmountcount>
+=item NTFS
 
-Set the number of mounts after which the filesystem is checked
-by L<e2fsck(8)>.  If this is C<0> then the number of mounts is
-disregarded.  This is the same as the tune2fs C<-c> option.
+Labels are limited to 128 unicode characters.
 
-=item C<mountcount>
+=item XFS
 
-Set the number of times the filesystem has been mounted.
-This is the same as the tune2fs C<-C> option.
+The label is limited to 12 bytes.  The filesystem must not
+be mounted when trying to set the label.
 
-=item C<errorbehavior>
+=item btrfs
 
-Change the behavior of the kernel code when errors are detected.
-Possible values currently are: C<continue>, C<remount-ro>, C<panic>.
-In practice these options don't really make any difference,
-particularly for write errors.
+The label is limited to 255 bytes and some characters are
+not allowed.  Setting the label on a btrfs subvolume will set the
+label on its parent filesystem.  The filesystem must not be mounted
+when trying to set the label.
 
-This is the same as the tune2fs C<-e> option.
+=item fat
 
-=item C<group>
+The label is limited to 11 bytes.
 
-Set the group which can use reserved filesystem blocks.
-This is the same as the tune2fs C<-g> option except that it
-can only be specified as a number.
+=item swap
 
-=item C<intervalbetweenchecks>
+The label is limited to 16 bytes.
 
-Adjust the maximal time between two filesystem checks
-(in seconds).  If the option is passed as C<0> then
-time-dependent checking is disabled.
+=back
 
-This is the same as the tune2fs C<-i> option.
+If there is no support for changing the label
+for the type of the specified filesystem,
+set_label will fail and set errno as ENOTSUP.
 
-=item C<reservedblockspercentage>
+To read the label on a filesystem, call C<guestfs_vfs_label>." };
 
-Set the percentage of the filesystem which may only be allocated
-by privileged processes.
-This is the same as the tune2fs C<-m> option.
+  { defaults with
+    name = "zero_free_space"; added = (1, 17, 18);
+    style = RErr, [Pathname "directory"], [];
+    proc_nr = Some 311;
+    progress = true;
+    tests = [
+      InitScratchFS, Always, TestRun (
+        [["zero_free_space"; "/"]]), []
+    ];
+    shortdesc = "zero free space in a filesystem";
+    longdesc = "\
+Zero the free space in the filesystem mounted on F<directory>.
+The filesystem must be mounted read-write.
 
-=item C<lastmounteddirectory>
+The filesystem contents are not affected, but any free space
+in the filesystem is freed.
 
-Set the last mounted directory.
-This is the same as the tune2fs C<-M> option.
+Free space is not \"trimmed\".  You may want to call
+C<guestfs_fstrim> either as an alternative to this,
+or after calling this, depending on your requirements." };
 
-=item C<reservedblockscount>
-Set the number of reserved filesystem blocks.
-This is the same as the tune2fs C<-r> option.
+  { defaults with
+    name = "lvcreate_free"; added = (1, 17, 18);
+    style = RErr, [String "logvol"; String "volgroup"; Int "percent"], [];
+    proc_nr = Some 312;
+    optional = Some "lvm2";
+    tests = [
+      InitEmpty, Always, TestResult (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["pvcreate"; "/dev/sda1"];
+         ["vgcreate"; "VG"; "/dev/sda1"];
+         ["lvcreate_free"; "LV1"; "VG"; "50"];
+         ["lvcreate_free"; "LV2"; "VG"; "50"];
+         ["lvcreate_free"; "LV3"; "VG"; "50"];
+         ["lvcreate_free"; "LV4"; "VG"; "100"];
+         ["lvs"]],
+        "is_string_list (ret, 4, \"/dev/VG/LV1\", \"/dev/VG/LV2\", \"/dev/VG/LV3\", \"/dev/VG/LV4\")"), []
+    ];
+    shortdesc = "create an LVM logical volume in % remaining free space";
+    longdesc = "\
+Create an LVM logical volume called F</dev/volgroup/logvol>,
+using approximately C<percent> % of the free space remaining
+in the volume group.  Most usefully, when C<percent> is C<100>
+this will create the largest possible LV." };
 
-=item C<user>
+  { defaults with
+    name = "isoinfo_device"; added = (1, 17, 19);
+    style = RStruct ("isodata", "isoinfo"), [Device "device"], [];
+    proc_nr = Some 313;
+    tests = [
+      InitNone, Always, TestResult (
+        [["isoinfo_device"; "/dev/sdd"]],
+        "STREQ (ret->iso_system_id, GUESTFS_ISO_SYSTEM_ID) && "^
+          "STREQ (ret->iso_volume_id, \"CDROM\") && "^
+          "STREQ (ret->iso_volume_set_id, \"\") && "^
+          "ret->iso_volume_set_size == 1 && "^
+          "ret->iso_volume_sequence_number == 1 && "^
+          "ret->iso_logical_block_size == 2048"), []
+    ];
+    shortdesc = "get ISO information from primary volume descriptor of device";
+    longdesc = "\
+C<device> is an ISO device.  This returns a struct of information
+read from the primary volume descriptor (the ISO equivalent of the
+superblock) of the device.
 
-Set the user who can use the reserved filesystem blocks.
-This is the same as the tune2fs C<-u> option except that it
-can only be specified as a number.
+Usually it is more efficient to use the L<isoinfo(1)> command
+with the I<-d> option on the host to analyze ISO files,
+instead of going through libguestfs.
 
-=back
+For information on the primary volume descriptor fields, see
+L<http://wiki.osdev.org/ISO_9660#The_Primary_Volume_Descriptor>" };
 
-To get the current values of filesystem parameters, see
-C<guestfs_tune2fs_l>.  For precise details of how tune2fs
-works, see the L<tune2fs(8)> man page." };
+  { defaults with
+    name = "isoinfo"; added = (1, 17, 19);
+    style = RStruct ("isodata", "isoinfo"), [Pathname "isofile"], [];
+    proc_nr = Some 314;
+    shortdesc = "get ISO information from primary volume descriptor of ISO file";
+    longdesc = "\
+This is the same as C<guestfs_isoinfo_device> except that it
+works for an ISO file located inside some other mounted filesystem.
+Note that in the common case where you have added an ISO file
+as a libguestfs device, you would I<not> call this.  Instead
+you would call C<guestfs_isoinfo_device>." };
 
   { defaults with
-    name = "md_create"; added = (1, 15, 6);
-    style = RErr, [String "name"; DeviceList "devices"], [OInt64 "missingbitmap"; OInt "nrdevices"; OInt "spare"; OInt64 "chunk"; OString "level"];
-    proc_nr = Some 299;
-    optional = Some "mdadm"; camel_name = "MDCreate";
-    shortdesc = "create a Linux md (RAID) device";
+    name = "vgmeta"; added = (1, 17, 20);
+    style = RBufferOut "metadata", [String "vgname"], [];
+    proc_nr = Some 315;
+    optional = Some "lvm2";
+    shortdesc = "get volume group metadata";
     longdesc = "\
-Create a Linux md (RAID) device named C<name> on the devices
-in the list C<devices>.
+C<vgname> is an LVM volume group.  This command examines the
+volume group and returns its metadata.
 
-The optional parameters are:
+Note that the metadata is an internal structure used by LVM,
+subject to change at any time, and is provided for information only." };
 
-=over 4
+  { defaults with
+    name = "md_stat"; added = (1, 17, 21);
+    style = RStructList ("devices", "mdstat"), [Device "md"], [];
+    proc_nr = Some 316;
+    optional = Some "mdadm";
+    shortdesc = "get underlying devices from an MD device";
+    longdesc = "\
+This call returns a list of the underlying devices which make
+up the single software RAID array device C<md>.
 
-=item C<missingbitmap>
+To get a list of software RAID devices, call C<guestfs_list_md_devices>.
 
-A bitmap of missing devices.  If a bit is set it means that a
-missing device is added to the array.  The least significant bit
-corresponds to the first device in the array.
+Each structure returned corresponds to one device along with
+additional status information:
 
-As examples:
+=over 4
 
-If C<devices = [\"/dev/sda\"]> and C<missingbitmap = 0x1> then
-the resulting array would be C<[E<lt>missingE<gt>, \"/dev/sda\"]>.
+=item C<mdstat_device>
 
-If C<devices = [\"/dev/sda\"]> and C<missingbitmap = 0x2> then
-the resulting array would be C<[\"/dev/sda\", E<lt>missingE<gt>]>.
+The name of the underlying device.
 
-This defaults to C<0> (no missing devices).
+=item C<mdstat_index>
 
-The length of C<devices> + the number of bits set in
-C<missingbitmap> must equal C<nrdevices> + C<spare>.
+The index of this device within the array.
 
-=item C<nrdevices>
+=item C<mdstat_flags>
 
-The number of active RAID devices.
+Flags associated with this device.  This is a string containing
+(in no specific order) zero or more of the following flags:
 
-If not set, this defaults to the length of C<devices> plus
-the number of bits set in C<missingbitmap>.
+=over 4
 
-=item C<spare>
+=item C<W>
 
-The number of spare devices.
+write-mostly
 
-If not set, this defaults to C<0>.
+=item C<F>
 
-=item C<chunk>
+device is faulty
 
-The chunk size in bytes.
+=item C<S>
 
-=item C<level>
+device is a RAID spare
 
-The RAID level, which can be one of:
-I<linear>, I<raid0>, I<0>, I<stripe>, I<raid1>, I<1>, I<mirror>,
-I<raid4>, I<4>, I<raid5>, I<5>, I<raid6>, I<6>, I<raid10>, I<10>.
-Some of these are synonymous, and more levels may be added in future.
+=item C<R>
 
-If not set, this defaults to C<raid1>.
+replacement
 
-=back" };
+=back
 
-  { defaults with
-    name = "list_md_devices"; added = (1, 15, 4);
-    style = RStringList "devices", [], [];
-    proc_nr = Some 300;
-    shortdesc = "list Linux md (RAID) devices";
-    longdesc = "\
-List all Linux md devices." };
+=back" };
 
   { defaults with
-    name = "md_detail"; added = (1, 15, 6);
-    style = RHashtable "info", [Device "md"], [];
-    proc_nr = Some 301;
-    optional = Some "mdadm";
-    shortdesc = "obtain metadata for an MD device";
+    name = "mkfs_btrfs"; added = (1, 17, 25);
+    style = RErr, [DeviceList "devices"], [OInt64 "allocstart"; OInt64 "bytecount"; OString "datatype"; OInt "leafsize"; OString "label"; OString "metadata"; OInt "nodesize"; OInt "sectorsize"];
+    proc_nr = Some 317;
+    optional = Some "btrfs";
+    tests = [
+      InitEmpty, Always, TestRun (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["mkfs_btrfs"; "/dev/sda1"; "0"; "268435456"; "single"; ""; "test"; "single"; "65536"; "512"]]), []
+    ];
+    shortdesc = "create a btrfs filesystem";
     longdesc = "\
-This command exposes the output of 'mdadm -DY E<lt>mdE<gt>'.
-The following fields are usually present in the returned hash.
-Other fields may also be present.
-
-=over
+Create a btrfs filesystem, allowing all configurables to be set.
+For more information on the optional arguments, see L<mkfs.btrfs(8)>.
 
-=item C<level>
+Since btrfs filesystems can span multiple devices, this takes a
+non-empty list of devices.
 
-The raid level of the MD device.
+To create general filesystems, use C<guestfs_mkfs>." };
 
-=item C<devices>
+  { defaults with
+    name = "get_e2attrs"; added = (1, 17, 31);
+    style = RString "attrs", [Pathname "file"], [];
+    proc_nr = Some 318;
+    tests = [
+      InitScratchFS, Always, TestResultString (
+        [["touch"; "/e2attrs1"];
+         ["get_e2attrs"; "/e2attrs1"]], ""), [];
+      InitScratchFS, Always, TestResultString (
+        [["touch"; "/e2attrs2"];
+         ["set_e2attrs"; "/e2attrs2"; "is"; "false"];
+         ["get_e2attrs"; "/e2attrs2"]], "is"), [];
+      InitScratchFS, Always, TestResultString (
+        [["touch"; "/e2attrs3"];
+         ["set_e2attrs"; "/e2attrs3"; "is"; "false"];
+         ["set_e2attrs"; "/e2attrs3"; "i"; "true"];
+         ["get_e2attrs"; "/e2attrs3"]], "s"), [];
+      InitScratchFS, Always, TestResultString (
+        [["touch"; "/e2attrs4"];
+         ["set_e2attrs"; "/e2attrs4"; "adst"; "false"];
+         ["set_e2attrs"; "/e2attrs4"; "iS"; "false"];
+         ["set_e2attrs"; "/e2attrs4"; "i"; "true"];
+         ["set_e2attrs"; "/e2attrs4"; "ad"; "true"];
+         ["set_e2attrs"; "/e2attrs4"; ""; "false"];
+         ["set_e2attrs"; "/e2attrs4"; ""; "true"];
+         ["get_e2attrs"; "/e2attrs4"]], "Sst"), [];
+      InitScratchFS, Always, TestLastFail (
+        [["touch"; "/e2attrs5"];
+         ["set_e2attrs"; "/e2attrs5"; "R"; "false"]]), [];
+      InitScratchFS, Always, TestLastFail (
+        [["touch"; "/e2attrs6"];
+         ["set_e2attrs"; "/e2attrs6"; "v"; "false"]]), [];
+      InitScratchFS, Always, TestLastFail (
+        [["touch"; "/e2attrs7"];
+         ["set_e2attrs"; "/e2attrs7"; "aa"; "false"]]), [];
+      InitScratchFS, Always, TestLastFail (
+        [["touch"; "/e2attrs8"];
+         ["set_e2attrs"; "/e2attrs8"; "BabcdB"; "false"]]), []
+    ];
+    shortdesc = "get ext2 file attributes of a file";
+    longdesc = "\
+This returns the file attributes associated with F<file>.
 
-The number of underlying devices in the MD device.
+The attributes are a set of bits associated with each
+inode which affect the behaviour of the file.  The attributes
+are returned as a string of letters (described below).  The
+string may be empty, indicating that no file attributes are
+set for this file.
 
-=item C<metadata>
+These attributes are only present when the file is located on
+an ext2/3/4 filesystem.  Using this call on other filesystem
+types will result in an error.
 
-The metadata version used.
+The characters (file attributes) in the returned string are
+currently:
 
-=item C<uuid>
+=over 4
 
-The UUID of the MD device.
+=item 'A'
 
-=item C<name>
+When the file is accessed, its atime is not modified.
 
-The name of the MD device.
+=item 'a'
 
-=back" };
+The file is append-only.
 
-  { defaults with
-    name = "md_stop"; added = (1, 15, 6);
-    style = RErr, [Device "md"], [];
-    proc_nr = Some 302;
-    optional = Some "mdadm";
-    shortdesc = "stop a Linux md (RAID) device";
-    longdesc = "\
-This command deactivates the MD array named C<md>.  The
-device is stopped, but it is not destroyed or zeroed." };
+=item 'c'
 
-  { defaults with
-    name = "blkid"; added = (1, 15, 9);
-    style = RHashtable "info", [Device "device"], [];
-    proc_nr = Some 303;
-    tests = [
-      InitScratchFS, Always, TestResult (
-        [["blkid"; "/dev/sdb1"]],
-        "check_hash (ret, \"TYPE\", \"ext2\") == 0 && "^
-          "check_hash (ret, \"USAGE\", \"filesystem\") == 0 && "^
-          "check_hash (ret, \"PART_ENTRY_NUMBER\", \"1\") == 0 && "^
-          "check_hash (ret, \"PART_ENTRY_TYPE\", \"0x83\") == 0 && "^
-          "check_hash (ret, \"PART_ENTRY_OFFSET\", \"128\") == 0 && "^
-          "check_hash (ret, \"PART_ENTRY_SIZE\", \"4194049\") == 0"), [];
-    ];
-    shortdesc = "print block device attributes";
-    longdesc = "\
-This command returns block device attributes for C<device>. The following fields are
-usually present in the returned hash. Other fields may also be present.
+The file is compressed on-disk.
 
-=over
+=item 'D'
 
-=item C<UUID>
+(Directories only.)  Changes to this directory are written
+synchronously to disk.
 
-The uuid of this device.
+=item 'd'
 
-=item C<LABEL>
+The file is not a candidate for backup (see L<dump(8)>).
 
-The label of this device.
+=item 'E'
 
-=item C<VERSION>
+The file has compression errors.
 
-The version of blkid command.
+=item 'e'
 
-=item C<TYPE>
+The file is using extents.
 
-The filesystem type or RAID of this device.
+=item 'h'
 
-=item C<USAGE>
+The file is storing its blocks in units of the filesystem blocksize
+instead of sectors.
 
-The usage of this device, for example C<filesystem> or C<raid>.
+=item 'I'
 
-=back" };
+(Directories only.)  The directory is using hashed trees.
 
-  { defaults with
-    name = "e2fsck"; added = (1, 15, 17);
-    style = RErr, [Device "device"], [OBool "correct"; OBool "forceall"];
-    proc_nr = Some 304;
-    shortdesc = "check an ext2/ext3 filesystem";
-    longdesc = "\
-This runs the ext2/ext3 filesystem checker on C<device>.
-It can take the following optional arguments:
+=item 'i'
 
-=over 4
+The file is immutable.  It cannot be modified, deleted or renamed.
+No link can be created to this file.
 
-=item C<correct>
+=item 'j'
 
-Automatically repair the file system. This option will cause e2fsck
-to automatically fix any filesystem problems that can be safely
-fixed without human intervention.
+The file is data-journaled.
 
-This option may not be specified at the same time as the C<forceall> option.
+=item 's'
 
-=item C<forceall>
+When the file is deleted, all its blocks will be zeroed.
 
-Assume an answer of 'yes' to all questions; allows e2fsck to be used
-non-interactively.
+=item 'S'
 
-This option may not be specified at the same time as the C<correct> option.
+Changes to this file are written synchronously to disk.
 
-=back" };
+=item 'T'
 
-  { defaults with
-    name = "llz"; added = (1, 17, 6);
-    style = RString "listing", [Pathname "directory"], [];
-    proc_nr = Some 305;
-    deprecated_by = Some "lgetxattrs";
-    shortdesc = "list the files in a directory (long format with SELinux contexts)";
-    longdesc = "\
-List the files in F<directory> in the format of 'ls -laZ'.
+(Directories only.)  This is a hint to the block allocator
+that subdirectories contained in this directory should be
+spread across blocks.  If not present, the block allocator
+will try to group subdirectories together.
 
-This command is mostly useful for interactive sessions.  It
-is I<not> intended that you try to parse the output string." };
+=item 't'
 
-  { defaults with
-    name = "wipefs"; added = (1, 17, 6);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 306;
-    optional = Some "wipefs";
-    tests = [
-      InitBasicFSonLVM, Always, TestRun (
-        [["umount"; "/dev/VG/LV"; ""; ""];
-         ["wipefs"; "/dev/VG/LV"]]), []
-    ];
-    shortdesc = "wipe a filesystem signature from a device";
-    longdesc = "\
-This command erases filesystem or RAID signatures from
-the specified C<device> to make the filesystem invisible to libblkid.
+For a file, this disables tail-merging.
+(Not used by upstream implementations of ext2.)
 
-This does not erase the filesystem itself nor any other data from the
-C<device>.
+=item 'u'
 
-Compare with C<guestfs_zero> which zeroes the first few blocks of a
-device." };
+When the file is deleted, its blocks will be saved, allowing
+the file to be undeleted.
 
-  { defaults with
-    name = "ntfsfix"; added = (1, 17, 9);
-    style = RErr, [Device "device"], [OBool "clearbadsectors"];
-    proc_nr = Some 307;
-    optional = Some "ntfs3g";
-    tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs"; "ntfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
-         ["ntfsfix"; "/dev/sda1"; "false"]]), []
-    ];
-    shortdesc = "fix common errors and force Windows to check NTFS";
-    longdesc = "\
-This command repairs some fundamental NTFS inconsistencies,
-resets the NTFS journal file, and schedules an NTFS consistency
-check for the first boot into Windows.
+=item 'X'
 
-This is I<not> an equivalent of Windows C<chkdsk>.  It does I<not>
-scan the filesystem for inconsistencies.
+The raw contents of the compressed file may be accessed.
 
-The optional C<clearbadsectors> flag clears the list of bad sectors.
-This is useful after cloning a disk with bad sectors to a new disk." };
+=item 'Z'
 
-  { defaults with
-    name = "ntfsclone_out"; added = (1, 17, 9);
-    style = RErr, [Device "device"; FileOut "backupfile"], [OBool "metadataonly"; OBool "rescue"; OBool "ignorefscheck"; OBool "preservetimestamps"; OBool "force"];
-    proc_nr = Some 308;
-    optional = Some "ntfs3g"; cancellable = true;
-    test_excuse = "tested in tests/ntfsclone";
-    shortdesc = "save NTFS to backup file";
-    longdesc = "\
-Stream the NTFS filesystem C<device> to the local file
-C<backupfile>.  The format used for the backup file is a
-special format used by the L<ntfsclone(8)> tool.
+The compressed file is dirty.
 
-If the optional C<metadataonly> flag is true, then I<only> the
-metadata is saved, losing all the user data (this is useful
-for diagnosing some filesystem problems).
+=back
 
-The optional C<rescue>, C<ignorefscheck>, C<preservetimestamps>
-and C<force> flags have precise meanings detailed in the
-L<ntfsclone(8)> man page.
+More file attributes may be added to this list later.  Not all
+file attributes may be set for all kinds of files.  For
+detailed information, consult the L<chattr(1)> man page.
 
-Use C<guestfs_ntfsclone_in> to restore the file back to a
-libguestfs device." };
+See also C<guestfs_set_e2attrs>.
 
-  { defaults with
-    name = "ntfsclone_in"; added = (1, 17, 9);
-    style = RErr, [FileIn "backupfile"; Device "device"], [];
-    proc_nr = Some 309;
-    optional = Some "ntfs3g"; cancellable = true;
-    test_excuse = "tested in tests/ntfsclone";
-    shortdesc = "restore NTFS from backup file";
-    longdesc = "\
-Restore the C<backupfile> (from a previous call to
-C<guestfs_ntfsclone_out>) to C<device>, overwriting
-any existing contents of this device." };
+Don't confuse these attributes with extended attributes
+(see C<guestfs_getxattr>)." };
 
   { defaults with
-    name = "set_label"; added = (1, 17, 9);
-    style = RErr, [Mountable "mountable"; String "label"], [];
-    proc_nr = Some 310;
-    tests = [
-      InitBasicFS, Always, TestResultString (
-        [["set_label"; "/dev/sda1"; "testlabel"];
-         ["vfs_label"; "/dev/sda1"]], "testlabel"), [];
-      InitPartition, IfAvailable "ntfs3g", TestResultString (
-        [["mkfs"; "ntfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
-         ["set_label"; "/dev/sda1"; "testlabel2"];
-         ["vfs_label"; "/dev/sda1"]], "testlabel2"), [];
-      InitPartition, Always, TestLastFail (
-        [["zero"; "/dev/sda1"];
-         ["set_label"; "/dev/sda1"; "testlabel2"]]), []
-    ];
-    shortdesc = "set filesystem label";
+    name = "set_e2attrs"; added = (1, 17, 31);
+    style = RErr, [Pathname "file"; String "attrs"], [OBool "clear"];
+    proc_nr = Some 319;
+    shortdesc = "set ext2 file attributes of a file";
     longdesc = "\
-Set the filesystem label on C<mountable> to C<label>.
-
-Only some filesystem types support labels, and libguestfs supports
-setting labels on only a subset of these.
-
-=over 4
-
-=item ext2, ext3, ext4
-
-Labels are limited to 16 bytes.
-
-=item NTFS
-
-Labels are limited to 128 unicode characters.
+This sets or clears the file attributes C<attrs>
+associated with the inode F<file>.
 
-=item XFS
+C<attrs> is a string of characters representing
+file attributes.  See C<guestfs_get_e2attrs> for a list of
+possible attributes.  Not all attributes can be changed.
 
-The label is limited to 12 bytes.  The filesystem must not
-be mounted when trying to set the label.
+If optional boolean C<clear> is not present or false, then
+the C<attrs> listed are set in the inode.
 
-=item btrfs
+If C<clear> is true, then the C<attrs> listed are cleared
+in the inode.
 
-The label is limited to 255 bytes and some characters are
-not allowed.  Setting the label on a btrfs subvolume will set the
-label on its parent filesystem.  The filesystem must not be mounted
-when trying to set the label.
+In both cases, other attributes not present in the C<attrs>
+string are left unchanged.
 
-=item fat
+These attributes are only present when the file is located on
+an ext2/3/4 filesystem.  Using this call on other filesystem
+types will result in an error." };
 
-The label is limited to 11 bytes.
+  { defaults with
+    name = "get_e2generation"; added = (1, 17, 31);
+    style = RInt64 "generation", [Pathname "file"], [];
+    proc_nr = Some 320;
+    tests = [
+      InitScratchFS, Always, TestResult (
+        [["touch"; "/e2generation"];
+         ["set_e2generation"; "/e2generation"; "123456"];
+         ["get_e2generation"; "/e2generation"]], "ret == 123456"), []
+    ];
+    shortdesc = "get ext2 file generation of a file";
+    longdesc = "\
+This returns the ext2 file generation of a file.  The generation
+(which used to be called the \"version\") is a number associated
+with an inode.  This is most commonly used by NFS servers.
 
-=item swap
+The generation is only present when the file is located on
+an ext2/3/4 filesystem.  Using this call on other filesystem
+types will result in an error.
 
-The label is limited to 16 bytes.
+See C<guestfs_set_e2generation>." };
 
-=back
+  { defaults with
+    name = "set_e2generation"; added = (1, 17, 31);
+    style = RErr, [Pathname "file"; Int64 "generation"], [];
+    proc_nr = Some 321;
+    shortdesc = "set ext2 file generation of a file";
+    longdesc = "\
+This sets the ext2 file generation of a file.
 
-If there is no support for changing the label
-for the type of the specified filesystem,
-set_label will fail and set errno as ENOTSUP.
+See C<guestfs_get_e2generation>." };
 
-To read the label on a filesystem, call C<guestfs_vfs_label>." };
+  { defaults with
+    name = "btrfs_subvolume_snapshot"; added = (1, 17, 35);
+    style = RErr, [Pathname "source"; Pathname "dest"], [OBool "ro"; OString "qgroupid"];
+    proc_nr = Some 322;
+    once_had_no_optargs = true;
+    optional = Some "btrfs"; camel_name = "BTRFSSubvolumeSnapshot";
+    tests = [
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mount"; "/dev/sda1"; "/"];
+         ["mkdir"; "/dir"];
+         ["btrfs_subvolume_create"; "/test1"; "NOARG"];
+         ["btrfs_subvolume_create"; "/test2"; "NOARG"];
+         ["btrfs_subvolume_create"; "/dir/test3"; "NOARG"];
+         ["btrfs_subvolume_snapshot"; "/dir/test3"; "/dir/test5"; "true"; "NOARG"];
+         ["btrfs_subvolume_snapshot"; "/dir/test3"; "/dir/test6"; ""; "0/1000"]]), []
+    ];
+    shortdesc = "create a btrfs snapshot";
+    longdesc = "\
+Create a snapshot of the btrfs subvolume C<source>.
+The C<dest> argument is the destination directory and the name
+of the snapshot, in the form F</path/to/dest/name>. By default
+the newly created snapshot is writable, if the value of optional
+parameter C<ro> is true, then a readonly snapshot is created. The
+optional parameter C<qgroupid> represents the qgroup which the
+newly created snapshot will be added to." };
 
   { defaults with
-    name = "zero_free_space"; added = (1, 17, 18);
-    style = RErr, [Pathname "directory"], [];
-    proc_nr = Some 311;
-    progress = true;
+    name = "btrfs_subvolume_delete"; added = (1, 17, 35);
+    style = RErr, [Pathname "subvolume"], [];
+    proc_nr = Some 323;
+    optional = Some "btrfs"; camel_name = "BTRFSSubvolumeDelete";
     tests = [
-      InitScratchFS, Always, TestRun (
-        [["zero_free_space"; "/"]]), []
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mount"; "/dev/sda1"; "/"];
+         ["btrfs_subvolume_create"; "/test1"; "NOARG"];
+         ["btrfs_subvolume_delete"; "/test1"]]), []
     ];
-    shortdesc = "zero free space in a filesystem";
+    shortdesc = "delete a btrfs subvolume or snapshot";
     longdesc = "\
-Zero the free space in the filesystem mounted on F<directory>.
-The filesystem must be mounted read-write.
+Delete the named btrfs subvolume or snapshot." };
 
-The filesystem contents are not affected, but any free space
-in the filesystem is freed.
+  { defaults with
+    name = "btrfs_subvolume_create"; added = (1, 17, 35);
+    style = RErr, [Pathname "dest"], [OString "qgroupid"];
+    proc_nr = Some 324;
+    once_had_no_optargs = true;
+    optional = Some "btrfs"; camel_name = "BTRFSSubvolumeCreate";
+    shortdesc = "create a btrfs subvolume";
+    longdesc = "\
+Create a btrfs subvolume.  The C<dest> argument is the destination
+directory and the name of the subvolume, in the form F</path/to/dest/name>.
+The optional parameter C<qgroupid> represents the qgroup which the newly
+created subvolume will be added to." };
 
-Free space is not \"trimmed\".  You may want to call
-C<guestfs_fstrim> either as an alternative to this,
-or after calling this, depending on your requirements." };
+  { defaults with
+    name = "btrfs_subvolume_list"; added = (1, 17, 35);
+    style = RStructList ("subvolumes", "btrfssubvolume"), [Mountable_or_Path "fs"], [];
+    proc_nr = Some 325;
+    optional = Some "btrfs"; camel_name = "BTRFSSubvolumeList";
+    test_excuse = "tested in tests/btrfs";
+    shortdesc = "list btrfs snapshots and subvolumes";
+    longdesc = "\
+List the btrfs snapshots and subvolumes of the btrfs filesystem
+which is mounted at C<fs>." };
 
   { defaults with
-    name = "lvcreate_free"; added = (1, 17, 18);
-    style = RErr, [String "logvol"; String "volgroup"; Int "percent"], [];
-    proc_nr = Some 312;
-    optional = Some "lvm2";
-    tests = [
-      InitEmpty, Always, TestResult (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["pvcreate"; "/dev/sda1"];
-         ["vgcreate"; "VG"; "/dev/sda1"];
-         ["lvcreate_free"; "LV1"; "VG"; "50"];
-         ["lvcreate_free"; "LV2"; "VG"; "50"];
-         ["lvcreate_free"; "LV3"; "VG"; "50"];
-         ["lvcreate_free"; "LV4"; "VG"; "100"];
-         ["lvs"]],
-        "is_string_list (ret, 4, \"/dev/VG/LV1\", \"/dev/VG/LV2\", \"/dev/VG/LV3\", \"/dev/VG/LV4\")"), []
-    ];
-    shortdesc = "create an LVM logical volume in % remaining free space";
+    name = "btrfs_subvolume_set_default"; added = (1, 17, 35);
+    style = RErr, [Int64 "id"; Pathname "fs"], [];
+    proc_nr = Some 326;
+    optional = Some "btrfs"; camel_name = "BTRFSSubvolumeSetDefault";
+    test_excuse = "tested in tests/btrfs";
+    shortdesc = "set default btrfs subvolume";
     longdesc = "\
-Create an LVM logical volume called F</dev/volgroup/logvol>,
-using approximately C<percent> % of the free space remaining
-in the volume group.  Most usefully, when C<percent> is C<100>
-this will create the largest possible LV." };
+Set the subvolume of the btrfs filesystem C<fs> which will
+be mounted by default.  See C<guestfs_btrfs_subvolume_list> to
+get a list of subvolumes." };
 
   { defaults with
-    name = "isoinfo_device"; added = (1, 17, 19);
-    style = RStruct ("isodata", "isoinfo"), [Device "device"], [];
-    proc_nr = Some 313;
+    name = "btrfs_filesystem_sync"; added = (1, 17, 35);
+    style = RErr, [Pathname "fs"], [];
+    proc_nr = Some 327;
+    optional = Some "btrfs"; camel_name = "BTRFSFilesystemSync";
     tests = [
-      InitNone, Always, TestResult (
-        [["isoinfo_device"; "/dev/sdd"]],
-        "STREQ (ret->iso_system_id, GUESTFS_ISO_SYSTEM_ID) && "^
-          "STREQ (ret->iso_volume_id, \"CDROM\") && "^
-          "STREQ (ret->iso_volume_set_id, \"\") && "^
-          "ret->iso_volume_set_size == 1 && "^
-          "ret->iso_volume_sequence_number == 1 && "^
-          "ret->iso_logical_block_size == 2048"), []
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mount"; "/dev/sda1"; "/"];
+         ["btrfs_subvolume_create"; "/test1"; "NOARG"];
+         ["btrfs_filesystem_sync"; "/test1"];
+         ["btrfs_filesystem_balance"; "/test1"]]), []
     ];
-    shortdesc = "get ISO information from primary volume descriptor of device";
+    shortdesc = "sync a btrfs filesystem";
     longdesc = "\
-C<device> is an ISO device.  This returns a struct of information
-read from the primary volume descriptor (the ISO equivalent of the
-superblock) of the device.
+Force sync on the btrfs filesystem mounted at C<fs>." };
 
-Usually it is more efficient to use the L<isoinfo(1)> command
-with the I<-d> option on the host to analyze ISO files,
-instead of going through libguestfs.
+  { defaults with
+    name = "btrfs_filesystem_balance"; added = (1, 17, 35);
+    style = RErr, [Pathname "fs"], [];
+    fish_alias = ["btrfs-balance"];
+    proc_nr = Some 328;
+    optional = Some "btrfs"; camel_name = "BTRFSFilesystemBalance";
+    shortdesc = "balance a btrfs filesystem";
+    longdesc = "\
+Balance the chunks in the btrfs filesystem mounted at C<fs>
+across the underlying devices." };
 
-For information on the primary volume descriptor fields, see
-L<http://wiki.osdev.org/ISO_9660#The_Primary_Volume_Descriptor>" };
+  { defaults with
+    name = "btrfs_device_add"; added = (1, 17, 35);
+    style = RErr, [DeviceList "devices"; Pathname "fs"], [];
+    proc_nr = Some 329;
+    optional = Some "btrfs"; camel_name = "BTRFSDeviceAdd";
+    test_excuse = "test disk isn't large enough to test this thoroughly, so there is an external test in 'tests/btrfs' directory";
+    shortdesc = "add devices to a btrfs filesystem";
+    longdesc = "\
+Add the list of device(s) in C<devices> to the btrfs filesystem
+mounted at C<fs>.  If C<devices> is an empty list, this does nothing." };
 
   { defaults with
-    name = "isoinfo"; added = (1, 17, 19);
-    style = RStruct ("isodata", "isoinfo"), [Pathname "isofile"], [];
-    proc_nr = Some 314;
-    shortdesc = "get ISO information from primary volume descriptor of ISO file";
+    name = "btrfs_device_delete"; added = (1, 17, 35);
+    style = RErr, [DeviceList "devices"; Pathname "fs"], [];
+    proc_nr = Some 330;
+    optional = Some "btrfs"; camel_name = "BTRFSDeviceDelete";
+    test_excuse = "test disk isn't large enough to test this thoroughly, so there is an external test in 'tests/btrfs' directory.";
+    shortdesc = "remove devices from a btrfs filesystem";
     longdesc = "\
-This is the same as C<guestfs_isoinfo_device> except that it
-works for an ISO file located inside some other mounted filesystem.
-Note that in the common case where you have added an ISO file
-as a libguestfs device, you would I<not> call this.  Instead
-you would call C<guestfs_isoinfo_device>." };
+Remove the C<devices> from the btrfs filesystem mounted at C<fs>.
+If C<devices> is an empty list, this does nothing." };
 
   { defaults with
-    name = "vgmeta"; added = (1, 17, 20);
-    style = RBufferOut "metadata", [String "vgname"], [];
-    proc_nr = Some 315;
-    optional = Some "lvm2";
-    shortdesc = "get volume group metadata";
+    name = "btrfs_set_seeding"; added = (1, 17, 43);
+    style = RErr, [Device "device"; Bool "seeding"], [];
+    proc_nr = Some 331;
+    optional = Some "btrfs";
+    tests = [
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["btrfs_set_seeding"; "/dev/sda1"; "true"];
+         ["btrfs_set_seeding"; "/dev/sda1"; "false"]]), []
+    ];
+    shortdesc = "enable or disable the seeding feature of device";
     longdesc = "\
-C<vgname> is an LVM volume group.  This command examines the
-volume group and returns its metadata.
+Enable or disable the seeding feature of a device that contains
+a btrfs filesystem." };
 
-Note that the metadata is an internal structure used by LVM,
-subject to change at any time, and is provided for information only." };
+  { defaults with
+    name = "btrfs_fsck"; added = (1, 17, 43);
+    style = RErr, [Device "device"], [OInt64 "superblock"; OBool "repair"];
+    proc_nr = Some 332;
+    optional = Some "btrfs";
+    tests = [
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["btrfs_fsck"; "/dev/sda1"; ""; ""]]), []
+    ];
+    shortdesc = "check a btrfs filesystem";
+    longdesc = "\
+Used to check a btrfs filesystem, C<device> is the device file where the
+filesystem is stored." };
 
   { defaults with
-    name = "md_stat"; added = (1, 17, 21);
-    style = RStructList ("devices", "mdstat"), [Device "md"], [];
-    proc_nr = Some 316;
-    optional = Some "mdadm";
-    shortdesc = "get underlying devices from an MD device";
+    name = "filesystem_available"; added = (1, 19, 5);
+    style = RBool "fsavail", [String "filesystem"], [];
+    proc_nr = Some 333;
+    shortdesc = "check if filesystem is available";
     longdesc = "\
-This call returns a list of the underlying devices which make
-up the single software RAID array device C<md>.
-
-To get a list of software RAID devices, call C<guestfs_list_md_devices>.
-
-Each structure returned corresponds to one device along with
-additional status information:
-
-=over 4
-
-=item C<mdstat_device>
-
-The name of the underlying device.
+Check whether libguestfs supports the named filesystem.
+The argument C<filesystem> is a filesystem name, such as
+C<ext3>.
 
-=item C<mdstat_index>
+You must call C<guestfs_launch> before using this command.
 
-The index of this device within the array.
+This is mainly useful as a negative test.  If this returns true,
+it doesn't mean that a particular filesystem can be created
+or mounted, since filesystems can fail for other reasons
+such as it being a later version of the filesystem,
+or having incompatible features, or lacking the right
+mkfs.E<lt>I<fs>E<gt> tool.
 
-=item C<mdstat_flags>
+See also C<guestfs_available>, C<guestfs_feature_available>,
+L<guestfs(3)/AVAILABILITY>." };
 
-Flags associated with this device.  This is a string containing
-(in no specific order) zero or more of the following flags:
+  { defaults with
+    name = "fstrim"; added = (1, 19, 6);
+    style = RErr, [Pathname "mountpoint"], [OInt64 "offset"; OInt64 "length"; OInt64 "minimumfreeextent"];
+    proc_nr = Some 334;
+    optional = Some "fstrim";
+    shortdesc = "trim free space in a filesystem";
+    longdesc = "\
+Trim the free space in the filesystem mounted on C<mountpoint>.
+The filesystem must be mounted read-write.
 
-=over 4
+The filesystem contents are not affected, but any free space
+in the filesystem is \"trimmed\", that is, given back to the host
+device, thus making disk images more sparse, allowing unused space
+in qcow2 files to be reused, etc.
 
-=item C<W>
+This operation requires support in libguestfs, the mounted
+filesystem, the host filesystem, qemu and the host kernel.
+If this support isn't present it may give an error or even
+appear to run but do nothing.
 
-write-mostly
+In the case where the kernel vfs driver does not support
+trimming, this call will fail with errno set to C<ENOTSUP>.
+Currently this happens when trying to trim FAT filesystems.
 
-=item C<F>
+See also C<guestfs_zero_free_space>.  That is a slightly
+different operation that turns free space in the filesystem
+into zeroes.  It is valid to call C<guestfs_fstrim> either
+instead of, or after calling C<guestfs_zero_free_space>." };
 
-device is faulty
+  { defaults with
+    name = "device_index"; added = (1, 19, 7);
+    style = RInt "index", [Device "device"], [];
+    proc_nr = Some 335;
+    tests = [
+      InitEmpty, Always, TestResult (
+        [["device_index"; "/dev/sda"]], "ret == 0"), []
+    ];
+    shortdesc = "convert device to index";
+    longdesc = "\
+This function takes a device name (eg. \"/dev/sdb\") and
+returns the index of the device in the list of devices.
 
-=item C<S>
+Index numbers start from 0.  The named device must exist,
+for example as a string returned from C<guestfs_list_devices>.
 
-device is a RAID spare
+See also C<guestfs_list_devices>, C<guestfs_part_to_dev>." };
 
-=item C<R>
+  { defaults with
+    name = "nr_devices"; added = (1, 19, 15);
+    style = RInt "nrdisks", [], [];
+    proc_nr = Some 336;
+    tests = [
+      InitEmpty, Always, TestResult (
+        [["nr_devices"]], "ret == 4"), []
+    ];
+    shortdesc = "return number of whole block devices (disks) added";
+    longdesc = "\
+This returns the number of whole block devices that were
+added.  This is the same as the number of devices that would
+be returned if you called C<guestfs_list_devices>.
 
-replacement
+To find out the maximum number of devices that could be added,
+call C<guestfs_max_disks>." };
 
-=back
+  { defaults with
+    name = "xfs_info"; added = (1, 19, 21);
+    style = RStruct ("info", "xfsinfo"), [Dev_or_Path "pathordevice"], [];
+    proc_nr = Some 337;
+    optional = Some "xfs";
+    tests = [
+      InitEmpty, Always, TestResult (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["mkfs"; "xfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["mount"; "/dev/sda1"; "/"];
+         ["xfs_info"; "/"]], "ret->xfs_blocksize == 4096"), []
+    ];
+    shortdesc = "get geometry of XFS filesystem";
+    longdesc = "\
+C<pathordevice> is a mounted XFS filesystem or a device containing
+an XFS filesystem.  This command returns the geometry of the filesystem.
 
-=back" };
+The returned struct contains geometry information.  Missing
+fields are returned as C<-1> (for numeric fields) or empty
+string." };
 
   { defaults with
-    name = "mkfs_btrfs"; added = (1, 17, 25);
-    style = RErr, [DeviceList "devices"], [OInt64 "allocstart"; OInt64 "bytecount"; OString "datatype"; OInt "leafsize"; OString "label"; OString "metadata"; OInt "nodesize"; OInt "sectorsize"];
-    proc_nr = Some 317;
-    optional = Some "btrfs";
+    name = "pvchange_uuid"; added = (1, 19, 26);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 338;
+    optional = Some "lvm2";
     tests = [
       InitEmpty, Always, TestRun (
         [["part_disk"; "/dev/sda"; "mbr"];
-         ["mkfs_btrfs"; "/dev/sda1"; "0"; "268435456"; "single"; ""; "test"; "single"; "65536"; "512"]]), []
+         ["pvcreate"; "/dev/sda1"];
+         ["pvchange_uuid"; "/dev/sda1"]]), []
     ];
-    shortdesc = "create a btrfs filesystem";
+    shortdesc = "generate a new random UUID for a physical volume";
     longdesc = "\
-Create a btrfs filesystem, allowing all configurables to be set.
-For more information on the optional arguments, see L<mkfs.btrfs(8)>.
-
-Since btrfs filesystems can span multiple devices, this takes a
-non-empty list of devices.
-
-To create general filesystems, use C<guestfs_mkfs>." };
+Generate a new random UUID for the physical volume C<device>." };
 
   { defaults with
-    name = "get_e2attrs"; added = (1, 17, 31);
-    style = RString "attrs", [Pathname "file"], [];
-    proc_nr = Some 318;
+    name = "pvchange_uuid_all"; added = (1, 19, 26);
+    style = RErr, [], [];
+    proc_nr = Some 339;
+    optional = Some "lvm2";
     tests = [
-      InitScratchFS, Always, TestResultString (
-        [["touch"; "/e2attrs1"];
-         ["get_e2attrs"; "/e2attrs1"]], ""), [];
-      InitScratchFS, Always, TestResultString (
-        [["touch"; "/e2attrs2"];
-         ["set_e2attrs"; "/e2attrs2"; "is"; "false"];
-         ["get_e2attrs"; "/e2attrs2"]], "is"), [];
-      InitScratchFS, Always, TestResultString (
-        [["touch"; "/e2attrs3"];
-         ["set_e2attrs"; "/e2attrs3"; "is"; "false"];
-         ["set_e2attrs"; "/e2attrs3"; "i"; "true"];
-         ["get_e2attrs"; "/e2attrs3"]], "s"), [];
-      InitScratchFS, Always, TestResultString (
-        [["touch"; "/e2attrs4"];
-         ["set_e2attrs"; "/e2attrs4"; "adst"; "false"];
-         ["set_e2attrs"; "/e2attrs4"; "iS"; "false"];
-         ["set_e2attrs"; "/e2attrs4"; "i"; "true"];
-         ["set_e2attrs"; "/e2attrs4"; "ad"; "true"];
-         ["set_e2attrs"; "/e2attrs4"; ""; "false"];
-         ["set_e2attrs"; "/e2attrs4"; ""; "true"];
-         ["get_e2attrs"; "/e2attrs4"]], "Sst"), [];
-      InitScratchFS, Always, TestLastFail (
-        [["touch"; "/e2attrs5"];
-         ["set_e2attrs"; "/e2attrs5"; "R"; "false"]]), [];
-      InitScratchFS, Always, TestLastFail (
-        [["touch"; "/e2attrs6"];
-         ["set_e2attrs"; "/e2attrs6"; "v"; "false"]]), [];
-      InitScratchFS, Always, TestLastFail (
-        [["touch"; "/e2attrs7"];
-         ["set_e2attrs"; "/e2attrs7"; "aa"; "false"]]), [];
-      InitScratchFS, Always, TestLastFail (
-        [["touch"; "/e2attrs8"];
-         ["set_e2attrs"; "/e2attrs8"; "BabcdB"; "false"]]), []
+      InitEmpty, Always, TestRun (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["pvcreate"; "/dev/sda1"];
+         ["pvchange_uuid_all"]]), []
     ];
-    shortdesc = "get ext2 file attributes of a file";
+    shortdesc = "generate new random UUIDs for all physical volumes";
     longdesc = "\
-This returns the file attributes associated with F<file>.
-
-The attributes are a set of bits associated with each
-inode which affect the behaviour of the file.  The attributes
-are returned as a string of letters (described below).  The
-string may be empty, indicating that no file attributes are
-set for this file.
-
-These attributes are only present when the file is located on
-an ext2/3/4 filesystem.  Using this call on other filesystem
-types will result in an error.
-
-The characters (file attributes) in the returned string are
-currently:
-
-=over 4
-
-=item 'A'
-
-When the file is accessed, its atime is not modified.
-
-=item 'a'
-
-The file is append-only.
-
-=item 'c'
-
-The file is compressed on-disk.
-
-=item 'D'
-
-(Directories only.)  Changes to this directory are written
-synchronously to disk.
-
-=item 'd'
-
-The file is not a candidate for backup (see L<dump(8)>).
-
-=item 'E'
+Generate new random UUIDs for all physical volumes." };
 
-The file has compression errors.
+  { defaults with
+    name = "vgchange_uuid"; added = (1, 19, 26);
+    style = RErr, [String "vg"], [];
+    proc_nr = Some 340;
+    optional = Some "lvm2";
+    tests = [
+      InitEmpty, Always, TestRun (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["pvcreate"; "/dev/sda1"];
+         ["vgcreate"; "VG"; "/dev/sda1"];
+         ["vgchange_uuid"; "/dev/VG"]]), []
+    ];
+    shortdesc = "generate a new random UUID for a volume group";
+    longdesc = "\
+Generate a new random UUID for the volume group C<vg>." };
 
-=item 'e'
+  { defaults with
+    name = "vgchange_uuid_all"; added = (1, 19, 26);
+    style = RErr, [], [];
+    proc_nr = Some 341;
+    optional = Some "lvm2";
+    tests = [
+      InitEmpty, Always, TestRun (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["pvcreate"; "/dev/sda1"];
+         ["vgcreate"; "VG"; "/dev/sda1"];
+         ["vgchange_uuid_all"]]), []
+    ];
+    shortdesc = "generate new random UUIDs for all volume groups";
+    longdesc = "\
+Generate new random UUIDs for all volume groups." };
 
-The file is using extents.
+  { defaults with
+    name = "utsname"; added = (1, 19, 27);
+    style = RStruct ("uts", "utsname"), [], [];
+    proc_nr = Some 342;
+    tests = [
+      InitEmpty, Always, TestRun (
+        [["utsname"]]), []
+    ];
+    shortdesc = "appliance kernel version";
+    longdesc = "\
+This returns the kernel version of the appliance, where this is
+available.  This information is only useful for debugging.  Nothing
+in the returned structure is defined by the API." };
 
-=item 'h'
+  { defaults with
+    name = "xfs_growfs"; added = (1, 19, 28);
+    style = RErr, [Pathname "path"], [OBool "datasec"; OBool "logsec"; OBool "rtsec"; OInt64 "datasize"; OInt64 "logsize"; OInt64 "rtsize"; OInt64 "rtextsize"; OInt "maxpct"];
+    proc_nr = Some 343;
+    optional = Some "xfs";
+    tests = [
+      InitEmpty, Always, TestResult (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["pvcreate"; "/dev/sda1"];
+         ["vgcreate"; "VG"; "/dev/sda1"];
+         ["lvcreate"; "LV"; "VG"; "40"];
+         ["mkfs"; "xfs"; "/dev/VG/LV"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["lvresize"; "/dev/VG/LV"; "80"];
+         ["mount"; "/dev/VG/LV"; "/"];
+         ["xfs_growfs"; "/"; "true"; "false"; "false"; ""; ""; ""; ""; ""];
+         ["xfs_info"; "/"]], "ret->xfs_blocksize == 4096"), [];
+    ];
+    shortdesc = "expand an existing XFS filesystem";
+    longdesc = "\
+Grow the XFS filesystem mounted at C<path>.
 
-The file is storing its blocks in units of the filesystem blocksize
-instead of sectors.
+The returned struct contains geometry information.  Missing
+fields are returned as C<-1> (for numeric fields) or empty
+string." };
 
-=item 'I'
+  { defaults with
+    name = "rsync"; added = (1, 19, 29);
+    style = RErr, [Pathname "src"; Pathname "dest"], [OBool "archive"; OBool "deletedest"];
+    proc_nr = Some 344;
+    optional = Some "rsync";
+    test_excuse = "tests are in tests/rsync";
+    shortdesc = "synchronize the contents of two directories";
+    longdesc = "\
+This call may be used to copy or synchronize two directories
+under the same libguestfs handle.  This uses the L<rsync(1)>
+program which uses a fast algorithm that avoids copying files
+unnecessarily.
 
-(Directories only.)  The directory is using hashed trees.
+C<src> and C<dest> are the source and destination directories.
+Files are copied from C<src> to C<dest>.
 
-=item 'i'
+The optional arguments are:
 
-The file is immutable.  It cannot be modified, deleted or renamed.
-No link can be created to this file.
+=over 4
 
-=item 'j'
+=item C<archive>
 
-The file is data-journaled.
+Turns on archive mode.  This is the same as passing the
+I<--archive> flag to C<rsync>.
 
-=item 's'
+=item C<deletedest>
 
-When the file is deleted, all its blocks will be zeroed.
+Delete files at the destination that do not exist at the source.
 
-=item 'S'
+=back" };
 
-Changes to this file are written synchronously to disk.
+  { defaults with
+    name = "rsync_in"; added = (1, 19, 29);
+    style = RErr, [String "remote"; Pathname "dest"], [OBool "archive"; OBool "deletedest"];
+    proc_nr = Some 345;
+    optional = Some "rsync";
+    test_excuse = "tests are in tests/rsync";
+    shortdesc = "synchronize host or remote filesystem with filesystem";
+    longdesc = "\
+This call may be used to copy or synchronize the filesystem
+on the host or on a remote computer with the filesystem
+within libguestfs.  This uses the L<rsync(1)> program
+which uses a fast algorithm that avoids copying files unnecessarily.
 
-=item 'T'
+This call only works if the network is enabled.  See
+C<guestfs_set_network> or the I<--network> option to
+various tools like L<guestfish(1)>.
 
-(Directories only.)  This is a hint to the block allocator
-that subdirectories contained in this directory should be
-spread across blocks.  If not present, the block allocator
-will try to group subdirectories together.
+Files are copied from the remote server and directory
+specified by C<remote> to the destination directory C<dest>.
 
-=item 't'
+The format of the remote server string is defined by L<rsync(1)>.
+Note that there is no way to supply a password or passphrase
+so the target must be set up not to require one.
 
-For a file, this disables tail-merging.
-(Not used by upstream implementations of ext2.)
+The optional arguments are the same as those of C<guestfs_rsync>." };
 
-=item 'u'
+  { defaults with
+    name = "rsync_out"; added = (1, 19, 29);
+    style = RErr, [Pathname "src"; String "remote"], [OBool "archive"; OBool "deletedest"];
+    proc_nr = Some 346;
+    optional = Some "rsync";
+    test_excuse = "tests are in tests/rsync";
+    shortdesc = "synchronize filesystem with host or remote filesystem";
+    longdesc = "\
+This call may be used to copy or synchronize the filesystem within
+libguestfs with a filesystem on the host or on a remote computer.
+This uses the L<rsync(1)> program which uses a fast algorithm that
+avoids copying files unnecessarily.
 
-When the file is deleted, its blocks will be saved, allowing
-the file to be undeleted.
+This call only works if the network is enabled.  See
+C<guestfs_set_network> or the I<--network> option to
+various tools like L<guestfish(1)>.
 
-=item 'X'
+Files are copied from the source directory C<src> to the
+remote server and directory specified by C<remote>.
 
-The raw contents of the compressed file may be accessed.
+The format of the remote server string is defined by L<rsync(1)>.
+Note that there is no way to supply a password or passphrase
+so the target must be set up not to require one.
 
-=item 'Z'
+The optional arguments are the same as those of C<guestfs_rsync>.
 
-The compressed file is dirty.
+Globbing does not happen on the C<src> parameter.  In programs
+which use the API directly you have to expand wildcards yourself
+(see C<guestfs_glob_expand>).  In guestfish you can use the C<glob>
+command (see L<guestfish(1)/glob>), for example:
 
-=back
+ ><fs> glob rsync-out /* rsync://remote/" };
 
-More file attributes may be added to this list later.  Not all
-file attributes may be set for all kinds of files.  For
-detailed information, consult the L<chattr(1)> man page.
+  { defaults with
+    name = "ls0"; added = (1, 19, 32);
+    style = RErr, [Pathname "dir"; FileOut "filenames"], [];
+    proc_nr = Some 347;
+    shortdesc = "get list of files in a directory";
+    longdesc = "\
+This specialized command is used to get a listing of
+the filenames in the directory C<dir>.  The list of filenames
+is written to the local file F<filenames> (on the host).
 
-See also C<guestfs_set_e2attrs>.
+In the output file, the filenames are separated by C<\\0> characters.
 
-Don't confuse these attributes with extended attributes
-(see C<guestfs_getxattr>)." };
+C<.> and C<..> are not returned.  The filenames are not sorted." };
 
   { defaults with
-    name = "set_e2attrs"; added = (1, 17, 31);
-    style = RErr, [Pathname "file"; String "attrs"], [OBool "clear"];
-    proc_nr = Some 319;
-    shortdesc = "set ext2 file attributes of a file";
+    name = "fill_dir"; added = (1, 19, 32);
+    style = RErr, [Pathname "dir"; Int "nr"], [];
+    proc_nr = Some 348;
+    shortdesc = "fill a directory with empty files";
     longdesc = "\
-This sets or clears the file attributes C<attrs>
-associated with the inode F<file>.
-
-C<attrs> is a string of characters representing
-file attributes.  See C<guestfs_get_e2attrs> for a list of
-possible attributes.  Not all attributes can be changed.
-
-If optional boolean C<clear> is not present or false, then
-the C<attrs> listed are set in the inode.
+This function, useful for testing filesystems, creates C<nr>
+empty files in the directory C<dir> with names C<00000000>
+through C<nr-1> (ie. each file name is 8 digits long padded
+with zeroes)." };
 
-If C<clear> is true, then the C<attrs> listed are cleared
-in the inode.
+  { defaults with
+    name = "xfs_admin"; added = (1, 19, 33);
+    style = RErr, [Device "device"], [OBool "extunwritten"; OBool "imgfile"; OBool "v2log"; OBool "projid32bit"; OBool "lazycounter"; OString "label"; OString "uuid"];
+    proc_nr = Some 349;
+    optional = Some "xfs";
+    tests =
+      (let uuid = uuidgen () in [
+        InitEmpty, Always, TestResult (
+          [["part_disk"; "/dev/sda"; "mbr"];
+           ["mkfs"; "xfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+           ["xfs_admin"; "/dev/sda1"; ""; ""; ""; ""; "false"; "NOARG"; "NOARG"];
+           ["mount"; "/dev/sda1"; "/"];
+           ["xfs_info"; "/"]], "ret->xfs_lazycount == 0"), [];
+        InitEmpty, Always, TestResultString (
+          [["part_disk"; "/dev/sda"; "mbr"];
+           ["mkfs"; "xfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+           ["xfs_admin"; "/dev/sda1"; ""; ""; ""; ""; ""; "NOARG"; uuid];
+           ["vfs_uuid"; "/dev/sda1"]], uuid), [];
+        InitEmpty, Always, TestResultString (
+          [["part_disk"; "/dev/sda"; "mbr"];
+           ["mkfs"; "xfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+           ["xfs_admin"; "/dev/sda1"; ""; ""; ""; ""; ""; "LBL-TEST"; "NOARG"];
+           ["vfs_label"; "/dev/sda1"]], "LBL-TEST"), [];
+      ]);
+    shortdesc = "change parameters of an XFS filesystem";
+    longdesc = "\
+Change the parameters of the XFS filesystem on C<device>.
 
-In both cases, other attributes not present in the C<attrs>
-string are left unchanged.
+Devices that are mounted cannot be modified.
+Administrators must unmount filesystems before this call
+can modify parameters.
 
-These attributes are only present when the file is located on
-an ext2/3/4 filesystem.  Using this call on other filesystem
-types will result in an error." };
+Some of the parameters of a mounted filesystem can be examined
+and modified using the C<guestfs_xfs_info> and
+C<guestfs_xfs_growfs> calls." };
 
   { defaults with
-    name = "get_e2generation"; added = (1, 17, 31);
-    style = RInt64 "generation", [Pathname "file"], [];
-    proc_nr = Some 320;
+    name = "hivex_open"; added = (1, 19, 35);
+    style = RErr, [Pathname "filename"], [OBool "verbose"; OBool "debug"; OBool "write"];
+    proc_nr = Some 350;
+    optional = Some "hivex";
     tests = [
-      InitScratchFS, Always, TestResult (
-        [["touch"; "/e2generation"];
-         ["set_e2generation"; "/e2generation"; "123456"];
-         ["get_e2generation"; "/e2generation"]], "ret == 123456"), []
+      InitScratchFS, Always, TestRun (
+        [["upload"; "$srcdir/../../test-data/files/minimal"; "/hivex_open"];
+         ["hivex_open"; "/hivex_open"; ""; ""; "false"];
+         ["hivex_root"]; (* in this hive, it returns 0x1020 *)
+         ["hivex_node_name"; "0x1020"];
+         ["hivex_node_children"; "0x1020"];
+         ["hivex_node_values"; "0x1020"]]), [["hivex_close"]]
     ];
-    shortdesc = "get ext2 file generation of a file";
+    shortdesc = "open a Windows Registry hive file";
     longdesc = "\
-This returns the ext2 file generation of a file.  The generation
-(which used to be called the \"version\") is a number associated
-with an inode.  This is most commonly used by NFS servers.
+Open the Windows Registry hive file named F<filename>.
+If there was any previous hivex handle associated with this
+guestfs session, then it is closed.
 
-The generation is only present when the file is located on
-an ext2/3/4 filesystem.  Using this call on other filesystem
-types will result in an error.
+This is a wrapper around the L<hivex(3)> call of the same name." };
+
+  { defaults with
+    name = "hivex_close"; added = (1, 19, 35);
+    style = RErr, [], [];
+    proc_nr = Some 351;
+    optional = Some "hivex";
+    shortdesc = "close the current hivex handle";
+    longdesc = "\
+Close the current hivex handle.
 
-See C<guestfs_set_e2generation>." };
+This is a wrapper around the L<hivex(3)> call of the same name." };
 
   { defaults with
-    name = "set_e2generation"; added = (1, 17, 31);
-    style = RErr, [Pathname "file"; Int64 "generation"], [];
-    proc_nr = Some 321;
-    shortdesc = "set ext2 file generation of a file";
+    name = "hivex_root"; added = (1, 19, 35);
+    style = RInt64 "nodeh", [], [];
+    proc_nr = Some 352;
+    optional = Some "hivex";
+    shortdesc = "return the root node of the hive";
     longdesc = "\
-This sets the ext2 file generation of a file.
+Return the root node of the hive.
 
-See C<guestfs_get_e2generation>." };
+This is a wrapper around the L<hivex(3)> call of the same name." };
 
   { defaults with
-    name = "btrfs_subvolume_snapshot"; added = (1, 17, 35);
-    style = RErr, [Pathname "source"; Pathname "dest"], [OBool "ro"; OString "qgroupid"];
-    proc_nr = Some 322;
-    once_had_no_optargs = true;
-    optional = Some "btrfs"; camel_name = "BTRFSSubvolumeSnapshot";
-    tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mount"; "/dev/sda1"; "/"];
-         ["mkdir"; "/dir"];
-         ["btrfs_subvolume_create"; "/test1"; "NOARG"];
-         ["btrfs_subvolume_create"; "/test2"; "NOARG"];
-         ["btrfs_subvolume_create"; "/dir/test3"; "NOARG"];
-         ["btrfs_subvolume_snapshot"; "/dir/test3"; "/dir/test5"; "true"; "NOARG"];
-         ["btrfs_subvolume_snapshot"; "/dir/test3"; "/dir/test6"; ""; "0/1000"]]), []
-    ];
-    shortdesc = "create a btrfs snapshot";
+    name = "hivex_node_name"; added = (1, 19, 35);
+    style = RString "name", [Int64 "nodeh"], [];
+    proc_nr = Some 353;
+    optional = Some "hivex";
+    shortdesc = "return the name of the node";
     longdesc = "\
-Create a snapshot of the btrfs subvolume C<source>.
-The C<dest> argument is the destination directory and the name
-of the snapshot, in the form F</path/to/dest/name>. By default
-the newly created snapshot is writable, if the value of optional
-parameter C<ro> is true, then a readonly snapshot is created. The
-optional parameter C<qgroupid> represents the qgroup which the
-newly created snapshot will be added to." };
+Return the name of C<nodeh>.
 
-  { defaults with
-    name = "btrfs_subvolume_delete"; added = (1, 17, 35);
-    style = RErr, [Pathname "subvolume"], [];
-    proc_nr = Some 323;
-    optional = Some "btrfs"; camel_name = "BTRFSSubvolumeDelete";
-    tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mount"; "/dev/sda1"; "/"];
-         ["btrfs_subvolume_create"; "/test1"; "NOARG"];
-         ["btrfs_subvolume_delete"; "/test1"]]), []
-    ];
-    shortdesc = "delete a btrfs subvolume or snapshot";
-    longdesc = "\
-Delete the named btrfs subvolume or snapshot." };
+This is a wrapper around the L<hivex(3)> call of the same name." };
 
   { defaults with
-    name = "btrfs_subvolume_create"; added = (1, 17, 35);
-    style = RErr, [Pathname "dest"], [OString "qgroupid"];
-    proc_nr = Some 324;
-    once_had_no_optargs = true;
-    optional = Some "btrfs"; camel_name = "BTRFSSubvolumeCreate";
-    shortdesc = "create a btrfs subvolume";
+    name = "hivex_node_children"; added = (1, 19, 35);
+    style = RStructList ("nodehs", "hivex_node"), [Int64 "nodeh"], [];
+    proc_nr = Some 354;
+    optional = Some "hivex";
+    shortdesc = "return list of nodes which are subkeys of node";
     longdesc = "\
-Create a btrfs subvolume.  The C<dest> argument is the destination
-directory and the name of the subvolume, in the form F</path/to/dest/name>.
-The optional parameter C<qgroupid> represents the qgroup which the newly
-created subvolume will be added to." };
+Return the list of nodes which are subkeys of C<nodeh>.
+
+This is a wrapper around the L<hivex(3)> call of the same name." };
 
   { defaults with
-    name = "btrfs_subvolume_list"; added = (1, 17, 35);
-    style = RStructList ("subvolumes", "btrfssubvolume"), [Mountable_or_Path "fs"], [];
-    proc_nr = Some 325;
-    optional = Some "btrfs"; camel_name = "BTRFSSubvolumeList";
-    test_excuse = "tested in tests/btrfs";
-    shortdesc = "list btrfs snapshots and subvolumes";
+    name = "hivex_node_get_child"; added = (1, 19, 35);
+    style = RInt64 "child", [Int64 "nodeh"; String "name"], [];
+    proc_nr = Some 355;
+    optional = Some "hivex";
+    shortdesc = "return the named child of node";
     longdesc = "\
-List the btrfs snapshots and subvolumes of the btrfs filesystem
-which is mounted at C<fs>." };
+Return the child of C<nodeh> with the name C<name>, if it exists.
+This can return C<0> meaning the name was not found.
+
+This is a wrapper around the L<hivex(3)> call of the same name." };
 
   { defaults with
-    name = "btrfs_subvolume_set_default"; added = (1, 17, 35);
-    style = RErr, [Int64 "id"; Pathname "fs"], [];
-    proc_nr = Some 326;
-    optional = Some "btrfs"; camel_name = "BTRFSSubvolumeSetDefault";
-    test_excuse = "tested in tests/btrfs";
-    shortdesc = "set default btrfs subvolume";
+    name = "hivex_node_parent"; added = (1, 19, 35);
+    style = RInt64 "parent", [Int64 "nodeh"], [];
+    proc_nr = Some 356;
+    optional = Some "hivex";
+    shortdesc = "return the parent of node";
     longdesc = "\
-Set the subvolume of the btrfs filesystem C<fs> which will
-be mounted by default.  See C<guestfs_btrfs_subvolume_list> to
-get a list of subvolumes." };
+Return the parent node of C<nodeh>.
+
+This is a wrapper around the L<hivex(3)> call of the same name." };
 
   { defaults with
-    name = "btrfs_filesystem_sync"; added = (1, 17, 35);
-    style = RErr, [Pathname "fs"], [];
-    proc_nr = Some 327;
-    optional = Some "btrfs"; camel_name = "BTRFSFilesystemSync";
-    tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mount"; "/dev/sda1"; "/"];
-         ["btrfs_subvolume_create"; "/test1"; "NOARG"];
-         ["btrfs_filesystem_sync"; "/test1"];
-         ["btrfs_filesystem_balance"; "/test1"]]), []
-    ];
-    shortdesc = "sync a btrfs filesystem";
+    name = "hivex_node_values"; added = (1, 19, 35);
+    style = RStructList ("valuehs", "hivex_value"), [Int64 "nodeh"], [];
+    proc_nr = Some 357;
+    optional = Some "hivex";
+    shortdesc = "return list of values attached to node";
     longdesc = "\
-Force sync on the btrfs filesystem mounted at C<fs>." };
+Return the array of (key, datatype, data) tuples attached to C<nodeh>.
+
+This is a wrapper around the L<hivex(3)> call of the same name." };
 
   { defaults with
-    name = "btrfs_filesystem_balance"; added = (1, 17, 35);
-    style = RErr, [Pathname "fs"], [];
-    fish_alias = ["btrfs-balance"];
-    proc_nr = Some 328;
-    optional = Some "btrfs"; camel_name = "BTRFSFilesystemBalance";
-    shortdesc = "balance a btrfs filesystem";
+    name = "hivex_node_get_value"; added = (1, 19, 35);
+    style = RInt64 "valueh", [Int64 "nodeh"; String "key"], [];
+    proc_nr = Some 358;
+    optional = Some "hivex";
+    shortdesc = "return the named value";
     longdesc = "\
-Balance the chunks in the btrfs filesystem mounted at C<fs>
-across the underlying devices." };
+Return the value attached to C<nodeh> which has the
+name C<key>, if it exists.  This can return C<0> meaning
+the key was not found.
+
+This is a wrapper around the L<hivex(3)> call of the same name." };
 
   { defaults with
-    name = "btrfs_device_add"; added = (1, 17, 35);
-    style = RErr, [DeviceList "devices"; Pathname "fs"], [];
-    proc_nr = Some 329;
-    optional = Some "btrfs"; camel_name = "BTRFSDeviceAdd";
-    test_excuse = "test disk isn't large enough to test this thoroughly, so there is an external test in 'tests/btrfs' directory";
-    shortdesc = "add devices to a btrfs filesystem";
+    name = "hivex_value_key"; added = (1, 19, 35);
+    style = RString "key", [Int64 "valueh"], [];
+    proc_nr = Some 359;
+    optional = Some "hivex";
+    shortdesc = "return the key field from the (key, datatype, data) tuple";
     longdesc = "\
-Add the list of device(s) in C<devices> to the btrfs filesystem
-mounted at C<fs>.  If C<devices> is an empty list, this does nothing." };
+Return the key (name) field of a (key, datatype, data) tuple.
+
+This is a wrapper around the L<hivex(3)> call of the same name." };
 
   { defaults with
-    name = "btrfs_device_delete"; added = (1, 17, 35);
-    style = RErr, [DeviceList "devices"; Pathname "fs"], [];
-    proc_nr = Some 330;
-    optional = Some "btrfs"; camel_name = "BTRFSDeviceDelete";
-    test_excuse = "test disk isn't large enough to test this thoroughly, so there is an external test in 'tests/btrfs' directory.";
-    shortdesc = "remove devices from a btrfs filesystem";
+    name = "hivex_value_type"; added = (1, 19, 35);
+    style = RInt64 "datatype", [Int64 "valueh"], [];
+    proc_nr = Some 360;
+    optional = Some "hivex";
+    shortdesc = "return the data type from the (key, datatype, data) tuple";
     longdesc = "\
-Remove the C<devices> from the btrfs filesystem mounted at C<fs>.
-If C<devices> is an empty list, this does nothing." };
+Return the data type field from a (key, datatype, data) tuple.
+
+This is a wrapper around the L<hivex(3)> call of the same name." };
 
   { defaults with
-    name = "btrfs_set_seeding"; added = (1, 17, 43);
-    style = RErr, [Device "device"; Bool "seeding"], [];
-    proc_nr = Some 331;
-    optional = Some "btrfs";
-    tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["btrfs_set_seeding"; "/dev/sda1"; "true"];
-         ["btrfs_set_seeding"; "/dev/sda1"; "false"]]), []
-    ];
-    shortdesc = "enable or disable the seeding feature of device";
+    name = "hivex_value_value"; added = (1, 19, 35);
+    style = RBufferOut "databuf", [Int64 "valueh"], [];
+    proc_nr = Some 361;
+    optional = Some "hivex";
+    shortdesc = "return the data field from the (key, datatype, data) tuple";
     longdesc = "\
-Enable or disable the seeding feature of a device that contains
-a btrfs filesystem." };
+Return the data field of a (key, datatype, data) tuple.
+
+This is a wrapper around the L<hivex(3)> call of the same name.
+
+See also: C<guestfs_hivex_value_utf8>." };
 
   { defaults with
-    name = "btrfs_fsck"; added = (1, 17, 43);
-    style = RErr, [Device "device"], [OInt64 "superblock"; OBool "repair"];
-    proc_nr = Some 332;
-    optional = Some "btrfs";
+    name = "hivex_commit"; added = (1, 19, 35);
+    style = RErr, [OptString "filename"], [];
+    proc_nr = Some 362;
+    optional = Some "hivex";
     tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["btrfs_fsck"; "/dev/sda1"; ""; ""]]), []
+      InitScratchFS, Always, TestRun (
+        [["upload"; "$srcdir/../../test-data/files/minimal"; "/hivex_commit1"];
+         ["hivex_open"; "/hivex_commit1"; ""; ""; "true"];
+         ["hivex_commit"; "NULL"]]), [["hivex_close"]];
+      InitScratchFS, Always, TestResultTrue (
+        [["upload"; "$srcdir/../../test-data/files/minimal"; "/hivex_commit2"];
+         ["hivex_open"; "/hivex_commit2"; ""; ""; "true"];
+         ["hivex_commit"; "/hivex_commit2_copy"];
+         ["is_file"; "/hivex_commit2_copy"; "false"]]), [["hivex_close"]]
     ];
-    shortdesc = "check a btrfs filesystem";
+    shortdesc = "commit (write) changes back to the hive";
     longdesc = "\
-Used to check a btrfs filesystem, C<device> is the device file where the
-filesystem is stored." };
+Commit (write) changes to the hive.
+
+If the optional F<filename> parameter is null, then the changes
+are written back to the same hive that was opened.  If this is
+not null then they are written to the alternate filename given
+and the original hive is left untouched.
+
+This is a wrapper around the L<hivex(3)> call of the same name." };
 
   { defaults with
-    name = "filesystem_available"; added = (1, 19, 5);
-    style = RBool "fsavail", [String "filesystem"], [];
-    proc_nr = Some 333;
-    shortdesc = "check if filesystem is available";
+    name = "hivex_node_add_child"; added = (1, 19, 35);
+    style = RInt64 "nodeh", [Int64 "parent"; String "name"], [];
+    proc_nr = Some 363;
+    optional = Some "hivex";
+    shortdesc = "add a child node";
     longdesc = "\
-Check whether libguestfs supports the named filesystem.
-The argument C<filesystem> is a filesystem name, such as
-C<ext3>.
+Add a child node to C<parent> named C<name>.
 
-You must call C<guestfs_launch> before using this command.
+This is a wrapper around the L<hivex(3)> call of the same name." };
 
-This is mainly useful as a negative test.  If this returns true,
-it doesn't mean that a particular filesystem can be created
-or mounted, since filesystems can fail for other reasons
-such as it being a later version of the filesystem,
-or having incompatible features, or lacking the right
-mkfs.E<lt>I<fs>E<gt> tool.
+  { defaults with
+    name = "hivex_node_delete_child"; added = (1, 19, 35);
+    style = RErr, [Int64 "nodeh"], [];
+    proc_nr = Some 364;
+    optional = Some "hivex";
+    shortdesc = "delete a node (recursively)";
+    longdesc = "\
+Delete C<nodeh>, recursively if necessary.
 
-See also C<guestfs_available>, C<guestfs_feature_available>,
-L<guestfs(3)/AVAILABILITY>." };
+This is a wrapper around the L<hivex(3)> call of the same name." };
 
   { defaults with
-    name = "fstrim"; added = (1, 19, 6);
-    style = RErr, [Pathname "mountpoint"], [OInt64 "offset"; OInt64 "length"; OInt64 "minimumfreeextent"];
-    proc_nr = Some 334;
-    optional = Some "fstrim";
-    shortdesc = "trim free space in a filesystem";
+    name = "hivex_node_set_value"; added = (1, 19, 35);
+    style = RErr, [Int64 "nodeh"; String "key"; Int64 "t"; BufferIn "val"], [];
+    proc_nr = Some 365;
+    optional = Some "hivex";
+    shortdesc = "set or replace a single value in a node";
     longdesc = "\
-Trim the free space in the filesystem mounted on C<mountpoint>.
-The filesystem must be mounted read-write.
+Set or replace a single value under the node C<nodeh>.  The
+C<key> is the name, C<t> is the type, and C<val> is the data.
 
-The filesystem contents are not affected, but any free space
-in the filesystem is \"trimmed\", that is, given back to the host
-device, thus making disk images more sparse, allowing unused space
-in qcow2 files to be reused, etc.
+This is a wrapper around the L<hivex(3)> call of the same name." };
 
-This operation requires support in libguestfs, the mounted
-filesystem, the host filesystem, qemu and the host kernel.
-If this support isn't present it may give an error or even
-appear to run but do nothing.
+  { defaults with
+    name = "xfs_repair"; added = (1, 19, 36);
+    style = RInt "status", [Dev_or_Path "device"], [OBool "forcelogzero"; OBool "nomodify"; OBool "noprefetch"; OBool "forcegeometry"; OInt64 "maxmem"; OInt64 "ihashsize"; OInt64 "bhashsize"; OInt64 "agstride"; OString "logdev"; OString "rtdev"];
+    proc_nr = Some 366;
+    optional = Some "xfs";
+    tests = [
+      InitEmpty, Always, TestRun (
+        [["part_disk"; "/dev/sda"; "mbr"];
+         ["mkfs"; "xfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["xfs_repair"; "/dev/sda1"; ""; "true"; ""; ""; ""; ""; ""; ""; "NOARG"; "NOARG"]
+        ]), []
+    ];
+    shortdesc = "repair an XFS filesystem";
+    longdesc = "\
+Repair corrupt or damaged XFS filesystem on C<device>.
 
-In the case where the kernel vfs driver does not support
-trimming, this call will fail with errno set to C<ENOTSUP>.
-Currently this happens when trying to trim FAT filesystems.
+The filesystem is specified using the C<device> argument which should be
+the device name of the disk partition or volume containing the filesystem.
+If given the name of a block device, C<xfs_repair> will attempt to find
+the raw device associated with the specified block device and will use
+the raw device instead.
 
-See also C<guestfs_zero_free_space>.  That is a slightly
-different operation that turns free space in the filesystem
-into zeroes.  It is valid to call C<guestfs_fstrim> either
-instead of, or after calling C<guestfs_zero_free_space>." };
+Regardless, the filesystem to be repaired must be unmounted, otherwise,
+the resulting filesystem may be inconsistent or corrupt.
+
+The returned status indicates whether filesystem corruption was
+detected (returns C<1>) or was not detected (returns C<0>)." };
 
   { defaults with
-    name = "device_index"; added = (1, 19, 7);
-    style = RInt "index", [Device "device"], [];
-    proc_nr = Some 335;
+    name = "rm_f"; added = (1, 19, 42);
+    style = RErr, [Pathname "path"], [];
+    proc_nr = Some 367;
     tests = [
-      InitEmpty, Always, TestResult (
-        [["device_index"; "/dev/sda"]], "ret == 0"), []
+      InitScratchFS, Always, TestResultFalse
+        [["mkdir"; "/rm_f"];
+         ["touch"; "/rm_f/foo"];
+         ["rm_f"; "/rm_f/foo"];
+         ["rm_f"; "/rm_f/not_exists"];
+         ["exists"; "/rm_f/foo"]], [];
+      InitScratchFS, Always, TestLastFail
+        [["mkdir"; "/rm_f2"];
+         ["mkdir"; "/rm_f2/foo"];
+         ["rm_f"; "/rm_f2/foo"]], []
     ];
-    shortdesc = "convert device to index";
+    shortdesc = "remove a file ignoring errors";
     longdesc = "\
-This function takes a device name (eg. \"/dev/sdb\") and
-returns the index of the device in the list of devices.
+Remove the file C<path>.
 
-Index numbers start from 0.  The named device must exist,
-for example as a string returned from C<guestfs_list_devices>.
+If the file doesn't exist, that error is ignored.  (Other errors,
+eg. I/O errors or bad paths, are not ignored)
 
-See also C<guestfs_list_devices>, C<guestfs_part_to_dev>." };
+This call cannot remove directories.
+Use C<guestfs_rmdir> to remove an empty directory,
+or C<guestfs_rm_rf> to remove directories recursively." };
 
   { defaults with
-    name = "nr_devices"; added = (1, 19, 15);
-    style = RInt "nrdisks", [], [];
-    proc_nr = Some 336;
-    tests = [
-      InitEmpty, Always, TestResult (
-        [["nr_devices"]], "ret == 4"), []
-    ];
-    shortdesc = "return number of whole block devices (disks) added";
+    name = "mke2fs"; added = (1, 19, 44);
+    style = RErr, [Device "device"], [OInt64 "blockscount"; OInt64 "blocksize"; OInt64 "fragsize"; OInt64 "blockspergroup"; OInt64 "numberofgroups"; OInt64 "bytesperinode"; OInt64 "inodesize"; OInt64 "journalsize"; OInt64 "numberofinodes"; OInt64 "stridesize"; OInt64 "stripewidth"; OInt64 "maxonlineresize"; OInt "reservedblockspercentage"; OInt "mmpupdateinterval"; OString "journaldevice"; OString "label"; OString "lastmounteddir"; OString "creatoros"; OString "fstype"; OString "usagetype"; OString "uuid"; OBool "forcecreate"; OBool "writesbandgrouponly"; OBool "lazyitableinit"; OBool "lazyjournalinit"; OBool "testfs"; OBool "discard"; OBool "quotatype";  OBool "extent"; OBool "filetype"; OBool "flexbg"; OBool "hasjournal"; OBool "journaldev"; OBool "largefile"; OBool "quota"; OBool "resizeinode"; OBool "sparsesuper"; OBool "uninitbg"];
+    proc_nr = Some 368;
+    tests =
+      (let uuid = uuidgen () in
+       let uuid_s = "UUID=" ^ uuid in [
+         InitEmpty, Always, TestResultString (
+           [["part_init"; "/dev/sda"; "mbr"];
+            ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
+            ["part_add"; "/dev/sda"; "p"; "204800"; "-64"];
+            ["mke2fs"; "/dev/sda1"; ""; "4096"; ""; ""; "";
+             ""; ""; ""; ""; "";
+             ""; ""; ""; ""; "NOARG";
+             "NOARG"; "NOARG"; "NOARG"; "NOARG"; "NOARG";
+             "NOARG"; ""; ""; ""; "";
+             ""; ""; ""; ""; "";
+             ""; ""; "true"; ""; "";
+             ""; ""; ""];
+            ["mke2fs"; "/dev/sda2"; ""; "4096"; ""; ""; "";
+             ""; ""; ""; ""; "";
+             ""; ""; ""; ""; "/dev/sda1";
+             "NOARG"; "NOARG"; "NOARG"; "ext2"; "NOARG";
+             "NOARG"; ""; ""; ""; "";
+             ""; ""; ""; ""; "";
+             ""; ""; ""; ""; "";
+             ""; ""; ""];
+            ["mount"; "/dev/sda2"; "/"];
+            ["write"; "/new"; "new file contents"];
+            ["cat"; "/new"]], "new file contents"), [];
+         InitEmpty, Always, TestResultString (
+           [["part_init"; "/dev/sda"; "mbr"];
+            ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
+            ["part_add"; "/dev/sda"; "p"; "204800"; "-64"];
+            ["mke2fs"; "/dev/sda1"; ""; "4096"; ""; ""; "";
+             ""; ""; ""; ""; "";
+             ""; ""; ""; ""; "/dev/sda1";
+             "JOURNAL"; "NOARG"; "NOARG"; "ext2"; "NOARG";
+             "NOARG"; ""; ""; ""; "";
+             ""; ""; ""; ""; "";
+             ""; ""; "true"; ""; "";
+             ""; ""; ""];
+            ["mke2fs"; "/dev/sda2"; ""; "4096"; ""; ""; "";
+             ""; ""; ""; ""; "";
+             ""; ""; ""; ""; "LABEL=JOURNAL";
+             "JOURNAL"; "NOARG"; "NOARG"; "ext2"; "NOARG";
+             "NOARG"; ""; ""; ""; "";
+             ""; ""; ""; ""; "";
+             ""; ""; ""; ""; "";
+             ""; ""; ""];
+            ["mount"; "/dev/sda2"; "/"];
+            ["write"; "/new"; "new file contents"];
+            ["cat"; "/new"]], "new file contents"), [];
+         InitEmpty, Always, TestResultString (
+           [["part_init"; "/dev/sda"; "mbr"];
+            ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
+            ["part_add"; "/dev/sda"; "p"; "204800"; "-64"];
+            ["mke2fs"; "/dev/sda1"; ""; "4096"; ""; ""; "";
+             ""; ""; ""; ""; "";
+             ""; ""; ""; ""; "NOARG";
+             "NOARG"; "NOARG"; "NOARG"; "NOARG"; "NOARG";
+             uuid; ""; ""; ""; "";
+             ""; ""; ""; ""; "";
+             ""; ""; "true"; ""; "";
+             ""; ""; ""];
+            ["mke2fs"; "/dev/sda2"; ""; "4096"; ""; ""; "";
+             ""; ""; ""; ""; "";
+             ""; ""; ""; ""; uuid_s;
+             "JOURNAL"; "NOARG"; "NOARG"; "ext2"; "NOARG";
+             "NOARG"; "true"; ""; ""; "";
+             ""; ""; ""; ""; "";
+             ""; ""; ""; ""; "";
+             ""; ""; ""];
+            ["mount"; "/dev/sda2"; "/"];
+            ["write"; "/new"; "new file contents"];
+            ["cat"; "/new"]], "new file contents"), []
+       ]);
+    shortdesc = "create an ext2/ext3/ext4 filesystem on device";
+    (* XXX document optional args properly *)
     longdesc = "\
-This returns the number of whole block devices that were
-added.  This is the same as the number of devices that would
-be returned if you called C<guestfs_list_devices>.
+C<mke2fs> is used to create an ext2, ext3, or ext4 filesystem
+on C<device>.
 
-To find out the maximum number of devices that could be added,
-call C<guestfs_max_disks>." };
+The optional C<blockscount> is the size of the filesystem in blocks.
+If omitted it defaults to the size of C<device>.  Note if the
+filesystem is too small to contain a journal, C<mke2fs> will
+silently create an ext2 filesystem instead." };
 
   { defaults with
-    name = "xfs_info"; added = (1, 19, 21);
-    style = RStruct ("info", "xfsinfo"), [Dev_or_Path "pathordevice"], [];
-    proc_nr = Some 337;
-    optional = Some "xfs";
+    name = "list_disk_labels"; added = (1, 19, 49);
+    style = RHashtable "labels", [], [];
+    proc_nr = Some 369;
     tests = [
-      InitEmpty, Always, TestResult (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["mkfs"; "xfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
-         ["mount"; "/dev/sda1"; "/"];
-         ["xfs_info"; "/"]], "ret->xfs_blocksize == 4096"), []
+      (* The test disks have no labels, so we can be sure there are
+       * no labels.  See in tests/disk-labels/ for tests checking
+       * for actual disk labels.
+       *
+       * Also, we make use of the assumption that RHashtable is a
+       * char*[] in C, so an empty hash has just a NULL element.
+       *)
+      InitScratchFS, Always, TestResult (
+        [["list_disk_labels"]],
+        "is_string_list (ret, 0)"), [];
     ];
-    shortdesc = "get geometry of XFS filesystem";
+    shortdesc = "mapping of disk labels to devices";
     longdesc = "\
-C<pathordevice> is a mounted XFS filesystem or a device containing
-an XFS filesystem.  This command returns the geometry of the filesystem.
+If you add drives using the optional C<label> parameter
+of C<guestfs_add_drive_opts>, you can use this call to
+map between disk labels, and raw block device and partition
+names (like F</dev/sda> and F</dev/sda1>).
 
-The returned struct contains geometry information.  Missing
-fields are returned as C<-1> (for numeric fields) or empty
-string." };
+This returns a hashtable, where keys are the disk labels
+(I<without> the F</dev/disk/guestfs> prefix), and the values
+are the full raw block device and partition names
+(eg. F</dev/sda> and F</dev/sda1>)." };
 
   { defaults with
-    name = "pvchange_uuid"; added = (1, 19, 26);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 338;
-    optional = Some "lvm2";
-    tests = [
-      InitEmpty, Always, TestRun (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["pvcreate"; "/dev/sda1"];
-         ["pvchange_uuid"; "/dev/sda1"]]), []
-    ];
-    shortdesc = "generate a new random UUID for a physical volume";
+    name = "internal_hot_add_drive"; added = (1, 19, 49);
+    style = RErr, [String "label"], [];
+    proc_nr = Some 370;
+    visibility = VInternal;
+    shortdesc = "internal hotplugging operation";
+    longdesc = "\
+This function is used internally when hotplugging drives." };
+
+  { defaults with
+    name = "internal_hot_remove_drive_precheck"; added = (1, 19, 49);
+    style = RErr, [String "label"], [];
+    proc_nr = Some 371;
+    visibility = VInternal;
+    shortdesc = "internal hotplugging operation";
     longdesc = "\
-Generate a new random UUID for the physical volume C<device>." };
+This function is used internally when hotplugging drives." };
 
   { defaults with
-    name = "pvchange_uuid_all"; added = (1, 19, 26);
-    style = RErr, [], [];
-    proc_nr = Some 339;
-    optional = Some "lvm2";
-    tests = [
-      InitEmpty, Always, TestRun (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["pvcreate"; "/dev/sda1"];
-         ["pvchange_uuid_all"]]), []
-    ];
-    shortdesc = "generate new random UUIDs for all physical volumes";
+    name = "internal_hot_remove_drive"; added = (1, 19, 49);
+    style = RErr, [String "label"], [];
+    proc_nr = Some 372;
+    visibility = VInternal;
+    shortdesc = "internal hotplugging operation";
     longdesc = "\
-Generate new random UUIDs for all physical volumes." };
+This function is used internally when hotplugging drives." };
 
   { defaults with
-    name = "vgchange_uuid"; added = (1, 19, 26);
-    style = RErr, [String "vg"], [];
-    proc_nr = Some 340;
-    optional = Some "lvm2";
+    name = "mktemp"; added = (1, 19, 53);
+    style = RString "path", [Pathname "tmpl"], [OString "suffix"];
+    proc_nr = Some 373;
     tests = [
-      InitEmpty, Always, TestRun (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["pvcreate"; "/dev/sda1"];
-         ["vgcreate"; "VG"; "/dev/sda1"];
-         ["vgchange_uuid"; "/dev/VG"]]), []
+      InitScratchFS, Always, TestRun (
+        [["mkdir"; "/mktemp"];
+         ["mktemp"; "/mktemp/tmpXXXXXX"; "NOARG"];
+         ["mktemp"; "/mktemp/tmpXXXXXX"; "suff"]]), []
     ];
-    shortdesc = "generate a new random UUID for a volume group";
+    shortdesc = "create a temporary file";
     longdesc = "\
-Generate a new random UUID for the volume group C<vg>." };
+This command creates a temporary file.  The
+C<tmpl> parameter should be a full pathname for the
+temporary directory name with the final six characters being
+\"XXXXXX\".
+
+For example: \"/tmp/myprogXXXXXX\" or \"/Temp/myprogXXXXXX\",
+the second one being suitable for Windows filesystems.
+
+The name of the temporary file that was created
+is returned.
+
+The temporary file is created with mode 0600
+and is owned by root.
+
+The caller is responsible for deleting the temporary
+file after use.
+
+If the optional C<suffix> parameter is given, then the suffix
+(eg. C<.txt>) is appended to the temporary name.
+
+See also: C<guestfs_mkdtemp>." };
 
   { defaults with
-    name = "vgchange_uuid_all"; added = (1, 19, 26);
-    style = RErr, [], [];
-    proc_nr = Some 341;
-    optional = Some "lvm2";
+    name = "mklost_and_found"; added = (1, 19, 56);
+    style = RErr, [Pathname "mountpoint"], [];
+    proc_nr = Some 374;
     tests = [
-      InitEmpty, Always, TestRun (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["pvcreate"; "/dev/sda1"];
-         ["vgcreate"; "VG"; "/dev/sda1"];
-         ["vgchange_uuid_all"]]), []
+      InitBasicFS, Always, TestRun (
+        [["rm_rf"; "/lost+found"];
+         ["mklost_and_found"; "/"]]), []
     ];
-    shortdesc = "generate new random UUIDs for all volume groups";
+    shortdesc = "make lost+found directory on an ext2/3/4 filesystem";
     longdesc = "\
-Generate new random UUIDs for all volume groups." };
+Make the C<lost+found> directory, normally in the root directory
+of an ext2/3/4 filesystem.  C<mountpoint> is the directory under
+which we try to create the C<lost+found> directory." };
 
   { defaults with
-    name = "utsname"; added = (1, 19, 27);
-    style = RStruct ("uts", "utsname"), [], [];
-    proc_nr = Some 342;
-    tests = [
-      InitEmpty, Always, TestRun (
-        [["utsname"]]), []
-    ];
-    shortdesc = "appliance kernel version";
+    name = "acl_get_file"; added = (1, 19, 63);
+    style = RString "acl", [Pathname "path"; String "acltype"], [];
+    proc_nr = Some 375;
+    optional = Some "acl";
+    shortdesc = "get the POSIX ACL attached to a file";
     longdesc = "\
-This returns the kernel version of the appliance, where this is
-available.  This information is only useful for debugging.  Nothing
-in the returned structure is defined by the API." };
+This function returns the POSIX Access Control List (ACL) attached
+to C<path>.  The ACL is returned in \"long text form\" (see L<acl(5)>).
+
+The C<acltype> parameter may be:
+
+=over 4
+
+=item C<access>
+
+Return the ordinary (access) ACL for any file, directory or
+other filesystem object.
+
+=item C<default>
+
+Return the default ACL.  Normally this only makes sense if
+C<path> is a directory.
+
+=back" };
 
   { defaults with
-    name = "xfs_growfs"; added = (1, 19, 28);
-    style = RErr, [Pathname "path"], [OBool "datasec"; OBool "logsec"; OBool "rtsec"; OInt64 "datasize"; OInt64 "logsize"; OInt64 "rtsize"; OInt64 "rtextsize"; OInt "maxpct"];
-    proc_nr = Some 343;
-    optional = Some "xfs";
+    name = "acl_set_file"; added = (1, 19, 63);
+    style = RErr, [Pathname "path"; String "acltype"; String "acl"], [];
+    proc_nr = Some 376;
+    optional = Some "acl";
     tests = [
-      InitEmpty, Always, TestResult (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["pvcreate"; "/dev/sda1"];
-         ["vgcreate"; "VG"; "/dev/sda1"];
-         ["lvcreate"; "LV"; "VG"; "40"];
-         ["mkfs"; "xfs"; "/dev/VG/LV"; ""; "NOARG"; ""; ""; "NOARG"];
-         ["lvresize"; "/dev/VG/LV"; "80"];
-         ["mount"; "/dev/VG/LV"; "/"];
-         ["xfs_growfs"; "/"; "true"; "false"; "false"; ""; ""; ""; ""; ""];
-         ["xfs_info"; "/"]], "ret->xfs_blocksize == 4096"), [];
+      InitScratchFS, Always, TestRun (
+        [["touch"; "/acl_set_file_0"];
+         ["acl_set_file"; "/acl_set_file_0"; "access"; "u::r-x,g::r-x,o::r-x"];
+         ["acl_get_file"; "/acl_set_file_0"; "access"]]), [];
+      InitScratchFS, Always, TestRun (
+        [["touch"; "/acl_set_file_1"];
+         ["acl_set_file"; "/acl_set_file_1"; "access"; "u::r-x,g::r-x,o::r-x,m::rwx,u:500:rw,g:600:x"]]), [];
+      InitScratchFS, Always, TestLastFail (
+        [["touch"; "/acl_set_file_2"];
+         (* m (mask) entry is required when setting user or group ACLs *)
+         ["acl_set_file"; "/acl_set_file_2"; "access"; "u::r-x,g::r-x,o::r-x,u:500:rw,g:600:x"]]), [];
+      InitScratchFS, Always, TestLastFail (
+        [["touch"; "/acl_set_file_3"];
+         (* user does not exist *)
+         ["acl_set_file"; "/acl_set_file_3"; "access"; "u::r-x,g::r-x,o::r-x,m::rwx,u:notauser:rw"]]), [];
+      InitScratchFS, Always, TestLastFail (
+        [["touch"; "/acl_set_file_4"];
+         (* cannot set default on a non-directory *)
+         ["acl_set_file"; "/acl_set_file_4"; "default"; "u::r-x,g::r-x,o::r-x"]]), [];
+      InitScratchFS, Always, TestRun (
+        [["mkdir"; "/acl_set_file_5"];
+         ["acl_set_file"; "/acl_set_file_5"; "default"; "u::r-x,g::r-x,o::r-x"]]), [];
     ];
-    shortdesc = "expand an existing XFS filesystem";
+    shortdesc = "set the POSIX ACL attached to a file";
     longdesc = "\
-Grow the XFS filesystem mounted at C<path>.
+This function sets the POSIX Access Control List (ACL) attached
+to C<path>.
 
-The returned struct contains geometry information.  Missing
-fields are returned as C<-1> (for numeric fields) or empty
-string." };
+The C<acltype> parameter may be:
 
-  { defaults with
-    name = "rsync"; added = (1, 19, 29);
-    style = RErr, [Pathname "src"; Pathname "dest"], [OBool "archive"; OBool "deletedest"];
-    proc_nr = Some 344;
-    optional = Some "rsync";
-    test_excuse = "tests are in tests/rsync";
-    shortdesc = "synchronize the contents of two directories";
-    longdesc = "\
-This call may be used to copy or synchronize two directories
-under the same libguestfs handle.  This uses the L<rsync(1)>
-program which uses a fast algorithm that avoids copying files
-unnecessarily.
+=over 4
 
-C<src> and C<dest> are the source and destination directories.
-Files are copied from C<src> to C<dest>.
+=item C<access>
 
-The optional arguments are:
+Set the ordinary (access) ACL for any file, directory or
+other filesystem object.
 
-=over 4
+=item C<default>
 
-=item C<archive>
+Set the default ACL.  Normally this only makes sense if
+C<path> is a directory.
 
-Turns on archive mode.  This is the same as passing the
-I<--archive> flag to C<rsync>.
+=back
 
-=item C<deletedest>
+The C<acl> parameter is the new ACL in either \"long text form\"
+or \"short text form\" (see L<acl(5)>).  The new ACL completely
+replaces any previous ACL on the file.  The ACL must contain the
+full Unix permissions (eg. C<u::rwx,g::rx,o::rx>).
 
-Delete files at the destination that do not exist at the source.
+If you are specifying individual users or groups, then the
+mask field is also required (eg. C<m::rwx>), followed by the
+C<u:I<ID>:...> and/or C<g:I<ID>:...> field(s).  A full ACL
+string might therefore look like this:
+
+ u::rwx,g::rwx,o::rwx,m::rwx,u:500:rwx,g:500:rwx
+ \\ Unix permissions / \\mask/ \\      ACL        /
+
+You should use numeric UIDs and GIDs.  To map usernames and
+groupnames to the correct numeric ID in the context of the
+guest, use the Augeas functions (see C<guestfs_aug_init>)." };
+
+  { defaults with
+    name = "acl_delete_def_file"; added = (1, 19, 63);
+    style = RErr, [Pathname "dir"], [];
+    proc_nr = Some 377;
+    optional = Some "acl";
+    tests = [
+      (* Documentation for libacl says this should fail, but it doesn't.
+       * Therefore disable this test.
+       *)
+      InitScratchFS, Disabled, TestLastFail (
+        [["touch"; "/acl_delete_def_file_0"];
+         ["acl_delete_def_file"; "/acl_delete_def_file_0"]]), [];
+      InitScratchFS, Always, TestRun (
+        [["mkdir"; "/acl_delete_def_file_1"];
+         ["acl_set_file"; "/acl_delete_def_file_1"; "default"; "user::r-x,group::r-x,other::r-x"];
+         ["acl_delete_def_file"; "/acl_delete_def_file_1"]]), [];
+    ];
+    shortdesc = "delete the default POSIX ACL of a directory";
+    longdesc = "\
+This function deletes the default POSIX Access Control List (ACL)
+attached to directory C<dir>." };
+
+  { defaults with
+    name = "cap_get_file"; added = (1, 19, 63);
+    style = RString "cap", [Pathname "path"], [];
+    proc_nr = Some 378;
+    optional = Some "linuxcaps";
+    shortdesc = "get the Linux capabilities attached to a file";
+    longdesc = "\
+This function returns the Linux capabilities attached to C<path>.
+The capabilities set is returned in text form (see L<cap_to_text(3)>).
+
+If no capabilities are attached to a file, an empty string is returned." };
+
+  { defaults with
+    name = "cap_set_file"; added = (1, 19, 63);
+    style = RErr, [Pathname "path"; String "cap"], [];
+    proc_nr = Some 379;
+    optional = Some "linuxcaps";
+    tests = [
+      InitScratchFS, Always, TestResultString (
+        [["touch"; "/cap_set_file_0"];
+         ["cap_set_file"; "/cap_set_file_0"; "cap_chown=p cap_chown+e"];
+         ["cap_get_file"; "/cap_set_file_0"]], "= cap_chown+ep"), [];
+    ];
+    shortdesc = "set the Linux capabilities attached to a file";
+    longdesc = "\
+This function sets the Linux capabilities attached to C<path>.
+The capabilities set C<cap> should be passed in text form
+(see L<cap_from_text(3)>)." };
 
-=back" };
+  { defaults with
+    name = "list_ldm_volumes"; added = (1, 20, 0);
+    style = RStringList "devices", [], [];
+    proc_nr = Some 380;
+    optional = Some "ldm";
+    shortdesc = "list all Windows dynamic disk volumes";
+    longdesc = "\
+This function returns all Windows dynamic disk volumes
+that were found at launch time.  It returns a list of
+device names." };
 
   { defaults with
-    name = "rsync_in"; added = (1, 19, 29);
-    style = RErr, [String "remote"; Pathname "dest"], [OBool "archive"; OBool "deletedest"];
-    proc_nr = Some 345;
-    optional = Some "rsync";
-    test_excuse = "tests are in tests/rsync";
-    shortdesc = "synchronize host or remote filesystem with filesystem";
+    name = "list_ldm_partitions"; added = (1, 20, 0);
+    style = RStringList "devices", [], [];
+    proc_nr = Some 381;
+    optional = Some "ldm";
+    shortdesc = "list all Windows dynamic disk partitions";
     longdesc = "\
-This call may be used to copy or synchronize the filesystem
-on the host or on a remote computer with the filesystem
-within libguestfs.  This uses the L<rsync(1)> program
-which uses a fast algorithm that avoids copying files unnecessarily.
+This function returns all Windows dynamic disk partitions
+that were found at launch time.  It returns a list of
+device names." };
 
-This call only works if the network is enabled.  See
-C<guestfs_set_network> or the I<--network> option to
-various tools like L<guestfish(1)>.
+  { defaults with
+    name = "ldmtool_create_all"; added = (1, 20, 0);
+    style = RErr, [], [];
+    proc_nr = Some 382;
+    optional = Some "ldm";
+    shortdesc = "scan and create Windows dynamic disk volumes";
+    longdesc = "\
+This function scans all block devices looking for Windows
+dynamic disk volumes and partitions, and creates devices
+for any that were found.
 
-Files are copied from the remote server and directory
-specified by C<remote> to the destination directory C<dest>.
+Call C<guestfs_list_ldm_volumes> and C<guestfs_list_ldm_partitions>
+to return all devices.
 
-The format of the remote server string is defined by L<rsync(1)>.
-Note that there is no way to supply a password or passphrase
-so the target must be set up not to require one.
+Note that you B<don't> normally need to call this explicitly,
+since it is done automatically at C<guestfs_launch> time.
+However you might want to call this function if you have
+hotplugged disks or have just created a Windows dynamic disk." };
 
-The optional arguments are the same as those of C<guestfs_rsync>." };
+  { defaults with
+    name = "ldmtool_remove_all"; added = (1, 20, 0);
+    style = RErr, [], [];
+    proc_nr = Some 383;
+    optional = Some "ldm";
+    shortdesc = "remove all Windows dynamic disk volumes";
+    longdesc = "\
+This is essentially the opposite of C<guestfs_ldmtool_create_all>.
+It removes the device mapper mappings for all Windows dynamic disk
+volumes" };
 
   { defaults with
-    name = "rsync_out"; added = (1, 19, 29);
-    style = RErr, [Pathname "src"; String "remote"], [OBool "archive"; OBool "deletedest"];
-    proc_nr = Some 346;
-    optional = Some "rsync";
-    test_excuse = "tests are in tests/rsync";
-    shortdesc = "synchronize filesystem with host or remote filesystem";
+    name = "ldmtool_scan"; added = (1, 20, 0);
+    style = RStringList "guids", [], [];
+    proc_nr = Some 384;
+    optional = Some "ldm";
+    shortdesc = "scan for Windows dynamic disks";
     longdesc = "\
-This call may be used to copy or synchronize the filesystem within
-libguestfs with a filesystem on the host or on a remote computer.
-This uses the L<rsync(1)> program which uses a fast algorithm that
-avoids copying files unnecessarily.
+This function scans for Windows dynamic disks.  It returns a list
+of identifiers (GUIDs) for all disk groups that were found.  These
+identifiers can be passed to other C<guestfs_ldmtool_*> functions.
 
-This call only works if the network is enabled.  See
-C<guestfs_set_network> or the I<--network> option to
-various tools like L<guestfish(1)>.
+This function scans all block devices.  To scan a subset of
+block devices, call C<guestfs_ldmtool_scan_devices> instead." };
 
-Files are copied from the source directory C<src> to the
-remote server and directory specified by C<remote>.
+  { defaults with
+    name = "ldmtool_scan_devices"; added = (1, 20, 0);
+    style = RStringList "guids", [DeviceList "devices"], [];
+    proc_nr = Some 385;
+    optional = Some "ldm";
+    shortdesc = "scan for Windows dynamic disks";
+    longdesc = "\
+This function scans for Windows dynamic disks.  It returns a list
+of identifiers (GUIDs) for all disk groups that were found.  These
+identifiers can be passed to other C<guestfs_ldmtool_*> functions.
 
-The format of the remote server string is defined by L<rsync(1)>.
-Note that there is no way to supply a password or passphrase
-so the target must be set up not to require one.
+The parameter C<devices> is a list of block devices which are
+scanned.  If this list is empty, all block devices are scanned." };
 
-The optional arguments are the same as those of C<guestfs_rsync>.
+  { defaults with
+    name = "ldmtool_diskgroup_name"; added = (1, 20, 0);
+    style = RString "name", [String "diskgroup"], [];
+    proc_nr = Some 386;
+    optional = Some "ldm";
+    shortdesc = "return the name of a Windows dynamic disk group";
+    longdesc = "\
+Return the name of a Windows dynamic disk group.  The C<diskgroup>
+parameter should be the GUID of a disk group, one element from
+the list returned by C<guestfs_ldmtool_scan>." };
 
-Globbing does not happen on the C<src> parameter.  In programs
-which use the API directly you have to expand wildcards yourself
-(see C<guestfs_glob_expand>).  In guestfish you can use the C<glob>
-command (see L<guestfish(1)/glob>), for example:
+  { defaults with
+    name = "ldmtool_diskgroup_volumes"; added = (1, 20, 0);
+    style = RStringList "volumes", [String "diskgroup"], [];
+    proc_nr = Some 387;
+    optional = Some "ldm";
+    shortdesc = "return the volumes in a Windows dynamic disk group";
+    longdesc = "\
+Return the volumes in a Windows dynamic disk group.  The C<diskgroup>
+parameter should be the GUID of a disk group, one element from
+the list returned by C<guestfs_ldmtool_scan>." };
 
- ><fs> glob rsync-out /* rsync://remote/" };
+  { defaults with
+    name = "ldmtool_diskgroup_disks"; added = (1, 20, 0);
+    style = RStringList "disks", [String "diskgroup"], [];
+    proc_nr = Some 388;
+    optional = Some "ldm";
+    shortdesc = "return the disks in a Windows dynamic disk group";
+    longdesc = "\
+Return the disks in a Windows dynamic disk group.  The C<diskgroup>
+parameter should be the GUID of a disk group, one element from
+the list returned by C<guestfs_ldmtool_scan>." };
 
   { defaults with
-    name = "ls0"; added = (1, 19, 32);
-    style = RErr, [Pathname "dir"; FileOut "filenames"], [];
-    proc_nr = Some 347;
-    shortdesc = "get list of files in a directory";
+    name = "ldmtool_volume_type"; added = (1, 20, 0);
+    style = RString "voltype", [String "diskgroup"; String "volume"], [];
+    proc_nr = Some 389;
+    optional = Some "ldm";
+    shortdesc = "return the type of a Windows dynamic disk volume";
     longdesc = "\
-This specialized command is used to get a listing of
-the filenames in the directory C<dir>.  The list of filenames
-is written to the local file F<filenames> (on the host).
+Return the type of the volume named C<volume> in the disk
+group with GUID C<diskgroup>.
 
-In the output file, the filenames are separated by C<\\0> characters.
+Possible volume types that can be returned here include:
+C<simple>, C<spanned>, C<striped>, C<mirrored>, C<raid5>.
+Other types may also be returned." };
 
-C<.> and C<..> are not returned.  The filenames are not sorted." };
+  { defaults with
+    name = "ldmtool_volume_hint"; added = (1, 20, 0);
+    style = RString "hint", [String "diskgroup"; String "volume"], [];
+    proc_nr = Some 390;
+    optional = Some "ldm";
+    shortdesc = "return the hint field of a Windows dynamic disk volume";
+    longdesc = "\
+Return the hint field of the volume named C<volume> in the disk
+group with GUID C<diskgroup>.  This may not be defined, in which
+case the empty string is returned.  The hint field is often, though
+not always, the name of a Windows drive, eg. C<E:>." };
 
   { defaults with
-    name = "fill_dir"; added = (1, 19, 32);
-    style = RErr, [Pathname "dir"; Int "nr"], [];
-    proc_nr = Some 348;
-    shortdesc = "fill a directory with empty files";
+    name = "ldmtool_volume_partitions"; added = (1, 20, 0);
+    style = RStringList "partitions", [String "diskgroup"; String "volume"], [];
+    proc_nr = Some 391;
+    optional = Some "ldm";
+    shortdesc = "return the partitions in a Windows dynamic disk volume";
     longdesc = "\
-This function, useful for testing filesystems, creates C<nr>
-empty files in the directory C<dir> with names C<00000000>
-through C<nr-1> (ie. each file name is 8 digits long padded
-with zeroes)." };
+Return the list of partitions in the volume named C<volume> in the disk
+group with GUID C<diskgroup>." };
 
   { defaults with
-    name = "xfs_admin"; added = (1, 19, 33);
-    style = RErr, [Device "device"], [OBool "extunwritten"; OBool "imgfile"; OBool "v2log"; OBool "projid32bit"; OBool "lazycounter"; OString "label"; OString "uuid"];
-    proc_nr = Some 349;
-    optional = Some "xfs";
-    tests =
-      (let uuid = uuidgen () in [
-        InitEmpty, Always, TestResult (
-          [["part_disk"; "/dev/sda"; "mbr"];
-           ["mkfs"; "xfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
-           ["xfs_admin"; "/dev/sda1"; ""; ""; ""; ""; "false"; "NOARG"; "NOARG"];
-           ["mount"; "/dev/sda1"; "/"];
-           ["xfs_info"; "/"]], "ret->xfs_lazycount == 0"), [];
-        InitEmpty, Always, TestResultString (
-          [["part_disk"; "/dev/sda"; "mbr"];
-           ["mkfs"; "xfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
-           ["xfs_admin"; "/dev/sda1"; ""; ""; ""; ""; ""; "NOARG"; uuid];
-           ["vfs_uuid"; "/dev/sda1"]], uuid), [];
-        InitEmpty, Always, TestResultString (
-          [["part_disk"; "/dev/sda"; "mbr"];
-           ["mkfs"; "xfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
-           ["xfs_admin"; "/dev/sda1"; ""; ""; ""; ""; ""; "LBL-TEST"; "NOARG"];
-           ["vfs_label"; "/dev/sda1"]], "LBL-TEST"), [];
-      ]);
-    shortdesc = "change parameters of an XFS filesystem";
+    name = "part_set_gpt_type"; added = (1, 21, 1);
+    style = RErr, [Device "device"; Int "partnum"; GUID "guid"], [];
+    proc_nr = Some 392;
+    optional = Some "gdisk";
+    tests = [
+      InitGPT, Always, TestLastFail (
+        [["part_set_gpt_type"; "/dev/sda"; "1"; "f"]]), [];
+      InitGPT, Always, TestResultString (
+        [["part_set_gpt_type"; "/dev/sda"; "1";
+          "01234567-89AB-CDEF-0123-456789ABCDEF"];
+         ["part_get_gpt_type"; "/dev/sda"; "1"]],
+        "01234567-89AB-CDEF-0123-456789ABCDEF"), [];
+    ];
+    shortdesc = "set the type GUID of a GPT partition";
     longdesc = "\
-Change the parameters of the XFS filesystem on C<device>.
+Set the type GUID of numbered GPT partition C<partnum> to C<guid>. Return an
+error if the partition table of C<device> isn't GPT, or if C<guid> is not a
+valid GUID.
 
-Devices that are mounted cannot be modified.
-Administrators must unmount filesystems before this call
-can modify parameters.
+See L<http://en.wikipedia.org/wiki/GUID_Partition_Table#Partition_type_GUIDs>
+for a useful list of type GUIDs." };
 
-Some of the parameters of a mounted filesystem can be examined
-and modified using the C<guestfs_xfs_info> and
-C<guestfs_xfs_growfs> calls." };
+  { defaults with
+    name = "part_get_gpt_type"; added = (1, 21, 1);
+    style = RString "guid", [Device "device"; Int "partnum"], [];
+    proc_nr = Some 393;
+    optional = Some "gdisk";
+    tests = [
+      InitGPT, Always, TestResultString (
+        [["part_set_gpt_type"; "/dev/sda"; "1";
+          "01234567-89AB-CDEF-0123-456789ABCDEF"];
+         ["part_get_gpt_type"; "/dev/sda"; "1"]],
+        "01234567-89AB-CDEF-0123-456789ABCDEF"), [];
+    ];
+    shortdesc = "get the type GUID of a GPT partition";
+    longdesc = "\
+Return the type GUID of numbered GPT partition C<partnum>. For MBR partitions,
+return an appropriate GUID corresponding to the MBR type. Behaviour is undefined
+for other partition types." };
 
   { defaults with
-    name = "hivex_open"; added = (1, 19, 35);
-    style = RErr, [Pathname "filename"], [OBool "verbose"; OBool "debug"; OBool "write"];
-    proc_nr = Some 350;
-    optional = Some "hivex";
+    name = "rename"; added = (1, 21, 5);
+    style = RErr, [Pathname "oldpath"; Pathname "newpath"], [];
+    proc_nr = Some 394;
     tests = [
-      InitScratchFS, Always, TestRun (
-        [["upload"; "$srcdir/../../test-data/files/minimal"; "/hivex_open"];
-         ["hivex_open"; "/hivex_open"; ""; ""; "false"];
-         ["hivex_root"]; (* in this hive, it returns 0x1020 *)
-         ["hivex_node_name"; "0x1020"];
-         ["hivex_node_children"; "0x1020"];
-         ["hivex_node_values"; "0x1020"]]), [["hivex_close"]]
+      InitScratchFS, Always, TestResultFalse (
+        [["mkdir"; "/rename"];
+         ["write"; "/rename/old"; "file content"];
+         ["rename"; "/rename/old"; "/rename/new"];
+         ["is_file"; "/rename/old"; ""]]), []
     ];
-    shortdesc = "open a Windows Registry hive file";
+    shortdesc = "rename a file on the same filesystem";
     longdesc = "\
-Open the Windows Registry hive file named F<filename>.
-If there was any previous hivex handle associated with this
-guestfs session, then it is closed.
-
-This is a wrapper around the L<hivex(3)> call of the same name." };
+Rename a file to a new place on the same filesystem.  This is
+the same as the Linux L<rename(2)> system call.  In most cases
+you are better to use C<guestfs_mv> instead." };
 
   { defaults with
-    name = "hivex_close"; added = (1, 19, 35);
-    style = RErr, [], [];
-    proc_nr = Some 351;
-    optional = Some "hivex";
-    shortdesc = "close the current hivex handle";
+    name = "is_whole_device"; added = (1, 21, 9);
+    style = RBool "flag", [Device "device"], [];
+    proc_nr = Some 395;
+    reentrant = true;
+    tests = [
+      InitEmpty, Always, TestResultTrue (
+        [["is_whole_device"; "/dev/sda"]]), [];
+      InitPartition, Always, TestResultFalse (
+        [["is_whole_device"; "/dev/sda1"]]), [];
+      InitBasicFSonLVM, Always, TestResultFalse (
+        [["is_whole_device"; "/dev/VG/LV"]]), [];
+    ];
+    shortdesc = "test if a device is a whole device";
     longdesc = "\
-Close the current hivex handle.
-
-This is a wrapper around the L<hivex(3)> call of the same name." };
+This returns C<true> if and only if C<device> refers to a whole block
+device. That is, not a partition or a logical device." };
 
   { defaults with
-    name = "hivex_root"; added = (1, 19, 35);
-    style = RInt64 "nodeh", [], [];
-    proc_nr = Some 352;
-    optional = Some "hivex";
-    shortdesc = "return the root node of the hive";
+    name = "internal_parse_mountable"; added = (1, 21, 11);
+    style = RStruct ("mountable", "internal_mountable"), [Mountable "mountable"], [];
+    visibility = VInternal;
+    proc_nr = Some 396;
+    shortdesc = "parse a mountable string";
     longdesc = "\
-Return the root node of the hive.
-
-This is a wrapper around the L<hivex(3)> call of the same name." };
+Parse a mountable string." };
 
   { defaults with
-    name = "hivex_node_name"; added = (1, 19, 35);
-    style = RString "name", [Int64 "nodeh"], [];
-    proc_nr = Some 353;
-    optional = Some "hivex";
-    shortdesc = "return the name of the node";
+    name = "internal_rhbz914931"; added = (1, 21, 14);
+    style = RErr, [FileIn "filename"; Int "count"], [];
+    proc_nr = Some 397;
+    visibility = VInternal;
+    cancellable = true;
+    shortdesc = "used only to test rhbz914931 (internal use only)";
     longdesc = "\
-Return the name of C<nodeh>.
-
-This is a wrapper around the L<hivex(3)> call of the same name." };
+This is only used to debug RHBZ#914931.  Note that this
+deliberately crashes guestfsd." };
 
   { defaults with
-    name = "hivex_node_children"; added = (1, 19, 35);
-    style = RStructList ("nodehs", "hivex_node"), [Int64 "nodeh"], [];
-    proc_nr = Some 354;
-    optional = Some "hivex";
-    shortdesc = "return list of nodes which are subkeys of node";
+    name = "syslinux"; added = (1, 21, 27);
+    style = RErr, [Device "device"], [OString "directory"];
+    proc_nr = Some 399;
+    optional = Some "syslinux";
+    shortdesc = "install the SYSLINUX bootloader";
     longdesc = "\
-Return the list of nodes which are subkeys of C<nodeh>.
+Install the SYSLINUX bootloader on C<device>.
 
-This is a wrapper around the L<hivex(3)> call of the same name." };
+The device parameter must be either a whole disk formatted
+as a FAT filesystem, or a partition formatted as a FAT filesystem.
+In the latter case, the partition should be marked as \"active\"
+(C<guestfs_part_set_bootable>) and a Master Boot Record must be
+installed (eg. using C<guestfs_pwrite_device>) on the first
+sector of the whole disk.
+The SYSLINUX package comes with some suitable Master Boot Records.
+See the L<syslinux(1)> man page for further information.
 
-  { defaults with
-    name = "hivex_node_get_child"; added = (1, 19, 35);
-    style = RInt64 "child", [Int64 "nodeh"; String "name"], [];
-    proc_nr = Some 355;
-    optional = Some "hivex";
-    shortdesc = "return the named child of node";
-    longdesc = "\
-Return the child of C<nodeh> with the name C<name>, if it exists.
-This can return C<0> meaning the name was not found.
+The optional arguments are:
 
-This is a wrapper around the L<hivex(3)> call of the same name." };
+=over 4
 
-  { defaults with
-    name = "hivex_node_parent"; added = (1, 19, 35);
-    style = RInt64 "parent", [Int64 "nodeh"], [];
-    proc_nr = Some 356;
-    optional = Some "hivex";
-    shortdesc = "return the parent of node";
-    longdesc = "\
-Return the parent node of C<nodeh>.
+=item F<directory>
 
-This is a wrapper around the L<hivex(3)> call of the same name." };
+Install SYSLINUX in the named subdirectory, instead of in the
+root directory of the FAT filesystem.
 
-  { defaults with
-    name = "hivex_node_values"; added = (1, 19, 35);
-    style = RStructList ("valuehs", "hivex_value"), [Int64 "nodeh"], [];
-    proc_nr = Some 357;
-    optional = Some "hivex";
-    shortdesc = "return list of values attached to node";
-    longdesc = "\
-Return the array of (key, datatype, data) tuples attached to C<nodeh>.
+=back
 
-This is a wrapper around the L<hivex(3)> call of the same name." };
+Additional configuration can be supplied to SYSLINUX by
+placing a file called F<syslinux.cfg> on the FAT filesystem,
+either in the root directory, or under F<directory> if that
+optional argument is being used.  For further information
+about the contents of this file, see L<syslinux(1)>.
+
+See also C<guestfs_extlinux>." };
 
   { defaults with
-    name = "hivex_node_get_value"; added = (1, 19, 35);
-    style = RInt64 "valueh", [Int64 "nodeh"; String "key"], [];
-    proc_nr = Some 358;
-    optional = Some "hivex";
-    shortdesc = "return the named value";
+    name = "extlinux"; added = (1, 21, 27);
+    style = RErr, [Pathname "directory"], [];
+    proc_nr = Some 400;
+    optional = Some "extlinux";
+    shortdesc = "install the SYSLINUX bootloader on an ext2/3/4 or btrfs filesystem";
     longdesc = "\
-Return the value attached to C<nodeh> which has the
-name C<key>, if it exists.  This can return C<0> meaning
-the key was not found.
+Install the SYSLINUX bootloader on the device mounted at F<directory>.
+Unlike C<guestfs_syslinux> which requires a FAT filesystem, this can
+be used on an ext2/3/4 or btrfs filesystem.
 
-This is a wrapper around the L<hivex(3)> call of the same name." };
+The F<directory> parameter can be either a mountpoint, or a
+directory within the mountpoint.
+
+You also have to mark the partition as \"active\"
+(C<guestfs_part_set_bootable>) and a Master Boot Record must
+be installed (eg. using C<guestfs_pwrite_device>) on the first
+sector of the whole disk.
+The SYSLINUX package comes with some suitable Master Boot Records.
+See the L<extlinux(1)> man page for further information.
+
+Additional configuration can be supplied to SYSLINUX by
+placing a file called F<extlinux.conf> on the filesystem
+under F<directory>.  For further information
+about the contents of this file, see L<extlinux(1)>.
+
+See also C<guestfs_syslinux>." };
 
   { defaults with
-    name = "hivex_value_key"; added = (1, 19, 35);
-    style = RString "key", [Int64 "valueh"], [];
-    proc_nr = Some 359;
-    optional = Some "hivex";
-    shortdesc = "return the key field from the (key, datatype, data) tuple";
+    name = "cp_r"; added = (1, 21, 38);
+    style = RErr, [Pathname "src"; Pathname "dest"], [];
+    proc_nr = Some 401;
+    tests = [
+      InitScratchFS, Always, TestResultString (
+        [["mkdir"; "/cp_r1"];
+         ["mkdir"; "/cp_r2"];
+         ["write"; "/cp_r1/file"; "file content"];
+         ["cp_r"; "/cp_r1"; "/cp_r2"];
+         ["cat"; "/cp_r2/cp_r1/file"]], "file content"), []
+    ];
+    shortdesc = "copy a file or directory recursively";
     longdesc = "\
-Return the key (name) field of a (key, datatype, data) tuple.
+This copies a file or directory from C<src> to C<dest>
+recursively using the C<cp -rP> command.
 
-This is a wrapper around the L<hivex(3)> call of the same name." };
+Most users should use C<guestfs_cp_a> instead.  This command
+is useful when you don't want to preserve permissions, because
+the target filesystem does not support it (primarily when
+writing to DOS FAT filesystems)." };
 
   { defaults with
-    name = "hivex_value_type"; added = (1, 19, 35);
-    style = RInt64 "datatype", [Int64 "valueh"], [];
-    proc_nr = Some 360;
-    optional = Some "hivex";
-    shortdesc = "return the data type from the (key, datatype, data) tuple";
+    name = "remount"; added = (1, 23, 2);
+    style = RErr, [Pathname "mountpoint"], [OBool "rw"];
+    proc_nr = Some 402;
+    tests = [
+      InitScratchFS, Always, TestLastFail (
+        [["remount"; "/"; "false"];
+         ["write"; "/remount1"; "data"]]), [];
+      InitScratchFS, Always, TestRun (
+        [["remount"; "/"; "false"];
+         ["remount"; "/"; "true"];
+         ["write"; "/remount2"; "data"]]), []
+    ];
+    shortdesc = "remount a filesystem with different options";
     longdesc = "\
-Return the data type field from a (key, datatype, data) tuple.
+This call allows you to change the C<rw> (readonly/read-write)
+flag on an already mounted filesystem at C<mountpoint>,
+converting a readonly filesystem to be read-write, or vice-versa.
 
-This is a wrapper around the L<hivex(3)> call of the same name." };
+Note that at the moment you must supply the \"optional\" C<rw>
+parameter.  In future we may allow other flags to be adjusted." };
 
   { defaults with
-    name = "hivex_value_value"; added = (1, 19, 35);
-    style = RBufferOut "databuf", [Int64 "valueh"], [];
-    proc_nr = Some 361;
-    optional = Some "hivex";
-    shortdesc = "return the data field from the (key, datatype, data) tuple";
+    name = "set_uuid"; added = (1, 23, 10);
+    style = RErr, [Device "device"; String "uuid"], [];
+    proc_nr = Some 403;
+    tests =
+      (let uuid = uuidgen () in [
+        InitBasicFS, Always, TestResultString (
+          [["set_uuid"; "/dev/sda1"; uuid];
+           ["vfs_uuid"; "/dev/sda1"]], uuid), [];
+      ]);
+    shortdesc = "set the filesystem UUID";
     longdesc = "\
-Return the data field of a (key, datatype, data) tuple.
+Set the filesystem UUID on C<device> to C<uuid>.
+If this fails and the errno is ENOTSUP,
+means that there is no support for changing the UUID
+for the type of the specified filesystem.
 
-This is a wrapper around the L<hivex(3)> call of the same name.
+Only some filesystem types support setting UUIDs.
 
-See also: C<guestfs_hivex_value_utf8>." };
+To read the UUID on a filesystem, call C<guestfs_vfs_uuid>." };
 
   { defaults with
-    name = "hivex_commit"; added = (1, 19, 35);
-    style = RErr, [OptString "filename"], [];
-    proc_nr = Some 362;
-    optional = Some "hivex";
-    tests = [
-      InitScratchFS, Always, TestRun (
-        [["upload"; "$srcdir/../../test-data/files/minimal"; "/hivex_commit1"];
-         ["hivex_open"; "/hivex_commit1"; ""; ""; "true"];
-         ["hivex_commit"; "NULL"]]), [["hivex_close"]];
-      InitScratchFS, Always, TestResultTrue (
-        [["upload"; "$srcdir/../../test-data/files/minimal"; "/hivex_commit2"];
-         ["hivex_open"; "/hivex_commit2"; ""; ""; "true"];
-         ["hivex_commit"; "/hivex_commit2_copy"];
-         ["is_file"; "/hivex_commit2_copy"; "false"]]), [["hivex_close"]]
-    ];
-    shortdesc = "commit (write) changes back to the hive";
+    name = "journal_open"; added = (1, 23, 11);
+    style = RErr, [Pathname "directory"], [];
+    proc_nr = Some 404;
+    optional = Some "journal";
+    test_excuse = "tests in tests/journal subdirectory";
+    shortdesc = "open the systemd journal";
     longdesc = "\
-Commit (write) changes to the hive.
+Open the systemd journal located in F<directory>.  Any previously
+opened journal handle is closed.
 
-If the optional F<filename> parameter is null, then the changes
-are written back to the same hive that was opened.  If this is
-not null then they are written to the alternate filename given
-and the original hive is left untouched.
+The contents of the journal can be read using C<guestfs_journal_next>
+and C<guestfs_journal_get>.
 
-This is a wrapper around the L<hivex(3)> call of the same name." };
+After you have finished using the journal, you should close the
+handle by calling C<guestfs_journal_close>." };
 
   { defaults with
-    name = "hivex_node_add_child"; added = (1, 19, 35);
-    style = RInt64 "nodeh", [Int64 "parent"; String "name"], [];
-    proc_nr = Some 363;
-    optional = Some "hivex";
-    shortdesc = "add a child node";
+    name = "journal_close"; added = (1, 23, 11);
+    style = RErr, [], [];
+    proc_nr = Some 405;
+    optional = Some "journal";
+    test_excuse = "tests in tests/journal subdirectory";
+    shortdesc = "close the systemd journal";
     longdesc = "\
-Add a child node to C<parent> named C<name>.
-
-This is a wrapper around the L<hivex(3)> call of the same name." };
+Close the journal handle." };
 
   { defaults with
-    name = "hivex_node_delete_child"; added = (1, 19, 35);
-    style = RErr, [Int64 "nodeh"], [];
-    proc_nr = Some 364;
-    optional = Some "hivex";
-    shortdesc = "delete a node (recursively)";
+    name = "journal_next"; added = (1, 23, 11);
+    style = RBool "more", [], [];
+    proc_nr = Some 406;
+    optional = Some "journal";
+    test_excuse = "tests in tests/journal subdirectory";
+    shortdesc = "move to the next journal entry";
     longdesc = "\
-Delete C<nodeh>, recursively if necessary.
+Move to the next journal entry.  You have to call this
+at least once after opening the handle before you are able
+to read data.
 
-This is a wrapper around the L<hivex(3)> call of the same name." };
+The returned boolean tells you if there are any more journal
+records to read.  C<true> means you can read the next record
+(eg. using C<guestfs_journal_get>), and C<false> means you
+have reached the end of the journal." };
 
   { defaults with
-    name = "hivex_node_set_value"; added = (1, 19, 35);
-    style = RErr, [Int64 "nodeh"; String "key"; Int64 "t"; BufferIn "val"], [];
-    proc_nr = Some 365;
-    optional = Some "hivex";
-    shortdesc = "set or replace a single value in a node";
+    name = "journal_skip"; added = (1, 23, 11);
+    style = RInt64 "rskip", [Int64 "skip"], [];
+    proc_nr = Some 407;
+    optional = Some "journal";
+    test_excuse = "tests in tests/journal subdirectory";
+    shortdesc = "skip forwards or backwards in the journal";
     longdesc = "\
-Set or replace a single value under the node C<nodeh>.  The
-C<key> is the name, C<t> is the type, and C<val> is the data.
+Skip forwards (C<skip E<ge> 0>) or backwards (C<skip E<lt> 0>) in the
+journal.
 
-This is a wrapper around the L<hivex(3)> call of the same name." };
+The number of entries actually skipped is returned (note S<C<rskip E<ge> 0>>).
+If this is not the same as the absolute value of the skip parameter
+(C<|skip|>) you passed in then it means you have reached the end or
+the start of the journal." };
 
   { defaults with
-    name = "xfs_repair"; added = (1, 19, 36);
-    style = RInt "status", [Dev_or_Path "device"], [OBool "forcelogzero"; OBool "nomodify"; OBool "noprefetch"; OBool "forcegeometry"; OInt64 "maxmem"; OInt64 "ihashsize"; OInt64 "bhashsize"; OInt64 "agstride"; OString "logdev"; OString "rtdev"];
-    proc_nr = Some 366;
-    optional = Some "xfs";
-    tests = [
-      InitEmpty, Always, TestRun (
-        [["part_disk"; "/dev/sda"; "mbr"];
-         ["mkfs"; "xfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
-         ["xfs_repair"; "/dev/sda1"; ""; "true"; ""; ""; ""; ""; ""; ""; "NOARG"; "NOARG"]
-        ]), []
-    ];
-    shortdesc = "repair an XFS filesystem";
+    name = "internal_journal_get"; added = (1, 23, 11);
+    style = RErr, [FileOut "filename"], [];
+    proc_nr = Some 408;
+    visibility = VInternal;
+    optional = Some "journal";
+    test_excuse = "tests in tests/journal subdirectory";
+    shortdesc = "internal journal reading operation";
     longdesc = "\
-Repair corrupt or damaged XFS filesystem on C<device>.
-
-The filesystem is specified using the C<device> argument which should be
-the device name of the disk partition or volume containing the filesystem.
-If given the name of a block device, C<xfs_repair> will attempt to find
-the raw device associated with the specified block device and will use
-the raw device instead.
+This function is used internally when reading the journal." };
 
-Regardless, the filesystem to be repaired must be unmounted, otherwise,
-the resulting filesystem may be inconsistent or corrupt.
+  { defaults with
+    name = "journal_get_data_threshold"; added = (1, 23, 11);
+    style = RInt64 "threshold", [], [];
+    proc_nr = Some 409;
+    optional = Some "journal";
+    test_excuse = "tests in tests/journal subdirectory";
+    shortdesc = "get the data threshold for reading journal entries";
+    longdesc = "\
+Get the current data threshold for reading journal entries.
+This is a hint to the journal that it may truncate data fields to
+this size when reading them (note also that it may not truncate them).
+If this returns C<0>, then the threshold is unlimited.
 
-The returned status indicates whether filesystem corruption was
-detected (returns C<1>) or was not detected (returns C<0>)." };
+See also C<guestfs_journal_set_data_threshold>." };
 
   { defaults with
-    name = "rm_f"; added = (1, 19, 42);
-    style = RErr, [Pathname "path"], [];
-    proc_nr = Some 367;
-    tests = [
-      InitScratchFS, Always, TestResultFalse
-        [["mkdir"; "/rm_f"];
-         ["touch"; "/rm_f/foo"];
-         ["rm_f"; "/rm_f/foo"];
-         ["rm_f"; "/rm_f/not_exists"];
-         ["exists"; "/rm_f/foo"]], [];
-      InitScratchFS, Always, TestLastFail
-        [["mkdir"; "/rm_f2"];
-         ["mkdir"; "/rm_f2/foo"];
-         ["rm_f"; "/rm_f2/foo"]], []
-    ];
-    shortdesc = "remove a file ignoring errors";
+    name = "journal_set_data_threshold"; added = (1, 23, 11);
+    style = RErr, [Int64 "threshold"], [];
+    proc_nr = Some 410;
+    optional = Some "journal";
+    test_excuse = "tests in tests/journal subdirectory";
+    shortdesc = "set the data threshold for reading journal entries";
     longdesc = "\
-Remove the file C<path>.
-
-If the file doesn't exist, that error is ignored.  (Other errors,
-eg. I/O errors or bad paths, are not ignored)
+Set the data threshold for reading journal entries.
+This is a hint to the journal that it may truncate data fields to
+this size when reading them (note also that it may not truncate them).
+If you set this to C<0>, then the threshold is unlimited.
 
-This call cannot remove directories.
-Use C<guestfs_rmdir> to remove an empty directory,
-or C<guestfs_rm_rf> to remove directories recursively." };
+See also C<guestfs_journal_get_data_threshold>." };
 
   { defaults with
-    name = "mke2fs"; added = (1, 19, 44);
-    style = RErr, [Device "device"], [OInt64 "blockscount"; OInt64 "blocksize"; OInt64 "fragsize"; OInt64 "blockspergroup"; OInt64 "numberofgroups"; OInt64 "bytesperinode"; OInt64 "inodesize"; OInt64 "journalsize"; OInt64 "numberofinodes"; OInt64 "stridesize"; OInt64 "stripewidth"; OInt64 "maxonlineresize"; OInt "reservedblockspercentage"; OInt "mmpupdateinterval"; OString "journaldevice"; OString "label"; OString "lastmounteddir"; OString "creatoros"; OString "fstype"; OString "usagetype"; OString "uuid"; OBool "forcecreate"; OBool "writesbandgrouponly"; OBool "lazyitableinit"; OBool "lazyjournalinit"; OBool "testfs"; OBool "discard"; OBool "quotatype";  OBool "extent"; OBool "filetype"; OBool "flexbg"; OBool "hasjournal"; OBool "journaldev"; OBool "largefile"; OBool "quota"; OBool "resizeinode"; OBool "sparsesuper"; OBool "uninitbg"];
-    proc_nr = Some 368;
-    tests =
-      (let uuid = uuidgen () in
-       let uuid_s = "UUID=" ^ uuid in [
-         InitEmpty, Always, TestResultString (
-           [["part_init"; "/dev/sda"; "mbr"];
-            ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
-            ["part_add"; "/dev/sda"; "p"; "204800"; "-64"];
-            ["mke2fs"; "/dev/sda1"; ""; "4096"; ""; ""; "";
-             ""; ""; ""; ""; "";
-             ""; ""; ""; ""; "NOARG";
-             "NOARG"; "NOARG"; "NOARG"; "NOARG"; "NOARG";
-             "NOARG"; ""; ""; ""; "";
-             ""; ""; ""; ""; "";
-             ""; ""; "true"; ""; "";
-             ""; ""; ""];
-            ["mke2fs"; "/dev/sda2"; ""; "4096"; ""; ""; "";
-             ""; ""; ""; ""; "";
-             ""; ""; ""; ""; "/dev/sda1";
-             "NOARG"; "NOARG"; "NOARG"; "ext2"; "NOARG";
-             "NOARG"; ""; ""; ""; "";
-             ""; ""; ""; ""; "";
-             ""; ""; ""; ""; "";
-             ""; ""; ""];
-            ["mount"; "/dev/sda2"; "/"];
-            ["write"; "/new"; "new file contents"];
-            ["cat"; "/new"]], "new file contents"), [];
-         InitEmpty, Always, TestResultString (
-           [["part_init"; "/dev/sda"; "mbr"];
-            ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
-            ["part_add"; "/dev/sda"; "p"; "204800"; "-64"];
-            ["mke2fs"; "/dev/sda1"; ""; "4096"; ""; ""; "";
-             ""; ""; ""; ""; "";
-             ""; ""; ""; ""; "/dev/sda1";
-             "JOURNAL"; "NOARG"; "NOARG"; "ext2"; "NOARG";
-             "NOARG"; ""; ""; ""; "";
-             ""; ""; ""; ""; "";
-             ""; ""; "true"; ""; "";
-             ""; ""; ""];
-            ["mke2fs"; "/dev/sda2"; ""; "4096"; ""; ""; "";
-             ""; ""; ""; ""; "";
-             ""; ""; ""; ""; "LABEL=JOURNAL";
-             "JOURNAL"; "NOARG"; "NOARG"; "ext2"; "NOARG";
-             "NOARG"; ""; ""; ""; "";
-             ""; ""; ""; ""; "";
-             ""; ""; ""; ""; "";
-             ""; ""; ""];
-            ["mount"; "/dev/sda2"; "/"];
-            ["write"; "/new"; "new file contents"];
-            ["cat"; "/new"]], "new file contents"), [];
-         InitEmpty, Always, TestResultString (
-           [["part_init"; "/dev/sda"; "mbr"];
-            ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
-            ["part_add"; "/dev/sda"; "p"; "204800"; "-64"];
-            ["mke2fs"; "/dev/sda1"; ""; "4096"; ""; ""; "";
-             ""; ""; ""; ""; "";
-             ""; ""; ""; ""; "NOARG";
-             "NOARG"; "NOARG"; "NOARG"; "NOARG"; "NOARG";
-             uuid; ""; ""; ""; "";
-             ""; ""; ""; ""; "";
-             ""; ""; "true"; ""; "";
-             ""; ""; ""];
-            ["mke2fs"; "/dev/sda2"; ""; "4096"; ""; ""; "";
-             ""; ""; ""; ""; "";
-             ""; ""; ""; ""; uuid_s;
-             "JOURNAL"; "NOARG"; "NOARG"; "ext2"; "NOARG";
-             "NOARG"; "true"; ""; ""; "";
-             ""; ""; ""; ""; "";
-             ""; ""; ""; ""; "";
-             ""; ""; ""];
-            ["mount"; "/dev/sda2"; "/"];
-            ["write"; "/new"; "new file contents"];
-            ["cat"; "/new"]], "new file contents"), []
-       ]);
-    shortdesc = "create an ext2/ext3/ext4 filesystem on device";
-    (* XXX document optional args properly *)
+    name = "aug_setm"; added = (1, 23, 14);
+    style = RInt "nodes", [String "base"; OptString "sub"; String "val"], [];
+    proc_nr = Some 411;
+    tests = [
+      InitBasicFS, Always, TestResultString (
+        [["mkdir"; "/etc"];
+         ["write"; "/etc/passwd"; "root:x:0:0:root:/root:/bin/bash\nbin:x:1:1:bin:/bin:/sbin/nologin\ndaemon:x:2:2:daemon:/sbin:/bin/csh\n"];
+         ["aug_init"; "/"; "0"];
+         ["aug_setm"; "/files/etc/passwd/*"; "shell"; "/sbin/nologin"];
+         ["aug_save"];
+         ["cat"; "/etc/passwd"]], "root:x:0:0:root:/root:/sbin/nologin\nbin:x:1:1:bin:/bin:/sbin/nologin\ndaemon:x:2:2:daemon:/sbin:/sbin/nologin\n"), [["aug_close"]]
+    ];
+    shortdesc = "set multiple Augeas nodes";
     longdesc = "\
-C<mke2fs> is used to create an ext2, ext3, or ext4 filesystem
-on C<device>.
+Change multiple Augeas nodes in a single operation.  C<base> is
+an expression matching multiple nodes.  C<sub> is a path expression
+relative to C<base>.  All nodes matching C<base> are found, and then
+for each node, C<sub> is changed to C<val>.  C<sub> may also be C<NULL>
+in which case the C<base> nodes are modified.
 
-The optional C<blockscount> is the size of the filesystem in blocks.
-If omitted it defaults to the size of C<device>.  Note if the
-filesystem is too small to contain a journal, C<mke2fs> will
-silently create an ext2 filesystem instead." };
+This returns the number of nodes modified." };
 
   { defaults with
-    name = "list_disk_labels"; added = (1, 19, 49);
-    style = RHashtable "labels", [], [];
-    proc_nr = Some 369;
+    name = "aug_label"; added = (1, 23, 14);
+    style = RString "label", [String "augpath"], [];
+    proc_nr = Some 412;
     tests = [
-      (* The test disks have no labels, so we can be sure there are
-       * no labels.  See in tests/disk-labels/ for tests checking
-       * for actual disk labels.
-       *
-       * Also, we make use of the assumption that RHashtable is a
-       * char*[] in C, so an empty hash has just a NULL element.
-       *)
-      InitScratchFS, Always, TestResult (
-        [["list_disk_labels"]],
-        "is_string_list (ret, 0)"), [];
+      InitBasicFS, Always, TestResultString (
+        [["mkdir"; "/etc"];
+         ["write"; "/etc/passwd"; "root:x:0:0:root:/root:/bin/bash\nbin:x:1:1:bin:/bin:/sbin/nologin\ndaemon:x:2:2:daemon:/sbin:/bin/csh\n"];
+         ["aug_init"; "/"; "0"];
+         ["aug_label"; "/files/etc/passwd/*[last()]"]], "daemon"), [["aug_close"]]
     ];
-    shortdesc = "mapping of disk labels to devices";
+    shortdesc = "return the label from an Augeas path expression";
     longdesc = "\
-If you add drives using the optional C<label> parameter
-of C<guestfs_add_drive_opts>, you can use this call to
-map between disk labels, and raw block device and partition
-names (like F</dev/sda> and F</dev/sda1>).
-
-This returns a hashtable, where keys are the disk labels
-(I<without> the F</dev/disk/guestfs> prefix), and the values
-are the full raw block device and partition names
-(eg. F</dev/sda> and F</dev/sda1>)." };
+The label (name of the last element) of the Augeas path expression
+C<augpath> is returned.  C<augpath> must match exactly one node, else
+this function returns an error." };
 
   { defaults with
-    name = "internal_hot_add_drive"; added = (1, 19, 49);
-    style = RErr, [String "label"], [];
-    proc_nr = Some 370;
+    name = "internal_upload"; added = (1, 23, 30);
+    style = RErr, [FileIn "filename"; String "tmpname"; Int "mode"], [];
+    proc_nr = Some 413;
     visibility = VInternal;
-    shortdesc = "internal hotplugging operation";
+    cancellable = true;
+    shortdesc = "upload a file to the appliance (internal use only)";
     longdesc = "\
-This function is used internally when hotplugging drives." };
+This function is used internally when setting up the appliance." };
 
   { defaults with
-    name = "internal_hot_remove_drive_precheck"; added = (1, 19, 49);
-    style = RErr, [String "label"], [];
-    proc_nr = Some 371;
-    visibility = VInternal;
-    shortdesc = "internal hotplugging operation";
+    name = "internal_exit"; added = (1, 23, 30);
+    style = RErr, [], [];
+    proc_nr = Some 414;
+    (* Really VInternal, but we need to use it from the Perl bindings. XXX *)
+    visibility = VDebug;
+    cancellable = true;
+    shortdesc = "cause the daemon to exit (internal use only)";
     longdesc = "\
-This function is used internally when hotplugging drives." };
+This function is used internally when testing the appliance." };
 
   { defaults with
-    name = "internal_hot_remove_drive"; added = (1, 19, 49);
-    style = RErr, [String "label"], [];
-    proc_nr = Some 372;
-    visibility = VInternal;
-    shortdesc = "internal hotplugging operation";
+    name = "copy_attributes"; added = (1, 25, 21);
+    style = RErr, [Pathname "src"; Pathname "dest"], [OBool "all"; OBool "mode"; OBool "xattributes"; OBool "ownership"];
+    proc_nr = Some 415;
+    shortdesc = "copy the attributes of a path (file/directory) to another";
     longdesc = "\
-This function is used internally when hotplugging drives." };
+Copy the attributes of a path (which can be a file or a directory)
+to another path.
 
-  { defaults with
-    name = "mktemp"; added = (1, 19, 53);
-    style = RString "path", [Pathname "tmpl"], [OString "suffix"];
-    proc_nr = Some 373;
-    tests = [
-      InitScratchFS, Always, TestRun (
-        [["mkdir"; "/mktemp"];
-         ["mktemp"; "/mktemp/tmpXXXXXX"; "NOARG"];
-         ["mktemp"; "/mktemp/tmpXXXXXX"; "suff"]]), []
-    ];
-    shortdesc = "create a temporary file";
-    longdesc = "\
-This command creates a temporary file.  The
-C<tmpl> parameter should be a full pathname for the
-temporary directory name with the final six characters being
-\"XXXXXX\".
+By default C<no> attribute is copied, so make sure to specify any
+(or C<all> to copy everything).
 
-For example: \"/tmp/myprogXXXXXX\" or \"/Temp/myprogXXXXXX\",
-the second one being suitable for Windows filesystems.
+The optional arguments specify which attributes can be copied:
 
-The name of the temporary file that was created
-is returned.
+=over 4
 
-The temporary file is created with mode 0600
-and is owned by root.
+=item C<mode>
 
-The caller is responsible for deleting the temporary
-file after use.
+Copy part of the file mode from C<source> to C<destination>. Only the
+UNIX permissions and the sticky/setuid/setgid bits can be copied.
 
-If the optional C<suffix> parameter is given, then the suffix
-(eg. C<.txt>) is appended to the temporary name.
+=item C<xattributes>
 
-See also: C<guestfs_mkdtemp>." };
+Copy the Linux extended attributes (xattrs) from C<source> to C<destination>.
+This flag does nothing if the I<linuxxattrs> feature is not available
+(see C<guestfs_feature_available>).
+
+=item C<ownership>
+
+Copy the owner uid and the group gid of C<source> to C<destination>.
+
+=item C<all>
+
+Copy B<all> the attributes from C<source> to C<destination>. Enabling it
+enables all the other flags, if they are not specified already.
+
+=back" };
 
   { defaults with
-    name = "mklost_and_found"; added = (1, 19, 56);
-    style = RErr, [Pathname "mountpoint"], [];
-    proc_nr = Some 374;
-    tests = [
-      InitBasicFS, Always, TestRun (
-        [["rm_rf"; "/lost+found"];
-         ["mklost_and_found"; "/"]]), []
-    ];
-    shortdesc = "make lost+found directory on an ext2/3/4 filesystem";
+    name = "part_get_name"; added = (1, 25, 33);
+    style = RString "name", [Device "device"; Int "partnum"], [];
+    proc_nr = Some 416;
+    shortdesc = "get partition name";
     longdesc = "\
-Make the C<lost+found> directory, normally in the root directory
-of an ext2/3/4 filesystem.  C<mountpoint> is the directory under
-which we try to create the C<lost+found> directory." };
+This gets the partition name on partition numbered C<partnum> on
+device C<device>.  Note that partitions are numbered from 1.
+
+The partition name can only be read on certain types of partition
+table.  This works on C<gpt> but not on C<mbr> partitions." };
 
   { defaults with
-    name = "acl_get_file"; added = (1, 19, 63);
-    style = RString "acl", [Pathname "path"; String "acltype"], [];
-    proc_nr = Some 375;
-    optional = Some "acl";
-    shortdesc = "get the POSIX ACL attached to a file";
+    name = "blkdiscard"; added = (1, 25, 44);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 417;
+    optional = Some "blkdiscard";
+    shortdesc = "discard all blocks on a device";
     longdesc = "\
-This function returns the POSIX Access Control List (ACL) attached
-to C<path>.  The ACL is returned in \"long text form\" (see L<acl(5)>).
+This discards all blocks on the block device C<device>, giving
+the free space back to the host.
 
-The C<acltype> parameter may be:
+This operation requires support in libguestfs, the host filesystem,
+qemu and the host kernel.  If this support isn't present it may give
+an error or even appear to run but do nothing.  You must also
+set the C<discard> attribute on the underlying drive (see
+C<guestfs_add_drive_opts>)." };
+
+  { defaults with
+    name = "blkdiscardzeroes"; added = (1, 25, 44);
+    style = RBool "zeroes", [Device "device"], [];
+    proc_nr = Some 418;
+    optional = Some "blkdiscardzeroes";
+    shortdesc = "return true if discarded blocks are read as zeroes";
+    longdesc = "\
+This call returns true if blocks on C<device> that have been
+discarded by a call to C<guestfs_blkdiscard> are returned as
+blocks of zero bytes when read the next time.
+
+If it returns false, then it may be that discarded blocks are
+read as stale or random data." };
+
+  { defaults with
+    name = "cpio_out"; added = (1, 27, 9);
+    style = RErr, [String "directory"; FileOut "cpiofile"], [OString "format"];
+    proc_nr = Some 419;
+    cancellable = true;
+    shortdesc = "pack directory into cpio file";
+    longdesc = "\
+This command packs the contents of F<directory> and downloads
+it to local file C<cpiofile>.
+
+The optional C<format> parameter can be used to select the format.
+Only the following formats are currently permitted:
 
 =over 4
 
-=item C<access>
+=item C<newc>
 
-Return the ordinary (access) ACL for any file, directory or
-other filesystem object.
+New (SVR4) portable format.  This format happens to be compatible
+with the cpio-like format used by the Linux kernel for initramfs.
 
-=item C<default>
+This is the default format.
 
-Return the default ACL.  Normally this only makes sense if
-C<path> is a directory.
+=item C<crc>
+
+New (SVR4) portable format with a checksum.
 
 =back" };
 
   { defaults with
-    name = "acl_set_file"; added = (1, 19, 63);
-    style = RErr, [Pathname "path"; String "acltype"; String "acl"], [];
-    proc_nr = Some 376;
-    optional = Some "acl";
-    tests = [
-      InitScratchFS, Always, TestRun (
-        [["touch"; "/acl_set_file_0"];
-         ["acl_set_file"; "/acl_set_file_0"; "access"; "u::r-x,g::r-x,o::r-x"];
-         ["acl_get_file"; "/acl_set_file_0"; "access"]]), [];
-      InitScratchFS, Always, TestRun (
-        [["touch"; "/acl_set_file_1"];
-         ["acl_set_file"; "/acl_set_file_1"; "access"; "u::r-x,g::r-x,o::r-x,m::rwx,u:500:rw,g:600:x"]]), [];
-      InitScratchFS, Always, TestLastFail (
-        [["touch"; "/acl_set_file_2"];
-         (* m (mask) entry is required when setting user or group ACLs *)
-         ["acl_set_file"; "/acl_set_file_2"; "access"; "u::r-x,g::r-x,o::r-x,u:500:rw,g:600:x"]]), [];
-      InitScratchFS, Always, TestLastFail (
-        [["touch"; "/acl_set_file_3"];
-         (* user does not exist *)
-         ["acl_set_file"; "/acl_set_file_3"; "access"; "u::r-x,g::r-x,o::r-x,m::rwx,u:notauser:rw"]]), [];
-      InitScratchFS, Always, TestLastFail (
-        [["touch"; "/acl_set_file_4"];
-         (* cannot set default on a non-directory *)
-         ["acl_set_file"; "/acl_set_file_4"; "default"; "u::r-x,g::r-x,o::r-x"]]), [];
-      InitScratchFS, Always, TestRun (
-        [["mkdir"; "/acl_set_file_5"];
-         ["acl_set_file"; "/acl_set_file_5"; "default"; "u::r-x,g::r-x,o::r-x"]]), [];
+    name = "journal_get_realtime_usec"; added = (1, 27, 18);
+    style = RInt64 "usec", [], [];
+    proc_nr = Some 420;
+    optional = Some "journal";
+    test_excuse = "tests in tests/journal subdirectory";
+    shortdesc = "get the timestamp of the current journal entry";
+    longdesc = "\
+Get the realtime (wallclock) timestamp of the current journal entry." };
+
+  { defaults with
+    name = "statns"; added = (1, 27, 53);
+    style = RStruct ("statbuf", "statns"), [Pathname "path"], [];
+    proc_nr = Some 421;
+    tests = [
+      InitISOFS, Always, TestResult (
+        [["statns"; "/empty"]], "ret->st_size == 0"), []
     ];
-    shortdesc = "set the POSIX ACL attached to a file";
+    shortdesc = "get file information";
     longdesc = "\
-This function sets the POSIX Access Control List (ACL) attached
-to C<path>.
+Returns file information for the given C<path>.
 
-The C<acltype> parameter may be:
+This is the same as the L<stat(2)> system call." };
 
-=over 4
+  { defaults with
+    name = "lstatns"; added = (1, 27, 53);
+    style = RStruct ("statbuf", "statns"), [Pathname "path"], [];
+    proc_nr = Some 422;
+    tests = [
+      InitISOFS, Always, TestResult (
+        [["lstatns"; "/empty"]], "ret->st_size == 0"), []
+    ];
+    shortdesc = "get file information for a symbolic link";
+    longdesc = "\
+Returns file information for the given C<path>.
 
-=item C<access>
+This is the same as C<guestfs_statns> except that if C<path>
+is a symbolic link, then the link is stat-ed, not the file it
+refers to.
 
-Set the ordinary (access) ACL for any file, directory or
-other filesystem object.
+This is the same as the L<lstat(2)> system call." };
 
-=item C<default>
+  { defaults with
+    name = "blockdev_setra"; added = (1, 29, 10);
+    style = RErr, [Device "device"; Int "sectors"], [];
+    proc_nr = Some 424;
+    tests = [
+      InitEmpty, Always, TestRun (
+        [["blockdev_setra"; "/dev/sda"; "1024" ]]), []
+    ];
+    shortdesc = "set readahead";
+    longdesc = "\
+Set readahead (in 512-byte sectors) for the device.
 
-Set the default ACL.  Normally this only makes sense if
-C<path> is a directory.
+This uses the L<blockdev(8)> command." };
 
-=back
+  { defaults with
+    name = "btrfs_subvolume_get_default"; added = (1, 29, 17);
+    style = RInt64 "id", [Mountable_or_Path "fs"], [];
+    proc_nr = Some 425;
+    optional = Some "btrfs"; camel_name = "BTRFSSubvolumeGetDefault";
+    tests = [
+      InitPartition, Always, TestResult (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["btrfs_subvolume_get_default"; "/dev/sda1"]], "ret > 0"), [];
+      InitPartition, Always, TestResult (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mount"; "/dev/sda1"; "/"];
+         ["btrfs_subvolume_get_default"; "/"]], "ret > 0"), []
+    ];
+    shortdesc = "get the default subvolume or snapshot of a filesystem";
+    longdesc = "\
+Get the default subvolume or snapshot of a filesystem mounted at C<mountpoint>." };
 
-The C<acl> parameter is the new ACL in either \"long text form\"
-or \"short text form\" (see L<acl(5)>).  The new ACL completely
-replaces any previous ACL on the file.  The ACL must contain the
-full Unix permissions (eg. C<u::rwx,g::rx,o::rx>).
+  { defaults with
+    name = "btrfs_subvolume_show"; added = (1, 29, 17);
+    style = RHashtable "btrfssubvolumeinfo", [Pathname "subvolume"], [];
+    proc_nr = Some 426;
+    optional = Some "btrfs"; camel_name = "BTRFSSubvolumeShow";
+    tests = [
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mount"; "/dev/sda1"; "/"];
+         ["btrfs_subvolume_create"; "/sub1"; "NOARG"];
+         ["btrfs_subvolume_show"; "/sub1"]]), [];
+      InitPartition, Always, TestLastFail (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mount"; "/dev/sda1"; "/"];
+         ["mkdir"; "/dir1"];
+         ["btrfs_subvolume_show"; "/dir1"]]), [];
+    ];
+    shortdesc = "return detailed information of the subvolume";
+    longdesc = "\
+Return detailed information of the subvolume." };
 
-If you are specifying individual users or groups, then the
-mask field is also required (eg. C<m::rwx>), followed by the
-C<u:I<ID>:...> and/or C<g:I<ID>:...> field(s).  A full ACL
-string might therefore look like this:
+  { defaults with
+    name = "btrfs_quota_enable"; added = (1, 29, 17);
+    style = RErr, [Mountable_or_Path "fs"; Bool "enable"], [];
+    proc_nr = Some 427;
+    optional = Some "btrfs"; camel_name = "BTRFSQuotaEnable";
+    tests = [
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["btrfs_quota_enable"; "/dev/sda1"; "true"]]), [];
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mount"; "/dev/sda1"; "/"];
+         ["btrfs_quota_enable"; "/"; "true"]]), [];
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["btrfs_quota_enable"; "/dev/sda1"; "false"]]), [];
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mount"; "/dev/sda1"; "/"];
+         ["btrfs_quota_enable"; "/"; "false"]]), [];
+    ];
+    shortdesc = "enable or disable subvolume quota support";
+    longdesc = "\
+Enable or disable subvolume quota support for filesystem which contains C<path>." };
 
- u::rwx,g::rwx,o::rwx,m::rwx,u:500:rwx,g:500:rwx
- \\ Unix permissions / \\mask/ \\      ACL        /
+  { defaults with
+    name = "btrfs_quota_rescan"; added = (1, 29, 17);
+    style = RErr, [Mountable_or_Path "fs"], [];
+    proc_nr = Some 428;
+    optional = Some "btrfs"; camel_name = "BTRFSQuotaRescan";
+    tests = [
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["btrfs_quota_enable"; "/dev/sda1"; "true"];
+         ["btrfs_quota_rescan"; "/dev/sda1"]]), [];
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mount"; "/dev/sda1"; "/"];
+         ["btrfs_quota_enable"; "/"; "true"];
+         ["btrfs_quota_rescan"; "/"]]), [];
+    ];
 
-You should use numeric UIDs and GIDs.  To map usernames and
-groupnames to the correct numeric ID in the context of the
-guest, use the Augeas functions (see C<guestfs_aug_init>)." };
+    shortdesc = "trash all qgroup numbers and scan the metadata again with the current config";
+    longdesc = "\
+Trash all qgroup numbers and scan the metadata again with the current config." };
 
   { defaults with
-    name = "acl_delete_def_file"; added = (1, 19, 63);
-    style = RErr, [Pathname "dir"], [];
-    proc_nr = Some 377;
-    optional = Some "acl";
+    name = "btrfs_qgroup_limit"; added = (1, 29, 17);
+    style = RErr, [Pathname "subvolume"; Int64 "size"], [];
+    proc_nr = Some 429;
+    optional = Some "btrfs"; camel_name = "BTRFSQgroupLimit";
     tests = [
-      (* Documentation for libacl says this should fail, but it doesn't.
-       * Therefore disable this test.
-       *)
-      InitScratchFS, Disabled, TestLastFail (
-        [["touch"; "/acl_delete_def_file_0"];
-         ["acl_delete_def_file"; "/acl_delete_def_file_0"]]), [];
-      InitScratchFS, Always, TestRun (
-        [["mkdir"; "/acl_delete_def_file_1"];
-         ["acl_set_file"; "/acl_delete_def_file_1"; "default"; "user::r-x,group::r-x,other::r-x"];
-         ["acl_delete_def_file"; "/acl_delete_def_file_1"]]), [];
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mount"; "/dev/sda1"; "/"];
+         ["btrfs_quota_enable"; "/"; "true"];
+         ["btrfs_qgroup_limit"; "/"; "10737418240"]]), [];
+      InitPartition, Always, TestLastFail (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mount"; "/dev/sda1"; "/"];
+         ["btrfs_quota_enable"; "/"; "false"];
+         ["btrfs_qgroup_limit"; "/"; "10737418240"]]), [];
     ];
-    shortdesc = "delete the default POSIX ACL of a directory";
+    shortdesc = "limit the size of a subvolume";
     longdesc = "\
-This function deletes the default POSIX Access Control List (ACL)
-attached to directory C<dir>." };
+Limit the size of a subvolume which's path is C<subvolume>. C<size>
+can have suffix of G, M, or K. " };
 
   { defaults with
-    name = "cap_get_file"; added = (1, 19, 63);
-    style = RString "cap", [Pathname "path"], [];
-    proc_nr = Some 378;
-    optional = Some "linuxcaps";
-    shortdesc = "get the Linux capabilities attached to a file";
+    name = "btrfs_qgroup_create"; added = (1, 29, 17);
+    style = RErr, [String "qgroupid"; Pathname "subvolume"], [];
+    proc_nr = Some 430;
+    optional = Some "btrfs"; camel_name = "BTRFSQgroupCreate";
+    tests = [
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mount"; "/dev/sda1"; "/"];
+         ["btrfs_quota_enable"; "/"; "true"];
+         ["btrfs_subvolume_create"; "/sub1"; "NOARG"];
+         ["btrfs_qgroup_create"; "0/1000"; "/sub1"]]), [];
+    ];
+    shortdesc = "create a subvolume quota group";
     longdesc = "\
-This function returns the Linux capabilities attached to C<path>.
-The capabilities set is returned in text form (see L<cap_to_text(3)>).
-
-If no capabilities are attached to a file, an empty string is returned." };
+Create a quota group (qgroup) for subvolume at C<subvolume>." };
 
   { defaults with
-    name = "cap_set_file"; added = (1, 19, 63);
-    style = RErr, [Pathname "path"; String "cap"], [];
-    proc_nr = Some 379;
-    optional = Some "linuxcaps";
+    name = "btrfs_qgroup_destroy"; added = (1, 29, 17);
+    style = RErr, [String "qgroupid"; Pathname "subvolume"], [];
+    proc_nr = Some 431;
+    optional = Some "btrfs"; camel_name = "BTRFSQgroupDestroy";
     tests = [
-      InitScratchFS, Always, TestResultString (
-        [["touch"; "/cap_set_file_0"];
-         ["cap_set_file"; "/cap_set_file_0"; "cap_chown=p cap_chown+e"];
-         ["cap_get_file"; "/cap_set_file_0"]], "= cap_chown+ep"), [];
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mount"; "/dev/sda1"; "/"];
+         ["btrfs_quota_enable"; "/"; "true"];
+         ["btrfs_subvolume_create"; "/sub1"; "NOARG"];
+         ["btrfs_qgroup_create"; "0/1000"; "/sub1"];
+         ["btrfs_qgroup_destroy"; "0/1000"; "/sub1"]]), [];
     ];
-    shortdesc = "set the Linux capabilities attached to a file";
+    shortdesc = "destroy a subvolume quota group";
     longdesc = "\
-This function sets the Linux capabilities attached to C<path>.
-The capabilities set C<cap> should be passed in text form
-(see L<cap_from_text(3)>)." };
+Destroy a quota group." };
 
   { defaults with
-    name = "list_ldm_volumes"; added = (1, 20, 0);
-    style = RStringList "devices", [], [];
-    proc_nr = Some 380;
-    optional = Some "ldm";
-    shortdesc = "list all Windows dynamic disk volumes";
+    name = "btrfs_qgroup_show"; added = (1, 29, 17);
+    style = RStructList ("qgroups", "btrfsqgroup"), [Pathname "path"], [];
+    proc_nr = Some 432;
+    tests = [
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mount"; "/dev/sda1"; "/"];
+         ["btrfs_quota_enable"; "/"; "true"];
+         ["btrfs_subvolume_create"; "/sub1"; "NOARG"];
+         ["btrfs_qgroup_create"; "0/1000"; "/sub1"];
+         ["btrfs_qgroup_show"; "/"]]), [];
+    ];
+    optional = Some "btrfs"; camel_name = "BTRFSQgroupShow";
+    shortdesc = "show subvolume quota groups";
     longdesc = "\
-This function returns all Windows dynamic disk volumes
-that were found at launch time.  It returns a list of
-device names." };
+Show all subvolume quota groups in a btrfs filesystem, including their
+usages." };
 
   { defaults with
-    name = "list_ldm_partitions"; added = (1, 20, 0);
-    style = RStringList "devices", [], [];
-    proc_nr = Some 381;
-    optional = Some "ldm";
-    shortdesc = "list all Windows dynamic disk partitions";
+    name = "btrfs_qgroup_assign"; added = (1, 29, 17);
+    style = RErr, [String "src"; String "dst"; Pathname "path"], [];
+    proc_nr = Some 433;
+    optional = Some "btrfs"; camel_name = "BTRFSQgroupAssign";
+    tests = [
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mount"; "/dev/sda1"; "/"];
+         ["btrfs_quota_enable"; "/"; "true"];
+         ["btrfs_qgroup_create"; "0/1000"; "/"];
+         ["btrfs_qgroup_create"; "1/1000"; "/"];
+         ["btrfs_qgroup_assign"; "0/1000"; "1/1000"; "/"]]), [];
+    ];
+    shortdesc = "add a qgroup to a parent qgroup";
     longdesc = "\
-This function returns all Windows dynamic disk partitions
-that were found at launch time.  It returns a list of
-device names." };
+Add qgroup C<src> to parent qgroup C<dst>. This command can group
+several qgroups into a parent qgroup to share common limit." };
 
   { defaults with
-    name = "ldmtool_create_all"; added = (1, 20, 0);
-    style = RErr, [], [];
-    proc_nr = Some 382;
-    optional = Some "ldm";
-    shortdesc = "scan and create Windows dynamic disk volumes";
+    name = "btrfs_qgroup_remove"; added = (1, 29, 17);
+    style = RErr, [String "src"; String "dst"; Pathname "path"], [];
+    proc_nr = Some 434;
+    optional = Some "btrfs"; camel_name = "BTRFSQgroupRemove";
+    tests = [
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mount"; "/dev/sda1"; "/"];
+         ["btrfs_quota_enable"; "/"; "true"];
+         ["btrfs_qgroup_create"; "0/1000"; "/"];
+         ["btrfs_qgroup_create"; "1/1000"; "/"];
+         ["btrfs_qgroup_assign"; "0/1000"; "1/1000"; "/"];
+         ["btrfs_qgroup_remove"; "0/1000"; "1/1000"; "/"]]), [];
+    ];
+    shortdesc = "remove a qgroup from its parent qgroup";
     longdesc = "\
-This function scans all block devices looking for Windows
-dynamic disk volumes and partitions, and creates devices
-for any that were found.
-
-Call C<guestfs_list_ldm_volumes> and C<guestfs_list_ldm_partitions>
-to return all devices.
-
-Note that you B<don't> normally need to call this explicitly,
-since it is done automatically at C<guestfs_launch> time.
-However you might want to call this function if you have
-hotplugged disks or have just created a Windows dynamic disk." };
+Remove qgroup C<src> from the parent qgroup C<dst>." };
 
   { defaults with
-    name = "ldmtool_remove_all"; added = (1, 20, 0);
-    style = RErr, [], [];
-    proc_nr = Some 383;
-    optional = Some "ldm";
-    shortdesc = "remove all Windows dynamic disk volumes";
+    name = "btrfs_scrub_start"; added = (1, 29, 22);
+    style = RErr, [Pathname "path"], [];
+    proc_nr = Some 435;
+    optional = Some "btrfs"; camel_name = "BTRFSScrubStart";
+    tests = [
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mount"; "/dev/sda1"; "/"];
+         ["btrfs_scrub_start"; "/"]]), [];
+    ];
+    shortdesc = "read all data from all disks and verify checksums";
     longdesc = "\
-This is essentially the opposite of C<guestfs_ldmtool_create_all>.
-It removes the device mapper mappings for all Windows dynamic disk
-volumes" };
+Reads all the data and metadata on the filesystem, and uses checksums
+and the duplicate copies from RAID storage to identify and repair any
+corrupt data." };
 
   { defaults with
-    name = "ldmtool_scan"; added = (1, 20, 0);
-    style = RStringList "guids", [], [];
-    proc_nr = Some 384;
-    optional = Some "ldm";
-    shortdesc = "scan for Windows dynamic disks";
+    name = "btrfs_scrub_cancel"; added = (1, 29, 22);
+    style = RErr, [Pathname "path"], [];
+    proc_nr = Some 436;
+    optional = Some "btrfs"; camel_name = "BTRFSScrubCancel";
+    test_excuse = "test disk isn't large enough that btrfs_scrub_start completes before we can cancel it";
+    shortdesc = "cancel a running scrub";
     longdesc = "\
-This function scans for Windows dynamic disks.  It returns a list
-of identifiers (GUIDs) for all disk groups that were found.  These
-identifiers can be passed to other C<guestfs_ldmtool_*> functions.
-
-This function scans all block devices.  To scan a subset of
-block devices, call C<guestfs_ldmtool_scan_devices> instead." };
+Cancel a running scrub on a btrfs filesystem." };
 
   { defaults with
-    name = "ldmtool_scan_devices"; added = (1, 20, 0);
-    style = RStringList "guids", [DeviceList "devices"], [];
-    proc_nr = Some 385;
-    optional = Some "ldm";
-    shortdesc = "scan for Windows dynamic disks";
+    name = "btrfs_scrub_resume"; added = (1, 29, 22);
+    style = RErr, [Pathname "path"], [];
+    proc_nr = Some 437;
+    optional = Some "btrfs"; camel_name = "BTRFSScrubResume";
+    test_excuse = "test disk isn't large enough that btrfs_scrub_start completes before we can cancel and resume it";
+    shortdesc = "resume a previously canceled or interrupted scrub";
     longdesc = "\
-This function scans for Windows dynamic disks.  It returns a list
-of identifiers (GUIDs) for all disk groups that were found.  These
-identifiers can be passed to other C<guestfs_ldmtool_*> functions.
-
-The parameter C<devices> is a list of block devices which are
-scanned.  If this list is empty, all block devices are scanned." };
+Resume a previously canceled or interrupted scrub on a btrfs filesystem." };
 
-  { defaults with
-    name = "ldmtool_diskgroup_name"; added = (1, 20, 0);
-    style = RString "name", [String "diskgroup"], [];
-    proc_nr = Some 386;
-    optional = Some "ldm";
-    shortdesc = "return the name of a Windows dynamic disk group";
+{ defaults with
+    name = "btrfs_balance_pause"; added = (1, 29, 22);
+    style = RErr, [Pathname "path"], [];
+    proc_nr = Some 438;
+    optional = Some "btrfs"; camel_name = "BTRFSBalancePause";
+    test_excuse = "test disk isn't large enough to test this thoroughly";
+    shortdesc = "pause a running balance";
     longdesc = "\
-Return the name of a Windows dynamic disk group.  The C<diskgroup>
-parameter should be the GUID of a disk group, one element from
-the list returned by C<guestfs_ldmtool_scan>." };
+Pause a running balance on a btrfs filesystem." };
 
-  { defaults with
-    name = "ldmtool_diskgroup_volumes"; added = (1, 20, 0);
-    style = RStringList "volumes", [String "diskgroup"], [];
-    proc_nr = Some 387;
-    optional = Some "ldm";
-    shortdesc = "return the volumes in a Windows dynamic disk group";
+{ defaults with
+    name = "btrfs_balance_cancel"; added = (1, 29, 22);
+    style = RErr, [Pathname "path"], [];
+    proc_nr = Some 439;
+    optional = Some "btrfs"; camel_name = "BTRFSBalanceCancel";
+    test_excuse = "test disk isn't large enough that btrfs_balance completes before we can cancel it";
+    shortdesc = "cancel a running or paused balance";
     longdesc = "\
-Return the volumes in a Windows dynamic disk group.  The C<diskgroup>
-parameter should be the GUID of a disk group, one element from
-the list returned by C<guestfs_ldmtool_scan>." };
+Cancel a running balance on a btrfs filesystem." };
 
-  { defaults with
-    name = "ldmtool_diskgroup_disks"; added = (1, 20, 0);
-    style = RStringList "disks", [String "diskgroup"], [];
-    proc_nr = Some 388;
-    optional = Some "ldm";
-    shortdesc = "return the disks in a Windows dynamic disk group";
+{ defaults with
+    name = "btrfs_balance_resume"; added = (1, 29, 22);
+    style = RErr, [Pathname "path"], [];
+    proc_nr = Some 440;
+    optional = Some "btrfs"; camel_name = "BTRFSBalanceResume";
+    test_excuse = "test disk isn't large enough that btrfs_balance completes before we can pause and resume it";
+    shortdesc = "resume a paused balance";
     longdesc = "\
-Return the disks in a Windows dynamic disk group.  The C<diskgroup>
-parameter should be the GUID of a disk group, one element from
-the list returned by C<guestfs_ldmtool_scan>." };
+Resume a paused balance on a btrfs filesystem." };
 
   { defaults with
-    name = "ldmtool_volume_type"; added = (1, 20, 0);
-    style = RString "voltype", [String "diskgroup"; String "volume"], [];
-    proc_nr = Some 389;
-    optional = Some "ldm";
-    shortdesc = "return the type of a Windows dynamic disk volume";
+    name = "btrfs_filesystem_defragment"; added = (1, 29, 22);
+    style = RErr, [Pathname "path"], [OBool "flush"; OString "compress"];
+    proc_nr = Some 443;
+    optional = Some "btrfs"; camel_name = "BTRFSFilesystemDefragment";
+    tests = [
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mount"; "/dev/sda1"; "/"];
+         ["btrfs_filesystem_defragment"; "/"; "true"; "lzo"]]), [];
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mount"; "/dev/sda1"; "/"];
+         ["touch"; "/hello"];
+         ["btrfs_filesystem_defragment"; "/hello"; ""; "zlib"]]), [];
+    ];
+    shortdesc = "defragment a file or directory";
     longdesc = "\
-Return the type of the volume named C<volume> in the disk
-group with GUID C<diskgroup>.
-
-Possible volume types that can be returned here include:
-C<simple>, C<spanned>, C<striped>, C<mirrored>, C<raid5>.
-Other types may also be returned." };
+Defragment a file or directory on a btrfs filesystem. compress is one of zlib or lzo." };
 
   { defaults with
-    name = "ldmtool_volume_hint"; added = (1, 20, 0);
-    style = RString "hint", [String "diskgroup"; String "volume"], [];
-    proc_nr = Some 390;
-    optional = Some "ldm";
-    shortdesc = "return the hint field of a Windows dynamic disk volume";
+    name = "btrfs_rescue_chunk_recover"; added = (1, 29, 22);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 444;
+    optional = Some "btrfs"; camel_name = "BTRFSRescueChunkRecover";
+    tests = [
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["btrfs_rescue_chunk_recover"; "/dev/sda1"]]), [];
+    ];
+    shortdesc = "recover the chunk tree of btrfs filesystem";
     longdesc = "\
-Return the hint field of the volume named C<volume> in the disk
-group with GUID C<diskgroup>.  This may not be defined, in which
-case the empty string is returned.  The hint field is often, though
-not always, the name of a Windows drive, eg. C<E:>." };
+Recover the chunk tree of btrfs filesystem by scanning the devices one by one." };
 
   { defaults with
-    name = "ldmtool_volume_partitions"; added = (1, 20, 0);
-    style = RStringList "partitions", [String "diskgroup"; String "volume"], [];
-    proc_nr = Some 391;
-    optional = Some "ldm";
-    shortdesc = "return the partitions in a Windows dynamic disk volume";
+    name = "btrfs_rescue_super_recover"; added = (1, 29, 22);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 445;
+    optional = Some "btrfs"; camel_name = "BTRFSRescueSuperRecover";
+    tests = [
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["btrfs_rescue_super_recover"; "/dev/sda1"]]), [];
+    ];
+    shortdesc = "recover bad superblocks from good copies";
     longdesc = "\
-Return the list of partitions in the volume named C<volume> in the disk
-group with GUID C<diskgroup>." };
+Recover bad superblocks from good copies." };
 
   { defaults with
-    name = "part_set_gpt_type"; added = (1, 21, 1);
+    name = "part_set_gpt_guid"; added = (1, 29, 25);
     style = RErr, [Device "device"; Int "partnum"; GUID "guid"], [];
-    proc_nr = Some 392;
+    proc_nr = Some 446;
     optional = Some "gdisk";
     tests = [
       InitGPT, Always, TestLastFail (
-        [["part_set_gpt_type"; "/dev/sda"; "1"; "f"]]), [];
+        [["part_set_gpt_guid"; "/dev/sda"; "1"; "f"]]), [];
       InitGPT, Always, TestResultString (
-        [["part_set_gpt_type"; "/dev/sda"; "1";
+        [["part_set_gpt_guid"; "/dev/sda"; "1";
           "01234567-89AB-CDEF-0123-456789ABCDEF"];
-         ["part_get_gpt_type"; "/dev/sda"; "1"]],
+         ["part_get_gpt_guid"; "/dev/sda"; "1"]],
         "01234567-89AB-CDEF-0123-456789ABCDEF"), [];
     ];
-    shortdesc = "set the type GUID of a GPT partition";
+    shortdesc = "set the GUID of a GPT partition";
     longdesc = "\
-Set the type GUID of numbered GPT partition C<partnum> to C<guid>. Return an
+Set the GUID of numbered GPT partition C<partnum> to C<guid>.  Return an
 error if the partition table of C<device> isn't GPT, or if C<guid> is not a
-valid GUID.
-
-See L<http://en.wikipedia.org/wiki/GUID_Partition_Table#Partition_type_GUIDs>
-for a useful list of type GUIDs." };
+valid GUID." };
 
   { defaults with
-    name = "part_get_gpt_type"; added = (1, 21, 1);
+    name = "part_get_gpt_guid"; added = (1, 29, 25);
     style = RString "guid", [Device "device"; Int "partnum"], [];
-    proc_nr = Some 393;
+    proc_nr = Some 447;
     optional = Some "gdisk";
     tests = [
       InitGPT, Always, TestResultString (
-        [["part_set_gpt_type"; "/dev/sda"; "1";
+        [["part_set_gpt_guid"; "/dev/sda"; "1";
           "01234567-89AB-CDEF-0123-456789ABCDEF"];
-         ["part_get_gpt_type"; "/dev/sda"; "1"]],
+         ["part_get_gpt_guid"; "/dev/sda"; "1"]],
         "01234567-89AB-CDEF-0123-456789ABCDEF"), [];
     ];
-    shortdesc = "get the type GUID of a GPT partition";
+    shortdesc = "get the GUID of a GPT partition";
+    longdesc = "\
+Return the GUID of numbered GPT partition C<partnum>." };
+
+{ defaults with
+    name = "btrfs_balance_status"; added = (1, 29, 26);
+    style = RStruct ("status", "btrfsbalance"), [Pathname "path"], [];
+    proc_nr = Some 448;
+    optional = Some "btrfs"; camel_name = "BTRFSBalanceStatus";
+    test_excuse = "test disk isn't large enough that btrfs_balance completes before we can get its status";
+    shortdesc = "show the status of a running or paused balance";
     longdesc = "\
-Return the type GUID of numbered GPT partition C<partnum>. For MBR partitions,
-return an appropriate GUID corresponding to the MBR type. Behaviour is undefined
-for other partition types." };
+Show the status of a running or paused balance on a btrfs filesystem." };
 
   { defaults with
-    name = "rename"; added = (1, 21, 5);
-    style = RErr, [Pathname "oldpath"; Pathname "newpath"], [];
-    proc_nr = Some 394;
+    name = "btrfs_scrub_status"; added = (1, 29, 26);
+    style = RStruct ("status", "btrfsscrub"), [Pathname "path"], [];
+    proc_nr = Some 449;
+    optional = Some "btrfs"; camel_name = "BTRFSScrubStatus";
     tests = [
-      InitScratchFS, Always, TestResultFalse (
-        [["mkdir"; "/rename"];
-         ["write"; "/rename/old"; "file content"];
-         ["rename"; "/rename/old"; "/rename/new"];
-         ["is_file"; "/rename/old"; ""]]), []
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mount"; "/dev/sda1"; "/"];
+         ["btrfs_scrub_start"; "/"];
+         ["btrfs_scrub_status"; "/"]]), [];
     ];
-    shortdesc = "rename a file on the same filesystem";
+    shortdesc = "show status of running or finished scrub";
     longdesc = "\
-Rename a file to a new place on the same filesystem.  This is
-the same as the Linux L<rename(2)> system call.  In most cases
-you are better to use C<guestfs_mv> instead." };
+Show status of running or finished scrub on a btrfs filesystem." };
 
   { defaults with
-    name = "is_whole_device"; added = (1, 21, 9);
-    style = RBool "flag", [Device "device"], [];
-    proc_nr = Some 395;
+    name = "btrfstune_seeding"; added = (1, 29, 29);
+    style = RErr, [Device "device"; Bool "seeding"], [];
+    proc_nr = Some 450;
+    optional = Some "btrfs"; camel_name = "BTRFSTuneSeeding";
     tests = [
-      InitEmpty, Always, TestResultTrue (
-        [["is_whole_device"; "/dev/sda"]]), [];
-      InitPartition, Always, TestResultFalse (
-        [["is_whole_device"; "/dev/sda1"]]), [];
-      InitBasicFSonLVM, Always, TestResultFalse (
-        [["is_whole_device"; "/dev/VG/LV"]]), [];
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["btrfstune_seeding"; "/dev/sda1"; "true"];
+         ["btrfstune_seeding"; "/dev/sda1"; "false"]]), []
     ];
-    shortdesc = "test if a device is a whole device";
-    longdesc = "\
-This returns C<true> if and only if C<device> refers to a whole block
-device. That is, not a partition or a logical device." };
 
-  { defaults with
-    name = "internal_parse_mountable"; added = (1, 21, 11);
-    style = RStruct ("mountable", "internal_mountable"), [Mountable "mountable"], [];
-    visibility = VInternal;
-    proc_nr = Some 396;
-    shortdesc = "parse a mountable string";
+    shortdesc = "enable or disable seeding of a btrfs device";
     longdesc = "\
-Parse a mountable string." };
+Enable seeding of a btrfs device, this will force a fs readonly
+so that you can use it to build other filesystems." };
 
   { defaults with
-    name = "internal_rhbz914931"; added = (1, 21, 14);
-    style = RErr, [FileIn "filename"; Int "count"], [];
-    proc_nr = Some 397;
-    visibility = VInternal;
-    cancellable = true;
-    shortdesc = "used only to test rhbz914931 (internal use only)";
-    longdesc = "\
-This is only used to debug RHBZ#914931.  Note that this
-deliberately crashes guestfsd." };
+    name = "btrfstune_enable_extended_inode_refs"; added = (1, 29, 29);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 451;
+    optional = Some "btrfs"; camel_name = "BTRFSTuneEnableExtendedInodeRefs";
+    tests = [
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["btrfstune_enable_extended_inode_refs"; "/dev/sda1"]]), []
+    ];
 
-  { defaults with
-    name = "syslinux"; added = (1, 21, 27);
-    style = RErr, [Device "device"], [OString "directory"];
-    proc_nr = Some 399;
-    optional = Some "syslinux";
-    shortdesc = "install the SYSLINUX bootloader";
+    shortdesc = "enable extended inode refs";
     longdesc = "\
-Install the SYSLINUX bootloader on C<device>.
-
-The device parameter must be either a whole disk formatted
-as a FAT filesystem, or a partition formatted as a FAT filesystem.
-In the latter case, the partition should be marked as \"active\"
-(C<guestfs_part_set_bootable>) and a Master Boot Record must be
-installed (eg. using C<guestfs_pwrite_device>) on the first
-sector of the whole disk.
-The SYSLINUX package comes with some suitable Master Boot Records.
-See the L<syslinux(1)> man page for further information.
-
-The optional arguments are:
-
-=over 4
-
-=item F<directory>
-
-Install SYSLINUX in the named subdirectory, instead of in the
-root directory of the FAT filesystem.
-
-=back
-
-Additional configuration can be supplied to SYSLINUX by
-placing a file called F<syslinux.cfg> on the FAT filesystem,
-either in the root directory, or under F<directory> if that
-optional argument is being used.  For further information
-about the contents of this file, see L<syslinux(1)>.
-
-See also C<guestfs_extlinux>." };
+This will Enable extended inode refs." };
 
   { defaults with
-    name = "extlinux"; added = (1, 21, 27);
-    style = RErr, [Pathname "directory"], [];
-    proc_nr = Some 400;
-    optional = Some "extlinux";
-    shortdesc = "install the SYSLINUX bootloader on an ext2/3/4 or btrfs filesystem";
-    longdesc = "\
-Install the SYSLINUX bootloader on the device mounted at F<directory>.
-Unlike C<guestfs_syslinux> which requires a FAT filesystem, this can
-be used on an ext2/3/4 or btrfs filesystem.
-
-The F<directory> parameter can be either a mountpoint, or a
-directory within the mountpoint.
+    name = "btrfstune_enable_skinny_metadata_extent_refs"; added = (1, 29, 29);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 452;
+    optional = Some "btrfs"; camel_name = "BTRFSTuneEnableSkinnyMetadataExtentRefs";
+    tests = [
+      InitPartition, Always, TestRun (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["btrfstune_enable_skinny_metadata_extent_refs"; "/dev/sda1"]]), []
+    ];
 
-You also have to mark the partition as \"active\"
-(C<guestfs_part_set_bootable>) and a Master Boot Record must
-be installed (eg. using C<guestfs_pwrite_device>) on the first
-sector of the whole disk.
-The SYSLINUX package comes with some suitable Master Boot Records.
-See the L<extlinux(1)> man page for further information.
+    shortdesc = "enable skinny metadata extent refs";
+    longdesc = "\
+This enable skinny metadata extent refs." };
 
-Additional configuration can be supplied to SYSLINUX by
-placing a file called F<extlinux.conf> on the filesystem
-under F<directory>.  For further information
-about the contents of this file, see L<extlinux(1)>.
+  { defaults with
+    name = "btrfs_image"; added = (1, 29, 32);
+    style = RErr, [DeviceList "source"; Pathname "image"], [OInt "compresslevel"];
+    proc_nr = Some 453;
+    optional = Some "btrfs"; camel_name = "BTRFSImage";
+    tests = [
+      InitEmpty, Always, TestRun (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "p"; "64"; "2047999"];
+         ["part_add"; "/dev/sda"; "p"; "2048000"; "4095999"];
+         ["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mkfs_btrfs"; "/dev/sda2"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["mount"; "/dev/sda1"; "/"];
+         ["btrfs_image"; "/dev/sda2"; "/1.img"; ""];
+         ["btrfs_image"; "/dev/sda2"; "/2.img"; "2"]]), []
+    ];
 
-See also C<guestfs_syslinux>." };
+    shortdesc = "create an image of a btrfs filesystem";
+    longdesc = "\
+This is used to create an image of a btrfs filesystem.
+All data will be zeroed, but metadata and the like is preserved." };
 
   { defaults with
-    name = "cp_r"; added = (1, 21, 38);
-    style = RErr, [Pathname "src"; Pathname "dest"], [];
-    proc_nr = Some 401;
+    name = "part_get_mbr_part_type"; added = (1, 29, 32);
+    style = RString "partitiontype", [Device "device"; Int "partnum"], [];
+    proc_nr = Some 454;
     tests = [
-      InitScratchFS, Always, TestResultString (
-        [["mkdir"; "/cp_r1"];
-         ["mkdir"; "/cp_r2"];
-         ["write"; "/cp_r1/file"; "file content"];
-         ["cp_r"; "/cp_r1"; "/cp_r2"];
-         ["cat"; "/cp_r2/cp_r1/file"]], "file content"), []
+      InitEmpty, Always, TestResultString (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
+         ["part_add"; "/dev/sda"; "e"; "204800"; "614400"];
+         ["part_add"; "/dev/sda"; "l"; "204864"; "205988"];
+         ["part_get_mbr_part_type"; "/dev/sda"; "5"]], "logical"), [];
+      InitEmpty, Always, TestResultString (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
+         ["part_add"; "/dev/sda"; "e"; "204800"; "614400"];
+         ["part_add"; "/dev/sda"; "l"; "204864"; "205988"];
+         ["part_get_mbr_part_type"; "/dev/sda"; "2"]], "extended"), []
     ];
-    shortdesc = "copy a file or directory recursively";
+
+    shortdesc = "get the MBR partition type";
     longdesc = "\
-This copies a file or directory from C<src> to C<dest>
-recursively using the C<cp -rP> command.
+This returns the partition type of an MBR partition
+numbered C<partnum> on device C<device>.
 
-Most users should use C<guestfs_cp_a> instead.  This command
-is useful when you don't want to preserve permissions, because
-the target filesystem does not support it (primarily when
-writing to DOS FAT filesystems)." };
+It returns C<primary>, C<logical>, or C<extended>." };
 
   { defaults with
-    name = "remount"; added = (1, 23, 2);
-    style = RErr, [Pathname "mountpoint"], [OBool "rw"];
-    proc_nr = Some 402;
-    tests = [
-      InitScratchFS, Always, TestLastFail (
-        [["remount"; "/"; "false"];
-         ["write"; "/remount1"; "data"]]), [];
-      InitScratchFS, Always, TestRun (
-        [["remount"; "/"; "false"];
-         ["remount"; "/"; "true"];
-         ["write"; "/remount2"; "data"]]), []
-    ];
-    shortdesc = "remount a filesystem with different options";
+    name = "btrfs_replace"; added = (1, 29, 48);
+    style = RErr, [Device "srcdev"; Device "targetdev"; Pathname "mntpoint"], [];
+    proc_nr = Some 455;
+    optional = Some "btrfs"; camel_name = "BTRFSReplace";
+    test_excuse = "put the test in 'tests/btrfs' directory";
+    shortdesc = "replace a btrfs managed device with another device";
     longdesc = "\
-This call allows you to change the C<rw> (readonly/read-write)
-flag on an already mounted filesystem at C<mountpoint>,
-converting a readonly filesystem to be read-write, or vice-versa.
+Replace device of a btrfs filesystem. On a live filesystem, duplicate the data
+to the target device which is currently stored on the source device.
+After completion of the operation, the source device is wiped out and
+removed from the filesystem.
 
-Note that at the moment you must supply the \"optional\" C<rw>
-parameter.  In future we may allow other flags to be adjusted." };
+The C<targetdev> needs to be same size or larger than the C<srcdev>. Devices
+which are currently mounted are never allowed to be used as the C<targetdev>." };
 
   { defaults with
-    name = "set_uuid"; added = (1, 23, 10);
-    style = RErr, [Device "device"; String "uuid"], [];
-    proc_nr = Some 403;
-    tests =
-      (let uuid = uuidgen () in [
-        InitBasicFS, Always, TestResultString (
-          [["set_uuid"; "/dev/sda1"; uuid];
-           ["vfs_uuid"; "/dev/sda1"]], uuid), [];
-      ]);
-    shortdesc = "set the filesystem UUID";
+    name = "set_uuid_random"; added = (1, 29, 50);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 456;
+    tests = [
+        InitBasicFS, Always, TestRun (
+            [["set_uuid_random"; "/dev/sda1"]]), [];
+      ];
+    shortdesc = "set a random UUID for the filesystem";
     longdesc = "\
-Set the filesystem UUID on C<device> to C<uuid>.
+Set the filesystem UUID on C<device> to a random UUID.
 If this fails and the errno is ENOTSUP,
 means that there is no support for changing the UUID
 for the type of the specified filesystem.
@@ -12201,1084 +13701,1702 @@ Only some filesystem types support setting UUIDs.
 To read the UUID on a filesystem, call C<guestfs_vfs_uuid>." };
 
   { defaults with
-    name = "journal_open"; added = (1, 23, 11);
-    style = RErr, [Pathname "directory"], [];
-    proc_nr = Some 404;
-    optional = Some "journal";
-    test_excuse = "tests in tests/journal subdirectory";
-    shortdesc = "open the systemd journal";
+    name = "vfs_minimum_size"; added = (1, 31, 18);
+    style = RInt64 "sizeinbytes", [Mountable "mountable"], [];
+    proc_nr = Some 457;
+    tests = [
+      InitBasicFS, Always, TestRun (
+        [["vfs_minimum_size"; "/dev/sda1"]]), [];
+      InitPartition, IfAvailable "ntfsprogs", TestRun(
+        [["mkfs"; "ntfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["vfs_minimum_size"; "/dev/sda1"]]), [];
+      InitPartition, IfAvailable "btrfs", TestRunOrUnsupported (
+        [["mkfs"; "btrfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["mount"; "/dev/sda1"; "/"];
+         ["vfs_minimum_size"; "/dev/sda1"]]), [];
+      InitPartition, IfAvailable "xfs", TestRun (
+        [["mkfs"; "xfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["mount"; "/dev/sda1"; "/"];
+         ["vfs_minimum_size"; "/dev/sda1"]]), [];
+    ];
+    shortdesc = "get minimum filesystem size";
     longdesc = "\
-Open the systemd journal located in F<directory>.  Any previously
-opened journal handle is closed.
+Get the minimum size of filesystem in bytes.
+This is the minimum possible size for filesystem shrinking.
 
-The contents of the journal can be read using C<guestfs_journal_next>
-and C<guestfs_journal_get>.
+If getting minimum size of specified filesystem is not supported,
+this will fail and set errno as ENOTSUP.
 
-After you have finished using the journal, you should close the
-handle by calling C<guestfs_journal_close>." };
+See also L<ntfsresize(8)>, L<resize2fs(8)>, L<btrfs(8)>, L<xfs_info(8)>." };
 
   { defaults with
-    name = "journal_close"; added = (1, 23, 11);
-    style = RErr, [], [];
-    proc_nr = Some 405;
-    optional = Some "journal";
-    test_excuse = "tests in tests/journal subdirectory";
-    shortdesc = "close the systemd journal";
+    name = "internal_feature_available"; added = (1, 31, 25);
+    style = RInt "result", [String "group"], [];
+    proc_nr = Some 458;
+    visibility = VInternal;
+    shortdesc = "test availability of some parts of the API";
     longdesc = "\
-Close the journal handle." };
+This is the internal call which implements C<guestfs_feature_available>." };
 
   { defaults with
-    name = "journal_next"; added = (1, 23, 11);
-    style = RBool "more", [], [];
-    proc_nr = Some 406;
-    optional = Some "journal";
-    test_excuse = "tests in tests/journal subdirectory";
-    shortdesc = "move to the next journal entry";
+    name = "part_set_disk_guid"; added = (1, 33, 2);
+    style = RErr, [Device "device"; GUID "guid"], [];
+    proc_nr = Some 459;
+    optional = Some "gdisk";
+    tests = [
+      InitGPT, Always, TestLastFail (
+        [["part_set_disk_guid"; "/dev/sda"; "f"]]), [];
+      InitGPT, Always, TestResultString (
+        [["part_set_disk_guid"; "/dev/sda";
+          "01234567-89AB-CDEF-0123-456789ABCDEF"];
+         ["part_get_disk_guid"; "/dev/sda"]],
+        "01234567-89AB-CDEF-0123-456789ABCDEF"), [];
+    ];
+    shortdesc = "set the GUID of a GPT-partitioned disk";
     longdesc = "\
-Move to the next journal entry.  You have to call this
-at least once after opening the handle before you are able
-to read data.
-
-The returned boolean tells you if there are any more journal
-records to read.  C<true> means you can read the next record
-(eg. using C<guestfs_journal_get>), and C<false> means you
-have reached the end of the journal." };
+Set the disk identifier (GUID) of a GPT-partitioned C<device> to C<guid>.
+Return an error if the partition table of C<device> isn't GPT,
+or if C<guid> is not a valid GUID." };
 
   { defaults with
-    name = "journal_skip"; added = (1, 23, 11);
-    style = RInt64 "rskip", [Int64 "skip"], [];
-    proc_nr = Some 407;
-    optional = Some "journal";
-    test_excuse = "tests in tests/journal subdirectory";
-    shortdesc = "skip forwards or backwards in the journal";
+    name = "part_get_disk_guid"; added = (1, 33, 2);
+    style = RString "guid", [Device "device"], [];
+    proc_nr = Some 460;
+    optional = Some "gdisk";
+    tests = [
+      InitGPT, Always, TestResultString (
+        [["part_set_disk_guid"; "/dev/sda";
+          "01234567-89AB-CDEF-0123-456789ABCDEF"];
+         ["part_get_disk_guid"; "/dev/sda"]],
+        "01234567-89AB-CDEF-0123-456789ABCDEF"), [];
+    ];
+    shortdesc = "get the GUID of a GPT-partitioned disk";
     longdesc = "\
-Skip forwards (C<skip E<ge> 0>) or backwards (C<skip E<lt> 0>) in the
-journal.
-
-The number of entries actually skipped is returned (note S<C<rskip E<ge> 0>>).
-If this is not the same as the absolute value of the skip parameter
-(C<|skip|>) you passed in then it means you have reached the end or
-the start of the journal." };
+Return the disk identifier (GUID) of a GPT-partitioned C<device>.
+Behaviour is undefined for other partition types." };
 
   { defaults with
-    name = "internal_journal_get"; added = (1, 23, 11);
-    style = RErr, [FileOut "filename"], [];
-    proc_nr = Some 408;
-    visibility = VInternal;
-    optional = Some "journal";
-    test_excuse = "tests in tests/journal subdirectory";
-    shortdesc = "internal journal reading operation";
+    name = "part_set_disk_guid_random"; added = (1, 33, 2);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 461;
+    optional = Some "gdisk";
+    tests = [
+      InitGPT, Always, TestRun (
+        [["part_set_disk_guid_random"; "/dev/sda"]]), [];
+    ];
+    shortdesc = "set the GUID of a GPT-partitioned disk to random value";
     longdesc = "\
-This function is used internally when reading the journal." };
+Set the disk identifier (GUID) of a GPT-partitioned C<device> to
+a randomly generated value.
+Return an error if the partition table of C<device> isn't GPT." };
 
   { defaults with
-    name = "journal_get_data_threshold"; added = (1, 23, 11);
-    style = RInt64 "threshold", [], [];
-    proc_nr = Some 409;
-    optional = Some "journal";
-    test_excuse = "tests in tests/journal subdirectory";
-    shortdesc = "get the data threshold for reading journal entries";
+    name = "part_expand_gpt"; added = (1, 33, 2);
+    style = RErr, [Device "device"], [];
+    proc_nr = Some 462;
+    optional = Some "gdisk";
+    shortdesc = "move backup GPT header to the end of the disk";
     longdesc = "\
-Get the current data threshold for reading journal entries.
-This is a hint to the journal that it may truncate data fields to
-this size when reading them (note also that it may not truncate them).
-If this returns C<0>, then the threshold is unlimited.
+Move backup GPT data structures to the end of the disk.
+This is useful in case of in-place image expand
+since disk space after backup GPT header is not usable.
+This is equivalent to C<sgdisk -e>.
 
-See also C<guestfs_journal_set_data_threshold>." };
+See also L<sgdisk(8)>." };
 
   { defaults with
-    name = "journal_set_data_threshold"; added = (1, 23, 11);
-    style = RErr, [Int64 "threshold"], [];
-    proc_nr = Some 410;
-    optional = Some "journal";
-    test_excuse = "tests in tests/journal subdirectory";
-    shortdesc = "set the data threshold for reading journal entries";
+    name = "ntfscat_i"; added = (1, 33, 14);
+    style = RErr, [Mountable "device"; Int64 "inode"; FileOut "filename"], [];
+    proc_nr = Some 463;
+    progress = true; cancellable = true;
+    shortdesc = "download a file to the local machine given its inode";
     longdesc = "\
-Set the data threshold for reading journal entries.
-This is a hint to the journal that it may truncate data fields to
-this size when reading them (note also that it may not truncate them).
-If you set this to C<0>, then the threshold is unlimited.
-
-See also C<guestfs_journal_get_data_threshold>." };
+Download a file given its inode from a NTFS filesystem and save it as
+F<filename> on the local machine.
 
-  { defaults with
-    name = "aug_setm"; added = (1, 23, 14);
-    style = RInt "nodes", [String "base"; OptString "sub"; String "val"], [];
-    proc_nr = Some 411;
-    tests = [
-      InitBasicFS, Always, TestResultString (
-        [["mkdir"; "/etc"];
-         ["write"; "/etc/passwd"; "root:x:0:0:root:/root:/bin/bash\nbin:x:1:1:bin:/bin:/sbin/nologin\ndaemon:x:2:2:daemon:/sbin:/bin/csh\n"];
-         ["aug_init"; "/"; "0"];
-         ["aug_setm"; "/files/etc/passwd/*"; "shell"; "/sbin/nologin"];
-         ["aug_save"];
-         ["cat"; "/etc/passwd"]], "root:x:0:0:root:/root:/sbin/nologin\nbin:x:1:1:bin:/bin:/sbin/nologin\ndaemon:x:2:2:daemon:/sbin:/sbin/nologin\n"), [["aug_close"]]
-    ];
-    shortdesc = "set multiple Augeas nodes";
-    longdesc = "\
-Change multiple Augeas nodes in a single operation.  C<base> is
-an expression matching multiple nodes.  C<sub> is a path expression
-relative to C<base>.  All nodes matching C<base> are found, and then
-for each node, C<sub> is changed to C<val>.  C<sub> may also be C<NULL>
-in which case the C<base> nodes are modified.
+This allows to download some otherwise inaccessible files such as the ones
+within the C<$Extend> folder.
 
-This returns the number of nodes modified." };
+The filesystem from which to extract the file must be unmounted,
+otherwise the call will fail." };
 
   { defaults with
-    name = "aug_label"; added = (1, 23, 14);
-    style = RString "label", [String "augpath"], [];
-    proc_nr = Some 412;
-    tests = [
-      InitBasicFS, Always, TestResultString (
-        [["mkdir"; "/etc"];
-         ["write"; "/etc/passwd"; "root:x:0:0:root:/root:/bin/bash\nbin:x:1:1:bin:/bin:/sbin/nologin\ndaemon:x:2:2:daemon:/sbin:/bin/csh\n"];
-         ["aug_init"; "/"; "0"];
-         ["aug_label"; "/files/etc/passwd/*[last()]"]], "daemon"), [["aug_close"]]
-    ];
-    shortdesc = "return the label from an Augeas path expression";
+    name = "download_inode"; added = (1, 33, 14);
+    style = RErr, [Mountable "device"; Int64 "inode"; FileOut "filename"], [];
+    proc_nr = Some 464;
+    optional = Some "sleuthkit";
+    progress = true; cancellable = true;
+    shortdesc = "download a file to the local machine given its inode";
     longdesc = "\
-The label (name of the last element) of the Augeas path expression
-C<augpath> is returned.  C<augpath> must match exactly one node, else
-this function returns an error." };
+Download a file given its inode from the disk partition
+(eg. F</dev/sda1>) and save it as F<filename> on the local machine.
 
-  { defaults with
-    name = "internal_upload"; added = (1, 23, 30);
-    style = RErr, [FileIn "filename"; String "tmpname"; Int "mode"], [];
-    proc_nr = Some 413;
-    visibility = VInternal;
-    cancellable = true;
-    shortdesc = "upload a file to the appliance (internal use only)";
-    longdesc = "\
-This function is used internally when setting up the appliance." };
+It is not required to mount the disk to run this command.
 
-  { defaults with
-    name = "internal_exit"; added = (1, 23, 30);
-    style = RErr, [], [];
-    proc_nr = Some 414;
-    (* Really VInternal, but we need to use it from the Perl bindings. XXX *)
-    visibility = VDebug;
-    cancellable = true;
-    shortdesc = "cause the daemon to exit (internal use only)";
-    longdesc = "\
-This function is used internally when testing the appliance." };
+The command is capable of downloading deleted or inaccessible files." };
 
   { defaults with
-    name = "copy_attributes"; added = (1, 25, 21);
-    style = RErr, [Pathname "src"; Pathname "dest"], [OBool "all"; OBool "mode"; OBool "xattributes"; OBool "ownership"];
-    proc_nr = Some 415;
-    shortdesc = "copy the attributes of a path (file/directory) to another";
+    name = "btrfs_filesystem_show"; added = (1, 33, 29);
+    style = RStringList "devices", [Device "device"], [];
+    proc_nr = Some 465;
+    optional = Some "btrfs"; camel_name = "BTRFSFilesystemsShow";
+    tests = [
+      InitScratchFS, Always, TestLastFail (
+        [["btrfs_filesystem_show"; "/dev/sdb"]]), [];
+      InitPartition, Always, TestResult (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["btrfs_filesystem_show"; "/dev/sda1"]],
+         "is_string_list (ret, 1, \"/dev/sda1\")"), [];
+      InitEmpty, Always, TestResult (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "p"; "64"; "2047999"];
+         ["part_add"; "/dev/sda"; "p"; "2048000"; "4095999"];
+         ["mkfs_btrfs"; "/dev/sda1 /dev/sda2"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
+         ["btrfs_filesystem_show"; "/dev/sda1"]],
+         "is_string_list (ret, 2, \"/dev/sda1\", \"/dev/sda2\")"), [];
+    ];
+    shortdesc = "list devices for btrfs filesystem";
     longdesc = "\
-Copy the attributes of a path (which can be a file or a directory)
-to another path.
+Show all the devices where the filesystems in C<device> is spanned over.
 
-By default C<no> attribute is copied, so make sure to specify any
-(or C<all> to copy everything).
+If not all the devices for the filesystems are present, then this function
+fails and the C<errno> is set to C<ENODEV>." };
 
-The optional arguments specify which attributes can be copied:
+  { defaults with
+    name = "internal_filesystem_walk"; added = (1, 33, 39);
+    style = RErr, [Mountable "device"; FileOut "filename"], [];
+    proc_nr = Some 466;
+    visibility = VInternal;
+    optional = Some "libtsk";
+    shortdesc = "walk through the filesystem content";
+    longdesc = "Internal function for filesystem_walk." };
 
-=over 4
+  { defaults with
+    name = "selinux_relabel"; added = (1, 33, 43);
+    style = RErr, [String "specfile"; Pathname "path"], [OBool "force"; OInt64 "since"];
+    proc_nr = Some 467;
+    optional = Some "selinuxrelabel";
+    test_excuse = "tests are in the tests/relabel directory";
+    shortdesc = "relabel parts of the filesystem";
+    longdesc = "\
+SELinux relabel parts of the filesystem.
 
-=item C<mode>
+The C<specfile> parameter controls the policy spec file used.
+You have to parse C</etc/selinux/config> to find the correct
+SELinux policy and then pass the spec file, usually:
+C</etc/selinux/> + I<selinuxtype> + C</contexts/files/file_contexts>.
 
-Copy part of the file mode from C<source> to C<destination>. Only the
-UNIX permissions and the sticky/setuid/setgid bits can be copied.
+The required C<path> parameter is the top level directory where
+relabelling starts.  Normally you should pass C<path> as C</>
+to relabel the whole guest filesystem.
 
-=item C<xattributes>
+The optional C<force> boolean controls whether the context
+is reset for customizable files, and also whether the
+user, role and range parts of the file context is changed.
 
-Copy the Linux extended attributes (xattrs) from C<source> to C<destination>.
-This flag does nothing if the I<linuxxattrs> feature is not available
-(see C<guestfs_feature_available>).
+If the appliance has more than one vCPU (see C<guestfs_set_smp>),
+the relabelling runs in parallel, using threads in L<setfiles(8)>
+if it supports them, else by relabelling each top level
+directory under C<path> separately.
 
-=item C<ownership>
+The optional C<since> parameter makes the relabelling
+incremental: only the files whose inode was changed at or after
+this time (in seconds since the epoch) are relabelled.  This is
+much faster than a full relabel after a small number of
+changes to the guest, but it cannot see files which had the
+wrong label already.  It needs libselinux in the appliance." };
 
-Copy the owner uid and the group gid of C<source> to C<destination>.
+  { defaults with
+    name = "download_blocks"; added = (1, 33, 45);
+    style = RErr, [Mountable "device"; Int64 "start"; Int64 "stop"; FileOut "filename"], [OBool "unallocated"];
+    proc_nr = Some 468;
+    optional = Some "sleuthkit";
+    progress = true; cancellable = true;
+    shortdesc = "download the given data units from the disk";
+    longdesc = "\
+Download the data units from F<start> address
+to F<stop> from the disk partition (eg. F</dev/sda1>)
+and save them as F<filename> on the local machine.
 
-=item C<all>
+The use of this API on sparse disk image formats such as QCOW,
+may result in large zero-filled files downloaded on the host.
 
-Copy B<all> the attributes from C<source> to C<destination>. Enabling it
-enables all the other flags, if they are not specified already.
+The size of a data unit varies across filesystem implementations.
+On NTFS filesystems data units are referred as clusters
+while on ExtX ones they are referred as fragments.
 
-=back" };
+If the optional C<unallocated> flag is true (default is false),
+only the unallocated blocks will be extracted.
+This is useful to detect hidden data or to retrieve deleted files
+which data units have not been overwritten yet." };
 
   { defaults with
-    name = "part_get_name"; added = (1, 25, 33);
-    style = RString "name", [Device "device"; Int "partnum"], [];
-    proc_nr = Some 416;
-    shortdesc = "get partition name";
+    name = "aug_transform"; added = (1, 35, 2);
+    style = RErr, [String "lens"; String "file"], [ OBool "remove"];
+    proc_nr = Some 469;
+    shortdesc = "add/remove an Augeas lens transformation";
     longdesc = "\
-This gets the partition name on partition numbered C<partnum> on
-device C<device>.  Note that partitions are numbered from 1.
+Add an Augeas transformation for the specified C<lens> so it can
+handle C<file>.
 
-The partition name can only be read on certain types of partition
-table.  This works on C<gpt> but not on C<mbr> partitions." };
+If C<remove> is true (C<false> by default), then the transformation
+is removed." };
 
   { defaults with
-    name = "blkdiscard"; added = (1, 25, 44);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 417;
-    optional = Some "blkdiscard";
-    shortdesc = "discard all blocks on a device";
-    longdesc = "\
-This discards all blocks on the block device C<device>, giving
-the free space back to the host.
-
-This operation requires support in libguestfs, the host filesystem,
-qemu and the host kernel.  If this support isn't present it may give
-an error or even appear to run but do nothing.  You must also
-set the C<discard> attribute on the underlying drive (see
-C<guestfs_add_drive_opts>)." };
+    name = "internal_find_inode"; added = (1, 35, 6);
+    style = RErr, [Mountable "device"; Int64 "inode"; FileOut "filename";], [];
+    proc_nr = Some 470;
+    visibility = VInternal;
+    optional = Some "libtsk";
+    shortdesc = "search the entries associated to the given inode";
+    longdesc = "Internal function for find_inode." };
 
   { defaults with
-    name = "blkdiscardzeroes"; added = (1, 25, 44);
-    style = RBool "zeroes", [Device "device"], [];
-    proc_nr = Some 418;
-    optional = Some "blkdiscardzeroes";
-    shortdesc = "return true if discarded blocks are read as zeroes";
+    name = "internal_set_chunk_size"; added = (1, 35, 20);
+    style = RInt "chunksize", [Int "chunksize"], [];
+    proc_nr = Some 471;
+    visibility = VInternal;
+    shortdesc = "negotiate the file transfer chunk size";
     longdesc = "\
-This call returns true if blocks on C<device> that have been
-discarded by a call to C<guestfs_blkdiscard> are returned as
-blocks of zero bytes when read the next time.
-
-If it returns false, then it may be that discarded blocks are
-read as stale or random data." };
+This is called by the library just after launch to ask the daemon
+to use chunks of up to C<chunksize> bytes for C<FileIn> and
+C<FileOut> transfers.  The daemon returns the chunk size it will
+actually use, which may be smaller.  Appliances which do not
+implement this call continue to use the default chunk size." };
 
   { defaults with
-    name = "cpio_out"; added = (1, 27, 9);
-    style = RErr, [String "directory"; FileOut "cpiofile"], [OString "format"];
-    proc_nr = Some 419;
-    cancellable = true;
-    shortdesc = "pack directory into cpio file";
+    name = "internal_set_data_channels"; added = (1, 35, 20);
+    style = RInt "channels", [Int "channels"], [];
+    proc_nr = Some 472;
+    visibility = VInternal;
+    shortdesc = "stripe file transfers across several channels";
     longdesc = "\
-This command packs the contents of F<directory> and downloads
-it to local file C<cpiofile>.
-
-The optional C<format> parameter can be used to select the format.
-Only the following formats are currently permitted:
-
-=over 4
-
-=item C<newc>
-
-New (SVR4) portable format.  This format happens to be compatible
-with the cpio-like format used by the Linux kernel for initramfs.
-
-This is the default format.
-
-=item C<crc>
-
-New (SVR4) portable format with a checksum.
-
-=back" };
+This is called by the library just after launch if the appliance was
+started with extra virtio-serial data channels.  The daemon opens
+channels C<1> to C<channels-1> and from then on stripes C<FileIn>
+and C<FileOut> chunks round-robin across all of them.  It returns the
+number of channels it will actually use, which may be smaller." };
 
   { defaults with
-    name = "journal_get_realtime_usec"; added = (1, 27, 18);
-    style = RInt64 "usec", [], [];
-    proc_nr = Some 420;
-    optional = Some "journal";
-    test_excuse = "tests in tests/journal subdirectory";
-    shortdesc = "get the timestamp of the current journal entry";
+    name = "internal_wait_for_devices"; added = (1, 35, 20);
+    style = RErr, [Int "nr"; Bool "scan"], [];
+    proc_nr = Some 473;
+    visibility = VInternal;
+    shortdesc = "wait for hotplugged drives to appear";
     longdesc = "\
-Get the realtime (wallclock) timestamp of the current journal entry." };
+This is used by the direct backend when the appliance is restored
+from a snapshot and the drives are hotplugged one at a time.  It
+waits until the appliance can see C<nr> devices.  If C<scan> is true
+it then scans for MD devices, LVM and Windows dynamic disks, as the
+appliance would have done at boot." };
 
   { defaults with
-    name = "statns"; added = (1, 27, 53);
-    style = RStruct ("statbuf", "statns"), [Pathname "path"], [];
-    proc_nr = Some 421;
-    tests = [
-      InitISOFS, Always, TestResult (
-        [["statns"; "/empty"]], "ret->st_size == 0"), []
-    ];
-    shortdesc = "get file information";
+    name = "internal_list_packages_raw"; added = (1, 35, 20);
+    style = RStringList "packages", [String "format"], [];
+    proc_nr = Some 474;
+    visibility = VInternal;
+    shortdesc = "list installed packages from the guest package database";
     longdesc = "\
-Returns file information for the given C<path>.
+This is used by C<guestfs_inspect_list_applications2> to read the
+package database of the guest mounted at F</> inside the appliance,
+so that the whole database does not have to be downloaded.
 
-This is the same as the L<stat(2)> system call." };
+C<format> is one of C<rpm>, C<deb>, C<pacman> or C<apk>.  The
+returned list contains seven strings for each package: name, epoch,
+version, release, architecture, URL and description.
+
+If the database is in a format that the appliance cannot read, this
+fails with C<ENOTSUP>." };
 
   { defaults with
-    name = "lstatns"; added = (1, 27, 53);
-    style = RStruct ("statbuf", "statns"), [Pathname "path"], [];
-    proc_nr = Some 422;
-    tests = [
-      InitISOFS, Always, TestResult (
-        [["lstatns"; "/empty"]], "ret->st_size == 0"), []
-    ];
-    shortdesc = "get file information for a symbolic link";
+    name = "internal_probe_paths"; added = (1, 35, 20);
+    style = RBufferOut "flags", [StringList "paths"], [];
+    proc_nr = Some 475;
+    visibility = VInternal;
+    shortdesc = "test the type of many paths at once";
     longdesc = "\
-Returns file information for the given C<path>.
+This is used by inspection to do the equivalent of many
+C<guestfs_exists>, C<guestfs_is_file>, C<guestfs_is_dir> and
+C<guestfs_is_symlink> calls in a single round trip.
 
-This is the same as C<guestfs_statns> except that if C<path>
-is a symbolic link, then the link is stat-ed, not the file it
-refers to.
-
-This is the same as the L<lstat(2)> system call." };
+It returns one byte for each path in C<paths>.  The bits in each
+byte are defined in F<src/guestfs-internal-all.h>." };
 
   { defaults with
-    name = "internal_lstatnslist"; added = (1, 27, 53);
-    style = RStructList ("statbufs", "statns"), [Pathname "path"; FilenameList "names"], [];
-    proc_nr = Some 423;
+    name = "internal_hivex_windows_info"; added = (1, 35, 20);
+    style = RHashtable "info", [OptString "software"; OptString "system"], [];
+    proc_nr = Some 476;
     visibility = VInternal;
-    shortdesc = "lstat on multiple files";
+    optional = Some "hivex";
+    shortdesc = "read the registry values used by Windows inspection";
     longdesc = "\
-This is the internal call which implements C<guestfs_lstatnslist>." };
+This is used by inspection to read the registry values it needs
+from the Windows C<software> and C<system> hives in a single
+round trip, without the library having to drive the
+C<guestfs_hivex_*> calls one value at a time.
+
+Each returned key is the name of a registry value prefixed by
+the name of the key it was found in (C<CurrentVersion>,
+C<Select>, C<MountedDevices> or C<Parameters>).  Each returned
+value is the registry type in decimal, a colon, and the data
+encoded in hexadecimal.  A hive which is null or does not
+exist is silently skipped." };
 
   { defaults with
-    name = "blockdev_setra"; added = (1, 29, 10);
-    style = RErr, [Device "device"; Int "sectors"], [];
-    proc_nr = Some 424;
+    name = "hivex_query"; added = (1, 35, 20);
+    style = RStructList ("values", "hivex_query_value"), [StringList "paths"], [];
+    proc_nr = Some 477;
+    optional = Some "hivex";
     tests = [
-      InitEmpty, Always, TestRun (
-        [["blockdev_setra"; "/dev/sda"; "1024" ]]), []
+      InitScratchFS, Always, TestRun (
+        [["upload"; "$srcdir/../../test-data/files/minimal"; "/hivex_query1"];
+         ["hivex_open"; "/hivex_query1"; ""; ""; "false"];
+         ["hivex_query"; "* */*"]]), [["hivex_close"]]
     ];
-    shortdesc = "set readahead";
+    shortdesc = "return the values of all nodes matching a list of paths";
     longdesc = "\
-Set readahead (in 512-byte sectors) for the device.
+Find every node in the currently open hive whose path matches
+one of the C<paths>, and return all the values of those nodes.
 
-This uses the L<blockdev(8)> command." };
+Each path is a sequence of node names separated by backslashes,
+relative to the root of the hive.  Each name may be a glob
+pattern, matched case insensitively as in L<fnmatch(3)>.  For
+example C<Microsoft\\Windows\\CurrentVersion\\Uninstall\\*>
+matches every child node of the C<Uninstall> node.
 
-  { defaults with
-    name = "btrfs_subvolume_get_default"; added = (1, 29, 17);
-    style = RInt64 "id", [Mountable_or_Path "fs"], [];
-    proc_nr = Some 425;
-    optional = Some "btrfs"; camel_name = "BTRFSSubvolumeGetDefault";
-    tests = [
-      InitPartition, Always, TestResult (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["btrfs_subvolume_get_default"; "/dev/sda1"]], "ret > 0"), [];
-      InitPartition, Always, TestResult (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mount"; "/dev/sda1"; "/"];
-         ["btrfs_subvolume_get_default"; "/"]], "ret > 0"), []
-    ];
-    shortdesc = "get the default subvolume or snapshot of a filesystem";
-    longdesc = "\
-Get the default subvolume or snapshot of a filesystem mounted at C<mountpoint>." };
+For each value found this returns the path of the node that
+contains it (using the real names of the nodes), and the key,
+type and data of the value.  All the values of one node are
+returned together.  Nodes which have no values are not
+returned.
+
+This is equivalent to walking the hive with
+C<guestfs_hivex_node_children> and C<guestfs_hivex_node_values>,
+but it only takes a single round trip to the appliance." };
 
   { defaults with
-    name = "btrfs_subvolume_show"; added = (1, 29, 17);
-    style = RHashtable "btrfssubvolumeinfo", [Pathname "subvolume"], [];
-    proc_nr = Some 426;
-    optional = Some "btrfs"; camel_name = "BTRFSSubvolumeShow";
+    name = "internal_lstatns_tree"; added = (1, 35, 20);
+    style = RErr, [Pathname "path"; Int "depth"; Bool "xattrs"; FileOut "filename"], [];
+    proc_nr = Some 478;
+    visibility = VInternal;
+    shortdesc = "lstat every file in a directory tree";
+    longdesc = "\
+This is the internal call used by C<guestfs_mount_local> to
+prefetch the attributes of a whole subtree, and by the C<visit>
+function of the tools (virt-ls, virt-diff) to walk a tree.
+
+It walks C<path> down to C<depth> levels (C<1> means only the
+entries of C<path> itself) and writes a sequence of XDR-encoded
+records to C<filename>.  Each record starts with a name relative
+to C<path> and a boolean.  If the boolean is true, the record
+marks the start of the listing of that directory (C<\"\"> is
+C<path> itself), and the following records up to the next such
+mark are its entries.  Otherwise the record is an entry, and is
+followed by its C<guestfs_int_statns> as from L<lstat(2)>, the
+target of the link (an empty string if it is not a symbolic
+link) and, if C<xattrs> is true, its C<guestfs_int_xattr_list>
+as from C<guestfs_lgetxattrs>.  Directories which cannot be read
+are skipped.
+
+The entries of each directory are sorted by name, and the
+listings of its subdirectories follow in the same order, so the
+records come in the order of a depth first walk which lists each
+directory before descending into it." };
+
+  { defaults with
+    name = "vfs_statvfs"; added = (1, 35, 20);
+    style = RStruct ("statbuf", "statvfs"), [Mountable "mountable"], [];
+    proc_nr = Some 479;
     tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mount"; "/dev/sda1"; "/"];
-         ["btrfs_subvolume_create"; "/sub1"; "NOARG"];
-         ["btrfs_subvolume_show"; "/sub1"]]), [];
-      InitPartition, Always, TestLastFail (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mount"; "/dev/sda1"; "/"];
-         ["mkdir"; "/dir1"];
-         ["btrfs_subvolume_show"; "/dir1"]]), [];
+      InitBasicFS, Always, TestResult (
+        [["vfs_statvfs"; "/dev/sda1"]], "ret->namemax == 255"), [];
+      InitPartition, IfAvailable "xfs", TestResult (
+        [["mkfs"; "xfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["vfs_statvfs"; "/dev/sda1"]], "ret->blocks > 0"), []
     ];
-    shortdesc = "return detailed information of the subvolume";
+    shortdesc = "get filesystem statistics without mounting";
     longdesc = "\
-Return detailed information of the subvolume." };
+Return the same filesystem statistics as C<guestfs_statvfs>,
+but read from the superblock of the filesystem on C<mountable>
+instead of from a mounted filesystem.  The filesystem does not
+need to be mounted, and is not changed.
 
-  { defaults with
-    name = "btrfs_quota_enable"; added = (1, 29, 17);
-    style = RErr, [Mountable_or_Path "fs"; Bool "enable"], [];
-    proc_nr = Some 427;
-    optional = Some "btrfs"; camel_name = "BTRFSQuotaEnable";
-    tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["btrfs_quota_enable"; "/dev/sda1"; "true"]]), [];
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mount"; "/dev/sda1"; "/"];
-         ["btrfs_quota_enable"; "/"; "true"]]), [];
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["btrfs_quota_enable"; "/dev/sda1"; "false"]]), [];
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mount"; "/dev/sda1"; "/"];
-         ["btrfs_quota_enable"; "/"; "false"]]), [];
-    ];
-    shortdesc = "enable or disable subvolume quota support";
+This is supported for ext2/3/4 and XFS.  For other filesystems
+it fails and sets errno to C<ENOTSUP>, in which case you can
+mount the filesystem and call C<guestfs_statvfs>.
+
+Since the journal is not replayed, the numbers may be slightly
+out of date, for example on the disk of a running guest.  The
+C<fsid> and C<flag> fields are set to C<-1> when they are not
+known." };
+
+  { defaults with
+    name = "internal_checksums_out"; added = (1, 35, 20);
+    style = RErr, [String "csumtype"; StringList "paths"; FileOut "sumsfile"], [];
+    proc_nr = Some 480;
+    visibility = VInternal;
+    cancellable = true;
+    shortdesc = "compute the checksums of a list of files";
     longdesc = "\
-Enable or disable subvolume quota support for filesystem which contains C<path>." };
+This is the internal call used by L<virt-diff(1)> to compute the
+checksums of many files in one call.
+
+It computes the checksum of type C<csumtype> (as for
+C<guestfs_checksum>) of each of the absolute C<paths>, and writes
+to C<sumsfile> one line containing the checksum for each path, in
+the same order.  If the checksum of a file cannot be computed, its
+line is empty." };
 
   { defaults with
-    name = "btrfs_quota_rescan"; added = (1, 29, 17);
-    style = RErr, [Mountable_or_Path "fs"], [];
-    proc_nr = Some 428;
-    optional = Some "btrfs"; camel_name = "BTRFSQuotaRescan";
+    name = "checksum_device_tree"; added = (1, 35, 20);
+    style = RString "checksum", [String "csumtype"; Device "device"], [OInt64 "blocksize"];
+    proc_nr = Some 481;
+    progress = true;
     tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["btrfs_quota_enable"; "/dev/sda1"; "true"];
-         ["btrfs_quota_rescan"; "/dev/sda1"]]), [];
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mount"; "/dev/sda1"; "/"];
-         ["btrfs_quota_enable"; "/"; "true"];
-         ["btrfs_quota_rescan"; "/"]]), [];
+      InitISOFS, Always, TestResult (
+        [["checksum_device_tree"; "sha256"; "/dev/sdd"; ""]],
+        "strlen (ret) == 64"), []
     ];
+    shortdesc = "compute a tree checksum of the contents of a device";
+    longdesc = "\
+This call splits the device C<device> into blocks of
+C<blocksize> bytes (default 1 MiB, which must be a multiple
+of 512) and computes the checksum of type C<csumtype> of each
+block.  It returns the checksum of the concatenated binary
+block checksums, in order, as a hex string.  The last block may
+be shorter than C<blocksize>.
 
-    shortdesc = "trash all qgroup numbers and scan the metadata again with the current config";
+The blocks are checksummed in parallel, using as many threads
+as the appliance has vCPUs (see C<guestfs_set_smp>), so this is
+much faster than C<guestfs_checksum_device> on a large device.
+The result is not the same as the checksum of the whole device,
+and depends on C<blocksize>.
+
+C<csumtype> can be any of the types supported by
+C<guestfs_checksum>, except C<crc>.
+
+To find which blocks differ between two devices, use
+C<guestfs_checksum_device_blocks>." };
+
+  { defaults with
+    name = "checksum_device_blocks"; added = (1, 35, 20);
+    style = RErr, [String "csumtype"; Device "device"; FileOut "sumsfile"], [OInt64 "blocksize"];
+    proc_nr = Some 482;
+    progress = true;
+    cancellable = true;
+    shortdesc = "compute the checksum of each block of a device";
     longdesc = "\
-Trash all qgroup numbers and scan the metadata again with the current config." };
+This computes the checksum of each block of C<device> in the
+same way as C<guestfs_checksum_device_tree>, and writes them to
+the local output file C<sumsfile>, one hex checksum per line,
+in block order.  Line I<n> (counting from 0) is the checksum
+of the bytes from I<n> * C<blocksize> up to the end of that
+block.
+
+Comparing the output for two snapshots of a device shows which
+regions have changed.  The tree checksum returned by
+C<guestfs_checksum_device_tree> is the checksum of these block
+checksums in binary form." };
 
   { defaults with
-    name = "btrfs_qgroup_limit"; added = (1, 29, 17);
-    style = RErr, [Pathname "subvolume"; Int64 "size"], [];
-    proc_nr = Some 429;
-    optional = Some "btrfs"; camel_name = "BTRFSQgroupLimit";
-    tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mount"; "/dev/sda1"; "/"];
-         ["btrfs_quota_enable"; "/"; "true"];
-         ["btrfs_qgroup_limit"; "/"; "10737418240"]]), [];
-      InitPartition, Always, TestLastFail (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mount"; "/dev/sda1"; "/"];
-         ["btrfs_quota_enable"; "/"; "false"];
-         ["btrfs_qgroup_limit"; "/"; "10737418240"]]), [];
-    ];
-    shortdesc = "limit the size of a subvolume";
+    name = "internal_changed_ranges"; added = (1, 35, 20);
+    style = RStructList ("ranges", "blockrange"), [Device "device1"; Device "device2"; Int64 "blocksize"; StringList "zeroes"], [];
+    proc_nr = Some 483;
+    visibility = VInternal;
+    progress = true;
+    shortdesc = "list the ranges which differ between two devices";
     longdesc = "\
-Limit the size of a subvolume which's path is C<subvolume>. C<size>
-can have suffix of G, M, or K. " };
+This is the internal call used by C<guestfs_device_changed_ranges>.
+Each of C<zeroes> is a string C<\"offset length\"> giving a range
+which reads as zeroes in both devices." };
 
   { defaults with
-    name = "btrfs_qgroup_create"; added = (1, 29, 17);
-    style = RErr, [String "qgroupid"; Pathname "subvolume"], [];
-    proc_nr = Some 430;
-    optional = Some "btrfs"; camel_name = "BTRFSQgroupCreate";
+    name = "internal_changed_ranges_sums"; added = (1, 35, 20);
+    style = RStructList ("ranges", "blockrange"), [String "csumtype"; Device "device"; FileIn "sumsfile"; Int64 "blocksize"; StringList "zeroes"], [];
+    proc_nr = Some 484;
+    visibility = VInternal;
+    progress = true; cancellable = true;
+    shortdesc = "list the ranges of a device which differ from block checksums";
+    longdesc = "\
+This is the internal call used by
+C<guestfs_device_changed_ranges_sums>.  Each of C<zeroes> is a
+string C<\"offset length\"> giving a range which reads as zeroes
+in C<device>." };
+
+  { defaults with
+    name = "grep_out"; added = (1, 35, 20);
+    style = RErr, [String "regex"; Pathname "path"; FileOut "output"], [OBool "extended"; OBool "fixed"; OBool "insensitive"];
+    proc_nr = Some 485;
+    cancellable = true;
+    shortdesc = "search the files in a directory and download the matching lines";
+    longdesc = "\
+This searches every regular file in F<path> and the directories
+below it for lines matching C<regex>, and writes the matching
+lines to the local file C<output>, in the format
+C<filename:line> as printed by S<C<grep -r>>.  If C<path> is a
+single file, only that file is searched.
+
+Unlike C<guestfs_grep>, the matching lines are not returned as a
+list, so there is no limit on how many lines can be found (see
+L<guestfs(3)/PROTOCOL LIMITS>).  The files are searched in
+parallel, using as many threads as the appliance has vCPUs (see
+C<guestfs_set_smp>), and the lines of each file are written
+together, in the order the files are found.
+
+The optional flags are the same as for C<guestfs_grep>.
+Symbolic links below F<path> are not followed.  Files
+containing a NUL byte are treated as binary and are not
+searched, as S<C<grep -I>> does, and compressed files are not
+uncompressed.  Files which cannot be read are skipped." };
+
+  { defaults with
+    name = "blkid_all"; added = (1, 35, 20);
+    style = RStructList ("tags", "blkid_tag"), [], [];
+    proc_nr = Some 486;
     tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mount"; "/dev/sda1"; "/"];
-         ["btrfs_quota_enable"; "/"; "true"];
-         ["btrfs_subvolume_create"; "/sub1"; "NOARG"];
-         ["btrfs_qgroup_create"; "0/1000"; "/sub1"]]), [];
+      InitBasicFS, Always, TestRun (
+        [["blkid_all"]]), []
     ];
-    shortdesc = "create a subvolume quota group";
+    shortdesc = "print the block device attributes of all devices";
     longdesc = "\
-Create a quota group (qgroup) for subvolume at C<subvolume>." };
+This returns the attributes found by C<guestfs_blkid> for all
+the devices, partitions, md devices, logical volumes and
+device mapper devices in one call.  Each attribute is returned
+as a C<bt_device>, C<bt_name> and C<bt_value> triple, and the
+attributes of each device are together.
+
+Devices which contain more than one filesystem signature are
+left out.  Use C<guestfs_blkid> or C<guestfs_wipefs> on them.
+
+The results are cached in the appliance, so calling this
+before C<guestfs_vfs_type>, C<guestfs_vfs_label> and
+C<guestfs_vfs_uuid> on many devices avoids reading each device
+several times.  The cached results for a device are dropped
+when the device is written to." };
 
   { defaults with
-    name = "btrfs_qgroup_destroy"; added = (1, 29, 17);
-    style = RErr, [String "qgroupid"; Pathname "subvolume"], [];
-    proc_nr = Some 431;
-    optional = Some "btrfs"; camel_name = "BTRFSQgroupDestroy";
+    name = "lvm_report"; added = (1, 35, 20);
+    style = RStructList ("objects", "lvm_object"), [], [];
+    proc_nr = Some 487;
+    optional = Some "lvm2";
     tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mount"; "/dev/sda1"; "/"];
-         ["btrfs_quota_enable"; "/"; "true"];
-         ["btrfs_subvolume_create"; "/sub1"; "NOARG"];
-         ["btrfs_qgroup_create"; "0/1000"; "/sub1"];
-         ["btrfs_qgroup_destroy"; "0/1000"; "/sub1"]]), [];
+      InitBasicFSonLVM, Always, TestRun (
+        [["lvm_report"]]), []
     ];
-    shortdesc = "destroy a subvolume quota group";
+    shortdesc = "list all LVM physical volumes, volume groups and logical volumes";
     longdesc = "\
-Destroy a quota group." };
+This returns every LVM physical volume (PV), volume group (VG)
+and logical volume (LV) found, using a single L<lvm(8)> report.
+It is much faster than calling C<guestfs_pvs>, C<guestfs_vgs>,
+C<guestfs_lvs> and the UUID calls separately.
+
+For each object, C<lo_type> is C<pv>, C<vg> or C<lv>.  C<lo_name>
+is the device name for PVs and LVs and the name of the VG for
+VGs.  C<lo_size> and C<lo_free> are in bytes (C<lo_free> is
+always 0 for LVs).  C<lo_vg_name> and C<lo_vg_uuid> are the VG
+which the object belongs to, or empty strings for PVs which are
+not in any VG.  The objects of each VG are returned together,
+with the VG first.
+
+As with C<guestfs_lvs>, internal LVs such as thin pools are
+not returned.
+
+This needs LVM2 E<ge> 2.02.158." };
 
   { defaults with
-    name = "btrfs_qgroup_show"; added = (1, 29, 17);
-    style = RStructList ("qgroups", "btrfsqgroup"), [Pathname "path"], [];
-    proc_nr = Some 432;
+    name = "file_extents"; added = (1, 35, 20);
+    style = RStructList ("extents", "file_extent"), [Pathname "path"], [];
+    proc_nr = Some 488;
     tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mount"; "/dev/sda1"; "/"];
-         ["btrfs_quota_enable"; "/"; "true"];
-         ["btrfs_subvolume_create"; "/sub1"; "NOARG"];
-         ["btrfs_qgroup_create"; "0/1000"; "/sub1"];
-         ["btrfs_qgroup_show"; "/"]]), [];
+      InitScratchFS, Always, TestRun (
+        [["fallocate64"; "/file_extents"; "1048576"];
+         ["file_extents"; "/file_extents"]]), []
     ];
-    optional = Some "btrfs"; camel_name = "BTRFSQgroupShow";
-    shortdesc = "show subvolume quota groups";
+    shortdesc = "return the extents of a file";
     longdesc = "\
-Show all subvolume quota groups in a btrfs filesystem, including their
-usages." };
+This returns the extents of the file C<path> using the Linux
+FIEMAP ioctl.  Each extent maps C<fe_length> bytes at offset
+C<fe_logical> in the file to offset C<fe_physical> on the device
+containing the filesystem.  Parts of the file which are not in
+any extent are holes.
+
+C<fe_flags> contains the C<FIEMAP_EXTENT_*> flags from
+F<linux/fiemap.h>.  In particular C<0x800>
+(C<FIEMAP_EXTENT_UNWRITTEN>) means that the extent is allocated
+but reads as zeroes, and C<0x1> (C<FIEMAP_EXTENT_LAST>) is set
+on the last extent.
+
+The file is synced first.  Not all filesystems support FIEMAP." };
 
   { defaults with
-    name = "btrfs_qgroup_assign"; added = (1, 29, 17);
-    style = RErr, [String "src"; String "dst"; Pathname "path"], [];
-    proc_nr = Some 433;
-    optional = Some "btrfs"; camel_name = "BTRFSQgroupAssign";
+    name = "filesystem_free_ranges"; added = (1, 35, 20);
+    style = RStructList ("ranges", "blockrange"), [Device "device"], [];
+    proc_nr = Some 489;
     tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mount"; "/dev/sda1"; "/"];
-         ["btrfs_quota_enable"; "/"; "true"];
-         ["btrfs_qgroup_create"; "0/1000"; "/"];
-         ["btrfs_qgroup_create"; "1/1000"; "/"];
-         ["btrfs_qgroup_assign"; "0/1000"; "1/1000"; "/"]]), [];
+      InitBasicFS, Always, TestRun (
+        [["umount"; "/"; "false"; "false"];
+         ["filesystem_free_ranges"; "/dev/sda1"]]), []
     ];
-    shortdesc = "add a qgroup to a parent qgroup";
+    shortdesc = "return the free space of a filesystem";
     longdesc = "\
-Add qgroup C<src> to parent qgroup C<dst>. This command can group
-several qgroups into a parent qgroup to share common limit." };
+This reads the free space maps of the filesystem on C<device>
+and returns the ranges of the device which are not used by the
+filesystem, as byte offsets and sizes, in order.  The contents
+of these ranges do not matter to the filesystem, so tools such
+as L<virt-sparsify(1)> and backup programs do not need to read
+or copy them.
+
+Only ext2/3/4, XFS and NTFS filesystems are supported.  The maps
+are read from the device, so the result is only accurate if the
+filesystem is not mounted, or is mounted read-only.
+
+See also C<guestfs_discard_free_ranges>." };
 
   { defaults with
-    name = "btrfs_qgroup_remove"; added = (1, 29, 17);
-    style = RErr, [String "src"; String "dst"; Pathname "path"], [];
-    proc_nr = Some 434;
-    optional = Some "btrfs"; camel_name = "BTRFSQgroupRemove";
+    name = "rm_globs"; added = (1, 35, 20);
+    style = RInt "count", [StringList "patterns"], [OStringList "exclude"; OBool "onlyfiles"; OBool "norecurse"];
+    proc_nr = Some 490;
     tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mount"; "/dev/sda1"; "/"];
-         ["btrfs_quota_enable"; "/"; "true"];
-         ["btrfs_qgroup_create"; "0/1000"; "/"];
-         ["btrfs_qgroup_create"; "1/1000"; "/"];
-         ["btrfs_qgroup_assign"; "0/1000"; "1/1000"; "/"];
-         ["btrfs_qgroup_remove"; "0/1000"; "1/1000"; "/"]]), [];
+      InitScratchFS, Always, TestResult (
+        [["mkdir_p"; "/rm_globs/a/b"];
+         ["touch"; "/rm_globs/a/b/c"];
+         ["touch"; "/rm_globs/d.log"];
+         ["touch"; "/rm_globs/e"];
+         ["rm_globs"; "/rm_globs/a /rm_globs/*.log /rm_globs/x*"; "NOARG"; ""; ""];
+         ["ls"; "/rm_globs"]],
+        "is_string_list (ret, 1, \"e\")"), [];
+      InitScratchFS, Always, TestResult (
+        [["mkdir_p"; "/rm_globs2/a/b"];
+         ["touch"; "/rm_globs2/a/b/c"];
+         ["touch"; "/rm_globs2/a/.SEQ"];
+         ["rm_globs"; "/rm_globs2/*"; "*/.SEQ"; "true"; ""];
+         ["find"; "/rm_globs2"]],
+        "is_string_list (ret, 3, \"a\", \"a/.SEQ\", \"a/b\")"), []
+    ];
+    shortdesc = "remove the files matching a list of wildcards";
+    longdesc = "\
+Remove everything matching any of the wildcards in C<patterns>,
+which must be absolute paths.  The wildcards are expanded as in
+C<guestfs_glob_expand>, and each match is removed recursively
+like the C<rm -rf> shell command.  Wildcards which match nothing
+are ignored.  All the work is done in a single call, so this is
+much faster than calling C<guestfs_glob_expand> followed by
+C<guestfs_rm_rf> on each match when there are many files.
+
+The optional arguments are:
+
+=over 4
+
+=item C<exclude>
+
+A list of wildcards.  Files and directories whose full path
+matches any of them are not removed, nor is anything inside
+them.  These are matched using L<fnmatch(3)> against the whole
+path, and C<*> matches C</> as well, so for example C<*/.SEQ>
+matches a file called F<.SEQ> in any directory.  Directories
+containing files which are kept are not removed either.
+
+=item C<onlyfiles>
+
+If true, only regular files are removed.  Matching directories
+are searched recursively for regular files to remove, but the
+directories themselves, symbolic links and other special files
+are kept.
+
+=item C<norecurse>
+
+If true, matching directories are skipped instead of being
+removed recursively, like the C<rm> shell command without C<-r>.
+
+=back
+
+If some files cannot be removed, the others are still removed,
+and then the error for the first one is returned.  Otherwise this
+returns the number of files and directories removed." };
+
+  { defaults with
+    name = "globs_matching"; added = (1, 35, 20);
+    style = RStringList "matching", [StringList "patterns"], [];
+    proc_nr = Some 491;
+    tests = [
+      InitScratchFS, Always, TestResult (
+        [["mkdir_p"; "/globs_matching/b"];
+         ["touch"; "/globs_matching/b/c"];
+         ["globs_matching"; "/globs_matching/b/* /globs_matching/x* /globs_matching/b"]],
+        "is_string_list (ret, 2, \"/globs_matching/b/*\", \"/globs_matching/b\")"), []
     ];
-    shortdesc = "remove a qgroup from its parent qgroup";
+    shortdesc = "find which wildcards match any files";
     longdesc = "\
-Remove qgroup C<src> from the parent qgroup C<dst>." };
+This returns the wildcards from C<patterns> which match at least
+one path, in the same order.  The wildcards must be absolute paths,
+and are expanded as in C<guestfs_glob_expand>.
+
+This can be used to find which of many paths exist in a single
+call.  See also C<guestfs_rm_globs>." };
 
   { defaults with
-    name = "btrfs_scrub_start"; added = (1, 29, 22);
-    style = RErr, [Pathname "path"], [];
-    proc_nr = Some 435;
-    optional = Some "btrfs"; camel_name = "BTRFSScrubStart";
+    name = "fstrim_multiple"; added = (1, 35, 20);
+    style = RStringList "unsupported", [StringList "mountpoints"], [];
+    proc_nr = Some 492;
+    optional = Some "fstrim";
+    progress = true;
+    shortdesc = "trim free space in several filesystems";
+    longdesc = "\
+Trim the free space in each filesystem mounted on C<mountpoints>,
+as C<guestfs_fstrim> does.  The filesystems are trimmed at the
+same time, so this is faster than calling C<guestfs_fstrim> on
+each one when they are on different devices, eg. logical volumes
+on separate physical volumes.
+
+The mountpoints do not have to be mounted under C</>, so mountpoints
+created with C<guestfs_mkmountpoint> can be used.
+
+This returns the list of mountpoints where the kernel does not
+support trimming the filesystem.  Any other error causes the whole
+call to fail.
+
+Progress notifications are sent as each filesystem finishes." };
+
+  { defaults with
+    name = "discard_free_ranges"; added = (1, 35, 20);
+    style = RInt64 "discarded", [Device "device"], [];
+    proc_nr = Some 493;
+    optional = Some "blkdiscard";
     tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mount"; "/dev/sda1"; "/"];
-         ["btrfs_scrub_start"; "/"]]), [];
+      InitBasicFS, Always, TestRun (
+        [["umount"; "/"; "false"; "false"];
+         ["discard_free_ranges"; "/dev/sda1"]]), []
     ];
-    shortdesc = "read all data from all disks and verify checksums";
+    shortdesc = "discard the free space of an unmounted filesystem";
     longdesc = "\
-Reads all the data and metadata on the filesystem, and uses checksums
-and the duplicate copies from RAID storage to identify and repair any
-corrupt data." };
+This discards the ranges of C<device> which are not used by the
+filesystem on it, as returned by C<guestfs_filesystem_free_ranges>,
+and returns the number of bytes discarded.
+
+Unlike C<guestfs_fstrim>, the filesystem is not mounted, and the
+ranges are discarded at the block device level, so this also works
+when the filesystem driver cannot trim, for example on NTFS
+partitions which are not aligned to the underlying storage.
+
+The filesystem must not be mounted, and it must be clean: use
+this after the filesystem has been mounted read-write and then
+unmounted, so any journal has been replayed.  Otherwise blocks
+which are only allocated in the journal would be discarded." };
 
   { defaults with
-    name = "btrfs_scrub_cancel"; added = (1, 29, 22);
-    style = RErr, [Pathname "path"], [];
-    proc_nr = Some 436;
-    optional = Some "btrfs"; camel_name = "BTRFSScrubCancel";
-    test_excuse = "test disk isn't large enough that btrfs_scrub_start completes before we can cancel it";
-    shortdesc = "cancel a running scrub";
+    name = "internal_hot_add_drives"; added = (1, 35, 20);
+    style = RErr, [StringList "labels"], [];
+    proc_nr = Some 494;
+    visibility = VInternal;
+    shortdesc = "internal hotplugging operation";
     longdesc = "\
-Cancel a running scrub on a btrfs filesystem." };
+This function is used internally when hotplugging drives." };
 
   { defaults with
-    name = "btrfs_scrub_resume"; added = (1, 29, 22);
-    style = RErr, [Pathname "path"], [];
-    proc_nr = Some 437;
-    optional = Some "btrfs"; camel_name = "BTRFSScrubResume";
-    test_excuse = "test disk isn't large enough that btrfs_scrub_start completes before we can cancel and resume it";
-    shortdesc = "resume a previously canceled or interrupted scrub";
+    name = "internal_hot_remove_drives_precheck"; added = (1, 35, 20);
+    style = RErr, [StringList "labels"], [];
+    proc_nr = Some 495;
+    visibility = VInternal;
+    shortdesc = "internal hotplugging operation";
     longdesc = "\
-Resume a previously canceled or interrupted scrub on a btrfs filesystem." };
+This function is used internally when hotplugging drives." };
 
-{ defaults with
-    name = "btrfs_balance_pause"; added = (1, 29, 22);
-    style = RErr, [Pathname "path"], [];
-    proc_nr = Some 438;
-    optional = Some "btrfs"; camel_name = "BTRFSBalancePause";
-    test_excuse = "test disk isn't large enough to test this thoroughly";
-    shortdesc = "pause a running balance";
+  { defaults with
+    name = "internal_hot_remove_drives"; added = (1, 35, 20);
+    style = RErr, [StringList "labels"], [];
+    proc_nr = Some 496;
+    visibility = VInternal;
+    shortdesc = "internal hotplugging operation";
     longdesc = "\
-Pause a running balance on a btrfs filesystem." };
+This function is used internally when hotplugging drives." };
 
-{ defaults with
-    name = "btrfs_balance_cancel"; added = (1, 29, 22);
-    style = RErr, [Pathname "path"], [];
-    proc_nr = Some 439;
-    optional = Some "btrfs"; camel_name = "BTRFSBalanceCancel";
-    test_excuse = "test disk isn't large enough that btrfs_balance completes before we can cancel it";
-    shortdesc = "cancel a running or paused balance";
+  { defaults with
+    name = "journal_export"; added = (1, 35, 20);
+    style = RErr, [FileOut "filename"], [OInt64 "maxentries"; OString "cursor"; OInt64 "since"; OInt64 "until"; OStringList "fields"];
+    proc_nr = Some 497;
+    optional = Some "journal";
+    test_excuse = "tests in tests/journal subdirectory";
+    shortdesc = "export journal entries";
     longdesc = "\
-Cancel a running balance on a btrfs filesystem." };
+Export journal entries to the local file C<filename>, starting
+with the entry after the current one.  This is much faster than
+calling C<guestfs_journal_next> and C<guestfs_journal_get> for
+each entry, since the entries are streamed in a single call.
+Afterwards the journal is positioned on the last entry exported,
+so calling this again exports the following entries.
 
-{ defaults with
-    name = "btrfs_balance_resume"; added = (1, 29, 22);
-    style = RErr, [Pathname "path"], [];
-    proc_nr = Some 440;
-    optional = Some "btrfs"; camel_name = "BTRFSBalanceResume";
-    test_excuse = "test disk isn't large enough that btrfs_balance completes before we can pause and resume it";
-    shortdesc = "resume a paused balance";
-    longdesc = "\
-Resume a paused balance on a btrfs filesystem." };
+The optional arguments are:
+
+=over 4
+
+=item C<maxentries>
+
+Export at most this many entries.  The default is to export
+all remaining entries.
+
+=item C<cursor>
+
+Seek to the entry with this cursor first, and start exporting
+after it.  Cursors are returned in the C<__CURSOR> field.
+
+=item C<since>
+
+Seek to the first entry with a realtime timestamp (in microseconds
+since the epoch) at or after C<since> first.  This is ignored
+if C<cursor> is given.
+
+=item C<until>
+
+Stop before the first entry with a realtime timestamp after
+C<until>.
+
+=item C<fields>
+
+Only export the named fields (for example C<MESSAGE>,
+C<_SYSTEMD_UNIT>).  The default is to export all fields.
+
+=back
+
+Each entry is written as a series of fields.  Each field is a
+big-endian 64 bit length followed by that many bytes of
+C<FIELD=data>, where data is binary.  The fields of an entry
+start with the C<__CURSOR> and C<__REALTIME_TIMESTAMP> pseudo-fields,
+and the entry ends with a zero length.
+
+The data threshold applies to the fields, see
+C<guestfs_journal_set_data_threshold>." };
 
   { defaults with
-    name = "btrfs_filesystem_defragment"; added = (1, 29, 22);
-    style = RErr, [Pathname "path"], [OBool "flush"; OString "compress"];
-    proc_nr = Some 443;
-    optional = Some "btrfs"; camel_name = "BTRFSFilesystemDefragment";
-    tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mount"; "/dev/sda1"; "/"];
-         ["btrfs_filesystem_defragment"; "/"; "true"; "lzo"]]), [];
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mount"; "/dev/sda1"; "/"];
-         ["touch"; "/hello"];
-         ["btrfs_filesystem_defragment"; "/hello"; ""; "zlib"]]), [];
-    ];
-    shortdesc = "defragment a file or directory";
+    name = "inotify_wait"; added = (1, 35, 20);
+    style = RStructList ("events", "inotify_event"), [], [OInt "timeout"; OInt "settle"; OBool "fullpaths"];
+    proc_nr = Some 498;
+    optional = Some "inotify";
+    shortdesc = "wait for inotify events";
     longdesc = "\
-Defragment a file or directory on a btrfs filesystem. compress is one of zlib or lzo." };
+Wait until inotify events are available, then return them in the
+same way as C<guestfs_inotify_read>.  Unlike C<guestfs_inotify_read>
+this does not return an empty list immediately when there are no
+events, so callers don't have to poll for changes.
+
+The optional arguments are:
+
+=over 4
+
+=item C<timeout>
+
+Wait at most this many milliseconds.  If no events arrived in that
+time an empty list is returned.  The default (or C<-1>) is to wait
+until there is an event.
+
+=item C<settle>
+
+After the first event arrives, wait this many milliseconds more so
+that related events (such as a burst of writes to a file) are
+returned together in the same list.  The default is C<0>.
+
+=item C<fullpaths>
+
+If true, the C<in_name> field of each event is the path that was
+passed to C<guestfs_inotify_add_watch> joined to the name in the
+event, so events from many watches (for example on several mounted
+filesystems) can be told apart without keeping a table of watch
+descriptors.
+
+=back
+
+Note that while this call is waiting no other calls can be made
+on the handle." };
 
   { defaults with
-    name = "btrfs_rescue_chunk_recover"; added = (1, 29, 22);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 444;
-    optional = Some "btrfs"; camel_name = "BTRFSRescueChunkRecover";
+    name = "chmod_globs"; added = (1, 35, 20);
+    style = RInt "count", [Int "mode"; StringList "patterns"], [];
+    proc_nr = Some 499;
     tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["btrfs_rescue_chunk_recover"; "/dev/sda1"]]), [];
+      InitScratchFS, Always, TestResult (
+        [["mkdir"; "/chmod_globs"];
+         ["touch"; "/chmod_globs/a.log"];
+         ["touch"; "/chmod_globs/b.log"];
+         ["chmod_globs"; "0o600"; "/chmod_globs/*.log"];
+         ["stat"; "/chmod_globs/b.log"]],
+        "S_ISREG (ret->mode) && (ret->mode & 0777) == 0600"), []
     ];
-    shortdesc = "recover the chunk tree of btrfs filesystem";
+    shortdesc = "change file mode of the files matching wildcards";
     longdesc = "\
-Recover the chunk tree of btrfs filesystem by scanning the devices one by one." };
+Change the mode (permissions) of everything matching any of the
+wildcards in C<patterns> to C<mode>, as C<guestfs_chmod> does.
+The wildcards must be absolute paths, and are expanded as in
+C<guestfs_glob_expand>.  A wildcard which matches nothing is used
+as a path unchanged, like the shell does.
+
+All the work is done in a single call, so this is much faster than
+calling C<guestfs_glob_expand> followed by C<guestfs_chmod> on each
+match when there are many files.
+
+If some files cannot be changed, the others are still changed, and
+then the error for the first one is returned.  Otherwise this
+returns the number of files changed." };
 
   { defaults with
-    name = "btrfs_rescue_super_recover"; added = (1, 29, 22);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 445;
-    optional = Some "btrfs"; camel_name = "BTRFSRescueSuperRecover";
+    name = "chown_globs"; added = (1, 35, 20);
+    style = RInt "count", [Int "owner"; Int "group"; StringList "patterns"], [];
+    proc_nr = Some 500;
     tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["btrfs_rescue_super_recover"; "/dev/sda1"]]), [];
+      InitScratchFS, Always, TestResult (
+        [["mkdir"; "/chown_globs"];
+         ["touch"; "/chown_globs/a.log"];
+         ["touch"; "/chown_globs/b.log"];
+         ["chown_globs"; "10"; "11"; "/chown_globs/*.log"];
+         ["stat"; "/chown_globs/b.log"]],
+        "ret->uid == 10 && ret->gid == 11"), []
     ];
-    shortdesc = "recover bad superblocks from good copies";
+    shortdesc = "change file owner and group of the files matching wildcards";
     longdesc = "\
-Recover bad superblocks from good copies." };
+Change the owner and group of everything matching any of the
+wildcards in C<patterns>, as C<guestfs_chown> does.  Symbolic
+links are followed.  The wildcards are handled as in
+C<guestfs_chmod_globs>.
+
+If some files cannot be changed, the others are still changed, and
+then the error for the first one is returned.  Otherwise this
+returns the number of files changed." };
 
   { defaults with
-    name = "part_set_gpt_guid"; added = (1, 29, 25);
-    style = RErr, [Device "device"; Int "partnum"; GUID "guid"], [];
-    proc_nr = Some 446;
-    optional = Some "gdisk";
+    name = "touch_globs"; added = (1, 35, 20);
+    style = RInt "count", [StringList "patterns"], [];
+    proc_nr = Some 501;
     tests = [
-      InitGPT, Always, TestLastFail (
-        [["part_set_gpt_guid"; "/dev/sda"; "1"; "f"]]), [];
-      InitGPT, Always, TestResultString (
-        [["part_set_gpt_guid"; "/dev/sda"; "1";
-          "01234567-89AB-CDEF-0123-456789ABCDEF"];
-         ["part_get_gpt_guid"; "/dev/sda"; "1"]],
-        "01234567-89AB-CDEF-0123-456789ABCDEF"), [];
+      InitScratchFS, Always, TestResult (
+        [["mkdir"; "/touch_globs"];
+         ["touch_globs"; "/touch_globs/{a,b}"];
+         ["ls"; "/touch_globs"]],
+        "is_string_list (ret, 2, \"a\", \"b\")"), []
     ];
-    shortdesc = "set the GUID of a GPT partition";
+    shortdesc = "update file timestamps of the files matching wildcards";
     longdesc = "\
-Set the GUID of numbered GPT partition C<partnum> to C<guid>.  Return an
-error if the partition table of C<device> isn't GPT, or if C<guid> is not a
-valid GUID." };
+Touch everything matching any of the wildcards in C<patterns>, as
+C<guestfs_touch> does.  Files which don't exist are created, so
+a wildcard which matches nothing creates a file with that name,
+like the shell command C<touch> does.  The wildcards are handled
+as in C<guestfs_chmod_globs>.
+
+Only regular files can be touched.  If some files cannot be
+touched, the others are still touched, and then the error for the
+first one is returned.  Otherwise this returns the number of files
+touched." };
 
   { defaults with
-    name = "part_get_gpt_guid"; added = (1, 29, 25);
-    style = RString "guid", [Device "device"; Int "partnum"], [];
-    proc_nr = Some 447;
-    optional = Some "gdisk";
-    tests = [
-      InitGPT, Always, TestResultString (
-        [["part_set_gpt_guid"; "/dev/sda"; "1";
-          "01234567-89AB-CDEF-0123-456789ABCDEF"];
-         ["part_get_gpt_guid"; "/dev/sda"; "1"]],
-        "01234567-89AB-CDEF-0123-456789ABCDEF"), [];
-    ];
-    shortdesc = "get the GUID of a GPT partition";
+    name = "cat_globs"; added = (1, 35, 20);
+    style = RErr, [StringList "patterns"; FileOut "filename"], [];
+    proc_nr = Some 502;
+    shortdesc = "download the files matching wildcards as one file";
     longdesc = "\
-Return the GUID of numbered GPT partition C<partnum>." };
+Download the contents of everything matching any of the wildcards
+in C<patterns>, one after another, to the local file C<filename>,
+like the shell command C<cat> does.  The wildcards are handled as
+in C<guestfs_chmod_globs>, and the matches of each wildcard are
+downloaded in sorted order.
 
-{ defaults with
-    name = "btrfs_balance_status"; added = (1, 29, 26);
-    style = RStruct ("status", "btrfsbalance"), [Pathname "path"], [];
-    proc_nr = Some 448;
-    optional = Some "btrfs"; camel_name = "BTRFSBalanceStatus";
-    test_excuse = "test disk isn't large enough that btrfs_balance completes before we can get its status";
-    shortdesc = "show the status of a running or paused balance";
-    longdesc = "\
-Show the status of a running or paused balance on a btrfs filesystem." };
+All the files are checked before anything is downloaded, so if one
+of them does not exist or is a directory nothing is downloaded
+and an error is returned." };
 
   { defaults with
-    name = "btrfs_scrub_status"; added = (1, 29, 26);
-    style = RStruct ("status", "btrfsscrub"), [Pathname "path"], [];
-    proc_nr = Some 449;
-    optional = Some "btrfs"; camel_name = "BTRFSScrubStatus";
-    tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mount"; "/dev/sda1"; "/"];
-         ["btrfs_scrub_start"; "/"];
-         ["btrfs_scrub_status"; "/"]]), [];
-    ];
-    shortdesc = "show status of running or finished scrub";
+    name = "internal_set_progress_interval"; added = (1, 35, 20);
+    style = RErr, [Int "interval"], [];
+    proc_nr = Some 503;
+    visibility = VInternal;
+    shortdesc = "set the minimum interval between progress messages";
     longdesc = "\
-Show status of running or finished scrub on a btrfs filesystem." };
+This is called by the library to ask the daemon not to send progress
+messages more often than once every C<interval> milliseconds.  The
+daemon never sends them more often than its own default interval.
+Appliances which do not implement this call continue to use the
+default interval." };
 
   { defaults with
-    name = "btrfstune_seeding"; added = (1, 29, 29);
-    style = RErr, [Device "device"; Bool "seeding"], [];
-    proc_nr = Some 450;
-    optional = Some "btrfs"; camel_name = "BTRFSTuneSeeding";
+    name = "list_block_devices"; added = (1, 35, 20);
+    style = RStructList ("devices", "block_device"), [], [];
+    proc_nr = Some 504;
     tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["btrfstune_seeding"; "/dev/sda1"; "true"];
-         ["btrfstune_seeding"; "/dev/sda1"; "false"]]), []
-    ];
+      InitBasicFS, Always, TestResult (
+        [["list_block_devices"]],
+        "ret->len >= 2 && "^
+        "STREQ (ret->val[0].bd_device, \"/dev/sda\") && "^
+        "STREQ (ret->val[0].bd_parent, \"\") && "^
+        "STREQ (ret->val[1].bd_device, \"/dev/sda1\") && "^
+        "STREQ (ret->val[1].bd_parent, \"/dev/sda\") && "^
+        "ret->val[1].bd_partnum == 1 && "^
+        "STREQ (ret->val[1].bd_vfs_type, \"ext2\")"), []
+    ];
+    shortdesc = "list block devices, partitions and filesystems";
+    longdesc = "\
+List all the block devices, their partitions and the filesystems
+on them in one call.  This returns the same information as
+C<guestfs_list_devices>, C<guestfs_list_md_devices>,
+C<guestfs_list_partitions>, C<guestfs_part_to_dev>,
+C<guestfs_part_to_partnum>, C<guestfs_vfs_type>,
+C<guestfs_vfs_label> and C<guestfs_vfs_uuid>, but without a round
+trip to the appliance for each device.
+
+Each whole device (including MD devices) is followed by its
+partitions.  The fields are:
 
-    shortdesc = "enable or disable seeding of a btrfs device";
-    longdesc = "\
-Enable seeding of a btrfs device, this will force a fs readonly
-so that you can use it to build other filesystems." };
+=over 4
 
-  { defaults with
-    name = "btrfstune_enable_extended_inode_refs"; added = (1, 29, 29);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 451;
-    optional = Some "btrfs"; camel_name = "BTRFSTuneEnableExtendedInodeRefs";
-    tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["btrfstune_enable_extended_inode_refs"; "/dev/sda1"]]), []
-    ];
+=item C<bd_device>
 
-    shortdesc = "enable extended inode refs";
-    longdesc = "\
-This will Enable extended inode refs." };
+The device or partition name, eg. F</dev/sda> or F</dev/sda1>.
 
-  { defaults with
-    name = "btrfstune_enable_skinny_metadata_extent_refs"; added = (1, 29, 29);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 452;
-    optional = Some "btrfs"; camel_name = "BTRFSTuneEnableSkinnyMetadataExtentRefs";
-    tests = [
-      InitPartition, Always, TestRun (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["btrfstune_enable_skinny_metadata_extent_refs"; "/dev/sda1"]]), []
-    ];
+=item C<bd_parent>
 
-    shortdesc = "enable skinny metadata extent refs";
-    longdesc = "\
-This enable skinny metadata extent refs." };
+For partitions, the whole device containing it.  For whole devices
+this is the empty string.
 
-  { defaults with
-    name = "btrfs_image"; added = (1, 29, 32);
-    style = RErr, [DeviceList "source"; Pathname "image"], [OInt "compresslevel"];
-    proc_nr = Some 453;
-    optional = Some "btrfs"; camel_name = "BTRFSImage";
-    tests = [
-      InitEmpty, Always, TestRun (
-        [["part_init"; "/dev/sda"; "mbr"];
-         ["part_add"; "/dev/sda"; "p"; "64"; "2047999"];
-         ["part_add"; "/dev/sda"; "p"; "2048000"; "4095999"];
-         ["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mkfs_btrfs"; "/dev/sda2"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["mount"; "/dev/sda1"; "/"];
-         ["btrfs_image"; "/dev/sda2"; "/1.img"; ""];
-         ["btrfs_image"; "/dev/sda2"; "/2.img"; "2"]]), []
-    ];
+=item C<bd_partnum>
 
-    shortdesc = "create an image of a btrfs filesystem";
-    longdesc = "\
-This is used to create an image of a btrfs filesystem.
-All data will be zeroed, but metadata and the like is preserved." };
+For partitions, the partition number.  For whole devices this is C<0>.
+
+=item C<bd_size>
+
+The size in bytes.
+
+=item C<bd_vfs_type>
+
+=item C<bd_vfs_label>
+
+=item C<bd_vfs_uuid>
+
+The filesystem type, label and UUID, or the empty string if there
+is no filesystem on the device.
+
+=back
+
+Logical volumes are not included, use C<guestfs_lvs>." };
 
   { defaults with
-    name = "part_get_mbr_part_type"; added = (1, 29, 32);
-    style = RString "partitiontype", [Device "device"; Int "partnum"], [];
-    proc_nr = Some 454;
+    name = "part_list_full"; added = (1, 35, 20);
+    style = RStructList ("partitions", "partition_info"), [Device "device"], [];
+    proc_nr = Some 505;
     tests = [
-      InitEmpty, Always, TestResultString (
-        [["part_init"; "/dev/sda"; "mbr"];
-         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
-         ["part_add"; "/dev/sda"; "e"; "204800"; "614400"];
-         ["part_add"; "/dev/sda"; "l"; "204864"; "205988"];
-         ["part_get_mbr_part_type"; "/dev/sda"; "5"]], "logical"), [];
-      InitEmpty, Always, TestResultString (
+      InitEmpty, Always, TestResult (
         [["part_init"; "/dev/sda"; "mbr"];
          ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
          ["part_add"; "/dev/sda"; "e"; "204800"; "614400"];
          ["part_add"; "/dev/sda"; "l"; "204864"; "205988"];
-         ["part_get_mbr_part_type"; "/dev/sda"; "2"]], "extended"), []
-    ];
+         ["part_set_bootable"; "/dev/sda"; "1"; "true"];
+         ["part_list_full"; "/dev/sda"]],
+        "ret->len == 3 && "^
+        "ret->val[0].pi_num == 1 && ret->val[0].pi_start == 64*512 && "^
+        "ret->val[0].pi_bootable && ret->val[0].pi_mbr_id == 0x83 && "^
+        "STREQ (ret->val[1].pi_mbr_part_type, \"extended\") && "^
+        "ret->val[2].pi_num == 5 && "^
+        "STREQ (ret->val[2].pi_mbr_part_type, \"logical\")"), [];
+      InitEmpty, Always, TestResult (
+        [["part_init"; "/dev/sda"; "gpt"];
+         ["part_add"; "/dev/sda"; "p"; "2048"; "-2048"];
+         ["part_set_name"; "/dev/sda"; "1"; "root"];
+         ["part_list_full"; "/dev/sda"]],
+        "ret->len == 1 && "^
+        "STREQ (ret->val[0].pi_name, \"root\") && "^
+        "ret->val[0].pi_mbr_id == -1 && "^
+        "strlen (ret->val[0].pi_gpt_type) == 36 && "^
+        "strlen (ret->val[0].pi_gpt_guid) == 36"), []
+    ];
+    shortdesc = "list all the fields of all partitions";
+    longdesc = "\
+This returns every partition in the partition table on C<device>
+with all of its fields, reading the partition table only once.
+It replaces calling C<guestfs_part_list> and then the
+C<guestfs_part_get_*> calls for each partition.
 
-    shortdesc = "get the MBR partition type";
-    longdesc = "\
-This returns the partition type of an MBR partition
-numbered C<partnum> on device C<device>.
+The fields in the returned structure are:
 
-It returns C<primary>, C<logical>, or C<extended>." };
+=over 4
+
+=item B<pi_num>
+
+Partition number, counting from 1.
+
+=item B<pi_start>
+
+=item B<pi_end>
+
+=item B<pi_size>
+
+Start and end (inclusive) of the partition, and its size, in bytes.
+
+=item B<pi_mbr_part_type>
+
+C<primary>, C<logical> or C<extended>, as returned by
+C<guestfs_part_get_mbr_part_type>.  Always C<primary> on GPT.
+
+=item B<pi_mbr_id>
+
+The MBR partition ID byte (see C<guestfs_part_get_mbr_id>), or
+C<-1> on GPT.
+
+=item B<pi_gpt_type>
+
+=item B<pi_gpt_guid>
+
+The GPT partition type and unique GUIDs (see
+C<guestfs_part_get_gpt_type> and C<guestfs_part_get_gpt_guid>),
+or empty strings on MBR.
+
+=item B<pi_gpt_attributes>
+
+The GPT attribute flags (see the UEFI specification), or C<0> on MBR.
+
+=item B<pi_name>
+
+The GPT partition name, or an empty string on MBR.
+
+=item B<pi_bootable>
+
+On MBR, true if the partition has the bootable flag.  On GPT, true
+if the I<legacy BIOS bootable> attribute (bit 2) is set.
+
+=back
+
+This uses L<sfdisk(8)>, and works for MBR and GPT partition tables
+only." };
 
   { defaults with
-    name = "btrfs_replace"; added = (1, 29, 48);
-    style = RErr, [Device "srcdev"; Device "targetdev"; Pathname "mntpoint"], [];
-    proc_nr = Some 455;
-    optional = Some "btrfs"; camel_name = "BTRFSReplace";
-    test_excuse = "put the test in 'tests/btrfs' directory";
-    shortdesc = "replace a btrfs managed device with another device";
+    name = "part_edit_batch"; added = (1, 35, 20);
+    style = RErr, [Device "device"; StringList "edits"], [];
+    proc_nr = Some 506;
+    tests = [
+      InitEmpty, Always, TestResult (
+        [["part_init"; "/dev/sda"; "gpt"];
+         ["part_add"; "/dev/sda"; "p"; "2048"; "204799"];
+         ["part_add"; "/dev/sda"; "p"; "204800"; "-2048"];
+         ["part_edit_batch"; "/dev/sda"; "1:name=boot 2:name=root 2:gpt_type=0FC63DAF-8483-4772-8E79-3D69D8477DE4 1:gpt_attributes=4"];
+         ["part_list_full"; "/dev/sda"]],
+        "ret->len == 2 && "^
+        "STREQ (ret->val[0].pi_name, \"boot\") && "^
+        "ret->val[0].pi_gpt_attributes == 4 && "^
+        "STREQ (ret->val[1].pi_name, \"root\") && "^
+        "STREQ (ret->val[1].pi_gpt_type, \"0FC63DAF-8483-4772-8E79-3D69D8477DE4\")"), [];
+      InitEmpty, Always, TestLastFail (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "p"; "64"; "-64"];
+         ["part_edit_batch"; "/dev/sda"; "1:mbr_id=7 1:name=foo"]]), []
+    ];
+    shortdesc = "change several partitions at once";
     longdesc = "\
-Replace device of a btrfs filesystem. On a live filesystem, duplicate the data
-to the target device which is currently stored on the source device.
-After completion of the operation, the source device is wiped out and
-removed from the filesystem.
+Apply all the C<edits> to the partition table on C<device>, and
+write the partition table once.  Either all the edits are made, or
+if any edit is not valid none of them are.  This is faster than
+making the same changes with C<guestfs_part_set_bootable>,
+C<guestfs_part_set_mbr_id>, C<guestfs_part_set_gpt_type>,
+C<guestfs_part_set_gpt_guid> and C<guestfs_part_set_name>,
+which each read and write the partition table.
+
+Each edit is a string C<partnum:field=value>, where C<field> is:
+
+=over 4
+
+=item C<bootable>
+
+C<true> or C<false>.  MBR only.
+
+=item C<mbr_id>
+
+The partition ID byte in hexadecimal.  MBR only.
+
+=item C<gpt_type>
+
+=item C<gpt_guid>
+
+The partition type GUID or unique GUID.  GPT only.
+
+=item C<name>
+
+The partition name.  GPT only.
+
+=item C<gpt_attributes>
 
-The C<targetdev> needs to be same size or larger than the C<srcdev>. Devices
-which are currently mounted are never allowed to be used as the C<targetdev>." };
+The attribute flags as a number.  Only bits 0-2 and 48-63 can be
+set.  GPT only.
+
+=back
+
+Edits are applied in order, so if one field of a partition is set
+twice the last edit wins.  The partitions cannot be added, removed,
+moved or resized with this call.
+
+This uses L<sfdisk(8)>." };
 
   { defaults with
-    name = "set_uuid_random"; added = (1, 29, 50);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 456;
+    name = "aug_init_files"; added = (1, 35, 20);
+    style = RErr, [Pathname "root"; Int "flags"; StringList "files"], [];
+    proc_nr = Some 507;
     tests = [
-        InitBasicFS, Always, TestRun (
-            [["set_uuid_random"; "/dev/sda1"]]), [];
-      ];
-    shortdesc = "set a random UUID for the filesystem";
+      InitBasicFS, Always, TestResultString (
+        [["mkdir"; "/etc"];
+         ["write"; "/etc/hostname"; "test.example.org"];
+         ["write"; "/etc/hosts"; "127.0.0.1 localhost"];
+         ["aug_init_files"; "/"; "0"; "/etc/hostname"];
+         ["aug_get"; "/files/etc/hostname/hostname"]], "test.example.org"), [["aug_close"]];
+      InitBasicFS, Always, TestLastFail (
+        [["mkdir"; "/etc"];
+         ["write"; "/etc/hostname"; "test.example.org"];
+         ["write"; "/etc/hosts"; "127.0.0.1 localhost"];
+         ["aug_init_files"; "/"; "0"; "/etc/hostname"];
+         ["aug_get"; "/files/etc/hosts/1/ipaddr"]]), [["aug_close"]]
+    ];
+    shortdesc = "create a new Augeas handle which loads only some files";
     longdesc = "\
-Set the filesystem UUID on C<device> to a random UUID.
-If this fails and the errno is ENOTSUP,
-means that there is no support for changing the UUID
-for the type of the specified filesystem.
+This is the same as C<guestfs_aug_init>, except that Augeas loads
+only the lenses which handle the configuration files listed in
+C<files> (absolute paths relative to C<root>), and parses only
+those files.  This is much faster than loading every lens and
+parsing all of F</etc> when you only need a few files.
 
-Only some filesystem types support setting UUIDs.
+As with C<guestfs_aug_init>, the files are not loaded if C<flags>
+contains C<AUG_NO_LOAD>.  Files in the list which do not exist, or
+which no lens handles, are ignored.
 
-To read the UUID on a filesystem, call C<guestfs_vfs_uuid>." };
+Calling C<guestfs_aug_init> or C<guestfs_aug_init_files> again with
+the same arguments is cheap, since the appliance keeps the handle
+after C<guestfs_aug_close> until something is mounted or unmounted,
+and only re-reads the files which have changed." };
 
   { defaults with
-    name = "vfs_minimum_size"; added = (1, 31, 18);
-    style = RInt64 "sizeinbytes", [Mountable "mountable"], [];
-    proc_nr = Some 457;
+    name = "btrfs_inventory"; added = (1, 35, 20);
+    style = RStructList ("subvolumes", "btrfsinventory"), [Mountable_or_Path "fs"], [];
+    proc_nr = Some 508;
+    optional = Some "btrfs"; camel_name = "BTRFSInventory";
     tests = [
-      InitBasicFS, Always, TestRun (
-        [["vfs_minimum_size"; "/dev/sda1"]]), [];
-      InitPartition, IfAvailable "ntfsprogs", TestRun(
-        [["mkfs"; "ntfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
-         ["vfs_minimum_size"; "/dev/sda1"]]), [];
-      InitPartition, IfAvailable "btrfs", TestRunOrUnsupported (
-        [["mkfs"; "btrfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
-         ["mount"; "/dev/sda1"; "/"];
-         ["vfs_minimum_size"; "/dev/sda1"]]), [];
-      InitPartition, IfAvailable "xfs", TestRun (
-        [["mkfs"; "xfs"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+      InitPartition, Always, TestResult (
+        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
          ["mount"; "/dev/sda1"; "/"];
-         ["vfs_minimum_size"; "/dev/sda1"]]), [];
+         ["mkdir"; "/dir"];
+         ["btrfs_subvolume_create"; "/test1"; "NOARG"];
+         ["btrfs_subvolume_snapshot"; "/test1"; "/dir/test2"; "true"; "NOARG"];
+         ["btrfs_inventory"; "/"]],
+        "ret->len == 2 && "^
+        "STREQ (ret->val[0].btrfsinventory_path, \"test1\") && "^
+        "ret->val[0].btrfsinventory_readonly == 0 && "^
+        "STREQ (ret->val[1].btrfsinventory_path, \"dir/test2\") && "^
+        "ret->val[1].btrfsinventory_readonly == 1 && "^
+        "STREQ (ret->val[1].btrfsinventory_parent_uuid, "^
+        "ret->val[0].btrfsinventory_uuid)"), []
+    ];
+    shortdesc = "list btrfs subvolumes and snapshots with their sizes";
+    longdesc = "\
+List all the subvolumes and snapshots of the btrfs filesystem
+C<fs>, which can be a device, a C<btrfsvol:> mountable or the
+mounted path of the filesystem.
+
+For each subvolume this returns its ID, the ID of the subvolume
+containing it, its path from the top level subvolume (as in
+C<guestfs_btrfs_subvolume_list>), its generation, its UUID and,
+for snapshots, the UUID of the subvolume it was taken from,
+whether it is read-only and whether it is the default subvolume.
+
+If quotas are enabled on the filesystem, C<btrfsinventory_rfer>
+and C<btrfsinventory_excl> are the referenced and exclusive
+sizes of the subvolume in bytes (as in C<guestfs_btrfs_qgroup_show>),
+else they are C<-1>.
+
+The information is read from the filesystem trees directly, so
+this is much faster than calling C<guestfs_btrfs_subvolume_list>,
+C<guestfs_btrfs_subvolume_get_default> and
+C<guestfs_btrfs_qgroup_show> on filesystems with many snapshots." };
+
+  { defaults with
+    name = "fsck_multiple"; added = (1, 35, 20);
+    style = RStructList ("results", "fsck_result"), [DeviceList "devices"], [OInt "maxjobs"];
+    proc_nr = Some 509;
+    progress = true;
+    tests = [
+      InitPartition, Always, TestResult (
+        [["mkfs"; "ext4"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["fsck_multiple"; "/dev/sda1"; "NOARG"]],
+        "ret->len == 1 && "^
+        "STREQ (ret->val[0].fr_device, \"/dev/sda1\") && "^
+        "STREQ (ret->val[0].fr_vfs_type, \"ext4\") && "^
+        "ret->val[0].fr_status == 0"), []
     ];
-    shortdesc = "get minimum filesystem size";
+    shortdesc = "check several filesystems at the same time";
     longdesc = "\
-Get the minimum size of filesystem in bytes.
-This is the minimum possible size for filesystem shrinking.
+Check the filesystems on C<devices>, which must not be mounted,
+without changing them.  The filesystems are checked at the same
+time, so this is much faster than calling C<guestfs_fsck> on
+each one when the appliance has several vCPUs (see
+C<guestfs_set_smp>) and the filesystems are on different disks.
 
-If getting minimum size of specified filesystem is not supported,
-this will fail and set errno as ENOTSUP.
+Only one filesystem is checked at a time on each disk.  By default
+the number of filesystems checked at the same time is the smaller
+of the number of vCPUs and the number of disks.  The optional
+C<maxjobs> parameter changes this limit.
 
-See also L<ntfsresize(8)>, L<resize2fs(8)>, L<btrfs(8)>, L<xfs_info(8)>." };
+ext2/3/4 filesystems are checked with S<C<e2fsck -n -f>>, XFS with
+S<C<xfs_repair -n>>, and other filesystems with S<C<fsck -n>>.
 
-  { defaults with
-    name = "internal_feature_available"; added = (1, 31, 25);
-    style = RInt "result", [String "group"], [];
-    proc_nr = Some 458;
-    visibility = VInternal;
-    shortdesc = "test availability of some parts of the API";
-    longdesc = "\
-This is the internal call which implements C<guestfs_feature_available>." };
+This returns one result per device, in the same order as C<devices>:
+
+=over 4
+
+=item C<fr_vfs_type>
+
+The type of the filesystem, as returned by C<guestfs_vfs_type>.
+
+=item C<fr_status>
+
+The exit status of the checker.  C<0> means that no errors were
+found.  For the meaning of other values see L<e2fsck(8)>,
+L<xfs_repair(8)> and L<fsck(8)>.  If the type of the filesystem
+is not known this is C<-1>.
+
+=item C<fr_output>
+
+The end of the output of the checker.
+
+=back
+
+Progress notifications are sent as each filesystem finishes." };
 
   { defaults with
-    name = "part_set_disk_guid"; added = (1, 33, 2);
-    style = RErr, [Device "device"; GUID "guid"], [];
-    proc_nr = Some 459;
-    optional = Some "gdisk";
+    name = "copy_device_to_device_multiple"; added = (1, 35, 20);
+    style = RErr, [DeviceList "srcs"; DeviceList "dests"], [OBool "sparse"; OBool "usedonly"; OInt "maxjobs"];
+    proc_nr = Some 510;
+    progress = true;
     tests = [
-      InitGPT, Always, TestLastFail (
-        [["part_set_disk_guid"; "/dev/sda"; "f"]]), [];
-      InitGPT, Always, TestResultString (
-        [["part_set_disk_guid"; "/dev/sda";
-          "01234567-89AB-CDEF-0123-456789ABCDEF"];
-         ["part_get_disk_guid"; "/dev/sda"]],
-        "01234567-89AB-CDEF-0123-456789ABCDEF"), [];
+      InitPartition, Always, TestResultString (
+        [["mkfs"; "ext4"; "/dev/sda1"; ""; "NOARG"; ""; ""; "NOARG"];
+         ["copy_device_to_device_multiple"; "/dev/sda1"; "/dev/sdc"; "true"; "true"; "NOARG"];
+         ["vfs_type"; "/dev/sdc"]], "ext4"), []
     ];
-    shortdesc = "set the GUID of a GPT-partitioned disk";
+    shortdesc = "copy several devices at the same time";
     longdesc = "\
-Set the disk identifier (GUID) of a GPT-partitioned C<device> to C<guid>.
-Return an error if the partition table of C<device> isn't GPT,
-or if C<guid> is not a valid GUID." };
+Copy each device in C<srcs> to the device at the same position in
+C<dests>.  The size copied is the size of the smaller of the two
+devices.  The copies are done at the same time, which is faster
+than calling C<guestfs_copy_device_to_device> for each one.
+
+The optional C<sparse> flag has the same meaning as for
+C<guestfs_copy_device_to_device>: blocks of zeroes are not written,
+so the destination devices must already be zeroed.
+
+If the optional C<usedonly> flag is true, the source devices which
+contain an unmounted filesystem whose free space maps can be read
+(see C<guestfs_filesystem_free_ranges>) are copied without their
+free space, whose contents do not matter to the filesystem.  The
+free space is not written to the destination at all, so this
+should also only be used if the destination devices are zeroed.
+
+The optional C<maxjobs> parameter limits the number of copies
+running at the same time.  The default depends on the number of
+vCPUs in the appliance." };
 
   { defaults with
-    name = "part_get_disk_guid"; added = (1, 33, 2);
-    style = RString "guid", [Device "device"], [];
-    proc_nr = Some 460;
-    optional = Some "gdisk";
+    name = "file_substitute"; added = (1, 35, 20);
+    style = RInt "count", [Pathname "path"; String "regex"; String "replacement"], [OBool "global"; OBool "caseless"; OString "backupextension"];
+    proc_nr = Some 511;
     tests = [
-      InitGPT, Always, TestResultString (
-        [["part_set_disk_guid"; "/dev/sda";
-          "01234567-89AB-CDEF-0123-456789ABCDEF"];
-         ["part_get_disk_guid"; "/dev/sda"]],
-        "01234567-89AB-CDEF-0123-456789ABCDEF"), [];
+      InitScratchFS, Always, TestResultString (
+        [["write"; "/file_substitute"; "Hello hello\nworld\nhello\n"];
+         ["file_substitute"; "/file_substitute"; "hel(l)o"; "j\\1y"; "true"; "true"; "NOARG"];
+         ["cat"; "/file_substitute"]], "jly jly\nworld\njly\n"), [];
+      InitScratchFS, Always, TestResult (
+        [["write"; "/file_substitute2"; "abc\n"];
+         ["file_substitute"; "/file_substitute2"; "x"; "y"; ""; ""; ".orig"]],
+        "ret == 0"), [];
+      InitScratchFS, Always, TestResultString (
+        [["write"; "/file_substitute3"; "a=1\na=2\n"];
+         ["file_substitute"; "/file_substitute3"; "^a=(\\d)$"; "b=\\1"; ""; ""; ".orig"];
+         ["cat"; "/file_substitute3.orig"]], "a=1\na=2\n"), []
     ];
-    shortdesc = "get the GUID of a GPT-partitioned disk";
+    shortdesc = "substitute a regular expression in a file";
     longdesc = "\
-Return the disk identifier (GUID) of a GPT-partitioned C<device>.
-Behaviour is undefined for other partition types." };
+This replaces matches of the Perl-compatible regular expression
+C<regex> in each line of the file C<path> with C<replacement>, like
+the L<sed(1)> or Perl command C<s/regex/replacement/>.  The file is
+edited in the appliance, so this is much faster than downloading,
+editing and uploading large files.  It returns the number of
+replacements which were made.
+
+In C<replacement>, C<\\1> to C<\\9> are replaced by the text matched
+by the corresponding group in C<regex>, C<\\0> by the whole match and
+C<\\\\> by a single backslash.  Any other character is copied
+literally.
+
+Each line of the file includes its terminating newline character, if
+it has one, so C<$> matches at the end of the line as it does in
+Perl.  If the optional C<global> flag is true, all the matches in each
+line are replaced, otherwise only the first one.  If the optional
+C<caseless> flag is true, the match is case insensitive.
+
+The new content is written to a new file in the same directory, which
+is given the permissions, ownership, extended attributes and SELinux
+context of the original file and then renamed over it.  If C<path> is
+a symbolic link, the file it points to is edited.  If there were no
+matches, the file is not changed.
+
+If C<backupextension> is given, the original file is kept with
+C<backupextension> appended to its name." };
 
   { defaults with
-    name = "part_set_disk_guid_random"; added = (1, 33, 2);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 461;
-    optional = Some "gdisk";
+    name = "list_storage"; added = (1, 35, 20);
+    style = RStructList ("entries", "storage_entry"), [], [];
+    proc_nr = Some 512;
     tests = [
-      InitGPT, Always, TestRun (
-        [["part_set_disk_guid_random"; "/dev/sda"]]), [];
-    ];
-    shortdesc = "set the GUID of a GPT-partitioned disk to random value";
+      InitBasicFSonLVM, Always, TestRun (
+        [["list_storage"]]), []
+    ];
+    shortdesc = "list all filesystems, partitions, devices and LVM objects";
+    longdesc = "\
+This returns every filesystem, logical volume (LV), volume group
+(VG), physical volume (PV), partition and block device, with their
+attributes, in one call.  It is much faster than calling
+C<guestfs_list_filesystems>, C<guestfs_lvm_report>,
+C<guestfs_list_partitions>, C<guestfs_list_devices> and then
+C<guestfs_vfs_type>, C<guestfs_vfs_label>, C<guestfs_vfs_uuid>,
+C<guestfs_blockdev_getsize64>, C<guestfs_part_get_mbr_id> etc.
+on each of them.
+
+For each entry, C<se_type> is one of C<filesystem>, C<lv>, C<vg>,
+C<pv>, C<partition> or C<device>, and the entries are returned in
+that order.  The filesystems are the same as the ones returned
+by C<guestfs_list_filesystems>, so C<se_name> may be a btrfs
+subvolume (see L<guestfs(3)/MOUNTABLE>), and C<se_vfs_type>
+may be C<swap> or C<unknown>.  The names of VGs are returned as
+C</dev/VG>.
+
+The other fields are empty strings or -1 if they do not apply:
+C<se_vfs_type>, C<se_vfs_label> and C<se_uuid> are the filesystem
+type, label and UUID of filesystems, and C<se_uuid> is also the
+LVM UUID of LVs, VGs and PVs.  C<se_mbr_id> is the MBR partition
+type byte of partitions on MBR-partitioned devices.  C<se_size> is
+the size in bytes (-1 for btrfs subvolumes).  C<se_parents> is a
+space-separated list of the devices or VGs which the entry is
+built on: the members of MD devices, the PVs of VGs, the VG of
+LVs and the device containing partitions.
+
+If LVM2 is available, this needs LVM2 E<ge> 2.02.158, as for
+C<guestfs_lvm_report>." };
+
+  { defaults with
+    name = "internal_readdir"; added = (1, 35, 20);
+    style = RErr, [Pathname "dir"; FileOut "filename"], [];
+    proc_nr = Some 513;
+    visibility = VInternal;
+    shortdesc = "read directories entries";
     longdesc = "\
-Set the disk identifier (GUID) of a GPT-partitioned C<device> to
-a randomly generated value.
-Return an error if the partition table of C<device> isn't GPT." };
+This is the internal call which implements C<guestfs_readdir>.
+The entries are written to F<filename> as a stream of XDR-encoded
+C<guestfs_int_dirent> structures." };
 
   { defaults with
-    name = "part_expand_gpt"; added = (1, 33, 2);
-    style = RErr, [Device "device"], [];
-    proc_nr = Some 462;
-    optional = Some "gdisk";
-    shortdesc = "move backup GPT header to the end of the disk";
+    name = "internal_lstatnslist_packed"; added = (1, 35, 20);
+    style = RBufferOut "statbufs", [Pathname "path"; FilenameList "names"], [];
+    proc_nr = Some 514;
+    visibility = VInternal;
+    shortdesc = "lstat on multiple files";
     longdesc = "\
-Move backup GPT data structures to the end of the disk.
-This is useful in case of in-place image expand
-since disk space after backup GPT header is not usable.
-This is equivalent to C<sgdisk -e>.
+This is the internal call which implements C<guestfs_lstatnslist>.
 
-See also L<sgdisk(8)>." };
+For each name, it returns the fields of the C<guestfs_statns>
+struct in order, each encoded as a variable length integer: the
+value is zigzag encoded (so that small negative numbers are small
+too), then written 7 bits at a time starting with the lowest bits,
+with the top bit of each byte set if more bytes follow.  Since most
+fields are small or zero, this is several times smaller than the
+XDR encoding of the struct list." };
 
   { defaults with
-    name = "ntfscat_i"; added = (1, 33, 14);
-    style = RErr, [Mountable "device"; Int64 "inode"; FileOut "filename"], [];
-    proc_nr = Some 463;
-    progress = true; cancellable = true;
-    shortdesc = "download a file to the local machine given its inode";
+    name = "luks_open_volume_key"; added = (1, 35, 20);
+    style = RErr, [Device "device"; Key "volumekey"; String "mapname"], [];
+    proc_nr = Some 515;
+    optional = Some "luks";
+    reentrant = true;
+    shortdesc = "open a LUKS-encrypted block device with its volume key";
     longdesc = "\
-Download a file given its inode from a NTFS filesystem and save it as
-F<filename> on the local machine.
-
-This allows to download some otherwise inaccessible files such as the ones
-within the C<$Extend> folder.
+This is the same as C<guestfs_luks_open>, but instead of a
+passphrase which unlocks one of the key slots, C<volumekey> is the
+volume key (master key) of the device, written in hexadecimal (the
+spaces, newlines and colons printed by
+S<C<cryptsetup luksDump --dump-master-key>> are allowed).
 
-The filesystem from which to extract the file must be unmounted,
-otherwise the call will fail." };
+Opening a device with a passphrase has to derive the key of the
+slot from it, which is deliberately slow.  With the volume key this
+is skipped, so programs which keep the volume keys of the guests
+they process can open the devices much faster." };
 
   { defaults with
-    name = "download_inode"; added = (1, 33, 14);
-    style = RErr, [Mountable "device"; Int64 "inode"; FileOut "filename"], [];
-    proc_nr = Some 464;
-    optional = Some "sleuthkit";
-    progress = true; cancellable = true;
-    shortdesc = "download a file to the local machine given its inode";
+    name = "internal_initrd_arch"; added = (1, 35, 20);
+    style = RString "arch", [Pathname "path"], [];
+    proc_nr = Some 516;
+    visibility = VInternal;
+    shortdesc = "detect the architecture of an initrd";
     longdesc = "\
-Download a file given its inode from the disk partition
-(eg. F</dev/sda1>) and save it as F<filename> on the local machine.
-
-It is not required to mount the disk to run this command.
-
-The command is capable of downloading deleted or inaccessible files." };
+This returns the architecture of the binaries in the initrd
+(a cpio archive, which may be compressed with gzip, bzip2 or xz)
+F<path>, for C<guestfs_file_architecture>.  Only the headers of
+the binaries are read, the archive is uncompressed as a stream
+and not stored anywhere." };
 
   { defaults with
-    name = "btrfs_filesystem_show"; added = (1, 33, 29);
-    style = RStringList "devices", [Device "device"], [];
-    proc_nr = Some 465;
-    optional = Some "btrfs"; camel_name = "BTRFSFilesystemsShow";
+    name = "case_sensitive_paths"; added = (1, 35, 20);
+    style = RStringList "rpaths", [StringList "paths"], [];
+    proc_nr = Some 517;
     tests = [
-      InitScratchFS, Always, TestLastFail (
-        [["btrfs_filesystem_show"; "/dev/sdb"]]), [];
-      InitPartition, Always, TestResult (
-        [["mkfs_btrfs"; "/dev/sda1"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["btrfs_filesystem_show"; "/dev/sda1"]],
-         "is_string_list (ret, 1, \"/dev/sda1\")"), [];
-      InitEmpty, Always, TestResult (
-        [["part_init"; "/dev/sda"; "mbr"];
-         ["part_add"; "/dev/sda"; "p"; "64"; "2047999"];
-         ["part_add"; "/dev/sda"; "p"; "2048000"; "4095999"];
-         ["mkfs_btrfs"; "/dev/sda1 /dev/sda2"; ""; ""; "NOARG"; ""; "NOARG"; "NOARG"; ""; ""];
-         ["btrfs_filesystem_show"; "/dev/sda1"]],
-         "is_string_list (ret, 2, \"/dev/sda1\", \"/dev/sda2\")"), [];
+      InitISOFS, Always, TestResult (
+        [["case_sensitive_paths"; "/DIRECTORY /Known-1 /known-1/nothere"]],
+        "is_string_list (ret, 3, \"/directory\", \"/known-1\", \"\")"), [];
     ];
-    shortdesc = "list devices for btrfs filesystem";
+    shortdesc = "return true paths for many case-insensitive paths";
     longdesc = "\
-Show all the devices where the filesystems in C<device> is spanned over.
+This is the same as calling C<guestfs_case_sensitive_path> on each
+of the absolute C<paths>, but in a single call.
 
-If not all the devices for the filesystems are present, then this function
-fails and the C<errno> is set to C<ENODEV>." };
+The list returned has one entry for each path.  Where a path
+cannot be resolved, the entry is the empty string, instead of
+the call failing.
 
-  { defaults with
-    name = "internal_filesystem_walk"; added = (1, 33, 39);
-    style = RErr, [Mountable "device"; FileOut "filename"], [];
-    proc_nr = Some 466;
-    visibility = VInternal;
-    optional = Some "libtsk";
-    shortdesc = "walk through the filesystem content";
-    longdesc = "Internal function for filesystem_walk." };
+The daemon keeps the names in the directories it has read recently,
+so resolving many paths under the same directories (as when
+converting Windows guests) is much faster than reading the
+directories again for each path." };
 
   { defaults with
-    name = "selinux_relabel"; added = (1, 33, 43);
-    style = RErr, [String "specfile"; Pathname "path"], [OBool "force"];
-    proc_nr = Some 467;
-    optional = Some "selinuxrelabel";
-    test_excuse = "tests are in the tests/relabel directory";
-    shortdesc = "relabel parts of the filesystem";
+    name = "hivex_import"; added = (1, 35, 20);
+    style = RErr, [Int64 "nodeh"; BufferIn "data"], [];
+    proc_nr = Some 518;
+    optional = Some "hivex";
+    shortdesc = "add many keys and values to the hive";
     longdesc = "\
-SELinux relabel parts of the filesystem.
+Add a tree of keys and values below the node C<nodeh> of the
+currently open hive.  This does the same as walking the tree with
+C<guestfs_hivex_node_get_child>, C<guestfs_hivex_node_add_child> and
+C<guestfs_hivex_node_set_value>, but in a single call, setting all
+the values of each node at once.
 
-The C<specfile> parameter controls the policy spec file used.
-You have to parse C</etc/selinux/config> to find the correct
-SELinux policy and then pass the spec file, usually:
-C</etc/selinux/> + I<selinuxtype> + C</contexts/files/file_contexts>.
+C<data> is a sequence of keys in a packed binary form, where each
+integer is an unsigned 32 bit little endian number, and each string
+is an integer length followed by that many bytes:
 
-The required C<path> parameter is the top level directory where
-relabelling starts.  Normally you should pass C<path> as C</>
-to relabel the whole guest filesystem.
+=over 4
 
-The optional C<force> boolean controls whether the context
-is reset for customizable files, and also whether the
-user, role and range parts of the file context is changed." };
+=item *
 
-  { defaults with
-    name = "download_blocks"; added = (1, 33, 45);
-    style = RErr, [Mountable "device"; Int64 "start"; Int64 "stop"; FileOut "filename"], [OBool "unallocated"];
-    proc_nr = Some 468;
-    optional = Some "sleuthkit";
-    progress = true; cancellable = true;
-    shortdesc = "download the given data units from the disk";
-    longdesc = "\
-Download the data units from F<start> address
-to F<stop> from the disk partition (eg. F</dev/sda1>)
-and save them as F<filename> on the local machine.
+The number of path elements, followed by the path elements (strings)
+of the key relative to C<nodeh>.  Nodes on the path which do not
+exist are created.
 
-The use of this API on sparse disk image formats such as QCOW,
-may result in large zero-filled files downloaded on the host.
+=item *
 
-The size of a data unit varies across filesystem implementations.
-On NTFS filesystems data units are referred as clusters
-while on ExtX ones they are referred as fragments.
+The number of values, followed by the name (a string), type (an
+integer) and data (a string) of each value.  A value which already
+exists with the same name is replaced.  Other existing values of the
+node are kept.
 
-If the optional C<unallocated> flag is true (default is false),
-only the unallocated blocks will be extracted.
-This is useful to detect hidden data or to retrieve deleted files
-which data units have not been overwritten yet." };
+=back
 
-  { defaults with
-    name = "aug_transform"; added = (1, 35, 2);
-    style = RErr, [String "lens"; String "file"], [ OBool "remove"];
-    proc_nr = Some 469;
-    shortdesc = "add/remove an Augeas lens transformation";
+As with the other hivex calls, the changes are not written to the
+hive until you call C<guestfs_hivex_commit>." };
+
+  { defaults with
+    name = "ext_inventory"; added = (1, 35, 20);
+    style = RErr, [Device "device"; FileOut "filename"], [];
+    proc_nr = Some 519;
+    optional = Some "libext2fs";
+    shortdesc = "list the files of an ext2/3/4 filesystem without mounting it";
+    longdesc = "\
+List every file and directory of the ext2, ext3 or ext4 filesystem
+on C<device>, writing the list to the local file C<filename>.
+
+The filesystem is not mounted.  Instead the inode tables and then
+the directory blocks are read directly, in the order they are
+stored on the disk, using large reads with readahead.  This is much
+faster than C<guestfs_find0> on a mounted filesystem or
+C<guestfs_filesystem_walk>, especially on rotational or networked
+storage.  The journal is not replayed, so changes which are only in
+the journal (of a filesystem which was not cleanly unmounted) are
+not seen.  Do not use this on a filesystem which is mounted
+read-write.
+
+Each entry is written as the absolute path of the file, the inode
+number, the mode (as in C<guestfs_statns>, including the file type
+bits), the size in bytes, and the access, modification and status
+change times in seconds since the epoch.  Numbers are written in
+decimal.  Every field is followed by an ASCII NUL character, so each
+entry is exactly 7 NUL-terminated strings.
+
+The root directory is listed first as F</>.  The other entries are
+in the order of the directory blocks on the disk, not sorted.  A
+file with several hard links is listed once for each link." };
+
+  { defaults with
+    name = "ntfs_inventory"; added = (1, 35, 20);
+    style = RErr, [Device "device"; FileOut "filename"], [];
+    proc_nr = Some 520;
+    shortdesc = "list the files of an NTFS filesystem without mounting it";
+    longdesc = "\
+List every file and directory of the NTFS filesystem on C<device>,
+writing the list to the local file C<filename>.
+
+The filesystem is not mounted.  Instead the master file table
+(C<$MFT>) is read directly from start to end, using large reads,
+and the paths are worked out from the file name records.  This is
+much faster than listing the files of a filesystem mounted with
+ntfs-3g, where every lookup is a round trip through FUSE.  Do not
+use this on a filesystem which is mounted read-write.
+
+Each entry is written as the absolute path of the file (with C</>
+as the separator), the MFT record number, the Windows file
+attributes (C<FILE_ATTRIBUTE_*>), the size of the unnamed data
+stream in bytes, and the creation, modification and access times in
+seconds since the Unix epoch.  Numbers are written in decimal.
+Every field is followed by an ASCII NUL character, so each entry is
+exactly 7 NUL-terminated strings.
+
+The root directory is listed first as F</>.  The other entries are
+in the order of the MFT, not sorted.  The NTFS metadata files
+(C<$MFT>, C<$Extend> and so on) and the short DOS names of files are
+not listed.  A file with several hard links is listed once for each
+link." };
+
+  { defaults with
+    name = "zero_devices"; added = (1, 35, 20);
+    style = RErr, [DeviceList "devices"], [];
+    proc_nr = Some 521;
+    progress = true;
+    tests = [
+      InitEmpty, Always, TestResultTrue (
+        [["zero_devices"; "/dev/sda /dev/sdb"];
+         ["is_zero_device"; "/dev/sdb"]]), []
+    ];
+    shortdesc = "write zeroes to several entire devices at once";
     longdesc = "\
-Add an Augeas transformation for the specified C<lens> so it can
-handle C<file>.
+This is the same as calling C<guestfs_zero_device> on each of
+C<devices>, but the devices are zeroed at the same time.
 
-If C<remove> is true (C<false> by default), then the transformation
-is removed." };
+Where a device supports discarding blocks or a \"write zeroes\"
+request, it is zeroed by a separate thread in the appliance, so
+zeroing many devices takes about as long as zeroing the largest one.
+Devices which support neither are zeroed one after another
+afterwards, as by C<guestfs_zero_device>.
+
+The progress notifications cover all of the devices together." };
 
   { defaults with
-    name = "internal_find_inode"; added = (1, 35, 6);
-    style = RErr, [Mountable "device"; Int64 "inode"; FileOut "filename";], [];
-    proc_nr = Some 470;
+    name = "internal_set_chunk_codec"; added = (1, 35, 20);
+    style = RInt "codecs", [Int "codecs"], [];
+    proc_nr = Some 522;
     visibility = VInternal;
-    optional = Some "libtsk";
-    shortdesc = "search the entries associated to the given inode";
-    longdesc = "Internal function for find_inode." };
+    shortdesc = "negotiate compression of file transfer chunks";
+    longdesc = "\
+This is called by the library just after launch when the appliance
+is remote, to ask the daemon to encode C<FileIn> and C<FileOut>
+chunks more compactly.  C<codecs> is a bitmask of
+C<GUESTFS_CODEC_ZERO> (chunks of zero bytes are sent as holes) and
+C<GUESTFS_CODEC_ZSTD> (other chunks may be compressed with zstd).
+The daemon returns the subset which it supports, and from then on
+both sides may send chunks using those codecs.  Appliances which do
+not implement this call continue to send plain chunks." };
 
 ]
 
@@ -42,6 +42,19 @@ let is_public { visibility = v } = match v with
 
 let is_private f = not (is_public f)
 
+(* Daemon functions which can also be called asynchronously, using
+ * guestfs_submit_<name> and guestfs_wait_<name>.  Calls which
+ * transfer files or take optional arguments are not supported.
+ *)
+let is_async = function
+  | { proc_nr = None } -> false
+  | { deprecated_by = Some _ } -> false
+  | { style = _, _, (_::_) } -> false
+  | { style = _, args, [] } as f ->
+    is_public f &&
+      not (List.exists (function FileIn _ | FileOut _ -> true | _ -> false)
+             args)
+
 let public_functions_sorted =
   List.filter is_public (actions |> sort)
 
@@ -529,6 +542,7 @@ typedef void (*guestfs_event_callback) (
 #endif
 
 #define GUESTFS_HAVE_SET_EVENT_CALLBACK 1
+#define GUESTFS_EVENT_CALLBACK_BUFFERED 1
 extern GUESTFS_DLL_PUBLIC int guestfs_set_event_callback (guestfs_h *g, guestfs_event_callback cb, uint64_t event_bitmask, int flags, void *opaque);
 #define GUESTFS_HAVE_DELETE_EVENT_CALLBACK 1
 extern GUESTFS_DLL_PUBLIC void guestfs_delete_event_callback (guestfs_h *g, int event_handle);
@@ -584,6 +598,14 @@ extern GUESTFS_DLL_PUBLIC void *guestfs_first_private (guestfs_h *g, const char
 #define GUESTFS_HAVE_NEXT_PRIVATE 1
 extern GUESTFS_DLL_PUBLIC void *guestfs_next_private (guestfs_h *g, const char **key_rtn);
 
+/* Reading into a buffer supplied by the caller. */
+#define GUESTFS_HAVE_PREAD_INTO 1
+extern GUESTFS_DLL_PUBLIC int64_t guestfs_pread_into (guestfs_h *g, const char *path, void *buf, size_t count, int64_t offset);
+#define GUESTFS_HAVE_PREAD_DEVICE_INTO 1
+extern GUESTFS_DLL_PUBLIC int64_t guestfs_pread_device_into (guestfs_h *g, const char *device, void *buf, size_t count, int64_t offset);
+#define GUESTFS_HAVE_READ_FILE_INTO 1
+extern GUESTFS_DLL_PUBLIC int64_t guestfs_read_file_into (guestfs_h *g, const char *path, void *buf, size_t size);
+
 /* Structures. */
 ";
 
@@ -718,6 +740,26 @@ extern GUESTFS_DLL_PUBLIC void *guestfs_next_private (guestfs_h *g, const char *
 
   generate_all_headers public_functions_sorted;
 
+  pr "\
+/* Asynchronous calls.  See \"ASYNCHRONOUS CALLS\" in guestfs(3). */
+#define GUESTFS_HAVE_ASYNC_CALLS 1
+
+";
+
+  List.iter (
+    fun { name = shortname; style = ret, args, _ } ->
+      let uc_shortname = String.uppercase_ascii shortname in
+      pr "#define GUESTFS_HAVE_SUBMIT_%s 1\n" uc_shortname;
+      generate_prototype ~single_line:true ~newline:true ~dll_public:true
+        ~handle:"g" ~prefix:"guestfs_submit_" shortname
+        (RInt "serial", args, []);
+      pr "#define GUESTFS_HAVE_WAIT_%s 1\n" uc_shortname;
+      generate_prototype ~single_line:true ~newline:true ~dll_public:true
+        ~handle:"g" ~prefix:"guestfs_wait_" shortname
+        (ret, [Int "serial"], []);
+      pr "\n"
+  ) (List.filter is_async public_functions_sorted);
+
   pr "\
 #if GUESTFS_PRIVATE
 /* Symbols protected by GUESTFS_PRIVATE are NOT part of the public,
@@ -1779,6 +1821,50 @@ and generate_client_actions actions () =
       () (* no wrapper *)
   ) (actions |> non_daemon_functions);
 
+  (* Convert the XDR reply 'ret' into the value 'ret_v' which is
+   * returned to the caller.
+   *)
+  let generate_ret_v ret =
+    match ret with
+    | RErr ->
+      pr "  ret_v = 0;\n"
+    | RInt n | RInt64 n | RBool n ->
+      pr "  ret_v = ret.%s;\n" n
+    | RConstString _ | RConstOptString _ ->
+      failwithf "RConstString|RConstOptString cannot be used by daemon functions"
+    | RString n ->
+      pr "  ret_v = ret.%s; /* caller will free */\n" n
+    | RStringList n | RHashtable n ->
+      pr "  /* caller will free this, but we need to add a NULL entry */\n";
+      pr "  ret.%s.%s_val =\n" n n;
+      pr "    safe_realloc (g, ret.%s.%s_val,\n" n n;
+      pr "                  sizeof (char *) * (ret.%s.%s_len + 1));\n"
+        n n;
+      pr "  ret.%s.%s_val[ret.%s.%s_len] = NULL;\n" n n n n;
+      pr "  ret_v = ret.%s.%s_val;\n" n n
+    | RStruct (n, _) ->
+      pr "  /* caller will free this */\n";
+      pr "  ret_v = safe_memdup (g, &ret.%s, sizeof (ret.%s));\n" n n
+    | RStructList (n, _) ->
+      pr "  /* caller will free this */\n";
+      pr "  ret_v = safe_memdup (g, &ret.%s, sizeof (ret.%s));\n" n n
+    | RBufferOut n ->
+      pr "  /* RBufferOut is tricky: If the buffer is zero-length, then\n";
+      pr "   * _val might be NULL here.  To make the API saner for\n";
+      pr "   * callers, we turn this case into a unique pointer (using\n";
+      pr "   * malloc(1)).\n";
+      pr "   */\n";
+      pr "  if (ret.%s.%s_len > 0) {\n" n n;
+      pr "    *size_r = ret.%s.%s_len;\n" n n;
+      pr "    ret_v = ret.%s.%s_val; /* caller will free */\n" n n;
+      pr "  } else {\n";
+      pr "    free (ret.%s.%s_val);\n" n n;
+      pr "    char *p = safe_malloc (g, 1);\n";
+      pr "    *size_r = ret.%s.%s_len;\n" n n;
+      pr "    ret_v = p;\n";
+      pr "  }\n"
+  in
+
   (* Client-side stubs for each function. *)
   let generate_daemon_stub { name = name; c_name = c_name;
                              style = ret, args, optargs as style } =
@@ -1961,7 +2047,7 @@ and generate_client_actions actions () =
         pr "  if (r == -1) {\n";
         trace_return_error ~indent:4 name style errcode;
         pr "    /* daemon will send an error reply which we discard */\n";
-        pr "    guestfs_int_recv_discard (g, \"%s\");\n" name;
+        pr "    guestfs_int_recv_discard (g, \"%s\", serial);\n" name;
         pr "    return %s;\n" (string_of_errcode errcode);
         pr "  }\n";
         pr "  if (r == -2) /* daemon cancelled */\n";
@@ -1977,7 +2063,7 @@ and generate_client_actions actions () =
     pr "  memset (&err, 0, sizeof err);\n";
     if has_ret then pr "  memset (&ret, 0, sizeof ret);\n";
     pr "\n";
-    pr "  r = guestfs_int_recv (g, \"%s\", &hdr, &err,\n        " name;
+    pr "  r = guestfs_int_recv (g, \"%s\", serial, &hdr, &err,\n        " name;
     if not has_ret then
       pr "NULL, NULL"
     else
@@ -2028,53 +2114,137 @@ and generate_client_actions actions () =
       | _ -> ()
     ) args;
 
+    generate_ret_v ret;
+    trace_return name style "ret_v";
+    pr "  return ret_v;\n";
+    pr "}\n\n"
+  in
+
+  (* Asynchronous stubs, guestfs_submit_<name> and guestfs_wait_<name>.
+   * These are only generated for the simple functions selected by
+   * is_async, so there are no optional arguments or files to transfer.
+   * They don't generate trace or enter events.
+   *)
+  let generate_async_stubs { name = name; c_name = c_name;
+                             style = ret, args, _ } =
+    let errcode =
+      match errcode_of_ret ret with
+      | `CannotReturnError -> assert false
+      | (`ErrorIsMinusOne | `ErrorIsNULL) as e -> e in
+
+    generate_prototype ~extern:false ~semicolon:false ~newline:true
+      ~handle:"g" ~prefix:"guestfs_submit_"
+      ~dll_public:true
+      c_name (RInt "serial", args, []);
+
+    pr "{\n";
+    if args <> [] then
+      pr "  struct guestfs_%s_args args;\n" name;
+    pr "\n";
+    check_null_strings c_name (RInt "serial", args, []);
+    check_args_validity c_name (RInt "serial", args, []);
+
+    pr "  if (guestfs_int_check_appliance_up (g, \"%s\") == -1)\n" name;
+    pr "    return -1;\n";
+    pr "\n";
+
+    List.iter (
+      function
+      | Pathname n | Device n | Mountable n | Dev_or_Path n
+      | Mountable_or_Path n | String n
+      | Key n | GUID n ->
+        pr "  args.%s = (char *) %s;\n" n n
+      | OptString n ->
+        pr "  args.%s = %s ? (char **) &%s : NULL;\n" n n n
+      | StringList n | DeviceList n | FilenameList n ->
+        pr "  args.%s.%s_val = (char **) %s;\n" n n n;
+        pr "  for (args.%s.%s_len = 0; %s[args.%s.%s_len]; args.%s.%s_len++) ;\n" n n n n n n n;
+      | Bool n | Int n | Int64 n ->
+        pr "  args.%s = %s;\n" n n
+      | BufferIn n ->
+        pr "  if (%s_size >= GUESTFS_MESSAGE_MAX) {\n" n;
+        pr "    error (g, \"%%s: size of input buffer too large\", \"%s\");\n"
+          name;
+        pr "    return -1;\n";
+        pr "  }\n";
+        pr "  args.%s.%s_val = (char *) %s;\n" n n n;
+        pr "  args.%s.%s_len = %s_size;\n" n n n
+      | FileIn _ | FileOut _ | Pointer _ -> assert false
+    ) args;
+    if args <> [] then pr "\n";
+
+    pr "  return guestfs_int_submit (g, GUESTFS_PROC_%s,\n"
+      (String.uppercase_ascii name);
+    if args = [] then
+      pr "                             NULL, NULL);\n"
+    else
+      pr "                             (xdrproc_t) xdr_guestfs_%s_args, (char *) &args);\n"
+        name;
+    pr "}\n\n";
+
+    generate_prototype ~extern:false ~semicolon:false ~newline:true
+      ~handle:"g" ~prefix:"guestfs_wait_"
+      ~dll_public:true
+      c_name (ret, [Int "serial"], []);
+
+    pr "{\n";
+    pr "  guestfs_message_header hdr;\n";
+    pr "  guestfs_message_error err;\n";
+    let has_ret = ret <> RErr in
+    if has_ret then
+      pr "  struct guestfs_%s_ret ret;\n" name;
     (match ret with
-    | RErr ->
-      pr "  ret_v = 0;\n"
-    | RInt n | RInt64 n | RBool n ->
-      pr "  ret_v = ret.%s;\n" n
-    | RConstString _ | RConstOptString _ ->
-      failwithf "RConstString|RConstOptString cannot be used by daemon functions"
-    | RString n ->
-      pr "  ret_v = ret.%s; /* caller will free */\n" n
-    | RStringList n | RHashtable n ->
-      pr "  /* caller will free this, but we need to add a NULL entry */\n";
-      pr "  ret.%s.%s_val =\n" n n;
-      pr "    safe_realloc (g, ret.%s.%s_val,\n" n n;
-      pr "                  sizeof (char *) * (ret.%s.%s_len + 1));\n"
-        n n;
-      pr "  ret.%s.%s_val[ret.%s.%s_len] = NULL;\n" n n n n;
-      pr "  ret_v = ret.%s.%s_val;\n" n n
-    | RStruct (n, _) ->
-      pr "  /* caller will free this */\n";
-      pr "  ret_v = safe_memdup (g, &ret.%s, sizeof (ret.%s));\n" n n
-    | RStructList (n, _) ->
-      pr "  /* caller will free this */\n";
-      pr "  ret_v = safe_memdup (g, &ret.%s, sizeof (ret.%s));\n" n n
-    | RBufferOut n ->
-      pr "  /* RBufferOut is tricky: If the buffer is zero-length, then\n";
-      pr "   * _val might be NULL here.  To make the API saner for\n";
-      pr "   * callers, we turn this case into a unique pointer (using\n";
-      pr "   * malloc(1)).\n";
-      pr "   */\n";
-      pr "  if (ret.%s.%s_len > 0) {\n" n n;
-      pr "    *size_r = ret.%s.%s_len;\n" n n;
-      pr "    ret_v = ret.%s.%s_val; /* caller will free */\n" n n;
-      pr "  } else {\n";
-      pr "    free (ret.%s.%s_val);\n" n n;
-      pr "    char *p = safe_malloc (g, 1);\n";
-      pr "    *size_r = ret.%s.%s_len;\n" n n;
-      pr "    ret_v = p;\n";
-      pr "  }\n";
+    | RErr | RInt _ | RBool _ -> pr "  int ret_v;\n"
+    | RInt64 _ -> pr "  int64_t ret_v;\n"
+    | RConstString _ | RConstOptString _ -> assert false
+    | RString _ | RBufferOut _ -> pr "  char *ret_v;\n"
+    | RStringList _ | RHashtable _ -> pr "  char **ret_v;\n"
+    | RStruct (_, typ) -> pr "  struct guestfs_%s *ret_v;\n" typ
+    | RStructList (_, typ) -> pr "  struct guestfs_%s_list *ret_v;\n" typ
     );
-    trace_return name style "ret_v";
+    pr "\n";
+    pr "  memset (&hdr, 0, sizeof hdr);\n";
+    pr "  memset (&err, 0, sizeof err);\n";
+    if has_ret then pr "  memset (&ret, 0, sizeof ret);\n";
+    pr "\n";
+    pr "  if (guestfs_int_wait (g, \"%s\", serial, &hdr, &err,\n        " name;
+    if not has_ret then
+      pr "NULL, NULL"
+    else
+      pr "(xdrproc_t) xdr_guestfs_%s_ret, (char *) &ret" name;
+    pr ") == -1)\n";
+    pr "    return %s;\n" (string_of_errcode errcode);
+    pr "\n";
+    pr "  if (guestfs_int_check_reply_header (g, &hdr, GUESTFS_PROC_%s, serial) == -1)\n"
+      (String.uppercase_ascii name);
+    pr "    return %s;\n" (string_of_errcode errcode);
+    pr "\n";
+    pr "  if (hdr.status == GUESTFS_STATUS_ERROR) {\n";
+    pr "    int errnum = 0;\n";
+    pr "\n";
+    pr "    if (err.errno_string[0] != '\\0')\n";
+    pr "      errnum = guestfs_int_string_to_errno (err.errno_string);\n";
+    pr "    if (errnum <= 0)\n";
+    pr "      error (g, \"%%s: %%s\", \"%s\", err.error_message);\n"
+      name;
+    pr "    else\n";
+    pr "      guestfs_int_error_errno (g, errnum, \"%%s: %%s\", \"%s\",\n"
+      name;
+    pr "                               err.error_message);\n";
+    pr "    free (err.error_message);\n";
+    pr "    free (err.errno_string);\n";
+    pr "    return %s;\n" (string_of_errcode errcode);
+    pr "  }\n";
+    pr "\n";
+    generate_ret_v ret;
     pr "  return ret_v;\n";
     pr "}\n\n"
   in
 
   List.iter (
     fun f ->
-      generate_daemon_stub f
+      generate_daemon_stub f;
+      if is_async f then generate_async_stubs f
   ) (actions |> daemon_functions)
 
 (* Functions which have optional arguments have two or three
@@ -2313,7 +2483,10 @@ and generate_linker_script () =
     "guestfs_last_error";
     "guestfs_next_private";
     "guestfs_pop_error_handler";
+    "guestfs_pread_device_into";
+    "guestfs_pread_into";
     "guestfs_push_error_handler";
+    "guestfs_read_file_into";
     "guestfs_set_close_callback";
     "guestfs_set_error_handler";
     "guestfs_set_event_callback";
@@ -2342,6 +2515,13 @@ and generate_linker_script () =
              "guestfs_" ^ c_name ^ "_argv"]
       ) actions
     ) in
+  let async_functions =
+    List.flatten (
+      List.map (
+        fun { c_name = c_name } ->
+          ["guestfs_submit_" ^ c_name; "guestfs_wait_" ^ c_name]
+      ) (List.filter is_async actions)
+    ) in
   let struct_frees =
     List.concat (
       List.map (fun { s_name = typ } ->
@@ -2355,6 +2535,7 @@ and generate_linker_script () =
     ) in
   let globals = List.sort compare (globals @
                                      functions @
+                                     async_functions @
                                      struct_frees) in
 
   pr "{\n";
@@ -18,6 +18,10 @@
 
 type optarg_proto = Dots | VA | Argv
 
+val is_async : Types.action -> bool
+(** Daemon functions which can also be called asynchronously, using
+    [guestfs_submit_<name>] and [guestfs_wait_<name>]. *)
+
 val generate_prototype : ?extern:bool -> ?static:bool -> ?semicolon:bool -> ?single_line:bool -> ?indent:string -> ?newline:bool -> ?in_daemon:bool -> ?dll_public:bool -> ?attribute_noreturn:bool -> ?prefix:string -> ?suffix:string -> ?handle:string -> ?optarg_proto:optarg_proto -> string -> Types.style -> unit
 
 val generate_c_call_args : ?handle:string -> ?implicit_size_ptr:string -> ?in_daemon:bool -> Types.ret * Types.args * Types.optargs -> unit
@@ -239,6 +239,22 @@ let () =
     | { blocking = true } -> ()
   ) (actions |> daemon_functions);
 
+  (* Check reentrant functions are daemon functions which don't
+   * transfer files, since FileIn/FileOut use the socket directly.
+   *)
+  List.iter (
+    function
+    | { name = name; reentrant = true; proc_nr = None } ->
+      failwithf "%s: reentrant flag can only be set on daemon functions"
+        name
+    | { name = name; reentrant = true; style = _, args, _ }
+        when List.exists (function FileIn _ | FileOut _ -> true | _ -> false)
+               args ->
+      failwithf "%s: reentrant functions cannot have FileIn or FileOut parameters"
+        name
+    | _ -> ()
+  ) actions;
+
   (* Check wrapper flag is set on all daemon functions. *)
   List.iter (
     function
@@ -524,6 +524,7 @@ and flag_type =
 | FlagBool of bool                  (* boolean is the default value *)
 | FlagPasswordCrypto of string
 | FlagSMCredentials of string
+| FlagString of string              (* string, default is None *)
 
 let flags = [
   { flag_name = "no-logfile";
@@ -538,6 +539,25 @@ the image was built, use this option.
 See also: L</LOG FILE>.";
   };
 
+  { flag_name = "package-cache";
+    flag_type = FlagString "DIR";
+    flag_ml_var = "package_cache";
+    flag_shortdesc = "Cache downloaded packages in DIR";
+    flag_pod_longdesc = "\
+Keep the packages downloaded by I<--install> and I<--update> in the
+host directory C<DIR>, and reuse them the next time a guest of the
+same distribution, version and architecture is customized, so that
+only new or updated packages have to be fetched over the network.
+
+The packages are copied into the guest's package cache before the
+first installation, and copied back to C<DIR> after the last one,
+after which the guest's package cache is cleaned so the packages do
+not end up in the image.  C<DIR> is created if it does not exist.
+
+This is currently supported for guests using C<apt>, C<dnf> or
+C<yum>.  For other guests the option is ignored with a warning.";
+  };
+
   { flag_name = "password-crypto";
     flag_type = FlagPasswordCrypto "md5|sha256|sha512";
     flag_ml_var = "password_crypto";
@@ -645,6 +665,8 @@ let rec argspec () =
       pr "  let %s = ref None in\n" var
     | { flag_type = FlagSMCredentials _; flag_ml_var = var } ->
       pr "  let %s = ref None in\n" var
+    | { flag_type = FlagString _; flag_ml_var = var } ->
+      pr "  let %s = ref None in\n" var
   ) flags;
   pr "\
 
@@ -847,6 +869,18 @@ let rec argspec () =
       pr "      s_\"%s\"\n" shortdesc;
       pr "    ),\n";
       pr "    Some %S, %S;\n" v longdesc
+    | { flag_type = FlagString v; flag_ml_var = var;
+        flag_name = name; flag_shortdesc = shortdesc;
+        flag_pod_longdesc = longdesc } ->
+      pr "    (\n";
+      pr "      [ L\"%s\" ],\n" name;
+      pr "      Getopt.String (\n";
+      pr "        s_\"%s\",\n" v;
+      pr "        fun s -> %s := Some s\n" var;
+      pr "      ),\n";
+      pr "      s_\"%s\"\n" shortdesc;
+      pr "    ),\n";
+      pr "    Some %S, %S;\n" v longdesc
   ) flags;
 
   pr "  ]
@@ -966,6 +1000,8 @@ type ops = {
         flag_name = name } ->
       pr "  %s : Subscription_manager.sm_credentials option;\n      (* --%s %s *)\n"
         var name v
+    | { flag_type = FlagString v; flag_ml_var = var; flag_name = name } ->
+      pr "  %s : string option;\n      (* --%s %s *)\n" var name v
   ) flags;
   pr "}\n"
 
@@ -989,7 +1025,7 @@ let generate_customize_synopsis_pod () =
           n, sprintf "[--%s]" n
         | { flag_type = FlagPasswordCrypto v; flag_name = n } ->
           n, sprintf "[--%s %s]" n v
-        | { flag_type = FlagSMCredentials v; flag_name = n } ->
+        | { flag_type = FlagSMCredentials v | FlagString v; flag_name = n } ->
           n, sprintf "[--%s %s]" n v
       ) flags in
 
@@ -1033,7 +1069,7 @@ let generate_customize_options_pod () =
         | { flag_type = FlagPasswordCrypto v;
             flag_name = n; flag_pod_longdesc = ld } ->
           n, sprintf "B<--%s> %s" n v, ld
-        | { flag_type = FlagSMCredentials v;
+        | { flag_type = FlagSMCredentials v | FlagString v;
             flag_name = n; flag_pod_longdesc = ld } ->
           n, sprintf "B<--%s> %s" n v, ld
       ) flags in
@@ -760,6 +760,36 @@ let generate_daemon_names () =
       pr "  [%d] = \"%s\",\n" proc_nr name
     | { proc_nr = None } -> assert false
   ) (actions |> daemon_functions);
+  pr "};\n";
+  pr "\n";
+
+  pr "/* This array is indexed by proc_nr.  Functions marked here may be\n";
+  pr " * dispatched to a worker thread (see guestfsd --workers).\n";
+  pr " */\n";
+  pr "const char reentrant_functions[GUESTFS_MAX_PROC_NR+1] = {\n";
+  List.iter (
+    function
+    | { name = name; proc_nr = Some proc_nr; reentrant = true } ->
+      pr "  [%d] = 1, /* %s */\n" proc_nr name
+    | { reentrant = false } -> ()
+    | { proc_nr = None } -> assert false
+  ) (actions |> daemon_functions);
+  pr "};\n";
+  pr "\n";
+
+  pr "/* This array is indexed by proc_nr.  Functions marked here have\n";
+  pr " * FileIn parameters, so the daemon socket carries the file data\n";
+  pr " * while they run (see call_cancelled).\n";
+  pr " */\n";
+  pr "const char filein_functions[GUESTFS_MAX_PROC_NR+1] = {\n";
+  List.iter (
+    function
+    | { name = name; proc_nr = Some proc_nr; style = _, args, _ }
+        when List.exists (function FileIn _ -> true | _ -> false) args ->
+      pr "  [%d] = 1, /* %s */\n" proc_nr name
+    | { proc_nr = Some _ } -> ()
+    | { proc_nr = None } -> assert false
+  ) (actions |> daemon_functions);
   pr "};\n"
 
 (* Generate the optional groups for the daemon to implement
@@ -39,6 +39,8 @@ let rec generate_erlang_erl () =
   pr "-module(guestfs).\n";
   pr "\n";
   pr "-export([create/0, create/1, close/1, init/1]).\n";
+  pr "-export([create_pool/1, create_pool/2, close_pool/1, pool_init/2]).\n";
+  pr "-export([checkout/1, checkout_async/1, checkin/2, with_handle/2]).\n";
   pr "\n";
 
   (* Export the public actions. *)
@@ -52,6 +54,7 @@ let rec generate_erlang_erl () =
           pr "-export([%s/%d, %s/%d]).\n" name (nr_args+1) name (nr_args+2)
       in
       export name;
+      export (name ^ "_async");
       List.iter export aliases
   ) (actions |> external_functions |> sort);
 
@@ -70,23 +73,35 @@ close(G) ->
   ok.
 
 call_port(G, Args) ->
-  G ! {call, self(), Args},
+  Mon = erlang:monitor(process, G),
+  Ref = call_port_async(G, Args),
   receive
-    {guestfs, Result} ->
-      Result
+    {guestfs, Ref, Result} ->
+      erlang:demonitor(Mon, [flush]),
+      Result;
+    {'DOWN', Mon, process, G, _} ->
+      {error, \"erl-guestfs process has exited\", 0}
   end.
 
+%%%% Send the request and return at once.  The result is sent to the
+%%%% calling process as {guestfs, Ref, Result}.  Each handle runs its
+%%%% requests one at a time, in order.
+call_port_async(G, Args) ->
+  Ref = make_ref(),
+  G ! {call, self(), Ref, Args},
+  Ref.
+
 init(ExtProg) ->
   process_flag(trap_exit, true),
   Port = open_port({spawn, ExtProg}, [{packet, 4}, binary]),
   loop(Port).
 loop(Port) ->
   receive
-    {call, Caller, Args} ->
+    {call, Caller, Ref, Args} ->
       Port ! { self(), {command, term_to_binary(Args)}},
       receive
         {Port, {data, Result}} ->
-          Caller ! { guestfs, binary_to_term(Result)}
+          Caller ! { guestfs, Ref, binary_to_term(Result)}
       end,
       loop(Port);
     close ->
@@ -96,6 +111,136 @@ loop(Port) ->
       exit(port_terminated)
   end.
 
+%%%% A pool of handles, each with its own erl-guestfs program and
+%%%% appliance, so that several processes can use libguestfs in
+%%%% parallel.  The pool process hands out handles for the exclusive
+%%%% use of one process at a time and queues requests when all the
+%%%% handles are in use.  Handles are not reset when they are checked
+%%%% in, so a launched appliance can be reused by the next process.
+%%%%
+%%%% The pool process supervises the handles: if an erl-guestfs program
+%%%% dies, or a process exits without checking in its handle, the
+%%%% handle is replaced by a new one.
+create_pool(Size) ->
+  create_pool(Size, \"erl-guestfs\").
+
+create_pool(Size, ExtProg) when Size > 0 ->
+  Pool = spawn(?MODULE, pool_init, [Size, ExtProg]),
+  {ok, Pool}.
+
+close_pool(Pool) ->
+  Pool ! close,
+  ok.
+
+checkout(Pool) ->
+  Mon = erlang:monitor(process, Pool),
+  Ref = checkout_async(Pool),
+  receive
+    {guestfs_pool, Ref, Result} ->
+      erlang:demonitor(Mon, [flush]),
+      Result;
+    {'DOWN', Mon, process, Pool, _} ->
+      {error, closed}
+  end.
+
+%%%% The handle is sent to the calling process as
+%%%% {guestfs_pool, Ref, {ok, G}}, or {guestfs_pool, Ref, {error, closed}}
+%%%% if the pool is closed first.
+checkout_async(Pool) ->
+  Ref = make_ref(),
+  Pool ! {checkout, self(), Ref},
+  Ref.
+
+checkin(Pool, G) ->
+  Pool ! {checkin, G},
+  ok.
+
+with_handle(Pool, Fun) ->
+  case checkout(Pool) of
+    {ok, G} ->
+      try Fun(G)
+      after checkin(Pool, G)
+      end;
+    Error ->
+      Error
+  end.
+
+pool_init(Size, ExtProg) ->
+  process_flag(trap_exit, true),
+  Idle = [pool_spawn(ExtProg) || _ <- lists:seq(1, Size)],
+  pool_loop(ExtProg, Idle, [], queue:new()).
+
+pool_spawn(ExtProg) ->
+  spawn_link(?MODULE, init, [ExtProg]).
+
+%%%% Idle is a list of free handles, Busy a list of {G, Owner, Mon} and
+%%%% Waiting a queue of {Caller, Ref} checkout requests.
+pool_loop(ExtProg, Idle, Busy, Waiting) ->
+  receive
+    {checkout, Caller, Ref} ->
+      case Idle of
+        [G | Idle1] ->
+          pool_loop(ExtProg, Idle1, pool_give(G, Caller, Ref, Busy), Waiting);
+        [] ->
+          pool_loop(ExtProg, Idle, Busy, queue:in({Caller, Ref}, Waiting))
+      end;
+    {checkin, G} ->
+      case lists:keytake(G, 1, Busy) of
+        {value, {G, _, Mon}, Busy1} ->
+          erlang:demonitor(Mon, [flush]),
+          pool_release(ExtProg, G, Idle, Busy1, Waiting);
+        false ->
+          pool_loop(ExtProg, Idle, Busy, Waiting)
+      end;
+    {'DOWN', Mon, process, _, _} ->
+      %%%% The owner exited with the handle checked out.  The state of
+      %%%% the handle is unknown, so replace it.
+      case lists:keytake(Mon, 3, Busy) of
+        {value, {G, _, Mon}, Busy1} ->
+          close(G),
+          pool_release(ExtProg, pool_spawn(ExtProg), Idle, Busy1, Waiting);
+        false ->
+          pool_loop(ExtProg, Idle, Busy, Waiting)
+      end;
+    {'EXIT', G, _} ->
+      %%%% A handle process exited.  Handles which the pool closed
+      %%%% itself are in neither list.
+      case lists:member(G, Idle) of
+        true ->
+          Idle1 = [pool_spawn(ExtProg) | lists:delete(G, Idle)],
+          pool_loop(ExtProg, Idle1, Busy, Waiting);
+        false ->
+          case lists:keytake(G, 1, Busy) of
+            {value, {G, _, Mon}, Busy1} ->
+              erlang:demonitor(Mon, [flush]),
+              pool_release(ExtProg, pool_spawn(ExtProg), Idle, Busy1, Waiting);
+            false ->
+              pool_loop(ExtProg, Idle, Busy, Waiting)
+          end
+      end;
+    close ->
+      lists:foreach(fun(G) -> close(G) end, Idle),
+      lists:foreach(fun({G, _, _}) -> close(G) end, Busy),
+      lists:foreach(
+        fun({Caller, Ref}) -> Caller ! {guestfs_pool, Ref, {error, closed}} end,
+        queue:to_list(Waiting)),
+      exit(normal)
+  end.
+
+pool_give(G, Caller, Ref, Busy) ->
+  Mon = erlang:monitor(process, Caller),
+  Caller ! {guestfs_pool, Ref, {ok, G}},
+  [{G, Caller, Mon} | Busy].
+
+%%%% Give G to the next waiting process, or make it idle.
+pool_release(ExtProg, G, Idle, Busy, Waiting) ->
+  case queue:out(Waiting) of
+    {{value, {Caller, Ref}}, Waiting1} ->
+      pool_loop(ExtProg, Idle, pool_give(G, Caller, Ref, Busy), Waiting1);
+    {empty, _} ->
+      pool_loop(ExtProg, [G | Idle], Busy, Waiting)
+  end.
+
 ";
 
   (* These bindings just marshal the parameters and call the back-end
@@ -121,6 +266,44 @@ loop(Port) ->
         pr ", Optargs";
       pr "}).\n";
 
+      (* The asynchronous variant returns a reference at once, and the
+       * result is sent later as {guestfs, Ref, Result}.
+       *)
+      pr "%s_async(G" name;
+      List.iter (
+        fun arg ->
+          pr ", %s" (String.capitalize_ascii (name_of_argt arg))
+      ) args;
+      if optargs <> [] then
+        pr ", Optargs";
+      pr ") ->\n";
+
+      pr "  call_port_async(G, {%s" name;
+      List.iter (
+        fun arg ->
+          pr ", %s" (String.capitalize_ascii (name_of_argt arg))
+      ) args;
+      if optargs <> [] then
+        pr ", Optargs";
+      pr "}).\n";
+
+      if optargs <> [] then (
+        pr "%s_async(G" name;
+        List.iter (
+          fun arg ->
+            pr ", %s" (String.capitalize_ascii (name_of_argt arg))
+        ) args;
+        pr ") ->\n";
+
+        pr "  %s_async(G" name;
+        List.iter (
+          fun arg ->
+            pr ", %s" (String.capitalize_ascii (name_of_argt arg))
+        ) args;
+        pr ", []";
+        pr ").\n"
+      );
+
       (* For functions with optional arguments, make a variant that
        * has no optarg array, which just calls the function above with
        * an empty list as the final arg.
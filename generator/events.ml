@@ -42,6 +42,8 @@ let events = [
   "libvirt_auth";                       (* libvirt authentication request *)
 
   "warning";                            (* warnings from the library *)
+
+  "launch_phase";                       (* launch phase reached *)
 ]
 
 let events = mapi (fun i name -> name, 1 lsl i) events
@@ -72,6 +72,13 @@ let all_functions_commands_and_aliases_sorted =
     ) ((actions |> fish_functions |> sort) @ fish_commands) [] in
   List.sort func_compare all
 
+(* Commands which guestfish --pipeline can submit without waiting
+ * for the reply, because they don't print anything.
+ *)
+let is_pipelined = function
+  | { style = RErr, _, _ } as f -> C.is_async f
+  | _ -> false
+
 let c_quoted_indented ~indent str =
   let str = c_quote str in
   let str = String.replace str "\\n" ("\\n\"\n" ^ indent ^ "\"") in
@@ -151,9 +158,9 @@ let generate_fish_run_cmds actions () =
   ) (rstructs_used_by (actions |> fish_functions));
 
   List.iter (
-    fun { name = name; style = (ret, args, optargs as style);
-          fish_output = fish_output; c_function = c_function;
-          c_optarg_prefix = c_optarg_prefix } ->
+    fun ({ name = name; style = (ret, args, optargs as style);
+           fish_output = fish_output; c_function = c_function;
+           c_optarg_prefix = c_optarg_prefix } as f) ->
       pr "\n";
       pr "int\n";
       pr "run_%s (const char *cmd, size_t argc, char *argv[])\n" name;
@@ -381,6 +388,22 @@ let generate_fish_run_cmds actions () =
         pr "\n";
       );
 
+      (* With --pipeline, commands which return nothing are submitted
+       * without waiting for the reply.
+       *)
+      if is_pipelined f then (
+        pr "  if (pipeline) {\n";
+        pr "    r = guestfs_submit_%s " name;
+        generate_c_call_args ~handle:"g" style;
+        pr ";\n";
+        pr "    if (r == -1) goto out;\n";
+        pr "    pipeline_add (r, guestfs_wait_%s);\n" name;
+        pr "    ret = 0;\n";
+        pr "    goto out;\n";
+        pr "  }\n";
+        pr "\n"
+      );
+
       (* Call C API function. *)
       pr "  r = %s " c_function;
       generate_c_call_args ~handle:"g" style;
@@ -592,6 +615,8 @@ Guestfish will prompt for these separately."
       pr "  .name = \"%s\",\n" name2;
       pr "  .help = \"%s\",\n" (c_quoted_indented ~indent:"          " text);
       pr "  .synopsis = \"%s\",\n" (c_quote synopsis);
+      if is_pipelined f then
+        pr "  .pipeline = 1,\n";
       pr "  .run = run_%s\n" name;
       pr "};\n";
       pr "\n";
@@ -35,38 +35,40 @@ let generate_header = generate_header ~inputs:["generator/gobject.ml"]
 
 let camel_of_name { camel_name = camel_name } = "Guestfs" ^ camel_name
 
-let generate_gobject_proto name ?(single_line = true)
-                                (ret, args, optargs) f =
+let generate_gobject_return_type ?(single_line = true) ret =
   let spacer = if single_line then " " else "\n" in
   let ptr_spacer = if single_line then "" else "\n" in
-  (match ret with
-   | RErr ->
-      pr "gboolean%s" spacer
-   | RInt _ ->
-      pr "gint32%s" spacer
-   | RInt64 _ ->
-      pr "gint64%s" spacer
-   | RBool _ ->
-      pr "gint8%s" spacer
-   | RConstString _
-   | RConstOptString _ ->
-      pr "const gchar *%s" ptr_spacer
-   | RString _ ->
-      pr "gchar *%s" ptr_spacer
-   | RStringList _ ->
-      pr "gchar **%s" ptr_spacer
-   | RStruct (_, typ) ->
-      let name = camel_name_of_struct typ in
-      pr "Guestfs%s *%s" name ptr_spacer
-   | RStructList (_, typ) ->
-      let name = camel_name_of_struct typ in
-      pr "Guestfs%s **%s" name ptr_spacer
-   | RHashtable _ ->
-      pr "GHashTable *%s" ptr_spacer
-   | RBufferOut _ ->
-      pr "guint8 *%s" ptr_spacer
-  );
-  pr "guestfs_session_%s (GuestfsSession *session" name;
+  match ret with
+  | RErr ->
+     pr "gboolean%s" spacer
+  | RInt _ ->
+     pr "gint32%s" spacer
+  | RInt64 _ ->
+     pr "gint64%s" spacer
+  | RBool _ ->
+     pr "gint8%s" spacer
+  | RConstString _
+  | RConstOptString _ ->
+     pr "const gchar *%s" ptr_spacer
+  | RString _ ->
+     pr "gchar *%s" ptr_spacer
+  | RStringList _ ->
+     pr "gchar **%s" ptr_spacer
+  | RStruct (_, typ) ->
+     let name = camel_name_of_struct typ in
+     pr "Guestfs%s *%s" name ptr_spacer
+  | RStructList (_, typ) ->
+     let name = camel_name_of_struct typ in
+     pr "Guestfs%s **%s" name ptr_spacer
+  | RHashtable _ ->
+     pr "GHashTable *%s" ptr_spacer
+  | RBufferOut _ ->
+     pr "guint8 *%s" ptr_spacer
+
+(* The parameters of guestfs_session_<name> and
+ * guestfs_session_<name>_async, after the session.
+ *)
+let generate_gobject_args (_, args, optargs) f =
   List.iter (
     fun arg ->
       pr ", ";
@@ -98,7 +100,13 @@ let generate_gobject_proto name ?(single_line = true)
   ) args;
   if optargs <> [] then (
     pr ", %s *optargs" (camel_of_name f)
-  );
+  )
+
+let generate_gobject_proto name ?(single_line = true)
+                                ((ret, _, _) as style) f =
+  generate_gobject_return_type ~single_line ret;
+  pr "guestfs_session_%s (GuestfsSession *session" name;
+  generate_gobject_args style f;
   (match ret with
   | RBufferOut _ ->
     pr ", gsize *size_r"
@@ -108,6 +116,35 @@ let generate_gobject_proto name ?(single_line = true)
   pr ", GError **err";
   pr ")"
 
+let generate_gobject_async_proto name ?(single_line = true) style f =
+  pr "void%s" (if single_line then " " else "\n");
+  pr "guestfs_session_%s_async (GuestfsSession *session" name;
+  generate_gobject_args style f;
+  pr ", GCancellable *cancellable";
+  pr ", GAsyncReadyCallback callback, gpointer user_data)"
+
+let generate_gobject_finish_proto name ?(single_line = true)
+                                       (ret, _, _) f =
+  generate_gobject_return_type ~single_line ret;
+  pr "guestfs_session_%s_finish (GuestfsSession *session" name;
+  pr ", GAsyncResult *result";
+  (match ret with
+  | RBufferOut _ ->
+    pr ", gsize *size_r"
+  | _ -> ());
+  pr ", GError **err";
+  pr ")"
+
+(* Functions which have _async and _finish variants.  That is all of
+ * them except the few which take a C pointer, since the pointer may
+ * not be valid by the time the call runs in another thread.
+ *)
+let async_functions () =
+  List.filter (
+    fun { style = _, args, _ } ->
+      not (List.exists (function Pointer _ -> true | _ -> false) args)
+  ) (actions |> external_functions |> sort)
+
 let filenames =
   "session" :: "tristate" ::
 
@@ -712,8 +749,77 @@ gboolean guestfs_session_close (GuestfsSession *session, GError **err);
       pr ";\n";
   ) (actions |> external_functions |> sort);
 
+  pr "\n";
+  pr "/* Asynchronous variants */\n";
+  List.iter (
+    fun ({ name = name; style = style } as f) ->
+      generate_gobject_async_proto name style f;
+      pr ";\n";
+      generate_gobject_finish_proto name style f;
+      pr ";\n";
+  ) (async_functions ());
+
   header_end filename
 
+(* The gtk-doc lines for the arguments, with GI annotations. *)
+let generate_gobject_arg_docs args =
+  List.iter (
+    fun argt ->
+      pr " * @%s:" (name_of_argt argt);
+      (match argt with
+      | Bool _ ->
+        pr " (type gboolean):"
+      | Int _ ->
+        pr " (type gint32):"
+      | Int64 _ ->
+        pr " (type gint64):"
+      | String _ | Key _ | GUID _ ->
+        pr " (transfer none) (type utf8):"
+      | OptString _ ->
+        pr " (transfer none) (type utf8) (allow-none):"
+      | Device _ | Mountable _ | Pathname _
+      | Dev_or_Path _ | Mountable_or_Path _
+      | FileIn _ | FileOut _ ->
+        pr " (transfer none) (type filename):"
+      | StringList _ ->
+        pr " (transfer none) (array zero-terminated=1) (element-type utf8): an array of strings"
+      | DeviceList _ | FilenameList _ ->
+        pr " (transfer none) (array zero-terminated=1) (element-type filename): an array of strings"
+      | BufferIn n ->
+        pr " (transfer none) (array length=%s_size) (element-type guint8): an array of binary data\n" n;
+        pr " * @%s_size: The size of %s, in bytes" n n;
+      | Pointer _ ->
+        pr "pointer (not implemented in gobject bindings)"
+      );
+      pr "\n";
+  ) args
+
+(* The text of the gtk-doc "Returns:" line. *)
+let generate_gobject_return_doc ret =
+  match ret with
+  | RErr ->
+    pr "true on success, false on error"
+  | RInt _ | RInt64 _ | RBool _ ->
+    pr "the returned value, or -1 on error"
+  | RConstString _ ->
+    pr "(transfer none): the returned string, or NULL on error"
+  | RConstOptString _ ->
+    pr "(transfer none): the returned string. Note that NULL does not indicate error"
+  | RString _ ->
+    pr "(transfer full): the returned string, or NULL on error"
+  | RStringList _ ->
+    pr "(transfer full) (array zero-terminated=1) (element-type utf8): an array of returned strings, or NULL on error"
+  | RHashtable _ ->
+    pr "(transfer full) (element-type utf8 utf8): a GHashTable of results, or NULL on error"
+  | RBufferOut _ ->
+    pr "(transfer full) (array length=size_r) (element-type guint8): an array of binary data, or NULL on error"
+  | RStruct (_, typ) ->
+     let name = camel_name_of_struct typ in
+     pr "(transfer full): a %s object, or NULL on error" name
+  | RStructList (_, typ) ->
+     let name = camel_name_of_struct typ in
+     pr "(transfer full) (array zero-terminated=1) (element-type Guestfs%s): an array of %s objects, or NULL on error" name name
+
 let generate_gobject_session_source () =
   let filename = "session" in
   let shortdesc = "A libguestfs session" in
@@ -759,6 +865,14 @@ guestfs_session_event_params_free (GuestfsSessionEventParams *src)
   g_slice_free (GuestfsSessionEventParams, src);
 }
 
+/* Free the params created by event_callback, including the buffer. */
+static void
+free_event_params (GuestfsSessionEventParams *params)
+{
+  g_byte_array_unref (params->buf);
+  guestfs_session_event_params_free (params);
+}
+
 G_DEFINE_BOXED_TYPE (GuestfsSessionEventParams,
                     guestfs_session_event_params,
                     guestfs_session_event_params_copy,
@@ -790,6 +904,9 @@ pr "
   return UINT32_MAX;
 }
 
+static gboolean defer_event (GuestfsSession *session,
+                             GuestfsSessionEventParams *params);
+
 static void
 event_callback (guestfs_h *g, void *opaque,
                uint64_t event, int event_handle,
@@ -815,9 +932,13 @@ event_callback (guestfs_h *g, void *opaque,
 
   GuestfsSession *session = (GuestfsSession *) opaque;
 
+  /* During an async call, the event is emitted from the main loop. */
+  if (defer_event (session, params))
+    return;
+
   g_signal_emit (session, signals[params->event], 0, params);
 
-  guestfs_session_event_params_free (params);
+  free_event_params (params);
 }
 
 /* GuestfsSessionEvent */
@@ -853,6 +974,13 @@ struct _GuestfsSessionPrivate
 {
   guestfs_h *g;
   int event_handle;
+
+  /* Async calls, see below.  The fields are protected by async_lock. */
+  GMutex async_lock;
+  GQueue async_queue;           /* Calls waiting for the running one. */
+  gboolean async_busy;          /* An async call is running or queued. */
+  GMainContext *async_context;  /* Context of the running async call. */
+  GuestfsSessionEventParams *pending_progress; /* Progress not emitted yet. */
 };
 
 G_DEFINE_TYPE (GuestfsSession, guestfs_session, G_TYPE_OBJECT);
@@ -865,6 +993,10 @@ guestfs_session_finalize (GObject *object)
 
   if (priv->g) guestfs_close (priv->g);
 
+  if (priv->pending_progress)
+    free_event_params (priv->pending_progress);
+  g_mutex_clear (&priv->async_lock);
+
   G_OBJECT_CLASS (guestfs_session_parent_class)->finalize (object);
 }
 
@@ -909,6 +1041,9 @@ guestfs_session_init (GuestfsSession *session)
   session->priv = GUESTFS_SESSION_GET_PRIVATE (session);
   session->priv->g = guestfs_create ();
 
+  g_mutex_init (&session->priv->async_lock);
+  g_queue_init (&session->priv->async_queue);
+
   guestfs_h *g = session->priv->g;
 
   session->priv->event_handle =
@@ -951,6 +1086,181 @@ guestfs_session_close (GuestfsSession *session, GError **err)
   guestfs_close (g);
   session->priv->g = NULL;
 
+  return TRUE;
+}
+
+/* Async calls
+ *
+ * The _async functions run the call on a thread pool which is shared
+ * by all sessions, so programs can drive many sessions without
+ * creating threads of their own.  Calls on one session run one at a
+ * time, in the order they were made: a call made while another is
+ * running is queued on the session, and the worker which finishes a
+ * call goes on to the next one, so that queued calls don't tie up
+ * pool threads waiting for the handle.
+ *
+ * While an async call is running, its events are emitted from the
+ * main context of the caller, not the worker thread.  Progress
+ * events can be very frequent, so only the latest one is kept until
+ * the main loop gets round to emitting it.
+ */
+
+struct async_call {
+  GTask *task;
+  GTaskThreadFunc func;
+};
+
+static GThreadPool *async_pool;
+G_LOCK_DEFINE_STATIC (async_pool);
+
+static void
+async_worker (gpointer data, gpointer user_data)
+{
+  struct async_call *call = data, *next;
+
+  while (call) {
+    GTask *task = call->task;
+    GuestfsSession *session = g_task_get_source_object (task);
+    GuestfsSessionPrivate *priv = session->priv;
+
+    g_mutex_lock (&priv->async_lock);
+    priv->async_context = g_task_get_context (task);
+    g_mutex_unlock (&priv->async_lock);
+
+    call->func (task, session, g_task_get_task_data (task),
+                g_task_get_cancellable (task));
+
+    g_mutex_lock (&priv->async_lock);
+    priv->async_context = NULL;
+    next = g_queue_pop_head (&priv->async_queue);
+    if (next == NULL)
+      priv->async_busy = FALSE;
+    g_mutex_unlock (&priv->async_lock);
+
+    g_object_unref (task);
+    g_slice_free (struct async_call, call);
+    call = next;
+  }
+}
+
+/* Run func in a worker thread.  This takes over the reference to task. */
+static void
+async_run (GuestfsSession *session, GTask *task, GTaskThreadFunc func)
+{
+  GuestfsSessionPrivate *priv = session->priv;
+  struct async_call *call = g_slice_new (struct async_call);
+  gboolean start;
+
+  call->task = task;
+  call->func = func;
+
+  G_LOCK (async_pool);
+  if (async_pool == NULL)
+    async_pool = g_thread_pool_new (async_worker, NULL, -1, FALSE, NULL);
+  G_UNLOCK (async_pool);
+
+  g_mutex_lock (&priv->async_lock);
+  start = !priv->async_busy;
+  if (start)
+    priv->async_busy = TRUE;
+  else
+    g_queue_push_tail (&priv->async_queue, call);
+  g_mutex_unlock (&priv->async_lock);
+
+  if (start)
+    g_thread_pool_push (async_pool, call, NULL);
+}
+
+static gboolean
+emit_progress_idle (gpointer data)
+{
+  GuestfsSession *session = data;
+  GuestfsSessionPrivate *priv = session->priv;
+  GuestfsSessionEventParams *params;
+
+  g_mutex_lock (&priv->async_lock);
+  params = priv->pending_progress;
+  priv->pending_progress = NULL;
+  g_mutex_unlock (&priv->async_lock);
+
+  if (params) {
+    g_signal_emit (session, signals[params->event], 0, params);
+    free_event_params (params);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+struct deferred_event {
+  GuestfsSession *session;
+  GuestfsSessionEventParams *params;
+};
+
+static gboolean
+emit_deferred_event (gpointer data)
+{
+  struct deferred_event *ev = data;
+
+  g_signal_emit (ev->session, signals[ev->params->event], 0, ev->params);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+free_deferred_event (gpointer data)
+{
+  struct deferred_event *ev = data;
+
+  g_object_unref (ev->session);
+  free_event_params (ev->params);
+  g_slice_free (struct deferred_event, ev);
+}
+
+/* Called from event_callback.  If an async call is running, arrange
+ * for the event to be emitted from the main context of the caller,
+ * and take over params.
+ */
+static gboolean
+defer_event (GuestfsSession *session, GuestfsSessionEventParams *params)
+{
+  GuestfsSessionPrivate *priv = session->priv;
+  GSource *source = NULL;
+
+  g_mutex_lock (&priv->async_lock);
+  if (priv->async_context == NULL) {
+    g_mutex_unlock (&priv->async_lock);
+    return FALSE;
+  }
+
+  if (params->event == GUESTFS_SESSION_EVENT_PROGRESS) {
+    /* If an idle is pending already, it will emit this one instead. */
+    if (priv->pending_progress)
+      free_event_params (priv->pending_progress);
+    else {
+      source = g_idle_source_new ();
+      g_source_set_callback (source, emit_progress_idle,
+                             g_object_ref (session), g_object_unref);
+    }
+    priv->pending_progress = params;
+  }
+  else {
+    struct deferred_event *ev = g_slice_new (struct deferred_event);
+
+    ev->session = g_object_ref (session);
+    ev->params = params;
+    source = g_idle_source_new ();
+    g_source_set_callback (source, emit_deferred_event,
+                           ev, free_deferred_event);
+  }
+
+  if (source) {
+    /* The same priority as the GTask callback, so events are emitted
+     * before the call is seen to finish.
+     */
+    g_source_set_priority (source, G_PRIORITY_DEFAULT);
+    g_source_attach (source, priv->async_context);
+    g_source_unref (source);
+  }
+  g_mutex_unlock (&priv->async_lock);
+
   return TRUE;
 }";
 
@@ -1037,36 +1347,7 @@ guestfs_session_close (GuestfsSession *session, GError **err)
       pr " * guestfs_session_%s:\n" name;
       pr " * @session: (transfer none): A GuestfsSession object\n";
 
-      List.iter (
-        fun argt ->
-          pr " * @%s:" (name_of_argt argt);
-          (match argt with
-          | Bool _ ->
-            pr " (type gboolean):"
-          | Int _ ->
-            pr " (type gint32):"
-          | Int64 _ ->
-            pr " (type gint64):"
-          | String _ | Key _ | GUID _ ->
-            pr " (transfer none) (type utf8):"
-          | OptString _ ->
-            pr " (transfer none) (type utf8) (allow-none):"
-          | Device _ | Mountable _ | Pathname _
-          | Dev_or_Path _ | Mountable_or_Path _
-          | FileIn _ | FileOut _ ->
-            pr " (transfer none) (type filename):"
-          | StringList _ ->
-            pr " (transfer none) (array zero-terminated=1) (element-type utf8): an array of strings"
-          | DeviceList _ | FilenameList _ ->
-            pr " (transfer none) (array zero-terminated=1) (element-type filename): an array of strings"
-          | BufferIn n ->
-            pr " (transfer none) (array length=%s_size) (element-type guint8): an array of binary data\n" n;
-            pr " * @%s_size: The size of %s, in bytes" n n;
-          | Pointer _ ->
-            pr "pointer (not implemented in gobject bindings)"
-          );
-          pr "\n";
-      ) args;
+      generate_gobject_arg_docs args;
       if optargs <> [] then
         pr " * @optargs: (transfer none) (allow-none): a %s containing optional arguments\n" camel_name;
       (match ret with
@@ -1092,30 +1373,7 @@ guestfs_session_close (GuestfsSession *session, GError **err)
       );
 
       pr " * Returns: ";
-      (match ret with
-      | RErr ->
-        pr "true on success, false on error"
-      | RInt _ | RInt64 _ | RBool _ ->
-        pr "the returned value, or -1 on error"
-      | RConstString _ ->
-        pr "(transfer none): the returned string, or NULL on error"
-      | RConstOptString _ ->
-        pr "(transfer none): the returned string. Note that NULL does not indicate error"
-      | RString _ ->
-        pr "(transfer full): the returned string, or NULL on error"
-      | RStringList _ ->
-        pr "(transfer full) (array zero-terminated=1) (element-type utf8): an array of returned strings, or NULL on error"
-      | RHashtable _ ->
-        pr "(transfer full) (element-type utf8 utf8): a GHashTable of results, or NULL on error"
-      | RBufferOut _ ->
-        pr "(transfer full) (array length=size_r) (element-type guint8): an array of binary data, or NULL on error"
-      | RStruct (_, typ) ->
-         let name = camel_name_of_struct typ in
-         pr "(transfer full): a %s object, or NULL on error" name
-      | RStructList (_, typ) ->
-         let name = camel_name_of_struct typ in
-         pr "(transfer full) (array zero-terminated=1) (element-type Guestfs%s): an array of %s objects, or NULL on error" name name
-      );
+      generate_gobject_return_doc ret;
       pr "\n";
       (match deprecated_by with
       | None -> ()
@@ -1317,4 +1575,223 @@ guestfs_session_close (GuestfsSession *session, GError **err)
       );
 
       pr "}\n";
-  ) (actions |> external_functions |> sort)
+  ) (actions |> external_functions |> sort);
+
+  (* The async variants.  The arguments are copied, since the call
+   * runs after guestfs_session_<name>_async has returned.
+   *)
+  List.iter (
+    fun ({ name = name; style = (ret, args, optargs as style);
+           cancellable = cancellable } as f) ->
+      pr "\n";
+
+      let camel_name = camel_of_name f in
+      let is_RBufferOut = match ret with RBufferOut _ -> true | _ -> false in
+      let has_data = args <> [] || optargs <> [] || is_RBufferOut in
+      let data_struct = sprintf "struct %s_async_data" name in
+
+      if has_data then (
+        pr "%s {\n" data_struct;
+        List.iter (
+          function
+          | Bool n -> pr "  gboolean %s;\n" n
+          | Int n -> pr "  gint32 %s;\n" n
+          | Int64 n -> pr "  gint64 %s;\n" n
+          | String n | Device n | Mountable n | Pathname n
+          | Dev_or_Path n | Mountable_or_Path n | OptString n
+          | Key n | FileIn n | FileOut n | GUID n ->
+            pr "  gchar *%s;\n" n
+          | StringList n | DeviceList n | FilenameList n ->
+            pr "  gchar **%s;\n" n
+          | BufferIn n ->
+            pr "  guint8 *%s;\n" n;
+            pr "  gsize %s_size;\n" n
+          | Pointer _ -> assert false
+        ) args;
+        if optargs <> [] then
+          pr "  %s *optargs;\n" camel_name;
+        if is_RBufferOut then
+          pr "  gsize size_r;\n";
+        pr "};\n\n";
+
+        pr "static void\n";
+        pr "%s_async_data_free (gpointer vp)\n" name;
+        pr "{\n";
+        pr "  %s *data = vp;\n\n" data_struct;
+        List.iter (
+          function
+          | Bool _ | Int _ | Int64 _ -> ()
+          | String n | Device n | Mountable n | Pathname n
+          | Dev_or_Path n | Mountable_or_Path n | OptString n
+          | Key n | FileIn n | FileOut n | GUID n | BufferIn n ->
+            pr "  g_free (data->%s);\n" n
+          | StringList n | DeviceList n | FilenameList n ->
+            pr "  g_strfreev (data->%s);\n" n
+          | Pointer _ -> assert false
+        ) args;
+        if optargs <> [] then
+          pr "  if (data->optargs) g_object_unref (data->optargs);\n";
+        pr "  g_slice_free (%s, data);\n" data_struct;
+        pr "}\n\n"
+      );
+
+      (* The worker thread. *)
+      pr "static void\n";
+      pr "%s_async_thread (GTask *task, gpointer source_object,\n" name;
+      pr "    gpointer task_data, GCancellable *cancellable)\n";
+      pr "{\n";
+      pr "  GuestfsSession *session = source_object;\n";
+      if has_data then
+        pr "  %s *data = task_data;\n" data_struct;
+      pr "  GError *err = NULL;\n\n";
+
+      (* Cancellable functions check this themselves. *)
+      if not cancellable then (
+        pr "  if (g_task_return_error_if_cancelled (task))\n";
+        pr "    return;\n\n"
+      );
+
+      pr "  ";
+      generate_gobject_return_type ret;
+      pr "ret = guestfs_session_%s (session" name;
+      List.iter (
+        function
+        | BufferIn n ->
+          pr ", data->%s, data->%s_size" n n
+        | Bool n | Int n | Int64 n | String n | Device n | Mountable n
+        | Pathname n | Dev_or_Path n | Mountable_or_Path n
+        | OptString n | StringList n
+        | DeviceList n | Key n | FileIn n | FileOut n
+        | GUID n | FilenameList n ->
+          pr ", data->%s" n
+        | Pointer _ -> assert false
+      ) args;
+      if optargs <> [] then pr ", data->optargs";
+      if is_RBufferOut then pr ", &data->size_r";
+      if cancellable then pr ", cancellable";
+      pr ", &err);\n";
+
+      pr "  if (err != NULL) {\n";
+      pr "    g_task_return_error (task, err);\n";
+      pr "    return;\n";
+      pr "  }\n";
+      (match ret with
+      | RErr ->
+        pr "  g_task_return_boolean (task, ret);\n"
+      | RInt _ | RBool _ ->
+        pr "  g_task_return_int (task, ret);\n"
+      | RInt64 _ ->
+        (* gssize may be too small. *)
+        pr "  gint64 *r = g_new (gint64, 1);\n";
+        pr "  *r = ret;\n";
+        pr "  g_task_return_pointer (task, r, g_free);\n"
+      | RConstString _ | RConstOptString _ ->
+        pr "  g_task_return_pointer (task, (gpointer) ret, NULL);\n"
+      | RString _ | RBufferOut _ ->
+        pr "  g_task_return_pointer (task, ret, g_free);\n"
+      | RStringList _ ->
+        pr "  g_task_return_pointer (task, ret, (GDestroyNotify) g_strfreev);\n"
+      | RHashtable _ ->
+        pr "  g_task_return_pointer (task, ret, (GDestroyNotify) g_hash_table_unref);\n"
+      | RStruct _ | RStructList _ ->
+        pr "  g_task_return_pointer (task, ret, NULL);\n"
+      );
+      pr "}\n\n";
+
+      (* guestfs_session_<name>_async *)
+      pr "/**\n";
+      pr " * guestfs_session_%s_async:\n" name;
+      pr " * @session: (transfer none): A GuestfsSession object\n";
+      generate_gobject_arg_docs args;
+      if optargs <> [] then
+        pr " * @optargs: (transfer none) (allow-none): a %s containing optional arguments\n" camel_name;
+      pr " * @cancellable: (allow-none): A GCancellable object\n";
+      pr " * @callback: (scope async): A function to call when the call has finished\n";
+      pr " * @user_data: (closure): Data to pass to @callback\n";
+      pr " *\n";
+      pr " * Run guestfs_session_%s() in a worker thread.  @callback is\n" name;
+      pr " * called in the thread-default main context of the caller when it\n";
+      pr " * has finished, and should call guestfs_session_%s_finish()\n" name;
+      pr " * to get the result.\n";
+      pr " *\n";
+      pr " * Calls on the same session run one at a time, in order.\n";
+      (match version_added f with
+      | None -> ()
+      | Some version -> pr " *\n * Since: %s\n" version
+      );
+      pr " */\n";
+      generate_gobject_async_proto ~single_line:false name style f;
+      pr "\n{\n";
+      pr "  GTask *task = g_task_new (session, cancellable, callback, user_data);\n";
+      if has_data then (
+        pr "  %s *data = g_slice_new0 (%s);\n\n" data_struct data_struct;
+        List.iter (
+          function
+          | Bool n | Int n | Int64 n ->
+            pr "  data->%s = %s;\n" n n
+          | String n | Device n | Mountable n | Pathname n
+          | Dev_or_Path n | Mountable_or_Path n | OptString n
+          | Key n | FileIn n | FileOut n | GUID n ->
+            pr "  data->%s = g_strdup (%s);\n" n n
+          | StringList n | DeviceList n | FilenameList n ->
+            pr "  data->%s = g_strdupv ((gchar **) %s);\n" n n
+          | BufferIn n ->
+            pr "  data->%s = g_memdup (%s, %s_size);\n" n n n;
+            pr "  data->%s_size = %s_size;\n" n n
+          | Pointer _ -> assert false
+        ) args;
+        if optargs <> [] then
+          pr "  data->optargs = optargs ? g_object_ref (optargs) : NULL;\n";
+        pr "  g_task_set_task_data (task, data, %s_async_data_free);\n" name
+      );
+      pr "  g_task_set_source_tag (task, guestfs_session_%s_async);\n" name;
+      pr "  async_run (session, task, %s_async_thread);\n" name;
+      pr "}\n\n";
+
+      (* guestfs_session_<name>_finish *)
+      pr "/**\n";
+      pr " * guestfs_session_%s_finish:\n" name;
+      pr " * @session: (transfer none): A GuestfsSession object\n";
+      pr " * @result: The GAsyncResult passed to the callback\n";
+      if is_RBufferOut then
+        pr " * @size_r: The size of the returned buffer, in bytes\n";
+      pr " * @err: A GError object to receive any generated errors\n";
+      pr " *\n";
+      pr " * Get the result of guestfs_session_%s_async().\n" name;
+      pr " *\n";
+      pr " * Returns: ";
+      generate_gobject_return_doc ret;
+      pr "\n";
+      (match version_added f with
+      | None -> ()
+      | Some version -> pr " * Since: %s\n" version
+      );
+      pr " */\n";
+      generate_gobject_finish_proto ~single_line:false name style f;
+      pr "\n{\n";
+      pr "  GTask *task = G_TASK (result);\n\n";
+      (match ret with
+      | RErr ->
+        pr "  return g_task_propagate_boolean (task, err);\n"
+      | RInt _ | RBool _ ->
+        pr "  return g_task_propagate_int (task, err);\n"
+      | RInt64 _ ->
+        pr "  gint64 *r = g_task_propagate_pointer (task, err);\n";
+        pr "  gint64 ret;\n\n";
+        pr "  if (r == NULL)\n";
+        pr "    return -1;\n";
+        pr "  ret = *r;\n";
+        pr "  g_free (r);\n";
+        pr "  return ret;\n"
+      | RBufferOut _ ->
+        pr "  %s *data = g_task_get_task_data (task);\n" data_struct;
+        pr "  guint8 *ret = g_task_propagate_pointer (task, err);\n\n";
+        pr "  if (ret)\n";
+        pr "    *size_r = data->size_r;\n";
+        pr "  return ret;\n"
+      | RConstString _ | RConstOptString _ | RString _ | RStringList _
+      | RHashtable _ | RStruct _ | RStructList _ ->
+        pr "  return g_task_propagate_pointer (task, err);\n"
+      );
+      pr "}\n";
+  ) (async_functions ())
@@ -56,8 +56,10 @@ _go_guestfs_create_flags (unsigned flags)
 import \"C\"
 
 import (
+    \"context\"
     \"fmt\"
     \"runtime\"
+    \"sync\"
     \"syscall\"
     \"unsafe\"
 )
@@ -129,6 +131,50 @@ func closed_handle_error (op string) *GuestfsError {
                           Errno : syscall.Errno (0) }
 }
 
+/* The *_context variants of the functions below take a
+ * context.Context.  If the context is already done, the call is not
+ * started.  For the functions which transfer files to or from the
+ * appliance (Upload, Download, etc.), the context being cancelled or
+ * timing out while the call runs causes guestfs_user_cancel to be
+ * called, which stops the transfer.  Other calls run to completion,
+ * since libguestfs has no way to interrupt them.
+ *
+ * In either case, the returned GuestfsError carries the context
+ * error and Errno is EINTR.
+ */
+func context_error (ctx context.Context, op string) *GuestfsError {
+    return &GuestfsError{ Op : op, Errmsg : ctx.Err ().Error (),
+                          Errno : syscall.EINTR }
+}
+
+func get_error_from_context (g *Guestfs, ctx context.Context, op string) *GuestfsError {
+    if ctx.Err () != nil {
+        return context_error (ctx, op)
+    }
+    return get_error_from_handle (g, op)
+}
+
+/* Call guestfs_user_cancel if ctx is done before the returned
+ * function is called.  guestfs_user_cancel is the only libguestfs
+ * function which may be called from another goroutine while the
+ * handle is in use.
+ */
+func (g *Guestfs) watch_context (ctx context.Context) func () {
+    if ctx.Done () == nil {
+        return func () {}
+    }
+    c_g := g.g
+    done := make (chan struct{})
+    go func () {
+        select {
+        case <-ctx.Done ():
+            C.guestfs_user_cancel (c_g)
+        case <-done:
+        }
+    } ()
+    return func () { close (done) }
+}
+
 /* Close the handle. */
 func (g *Guestfs) Close () *GuestfsError {
     if g.g == nil {
@@ -198,6 +244,208 @@ func return_hashtable (argv **C.char) map[string]string {
     return r
 }
 
+/* Functions which read into a buffer supplied by the caller, instead
+ * of returning a new []byte like Pread, Pread_device and Read_file.
+ * The data is copied straight into buf.
+ */
+func buffer_pointer (buf []byte) unsafe.Pointer {
+    if len (buf) == 0 {
+        return nil
+    }
+    return unsafe.Pointer (&buf[0])
+}
+
+/* Read up to len (buf) bytes at offset from the file path into buf.
+ * Returns the number of bytes read, which is 0 at the end of the file.
+ */
+func (g *Guestfs) Pread_into (path string, buf []byte, offset int64) (int, *GuestfsError) {
+    if g.g == nil {
+        return 0, closed_handle_error (\"pread_into\")
+    }
+    c_path := C.CString (path)
+    defer C.free (unsafe.Pointer (c_path))
+
+    r := C.guestfs_pread_into (g.g, c_path, buffer_pointer (buf),
+                               C.size_t (len (buf)), C.int64_t (offset))
+    if r == -1 {
+        return 0, get_error_from_handle (g, \"pread_into\")
+    }
+    return int (r), nil
+}
+
+/* The same as Pread_into, but reads from a device. */
+func (g *Guestfs) Pread_device_into (device string, buf []byte, offset int64) (int, *GuestfsError) {
+    if g.g == nil {
+        return 0, closed_handle_error (\"pread_device_into\")
+    }
+    c_device := C.CString (device)
+    defer C.free (unsafe.Pointer (c_device))
+
+    r := C.guestfs_pread_device_into (g.g, c_device, buffer_pointer (buf),
+                                      C.size_t (len (buf)), C.int64_t (offset))
+    if r == -1 {
+        return 0, get_error_from_handle (g, \"pread_device_into\")
+    }
+    return int (r), nil
+}
+
+/* Read the whole file path into buf, returning the size of the file.
+ * If the file doesn't fit, the error is ERANGE.
+ */
+func (g *Guestfs) Read_file_into (path string, buf []byte) (int, *GuestfsError) {
+    if g.g == nil {
+        return 0, closed_handle_error (\"read_file_into\")
+    }
+    c_path := C.CString (path)
+    defer C.free (unsafe.Pointer (c_path))
+
+    r := C.guestfs_read_file_into (g.g, c_path, buffer_pointer (buf),
+                                   C.size_t (len (buf)))
+    if r == -1 {
+        return 0, get_error_from_handle (g, \"read_file_into\")
+    }
+    return int (r), nil
+}
+
+/* A pool of launched handles which can be shared by goroutines.
+ *
+ * Launching the appliance is by far the slowest part of most
+ * programs, so a service which does many short operations can use a
+ * pool to keep some appliances running and reuse them.  At most
+ * size handles exist at any time.  Get returns an idle handle if
+ * there is one, otherwise it creates a handle, calls setup on it
+ * (which should add drives and so on) and launches it.
+ *
+ * Idle handles are checked with Ping_daemon before Get returns them,
+ * and handles which fail are closed and replaced.  Put unmounts
+ * everything and returns the handle to the pool; a handle which is
+ * in an unknown state should be given back with Discard instead.
+ */
+type Pool struct {
+    setup func (g *Guestfs) *GuestfsError
+    slots chan struct{}         // one token for each handle which exists
+    idle chan *Guestfs          // launched handles not in use
+    mu sync.Mutex               // protects closed
+    closed bool
+}
+
+func New_pool (size int, setup func (g *Guestfs) *GuestfsError) *Pool {
+    if size < 1 {
+        size = 1
+    }
+    return &Pool{ setup : setup,
+                  slots : make (chan struct{}, size),
+                  idle : make (chan *Guestfs, size) }
+}
+
+func pool_closed_error () *GuestfsError {
+    return &GuestfsError{ Op : \"pool_get\", Errmsg : \"pool is closed\",
+                          Errno : syscall.Errno (0) }
+}
+
+/* Get a launched handle, waiting for one to be free if the pool is
+ * full.  The wait is abandoned if ctx is done.
+ */
+func (p *Pool) Get (ctx context.Context) (*Guestfs, *GuestfsError) {
+    for {
+        p.mu.Lock ()
+        closed := p.closed
+        p.mu.Unlock ()
+        if closed {
+            return nil, pool_closed_error ()
+        }
+
+        // Prefer an idle handle to launching a new appliance.
+        var g *Guestfs
+        select {
+        case g = <-p.idle:
+        default:
+            select {
+            case g = <-p.idle:
+            case p.slots <- struct{}{}:
+                g, err := p.launch ()
+                if err != nil {
+                    <-p.slots
+                    return nil, err
+                }
+                return g, nil
+            case <-ctx.Done ():
+                return nil, context_error (ctx, \"pool_get\")
+            }
+        }
+
+        err := g.Ping_daemon_context (ctx)
+        if err == nil {
+            return g, nil
+        }
+        if ctx.Err () != nil {
+            p.Put (g)
+            return nil, err
+        }
+        // The appliance has died: throw it away and try again.
+        p.Discard (g)
+    }
+}
+
+func (p *Pool) launch () (*Guestfs, *GuestfsError) {
+    g, errno := Create ()
+    if errno != nil {
+        return nil, &GuestfsError{ Op : \"create\", Errmsg : errno.Error (),
+                                   Errno : syscall.Errno (0) }
+    }
+    if p.setup != nil {
+        if err := p.setup (g); err != nil {
+            g.Close ()
+            return nil, err
+        }
+    }
+    if err := g.Launch (); err != nil {
+        g.Close ()
+        return nil, err
+    }
+    return g, nil
+}
+
+/* Return a handle obtained from Get to the pool. */
+func (p *Pool) Put (g *Guestfs) {
+    if err := g.Umount_all (); err != nil {
+        p.Discard (g)
+        return
+    }
+    p.mu.Lock ()
+    defer p.mu.Unlock ()
+    if p.closed {
+        g.Close ()
+        <-p.slots
+        return
+    }
+    // This can't block, since there are no more handles than slots.
+    p.idle <- g
+}
+
+/* Close a handle obtained from Get, instead of returning it. */
+func (p *Pool) Discard (g *Guestfs) {
+    g.Close ()
+    <-p.slots
+}
+
+/* Close the idle handles.  Handles which are in use are closed when
+ * they are returned.
+ */
+func (p *Pool) Close () {
+    p.mu.Lock ()
+    p.closed = true
+    p.mu.Unlock ()
+    for {
+        select {
+        case g := <-p.idle:
+            p.Discard (g)
+        default:
+            return
+        }
+    }
+}
+
 /* XXX Events/callbacks not yet implemented. */
 ";
 
@@ -292,46 +540,41 @@ func return_hashtable (argv **C.char) map[string]string {
         pr "}\n";
       );
 
-      pr "\n";
-      pr "/* %s : %s */\n" name shortdesc;
-      pr "func (g *Guestfs) %s" go_name;
-
       (* Arguments. *)
-      pr " (";
-      let comma = ref false in
-      List.iter (
-        fun arg ->
+      let pr_args () =
+        let comma = ref false in
+        List.iter (
+          fun arg ->
+            if !comma then pr ", ";
+            comma := true;
+            match arg with
+            | Bool n -> pr "%s bool" n
+            | Int n -> pr "%s int" n
+            | Int64 n -> pr "%s int64" n
+            | String n
+            | Device n
+            | Mountable n
+            | Pathname n
+            | Dev_or_Path n
+            | Mountable_or_Path n
+            | Key n
+            | FileIn n | FileOut n
+            | GUID n -> pr "%s string" n
+            | OptString n -> pr "%s *string" n
+            | StringList n
+            | DeviceList n
+            | FilenameList n -> pr "%s []string" n
+            | BufferIn n -> pr "%s []byte" n
+            | Pointer (_, n) -> pr "%s int64" n
+        ) args;
+        if optargs <> [] then (
           if !comma then pr ", ";
           comma := true;
-          match arg with
-          | Bool n -> pr "%s bool" n
-          | Int n -> pr "%s int" n
-          | Int64 n -> pr "%s int64" n
-          | String n
-          | Device n
-          | Mountable n
-          | Pathname n
-          | Dev_or_Path n
-          | Mountable_or_Path n
-          | Key n
-          | FileIn n | FileOut n
-          | GUID n -> pr "%s string" n
-          | OptString n -> pr "%s *string" n
-          | StringList n
-          | DeviceList n
-          | FilenameList n -> pr "%s []string" n
-          | BufferIn n -> pr "%s []byte" n
-          | Pointer (_, n) -> pr "%s int64" n
-      ) args;
-      if optargs <> [] then (
-        if !comma then pr ", ";
-        comma := true;
-        pr "optargs *Optargs%s" go_name
-      );
-      pr ")";
+          pr "optargs *Optargs%s" go_name
+        ) in
 
       (* Return type. *)
-      let noreturn =
+      let pr_ret () =
         match ret with
         | RErr -> pr " *GuestfsError"; ""
         | RInt _ -> pr " (int, *GuestfsError)"; "0, "
@@ -352,11 +595,35 @@ func return_hashtable (argv **C.char) map[string]string {
         | RHashtable _ -> pr " (map[string]string, *GuestfsError)"; "nil, "
         | RBufferOut _ -> pr " ([]byte, *GuestfsError)"; "nil, " in
 
+      pr "\n";
+      pr "/* %s : %s */\n" name shortdesc;
+      pr "func (g *Guestfs) %s (" go_name;
+      pr_args ();
+      pr ")";
+      ignore (pr_ret ());
+      pr " {\n";
+      pr "    return g.%s_context (context.Background ()" go_name;
+      List.iter (fun arg -> pr ", %s" (name_of_argt arg)) args;
+      if optargs <> [] then pr ", optargs";
+      pr ")\n";
+      pr "}\n";
+
+      pr "\n";
+      pr "/* %s_context : %s */\n" name shortdesc;
+      pr "func (g *Guestfs) %s_context (ctx context.Context" go_name;
+      if args <> [] || optargs <> [] then pr ", ";
+      pr_args ();
+      pr ")";
+      let noreturn = pr_ret () in
+
       (* Body of the function. *)
       pr " {\n";
       pr "    if g.g == nil {\n";
       pr "        return %sclosed_handle_error (\"%s\")\n" noreturn name;
       pr "    }\n";
+      pr "    if ctx.Err () != nil {\n";
+      pr "        return %scontext_error (ctx, \"%s\")\n" noreturn name;
+      pr "    }\n";
 
       List.iter (
         function
@@ -440,6 +707,11 @@ func return_hashtable (argv **C.char) map[string]string {
       | _ -> ()
       );
 
+      if f.cancellable then (
+        pr "\n";
+        pr "    defer g.watch_context (ctx) ()\n"
+      );
+
       pr "\n";
       pr "    r := C.%s (g.g" f.c_function;
       List.iter (
@@ -478,12 +750,12 @@ func return_hashtable (argv **C.char) map[string]string {
       | `ErrorIsMinusOne ->
         pr "\n";
         pr "    if r == -1 {\n";
-        pr "        return %sget_error_from_handle (g, \"%s\")\n" noreturn name;
+        pr "        return %sget_error_from_context (g, ctx, \"%s\")\n" noreturn name;
         pr "    }\n"
       | `ErrorIsNULL ->
         pr "\n";
         pr "    if r == nil {\n";
-        pr "        return %sget_error_from_handle (g, \"%s\")\n" noreturn name;
+        pr "        return %sget_error_from_context (g, ctx, \"%s\")\n" noreturn name;
         pr "    }\n"
       );
 
@@ -253,6 +253,103 @@ public class GuestFS {
 
   private native void _delete_event_callback (long g, int eh);
 
+  /**
+   * <p>
+   * Read part of a file into a buffer.
+   * </p><p>
+   * This is like {@link #pread pread}, but the data is read
+   * into the remaining space of <code>buf</code>, which must be a
+   * direct buffer, instead of being returned as a new array.  The
+   * position of <code>buf</code> is advanced by the number of bytes
+   * read.
+   * </p>
+   *
+   * @throws LibGuestFSException If there is a libguestfs error.
+   * @see \"The section &quot;READING INTO A CALLER BUFFER&quot; in the guestfs(3) manual\"
+   * @return the number of bytes read, or 0 at the end of the file
+   */
+  public int preadInto (String path, java.nio.ByteBuffer buf, long offset)
+    throws LibGuestFSException
+  {
+    if (g == 0)
+      throw new LibGuestFSException (\"preadInto: handle is closed\");
+    if (!buf.isDirect ())
+      throw new IllegalArgumentException (\"preadInto: buffer is not direct\");
+
+    int r = _pread_into (g, path, buf, buf.position (), buf.remaining (),
+                         offset);
+    buf.position (buf.position () + r);
+    return r;
+  }
+
+  private native int _pread_into (long g, String path,
+                                  java.nio.ByteBuffer buf, int pos, int len,
+                                  long offset)
+    throws LibGuestFSException;
+
+  /**
+   * <p>
+   * Read part of a device into a buffer.
+   * </p><p>
+   * This is like {@link #preadInto preadInto}, but reads from a
+   * device.
+   * </p>
+   *
+   * @throws LibGuestFSException If there is a libguestfs error.
+   * @return the number of bytes read, or 0 at the end of the device
+   */
+  public int preadDeviceInto (String device, java.nio.ByteBuffer buf,
+                              long offset)
+    throws LibGuestFSException
+  {
+    if (g == 0)
+      throw new LibGuestFSException (\"preadDeviceInto: handle is closed\");
+    if (!buf.isDirect ())
+      throw new IllegalArgumentException (\"preadDeviceInto: buffer is not direct\");
+
+    int r = _pread_device_into (g, device, buf, buf.position (),
+                                buf.remaining (), offset);
+    buf.position (buf.position () + r);
+    return r;
+  }
+
+  private native int _pread_device_into (long g, String device,
+                                         java.nio.ByteBuffer buf,
+                                         int pos, int len, long offset)
+    throws LibGuestFSException;
+
+  /**
+   * <p>
+   * Read a whole file into a buffer.
+   * </p><p>
+   * This is like {@link #read_file read_file}, but the file is read
+   * into the remaining space of <code>buf</code>, which must be a
+   * direct buffer.  If the file does not fit, an exception is thrown.
+   * The position of <code>buf</code> is advanced by the size of the
+   * file.
+   * </p>
+   *
+   * @throws LibGuestFSException If there is a libguestfs error.
+   * @return the size of the file
+   */
+  public int readFileInto (String path, java.nio.ByteBuffer buf)
+    throws LibGuestFSException
+  {
+    if (g == 0)
+      throw new LibGuestFSException (\"readFileInto: handle is closed\");
+    if (!buf.isDirect ())
+      throw new IllegalArgumentException (\"readFileInto: buffer is not direct\");
+
+    int r = _read_file_into (g, path, buf, buf.position (), buf.remaining ());
+    buf.position (buf.position () + r);
+    return r;
+  }
+
+  private native int _read_file_into (long g, String path,
+                                      java.nio.ByteBuffer buf,
+                                      int pos, int len)
+    throws LibGuestFSException;
+
 ";
 
   (* Methods. *)
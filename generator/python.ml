@@ -88,6 +88,9 @@ extern PyObject *guestfs_int_py_close (PyObject *self, PyObject *args);
 extern PyObject *guestfs_int_py_set_event_callback (PyObject *self, PyObject *args);
 extern PyObject *guestfs_int_py_delete_event_callback (PyObject *self, PyObject *args);
 extern PyObject *guestfs_int_py_event_to_string (PyObject *self, PyObject *args);
+extern PyObject *guestfs_int_py_pread_into (PyObject *self, PyObject *args);
+extern PyObject *guestfs_int_py_pread_device_into (PyObject *self, PyObject *args);
+extern PyObject *guestfs_int_py_read_file_into (PyObject *self, PyObject *args);
 extern char **guestfs_int_py_get_string_list (PyObject *obj);
 extern PyObject *guestfs_int_py_put_string_list (char * const * const argv);
 extern PyObject *guestfs_int_py_put_table (char * const * const argv);
@@ -605,6 +608,12 @@ and generate_python_module () =
   pr "    guestfs_int_py_delete_event_callback, METH_VARARGS, NULL },\n";
   pr "  { (char *) \"event_to_string\",\n";
   pr "    guestfs_int_py_event_to_string, METH_VARARGS, NULL },\n";
+  pr "  { (char *) \"pread_into\",\n";
+  pr "    guestfs_int_py_pread_into, METH_VARARGS, NULL },\n";
+  pr "  { (char *) \"pread_device_into\",\n";
+  pr "    guestfs_int_py_pread_device_into, METH_VARARGS, NULL },\n";
+  pr "  { (char *) \"read_file_into\",\n";
+  pr "    guestfs_int_py_read_file_into, METH_VARARGS, NULL },\n";
   List.iter (
     fun { name = name; c_name = c_name } ->
       pr "#ifdef GUESTFS_HAVE_%s\n" (String.uppercase_ascii c_name);
@@ -836,6 +845,39 @@ class GuestFS(object):
         self._check_not_closed()
         libguestfsmod.delete_event_callback(self._o, event_handle)
 
+    def pread_into(self, path, buf, offset):
+        \"\"\"Read part of a file into a buffer.
+
+        This is like \"pread\", but it reads up to len(buf) bytes
+        into \"buf\", which must be a writable buffer such as a
+        bytearray or a memoryview, instead of returning a new string.
+        This avoids copying the data again for large reads.
+
+        This function returns the number of bytes read, which is
+        0 at the end of the file.
+        \"\"\"
+        self._check_not_closed()
+        return libguestfsmod.pread_into(self._o, path, buf, offset)
+
+    def pread_device_into(self, device, buf, offset):
+        \"\"\"Read part of a device into a buffer.
+
+        This is like \"pread_into\", but it reads from a device.
+        \"\"\"
+        self._check_not_closed()
+        return libguestfsmod.pread_device_into(self._o, device, buf, offset)
+
+    def read_file_into(self, path, buf):
+        \"\"\"Read a whole file into a buffer.
+
+        This is like \"read_file\", but it reads the file into
+        \"buf\", which must be a writable buffer such as a
+        bytearray or a memoryview, and returns the size of the
+        file.  An exception is raised if the file does not fit.
+        \"\"\"
+        self._check_not_closed()
+        return libguestfsmod.read_file_into(self._o, path, buf)
+
 ";
 
   let map_join f l =
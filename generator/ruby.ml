@@ -84,6 +84,7 @@ extern VALUE guestfs_int_ruby_close_handle (VALUE gv);
 extern VALUE guestfs_int_ruby_set_event_callback (VALUE gv, VALUE cbv, VALUE event_bitmaskv);
 extern VALUE guestfs_int_ruby_delete_event_callback (VALUE gv, VALUE event_handlev);
 extern VALUE guestfs_int_ruby_event_to_string (VALUE modulev, VALUE eventsv);
+extern void guestfs_int_ruby_call_without_gvl (guestfs_h *g, void *(*fn) (void *), void *data);
 
 ";
 
@@ -203,6 +204,60 @@ and generate_ruby_c actions () =
 " f.name
       );
 
+      (* Blocking calls are made without holding the GVL, so that
+       * other Ruby threads can run.  The call and its arguments are
+       * packed into a struct for rb_thread_call_without_gvl.
+       *)
+      if f.blocking then (
+        pr "struct ruby_%s_call {\n" f.name;
+        pr "  guestfs_h *g;\n";
+        List.iter (
+          function
+          | Pathname n | Device n | Mountable n
+          | Dev_or_Path n | Mountable_or_Path n | String n | Key n
+          | FileIn n | FileOut n | GUID n | OptString n ->
+            pr "  const char *%s;\n" n
+          | BufferIn n ->
+            pr "  const char *%s;\n" n;
+            pr "  size_t %s_size;\n" n
+          | StringList n | DeviceList n | FilenameList n ->
+            pr "  char **%s;\n" n
+          | Bool n | Int n ->
+            pr "  int %s;\n" n
+          | Int64 n ->
+            pr "  long long %s;\n" n
+          | Pointer (t, n) ->
+            pr "  void * /* %s */ %s;\n" t n
+        ) args;
+        if optargs <> [] then
+          pr "  struct %s *optargs;\n" f.c_function;
+        pr "  %s;\n" (ruby_ret_decl ret);
+        (match ret with
+         | RBufferOut _ -> pr "  size_t size;\n"
+         | _ -> ());
+        pr "};\n";
+        pr "\n";
+        pr "static void *\n";
+        pr "ruby_%s_nogvl (void *callv)\n" f.name;
+        pr "{\n";
+        pr "  struct ruby_%s_call *call = callv;\n" f.name;
+        pr "\n";
+        pr "  call->r = %s (call->g" f.c_function;
+        List.iter (
+          function
+          | BufferIn n -> pr ", call->%s, call->%s_size" n n
+          | arg -> pr ", call->%s" (name_of_argt arg)
+        ) args;
+        (match ret with
+         | RBufferOut _ -> pr ", &call->size"
+         | _ -> ());
+        if optargs <> [] then pr ", call->optargs";
+        pr ");\n";
+        pr "  return NULL;\n";
+        pr "}\n";
+        pr "\n"
+      );
+
       (* Generate the function.  Prototype is completely different
        * depending on whether it's got optargs or not.
        *
@@ -346,9 +401,32 @@ and generate_ruby_c actions () =
       );
       pr "\n";
 
-      pr "  r = %s " f.c_function;
-      generate_c_call_args ~handle:"g" f.style;
-      pr ";\n";
+      if f.blocking then (
+        pr "  struct ruby_%s_call call = {\n" f.name;
+        pr "    .g = g,\n";
+        List.iter (
+          function
+          | BufferIn n ->
+            pr "    .%s = %s,\n" n n;
+            pr "    .%s_size = %s_size,\n" n n
+          | arg ->
+            let n = name_of_argt arg in
+            pr "    .%s = %s,\n" n n
+        ) args;
+        if optargs <> [] then
+          pr "    .optargs = optargs,\n";
+        pr "  };\n";
+        pr "  guestfs_int_ruby_call_without_gvl (g, ruby_%s_nogvl, &call);\n"
+          f.name;
+        pr "  r = call.r;\n";
+        (match ret with
+         | RBufferOut _ -> pr "  size = call.size;\n"
+         | _ -> ())
+      ) else (
+        pr "  r = %s " f.c_function;
+        generate_c_call_args ~handle:"g" f.style;
+        pr ";\n"
+      );
 
       List.iter (
         function
@@ -509,6 +587,17 @@ Init__guestfs (void)
 
   pr "}\n"
 
+(* The C declaration of the return value [r] of a call. *)
+and ruby_ret_decl = function
+  | RErr | RInt _ | RBool _ -> "int r"
+  | RInt64 _ -> "int64_t r"
+  | RConstString _ | RConstOptString _ -> "const char *r"
+  | RString _ -> "char *r"
+  | RStringList _ | RHashtable _ -> "char **r"
+  | RStruct (_, typ) -> sprintf "struct guestfs_%s *r" typ
+  | RStructList (_, typ) -> sprintf "struct guestfs_%s_list *r" typ
+  | RBufferOut _ -> "char *r"
+
 (* Ruby code to return a struct. *)
 and generate_ruby_struct_code typ cols =
   pr "  volatile VALUE rv = rb_hash_new ();\n";
@@ -121,6 +121,21 @@ let structs = [
   { defaults with
     s_name = "lvm_lv"; s_cols = lvm_lv_cols; s_camel_name = "LV" };
 
+  (* Returned by lvm_report, one entry for each PV, VG or LV. *)
+  { defaults with
+    s_name = "lvm_object";
+    s_cols = [
+    "lo_type", FString;         (* "pv", "vg" or "lv" *)
+    "lo_name", FString;
+    "lo_uuid", FString;
+    "lo_attr", FString;
+    "lo_size", FBytes;
+    "lo_free", FBytes;
+    "lo_vg_name", FString;
+    "lo_vg_uuid", FString;
+    ];
+    s_camel_name = "LVMObject" };
+
   (* Column names and types from stat structures.
    * NB. Can't use things like 'st_atime' because glibc header files
    * define some of these as macros.  Ugh.
@@ -434,6 +449,45 @@ let structs = [
     "hivex_value_h", FInt64;
     ];
     s_camel_name = "HivexValue" };
+
+  (* Used by hivex_query to return the values of many nodes at once. *)
+  { defaults with
+    s_name = "hivex_query_value";
+    s_cols = [
+    "hivex_query_path", FString;
+    "hivex_query_key", FString;
+    "hivex_query_type", FInt64;
+    "hivex_query_value", FBuffer;
+    ];
+    s_camel_name = "HivexQueryValue" };
+
+  (* Used by device_changed_ranges to return byte ranges of a device. *)
+  { defaults with
+    s_name = "blockrange";
+    s_cols = [
+    "br_start", FBytes;
+    "br_size", FBytes;
+    ];
+    s_camel_name = "BlockRange" };
+  (* Used by file_extents to return the FIEMAP extents of a file. *)
+  { defaults with
+    s_name = "file_extent";
+    s_cols = [
+    "fe_logical", FBytes;
+    "fe_physical", FBytes;
+    "fe_length", FBytes;
+    "fe_flags", FUInt32;
+    ];
+    s_camel_name = "FileExtent" };
+  (* Used by blkid_all to return the tags of all devices at once. *)
+  { defaults with
+    s_name = "blkid_tag";
+    s_cols = [
+    "bt_device", FString;
+    "bt_name", FString;
+    "bt_value", FString;
+    ];
+    s_camel_name = "BlkidTag" };
   { defaults with
     s_name = "internal_mountable";
     s_internal = true;
@@ -468,6 +522,81 @@ let structs = [
     ];
     s_camel_name = "TSKDirent" };
 
+  (* Block device, partition and filesystem. *)
+  { defaults with
+    s_name = "block_device";
+    s_cols = [
+    "bd_device", FString;
+    "bd_parent", FString;
+    "bd_partnum", FInt32;
+    "bd_size", FBytes;
+    "bd_vfs_type", FString;
+    "bd_vfs_label", FString;
+    "bd_vfs_uuid", FString;
+    ];
+    s_camel_name = "BlockDevice" };
+
+  (* Everything about a partition table entry. *)
+  { defaults with
+    s_name = "partition_info";
+    s_cols = [
+    "pi_num", FInt32;
+    "pi_start", FBytes;
+    "pi_end", FBytes;
+    "pi_size", FBytes;
+    "pi_mbr_part_type", FString;
+    "pi_mbr_id", FInt32;
+    "pi_gpt_type", FString;
+    "pi_gpt_guid", FString;
+    "pi_gpt_attributes", FInt64;
+    "pi_name", FString;
+    "pi_bootable", FInt32;
+    ];
+    s_camel_name = "PartitionInfo" };
+
+  (* btrfs subvolumes and snapshots, from the root and quota trees *)
+  { defaults with
+    s_name = "btrfsinventory";
+    s_cols = [
+    "btrfsinventory_id", FUInt64;
+    "btrfsinventory_top_level_id", FUInt64;
+    "btrfsinventory_path", FString;
+    "btrfsinventory_generation", FUInt64;
+    "btrfsinventory_uuid", FString;
+    "btrfsinventory_parent_uuid", FString;
+    "btrfsinventory_readonly", FInt32;
+    "btrfsinventory_default", FInt32;
+    "btrfsinventory_rfer", FInt64;
+    "btrfsinventory_excl", FInt64;
+    ];
+    s_camel_name = "BTRFSInventory" };
+
+  (* fsck_multiple result for each device *)
+  { defaults with
+    s_name = "fsck_result";
+    s_cols = [
+    "fr_device", FString;
+    "fr_vfs_type", FString;
+    "fr_status", FInt32;
+    "fr_output", FString;
+    ];
+    s_camel_name = "FsckResult" };
+
+  (* list_storage result for each filesystem, LV, VG, PV etc. *)
+  { defaults with
+    s_name = "storage_entry";
+    s_cols = [
+    "se_name", FString;
+    "se_type", FString;
+    "se_vfs_type", FString;
+    "se_vfs_label", FString;
+    "se_uuid", FString;
+    "se_mbr_id", FInt32;
+    "se_size", FInt64;
+    "se_parents", FString;
+    ];
+    s_camel_name = "StorageEntry" };
+
 ] (* end of structs *)
 
 let lookup_struct name =
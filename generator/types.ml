@@ -379,6 +379,13 @@ type action = {
                                      set flags in the handle are marked
                                      non-blocking so that we don't add
                                      machinery in various bindings. *)
+  reentrant : bool;               (* Daemon function is read-only (or only
+                                     creates objects named by its caller,
+                                     like luks_open) and safe to run
+                                     concurrently with other reentrant
+                                     calls in a guestfsd worker thread.
+                                     It must not use CHROOT_IN, pulse mode
+                                     or any global state. *)
   wrapper : bool;                 (* For non-daemon functions, generate a
                                      wrapper which calls the underlying
                                      guestfs_impl_<name> function.  The wrapper
@@ -244,10 +244,46 @@ struct guestfs_message_header {
   guestfs_message_status status;
 };
 
-const GUESTFS_MAX_CHUNK_SIZE = 8192;
+";
+
+  (* File transfers start off using the small default chunk size.
+   * After launch the library and daemon may negotiate a larger chunk
+   * size (see internal_set_chunk_size), up to GUESTFS_MAX_CHUNK_SIZE.
+   * An encoded chunk must still fit inside GUESTFS_MESSAGE_MAX.
+   *)
+  pr "const GUESTFS_DEFAULT_CHUNK_SIZE = %d;\n" 8192;
+  pr "const GUESTFS_MAX_CHUNK_SIZE = %d;\n" (2 * 1024 * 1024);
+  pr "\n";
+
+  (* File transfer chunks may be striped across several virtio-serial
+   * channels (see internal_set_data_channels).  Channel 0 is the main
+   * daemon channel.
+   *)
+  pr "const GUESTFS_MAX_DATA_CHANNELS = %d;\n" 8;
+  pr "\n";
+
+  pr "\
+/* A chunk with cancel == GUESTFS_CHUNK_HOLE is not a cancellation:
+ * it stands for a run of zero bytes (a hole) in a downloaded file,
+ * and its data is the length of the hole as an XDR unsigned hyper.
+ * Only the daemon sends these, unless GUESTFS_CODEC_ZERO has been
+ * negotiated, in which case the library may send them too.
+ */
+const GUESTFS_CHUNK_HOLE = 2;
+
+/* A chunk with cancel == GUESTFS_CHUNK_ZSTD carries a single zstd
+ * frame, which decompresses to at most the negotiated chunk size.
+ * Either side may send these once GUESTFS_CODEC_ZSTD has been
+ * negotiated.
+ */
+const GUESTFS_CHUNK_ZSTD = 3;
+
+/* Chunk codecs, negotiated after launch by internal_set_chunk_codec. */
+const GUESTFS_CODEC_ZERO = 1;
+const GUESTFS_CODEC_ZSTD = 2;
 
 struct guestfs_chunk {
-  int cancel;			     /* if non-zero, transfer is cancelled */
+  int cancel;			     /* if 1, transfer is cancelled */
   /* data size is 0 bytes if the transfer has finished successfully */
   opaque data<GUESTFS_MAX_CHUNK_SIZE>;
 };
@@ -33,6 +33,7 @@ let parse_cmdline () =
   let machine_readable = ref false in
   let unversioned = ref false in
   let prefix = ref None in
+  let boot_filesystem = ref None in
 
   let set_file arg =
     if !file <> None then
@@ -49,10 +50,16 @@ let parse_cmdline () =
   and set_prefix p =
     if !prefix <> None then
       error (f_"--prefix option can only be given once");
-    prefix := Some p in
+    prefix := Some p
+  and set_boot_filesystem arg =
+    if !boot_filesystem <> None then
+      error (f_"--boot-filesystem option can only be given once");
+    boot_filesystem := Some arg in
 
   let argspec = [
     [ S 'a'; L"add" ],        Getopt.String (s_"file", set_file),        s_"Add disk image file";
+    [ L"boot-filesystem" ], Getopt.String (s_"auto|LABEL=..|UUID=..|device", set_boot_filesystem),
+                                            s_"Look for the kernel only in this filesystem";
     [ S 'c'; L"connect" ],        Getopt.Set_string (s_"uri", libvirturi), s_"Set libvirt URI";
     [ S 'd'; L"domain" ],        Getopt.String (s_"domain", set_domain),      s_"Set libvirt guest name";
     [ L"format" ],  Getopt.Set_string (s_"format", format),      s_"Format of input disk";
@@ -112,8 +119,9 @@ read the man page virt-get-kernel(1).
   let output = match !output with "" -> None | str -> Some str in
   let unversioned = !unversioned in
   let prefix = !prefix in
+  let boot_filesystem = !boot_filesystem in
 
-  add, output, unversioned, prefix
+  add, output, unversioned, prefix, boot_filesystem
 
 let rec do_fetch ~transform_fn ~outputdir g root =
   (* Mount up the disks. *)
@@ -122,10 +130,67 @@ let rec do_fetch ~transform_fn ~outputdir g root =
   let files =
     let typ = g#inspect_get_type root in
     match typ with
-    | "linux" -> pick_kernel_files_linux g root
+    | "linux" -> pick_kernel_files_linux g "/boot" root
     | typ ->
       error (f_"operating system '%s' not supported") typ in
 
+  download_files ~transform_fn ~outputdir g files
+
+(* The fast path: mount only the filesystem with the kernel, without
+ * inspecting the guest.
+ *)
+and do_fetch_boot_filesystem ~transform_fn ~outputdir g spec =
+  let fs, boot_dir =
+    match spec with
+    | "auto" -> find_boot_filesystem g
+    | spec ->
+      let fs =
+        if String.is_prefix spec "LABEL=" then
+          g#findfs_label (String.sub spec 6 (String.length spec - 6))
+        else if String.is_prefix spec "UUID=" then
+          g#findfs_uuid (String.sub spec 5 (String.length spec - 5))
+        else spec in
+      g#mount_ro fs "/";
+      match kernel_dir g with
+      | Some dir -> fs, dir
+      | None -> error (f_"no kernel found in %s") fs in
+
+  let files = pick_kernel_files_linux g boot_dir fs in
+  download_files ~transform_fn ~outputdir g files
+
+(* Try the filesystems which are most likely to contain the kernel
+ * first: the ones labelled "boot", then the rest of the Linux
+ * filesystems.  The first one with a kernel is left mounted on /.
+ *)
+and find_boot_filesystem (g : Guestfs.guestfs) =
+  let filesystems = g#list_filesystems () in
+  let filesystems = List.filter (
+    fun (_, vfs) ->
+      List.mem vfs [ "ext2"; "ext3"; "ext4"; "xfs"; "btrfs"; "jfs";
+                     "reiserfs"; "f2fs" ]
+  ) filesystems in
+  let is_boot_label (fs, _) =
+    let label = try g#vfs_label fs with G.Error _ -> "" in
+    List.mem (String.lowercase_ascii label) [ "boot"; "/boot" ] in
+  let boot, others = List.partition is_boot_label filesystems in
+  let rec loop = function
+    | [] -> error (f_"no filesystem containing a kernel found")
+    | (fs, _) :: rest ->
+      let mounted = try g#mount_ro fs "/"; true with G.Error _ -> false in
+      match (if mounted then kernel_dir g else None) with
+      | Some dir -> fs, dir
+      | None ->
+        if mounted then g#umount_all ();
+        loop rest in
+  loop (boot @ others)
+
+(* A separate /boot filesystem has the kernels at the top level. *)
+and kernel_dir (g : Guestfs.guestfs) =
+  if g#glob_expand "/boot/vmlinuz-*" <> [||] then Some "/boot"
+  else if g#glob_expand "/vmlinuz-*" <> [||] then Some "/"
+  else None
+
+and download_files ~transform_fn ~outputdir (g : Guestfs.guestfs) files =
   (* Download the files. *)
   List.iter (
     fun f ->
@@ -137,17 +202,17 @@ let rec do_fetch ~transform_fn ~outputdir g root =
 
   g#umount_all ()
 
-and pick_kernel_files_linux (g : Guestfs.guestfs) root =
+and pick_kernel_files_linux (g : Guestfs.guestfs) boot_dir root =
   (* Get all kernels and initramfses. *)
-  let glob w = Array.to_list (g#glob_expand w) in
-  let kernels = glob "/boot/vmlinuz-*" in
-  let initrds = glob "/boot/initramfs-*" in
+  let glob w = Array.to_list (g#glob_expand (boot_dir // w)) in
+  let kernels = glob "vmlinuz-*" in
+  let initrds = glob "initramfs-*" in
 
   (* Old RHEL: *)
-  let initrds = if initrds <> [] then initrds else glob "/boot/initrd-*" in
+  let initrds = if initrds <> [] then initrds else glob "initrd-*" in
 
   (* Debian/Ubuntu: *)
-  let initrds = if initrds <> [] then initrds else glob "/boot/initrd.img-*" in
+  let initrds = if initrds <> [] then initrds else glob "initrd.img-*" in
 
   (* Sort by version to get the latest version as first element. *)
   let kernels = List.rev (List.sort compare_version kernels) in
@@ -167,7 +232,7 @@ and pick_kernel_files_linux (g : Guestfs.guestfs) root =
 
 (* Main program. *)
 let main () =
-  let add, output, unversioned, prefix = parse_cmdline () in
+  let add, output, unversioned, prefix, boot_filesystem = parse_cmdline () in
 
   (* Connect to libguestfs. *)
   let g = open_guestfs () in
@@ -177,13 +242,6 @@ let main () =
   (* Decrypt the disks. *)
   inspect_decrypt g;
 
-  let roots = g#inspect_os () in
-  if Array.length roots = 0 then
-    error (f_"no operating system found");
-  if Array.length roots > 1 then
-    error (f_"dual/multi-boot images are not supported by this tool");
-  let root = roots.(0) in
-
   let dest_filename fn =
     let fn = Filename.basename fn in
     let fn =
@@ -198,7 +256,19 @@ let main () =
     | None -> Filename.current_dir_name
     | Some dir -> dir in
 
-  do_fetch ~transform_fn:dest_filename ~outputdir g root;
+  (match boot_filesystem with
+  | Some spec ->
+    do_fetch_boot_filesystem ~transform_fn:dest_filename ~outputdir g spec
+  | None ->
+    let roots = g#inspect_os () in
+    if Array.length roots = 0 then
+      error (f_"no operating system found");
+    if Array.length roots > 1 then
+      error (f_"dual/multi-boot images are not supported by this tool");
+    let root = roots.(0) in
+
+    do_fetch ~transform_fn:dest_filename ~outputdir g root
+  );
 
   (* Shutdown. *)
   g#shutdown ();
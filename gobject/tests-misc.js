@@ -16,6 +16,7 @@
 // 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 
 const Guestfs = imports.gi.Guestfs;
+const GLib = imports.gi.GLib;
 
 var fail = false;
 
@@ -54,6 +55,25 @@ if (!progress_detected) {
   fail = true;
 }
 
+// Test an asynchronous call, and that events are delivered in the
+// main loop while it runs.
+progress_detected = false;
+var loop = new GLib.MainLoop(null, false);
+g.debug_async('progress', ['5'], null, function(session, result) {
+  try {
+    session.debug_finish(result);
+  } catch (error) {
+    print("debug_async failed: " + error.message);
+    fail = true;
+  }
+  loop.quit();
+});
+loop.run();
+if (!progress_detected) {
+  print("failed to detect progress message for debug_async");
+  fail = true;
+}
+
 // Test close()
 g.close();
 var threw = false;
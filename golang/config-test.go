@@ -22,6 +22,9 @@
 
 package main
 
+/* The bindings use context.Context, which was added in Go 1.7. */
+import _ "context"
+
 func main() {
 	/* XXX Check for minimum runtime.Version() >= "go1.1.1"
          * Unfortunately go version numbers are not easy to parse.
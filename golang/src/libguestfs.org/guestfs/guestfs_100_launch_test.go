@@ -21,6 +21,8 @@
 package guestfs
 
 import (
+	"context"
+	"syscall"
 	"testing"
 //	"sort"
 )
@@ -94,12 +96,58 @@ func Test100Launch (t *testing.T) {
 	//sort.Sort (byName (dirs))
 	// XXX Sort interface is needlessly complicated
 
+	// A call with a context which is already done is not started.
+	ctx, cancel := context.WithCancel (context.Background ())
+	cancel ()
+	err = g.Touch_context (ctx, "/r")
+	if err == nil || err.Errno != syscall.EINTR {
+		t.Errorf ("g.Touch_context with cancelled context: %v", err)
+	}
+	exists, err := g.Exists ("/r")
+	if err != nil {
+		t.Errorf ("%s", err)
+	}
+	if exists {
+		t.Errorf ("g.Touch_context ran with a cancelled context")
+	}
+
 	err = g.Shutdown ()
 	if err != nil {
 		t.Errorf ("%s", err)
 	}
 }
 
+func Test100LaunchPool (t *testing.T) {
+	pool := New_pool (1, func (g *Guestfs) *GuestfsError {
+		return g.Add_drive_scratch (100 * 1024 * 1024, nil)
+	})
+	defer pool.Close ()
+
+	g1, err := pool.Get (context.Background ())
+	if err != nil {
+		t.Fatalf ("%s", err)
+	}
+	pool.Put (g1)
+
+	// The launched appliance is reused.
+	g2, err := pool.Get (context.Background ())
+	if err != nil {
+		t.Fatalf ("%s", err)
+	}
+	if g2 != g1 {
+		t.Errorf ("pool.Get did not reuse the idle handle")
+	}
+
+	// The pool is full, so this must wait until the context is done.
+	ctx, cancel := context.WithCancel (context.Background ())
+	cancel ()
+	_, err = pool.Get (ctx)
+	if err == nil {
+		t.Errorf ("pool.Get on a full pool did not fail")
+	}
+	pool.Put (g2)
+}
+
 /* - declared in guestfs_900_rstringlist_test.go
 func equal (xs []string, ys []string) bool {
 	if len(xs) != len(ys) {
@@ -42,6 +42,8 @@
 #include "guestfs.h"
 #include "options.h"
 #include "display-options.h"
+#include "domains.h"
+#include "parallel.h"
 
 /* Currently open libguestfs handle. */
 guestfs_h *g;
@@ -57,14 +59,17 @@ static const char *xpath = NULL;
 static int inspect_apps = 1;
 static int inspect_icon = 1;
 
-static void output (char **roots);
-static void output_roots (xmlTextWriterPtr xo, char **roots);
-static void output_root (xmlTextWriterPtr xo, char *root);
-static void output_mountpoints (xmlTextWriterPtr xo, char *root);
-static void output_filesystems (xmlTextWriterPtr xo, char *root);
-static void output_drive_mappings (xmlTextWriterPtr xo, char *root);
-static void output_applications (xmlTextWriterPtr xo, char *root);
+static void output (guestfs_h *g, char **roots);
+static int output_roots (guestfs_h *g, xmlTextWriterPtr xo, char **roots);
+static int output_root (guestfs_h *g, xmlTextWriterPtr xo, char *root);
+static int output_mountpoints (guestfs_h *g, xmlTextWriterPtr xo, char *root);
+static int output_filesystems (guestfs_h *g, xmlTextWriterPtr xo, char *root);
+static int output_drive_mappings (guestfs_h *g, xmlTextWriterPtr xo, char *root);
+static int output_applications (guestfs_h *g, xmlTextWriterPtr xo, char *root);
 static void do_xpath (const char *query);
+#if defined(HAVE_LIBVIRT)
+static int inspect_work (guestfs_h *g, size_t i, FILE *fp);
+#endif
 
 static void __attribute__((noreturn))
 usage (int status)
@@ -78,8 +83,10 @@ usage (int status)
               "Usage:\n"
               "  %s [--options] -d domname file [file ...]\n"
               "  %s [--options] -a disk.img [-a disk.img ...] file [file ...]\n"
+              "  %s [--options] --all\n"
               "Options:\n"
               "  -a|--add image       Add image\n"
+              "  --all                Inspect every libvirt guest\n"
               "  -c|--connect uri     Specify libvirt URI for -d option\n"
               "  -d|--domain guest    Add disks from libvirt guest\n"
               "  --echo-keys          Don't turn off echo for passphrases\n"
@@ -88,13 +95,15 @@ usage (int status)
               "  --keys-from-stdin    Read passphrases from stdin\n"
               "  --no-applications    Do not output the installed applications\n"
               "  --no-icon            Do not output the guest icon\n"
+              "  -P nr_threads        Use at most nr_threads with --all\n"
+              "  --sizing type        Size the appliance automatically\n"
               "  -v|--verbose         Verbose messages\n"
               "  -V|--version         Display version and exit\n"
               "  -x                   Trace libguestfs API calls\n"
               "  --xpath query        Perform an XPath query\n"
               "For more information, see the manpage %s(1).\n"),
             getprogname (), getprogname (),
-            getprogname (), getprogname ());
+            getprogname (), getprogname (), getprogname ());
   }
   exit (status);
 }
@@ -108,9 +117,10 @@ main (int argc, char *argv[])
 
   enum { HELP_OPTION = CHAR_MAX + 1 };
 
-  static const char options[] = "a:c:d:vVx";
+  static const char options[] = "a:c:d:P:vVx";
   static const struct option long_options[] = {
     { "add", 1, 0, 'a' },
+    { "all", 0, 0, 0 },
     { "connect", 1, 0, 'c' },
     { "domain", 1, 0, 'd' },
     { "echo-keys", 0, 0, 0 },
@@ -121,6 +131,7 @@ main (int argc, char *argv[])
     { "no-applications", 0, 0, 0 },
     { "no-icon", 0, 0, 0 },
     { "short-options", 0, 0, 0 },
+    { "sizing", 1, 0, 0 },
     { "verbose", 0, 0, 'v' },
     { "version", 0, 0, 'V' },
     { "xpath", 1, 0, 0 },
@@ -132,6 +143,8 @@ main (int argc, char *argv[])
   bool format_consumed = true;
   int c;
   int option_index;
+  int all = 0;
+  size_t max_threads = 0;
 
   g = guestfs_create ();
   if (g == NULL)
@@ -153,12 +166,16 @@ main (int argc, char *argv[])
         echo_keys = 1;
       } else if (STREQ (long_options[option_index].name, "format")) {
         OPTION_format;
+      } else if (STREQ (long_options[option_index].name, "sizing")) {
+        OPTION_sizing;
       } else if (STREQ (long_options[option_index].name, "xpath")) {
         xpath = optarg;
       } else if (STREQ (long_options[option_index].name, "no-applications")) {
         inspect_apps = 0;
       } else if (STREQ (long_options[option_index].name, "no-icon")) {
         inspect_icon = 0;
+      } else if (STREQ (long_options[option_index].name, "all")) {
+        all = 1;
       } else
         error (EXIT_FAILURE, 0,
                _("unknown long option: %s (%d)"),
@@ -177,6 +194,11 @@ main (int argc, char *argv[])
       OPTION_d;
       break;
 
+    case 'P':
+      if (sscanf (optarg, "%zu", &max_threads) != 1)
+        error (EXIT_FAILURE, 0, _("-P option is not numeric"));
+      break;
+
     case 'v':
       OPTION_v;
       break;
@@ -259,6 +281,34 @@ main (int argc, char *argv[])
     exit (EXIT_SUCCESS);
   }
 
+  /* --all inspects every libvirt guest in parallel, and writes a
+   * single document with one <guest> element per guest.
+   */
+  if (all) {
+#if defined(HAVE_LIBVIRT)
+    int r;
+
+    if (drvs != NULL)
+      error (EXIT_FAILURE, 0,
+             _("cannot use --all together with -a or -d options."));
+
+    get_all_libvirt_domains (libvirt_uri);
+
+    /* libxml2 must be initialized before it is used from threads. */
+    xmlInitParser ();
+
+    printf ("<?xml version=\"1.0\"?>\n<guests>\n");
+    r = start_threads (max_threads, g, inspect_work, 0, 0);
+    printf ("</guests>\n");
+    free_domains ();
+    guestfs_close (g);
+
+    exit (r == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+#else
+    error (EXIT_FAILURE, 0, _("compiled without support for libvirt."));
+#endif
+  }
+
   /* User must have specified some drives. */
   if (drvs == NULL) {
     fprintf (stderr, _("%s: error: you must specify at least one -a or -d option.\n"),
@@ -289,7 +339,7 @@ main (int argc, char *argv[])
       error (EXIT_FAILURE, 0,
              _("no operating system could be detected inside this disk image.\n\nThis may be because the file is not a disk image, or is not a virtual machine\nimage, or because the OS type is not understood by libguestfs.\n\nNOTE for Red Hat Enterprise Linux 6 users: for Windows guest support you must\ninstall the separate libguestfs-winsupport package.\n\nIf you feel this is an error, please file a bug report including as much\ninformation about the disk image as possible.\n"));
 
-    output (roots);
+    output (g, roots);
   }
 
   guestfs_close (g);
@@ -303,7 +353,7 @@ main (int argc, char *argv[])
   } while (0)
 
 static void
-output (char **roots)
+output (guestfs_h *g, char **roots)
 {
   xmlOutputBufferPtr ob = xmlOutputBufferCreateFd (1, NULL);
   if (ob == NULL)
@@ -321,23 +371,27 @@ output (char **roots)
   XMLERROR (-1, xmlTextWriterSetIndentString (xo, BAD_CAST "  "));
 
   XMLERROR (-1, xmlTextWriterStartDocument (xo, NULL, NULL, NULL));
-  output_roots (xo, roots);
+  if (output_roots (g, xo, roots) == -1)
+    exit (EXIT_FAILURE);
   XMLERROR (-1, xmlTextWriterEndDocument (xo));
 }
 
-static void
-output_roots (xmlTextWriterPtr xo, char **roots)
+static int
+output_roots (guestfs_h *g, xmlTextWriterPtr xo, char **roots)
 {
   size_t i;
 
   XMLERROR (-1, xmlTextWriterStartElement (xo, BAD_CAST "operatingsystems"));
-  for (i = 0; roots[i] != NULL; ++i)
-    output_root (xo, roots[i]);
+  for (i = 0; roots[i] != NULL; ++i) {
+    if (output_root (g, xo, roots[i]) == -1)
+      return -1;
+  }
   XMLERROR (-1, xmlTextWriterEndElement (xo));
+  return 0;
 }
 
-static void
-output_root (xmlTextWriterPtr xo, char *root)
+static int
+output_root (guestfs_h *g, xmlTextWriterPtr xo, char *root)
 {
   char *str;
   int i, r;
@@ -349,41 +403,41 @@ output_root (xmlTextWriterPtr xo, char *root)
 
   canonical_root = guestfs_canonical_device_name (g, root);
   if (canonical_root == NULL)
-    exit (EXIT_FAILURE);
+    return -1;
   XMLERROR (-1,
 	    xmlTextWriterWriteElement (xo, BAD_CAST "root", BAD_CAST canonical_root));
   free (canonical_root);
 
   str = guestfs_inspect_get_type (g, root);
-  if (!str) exit (EXIT_FAILURE);
+  if (!str) return -1;
   if (STRNEQ (str, "unknown"))
     XMLERROR (-1,
 	      xmlTextWriterWriteElement (xo, BAD_CAST "name", BAD_CAST str));
   free (str);
 
   str = guestfs_inspect_get_arch (g, root);
-  if (!str) exit (EXIT_FAILURE);
+  if (!str) return -1;
   if (STRNEQ (str, "unknown"))
     XMLERROR (-1,
 	      xmlTextWriterWriteElement (xo, BAD_CAST "arch", BAD_CAST str));
   free (str);
 
   str = guestfs_inspect_get_distro (g, root);
-  if (!str) exit (EXIT_FAILURE);
+  if (!str) return -1;
   if (STRNEQ (str, "unknown"))
     XMLERROR (-1,
 	      xmlTextWriterWriteElement (xo, BAD_CAST "distro", BAD_CAST str));
   free (str);
 
   str = guestfs_inspect_get_product_name (g, root);
-  if (!str) exit (EXIT_FAILURE);
+  if (!str) return -1;
   if (STRNEQ (str, "unknown"))
     XMLERROR (-1,
 	      xmlTextWriterWriteElement (xo, BAD_CAST "product_name", BAD_CAST str));
   free (str);
 
   str = guestfs_inspect_get_product_variant (g, root);
-  if (!str) exit (EXIT_FAILURE);
+  if (!str) return -1;
   if (STRNEQ (str, "unknown"))
     XMLERROR (-1,
 	      xmlTextWriterWriteElement (xo, BAD_CAST "product_variant", BAD_CAST str));
@@ -399,14 +453,14 @@ output_root (xmlTextWriterPtr xo, char *root)
 	    xmlTextWriterWriteElement (xo, BAD_CAST "minor_version", BAD_CAST buf));
 
   str = guestfs_inspect_get_package_format (g, root);
-  if (!str) exit (EXIT_FAILURE);
+  if (!str) return -1;
   if (STRNEQ (str, "unknown"))
     XMLERROR (-1,
 	      xmlTextWriterWriteElement (xo, BAD_CAST "package_format", BAD_CAST str));
   free (str);
 
   str = guestfs_inspect_get_package_management (g, root);
-  if (!str) exit (EXIT_FAILURE);
+  if (!str) return -1;
   if (STRNEQ (str, "unknown"))
     XMLERROR (-1,
 	      xmlTextWriterWriteElement (xo, BAD_CAST "package_management",
@@ -433,7 +487,7 @@ output_root (xmlTextWriterPtr xo, char *root)
   guestfs_pop_error_handler (g);
 
   str = guestfs_inspect_get_hostname (g, root);
-  if (!str) exit (EXIT_FAILURE);
+  if (!str) return -1;
   if (STRNEQ (str, "unknown"))
     XMLERROR (-1,
 	      xmlTextWriterWriteElement (xo, BAD_CAST "hostname",
@@ -441,7 +495,7 @@ output_root (xmlTextWriterPtr xo, char *root)
   free (str);
 
   str = guestfs_inspect_get_format (g, root);
-  if (!str) exit (EXIT_FAILURE);
+  if (!str) return -1;
   if (STRNEQ (str, "unknown"))
     XMLERROR (-1,
 	      xmlTextWriterWriteElement (xo, BAD_CAST "format",
@@ -469,11 +523,14 @@ output_root (xmlTextWriterPtr xo, char *root)
     XMLERROR (-1, xmlTextWriterEndElement (xo));
   }
 
-  output_mountpoints (xo, root);
+  if (output_mountpoints (g, xo, root) == -1)
+    return -1;
 
-  output_filesystems (xo, root);
+  if (output_filesystems (g, xo, root) == -1)
+    return -1;
 
-  output_drive_mappings (xo, root);
+  if (output_drive_mappings (g, xo, root) == -1)
+    return -1;
 
   /* We need to mount everything up in order to read out the list of
    * applications and the icon, ie. everything below this point.
@@ -481,8 +538,8 @@ output_root (xmlTextWriterPtr xo, char *root)
   if (inspect_apps || inspect_icon) {
     inspect_mount_root (g, root);
 
-    if (inspect_apps)
-      output_applications (xo, root);
+    if (inspect_apps && output_applications (g, xo, root) == -1)
+      return -1;
 
     if (inspect_icon) {
       /* Don't return favicon.  RHEL 7 and Fedora have crappy 16x16
@@ -491,7 +548,7 @@ output_root (xmlTextWriterPtr xo, char *root)
       str = guestfs_inspect_get_icon (g, root, &size,
                                       GUESTFS_INSPECT_GET_ICON_FAVICON, 0,
                                       -1);
-      if (!str) exit (EXIT_FAILURE);
+      if (!str) return -1;
       if (size > 0) {
         XMLERROR (-1, xmlTextWriterStartElement (xo, BAD_CAST "icon"));
         XMLERROR (-1, xmlTextWriterWriteBase64 (xo, str, 0, size));
@@ -505,10 +562,11 @@ output_root (xmlTextWriterPtr xo, char *root)
 
     /* Unmount (see inspect_mount_root above). */
     if (guestfs_umount_all (g) == -1)
-      exit (EXIT_FAILURE);
+      return -1;
   }
 
   XMLERROR (-1, xmlTextWriterEndElement (xo));
+  return 0;
 }
 
 static int
@@ -543,15 +601,15 @@ compare_keys_len (const void *p1, const void *p2)
   return compare_keys (p1, p2);
 }
 
-static void
-output_mountpoints (xmlTextWriterPtr xo, char *root)
+static int
+output_mountpoints (guestfs_h *g, xmlTextWriterPtr xo, char *root)
 {
   size_t i;
 
   CLEANUP_FREE_STRING_LIST char **mountpoints =
     guestfs_inspect_get_mountpoints (g, root);
   if (mountpoints == NULL)
-    exit (EXIT_FAILURE);
+    return -1;
 
   /* Sort by key length, shortest key first, and then name, so the
    * output is stable.
@@ -565,7 +623,7 @@ output_mountpoints (xmlTextWriterPtr xo, char *root)
   for (i = 0; mountpoints[i] != NULL; i += 2) {
     CLEANUP_FREE char *p = guestfs_canonical_device_name (g, mountpoints[i+1]);
     if (!p)
-      exit (EXIT_FAILURE);
+      return -1;
 
     XMLERROR (-1,
               xmlTextWriterStartElement (xo, BAD_CAST "mountpoint"));
@@ -577,10 +635,11 @@ output_mountpoints (xmlTextWriterPtr xo, char *root)
   }
 
   XMLERROR (-1, xmlTextWriterEndElement (xo));
+  return 0;
 }
 
-static void
-output_filesystems (xmlTextWriterPtr xo, char *root)
+static int
+output_filesystems (guestfs_h *g, xmlTextWriterPtr xo, char *root)
 {
   char *str;
   size_t i;
@@ -588,7 +647,7 @@ output_filesystems (xmlTextWriterPtr xo, char *root)
   CLEANUP_FREE_STRING_LIST char **filesystems =
     guestfs_inspect_get_filesystems (g, root);
   if (filesystems == NULL)
-    exit (EXIT_FAILURE);
+    return -1;
 
   /* Sort by name so the output is stable. */
   qsort (filesystems, guestfs_int_count_strings (filesystems), sizeof (char *),
@@ -599,7 +658,7 @@ output_filesystems (xmlTextWriterPtr xo, char *root)
   for (i = 0; filesystems[i] != NULL; ++i) {
     str = guestfs_canonical_device_name (g, filesystems[i]);
     if (!str)
-      exit (EXIT_FAILURE);
+      return -1;
 
     XMLERROR (-1, xmlTextWriterStartElement (xo, BAD_CAST "filesystem"));
     XMLERROR (-1,
@@ -635,10 +694,11 @@ output_filesystems (xmlTextWriterPtr xo, char *root)
   }
 
   XMLERROR (-1, xmlTextWriterEndElement (xo));
+  return 0;
 }
 
-static void
-output_drive_mappings (xmlTextWriterPtr xo, char *root)
+static int
+output_drive_mappings (guestfs_h *g, xmlTextWriterPtr xo, char *root)
 {
   CLEANUP_FREE_STRING_LIST char **drive_mappings = NULL;
   char *str;
@@ -648,10 +708,10 @@ output_drive_mappings (xmlTextWriterPtr xo, char *root)
   drive_mappings = guestfs_inspect_get_drive_mappings (g, root);
   guestfs_pop_error_handler (g);
   if (drive_mappings == NULL)
-    return;
+    return 0;
 
   if (drive_mappings[0] == NULL)
-    return;
+    return 0;
 
   /* Sort by key. */
   qsort (drive_mappings,
@@ -663,7 +723,7 @@ output_drive_mappings (xmlTextWriterPtr xo, char *root)
   for (i = 0; drive_mappings[i] != NULL; i += 2) {
     str = guestfs_canonical_device_name (g, drive_mappings[i+1]);
     if (!str)
-      exit (EXIT_FAILURE);
+      return -1;
 
     XMLERROR (-1,
               xmlTextWriterStartElement (xo, BAD_CAST "drive_mapping"));
@@ -678,10 +738,11 @@ output_drive_mappings (xmlTextWriterPtr xo, char *root)
   }
 
   XMLERROR (-1, xmlTextWriterEndElement (xo));
+  return 0;
 }
 
-static void
-output_applications (xmlTextWriterPtr xo, char *root)
+static int
+output_applications (guestfs_h *g, xmlTextWriterPtr xo, char *root)
 {
   size_t i;
 
@@ -691,7 +752,7 @@ output_applications (xmlTextWriterPtr xo, char *root)
   CLEANUP_FREE_APPLICATION2_LIST struct guestfs_application2_list *apps =
     guestfs_inspect_list_applications2 (g, root);
   if (apps == NULL)
-    exit (EXIT_FAILURE);
+    return -1;
 
   XMLERROR (-1, xmlTextWriterStartElement (xo, BAD_CAST "applications"));
 
@@ -758,8 +819,64 @@ output_applications (xmlTextWriterPtr xo, char *root)
   }
 
   XMLERROR (-1, xmlTextWriterEndElement (xo));
+  return 0;
 }
 
+#if defined(HAVE_LIBVIRT)
+
+/* The multi-threaded version, used by --all.  This callback is called
+ * from the code in "parallel.c" with a fresh handle for each guest.
+ * Failures are reported on stderr, and the <guest> element is still
+ * closed properly so the merged output is well-formed.
+ */
+static int
+inspect_work (guestfs_h *g, size_t i, FILE *fp)
+{
+  CLEANUP_FREE_STRING_LIST char **roots = NULL;
+  xmlOutputBufferPtr ob;
+  int r = 0;
+
+  ob = xmlOutputBufferCreateFile (fp, NULL);
+  if (ob == NULL)
+    error (EXIT_FAILURE, 0,
+           _("xmlOutputBufferCreateFile: failed to create output buffer"));
+
+  /* 'ob' is freed when 'xo' is freed.. */
+  CLEANUP_XMLFREETEXTWRITER xmlTextWriterPtr xo = xmlNewTextWriter (ob);
+  if (xo == NULL)
+    error (EXIT_FAILURE, 0,
+           _("xmlNewTextWriter: failed to create libxml2 writer"));
+
+  XMLERROR (-1, xmlTextWriterSetIndent (xo, 1));
+  XMLERROR (-1, xmlTextWriterSetIndentString (xo, BAD_CAST "  "));
+
+  XMLERROR (-1, xmlTextWriterStartElement (xo, BAD_CAST "guest"));
+  XMLERROR (-1,
+            xmlTextWriterWriteAttribute (xo, BAD_CAST "name",
+                                         BAD_CAST domains[i].name));
+  if (domains[i].uuid)
+    XMLERROR (-1,
+              xmlTextWriterWriteAttribute (xo, BAD_CAST "uuid",
+                                           BAD_CAST domains[i].uuid));
+
+  if (add_domain_disks (g, i) == -1 || launch_domain_handle (g) == -1)
+    r = -1;
+  else {
+    roots = guestfs_inspect_os (g);
+    if (roots == NULL)
+      r = -1;
+    else if (roots[0] != NULL)
+      r = output_roots (g, xo, roots);
+  }
+
+  /* This closes all open elements, even after an error. */
+  XMLERROR (-1, xmlTextWriterEndDocument (xo));
+
+  return r;
+}
+
+#endif /* HAVE_LIBVIRT */
+
 /* Run an XPath query on XML on stdin, print results to stdout. */
 static void
 do_xpath (const char *query)
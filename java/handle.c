@@ -257,6 +257,104 @@ Java_com_redhat_et_libguestfs_GuestFS__1event_1to_1string
   return jr;
 }
 
+/* Return the address of pos..pos+len in the direct buffer jbuf, or
+ * throw an exception and return NULL.
+ */
+static char *
+get_direct_buffer (JNIEnv *env, jobject jbuf, jint pos, jint len)
+{
+  char *buf;
+  jlong capacity;
+
+  buf = (*env)->GetDirectBufferAddress (env, jbuf);
+  capacity = (*env)->GetDirectBufferCapacity (env, jbuf);
+  if (buf == NULL || capacity == -1) {
+    throw_exception (env, "buffer is not a direct buffer");
+    return NULL;
+  }
+  if (pos < 0 || len < 0 || (jlong) pos + len > capacity) {
+    throw_exception (env, "buffer position or length out of range");
+    return NULL;
+  }
+
+  return buf + pos;
+}
+
+JNIEXPORT jint JNICALL
+Java_com_redhat_et_libguestfs_GuestFS__1pread_1into
+  (JNIEnv *env, jobject obj, jlong jg, jstring jpath,
+   jobject jbuf, jint pos, jint len, jlong joffset)
+{
+  guestfs_h *g = (guestfs_h *) (long) jg;
+  const char *path;
+  char *buf;
+  int64_t r;
+
+  buf = get_direct_buffer (env, jbuf, pos, len);
+  if (buf == NULL)
+    return -1;
+
+  path = (*env)->GetStringUTFChars (env, jpath, NULL);
+  r = guestfs_pread_into (g, path, buf, len, joffset);
+  (*env)->ReleaseStringUTFChars (env, jpath, path);
+
+  if (r == -1) {
+    throw_exception (env, guestfs_last_error (g));
+    return -1;
+  }
+  return (jint) r;
+}
+
+JNIEXPORT jint JNICALL
+Java_com_redhat_et_libguestfs_GuestFS__1pread_1device_1into
+  (JNIEnv *env, jobject obj, jlong jg, jstring jdevice,
+   jobject jbuf, jint pos, jint len, jlong joffset)
+{
+  guestfs_h *g = (guestfs_h *) (long) jg;
+  const char *device;
+  char *buf;
+  int64_t r;
+
+  buf = get_direct_buffer (env, jbuf, pos, len);
+  if (buf == NULL)
+    return -1;
+
+  device = (*env)->GetStringUTFChars (env, jdevice, NULL);
+  r = guestfs_pread_device_into (g, device, buf, len, joffset);
+  (*env)->ReleaseStringUTFChars (env, jdevice, device);
+
+  if (r == -1) {
+    throw_exception (env, guestfs_last_error (g));
+    return -1;
+  }
+  return (jint) r;
+}
+
+JNIEXPORT jint JNICALL
+Java_com_redhat_et_libguestfs_GuestFS__1read_1file_1into
+  (JNIEnv *env, jobject obj, jlong jg, jstring jpath,
+   jobject jbuf, jint pos, jint len)
+{
+  guestfs_h *g = (guestfs_h *) (long) jg;
+  const char *path;
+  char *buf;
+  int64_t r;
+
+  buf = get_direct_buffer (env, jbuf, pos, len);
+  if (buf == NULL)
+    return -1;
+
+  path = (*env)->GetStringUTFChars (env, jpath, NULL);
+  r = guestfs_read_file_into (g, path, buf, len);
+  (*env)->ReleaseStringUTFChars (env, jpath, path);
+
+  if (r == -1) {
+    throw_exception (env, guestfs_last_error (g));
+    return -1;
+  }
+  return (jint) r;
+}
+
 static struct callback_data **
 get_all_event_callbacks (JNIEnv *env, guestfs_h *g, size_t *len_rtn)
 {
@@ -119,6 +119,40 @@ PKG_CHECK_MODULES([SD_JOURNAL], [libsystemd],[
     ])
 ])
 
+dnl libblkid, used by the daemon to probe devices (optional,
+dnl otherwise blkid is run).
+PKG_CHECK_MODULES([BLKID], [blkid],[
+    AC_SUBST([BLKID_CFLAGS])
+    AC_SUBST([BLKID_LIBS])
+    AC_DEFINE([HAVE_BLKID],[1],[libblkid found at compile time.])
+],[AC_MSG_WARN([libblkid not found, the daemon will run blkid instead])])
+
+dnl zlib and libzstd, used by the daemon to compress data on all
+dnl vCPUs (optional, otherwise external programs are used).
+PKG_CHECK_MODULES([ZLIB], [zlib],[
+    AC_SUBST([ZLIB_CFLAGS])
+    AC_SUBST([ZLIB_LIBS])
+    AC_DEFINE([HAVE_ZLIB],[1],[zlib found at compile time.])
+],[AC_MSG_WARN([zlib not found, gzip compression in the daemon will be slower])])
+
+PKG_CHECK_MODULES([LIBZSTD], [libzstd >= 1.4.0],[
+    AC_SUBST([LIBZSTD_CFLAGS])
+    AC_SUBST([LIBZSTD_LIBS])
+    AC_DEFINE([HAVE_LIBZSTD],[1],[libzstd found at compile time.])
+],[AC_MSG_WARN([libzstd not found, zstd compression in the daemon will be slower])])
+
+dnl libext2fs, used to scan ext2/3/4 filesystems without mounting them
+dnl (optional)
+PKG_CHECK_MODULES([EXT2FS], [ext2fs com_err],[
+    AC_SUBST([EXT2FS_CFLAGS])
+    AC_SUBST([EXT2FS_LIBS])
+    AC_DEFINE([HAVE_LIBEXT2FS],[1],[libext2fs found at compile time.])
+    old_LIBS="$LIBS"
+    LIBS="$EXT2FS_LIBS $LIBS"
+    AC_CHECK_FUNCS([ext2fs_readahead])
+    LIBS="$old_LIBS"
+],[AC_MSG_WARN([libext2fs not found, ext_inventory will not be available])])
+
 dnl libtsk sleuthkit library (optional)
 AC_CHECK_LIB([tsk],[tsk_version_print],[
     AC_CHECK_HEADER([tsk/libtsk.h],[
@@ -21,7 +21,7 @@ AC_ARG_ENABLE([gobject],
     [],
     [enable_gobject=yes])
 AS_IF([test "x$enable_gobject" != "xno"],[
-    PKG_CHECK_MODULES([GOBJECT], [gobject-2.0 >= 2.26.0],[
+    PKG_CHECK_MODULES([GOBJECT], [gobject-2.0 >= 2.36.0],[
         AC_SUBST([GOBJECT_CFLAGS])
         AC_SUBST([GOBJECT_LIBS])
         AC_DEFINE([HAVE_GOBJECT],[1],
@@ -29,7 +29,7 @@ AS_IF([test "x$enable_gobject" != "xno"],[
     ],
     [AC_MSG_WARN([gobject library not found, gobject binding will be disabled])])
 
-    PKG_CHECK_MODULES([GIO], [gio-2.0 >= 2.26.0],[
+    PKG_CHECK_MODULES([GIO], [gio-2.0 >= 2.36.0],[
         AC_SUBST([GIO_CFLAGS])
         AC_SUBST([GIO_LIBS])
         AC_DEFINE([HAVE_GIO],[1],
@@ -41,7 +41,11 @@ AC_CHECK_HEADERS([\
     endian.h \
     sys/endian.h \
     errno.h \
+    linux/btrfs.h \
+    linux/btrfs_tree.h \
+    linux/fiemap.h \
     linux/fs.h \
+    linux/mempolicy.h \
     linux/raid/md_u.h \
     printf.h \
     sys/inotify.h \
@@ -58,6 +62,7 @@ AC_CHECK_HEADERS([\
 dnl Functions.
 AC_CHECK_FUNCS([\
     be32toh \
+    copy_file_range \
     fsync \
     futimens \
     getxattr \
@@ -75,10 +80,12 @@ AC_CHECK_FUNCS([\
     posix_fallocate \
     posix_fadvise \
     removexattr \
+    sched_setaffinity \
     setitimer \
     setrlimit \
     setxattr \
     sigaction \
+    splice \
     statvfs \
     sync])
 
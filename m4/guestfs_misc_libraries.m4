@@ -36,10 +36,22 @@ PKG_CHECK_MODULES([LIBLZMA], [liblzma], [
     old_LIBS="$LIBS"
     LIBS="$LIBS $LIBLZMA_LIBS"
     AC_CHECK_FUNCS([lzma_index_stream_flags lzma_index_stream_padding])
+
+    dnl The daemon uses the multi-threaded encoder if available.
+    AC_CHECK_FUNCS([lzma_stream_encoder_mt])
     LIBS="$old_LIBS"
 ],
 [AC_MSG_WARN([liblzma not found, virt-builder will be slower])])
 
+dnl libzstd can be used by virt-builder, and by the library to compress
+dnl file transfers to remote appliances (optional).
+PKG_CHECK_MODULES([LIBZSTD], [libzstd], [
+    AC_SUBST([LIBZSTD_CFLAGS])
+    AC_SUBST([LIBZSTD_LIBS])
+    AC_DEFINE([HAVE_LIBZSTD],[1],[libzstd found at compile time.])
+],
+[AC_MSG_WARN([libzstd not found, virt-builder will use zstdcat for zstd templates])])
+
 dnl Readline (used by guestfish).
 AC_ARG_WITH([readline],[
     AS_HELP_STRING([--with-readline],
@@ -32,6 +32,7 @@
 #include <libintl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <sys/wait.h>
 
 #include "guestfs.h"
@@ -51,6 +52,10 @@ int verbose;
 
 static const char *format = "raw", *label = NULL,
   *partition = NULL, *size_str = NULL, *type = "ext2";
+static int shrink = 0;
+
+/* With --shrink, the output is created this big at most, then shrunk. */
+#define SHRINK_MAX_SIZE (UINT64_C(1024) * 1024 * 1024 * 1024)
 
 enum { HELP_OPTION = CHAR_MAX + 1 };
 static const char options[] = "F:s:t:Vvx";
@@ -63,6 +68,7 @@ static const struct option long_options[] = {
   { "long-options", 0, 0, 0 },
   { "partition", 2, 0, 0 },
   { "short-options", 0, 0, 0 },
+  { "shrink", 0, 0, 0 },
   { "size", 1, 0, 's' },
   { "type", 1, 0, 't' },
   { "verbose", 0, 0, 'v' },
@@ -89,6 +95,7 @@ usage (int status)
               "  --help                   Display brief help\n"
               "  --label=label            Filesystem label\n"
               "  --partition=mbr|gpt|..   Set partition type\n"
+              "  --shrink                 Shrink to fit instead of estimating\n"
               "  -s|--size=size|+size     Set size of output disk\n"
               "  -t|--type=ext4|..        Set filesystem type\n"
               "  -v|--verbose             Verbose messages\n"
@@ -143,6 +150,9 @@ main (int argc, char *argv[])
           partition = "mbr";
         else
           partition = optarg;
+      }
+      else if (STREQ (long_options[option_index].name, "shrink")) {
+        shrink = 1;
       } else
         error (EXIT_FAILURE, 0,
                _("unknown long option: %s (%d)"),
@@ -376,6 +386,9 @@ bg_command (char **argv, int *fd_rtn, pid_t *pid_rtn)
  * input, either the string "directory" if the input is a directory,
  * or the output of the "file" command on the input.
  *
+ * If estimate_rtn is NULL, only the format is found, which does not
+ * need to read the whole input.
+ *
  * Estimation is a Hard Problem.  Some factors which make it hard:
  *
  *   - Superblocks, block free bitmaps, FAT and other fixed overhead
@@ -383,8 +396,8 @@ bg_command (char **argv, int *fd_rtn, pid_t *pid_rtn)
  *   - Journal size
  *   - Internal fragmentation of files
  *
- * What we could also do is try shrinking the filesystem after
- * creating and populating it, but that is complex given partitions.
+ * The alternative is to shrink the filesystem after creating and
+ * populating it, which is what --shrink does (see shrink_output).
  */
 static int
 estimate_input (const char *input, uint64_t *estimate_rtn, char **ifmt_rtn)
@@ -420,6 +433,9 @@ estimate_input (const char *input, uint64_t *estimate_rtn, char **ifmt_rtn)
       return -1;
     }
 
+    if (estimate_rtn == NULL)
+      return 0;
+
     argv[0] = "du";
     argv[1] = "--apparent-size";
     argv[2] = "-b";
@@ -512,11 +528,14 @@ estimate_input (const char *input, uint64_t *estimate_rtn, char **ifmt_rtn)
         return -1;
       }
 
+      if (estimate_rtn == NULL)
+        return 0;
+
       *estimate_rtn = 0;
       if (exec_command_count_output ((char **) argv, estimate_rtn) == -1)
         return -1;
     }
-    else {
+    else if (estimate_rtn != NULL) {
       /* Plain tar file, just get the size directly.  Tar files have
        * a 512 byte block size (compared with typically 1K or 4K for
        * filesystems) so this isn't very accurate.
@@ -643,12 +662,159 @@ parse_size (const char *str, uint64_t estimate, uint64_t *size_rtn)
   return 0;
 }
 
+/* --shrink only works where the filesystem and the disk image can be
+ * shrunk afterwards.  The filesystem types are the ones which can be
+ * created quickly on a very large device.
+ */
+static int
+check_shrink_options (void)
+{
+  if (STRNEQ (format, "raw")) {
+    fprintf (stderr, _("%s: --shrink can only be used with raw output\n"),
+             getprogname ());
+    return -1;
+  }
+  if (STRNEQ (type, "ext4") && STRNEQ (type, "btrfs") &&
+      STRNEQ (type, "ntfs")) {
+    fprintf (stderr, _("%s: --shrink can only be used with ext4, btrfs or ntfs filesystems\n"),
+             getprogname ());
+    return -1;
+  }
+  /* Shrinking the disk would lose the backup GPT at the end. */
+  if (partition && STRNEQ (partition, "") &&
+      STRNEQ (partition, "mbr") && STRNEQ (partition, "msdos")) {
+    fprintf (stderr, _("%s: --shrink can only be used with MBR partitions\n"),
+             getprogname ());
+    return -1;
+  }
+  if (size_str && size_str[0] != '+') {
+    fprintf (stderr, _("%s: --shrink cannot be used with a fixed --size\n"),
+             getprogname ());
+    return -1;
+  }
+
+  return 0;
+}
+
+/* With --shrink, the output is first made as big as it could possibly
+ * need to be, which is the free space on the host filesystem where it
+ * is written, up to SHRINK_MAX_SIZE.  The output is sparse, so only
+ * the space which is used is allocated.
+ */
+static int
+get_shrink_initial_size (const char *output, uint64_t *size_rtn)
+{
+  CLEANUP_FREE char *dir = NULL;
+  struct statvfs buf;
+  char *p;
+
+  dir = strdup (output);
+  if (dir == NULL) {
+    perror ("strdup");
+    return -1;
+  }
+  p = strrchr (dir, '/');
+  if (p == NULL)
+    strcpy (dir, ".");
+  else if (p == dir)
+    p[1] = '\0';
+  else
+    *p = '\0';
+
+  if (statvfs (dir, &buf) == -1) {
+    perror (dir);
+    return -1;
+  }
+
+  *size_rtn = (uint64_t) buf.f_bavail * buf.f_frsize;
+  *size_rtn = MIN (*size_rtn, SHRINK_MAX_SIZE);
+  *size_rtn = MAX (*size_rtn, 1024 * 1024 * 1024);
+  *size_rtn &= ~UINT64_C(1024 * 1024 - 1);
+
+  return 0;
+}
+
+/* Shrink the filesystem on dev, which is mounted on /, to its minimum
+ * size plus extra bytes, and the partition (if any) to fit.  Returns
+ * the size that the output disk should be truncated to.  The
+ * filesystem is unmounted afterwards.
+ */
+static int
+shrink_output (const char *dev, uint64_t extra, uint64_t *size_rtn)
+{
+  int64_t min_size;
+  uint64_t fs_size;
+
+  /* btrfs must be mounted to find its minimum size and to resize it,
+   * the others must not be.
+   */
+  if (STRNEQ (type, "btrfs")) {
+    if (guestfs_umount_all (g) == -1)
+      return -1;
+    if (STRPREFIX (type, "ext") &&
+        guestfs_e2fsck (g, dev, GUESTFS_E2FSCK_CORRECT, 1, -1) == -1)
+      return -1;
+  }
+
+  min_size = guestfs_vfs_minimum_size (g, dev);
+  if (min_size == -1)
+    return -1;
+  fs_size = min_size + extra;
+  fs_size = (fs_size + 1024 * 1024 - 1) & ~UINT64_C(1024 * 1024 - 1);
+
+  if (verbose)
+    fprintf (stderr, "shrinking %s filesystem to %" PRIu64 " bytes "
+             "(minimum %" PRIi64 ")\n", type, fs_size, min_size);
+
+  if (STREQ (type, "btrfs")) {
+    struct guestfs_btrfs_filesystem_resize_argv optargs = {
+      .bitmask = GUESTFS_BTRFS_FILESYSTEM_RESIZE_SIZE_BITMASK,
+      .size = fs_size,
+    };
+
+    if (guestfs_btrfs_filesystem_resize_argv (g, "/", &optargs) == -1)
+      return -1;
+    if (guestfs_umount_all (g) == -1)
+      return -1;
+  }
+  else if (STREQ (type, "ntfs")) {
+    if (guestfs_ntfsresize_opts (g, dev,
+                                 GUESTFS_NTFSRESIZE_OPTS_SIZE, fs_size,
+                                 -1) == -1)
+      return -1;
+  }
+  else {
+    if (guestfs_resize2fs_size (g, dev, fs_size) == -1)
+      return -1;
+  }
+
+  if (!partition) {
+    *size_rtn = fs_size;
+    return 0;
+  }
+
+  /* Move the end of the partition.  With MBR there is nothing after
+   * it on the disk.
+   */
+  CLEANUP_FREE_PARTITION_LIST struct guestfs_partition_list *parts =
+    guestfs_part_list (g, "/dev/sda");
+  if (parts == NULL)
+    return -1;
+  assert (parts->len == 1);
+
+  *size_rtn = parts->val[0].part_start + fs_size;
+  if (guestfs_part_resize (g, "/dev/sda", 1, *size_rtn / 512 - 1) == -1)
+    return -1;
+
+  return 0;
+}
+
 static int
 do_make_fs (const char *input, const char *output_str)
 {
   const char *dev, *options;
   CLEANUP_UNLINK_FREE char *output = NULL;
-  uint64_t estimate, size;
+  uint64_t estimate = 0, size, extra = 0;
   struct guestfs_disk_create_argv optargs;
   CLEANUP_FREE char *ifmt = NULL;
   CLEANUP_FREE char *ifile = NULL;
@@ -664,15 +830,28 @@ do_make_fs (const char *input, const char *output_str)
     return -1;
   }
 
-  /* Input.  What is it?  Estimate how much space it will need. */
-  if (estimate_input (input, &estimate, &ifmt) == -1)
+  if (shrink && check_shrink_options () == -1)
     return -1;
 
-  if (verbose) {
-    fprintf (stderr, "input format = %s\n", ifmt);
-    fprintf (stderr, "estimate = %" PRIu64 " bytes "
-             "(%" PRIu64 " 1K blocks, %" PRIu64 " 4K blocks)\n",
-             estimate, estimate / 1024, estimate / 4096);
+  /* Input.  What is it?  Estimate how much space it will need,
+   * unless the size is fixed or we will shrink to fit afterwards.
+   */
+  if (shrink || (size_str && size_str[0] != '+')) {
+    if (estimate_input (input, NULL, &ifmt) == -1)
+      return -1;
+    if (verbose)
+      fprintf (stderr, "input format = %s\n", ifmt);
+  }
+  else {
+    if (estimate_input (input, &estimate, &ifmt) == -1)
+      return -1;
+
+    if (verbose) {
+      fprintf (stderr, "input format = %s\n", ifmt);
+      fprintf (stderr, "estimate = %" PRIu64 " bytes "
+               "(%" PRIu64 " 1K blocks, %" PRIu64 " 4K blocks)\n",
+               estimate, estimate / 1024, estimate / 4096);
+    }
   }
 
   estimate += 256 * 1024;       /* For superblocks &c. */
@@ -697,8 +876,16 @@ do_make_fs (const char *input, const char *output_str)
   /* Add 10%, see above. */
   estimate *= 1.10;
 
-  /* Calculate the output size. */
-  if (size_str == NULL)
+  /* Calculate the output size.  With --shrink, any extra space
+   * requested is added when shrinking.
+   */
+  if (shrink) {
+    if (size_str && parse_size (size_str, 0, &extra) == -1)
+      return -1;
+    if (get_shrink_initial_size (output, &size) == -1)
+      return -1;
+  }
+  else if (size_str == NULL)
     size = estimate;
   else
     if (parse_size (size_str, estimate, &size) == -1)
@@ -762,8 +949,32 @@ do_make_fs (const char *input, const char *output_str)
   if (verbose)
     fprintf (stderr, "creating %s filesystem on %s ...\n", type, dev);
 
-  /* Create the filesystem. */
-  if (STRNEQ (type, "btrfs")) {
+  /* Create the filesystem.  With --shrink, the inode tables and the
+   * journal of ext4 are initialized lazily, since most of them will
+   * be discarded, and the journal is given the size mkfs would choose
+   * for a small filesystem.
+   */
+  if (shrink && STREQ (type, "ext4")) {
+    struct guestfs_mke2fs_argv optargs = {
+      .bitmask = GUESTFS_MKE2FS_FSTYPE_BITMASK |
+                 GUESTFS_MKE2FS_JOURNALSIZE_BITMASK |
+                 GUESTFS_MKE2FS_LAZYITABLEINIT_BITMASK |
+                 GUESTFS_MKE2FS_LAZYJOURNALINIT_BITMASK,
+      .fstype = type,
+      .journalsize = 64,
+      .lazyitableinit = 1,
+      .lazyjournalinit = 1,
+    };
+
+    if (label) {
+      optargs.label = label;
+      optargs.bitmask |= GUESTFS_MKE2FS_LABEL_BITMASK;
+    }
+
+    if (guestfs_mke2fs_argv (g, dev, &optargs) == -1)
+      return -1;
+  }
+  else if (STRNEQ (type, "btrfs")) {
     int r;
     struct guestfs_mkfs_opts_argv optargs = { .bitmask = 0 };
 
@@ -812,6 +1023,9 @@ do_make_fs (const char *input, const char *output_str)
    */
   if (STREQ (type, "vfat"))
     options = "utf8";
+  /* Don't let the kernel zero the lazily initialized inode tables. */
+  else if (shrink && STREQ (type, "ext4"))
+    options = "noinit_itable";
   else
     options = "";
 
@@ -845,12 +1059,24 @@ do_make_fs (const char *input, const char *output_str)
 
   print_stats (g, "after");
 
+  if (shrink && shrink_output (dev, extra, &size) == -1)
+    return -1;
+
   if (verbose)
     fprintf (stderr, "finishing off\n");
   if (guestfs_shutdown (g) == -1)
     return -1;
   guestfs_close (g);
 
+  if (shrink) {
+    if (verbose)
+      fprintf (stderr, "truncating %s to %" PRIu64 " bytes\n", output, size);
+    if (truncate (output, size) == -1) {
+      perror (output);
+      return -1;
+    }
+  }
+
   /* Output was created OK, so save it from being deleted by
    * CLEANUP_UNLINK_FREE.
    */
@@ -0,0 +1,136 @@
+/* libguestfs OCaml tools common code
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Compute checksums in-process, see checksums.ml. */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <caml/alloc.h>
+#include <caml/custom.h>
+#include <caml/fail.h>
+#include <caml/memory.h>
+#include <caml/mlvalues.h>
+
+#include "sha1.h"
+#include "sha256.h"
+#include "sha512.h"
+
+#pragma GCC diagnostic ignored "-Wmissing-prototypes"
+
+/* The order must match the hash_kind type in checksums.ml. */
+enum hash_kind { HASH_SHA1, HASH_SHA256, HASH_SHA512 };
+
+struct hash {
+  enum hash_kind kind;
+  union {
+    struct sha1_ctx sha1;
+    struct sha256_ctx sha256;
+    struct sha512_ctx sha512;
+  } ctx;
+};
+
+#define Hash_val(v) ((struct hash *) Data_custom_val (v))
+
+/* The context is stored in the custom block, so there is nothing to
+ * free.
+ */
+static struct custom_operations hash_custom_operations = {
+  (char *) "hash_custom_operations",
+  custom_finalize_default,
+  custom_compare_default,
+  custom_hash_default,
+  custom_serialize_default,
+  custom_deserialize_default
+};
+
+value
+guestfs_int_mllib_hash_create (value kindv)
+{
+  CAMLparam1 (kindv);
+  CAMLlocal1 (hv);
+  struct hash *h;
+
+  hv = caml_alloc_custom (&hash_custom_operations, sizeof (struct hash), 0, 1);
+  h = Hash_val (hv);
+  h->kind = Int_val (kindv);
+  switch (h->kind) {
+  case HASH_SHA1: sha1_init_ctx (&h->ctx.sha1); break;
+  case HASH_SHA256: sha256_init_ctx (&h->ctx.sha256); break;
+  case HASH_SHA512: sha512_init_ctx (&h->ctx.sha512); break;
+  default: abort ();
+  }
+
+  CAMLreturn (hv);
+}
+
+/* NB: "noalloc" function. */
+value
+guestfs_int_mllib_hash_update (value hv, value bufv, value offsetv,
+                               value lenv)
+{
+  struct hash *h = Hash_val (hv);
+  const char *buf = String_val (bufv) + Int_val (offsetv);
+  const size_t len = Int_val (lenv);
+
+  switch (h->kind) {
+  case HASH_SHA1: sha1_process_bytes (buf, len, &h->ctx.sha1); break;
+  case HASH_SHA256: sha256_process_bytes (buf, len, &h->ctx.sha256); break;
+  case HASH_SHA512: sha512_process_bytes (buf, len, &h->ctx.sha512); break;
+  default: abort ();
+  }
+
+  return Val_unit;
+}
+
+/* Return the checksum as a hex string, as sha256sum etc print it.
+ * The context must not be updated after this.
+ */
+value
+guestfs_int_mllib_hash_final (value hv)
+{
+  CAMLparam1 (hv);
+  struct hash *h = Hash_val (hv);
+  unsigned char digest[SHA512_DIGEST_SIZE];
+  char hex[SHA512_DIGEST_SIZE * 2 + 1];
+  size_t i, size;
+
+  switch (h->kind) {
+  case HASH_SHA1:
+    sha1_finish_ctx (&h->ctx.sha1, digest);
+    size = SHA1_DIGEST_SIZE;
+    break;
+  case HASH_SHA256:
+    sha256_finish_ctx (&h->ctx.sha256, digest);
+    size = SHA256_DIGEST_SIZE;
+    break;
+  case HASH_SHA512:
+    sha512_finish_ctx (&h->ctx.sha512, digest);
+    size = SHA512_DIGEST_SIZE;
+    break;
+  default: abort ();
+  }
+
+  for (i = 0; i < size; ++i)
+    sprintf (&hex[i*2], "%02x", digest[i]);
+
+  CAMLreturn (caml_copy_string (hex));
+}
@@ -45,30 +45,80 @@ let of_string csum_type csum_value =
   | "sha512" -> SHA512 csum_value
   | _ -> invalid_arg csum_type
 
-let verify_checksum csum ?tar filename =
-  let prog, csum_ref =
-    match csum with
-    | SHA1 c -> "sha1sum", c
-    | SHA256 c -> "sha256sum", c
-    | SHA512 c -> "sha512sum", c
-  in
+(* The order must match enum hash_kind in checksums-c.c. *)
+type hash_kind = HashSHA1 | HashSHA256 | HashSHA512
+
+type hash
+external hash_create : hash_kind -> hash = "guestfs_int_mllib_hash_create"
+external hash_update : hash -> Bytes.t -> int -> int -> unit
+  = "guestfs_int_mllib_hash_update" "noalloc"
+external hash_final : hash -> string = "guestfs_int_mllib_hash_final"
+
+type t = (csum_t * hash) list
+
+let create checksums =
+  List.map (
+    fun csum ->
+      let kind =
+        match csum with
+        | SHA1 _ -> HashSHA1
+        | SHA256 _ -> HashSHA256
+        | SHA512 _ -> HashSHA512 in
+      csum, hash_create kind
+  ) checksums
 
-  let cmd =
-    match tar with
-    | None ->
-      sprintf "%s %s" prog (quote filename)
-    | Some tar ->
-      sprintf "tar xOf %s %s | %s"
-        (quote tar) (quote filename) prog
+let update t buf offset len =
+  if offset < 0 || len < 0 || offset + len > Bytes.length buf then
+    invalid_arg "Checksums.update";
+  List.iter (fun (_, hash) -> hash_update hash buf offset len) t
+
+let update_from_channel t chan =
+  let buf = Bytes.create 65536 in
+  let rec loop () =
+    let n = input chan buf 0 (Bytes.length buf) in
+    if n > 0 then (
+      update t buf 0 n;
+      loop ()
+    )
   in
-  let lines = external_command cmd in
-  match lines with
-  | [] ->
-    error (f_"%s did not return any output") prog
-  | line :: _ ->
-    let csum_actual = fst (String.split " " line) in
-    if csum_ref <> csum_actual then
-      raise (Mismatched_checksum (csum, csum_actual))
+  loop ()
+
+let update_from_file t filename =
+  let chan = open_in_bin filename in
+  update_from_channel t chan;
+  close_in chan
+
+let verify t =
+  List.iter (
+    fun (csum, hash) ->
+      let csum_actual = hash_final hash in
+      if string_of_csum csum <> csum_actual then
+        raise (Mismatched_checksum (csum, csum_actual))
+  ) t
+
+let verify_checksum csum ?tar filename =
+  let t = create [csum] in
+  (match tar with
+  | None ->
+    update_from_file t filename
+  | Some tar ->
+    let cmd = sprintf "tar xOf %s %s" (quote tar) (quote filename) in
+    debug "%s" cmd;
+    let chan = Unix.open_process_in cmd in
+    update_from_channel t chan;
+    (match Unix.close_process_in chan with
+    | Unix.WEXITED 0 -> ()
+    | Unix.WEXITED i ->
+      error (f_"external command '%s' exited with error %d") cmd i
+    | Unix.WSIGNALED i ->
+      error (f_"external command '%s' killed by signal %d") cmd i
+    | Unix.WSTOPPED i ->
+      error (f_"external command '%s' stopped by signal %d") cmd i
+    )
+  );
+  verify t
 
 let verify_checksums checksums filename =
-  List.iter (fun c -> verify_checksum c filename) checksums
+  let t = create checksums in
+  update_from_file t filename;
+  verify t
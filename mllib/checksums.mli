@@ -38,6 +38,27 @@ val verify_checksum : csum_t -> ?tar:string -> string -> unit
 val verify_checksums : csum_t list -> string -> unit
 (** Verify all the checksums of the file. *)
 
+type t
+(** A computation of one or more checksums of the same data.  The
+    checksums are computed in-process, as the data is passed to
+    {!update}, so that data which is being downloaded or copied
+    anyway doesn't have to be read again to verify it. *)
+
+val create : csum_t list -> t
+(** [create checksums] starts computing the checksums. *)
+
+val update : t -> Bytes.t -> int -> int -> unit
+(** [update t buf offset len] adds the [len] bytes of [buf]
+    starting at [offset] to the data. *)
+
+val update_from_file : t -> string -> unit
+(** Add the contents of the file to the data. *)
+
+val verify : t -> unit
+(** Verify the checksums of the data, raising [Mismatched_checksum]
+    for the first one which does not match.  [t] must not be used
+    after this. *)
+
 val string_of_csum_t : csum_t -> string
 (** Return a string representation of the checksum type. *)
 
@@ -990,6 +990,7 @@ let detect_file_type filename =
   in
   let ret =
     if get 0 6 = Some "\2537zXZ\000" then `XZ
+    else if get 0 4 = Some "\x28\xb5\x2f\xfd" then `Zstd
     else if get 0 4 = Some "PK\003\004" then `Zip
     else if get 0 4 = Some "PK\005\006" then `Zip
     else if get 0 4 = Some "PK\007\008" then `Zip
@@ -390,7 +390,7 @@ val debug_augeas_errors : Guestfs.guestfs -> unit
 
     If not in verbose mode, this does nothing. *)
 
-val detect_file_type : string -> [`GZip | `Tar | `XZ | `Zip | `Unknown]
+val detect_file_type : string -> [`GZip | `Tar | `XZ | `Zip | `Zstd | `Unknown]
 (** Detect type of a file (for a very limited range of file types). *)
 
 (*<stdlib>*)
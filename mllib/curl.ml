@@ -16,10 +16,11 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  *)
 
-open Printf
-
+open Common_gettext.Gettext
 open Common_utils
 
+open Printf
+
 type t = {
   curl : string;
   args : args;
@@ -43,7 +44,10 @@ let create ?(curl = "curl") ?(proxy = SystemProxy) ?tmpdir args =
   let args = safe_args @ args_of_proxy proxy @ args in
   { curl = curl; args = args; tmpdir = tmpdir }
 
-let run { curl = curl; args = args; tmpdir = tmpdir } =
+(* Write the arguments to a temporary config file, and return the
+ * command which runs curl with it.
+ *)
+let write_config { curl = curl; args = args; tmpdir = tmpdir } =
   let config_file, chan = Filename.open_temp_file ?temp_dir:tmpdir
     "guestfscurl" ".conf" in
   List.iter (
@@ -70,10 +74,37 @@ let run { curl = curl; args = args; tmpdir = tmpdir } =
   close_out chan;
 
   let cmd = sprintf "%s -q --config %s" (quote curl) (quote config_file) in
+  config_file, cmd
+
+let run t =
+  let config_file, cmd = write_config t in
   let lines = external_command ~echo_cmd:false cmd in
   Unix.unlink config_file;
   lines
 
+let stream t f =
+  let config_file, cmd = write_config t in
+  let chan = Unix.open_process_in cmd in
+  let buf = Bytes.create 65536 in
+  let rec loop () =
+    let n = input chan buf 0 (Bytes.length buf) in
+    if n > 0 then (
+      f buf 0 n;
+      loop ()
+    )
+  in
+  loop ();
+  let stat = Unix.close_process_in chan in
+  Unix.unlink config_file;
+  match stat with
+  | Unix.WEXITED 0 -> ()
+  | Unix.WEXITED i ->
+    error (f_"external command '%s' exited with error %d") cmd i
+  | Unix.WSIGNALED i ->
+    error (f_"external command '%s' killed by signal %d") cmd i
+  | Unix.WSTOPPED i ->
+    error (f_"external command '%s' stopped by signal %d") cmd i
+
 let to_string { curl = curl; args = args } =
   let b = Buffer.create 128 in
   bprintf b "%s -q" (quote curl);
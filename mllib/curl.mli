@@ -57,6 +57,12 @@ val run : t -> string list
 
     The result is the output of curl as a list of lines. *)
 
+val stream : t -> (Bytes.t -> int -> int -> unit) -> unit
+(** [stream t f] runs the curl command like {!run}, but calls
+    [f buf offset len] with each block of the output as it arrives,
+    instead of collecting it.  This is used to process a download
+    while it is in progress. *)
+
 val to_string : t -> string
 (** Convert the curl command line to a string.
 
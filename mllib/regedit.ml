@@ -58,52 +58,47 @@ let decode_utf16le str =
   done;
   Bytes.to_string copy
 
-let rec import_key (g : Guestfs.guestfs) root (path, values) =
-  (* Create the path starting at the root node. *)
-  let node =
-    let rec loop parent = function
-      | [] -> parent
-      | x :: xs ->
-        let node =
-          match g#hivex_node_get_child parent x with
-          | 0L -> g#hivex_node_add_child parent x (* not found, create *)
-          | node -> node in
-        loop node xs
-    in
-    loop root path in
-
-  (* Delete any existing values in this node. *)
-  (* g#hivex_node_set_values ...
-     XXX Or at least, it would be nice to do this, but there is no
-     binding for it in libguestfs.  I'm not sure how much this matters. *)
-
-  (* Create the values. *)
-  import_values g node values
-
-and import_values g node = List.iter (import_value g node)
-
-and import_value g node = function
-  | key, REG_NONE -> g#hivex_node_set_value node key 0L ""
+(* Encode a value as its registry type and data. *)
+let encode_value = function
+  | REG_NONE -> 0L, ""
   (* All string registry fields have a terminating NUL, which in
    * UTF-16LE means they have 3 zero bytes -- the first is the high
    * byte from the last character, and the second and third are the
    * UTF-16LE encoding of ASCII NUL.  So we have to add two zero
    * bytes at the end of string fields.
    *)
-  | key, REG_SZ s ->
-    g#hivex_node_set_value node key 1L (encode_utf16le s ^ "\000\000")
-  | key, REG_EXPAND_SZ s ->
-    g#hivex_node_set_value node key 2L (encode_utf16le s ^ "\000\000")
-  | key, REG_BINARY bin ->
-    g#hivex_node_set_value node key 3L bin
-  | key, REG_DWORD dw ->
-    g#hivex_node_set_value node key 4L (le32_of_int (Int64.of_int32 dw))
-  | key, REG_MULTI_SZ ss ->
+  | REG_SZ s -> 1L, encode_utf16le s ^ "\000\000"
+  | REG_EXPAND_SZ s -> 2L, encode_utf16le s ^ "\000\000"
+  | REG_BINARY bin -> 3L, bin
+  | REG_DWORD dw -> 4L, le32_of_int (Int64.of_int32 dw)
+  | REG_MULTI_SZ ss ->
     (* http://blogs.msdn.com/oldnewthing/archive/2009/10/08/9904646.aspx *)
     List.iter (fun s -> assert (s <> "")) ss;
     let ss = ss @ [""] in
     let ss = List.map (fun s -> encode_utf16le s ^ "\000\000") ss in
-    let ss = String.concat "" ss in
-    g#hivex_node_set_value node key 7L ss
+    7L, String.concat "" ss
+
+(* Pack the edits in the form expected by hivex_import, so they can
+ * all be made in one call.
+ *)
+let pack_regedits regedits =
+  let buf = Buffer.create 4096 in
+  let add_int i = Buffer.add_string buf (le32_of_int (Int64.of_int i)) in
+  let add_string s = add_int (String.length s); Buffer.add_string buf s in
+  List.iter (
+    fun (path, values) ->
+      add_int (List.length path);
+      List.iter add_string path;
+      add_int (List.length values);
+      List.iter (
+        fun (key, v) ->
+          let t, data = encode_value v in
+          add_string key;
+          Buffer.add_string buf (le32_of_int t);
+          add_string data
+      ) values
+  ) regedits;
+  Buffer.contents buf
 
-let reg_import g root = List.iter (import_key g root)
+let reg_import (g : Guestfs.guestfs) root regedits =
+  g#hivex_import root (pack_regedits regedits)
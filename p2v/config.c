@@ -128,6 +128,8 @@ print_config (struct config *config, FILE *fp)
            config->identity_url ? config->identity_url : "none");
   fprintf (fp, "sudo . . . . . .   %s\n",
            config->sudo ? "true" : "false");
+  fprintf (fp, "compress . . . .   %s\n",
+           config->compress ? "true" : "false");
   fprintf (fp, "guest name . . .   %s\n",
            config->guestname ? config->guestname : "none");
   fprintf (fp, "vcpus  . . . . .   %d\n", config->vcpus);
@@ -798,6 +798,17 @@ generate_libvirt_xml (struct config *config, struct data_conn *data_conns,
      "\n"
      "  TL;DR: Don't try to load this XML into libvirt. ");
 
+  if (link_throughput > 0) {
+    CLEANUP_FREE char *link = NULL;
+
+    if (asprintf (&link,
+                  " Network link to the conversion server measured by"
+                  " virt-p2v: %" PRIu64 " bytes/s, latency %" PRIu64 " us. ",
+                  link_throughput, link_latency) == -1)
+      error (EXIT_FAILURE, errno, "asprintf");
+    comment (link);
+  }
+
   start_element ("domain") {
     attribute ("type", "physical");
 
@@ -1039,6 +1050,22 @@ generate_wrapper_script (struct config *config, const char *remote_dir,
     print_quoted (fp, config->output_storage);
   }
 
+  /* Each disk has its own data connection, so copy all of the disks
+   * at the same time to use the connections in parallel.  This does
+   * not help if the link is slow, unless the latency is high too:
+   * one connection already uses all of the bandwidth, and copying
+   * one disk at a time needs less CPU for the compression.
+   */
+  if (feature_parallel_copy_option && config->disks != NULL) {
+    size_t nr_disks = guestfs_int_count_strings (config->disks);
+
+    if (link_is_slow () && link_latency < HIGH_LINK_LATENCY)
+      nr_disks = 1;
+
+    if (nr_disks > 1)
+      fprintf (fp, " --parallel %zu", nr_disks);
+  }
+
   fprintf (fp, " --root first");
   fprintf (fp, " physical.xml");
   fprintf (fp, " </dev/null");  /* no stdin */
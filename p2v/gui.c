@@ -111,6 +111,7 @@ static void set_info_label (void);
 static GtkWidget *conn_dlg,
   *server_entry, *port_entry,
   *username_entry, *password_entry, *identity_entry, *sudo_button,
+  *compress_button,
   *spinner_hbox,
 #ifdef GTK_SPINNER
   *spinner,
@@ -201,7 +202,7 @@ create_connection_dialog (struct config *config)
   gtk_label_set_line_wrap (GTK_LABEL (intro), TRUE);
   set_padding (intro, 10, 10);
 
-  table_new (table, 5, 2);
+  table_new (table, 6, 2);
   server_label = gtk_label_new_with_mnemonic (_("Conversion _server:"));
   table_attach (table, server_label,
                 0, 1, 0, 1, GTK_FILL, GTK_FILL, 4, 4);
@@ -270,6 +271,13 @@ create_connection_dialog (struct config *config)
   table_attach (table, sudo_button,
                 1, 2, 4, 5, GTK_FILL, GTK_FILL, 4, 4);
 
+  compress_button =
+    gtk_check_button_new_with_mnemonic (_("_Compress the disk data sent over the network"));
+  gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (compress_button),
+                                config->compress);
+  table_attach (table, compress_button,
+                1, 2, 5, 6, GTK_FILL, GTK_FILL, 4, 4);
+
   hbox_new (test_hbox, FALSE, 0);
   test = gtk_button_new_with_mnemonic (_("_Test connection"));
   gtk_box_pack_start (GTK_BOX (test_hbox), test, TRUE, FALSE, 0);
@@ -464,6 +472,8 @@ test_connection_clicked (GtkWidget *w, gpointer data)
   config->identity_file_needs_update = 1;
 
   config->sudo = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (sudo_button));
+  config->compress =
+    gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (compress_button));
 
   if (errors)
     return;
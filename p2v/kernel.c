@@ -83,6 +83,10 @@ update_config_from_kernel_cmdline (struct config *config, char **cmdline)
   if (p)
     config->sudo = 1;
 
+  p = get_cmdline_key (cmdline, "p2v.compress");
+  if (p)
+    config->compress = 1;
+
   p = get_cmdline_key (cmdline, "p2v.name");
   if (p) {
     free (config->guestname);
@@ -52,6 +52,7 @@ char **all_removable;
 char **all_interfaces;
 int is_iso_environment = 0;
 int feature_colours_option = 0;
+int feature_parallel_copy_option = 0;
 int force_colour = 0;
 
 static const char *test_disk = NULL;
@@ -55,6 +55,9 @@ extern int is_iso_environment;
 /* True if virt-v2v supports the --colours option. */
 extern int feature_colours_option;
 
+/* True if virt-v2v supports the --parallel option. */
+extern int feature_parallel_copy_option;
+
 /* virt-p2v --colours option (used by ansi_* macros). */
 extern int force_colour;
 
@@ -68,6 +71,7 @@ struct config {
   char *identity_file; /* Used to cache the downloaded identity_url. */
   int identity_file_needs_update;
   int sudo;
+  int compress;
   char *guestname;
   int vcpus;
   uint64_t memory;
@@ -148,6 +152,24 @@ extern char *v2v_version;
 extern char **input_drivers;
 extern char **output_drivers;
 
+/* Speed of the network link to the conversion server, measured in
+ * test_connection.  Both are 0 if the link has not been measured.
+ */
+extern uint64_t link_throughput; /* bytes per second, to the server */
+extern uint64_t link_latency;    /* round trip time in microseconds */
+
+/* Links slower than this (in bytes per second) are slow.  The disk
+ * data sent over them is always compressed.
+ */
+#define SLOW_LINK_THROUGHPUT (10 * 1000 * 1000)
+
+/* On links with a latency above this (in microseconds), a single
+ * ssh connection cannot use all of the bandwidth.
+ */
+#define HIGH_LINK_LATENCY 30000
+
+extern int link_is_slow (void);
+
 /* about-authors.c */
 extern const char *authors[];
 
@@ -24,9 +24,11 @@
  *
  * In C<test_connection>, it will first open a connection (to check it
  * is possible) and query virt-v2v on the server to ensure it exists,
- * it is the right version, and so on.  This connection is then
- * closed, because in the GUI case we don't want to deal with keeping
- * it alive in case the administrator has set up an autologout.
+ * it is the right version, and so on.  It also measures the speed of
+ * the network link, which is used to tune the data connections.  This
+ * connection is then closed, because in the GUI case we don't want to
+ * deal with keeping it alive in case the administrator has set up an
+ * autologout.
  *
  * Once we start conversion, we will open a control connection to send
  * the libvirt configuration data and to start up virt-v2v, and we
@@ -50,6 +52,7 @@
 #include <locale.h>
 #include <assert.h>
 #include <libintl.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
@@ -65,6 +68,9 @@ char *v2v_version = NULL;
 char **input_drivers = NULL;
 char **output_drivers = NULL;
 
+uint64_t link_throughput = 0;
+uint64_t link_latency = 0;
+
 static char *ssh_error;
 
 static void set_ssh_error (const char *fs, ...)
@@ -121,6 +127,7 @@ static pcre *prompt_re;
 static pcre *version_re;
 static pcre *feature_libguestfs_rewrite_re;
 static pcre *feature_colours_option_re;
+static pcre *feature_parallel_copy_option_re;
 static pcre *feature_input_re;
 static pcre *feature_output_re;
 static pcre *portfwd_re;
@@ -181,6 +188,7 @@ compile_regexps (void)
 	   0);
   COMPILE (feature_libguestfs_rewrite_re, "libguestfs-rewrite", 0);
   COMPILE (feature_colours_option_re, "colours-option", 0);
+  COMPILE (feature_parallel_copy_option_re, "parallel-copy-option", 0);
   COMPILE (feature_input_re, "input:((?:\\w)*)", 0);
   COMPILE (feature_output_re, "output:((?:\\w)*)", 0);
   COMPILE (portfwd_re, "Allocated port ((?:\\d)+) for remote forward", 0);
@@ -196,6 +204,7 @@ free_regexps (void)
   pcre_free (version_re);
   pcre_free (feature_libguestfs_rewrite_re);
   pcre_free (feature_colours_option_re);
+  pcre_free (feature_parallel_copy_option_re);
   pcre_free (feature_input_re);
   pcre_free (feature_output_re);
   pcre_free (portfwd_re);
@@ -744,6 +753,8 @@ scp_file (struct config *config, const char *localfile, const char *remotefile)
 static void add_input_driver (const char *name, size_t len);
 static void add_output_driver (const char *name, size_t len);
 static int compatible_version (const char *v2v_version);
+static int measure_link (mexp_h *h);
+static int wait_for_prompt (mexp_h *h);
 
 #pragma GCC diagnostic ignored "-Wsuggest-attribute=noreturn" /* WTF? */
 int
@@ -863,6 +874,7 @@ test_connection (struct config *config)
                            { 102, .re = feature_input_re },
                            { 103, .re = feature_output_re },
                            { 104, .re = prompt_re },
+                           { 105, .re = feature_parallel_copy_option_re },
                            { 0 }
                          }, ovector, ovecsize)) {
     case 100:                   /* libguestfs-rewrite. */
@@ -892,6 +904,14 @@ test_connection (struct config *config)
     case 104:                   /* Got prompt, so end of output. */
       goto end_of_machine_readable;
 
+    case 105:                   /* virt-v2v supports --parallel option */
+#if DEBUG_STDERR
+  fprintf (stderr, "%s: remote virt-v2v supports --parallel option\n",
+           getprogname ());
+#endif
+      feature_parallel_copy_option = 1;
+      break;
+
     case MEXP_EOF:
       set_ssh_unexpected_eof ("\"virt-v2v --machine-readable\" output");
       mexp_close (h);
@@ -921,6 +941,11 @@ test_connection (struct config *config)
     return -1;
   }
 
+  if (measure_link (h) == -1) {
+    mexp_close (h);
+    return -1;
+  }
+
   /* Test finished, shut down ssh. */
   if (mexp_printf (h, "exit\n") == -1) {
     set_ssh_mexp_error ("mexp_printf");
@@ -963,6 +988,196 @@ test_connection (struct config *config)
   return 0;
 }
 
+/* How much data measure_link sends to the server, in lines of
+ * PROBE_LINE_SIZE bytes.  Lines are kept short because the data goes
+ * through the remote terminal.
+ */
+#define PROBE_LINE_SIZE 1024
+#define PROBE_LINES 512
+
+/* How many round trips measure_link times to find the latency. */
+#define PROBE_ROUND_TRIPS 3
+
+static uint64_t
+now_us (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Measure the latency and throughput of the network link to the
+ * conversion server, and save them in C<link_latency> and
+ * C<link_throughput>.  C<h> must be at the shell prompt.
+ *
+ * The latency is the fastest of a few round trips to the shell
+ * prompt.  The throughput is found by timing how long it takes
+ * to send a block of data to L<head(1)> on the server.
+ *
+ * Returns C<-1> if the ssh session failed.
+ */
+static int
+measure_link (mexp_h *h)
+{
+  char line[PROBE_LINE_SIZE];
+  uint64_t start, t, latency = UINT64_MAX;
+  size_t i, n;
+  ssize_t r;
+
+  link_throughput = link_latency = 0;
+
+  for (i = 0; i < PROBE_ROUND_TRIPS; ++i) {
+    start = now_us ();
+    if (mexp_printf (h, "\n") == -1) {
+      set_ssh_mexp_error ("mexp_printf");
+      return -1;
+    }
+    if (wait_for_prompt (h) == -1)
+      return -1;
+    t = now_us () - start;
+    if (t < latency)
+      latency = t;
+  }
+
+  /* Random letters, so that neither the terminals nor any
+   * compression along the way change the amount of data sent.
+   */
+  if (guestfs_int_random_string (line, PROBE_LINE_SIZE - 1) == -1) {
+    set_ssh_internal_error ("random_string: %m");
+    return -1;
+  }
+  line[PROBE_LINE_SIZE - 1] = '\n';
+
+  /* The remote terminal must not echo the data back. */
+  if (mexp_printf (h, "stty -echo\n") == -1) {
+    set_ssh_mexp_error ("mexp_printf");
+    return -1;
+  }
+  if (wait_for_prompt (h) == -1)
+    return -1;
+
+  start = now_us ();
+  if (mexp_printf (h, "head -c %d >/dev/null\n",
+                   PROBE_LINE_SIZE * PROBE_LINES) == -1) {
+    set_ssh_mexp_error ("mexp_printf");
+    return -1;
+  }
+  for (i = 0; i < PROBE_LINES; ++i) {
+    for (n = 0; n < PROBE_LINE_SIZE; n += r) {
+      r = write (mexp_get_fd (h), &line[n], PROBE_LINE_SIZE - n);
+      if (r == -1 && errno == EINTR)
+        r = 0;
+      else if (r == -1) {
+        set_ssh_internal_error ("write: %m");
+        return -1;
+      }
+    }
+  }
+  if (wait_for_prompt (h) == -1)
+    return -1;
+  t = now_us () - start;
+
+  if (mexp_printf (h, "stty echo\n") == -1) {
+    set_ssh_mexp_error ("mexp_printf");
+    return -1;
+  }
+  if (wait_for_prompt (h) == -1)
+    return -1;
+
+  /* Don't count the round trip for the prompt. */
+  if (t > latency)
+    t -= latency;
+  if (t == 0)
+    t = 1;
+  link_latency = latency;
+  link_throughput = (uint64_t) PROBE_LINE_SIZE * PROBE_LINES * 1000000 / t;
+
+#if DEBUG_STDERR
+  fprintf (stderr, "%s: network link: %" PRIu64 " bytes/s, latency %" PRIu64 " us\n",
+           getprogname (), link_throughput, link_latency);
+#endif
+
+  return 0;
+}
+
+/**
+ * Returns true if C<test_connection> found that the network link to
+ * the conversion server is slow.
+ */
+int
+link_is_slow (void)
+{
+  return link_throughput > 0 && link_throughput < SLOW_LINK_THROUGHPUT;
+}
+
+/**
+ * Return the ciphers which ssh should prefer for the data
+ * connections on a fast link, as a list for the ssh C<-c> option,
+ * or C<NULL> to use the defaults.  Only ciphers which the local ssh
+ * supports (see C<ssh -Q cipher>) can be listed, otherwise it refuses
+ * to start.  The server uses the first one that it also supports.
+ */
+static const char *
+get_fast_ciphers (void)
+{
+  /* In order of preference.  AES-GCM is much faster than the other
+   * ciphers on processors with AES instructions.
+   */
+  static const char *preferred[] = {
+    "aes128-gcm@openssh.com",
+    "aes256-gcm@openssh.com",
+    "aes128-ctr",
+    "chacha20-poly1305@openssh.com",
+    "aes192-ctr",
+    "aes256-ctr",
+    NULL
+  };
+  static char ciphers[256];
+  static int done = 0;
+  CLEANUP_FREE_STRING_LIST char **supported = NULL;
+  CLEANUP_FREE char *line = NULL;
+  size_t len = 0, nr_supported = 0, i, j;
+  FILE *pp;
+
+  if (done)
+    return ciphers[0] ? ciphers : NULL;
+  done = 1;
+
+  pp = popen ("ssh -Q cipher 2>/dev/null", "r");
+  if (pp == NULL)
+    return NULL;
+  while (getline (&line, &len, pp) != -1) {
+    char **p;
+
+    line[strcspn (line, "\r\n")] = '\0';
+    p = realloc (supported, sizeof (char *) * (nr_supported + 2));
+    if (p == NULL)
+      error (EXIT_FAILURE, errno, "realloc");
+    supported = p;
+    supported[nr_supported] = strdup (line);
+    if (supported[nr_supported] == NULL)
+      error (EXIT_FAILURE, errno, "strdup");
+    supported[++nr_supported] = NULL;
+  }
+  if (pclose (pp) != 0 || supported == NULL)
+    return NULL;
+
+  for (i = 0; preferred[i] != NULL; ++i) {
+    for (j = 0; supported[j] != NULL; ++j) {
+      if (STREQ (preferred[i], supported[j])) {
+        if (ciphers[0])
+          strcat (ciphers, ",");
+        strcat (ciphers, preferred[i]);
+        break;
+      }
+    }
+  }
+
+  return ciphers[0] ? ciphers : NULL;
+}
+
 static void
 add_option (const char *type, char ***drivers, const char *name, size_t len)
 {
@@ -1049,13 +1264,30 @@ open_data_connection (struct config *config, int *local_port, int *remote_port)
   const char *extra_args[] = {
     "-R", remote_arg,
     "-N",
+    NULL,                       /* -C or -c, see below */
+    NULL,
     NULL
   };
+  const char *ciphers;
   CLEANUP_FREE char *port_str = NULL;
   const int ovecsize = 12;
   int ovector[ovecsize];
 
   snprintf (remote_arg, sizeof remote_arg, "0:localhost:%d", nbd_local_port);
+
+  /* The disk data is not compressed by NBD.  Blocks of zeroes and
+   * unused space in particular compress very well, so on slow links
+   * this is much faster than sending the blocks as they are.
+   *
+   * On fast links the encryption can limit the speed instead, so
+   * choose a fast cipher.
+   */
+  if (config->compress || link_is_slow ())
+    extra_args[3] = "-C";
+  else if (link_throughput > 0 && (ciphers = get_fast_ciphers ()) != NULL) {
+    extra_args[3] = "-c";
+    extra_args[4] = ciphers;
+  }
   *local_port = nbd_local_port;
   nbd_local_port++;
 
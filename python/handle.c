@@ -118,6 +118,13 @@ guestfs_int_py_event_callback_wrapper (guestfs_h *g,
   size_t i;
   PyObject *py_r;
 
+  /* The callback may be called from any libguestfs call, and most of
+   * those run with the GIL released (see the generated bindings), so
+   * take it before touching any Python object.
+   */
+  if (PyEval_ThreadsInitialized ())
+    py_save = PyGILState_Ensure ();
+
   py_array = PyList_New (array_len);
   for (i = 0; i < array_len; ++i) {
     a = PyLong_FromLongLong (array[i]);
@@ -128,15 +135,10 @@ guestfs_int_py_event_callback_wrapper (guestfs_h *g,
   args = Py_BuildValue ("(Kis#O)",
                         (unsigned PY_LONG_LONG) event, event_handle,
                         buf, buf_len, py_array);
-
-  if (PyEval_ThreadsInitialized ())
-    py_save = PyGILState_Ensure ();
+  Py_DECREF (py_array);
 
   py_r = PyEval_CallObject (py_callback, args);
 
-  if (PyEval_ThreadsInitialized ())
-    PyGILState_Release (py_save);
-
   Py_DECREF (args);
 
   if (py_r != NULL)
@@ -144,6 +146,9 @@ guestfs_int_py_event_callback_wrapper (guestfs_h *g,
   else
     /* Callback threw an exception: print it. */
     PyErr_PrintEx (0);
+
+  if (PyEval_ThreadsInitialized ())
+    PyGILState_Release (py_save);
 }
 
 PyObject *
@@ -243,6 +248,87 @@ guestfs_int_py_event_to_string (PyObject *self, PyObject *args)
   return py_r;
 }
 
+/* The *_into functions read straight into a writable Python buffer,
+ * such as a bytearray or memoryview, without the copy made by the
+ * generated bindings for functions returning RBufferOut.
+ */
+static PyObject *
+pread_into (PyObject *args, const char *format,
+            int64_t (*fn) (guestfs_h *g, const char *path,
+                           void *buf, size_t count, int64_t offset))
+{
+  PyThreadState *py_save = NULL;
+  PyObject *py_g;
+  guestfs_h *g;
+  const char *path;
+  Py_buffer buf;
+  PY_LONG_LONG offset;
+  int64_t r;
+
+  if (!PyArg_ParseTuple (args, (char *) format, &py_g, &path, &buf, &offset))
+    return NULL;
+  g = get_handle (py_g);
+
+  if (PyEval_ThreadsInitialized ())
+    py_save = PyEval_SaveThread ();
+  r = fn (g, path, buf.buf, buf.len, offset);
+  if (PyEval_ThreadsInitialized ())
+    PyEval_RestoreThread (py_save);
+
+  PyBuffer_Release (&buf);
+
+  if (r == -1) {
+    PyErr_SetString (PyExc_RuntimeError, guestfs_last_error (g));
+    return NULL;
+  }
+
+  return PyLong_FromLongLong (r);
+}
+
+PyObject *
+guestfs_int_py_pread_into (PyObject *self, PyObject *args)
+{
+  return pread_into (args, "Osw*L:guestfs_pread_into", guestfs_pread_into);
+}
+
+PyObject *
+guestfs_int_py_pread_device_into (PyObject *self, PyObject *args)
+{
+  return pread_into (args, "Osw*L:guestfs_pread_device_into",
+                     guestfs_pread_device_into);
+}
+
+PyObject *
+guestfs_int_py_read_file_into (PyObject *self, PyObject *args)
+{
+  PyThreadState *py_save = NULL;
+  PyObject *py_g;
+  guestfs_h *g;
+  const char *path;
+  Py_buffer buf;
+  int64_t r;
+
+  if (!PyArg_ParseTuple (args, (char *) "Osw*:guestfs_read_file_into",
+                         &py_g, &path, &buf))
+    return NULL;
+  g = get_handle (py_g);
+
+  if (PyEval_ThreadsInitialized ())
+    py_save = PyEval_SaveThread ();
+  r = guestfs_read_file_into (g, path, buf.buf, buf.len);
+  if (PyEval_ThreadsInitialized ())
+    PyEval_RestoreThread (py_save);
+
+  PyBuffer_Release (&buf);
+
+  if (r == -1) {
+    PyErr_SetString (PyExc_RuntimeError, guestfs_last_error (g));
+    return NULL;
+  }
+
+  return PyLong_FromLongLong (r);
+}
+
 static PyObject **
 get_all_event_callbacks (guestfs_h *g, size_t *len_rtn)
 {
@@ -76,6 +76,7 @@ usage (int status)
               "  -r|--ro              Access read-only\n"
               "  --scratch[=N]        Add scratch disk(s)\n"
               "  --selinux            For backwards compat only, does nothing\n"
+              "  --sizing type        Size the appliance automatically\n"
               "  --smp N              Enable SMP with N >= 2 virtual CPUs\n"
               "  --suggest            Suggest mount commands for this guest\n"
               "  -v|--verbose         Verbose messages\n"
@@ -116,6 +117,7 @@ main (int argc, char *argv[])
     { "scratch", 2, 0, 0 },
     { "selinux", 0, 0, 0 },
     { "short-options", 0, 0, 0 },
+    { "sizing", 1, 0, 0 },
     { "smp", 1, 0, 0 },
     { "suggest", 0, 0, 0 },
     { "verbose", 0, 0, 'v' },
@@ -156,6 +158,8 @@ main (int argc, char *argv[])
         network = 1;
       } else if (STREQ (long_options[option_index].name, "format")) {
         OPTION_format;
+      } else if (STREQ (long_options[option_index].name, "sizing")) {
+        OPTION_sizing;
       } else if (STREQ (long_options[option_index].name, "smp")) {
         if (sscanf (optarg, "%d", &smp) != 1)
           error (EXIT_FAILURE, 0,
@@ -1192,50 +1192,61 @@ read the man page virt-resize(1).
   in
   List.iter set_partition_bootable_and_id partitions;
 
-  (* Copy over the data. *)
-  let copy_partition p =
+  (* Copy over the data.  Partitions are copied at the same time by
+   * the appliance, and when the target is sparse only the used blocks
+   * of filesystems are copied.
+   *)
+  let copies = List.filter (
+    fun p ->
       match p.p_operation with
-      | OpCopy | OpResize _ ->
-        (* XXX Old code had 'when target_partnum > 0', but it appears
-         * to have served no purpose since the field could never be 0
-         * at this point.
-         *)
+      | OpCopy | OpResize _ -> true
+      | OpIgnore | OpDelete -> false
+  ) partitions in
+  let extended, copies = List.partition (
+    fun p -> p.p_type = ContentExtendedPartition
+  ) copies in
+
+  let copy_extended_partition p =
+    let oldsize = p.p_part.G.part_size in
+    let newsize =
+      match p.p_operation with OpResize s -> s | _ -> oldsize in
 
-        let oldsize = p.p_part.G.part_size in
-        let newsize =
-          match p.p_operation with OpResize s -> s | _ -> oldsize in
-
-        let copysize = if newsize < oldsize then newsize else oldsize in
-
-        let source = p.p_name in
-        let target = sprintf "/dev/sdb%d" p.p_target_partnum in
-
-        message (f_"Copying %s") source;
-
-        (match p.p_type with
-         | ContentUnknown | ContentPV _ | ContentFS _ | ContentSwap ->
-           g#copy_device_to_device ~size:copysize ~sparse source target
-
-         | ContentExtendedPartition ->
-           (* You can't just copy an extended partition by name, eg.
-            * source = "/dev/sda2", because the device name only covers
-            * the first 1K of the partition.  Instead, copy the
-            * source bytes from the parent disk (/dev/sda).
-            *
-            * You can't write directly to the extended partition,
-            * because the size of it reported by Linux is always 1024
-            * bytes. Instead, write to the offset of the extended
-            * partition in the destination disk (/dev/sdb).
-            *)
-           let srcoffset = p.p_part.G.part_start in
-           let destoffset = p.p_target_start *^ 512L in
-           g#copy_device_to_device ~srcoffset ~destoffset ~size:copysize
-                                   ~sparse
-                                   "/dev/sda" "/dev/sdb"
-        )
-      | OpIgnore | OpDelete -> ()
+    let copysize = if newsize < oldsize then newsize else oldsize in
+
+    message (f_"Copying %s") p.p_name;
+
+    (* You can't just copy an extended partition by name, eg.
+     * source = "/dev/sda2", because the device name only covers
+     * the first 1K of the partition.  Instead, copy the
+     * source bytes from the parent disk (/dev/sda).
+     *
+     * You can't write directly to the extended partition,
+     * because the size of it reported by Linux is always 1024
+     * bytes. Instead, write to the offset of the extended
+     * partition in the destination disk (/dev/sdb).
+     *)
+    let srcoffset = p.p_part.G.part_start in
+    let destoffset = p.p_target_start *^ 512L in
+    g#copy_device_to_device ~srcoffset ~destoffset ~size:copysize
+                            ~sparse
+                            "/dev/sda" "/dev/sdb"
   in
-  List.iter copy_partition partitions;
+  List.iter copy_extended_partition extended;
+
+  if copies <> [] then (
+    let sources = List.map (fun p -> p.p_name) copies in
+    let targets =
+      List.map (fun p -> sprintf "/dev/sdb%d" p.p_target_partnum) copies in
+
+    message (f_"Copying %s") (String.concat " " sources);
+
+    (* The size copied is the size of the smaller of the source and
+     * target partitions.
+     *)
+    g#copy_device_to_device_multiple ~sparse ~usedonly:sparse
+                                     (Array.of_list sources)
+                                     (Array.of_list targets)
+  );
 
   (* Fix the bootloader if we aligned the first partition. *)
   if align_first_partition_and_fix_bootloader then (
@@ -27,6 +27,10 @@
 
 #include "actions.h"
 
+#ifdef HAVE_RUBY_THREAD_H
+#include <ruby/thread.h>
+#endif
+
 /* Ruby has a mark-sweep garbage collector and performs imprecise
  * scanning of the stack to look for pointers.  Some implications
  * of this:
@@ -43,6 +47,18 @@ static VALUE event_callback_wrapper_wrapper (VALUE argv);
 static VALUE event_callback_handle_exception (VALUE not_used, VALUE exn);
 static VALUE **get_all_event_callbacks (guestfs_h *g, size_t *len_rtn);
 
+#if defined(HAVE_RB_THREAD_CALL_WITHOUT_GVL2) && defined(HAVE_RB_THREAD_CALL_WITH_GVL)
+#define RUBY_CALL_WITHOUT_GVL 1
+#endif
+
+#ifdef RUBY_CALL_WITHOUT_GVL
+/* True while this thread is in a libguestfs call made without the
+ * GVL.  Event callbacks have to take the GVL back before running any
+ * Ruby code, but must not try to if this thread already holds it.
+ */
+static __thread int without_gvl;
+#endif
+
 static void
 free_handle (void *gvp)
 {
@@ -286,32 +302,95 @@ guestfs_int_ruby_event_to_string (VALUE modulev, VALUE eventsv)
   return rv;
 }
 
+#ifdef RUBY_CALL_WITHOUT_GVL
+struct nogvl_call {
+  void *(*fn) (void *);
+  void *data;
+  int called;
+};
+
+static void *
+nogvl_call (void *callv)
+{
+  struct nogvl_call *call = callv;
+  const int saved_without_gvl = without_gvl;
+  void *r;
+
+  call->called = 1;
+  without_gvl = 1;
+  r = call->fn (call->data);
+  without_gvl = saved_without_gvl;
+
+  return r;
+}
+
+/* Called by Ruby to interrupt the thread, eg. for Thread#kill or ^C.
+ * This cancels any upload or download in progress.  Other calls run
+ * until they finish.
+ */
 static void
-event_callback_wrapper (guestfs_h *g,
-                        void *data,
-                        uint64_t event,
-                        int event_handle,
-                        int flags,
-                        const char *buf, size_t buf_len,
-                        const uint64_t *array, size_t array_len)
+nogvl_unblock (void *gv)
+{
+  guestfs_user_cancel (gv);
+}
+#endif
+
+/* Run 'fn', which makes a libguestfs call on the handle 'g', without
+ * holding the GVL, so that other Ruby threads run meanwhile.  This
+ * is used by the generated bindings for all blocking calls.
+ *
+ * rb_thread_call_without_gvl2 is used because, unlike
+ * rb_thread_call_without_gvl, it doesn't raise pending exceptions
+ * when the call returns, which would leak the call's result.  If the
+ * thread is interrupted before the call starts, it doesn't call 'fn'
+ * at all, so then we make the call while holding the GVL.
+ */
+void
+guestfs_int_ruby_call_without_gvl (guestfs_h *g,
+                                   void *(*fn) (void *), void *data)
+{
+#ifdef RUBY_CALL_WITHOUT_GVL
+  struct nogvl_call call = { .fn = fn, .data = data, .called = 0 };
+
+  rb_thread_call_without_gvl2 (nogvl_call, &call, nogvl_unblock, g);
+  if (!call.called)
+    fn (data);
+#else
+  fn (data);
+#endif
+}
+
+struct event_callback_args {
+  void *data;
+  uint64_t event;
+  int event_handle;
+  const char *buf;
+  size_t buf_len;
+  const uint64_t *array;
+  size_t array_len;
+};
+
+static void *
+event_callback_with_gvl (void *argsv)
 {
+  const struct event_callback_args *args = argsv;
   size_t i;
   volatile VALUE eventv, event_handlev, bufv, arrayv;
   volatile VALUE argv[5];
 
-  eventv = ULL2NUM (event);
-  event_handlev = INT2NUM (event_handle);
+  eventv = ULL2NUM (args->event);
+  event_handlev = INT2NUM (args->event_handle);
 
-  bufv = rb_str_new (buf, buf_len);
+  bufv = rb_str_new (args->buf, args->buf_len);
 
-  arrayv = rb_ary_new2 (array_len);
-  for (i = 0; i < array_len; ++i)
-    rb_ary_push (arrayv, ULL2NUM (array[i]));
+  arrayv = rb_ary_new2 (args->array_len);
+  for (i = 0; i < args->array_len; ++i)
+    rb_ary_push (arrayv, ULL2NUM (args->array[i]));
 
   /* This is a crap limitation of rb_rescue.
    * http://blade.nagaokaut.ac.jp/cgi-bin/scat.rb/~poffice/mail/ruby-talk/65698
    */
-  argv[0] = * (VALUE *) data; /* function */
+  argv[0] = * (VALUE *) args->data; /* function */
   argv[1] = eventv;
   argv[2] = event_handlev;
   argv[3] = bufv;
@@ -319,6 +398,42 @@ event_callback_wrapper (guestfs_h *g,
 
   rb_rescue (event_callback_wrapper_wrapper, (VALUE) argv,
              event_callback_handle_exception, Qnil);
+
+  return NULL;
+}
+
+static void
+event_callback_wrapper (guestfs_h *g,
+                        void *data,
+                        uint64_t event,
+                        int event_handle,
+                        int flags,
+                        const char *buf, size_t buf_len,
+                        const uint64_t *array, size_t array_len)
+{
+  struct event_callback_args args = {
+    .data = data,
+    .event = event,
+    .event_handle = event_handle,
+    .buf = buf,
+    .buf_len = buf_len,
+    .array = array,
+    .array_len = array_len,
+  };
+
+#ifdef RUBY_CALL_WITHOUT_GVL
+  /* Most events happen during blocking calls, which run without the
+   * GVL (see guestfs_int_ruby_call_without_gvl).
+   */
+  if (without_gvl) {
+    without_gvl = 0;
+    rb_thread_call_with_gvl (event_callback_with_gvl, &args);
+    without_gvl = 1;
+    return;
+  }
+#endif
+
+  event_callback_with_gvl (&args);
 }
 
 static VALUE
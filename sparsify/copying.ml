@@ -171,16 +171,34 @@ You can ignore this warning or change it to a hard failure using the
   message (f_"Examine source disk");
 
   (* Connect to libguestfs. *)
-  let g =
-    let g = open_guestfs () in
+  let g, discard =
+    let open_overlay ?discard () =
+      let g = open_guestfs () in
+
+      (* Note that the temporary overlay disk is always qcow2 format. *)
+      g#add_drive ~format:"qcow2" ~readonly:false ~cachemode:"unsafe"
+        ?discard overlaydisk;
 
-    (* Note that the temporary overlay disk is always qcow2 format. *)
-    g#add_drive ~format:"qcow2" ~readonly:false ~cachemode:"unsafe" overlaydisk;
+      if not (quiet ()) then Progress.set_up_progress_bar ~machine_readable g;
+      g#launch ();
 
-    if not (quiet ()) then Progress.set_up_progress_bar ~machine_readable g;
-    g#launch ();
+      g in
 
-    g in
+    (* Discarding a cluster of the overlay which we created (qcow2
+     * compat 1.1) marks it as reading zeroes, without writing any
+     * data or reading the source disk.  This is not true of a
+     * prebuilt overlay, which might be qcow2 compat 0.10, where the
+     * discarded clusters would read from the source disk again.
+     *)
+    match tmp_place with
+    | Directory _ | Block_device _ ->
+      (try open_overlay ~discard:"enable" (), true
+       with G.Error msg ->
+         debug "cannot enable discard on the overlay: %s" msg;
+         open_overlay (), false)
+    | Prebuilt_file _ -> open_overlay (), false in
+
+  let discard = discard && g#feature_available [| "fstrim" |] in
 
   (* Decrypt the disks. *)
   inspect_decrypt g;
@@ -248,8 +266,22 @@ You can ignore this warning or change it to a hard failure using the
             ) else if is_readonly_device "/" then (
               info (f_"Skipping %s, as it is a read-only device.") fs;
             ) else (
-              message (f_"Fill free space in %s with zero") fs;
-              g#zero_free_space "/"
+              (* Trimming the filesystem zeroes the free space without
+               * writing it, and leaves the parts of it which are
+               * holes in the source disk alone.
+               *)
+              let trimmed =
+                discard && (
+                  message (f_"Discard free space in %s") fs;
+                  try g#fstrim "/"; true
+                  with G.Error msg ->
+                    debug "%s: fstrim: %s" fs msg;
+                    false
+                ) in
+              if not trimmed then (
+                message (f_"Fill free space in %s with zero") fs;
+                g#zero_free_space "/"
+              )
             )
           ) else (
             let is_linux_x86_swap =
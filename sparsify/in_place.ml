@@ -74,62 +74,83 @@ let run disk format ignores machine_readable zeroes =
 
   let is_read_only_lv = is_read_only_lv g in
 
+  let filesystems = List.filter (
+    fun fs -> not (is_ignored fs) && not (is_read_only_lv fs)
+  ) filesystems in
+
+  (* Each filesystem that we are able to mount is mounted on its own
+   * mountpoint, and then they are all trimmed together, which is
+   * faster when they are on different devices.
+   *)
+  let mounted = ref [] in
+
   let tasks =
-    List.map (
-      fun fs () ->
-        if not (is_ignored fs) && not (is_read_only_lv fs) then (
-          if List.mem fs zeroes then (
-            message (f_"Zeroing %s") fs;
-
-            if not (g#blkdiscardzeroes fs) then
-              g#zero_device fs;
-            g#blkdiscard fs
-          ) else (
-            let mounted =
-              try g#mount_options "discard" fs "/"; true
+    mapi (
+      fun i fs () ->
+        if List.mem fs zeroes then (
+          message (f_"Zeroing %s") fs;
+
+          if not (g#blkdiscardzeroes fs) then
+            g#zero_device fs;
+          g#blkdiscard fs
+        ) else (
+          let mp = sprintf "/sparsify%d" i in
+          g#mkmountpoint mp;
+
+          let is_mounted =
+            try g#mount_options "discard" fs mp; true
+            with _ -> false in
+
+          if is_mounted then
+            push_front (fs, mp) mounted
+          else (
+            let is_linux_x86_swap =
+              (* Look for the signature for Linux swap on i386.
+               * Location depends on page size, so it definitely won't
+               * work on non-x86 architectures (eg. on PPC, page size is
+               * 64K).  Also this avoids hibernated swap space: in those,
+               * the signature is moved to a different location.
+               *)
+              try g#pread_device fs 10 4086L = "SWAPSPACE2"
               with _ -> false in
 
-            if mounted then (
-              message (f_"Trimming %s") fs;
-
-              try g#fstrim "/"
-              with G.Error msg as exn ->
-                if g#last_errno () = G.Errno.errno_ENOTSUP then (
-                  let vfs_type = try g#vfs_type fs with _ -> "unknown" in
-                  warning (f_"fstrim operation is not supported on %s (%s).  Suppress this warning using '--ignore %s', or use copying mode instead.")
-                          fs vfs_type fs
-                )
-                else raise exn
-            ) else (
-              let is_linux_x86_swap =
-                (* Look for the signature for Linux swap on i386.
-                 * Location depends on page size, so it definitely won't
-                 * work on non-x86 architectures (eg. on PPC, page size is
-                 * 64K).  Also this avoids hibernated swap space: in those,
-                 * the signature is moved to a different location.
-                 *)
-                try g#pread_device fs 10 4086L = "SWAPSPACE2"
-                with _ -> false in
-
-              if is_linux_x86_swap then (
-                message (f_"Clearing Linux swap on %s") fs;
-
-                (* Don't use mkswap.  Just preserve the header containing
-                 * the label, UUID and swap format version (libguestfs
-                 * mkswap may differ from guest's own).
-                 *)
-                let header = g#pread_device fs 4096 0L in
-                g#blkdiscard fs;
-                if g#pwrite_device fs header 0L <> 4096 then
-                  error (f_"pwrite: short write restoring swap partition header")
-              )
+            if is_linux_x86_swap then (
+              message (f_"Clearing Linux swap on %s") fs;
+
+              (* Don't use mkswap.  Just preserve the header containing
+               * the label, UUID and swap format version (libguestfs
+               * mkswap may differ from guest's own).
+               *)
+              let header = g#pread_device fs 4096 0L in
+              g#blkdiscard fs;
+              if g#pwrite_device fs header 0L <> 4096 then
+                error (f_"pwrite: short write restoring swap partition header")
             )
-          );
-
-          g#umount_all ()
+          )
         )
     ) filesystems in
 
+  let tasks = tasks @ [
+    fun () ->
+      let mounted = List.rev !mounted in
+      if mounted <> [] then (
+        message (f_"Trimming %s") (String.concat " " (List.map fst mounted));
+
+        let mps = Array.of_list (List.map snd mounted) in
+        let unsupported = Array.to_list (g#fstrim_multiple mps) in
+        List.iter (
+          fun (fs, mp) ->
+            if List.mem mp unsupported then (
+              let vfs_type = try g#vfs_type fs with _ -> "unknown" in
+              warning (f_"fstrim operation is not supported on %s (%s).  Suppress this warning using '--ignore %s', or use copying mode instead.")
+                      fs vfs_type fs
+            )
+        ) mounted;
+
+        g#umount_all ()
+      )
+  ] in
+
   (* Discard unused space in volume groups. *)
   let vgs = g#vgs () in
   let vgs = Array.to_list vgs in
@@ -72,6 +72,11 @@
  * If we are launching a qemu TCG guest (ie. KVM is known to be
  * disabled or unavailable).  If you don't know, don't pass this flag.
  *
+ * =item C<APPLIANCE_COMMAND_LINE_NO_UDEV>
+ *
+ * Tell the appliance not to run udev (see
+ * L<guestfs(3)/guestfs_set_appliance_profile>).
+ *
  * =back
  *
  * Note that this function returns a newly allocated buffer which must
@@ -177,10 +182,18 @@ guestfs_int_appliance_command_line (guestfs_h *g, const char *appliance_dev,
   else
     guestfs_int_add_string (g, &argv, "quiet");
 
+  /* Boot without udev. */
+  if (flags & APPLIANCE_COMMAND_LINE_NO_UDEV)
+    guestfs_int_add_string (g, &argv, "guestfs_noudev=1");
+
   /* Network. */
   if (g->enable_network)
     guestfs_int_add_string (g, &argv, "guestfs_network=1");
 
+  /* Let the daemon run reentrant calls on the extra vCPUs. */
+  if (g->smp > 1)
+    guestfs_int_add_sprintf (g, &argv, "guestfs_workers=%d", g->smp);
+
   /* TERM environment variable. */
   if (term && VALID_TERM (term))
     guestfs_int_add_sprintf (g, &argv, "TERM=%s", term);
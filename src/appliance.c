@@ -26,6 +26,8 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -50,6 +52,8 @@ static int contains_fixed_appliance (guestfs_h *g, const char *path, void *data)
 static int contains_supermin_appliance (guestfs_h *g, const char *path, void *data);
 static int build_supermin_appliance (guestfs_h *g, const char *supermin_path, char **kernel, char **initrd, char **appliance);
 static int run_supermin_build (guestfs_h *g, const char *lockfile, const char *appliancedir, const char *supermin_path);
+static int supermin_is_locked (const char *lockfile);
+static int snapshot_supermin_appliance (guestfs_h *g, const char *cachedir, const char *appliancedir);
 
 /**
  * Locate or build the appliance.
@@ -105,6 +109,13 @@ static int run_supermin_build (guestfs_h *g, const char *lockfile, const char *a
  * create an appliance.  However (since supermin E<ge> 5) supermin
  * provides a I<--lock> flag and atomic update of the F<appliance.d>
  * subdirectory.
+ *
+ * While one instance holds the lock, for example because it is
+ * rebuilding the appliance after host packages were updated, the
+ * other instances don't wait for it if an appliance has already been
+ * built.  They hard link the current F<appliance.d> files into a
+ * snapshot directory F<$TMPDIR/.guestfs-$UID/appliance.XXXXXX>,
+ * which is deleted when the handle is closed, and use that.
  */
 int
 guestfs_int_build_appliance (guestfs_h *g,
@@ -223,15 +234,29 @@ build_supermin_appliance (guestfs_h *g,
   appliancedir = safe_asprintf (g, "%s/appliance.d", cachedir);
   lockfile = safe_asprintf (g, "%s/lock", cachedir);
 
-  debug (g, "begin building supermin appliance");
+  /* If another process is running supermin it may be rebuilding the
+   * appliance, which can take a long time.  Rather than waiting for
+   * it, use the appliance which is already built, if there is one.
+   */
+  if (supermin_is_locked (lockfile) &&
+      snapshot_supermin_appliance (g, cachedir, appliancedir) == 0) {
+    debug (g, "supermin is running in another process, "
+           "using a snapshot of the current appliance: %s",
+           g->appliance_snapshot);
+    free (appliancedir);
+    appliancedir = safe_strdup (g, g->appliance_snapshot);
+  }
+  else {
+    debug (g, "begin building supermin appliance");
 
-  /* Build the appliance if it needs to be built. */
-  debug (g, "run supermin");
+    /* Build the appliance if it needs to be built. */
+    debug (g, "run supermin");
 
-  if (run_supermin_build (g, lockfile, appliancedir, supermin_path) == -1)
-    return -1;
+    if (run_supermin_build (g, lockfile, appliancedir, supermin_path) == -1)
+      return -1;
 
-  debug (g, "finished building supermin appliance");
+    debug (g, "finished building supermin appliance");
+  }
 
   /* Return the appliance filenames. */
   *kernel = safe_asprintf (g, "%s/kernel", appliancedir);
@@ -260,6 +285,84 @@ build_supermin_appliance (guestfs_h *g,
   return 0;
 }
 
+/**
+ * Returns true if another process holds the supermin lock file,
+ * that is, it is running C<supermin --build>.
+ */
+static int
+supermin_is_locked (const char *lockfile)
+{
+  int fd, r;
+
+  fd = open (lockfile, O_RDONLY|O_CLOEXEC);
+  if (fd == -1)
+    return 0;
+  r = lockf (fd, F_TEST, 0);
+  close (fd);
+  return r == -1 && (errno == EACCES || errno == EAGAIN);
+}
+
+/**
+ * Hard link the files of the current supermin appliance into a new
+ * snapshot directory, and save its name in C<g-E<gt>appliance_snapshot>.
+ *
+ * supermin replaces F<appliance.d> atomically, so the linked files
+ * all come from the same build if F<appliance.d> is still the same
+ * directory after they have been linked.
+ *
+ * Returns C<0> on success, or C<-1> if there is no complete
+ * appliance or it was replaced while we were linking it.  This does
+ * not set the error in the handle.
+ */
+static int
+snapshot_supermin_appliance (guestfs_h *g, const char *cachedir,
+                             const char *appliancedir)
+{
+  static const char *const files[] = { "kernel", "initrd", "root", NULL };
+  CLEANUP_FREE char *snapshot = NULL;
+  struct stat before, after;
+  size_t i;
+
+  if (stat (appliancedir, &before) == -1)
+    return -1;
+
+  snapshot = safe_asprintf (g, "%s/appliance.XXXXXX", cachedir);
+  if (mkdtemp (snapshot) == NULL) {
+    debug (g, "mkdtemp: %s: %m", snapshot);
+    return -1;
+  }
+
+  for (i = 0; files[i] != NULL; ++i) {
+    CLEANUP_FREE char *src =
+      safe_asprintf (g, "%s/%s", appliancedir, files[i]);
+    CLEANUP_FREE char *dst = safe_asprintf (g, "%s/%s", snapshot, files[i]);
+
+    if (link (src, dst) == -1) {
+      debug (g, "link: %s: %m", src);
+      goto error;
+    }
+  }
+
+  if (stat (appliancedir, &after) == -1 ||
+      before.st_dev != after.st_dev || before.st_ino != after.st_ino)
+    goto error;
+
+  /* The snapshot from an earlier launch of this handle is no longer
+   * used.
+   */
+  if (g->appliance_snapshot) {
+    guestfs_int_recursive_remove_dir (g, g->appliance_snapshot);
+    free (g->appliance_snapshot);
+  }
+  g->appliance_snapshot = snapshot;
+  snapshot = NULL;
+  return 0;
+
+ error:
+  guestfs_int_recursive_remove_dir (g, snapshot);
+  return -1;
+}
+
 /**
  * Run C<supermin --build> and tell it to generate the appliance.
  */
@@ -0,0 +1,205 @@
+/* libguestfs
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * Find the ranges of a device which have changed, either compared
+ * with another device or with the block checksums written by
+ * C<guestfs_checksum_device_blocks>.
+ *
+ * The comparison is done in the daemon.  The library only finds the
+ * ranges which are known to read as zeroes, using S<C<qemu-img map>>
+ * on the disk images, so that the daemon does not have to read them.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "guestfs.h"
+#include "guestfs-internal.h"
+#include "guestfs-internal-actions.h"
+
+#define DEFAULT_BLOCKSIZE (1024 * 1024)
+
+/* Limit the zero ranges sent to the daemon, so the message stays
+ * small.  Leaving some out only means more blocks are read.
+ */
+#define MAX_ZERO_RANGES 65536
+
+/**
+ * Find the ranges of C<device> which read as zeroes.  This only
+ * works for whole disks added from local files with an explicit
+ * format, and otherwise (or if S<C<qemu-img map>> fails) returns no
+ * ranges.
+ */
+static size_t
+device_zero_ranges (guestfs_h *g, const char *device,
+                    struct disk_range **ranges_r)
+{
+  CLEANUP_FREE char *canonical = NULL;
+  struct drive *drv;
+  const char *filename, *format;
+  ssize_t i, n;
+
+  *ranges_r = NULL;
+
+  canonical = guestfs_canonical_device_name (g, device);
+  if (canonical == NULL || !STRPREFIX (canonical, "/dev/sd"))
+    return 0;
+  i = guestfs_int_drive_index (&canonical[7]);
+  if (i < 0 || (size_t) i >= g->nr_drives || g->drives[i] == NULL)
+    return 0;
+  drv = g->drives[i];
+
+  if (drv->src.protocol != drive_protocol_file || drv->src.format == NULL)
+    return 0;
+
+  /* Writes to a readonly drive go to the overlay, so map that (the
+   * unallocated parts of the overlay are mapped through to the
+   * original).  The UML overlay is not a qcow2 file.
+   */
+  if (drv->overlay) {
+    if (STREQ (g->backend, "uml"))
+      return 0;
+    filename = drv->overlay;
+    format = "qcow2";
+  }
+  else {
+    filename = drv->src.u.path;
+    format = drv->src.format;
+  }
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  n = guestfs_int_disk_zero_ranges (g, filename, format, ranges_r);
+  guestfs_pop_error_handler (g);
+  if (n == -1) {
+    debug (g, "%s: cannot map %s, all blocks will be read",
+           device, filename);
+    return 0;
+  }
+
+  return n;
+}
+
+/* Make the list of zero ranges for the daemon, leaving out the ones
+ * too short to contain a block.
+ */
+static char **
+zero_ranges_argv (guestfs_h *g, const struct disk_range *ranges, size_t n,
+                  int64_t blocksize)
+{
+  DECLARE_STRINGSBUF (ret);
+  size_t i;
+
+  for (i = 0; i < n && ret.size < MAX_ZERO_RANGES; ++i) {
+    if (ranges[i].length < blocksize)
+      continue;
+    guestfs_int_add_sprintf (g, &ret, "%" PRIi64 " %" PRIi64,
+                             ranges[i].start, ranges[i].length);
+  }
+  guestfs_int_end_stringsbuf (g, &ret);
+
+  return ret.argv;              /* caller frees */
+}
+
+/* Intersect two sorted lists of ranges. */
+static size_t
+intersect_ranges (guestfs_h *g,
+                  const struct disk_range *r1, size_t n1,
+                  const struct disk_range *r2, size_t n2,
+                  struct disk_range **ranges_r)
+{
+  struct disk_range *ret;
+  size_t i = 0, j = 0, n = 0;
+
+  ret = safe_malloc (g, (n1 + n2 + 1) * sizeof (struct disk_range));
+
+  while (i < n1 && j < n2) {
+    const int64_t end1 = r1[i].start + r1[i].length;
+    const int64_t end2 = r2[j].start + r2[j].length;
+    const int64_t start = r1[i].start > r2[j].start ? r1[i].start : r2[j].start;
+    const int64_t end = end1 < end2 ? end1 : end2;
+
+    if (start < end) {
+      ret[n].start = start;
+      ret[n].length = end - start;
+      n++;
+    }
+    if (end1 < end2)
+      i++;
+    else
+      j++;
+  }
+
+  *ranges_r = ret;
+  return n;
+}
+
+struct guestfs_blockrange_list *
+guestfs_impl_device_changed_ranges (guestfs_h *g,
+                                    const char *device1, const char *device2,
+                                    const struct guestfs_device_changed_ranges_argv *optargs)
+{
+  CLEANUP_FREE struct disk_range *ranges1 = NULL, *ranges2 = NULL;
+  CLEANUP_FREE struct disk_range *ranges = NULL;
+  CLEANUP_FREE_STRING_LIST char **zeroes = NULL;
+  int64_t blocksize;
+  size_t n1, n2, n;
+
+  blocksize = optargs->bitmask & GUESTFS_DEVICE_CHANGED_RANGES_BLOCKSIZE_BITMASK
+    ? optargs->blocksize : DEFAULT_BLOCKSIZE;
+
+  /* Blocks can only be skipped if they are zeroes in both devices. */
+  n1 = device_zero_ranges (g, device1, &ranges1);
+  n2 = n1 > 0 ? device_zero_ranges (g, device2, &ranges2) : 0;
+  n = intersect_ranges (g, ranges1, n1, ranges2, n2, &ranges);
+  debug (g, "%s: %zu ranges of zeroes will not be read",
+         __func__, n);
+
+  zeroes = zero_ranges_argv (g, ranges, n, blocksize);
+  return guestfs_internal_changed_ranges (g, device1, device2,
+                                          blocksize, zeroes);
+}
+
+struct guestfs_blockrange_list *
+guestfs_impl_device_changed_ranges_sums (guestfs_h *g, const char *csumtype,
+                                         const char *device,
+                                         const char *sumsfile,
+                                         const struct guestfs_device_changed_ranges_sums_argv *optargs)
+{
+  CLEANUP_FREE struct disk_range *ranges = NULL;
+  CLEANUP_FREE_STRING_LIST char **zeroes = NULL;
+  int64_t blocksize;
+  size_t n;
+
+  blocksize =
+    optargs->bitmask & GUESTFS_DEVICE_CHANGED_RANGES_SUMS_BLOCKSIZE_BITMASK
+    ? optargs->blocksize : DEFAULT_BLOCKSIZE;
+
+  n = device_zero_ranges (g, device, &ranges);
+  debug (g, "%s: %zu ranges of zeroes will not be read",
+         __func__, n);
+
+  zeroes = zero_ranges_argv (g, ranges, n, blocksize);
+  return guestfs_internal_changed_ranges_sums (g, csumtype, device, sumsfile,
+                                               blocksize, zeroes);
+}
@@ -58,7 +58,7 @@
  *
  * =item 5.
  *
- * Run the command.  This is what does the L<fork(2)> call, optionally
+ * Run the command.  This is what does the L<vfork(2)> call, optionally
  * loops over the output, and then does a L<waitpid(3)> and returns the
  * exit status of the command.
  *
@@ -100,9 +100,13 @@
 #include <sys/resource.h>
 #endif
 
+#include "ignore-value.h"
+
 #include "guestfs.h"
 #include "guestfs-internal.h"
 
+extern char **environ;
+
 enum command_style {
   COMMAND_STYLE_NOT_SELECTED = 0,
   COMMAND_STYLE_EXECV = 1,
@@ -130,6 +134,17 @@ struct child_rlimits {
   long limit;
 };
 
+enum child_action_type {
+  CHILD_ACTION_CHDIR,
+  CHILD_ACTION_MKDIR,
+};
+
+struct child_action {
+  struct child_action *next;
+  enum child_action_type type;
+  char *path;
+};
+
 struct command
 {
   guestfs_h *g;
@@ -167,12 +182,28 @@ struct command
   /* PID of subprocess (if > 0). */
   pid_t pid;
 
-  /* Optional child setup callback. */
-  cmd_child_callback child_callback;
-  void *child_callback_data;
+  /* Optional actions done in the child before running the command,
+   * in order.
+   */
+  struct child_action *child_actions;
 
   /* Optional child limits. */
   struct child_rlimits *child_rlimits;
+
+  /* The program, arguments and environment of the child, prepared
+   * before forking (see prepare_child).
+   */
+  char *child_prog;
+  char **child_argv;
+  char **child_env;
+  char *sh_argv[4];
+
+  /* If setting up the child or exec fails, the child stores errno
+   * and what failed here before exiting.  The child shares memory
+   * with the parent until then because it is created by vfork.
+   */
+  volatile int child_errno;
+  const char * volatile child_error_what;
 };
 
 /**
@@ -369,18 +400,45 @@ guestfs_int_cmd_clear_close_files (struct command *cmd)
   cmd->close_files = false;
 }
 
+static void
+add_child_action (struct command *cmd, enum child_action_type type,
+                  const char *path)
+{
+  struct child_action *p, **pp;
+
+  p = safe_malloc (cmd->g, sizeof *p);
+  p->next = NULL;
+  p->type = type;
+  p->path = safe_strdup (cmd->g, path);
+
+  for (pp = &cmd->child_actions; *pp != NULL; pp = &(*pp)->next)
+    ;
+  *pp = p;
+}
+
+/**
+ * Change the current directory of the child before running the
+ * command.  Relative paths are relative to the directory set by an
+ * earlier call, if any.
+ *
+ * The child is created by L<vfork(2)>, so instead of arbitrary
+ * callbacks, only the simple setup actions provided here can be
+ * done in it.
+ */
+void
+guestfs_int_cmd_add_child_chdir (struct command *cmd, const char *dir)
+{
+  add_child_action (cmd, CHILD_ACTION_CHDIR, dir);
+}
+
 /**
- * Set a function to be executed in the child, right before the
- * execution.  Can be used to setup the child, for example changing
- * its current directory.
+ * Create a directory in the child before running the command.  It
+ * is not an error if the directory exists already.
  */
 void
-guestfs_int_cmd_set_child_callback (struct command *cmd,
-                                    cmd_child_callback child_callback,
-                                    void *data)
+guestfs_int_cmd_add_child_mkdir (struct command *cmd, const char *dir)
 {
-  cmd->child_callback = child_callback;
-  cmd->child_callback_data = data;
+  add_child_action (cmd, CHILD_ACTION_MKDIR, dir);
 }
 
 /**
@@ -452,13 +510,122 @@ debug_command (struct command *cmd)
   }
 }
 
-static void run_child (struct command *cmd) __attribute__((noreturn));
+/**
+ * Find the program to run, and build the environment of the child.
+ * This is done before forking because the child, sharing memory with
+ * the parent, must not allocate memory.
+ */
+static void
+prepare_child (struct command *cmd)
+{
+  const char *prog, *path, *p, *end;
+  size_t i, n, len;
+
+  switch (cmd->style) {
+  case COMMAND_STYLE_EXECV:
+    cmd->child_argv = cmd->argv.argv;
+    break;
+
+  case COMMAND_STYLE_SYSTEM:
+    /* This is what system(3) runs. */
+    cmd->sh_argv[0] = (char *) "sh";
+    cmd->sh_argv[1] = (char *) "-c";
+    cmd->sh_argv[2] = cmd->string.str;
+    cmd->sh_argv[3] = NULL;
+    cmd->child_argv = cmd->sh_argv;
+    break;
+
+  case COMMAND_STYLE_NOT_SELECTED:
+    abort ();
+  }
+
+  /* Search $PATH like execvp(3) does. */
+  free (cmd->child_prog);
+  cmd->child_prog = NULL;
+  prog = cmd->style == COMMAND_STYLE_SYSTEM ? "/bin/sh" : cmd->child_argv[0];
+  if (strchr (prog, '/') == NULL) {
+    path = getenv ("PATH");
+    if (path == NULL)
+      path = "/bin:/usr/bin";
+    for (p = path; cmd->child_prog == NULL && *p; p = end) {
+      end = strchrnul (p, ':');
+      len = end - p;
+      if (*end == ':')
+        end++;
+      if (len == 0)
+        continue;
+      cmd->child_prog = safe_asprintf (cmd->g, "%.*s/%s", (int) len, p, prog);
+      if (access (cmd->child_prog, X_OK) == -1) {
+        free (cmd->child_prog);
+        cmd->child_prog = NULL;
+      }
+    }
+  }
+  if (cmd->child_prog == NULL)
+    cmd->child_prog = safe_strdup (cmd->g, prog);
+
+  /* The environment, with LC_ALL=C. */
+  free (cmd->child_env);
+  for (n = 0; environ[n] != NULL; ++n)
+    ;
+  cmd->child_env = safe_malloc (cmd->g, (n+2) * sizeof (char *));
+  for (i = n = 0; environ[i] != NULL; ++i) {
+    if (!STRPREFIX (environ[i], "LC_ALL="))
+      cmd->child_env[n++] = environ[i];
+  }
+  cmd->child_env[n++] = (char *) "LC_ALL=C";
+  cmd->child_env[n] = NULL;
+
+  cmd->child_errno = 0;
+  cmd->child_error_what = NULL;
+}
+
+/**
+ * Block all signals in the parent around L<vfork(2)>, so that no
+ * signal handler of the parent can run in the child (see
+ * C<run_child>).
+ */
+static pid_t
+start_child (struct command *cmd, sigset_t *oldmask)
+{
+  sigset_t mask;
+  pid_t pid;
+
+  sigfillset (&mask);
+  pthread_sigmask (SIG_SETMASK, &mask, oldmask);
+  pid = vfork ();
+  if (pid != 0)
+    pthread_sigmask (SIG_SETMASK, oldmask, NULL);
+  return pid;
+}
+
+/**
+ * If setting up or running the child failed, print the error where
+ * the child would have printed it, ie. to C<fd>.
+ */
+static void
+report_child_error (struct command *cmd, int fd)
+{
+  CLEANUP_FREE char *msg = NULL;
+
+  if (cmd->child_errno == 0)
+    return;
+
+  msg = safe_asprintf (cmd->g, "%s: %s\n",
+                       cmd->child_error_what, strerror (cmd->child_errno));
+  ignore_value (write (fd, msg, strlen (msg)));
+}
+
+static void run_child (struct command *cmd, const sigset_t *oldmask)
+  __attribute__((noreturn));
 
 static int
 run_command (struct command *cmd)
 {
   int errorfd[2] = { -1, -1 };
   int outfd[2] = { -1, -1 };
+  sigset_t oldmask;
+  pid_t pid;
 
   /* Set up a pipe to capture command output and send it to the error log. */
   if (cmd->capture_errors) {
@@ -476,14 +643,19 @@ run_command (struct command *cmd)
     }
   }
 
-  cmd->pid = fork ();
-  if (cmd->pid == -1) {
-    perrorf (cmd->g, "fork");
+  prepare_child (cmd);
+
+  pid = start_child (cmd, &oldmask);
+  if (pid == -1) {
+    perrorf (cmd->g, "vfork");
     goto error;
   }
 
   /* In parent, return to caller. */
-  if (cmd->pid > 0) {
+  if (pid > 0) {
+    cmd->pid = pid;
+    report_child_error (cmd, cmd->capture_errors ? errorfd[1] : 2);
+
     if (cmd->capture_errors) {
       close (errorfd[1]);
       errorfd[1] = -1;
@@ -519,7 +691,7 @@ run_command (struct command *cmd)
   if (cmd->stderr_to_stdout)
     dup2 (1, 2);
 
-  run_child (cmd);
+  run_child (cmd, &oldmask);
   /*NOTREACHED*/
 
  error:
@@ -535,12 +707,30 @@ run_command (struct command *cmd)
   return -1;
 }
 
+/**
+ * Record why the child failed for C<report_child_error> and exit.
+ */
+static void __attribute__((noreturn))
+child_failed (struct command *cmd, const char *what)
+{
+  cmd->child_errno = errno;
+  cmd->child_error_what = what;
+  _exit (EXIT_FAILURE);
+}
+
+/**
+ * This runs in the child created by L<vfork(2)>, which shares memory
+ * with the parent until it calls L<execve(2)> or L<_exit(2)>.  It
+ * must only make system calls: no allocation, no stdio and no
+ * changes to memory other than C<cmd-E<gt>child_errno> and
+ * C<cmd-E<gt>child_error_what>.
+ */
 static void
-run_child (struct command *cmd)
+run_child (struct command *cmd, const sigset_t *oldmask)
 {
   struct sigaction sa;
-  int i, fd, max_fd, r;
-  char status_string[80];
+  int i, fd, max_fd;
+  struct child_action *action;
 #ifdef HAVE_SETRLIMIT
   struct child_rlimits *child_rlimit;
   struct rlimit rlimit;
@@ -548,8 +738,8 @@ run_child (struct command *cmd)
 
   /* Remove all signal handlers.  See the justification here:
    * https://www.redhat.com/archives/libvir-list/2008-August/msg00303.html
-   * We don't mask signal handlers yet, so this isn't completely
-   * race-free, but better than not doing it at all.
+   * Signals are blocked until this is done, so none of the parent's
+   * handlers can run in the child.
    */
   memset (&sa, 0, sizeof sa);
   sa.sa_handler = SIG_DFL;
@@ -557,6 +747,7 @@ run_child (struct command *cmd)
   sigemptyset (&sa.sa_mask);
   for (i = 1; i < NSIG; ++i)
     sigaction (i, &sa, NULL);
+  sigprocmask (SIG_SETMASK, oldmask, NULL);
 
   if (cmd->close_files) {
     /* Close all other file descriptors.  This ensures that we don't
@@ -571,15 +762,21 @@ run_child (struct command *cmd)
       close (fd);
   }
 
-  /* Clean up the environment. */
-  setenv ("LC_ALL", "C", 1);
-
   /* Set the umask for all subcommands to something sensible (RHBZ#610880). */
   umask (022);
 
-  if (cmd->child_callback) {
-    if (cmd->child_callback (cmd->g, cmd->child_callback_data) == -1)
-      _exit (EXIT_FAILURE);
+  for (action = cmd->child_actions; action != NULL; action = action->next) {
+    switch (action->type) {
+    case CHILD_ACTION_CHDIR:
+      if (chdir (action->path) == -1)
+        child_failed (cmd, action->path);
+      break;
+
+    case CHILD_ACTION_MKDIR:
+      if (mkdir (action->path, 0777) == -1 && errno != EEXIST)
+        child_failed (cmd, action->path);
+      break;
+    }
   }
 
 #ifdef HAVE_SETRLIMIT
@@ -591,52 +788,25 @@ run_child (struct command *cmd)
       /* EPERM means we're trying to raise the limit (ie. the limit is
        * already more restrictive than what we want), so ignore it.
        */
-      if (errno != EPERM) {
-        perror ("setrlimit");
-        _exit (EXIT_FAILURE);
-      }
+      if (errno != EPERM)
+        child_failed (cmd, "setrlimit");
     }
   }
 #endif /* HAVE_SETRLIMIT */
 
-  /* NB: If the main process (which we have forked a copy of) uses
-   * more heap than the RLIMIT_AS we set above, then any call to
-   * malloc or any extension of the stack will fail with ENOMEM or
-   * SIGSEGV respectively.  Luckily we only use RLIMIT_AS followed by
-   * execvp below, so we get away with it, but adding any code here
-   * could cause a failure.
+  /* NB: The limits only apply to the child, which has not allocated
+   * anything, so RLIMIT_AS does not stop us getting to execve below
+   * even if the main process uses more heap than that.
    *
    * There is a regression test for this.  See:
    * tests/regressions/test-big-heap.c
    */
 
-  /* Run the command. */
-  switch (cmd->style) {
-  case COMMAND_STYLE_EXECV:
-    execvp (cmd->argv.argv[0], cmd->argv.argv);
-    perror (cmd->argv.argv[0]);
-    _exit (EXIT_FAILURE);
-
-  case COMMAND_STYLE_SYSTEM:
-    r = system (cmd->string.str);
-    if (r == -1) {
-      perror ("system");
-      _exit (EXIT_FAILURE);
-    }
-    if (WIFEXITED (r))
-      _exit (WEXITSTATUS (r));
-    fprintf (stderr, "%s\n",
-             guestfs_int_exit_status_to_string (r, cmd->string.str,
-                                                status_string,
-                                                sizeof status_string));
-    _exit (EXIT_FAILURE);
-
-  case COMMAND_STYLE_NOT_SELECTED:
-    abort ();
-  }
-
-  /*NOTREACHED*/
-  abort ();
+  /* Run the command.  The environment was cleaned up (LC_ALL=C) by
+   * prepare_child.
+   */
+  execve (cmd->child_prog, cmd->child_argv, cmd->child_env);
+  child_failed (cmd, cmd->child_argv[0]);
 }
 
 /**
@@ -743,7 +913,7 @@ wait_command (struct command *cmd)
 }
 
 /**
- * Fork, run the command, loop over the output, and waitpid.
+ * Start the command, loop over the output, and waitpid.
  *
  * Returns the exit status.  Test it using C<WIF*> macros.
  *
@@ -767,7 +937,7 @@ guestfs_int_cmd_run (struct command *cmd)
 }
 
 /**
- * Fork and run the command, but don't wait.  Roughly equivalent to
+ * Start the command, but don't wait.  Roughly equivalent to
  * S<C<popen (..., "r"|"w")>>.
  *
  * Returns the file descriptor of the pipe, connected to stdout
@@ -788,6 +958,8 @@ guestfs_int_cmd_pipe_run (struct command *cmd, const char *mode)
   int errfd = -1;
   int r_mode;
   int ret;
+  sigset_t oldmask;
+  pid_t pid;
 
   finish_command (cmd);
 
@@ -821,14 +993,18 @@ guestfs_int_cmd_pipe_run (struct command *cmd, const char *mode)
     goto error;
   }
 
-  cmd->pid = fork ();
-  if (cmd->pid == -1) {
-    perrorf (cmd->g, "fork");
+  prepare_child (cmd);
+
+  pid = start_child (cmd, &oldmask);
+  if (pid == -1) {
+    perrorf (cmd->g, "vfork");
     goto error;
   }
 
   /* Parent. */
-  if (cmd->pid > 0) {
+  if (pid > 0) {
+    cmd->pid = pid;
+    report_child_error (cmd, errfd);
     close (errfd);
     errfd = -1;
 
@@ -859,7 +1035,7 @@ guestfs_int_cmd_pipe_run (struct command *cmd, const char *mode)
     close (fd[0]);
   }
 
-  run_child (cmd);
+  run_child (cmd, &oldmask);
   /*NOTREACHED*/
 
  error:
@@ -917,6 +1093,7 @@ void
 guestfs_int_cmd_close (struct command *cmd)
 {
   struct child_rlimits *child_rlimit, *child_rlimit_next;
+  struct child_action *action, *action_next;
 
   if (!cmd)
     return;
@@ -957,6 +1134,15 @@ guestfs_int_cmd_close (struct command *cmd)
     free (child_rlimit);
   }
 
+  for (action = cmd->child_actions; action != NULL; action = action_next) {
+    action_next = action->next;
+    free (action->path);
+    free (action);
+  }
+
+  free (cmd->child_prog);
+  free (cmd->child_env);
+
   free (cmd);
 }
 
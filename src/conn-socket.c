@@ -33,6 +33,8 @@
 #include <sys/stat.h>
 #include <sys/socket.h>  /* accept4 */
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <stdbool.h>
 #include <assert.h>
 #include <libintl.h>
 
@@ -40,6 +42,7 @@
 
 #include "guestfs.h"
 #include "guestfs-internal.h"
+#include "guestfs_protocol.h"
 
 struct connection_socket {
   const struct connection_ops *ops;
@@ -51,31 +54,47 @@ struct connection_socket {
    * before and during accept_connection.
    */
   int daemon_accept_sock;
+
+  /* Extra data channels.  The sockets in data_accept_socks are only
+   * used before and during accept_connection.  Channel 0 is
+   * daemon_sock, so the first entry in each array is unused.
+   */
+  size_t nr_channels;
+  int data_socks[GUESTFS_MAX_DATA_CHANNELS];
+  int data_accept_socks[GUESTFS_MAX_DATA_CHANNELS];
+
+  /* Pipe used by splice_channel, created the first time it is
+   * needed.  If splicing from the socket doesn't work, no_splice is
+   * set and we always copy through a buffer instead.
+   */
+  int splice_pipe[2];
+  bool no_splice;
 };
 
 static int handle_log_message (guestfs_h *g, struct connection_socket *conn);
+static int forward_cancellation (guestfs_h *g, struct connection_socket *conn);
 
+/**
+ * Wait for a connection on C<accept_sock> and accept it, passing on
+ * any log messages from the console in the meantime.
+ *
+ * Returns: 1 = accepted (C<*sock_rtn> is set), 0 = appliance closed
+ * connection, -1 = error
+ */
 static int
-accept_connection (guestfs_h *g, struct connection *connv)
+accept_socket (guestfs_h *g, struct connection_socket *conn,
+               int accept_sock, time_t start_t, int *sock_rtn)
 {
-  struct connection_socket *conn = (struct connection_socket *) connv;
   int sock = -1;
-  time_t start_t, now_t;
+  time_t now_t;
   int timeout_ms;
 
-  time (&start_t);
-
-  if (conn->daemon_accept_sock == -1) {
-    error (g, _("accept_connection called twice"));
-    return -1;
-  }
-
   while (sock == -1) {
     struct pollfd fds[2];
     nfds_t nfds = 1;
     int r;
 
-    fds[0].fd = conn->daemon_accept_sock;
+    fds[0].fd = accept_sock;
     fds[0].events = POLLIN;
     fds[0].revents = 0;
 
@@ -111,7 +130,7 @@ accept_connection (guestfs_h *g, struct connection *connv)
 
     /* Accept on socket? */
     if ((fds[0].revents & POLLIN) != 0) {
-      sock = accept4 (conn->daemon_accept_sock, NULL, NULL, SOCK_CLOEXEC);
+      sock = accept4 (accept_sock, NULL, NULL, SOCK_CLOEXEC);
       if (sock == -1) {
         if (errno == EINTR || errno == EAGAIN)
           continue;
@@ -121,40 +140,75 @@ accept_connection (guestfs_h *g, struct connection *connv)
     }
   }
 
+  /* Make sure the new socket is non-blocking. */
+  if (fcntl (sock, F_SETFL, O_NONBLOCK) == -1) {
+    perrorf (g, "accept_connection: fcntl");
+    close (sock);
+    return -1;
+  }
+
+  *sock_rtn = sock;
+  return 1;
+}
+
+static int
+accept_connection (guestfs_h *g, struct connection *connv)
+{
+  struct connection_socket *conn = (struct connection_socket *) connv;
+  time_t start_t;
+  size_t i;
+  int r;
+
+  time (&start_t);
+
+  if (conn->daemon_accept_sock == -1) {
+    error (g, _("accept_connection called twice"));
+    return -1;
+  }
+
+  r = accept_socket (g, conn, conn->daemon_accept_sock, start_t,
+                     &conn->daemon_sock);
+  if (r <= 0)
+    return r;
+
   /* Got a connection and accepted it, so update the connection's
    * internal status.
    */
   close (conn->daemon_accept_sock);
   conn->daemon_accept_sock = -1;
-  conn->daemon_sock = sock;
 
-  /* Make sure the new socket is non-blocking. */
-  if (fcntl (conn->daemon_sock, F_SETFL, O_NONBLOCK) == -1) {
-    perrorf (g, "accept_connection: fcntl");
-    return -1;
+  /* qemu connects all of the chardevs when it starts up, so the data
+   * channels should be waiting for us too.
+   */
+  for (i = 1; i < conn->nr_channels; ++i) {
+    r = accept_socket (g, conn, conn->data_accept_socks[i], start_t,
+                       &conn->data_socks[i]);
+    if (r <= 0)
+      return r;
+    close (conn->data_accept_socks[i]);
+    conn->data_accept_socks[i] = -1;
   }
 
   return 1;
 }
 
+/**
+ * Read the whole buffer from C<fd>, also handling console log
+ * messages.  See C<read_data> in F<src/guestfs-internal.h>.
+ */
 static ssize_t
-read_data (guestfs_h *g, struct connection *connv, void *bufv, size_t len)
+read_fd (guestfs_h *g, struct connection_socket *conn, int fd,
+         void *bufv, size_t len)
 {
   char *buf = bufv;
-  struct connection_socket *conn = (struct connection_socket *) connv;
   const size_t original_len = len;
 
-  if (conn->daemon_sock == -1) {
-    error (g, _("read_data: socket not connected"));
-    return -1;
-  }
-
   while (len > 0) {
-    struct pollfd fds[2];
-    nfds_t nfds = 1;
+    struct pollfd fds[3];
+    nfds_t nfds = 1, cancel_idx = 0;
     int r;
 
-    fds[0].fd = conn->daemon_sock;
+    fds[0].fd = fd;
     fds[0].events = POLLIN;
     fds[0].revents = 0;
 
@@ -165,6 +219,15 @@ read_data (guestfs_h *g, struct connection *connv, void *bufv, size_t len)
       nfds++;
     }
 
+    /* Waiting for a reply, so watch for guestfs_user_cancel too. */
+    if (g->reply_cancellable && fd == conn->daemon_sock) {
+      cancel_idx = nfds;
+      fds[cancel_idx].fd = g->cancel_pipe[0];
+      fds[cancel_idx].events = POLLIN;
+      fds[cancel_idx].revents = 0;
+      nfds++;
+    }
+
     r = poll (fds, nfds, -1);
     if (r == -1) {
       if (errno == EINTR || errno == EAGAIN)
@@ -174,15 +237,22 @@ read_data (guestfs_h *g, struct connection *connv, void *bufv, size_t len)
     }
 
     /* Log message? */
-    if (nfds > 1 && (fds[1].revents & POLLIN) != 0) {
+    if (conn->console_sock >= 0 && (fds[1].revents & POLLIN) != 0) {
       r = handle_log_message (g, conn);
       if (r <= 0)
         return r;
     }
 
+    /* Cancelled by the user? */
+    if (cancel_idx > 0 && (fds[cancel_idx].revents & POLLIN) != 0) {
+      r = forward_cancellation (g, conn);
+      if (r <= 0)
+        return r;
+    }
+
     /* Read data on daemon socket? */
     if ((fds[0].revents & POLLIN) != 0) {
-      ssize_t n = read (conn->daemon_sock, buf, len);
+      ssize_t n = read (fd, buf, len);
       if (n == -1) {
         if (errno == EINTR || errno == EAGAIN)
           continue;
@@ -212,6 +282,19 @@ read_data (guestfs_h *g, struct connection *connv, void *bufv, size_t len)
   return original_len;
 }
 
+static ssize_t
+read_data (guestfs_h *g, struct connection *connv, void *buf, size_t len)
+{
+  struct connection_socket *conn = (struct connection_socket *) connv;
+
+  if (conn->daemon_sock == -1) {
+    error (g, _("read_data: socket not connected"));
+    return -1;
+  }
+
+  return read_fd (g, conn, conn->daemon_sock, buf, len);
+}
+
 static int
 can_read_data (guestfs_h *g, struct connection *connv)
 {
@@ -240,25 +323,32 @@ can_read_data (guestfs_h *g, struct connection *connv)
   return (fd.revents & POLLIN) != 0 ? 1 : 0;
 }
 
+/**
+ * Write the whole of the buffers in C<iov> to C<fd>, also handling
+ * console log messages.  See C<write_data> in
+ * F<src/guestfs-internal.h>.  C<iov> is not modified.
+ */
 static ssize_t
-write_data (guestfs_h *g, struct connection *connv,
-            const void *bufv, size_t len)
+write_fdv (guestfs_h *g, struct connection_socket *conn, int fd,
+           const struct iovec *iov_in, int iovcnt)
 {
-  const char *buf = bufv;
-  struct connection_socket *conn = (struct connection_socket *) connv;
-  const size_t original_len = len;
-
-  if (conn->daemon_sock == -1) {
-    error (g, _("write_data: socket not connected"));
-    return -1;
+  struct iovec iov[iovcnt];
+  struct iovec *p = iov;
+  size_t len = 0, original_len;
+  int i;
+
+  for (i = 0; i < iovcnt; ++i) {
+    iov[i] = iov_in[i];
+    len += iov[i].iov_len;
   }
+  original_len = len;
 
   while (len > 0) {
     struct pollfd fds[2];
     nfds_t nfds = 1;
     int r;
 
-    fds[0].fd = conn->daemon_sock;
+    fds[0].fd = fd;
     fds[0].events = POLLOUT;
     fds[0].revents = 0;
 
@@ -286,7 +376,7 @@ write_data (guestfs_h *g, struct connection *connv,
 
     /* Can write data on daemon socket? */
     if ((fds[0].revents & POLLOUT) != 0) {
-      ssize_t n = write (conn->daemon_sock, buf, len);
+      ssize_t n = writev (fd, p, iovcnt);
       if (n == -1) {
         if (errno == EINTR || errno == EAGAIN)
           continue;
@@ -296,14 +386,349 @@ write_data (guestfs_h *g, struct connection *connv,
         return -1;
       }
 
-      buf += n;
       len -= n;
+      while (iovcnt > 0 && (size_t) n >= p->iov_len) {
+        n -= p->iov_len;
+        p++;
+        iovcnt--;
+      }
+      if (iovcnt > 0) {
+        p->iov_base = (char *) p->iov_base + n;
+        p->iov_len -= n;
+      }
+    }
+  }
+
+  return original_len;
+}
+
+static ssize_t
+write_fd (guestfs_h *g, struct connection_socket *conn, int fd,
+          const void *buf, size_t len)
+{
+  const struct iovec iov = { .iov_base = (void *) buf, .iov_len = len };
+
+  return write_fdv (g, conn, fd, &iov, 1);
+}
+
+/**
+ * Called from C<read_fd> when C<guestfs_user_cancel> was called
+ * while waiting for a reply.  Send the cancellation flag to the
+ * daemon, which makes the call in progress fail with C<EINTR>.  The
+ * daemon still sends the (error) reply, which we go on waiting for.
+ *
+ * Returns: 1 = ok, 0 = appliance closed connection, -1 = error
+ */
+static int
+forward_cancellation (guestfs_h *g, struct connection_socket *conn)
+{
+  char buf[16];
+  char fbuf[4];
+  uint32_t flag = GUESTFS_CANCEL_FLAG;
+  XDR xdr;
+  ssize_t r;
+
+  while (read (g->cancel_pipe[0], buf, sizeof buf) > 0)
+    ;
+
+  debug (g, "cancelling the call in progress");
+
+  xdrmem_create (&xdr, fbuf, sizeof fbuf, XDR_ENCODE);
+  xdr_uint32_t (&xdr, &flag);
+  xdr_destroy (&xdr);
+
+  r = write_fd (g, conn, conn->daemon_sock, fbuf, sizeof fbuf);
+  if (r == -1)
+    return -1;
+  return r == 0 ? 0 : 1;
+}
+
+static ssize_t
+write_data (guestfs_h *g, struct connection *connv,
+            const void *buf, size_t len)
+{
+  struct connection_socket *conn = (struct connection_socket *) connv;
+
+  if (conn->daemon_sock == -1) {
+    error (g, _("write_data: socket not connected"));
+    return -1;
+  }
+
+  return write_fd (g, conn, conn->daemon_sock, buf, len);
+}
+
+static size_t
+get_nr_channels (guestfs_h *g, struct connection *connv)
+{
+  struct connection_socket *conn = (struct connection_socket *) connv;
+
+  return conn->nr_channels;
+}
+
+/* Returns the socket for channel 'ch', or -1 if not connected. */
+static int
+get_channel_sock (struct connection_socket *conn, size_t ch)
+{
+  if (ch == 0)
+    return conn->daemon_sock;
+  if (ch < conn->nr_channels)
+    return conn->data_socks[ch];
+  return -1;
+}
+
+static ssize_t
+read_channel (guestfs_h *g, struct connection *connv, size_t ch,
+              void *buf, size_t len)
+{
+  struct connection_socket *conn = (struct connection_socket *) connv;
+  const int fd = get_channel_sock (conn, ch);
+
+  if (fd == -1) {
+    error (g, _("read_channel: channel %zu not connected"), ch);
+    return -1;
+  }
+
+  return read_fd (g, conn, fd, buf, len);
+}
+
+static ssize_t
+write_channel (guestfs_h *g, struct connection *connv, size_t ch,
+               const void *buf, size_t len)
+{
+  struct connection_socket *conn = (struct connection_socket *) connv;
+  const int fd = get_channel_sock (conn, ch);
+
+  if (fd == -1) {
+    error (g, _("write_channel: channel %zu not connected"), ch);
+    return -1;
+  }
+
+  return write_fd (g, conn, fd, buf, len);
+}
+
+static ssize_t
+writev_channel (guestfs_h *g, struct connection *connv, size_t ch,
+                const struct iovec *iov, int iovcnt)
+{
+  struct connection_socket *conn = (struct connection_socket *) connv;
+  const int fd = get_channel_sock (conn, ch);
+
+  if (fd == -1) {
+    error (g, _("write_channel: channel %zu not connected"), ch);
+    return -1;
+  }
+
+  return write_fdv (g, conn, fd, iov, iovcnt);
+}
+
+static int
+xwrite (int fd, const void *v_buf, size_t len)
+{
+  const char *buf = v_buf;
+  ssize_t r;
+
+  while (len > 0) {
+    r = write (fd, buf, len);
+    if (r == -1) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+
+    buf += r;
+    len -= r;
+  }
+
+  return 0;
+}
+
+/**
+ * Read C<len> bytes from C<sock> and write them to C<fd>, copying
+ * through a buffer.  If writing fails, C<*write_errno> is set and
+ * the rest of the data is read and discarded.
+ */
+static ssize_t
+copy_fd (guestfs_h *g, struct connection_socket *conn, int sock, int fd,
+         size_t len, int *write_errno)
+{
+  char buf[BUFSIZ];
+  ssize_t n;
+
+  while (len > 0) {
+    n = read_fd (g, conn, sock, buf, MIN (len, sizeof buf));
+    if (n <= 0)
+      return n;
+
+    if (*write_errno == 0 && xwrite (fd, buf, n) == -1)
+      *write_errno = errno;
+
+    len -= n;
+  }
+
+  return 1;
+}
+
+#ifdef HAVE_SPLICE
+
+/**
+ * Move C<len> bytes, which are already in C<conn-E<gt>splice_pipe>,
+ * to C<fd>.  If C<fd> doesn't support L<splice(2)> then we fall back
+ * to copying (C<*splice_out> is cleared).  If writing fails,
+ * C<*write_errno> is set and the data is discarded.
+ */
+static int
+drain_splice_pipe (guestfs_h *g, struct connection_socket *conn, int fd,
+                   size_t len, bool *splice_out, int *write_errno)
+{
+  char buf[BUFSIZ];
+  ssize_t n;
+
+  while (len > 0) {
+    if (*write_errno == 0 && *splice_out) {
+      n = splice (conn->splice_pipe[0], NULL, fd, NULL, len, SPLICE_F_MOVE);
+      if (n > 0) {
+        len -= n;
+        continue;
+      }
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n == -1 && errno == EINVAL) {
+        *splice_out = false;
+        continue;
+      }
+      *write_errno = n == -1 ? errno : EIO;
+      continue;
+    }
+
+    n = read (conn->splice_pipe[0], buf, MIN (len, sizeof buf));
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      perrorf (g, "splice_channel: read");
+      return -1;
+    }
+    if (*write_errno == 0 && xwrite (fd, buf, n) == -1)
+      *write_errno = errno;
+    len -= n;
+  }
+
+  return 0;
+}
+
+#endif /* HAVE_SPLICE */
+
+/**
+ * Move C<len> bytes from C<sock> to C<fd>.  Where possible the data
+ * is spliced through a pipe so that it is never copied into
+ * userspace.  See C<splice_channel> in F<src/guestfs-internal.h>.
+ */
+static ssize_t
+splice_fd (guestfs_h *g, struct connection_socket *conn, int sock, int fd,
+           size_t len)
+{
+  const size_t original_len = len;
+  int write_errno = 0;
+  ssize_t r;
+
+#ifdef HAVE_SPLICE
+  bool splice_out = true;
+
+  if (!conn->no_splice && conn->splice_pipe[0] == -1 &&
+      pipe2 (conn->splice_pipe, O_CLOEXEC|O_NONBLOCK) == -1) {
+    debug (g, "pipe2: %m (not using splice)");
+    conn->no_splice = true;
+  }
+
+  while (!conn->no_splice && len > 0) {
+    struct pollfd fds[2];
+    nfds_t nfds = 1;
+    ssize_t n;
+
+    fds[0].fd = sock;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+
+    if (conn->console_sock >= 0) {
+      fds[1].fd = conn->console_sock;
+      fds[1].events = POLLIN;
+      fds[1].revents = 0;
+      nfds++;
+    }
+
+    r = poll (fds, nfds, -1);
+    if (r == -1) {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+      perrorf (g, "splice_channel: poll");
+      return -1;
+    }
+
+    /* Log message? */
+    if (nfds > 1 && (fds[1].revents & POLLIN) != 0) {
+      r = handle_log_message (g, conn);
+      if (r <= 0)
+        return r;
+    }
+
+    if ((fds[0].revents & (POLLIN|POLLHUP)) == 0)
+      continue;
+
+    /* The pipe is always empty here, so this only blocks (EAGAIN) if
+     * the socket has no data.
+     */
+    n = splice (sock, NULL, conn->splice_pipe[1], NULL, len,
+                SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+    if (n == -1) {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+      if (errno == EINVAL) {
+        debug (g, "splice: %m (not using splice)");
+        conn->no_splice = true;
+        break;
+      }
+      if (errno == ECONNRESET)
+        return 0;
+      perrorf (g, "splice_channel: splice");
+      return -1;
     }
+    if (n == 0)
+      return 0;
+
+    if (drain_splice_pipe (g, conn, fd, n, &splice_out, &write_errno) == -1)
+      return -1;
+    len -= n;
+  }
+#endif /* HAVE_SPLICE */
+
+  if (len > 0) {
+    r = copy_fd (g, conn, sock, fd, len, &write_errno);
+    if (r <= 0)
+      return r;
+  }
+
+  if (write_errno) {
+    errno = write_errno;
+    return -2;
   }
 
   return original_len;
 }
 
+static ssize_t
+splice_channel (guestfs_h *g, struct connection *connv, size_t ch,
+                int fd, size_t len)
+{
+  struct connection_socket *conn = (struct connection_socket *) connv;
+  const int sock = get_channel_sock (conn, ch);
+
+  if (sock == -1) {
+    error (g, _("splice_channel: channel %zu not connected"), ch);
+    return -1;
+  }
+
+  return splice_fd (g, conn, sock, fd, len);
+}
+
 /**
  * This is called if C<conn-E<gt>console_sock> becomes ready to read
  * while we are doing one of the connection operations above.  It
@@ -400,6 +825,7 @@ static void
 free_conn_socket (guestfs_h *g, struct connection *connv)
 {
   struct connection_socket *conn = (struct connection_socket *) connv;
+  size_t i;
 
   if (conn->console_sock >= 0)
     close (conn->console_sock);
@@ -407,6 +833,16 @@ free_conn_socket (guestfs_h *g, struct connection *connv)
     close (conn->daemon_sock);
   if (conn->daemon_accept_sock >= 0)
     close (conn->daemon_accept_sock);
+  for (i = 1; i < conn->nr_channels; ++i) {
+    if (conn->data_socks[i] >= 0)
+      close (conn->data_socks[i]);
+    if (conn->data_accept_socks[i] >= 0)
+      close (conn->data_accept_socks[i]);
+  }
+  if (conn->splice_pipe[0] >= 0) {
+    close (conn->splice_pipe[0]);
+    close (conn->splice_pipe[1]);
+  }
 
   free (conn);
 }
@@ -417,6 +853,11 @@ static struct connection_ops ops = {
   .read_data = read_data,
   .write_data = write_data,
   .can_read_data = can_read_data,
+  .get_nr_channels = get_nr_channels,
+  .read_channel = read_channel,
+  .write_channel = write_channel,
+  .writev_channel = writev_channel,
+  .splice_channel = splice_channel,
 };
 
 /**
@@ -459,10 +900,50 @@ guestfs_int_new_conn_socket_listening (guestfs_h *g,
   conn->console_sock = console_sock;
   conn->daemon_sock = -1;
   conn->daemon_accept_sock = daemon_accept_sock;
+  conn->nr_channels = 1;
+  conn->splice_pipe[0] = conn->splice_pipe[1] = -1;
+  conn->no_splice = false;
 
   return (struct connection *) conn;
 }
 
+/**
+ * Add an extra data channel to a listening socket connection.  The
+ * daemon side of the channel is
+ * F</dev/virtio-ports/org.libguestfs.channel.I<N>>, where I<N> is
+ * the number of channels added before this one plus one.
+ *
+ * This must be called before C<accept_connection>.  After calling
+ * this, C<accept_sock> is owned by the connection.
+ */
+int
+guestfs_int_conn_socket_add_channel (guestfs_h *g, struct connection *connv,
+                                     int accept_sock)
+{
+  struct connection_socket *conn = (struct connection_socket *) connv;
+
+  assert (accept_sock >= 0);
+  assert (conn->daemon_accept_sock >= 0);
+
+  if (conn->nr_channels >= GUESTFS_MAX_DATA_CHANNELS) {
+    error (g, _("too many data channels"));
+    close (accept_sock);
+    return -1;
+  }
+
+  if (fcntl (accept_sock, F_SETFL, O_NONBLOCK) == -1) {
+    perrorf (g, "conn_socket_add_channel: fcntl");
+    close (accept_sock);
+    return -1;
+  }
+
+  conn->data_socks[conn->nr_channels] = -1;
+  conn->data_accept_socks[conn->nr_channels] = accept_sock;
+  conn->nr_channels++;
+
+  return 0;
+}
+
 /**
  * Create a new socket connection, connected.
  *
@@ -499,6 +980,9 @@ guestfs_int_new_conn_socket_connected (guestfs_h *g,
   conn->console_sock = console_sock;
   conn->daemon_sock = daemon_sock;
   conn->daemon_accept_sock = -1;
+  conn->nr_channels = 1;
+  conn->splice_pipe[0] = conn->splice_pipe[1] = -1;
+  conn->no_splice = false;
 
   return (struct connection *) conn;
 }
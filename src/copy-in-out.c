@@ -38,18 +38,27 @@ int
 guestfs_impl_copy_in (guestfs_h *g,
                       const char *localpath, const char *remotedir)
 {
-  CLEANUP_CMD_CLOSE struct command *cmd = guestfs_int_new_command (g);
-  int fd;
-  int r;
-  char fdbuf[64];
-  const size_t buf_len = strlen (localpath) + 1;
-  CLEANUP_FREE char *buf = safe_malloc (g, buf_len);
-  const char *dirname, *basename;
+  char *const localpaths[] = { (char *) localpath, NULL };
+
+  return guestfs_copy_in_multiple (g, localpaths, remotedir);
+}
+
+int
+guestfs_impl_copy_in_multiple (guestfs_h *g,
+                               char *const *localpaths, const char *remotedir)
+{
+  struct tar_writer *tw;
+  struct send_source src;
   struct stat statbuf;
+  size_t i;
+  int r;
 
-  if (stat (localpath, &statbuf) == -1) {
-    error (g, _("source '%s' does not exist (or cannot be read)"), localpath);
-    return -1;
+  for (i = 0; localpaths[i] != NULL; ++i) {
+    if (STREQ (localpaths[i], "") || stat (localpaths[i], &statbuf) == -1) {
+      error (g, _("source '%s' does not exist (or cannot be read)"),
+             localpaths[i]);
+      return -1;
+    }
   }
 
   const int remote_is_dir = guestfs_is_dir (g, remotedir);
@@ -61,73 +70,21 @@ guestfs_impl_copy_in (guestfs_h *g,
     return -1;
   }
 
-  if (split_path (g, buf, buf_len, localpath, &dirname, &basename) == -1)
-    return -1;
-
-  guestfs_int_cmd_add_arg (cmd, "tar");
-  if (dirname) {
-    guestfs_int_cmd_add_arg (cmd, "-C");
-    guestfs_int_cmd_add_arg (cmd, dirname);
-  }
-  guestfs_int_cmd_add_arg (cmd, "-cf");
-  guestfs_int_cmd_add_arg (cmd, "-");
-  guestfs_int_cmd_add_arg (cmd, basename);
-
-  guestfs_int_cmd_clear_capture_errors (cmd);
-
-  fd = guestfs_int_cmd_pipe_run (cmd, "r");
-  if (fd == -1)
-    return -1;
-
-  snprintf (fdbuf, sizeof fdbuf, "/dev/fd/%d", fd);
-
-  r = guestfs_tar_in (g, fdbuf, remotedir);
-
-  if (close (fd) == -1) {
-    perrorf (g, "close (tar subprocess)");
-    return -1;
-  }
-
-  r = guestfs_int_cmd_pipe_wait (cmd);
-  if (r == -1)
-    return -1;
-  if (!WIFEXITED (r) || WEXITSTATUS (r) != 0) {
-    CLEANUP_FREE char *errors = guestfs_int_cmd_get_pipe_errors (cmd);
-    if (errors == NULL)
-      return -1;
-    error (g, "tar subprocess failed: %s", errors);
-    return -1;
-  }
-
-  return 0;
-}
-
-struct copy_out_child_data {
-  const char *localdir;
-  const char *basename;
-};
-
-static int
-child_setup (guestfs_h *g, void *data)
-{
-  struct copy_out_child_data d = *(struct copy_out_child_data *) data;
+  /* All the sources are packed into a single tar stream, which is
+   * generated in the library while it is being sent.  The filename
+   * passed to guestfs_tar_in is ignored.
+   */
+  tw = guestfs_int_new_tar_writer (g, localpaths);
+  src.read = guestfs_int_tar_writer_read;
+  src.opaque = tw;
 
-  if (chdir (d.localdir) == -1) {
-    perror (d.localdir);
-    return -1;
-  }
+  g->send_source = &src;
+  r = guestfs_tar_in (g, "/dev/null", remotedir);
+  g->send_source = NULL;
 
-  if (mkdir (d.basename, 0777) == -1 && errno != EEXIST) {
-    perror (d.basename);
-    return -1;
-  }
+  guestfs_int_free_tar_writer (tw);
 
-  if (chdir (d.basename) == -1) {
-    perror (d.basename);
-    return -1;
-  }
-
-  return 0;
+  return r;
 }
 
 int
@@ -167,7 +124,6 @@ guestfs_impl_copy_out (guestfs_h *g,
       return -1;
   } else {                    /* not a regular file */
     CLEANUP_CMD_CLOSE struct command *cmd = guestfs_int_new_command (g);
-    struct copy_out_child_data data;
     char fdbuf[64];
     int fd;
 
@@ -193,10 +149,9 @@ guestfs_impl_copy_out (guestfs_h *g,
     if (STREQ (basename, ""))
       basename = ".";
 
-    data.localdir = localdir;
-    data.basename = basename;
-
-    guestfs_int_cmd_set_child_callback (cmd, &child_setup, &data);
+    guestfs_int_cmd_add_child_chdir (cmd, localdir);
+    guestfs_int_cmd_add_child_mkdir (cmd, basename);
+    guestfs_int_cmd_add_child_chdir (cmd, basename);
 
     guestfs_int_cmd_add_arg (cmd, "tar");
     guestfs_int_cmd_add_arg (cmd, "-xf");
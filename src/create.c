@@ -36,18 +36,22 @@
 #include <sys/ioctl.h>
 #include <errno.h>
 #include <string.h>
+#include <endian.h>
 #include <libintl.h>
 
 #ifdef HAVE_LINUX_FS_H
 #include <linux/fs.h>
 #endif
 
+#include "full-write.h"
+
 #include "guestfs.h"
 #include "guestfs-internal.h"
 #include "guestfs-internal-actions.h"
 
 static int disk_create_raw (guestfs_h *g, const char *filename, int64_t size, const struct guestfs_disk_create_argv *optargs);
 static int disk_create_qcow2 (guestfs_h *g, const char *filename, int64_t size, const char *backingfile, const struct guestfs_disk_create_argv *optargs);
+static int disk_create_qcow2_overlay (guestfs_h *g, const char *filename, const char *backingfile, const char *backingformat);
 
 int
 guestfs_impl_disk_create (guestfs_h *g, const char *filename,
@@ -310,6 +314,18 @@ disk_create_qcow2 (guestfs_h *g, const char *orig_filename, int64_t size,
     }
   }
 
+  /* Overlays are created for every read-only drive, so avoid running
+   * qemu-img for the common case.
+   */
+  if (backingfile && backingformat && !preallocation &&
+      (!compat || STREQ (compat, "1.1")) && clustersize == -1) {
+    r = disk_create_qcow2_overlay (g, filename, backingfile, backingformat);
+    if (r == -1)
+      return -1;
+    if (r == 1)
+      return 0;
+  }
+
   /* Assemble the qemu-img command line. */
   guestfs_int_cmd_add_arg (cmd, "qemu-img");
   guestfs_int_cmd_add_arg (cmd, "create");
@@ -350,3 +366,175 @@ disk_create_qcow2 (guestfs_h *g, const char *orig_filename, int64_t size,
 
   return 0;
 }
+
+/* Return the virtual size of a local raw or qcow2 backing file, or
+ * -1 if it cannot be found here (and qemu-img must be used).
+ */
+static int64_t
+get_backing_size (const char *backingfile,
+                  const char *backingformat)
+{
+  struct stat statbuf;
+  int fd;
+  int64_t size = -1;
+
+  fd = open (backingfile, O_RDONLY|O_NOCTTY|O_CLOEXEC);
+  if (fd == -1)
+    return -1;
+  if (fstat (fd, &statbuf) == -1)
+    goto out;
+
+  if (STREQ (backingformat, "raw")) {
+    if (S_ISREG (statbuf.st_mode))
+      size = statbuf.st_size;
+#ifdef BLKGETSIZE64
+    else if (S_ISBLK (statbuf.st_mode)) {
+      uint64_t u;
+
+      if (ioctl (fd, BLKGETSIZE64, &u) == 0)
+        size = u;
+    }
+#endif
+    /* qemu rounds the size of raw files up to whole sectors. */
+    if (size >= 0)
+      size = (size + 511) & ~INT64_C(511);
+  }
+  else if (STREQ (backingformat, "qcow2")) {
+    unsigned char header[32];
+
+    if (pread (fd, header, sizeof header, 0) == sizeof header &&
+        memcmp (header, "QFI\xfb", 4) == 0) {
+      uint64_t be;
+
+      memcpy (&be, &header[24], sizeof be);
+      size = be64toh (be);
+    }
+  }
+
+ out:
+  close (fd);
+  return size;
+}
+
+#define QCOW2_CLUSTER_BITS 16
+#define QCOW2_CLUSTER_SIZE (1 << QCOW2_CLUSTER_BITS)
+
+/* Store big endian integers in the header buffer. */
+static void
+put_be32 (unsigned char *buf, size_t offset, uint32_t v)
+{
+  v = htobe32 (v);
+  memcpy (&buf[offset], &v, sizeof v);
+}
+
+static void
+put_be64 (unsigned char *buf, size_t offset, uint64_t v)
+{
+  v = htobe64 (v);
+  memcpy (&buf[offset], &v, sizeof v);
+}
+
+/**
+ * Write an empty qcow2 v3 overlay on a local raw or qcow2 backing
+ * file directly, the same as
+ * C<qemu-img create -f qcow2 -o backing_file=...,backing_fmt=...>
+ * would.
+ *
+ * The image has 64K clusters and 16 bit refcounts.  Cluster 0 is the
+ * header, cluster 1 the refcount table, cluster 2 the only refcount
+ * block, and the (empty) L1 table follows.
+ *
+ * Returns 1 if the overlay was created, 0 if the backing file is not
+ * a local raw or qcow2 file (and qemu-img must be used), or -1 on
+ * error.
+ */
+static int
+disk_create_qcow2_overlay (guestfs_h *g, const char *filename,
+                           const char *backingfile, const char *backingformat)
+{
+  const uint64_t cs = QCOW2_CLUSTER_SIZE;
+  const uint64_t l2_coverage = cs * (cs / 8);
+  CLEANUP_FREE unsigned char *buf = NULL;
+  int64_t size;
+  uint64_t l1_size, l1_clusters, nr_clusters, i;
+  size_t offset, fmtlen, namelen;
+  int fd;
+
+  /* Non-local backing files are URIs or json: strings. */
+  if (backingfile[0] != '/')
+    return 0;
+  namelen = strlen (backingfile);
+  fmtlen = strlen (backingformat);
+  if (namelen > 1023)
+    return 0;
+
+  size = get_backing_size (backingfile, backingformat);
+  if (size == -1)
+    return 0;
+
+  l1_size = (size + l2_coverage - 1) / l2_coverage;
+  l1_clusters = (l1_size * 8 + cs - 1) / cs;
+  if (l1_clusters == 0)
+    l1_clusters = 1;
+  nr_clusters = 3 + l1_clusters;
+  if (nr_clusters > cs / 2)     /* more than one refcount block */
+    return 0;
+
+  buf = safe_calloc (g, 3, cs);
+
+  /* Header. */
+  memcpy (buf, "QFI\xfb", 4);
+  put_be32 (buf, 4, 3);                         /* version */
+  put_be32 (buf, 20, QCOW2_CLUSTER_BITS);
+  put_be64 (buf, 24, size);
+  put_be32 (buf, 36, l1_size);
+  put_be64 (buf, 40, 3 * cs);                   /* L1 table */
+  put_be64 (buf, 48, cs);                       /* refcount table */
+  put_be32 (buf, 56, 1);                        /* refcount table clusters */
+  put_be32 (buf, 96, 4);                        /* refcount order */
+  put_be32 (buf, 100, 104);                     /* header length */
+
+  /* Header extensions: backing format, then the end marker. */
+  offset = 104;
+  put_be32 (buf, offset, 0xE2792ACA);
+  put_be32 (buf, offset+4, fmtlen);
+  memcpy (&buf[offset+8], backingformat, fmtlen);
+  offset += 8 + ((fmtlen + 7) & ~7);
+  offset += 8;
+
+  /* Backing file name, not terminated. */
+  put_be64 (buf, 8, offset);
+  put_be32 (buf, 16, namelen);
+  memcpy (&buf[offset], backingfile, namelen);
+
+  /* Refcount table pointing to the refcount block. */
+  put_be64 (buf, cs, 2 * cs);
+
+  /* Refcount block: all the clusters in the file are used once. */
+  for (i = 0; i < nr_clusters; ++i) {
+    buf[2*cs + i*2] = 0;
+    buf[2*cs + i*2 + 1] = 1;
+  }
+
+  fd = open (filename, O_WRONLY|O_CREAT|O_NOCTTY|O_TRUNC|O_CLOEXEC, 0666);
+  if (fd == -1) {
+    perrorf (g, _("cannot create qcow2 file: %s"), filename);
+    return -1;
+  }
+  if (full_write (fd, buf, 3 * cs) != 3 * cs ||
+      ftruncate (fd, nr_clusters * cs) == -1) {
+    perrorf (g, _("%s: write"), filename);
+    close (fd);
+    unlink (filename);
+    return -1;
+  }
+  if (close (fd) == -1) {
+    perrorf (g, _("%s: close"), filename);
+    unlink (filename);
+    return -1;
+  }
+
+  debug (g, "disk_create: created overlay %s on %s without qemu-img",
+         filename, backingfile);
+  return 1;
+}
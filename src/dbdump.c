@@ -16,11 +16,30 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+/**
+ * Read the key, value pairs from a Berkeley DB hash or btree
+ * database, such as the RPM database.
+ *
+ * The file is mapped into memory and the leaf pages are walked
+ * directly.  This only understands enough of the on-disk format to
+ * read the RPM database (no duplicates, checksums or encryption).
+ * Databases which use those features are read by running
+ * L<db_dump(1)> instead, if it was available at configure time.
+ */
+
 #include <config.h>
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 #include <libintl.h>
 
@@ -31,11 +50,341 @@
 #include "guestfs.h"
 #include "guestfs-internal.h"
 
+/* Magic numbers in the metadata page. */
+#define DB_HASHMAGIC  0x061561
+#define DB_BTREEMAGIC 0x053162
+
+/* Page types (byte 25 of each page). */
+#define P_LBTREE         5      /* Btree leaf. */
+#define P_OVERFLOW       7      /* Overflow. */
+#define P_HASH_UNSORTED  2      /* Hash, unsorted (db 4.x). */
+#define P_HASH          13      /* Hash. */
+
+/* Item types. */
+#define H_KEYDATA   1
+#define H_OFFPAGE   3
+#define B_KEYDATA   1
+#define B_OVERFLOW  3
+#define B_DELETE    0x80
+
+#define SIZEOF_PAGE 26          /* Size of the generic page header. */
+
+struct db {
+  const unsigned char *map;     /* The whole file. */
+  size_t size;
+  uint32_t pagesize;
+  uint32_t nr_pages;
+  bool swapped;                 /* Opposite byte order to the host. */
+};
+
+static uint16_t
+get16 (const struct db *db, const unsigned char *p)
+{
+  uint16_t v;
+
+  memcpy (&v, p, sizeof v);
+  return db->swapped ? __builtin_bswap16 (v) : v;
+}
+
+static uint32_t
+get32 (const struct db *db, const unsigned char *p)
+{
+  uint32_t v;
+
+  memcpy (&v, p, sizeof v);
+  return db->swapped ? __builtin_bswap32 (v) : v;
+}
+
+/**
+ * Return a pointer to the start of page C<pgno>, or C<NULL> if
+ * it is outside the file.
+ */
+static const unsigned char *
+get_page (const struct db *db, uint32_t pgno)
+{
+  if (pgno >= db->nr_pages)
+    return NULL;
+  return db->map + (size_t) pgno * db->pagesize;
+}
+
+/**
+ * Reassemble an item of C<tlen> bytes stored on the chain of overflow
+ * pages starting at C<pgno>.  The caller must free the result.
+ */
+static unsigned char *
+read_overflow (guestfs_h *g, const struct db *db, uint32_t pgno, uint32_t tlen)
+{
+  CLEANUP_FREE unsigned char *ret = NULL;
+  size_t len = 0;
+  const unsigned char *pg;
+  uint32_t n;
+  unsigned char *r;
+
+  ret = safe_malloc (g, tlen > 0 ? tlen : 1);
+
+  while (len < tlen) {
+    pg = get_page (db, pgno);
+    if (pg == NULL || pg[25] != P_OVERFLOW)
+      goto corrupt;
+
+    /* On overflow pages hf_offset is the length of the data. */
+    n = get16 (db, pg + 22);
+    if (n > db->pagesize - SIZEOF_PAGE || n > tlen - len)
+      goto corrupt;
+    memcpy (ret + len, pg + SIZEOF_PAGE, n);
+    len += n;
+    if (n == 0)
+      goto corrupt;
+
+    pgno = get32 (db, pg + 16);   /* next_pgno */
+  }
+
+  r = ret;
+  ret = NULL;
+  return r;
+
+ corrupt:
+  error (g, _("Berkeley DB: corrupt overflow page %" PRIu32), pgno);
+  return NULL;
+}
+
+/**
+ * Get item C<i> from a hash or btree leaf page C<pg> with C<entries>
+ * items.  Returns C<1> if the item was found, C<0> if it is a deleted
+ * btree item, or C<-1> on error.  If C<*buf_rtn> is set on return the
+ * data was reassembled from overflow pages and the caller must free
+ * it.
+ */
+static int
+get_item (guestfs_h *g, const struct db *db, const unsigned char *pg,
+          uint16_t entries, uint16_t i, bool is_hash,
+          const unsigned char **data_rtn, size_t *len_rtn,
+          unsigned char **buf_rtn)
+{
+  const uint32_t psize = db->pagesize;
+  uint32_t offset, end;
+  const unsigned char *item;
+
+  *buf_rtn = NULL;
+
+  if (i >= entries || SIZEOF_PAGE + 2 * (size_t) entries > psize)
+    goto corrupt;
+
+  offset = get16 (db, pg + SIZEOF_PAGE + 2*i);
+  if (offset < SIZEOF_PAGE + 2 * (uint32_t) entries || offset >= psize)
+    goto corrupt;
+  item = pg + offset;
+
+  if (is_hash) {
+    /* Hash items are packed down from the end of the page, so the
+     * length of an item comes from the offset of the previous one.
+     */
+    end = i == 0 ? psize : get16 (db, pg + SIZEOF_PAGE + 2*(i-1));
+    if (end <= offset || end > psize)
+      goto corrupt;
+
+    switch (item[0]) {
+    case H_KEYDATA:
+      *data_rtn = item + 1;
+      *len_rtn = end - offset - 1;
+      return 1;
+    case H_OFFPAGE:
+      if (offset + 12 > psize)
+        goto corrupt;
+      *len_rtn = get32 (db, item + 8);
+      *buf_rtn = read_overflow (g, db, get32 (db, item + 4), *len_rtn);
+      if (*buf_rtn == NULL)
+        return -1;
+      *data_rtn = *buf_rtn;
+      return 1;
+    default:                    /* Duplicates are not used by RPM. */
+      error (g, _("Berkeley DB: unsupported hash item type %d"), item[0]);
+      return -1;
+    }
+  }
+  else {
+    uint16_t len;
+
+    if (offset + 3 > psize)
+      goto corrupt;
+    len = get16 (db, item);
+    if (item[2] & B_DELETE)
+      return 0;
+
+    switch (item[2]) {
+    case B_KEYDATA:
+      if (offset + 3 + len > psize)
+        goto corrupt;
+      *data_rtn = item + 3;
+      *len_rtn = len;
+      return 1;
+    case B_OVERFLOW:
+      if (offset + 12 > psize)
+        goto corrupt;
+      *len_rtn = get32 (db, item + 8);
+      *buf_rtn = read_overflow (g, db, get32 (db, item + 4), *len_rtn);
+      if (*buf_rtn == NULL)
+        return -1;
+      *data_rtn = *buf_rtn;
+      return 1;
+    default:
+      error (g, _("Berkeley DB: unsupported btree item type %d"), item[2]);
+      return -1;
+    }
+  }
+
+ corrupt:
+  error (g, _("Berkeley DB: corrupt page %" PRIu32 " (item %" PRIu16 ")"),
+         get32 (db, pg + 8), i);
+  return -1;
+}
+
+/**
+ * Walk every page of the database and pass each key, value pair on
+ * the hash or btree leaf pages to the callback.
+ */
+static int
+walk_pages (guestfs_h *g, const struct db *db, void *opaque,
+            guestfs_int_db_dump_callback callback)
+{
+  uint32_t pgno;
+  uint16_t i, entries;
+
+  for (pgno = 1; pgno < db->nr_pages; ++pgno) {
+    const unsigned char *pg = get_page (db, pgno);
+    const bool is_hash = pg[25] == P_HASH || pg[25] == P_HASH_UNSORTED;
+
+    if (!is_hash && pg[25] != P_LBTREE)
+      continue;
+
+    entries = get16 (db, pg + 20);
+    for (i = 0; i+1 < entries; i += 2) {
+      const unsigned char *key, *value;
+      size_t keylen, valuelen;
+      CLEANUP_FREE unsigned char *keybuf = NULL, *valuebuf = NULL;
+      int r;
+
+      r = get_item (g, db, pg, entries, i, is_hash, &key, &keylen, &keybuf);
+      if (r == -1)
+        return -1;
+      if (r == 0)
+        continue;
+      r = get_item (g, db, pg, entries, i+1, is_hash,
+                    &value, &valuelen, &valuebuf);
+      if (r == -1)
+        return -1;
+      if (r == 0)
+        continue;
+
+      if (callback (g, key, keylen, value, valuelen, opaque) == -1)
+        return -1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Read the database natively.  Returns C<0> on success, C<-1> on
+ * error, or C<-2> (without setting an error) if the file uses
+ * features which this reader doesn't understand.
+ */
+static int
+read_db_native (guestfs_h *g, const char *dbfile, void *opaque,
+                guestfs_int_db_dump_callback callback)
+{
+  struct db db;
+  struct stat statbuf;
+  void *map;
+  uint32_t magic;
+  int fd, r;
+
+  fd = open (dbfile, O_RDONLY|O_CLOEXEC);
+  if (fd == -1) {
+    perrorf (g, "open: %s", dbfile);
+    return -1;
+  }
+  if (fstat (fd, &statbuf) == -1) {
+    perrorf (g, "fstat: %s", dbfile);
+    close (fd);
+    return -1;
+  }
+  if (statbuf.st_size < 512) {
+    close (fd);
+    debug (g, "%s: too short for a Berkeley DB file", dbfile);
+    return -2;
+  }
+
+  map = mmap (NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (map == MAP_FAILED) {
+    perrorf (g, "mmap: %s", dbfile);
+    return -1;
+  }
+
+  db.map = map;
+  db.size = statbuf.st_size;
+  db.swapped = false;
+  memcpy (&magic, db.map + 12, sizeof magic);
+  if (magic != DB_HASHMAGIC && magic != DB_BTREEMAGIC) {
+    magic = __builtin_bswap32 (magic);
+    db.swapped = true;
+  }
+  db.pagesize = get32 (&db, db.map + 20);
+
+  if ((magic != DB_HASHMAGIC && magic != DB_BTREEMAGIC) ||
+      db.pagesize < 512 || db.pagesize > 65536 ||
+      (db.pagesize & (db.pagesize - 1)) != 0 ||
+      db.map[24] != 0 /* encrypt_alg */ ||
+      (db.map[26] & 1) != 0 /* DBMETA_CHKSUM */) {
+    debug (g, "%s: unsupported Berkeley DB format "
+           "(magic %" PRIx32 ", pagesize %" PRIu32 ", flags 0x%x)",
+           dbfile, magic, db.pagesize, db.map[26]);
+    r = -2;
+    goto out;
+  }
+  db.nr_pages = db.size / db.pagesize;
+
+  r = walk_pages (g, &db, opaque, callback);
+
+ out:
+  munmap (map, statbuf.st_size);
+  return r;
+}
+
 #if defined(DB_DUMP)
 
+static int run_db_dump (guestfs_h *g, const char *dumpfile, void *opaque, guestfs_int_db_dump_callback callback);
 static void read_db_dump_line (guestfs_h *g, void *datav, const char *line, size_t len);
 static unsigned char *convert_hex_to_binary (guestfs_h *g, const char *hex, size_t hexlen, size_t *binlen_rtn);
 
+#endif
+
+/**
+ * Read all the key, value pairs from the Berkeley DB hash or btree
+ * database C<dbfile>, calling C<callback> for each one.
+ */
+int
+guestfs_int_read_db_dump (guestfs_h *g,
+			  const char *dbfile, void *opaque,
+			  guestfs_int_db_dump_callback callback)
+{
+  int r;
+
+  r = read_db_native (g, dbfile, opaque, callback);
+  if (r != -2)
+    return r;
+
+#if defined(DB_DUMP)
+  return run_db_dump (g, dbfile, opaque, callback);
+#else
+  error (g, _("%s: unsupported Berkeley DB format"), dbfile);
+  return -1;
+#endif
+}
+
+#if defined(DB_DUMP)
+
 struct cb_data {
   guestfs_int_db_dump_callback callback;
   void *opaque;
@@ -51,10 +400,10 @@ struct cb_data {
  * output from db_dump/db4_dump.  It's just enough to support the RPM
  * database format.
  */
-int
-guestfs_int_read_db_dump (guestfs_h *g,
-			  const char *dumpfile, void *opaque,
-			  guestfs_int_db_dump_callback callback)
+static int
+run_db_dump (guestfs_h *g,
+             const char *dumpfile, void *opaque,
+             guestfs_int_db_dump_callback callback)
 {
   struct cb_data data;
   CLEANUP_CMD_CLOSE struct command *cmd = guestfs_int_new_command (g);
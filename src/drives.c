@@ -26,9 +26,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
 #include <unistd.h>
 #include <netdb.h>
+#include <sys/time.h>
 #include <arpa/inet.h>
 #include <assert.h>
 #include <libintl.h>
@@ -717,6 +720,7 @@ guestfs_impl_add_drive_opts (guestfs_h *g, const char *filename,
   const char *protocol;
   struct drive *drv;
   size_t i, drv_index;
+  struct timeval start_t, attach_t, end_t;
 
   data.nr_servers = 0;
   data.servers = NULL;
@@ -907,18 +911,32 @@ guestfs_impl_add_drive_opts (guestfs_h *g, const char *filename,
       drv_index = i;
 
   /* Hot-add the drive. */
+  gettimeofday (&start_t, NULL);
   if (g->backend_ops->hot_add_drive (g, g->backend_data,
                                      drv, drv_index) == -1) {
     free_drive_struct (drv);
     return -1;
   }
+  gettimeofday (&attach_t, NULL);
 
   add_drive_to_handle_at (g, drv, drv_index);
   /* drv is now owned by the handle */
 
+  if (g->hotplug_defer_wait) {
+    debug (g, "hot-add: %s: attach %" PRIi64 " ms", drv->disk_label,
+           guestfs_int_timeval_diff (&start_t, &attach_t));
+    return 0;
+  }
+
   /* Call into the appliance to wait for the new drive to appear. */
   if (guestfs_internal_hot_add_drive (g, drv->disk_label) == -1)
     return -1;
+  gettimeofday (&end_t, NULL);
+
+  debug (g, "hot-add: %s: attach %" PRIi64 " ms, wait %" PRIi64 " ms",
+         drv->disk_label,
+         guestfs_int_timeval_diff (&start_t, &attach_t),
+         guestfs_int_timeval_diff (&attach_t, &end_t));
 
   return 0;
 }
@@ -1018,23 +1036,52 @@ guestfs_impl_add_cdrom (guestfs_h *g, const char *filename)
 int
 guestfs_impl_remove_drive (guestfs_h *g, const char *label)
 {
-  size_t i;
+  char *labels[] = { (char *) label, NULL };
+
+  return guestfs_impl_remove_drives (g, labels);
+}
+
+/**
+ * This function implements L<guestfs(3)/guestfs_remove_drives>.
+ *
+ * When hotplugging, the drives are checked and then waited for
+ * together, so removing several drives costs about the same as
+ * removing one.
+ */
+int
+guestfs_impl_remove_drives (guestfs_h *g, char *const *labels)
+{
+  const size_t nr = guestfs_int_count_strings (labels);
+  CLEANUP_FREE size_t *indexes = NULL;
+  struct timeval start_t, detach_t, end_t;
+  size_t i, j;
   struct drive *drv;
 
-  ITER_DRIVES (g, i, drv) {
-    if (drv->disk_label && STREQ (label, drv->disk_label))
-      goto found;
+  indexes = safe_malloc (g, (nr + 1) * sizeof (size_t));
+  for (j = 0; j < nr; ++j) {
+    ITER_DRIVES (g, i, drv) {
+      if (drv->disk_label && STREQ (labels[j], drv->disk_label))
+        goto found;
+    }
+    error (g, _("disk with label '%s' not found"), labels[j]);
+    return -1;
+  found:
+    indexes[j] = i;
   }
-  error (g, _("disk with label '%s' not found"), label);
-  return -1;
 
- found:
   if (g->state == CONFIG) {     /* Not hotplugging. */
-    free_drive_struct (drv);
-
-    g->nr_drives--;
-    for (; i < g->nr_drives; ++i)
-      g->drives[i] = g->drives[i+1];
+    for (j = 0; j < nr; ++j) {
+      ITER_DRIVES (g, i, drv) {
+        if (drv->disk_label && STREQ (labels[j], drv->disk_label)) {
+          free_drive_struct (drv);
+
+          g->nr_drives--;
+          for (; i < g->nr_drives; ++i)
+            g->drives[i] = g->drives[i+1];
+          break;
+        }
+      }
+    }
 
     return 0;
   }
@@ -1044,19 +1091,39 @@ guestfs_impl_remove_drive (guestfs_h *g, const char *label)
       return -1;
     }
 
-    if (guestfs_internal_hot_remove_drive_precheck (g, label) == -1)
-      return -1;
+    if (nr == 0)
+      return 0;
 
-    if (g->backend_ops->hot_remove_drive (g, g->backend_data, drv, i) == -1)
+    if (guestfs_internal_hot_remove_drives_precheck (g, labels) == -1)
       return -1;
 
-    free_drive_struct (drv);
-    g->drives[i] = NULL;
-    if (i == g->nr_drives-1)
+    gettimeofday (&start_t, NULL);
+    for (j = 0; j < nr; ++j) {
+      i = indexes[j];
+      drv = g->drives[i];
+      if (drv == NULL)          /* label listed twice */
+        continue;
+
+      if (g->backend_ops->hot_remove_drive (g, g->backend_data,
+                                            drv, i) == -1)
+        return -1;
+
+      free_drive_struct (drv);
+      g->drives[i] = NULL;
+    }
+    while (g->nr_drives > 0 && g->drives[g->nr_drives-1] == NULL)
       g->nr_drives--;
+    gettimeofday (&detach_t, NULL);
 
-    if (guestfs_internal_hot_remove_drive (g, label) == -1)
+    if (guestfs_internal_hot_remove_drives (g, labels) == -1)
       return -1;
+    gettimeofday (&end_t, NULL);
+
+    debug (g, "hot-remove: %zu drive(s): detach %" PRIi64 " ms, "
+           "wait %" PRIi64 " ms",
+           nr,
+           guestfs_int_timeval_diff (&start_t, &detach_t),
+           guestfs_int_timeval_diff (&detach_t, &end_t));
 
     return 0;
   }
@@ -28,6 +28,57 @@
 #include "guestfs.h"
 #include "guestfs-internal.h"
 
+/* Buffered log messages are delivered when the buffer would grow
+ * larger than this.
+ */
+#define EVENT_BUFFER_SIZE 16384
+
+/* Event classes which can be buffered by
+ * GUESTFS_EVENT_CALLBACK_BUFFERED.
+ */
+#define BUFFERED_EVENTS (GUESTFS_EVENT_APPLIANCE | GUESTFS_EVENT_LIBRARY)
+
+/* Return the bit number of a single event. */
+static size_t
+event_bit (uint64_t event)
+{
+  size_t b = 0;
+
+  while (b < 63 && (event & 1) == 0) {
+    event >>= 1;
+    b++;
+  }
+  return b;
+}
+
+/* Add the callback to the index of each event class in its bitmask. */
+static void
+index_event_callback (guestfs_h *g, int event_handle)
+{
+  const uint64_t event_bitmask = g->events[event_handle].event_bitmask;
+  size_t b, j;
+
+  for (b = 0; b < 64; ++b) {
+    struct event_index *idx = &g->events_index[b];
+
+    if ((event_bitmask & (UINT64_C(1) << b)) == 0)
+      continue;
+
+    /* The handle may be in the index already if it was deleted and
+     * has been reused.
+     */
+    for (j = 0; j < idx->len; ++j)
+      if (idx->handles[j] == event_handle)
+        break;
+    if (j < idx->len)
+      continue;
+
+    idx->handles = safe_realloc (g, idx->handles,
+                                 (idx->len+1) * sizeof (int));
+    idx->handles[idx->len++] = event_handle;
+  }
+}
+
 int
 guestfs_set_event_callback (guestfs_h *g,
                             guestfs_event_callback cb,
@@ -37,8 +88,8 @@ guestfs_set_event_callback (guestfs_h *g,
 {
   int event_handle;
 
-  if (flags != 0) {
-    error (g, "flags parameter should be passed as 0 to this function");
+  if ((flags & ~GUESTFS_EVENT_CALLBACK_BUFFERED) != 0) {
+    error (g, "flags parameter should be 0 or GUESTFS_EVENT_CALLBACK_BUFFERED");
     return -1;
   }
 
@@ -62,16 +113,63 @@ guestfs_set_event_callback (guestfs_h *g,
   g->events[event_handle].cb = cb;
   g->events[event_handle].opaque = opaque;
   g->events[event_handle].opaque2 = NULL;
+  g->events[event_handle].flags = flags;
+  g->events[event_handle].buffered_event = 0;
+  g->events[event_handle].buf = NULL;
+  g->events[event_handle].buf_len = 0;
+  g->events[event_handle].buf_alloc = 0;
+
+  index_event_callback (g, event_handle);
 
   return event_handle;
 }
 
+/* Deliver the buffered messages of one callback. */
+static void
+flush_event_buffer (guestfs_h *g, int event_handle)
+{
+  struct event *ev = &g->events[event_handle];
+  const uint64_t event = ev->buffered_event;
+  char *buf = ev->buf;
+  const size_t len = ev->buf_len, alloc = ev->buf_alloc;
+
+  if (len == 0)
+    return;
+
+  /* Detach the buffer while the callback runs, since the callback
+   * could raise more events or delete itself.
+   */
+  ev->buf = NULL;
+  ev->buf_len = ev->buf_alloc = 0;
+  ev->buffered_event = 0;
+
+  ev->cb (g, ev->opaque, event, event_handle, 0, buf, len, NULL, 0);
+
+  /* g->events may have been reallocated by the callback. */
+  ev = &g->events[event_handle];
+  if ((size_t) event_handle < g->nr_events && ev->buf == NULL &&
+      ev->event_bitmask != 0) {
+    ev->buf = buf;
+    ev->buf_alloc = alloc;
+  }
+  else
+    free (buf);
+}
+
 void
 guestfs_delete_event_callback (guestfs_h *g, int event_handle)
 {
   if (event_handle < 0 || event_handle >= (int) g->nr_events)
     return;
 
+  /* Don't lose messages which were logged before the callback was
+   * deleted.
+   */
+  flush_event_buffer (g, event_handle);
+  free (g->events[event_handle].buf);
+  g->events[event_handle].buf = NULL;
+  g->events[event_handle].buf_alloc = 0;
+
   /* Set the event_bitmask to 0, which will ensure that this callback
    * cannot match any event and therefore cannot be called.
    */
@@ -87,16 +185,125 @@ guestfs_delete_event_callback (guestfs_h *g, int event_handle)
     g->nr_events--;
 }
 
-/* Functions to generate an event with various payloads. */
+/**
+ * Deliver the log messages held back for all callbacks registered
+ * with C<GUESTFS_EVENT_CALLBACK_BUFFERED>.  This is called at the end
+ * of each call to the daemon, after launch, and before the handle is
+ * closed, so that messages are never delayed for long.
+ */
+void
+guestfs_int_flush_event_buffers (guestfs_h *g)
+{
+  size_t i;
+
+  for (i = 0; i < g->nr_events; ++i)
+    flush_event_buffer (g, i);
+}
 
+/**
+ * Free the event callbacks, when the handle is closed.
+ */
 void
-guestfs_int_call_callbacks_void (guestfs_h *g, uint64_t event)
+guestfs_int_free_events (guestfs_h *g)
 {
   size_t i;
 
   for (i = 0; i < g->nr_events; ++i)
-    if ((g->events[i].event_bitmask & event) != 0)
-      g->events[i].cb (g, g->events[i].opaque, event, i, 0, NULL, 0, NULL, 0);
+    free (g->events[i].buf);
+  free (g->events);
+  g->nr_events = 0;
+  g->events = NULL;
+
+  for (i = 0; i < 64; ++i) {
+    free (g->events_index[i].handles);
+    g->events_index[i].handles = NULL;
+    g->events_index[i].len = 0;
+  }
+}
+
+/* Add a log message to the buffer of a buffered callback. */
+static void
+buffer_message (guestfs_h *g, int event_handle, uint64_t event,
+                const char *buf, size_t buf_len)
+{
+  struct event *ev = &g->events[event_handle];
+  /* Library messages don't end with a newline, so add one to
+   * separate them in the buffer.
+   */
+  const size_t len = buf_len + (event == GUESTFS_EVENT_LIBRARY ? 1 : 0);
+
+  if (ev->buf_len > 0 &&
+      (ev->buffered_event != event || ev->buf_len + len > EVENT_BUFFER_SIZE))
+    flush_event_buffer (g, event_handle);
+
+  ev = &g->events[event_handle];
+  if (ev->event_bitmask == 0)   /* Deleted by the callback. */
+    return;
+
+  /* A message too large for the buffer is passed straight through. */
+  if (len > EVENT_BUFFER_SIZE) {
+    ev->cb (g, ev->opaque, event, event_handle, 0, buf, buf_len, NULL, 0);
+    return;
+  }
+
+  if (ev->buf_alloc < ev->buf_len + len) {
+    ev->buf_alloc = EVENT_BUFFER_SIZE;
+    ev->buf = safe_realloc (g, ev->buf, ev->buf_alloc);
+  }
+  memcpy (ev->buf + ev->buf_len, buf, buf_len);
+  if (event == GUESTFS_EVENT_LIBRARY)
+    ev->buf[ev->buf_len + buf_len] = '\n';
+  ev->buf_len += len;
+  ev->buffered_event = event;
+}
+
+/* Call the callbacks registered for 'event', which is a single event
+ * class.  Returns the number of callbacks called.
+ */
+static size_t
+call_callbacks (guestfs_h *g, uint64_t event,
+                const char *buf, size_t buf_len,
+                const uint64_t *array, size_t array_len)
+{
+  const size_t b = event_bit (event);
+  size_t j, count = 0;
+
+  /* Callbacks may register or delete callbacks, so g->events and the
+   * index must be read again each time around the loop.
+   */
+  for (j = 0; j < g->events_index[b].len; ++j) {
+    const int i = g->events_index[b].handles[j];
+
+    if ((size_t) i >= g->nr_events ||
+        (g->events[i].event_bitmask & event) == 0)
+      continue;
+
+    count++;
+
+    if (g->events[i].flags & GUESTFS_EVENT_CALLBACK_BUFFERED) {
+      if (event & BUFFERED_EVENTS) {
+        buffer_message (g, i, event, buf, buf_len);
+        continue;
+      }
+      /* Keep the messages in order with other events. */
+      flush_event_buffer (g, i);
+      if (g->events[i].event_bitmask == 0)
+        continue;
+    }
+
+    g->events[i].cb (g, g->events[i].opaque, event, i, 0,
+                     buf, buf_len, array, array_len);
+  }
+
+  return count;
+}
+
+/* Functions to generate an event with various payloads. */
+
+void
+guestfs_int_call_callbacks_void (guestfs_h *g, uint64_t event)
+{
+  call_callbacks (g, event, NULL, 0, NULL, 0);
 
   /* All events with payload type void are discarded if no callback
    * was registered.
@@ -107,14 +314,9 @@ void
 guestfs_int_call_callbacks_message (guestfs_h *g, uint64_t event,
 				    const char *buf, size_t buf_len)
 {
-  size_t i, count = 0;
+  size_t i, count;
 
-  for (i = 0; i < g->nr_events; ++i)
-    if ((g->events[i].event_bitmask & event) != 0) {
-      g->events[i].cb (g, g->events[i].opaque, event, i, 0,
-                       buf, buf_len, NULL, 0);
-      count++;
-    }
+  count = call_callbacks (g, event, buf, buf_len, NULL, 0);
 
   /* Emulate the old-style handlers. */
 
@@ -212,12 +414,7 @@ void
 guestfs_int_call_callbacks_array (guestfs_h *g, uint64_t event,
 				  const uint64_t *array, size_t array_len)
 {
-  size_t i;
-
-  for (i = 0; i < g->nr_events; ++i)
-    if ((g->events[i].event_bitmask & event) != 0)
-      g->events[i].cb (g, g->events[i].opaque, event, i, 0,
-                       NULL, 0, array, array_len);
+  call_callbacks (g, event, NULL, 0, array, array_len);
 
   /* All events with payload type array are discarded if no callback
    * was registered.
@@ -267,12 +464,19 @@ replace_old_style_event_callback (guestfs_h *g,
     safe_realloc (g, g->events,
                   (g->nr_events+1) * sizeof (struct event));
   g->nr_events++;
+  g->events[i].flags = 0;
+  g->events[i].buffered_event = 0;
+  g->events[i].buf = NULL;
+  g->events[i].buf_len = 0;
+  g->events[i].buf_alloc = 0;
 
  replace:
   g->events[i].event_bitmask = event_bitmask;
   g->events[i].cb = cb;
   g->events[i].opaque = opaque;
   g->events[i].opaque2 = opaque2;
+
+  index_event_callback (g, i);
 }
 
 static void
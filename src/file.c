@@ -20,16 +20,20 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <string.h>
+#include <rpc/types.h>
+#include <rpc/xdr.h>
 
-#include "full-read.h"
 #include "full-write.h"
 
 #include "guestfs.h"
+#include "guestfs_protocol.h"
 #include "guestfs-internal.h"
 #include "guestfs-internal-actions.h"
 
@@ -80,62 +84,27 @@ guestfs_impl_cat (guestfs_h *g, const char *path)
 char *
 guestfs_impl_read_file (guestfs_h *g, const char *path, size_t *size_r)
 {
-  int fd = -1;
-  size_t size;
-  CLEANUP_UNLINK_FREE char *tmpfile = NULL;
-  char *ret = NULL;
-  struct stat statbuf;
-
-  tmpfile = guestfs_int_make_temp_path (g, "cat");
-  if (tmpfile == NULL)
-    goto err;
-
-  if (guestfs_download (g, path, tmpfile) == -1)
-    goto err;
-
-  fd = open (tmpfile, O_RDONLY|O_CLOEXEC);
-  if (fd == -1) {
-    perrorf (g, "open: %s", tmpfile);
-    goto err;
-  }
-
-  /* Read the whole file into memory. */
-  if (fstat (fd, &statbuf) == -1) {
-    perrorf (g, "stat: %s", tmpfile);
-    goto err;
-  }
+  struct recv_buffer buf = { .data = NULL };
+  int r;
 
-  /* Don't use safe_malloc, because we want to return an errno to the caller. */
-  size = statbuf.st_size;
-  ret = malloc (size + 1);
-  if (!ret) {
-    perrorf (g, "malloc: %zu bytes", size + 1);
-    goto err;
-  }
-
-  if (full_read (fd, ret, size) != size) {
-    perrorf (g, "full-read: %s: %zu bytes", tmpfile, size + 1);
-    goto err;
-  }
-
-  ret[size] = '\0';
-
-  if (close (fd) == -1) {
-    perrorf (g, "close: %s", tmpfile);
-    goto err;
+  /* Receive the file straight into memory (the filename passed to
+   * guestfs_download is ignored).  The buffer is allocated with
+   * malloc, so an allocation failure is returned to the caller with
+   * an errno.
+   */
+  g->recv_buffer = &buf;
+  r = guestfs_download (g, path, "/dev/null");
+  g->recv_buffer = NULL;
+  if (r == -1) {
+    free (buf.data);
+    return NULL;
   }
 
   /* Mustn't touch *size_r until we are sure that we won't return any
    * error (RHBZ#589039).
    */
-  *size_r = size;
-  return ret;
-
- err:
-  free (ret);
-  if (fd >= 0)
-    close (fd);
-  return NULL;
+  *size_r = buf.size;
+  return buf.data;              /* caller frees */
 }
 
 char **
@@ -205,50 +174,19 @@ guestfs_impl_read_lines (guestfs_h *g, const char *file)
 char **
 guestfs_impl_find (guestfs_h *g, const char *directory)
 {
-  int fd = -1;
-  struct stat statbuf;
-  CLEANUP_UNLINK_FREE char *tmpfile = NULL;
+  struct recv_buffer rbuf = { .data = NULL };
   CLEANUP_FREE char *buf = NULL;
   char **ret = NULL;
   size_t i, count, size;
+  int r;
 
-  tmpfile = guestfs_int_make_temp_path (g, "find");
-  if (tmpfile == NULL)
-    goto err;
-
-  if (guestfs_find0 (g, directory, tmpfile) == -1)
+  g->recv_buffer = &rbuf;
+  r = guestfs_find0 (g, directory, "/dev/null");
+  g->recv_buffer = NULL;
+  buf = rbuf.data;
+  if (r == -1)
     goto err;
-
-  fd = open (tmpfile, O_RDONLY|O_CLOEXEC);
-  if (fd == -1) {
-    perrorf (g, "open: %s", tmpfile);
-    goto err;
-  }
-
-  /* Read the whole file into memory. */
-  if (fstat (fd, &statbuf) == -1) {
-    perrorf (g, "stat: %s", tmpfile);
-    goto err;
-  }
-
-  /* Don't use safe_malloc, because we want to return an errno to the caller. */
-  size = statbuf.st_size;
-  buf = malloc (size);
-  if (!buf) {
-    perrorf (g, "malloc: %zu bytes", size);
-    goto err;
-  }
-
-  if (full_read (fd, buf, size) != size) {
-    perrorf (g, "full-read: %s: %zu bytes", tmpfile, size);
-    goto err;
-  }
-
-  if (close (fd) == -1) {
-    perrorf (g, "close: %s", tmpfile);
-    goto err;
-  }
-  fd = -1;
+  size = rbuf.size;
 
   /* 'buf' contains the list of strings, separated (and terminated) by
    * '\0' characters.  Convert this to a list of lines.  Note we
@@ -293,8 +231,6 @@ guestfs_impl_find (guestfs_h *g, const char *directory)
 
  err:
   free (ret);
-  if (fd >= 0)
-    close (fd);
   return NULL;
 }
 
@@ -372,46 +308,115 @@ guestfs_impl_write_append (guestfs_h *g, const char *path,
   return write_or_append (g, path, content, size, 1);
 }
 
+/* The fields of struct guestfs_statns, in the order they are packed
+ * by the daemon in internal_lstatnslist_packed.
+ */
+static const size_t statns_fields[] = {
+  offsetof (struct guestfs_statns, st_dev),
+  offsetof (struct guestfs_statns, st_ino),
+  offsetof (struct guestfs_statns, st_mode),
+  offsetof (struct guestfs_statns, st_nlink),
+  offsetof (struct guestfs_statns, st_uid),
+  offsetof (struct guestfs_statns, st_gid),
+  offsetof (struct guestfs_statns, st_rdev),
+  offsetof (struct guestfs_statns, st_size),
+  offsetof (struct guestfs_statns, st_blksize),
+  offsetof (struct guestfs_statns, st_blocks),
+  offsetof (struct guestfs_statns, st_atime_sec),
+  offsetof (struct guestfs_statns, st_atime_nsec),
+  offsetof (struct guestfs_statns, st_mtime_sec),
+  offsetof (struct guestfs_statns, st_mtime_nsec),
+  offsetof (struct guestfs_statns, st_ctime_sec),
+  offsetof (struct guestfs_statns, st_ctime_nsec),
+  offsetof (struct guestfs_statns, st_spare1),
+  offsetof (struct guestfs_statns, st_spare2),
+  offsetof (struct guestfs_statns, st_spare3),
+  offsetof (struct guestfs_statns, st_spare4),
+  offsetof (struct guestfs_statns, st_spare5),
+  offsetof (struct guestfs_statns, st_spare6),
+};
+
+#define NR_STATNS_FIELDS (sizeof statns_fields / sizeof statns_fields[0])
+
+/* Decode one integer packed by the daemon (see
+ * internal_lstatnslist_packed in generator/actions.ml).  Returns -1
+ * if the buffer ends in the middle of it.
+ */
+static int
+unpack_int64 (const unsigned char **pp, const unsigned char *end,
+              int64_t *v)
+{
+  const unsigned char *p = *pp;
+  uint64_t u = 0;
+  unsigned shift = 0;
+
+  do {
+    if (p == end || shift >= 64)
+      return -1;
+    u |= (uint64_t) (*p & 0x7f) << shift;
+    shift += 7;
+  } while (*p++ & 0x80);
+
+  *v = (int64_t) (u >> 1) ^ -(int64_t) (u & 1);
+  *pp = p;
+  return 0;
+}
+
 #define LSTATNSLIST_MAX 1000
 
 struct guestfs_statns_list *
 guestfs_impl_lstatnslist (guestfs_h *g, const char *dir, char * const*names)
 {
   size_t len = guestfs_int_count_strings (names);
-  size_t old_len;
+  size_t i, j, n;
   struct guestfs_statns_list *ret;
 
   ret = safe_malloc (g, sizeof *ret);
   ret->len = 0;
-  ret->val = NULL;
+  ret->val = safe_malloc (g, (len > 0 ? len : 1) * sizeof (struct guestfs_statns));
 
   while (len > 0) {
-    CLEANUP_FREE_STATNS_LIST struct guestfs_statns_list *stats = NULL;
+    CLEANUP_FREE char *buf = NULL;
+    const unsigned char *p, *end;
+    size_t size;
 
     /* Note we don't need to free up the strings because take_strings
      * does not do a deep copy.
      */
     CLEANUP_FREE char **first = take_strings (g, names, LSTATNSLIST_MAX, &names);
 
-    len = len <= LSTATNSLIST_MAX ? 0 : len - LSTATNSLIST_MAX;
-
-    stats = guestfs_internal_lstatnslist (g, dir, first);
+    n = len <= LSTATNSLIST_MAX ? len : LSTATNSLIST_MAX;
+    len -= n;
 
-    if (stats == NULL) {
+    buf = guestfs_internal_lstatnslist_packed (g, dir, first, &size);
+    if (buf == NULL) {
       guestfs_free_statns_list (ret);
       return NULL;
     }
 
-    /* Append stats to ret. */
-    old_len = ret->len;
-    ret->len += stats->len;
-    ret->val = safe_realloc (g, ret->val,
-                             ret->len * sizeof (struct guestfs_statns));
-    memcpy (&ret->val[old_len], stats->val,
-            stats->len * sizeof (struct guestfs_statns));
+    /* Decode the stats straight into the list being returned. */
+    p = (const unsigned char *) buf;
+    end = p + size;
+    for (i = 0; i < n; ++i) {
+      struct guestfs_statns *st = &ret->val[ret->len];
+
+      for (j = 0; j < NR_STATNS_FIELDS; ++j) {
+        if (unpack_int64 (&p, end,
+                          (int64_t *) ((char *) st + statns_fields[j])) == -1)
+          goto parse_error;
+      }
+      ret->len++;
+    }
+    if (p != end)
+      goto parse_error;
   }
 
   return ret;
+
+ parse_error:
+  error (g, _("lstatnslist: could not parse the reply from the daemon"));
+  guestfs_free_statns_list (ret);
+  return NULL;
 }
 
 #define LXATTRLIST_MAX 1000
@@ -505,50 +510,19 @@ guestfs_impl_readlinklist (guestfs_h *g, const char *dir, char *const *names)
 char **
 guestfs_impl_ls (guestfs_h *g, const char *directory)
 {
-  int fd = -1;
-  struct stat statbuf;
-  CLEANUP_UNLINK_FREE char *tmpfile = NULL;
+  struct recv_buffer rbuf = { .data = NULL };
   CLEANUP_FREE char *buf = NULL;
   char **ret = NULL;
   size_t i, count, size;
+  int r;
 
-  tmpfile = guestfs_int_make_temp_path (g, "ls");
-  if (tmpfile == NULL)
-    goto err;
-
-  if (guestfs_ls0 (g, directory, tmpfile) == -1)
+  g->recv_buffer = &rbuf;
+  r = guestfs_ls0 (g, directory, "/dev/null");
+  g->recv_buffer = NULL;
+  buf = rbuf.data;
+  if (r == -1)
     goto err;
-
-  fd = open (tmpfile, O_RDONLY|O_CLOEXEC);
-  if (fd == -1) {
-    perrorf (g, "open: %s", tmpfile);
-    goto err;
-  }
-
-  /* Read the whole file into memory. */
-  if (fstat (fd, &statbuf) == -1) {
-    perrorf (g, "stat: %s", tmpfile);
-    goto err;
-  }
-
-  /* Don't use safe_malloc, because we want to return an errno to the caller. */
-  size = statbuf.st_size;
-  buf = malloc (size);
-  if (!buf) {
-    perrorf (g, "malloc: %zu bytes", size);
-    goto err;
-  }
-
-  if (full_read (fd, buf, size) != size) {
-    perrorf (g, "full-read: %s: %zu bytes", tmpfile, size);
-    goto err;
-  }
-
-  if (close (fd) == -1) {
-    perrorf (g, "close: %s", tmpfile);
-    goto err;
-  }
-  fd = -1;
+  size = rbuf.size;
 
   /* 'buf' contains the list of strings, separated (and terminated) by
    * '\0' characters.  Convert this to a list of lines.  Note we
@@ -592,11 +566,99 @@ guestfs_impl_ls (guestfs_h *g, const char *directory)
 
  err:
   free (ret);
-  if (fd >= 0)
-    close (fd);
   return NULL;
 }
 
+/* The entries sent by the daemon for internal_readdir are a stream
+ * of XDR-encoded guestfs_int_dirent structures.  They are decoded as
+ * each chunk arrives, so only the list being returned and a partial
+ * entry at the end of a chunk are held in memory.
+ */
+struct readdir_stream {
+  struct guestfs_dirent_list *list;
+  size_t alloc;
+  char *pending;                /* Undecoded bytes. */
+  size_t pending_len;
+  size_t pending_alloc;
+};
+
+static int
+readdir_chunk_cb (guestfs_h *g, const char *buf, size_t len, void *rsv)
+{
+  struct readdir_stream *rs = rsv;
+  guestfs_int_dirent d;
+  XDR xdr;
+  size_t pos = 0;
+
+  if (rs->pending_len + len > rs->pending_alloc) {
+    rs->pending_alloc = MAX (rs->pending_len + len, 2 * rs->pending_alloc);
+    rs->pending = safe_realloc (g, rs->pending, rs->pending_alloc);
+  }
+  memcpy (&rs->pending[rs->pending_len], buf, len);
+  rs->pending_len += len;
+
+  xdrmem_create (&xdr, rs->pending, rs->pending_len, XDR_DECODE);
+  while (pos < rs->pending_len) {
+    /* Clear the entry so xdr logic will allocate necessary memory. */
+    memset (&d, 0, sizeof d);
+    if (!xdr_guestfs_int_dirent (&xdr, &d)) {
+      /* Probably the entry continues in the next chunk. */
+      xdr_free ((xdrproc_t) xdr_guestfs_int_dirent, (char *) &d);
+      break;
+    }
+    pos = xdr_getpos (&xdr);
+
+    if (rs->list->len == rs->alloc) {
+      rs->alloc = rs->alloc > 0 ? 2 * rs->alloc : 64;
+      rs->list->val = safe_realloc (g, rs->list->val,
+                                    rs->alloc * sizeof (*rs->list->val));
+    }
+    /* The list takes ownership of the name. */
+    rs->list->val[rs->list->len].name = d.name;
+    rs->list->val[rs->list->len].ino = d.ino;
+    rs->list->val[rs->list->len].ftyp = d.ftyp;
+    rs->list->len++;
+  }
+  xdr_destroy (&xdr);
+
+  memmove (rs->pending, &rs->pending[pos], rs->pending_len - pos);
+  rs->pending_len -= pos;
+
+  return 0;
+}
+
+struct guestfs_dirent_list *
+guestfs_impl_readdir (guestfs_h *g, const char *dir)
+{
+  struct readdir_stream rs = { .alloc = 0, .pending = NULL };
+  struct recv_buffer rbuf = {
+    .data = NULL, .chunk_cb = readdir_chunk_cb, .opaque = &rs
+  };
+  int r;
+
+  rs.list = safe_calloc (g, 1, sizeof (*rs.list));
+
+  /* The entries are passed to the callback, the filename is ignored. */
+  g->recv_buffer = &rbuf;
+  r = guestfs_internal_readdir (g, dir, "/dev/null");
+  g->recv_buffer = NULL;
+
+  if (r == 0 && rs.pending_len > 0) {
+    error (g, _("failed to parse directory entries from the daemon: %zu bytes left over"),
+           rs.pending_len);
+    r = -1;
+  }
+
+  free (rs.pending);
+
+  if (r == -1) {
+    guestfs_free_dirent_list (rs.list);
+    return NULL;
+  }
+
+  return rs.list;               /* caller frees */
+}
+
 static void
 statns_to_old_stat (struct guestfs_statns *a, struct guestfs_stat *r)
 {
@@ -120,14 +120,6 @@ canonical_elf_arch (guestfs_h *g,
   return ret;
 }
 
-static int
-is_regular_file (const char *filename)
-{
-  struct stat statbuf;
-
-  return lstat (filename, &statbuf) == 0 && S_ISREG (statbuf.st_mode);
-}
-
 static char *
 magic_for_file (guestfs_h *g, const char *filename, bool *loading_ok,
                 bool *matched)
@@ -178,99 +170,6 @@ magic_for_file (guestfs_h *g, const char *filename, bool *loading_ok,
   return canonical_elf_arch (g, bits, endianness, elf_arch);
 }
 
-/* Download and uncompress the cpio file to find binaries within. */
-static const char *initrd_binaries[] = {
-  "bin/ls",
-  "bin/rm",
-  "bin/modprobe",
-  "sbin/modprobe",
-  "bin/sh",
-  "bin/bash",
-  "bin/dash",
-  "bin/nash",
-  NULL
-};
-
-static char *
-cpio_arch (guestfs_h *g, const char *file, const char *path)
-{
-  CLEANUP_FREE char *tmpdir = guestfs_get_tmpdir (g), *dir = NULL;
-  CLEANUP_FREE char *initrd = NULL;
-  CLEANUP_CMD_CLOSE struct command *cmd = guestfs_int_new_command (g);
-  char *ret = NULL;
-  const char *method;
-  int64_t size;
-  int r;
-  size_t i;
-
-  if (asprintf (&dir, "%s/libguestfsXXXXXX", tmpdir) == -1) {
-    perrorf (g, "asprintf");
-    return NULL;
-  }
-
-  if (strstr (file, "gzip"))
-    method = "zcat";
-  else if (strstr (file, "bzip2"))
-    method = "bzcat";
-  else
-    method = "cat";
-
-  /* Security: Refuse to download initrd if it is huge. */
-  size = guestfs_filesize (g, path);
-  if (size == -1 || size > 100000000) {
-    error (g, _("size of %s unreasonable (%" PRIi64 " bytes)"),
-           path, size);
-    goto out;
-  }
-
-  if (mkdtemp (dir) == NULL) {
-    perrorf (g, "mkdtemp");
-    goto out;
-  }
-
-  initrd = safe_asprintf (g, "%s/initrd", dir);
-  if (guestfs_download (g, path, initrd) == -1)
-    goto out;
-
-  /* Construct a command to extract named binaries from the initrd file. */
-  guestfs_int_cmd_add_string_unquoted (cmd, "cd ");
-  guestfs_int_cmd_add_string_quoted   (cmd, dir);
-  guestfs_int_cmd_add_string_unquoted (cmd, " && ");
-  guestfs_int_cmd_add_string_unquoted (cmd, method);
-  guestfs_int_cmd_add_string_unquoted (cmd, " initrd | cpio --quiet -id");
-  for (i = 0; initrd_binaries[i] != NULL; ++i) {
-    guestfs_int_cmd_add_string_unquoted (cmd, " ");
-    guestfs_int_cmd_add_string_quoted (cmd, initrd_binaries[i]);
-  }
-
-  r = guestfs_int_cmd_run (cmd);
-  if (r == -1)
-    goto out;
-  if (!WIFEXITED (r) || WEXITSTATUS (r) != 0) {
-    guestfs_int_external_command_failed (g, r, "cpio", path);
-    goto out;
-  }
-
-  for (i = 0; initrd_binaries[i] != NULL; ++i) {
-    CLEANUP_FREE char *bin =
-      safe_asprintf (g, "%s/%s", dir, initrd_binaries[i]);
-
-    if (is_regular_file (bin)) {
-      bool loading_ok, matched;
-
-      ret = magic_for_file (g, bin, &loading_ok, &matched);
-      if (!loading_ok || matched)
-        goto out;
-    }
-  }
-  error (g, "file_architecture: could not determine architecture of cpio archive");
-
- out:
-  guestfs_int_recursive_remove_dir (g, dir);
-
-  return ret;
-}
-
 static char *
 compressed_file_arch (guestfs_h *g, const char *path, const char *method)
 {
@@ -354,7 +253,10 @@ guestfs_impl_file_architecture (guestfs_h *g, const char *path)
   else if (strstr (file, "PE32+ executable"))
     ret = safe_strdup (g, "x86_64");
   else if (strstr (file, "cpio archive"))
-    ret = cpio_arch (g, file, path);
+    /* The appliance finds the binaries in the initrd, which saves
+     * downloading the whole of it.
+     */
+    ret = guestfs_internal_initrd_arch (g, path);
   else if (strstr (file, "gzip compressed data"))
     ret = compressed_file_arch (g, path, "zcat");
   else if (strstr (file, "XZ compressed data"))
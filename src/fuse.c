@@ -27,6 +27,9 @@
 #include <string.h>
 #include <libintl.h>
 #include <sys/sysmacros.h>
+#include <sys/stat.h>
+#include <rpc/types.h>
+#include <rpc/xdr.h>
 
 #if HAVE_FUSE
 /* See <attr/xattr.h> */
@@ -44,8 +47,10 @@
 #include "glthread/lock.h"
 #include "hash.h"
 #include "hash-pjw.h"
+#include "ignore-value.h"
 
 #include "guestfs.h"
+#include "guestfs_protocol.h"
 #include "guestfs-internal.h"
 #include "guestfs-internal-actions.h"
 
@@ -56,12 +61,38 @@ static int init_dir_caches (guestfs_h *);
 static void free_dir_caches (guestfs_h *);
 static void dir_cache_remove_all_expired (guestfs_h *, time_t now);
 static void dir_cache_invalidate (guestfs_h *, const char *path);
+static void statvfs_cache_invalidate (guestfs_h *);
 static int lsc_insert (guestfs_h *, const char *path, const char *name, time_t now, struct stat const *statbuf);
 static int xac_insert (guestfs_h *, const char *path, const char *name, time_t now, struct guestfs_xattr_list *xattrs);
 static int rlc_insert (guestfs_h *, const char *path, const char *name, time_t now, char *link);
 static const struct stat *lsc_lookup (guestfs_h *, const char *pathname);
+static int nec_insert (guestfs_h *, const char *pathname, time_t now);
+static bool nec_lookup (guestfs_h *, const char *pathname);
 static const struct guestfs_xattr_list *xac_lookup (guestfs_h *, const char *pathname);
 static const char *rlc_lookup (guestfs_h *, const char *pathname);
+static int readdir_from_cache (guestfs_h *, const char *path, void *buf, fuse_fill_dir_t filler);
+static int prefetch_tree (guestfs_h *, const char *path, time_t now);
+static void dir_cache_invalidate_tree (guestfs_h *, const char *path);
+
+/* Functions handling write-back. */
+static int wb_flush_path (guestfs_h *, const char *path);
+static int wb_flush_all (guestfs_h *);
+
+/* Functions handling the block cache. */
+#define BLC_BLOCK_SIZE (128 * 1024)
+#define BLC_MAX_BLOCKS 256      /* 32 MB */
+
+/* Largest single read from the appliance, in blocks.  See the
+ * comment about the protocol limit in mount_local_read.
+ */
+#define BLC_MAX_READ_BLOCKS 16
+
+static int blc_read (guestfs_h *, const char *path, char *buf, size_t size, off_t offset, size_t readahead);
+
+/* statfs results are cached for this long (but no longer than the
+ * cache timeout), or until the filesystem is changed.
+ */
+#define STATFS_CACHE_TIMEOUT 2  /* seconds */
 
 /* This lock protects access to g->localmountpoint. */
 gl_lock_define_initialized (static, mount_local_lock);
@@ -87,34 +118,77 @@ gl_lock_define_initialized (static, mount_local_lock);
     return -ret_errno;							\
   } while (0)
 
-static struct guestfs_xattr_list *
-copy_xattr_list (guestfs_h *g, const struct guestfs_xattr *first, size_t num)
+/* In multi-threaded mode FUSE calls the operations from several
+ * threads at once, but the handle and the caches may only be used by
+ * one thread at a time.  Each operation therefore takes a turn,
+ * handed out strictly in order (a ticket lock), and holds it until
+ * it returns.  Operations which have to wait for the appliance give
+ * up their turn between sending the request and collecting the
+ * reply (see ml_yield), so the other threads can queue up their own
+ * requests in the meantime.
+ */
+static void
+ml_enter (guestfs_h *g)
 {
-  struct guestfs_xattr_list *xattrs;
-  size_t i;
+  unsigned ticket;
 
-  xattrs = malloc (sizeof *xattrs);
-  if (xattrs == NULL) {
-    perrorf (g, "malloc");
-    return NULL;
-  }
+  pthread_mutex_lock (&g->ml_lock);
+  ticket = g->ml_next_ticket++;
+  while (ticket != g->ml_now_serving)
+    pthread_cond_wait (&g->ml_cond, &g->ml_lock);
+  pthread_mutex_unlock (&g->ml_lock);
+}
 
-  xattrs->len = num;
-  xattrs->val = malloc (num * sizeof (struct guestfs_xattr));
-  if (xattrs->val == NULL) {
-    perrorf (g, "malloc");
-    free (xattrs);
-    return NULL;
-  }
+static void
+ml_leave (guestfs_h *g)
+{
+  pthread_mutex_lock (&g->ml_lock);
+  g->ml_now_serving++;
+  pthread_cond_broadcast (&g->ml_cond);
+  pthread_mutex_unlock (&g->ml_lock);
+}
 
-  for (i = 0; i < num; ++i) {
-    xattrs->val[i].attrname = strdup (first[i].attrname);
-    xattrs->val[i].attrval_len = first[i].attrval_len;
-    xattrs->val[i].attrval = malloc (first[i].attrval_len);
-    memcpy (xattrs->val[i].attrval, first[i].attrval, first[i].attrval_len);
+/* Let every thread which is waiting for a turn go first.  This is
+ * called after submitting a request with guestfs_submit_*, and
+ * before collecting the reply with guestfs_wait_*.  Anything looked
+ * up in the caches before this call may have been freed by the time
+ * it returns.
+ */
+static void
+ml_yield (guestfs_h *g)
+{
+  if (g->ml_multithreaded) {
+    ml_leave (g);
+    ml_enter (g);
   }
+}
 
-  return xattrs;
+static void
+statns_to_stat (const struct guestfs_statns *r, struct stat *statbuf)
+{
+  memset (statbuf, 0, sizeof *statbuf);
+  statbuf->st_dev = r->st_dev;
+  statbuf->st_ino = r->st_ino;
+  statbuf->st_mode = r->st_mode;
+  statbuf->st_nlink = r->st_nlink;
+  statbuf->st_uid = r->st_uid;
+  statbuf->st_gid = r->st_gid;
+  statbuf->st_rdev = r->st_rdev;
+  statbuf->st_size = r->st_size;
+  statbuf->st_blksize = r->st_blksize;
+  statbuf->st_blocks = r->st_blocks;
+  statbuf->st_atime = r->st_atime_sec;
+#ifdef HAVE_STRUCT_STAT_ST_ATIM_TV_NSEC
+  statbuf->st_atim.tv_nsec = r->st_atime_nsec;
+#endif
+  statbuf->st_mtime = r->st_mtime_sec;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+  statbuf->st_mtim.tv_nsec = r->st_mtime_nsec;
+#endif
+  statbuf->st_ctime = r->st_ctime_sec;
+#ifdef HAVE_STRUCT_STAT_ST_CTIM_TV_NSEC
+  statbuf->st_ctim.tv_nsec = r->st_ctime_nsec;
+#endif
 }
 
 static int
@@ -123,7 +197,7 @@ mount_local_readdir (const char *path, void *buf, fuse_fill_dir_t filler,
 {
   time_t now;
   size_t i;
-  char **names;
+  int r;
   CLEANUP_FREE_DIRENT_LIST struct guestfs_dirent_list *ents = NULL;
   DECL_G ();
   DEBUG_CALL ("%s, %p, %ld", path, buf, (long) offset);
@@ -132,6 +206,21 @@ mount_local_readdir (const char *path, void *buf, fuse_fill_dir_t filler,
 
   dir_cache_remove_all_expired (g, now);
 
+  /* Pending writes would make the file sizes we cache below wrong. */
+  if (wb_flush_all (g) == -1)
+    RETURN_ERRNO;
+
+  /* The listing may be cached already, from an earlier readdir or
+   * (with prefetching) when the tree of a parent directory was
+   * fetched.  Otherwise fetch it now, together with the attributes of
+   * the entries, in one call.
+   */
+  r = readdir_from_cache (g, path, buf, filler);
+  if (r == 0 && prefetch_tree (g, path, now) == 0)
+    r = readdir_from_cache (g, path, buf, filler);
+  if (r == 1)
+    return 0;
+
   ents = guestfs_readdir (g, path);
   if (ents == NULL)
     RETURN_ERRNO;
@@ -162,94 +251,6 @@ mount_local_readdir (const char *path, void *buf, fuse_fill_dir_t filler,
       break;
   }
 
-  /* Now prepopulate the directory caches.  This step is just an
-   * optimization, don't worry if it fails.
-   */
-  names = malloc ((ents->len + 1) * sizeof (char *));
-  if (names) {
-    CLEANUP_FREE_STATNS_LIST struct guestfs_statns_list *ss = NULL;
-    CLEANUP_FREE_XATTR_LIST struct guestfs_xattr_list *xattrs = NULL;
-    char **links;
-
-    for (i = 0; i < ents->len; ++i)
-      names[i] = ents->val[i].name;
-    names[i] = NULL;
-
-    ss = guestfs_lstatnslist (g, path, names);
-    if (ss) {
-      for (i = 0; i < ss->len; ++i) {
-        if (ss->val[i].st_ino >= 0) {
-          struct stat statbuf;
-
-          memset (&statbuf, 0, sizeof statbuf);
-          statbuf.st_dev = ss->val[i].st_dev;
-          statbuf.st_ino = ss->val[i].st_ino;
-          statbuf.st_mode = ss->val[i].st_mode;
-          statbuf.st_nlink = ss->val[i].st_nlink;
-          statbuf.st_uid = ss->val[i].st_uid;
-          statbuf.st_gid = ss->val[i].st_gid;
-          statbuf.st_rdev = ss->val[i].st_rdev;
-          statbuf.st_size = ss->val[i].st_size;
-          statbuf.st_blksize = ss->val[i].st_blksize;
-          statbuf.st_blocks = ss->val[i].st_blocks;
-          statbuf.st_atime = ss->val[i].st_atime_sec;
-#ifdef HAVE_STRUCT_STAT_ST_ATIM_TV_NSEC
-          statbuf.st_atim.tv_nsec = ss->val[i].st_atime_nsec;
-#endif
-          statbuf.st_mtime = ss->val[i].st_mtime_sec;
-#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
-          statbuf.st_mtim.tv_nsec = ss->val[i].st_mtime_nsec;
-#endif
-          statbuf.st_ctime = ss->val[i].st_ctime_sec;
-#ifdef HAVE_STRUCT_STAT_ST_CTIM_TV_NSEC
-          statbuf.st_ctim.tv_nsec = ss->val[i].st_ctime_nsec;
-#endif
-
-          lsc_insert (g, path, names[i], now, &statbuf);
-        }
-      }
-    }
-
-    xattrs = guestfs_lxattrlist (g, path, names);
-    if (xattrs) {
-      size_t ni, num;
-      struct guestfs_xattr *first;
-      struct guestfs_xattr_list *copy;
-
-      for (i = 0, ni = 0; i < xattrs->len; ++i, ++ni) {
-        /* assert (strlen (xattrs->val[i].attrname) == 0); */
-        if (xattrs->val[i].attrval_len > 0) {
-          ++i;
-          first = &xattrs->val[i];
-          num = 0;
-          for (; i < xattrs->len && strlen (xattrs->val[i].attrname) > 0; ++i)
-            num++;
-
-          copy = copy_xattr_list (g, first, num);
-          if (copy)
-            xac_insert (g, path, names[ni], now, copy);
-
-          i--;
-        }
-      }
-    }
-
-    links = guestfs_readlinklist (g, path, names);
-    if (links) {
-      for (i = 0; names[i] != NULL; ++i) {
-        if (links[i][0])
-          /* Note that rlc_insert owns the string links[i] after this, */
-          rlc_insert (g, path, names[i], now, links[i]);
-        else
-          /* which is why we have to free links[i] here. */
-          free (links[i]);
-      }
-      free (links);             /* free the array, not the strings */
-    }
-
-    free (names);
-  }
-
   return 0;
 }
 
@@ -258,42 +259,42 @@ mount_local_getattr (const char *path, struct stat *statbuf)
 {
   const struct stat *buf;
   CLEANUP_FREE_STAT struct guestfs_statns *r = NULL;
+  int serial;
+  unsigned generation;
   DECL_G ();
   DEBUG_CALL ("%s, %p", path, statbuf);
 
+  if (wb_flush_path (g, path) == -1)
+    RETURN_ERRNO;
+
   buf = lsc_lookup (g, path);
   if (buf) {
     memcpy (statbuf, buf, sizeof *statbuf);
     return 0;
   }
+  if (nec_lookup (g, path))
+    return -ENOENT;
 
-  r = guestfs_lstatns (g, path);
-  if (r == NULL)
+  generation = g->ml_generation;
+  serial = guestfs_submit_lstatns (g, path);
+  if (serial == -1)
     RETURN_ERRNO;
+  ml_yield (g);
+  r = guestfs_wait_lstatns (g, serial);
+  if (r == NULL) {
+    /* Remember that the path does not exist, unless another thread
+     * changed the filesystem while we were waiting.
+     */
+    if (guestfs_last_errno (g) == ENOENT && generation == g->ml_generation) {
+      time_t now;
 
-  memset (statbuf, 0, sizeof *statbuf);
-  statbuf->st_dev = r->st_dev;
-  statbuf->st_ino = r->st_ino;
-  statbuf->st_mode = r->st_mode;
-  statbuf->st_nlink = r->st_nlink;
-  statbuf->st_uid = r->st_uid;
-  statbuf->st_gid = r->st_gid;
-  statbuf->st_rdev = r->st_rdev;
-  statbuf->st_size = r->st_size;
-  statbuf->st_blksize = r->st_blksize;
-  statbuf->st_blocks = r->st_blocks;
-  statbuf->st_atime = r->st_atime_sec;
-#ifdef HAVE_STRUCT_STAT_ST_ATIM_TV_NSEC
-  statbuf->st_atim.tv_nsec = r->st_atime_nsec;
-#endif
-  statbuf->st_mtime = r->st_mtime_sec;
-#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
-  statbuf->st_mtim.tv_nsec = r->st_mtime_nsec;
-#endif
-  statbuf->st_ctime = r->st_ctime_sec;
-#ifdef HAVE_STRUCT_STAT_ST_CTIM_TV_NSEC
-  statbuf->st_ctim.tv_nsec = r->st_ctime_nsec;
-#endif
+      time (&now);
+      nec_insert (g, path, now);
+    }
+    RETURN_ERRNO;
+  }
+
+  statns_to_stat (r, statbuf);
 
   return 0;
 }
@@ -369,12 +370,17 @@ mount_local_readlink (const char *path, char *buf, size_t size)
   const char *r;
   int free_it = 0;
   size_t len;
+  int serial;
   DECL_G ();
   DEBUG_CALL ("%s, %p, %zu", path, buf, size);
 
   r = rlc_lookup (g, path);
   if (!r) {
-    r = guestfs_readlink (g, path);
+    serial = guestfs_submit_readlink (g, path);
+    if (serial == -1)
+      RETURN_ERRNO;
+    ml_yield (g);
+    r = guestfs_wait_readlink (g, serial);
     if (r == NULL)
       RETURN_ERRNO;
     free_it = 1;
@@ -443,6 +449,9 @@ mount_local_unlink (const char *path)
 
   if (g->ml_read_only) return -EROFS;
 
+  if (wb_flush_path (g, path) == -1)
+    RETURN_ERRNO;
+
   dir_cache_invalidate (g, path);
 
   r = guestfs_rm (g, path);
@@ -497,6 +506,10 @@ mount_local_rename (const char *from, const char *to)
 
   if (g->ml_read_only) return -EROFS;
 
+  if (wb_flush_path (g, from) == -1 || wb_flush_path (g, to) == -1)
+    RETURN_ERRNO;
+
+  dir_cache_invalidate_tree (g, from);
   dir_cache_invalidate (g, from);
   dir_cache_invalidate (g, to);
 
@@ -516,6 +529,9 @@ mount_local_link (const char *from, const char *to)
 
   if (g->ml_read_only) return -EROFS;
 
+  if (wb_flush_path (g, from) == -1)
+    RETURN_ERRNO;
+
   dir_cache_invalidate (g, from);
   dir_cache_invalidate (g, to);
 
@@ -571,6 +587,9 @@ mount_local_truncate (const char *path, off_t size)
 
   if (g->ml_read_only) return -EROFS;
 
+  if (wb_flush_path (g, path) == -1)
+    RETURN_ERRNO;
+
   dir_cache_invalidate (g, path);
 
   r = guestfs_truncate_size (g, path, size);
@@ -592,6 +611,10 @@ mount_local_utimens (const char *path, const struct timespec ts[2])
 
   if (g->ml_read_only) return -EROFS;
 
+  /* Flush first, else the write would update the mtime again. */
+  if (wb_flush_path (g, path) == -1)
+    RETURN_ERRNO;
+
   dir_cache_invalidate (g, path);
 
   atsecs = ts[0].tv_sec;
@@ -623,19 +646,194 @@ mount_local_utimens (const char *path, const struct timespec ts[2])
   return 0;
 }
 
-/* All this function needs to do is to check that the requested open
- * flags are valid.  See the notes in <fuse/fuse.h>.
+/* Per-open-file state, stored in fi->fh, used to detect sequential
+ * reads and (in write-back mode) to hold pending writes.
+ */
+struct ml_file {
+  off_t next_offset;            /* offset a sequential read would use */
+  size_t readahead;             /* current readahead window, in blocks */
+
+  /* Pending writes.  If wb_len > 0, this file is on the
+   * g->ml_dirty_files list.
+   */
+  struct ml_file *wb_next;
+  char *wb_path;                /* path the data was written to */
+  char *wb_buf;                 /* WB_MAX_SIZE bytes, allocated on demand */
+  size_t wb_len;
+  off_t wb_offset;              /* offset of wb_buf in the file */
+  time_t wb_time;               /* time of the first pending write */
+};
+
+/* Limits on how much data is held back, and for how long, before
+ * it is written to the appliance.  The size limit is the protocol
+ * limit mentioned in mount_local_read.
+ */
+#define WB_MAX_SIZE (2 * 1024 * 1024)
+#define WB_MAX_AGE 5            /* seconds */
+
+/* Write out the pending data of 'file'.  Returns -1 (with the error
+ * set in the handle) on failure, in which case the data is lost.
+ */
+static int
+wb_flush (guestfs_h *g, struct ml_file *file)
+{
+  struct ml_file **pp;
+  size_t done = 0;
+  int r = 0;
+
+  if (file->wb_len == 0)
+    return 0;
+
+  for (pp = &g->ml_dirty_files; *pp != NULL; pp = &(*pp)->wb_next) {
+    if (*pp == file) {
+      *pp = file->wb_next;
+      break;
+    }
+  }
+  file->wb_next = NULL;
+
+  dir_cache_invalidate (g, file->wb_path);
+
+  /* guestfs_pwrite may write less than requested. */
+  while (done < file->wb_len) {
+    r = guestfs_pwrite (g, file->wb_path,
+                        file->wb_buf + done, file->wb_len - done,
+                        file->wb_offset + done);
+    if (r <= 0) {
+      r = -1;
+      break;
+    }
+    done += r;
+  }
+
+  file->wb_len = 0;
+  free (file->wb_path);
+  file->wb_path = NULL;
+
+  return r == -1 ? -1 : 0;
+}
+
+/* Flush every file with pending writes to 'path'. */
+static int
+wb_flush_path (guestfs_h *g, const char *path)
+{
+  struct ml_file *file, *next;
+  int r = 0;
+
+  for (file = g->ml_dirty_files; file != NULL; file = next) {
+    next = file->wb_next;
+    if (STREQ (file->wb_path, path) && wb_flush (g, file) == -1)
+      r = -1;
+  }
+
+  return r;
+}
+
+static int
+wb_flush_all (guestfs_h *g)
+{
+  int r = 0;
+
+  while (g->ml_dirty_files) {
+    if (wb_flush (g, g->ml_dirty_files) == -1)
+      r = -1;
+  }
+
+  return r;
+}
+
+/* Flush files whose pending writes are older than WB_MAX_AGE.
+ * Since the FUSE main loop has no timers, this is done on each write.
+ */
+static int
+wb_flush_expired (guestfs_h *g, time_t now)
+{
+  struct ml_file *file, *next;
+  int r = 0;
+
+  for (file = g->ml_dirty_files; file != NULL; file = next) {
+    next = file->wb_next;
+    if (now - file->wb_time >= WB_MAX_AGE && wb_flush (g, file) == -1)
+      r = -1;
+  }
+
+  return r;
+}
+
+/* Add a write to the pending data of 'file', if it extends it.
+ * Returns 1 if the write was buffered, 0 if it must be written
+ * directly, or -1 on error.
+ */
+static int
+wb_write (guestfs_h *g, struct ml_file *file, const char *path,
+          const char *buf, size_t size, off_t offset)
+{
+  time_t now;
+
+  time (&now);
+
+  if (file->wb_len > 0 &&
+      (STRNEQ (file->wb_path, path) ||
+       offset != file->wb_offset + (off_t) file->wb_len ||
+       file->wb_len + size > WB_MAX_SIZE)) {
+    if (wb_flush (g, file) == -1)
+      return -1;
+  }
+
+  if (wb_flush_expired (g, now) == -1)
+    return -1;
+
+  if (size >= WB_MAX_SIZE)
+    return 0;
+
+  if (file->wb_buf == NULL) {
+    file->wb_buf = malloc (WB_MAX_SIZE);
+    if (file->wb_buf == NULL) {
+      perrorf (g, "malloc");
+      return -1;
+    }
+  }
+
+  if (file->wb_len == 0) {
+    file->wb_path = strdup (path);
+    if (file->wb_path == NULL) {
+      perrorf (g, "strdup");
+      return -1;
+    }
+    file->wb_offset = offset;
+    file->wb_time = now;
+    file->wb_next = g->ml_dirty_files;
+    g->ml_dirty_files = file;
+  }
+
+  memcpy (file->wb_buf + file->wb_len, buf, size);
+  file->wb_len += size;
+
+  if (file->wb_len == WB_MAX_SIZE && wb_flush (g, file) == -1)
+    return -1;
+
+  return 1;
+}
+
+/* Check that the requested open flags are valid (see the notes in
+ * <fuse/fuse.h>), and set up the readahead state.
  */
 static int
 mount_local_open (const char *path, struct fuse_file_info *fi)
 {
   const int flags = fi->flags & O_ACCMODE;
+  struct ml_file *file;
   DECL_G ();
   DEBUG_CALL ("%s, 0%o", path, (unsigned) fi->flags);
 
   if (g->ml_read_only && flags != O_RDONLY)
     return -EROFS;
 
+  file = calloc (1, sizeof *file);
+  if (file == NULL)
+    return -ENOMEM;
+  fi->fh = (uintptr_t) file;
+
   return 0;
 }
 
@@ -643,8 +841,9 @@ static int
 mount_local_read (const char *path, char *buf, size_t size, off_t offset,
                   struct fuse_file_info *fi)
 {
-  char *r;
-  size_t rsize;
+  struct ml_file *file = (struct ml_file *) (uintptr_t) fi->fh;
+  size_t readahead = 0;
+  int r;
   const size_t limit = 2 * 1024 * 1024;
   DECL_G ();
   DEBUG_CALL ("%s, %p, %zu, %ld", path, buf, size, (long) offset);
@@ -656,26 +855,36 @@ mount_local_read (const char *path, char *buf, size_t size, off_t offset,
   if (size > limit)
     size = limit;
 
-  r = guestfs_pread (g, path, size, offset, &rsize);
-  if (r == NULL)
-    RETURN_ERRNO;
-
-  /* This should never happen, but at least it stops us overflowing
-   * the output buffer if it does happen.
+  /* If this read continues where the last one on this file handle
+   * stopped, grow the readahead window, otherwise drop it.
    */
-  if (rsize > size)
-    rsize = size;
+  if (file) {
+    if (offset == file->next_offset) {
+      file->readahead = file->readahead ? file->readahead * 2 : 1;
+      if (file->readahead > BLC_MAX_READ_BLOCKS)
+        file->readahead = BLC_MAX_READ_BLOCKS;
+    }
+    else
+      file->readahead = 0;
+    file->next_offset = offset + size;
+    readahead = file->readahead;
+  }
+
+  if (wb_flush_path (g, path) == -1)
+    RETURN_ERRNO;
 
-  memcpy (buf, r, rsize);
-  free (r);
+  r = blc_read (g, path, buf, size, offset, readahead);
+  if (r == -1)
+    RETURN_ERRNO;
 
-  return rsize;
+  return r;
 }
 
 static int
 mount_local_write (const char *path, const char *buf, size_t size,
                    off_t offset, struct fuse_file_info *fi)
 {
+  struct ml_file *file = (struct ml_file *) (uintptr_t) fi->fh;
   const size_t limit = 2 * 1024 * 1024;
   int r;
   DECL_G ();
@@ -683,12 +892,23 @@ mount_local_write (const char *path, const char *buf, size_t size,
 
   if (g->ml_read_only) return -EROFS;
 
-  dir_cache_invalidate (g, path);
-
   /* See mount_local_read. */
   if (size > limit)
     size = limit;
 
+  /* In write-back mode, adjacent writes are coalesced and written
+   * out later (see wb_write above).
+   */
+  if (g->ml_writeback && file) {
+    r = wb_write (g, file, path, buf, size, offset);
+    if (r == -1)
+      RETURN_ERRNO;
+    if (r == 1)
+      return size;
+  }
+
+  dir_cache_invalidate (g, path);
+
   r = guestfs_pwrite (g, path, buf, size, offset);
   if (r == -1)
     RETURN_ERRNO;
@@ -699,14 +919,31 @@ mount_local_write (const char *path, const char *buf, size_t size,
 static int
 mount_local_statfs (const char *path, struct statvfs *stbuf)
 {
-  CLEANUP_FREE_STATVFS struct guestfs_statvfs *r;
+  const struct guestfs_statvfs *r;
+  time_t now;
   DECL_G ();
   DEBUG_CALL ("%s, %p", path, stbuf);
 
-  r = guestfs_statvfs (g, path);
-  if (r == NULL)
+  if (wb_flush_all (g) == -1)
     RETURN_ERRNO;
 
+  /* File managers and monitoring agents call statfs all the time.
+   * dir_cache_invalidate drops the cached result when anything is
+   * changed through the mountpoint.
+   */
+  time (&now);
+  if (g->ml_statvfs == NULL || g->ml_statvfs_timeout < now ||
+      STRNEQ (g->ml_statvfs_path, path)) {
+    statvfs_cache_invalidate (g);
+    g->ml_statvfs = guestfs_statvfs (g, path);
+    if (g->ml_statvfs == NULL)
+      RETURN_ERRNO;
+    g->ml_statvfs_path = safe_strdup (g, path);
+    g->ml_statvfs_timeout =
+      now + MIN (STATFS_CACHE_TIMEOUT, g->ml_dir_cache_timeout);
+  }
+  r = g->ml_statvfs;
+
   stbuf->f_bsize = r->bsize;
   stbuf->f_frsize = r->frsize;
   stbuf->f_blocks = r->blocks;
@@ -725,12 +962,21 @@ mount_local_statfs (const char *path, struct statvfs *stbuf)
 static int
 mount_local_release (const char *path, struct fuse_file_info *fi)
 {
+  struct ml_file *file;
   DECL_G ();
   DEBUG_CALL ("%s", path);
 
-  /* Just a stub. This method is optional and can safely be left
-   * unimplemented.
-   */
+  file = (struct ml_file *) (uintptr_t) fi->fh;
+  if (file) {
+    /* Errors can't be returned from here, but mount_local_flush has
+     * normally written out everything already.
+     */
+    ignore_value (wb_flush (g, file));
+    free (file->wb_buf);
+    free (file);
+  }
+  fi->fh = 0;
+
   return 0;
 }
 
@@ -743,6 +989,9 @@ mount_local_fsync (const char *path, int isdatasync,
   DECL_G ();
   DEBUG_CALL ("%s, %d", path, isdatasync);
 
+  if (fi->fh && wb_flush (g, (struct ml_file *) (uintptr_t) fi->fh) == -1)
+    RETURN_ERRNO;
+
   r = guestfs_sync (g);
   if (r == -1)
     RETURN_ERRNO;
@@ -916,11 +1165,13 @@ mount_local_flush(const char *path, struct fuse_file_info *fi)
   DECL_G ();
   DEBUG_CALL ("%s", path);
 
-  /* Just a stub. This method is called whenever FUSE wants to flush the
-   * pending changes (f.ex. to attributes) to a file.  Since we don't have
-   * anything to do and don't want FUSE to think something went badly,
-   * just return 0.
+  /* This method is called whenever FUSE wants to flush the pending
+   * changes to a file, usually on close(2).  All we have to do is to
+   * write out data held back in write-back mode.
    */
+  if (fi->fh && wb_flush (g, (struct ml_file *) (uintptr_t) fi->fh) == -1)
+    RETURN_ERRNO;
+
   return 0;
 }
 
@@ -953,6 +1204,98 @@ static struct fuse_operations mount_local_operations = {
   .flush        = mount_local_flush,
 };
 
+/* Wrappers around the operations above, used in multi-threaded
+ * mode.  See ml_enter.
+ */
+#define ML_LOCKED(name, params, args)           \
+  static int                                    \
+  mount_local_locked_##name params              \
+  {                                             \
+    int r;                                      \
+    DECL_G ();                                  \
+                                                \
+    ml_enter (g);                               \
+    r = mount_local_##name args;                \
+    ml_leave (g);                               \
+    return r;                                   \
+  }
+
+ML_LOCKED (getattr, (const char *path, struct stat *statbuf),
+           (path, statbuf))
+ML_LOCKED (access, (const char *path, int mask), (path, mask))
+ML_LOCKED (readlink, (const char *path, char *buf, size_t size),
+           (path, buf, size))
+ML_LOCKED (readdir, (const char *path, void *buf, fuse_fill_dir_t filler,
+                     off_t offset, struct fuse_file_info *fi),
+           (path, buf, filler, offset, fi))
+ML_LOCKED (mknod, (const char *path, mode_t mode, dev_t rdev),
+           (path, mode, rdev))
+ML_LOCKED (mkdir, (const char *path, mode_t mode), (path, mode))
+ML_LOCKED (symlink, (const char *from, const char *to), (from, to))
+ML_LOCKED (unlink, (const char *path), (path))
+ML_LOCKED (rmdir, (const char *path), (path))
+ML_LOCKED (rename, (const char *from, const char *to), (from, to))
+ML_LOCKED (link, (const char *from, const char *to), (from, to))
+ML_LOCKED (chmod, (const char *path, mode_t mode), (path, mode))
+ML_LOCKED (chown, (const char *path, uid_t uid, gid_t gid),
+           (path, uid, gid))
+ML_LOCKED (truncate, (const char *path, off_t size), (path, size))
+ML_LOCKED (utimens, (const char *path, const struct timespec ts[2]),
+           (path, ts))
+ML_LOCKED (open, (const char *path, struct fuse_file_info *fi), (path, fi))
+ML_LOCKED (read, (const char *path, char *buf, size_t size, off_t offset,
+                  struct fuse_file_info *fi),
+           (path, buf, size, offset, fi))
+ML_LOCKED (write, (const char *path, const char *buf, size_t size,
+                   off_t offset, struct fuse_file_info *fi),
+           (path, buf, size, offset, fi))
+ML_LOCKED (statfs, (const char *path, struct statvfs *stbuf),
+           (path, stbuf))
+ML_LOCKED (release, (const char *path, struct fuse_file_info *fi),
+           (path, fi))
+ML_LOCKED (fsync, (const char *path, int isdatasync,
+                   struct fuse_file_info *fi),
+           (path, isdatasync, fi))
+ML_LOCKED (setxattr, (const char *path, const char *name, const char *value,
+                      size_t size, int flags),
+           (path, name, value, size, flags))
+ML_LOCKED (getxattr, (const char *path, const char *name, char *value,
+                      size_t size),
+           (path, name, value, size))
+ML_LOCKED (listxattr, (const char *path, char *list, size_t size),
+           (path, list, size))
+ML_LOCKED (removexattr, (const char *path, const char *name), (path, name))
+ML_LOCKED (flush, (const char *path, struct fuse_file_info *fi), (path, fi))
+
+static struct fuse_operations mount_local_operations_mt = {
+  .getattr	= mount_local_locked_getattr,
+  .access	= mount_local_locked_access,
+  .readlink	= mount_local_locked_readlink,
+  .readdir	= mount_local_locked_readdir,
+  .mknod	= mount_local_locked_mknod,
+  .mkdir	= mount_local_locked_mkdir,
+  .symlink	= mount_local_locked_symlink,
+  .unlink	= mount_local_locked_unlink,
+  .rmdir	= mount_local_locked_rmdir,
+  .rename	= mount_local_locked_rename,
+  .link		= mount_local_locked_link,
+  .chmod	= mount_local_locked_chmod,
+  .chown	= mount_local_locked_chown,
+  .truncate	= mount_local_locked_truncate,
+  .utimens	= mount_local_locked_utimens,
+  .open		= mount_local_locked_open,
+  .read		= mount_local_locked_read,
+  .write	= mount_local_locked_write,
+  .statfs	= mount_local_locked_statfs,
+  .release	= mount_local_locked_release,
+  .fsync	= mount_local_locked_fsync,
+  .setxattr	= mount_local_locked_setxattr,
+  .getxattr	= mount_local_locked_getxattr,
+  .listxattr	= mount_local_locked_listxattr,
+  .removexattr	= mount_local_locked_removexattr,
+  .flush        = mount_local_locked_flush,
+};
+
 int
 guestfs_impl_mount_local (guestfs_h *g, const char *localmountpoint,
 			  const struct guestfs_mount_local_argv *optargs)
@@ -983,6 +1326,30 @@ guestfs_impl_mount_local (guestfs_h *g, const char *localmountpoint,
     g->ml_debug_calls = optargs->debugcalls;
   else
     g->ml_debug_calls = 0;
+  if (optargs->bitmask & GUESTFS_MOUNT_LOCAL_WRITEBACK_BITMASK)
+    g->ml_writeback = optargs->writeback;
+  else
+    g->ml_writeback = 0;
+  g->ml_dirty_files = NULL;
+  if (optargs->bitmask & GUESTFS_MOUNT_LOCAL_MULTITHREADED_BITMASK)
+    g->ml_multithreaded = optargs->multithreaded;
+  else
+    g->ml_multithreaded = 0;
+  if (g->ml_multithreaded) {
+    pthread_mutex_init (&g->ml_lock, NULL);
+    pthread_cond_init (&g->ml_cond, NULL);
+    g->ml_next_ticket = g->ml_now_serving = 0;
+  }
+  g->ml_generation = 0;
+  if (optargs->bitmask & GUESTFS_MOUNT_LOCAL_PREFETCHDEPTH_BITMASK) {
+    if (optargs->prefetchdepth < 0) {
+      error (g, _("prefetchdepth must be >= 0"));
+      return -1;
+    }
+    g->ml_prefetch_depth = optargs->prefetchdepth;
+  }
+  else
+    g->ml_prefetch_depth = 0;
 
   /* Initialize the directory caches in the handle. */
   if (init_dir_caches (g) == -1)
@@ -998,6 +1365,33 @@ guestfs_impl_mount_local (guestfs_h *g, const char *localmountpoint,
     return -1;
   }
 
+  /* Let the kernel keep the contents of files in the page cache, so
+   * that reading a file again does not go through FUSE.  Nothing can
+   * change a read-only mount, so the page cache and the attributes
+   * are kept for the cache timeout.  Otherwise auto_cache drops the
+   * pages when a file is opened if its size or mtime has changed.
+   * dir_cache_invalidate removes the cached attributes of a file
+   * which is changed through the mountpoint, so FUSE sees the new
+   * ones.  These options come first so that the user's options can
+   * override them.
+   */
+  if (g->ml_read_only) {
+    CLEANUP_FREE char *cache_options =
+      safe_asprintf (g, "kernel_cache,entry_timeout=%d,"
+                     "negative_timeout=%d,attr_timeout=%d",
+                     g->ml_dir_cache_timeout, g->ml_dir_cache_timeout,
+                     g->ml_dir_cache_timeout);
+
+    if (fuse_opt_add_arg (&args, "-o") == -1 ||
+        fuse_opt_add_arg (&args, cache_options) == -1)
+      goto arg_error;
+  }
+  else {
+    if (fuse_opt_add_arg (&args, "-o") == -1 ||
+        fuse_opt_add_arg (&args, "auto_cache") == -1)
+      goto arg_error;
+  }
+
   if (optargs->bitmask & GUESTFS_MOUNT_LOCAL_OPTIONS_BITMASK) {
     if (fuse_opt_add_arg (&args, "-o") == -1 ||
         fuse_opt_add_arg (&args, optargs->options) == -1)
@@ -1024,7 +1418,9 @@ guestfs_impl_mount_local (guestfs_h *g, const char *localmountpoint,
 
   /* Create the FUSE handle. */
   g->fuse = fuse_new (ch, &args,
-                      &mount_local_operations, sizeof mount_local_operations,
+                      g->ml_multithreaded
+                      ? &mount_local_operations_mt : &mount_local_operations,
+                      sizeof mount_local_operations,
                       g);
   if (!g->fuse) {
     perrorf (g, _("fuse_new: %s"), localmountpoint);
@@ -1072,15 +1468,27 @@ guestfs_impl_mount_local_run (guestfs_h *g)
     return -1;
   }
 
-  debug (g, "%s: entering fuse_loop", __func__);
+  debug (g, "%s: entering fuse_loop%s", __func__,
+         g->ml_multithreaded ? "_mt" : "");
 
   /* Enter the main loop. */
-  r = fuse_loop (g->fuse);
-  if (r != 0)
-    perrorf (g, _("fuse_loop: %s"), g->localmountpoint);
+  if (!g->ml_multithreaded) {
+    r = fuse_loop (g->fuse);
+    if (r != 0)
+      perrorf (g, _("fuse_loop: %s"), g->localmountpoint);
+  }
+  else {
+    r = fuse_loop_mt (g->fuse);
+    if (r != 0)
+      perrorf (g, _("fuse_loop_mt: %s"), g->localmountpoint);
+  }
 
   debug (g, "%s: leaving fuse_loop", __func__);
 
+  /* In write-back mode, in case some files were never released. */
+  if (wb_flush_all (g) == -1)
+    r = -1;
+
   guestfs_int_free_fuse (g);
   gl_lock_lock (mount_local_lock);
   g->localmountpoint = NULL;
@@ -1099,6 +1507,11 @@ guestfs_int_free_fuse (guestfs_h *g)
     fuse_destroy (g->fuse);     /* also closes the channel */
   g->fuse = NULL;
   free_dir_caches (g);
+  if (g->ml_multithreaded) {
+    pthread_cond_destroy (&g->ml_cond);
+    pthread_mutex_destroy (&g->ml_lock);
+    g->ml_multithreaded = 0;
+  }
 }
 
 int
@@ -1170,331 +1583,1098 @@ guestfs_impl_umount_local (guestfs_h *g,
  * if you like.
  */
 
-struct entry_common {
-  char *pathname;               /* full path to the file */
-  time_t timeout;               /* when this entry expires */
-};
+/* The attribute cache holds the stat structure, extended attributes
+ * and link target of each path, as read by readdir, together in one
+ * entry.
+ *
+ * The entries are stored in a dense array (g->ac_entries).  They are
+ * found through an open addressed hash table with linear probing
+ * (g->ac_slots), where each slot holds only the hash of the path and
+ * the index of the entry, so that probing touches little memory.
+ * Slots are deleted by shifting the following slots of the cluster
+ * back, so there are no tombstones.  Deleting an entry moves the last
+ * entry into its place, keeping the array dense.
+ *
+ * The entries are also kept in a binary min-heap ordered by expiry
+ * time (g->ac_heap, which holds entry indexes), so removing the
+ * expired entries costs O(expired) rather than a scan of the whole
+ * cache.
+ */
+#define AC_INITIAL_SLOTS 1024   /* must be a power of 2 */
 
-struct lsc_entry {              /* lstat cache entry */
-  struct entry_common c;
-  struct stat statbuf;          /* statbuf */
-};
+#define AC_STAT   1             /* ac_entry.flags */
+#define AC_XATTRS 2
+#define AC_LINK   4
+#define AC_DIRENTS 8
+#define AC_NOENT  16            /* the path does not exist */
 
-struct xac_entry {              /* xattr cache entry */
-  struct entry_common c;
-  struct guestfs_xattr_list *xattrs;
+struct ac_slot {
+  size_t hash;                  /* hash of the pathname */
+  size_t entry;                 /* index in g->ac_entries + 1, 0 if free */
 };
 
-struct rlc_entry {              /* readlink cache entry */
-  struct entry_common c;
+struct ac_entry {
+  char *pathname;               /* full path to the file */
+  size_t hash;
+  time_t timeout;               /* when this entry expires */
+  size_t heap_index;            /* position in g->ac_heap */
+  unsigned flags;               /* which of the fields below are set */
+  struct stat statbuf;
+  struct guestfs_xattr_list *xattrs;
   char *link;
+  struct guestfs_dirent_list *dirents; /* listing of a directory */
 };
 
 static size_t
-gen_hash (void const *x, size_t table_size)
+ac_hash (const char *pathname)
 {
-  struct entry_common const *p = x;
-  return hash_pjw (p->pathname, table_size);
+  return hash_pjw (pathname, SIZE_MAX);
 }
 
-static bool
-gen_compare (void const *x, void const *y)
+/* Return the slot holding 'pathname', or if it is not in the cache,
+ * the free slot where it would go.
+ */
+static size_t
+ac_find_slot (guestfs_h *g, const char *pathname, size_t hash, bool *found)
 {
-  struct entry_common const *a = x;
-  struct entry_common const *b = y;
-  return STREQ (a->pathname, b->pathname);
+  const size_t mask = g->ac_nr_slots - 1;
+  size_t i;
+
+  for (i = hash & mask;; i = (i + 1) & mask) {
+    const struct ac_slot *slot = &g->ac_slots[i];
+
+    if (slot->entry == 0) {
+      *found = false;
+      return i;
+    }
+    if (slot->hash == hash &&
+        STREQ (g->ac_entries[slot->entry-1].pathname, pathname)) {
+      *found = true;
+      return i;
+    }
+  }
 }
 
-static void
-lsc_free (void *x)
+/* Return the slot which points to entry 'e'. */
+static size_t
+ac_slot_of_entry (guestfs_h *g, size_t e)
 {
-  if (x) {
-    struct entry_common *p = x;
+  const size_t mask = g->ac_nr_slots - 1;
+  size_t i;
 
-    free (p->pathname);
-    free (p);
+  for (i = g->ac_entries[e].hash & mask;; i = (i + 1) & mask) {
+    if (g->ac_slots[i].entry == e+1)
+      return i;
   }
 }
 
 static void
-xac_free (void *x)
+ac_delete_slot (guestfs_h *g, size_t i)
 {
-  if (x) {
-    struct xac_entry *p = x;
+  const size_t mask = g->ac_nr_slots - 1;
+  size_t j = i, k;
+
+  for (;;) {
+    g->ac_slots[i].entry = 0;
+    for (;;) {
+      j = (j + 1) & mask;
+      if (g->ac_slots[j].entry == 0)
+        return;
+      /* The slot at 'j' can be moved back to 'i' unless its home
+       * slot 'k' lies cyclically in (i, j].
+       */
+      k = g->ac_slots[j].hash & mask;
+      if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+        continue;
+      break;
+    }
+    g->ac_slots[i] = g->ac_slots[j];
+    i = j;
+  }
+}
 
-    guestfs_free_xattr_list (p->xattrs);
-    lsc_free (x);
+/* Double the number of slots.  This keeps the table at most half
+ * full, so probe sequences stay short and always end at a free slot.
+ */
+static int
+ac_grow_slots (guestfs_h *g)
+{
+  const size_t nr_slots = g->ac_nr_slots * 2;
+  const size_t mask = nr_slots - 1;
+  struct ac_slot *slots;
+  size_t i, j;
+
+  slots = calloc (nr_slots, sizeof *slots);
+  if (slots == NULL) {
+    perrorf (g, "calloc");
+    return -1;
+  }
+
+  for (i = 0; i < g->ac_nr_slots; ++i) {
+    if (g->ac_slots[i].entry == 0)
+      continue;
+    for (j = g->ac_slots[i].hash & mask; slots[j].entry != 0;
+         j = (j + 1) & mask)
+      ;
+    slots[j] = g->ac_slots[i];
   }
+
+  free (g->ac_slots);
+  g->ac_slots = slots;
+  g->ac_nr_slots = nr_slots;
+  return 0;
+}
+
+static time_t
+ac_heap_timeout (guestfs_h *g, size_t pos)
+{
+  return g->ac_entries[g->ac_heap[pos]].timeout;
 }
 
 static void
-rlc_free (void *x)
+ac_heap_set (guestfs_h *g, size_t pos, size_t e)
 {
-  if (x) {
-    struct rlc_entry *p = x;
+  g->ac_heap[pos] = e;
+  g->ac_entries[e].heap_index = pos;
+}
+
+static void
+ac_heap_sift_up (guestfs_h *g, size_t pos)
+{
+  const size_t e = g->ac_heap[pos];
+  const time_t timeout = g->ac_entries[e].timeout;
 
-    free (p->link);
-    lsc_free (x);
+  while (pos > 0 && ac_heap_timeout (g, (pos - 1) / 2) > timeout) {
+    ac_heap_set (g, pos, g->ac_heap[(pos - 1) / 2]);
+    pos = (pos - 1) / 2;
   }
+  ac_heap_set (g, pos, e);
 }
 
-static int
-init_dir_caches (guestfs_h *g)
+static void
+ac_heap_sift_down (guestfs_h *g, size_t pos)
 {
-  g->lsc_ht = hash_initialize (1024, NULL, gen_hash, gen_compare, lsc_free);
-  g->xac_ht = hash_initialize (1024, NULL, gen_hash, gen_compare, xac_free);
-  g->rlc_ht = hash_initialize (1024, NULL, gen_hash, gen_compare, rlc_free);
-  if (!g->lsc_ht || !g->xac_ht || !g->rlc_ht) {
-    error (g, _("could not initialize dir cache hashtables"));
-    return -1;
+  const size_t n = g->ac_nr_entries;
+  const size_t e = g->ac_heap[pos];
+  const time_t timeout = g->ac_entries[e].timeout;
+  size_t child;
+
+  while ((child = 2 * pos + 1) < n) {
+    if (child + 1 < n &&
+        ac_heap_timeout (g, child + 1) < ac_heap_timeout (g, child))
+      child++;
+    if (ac_heap_timeout (g, child) >= timeout)
+      break;
+    ac_heap_set (g, pos, g->ac_heap[child]);
+    pos = child;
   }
-  return 0;
+  ac_heap_set (g, pos, e);
 }
 
 static void
-free_dir_caches (guestfs_h *g)
+ac_free_fields (struct ac_entry *entry)
+{
+  if (entry->flags & AC_XATTRS)
+    guestfs_free_xattr_list (entry->xattrs);
+  if (entry->flags & AC_LINK)
+    free (entry->link);
+  if (entry->flags & AC_DIRENTS)
+    guestfs_free_dirent_list (entry->dirents);
+  entry->flags = 0;
+}
+
+/* Remove the entry pointed to by slot 'i'. */
+static void
+ac_remove (guestfs_h *g, size_t i)
+{
+  const size_t e = g->ac_slots[i].entry - 1;
+  const size_t last = g->ac_nr_entries - 1;
+  struct ac_entry *entry = &g->ac_entries[e];
+  size_t pos = entry->heap_index;
+
+  ac_free_fields (entry);
+  free (entry->pathname);
+  ac_delete_slot (g, i);
+
+  /* Move the last entry into the hole in the array. */
+  if (e != last) {
+    g->ac_slots[ac_slot_of_entry (g, last)].entry = e+1;
+    *entry = g->ac_entries[last];
+    g->ac_heap[entry->heap_index] = e;
+  }
+
+  /* Remove the entry from the heap (its position has not changed,
+   * only what it points to).
+   */
+  g->ac_nr_entries--;
+  if (pos < g->ac_nr_entries) {
+    ac_heap_set (g, pos, g->ac_heap[g->ac_nr_entries]);
+    ac_heap_sift_down (g, pos);
+    ac_heap_sift_up (g, pos);
+  }
+}
+
+/* Return the entry for 'pathname', creating it if necessary.  This
+ * takes ownership of 'pathname'.  An entry left over from an earlier
+ * readdir is emptied first, so that all the fields of an entry
+ * always expire together.
+ */
+static struct ac_entry *
+ac_get_pathname (guestfs_h *g, char *pathname, time_t now)
+{
+  const time_t timeout = now + g->ml_dir_cache_timeout;
+  struct ac_entry *entry;
+  size_t hash, i, e;
+  bool found;
+
+  hash = ac_hash (pathname);
+  i = ac_find_slot (g, pathname, hash, &found);
+  if (found) {
+    free (pathname);
+    entry = &g->ac_entries[g->ac_slots[i].entry-1];
+    if (entry->timeout != timeout) {
+      ac_free_fields (entry);
+      entry->timeout = timeout;
+      ac_heap_sift_down (g, entry->heap_index);
+      ac_heap_sift_up (g, entry->heap_index);
+    }
+    /* Whatever is being added, the path exists after all. */
+    entry->flags &= ~AC_NOENT;
+    return entry;
+  }
+
+  if (g->ac_nr_entries == g->ac_alloc_entries) {
+    const size_t n = g->ac_alloc_entries ? 2 * g->ac_alloc_entries : 256;
+    struct ac_entry *entries;
+    size_t *heap;
+
+    entries = realloc (g->ac_entries, n * sizeof *entries);
+    if (entries == NULL) {
+    alloc_error:
+      perrorf (g, "realloc");
+      free (pathname);
+      return NULL;
+    }
+    g->ac_entries = entries;
+    heap = realloc (g->ac_heap, n * sizeof *heap);
+    if (heap == NULL)
+      goto alloc_error;
+    g->ac_heap = heap;
+    g->ac_alloc_entries = n;
+  }
+
+  if (2 * (g->ac_nr_entries + 1) > g->ac_nr_slots) {
+    if (ac_grow_slots (g) == -1) {
+      free (pathname);
+      return NULL;
+    }
+    i = ac_find_slot (g, pathname, hash, &found);
+  }
+
+  e = g->ac_nr_entries++;
+  entry = &g->ac_entries[e];
+  entry->pathname = pathname;
+  entry->hash = hash;
+  entry->timeout = timeout;
+  entry->flags = 0;
+  g->ac_slots[i].hash = hash;
+  g->ac_slots[i].entry = e+1;
+  g->ac_heap[e] = e;
+  ac_heap_sift_up (g, e);
+
+  return entry;
+}
+
+/* Return the entry for 'path/name', creating it if necessary. */
+static struct ac_entry *
+ac_get (guestfs_h *g, const char *path, const char *name, time_t now)
 {
-  if (g->lsc_ht)
-    hash_free (g->lsc_ht);
-  if (g->xac_ht)
-    hash_free (g->xac_ht);
-  if (g->rlc_ht)
-    hash_free (g->rlc_ht);
-  g->lsc_ht = NULL;
-  g->xac_ht = NULL;
-  g->rlc_ht = NULL;
+  char *pathname;
+  size_t len;
+
+  len = strlen (path) + strlen (name) + 2;
+  pathname = malloc (len);
+  if (pathname == NULL) {
+    perrorf (g, "malloc");
+    return NULL;
+  }
+  if (STREQ (path, "/"))
+    snprintf (pathname, len, "/%s", name);
+  else
+    snprintf (pathname, len, "%s/%s", path, name);
+
+  return ac_get_pathname (g, pathname, now);
 }
 
-struct gen_remove_data {
+/* Return the unexpired entry for 'pathname', or NULL. */
+static struct ac_entry *
+ac_lookup (guestfs_h *g, const char *pathname)
+{
+  struct ac_entry *entry;
+  size_t i;
+  bool found;
   time_t now;
-  Hash_table *ht;
-  Hash_data_freer freer;
+
+  i = ac_find_slot (g, pathname, ac_hash (pathname), &found);
+  if (!found)
+    return NULL;
+
+  time (&now);
+
+  entry = &g->ac_entries[g->ac_slots[i].entry-1];
+  if (entry->timeout < now)
+    return NULL;
+  return entry;
+}
+
+static void
+ac_free (guestfs_h *g)
+{
+  size_t e;
+
+  for (e = 0; e < g->ac_nr_entries; ++e) {
+    ac_free_fields (&g->ac_entries[e]);
+    free (g->ac_entries[e].pathname);
+  }
+  free (g->ac_entries);
+  free (g->ac_heap);
+  free (g->ac_slots);
+  g->ac_entries = NULL;
+  g->ac_heap = NULL;
+  g->ac_slots = NULL;
+  g->ac_nr_entries = g->ac_alloc_entries = g->ac_nr_slots = 0;
+}
+
+struct entry_common {
+  char *pathname;               /* full path to the file */
+  time_t timeout;               /* when this entry expires */
 };
 
-static bool
-gen_remove_if_expired (void *x, void *data)
+static void
+blc_free (void *x)
 {
-  /* XXX hash_do_for_each was observed calling this function
-   * with x == NULL.
-   */
   if (x) {
     struct entry_common *p = x;
-    struct gen_remove_data *d = data;
 
-    if (p->timeout < d->now)
-      d->freer (hash_delete (d->ht, x));
+    free (p->pathname);
+    free (p);
   }
+}
 
-  return 1;
+/* The block cache holds the contents of files read through
+ * mount_local_read, in fixed size blocks.  Entries are keyed on
+ * (pathname, block number), and expire like the other caches.  They
+ * are also kept on a list in least recently used order, so that the
+ * total size of the cache is bounded.
+ *
+ * A block shorter than BLC_BLOCK_SIZE (possibly empty) is the last
+ * block of the file.
+ */
+struct blc_entry {              /* block cache entry */
+  struct entry_common c;
+  uint64_t block;               /* block number in the file */
+  struct blc_entry *prev, *next; /* LRU list, most recently used first */
+  size_t len;                   /* length of data */
+  char data[];
+};
+
+static size_t
+blc_hash (void const *x, size_t table_size)
+{
+  struct blc_entry const *p = x;
+  return (hash_pjw (p->c.pathname, table_size) + p->block) % table_size;
 }
 
-static void
-gen_remove_all_expired (Hash_table *ht, Hash_data_freer freer, time_t now)
+static bool
+blc_compare (void const *x, void const *y)
 {
-  struct gen_remove_data data;
-  data.now = now;
-  data.ht = ht;
-  data.freer = freer;
+  struct blc_entry const *a = x;
+  struct blc_entry const *b = y;
+  return a->block == b->block && STREQ (a->c.pathname, b->c.pathname);
+}
 
-  /* Careful reading of the documentation to hash _seems_ to indicate
-   * that this is safe, _provided_ we use the default thresholds (in
-   * particular, no shrink threshold).
-   */
-  hash_do_for_each (ht, gen_remove_if_expired, &data);
+static int
+init_dir_caches (guestfs_h *g)
+{
+  g->ac_slots = calloc (AC_INITIAL_SLOTS, sizeof *g->ac_slots);
+  if (g->ac_slots == NULL) {
+    perrorf (g, "calloc");
+    return -1;
+  }
+  g->ac_nr_slots = AC_INITIAL_SLOTS;
+  g->ac_entries = NULL;
+  g->ac_heap = NULL;
+  g->ac_nr_entries = g->ac_alloc_entries = 0;
+
+  g->blc_ht = hash_initialize (1024, NULL, blc_hash, blc_compare, blc_free);
+  if (!g->blc_ht) {
+    error (g, _("could not initialize block cache hashtable"));
+    return -1;
+  }
+  g->blc_lru_head = g->blc_lru_tail = NULL;
+  g->blc_nr_blocks = 0;
+  g->ml_statvfs = NULL;
+  g->ml_statvfs_path = NULL;
+  return 0;
+}
+
+static void
+free_dir_caches (guestfs_h *g)
+{
+  ac_free (g);
+  statvfs_cache_invalidate (g);
+  if (g->blc_ht)
+    hash_free (g->blc_ht);
+  g->blc_ht = NULL;
+  g->blc_lru_head = g->blc_lru_tail = NULL;
+  g->blc_nr_blocks = 0;
 }
 
 static void
 dir_cache_remove_all_expired (guestfs_h *g, time_t now)
 {
-  gen_remove_all_expired (g->lsc_ht, lsc_free, now);
-  gen_remove_all_expired (g->xac_ht, xac_free, now);
-  gen_remove_all_expired (g->rlc_ht, rlc_free, now);
+  while (g->ac_nr_entries > 0 && ac_heap_timeout (g, 0) < now)
+    ac_remove (g, ac_slot_of_entry (g, g->ac_heap[0]));
 }
 
 static int
-gen_replace (guestfs_h *g, Hash_table *ht,
-             struct entry_common *new_entry, Hash_data_freer freer)
+lsc_insert (guestfs_h *g,
+            const char *path, const char *name, time_t now,
+            struct stat const *statbuf)
 {
-  struct entry_common *old_entry;
+  struct ac_entry *entry;
 
-  old_entry = hash_delete (ht, new_entry);
-  freer (old_entry);
+  entry = ac_get (g, path, name, now);
+  if (entry == NULL)
+    return -1;
 
-  old_entry = hash_insert (ht, new_entry);
-  if (old_entry == NULL) {
-    perrorf (g, "hash_insert");
-    freer (new_entry);
+  memcpy (&entry->statbuf, statbuf, sizeof entry->statbuf);
+  entry->flags |= AC_STAT;
+  return 0;
+}
+
+/* This takes ownership of 'xattrs'. */
+static int
+xac_insert (guestfs_h *g,
+            const char *path, const char *name, time_t now,
+            struct guestfs_xattr_list *xattrs)
+{
+  struct ac_entry *entry;
+
+  entry = ac_get (g, path, name, now);
+  if (entry == NULL) {
+    guestfs_free_xattr_list (xattrs);
     return -1;
   }
-  /* assert (old_entry == new_entry); */
 
+  if (entry->flags & AC_XATTRS)
+    guestfs_free_xattr_list (entry->xattrs);
+  entry->xattrs = xattrs;
+  entry->flags |= AC_XATTRS;
   return 0;
 }
 
+/* This takes ownership of 'link'. */
 static int
-lsc_insert (guestfs_h *g,
+rlc_insert (guestfs_h *g,
             const char *path, const char *name, time_t now,
-            struct stat const *statbuf)
+            char *link)
 {
-  struct lsc_entry *entry;
-  size_t len;
+  struct ac_entry *entry;
 
-  entry = malloc (sizeof *entry);
+  entry = ac_get (g, path, name, now);
   if (entry == NULL) {
-    perrorf (g, "malloc");
+    free (link);
     return -1;
   }
 
-  len = strlen (path) + strlen (name) + 2;
-  entry->c.pathname = malloc (len);
-  if (entry->c.pathname == NULL) {
-    perrorf (g, "malloc");
-    free (entry);
+  if (entry->flags & AC_LINK)
+    free (entry->link);
+  entry->link = link;
+  entry->flags |= AC_LINK;
+  return 0;
+}
+
+static const struct stat *
+lsc_lookup (guestfs_h *g, const char *pathname)
+{
+  const struct ac_entry *entry = ac_lookup (g, pathname);
+
+  if (entry && (entry->flags & AC_STAT))
+    return &entry->statbuf;
+  else
+    return NULL;
+}
+
+/* Negative entries, for paths which do not exist.  They expire
+ * like the other entries, and dir_cache_invalidate removes them when
+ * the path is created through the mountpoint.
+ */
+static int
+nec_insert (guestfs_h *g, const char *pathname, time_t now)
+{
+  struct ac_entry *entry;
+
+  entry = ac_get_pathname (g, safe_strdup (g, pathname), now);
+  if (entry == NULL)
     return -1;
-  }
-  if (STREQ (path, "/"))
-    snprintf (entry->c.pathname, len, "/%s", name);
+
+  ac_free_fields (entry);
+  entry->flags = AC_NOENT;
+  return 0;
+}
+
+static bool
+nec_lookup (guestfs_h *g, const char *pathname)
+{
+  const struct ac_entry *entry = ac_lookup (g, pathname);
+
+  return entry && (entry->flags & AC_NOENT);
+}
+
+static const struct guestfs_xattr_list *
+xac_lookup (guestfs_h *g, const char *pathname)
+{
+  const struct ac_entry *entry = ac_lookup (g, pathname);
+
+  if (entry && (entry->flags & AC_XATTRS))
+    return entry->xattrs;
   else
-    snprintf (entry->c.pathname, len, "%s/%s", path, name);
+    return NULL;
+}
 
-  memcpy (&entry->statbuf, statbuf, sizeof entry->statbuf);
+static const char *
+rlc_lookup (guestfs_h *g, const char *pathname)
+{
+  const struct ac_entry *entry = ac_lookup (g, pathname);
 
-  entry->c.timeout = now + g->ml_dir_cache_timeout;
+  if (entry && (entry->flags & AC_LINK))
+    return entry->link;
+  else
+    return NULL;
+}
 
-  return gen_replace (g, g->lsc_ht, (struct entry_common *) entry, lsc_free);
+/* Prefetching (see guestfs_mount_local 'prefetchdepth').
+ *
+ * readdir fetches the whole tree below the directory, down to
+ * ml_prefetch_depth levels, in one internal_lstatns_tree call.  The
+ * stat buffer and link target of every file are put in the attribute
+ * cache, and the listing of every directory in the tree is stored in
+ * the cache entry of the directory (AC_DIRENTS), so reading those
+ * directories later needs no call to the appliance.
+ *
+ * Without prefetching, readdir fetches just the one directory in the
+ * same way, and the extended attributes of its entries too.  This
+ * replaces a readdir call followed by lstatnslist, lxattrlist and
+ * readlinklist calls on the names.
+ */
+
+static char
+mode_to_ftyp (mode_t mode)
+{
+  if (S_ISBLK (mode)) return 'b';
+  if (S_ISCHR (mode)) return 'c';
+  if (S_ISDIR (mode)) return 'd';
+  if (S_ISFIFO (mode)) return 'f';
+  if (S_ISLNK (mode)) return 'l';
+  if (S_ISREG (mode)) return 'r';
+  if (S_ISSOCK (mode)) return 's';
+  return '?';
 }
 
+/* Start an empty listing for the directory 'pathname'.  This takes
+ * ownership of 'pathname'.
+ */
 static int
-xac_insert (guestfs_h *g,
-            const char *path, const char *name, time_t now,
-            struct guestfs_xattr_list *xattrs)
+ac_start_dirents (guestfs_h *g, char *pathname, time_t now)
 {
-  struct xac_entry *entry;
-  size_t len;
+  struct ac_entry *entry;
 
-  entry = malloc (sizeof *entry);
-  if (entry == NULL) {
-    perrorf (g, "malloc");
+  entry = ac_get_pathname (g, pathname, now);
+  if (entry == NULL)
+    return -1;
+
+  if (entry->flags & AC_DIRENTS)
+    guestfs_free_dirent_list (entry->dirents);
+  entry->dirents = calloc (1, sizeof *entry->dirents);
+  if (entry->dirents == NULL) {
+    perrorf (g, "calloc");
+    entry->flags &= ~AC_DIRENTS;
     return -1;
   }
+  entry->flags |= AC_DIRENTS;
+  return 0;
+}
 
-  len = strlen (path) + strlen (name) + 2;
-  entry->c.pathname = malloc (len);
-  if (entry->c.pathname == NULL) {
-    perrorf (g, "malloc");
-    free (entry);
+/* Add 'name' to the listing of the directory 'pathname'. */
+static int
+ac_add_dirent (guestfs_h *g, const char *pathname, const char *name,
+               const struct stat *statbuf)
+{
+  struct guestfs_dirent_list *dirents;
+  struct guestfs_dirent *d;
+  size_t i;
+  bool found;
+
+  i = ac_find_slot (g, pathname, ac_hash (pathname), &found);
+  if (!found || !(g->ac_entries[g->ac_slots[i].entry-1].flags & AC_DIRENTS))
+    return 0;
+  dirents = g->ac_entries[g->ac_slots[i].entry-1].dirents;
+
+  /* The array is grown whenever its length reaches a power of 2. */
+  if ((dirents->len & (dirents->len - 1)) == 0) {
+    d = realloc (dirents->val,
+                 (dirents->len ? 2 * dirents->len : 1) * sizeof *d);
+    if (d == NULL) {
+      perrorf (g, "realloc");
+      return -1;
+    }
+    dirents->val = d;
+  }
+
+  d = &dirents->val[dirents->len];
+  d->name = strdup (name);
+  if (d->name == NULL) {
+    perrorf (g, "strdup");
     return -1;
   }
-  if (STREQ (path, "/"))
-    snprintf (entry->c.pathname, len, "/%s", name);
+  d->ino = statbuf->st_ino;
+  d->ftyp = mode_to_ftyp (statbuf->st_mode);
+  dirents->len++;
+  return 0;
+}
+
+/* Fill in the listing of 'path' from the cache.  Returns 1 if it was
+ * in the cache, 0 if not.
+ */
+static int
+readdir_from_cache (guestfs_h *g, const char *path,
+                    void *buf, fuse_fill_dir_t filler)
+{
+  const struct ac_entry *entry = ac_lookup (g, path);
+  const struct guestfs_dirent_list *dirents;
+  struct stat stat;
+  size_t i;
+
+  if (entry == NULL || !(entry->flags & AC_DIRENTS))
+    return 0;
+  dirents = entry->dirents;
+
+  memset (&stat, 0, sizeof stat);
+  stat.st_mode = S_IFDIR;
+  if (entry->flags & AC_STAT)
+    stat.st_ino = entry->statbuf.st_ino;
+  if (filler (buf, ".", &stat, 0))
+    return 1;
+  stat.st_ino = 0;
+  if (filler (buf, "..", &stat, 0))
+    return 1;
+
+  for (i = 0; i < dirents->len; ++i) {
+    memset (&stat, 0, sizeof stat);
+    stat.st_ino = dirents->val[i].ino;
+    switch (dirents->val[i].ftyp) {
+    case 'b': stat.st_mode = S_IFBLK; break;
+    case 'c': stat.st_mode = S_IFCHR; break;
+    case 'd': stat.st_mode = S_IFDIR; break;
+    case 'f': stat.st_mode = S_IFIFO; break;
+    case 'l': stat.st_mode = S_IFLNK; break;
+    case 'r': stat.st_mode = S_IFREG; break;
+    case 's': stat.st_mode = S_IFSOCK; break;
+    default:  stat.st_mode = 0;
+    }
+    if (filler (buf, dirents->val[i].name, &stat, 0))
+      break;
+  }
+
+  return 1;
+}
+
+/* Fetch the tree below 'path' into the cache.  The records written by
+ * internal_lstatns_tree are described in generator/actions.ml.
+ */
+static int
+prefetch_tree (guestfs_h *g, const char *path, time_t now)
+{
+  CLEANUP_UNLINK_FREE char *tmpfile = NULL;
+  CLEANUP_FCLOSE FILE *fp = NULL;
+  CLEANUP_FREE char *dir = NULL; /* the directory being listed */
+  const int depth = g->ml_prefetch_depth > 0 ? g->ml_prefetch_depth : 1;
+  const bool xattrs = g->ml_prefetch_depth == 0;
+  struct stat statbuf;
+  off_t size;
+  XDR xdr;
+  int r;
+
+  tmpfile = guestfs_int_make_temp_path (g, "lstatns_tree");
+  if (tmpfile == NULL)
+    return -1;
+
+  /* If this fails, readdir falls back to guestfs_readdir, which
+   * reports the error if there is one.
+   */
+  guestfs_push_error_handler (g, NULL, NULL);
+  r = guestfs_internal_lstatns_tree (g, path, depth, xattrs, tmpfile);
+  guestfs_pop_error_handler (g);
+  if (r == -1)
+    return -1;
+
+  fp = fopen (tmpfile, "r");
+  if (fp == NULL) {
+    perrorf (g, "fopen: %s", tmpfile);
+    return -1;
+  }
+  if (fstat (fileno (fp), &statbuf) == -1) {
+    perrorf (g, "fstat: %s", tmpfile);
+    return -1;
+  }
+  size = statbuf.st_size;
+
+  xdrstdio_create (&xdr, fp, XDR_DECODE);
+
+  r = -1;
+  while (xdr_getpos (&xdr) < (u_int) size) {
+    CLEANUP_FREE char *name = NULL, *link = NULL;
+    struct guestfs_statns ns;
+    struct guestfs_xattr_list *xattr_list = NULL;
+    const char *base;
+    bool_t is_dir;
+
+    if (!xdr_string (&xdr, &name, ~0) || !xdr_bool (&xdr, &is_dir))
+      goto parse_error;
+
+    if (is_dir) {
+      free (dir);
+      if (name[0] == '\0')
+        dir = safe_strdup (g, path);
+      else if (STREQ (path, "/"))
+        dir = safe_asprintf (g, "/%s", name);
+      else
+        dir = safe_asprintf (g, "%s/%s", path, name);
+      if (ac_start_dirents (g, safe_strdup (g, dir), now) == -1)
+        goto out;
+      continue;
+    }
+
+    memset (&ns, 0, sizeof ns);
+    if (!xdr_guestfs_int_statns (&xdr, (guestfs_int_statns *) &ns) ||
+        !xdr_string (&xdr, &link, ~0) || dir == NULL)
+      goto parse_error;
+
+    statns_to_stat (&ns, &statbuf);
+    base = strrchr (name, '/');
+    base = base ? base + 1 : name;
+
+    if (ac_add_dirent (g, dir, base, &statbuf) == -1 ||
+        lsc_insert (g, dir, base, now, &statbuf) == -1)
+      goto out;
+    if (link[0] != '\0') {
+      rlc_insert (g, dir, base, now, link);
+      link = NULL;              /* owned by the cache now */
+    }
+
+    if (xattrs) {
+      xattr_list = safe_calloc (g, 1, sizeof *xattr_list);
+      if (!xdr_guestfs_int_xattr_list (&xdr,
+                                       (guestfs_int_xattr_list *) xattr_list)) {
+        guestfs_free_xattr_list (xattr_list);
+        goto parse_error;
+      }
+      /* xac_insert owns the list after this. */
+      xac_insert (g, dir, base, now, xattr_list);
+    }
+  }
+
+  r = 0;
+  goto out;
+
+ parse_error:
+  error (g, _("%s: could not parse the tree listing"), path);
+ out:
+  xdr_destroy (&xdr);
+  return r;
+}
+
+static void
+blc_unlink (guestfs_h *g, struct blc_entry *entry)
+{
+  if (entry->prev)
+    entry->prev->next = entry->next;
   else
-    snprintf (entry->c.pathname, len, "%s/%s", path, name);
+    g->blc_lru_head = entry->next;
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    g->blc_lru_tail = entry->prev;
+  entry->prev = entry->next = NULL;
+}
 
-  entry->xattrs = xattrs;
+static void
+blc_link_head (guestfs_h *g, struct blc_entry *entry)
+{
+  entry->prev = NULL;
+  entry->next = g->blc_lru_head;
+  if (g->blc_lru_head)
+    g->blc_lru_head->prev = entry;
+  else
+    g->blc_lru_tail = entry;
+  g->blc_lru_head = entry;
+}
 
-  entry->c.timeout = now + g->ml_dir_cache_timeout;
+static void
+blc_remove (guestfs_h *g, struct blc_entry *entry)
+{
+  blc_unlink (g, entry);
+  hash_delete (g->blc_ht, entry);
+  g->blc_nr_blocks--;
+  blc_free (entry);
+}
 
-  return gen_replace (g, g->xac_ht, (struct entry_common *) entry, xac_free);
+static const struct blc_entry *
+blc_lookup (guestfs_h *g, const char *pathname, uint64_t block)
+{
+  const struct blc_entry key =
+    { .c.pathname = (char *) pathname, .block = block };
+  struct blc_entry *entry;
+  time_t now;
+
+  time (&now);
+
+  entry = hash_lookup (g->blc_ht, &key);
+  if (entry == NULL)
+    return NULL;
+  if (entry->c.timeout < now) {
+    blc_remove (g, entry);
+    return NULL;
+  }
+
+  blc_unlink (g, entry);
+  blc_link_head (g, entry);
+  return entry;
 }
 
 static int
-rlc_insert (guestfs_h *g,
-            const char *path, const char *name, time_t now,
-            char *link)
+blc_insert (guestfs_h *g, const char *pathname, uint64_t block, time_t now,
+            const char *data, size_t len)
 {
-  struct rlc_entry *entry;
-  size_t len;
+  struct blc_entry *entry, *old_entry;
 
-  entry = malloc (sizeof *entry);
+  entry = malloc (sizeof *entry + len);
   if (entry == NULL) {
     perrorf (g, "malloc");
     return -1;
   }
-
-  len = strlen (path) + strlen (name) + 2;
-  entry->c.pathname = malloc (len);
+  entry->c.pathname = strdup (pathname);
   if (entry->c.pathname == NULL) {
-    perrorf (g, "malloc");
+    perrorf (g, "strdup");
     free (entry);
     return -1;
   }
-  if (STREQ (path, "/"))
-    snprintf (entry->c.pathname, len, "/%s", name);
-  else
-    snprintf (entry->c.pathname, len, "%s/%s", path, name);
+  entry->c.timeout = now + g->ml_dir_cache_timeout;
+  entry->block = block;
+  entry->len = len;
+  memcpy (entry->data, data, len);
 
-  entry->link = link;
+  old_entry = hash_lookup (g->blc_ht, entry);
+  if (old_entry)
+    blc_remove (g, old_entry);
+  while (g->blc_nr_blocks >= BLC_MAX_BLOCKS)
+    blc_remove (g, g->blc_lru_tail);
 
-  entry->c.timeout = now + g->ml_dir_cache_timeout;
+  if (hash_insert (g->blc_ht, entry) == NULL) {
+    perrorf (g, "hash_insert");
+    blc_free (entry);
+    return -1;
+  }
+  blc_link_head (g, entry);
+  g->blc_nr_blocks++;
 
-  return gen_replace (g, g->rlc_ht, (struct entry_common *) entry, rlc_free);
+  return 0;
 }
 
-static const struct stat *
-lsc_lookup (guestfs_h *g, const char *pathname)
+/* Read 'nr_blocks' blocks starting at 'block' from the appliance in
+ * a single call, and add them to the cache.
+ */
+static int
+blc_fill (guestfs_h *g, const char *pathname, uint64_t block,
+          size_t nr_blocks)
 {
-  const struct entry_common key = { .pathname = (char *) pathname };
-  struct lsc_entry *entry;
+  CLEANUP_FREE char *r = NULL;
+  size_t rsize, i;
   time_t now;
+  const unsigned generation = g->ml_generation;
+  int serial;
+
+  serial = guestfs_submit_pread (g, pathname, nr_blocks * BLC_BLOCK_SIZE,
+                                 block * BLC_BLOCK_SIZE);
+  if (serial == -1)
+    return -1;
+  ml_yield (g);
+  r = guestfs_wait_pread (g, serial, &rsize);
+  if (r == NULL)
+    return -1;
+
+  /* Another thread wrote to a file while we were waiting, so the
+   * data may be out of date.  Read it again without giving up our
+   * turn.
+   */
+  if (generation != g->ml_generation) {
+    free (r);
+    r = guestfs_pread (g, pathname, nr_blocks * BLC_BLOCK_SIZE,
+                       block * BLC_BLOCK_SIZE, &rsize);
+    if (r == NULL)
+      return -1;
+  }
+  if (rsize > nr_blocks * BLC_BLOCK_SIZE)
+    rsize = nr_blocks * BLC_BLOCK_SIZE;
 
   time (&now);
 
-  entry = hash_lookup (g->lsc_ht, &key);
-  if (entry && entry->c.timeout >= now)
-    return &entry->statbuf;
-  else
-    return NULL;
+  for (i = 0; i < nr_blocks; ++i) {
+    const size_t offset = i * BLC_BLOCK_SIZE;
+    const size_t len =
+      rsize - offset < BLC_BLOCK_SIZE ? rsize - offset : BLC_BLOCK_SIZE;
+
+    if (blc_insert (g, pathname, block + i, now, r + offset, len) == -1)
+      return -1;
+    if (len < BLC_BLOCK_SIZE)   /* end of file */
+      break;
+  }
+
+  return 0;
 }
 
-static const struct guestfs_xattr_list *
-xac_lookup (guestfs_h *g, const char *pathname)
+/* Read 'size' bytes at 'offset' from the file, going through the
+ * block cache.  When blocks are missing, they are fetched together
+ * with up to 'readahead' blocks following the request.  Returns the
+ * number of bytes read, or -1 on error.
+ */
+static int
+blc_read (guestfs_h *g, const char *path, char *buf, size_t size,
+          off_t offset, size_t readahead)
 {
-  const struct entry_common key = { .pathname = (char *) pathname };
-  struct xac_entry *entry;
-  time_t now;
+  size_t done = 0;
+
+  while (done < size) {
+    const uint64_t pos = offset + done;
+    const uint64_t block = pos / BLC_BLOCK_SIZE;
+    const size_t block_offset = pos % BLC_BLOCK_SIZE;
+    const struct blc_entry *entry;
+    size_t n;
+
+    entry = blc_lookup (g, path, block);
+    if (entry == NULL) {
+      const uint64_t last = (offset + size - 1) / BLC_BLOCK_SIZE;
+      size_t nr_blocks = last - block + 1 + readahead;
+
+      if (nr_blocks > BLC_MAX_READ_BLOCKS)
+        nr_blocks = BLC_MAX_READ_BLOCKS;
+      if (blc_fill (g, path, block, nr_blocks) == -1)
+        return done > 0 ? (int) done : -1;
+      entry = blc_lookup (g, path, block);
+      if (entry == NULL)
+        break;
+    }
 
-  time (&now);
+    if (block_offset >= entry->len)
+      break;
+    n = entry->len - block_offset;
+    if (n > size - done)
+      n = size - done;
+    memcpy (buf + done, entry->data + block_offset, n);
+    done += n;
 
-  entry = hash_lookup (g->xac_ht, &key);
-  if (entry && entry->c.timeout >= now)
-    return entry->xattrs;
-  else
-    return NULL;
+    if (entry->len < BLC_BLOCK_SIZE) /* end of file */
+      break;
+  }
+
+  return done;
 }
 
-static const char *
-rlc_lookup (guestfs_h *g, const char *pathname)
+/* Drop every cached block of 'path'.  The list is bounded by
+ * BLC_MAX_BLOCKS, so a linear scan is cheap enough.
+ */
+static void
+blc_invalidate (guestfs_h *g, const char *path)
 {
-  const struct entry_common key = { .pathname = (char *) pathname };
-  struct rlc_entry *entry;
-  time_t now;
+  struct blc_entry *entry, *next;
 
-  time (&now);
+  for (entry = g->blc_lru_head; entry != NULL; entry = next) {
+    next = entry->next;
+    if (STREQ (entry->c.pathname, path))
+      blc_remove (g, entry);
+  }
+}
 
-  entry = hash_lookup (g->rlc_ht, &key);
-  if (entry && entry->c.timeout >= now)
-    return entry->link;
-  else
-    return NULL;
+static void
+statvfs_cache_invalidate (guestfs_h *g)
+{
+  guestfs_free_statvfs (g->ml_statvfs);
+  free (g->ml_statvfs_path);
+  g->ml_statvfs = NULL;
+  g->ml_statvfs_path = NULL;
 }
 
 static void
-gen_remove (Hash_table *ht, const char *pathname, Hash_data_freer freer)
+dir_cache_invalidate (guestfs_h *g, const char *path)
 {
-  const struct entry_common key = { .pathname = (char *) pathname };
-  struct entry_common *entry;
+  size_t i;
+  bool found;
+  const char *p;
+
+  g->ml_generation++;
+  statvfs_cache_invalidate (g);
 
-  entry = hash_delete (ht, &key);
+  i = ac_find_slot (g, path, ac_hash (path), &found);
+  if (found)
+    ac_remove (g, i);
+  blc_invalidate (g, path);
 
-  freer (entry);
+  /* The listing of the parent directory, if prefetched, is out of
+   * date too.
+   */
+  p = strrchr (path, '/');
+  if (p != NULL && p[1] != '\0') {
+    CLEANUP_FREE char *parent =
+      p == path ? safe_strdup (g, "/") : safe_strndup (g, path, p - path);
+
+    i = ac_find_slot (g, parent, ac_hash (parent), &found);
+    if (found) {
+      struct ac_entry *entry = &g->ac_entries[g->ac_slots[i].entry-1];
+
+      if (entry->flags & AC_DIRENTS) {
+        guestfs_free_dirent_list (entry->dirents);
+        entry->flags &= ~AC_DIRENTS;
+      }
+    }
+  }
 }
 
+/* Invalidate everything cached below the directory 'path', when it
+ * is renamed.  Only prefetching caches more than one level, so
+ * without it there is nothing to do.
+ */
 static void
-dir_cache_invalidate (guestfs_h *g, const char *path)
+dir_cache_invalidate_tree (guestfs_h *g, const char *path)
 {
-  gen_remove (g->lsc_ht, path, lsc_free);
-  gen_remove (g->xac_ht, path, xac_free);
-  gen_remove (g->rlc_ht, path, rlc_free);
+  const size_t len = strlen (path);
+  size_t e;
+
+  if (g->ml_prefetch_depth == 0)
+    return;
+
+  g->ml_generation++;
+
+  for (e = 0; e < g->ac_nr_entries; ) {
+    const char *pathname = g->ac_entries[e].pathname;
+
+    if (strncmp (pathname, path, len) == 0 && pathname[len] == '/') {
+      /* ac_remove moves the last entry into slot 'e'. */
+      ac_remove (g, ac_slot_of_entry (g, e));
+      continue;
+    }
+    ++e;
+  }
 }
 
 #else /* !HAVE_FUSE */
@@ -32,6 +32,8 @@
 #ifndef GUESTFS_INTERNAL_ALL_H_
 #define GUESTFS_INTERNAL_ALL_H_
 
+#include <string.h>
+
 /* This is also defined in <guestfs.h>, so don't redefine it. */
 #if defined(__GNUC__) && !defined(GUESTFS_GCC_VERSION)
 # define GUESTFS_GCC_VERSION \
@@ -74,6 +76,29 @@
 #define xdr_uint32_t xdr_u_int32_t
 #endif
 
+/* Return true iff the buffer is all zero bytes.
+ *
+ * Once the first 16 bytes are known to be zero, the buffer is all
+ * zero iff it is equal to itself shifted by 16 bytes.  memcmp in
+ * glibc picks an SSE2 or AVX2 version for the CPU at run time, so
+ * this is much faster than testing a byte at a time.
+ */
+static inline int
+is_zero (const char *buffer, size_t size)
+{
+  const size_t limit = size < 16 ? size : 16;
+  size_t i;
+
+  for (i = 0; i < limit; ++i) {
+    if (buffer[i] != 0)
+      return 0;
+  }
+  if (size > limit)
+    return memcmp (buffer, buffer + 16, size - 16) == 0;
+
+  return 1;
+}
+
 /* Macro which compiles the regexp once when the program/library is
  * loaded, and frees it when the library is unloaded.
  */
@@ -112,4 +137,16 @@ typedef enum {
   MOUNTABLE_PATH        /* An already mounted path: device = path */
 } mountable_type_t;
 
+/* The bits in each byte returned by guestfs_internal_probe_paths.
+ * PROBE_IS_FILE and PROBE_IS_DIR use lstat, the PROBE_FOLLOW_* bits
+ * use stat.  PROBE_ERROR means the result is unknown.
+ */
+#define PROBE_EXISTS          1
+#define PROBE_IS_FILE         2
+#define PROBE_IS_DIR          4
+#define PROBE_IS_SYMLINK      8
+#define PROBE_FOLLOW_IS_FILE 16
+#define PROBE_FOLLOW_IS_DIR  32
+#define PROBE_ERROR         128
+
 #endif /* GUESTFS_INTERNAL_ALL_H_ */
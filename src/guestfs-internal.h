@@ -28,6 +28,7 @@
 #define GUESTFS_INTERNAL_H_
 
 #include <stdbool.h>
+#include <sys/uio.h>
 
 #include <rpc/types.h>  /* Needed on libc's different than glibc. */
 #include <rpc/xdr.h>
@@ -53,6 +54,10 @@
 #endif
 #endif
 
+#if HAVE_FUSE
+#include <pthread.h>
+#endif
+
 #include "hash.h"
 
 #include "guestfs-internal-frontend.h"
@@ -150,11 +155,13 @@
 #define VIRTIO_SCSI "virtio-scsi-pci"
 #define VIRTIO_SERIAL "virtio-serial-pci"
 #define VIRTIO_NET "virtio-net-pci"
+#define VIRTIO_BALLOON "virtio-balloon-pci"
 #else /* ARMv7 */
 #define VIRTIO_BLK "virtio-blk-device"
 #define VIRTIO_SCSI "virtio-scsi-device"
 #define VIRTIO_SERIAL "virtio-serial-device"
 #define VIRTIO_NET "virtio-net-device"
+#define VIRTIO_BALLOON "virtio-balloon-device"
 #endif /* ARMv7 */
 
 /* Machine types. */
@@ -187,6 +194,25 @@ struct event {
    * emulate the old-style callback API.
    */
   void *opaque2;
+
+  int flags;                    /* GUESTFS_EVENT_CALLBACK_* flags */
+
+  /* Log messages waiting to be delivered to a callback registered
+   * with GUESTFS_EVENT_CALLBACK_BUFFERED.  The buffer only holds
+   * messages of one event class (buffered_event) at a time.
+   */
+  uint64_t buffered_event;
+  char *buf;
+  size_t buf_len, buf_alloc;
+};
+
+/**
+ * The handles of the callbacks registered for one event class.  See
+ * C<g-E<gt>events_index> in the handle.
+ */
+struct event_index {
+  int *handles;
+  size_t len;
 };
 
 /* Drives added to the handle. */
@@ -373,6 +399,29 @@ struct connection_ops {
    * Returns: 1 = yes, 0 = no, -1 = error
    */
   int (*can_read_data) (guestfs_h *g, struct connection *);
+
+  /* Extra data channels which file transfer chunks may be striped
+   * across.  get_nr_channels returns the number of channels including
+   * the daemon socket, which is always channel 0.  read_channel and
+   * write_channel work like read_data and write_data on channel 'ch'.
+   */
+  size_t (*get_nr_channels) (guestfs_h *g, struct connection *);
+  ssize_t (*read_channel) (guestfs_h *g, struct connection *, size_t ch, void *buf, size_t len);
+  ssize_t (*write_channel) (guestfs_h *g, struct connection *, size_t ch, const void *buf, size_t len);
+
+  /* Like write_channel, but write all the buffers in 'iov' in order,
+   * with as few system calls as possible.  Channel 0 is the daemon
+   * socket.
+   */
+  ssize_t (*writev_channel) (guestfs_h *g, struct connection *, size_t ch, const struct iovec *iov, int iovcnt);
+
+  /* Move exactly 'len' bytes from channel 'ch' to 'fd', using
+   * splice(2) where possible so the data is not copied through
+   * userspace.  Returns: len = ok, 0 = connection closed, -1 = error
+   * (error is set).  If writing to 'fd' fails, the remaining bytes
+   * are still read and discarded, and -2 is returned with errno set.
+   */
+  ssize_t (*splice_channel) (guestfs_h *g, struct connection *, size_t ch, int fd, size_t len);
 };
 
 /**
@@ -384,6 +433,49 @@ struct error_cb_stack {
   void *                   error_cb_data;
 };
 
+/**
+ * An asynchronous call which has been submitted to the daemon but
+ * not yet collected by the caller.  C<buf> is C<NULL> until the
+ * reply arrives.  See F<src/proto.c>.
+ */
+struct async_call {
+  unsigned serial;
+  uint32_t size;
+  void *buf;
+};
+
+/**
+ * A buffer which a C<FileOut> is received into, so that library
+ * functions can read small files from the appliance without going
+ * through a temporary file.  C<data> is allocated by
+ * F<src/proto.c> and freed by the caller.  See C<g-E<gt>recv_buffer>.
+ *
+ * If C<chunk_cb> is set, the data is instead passed to the callback
+ * as each chunk arrives, so that large streams can be parsed
+ * incrementally.  The callback returns C<-1> (after setting the
+ * error) to cancel the transfer.
+ */
+struct recv_buffer {
+  char *data;
+  size_t size;
+  size_t alloc;
+  int (*chunk_cb) (guestfs_h *g, const char *buf, size_t len, void *opaque);
+  void *opaque;
+};
+
+/**
+ * A source of data for a C<FileIn>, so that library functions can
+ * send data which they generate without a temporary file or a
+ * subprocess.  C<read> fills C<buf> with up to C<len> bytes and
+ * returns the number of bytes, C<0> at the end, or C<-1> (after
+ * setting the error) to cancel the transfer.  See
+ * C<g-E<gt>send_source>.
+ */
+struct send_source {
+  ssize_t (*read) (guestfs_h *g, char *buf, size_t len, void *opaque);
+  void *opaque;
+};
+
 /**
  * Cache of queried features.
  *
@@ -394,6 +486,21 @@ struct cached_feature {
   int result;
 };
 
+/**
+ * Phases of launch which are timed, see C<guestfs_int_launch_phase>
+ * and L<guestfs(3)/guestfs_get_launch_stats>.
+ */
+enum launch_phase {
+  LAUNCH_PHASE_START,           /* guestfs_launch was called */
+  LAUNCH_PHASE_APPLIANCE,       /* appliance built or found */
+  LAUNCH_PHASE_HYPERVISOR,      /* qemu or the libvirt domain started */
+  LAUNCH_PHASE_KERNEL,          /* appliance kernel booting */
+  LAUNCH_PHASE_INIT,            /* appliance /init script started */
+  LAUNCH_PHASE_UDEV,            /* udev settled in the appliance */
+  LAUNCH_PHASE_DAEMON,          /* daemon is ready */
+  NR_LAUNCH_PHASES
+};
+
 /**
  * The libguestfs handle.
  */
@@ -414,6 +521,15 @@ struct guestfs_h {
 
   int smp;                      /* If > 1, -smp flag passed to hv. */
   int memsize;			/* Size of RAM (megabytes). */
+  bool smp_set;                 /* smp or memsize set by the caller, so */
+  bool memsize_set;             /* not chosen by automatic sizing. */
+  const char *sizing;           /* Automatic sizing of the appliance, or
+                                   NULL for manual (static string). */
+  bool appliance_counted;       /* Counted in the number of appliances. */
+  bool iothread;                /* Run disk controllers in iothreads. */
+  const char *aio;              /* aio mode for host block devices, or
+                                   NULL for the default (static string). */
+  bool minimal_appliance;       /* Boot the appliance without udev. */
 
   char *path;			/* Path to the appliance. */
   char *hv;			/* Hypervisor (HV) binary. */
@@ -448,6 +564,33 @@ struct guestfs_h {
   for (i = 0; i < (g)->nr_drives; ++i)    \
     if (((drv) = (g)->drives[i]) != NULL)
 
+  /* Milliseconds from launch_t to each phase of the last launch, or
+   * -1 if the phase was not seen.  See guestfs_int_launch_phase.
+   */
+  int64_t launch_phases[NR_LAUNCH_PHASES];
+
+  /* If not NULL, the next FileOut is received into this buffer
+   * instead of being written to the named file.  See
+   * guestfs_int_recv_file.
+   */
+  struct recv_buffer *recv_buffer;
+
+  /* If not NULL, the next FileIn is read from this source instead
+   * of the named file.  See guestfs_int_send_file.
+   */
+  struct send_source *send_source;
+
+  /* Per-procedure RPC statistics, or NULL if not enabled.  See
+   * src/rpc-stats.c.
+   */
+  struct rpc_stats *rpc_stats;
+
+  /* True while add_domain is hot-adding drives.  add_drive does not
+   * wait for each drive to appear in the appliance, add_domain waits
+   * for all of them at the end.
+   */
+  bool hotplug_defer_wait;
+
   /* Backend.  NB: Use guestfs_int_set_backend to change the backend. */
   char *backend;                /* The full string, always non-NULL. */
   char *backend_arg;            /* Pointer to the argument part. */
@@ -465,11 +608,17 @@ struct guestfs_h {
    */
   char *tmpdir;
   char *sockdir;
+  /* Hard linked copy of the supermin appliance used while another
+   * process is rebuilding it (see appliance.c), or NULL.
+   */
+  char *appliance_snapshot;
   /* Environment variables that affect tmpdir/cachedir/sockdir locations. */
   char *env_tmpdir;             /* $TMPDIR (NULL if not set) */
   char *env_runtimedir;         /* $XDG_RUNTIME_DIR (NULL if not set)*/
   char *int_tmpdir;   /* $LIBGUESTFS_TMPDIR or guestfs_set_tmpdir or NULL */
   char *int_cachedir; /* $LIBGUESTFS_CACHEDIR or guestfs_set_cachedir or NULL */
+  char *inspect_cachedir;       /* $LIBGUESTFS_INSPECT_CACHE or NULL */
+  unsigned inspect_cache_size_mb; /* $LIBGUESTFS_INSPECT_CACHE_SIZE or 0 */
 
   /* Error handler, plus stack of old error handlers. */
   guestfs_error_handler_cb   error_cb;
@@ -483,12 +632,27 @@ struct guestfs_h {
   struct event *events;
   size_t nr_events;
 
+  /* The callbacks for each event class, indexed by the bit number of
+   * the event, so that raising an event does not have to scan every
+   * callback.  Entries are only ever added, so it may also contain
+   * callbacks which have since been deleted.
+   */
+  struct event_index events_index[64];
+
   /* Information gathered by inspect_os.  Must be freed by calling
    * guestfs_int_free_inspect_info.
    */
   struct inspect_fs *fses;
   size_t nr_fses;
 
+  /* Results of probing the filesystem currently being inspected (one
+   * byte for each path in probe_paths in inspect-fs.c), or NULL.
+   */
+  char *inspect_probe;
+
+  /* True while inspect_os is running with defer=true. */
+  bool inspect_defer;
+
   /* Private data area. */
   struct hash_table *pda;
   struct pda_entry *pda_next;
@@ -498,6 +662,14 @@ struct guestfs_h {
    */
   int user_cancel;
 
+  /* guestfs_user_cancel also writes a byte to this pipe, so that a
+   * thread waiting for a reply (see read_fd in conn-socket.c) wakes
+   * up and forwards the cancellation to the daemon.
+   * 'reply_cancellable' is set while such a wait is possible.
+   */
+  int cancel_pipe[2];
+  int reply_cancellable;
+
   struct timeval launch_t;      /* The time that we called guestfs_launch. */
 
   /* Used by bindtests. */
@@ -512,15 +684,55 @@ struct guestfs_h {
   /*** Protocol. ***/
   struct connection *conn;              /* Connection to appliance. */
   int msg_next_serial;
+  size_t chunk_size;            /* Negotiated FileIn/FileOut chunk size. */
+  size_t nr_data_channels;      /* Channels that chunks are striped across. */
+  size_t next_data_channel;     /* Channel for the next chunk. */
+  int remote_appliance;         /* Set by backends if the appliance is remote. */
+  int chunk_codecs;             /* Negotiated GUESTFS_CODEC_* flags. */
+  void *zstd_cctx;              /* ZSTD_CCtx for compressing chunks. */
+  void *zstd_dctx;              /* ZSTD_DCtx for decompressing chunks. */
+  char *codec_buf;              /* Buffer for compressed chunks. */
+  struct async_call *async_calls;       /* Calls submitted asynchronously. */
+  size_t nr_async_calls;
+  char *send_buf;               /* Reusable buffer for outgoing messages. */
+
+  /* Progress messages are dropped to honour these limits (see
+   * guestfs_set_progress_interval and guestfs_set_progress_delta).
+   * progress_* record the last progress message passed on.
+   */
+  int progress_interval;        /* Milliseconds, 0 = no limit. */
+  int progress_delta;           /* Thousandths of total, 0 = no limit. */
+  uint32_t progress_proc, progress_serial;
+  uint64_t progress_position;
+  struct timeval progress_t;
+  size_t send_buf_size;
 
 #if HAVE_FUSE
   /**** Used by the mount-local APIs. ****/
   const char *localmountpoint;
   struct fuse *fuse;                    /* FUSE handle. */
   int ml_dir_cache_timeout;             /* Directory cache timeout. */
-  Hash_table *lsc_ht, *xac_ht, *rlc_ht; /* Directory cache. */
+  struct ac_slot *ac_slots;             /* Attribute cache, see fuse.c. */
+  size_t ac_nr_slots;
+  struct ac_entry *ac_entries;
+  size_t ac_nr_entries, ac_alloc_entries;
+  size_t *ac_heap;                      /* Expiry heap of ac_entries. */
+  Hash_table *blc_ht;                   /* Block cache. */
+  struct blc_entry *blc_lru_head, *blc_lru_tail;
+  size_t blc_nr_blocks;
+  struct guestfs_statvfs *ml_statvfs;   /* Cached statfs result. */
+  char *ml_statvfs_path;
+  time_t ml_statvfs_timeout;
   int ml_read_only;                     /* If mounted read-only. */
   int ml_debug_calls;        /* Extra debug info on each FUSE call. */
+  int ml_writeback;                     /* If writes are coalesced. */
+  struct ml_file *ml_dirty_files;       /* Files with pending writes. */
+  int ml_multithreaded;                 /* If using fuse_loop_mt. */
+  pthread_mutex_t ml_lock;              /* See ml_enter in fuse.c. */
+  pthread_cond_t ml_cond;
+  unsigned ml_next_ticket, ml_now_serving;
+  unsigned ml_generation;               /* Bumped on cache invalidation. */
+  int ml_prefetch_depth;                /* Levels fetched by readdir. */
 #endif
 
 #ifdef HAVE_LIBVIRT_BACKEND
@@ -667,8 +879,18 @@ struct inspect_fs {
   int is_multipart_disk;
   struct inspect_fstab_entry *fstab;
   size_t nr_fstab;
+  char *cache_key;              /* Key in the inspection cache, or NULL. */
+  int deferred;                 /* INSPECT_DEFER_* checks not done yet. */
 };
 
+/* Checks skipped by inspect_os when called with defer=true.  They are
+ * done by guestfs_int_inspect_complete when one of the inspect_get_*
+ * calls first needs the fields they set.
+ */
+#define INSPECT_DEFER_ARCH      1 /* arch */
+#define INSPECT_DEFER_HOSTNAME  2 /* hostname, Windows drive mappings and
+                                   * current control set */
+
 struct inspect_fstab_entry {
   char *mountable;
   char *mountpoint;
@@ -680,6 +902,7 @@ struct guestfs_progress;
 
 /* handle.c */
 extern int guestfs_int_get_backend_setting_bool (guestfs_h *g, const char *name);
+extern int guestfs_int_get_backend_setting_int (guestfs_h *g, const char *name, int dflt);
 
 /* alloc.c */
 extern void *guestfs_int_safe_malloc (guestfs_h *g, size_t nbytes);
@@ -791,8 +1014,13 @@ extern void guestfs_int_cleanup_free_stringsbuf (struct stringsbuf *sb);
 
 /* proto.c */
 extern int guestfs_int_send (guestfs_h *g, int proc_nr, uint64_t progress_hint, uint64_t optargs_bitmask, xdrproc_t xdrp, char *args);
-extern int guestfs_int_recv (guestfs_h *g, const char *fn, struct guestfs_message_header *hdr, struct guestfs_message_error *err, xdrproc_t xdrp, char *ret);
-extern int guestfs_int_recv_discard (guestfs_h *g, const char *fn);
+extern int guestfs_int_recv (guestfs_h *g, const char *fn, unsigned serial, struct guestfs_message_header *hdr, struct guestfs_message_error *err, xdrproc_t xdrp, char *ret);
+extern int guestfs_int_recv_discard (guestfs_h *g, const char *fn, unsigned serial);
+extern int guestfs_int_submit (guestfs_h *g, int proc_nr, xdrproc_t xdrp, char *args);
+extern int guestfs_int_wait (guestfs_h *g, const char *fn, unsigned serial, struct guestfs_message_header *hdr, struct guestfs_message_error *err, xdrproc_t xdrp, char *ret);
+extern void guestfs_int_free_async_calls (guestfs_h *g);
+extern int guestfs_int_init_chunk_codecs (guestfs_h *g, int codecs);
+extern void guestfs_int_free_chunk_codecs (guestfs_h *g);
 extern int guestfs_int_send_file (guestfs_h *g, const char *filename);
 extern int guestfs_int_recv_file (guestfs_h *g, const char *filename);
 extern int guestfs_int_recv_from_daemon (guestfs_h *g, uint32_t *size_rtn, void **buf_rtn);
@@ -802,11 +1030,14 @@ extern void guestfs_int_log_message_callback (guestfs_h *g, const char *buf, siz
 /* conn-socket.c */
 extern struct connection *guestfs_int_new_conn_socket_listening (guestfs_h *g, int daemon_accept_sock, int console_sock);
 extern struct connection *guestfs_int_new_conn_socket_connected (guestfs_h *g, int daemon_sock, int console_sock);
+extern int guestfs_int_conn_socket_add_channel (guestfs_h *g, struct connection *conn, int accept_sock);
 
 /* events.c */
 extern void guestfs_int_call_callbacks_void (guestfs_h *g, uint64_t event);
 extern void guestfs_int_call_callbacks_message (guestfs_h *g, uint64_t event, const char *buf, size_t buf_len);
 extern void guestfs_int_call_callbacks_array (guestfs_h *g, uint64_t event, const uint64_t *array, size_t array_len);
+extern void guestfs_int_flush_event_buffers (guestfs_h *g);
+extern void guestfs_int_free_events (guestfs_h *g);
 
 /* tmpdirs.c */
 extern int guestfs_int_set_env_tmpdir (guestfs_h *g, const char *envname, const char *tmpdir);
@@ -838,6 +1069,7 @@ const char *guestfs_int_get_cpu_model (int kvm);
 /* appliance-kcmdline.c */
 extern char *guestfs_int_appliance_command_line (guestfs_h *g, const char *appliance_dev, int flags);
 #define APPLIANCE_COMMAND_LINE_IS_TCG 1
+#define APPLIANCE_COMMAND_LINE_NO_UDEV 2
 
 /* appliance-uefi.c */
 extern int guestfs_int_get_uefi (guestfs_h *g, char **code, char **vars, int *flags);
@@ -845,7 +1077,13 @@ extern int guestfs_int_get_uefi (guestfs_h *g, char **code, char **vars, int *fl
 /* launch.c */
 extern int64_t guestfs_int_timeval_diff (const struct timeval *x, const struct timeval *y);
 extern void guestfs_int_launch_send_progress (guestfs_h *g, int perdozen);
+extern void guestfs_int_launch_phase (guestfs_h *g, enum launch_phase phase);
+extern void guestfs_int_appliance_stopped (guestfs_h *g);
 int guestfs_int_create_socketname (guestfs_h *g, const char *filename, char (*sockname)[UNIX_PATH_MAX]);
+extern int guestfs_int_create_listening_socket (guestfs_h *g, const char *sockpath);
+extern int guestfs_int_get_nr_data_channels (guestfs_h *g);
+extern int guestfs_int_check_bridge_exists (guestfs_h *g, const char *brname);
+extern int guestfs_int_get_appliance_placement (guestfs_h *g, char **cpus_ret, int *node_ret);
 extern void guestfs_int_register_backend (const char *name, const struct backend_ops *);
 extern int guestfs_int_set_backend (guestfs_h *g, const char *method);
 
@@ -858,8 +1096,12 @@ extern int guestfs_int_is_partition (guestfs_h *g, const char *partition);
 /* inspect-fs.c */
 extern int guestfs_int_is_file_nocase (guestfs_h *g, const char *);
 extern int guestfs_int_is_dir_nocase (guestfs_h *g, const char *);
+extern int guestfs_int_probe_is_file (guestfs_h *g, const char *path, int followsymlinks);
+extern int guestfs_int_probe_is_dir (guestfs_h *g, const char *path);
+extern int guestfs_int_probe_is_symlink (guestfs_h *g, const char *path);
 extern int guestfs_int_check_for_filesystem_on (guestfs_h *g,
-                                              const char *mountable);
+                                              const char *mountable,
+                                              const char *vfs_type);
 extern int guestfs_int_parse_unsigned_int (guestfs_h *g, const char *str);
 extern int guestfs_int_parse_unsigned_int_ignore_trailing (guestfs_h *g, const char *str);
 extern int guestfs_int_parse_major_minor (guestfs_h *g, struct inspect_fs *fs);
@@ -868,6 +1110,7 @@ extern int guestfs_int_first_egrep_of_file (guestfs_h *g, const char *filename,
 extern void guestfs_int_check_package_format (guestfs_h *g, struct inspect_fs *fs);
 extern void guestfs_int_check_package_management (guestfs_h *g, struct inspect_fs *fs);
 extern void guestfs_int_merge_fs_inspections (guestfs_h *g, struct inspect_fs *dst, struct inspect_fs *src);
+extern int guestfs_int_inspect_complete (guestfs_h *g, struct inspect_fs *fs);
 
 /* inspect-fs-unix.c */
 extern int guestfs_int_check_linux_root (guestfs_h *g, struct inspect_fs *fs);
@@ -879,11 +1122,28 @@ extern int guestfs_int_check_hurd_root (guestfs_h *g, struct inspect_fs *fs);
 extern int guestfs_int_check_minix_root (guestfs_h *g, struct inspect_fs *fs);
 extern int guestfs_int_check_coreos_root (guestfs_h *g, struct inspect_fs *fs);
 extern int guestfs_int_check_coreos_usr (guestfs_h *g, struct inspect_fs *fs);
+extern int guestfs_int_check_unix_deferred (guestfs_h *g, struct inspect_fs *fs, int what);
 
 /* inspect-fs-windows.c */
 extern char *guestfs_int_case_sensitive_path_silently (guestfs_h *g, const char *);
 extern char * guestfs_int_get_windows_systemroot (guestfs_h *g);
 extern int guestfs_int_check_windows_root (guestfs_h *g, struct inspect_fs *fs, char *windows_systemroot);
+extern char *guestfs_int_utf16_to_utf8 (/* const */ char *input, size_t len);
+extern int guestfs_int_check_windows_deferred (guestfs_h *g, struct inspect_fs *fs, int what);
+
+/* inspect-cache.c */
+extern char *guestfs_int_inspect_cache_key (guestfs_h *g, const char *mountable, const struct guestfs_internal_mountable *m, const char *vfs_type);
+extern char *guestfs_int_inspect_cache_apps_key (guestfs_h *g, const struct inspect_fs *fs);
+extern int guestfs_int_inspect_cache_load_fs (guestfs_h *g, const char *key, struct inspect_fs *fs);
+extern void guestfs_int_inspect_cache_save_fs (guestfs_h *g, const char *key, const struct inspect_fs *fs);
+extern struct guestfs_application2_list *guestfs_int_inspect_cache_load_apps (guestfs_h *g, const char *key);
+extern void guestfs_int_inspect_cache_save_apps (guestfs_h *g, const char *key, const struct guestfs_application2_list *apps);
+extern char *guestfs_int_inspect_cache_icon_key (guestfs_h *g, const char *filename, const char *method);
+extern char *guestfs_int_inspect_cache_load_icon (guestfs_h *g, const char *key, size_t *size_r);
+extern void guestfs_int_inspect_cache_save_icon (guestfs_h *g, const char *key, const char *icon, size_t size);
+extern char *guestfs_int_inspect_cache_file_key (guestfs_h *g, const struct inspect_fs *fs, const char *filename, const struct guestfs_statns *statbuf);
+extern int guestfs_int_inspect_cache_load_file (guestfs_h *g, const char *key, const char *localfile);
+extern void guestfs_int_inspect_cache_save_file (guestfs_h *g, const char *key, const char *localfile);
 
 /* inspect-fs-cd.c */
 extern int guestfs_int_check_installer_root (guestfs_h *g, struct inspect_fs *fs);
@@ -893,9 +1153,27 @@ extern int guestfs_int_check_installer_iso (guestfs_h *g, struct inspect_fs *fs,
 typedef int (*guestfs_int_db_dump_callback) (guestfs_h *g, const unsigned char *key, size_t keylen, const unsigned char *value, size_t valuelen, void *opaque);
 extern int guestfs_int_read_db_dump (guestfs_h *g, const char *dumpfile, void *opaque, guestfs_int_db_dump_callback callback);
 
+/* info.c */
+struct disk_range {
+  int64_t start, length;
+};
+extern ssize_t guestfs_int_disk_zero_ranges (guestfs_h *g, const char *filename, const char *format, struct disk_range **ranges_r);
+
 /* lpj.c */
 extern int guestfs_int_get_lpj (guestfs_h *g);
 
+/* tar-writer.c */
+struct tar_writer;
+extern struct tar_writer *guestfs_int_new_tar_writer (guestfs_h *g, char *const *paths);
+extern ssize_t guestfs_int_tar_writer_read (guestfs_h *g, char *buf, size_t len, void *twv);
+extern void guestfs_int_free_tar_writer (struct tar_writer *tw);
+
+/* rpc-stats.c */
+extern void guestfs_int_rpc_stats_send (guestfs_h *g, int proc_nr, unsigned serial, size_t bytes);
+extern void guestfs_int_rpc_stats_reply (guestfs_h *g, const char *fn, unsigned serial, size_t bytes, int is_error);
+extern void guestfs_int_rpc_stats_file (guestfs_h *g, size_t bytes);
+extern void guestfs_int_free_rpc_stats (guestfs_h *g);
+
 /* fuse.c */
 #if HAVE_FUSE
 extern void guestfs_int_free_fuse (guestfs_h *g);
@@ -933,10 +1211,15 @@ struct osinfo {
 };
 extern int guestfs_int_osinfo_map (guestfs_h *g, const struct guestfs_isoinfo *isoinfo, const struct osinfo **osinfo_ret);
 
+/* pe.c */
+extern char *guestfs_int_pe_read_resource (guestfs_h *g, const char *filename, int type, int name, size_t max_size, size_t *size_r);
+
+/* png.c */
+extern char *guestfs_int_dib_to_png (guestfs_h *g, const char *dib, size_t len, int max_height, size_t *size_r);
+
 /* command.c */
 struct command;
 typedef void (*cmd_stdout_callback) (guestfs_h *g, void *data, const char *line, size_t len);
-typedef int (*cmd_child_callback) (guestfs_h *g, void *data);
 extern struct command *guestfs_int_new_command (guestfs_h *g);
 extern void guestfs_int_cmd_add_arg (struct command *, const char *arg);
 extern void guestfs_int_cmd_add_arg_format (struct command *, const char *fs, ...)
@@ -951,7 +1234,8 @@ extern void guestfs_int_cmd_set_stderr_to_stdout (struct command *);
 extern void guestfs_int_cmd_set_child_rlimit (struct command *, int resource, long limit);
 extern void guestfs_int_cmd_clear_capture_errors (struct command *);
 extern void guestfs_int_cmd_clear_close_files (struct command *);
-extern void guestfs_int_cmd_set_child_callback (struct command *, cmd_child_callback child_callback, void *data);
+extern void guestfs_int_cmd_add_child_chdir (struct command *, const char *dir);
+extern void guestfs_int_cmd_add_child_mkdir (struct command *, const char *dir);
 extern int guestfs_int_cmd_run (struct command *);
 extern void guestfs_int_cmd_close (struct command *);
 extern int guestfs_int_cmd_pipe_run (struct command *cmd, const char *mode);
@@ -976,14 +1260,25 @@ void guestfs_int_init_unix_backend (void) __attribute__((constructor));
 /* qemu.c */
 struct qemu_data;
 extern struct qemu_data *guestfs_int_test_qemu (guestfs_h *g, struct version *qemu_version);
-extern int guestfs_int_qemu_supports (guestfs_h *g, const struct qemu_data *, const char *option);
-extern int guestfs_int_qemu_supports_device (guestfs_h *g, const struct qemu_data *, const char *device_name);
+extern int guestfs_int_qemu_supports (guestfs_h *g, struct qemu_data *, const char *option);
+extern int guestfs_int_qemu_supports_device (guestfs_h *g, struct qemu_data *, const char *device_name);
 extern int guestfs_int_qemu_supports_virtio_scsi (guestfs_h *g, struct qemu_data *, const struct version *qemu_version);
 extern char *guestfs_int_drive_source_qemu_param (guestfs_h *g, const struct drive_source *src);
 extern bool guestfs_int_discard_possible (guestfs_h *g, struct drive *drv, const struct version *qemu_version);
+extern const char *guestfs_int_drive_aio (guestfs_h *g, struct drive *drv, const struct version *qemu_version);
 extern char *guestfs_int_qemu_escape_param (guestfs_h *g, const char *param);
 extern void guestfs_int_free_qemu_data (struct qemu_data *);
 
+/* storage-proxy.c */
+extern bool guestfs_int_use_storage_proxy (guestfs_h *g, const struct drive *drv);
+extern char *guestfs_int_storage_proxy_param (guestfs_h *g, struct drive *drv);
+
+/* qmp.c */
+extern int guestfs_int_qmp_accept (guestfs_h *g, int accept_sock, pid_t pid);
+extern int guestfs_int_qmp_command (guestfs_h *g, int sock, char **reply_rtn, const char *fs, ...) __attribute__((format (printf,4,5)));
+extern int guestfs_int_qmp_match (guestfs_h *g, const char *reply, const char *key, const char *value);
+extern char *guestfs_int_qmp_quote (guestfs_h *g, const char *str);
+
 /* guid.c */
 extern int guestfs_int_validate_guid (const char *);
 
@@ -26,6 +26,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include <libintl.h>
 
 #include <libxml/parser.h>
@@ -35,6 +38,7 @@
 #include "ignore-value.h"
 #include "c-ctype.h"
 #include "getprogname.h"
+#include "xstrtol.h"
 
 #include "guestfs.h"
 #include "guestfs-internal.h"
@@ -82,6 +86,7 @@ guestfs_h *
 guestfs_create_flags (unsigned flags, ...)
 {
   guestfs_h *g;
+  size_t i;
 
   g = calloc (1, sizeof (*g));
   if (!g) return NULL;
@@ -90,6 +95,10 @@ guestfs_create_flags (unsigned flags, ...)
 
   g->conn = NULL;
 
+  g->cancel_pipe[0] = g->cancel_pipe[1] = -1;
+  if (pipe2 (g->cancel_pipe, O_CLOEXEC|O_NONBLOCK) == -1)
+    goto error;
+
   guestfs_int_init_error_handler (g);
   g->abort_cb = abort;
 
@@ -103,9 +112,17 @@ guestfs_create_flags (unsigned flags, ...)
    */
   g->msg_next_serial = 0x00123400;
 
+  /* Until negotiated with the daemon, use the default chunk size. */
+  g->chunk_size = GUESTFS_DEFAULT_CHUNK_SIZE;
+  g->nr_data_channels = 1;
+
   /* Default is uniprocessor appliance. */
   g->smp = 1;
 
+  /* The handle has not been launched, so no launch phases were seen. */
+  for (i = 0; i < NR_LAUNCH_PHASES; ++i)
+    g->launch_phases[i] = -1;
+
   g->path = strdup (GUESTFS_DEFAULT_PATH);
   if (!g->path) goto error;
 
@@ -169,6 +186,10 @@ guestfs_create_flags (unsigned flags, ...)
   free (g->path);
   free (g->hv);
   free (g->append);
+  if (g->cancel_pipe[0] >= 0) {
+    close (g->cancel_pipe[0]);
+    close (g->cancel_pipe[1]);
+  }
   free (g);
   return NULL;
 }
@@ -217,6 +238,14 @@ parse_environment (guestfs_h *g,
       return -1;
   }
 
+  str = do_getenv (data, "LIBGUESTFS_INSPECT_CACHE");
+  free (g->inspect_cachedir);
+  g->inspect_cachedir = str && STRNEQ (str, "") ? safe_strdup (g, str) : NULL;
+
+  str = do_getenv (data, "LIBGUESTFS_INSPECT_CACHE_SIZE");
+  if (str == NULL || sscanf (str, "%u", &g->inspect_cache_size_mb) != 1)
+    g->inspect_cache_size_mb = 0;
+
   str = do_getenv (data, "TMPDIR");
   if (guestfs_int_set_env_tmpdir (g, "TMPDIR", str) == -1)
     return -1;
@@ -250,6 +279,12 @@ parse_environment (guestfs_h *g,
     }
   }
 
+  str = do_getenv (data, "LIBGUESTFS_SIZING");
+  if (str && STRNEQ (str, "")) {
+    if (guestfs_set_sizing (g, str) == -1)
+      return -1;
+  }
+
   str = do_getenv (data, "LIBGUESTFS_BACKEND");
   if (str && STRNEQ (str, "")) {
     if (guestfs_set_backend (g, str) == -1)
@@ -346,8 +381,11 @@ guestfs_close (guestfs_h *g)
 
   if (g->state != CONFIG)
     shutdown_backend (g, 0);
+  else
+    guestfs_int_appliance_stopped (g);
 
   /* Run user close callbacks. */
+  guestfs_int_flush_event_buffers (g);
   guestfs_int_call_callbacks_void (g, GUESTFS_EVENT_CLOSE);
 
   /* Test output file used by bindtests. */
@@ -357,13 +395,18 @@ guestfs_close (guestfs_h *g)
   /* Remove temporary directories. */
   guestfs_int_remove_tmpdir (g);
   guestfs_int_remove_sockdir (g);
+  if (g->appliance_snapshot)
+    guestfs_int_recursive_remove_dir (g, g->appliance_snapshot);
 
   /* Mark the handle as dead and then free up all memory. */
   g->state = NO_HANDLE;
 
-  free (g->events);
-  g->nr_events = 0;
-  g->events = NULL;
+  guestfs_int_free_events (g);
+
+  free (g->send_buf);
+
+  close (g->cancel_pipe[0]);
+  close (g->cancel_pipe[1]);
 
 #if HAVE_FUSE
   guestfs_int_free_fuse (g);
@@ -386,10 +429,13 @@ guestfs_close (guestfs_h *g)
     hash_free (g->pda);
   free (g->tmpdir);
   free (g->sockdir);
+  free (g->appliance_snapshot);
+  guestfs_int_free_rpc_stats (g);
   free (g->env_tmpdir);
   free (g->env_runtimedir);
   free (g->int_tmpdir);
   free (g->int_cachedir);
+  free (g->inspect_cachedir);
   free (g->last_error);
   free (g->identifier);
   free (g->program);
@@ -435,6 +481,9 @@ shutdown_backend (guestfs_h *g, int check_for_errors)
   int ret = 0;
   size_t i;
 
+  /* This is done even if the appliance has died already. */
+  guestfs_int_appliance_stopped (g);
+
   if (g->state == CONFIG)
     return 0;
 
@@ -456,6 +505,11 @@ shutdown_backend (guestfs_h *g, int check_for_errors)
 
   guestfs_int_free_drives (g);
 
+  g->chunk_size = GUESTFS_DEFAULT_CHUNK_SIZE;
+  g->nr_data_channels = 1;
+  guestfs_int_free_chunk_codecs (g);
+  guestfs_int_free_async_calls (g);
+
   for (i = 0; i < g->nr_features; ++i)
     free (g->features[i].group);
   free (g->features);
@@ -590,6 +644,7 @@ guestfs_impl_set_memsize (guestfs_h *g, int memsize)
     return -1;
   }
   g->memsize = memsize;
+  g->memsize_set = true;
   return 0;
 }
 
@@ -599,6 +654,51 @@ guestfs_impl_get_memsize (guestfs_h *g)
   return g->memsize;
 }
 
+int
+guestfs_impl_set_progress_interval (guestfs_h *g, int interval)
+{
+  if (interval < 0) {
+    error (g, _("progress interval must be >= 0"));
+    return -1;
+  }
+  g->progress_interval = interval;
+
+  /* Ask a running daemon to send fewer messages.  Older appliances
+   * don't implement this, which doesn't matter since the library
+   * drops the extra messages anyway.
+   */
+  if (g->state == READY) {
+    guestfs_push_error_handler (g, NULL, NULL);
+    guestfs_internal_set_progress_interval (g, interval);
+    guestfs_pop_error_handler (g);
+  }
+
+  return 0;
+}
+
+int
+guestfs_impl_get_progress_interval (guestfs_h *g)
+{
+  return g->progress_interval;
+}
+
+int
+guestfs_impl_set_progress_delta (guestfs_h *g, int delta)
+{
+  if (delta < 0 || delta > 1000) {
+    error (g, _("progress delta must be between 0 and 1000"));
+    return -1;
+  }
+  g->progress_delta = delta;
+  return 0;
+}
+
+int
+guestfs_impl_get_progress_delta (guestfs_h *g)
+{
+  return g->progress_delta;
+}
+
 int
 guestfs_impl_set_selinux (guestfs_h *g, int selinux)
 {
@@ -894,6 +994,37 @@ guestfs_int_get_backend_setting_bool (guestfs_h *g, const char *name)
   return b;
 }
 
+/**
+ * Like C<guestfs_int_get_backend_setting_bool>, but parse the setting
+ * as a non-negative integer.  If the setting is not present, returns
+ * C<dflt>.  Returns C<-1> (with an error) if the setting cannot be
+ * parsed.
+ */
+int
+guestfs_int_get_backend_setting_int (guestfs_h *g, const char *name, int dflt)
+{
+  CLEANUP_FREE char *value = NULL;
+  long n;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  value = guestfs_get_backend_setting (g, name);
+  guestfs_pop_error_handler (g);
+
+  if (value == NULL && guestfs_last_errno (g) == ESRCH)
+    return dflt;
+
+  if (value == NULL)
+    return -1;
+
+  if (xstrtol (value, NULL, 10, &n, "") != LONGINT_OK ||
+      n < 0 || n > INT_MAX) {
+    error (g, _("could not parse backend setting %s=%s"), name, value);
+    return -1;
+  }
+
+  return (int) n;
+}
+
 int
 guestfs_impl_set_pgroup (guestfs_h *g, int v)
 {
@@ -915,6 +1046,7 @@ guestfs_impl_set_smp (guestfs_h *g, int v)
     return -1;
   } else if (v >= 1) {
     g->smp = v;
+    g->smp_set = true;
     return 0;
   } else {
     error (g, "invalid smp parameter: %d", v);
@@ -927,3 +1059,85 @@ guestfs_impl_get_smp (guestfs_h *g)
 {
   return g->smp;
 }
+
+int
+guestfs_impl_set_iothread (guestfs_h *g, int v)
+{
+  g->iothread = !!v;
+  return 0;
+}
+
+int
+guestfs_impl_get_iothread (guestfs_h *g)
+{
+  return g->iothread;
+}
+
+int
+guestfs_impl_set_aio (guestfs_h *g, const char *aio)
+{
+  if (STREQ (aio, "") || STREQ (aio, "threads"))
+    g->aio = NULL;
+  else if (STREQ (aio, "native"))
+    g->aio = "native";
+  else if (STREQ (aio, "io_uring"))
+    g->aio = "io_uring";
+  else {
+    error (g, _("invalid aio mode: %s (must be threads, native or io_uring)"),
+           aio);
+    return -1;
+  }
+  return 0;
+}
+
+const char *
+guestfs_impl_get_aio (guestfs_h *g)
+{
+  return g->aio ? g->aio : "threads";
+}
+
+int
+guestfs_impl_set_appliance_profile (guestfs_h *g, const char *profile)
+{
+  if (STREQ (profile, "default"))
+    g->minimal_appliance = false;
+  else if (STREQ (profile, "minimal"))
+    g->minimal_appliance = true;
+  else {
+    error (g, _("invalid appliance profile: %s (must be default or minimal)"),
+           profile);
+    return -1;
+  }
+  return 0;
+}
+
+const char *
+guestfs_impl_get_appliance_profile (guestfs_h *g)
+{
+  return g->minimal_appliance ? "minimal" : "default";
+}
+
+int
+guestfs_impl_set_sizing (guestfs_h *g, const char *sizing)
+{
+  if (STREQ (sizing, "manual"))
+    g->sizing = NULL;
+  else if (STREQ (sizing, "auto"))
+    g->sizing = "auto";
+  else if (STREQ (sizing, "metadata"))
+    g->sizing = "metadata";
+  else if (STREQ (sizing, "bulk"))
+    g->sizing = "bulk";
+  else {
+    error (g, _("invalid sizing: %s (must be manual, auto, metadata or bulk)"),
+           sizing);
+    return -1;
+  }
+  return 0;
+}
+
+const char *
+guestfs_impl_get_sizing (guestfs_h *g)
+{
+  return g->sizing ? g->sizing : "manual";
+}
@@ -28,6 +28,7 @@
 #include <sys/wait.h>
 #include <assert.h>
 #include <string.h>
+#include <endian.h>
 #include <libintl.h>
 
 #ifdef HAVE_SYS_TIME_H
@@ -40,6 +41,8 @@
 
 #include <yajl/yajl_tree.h>
 
+#include "glthread/lock.h"
+
 #include "guestfs.h"
 #include "guestfs-internal.h"
 #include "guestfs-internal-actions.h"
@@ -57,118 +60,314 @@ cleanup_yajl_tree_free (void *ptr)
 #define CLEANUP_YAJL_TREE_FREE
 #endif
 
-static yajl_val get_json_output (guestfs_h *g, const char *filename);
+static yajl_val get_json_output (guestfs_h *g, const char *subcmd, const char *filename, const char *format);
+static yajl_val run_qemu_img_json (guestfs_h *g, const char *subcmd, int fd, const char *filename, const char *format);
 static void set_child_rlimits (struct command *);
 
+/* The results of 'qemu-img info' for a file.  Tools often ask about
+ * the same images many times (and guestfs_disk_format is called for
+ * each drive added without a format), so the results for regular
+ * files are kept in a small process-wide cache, and the common raw
+ * and qcow2 cases are worked out by reading the header of the file
+ * instead of running qemu-img.
+ */
+struct disk_info {
+  /* Key.  Any write to the file changes the mtime. */
+  dev_t dev;
+  ino_t ino;
+  struct timespec mtim;
+  off_t size;
+
+  char *format;                 /* NULL if not in the output */
+  int64_t virtual_size;         /* -1 if not in the output, -2 if too big */
+  int has_backing_file;         /* -1 if the output was not an object */
+};
+
+#define DISK_INFO_CACHE_SIZE 64
+
+gl_lock_define_initialized (static, disk_info_lock);
+static struct disk_info disk_info_cache[DISK_INFO_CACHE_SIZE];
+static size_t disk_info_cache_next;
+
+static int get_disk_info (guestfs_h *g, const char *filename, struct disk_info *info);
+
 char *
 guestfs_impl_disk_format (guestfs_h *g, const char *filename)
 {
-  size_t i, len;
-  CLEANUP_YAJL_TREE_FREE yajl_val tree = get_json_output (g, filename);
+  struct disk_info info;
 
-  if (tree == NULL)
+  if (get_disk_info (g, filename, &info) == -1)
     return NULL;
 
-  if (! YAJL_IS_OBJECT (tree))
-    goto bad_type;
-
-  len = YAJL_GET_OBJECT(tree)->len;
-  for (i = 0; i < len; ++i) {
-    if (STREQ (YAJL_GET_OBJECT(tree)->keys[i], "format")) {
-      const char *str;
-      yajl_val node = YAJL_GET_OBJECT(tree)->values[i];
-      if (YAJL_IS_NULL (node))
-        goto bad_type;
-      str = YAJL_GET_STRING (node);
-      if (str == NULL)
-        goto bad_type;
-      return safe_strdup (g, str); /* caller frees */
-    }
+  if (info.format == NULL) {
+    error (g, _("qemu-img info: JSON output did not contain 'format' key"));
+    return NULL;
   }
-
- bad_type:
-  error (g, _("qemu-img info: JSON output did not contain 'format' key"));
-  return NULL;
+  return info.format;           /* caller frees */
 }
 
 int64_t
 guestfs_impl_disk_virtual_size (guestfs_h *g, const char *filename)
 {
-  size_t i, len;
-  CLEANUP_YAJL_TREE_FREE yajl_val tree = get_json_output (g, filename);
+  struct disk_info info;
 
-  if (tree == NULL)
+  if (get_disk_info (g, filename, &info) == -1)
     return -1;
+  free (info.format);
 
-  if (! YAJL_IS_OBJECT (tree))
-    goto bad_type;
-
-  len = YAJL_GET_OBJECT(tree)->len;
-  for (i = 0; i < len; ++i) {
-    if (STREQ (YAJL_GET_OBJECT(tree)->keys[i], "virtual-size")) {
-      yajl_val node = YAJL_GET_OBJECT(tree)->values[i];
-      if (YAJL_IS_NULL (node))
-        goto bad_type;
-      if (! YAJL_IS_NUMBER (node))
-        goto bad_type;
-      if (! YAJL_IS_INTEGER (node)) {
-        error (g, _("qemu-img info: 'virtual-size' is not representable as a 64 bit integer"));
-        return -1;
-      }
-      return YAJL_GET_INTEGER (node);
-    }
+  if (info.virtual_size == -2) {
+    error (g, _("qemu-img info: 'virtual-size' is not representable as a 64 bit integer"));
+    return -1;
   }
-
- bad_type:
-  error (g, _("qemu-img info: JSON output did not contain 'virtual-size' key"));
-  return -1;
+  if (info.virtual_size < 0) {
+    error (g, _("qemu-img info: JSON output did not contain 'virtual-size' key"));
+    return -1;
+  }
+  return info.virtual_size;
 }
 
 int
 guestfs_impl_disk_has_backing_file (guestfs_h *g, const char *filename)
 {
-  size_t i, len;
-  CLEANUP_YAJL_TREE_FREE yajl_val tree = get_json_output (g, filename);
+  struct disk_info info;
 
-  if (tree == NULL)
+  if (get_disk_info (g, filename, &info) == -1)
+    return -1;
+  free (info.format);
+
+  if (info.has_backing_file == -1) {
+    error (g, _("qemu-img info: JSON output was not an object"));
     return -1;
+  }
+  return info.has_backing_file;
+}
+
+/* Pull the fields we use out of the 'qemu-img info' JSON output. */
+static void
+parse_disk_info (guestfs_h *g, yajl_val tree, struct disk_info *info)
+{
+  size_t i, len;
+
+  info->format = NULL;
+  info->virtual_size = -1;
+  info->has_backing_file = -1;
 
   if (! YAJL_IS_OBJECT (tree))
-    goto bad_type;
+    return;
+
+  /* No backing-filename key means no backing file. */
+  info->has_backing_file = 0;
 
   len = YAJL_GET_OBJECT(tree)->len;
   for (i = 0; i < len; ++i) {
-    if (STREQ (YAJL_GET_OBJECT(tree)->keys[i], "backing-filename")) {
-      yajl_val node = YAJL_GET_OBJECT(tree)->values[i];
+    const char *key = YAJL_GET_OBJECT(tree)->keys[i];
+    yajl_val node = YAJL_GET_OBJECT(tree)->values[i];
+
+    if (STREQ (key, "format")) {
+      if (YAJL_IS_STRING (node))
+        info->format = safe_strdup (g, YAJL_GET_STRING (node));
+    }
+    else if (STREQ (key, "virtual-size")) {
+      if (YAJL_IS_INTEGER (node))
+        info->virtual_size = YAJL_GET_INTEGER (node);
+      else if (YAJL_IS_NUMBER (node))
+        info->virtual_size = -2;
+    }
+    else if (STREQ (key, "backing-filename")) {
       /* Work on the assumption that if this field is null, it means
        * no backing file, rather than being an error.
        */
-      if (YAJL_IS_NULL (node))
-        return 0;
+      info->has_backing_file = ! YAJL_IS_NULL (node);
+    }
+  }
+}
+
+/* Return true if the first sector of a file, 'buf', might be
+ * recognized by qemu as a format other than raw or qcow2.  The checks
+ * follow the probe functions of the qemu block drivers.
+ */
+static int
+maybe_other_format (const char *filename, const unsigned char *buf)
+{
+  static const char *const magics[] = {
+    "QED\0",                    /* qed */
+    "KDMV",                     /* vmdk */
+    "COWD",                     /* vmdk3 */
+    "vhdxfile",                 /* vhdx */
+    "conectix",                 /* vpc */
+    "LUKS\xba\xbe",             /* luks */
+    "WithoutFreeSpace",         /* parallels */
+    "WithouFreSpacExt",         /* parallels */
+    "Bochs Virtual HD Image",   /* bochs */
+    "#!/bin/sh\n#V2.0 Format",  /* cloop */
+    NULL
+  };
+  size_t i;
+  uint32_t le;
+
+  for (i = 0; magics[i] != NULL; ++i) {
+    /* The qed magic contains a \0, so compare at least 4 bytes. */
+    if (memcmp (buf, magics[i], MAX (strlen (magics[i]), 4)) == 0)
       return 1;
+  }
+
+  /* vdi */
+  memcpy (&le, &buf[0x40], sizeof le);
+  if (le32toh (le) == 0xbeda107f)
+    return 1;
+
+  /* vmdk text descriptor */
+  if (memmem (buf, 512, "version=", 8) != NULL)
+    return 1;
+
+  /* dmg is recognized by the file name */
+  if (STRSUFFIX (filename, ".dmg"))
+    return 1;
+
+  return 0;
+}
+
+/* Fill in 'info' from the header of the regular file 'fd'.  Returns
+ * true if this was possible, or false if qemu-img must be run.
+ */
+static int
+probe_disk_header (guestfs_h *g, int fd, const char *filename,
+                   const struct stat *statbuf, struct disk_info *info)
+{
+  unsigned char buf[512];
+  ssize_t n;
+  uint32_t be32;
+  uint64_t be64;
+
+  n = pread (fd, buf, sizeof buf, 0);
+  if (n == -1)
+    return 0;
+  memset (&buf[n], 0, sizeof buf - n);
+
+  if (memcmp (buf, "QFI\xfb", 4) == 0) {
+    /* qcow2.  The qcow (version 1) format has the same magic. */
+    memcpy (&be32, &buf[4], sizeof be32);
+    if (n < 32 || be32toh (be32) < 2)
+      return 0;
+    memcpy (&be64, &buf[24], sizeof be64);
+    if (be64toh (be64) > INT64_MAX)
+      return 0;
+    info->virtual_size = be64toh (be64);
+    memcpy (&be64, &buf[8], sizeof be64);
+    info->has_backing_file = be64 != 0;
+    info->format = safe_strdup (g, "qcow2");
+    return 1;
+  }
+
+  if (maybe_other_format (filename, buf))
+    return 0;
+
+  /* raw.  qemu rounds the size up to whole sectors. */
+  info->format = safe_strdup (g, "raw");
+  info->virtual_size = (statbuf->st_size + 511) & ~INT64_C(511);
+  info->has_backing_file = 0;
+  return 1;
+}
+
+static int
+same_file (const struct disk_info *info, const struct stat *statbuf)
+{
+  return info->dev == statbuf->st_dev && info->ino == statbuf->st_ino &&
+    info->mtim.tv_sec == statbuf->st_mtim.tv_sec &&
+    info->mtim.tv_nsec == statbuf->st_mtim.tv_nsec &&
+    info->size == statbuf->st_size;
+}
+
+/* Get the 'qemu-img info' results for 'filename'.  On success the
+ * caller must free info->format.
+ */
+static int
+get_disk_info (guestfs_h *g, const char *filename, struct disk_info *info)
+{
+  struct stat statbuf;
+  struct disk_info *entry;
+  size_t i;
+  int fd;
+
+  fd = open (filename, O_RDONLY /* NB: !O_CLOEXEC */);
+  if (fd == -1) {
+    perrorf (g, "disk info: %s", filename);
+    return -1;
+  }
+
+  if (fstat (fd, &statbuf) == -1) {
+    perrorf (g, "disk info: fstat: %s", filename);
+    close (fd);
+    return -1;
+  }
+  if (S_ISDIR (statbuf.st_mode)) {
+    error (g, "disk info: %s is a directory", filename);
+    close (fd);
+    return -1;
+  }
+
+  /* Block devices can change without their mtime changing, so they
+   * are not cached.
+   */
+  if (S_ISREG (statbuf.st_mode)) {
+    gl_lock_lock (disk_info_lock);
+    for (i = 0; i < DISK_INFO_CACHE_SIZE; ++i) {
+      entry = &disk_info_cache[i];
+      if (entry->ino != 0 && same_file (entry, &statbuf)) {
+        *info = *entry;
+        info->format = entry->format ? safe_strdup (g, entry->format) : NULL;
+        gl_lock_unlock (disk_info_lock);
+        close (fd);
+        debug (g, "disk info: %s: cached", filename);
+        return 0;
+      }
     }
+    gl_lock_unlock (disk_info_lock);
   }
 
-  return 0; /* no backing-filename key means no backing file */
+  if (!S_ISREG (statbuf.st_mode) ||
+      !probe_disk_header (g, fd, filename, &statbuf, info)) {
+    CLEANUP_YAJL_TREE_FREE yajl_val tree =
+      run_qemu_img_json (g, "info", fd, filename, NULL);
 
- bad_type:
-  error (g, _("qemu-img info: JSON output was not an object"));
-  return -1;
+    if (tree == NULL) {
+      close (fd);
+      return -1;
+    }
+    parse_disk_info (g, tree, info);
+  }
+  close (fd);
+
+  info->dev = statbuf.st_dev;
+  info->ino = statbuf.st_ino;
+  info->mtim = statbuf.st_mtim;
+  info->size = statbuf.st_size;
+
+  if (S_ISREG (statbuf.st_mode)) {
+    gl_lock_lock (disk_info_lock);
+    entry = &disk_info_cache[disk_info_cache_next];
+    disk_info_cache_next = (disk_info_cache_next + 1) % DISK_INFO_CACHE_SIZE;
+    free (entry->format);
+    *entry = *info;
+    entry->format = info->format ? safe_strdup (g, info->format) : NULL;
+    gl_lock_unlock (disk_info_lock);
+  }
+
+  return 0;
 }
 
-/* Run 'qemu-img info --output json filename', and parse the output
- * as JSON, returning a JSON tree and handling errors.
+/* Run 'qemu-img <subcmd> --output json [-f format] filename', and
+ * parse the output as JSON, returning a JSON tree and handling errors.
  */
 static void parse_json (guestfs_h *g, void *treevp, const char *input, size_t len);
 #define PARSE_JSON_NO_OUTPUT ((void *) -1)
 
 static yajl_val
-get_json_output (guestfs_h *g, const char *filename)
+get_json_output (guestfs_h *g, const char *subcmd,
+                 const char *filename, const char *format)
 {
-  CLEANUP_CMD_CLOSE struct command *cmd = guestfs_int_new_command (g);
-  int fd, r;
-  char fdpath[64];
-  yajl_val tree = NULL;
+  int fd;
+  yajl_val tree;
   struct stat statbuf;
 
   fd = open (filename, O_RDONLY /* NB: !O_CLOEXEC */);
@@ -188,23 +387,41 @@ get_json_output (guestfs_h *g, const char *filename)
     return NULL;
   }
 
+  tree = run_qemu_img_json (g, subcmd, fd, filename, format);
+  close (fd);
+  return tree;          /* caller must call yajl_tree_free (tree) */
+}
+
+/* Run qemu-img on the open file 'fd', which must not be close-on-exec. */
+static yajl_val
+run_qemu_img_json (guestfs_h *g, const char *subcmd, int fd,
+                   const char *filename, const char *format)
+{
+  CLEANUP_CMD_CLOSE struct command *cmd = guestfs_int_new_command (g);
+  int r;
+  char fdpath[64];
+  yajl_val tree = NULL;
+
   snprintf (fdpath, sizeof fdpath, "/dev/fd/%d", fd);
   guestfs_int_cmd_clear_close_files (cmd);
 
   guestfs_int_cmd_add_arg (cmd, "qemu-img");
-  guestfs_int_cmd_add_arg (cmd, "info");
+  guestfs_int_cmd_add_arg (cmd, subcmd);
   guestfs_int_cmd_add_arg (cmd, "--output");
   guestfs_int_cmd_add_arg (cmd, "json");
+  if (format) {
+    guestfs_int_cmd_add_arg (cmd, "-f");
+    guestfs_int_cmd_add_arg (cmd, format);
+  }
   guestfs_int_cmd_add_arg (cmd, fdpath);
   guestfs_int_cmd_set_stdout_callback (cmd, parse_json, &tree,
                                        CMD_STDOUT_FLAG_WHOLE_BUFFER);
   set_child_rlimits (cmd);
   r = guestfs_int_cmd_run (cmd);
-  close (fd);
   if (r == -1)
     return NULL;
   if (!WIFEXITED (r) || WEXITSTATUS (r) != 0) {
-    guestfs_int_external_command_failed (g, r, "qemu-img info", filename);
+    guestfs_int_external_command_failed (g, r, "qemu-img", filename);
     return NULL;
   }
 
@@ -212,15 +429,16 @@ get_json_output (guestfs_h *g, const char *filename)
     return NULL;        /* parse_json callback already set an error */
 
   if (tree == PARSE_JSON_NO_OUTPUT) {
-    /* If this ever happened, it would indicate a bug in 'qemu-img info'. */
-    error (g, _("qemu-img info command produced no output, but didn't return an error status code"));
+    /* If this ever happened, it would indicate a bug in 'qemu-img'. */
+    error (g, _("qemu-img %s command produced no output, but didn't return an error status code"),
+           subcmd);
     return NULL;
   }
 
   return tree;          /* caller must call yajl_tree_free (tree) */
 }
 
-/* Parse the JSON document printed by qemu-img info --output json. */
+/* Parse the JSON document printed by qemu-img --output json. */
 static void
 parse_json (guestfs_h *g, void *treevp, const char *input, size_t len)
 {
@@ -242,17 +460,91 @@ parse_json (guestfs_h *g, void *treevp, const char *input, size_t len)
   /* 'input' is not \0-terminated; we have to make it so. */
   input_copy = safe_strndup (g, input, len);
 
-  debug (g, "%s: qemu-img info JSON output:\n%s\n", __func__, input_copy);
+  debug (g, "%s: qemu-img JSON output:\n%s\n", __func__, input_copy);
 
   *tree_ret = yajl_tree_parse (input_copy, parse_error, sizeof parse_error);
   if (*tree_ret == NULL) {
     if (strlen (parse_error) > 0)
-      error (g, _("qemu-img info: JSON parse error: %s"), parse_error);
+      error (g, _("qemu-img: JSON parse error: %s"), parse_error);
     else
-      error (g, _("qemu-img info: unknown JSON parse error"));
+      error (g, _("qemu-img: unknown JSON parse error"));
   }
 }
 
+/**
+ * Run S<C<qemu-img map>> on the disk image C<filename> and return
+ * the ranges which read as zeroes, sorted and with adjacent ranges
+ * merged.  C<format> must not be C<NULL>, so that the format is never
+ * probed.
+ *
+ * Returns the number of ranges, or C<-1> on error.  The caller must
+ * free C<*ranges_r>.
+ */
+ssize_t
+guestfs_int_disk_zero_ranges (guestfs_h *g, const char *filename,
+                              const char *format,
+                              struct disk_range **ranges_r)
+{
+  CLEANUP_YAJL_TREE_FREE yajl_val tree =
+    get_json_output (g, "map", filename, format);
+  struct disk_range *ranges = NULL, *p;
+  size_t i, j, n = 0;
+
+  if (tree == NULL)
+    return -1;
+
+  if (! YAJL_IS_ARRAY (tree))
+    goto bad_type;
+
+  for (i = 0; i < YAJL_GET_ARRAY(tree)->len; ++i) {
+    yajl_val node = YAJL_GET_ARRAY(tree)->values[i];
+    int64_t start = -1, length = -1;
+    bool zero = false;
+
+    if (! YAJL_IS_OBJECT (node))
+      goto bad_type;
+
+    for (j = 0; j < YAJL_GET_OBJECT(node)->len; ++j) {
+      const char *key = YAJL_GET_OBJECT(node)->keys[j];
+      yajl_val value = YAJL_GET_OBJECT(node)->values[j];
+
+      if (STREQ (key, "start") && YAJL_IS_INTEGER (value))
+        start = YAJL_GET_INTEGER (value);
+      else if (STREQ (key, "length") && YAJL_IS_INTEGER (value))
+        length = YAJL_GET_INTEGER (value);
+      else if (STREQ (key, "zero"))
+        zero = YAJL_IS_TRUE (value);
+    }
+    if (start < 0 || length < 0)
+      goto bad_type;
+    if (!zero || length == 0)
+      continue;
+
+    if (n > 0 && ranges[n-1].start + ranges[n-1].length == start) {
+      ranges[n-1].length += length;
+      continue;
+    }
+    p = realloc (ranges, (n+1) * sizeof (struct disk_range));
+    if (p == NULL) {
+      perrorf (g, "realloc");
+      free (ranges);
+      return -1;
+    }
+    ranges = p;
+    ranges[n].start = start;
+    ranges[n].length = length;
+    n++;
+  }
+
+  *ranges_r = ranges;
+  return n;
+
+ bad_type:
+  error (g, _("qemu-img map: JSON output was not a list of extents"));
+  free (ranges);
+  return -1;
+}
+
 static void
 set_child_rlimits (struct command *cmd)
 {
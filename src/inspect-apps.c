@@ -20,6 +20,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <unistd.h>
 #include <string.h>
 
@@ -44,9 +45,9 @@
 #include "guestfs-internal.h"
 #include "guestfs-internal-actions.h"
 
-#ifdef DB_DUMP
+typedef struct guestfs_application2_list *(*list_applications_fn) (guestfs_h *g, struct inspect_fs *fs);
+static struct guestfs_application2_list *list_applications_raw (guestfs_h *g, struct inspect_fs *fs, const char *format, list_applications_fn fallback);
 static struct guestfs_application2_list *list_applications_rpm (guestfs_h *g, struct inspect_fs *fs);
-#endif
 static struct guestfs_application2_list *list_applications_deb (guestfs_h *g, struct inspect_fs *fs);
 static struct guestfs_application2_list *list_applications_pacman (guestfs_h *g, struct inspect_fs *fs);
 static struct guestfs_application2_list *list_applications_apk (guestfs_h *g, struct inspect_fs *fs);
@@ -108,10 +109,18 @@ struct guestfs_application2_list *
 guestfs_impl_inspect_list_applications2 (guestfs_h *g, const char *root)
 {
   struct guestfs_application2_list *ret = NULL;
+  CLEANUP_FREE char *cache_key = NULL;
   struct inspect_fs *fs = guestfs_int_search_for_root (g, root);
   if (!fs)
     return NULL;
 
+  cache_key = guestfs_int_inspect_cache_apps_key (g, fs);
+  if (cache_key) {
+    ret = guestfs_int_inspect_cache_load_apps (g, cache_key);
+    if (ret)
+      return ret;
+  }
+
   /* Presently we can only list applications for installed disks.  It
    * is possible in future to get lists of packages from installers.
    */
@@ -121,27 +130,25 @@ guestfs_impl_inspect_list_applications2 (guestfs_h *g, const char *root)
     case OS_TYPE_HURD:
       switch (fs->package_format) {
       case OS_PACKAGE_FORMAT_RPM:
-#ifdef DB_DUMP
-        ret = list_applications_rpm (g, fs);
+        ret = list_applications_raw (g, fs, "rpm", list_applications_rpm);
         if (ret == NULL)
           return NULL;
-#endif
         break;
 
       case OS_PACKAGE_FORMAT_DEB:
-        ret = list_applications_deb (g, fs);
+        ret = list_applications_raw (g, fs, "deb", list_applications_deb);
         if (ret == NULL)
           return NULL;
         break;
 
       case OS_PACKAGE_FORMAT_PACMAN:
-	ret = list_applications_pacman (g, fs);
+	ret = list_applications_raw (g, fs, "pacman", list_applications_pacman);
 	if (ret == NULL)
 	  return NULL;
 	break;
 
       case OS_PACKAGE_FORMAT_APK:
-        ret = list_applications_apk (g, fs);
+        ret = list_applications_raw (g, fs, "apk", list_applications_apk);
         if (ret == NULL)
           return NULL;
         break;
@@ -182,10 +189,64 @@ guestfs_impl_inspect_list_applications2 (guestfs_h *g, const char *root)
 
   sort_applications (ret);
 
+  if (cache_key)
+    guestfs_int_inspect_cache_save_apps (g, cache_key, ret);
+
   return ret;
 }
 
-#ifdef DB_DUMP
+/* Number of strings per package returned by
+ * guestfs_internal_list_packages_raw.
+ */
+#define NR_RAW_FIELDS 7
+
+/* Parse the package database inside the appliance, which only sends
+ * back the fields we need.  If the appliance cannot read this
+ * database (ENOTSUP), download it and parse it using 'fallback'.
+ */
+static struct guestfs_application2_list *
+list_applications_raw (guestfs_h *g, struct inspect_fs *fs,
+                       const char *format, list_applications_fn fallback)
+{
+  CLEANUP_FREE_STRING_LIST char **packages = NULL;
+  struct guestfs_application2_list *apps;
+  size_t i, n;
+  int32_t epoch;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  packages = guestfs_internal_list_packages_raw (g, format);
+  guestfs_pop_error_handler (g);
+  if (packages == NULL) {
+    if (guestfs_last_errno (g) == ENOTSUP) {
+      debug (g, "%s", guestfs_last_error (g));
+      return fallback (g, fs);
+    }
+    guestfs_int_error_errno (g, guestfs_last_errno (g),
+                             "%s", guestfs_last_error (g));
+    return NULL;
+  }
+
+  n = guestfs_int_count_strings (packages);
+  if (n % NR_RAW_FIELDS != 0) {
+    error (g, _("internal_list_packages_raw: odd number of fields (%zu)"), n);
+    return NULL;
+  }
+
+  /* Allocate 'apps' list. */
+  apps = safe_malloc (g, sizeof *apps);
+  apps->len = 0;
+  apps->val = NULL;
+
+  for (i = 0; i < n; i += NR_RAW_FIELDS) {
+    epoch = guestfs_int_parse_unsigned_int (g, packages[i+1]); /* -1 on error */
+    if (epoch >= 0)
+      add_application (g, apps, packages[i], "", epoch,
+                       packages[i+2], packages[i+3], packages[i+4],
+                       "", "", packages[i+5], packages[i+6]);
+  }
+
+  return apps;
+}
 
 /* This data comes from the Name database, and contains the application
  * names and the first 4 bytes of each link field.
@@ -425,7 +486,6 @@ list_applications_rpm (guestfs_h *g, struct inspect_fs *fs)
   return NULL;
 }
 
-#endif /* defined DB_DUMP */
 
 static struct guestfs_application2_list *
 list_applications_deb (guestfs_h *g, struct inspect_fs *fs)
@@ -777,7 +837,7 @@ list_applications_apk (guestfs_h *g, struct inspect_fs *fs)
   return ret;
 }
 
-static void list_applications_windows_from_path (guestfs_h *g, struct guestfs_application2_list *apps, const char **path, size_t path_len);
+static void list_applications_windows_from_node (guestfs_h *g, struct guestfs_application2_list *apps, const struct guestfs_hivex_query_value *values, size_t nr_values);
 
 static struct guestfs_application2_list *
 list_applications_windows (guestfs_h *g, struct inspect_fs *fs)
@@ -785,7 +845,19 @@ list_applications_windows (guestfs_h *g, struct inspect_fs *fs)
   CLEANUP_FREE char *software =
     safe_asprintf (g, "%s/system32/config/software", fs->windows_systemroot);
   CLEANUP_FREE char *software_path;
+  CLEANUP_FREE_HIVEX_QUERY_VALUE_LIST struct guestfs_hivex_query_value_list *values = NULL;
   struct guestfs_application2_list *ret = NULL;
+  size_t i, j;
+
+  /* Ordinary native applications, and 32-bit emulated Windows apps
+   * running on the WOW64 emulator.
+   * http://support.microsoft.com/kb/896459 (RHBZ#692545).
+   */
+  const char *hivepaths[] = {
+    "Microsoft\\Windows\\CurrentVersion\\Uninstall\\*",
+    "WOW6432node\\Microsoft\\Windows\\CurrentVersion\\Uninstall\\*",
+    NULL
+  };
 
   software_path = guestfs_case_sensitive_path (g, software);
   if (!software_path)
@@ -795,97 +867,84 @@ list_applications_windows (guestfs_h *g, struct inspect_fs *fs)
                           GUESTFS_HIVEX_OPEN_VERBOSE, g->verbose, -1) == -1)
     return NULL;
 
+  /* Fetch every value of every uninstall node in one round trip. */
+  values = guestfs_hivex_query (g, (char **) hivepaths);
+  guestfs_hivex_close (g);
+  if (values == NULL)
+    return NULL;
+
   /* Allocate apps list. */
   ret = safe_malloc (g, sizeof *ret);
   ret->len = 0;
   ret->val = NULL;
 
-  /* Ordinary native applications. */
-  const char *hivepath[] =
-    { "Microsoft", "Windows", "CurrentVersion", "Uninstall" };
-  list_applications_windows_from_path (g, ret, hivepath,
-                                       sizeof hivepath / sizeof hivepath[0]);
-
-  /* 32-bit emulated Windows apps running on the WOW64 emulator.
-   * http://support.microsoft.com/kb/896459 (RHBZ#692545).
-   */
-  const char *hivepath2[] =
-    { "WOW6432node", "Microsoft", "Windows", "CurrentVersion", "Uninstall" };
-  list_applications_windows_from_path (g, ret, hivepath2,
-                                       sizeof hivepath2 / sizeof hivepath2[0]);
+  /* All the values of one node are returned together. */
+  for (i = 0; i < values->len; i = j) {
+    for (j = i+1; j < values->len; ++j)
+      if (STRNEQ (values->val[j].hivex_query_path,
+                  values->val[i].hivex_query_path))
+        break;
+    list_applications_windows_from_node (g, ret, &values->val[i], j-i);
+  }
 
-  guestfs_hivex_close (g);
   return ret;
 }
 
-static void
-list_applications_windows_from_path (guestfs_h *g,
-                                     struct guestfs_application2_list *apps,
-                                     const char **path, size_t path_len)
+/* Return the value called 'key' converted to UTF-8, or NULL if the
+ * node doesn't have that value or it cannot be converted.
+ */
+static char *
+get_value_utf8 (const struct guestfs_hivex_query_value *values,
+                size_t nr_values, const char *key)
 {
-  CLEANUP_FREE_HIVEX_NODE_LIST struct guestfs_hivex_node_list *children = NULL;
-  int64_t node;
   size_t i;
 
-  node = guestfs_hivex_root (g);
+  for (i = 0; i < nr_values; ++i) {
+    if (STRCASEEQ (values[i].hivex_query_key, key))
+      return guestfs_int_utf16_to_utf8 (values[i].hivex_query_value,
+                                        values[i].hivex_query_value_len);
+  }
 
-  for (i = 0; node != 0 && i < path_len; ++i)
-    node = guestfs_hivex_node_get_child (g, node, path[i]);
+  return NULL;
+}
 
-  if (node == 0)
-    return;
+static void
+list_applications_windows_from_node (guestfs_h *g,
+                                     struct guestfs_application2_list *apps,
+                                     const struct guestfs_hivex_query_value *values,
+                                     size_t nr_values)
+{
+  const char *name;
+  CLEANUP_FREE char *display_name = NULL, *version = NULL,
+    *install_path = NULL, *publisher = NULL, *url = NULL, *comments = NULL;
 
-  children = guestfs_hivex_node_children (g, node);
-  if (children == NULL)
-    return;
+  /* Use the node name as a proxy for the package name in Linux.  The
+   * display name is not language-independent, so it cannot be used.
+   */
+  name = strrchr (values[0].hivex_query_path, '\\');
+  name = name ? name+1 : values[0].hivex_query_path;
 
-  /* Consider any child node that has a DisplayName key.
+  /* Consider any node that has a DisplayName key.
    * See also:
    * http://nsis.sourceforge.net/Add_uninstall_information_to_Add/Remove_Programs#Optional_values
    */
-  for (i = 0; i < children->len; ++i) {
-    const int64_t child = children->val[i].hivex_node_h;
-    int64_t value;
-    CLEANUP_FREE char *name = NULL, *display_name = NULL, *version = NULL,
-      *install_path = NULL, *publisher = NULL, *url = NULL, *comments = NULL;
-
-    /* Use the node name as a proxy for the package name in Linux.  The
-     * display name is not language-independent, so it cannot be used.
-     */
-    name = guestfs_hivex_node_name (g, child);
-    if (name == NULL)
-      continue;
+  display_name = get_value_utf8 (values, nr_values, "DisplayName");
+  if (display_name == NULL)
+    return;
 
-    value = guestfs_hivex_node_get_value (g, child, "DisplayName");
-    if (value) {
-      display_name = guestfs_hivex_value_utf8 (g, value);
-      if (display_name) {
-        value = guestfs_hivex_node_get_value (g, child, "DisplayVersion");
-        if (value)
-          version = guestfs_hivex_value_utf8 (g, value);
-        value = guestfs_hivex_node_get_value (g, child, "InstallLocation");
-        if (value)
-          install_path = guestfs_hivex_value_utf8 (g, value);
-        value = guestfs_hivex_node_get_value (g, child, "Publisher");
-        if (value)
-          publisher = guestfs_hivex_value_utf8 (g, value);
-        value = guestfs_hivex_node_get_value (g, child, "URLInfoAbout");
-        if (value)
-          url = guestfs_hivex_value_utf8 (g, value);
-        value = guestfs_hivex_node_get_value (g, child, "Comments");
-        if (value)
-          comments = guestfs_hivex_value_utf8 (g, value);
-
-        add_application (g, apps, name, display_name, 0,
-                         version ? : "",
-                         "", "",
-                         install_path ? : "",
-                         publisher ? : "",
-                         url ? : "",
-                         comments ? : "");
-      }
-    }
-  }
+  version = get_value_utf8 (values, nr_values, "DisplayVersion");
+  install_path = get_value_utf8 (values, nr_values, "InstallLocation");
+  publisher = get_value_utf8 (values, nr_values, "Publisher");
+  url = get_value_utf8 (values, nr_values, "URLInfoAbout");
+  comments = get_value_utf8 (values, nr_values, "Comments");
+
+  add_application (g, apps, name, display_name, 0,
+                   version ? : "",
+                   "", "",
+                   install_path ? : "",
+                   publisher ? : "",
+                   url ? : "",
+                   comments ? : "");
 }
 
 static void
@@ -0,0 +1,873 @@
+/* libguestfs
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * Persistent cache of inspection results.
+ *
+ * If C<LIBGUESTFS_INSPECT_CACHE> is set to a directory, the result of
+ * inspecting each filesystem (a C<struct inspect_fs>) and the list of
+ * applications of each operating system are saved there, and reused
+ * the next time the same unchanged filesystem is inspected.
+ *
+ * Entries are keyed on the filesystem UUID and on counters in the
+ * superblock which change whenever the filesystem is written to,
+ * which we can read with a single C<guestfs_pread_device> without
+ * mounting anything.  Only ext2/3/4 (write time, mount count and
+ * lifetime kilobytes written) and btrfs (generation) record such
+ * counters, so other filesystems are never cached.
+ *
+ * Guest files which inspection downloads (package databases, registry
+ * hives, icons) are cached too, keyed on the filesystem UUID and the
+ * path, inode, mtime and size of the file, so that the same file in
+ * many clones of one image is only downloaded once.  Downloaded files
+ * can be large, so the cache is limited in size
+ * (C<LIBGUESTFS_INSPECT_CACHE_SIZE>) and the least recently used
+ * entries are deleted to stay under the limit.
+ *
+ * Everything here is best effort: any problem reading or writing the
+ * cache is only reported in debug messages, and the caller goes on
+ * to inspect the filesystem normally.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <libintl.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_ENDIAN_H
+#include <endian.h>
+#endif
+
+#include "c-ctype.h"
+
+#include "guestfs.h"
+#include "guestfs-internal.h"
+
+#define CACHE_SIGNATURE "libguestfs inspect cache 1"
+
+/* Default limit on the size of the cache directory, in megabytes. */
+#define DEFAULT_CACHE_SIZE_MB 1024
+
+static void
+append_hex (char *out, const unsigned char *p, size_t len)
+{
+  size_t i;
+
+  for (i = 0; i < len; ++i)
+    sprintf (out + 2*i, "%02x", p[i]);
+}
+
+/* FNV-1a, used to turn variable length keys into short file names. */
+static uint64_t
+hash_bytes (uint64_t h, const char *p, size_t len)
+{
+  size_t i;
+
+  for (i = 0; i < len; ++i)
+    h = (h ^ (unsigned char) p[i]) * UINT64_C (0x100000001b3);
+  return h;
+}
+
+#define HASH_INIT UINT64_C (0xcbf29ce484222325)
+
+/**
+ * Return the cache key for C<mountable>, or C<NULL> if the cache is
+ * not enabled or this filesystem cannot be cached.
+ *
+ * The mountable name is part of the key because the inspection data
+ * (such as the fstab) refers to other devices by name, and those
+ * names change if the disks are added in a different order.
+ */
+char *
+guestfs_int_inspect_cache_key (guestfs_h *g, const char *mountable,
+                               const struct guestfs_internal_mountable *m,
+                               const char *vfs_type)
+{
+  CLEANUP_FREE char *sb = NULL;
+  size_t size, i;
+  char uuid[33];
+  char *ret;
+  int64_t offset;
+  uint16_t u16;
+  uint32_t u32;
+  uint64_t u64, gen1, gen2;
+
+  if (!g->inspect_cachedir || !vfs_type)
+    return NULL;
+  if (m->im_type != MOUNTABLE_DEVICE && m->im_type != MOUNTABLE_BTRFSVOL)
+    return NULL;
+
+  if (STRPREFIX (vfs_type, "ext"))
+    offset = 1024;
+  else if (STREQ (vfs_type, "btrfs"))
+    offset = 65536;
+  else
+    return NULL;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  sb = guestfs_pread_device (g, m->im_device, 1024, offset, &size);
+  guestfs_pop_error_handler (g);
+  if (sb == NULL || size < 1024) {
+    debug (g, "inspect cache: %s: could not read superblock", mountable);
+    return NULL;
+  }
+
+  if (offset == 1024) {
+    /* struct ext2_super_block */
+    memcpy (&u16, &sb[0x38], 2);
+    if (le16toh (u16) != 0xef53)
+      return NULL;
+    append_hex (uuid, (unsigned char *) &sb[0x68], 16);
+    memcpy (&u32, &sb[0x30], 4);            /* s_wtime */
+    gen1 = le32toh (u32);
+    memcpy (&u16, &sb[0x34], 2);            /* s_mnt_count */
+    gen1 = (gen1 << 16) | le16toh (u16);
+    memcpy (&u64, &sb[0x178], 8);           /* s_kbytes_written */
+    gen2 = le64toh (u64);
+  }
+  else {
+    /* struct btrfs_super_block */
+    if (memcmp (&sb[0x40], "_BHRfS_M", 8) != 0)
+      return NULL;
+    append_hex (uuid, (unsigned char *) &sb[0x20], 16);
+    memcpy (&u64, &sb[0x48], 8);            /* generation */
+    gen1 = le64toh (u64);
+    gen2 = 0;
+  }
+
+  ret = safe_asprintf (g, "%s-%" PRIx64 "-%" PRIx64 "-%s",
+                       uuid, gen1, gen2, mountable);
+  for (i = strlen (uuid); ret[i]; ++i)
+    if (!c_isalnum (ret[i]) && ret[i] != '-')
+      ret[i] = '_';
+
+  return ret;
+}
+
+/**
+ * Return the cache key for a list of applications read from the
+ * operating system whose root filesystem is C<fs>.  Since package
+ * databases may live on other filesystems (eg. F</var>), this
+ * combines the keys of every filesystem in the fstab.
+ */
+char *
+guestfs_int_inspect_cache_apps_key (guestfs_h *g, const struct inspect_fs *fs)
+{
+  uint64_t h = HASH_INIT;
+  size_t i, j;
+
+  if (!g->inspect_cachedir || !fs->cache_key)
+    return NULL;
+
+  h = hash_bytes (h, fs->cache_key, strlen (fs->cache_key));
+
+  for (i = 0; i < fs->nr_fstab; ++i) {
+    for (j = 0; j < g->nr_fses; ++j) {
+      if (STREQ (g->fses[j].mountable, fs->fstab[i].mountable))
+        break;
+    }
+    if (j == g->nr_fses || &g->fses[j] == fs)
+      continue;
+    if (!g->fses[j].cache_key)
+      return NULL;
+    h = hash_bytes (h, g->fses[j].cache_key, strlen (g->fses[j].cache_key));
+  }
+
+  return safe_asprintf (g, "apps-%016" PRIx64, h);
+}
+
+/* The file format is the signature line followed by a sequence of
+ * fields.  Each field is a length, a space, the bytes of the field,
+ * and a newline.  NULL strings are written as "-".
+ */
+static void
+write_buf (FILE *fp, const char *buf, size_t len)
+{
+  fprintf (fp, "%zu ", len);
+  fwrite (buf, 1, len, fp);
+  fputc ('\n', fp);
+}
+
+static void
+write_str (FILE *fp, const char *str)
+{
+  if (str == NULL)
+    fputs ("-\n", fp);
+  else
+    write_buf (fp, str, strlen (str));
+}
+
+static void
+write_int (FILE *fp, int64_t i)
+{
+  char buf[32];
+
+  snprintf (buf, sizeof buf, "%" PRIi64, i);
+  write_str (fp, buf);
+}
+
+/* The returned buffer is always followed by a '\0', so strings can
+ * be read with this too.
+ */
+static int
+read_buf (guestfs_h *g, FILE *fp, char **ret, size_t *len_r)
+{
+  size_t len;
+  int c;
+
+  c = fgetc (fp);
+  if (c == '-') {
+    *ret = NULL;
+    *len_r = 0;
+    return fgetc (fp) == '\n' ? 0 : -1;
+  }
+  ungetc (c, fp);
+
+  if (fscanf (fp, "%zu", &len) != 1 || fgetc (fp) != ' ' ||
+      len > 1024*1024)
+    return -1;
+
+  *ret = safe_malloc (g, len + 1);
+  if (fread (*ret, 1, len, fp) != len || fgetc (fp) != '\n') {
+    free (*ret);
+    *ret = NULL;
+    return -1;
+  }
+  (*ret)[len] = '\0';
+  *len_r = len;
+  return 0;
+}
+
+static int
+read_str (guestfs_h *g, FILE *fp, char **ret)
+{
+  size_t len;
+
+  return read_buf (g, fp, ret, &len);
+}
+
+static int
+read_int (guestfs_h *g, FILE *fp, int64_t *ret)
+{
+  CLEANUP_FREE char *str = NULL;
+
+  if (read_str (g, fp, &str) == -1 || str == NULL ||
+      sscanf (str, "%" SCNd64, ret) != 1)
+    return -1;
+  return 0;
+}
+
+/* Open a cache file for reading, checking the signature. */
+static FILE *
+open_cache_file (guestfs_h *g, const char *key, const char *suffix)
+{
+  CLEANUP_FREE char *filename =
+    safe_asprintf (g, "%s/%s.%s", g->inspect_cachedir, key, suffix);
+  char line[sizeof CACHE_SIGNATURE + 1];
+  FILE *fp;
+
+  fp = fopen (filename, "re");
+  if (fp == NULL)
+    return NULL;
+
+  if (fgets (line, sizeof line, fp) == NULL ||
+      STRNEQ (line, CACHE_SIGNATURE "\n")) {
+    debug (g, "inspect cache: %s: ignoring file with bad signature", filename);
+    fclose (fp);
+    return NULL;
+  }
+
+  return fp;
+}
+
+/* Write a cache file atomically.  'write_fn' writes the fields. */
+static void
+save_cache_file (guestfs_h *g, const char *key, const char *suffix,
+                 void (*write_fn) (FILE *fp, const void *data),
+                 const void *data)
+{
+  CLEANUP_FREE char *filename =
+    safe_asprintf (g, "%s/%s.%s", g->inspect_cachedir, key, suffix);
+  CLEANUP_FREE char *tmpname =
+    safe_asprintf (g, "%s.%d", filename, getpid ());
+  FILE *fp;
+
+  if (mkdir (g->inspect_cachedir, 0700) == -1 && errno != EEXIST) {
+    debug (g, "inspect cache: mkdir: %s: %m", g->inspect_cachedir);
+    return;
+  }
+
+  fp = fopen (tmpname, "we");
+  if (fp == NULL) {
+    debug (g, "inspect cache: fopen: %s: %m", tmpname);
+    return;
+  }
+
+  fputs (CACHE_SIGNATURE "\n", fp);
+  write_fn (fp, data);
+
+  if (ferror (fp) || fclose (fp) == EOF) {
+    debug (g, "inspect cache: error writing %s", tmpname);
+    unlink (tmpname);
+    return;
+  }
+  if (rename (tmpname, filename) == -1) {
+    debug (g, "inspect cache: rename: %s: %m", filename);
+    unlink (tmpname);
+  }
+}
+
+static void
+write_fs (FILE *fp, const void *fsv)
+{
+  const struct inspect_fs *fs = fsv;
+  size_t i, n;
+
+  write_int (fp, fs->role);
+  write_int (fp, fs->type);
+  write_int (fp, fs->distro);
+  write_int (fp, fs->package_format);
+  write_int (fp, fs->package_management);
+  write_str (fp, fs->product_name);
+  write_str (fp, fs->product_variant);
+  write_int (fp, fs->version.v_major);
+  write_int (fp, fs->version.v_minor);
+  write_int (fp, fs->version.v_micro);
+  write_str (fp, fs->arch);
+  write_str (fp, fs->hostname);
+  write_str (fp, fs->windows_systemroot);
+  write_str (fp, fs->windows_current_control_set);
+  if (fs->drive_mappings) {
+    n = guestfs_int_count_strings (fs->drive_mappings);
+    write_int (fp, n);
+    for (i = 0; i < n; ++i)
+      write_str (fp, fs->drive_mappings[i]);
+  }
+  else
+    write_int (fp, -1);
+  write_int (fp, fs->format);
+  write_int (fp, fs->is_live_disk);
+  write_int (fp, fs->is_netinst_disk);
+  write_int (fp, fs->is_multipart_disk);
+  write_int (fp, fs->nr_fstab);
+  for (i = 0; i < fs->nr_fstab; ++i) {
+    write_str (fp, fs->fstab[i].mountable);
+    write_str (fp, fs->fstab[i].mountpoint);
+  }
+}
+
+static void
+free_fs (struct inspect_fs *fs)
+{
+  size_t i;
+
+  free (fs->product_name);
+  free (fs->product_variant);
+  free (fs->arch);
+  free (fs->hostname);
+  free (fs->windows_systemroot);
+  free (fs->windows_current_control_set);
+  if (fs->drive_mappings)
+    guestfs_int_free_string_list (fs->drive_mappings);
+  for (i = 0; i < fs->nr_fstab; ++i) {
+    free (fs->fstab[i].mountable);
+    free (fs->fstab[i].mountpoint);
+  }
+  free (fs->fstab);
+}
+
+static int
+read_fs (guestfs_h *g, FILE *fp, struct inspect_fs *fs)
+{
+  int64_t i, n, v[5];
+
+  for (i = 0; i < 5; ++i)
+    if (read_int (g, fp, &v[i]) == -1)
+      return -1;
+  fs->role = v[0];
+  fs->type = v[1];
+  fs->distro = v[2];
+  fs->package_format = v[3];
+  fs->package_management = v[4];
+  if (read_str (g, fp, &fs->product_name) == -1 ||
+      read_str (g, fp, &fs->product_variant) == -1)
+    return -1;
+  for (i = 0; i < 3; ++i)
+    if (read_int (g, fp, &v[i]) == -1)
+      return -1;
+  fs->version.v_major = v[0];
+  fs->version.v_minor = v[1];
+  fs->version.v_micro = v[2];
+  if (read_str (g, fp, &fs->arch) == -1 ||
+      read_str (g, fp, &fs->hostname) == -1 ||
+      read_str (g, fp, &fs->windows_systemroot) == -1 ||
+      read_str (g, fp, &fs->windows_current_control_set) == -1 ||
+      read_int (g, fp, &n) == -1 || n < -1 || n > 1024)
+    return -1;
+  if (n >= 0) {
+    fs->drive_mappings = safe_calloc (g, n + 1, sizeof (char *));
+    for (i = 0; i < n; ++i)
+      if (read_str (g, fp, &fs->drive_mappings[i]) == -1 ||
+          fs->drive_mappings[i] == NULL)
+        return -1;
+  }
+  for (i = 0; i < 4; ++i)
+    if (read_int (g, fp, &v[i]) == -1)
+      return -1;
+  fs->format = v[0];
+  fs->is_live_disk = v[1];
+  fs->is_netinst_disk = v[2];
+  fs->is_multipart_disk = v[3];
+  if (read_int (g, fp, &n) == -1 || n < 0 || n > 1024)
+    return -1;
+  fs->fstab = safe_calloc (g, n, sizeof (struct inspect_fstab_entry));
+  for (i = 0; i < n; ++i) {
+    fs->nr_fstab++;
+    if (read_str (g, fp, &fs->fstab[i].mountable) == -1 ||
+        read_str (g, fp, &fs->fstab[i].mountpoint) == -1)
+      return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Fill in C<fs> from the cache entry C<key>.  Returns true if it was
+ * found.  The caller must set C<fs-E<gt>mountable>.
+ */
+int
+guestfs_int_inspect_cache_load_fs (guestfs_h *g, const char *key,
+                                   struct inspect_fs *fs)
+{
+  FILE *fp;
+  struct inspect_fs cached;
+  int r;
+
+  fp = open_cache_file (g, key, "fs");
+  if (fp == NULL)
+    return 0;
+
+  memset (&cached, 0, sizeof cached);
+  r = read_fs (g, fp, &cached);
+  fclose (fp);
+  if (r == -1) {
+    debug (g, "inspect cache: %s: ignoring corrupt entry", key);
+    free_fs (&cached);
+    return 0;
+  }
+
+  debug (g, "inspect cache: %s: hit", key);
+  *fs = cached;
+  return 1;
+}
+
+void
+guestfs_int_inspect_cache_save_fs (guestfs_h *g, const char *key,
+                                   const struct inspect_fs *fs)
+{
+  save_cache_file (g, key, "fs", write_fs, fs);
+}
+
+static void
+write_apps (FILE *fp, const void *appsv)
+{
+  const struct guestfs_application2_list *apps = appsv;
+  size_t i;
+
+  write_int (fp, apps->len);
+  for (i = 0; i < apps->len; ++i) {
+    const struct guestfs_application2 *app = &apps->val[i];
+
+    write_str (fp, app->app2_name);
+    write_str (fp, app->app2_display_name);
+    write_int (fp, app->app2_epoch);
+    write_str (fp, app->app2_version);
+    write_str (fp, app->app2_release);
+    write_str (fp, app->app2_arch);
+    write_str (fp, app->app2_install_path);
+    write_str (fp, app->app2_trans_path);
+    write_str (fp, app->app2_publisher);
+    write_str (fp, app->app2_url);
+    write_str (fp, app->app2_source_package);
+    write_str (fp, app->app2_summary);
+    write_str (fp, app->app2_description);
+    write_str (fp, app->app2_spare1);
+    write_str (fp, app->app2_spare2);
+    write_str (fp, app->app2_spare3);
+    write_str (fp, app->app2_spare4);
+  }
+}
+
+static int
+read_app (guestfs_h *g, FILE *fp, struct guestfs_application2 *app)
+{
+  int64_t epoch;
+
+  /* None of the strings may be NULL in the public struct. */
+#define READ_STR(field) \
+  if (read_str (g, fp, &app->field) == -1 || app->field == NULL) \
+    return -1
+  READ_STR (app2_name);
+  READ_STR (app2_display_name);
+  if (read_int (g, fp, &epoch) == -1)
+    return -1;
+  app->app2_epoch = epoch;
+  READ_STR (app2_version);
+  READ_STR (app2_release);
+  READ_STR (app2_arch);
+  READ_STR (app2_install_path);
+  READ_STR (app2_trans_path);
+  READ_STR (app2_publisher);
+  READ_STR (app2_url);
+  READ_STR (app2_source_package);
+  READ_STR (app2_summary);
+  READ_STR (app2_description);
+  READ_STR (app2_spare1);
+  READ_STR (app2_spare2);
+  READ_STR (app2_spare3);
+  READ_STR (app2_spare4);
+#undef READ_STR
+
+  return 0;
+}
+
+/**
+ * Return the cached list of applications for C<key>, or C<NULL> if
+ * there is no usable entry.
+ */
+struct guestfs_application2_list *
+guestfs_int_inspect_cache_load_apps (guestfs_h *g, const char *key)
+{
+  FILE *fp;
+  struct guestfs_application2_list *apps;
+  int64_t n, i;
+
+  fp = open_cache_file (g, key, "apps");
+  if (fp == NULL)
+    return NULL;
+
+  if (read_int (g, fp, &n) == -1 || n < 0 || n > 1000000) {
+    fclose (fp);
+    goto corrupt;
+  }
+
+  apps = safe_malloc (g, sizeof *apps);
+  apps->len = 0;
+  apps->val = safe_calloc (g, n > 0 ? n : 1, sizeof (struct guestfs_application2));
+  for (i = 0; i < n; ++i) {
+    apps->len++;
+    if (read_app (g, fp, &apps->val[i]) == -1) {
+      fclose (fp);
+      guestfs_free_application2_list (apps);
+      goto corrupt;
+    }
+  }
+  fclose (fp);
+
+  debug (g, "inspect cache: %s: hit", key);
+  return apps;
+
+ corrupt:
+  debug (g, "inspect cache: %s: ignoring corrupt entry", key);
+  return NULL;
+}
+
+void
+guestfs_int_inspect_cache_save_apps (guestfs_h *g, const char *key,
+                                     const struct guestfs_application2_list *apps)
+{
+  save_cache_file (g, key, "apps", write_apps, apps);
+}
+
+/**
+ * Return the cache key for an icon made from the guest file
+ * C<filename> by C<method> (which identifies how the icon is
+ * extracted from the file), or C<NULL> if the cache is not enabled.
+ *
+ * Icons are keyed on the SHA-256 checksum of the file, which is
+ * computed in the appliance, so an icon is only extracted once for
+ * every guest that contains the same file.
+ */
+char *
+guestfs_int_inspect_cache_icon_key (guestfs_h *g, const char *filename,
+                                    const char *method)
+{
+  CLEANUP_FREE char *checksum = NULL;
+
+  if (g->inspect_cachedir == NULL)
+    return NULL;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  checksum = guestfs_checksum (g, "sha256", filename);
+  guestfs_pop_error_handler (g);
+  if (checksum == NULL)
+    return NULL;
+
+  return safe_asprintf (g, "icon-%s-%s", method, checksum);
+}
+
+/**
+ * Return the cached icon for C<key>, or C<NULL> if there is no
+ * usable entry.
+ */
+char *
+guestfs_int_inspect_cache_load_icon (guestfs_h *g, const char *key,
+                                     size_t *size_r)
+{
+  FILE *fp;
+  char *icon;
+  int r;
+
+  fp = open_cache_file (g, key, "png");
+  if (fp == NULL)
+    return NULL;
+
+  r = read_buf (g, fp, &icon, size_r);
+  fclose (fp);
+  if (r == -1 || icon == NULL) {
+    debug (g, "inspect cache: %s: ignoring corrupt entry", key);
+    return NULL;
+  }
+
+  debug (g, "inspect cache: %s: hit", key);
+  return icon;
+}
+
+struct icon {
+  const char *data;
+  size_t size;
+};
+
+static void
+write_icon (FILE *fp, const void *iconv)
+{
+  const struct icon *icon = iconv;
+
+  write_buf (fp, icon->data, icon->size);
+}
+
+void
+guestfs_int_inspect_cache_save_icon (guestfs_h *g, const char *key,
+                                     const char *icon, size_t size)
+{
+  const struct icon data = { .data = icon, .size = size };
+
+  save_cache_file (g, key, "png", write_icon, &data);
+}
+
+/**
+ * Return the cache key for the guest file C<filename> on C<fs>, whose
+ * C<stat> is C<statbuf>, or C<NULL> if the cache is not enabled or
+ * the filesystem has no UUID.
+ *
+ * Clones of one image have the same filesystem UUID, and a file which
+ * has not been changed in the clone has the same inode, mtime and
+ * size, so it gets the same key.
+ */
+char *
+guestfs_int_inspect_cache_file_key (guestfs_h *g, const struct inspect_fs *fs,
+                                    const char *filename,
+                                    const struct guestfs_statns *statbuf)
+{
+  CLEANUP_FREE char *uuid = NULL, *str = NULL;
+  uint64_t h;
+
+  if (g->inspect_cachedir == NULL)
+    return NULL;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  uuid = guestfs_vfs_uuid (g, fs->mountable);
+  guestfs_pop_error_handler (g);
+  if (uuid == NULL || STREQ (uuid, ""))
+    return NULL;
+
+  str = safe_asprintf (g, "%s\n%s\n%" PRIi64 "\n%" PRIi64 ".%09" PRIi64
+                       "\n%" PRIi64,
+                       uuid, filename, statbuf->st_ino,
+                       statbuf->st_mtime_sec, statbuf->st_mtime_nsec,
+                       statbuf->st_size);
+  h = hash_bytes (HASH_INIT, str, strlen (str));
+
+  return safe_asprintf (g, "file-%016" PRIx64, h);
+}
+
+/* Copy a file, or hard link it if both are on the same filesystem. */
+static int
+link_or_copy (const char *src, const char *dest)
+{
+  char buf[BUFSIZ];
+  int ifd, ofd;
+  ssize_t n;
+  int r = 0;
+
+  if (link (src, dest) == 0)
+    return 0;
+
+  ifd = open (src, O_RDONLY|O_CLOEXEC);
+  if (ifd == -1)
+    return -1;
+  ofd = open (dest, O_WRONLY|O_CREAT|O_TRUNC|O_NOCTTY|O_CLOEXEC, 0600);
+  if (ofd == -1) {
+    close (ifd);
+    return -1;
+  }
+
+  while ((n = read (ifd, buf, sizeof buf)) > 0) {
+    if (write (ofd, buf, n) != n) {
+      r = -1;
+      break;
+    }
+  }
+  if (n == -1)
+    r = -1;
+  close (ifd);
+  if (close (ofd) == -1)
+    r = -1;
+  if (r == -1)
+    unlink (dest);
+
+  return r;
+}
+
+/**
+ * If the guest file with cache key C<key> is in the cache, make
+ * C<localfile> a copy of it and return true.
+ */
+int
+guestfs_int_inspect_cache_load_file (guestfs_h *g, const char *key,
+                                     const char *localfile)
+{
+  CLEANUP_FREE char *filename =
+    safe_asprintf (g, "%s/%s.file", g->inspect_cachedir, key);
+
+  if (link_or_copy (filename, localfile) == -1)
+    return 0;
+
+  /* The mtime of cache entries records when they were last used. */
+  utimensat (AT_FDCWD, filename, NULL, 0);
+
+  debug (g, "inspect cache: %s: hit", key);
+  return 1;
+}
+
+struct cache_entry {
+  char *name;
+  off_t size;
+  time_t mtime;
+};
+
+static int
+compare_entry_mtime (const void *av, const void *bv)
+{
+  const struct cache_entry *a = av, *b = bv;
+
+  return a->mtime < b->mtime ? -1 : a->mtime > b->mtime ? 1 : 0;
+}
+
+/* Delete the least recently used entries until the cache is within
+ * its size limit.
+ */
+static void
+evict_cache_entries (guestfs_h *g)
+{
+  DIR *dir;
+  struct dirent *d;
+  struct stat statbuf;
+  struct cache_entry *entries = NULL;
+  size_t nr_entries = 0, i;
+  uint64_t total = 0, limit;
+  int dfd;
+
+  limit = g->inspect_cache_size_mb > 0
+    ? g->inspect_cache_size_mb : DEFAULT_CACHE_SIZE_MB;
+  limit *= 1024 * 1024;
+
+  dir = opendir (g->inspect_cachedir);
+  if (dir == NULL)
+    return;
+  dfd = dirfd (dir);
+
+  while ((d = readdir (dir)) != NULL) {
+    if (fstatat (dfd, d->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) == -1 ||
+        !S_ISREG (statbuf.st_mode))
+      continue;
+    entries = safe_realloc (g, entries,
+                            (nr_entries + 1) * sizeof (struct cache_entry));
+    entries[nr_entries].name = safe_strdup (g, d->d_name);
+    entries[nr_entries].size = statbuf.st_size;
+    entries[nr_entries].mtime = statbuf.st_mtime;
+    nr_entries++;
+    total += statbuf.st_size;
+  }
+
+  if (total > limit) {
+    qsort (entries, nr_entries, sizeof (struct cache_entry),
+           compare_entry_mtime);
+    for (i = 0; i < nr_entries && total > limit; ++i) {
+      if (unlinkat (dfd, entries[i].name, 0) == 0) {
+        debug (g, "inspect cache: evicted %s", entries[i].name);
+        total -= entries[i].size;
+      }
+    }
+  }
+
+  for (i = 0; i < nr_entries; ++i)
+    free (entries[i].name);
+  free (entries);
+  closedir (dir);
+}
+
+/**
+ * Save the downloaded guest file C<localfile> in the cache as C<key>.
+ */
+void
+guestfs_int_inspect_cache_save_file (guestfs_h *g, const char *key,
+                                     const char *localfile)
+{
+  CLEANUP_FREE char *filename =
+    safe_asprintf (g, "%s/%s.file", g->inspect_cachedir, key);
+  CLEANUP_FREE char *tmpname =
+    safe_asprintf (g, "%s.%d", filename, getpid ());
+
+  if (mkdir (g->inspect_cachedir, 0700) == -1 && errno != EEXIST) {
+    debug (g, "inspect cache: mkdir: %s: %m", g->inspect_cachedir);
+    return;
+  }
+
+  unlink (tmpname);
+  if (link_or_copy (localfile, tmpname) == -1) {
+    debug (g, "inspect cache: copy: %s: %m", tmpname);
+    return;
+  }
+  if (rename (tmpname, filename) == -1) {
+    debug (g, "inspect cache: rename: %s: %m", filename);
+    unlink (tmpname);
+    return;
+  }
+
+  evict_cache_entries (g);
+}
@@ -83,13 +83,21 @@ static void check_architecture (guestfs_h *g, struct inspect_fs *fs);
 static int check_hostname_unix (guestfs_h *g, struct inspect_fs *fs);
 static int check_hostname_redhat (guestfs_h *g, struct inspect_fs *fs);
 static int check_hostname_freebsd (guestfs_h *g, struct inspect_fs *fs);
+static int inspect_fstab (guestfs_h *g, struct inspect_fs *fs, const char **configfiles);
+static int check_fstab_native (guestfs_h *g, struct inspect_fs *fs, const char **configfiles);
 static int check_fstab (guestfs_h *g, struct inspect_fs *fs);
+static int resolve_fstab_entry (guestfs_h *g, struct inspect_fs *fs,
+                                Hash_table *md_map,
+                                const char *spec, char *mp,
+                                char **mountable_rtn);
 static void add_fstab_entry (guestfs_h *g, struct inspect_fs *fs,
                              const char *mountable, const char *mp);
 static char *resolve_fstab_device (guestfs_h *g, const char *spec,
                                    Hash_table *md_map,
                                    enum inspect_os_type os_type);
+static int check_config_file_sizes (guestfs_h *g, const char **configfiles);
 static int inspect_with_augeas (guestfs_h *g, struct inspect_fs *fs, const char **configfiles, int (*f) (guestfs_h *, struct inspect_fs *));
+static size_t split_fields (char *line, char **fields, size_t max);
 static void canonical_mountpoint (char *mp);
 
 /* Hash structure for uuid->path lookups */
@@ -115,7 +123,9 @@ static bool mdadm_app_cmp(const void *x, const void *y);
 static void mdadm_app_free(void *x);
 
 static ssize_t map_app_md_devices (guestfs_h *g, Hash_table **map);
-static int map_md_devices(guestfs_h *g, Hash_table **map);
+static int map_md_devices(guestfs_h *g, char *const *arrays, Hash_table **map);
+static char **get_md_arrays_augeas (guestfs_h *g);
+static int parse_mdadm_conf (guestfs_h *g, char ***arrays_rtn);
 
 /* Set fs->product_name to the first line of the release file. */
 static int
@@ -459,8 +469,7 @@ guestfs_int_check_linux_root (guestfs_h *g, struct inspect_fs *fs)
 
   fs->type = OS_TYPE_LINUX;
 
-  if (guestfs_is_file_opts (g, "/etc/os-release",
-                            GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  if (guestfs_int_probe_is_file (g, "/etc/os-release", 1) > 0) {
     r = parse_os_release (g, fs, "/etc/os-release");
     if (r == -1)        /* error */
       return -1;
@@ -468,8 +477,7 @@ guestfs_int_check_linux_root (guestfs_h *g, struct inspect_fs *fs)
       goto skip_release_checks;
   }
 
-  if (guestfs_is_file_opts (g, "/etc/lsb-release",
-                            GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  if (guestfs_int_probe_is_file (g, "/etc/lsb-release", 1) > 0) {
     r = parse_lsb_release (g, fs, "/etc/lsb-release");
     if (r == -1)        /* error */
       return -1;
@@ -480,8 +488,7 @@ guestfs_int_check_linux_root (guestfs_h *g, struct inspect_fs *fs)
   /* RHEL-based distros include a "/etc/redhat-release" file, hence their
    * checks need to be performed before the Red-Hat one.
    */
-  if (guestfs_is_file_opts (g, "/etc/oracle-release",
-                            GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  if (guestfs_int_probe_is_file (g, "/etc/oracle-release", 1) > 0) {
 
     fs->distro = OS_DISTRO_ORACLE_LINUX;
 
@@ -508,8 +515,7 @@ guestfs_int_check_linux_root (guestfs_h *g, struct inspect_fs *fs)
       fs->version.v_minor = 0;
     }
   }
-  else if (guestfs_is_file_opts (g, "/etc/centos-release",
-                                 GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  else if (guestfs_int_probe_is_file (g, "/etc/centos-release", 1) > 0) {
     fs->distro = OS_DISTRO_CENTOS;
 
     if (parse_release_file (g, fs, "/etc/centos-release") == -1)
@@ -536,8 +542,7 @@ guestfs_int_check_linux_root (guestfs_h *g, struct inspect_fs *fs)
       fs->version.v_minor = 0;
     }
   }
-  else if (guestfs_is_file_opts (g, "/etc/altlinux-release",
-                                 GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  else if (guestfs_int_probe_is_file (g, "/etc/altlinux-release", 1) > 0) {
     fs->distro = OS_DISTRO_ALTLINUX;
 
     if (parse_release_file (g, fs, "/etc/altlinux-release") == -1)
@@ -547,8 +552,7 @@ guestfs_int_check_linux_root (guestfs_h *g, struct inspect_fs *fs)
                                          re_altlinux) == -1)
       return -1;
   }
-  else if (guestfs_is_file_opts (g, "/etc/redhat-release",
-                                 GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  else if (guestfs_int_probe_is_file (g, "/etc/redhat-release", 1) > 0) {
     fs->distro = OS_DISTRO_REDHAT_BASED; /* Something generic Red Hat-like. */
 
     if (parse_release_file (g, fs, "/etc/redhat-release") == -1)
@@ -628,8 +632,7 @@ guestfs_int_check_linux_root (guestfs_h *g, struct inspect_fs *fs)
       fs->version.v_minor = 0;
     }
   }
-  else if (guestfs_is_file_opts (g, "/etc/debian_version",
-                                 GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  else if (guestfs_int_probe_is_file (g, "/etc/debian_version", 1) > 0) {
     fs->distro = OS_DISTRO_DEBIAN;
 
     if (parse_release_file (g, fs, "/etc/debian_version") == -1)
@@ -638,8 +641,7 @@ guestfs_int_check_linux_root (guestfs_h *g, struct inspect_fs *fs)
     if (guestfs_int_parse_major_minor (g, fs) == -1)
       return -1;
   }
-  else if (guestfs_is_file_opts (g, "/etc/pardus-release",
-                                 GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  else if (guestfs_int_probe_is_file (g, "/etc/pardus-release", 1) > 0) {
     fs->distro = OS_DISTRO_PARDUS;
 
     if (parse_release_file (g, fs, "/etc/pardus-release") == -1)
@@ -648,16 +650,14 @@ guestfs_int_check_linux_root (guestfs_h *g, struct inspect_fs *fs)
     if (guestfs_int_parse_major_minor (g, fs) == -1)
       return -1;
   }
-  else if (guestfs_is_file_opts (g, "/etc/arch-release",
-                                 GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  else if (guestfs_int_probe_is_file (g, "/etc/arch-release", 1) > 0) {
     fs->distro = OS_DISTRO_ARCHLINUX;
 
     /* /etc/arch-release file is empty and I can't see a way to
      * determine the actual release or product string.
      */
   }
-  else if (guestfs_is_file_opts (g, "/etc/gentoo-release",
-                                 GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  else if (guestfs_int_probe_is_file (g, "/etc/gentoo-release", 1) > 0) {
     fs->distro = OS_DISTRO_GENTOO;
 
     if (parse_release_file (g, fs, "/etc/gentoo-release") == -1)
@@ -666,8 +666,7 @@ guestfs_int_check_linux_root (guestfs_h *g, struct inspect_fs *fs)
     if (guestfs_int_parse_major_minor (g, fs) == -1)
       return -1;
   }
-  else if (guestfs_is_file_opts (g, "/etc/meego-release",
-                                 GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  else if (guestfs_int_probe_is_file (g, "/etc/meego-release", 1) > 0) {
     fs->distro = OS_DISTRO_MEEGO;
 
     if (parse_release_file (g, fs, "/etc/meego-release") == -1)
@@ -676,8 +675,7 @@ guestfs_int_check_linux_root (guestfs_h *g, struct inspect_fs *fs)
     if (guestfs_int_parse_major_minor (g, fs) == -1)
       return -1;
   }
-  else if (guestfs_is_file_opts (g, "/etc/slackware-version",
-                                 GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  else if (guestfs_int_probe_is_file (g, "/etc/slackware-version", 1) > 0) {
     fs->distro = OS_DISTRO_SLACKWARE;
 
     if (parse_release_file (g, fs, "/etc/slackware-version") == -1)
@@ -686,8 +684,7 @@ guestfs_int_check_linux_root (guestfs_h *g, struct inspect_fs *fs)
     if (guestfs_int_parse_major_minor (g, fs) == -1)
       return -1;
   }
-  else if (guestfs_is_file_opts (g, "/etc/ttylinux-target",
-                                 GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  else if (guestfs_int_probe_is_file (g, "/etc/ttylinux-target", 1) > 0) {
     fs->distro = OS_DISTRO_TTYLINUX;
 
     if (parse_release_file (g, fs, "/etc/ttylinux-target") == -1)
@@ -696,8 +693,7 @@ guestfs_int_check_linux_root (guestfs_h *g, struct inspect_fs *fs)
     if (guestfs_int_parse_major_minor (g, fs) == -1)
       return -1;
   }
-  else if (guestfs_is_file_opts (g, "/etc/SuSE-release",
-                                 GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  else if (guestfs_int_probe_is_file (g, "/etc/SuSE-release", 1) > 0) {
     fs->distro = OS_DISTRO_SUSE_BASED;
 
     if (parse_suse_release (g, fs, "/etc/SuSE-release") == -1)
@@ -706,8 +702,7 @@ guestfs_int_check_linux_root (guestfs_h *g, struct inspect_fs *fs)
   }
   /* CirrOS versions providing a own version file.
    */
-  else if (guestfs_is_file_opts (g, "/etc/cirros/version",
-                                 GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  else if (guestfs_int_probe_is_file (g, "/etc/cirros/version", 1) > 0) {
     fs->distro = OS_DISTRO_CIRROS;
 
     if (parse_release_file (g, fs, "/etc/cirros/version") == -1)
@@ -719,10 +714,8 @@ guestfs_int_check_linux_root (guestfs_h *g, struct inspect_fs *fs)
   /* Buildroot (http://buildroot.net) is an embedded Linux distro
    * toolkit.  It is used by specific distros such as Cirros.
    */
-  else if (guestfs_is_file_opts (g, "/etc/br-version",
-                                 GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
-    if (guestfs_is_file_opts (g, "/usr/share/cirros/logo",
-                              GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0)
+  else if (guestfs_int_probe_is_file (g, "/etc/br-version", 1) > 0) {
+    if (guestfs_int_probe_is_file (g, "/usr/share/cirros/logo", 1) > 0)
       fs->distro = OS_DISTRO_CIRROS;
     else
       fs->distro = OS_DISTRO_BUILDROOT;
@@ -734,8 +727,7 @@ guestfs_int_check_linux_root (guestfs_h *g, struct inspect_fs *fs)
     if (guestfs_int_parse_major_minor (g, fs) == -1)
       return -1;
   }
-  else if (guestfs_is_file_opts (g, "/etc/alpine-release",
-                                 GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  else if (guestfs_int_probe_is_file (g, "/etc/alpine-release", 1) > 0) {
     fs->distro = OS_DISTRO_ALPINE_LINUX;
 
     if (parse_release_file (g, fs, "/etc/alpine-release") == -1)
@@ -744,8 +736,7 @@ guestfs_int_check_linux_root (guestfs_h *g, struct inspect_fs *fs)
     if (guestfs_int_parse_major_minor (g, fs) == -1)
       return -1;
   }
-  else if (guestfs_is_file_opts (g, "/etc/frugalware-release",
-                                 GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  else if (guestfs_int_probe_is_file (g, "/etc/frugalware-release", 1) > 0) {
     fs->distro = OS_DISTRO_FRUGALWARE;
 
     if (parse_release_file (g, fs, "/etc/frugalware-release") == -1)
@@ -755,8 +746,7 @@ guestfs_int_check_linux_root (guestfs_h *g, struct inspect_fs *fs)
                                          re_frugalware) == -1)
       return -1;
   }
-  else if (guestfs_is_file_opts (g, "/etc/pld-release",
-                                 GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  else if (guestfs_int_probe_is_file (g, "/etc/pld-release", 1) > 0) {
     fs->distro = OS_DISTRO_PLD_LINUX;
 
     if (parse_release_file (g, fs, "/etc/pld-release") == -1)
@@ -778,7 +768,7 @@ guestfs_int_check_linux_root (guestfs_h *g, struct inspect_fs *fs)
    * are mounted.
    */
   const char *configfiles[] = { "/etc/fstab", "/etc/mdadm.conf", NULL };
-  if (inspect_with_augeas (g, fs, configfiles, check_fstab) == -1)
+  if (inspect_fstab (g, fs, configfiles) == -1)
     return -1;
 
   /* Determine hostname. */
@@ -797,8 +787,7 @@ guestfs_int_check_linux_usr (guestfs_h *g, struct inspect_fs *fs)
   fs->type = OS_TYPE_LINUX;
   fs->role = OS_ROLE_USR;
 
-  if (guestfs_is_file_opts (g, "/lib/os-release",
-                            GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  if (guestfs_int_probe_is_file (g, "/lib/os-release", 1) > 0) {
     r = parse_os_release (g, fs, "/lib/os-release");
     if (r == -1)        /* error */
       return -1;
@@ -826,8 +815,7 @@ guestfs_int_check_freebsd_root (guestfs_h *g, struct inspect_fs *fs)
    * we'll use that anyway.
    */
 
-  if (guestfs_is_file_opts (g, "/etc/motd",
-                            GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  if (guestfs_int_probe_is_file (g, "/etc/motd", 1) > 0) {
     if (parse_release_file (g, fs, "/etc/motd") == -1)
       return -1;
 
@@ -840,7 +828,7 @@ guestfs_int_check_freebsd_root (guestfs_h *g, struct inspect_fs *fs)
 
   /* We already know /etc/fstab exists because it's part of the test above. */
   const char *configfiles[] = { "/etc/fstab", NULL };
-  if (inspect_with_augeas (g, fs, configfiles, check_fstab) == -1)
+  if (inspect_fstab (g, fs, configfiles) == -1)
     return -1;
 
   /* Determine hostname. */
@@ -855,8 +843,7 @@ int
 guestfs_int_check_netbsd_root (guestfs_h *g, struct inspect_fs *fs)
 {
 
-  if (guestfs_is_file_opts (g, "/etc/release",
-                            GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  if (guestfs_int_probe_is_file (g, "/etc/release", 1) > 0) {
     int result;
     if (parse_release_file (g, fs, "/etc/release") == -1)
       return -1;
@@ -878,7 +865,7 @@ guestfs_int_check_netbsd_root (guestfs_h *g, struct inspect_fs *fs)
 
   /* We already know /etc/fstab exists because it's part of the test above. */
   const char *configfiles[] = { "/etc/fstab", NULL };
-  if (inspect_with_augeas (g, fs, configfiles, check_fstab) == -1)
+  if (inspect_fstab (g, fs, configfiles) == -1)
     return -1;
 
   /* Determine hostname. */
@@ -892,8 +879,7 @@ guestfs_int_check_netbsd_root (guestfs_h *g, struct inspect_fs *fs)
 int
 guestfs_int_check_openbsd_root (guestfs_h *g, struct inspect_fs *fs)
 {
-  if (guestfs_is_file_opts (g, "/etc/motd",
-                            GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  if (guestfs_int_probe_is_file (g, "/etc/motd", 1) > 0) {
     CLEANUP_FREE char *major = NULL, *minor = NULL;
 
     /* The first line of this file gets automatically updated at boot. */
@@ -927,7 +913,7 @@ guestfs_int_check_openbsd_root (guestfs_h *g, struct inspect_fs *fs)
 
   /* We already know /etc/fstab exists because it's part of the test above. */
   const char *configfiles[] = { "/etc/fstab", NULL };
-  if (inspect_with_augeas (g, fs, configfiles, check_fstab) == -1)
+  if (inspect_fstab (g, fs, configfiles) == -1)
     return -1;
 
   /* Determine hostname. */
@@ -945,8 +931,7 @@ guestfs_int_check_hurd_root (guestfs_h *g, struct inspect_fs *fs)
 {
   fs->type = OS_TYPE_HURD;
 
-  if (guestfs_is_file_opts (g, "/etc/debian_version",
-                            GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  if (guestfs_int_probe_is_file (g, "/etc/debian_version", 1) > 0) {
     fs->distro = OS_DISTRO_DEBIAN;
 
     if (parse_release_file (g, fs, "/etc/debian_version") == -1)
@@ -963,9 +948,9 @@ guestfs_int_check_hurd_root (guestfs_h *g, struct inspect_fs *fs)
   /* Determine the architecture. */
   check_architecture (g, fs);
 
-  if (guestfs_is_file (g, "/etc/fstab") > 0) {
+  if (guestfs_int_probe_is_file (g, "/etc/fstab", 0) > 0) {
     const char *configfiles[] = { "/etc/fstab", NULL };
-    if (inspect_with_augeas (g, fs, configfiles, check_fstab) == -1)
+    if (inspect_fstab (g, fs, configfiles) == -1)
       return -1;
   }
 
@@ -982,8 +967,7 @@ guestfs_int_check_minix_root (guestfs_h *g, struct inspect_fs *fs)
 {
   fs->type = OS_TYPE_MINIX;
 
-  if (guestfs_is_file_opts (g, "/etc/version",
-                            GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  if (guestfs_int_probe_is_file (g, "/etc/version", 1) > 0) {
     if (parse_release_file (g, fs, "/etc/version") == -1)
       return -1;
 
@@ -1043,8 +1027,7 @@ guestfs_int_check_coreos_usr (guestfs_h *g, struct inspect_fs *fs)
   fs->distro = OS_DISTRO_COREOS;
   fs->role = OS_ROLE_USR;
 
-  if (guestfs_is_file_opts (g, "/lib/os-release",
-                            GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  if (guestfs_int_probe_is_file (g, "/lib/os-release", 1) > 0) {
     r = parse_os_release (g, fs, "/lib/os-release");
     if (r == -1)        /* error */
       return -1;
@@ -1052,8 +1035,7 @@ guestfs_int_check_coreos_usr (guestfs_h *g, struct inspect_fs *fs)
       goto skip_release_checks;
   }
 
-  if (guestfs_is_file_opts (g, "/share/coreos/lsb-release",
-                            GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+  if (guestfs_int_probe_is_file (g, "/share/coreos/lsb-release", 1) > 0) {
     r = parse_lsb_release (g, fs, "/share/coreos/lsb-release");
     if (r == -1)        /* error */
       return -1;
@@ -1072,6 +1054,24 @@ guestfs_int_check_coreos_usr (guestfs_h *g, struct inspect_fs *fs)
   return 0;
 }
 
+/* Do the checks which were skipped because inspect_os was called
+ * with defer=true.  The root filesystem is mounted on /.
+ */
+int
+guestfs_int_check_unix_deferred (guestfs_h *g, struct inspect_fs *fs,
+                                 int what)
+{
+  if (what & INSPECT_DEFER_ARCH)
+    check_architecture (g, fs);
+
+  if (what & INSPECT_DEFER_HOSTNAME) {
+    if (check_hostname_unix (g, fs) == -1)
+      return -1;
+  }
+
+  return 0;
+}
+
 static void
 check_architecture (guestfs_h *g, struct inspect_fs *fs)
 {
@@ -1080,13 +1080,17 @@ check_architecture (guestfs_h *g, struct inspect_fs *fs)
   size_t i;
   char *arch = NULL;
 
+  if (g->inspect_defer) {
+    fs->deferred |= INSPECT_DEFER_ARCH;
+    return;
+  }
+
   for (i = 0; i < sizeof binaries / sizeof binaries[0]; ++i) {
     /* Allow symlinks when checking the binaries:,so in case they are
      * relative ones (which can be resolved within the same partition),
      * then we can check the architecture of their target.
      */
-    if (guestfs_is_file_opts (g, binaries[i],
-                              GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0) {
+    if (guestfs_int_probe_is_file (g, binaries[i], 1) > 0) {
       CLEANUP_FREE char *resolved = NULL;
 
       /* Ignore errors from realpath and file_architecture calls. */
@@ -1117,6 +1121,11 @@ check_architecture (guestfs_h *g, struct inspect_fs *fs)
 static int
 check_hostname_unix (guestfs_h *g, struct inspect_fs *fs)
 {
+  if (g->inspect_defer) {
+    fs->deferred |= INSPECT_DEFER_HOSTNAME;
+    return 0;
+  }
+
   switch (fs->type) {
   case OS_TYPE_LINUX:
   case OS_TYPE_HURD:
@@ -1126,7 +1135,7 @@ check_hostname_unix (guestfs_h *g, struct inspect_fs *fs)
      * It's best to just look for each of these files in turn, rather
      * than try anything clever based on distro.
      */
-    if (guestfs_is_file (g, "/etc/HOSTNAME")) {
+    if (guestfs_int_probe_is_file (g, "/etc/HOSTNAME", 0)) {
       fs->hostname = guestfs_int_first_line_of_file (g, "/etc/HOSTNAME");
       if (fs->hostname == NULL)
         return -1;
@@ -1136,7 +1145,7 @@ check_hostname_unix (guestfs_h *g, struct inspect_fs *fs)
       }
     }
 
-    if (!fs->hostname && guestfs_is_file (g, "/etc/hostname")) {
+    if (!fs->hostname && guestfs_int_probe_is_file (g, "/etc/hostname", 0)) {
       fs->hostname = guestfs_int_first_line_of_file (g, "/etc/hostname");
       if (fs->hostname == NULL)
         return -1;
@@ -1146,7 +1155,7 @@ check_hostname_unix (guestfs_h *g, struct inspect_fs *fs)
       }
     }
 
-    if (!fs->hostname && guestfs_is_file (g, "/etc/sysconfig/network")) {
+    if (!fs->hostname && guestfs_int_probe_is_file (g, "/etc/sysconfig/network", 0)) {
       const char *configfiles[] = { "/etc/sysconfig/network", NULL };
       if (inspect_with_augeas (g, fs, configfiles,
                                check_hostname_redhat) == -1)
@@ -1159,14 +1168,14 @@ check_hostname_unix (guestfs_h *g, struct inspect_fs *fs)
     /* /etc/rc.conf contains the hostname, but there is no Augeas lens
      * for this file.
      */
-    if (guestfs_is_file (g, "/etc/rc.conf")) {
+    if (guestfs_int_probe_is_file (g, "/etc/rc.conf", 0)) {
       if (check_hostname_freebsd (g, fs) == -1)
         return -1;
     }
     break;
 
   case OS_TYPE_OPENBSD:
-    if (guestfs_is_file (g, "/etc/myname")) {
+    if (guestfs_int_probe_is_file (g, "/etc/myname", 0)) {
       fs->hostname = guestfs_int_first_line_of_file (g, "/etc/myname");
       if (fs->hostname == NULL)
         return -1;
@@ -1178,7 +1187,7 @@ check_hostname_unix (guestfs_h *g, struct inspect_fs *fs)
     break;
 
   case OS_TYPE_MINIX:
-    if (guestfs_is_file (g, "/etc/hostname.file")) {
+    if (guestfs_int_probe_is_file (g, "/etc/hostname.file", 0)) {
       fs->hostname = guestfs_int_first_line_of_file (g, "/etc/hostname.file");
       if (fs->hostname == NULL)
         return -1;
@@ -1269,20 +1278,136 @@ check_hostname_freebsd (guestfs_h *g, struct inspect_fs *fs)
   return 0;
 }
 
+/* Parse /etc/fstab, and /etc/mdadm.conf if it is listed in
+ * 'configfiles'.  These files are simple enough to parse here, which
+ * is much quicker than starting Augeas.  Augeas is only used if they
+ * contain something that check_fstab_native does not understand.
+ */
+static int
+inspect_fstab (guestfs_h *g, struct inspect_fs *fs, const char **configfiles)
+{
+  int r;
+
+  r = check_fstab_native (g, fs, configfiles);
+  if (r == 1) {
+    debug (g, "inspect-os: parsing fstab with augeas instead");
+    r = inspect_with_augeas (g, fs, configfiles, check_fstab);
+  }
+  return r;
+}
+
+/* The fields of an fstab line: spec, file, vfstype, options, freq
+ * and passno.  The last three are optional.
+ */
+#define FSTAB_FIELDS 6
+
+struct fstab_line {
+  char *fields[FSTAB_FIELDS];
+  size_t nr_fields;
+};
+
+/* Returns 0 on success, -1 on error, or 1 if a file contains syntax
+ * which is not handled here.  In the last case nothing has been added
+ * to 'fs', so the caller can parse the files again with Augeas.
+ */
+static int
+check_fstab_native (guestfs_h *g, struct inspect_fs *fs,
+                    const char **configfiles)
+{
+  CLEANUP_FREE_STRING_LIST char **lines = NULL;
+  CLEANUP_FREE_STRING_LIST char **arrays = NULL;
+  CLEANUP_FREE struct fstab_line *entries = NULL;
+  CLEANUP_HASH_FREE Hash_table *md_map = NULL;
+  size_t i, nr_entries = 0;
+  int r;
+
+  if (check_config_file_sizes (g, configfiles) == -1)
+    return -1;
+
+  for (i = 0; configfiles[i] != NULL; ++i) {
+    if (STREQ (configfiles[i], "/etc/mdadm.conf")) {
+      r = parse_mdadm_conf (g, &arrays);
+      if (r != 0)
+        return r;
+    }
+  }
+
+  lines = guestfs_read_lines (g, "/etc/fstab");
+  if (lines == NULL)
+    return -1;
+
+  /* Split every line before adding anything, so that we can still
+   * fall back to Augeas.  The fields point into 'lines'.
+   */
+  entries = safe_malloc (g, (guestfs_int_count_strings (lines) + 1) *
+                         sizeof (struct fstab_line));
+  for (i = 0; lines[i] != NULL; ++i) {
+    struct fstab_line *entry = &entries[nr_entries];
+
+    entry->nr_fields = split_fields (lines[i], entry->fields, FSTAB_FIELDS);
+    if (entry->nr_fields == 0)  /* blank line or comment */
+      continue;
+    if (entry->nr_fields < 3 || entry->nr_fields > FSTAB_FIELDS) {
+      debug (g, "inspect-os: /etc/fstab:%zu: cannot parse line with %zu fields",
+             i+1, entry->nr_fields);
+      return 1;
+    }
+    nr_entries++;
+  }
+
+  /* Generate a map of MD device paths listed in /etc/mdadm.conf to MD device
+   * paths in the guestfs appliance */
+  if (map_md_devices (g, arrays, &md_map) == -1) return -1;
+
+  for (i = 0; i < nr_entries; ++i) {
+    struct fstab_line *entry = &entries[i];
+    const char *spec = entry->fields[0];
+    char *mp = entry->fields[1];
+    const char *vfstype = entry->fields[2];
+    CLEANUP_FREE char *mountable = NULL;
+
+    if (resolve_fstab_entry (g, fs, md_map, spec, mp, &mountable) == -1)
+      return -1;
+    if (mountable == NULL)
+      continue;
+
+    if (STREQ (vfstype, "btrfs") && entry->nr_fields >= 4) {
+      char *opt, *saveptr;
+
+      for (opt = strtok_r (entry->fields[3], ",", &saveptr);
+           opt != NULL;
+           opt = strtok_r (NULL, ",", &saveptr)) {
+        if (STRPREFIX (opt, "subvol=")) {
+          char *old_mountable = mountable;
+          mountable = safe_asprintf (g, "btrfsvol:%s/%s", mountable, &opt[7]);
+          free (old_mountable);
+        }
+      }
+    }
+
+    add_fstab_entry (g, fs, mountable, mp);
+  }
+
+  return 0;
+}
+
+/* Parse /etc/fstab with Augeas.  This is called from the
+ * inspect_with_augeas wrapper.
+ */
 static int
 check_fstab (guestfs_h *g, struct inspect_fs *fs)
 {
   CLEANUP_FREE_STRING_LIST char **entries = NULL;
+  CLEANUP_FREE_STRING_LIST char **arrays = NULL;
   char **entry;
   char augpath[256];
   CLEANUP_HASH_FREE Hash_table *md_map = NULL;
-  bool is_bsd = (fs->type == OS_TYPE_FREEBSD ||
-                 fs->type == OS_TYPE_NETBSD ||
-                 fs->type == OS_TYPE_OPENBSD);
 
   /* Generate a map of MD device paths listed in /etc/mdadm.conf to MD device
    * paths in the guestfs appliance */
-  if (map_md_devices (g, &md_map) == -1) return -1;
+  arrays = get_md_arrays_augeas (g);
+  if (arrays == NULL) return -1;
+  if (map_md_devices (g, arrays, &md_map) == -1) return -1;
 
   entries = guestfs_aug_match (g, "/files/etc/fstab/*[label() != '#comment']");
   if (entries == NULL)
@@ -1299,74 +1424,13 @@ check_fstab (guestfs_h *g, struct inspect_fs *fs)
     if (spec == NULL)
       return -1;
 
-    /* Ignore /dev/fd (floppy disks) (RHBZ#642929) and CD-ROM drives.
-     *
-     * /dev/iso9660/FREEBSD_INSTALL can be found in FreeBSDs installation
-     * discs.
-     */
-    if ((STRPREFIX (spec, "/dev/fd") && c_isdigit (spec[7])) ||
-        STREQ (spec, "/dev/floppy") ||
-        STREQ (spec, "/dev/cdrom") ||
-        STRPREFIX (spec, "/dev/iso9660/"))
-      continue;
-
     snprintf (augpath, sizeof augpath, "%s/file", *entry);
     mp = guestfs_aug_get (g, augpath);
     if (mp == NULL)
       return -1;
 
-    /* Canonicalize the path, so "///usr//local//" -> "/usr/local" */
-    canonical_mountpoint (mp);
-
-    /* Ignore certain mountpoints. */
-    if (STRPREFIX (mp, "/dev/") ||
-        STREQ (mp, "/dev") ||
-        STRPREFIX (mp, "/media/") ||
-        STRPREFIX (mp, "/proc/") ||
-        STREQ (mp, "/proc") ||
-        STRPREFIX (mp, "/selinux/") ||
-        STREQ (mp, "/selinux") ||
-        STRPREFIX (mp, "/sys/") ||
-        STREQ (mp, "/sys"))
-      continue;
-
-    /* Resolve UUID= and LABEL= to the actual device. */
-    if (STRPREFIX (spec, "UUID=")) {
-      CLEANUP_FREE char *s = guestfs_int_shell_unquote (&spec[5]);
-      if (s == NULL) { perrorf (g, "guestfs_int_shell_unquote"); return -1; }
-      mountable = guestfs_findfs_uuid (g, s);
-    }
-    else if (STRPREFIX (spec, "LABEL=")) {
-      CLEANUP_FREE char *s = guestfs_int_shell_unquote (&spec[6]);
-      if (s == NULL) { perrorf (g, "guestfs_int_shell_unquote"); return -1; }
-      mountable = guestfs_findfs_label (g, s);
-    }
-    /* Ignore "/.swap" (Pardus) and pseudo-devices like "tmpfs". */
-    else if (STREQ (spec, "/dev/root") || (is_bsd && STREQ (mp, "/")))
-      /* Resolve /dev/root to the current device.
-       * Do the same for the / partition of the *BSD systems, since the
-       * BSD -> Linux device translation is not straight forward.
-       */
-      mountable = safe_strdup (g, fs->mountable);
-    else if (STRPREFIX (spec, "/dev/"))
-      /* Resolve guest block device names. */
-      mountable = resolve_fstab_device (g, spec, md_map, fs->type);
-    else if (match (g, spec, re_openbsd_duid)) {
-      /* In OpenBSD's fstab you can specify partitions on a disk by appending a
-       * period and a partition letter to a Disklable Unique Identifier. The
-       * DUID is a 16 hex digit field found in the OpenBSD's altered BSD
-       * disklabel. For more info see here:
-       * http://www.openbsd.org/faq/faq14.html#intro
-       */
-      char device[10]; /* /dev/sd[0-9][a-z] */
-      char part = spec[17];
-
-      /* We cannot peep into disklables, we can only assume that this is the
-       * first disk.
-       */
-      snprintf(device, 10, "%s%c", "/dev/sd0", part);
-      mountable = resolve_fstab_device (g, device, md_map, fs->type);
-    }
+    if (resolve_fstab_entry (g, fs, md_map, spec, mp, &mountable) == -1)
+      return -1;
 
     /* If we haven't resolved the device successfully by this point,
      * we don't care, just ignore it.
@@ -1411,6 +1475,92 @@ check_fstab (guestfs_h *g, struct inspect_fs *fs)
   return 0;
 }
 
+/* Decide whether the fstab entry for 'spec' mounted on 'mp' is
+ * interesting, and if so resolve 'spec' to a mountable.  'mp' is
+ * canonicalized in place.
+ *
+ * Returns 0 and sets '*mountable_rtn' (to NULL if the entry should
+ * be ignored), or -1 on error.
+ */
+static int
+resolve_fstab_entry (guestfs_h *g, struct inspect_fs *fs, Hash_table *md_map,
+                     const char *spec, char *mp, char **mountable_rtn)
+{
+  char *mountable = NULL;
+  bool is_bsd = (fs->type == OS_TYPE_FREEBSD ||
+                 fs->type == OS_TYPE_NETBSD ||
+                 fs->type == OS_TYPE_OPENBSD);
+
+  *mountable_rtn = NULL;
+
+  /* Ignore /dev/fd (floppy disks) (RHBZ#642929) and CD-ROM drives.
+   *
+   * /dev/iso9660/FREEBSD_INSTALL can be found in FreeBSDs installation
+   * discs.
+   */
+  if ((STRPREFIX (spec, "/dev/fd") && c_isdigit (spec[7])) ||
+      STREQ (spec, "/dev/floppy") ||
+      STREQ (spec, "/dev/cdrom") ||
+      STRPREFIX (spec, "/dev/iso9660/"))
+    return 0;
+
+  /* Canonicalize the path, so "///usr//local//" -> "/usr/local" */
+  canonical_mountpoint (mp);
+
+  /* Ignore certain mountpoints. */
+  if (STRPREFIX (mp, "/dev/") ||
+      STREQ (mp, "/dev") ||
+      STRPREFIX (mp, "/media/") ||
+      STRPREFIX (mp, "/proc/") ||
+      STREQ (mp, "/proc") ||
+      STRPREFIX (mp, "/selinux/") ||
+      STREQ (mp, "/selinux") ||
+      STRPREFIX (mp, "/sys/") ||
+      STREQ (mp, "/sys"))
+    return 0;
+
+  /* Resolve UUID= and LABEL= to the actual device. */
+  if (STRPREFIX (spec, "UUID=")) {
+    CLEANUP_FREE char *s = guestfs_int_shell_unquote (&spec[5]);
+    if (s == NULL) { perrorf (g, "guestfs_int_shell_unquote"); return -1; }
+    mountable = guestfs_findfs_uuid (g, s);
+  }
+  else if (STRPREFIX (spec, "LABEL=")) {
+    CLEANUP_FREE char *s = guestfs_int_shell_unquote (&spec[6]);
+    if (s == NULL) { perrorf (g, "guestfs_int_shell_unquote"); return -1; }
+    mountable = guestfs_findfs_label (g, s);
+  }
+  /* Ignore "/.swap" (Pardus) and pseudo-devices like "tmpfs". */
+  else if (STREQ (spec, "/dev/root") || (is_bsd && STREQ (mp, "/")))
+    /* Resolve /dev/root to the current device.
+     * Do the same for the / partition of the *BSD systems, since the
+     * BSD -> Linux device translation is not straight forward.
+     */
+    mountable = safe_strdup (g, fs->mountable);
+  else if (STRPREFIX (spec, "/dev/"))
+    /* Resolve guest block device names. */
+    mountable = resolve_fstab_device (g, spec, md_map, fs->type);
+  else if (match (g, spec, re_openbsd_duid)) {
+    /* In OpenBSD's fstab you can specify partitions on a disk by appending a
+     * period and a partition letter to a Disklable Unique Identifier. The
+     * DUID is a 16 hex digit field found in the OpenBSD's altered BSD
+     * disklabel. For more info see here:
+     * http://www.openbsd.org/faq/faq14.html#intro
+     */
+    char device[10]; /* /dev/sd[0-9][a-z] */
+    char part = spec[17];
+
+    /* We cannot peep into disklables, we can only assume that this is the
+     * first disk.
+     */
+    snprintf(device, 10, "%s%c", "/dev/sd0", part);
+    mountable = resolve_fstab_device (g, device, md_map, fs->type);
+  }
+
+  *mountable_rtn = mountable;
+  return 0;
+}
+
 /* Add a filesystem and possibly a mountpoint entry for
  * the root filesystem 'fs'.
  *
@@ -1608,14 +1758,134 @@ mdadm_app_free(void *x)
   free(a);
 }
 
+/* Get the arrays listed in /etc/mdadm.conf, using Augeas.  The
+ * result is a list of device name, uuid pairs.
+ */
+static char **
+get_md_arrays_augeas (guestfs_h *g)
+{
+  CLEANUP_FREE_STRING_LIST char **matches = NULL;
+  DECLARE_STRINGSBUF (arrays);
+
+  /* Get all arrays listed in mdadm.conf */
+  matches = guestfs_aug_match(g, "/files/etc/mdadm.conf/array");
+  if (!matches) return NULL;
+
+  for (char **m = matches; *m != NULL; m++) {
+    /* Get device name and uuid for each array */
+    CLEANUP_FREE char *dev_path = safe_asprintf (g, "%s/devicename", *m);
+    char *dev = guestfs_aug_get (g, dev_path);
+    if (!dev) {
+      guestfs_int_free_stringsbuf (&arrays);
+      return NULL;
+    }
+
+    CLEANUP_FREE char *uuid_path = safe_asprintf (g, "%s/uuid", *m);
+    char *uuid = guestfs_aug_get (g, uuid_path);
+    if (!uuid) {
+      free (dev);
+      continue;
+    }
+
+    guestfs_int_add_string_nodup (g, &arrays, dev);
+    guestfs_int_add_string_nodup (g, &arrays, uuid);
+  }
+
+  guestfs_int_end_stringsbuf (g, &arrays);
+  return arrays.argv;
+}
+
+/* The most words we expect on a line of mdadm.conf. */
+#define MDADM_CONF_MAX_WORDS 32
+
+/* Get the arrays listed in /etc/mdadm.conf without using Augeas.
+ * '*arrays_rtn' is set to a list of device name, uuid pairs, which
+ * is empty if the file does not exist.
+ *
+ * Returns 0 on success, -1 on error, or 1 if the file contains
+ * syntax which is not handled here.
+ */
+static int
+parse_mdadm_conf (guestfs_h *g, char ***arrays_rtn)
+{
+  CLEANUP_FREE_STRING_LIST char **lines = NULL;
+  DECLARE_STRINGSBUF (arrays);
+  char *words[MDADM_CONF_MAX_WORDS];
+  size_t i, j, n;
+  int r;
+
+  r = guestfs_int_probe_is_file (g, "/etc/mdadm.conf", 1);
+  if (r == -1)
+    return -1;
+  if (r > 0) {
+    lines = guestfs_read_lines (g, "/etc/mdadm.conf");
+    if (lines == NULL)
+      return -1;
+  }
+
+  for (i = 0; lines != NULL && lines[i] != NULL; ++i) {
+    CLEANUP_FREE char *line = NULL;
+    const char *dev = NULL, *uuid = NULL;
+
+    /* Lines starting with whitespace continue the previous line. */
+    line = safe_strdup (g, lines[i]);
+    while (lines[i+1] != NULL && c_isspace (lines[i+1][0])) {
+      char *old_line = line;
+      line = safe_asprintf (g, "%s %s", old_line, lines[++i]);
+      free (old_line);
+    }
+
+    /* Quoted words are rare, leave them to Augeas. */
+    if (strchr (line, '"') || strchr (line, '\'')) {
+      debug (g, "inspect-os: /etc/mdadm.conf: cannot parse quoted words");
+      guestfs_int_free_stringsbuf (&arrays);
+      return 1;
+    }
+
+    n = split_fields (line, words, MDADM_CONF_MAX_WORDS);
+    if (n > MDADM_CONF_MAX_WORDS) {
+      debug (g, "inspect-os: /etc/mdadm.conf: line with %zu words is too long",
+             n);
+      guestfs_int_free_stringsbuf (&arrays);
+      return 1;
+    }
+
+    /* Keywords can be abbreviated to 3 or more characters. */
+    if (n < 2 || strlen (words[0]) < 3 || strlen (words[0]) > 5 ||
+        STRCASENEQLEN (words[0], "array", strlen (words[0])))
+      continue;
+
+    /* The device name is optional, and arrays without one are not
+     * useful here.
+     */
+    if (strchr (words[1], '=') == NULL)
+      dev = words[1];
+    for (j = 2; j < n; ++j) {
+      if (STRCASEPREFIX (words[j], "uuid="))
+        uuid = &words[j][5];
+    }
+    if (dev == NULL || uuid == NULL)
+      continue;
+
+    guestfs_int_add_string (g, &arrays, dev);
+    guestfs_int_add_string (g, &arrays, uuid);
+  }
+
+  guestfs_int_end_stringsbuf (g, &arrays);
+  *arrays_rtn = arrays.argv;
+  return 0;
+}
+
 /* Get a map of md device names in mdadm.conf to their device names in the
- * appliance */
+ * appliance.  'arrays' is the list of device name, uuid pairs from
+ * mdadm.conf, or NULL if it was not parsed.
+ */
 static int
-map_md_devices(guestfs_h *g, Hash_table **map)
+map_md_devices(guestfs_h *g, char *const *arrays, Hash_table **map)
 {
   CLEANUP_HASH_FREE Hash_table *app_map = NULL;
-  CLEANUP_FREE_STRING_LIST char **matches = NULL;
   ssize_t n_app_md_devices;
+  size_t i;
 
   *map = NULL;
 
@@ -1627,13 +1897,9 @@ map_md_devices(guestfs_h *g, Hash_table **map)
   if (n_app_md_devices == 0)
     return 0;
 
-  /* Get all arrays listed in mdadm.conf */
-  matches = guestfs_aug_match(g, "/files/etc/mdadm.conf/array");
-  if (!matches) goto error;
-
   /* Log a debug message if we've got md devices, but nothing in mdadm.conf */
-  if (matches[0] == NULL) {
-    debug(g, "Appliance has MD devices, but augeas returned no array matches "
+  if (arrays == NULL || arrays[0] == NULL) {
+    debug(g, "Appliance has MD devices, but there are no arrays "
 	  "in mdadm.conf");
     return 0;
   }
@@ -1642,28 +1908,18 @@ map_md_devices(guestfs_h *g, Hash_table **map)
 			 mdadm_app_free);
   if (!*map) g->abort_cb();
 
-  for (char **m = matches; *m != NULL; m++) {
-    /* Get device name and uuid for each array */
-    CLEANUP_FREE char *dev_path = safe_asprintf (g, "%s/devicename", *m);
-    char *dev = guestfs_aug_get (g, dev_path);
-    if (!dev) goto error;
-
-    CLEANUP_FREE char *uuid_path = safe_asprintf (g, "%s/uuid", *m);
-    CLEANUP_FREE char *uuid = guestfs_aug_get (g, uuid_path);
-    if (!uuid) {
-      free (dev);
-      continue;
-    }
+  for (i = 0; arrays[i] != NULL && arrays[i+1] != NULL; i += 2) {
+    const char *dev = arrays[i];
+    const char *uuid = arrays[i+1];
 
     /* Parse the uuid into an md_uuid structure so we can look it up in the
      * uuid->appliance device map */
     md_uuid mdadm;
-    mdadm.path = dev;
+    mdadm.path = (char *) dev;
     if (parse_uuid(uuid, mdadm.uuid) == -1) {
       /* Invalid uuid. Weird, but not fatal. */
       debug(g, "inspect-os: mdadm.conf contains invalid uuid for %s: %s",
             dev, uuid);
-      free (dev);
       continue;
     }
 
@@ -1672,7 +1928,7 @@ map_md_devices(guestfs_h *g, Hash_table **map)
     md_uuid *app = hash_lookup(app_map, &mdadm);
     if (app) {
       mdadm_app *entry = safe_malloc(g, sizeof(mdadm_app));
-      entry->mdadm = dev;
+      entry->mdadm = safe_strdup(g, dev);
       entry->app = safe_strdup(g, app->path);
 
       switch (hash_insert_if_absent(*map, entry, NULL)) {
@@ -1686,8 +1942,7 @@ map_md_devices(guestfs_h *g, Hash_table **map)
 	mdadm_app_free(entry);
 	continue;
       }
-    } else
-      free (dev);
+    }
   }
 
   return 0;
@@ -2000,29 +2255,47 @@ resolve_fstab_device (guestfs_h *g, const char *spec, Hash_table *md_map,
   return device;
 }
 
-static char *make_augeas_path_expression (guestfs_h *g, const char **configfiles);
+/* Split 'line' in place into words separated by whitespace, storing
+ * at most 'max' of them in 'words'.  A word starting with '#' begins
+ * a comment which runs to the end of the line.  Returns the number
+ * of words, which may be larger than 'max'.
+ */
+static size_t
+split_fields (char *line, char **words, size_t max)
+{
+  char *p = line;
+  size_t n = 0;
 
-/* Call 'f' with Augeas opened and having parsed 'configfiles' (these
- * files must exist).  As a security measure, this bails if any file
- * is too large for a reasonable configuration file.  After the call
- * to 'f' the Augeas handle is closed.
+  for (;;) {
+    while (c_isspace (*p))
+      p++;
+    if (*p == '\0' || *p == '#')
+      break;
+    if (n < max)
+      words[n] = p;
+    n++;
+    while (*p != '\0' && !c_isspace (*p))
+      p++;
+    if (*p == '\0')
+      break;
+    *p++ = '\0';
+  }
+
+  return n;
+}
+
+/* Security: Refuse to parse any of 'configfiles' if it is too large
+ * for a reasonable configuration file.  Files which don't exist are
+ * ignored.
  */
 static int
-inspect_with_augeas (guestfs_h *g, struct inspect_fs *fs,
-                     const char **configfiles,
-                     int (*f) (guestfs_h *, struct inspect_fs *))
+check_config_file_sizes (guestfs_h *g, const char **configfiles)
 {
   size_t i;
   int64_t size;
-  int r;
-  CLEANUP_FREE char *pathexpr = NULL;
-  CLEANUP_FREE_STRING_LIST char **matches = NULL;
-  char **match;
 
-  /* Security: Refuse to do this if a config file is too large. */
   for (i = 0; configfiles[i] != NULL; ++i) {
-    if (guestfs_is_file_opts (g, configfiles[i],
-                              GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) == 0)
+    if (guestfs_int_probe_is_file (g, configfiles[i], 1) == 0)
       continue;
 
     size = guestfs_filesize (g, configfiles[i]);
@@ -2036,23 +2309,37 @@ inspect_with_augeas (guestfs_h *g, struct inspect_fs *fs,
     }
   }
 
-  if (guestfs_aug_init (g, "/", 16|32 /* AUG_SAVE_NOOP|AUG_NO_LOAD */) == -1)
-    return -1;
+  return 0;
+}
 
-  r = -1;
+/* Call 'f' with Augeas opened and having parsed 'configfiles' (these
+ * files must exist).  As a security measure, this bails if any file
+ * is too large for a reasonable configuration file.  After the call
+ * to 'f' the Augeas handle is closed.
+ */
+static int
+inspect_with_augeas (guestfs_h *g, struct inspect_fs *fs,
+                     const char **configfiles,
+                     int (*f) (guestfs_h *, struct inspect_fs *))
+{
+  size_t i;
+  int r;
+  CLEANUP_FREE_STRING_LIST char **matches = NULL;
+  char **match;
+
+  if (check_config_file_sizes (g, configfiles) == -1)
+    return -1;
 
   /* Tell Augeas to only load configfiles and no other files.  This
    * prevents a rogue guest from performing a denial of service attack
    * by having large, over-complicated configuration files which are
    * unrelated to the task at hand.  (Thanks Dominic Cleal).
-   * Note this requires Augeas >= 1.0.0 because of RHBZ#975412.
    */
-  pathexpr = make_augeas_path_expression (g, configfiles);
-  if (guestfs_aug_rm (g, pathexpr) == -1)
-    goto out;
+  if (guestfs_aug_init_files (g, "/", 16 /* AUG_SAVE_NOOP */,
+                              (char * const *) configfiles) == -1)
+    return -1;
 
-  if (guestfs_aug_load (g) == -1)
-    goto out;
+  r = -1;
 
   /* Check that augeas did not get a parse error for any of the configfiles,
    * otherwise we are silently missing information.
@@ -2095,35 +2382,6 @@ inspect_with_augeas (guestfs_h *g, struct inspect_fs *fs,
   return r;
 }
 
-/* Explained here: https://bugzilla.redhat.com/show_bug.cgi?id=975412#c0 */
-static char *
-make_augeas_path_expression (guestfs_h *g, const char **configfiles)
-{
-  size_t i;
-  size_t nr_files;
-  CLEANUP_FREE_STRING_LIST char **subexprs = NULL;
-  CLEANUP_FREE char *subexpr = NULL;
-  char *ret;
-
-  nr_files = guestfs_int_count_strings ((char **) configfiles);
-  subexprs = safe_malloc (g, sizeof (char *) * (nr_files + 1));
-
-  for (i = 0; i < nr_files; ++i) {
-    subexprs[i] = /*         v NB trailing '/' after filename */
-      safe_asprintf (g, "\"%s/\" !~ regexp('^') + glob(incl) + regexp('/.*')",
-                     configfiles[i]);
-  }
-  subexprs[nr_files] = NULL;
-
-  subexpr = guestfs_int_join_strings (" and ", subexprs);
-  if (subexpr == NULL)
-    g->abort_cb ();
-
-  ret = safe_asprintf (g, "/augeas/load/*[ %s ]", subexpr);
-  debug (g, "augeas pathexpr = %s", ret);
-  return ret;
-}
-
 /* Canonicalize the path, so "///usr//local//" -> "/usr/local"
  *
  * The path is modified in place because the result is always
@@ -55,8 +55,10 @@ COMPILE_REGEXP (re_boot_ini_os,
                 "^(multi|scsi)\\((\\d+)\\)disk\\((\\d+)\\)rdisk\\((\\d+)\\)partition\\((\\d+)\\)([^=]+)=", 0)
 
 static int check_windows_arch (guestfs_h *g, struct inspect_fs *fs);
-static int check_windows_software_registry (guestfs_h *g, struct inspect_fs *fs);
-static int check_windows_system_registry (guestfs_h *g, struct inspect_fs *fs);
+static int check_windows_registry (guestfs_h *g, struct inspect_fs *fs, bool software, bool system);
+static int check_windows_software_registry (guestfs_h *g, struct inspect_fs *fs, char *const *info);
+static int check_windows_system_registry (guestfs_h *g, struct inspect_fs *fs, char *const *info);
+static char *registry_value (guestfs_h *g, char *const *info, size_t i, const char *prefix, int64_t *type, size_t *len);
 static char *map_registry_disk_blob (guestfs_h *g, const void *blob);
 static char *map_registry_disk_blob_gpt (guestfs_h *g, const void *blob);
 static char *extract_guid_from_registry_blob (guestfs_h *g, const void *blob);
@@ -106,19 +108,21 @@ guestfs_int_get_windows_systemroot (guestfs_h *g)
   /* Check a predefined list of common windows system root locations */
   static const char *systemroots[] =
     { "/windows", "/winnt", "/win32", "/win", "/reactos", NULL };
+  CLEANUP_FREE_STRING_LIST char **rpaths;
 
-  for (size_t i = 0; i < sizeof systemroots / sizeof systemroots[0]; ++i) {
-    char *systemroot =
-      guestfs_int_case_sensitive_path_silently (g, systemroots[i]);
-    if (!systemroot)
+  /* Resolve all the candidates in one round trip. */
+  guestfs_push_error_handler (g, NULL, NULL);
+  rpaths = guestfs_case_sensitive_paths (g, (char **) systemroots);
+  guestfs_pop_error_handler (g);
+
+  for (size_t i = 0; rpaths && rpaths[i] != NULL; ++i) {
+    if (STREQ (rpaths[i], ""))
       continue;
 
-    if (is_systemroot (g, systemroot)) {
-      debug (g, "windows %%SYSTEMROOT%% = %s", systemroot);
+    if (is_systemroot (g, rpaths[i])) {
+      debug (g, "windows %%SYSTEMROOT%% = %s", rpaths[i]);
 
-      return systemroot;
-    } else {
-      free (systemroot);
+      return safe_strdup (g, rpaths[i]);
     }
   }
 
@@ -218,13 +222,33 @@ guestfs_int_check_windows_root (guestfs_h *g, struct inspect_fs *fs,
   if (check_windows_arch (g, fs) == -1)
     return -1;
 
-  /* Product name and version. */
-  if (check_windows_software_registry (g, fs) == -1)
+  /* Product name, version and hostname.  The system hive (hostname
+   * and drive mappings) can be read later if we are deferring checks.
+   */
+  if (g->inspect_defer)
+    fs->deferred |= INSPECT_DEFER_HOSTNAME;
+  if (check_windows_registry (g, fs, true, !g->inspect_defer) == -1)
     return -1;
 
-  /* Hostname. */
-  if (check_windows_system_registry (g, fs) == -1)
-    return -1;
+  return 0;
+}
+
+/* Do the checks which were skipped because inspect_os was called
+ * with defer=true.  The root filesystem is mounted on /.
+ */
+int
+guestfs_int_check_windows_deferred (guestfs_h *g, struct inspect_fs *fs,
+                                    int what)
+{
+  if (what & INSPECT_DEFER_ARCH) {
+    if (check_windows_arch (g, fs) == -1)
+      return -1;
+  }
+
+  if (what & INSPECT_DEFER_HOSTNAME) {
+    if (check_windows_registry (g, fs, false, true) == -1)
+      return -1;
+  }
 
   return 0;
 }
@@ -232,6 +256,11 @@ guestfs_int_check_windows_root (guestfs_h *g, struct inspect_fs *fs,
 static int
 check_windows_arch (guestfs_h *g, struct inspect_fs *fs)
 {
+  if (g->inspect_defer) {
+    fs->deferred |= INSPECT_DEFER_ARCH;
+    return 0;
+  }
+
   CLEANUP_FREE char *cmd_exe =
     safe_asprintf (g, "%s/system32/cmd.exe", fs->windows_systemroot);
 
@@ -249,79 +278,134 @@ check_windows_arch (guestfs_h *g, struct inspect_fs *fs)
   return 0;
 }
 
-/* At the moment, pull just the ProductName and version numbers from
- * the registry.  In future there is a case for making many more
- * registry fields available to callers.
+/* Read all the registry values we need from the software and/or
+ * system hives in a single daemon call.  This avoids a round trip for
+ * every node and value that the guestfs_hivex_* calls would need.
  */
 static int
-check_windows_software_registry (guestfs_h *g, struct inspect_fs *fs)
+check_windows_registry (guestfs_h *g, struct inspect_fs *fs,
+                        bool software, bool system)
 {
-  int ret = -1;
-  int r;
+  CLEANUP_FREE char *software_path = NULL;
+  CLEANUP_FREE char *system_path = NULL;
+  CLEANUP_FREE_STRING_LIST char **info = NULL;
+
+  if (software) {
+    CLEANUP_FREE char *path =
+      safe_asprintf (g, "%s/system32/config/software",
+                     fs->windows_systemroot);
+
+    software_path = guestfs_case_sensitive_path (g, path);
+    if (!software_path)
+      return -1;
+  }
 
-  CLEANUP_FREE char *software =
-    safe_asprintf (g, "%s/system32/config/software", fs->windows_systemroot);
+  if (system) {
+    CLEANUP_FREE char *path =
+      safe_asprintf (g, "%s/system32/config/system", fs->windows_systemroot);
 
-  CLEANUP_FREE char *software_path = guestfs_case_sensitive_path (g, software);
-  if (!software_path)
-    return -1;
+    system_path = guestfs_case_sensitive_path (g, path);
+    if (!system_path)
+      return -1;
+  }
 
-  r = guestfs_is_file (g, software_path);
-  if (r == -1)
-    return -1;
-  /* If the software hive doesn't exist, just accept that we cannot
-   * find product_name etc.
+  /* If either hive doesn't exist, the daemon skips it and we just
+   * accept that we cannot find product_name, hostname etc.
    */
-  if (r == 0)
-    return 0;
+  info = guestfs_internal_hivex_windows_info (g, software_path, system_path);
+  if (info == NULL)
+    return -1;
 
-  int64_t node;
-  const char *hivepath[] =
-    { "Microsoft", "Windows NT", "CurrentVersion" };
-  size_t i;
-  CLEANUP_FREE_HIVEX_VALUE_LIST struct guestfs_hivex_value_list *values = NULL;
-  bool ignore_currentversion = false;
+  if (check_windows_software_registry (g, fs, info) == -1)
+    return -1;
 
-  if (guestfs_hivex_open (g, software_path,
-                          GUESTFS_HIVEX_OPEN_VERBOSE, g->verbose, -1) == -1)
+  if (check_windows_system_registry (g, fs, info) == -1)
     return -1;
 
-  node = guestfs_hivex_root (g);
-  for (i = 0; node > 0 && i < sizeof hivepath / sizeof hivepath[0]; ++i)
-    node = guestfs_hivex_node_get_child (g, node, hivepath[i]);
+  return 0;
+}
 
-  if (node == -1)
-    goto out;
+/* If info[i] is the name of a value in the registry key 'prefix'
+ * then decode and return its data (caller frees).  Returns NULL with
+ * errno == 0 if the value is in some other key, or NULL with errno
+ * set (and an error raised) if the data could not be decoded.
+ */
+static char *
+registry_value (guestfs_h *g, char *const *info, size_t i, const char *prefix,
+                int64_t *type, size_t *len)
+{
+  const size_t prefixlen = strlen (prefix);
+  const char *p;
+  char *endp;
+  char *ret;
+  size_t j, n;
+
+  errno = 0;
+  if (!STREQLEN (info[i], prefix, prefixlen) || info[i][prefixlen] != '\\')
+    return NULL;
 
-  if (node == 0) {
-    perrorf (g, "hivex: cannot locate HKLM\\SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion");
-    goto out;
+  *type = strtoll (info[i+1], &endp, 10);
+  if (*endp != ':')
+    goto corrupt;
+  p = endp+1;
+  n = strlen (p);
+  if (n & 1)
+    goto corrupt;
+
+  *len = n / 2;
+  ret = safe_malloc (g, *len + 1);
+  for (j = 0; j < *len; ++j) {
+    if (!c_isxdigit (p[2*j]) || !c_isxdigit (p[2*j+1])) {
+      free (ret);
+      goto corrupt;
+    }
+    ret[j] = hexval (p[2*j]) << 4 | hexval (p[2*j+1]);
   }
+  ret[*len] = '\0';
+  return ret;
 
-  values = guestfs_hivex_node_values (g, node);
+ corrupt:
+  error (g, "hivex: corrupt registry value returned for %s", info[i]);
+  errno = EINVAL;
+  return NULL;
+}
 
-  for (i = 0; i < values->len; ++i) {
-    const int64_t value = values->val[i].hivex_value_h;
-    CLEANUP_FREE char *key = guestfs_hivex_value_key (g, value);
-    if (key == NULL)
-      goto out;
+/* At the moment, pull just the ProductName and version numbers from
+ * the registry.  In future there is a case for making many more
+ * registry fields available to callers.
+ */
+static int
+check_windows_software_registry (guestfs_h *g, struct inspect_fs *fs,
+                                 char *const *info)
+{
+  static const char prefix[] = "CurrentVersion";
+  size_t i;
+  bool ignore_currentversion = false;
+
+  for (i = 0; info[i] != NULL; i += 2) {
+    const char *key;
+    int64_t vtype;
+    size_t vsize;
+    CLEANUP_FREE char *vbuf =
+      registry_value (g, info, i, prefix, &vtype, &vsize);
+
+    if (vbuf == NULL) {
+      if (errno != 0)
+        return -1;
+      continue;
+    }
+    key = &info[i][sizeof prefix];
 
     if (STRCASEEQ (key, "ProductName")) {
-      fs->product_name = guestfs_hivex_value_utf8 (g, value);
+      fs->product_name = guestfs_int_utf16_to_utf8 (vbuf, vsize);
       if (!fs->product_name)
-        goto out;
+        goto conversion_failed;
     }
     else if (STRCASEEQ (key, "CurrentMajorVersionNumber")) {
-      size_t vsize;
-      const int64_t vtype = guestfs_hivex_value_type (g, value);
-      CLEANUP_FREE char *vbuf = guestfs_hivex_value_value (g, value, &vsize);
-
-      if (vbuf == NULL)
-        goto out;
       if (vtype != 4 || vsize != 4) {
         error (g, "hivex: expected CurrentVersion\\%s to be a DWORD field",
                "CurrentMajorVersionNumber");
-        goto out;
+        return -1;
       }
 
       fs->version.v_major = le32toh (*(int32_t *)vbuf);
@@ -330,16 +414,10 @@ check_windows_software_registry (guestfs_h *g, struct inspect_fs *fs)
       ignore_currentversion = true;
     }
     else if (STRCASEEQ (key, "CurrentMinorVersionNumber")) {
-      size_t vsize;
-      const int64_t vtype = guestfs_hivex_value_type (g, value);
-      CLEANUP_FREE char *vbuf = guestfs_hivex_value_value (g, value, &vsize);
-
-      if (vbuf == NULL)
-        goto out;
       if (vtype != 4 || vsize != 4) {
         error (g, "hivex: expected CurrentVersion\\%s to be a DWORD field",
                "CurrentMinorVersionNumber");
-        goto out;
+        return -1;
       }
 
       fs->version.v_minor = le32toh (*(int32_t *)vbuf);
@@ -348,202 +426,140 @@ check_windows_software_registry (guestfs_h *g, struct inspect_fs *fs)
       ignore_currentversion = true;
     }
     else if (!ignore_currentversion && STRCASEEQ (key, "CurrentVersion")) {
-      CLEANUP_FREE char *version = guestfs_hivex_value_utf8 (g, value);
+      CLEANUP_FREE char *version = guestfs_int_utf16_to_utf8 (vbuf, vsize);
       if (!version)
-        goto out;
+        goto conversion_failed;
       if (guestfs_int_version_from_x_y_re (g, &fs->version, version,
                                            re_windows_version) == -1)
-        goto out;
+        return -1;
     }
     else if (STRCASEEQ (key, "InstallationType")) {
-      fs->product_variant = guestfs_hivex_value_utf8 (g, value);
+      fs->product_variant = guestfs_int_utf16_to_utf8 (vbuf, vsize);
       if (!fs->product_variant)
-        goto out;
+        goto conversion_failed;
     }
   }
 
-  ret = 0;
-
- out:
-  guestfs_hivex_close (g);
+  return 0;
 
-  return ret;
+ conversion_failed:
+  perrorf (g, "hivex: conversion of registry value to UTF8 failed");
+  return -1;
 }
 
 static int
-check_windows_system_registry (guestfs_h *g, struct inspect_fs *fs)
+check_windows_system_registry (guestfs_h *g, struct inspect_fs *fs,
+                               char *const *info)
 {
-  int r;
   static const char gpt_prefix[] = "DMIO:ID:";
-
-  CLEANUP_FREE char *system =
-    safe_asprintf (g, "%s/system32/config/system",
-                   fs->windows_systemroot);
-
-  CLEANUP_FREE char *system_path = guestfs_case_sensitive_path (g, system);
-  if (!system_path)
-    return -1;
-
-  r = guestfs_is_file (g, system_path);
-  if (r == -1)
-    return -1;
-  /* If the system hive doesn't exist, just accept that we cannot
-   * find hostname etc.
-   */
-  if (r == 0)
-    return 0;
-
-  int ret = -1;
-  int64_t root, node, value;
-  CLEANUP_FREE_HIVEX_VALUE_LIST struct guestfs_hivex_value_list *values = NULL;
-  CLEANUP_FREE_HIVEX_VALUE_LIST struct guestfs_hivex_value_list *values2 = NULL;
   int32_t dword;
   size_t i, count;
-  CLEANUP_FREE void *buf = NULL;
-  size_t buflen;
-  const char *hivepath[] =
-    { NULL /* current control set */, "Services", "Tcpip", "Parameters" };
-
-  if (guestfs_hivex_open (g, system_path,
-                          GUESTFS_HIVEX_OPEN_VERBOSE, g->verbose, -1) == -1)
-    goto out;
-
-  root = guestfs_hivex_root (g);
-  if (root == 0)
-    goto out;
 
-  /* Get the CurrentControlSet. */
-  node = guestfs_hivex_node_get_child (g, root, "Select");
-  if (node == -1)
-    goto out;
+  for (i = 0; info[i] != NULL; i += 2) {
+    int64_t type;
+    size_t buflen;
+    CLEANUP_FREE char *buf =
+      registry_value (g, info, i, "Select", &type, &buflen);
 
-  if (node == 0) {
-    error (g, "hivex: could not locate HKLM\\SYSTEM\\Select");
-    goto out;
-  }
-
-  value = guestfs_hivex_node_get_value (g, node, "Current");
-  if (value == -1)
-    goto out;
+    if (buf == NULL) {
+      if (errno != 0)
+        return -1;
+      continue;
+    }
 
-  if (value == 0) {
-    error (g, "hivex: HKLM\\System\\Select Default entry not found");
-    goto out;
+    if (STRCASEEQ (&info[i][7], "Current")) {
+      /* XXX Should check the type. */
+      if (buflen != 4) {
+        error (g, "hivex: HKLM\\System\\Select\\Current expected to be DWORD");
+        return -1;
+      }
+      dword = le32toh (*(int32_t *)buf);
+      fs->windows_current_control_set =
+        safe_asprintf (g, "ControlSet%03d", dword);
+    }
   }
 
-  /* XXX Should check the type. */
-  buf = guestfs_hivex_value_value (g, value, &buflen);
-  if (buflen != 4) {
-    error (g, "hivex: HKLM\\System\\Select\\Current expected to be DWORD");
-    goto out;
-  }
-  dword = le32toh (*(int32_t *)buf);
-  fs->windows_current_control_set = safe_asprintf (g, "ControlSet%03d", dword);
+  /* The system hive doesn't exist. */
+  if (fs->windows_current_control_set == NULL)
+    return 0;
 
   /* Get the drive mappings.
    * This page explains the contents of HKLM\System\MountedDevices:
    * http://www.goodells.net/multiboot/partsigs.shtml
-   */
-  node = guestfs_hivex_node_get_child (g, root, "MountedDevices");
-  if (node == -1)
-    goto out;
-
-  if (node == 0)
-    /* Not found: skip getting drive letter mappings (RHBZ#803664). */
-    goto skip_drive_letter_mappings;
-
-  values = guestfs_hivex_node_values (g, node);
-
-  /* Count how many DOS drive letter mappings there are.  This doesn't
+   *
+   * Count how many DOS drive letter mappings there are.  This doesn't
    * ignore removable devices, so it overestimates, but that doesn't
    * matter because it just means we'll allocate a few bytes extra.
    */
-  for (i = count = 0; i < values->len; ++i) {
-    CLEANUP_FREE char *key =
-      guestfs_hivex_value_key (g, values->val[i].hivex_value_h);
-    if (key == NULL)
-      goto out;
-    if (STRCASEEQLEN (key, "\\DosDevices\\", 12) &&
-        c_isalpha (key[12]) && key[13] == ':')
-      count++;
+  for (i = count = 0; info[i] != NULL; i += 2) {
+    if (STRPREFIX (info[i], "MountedDevices\\")) {
+      const char *key = &info[i][15];
+      if (STRCASEEQLEN (key, "\\DosDevices\\", 12) &&
+          c_isalpha (key[12]) && key[13] == ':')
+        count++;
+    }
   }
 
   fs->drive_mappings = safe_calloc (g, 2*count + 1, sizeof (char *));
 
-  for (i = count = 0; i < values->len; ++i) {
-    const int64_t v = values->val[i].hivex_value_h;
-    CLEANUP_FREE char *key = guestfs_hivex_value_key (g, v);
-    if (key == NULL)
-      goto out;
-    if (STRCASEEQLEN (key, "\\DosDevices\\", 12) &&
-        c_isalpha (key[12]) && key[13] == ':') {
-      /* Get the binary value.  Is it a fixed disk? */
-      CLEANUP_FREE char *blob = NULL;
-      char *device;
-      int64_t type;
-      bool is_gpt;
-      size_t len;
-
-      type = guestfs_hivex_value_type (g, v);
-      blob = guestfs_hivex_value_value (g, v, &len);
-      is_gpt = memcmp (blob, gpt_prefix, 8) == 0;
-      if (blob != NULL && type == 3 && (len == 12 || is_gpt)) {
-        /* Try to map the blob to a known disk and partition. */
-        if (is_gpt)
-          device = map_registry_disk_blob_gpt (g, blob);
-        else
-          device = map_registry_disk_blob (g, blob);
-
-        if (device != NULL) {
-          fs->drive_mappings[count++] = safe_strndup (g, &key[12], 1);
-          fs->drive_mappings[count++] = device;
-        }
+  for (i = count = 0; info[i] != NULL; i += 2) {
+    const char *key;
+    CLEANUP_FREE char *blob = NULL;
+    char *device;
+    int64_t type;
+    bool is_gpt;
+    size_t len;
+
+    if (!STRPREFIX (info[i], "MountedDevices\\"))
+      continue;
+    key = &info[i][15];
+    if (!STRCASEEQLEN (key, "\\DosDevices\\", 12) ||
+        !c_isalpha (key[12]) || key[13] != ':')
+      continue;
+
+    /* Get the binary value.  Is it a fixed disk? */
+    blob = registry_value (g, info, i, "MountedDevices", &type, &len);
+    if (blob == NULL)
+      return -1;
+    is_gpt = len >= 8 && memcmp (blob, gpt_prefix, 8) == 0;
+    if (type == 3 && (len == 12 || is_gpt)) {
+      /* Try to map the blob to a known disk and partition. */
+      if (is_gpt)
+        device = map_registry_disk_blob_gpt (g, blob);
+      else
+        device = map_registry_disk_blob (g, blob);
+
+      if (device != NULL) {
+        fs->drive_mappings[count++] = safe_strndup (g, &key[12], 1);
+        fs->drive_mappings[count++] = device;
       }
     }
   }
 
- skip_drive_letter_mappings:;
   /* Get the hostname. */
-  hivepath[0] = fs->windows_current_control_set;
-  for (node = root, i = 0;
-       node > 0 && i < sizeof hivepath / sizeof hivepath[0];
-       ++i) {
-    node = guestfs_hivex_node_get_child (g, node, hivepath[i]);
-  }
-
-  if (node == -1)
-    goto out;
-
-  if (node == 0) {
-    perrorf (g, "hivex: cannot locate HKLM\\SYSTEM\\%s\\Services\\Tcpip\\Parameters",
-             fs->windows_current_control_set);
-    goto out;
-  }
-
-  values2 = guestfs_hivex_node_values (g, node);
-  if (values2 == NULL)
-    goto out;
-
-  for (i = 0; i < values2->len; ++i) {
-    const int64_t v = values2->val[i].hivex_value_h;
-    CLEANUP_FREE char *key = guestfs_hivex_value_key (g, v);
-    if (key == NULL)
-      goto out;
+  for (i = 0; info[i] != NULL; i += 2) {
+    int64_t type;
+    size_t len;
+    CLEANUP_FREE char *buf =
+      registry_value (g, info, i, "Parameters", &type, &len);
+
+    if (buf == NULL) {
+      if (errno != 0)
+        return -1;
+      continue;
+    }
 
-    if (STRCASEEQ (key, "Hostname")) {
-      fs->hostname = guestfs_hivex_value_utf8 (g, v);
-      if (!fs->hostname)
-        goto out;
+    if (STRCASEEQ (&info[i][11], "Hostname")) {
+      fs->hostname = guestfs_int_utf16_to_utf8 (buf, len);
+      if (!fs->hostname) {
+        perrorf (g, "hivex: conversion of registry value to UTF8 failed");
+        return -1;
+      }
     }
     /* many other interesting fields here ... */
   }
 
-  ret = 0;
-
- out:
-  guestfs_hivex_close (g);
-
-  return ret;
+  return 0;
 }
 
 /* Windows Registry HKLM\SYSTEM\MountedDevices uses a blob of data
@@ -706,8 +722,6 @@ guestfs_int_case_sensitive_path_silently (guestfs_h *g, const char *path)
  * the appliance because it uses iconv_open which doesn't work because
  * we delete all the i18n databases.
  */
-static char *utf16_to_utf8 (/* const */ char *input, size_t len);
-
 char *
 guestfs_impl_hivex_value_utf8 (guestfs_h *g, int64_t valueh)
 {
@@ -718,7 +732,7 @@ guestfs_impl_hivex_value_utf8 (guestfs_h *g, int64_t valueh)
   if (buf == NULL)
     return NULL;
 
-  ret = utf16_to_utf8 (buf, buflen);
+  ret = guestfs_int_utf16_to_utf8 (buf, buflen);
   if (ret == NULL) {
     perrorf (g, "hivex: conversion of registry value to UTF8 failed");
     return NULL;
@@ -727,8 +741,8 @@ guestfs_impl_hivex_value_utf8 (guestfs_h *g, int64_t valueh)
   return ret;
 }
 
-static char *
-utf16_to_utf8 (/* const */ char *input, size_t len)
+char *
+guestfs_int_utf16_to_utf8 (/* const */ char *input, size_t len)
 {
   iconv_t ic = iconv_open ("UTF-8", "UTF-16LE");
   if (ic == (iconv_t) -1)
@@ -42,27 +42,26 @@ static int check_filesystem (guestfs_h *g, const char *mountable,
 static void extend_fses (guestfs_h *g);
 static int get_partition_context (guestfs_h *g, const char *partition, int *partnum_ret, int *nr_partitions_ret);
 static int is_symlink_to (guestfs_h *g, const char *file, const char *wanted_target);
+static void probe_filesystem (guestfs_h *g);
 
 /* Find out if 'device' contains a filesystem.  If it does, add
  * another entry in g->fses.
+ *
+ * 'vfs_type' is the result of guestfs_vfs_type on 'mountable', or
+ * NULL if that failed.  The caller gets these for all filesystems up
+ * front (see probe_vfs_types in inspect.c).
  */
 int
-guestfs_int_check_for_filesystem_on (guestfs_h *g, const char *mountable)
+guestfs_int_check_for_filesystem_on (guestfs_h *g, const char *mountable,
+                                     const char *vfs_type)
 {
-  CLEANUP_FREE char *vfs_type = NULL;
   int is_swap, r;
   struct inspect_fs *fs;
   CLEANUP_FREE_INTERNAL_MOUNTABLE struct guestfs_internal_mountable *m = NULL;
   int whole_device = 0;
+  char *cache_key;
 
-  /* Get vfs-type in order to check if it's a Linux(?) swap device.
-   * If there's an error we should ignore it, so to do that we have to
-   * temporarily replace the error handler with a null one.
-   */
-  guestfs_push_error_handler (g, NULL, NULL);
-  vfs_type = guestfs_vfs_type (g, mountable);
-  guestfs_pop_error_handler (g);
-
+  /* Check if it's a Linux(?) swap device. */
   is_swap = vfs_type && STREQ (vfs_type, "swap");
   debug (g, "check_for_filesystem_on: %s (%s)",
          mountable, vfs_type ? vfs_type : "failed to get vfs type");
@@ -102,6 +101,21 @@ guestfs_int_check_for_filesystem_on (guestfs_h *g, const char *mountable)
     g->nr_fses--;
   }
 
+  /* If this filesystem has not changed since it was last inspected,
+   * we can avoid mounting it at all.
+   */
+  cache_key = guestfs_int_inspect_cache_key (g, mountable, m, vfs_type);
+  if (cache_key) {
+    extend_fses (g);
+    fs = &g->fses[g->nr_fses-1];
+    if (guestfs_int_inspect_cache_load_fs (g, cache_key, fs)) {
+      fs->mountable = safe_strdup (g, mountable);
+      fs->cache_key = cache_key;
+      return 0;
+    }
+    g->nr_fses--;
+  }
+
   /* Try mounting the device.  As above, ignore errors. */
   guestfs_push_error_handler (g, NULL, NULL);
   if (vfs_type && STREQ (vfs_type, "ufs")) { /* Hack for the *BSDs. */
@@ -114,11 +128,25 @@ guestfs_int_check_for_filesystem_on (guestfs_h *g, const char *mountable)
     r = guestfs_mount_ro (g, mountable, "/");
   }
   guestfs_pop_error_handler (g);
-  if (r == -1)
+  if (r == -1) {
+    free (cache_key);
     return 0;
+  }
 
   /* Do the rest of the checks. */
+  probe_filesystem (g);
   r = check_filesystem (g, mountable, m, whole_device);
+  free (g->inspect_probe);
+  g->inspect_probe = NULL;
+
+  /* Don't cache incomplete results from a deferred inspection. */
+  if (r == 0 && cache_key && g->fses[g->nr_fses-1].deferred == 0) {
+    fs = &g->fses[g->nr_fses-1];
+    guestfs_int_inspect_cache_save_fs (g, cache_key, fs);
+    fs->cache_key = cache_key;
+  }
+  else
+    free (cache_key);
 
   /* Unmount the filesystem. */
   if (guestfs_umount_all (g) == -1)
@@ -150,20 +178,20 @@ check_filesystem (guestfs_h *g, const char *mountable,
   fs->mountable = safe_strdup (g, mountable);
 
   /* Optimize some of the tests by avoiding multiple tests of the same thing. */
-  const int is_dir_etc = guestfs_is_dir (g, "/etc") > 0;
-  const int is_dir_bin = guestfs_is_dir (g, "/bin") > 0;
-  const int is_dir_share = guestfs_is_dir (g, "/share") > 0;
+  const int is_dir_etc = guestfs_int_probe_is_dir (g, "/etc") > 0;
+  const int is_dir_bin = guestfs_int_probe_is_dir (g, "/bin") > 0;
+  const int is_dir_share = guestfs_int_probe_is_dir (g, "/share") > 0;
 
   /* Grub /boot? */
-  if (guestfs_is_file (g, "/grub/menu.lst") > 0 ||
-      guestfs_is_file (g, "/grub/grub.conf") > 0 ||
-      guestfs_is_file (g, "/grub2/grub.cfg") > 0)
+  if (guestfs_int_probe_is_file (g, "/grub/menu.lst", 0) > 0 ||
+      guestfs_int_probe_is_file (g, "/grub/grub.conf", 0) > 0 ||
+      guestfs_int_probe_is_file (g, "/grub2/grub.cfg", 0) > 0)
     ;
   /* FreeBSD root? */
   else if (is_dir_etc &&
            is_dir_bin &&
-           guestfs_is_file (g, "/etc/freebsd-update.conf") > 0 &&
-           guestfs_is_file (g, "/etc/fstab") > 0) {
+           guestfs_int_probe_is_file (g, "/etc/freebsd-update.conf", 0) > 0 &&
+           guestfs_int_probe_is_file (g, "/etc/fstab", 0) > 0) {
     fs->role = OS_ROLE_ROOT;
     fs->format = OS_FORMAT_INSTALLED;
     if (guestfs_int_check_freebsd_root (g, fs) == -1)
@@ -172,9 +200,9 @@ check_filesystem (guestfs_h *g, const char *mountable,
   /* NetBSD root? */
   else if (is_dir_etc &&
            is_dir_bin &&
-           guestfs_is_file (g, "/netbsd") > 0 &&
-           guestfs_is_file (g, "/etc/fstab") > 0 &&
-           guestfs_is_file (g, "/etc/release") > 0) {
+           guestfs_int_probe_is_file (g, "/netbsd", 0) > 0 &&
+           guestfs_int_probe_is_file (g, "/etc/fstab", 0) > 0 &&
+           guestfs_int_probe_is_file (g, "/etc/release", 0) > 0) {
     fs->role = OS_ROLE_ROOT;
     fs->format = OS_FORMAT_INSTALLED;
     if (guestfs_int_check_netbsd_root (g, fs) == -1)
@@ -183,18 +211,18 @@ check_filesystem (guestfs_h *g, const char *mountable,
   /* OpenBSD root? */
   else if (is_dir_etc &&
            is_dir_bin &&
-           guestfs_is_file (g, "/bsd") > 0 &&
-           guestfs_is_file (g, "/etc/fstab") > 0 &&
-           guestfs_is_file (g, "/etc/motd") > 0) {
+           guestfs_int_probe_is_file (g, "/bsd", 0) > 0 &&
+           guestfs_int_probe_is_file (g, "/etc/fstab", 0) > 0 &&
+           guestfs_int_probe_is_file (g, "/etc/motd", 0) > 0) {
     fs->role = OS_ROLE_ROOT;
     fs->format = OS_FORMAT_INSTALLED;
     if (guestfs_int_check_openbsd_root (g, fs) == -1)
       return -1;
   }
   /* Hurd root? */
-  else if (guestfs_is_file (g, "/hurd/console") > 0 &&
-           guestfs_is_file (g, "/hurd/hello") > 0 &&
-           guestfs_is_file (g, "/hurd/null") > 0) {
+  else if (guestfs_int_probe_is_file (g, "/hurd/console", 0) > 0 &&
+           guestfs_int_probe_is_file (g, "/hurd/hello", 0) > 0 &&
+           guestfs_int_probe_is_file (g, "/hurd/null", 0) > 0) {
     fs->role = OS_ROLE_ROOT;
     fs->format = OS_FORMAT_INSTALLED; /* XXX could be more specific */
     if (guestfs_int_check_hurd_root (g, fs) == -1)
@@ -203,9 +231,9 @@ check_filesystem (guestfs_h *g, const char *mountable,
   /* Minix root? */
   else if (is_dir_etc &&
            is_dir_bin &&
-           guestfs_is_file (g, "/service/vm") > 0 &&
-           guestfs_is_file (g, "/etc/fstab") > 0 &&
-           guestfs_is_file (g, "/etc/version") > 0) {
+           guestfs_int_probe_is_file (g, "/service/vm", 0) > 0 &&
+           guestfs_int_probe_is_file (g, "/etc/fstab", 0) > 0 &&
+           guestfs_int_probe_is_file (g, "/etc/version", 0) > 0) {
     fs->role = OS_ROLE_ROOT;
     fs->format = OS_FORMAT_INSTALLED;
     if (guestfs_int_check_minix_root (g, fs) == -1)
@@ -215,8 +243,8 @@ check_filesystem (guestfs_h *g, const char *mountable,
   else if (is_dir_etc &&
            (is_dir_bin ||
             is_symlink_to (g, "/bin", "usr/bin") > 0) &&
-           (guestfs_is_file (g, "/etc/fstab") > 0 ||
-            guestfs_is_file (g, "/etc/hosts") > 0)) {
+           (guestfs_int_probe_is_file (g, "/etc/fstab", 0) > 0 ||
+            guestfs_int_probe_is_file (g, "/etc/hosts", 0) > 0)) {
     fs->role = OS_ROLE_ROOT;
     fs->format = OS_FORMAT_INSTALLED;
     if (guestfs_int_check_linux_root (g, fs) == -1)
@@ -224,10 +252,10 @@ check_filesystem (guestfs_h *g, const char *mountable,
   }
   /* CoreOS root? */
   else if (is_dir_etc &&
-           guestfs_is_dir (g, "/root") > 0 &&
-           guestfs_is_dir (g, "/home") > 0 &&
-           guestfs_is_dir (g, "/usr") > 0 &&
-           guestfs_is_file (g, "/etc/coreos/update.conf") > 0) {
+           guestfs_int_probe_is_dir (g, "/root") > 0 &&
+           guestfs_int_probe_is_dir (g, "/home") > 0 &&
+           guestfs_int_probe_is_dir (g, "/usr") > 0 &&
+           guestfs_int_probe_is_file (g, "/etc/coreos/update.conf", 0) > 0) {
     fs->role = OS_ROLE_ROOT;
     fs->format = OS_FORMAT_INSTALLED;
     if (guestfs_int_check_coreos_root (g, fs) == -1)
@@ -237,30 +265,30 @@ check_filesystem (guestfs_h *g, const char *mountable,
   else if (is_dir_etc &&
            is_dir_bin &&
            is_dir_share &&
-           guestfs_is_dir (g, "/local") == 0 &&
-           guestfs_is_file (g, "/etc/fstab") == 0)
+           guestfs_int_probe_is_dir (g, "/local") == 0 &&
+           guestfs_int_probe_is_file (g, "/etc/fstab", 0) == 0)
     ;
   /* Linux /usr? */
   else if (is_dir_etc &&
            is_dir_bin &&
            is_dir_share &&
-           guestfs_is_dir (g, "/local") > 0 &&
-           guestfs_is_file (g, "/etc/fstab") == 0) {
+           guestfs_int_probe_is_dir (g, "/local") > 0 &&
+           guestfs_int_probe_is_file (g, "/etc/fstab", 0) == 0) {
     if (guestfs_int_check_linux_usr (g, fs) == -1)
       return -1;
   }
   /* CoreOS /usr? */
   else if (is_dir_bin &&
            is_dir_share &&
-           guestfs_is_dir (g, "/local") > 0 &&
-           guestfs_is_dir (g, "/share/coreos") > 0) {
+           guestfs_int_probe_is_dir (g, "/local") > 0 &&
+           guestfs_int_probe_is_dir (g, "/share/coreos") > 0) {
     if (guestfs_int_check_coreos_usr (g, fs) == -1)
       return -1;
   }
   /* Linux /var? */
-  else if (guestfs_is_dir (g, "/log") > 0 &&
-           guestfs_is_dir (g, "/run") > 0 &&
-           guestfs_is_dir (g, "/spool") > 0)
+  else if (guestfs_int_probe_is_dir (g, "/log") > 0 &&
+           guestfs_int_probe_is_dir (g, "/run") > 0 &&
+           guestfs_int_probe_is_dir (g, "/spool") > 0)
     ;
   /* Windows root? */
   else if ((windows_systemroot = guestfs_int_get_windows_systemroot (g)) != NULL)
@@ -299,15 +327,15 @@ check_filesystem (guestfs_h *g, const char *mountable,
    * first partition (eg. bootable USB key).
    */
   else if ((whole_device || (partnum == 1 && nr_partitions == 1)) &&
-           (guestfs_is_file (g, "/isolinux/isolinux.cfg") > 0 ||
-            guestfs_is_dir (g, "/EFI/BOOT") > 0 ||
-            guestfs_is_file (g, "/images/install.img") > 0 ||
-            guestfs_is_dir (g, "/.disk") > 0 ||
-            guestfs_is_file (g, "/.discinfo") > 0 ||
-            guestfs_is_file (g, "/i386/txtsetup.sif") > 0 ||
-            guestfs_is_file (g, "/amd64/txtsetup.sif") > 0 ||
-            guestfs_is_file (g, "/freedos/freedos.ico") > 0 ||
-            guestfs_is_file (g, "/boot/loader.rc") > 0)) {
+           (guestfs_int_probe_is_file (g, "/isolinux/isolinux.cfg", 0) > 0 ||
+            guestfs_int_probe_is_dir (g, "/EFI/BOOT") > 0 ||
+            guestfs_int_probe_is_file (g, "/images/install.img", 0) > 0 ||
+            guestfs_int_probe_is_dir (g, "/.disk") > 0 ||
+            guestfs_int_probe_is_file (g, "/.discinfo", 0) > 0 ||
+            guestfs_int_probe_is_file (g, "/i386/txtsetup.sif", 0) > 0 ||
+            guestfs_int_probe_is_file (g, "/amd64/txtsetup.sif", 0) > 0 ||
+            guestfs_int_probe_is_file (g, "/freedos/freedos.ico", 0) > 0 ||
+            guestfs_int_probe_is_file (g, "/boot/loader.rc", 0) > 0)) {
     fs->role = OS_ROLE_ROOT;
     fs->format = OS_FORMAT_INSTALLER;
     if (guestfs_int_check_installer_root (g, fs) == -1)
@@ -372,7 +400,7 @@ is_symlink_to (guestfs_h *g, const char *file, const char *wanted_target)
 {
   CLEANUP_FREE char *target = NULL;
 
-  if (guestfs_is_symlink (g, file) == 0)
+  if (guestfs_int_probe_is_symlink (g, file) == 0)
     return 0;
 
   target = guestfs_readlink (g, file);
@@ -383,6 +411,188 @@ is_symlink_to (guestfs_h *g, const char *file, const char *wanted_target)
   return STREQ (target, wanted_target);
 }
 
+/* Every constant path tested by check_filesystem and the
+ * guestfs_int_check_*_root functions.  These are all looked up with a
+ * single guestfs_internal_probe_paths call when the filesystem is
+ * mounted, and the guestfs_int_probe_is_* functions answer from the
+ * result.  Other paths still cost a round trip each, so add any new
+ * paths here.  This list must be sorted by strcmp.
+ */
+static const char *probe_paths[] = {
+  "/.discinfo",
+  "/.disk",
+  "/.disk/cd_type",
+  "/.disk/info",
+  "/.treeinfo",
+  "/EFI/BOOT",
+  "/amd64/txtsetup.sif",
+  "/bin",
+  "/bin/bash",
+  "/bin/echo",
+  "/bin/ls",
+  "/bin/rm",
+  "/bin/sh",
+  "/boot/loader.rc",
+  "/bsd",
+  "/casper/filesystem.squashfs",
+  "/etc",
+  "/etc/HOSTNAME",
+  "/etc/SuSE-release",
+  "/etc/alpine-release",
+  "/etc/altlinux-release",
+  "/etc/arch-release",
+  "/etc/br-version",
+  "/etc/centos-release",
+  "/etc/cirros/version",
+  "/etc/coreos/update.conf",
+  "/etc/debian_version",
+  "/etc/freebsd-update.conf",
+  "/etc/frugalware-release",
+  "/etc/fstab",
+  "/etc/gentoo-release",
+  "/etc/hostname",
+  "/etc/hostname.file",
+  "/etc/hosts",
+  "/etc/lsb-release",
+  "/etc/meego-release",
+  "/etc/motd",
+  "/etc/myname",
+  "/etc/oracle-release",
+  "/etc/os-release",
+  "/etc/pardus-release",
+  "/etc/pld-release",
+  "/etc/rc.conf",
+  "/etc/redhat-release",
+  "/etc/release",
+  "/etc/slackware-version",
+  "/etc/sysconfig/network",
+  "/etc/ttylinux-target",
+  "/etc/version",
+  "/freedos/freedos.ico",
+  "/grub/grub.conf",
+  "/grub/menu.lst",
+  "/grub2/grub.cfg",
+  "/home",
+  "/hurd/console",
+  "/hurd/hello",
+  "/hurd/null",
+  "/i386/txtsetup.sif",
+  "/images/install.img",
+  "/isolinux/isolinux.cfg",
+  "/lib/os-release",
+  "/live/filesystem.squashfs",
+  "/local",
+  "/log",
+  "/mfsroot.gz",
+  "/netbsd",
+  "/root",
+  "/run",
+  "/service/vm",
+  "/setup.bat",
+  "/share",
+  "/share/coreos",
+  "/share/coreos/lsb-release",
+  "/spool",
+  "/usr",
+  "/usr/bin/dnf",
+  "/usr/share/cirros/logo",
+  NULL
+};
+#define NR_PROBE_PATHS (sizeof probe_paths / sizeof probe_paths[0] - 1)
+
+static int
+compare_probe_paths (const void *av, const void *bv)
+{
+  const char *a = av;
+  const char *const *b = bv;
+
+  return strcmp (a, *b);
+}
+
+/* Probe all of probe_paths in the filesystem mounted on /.  If this
+ * fails, g->inspect_probe is left NULL and every test does a round
+ * trip as before.
+ */
+static void
+probe_filesystem (guestfs_h *g)
+{
+  const size_t n = NR_PROBE_PATHS;
+  char *flags;
+  size_t size;
+
+  free (g->inspect_probe);
+  g->inspect_probe = NULL;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  flags = guestfs_internal_probe_paths (g, (char **) probe_paths, &size);
+  guestfs_pop_error_handler (g);
+  if (flags == NULL)
+    return;
+  if (size != n) {
+    debug (g, "internal_probe_paths: expected %zu results, got %zu", n, size);
+    free (flags);
+    return;
+  }
+
+  g->inspect_probe = flags;
+}
+
+/* Return the probe result for 'path', or -1 if we have to ask the
+ * daemon.
+ */
+static int
+get_probe (guestfs_h *g, const char *path)
+{
+  const char **p;
+  int flags;
+
+  if (g->inspect_probe == NULL)
+    return -1;
+
+  p = bsearch (path, probe_paths, NR_PROBE_PATHS,
+               sizeof probe_paths[0], compare_probe_paths);
+  if (p == NULL)
+    return -1;
+
+  flags = (unsigned char) g->inspect_probe[p - probe_paths];
+  if (flags & PROBE_ERROR)
+    return -1;
+  return flags;
+}
+
+/* These return the same as the equivalent guestfs_is_* calls. */
+int
+guestfs_int_probe_is_file (guestfs_h *g, const char *path, int followsymlinks)
+{
+  const int flags = get_probe (g, path);
+
+  if (flags == -1)
+    return guestfs_is_file_opts (g, path,
+                                 GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS,
+                                 followsymlinks, -1);
+  return (flags & (followsymlinks ? PROBE_FOLLOW_IS_FILE : PROBE_IS_FILE)) != 0;
+}
+
+int
+guestfs_int_probe_is_dir (guestfs_h *g, const char *path)
+{
+  const int flags = get_probe (g, path);
+
+  if (flags == -1)
+    return guestfs_is_dir (g, path);
+  return (flags & PROBE_IS_DIR) != 0;
+}
+
+int
+guestfs_int_probe_is_symlink (guestfs_h *g, const char *path)
+{
+  const int flags = get_probe (g, path);
+
+  if (flags == -1)
+    return guestfs_is_symlink (g, path);
+  return (flags & PROBE_IS_SYMLINK) != 0;
+}
+
 int
 guestfs_int_is_file_nocase (guestfs_h *g, const char *path)
 {
@@ -522,8 +732,7 @@ guestfs_int_check_package_management (guestfs_h *g, struct inspect_fs *fs)
   case OS_DISTRO_FEDORA:
     /* If Fedora >= 22 and dnf is installed, say "dnf". */
     if (guestfs_int_version_ge (&fs->version, 22, 0, 0) &&
-        guestfs_is_file_opts (g, "/usr/bin/dnf",
-                              GUESTFS_IS_FILE_OPTS_FOLLOWSYMLINKS, 1, -1) > 0)
+        guestfs_int_probe_is_file (g, "/usr/bin/dnf", 1) > 0)
       fs->package_management = OS_PACKAGE_MANAGEMENT_DNF;
     else if (guestfs_int_version_ge (&fs->version, 1, 0, 0))
       fs->package_management = OS_PACKAGE_MANAGEMENT_YUM;
@@ -713,6 +922,8 @@ guestfs_int_merge_fs_inspections (guestfs_h *g, struct inspect_fs *dst, struct i
   if (dst->distro == 0)
     dst->distro = src->distro;
 
+  dst->deferred |= src->deferred;
+
   if (dst->package_format == 0)
     dst->package_format = src->package_format;
 
@@ -795,3 +1006,82 @@ guestfs_int_merge_fs_inspections (guestfs_h *g, struct inspect_fs *dst, struct i
     dst->nr_fstab = n;
   }
 }
+
+/**
+ * Do the checks which L<guestfs(3)/guestfs_inspect_os> skipped for
+ * the root C<fs> because it was called with C<defer> set.
+ *
+ * If nothing is mounted, the root filesystem (and a separate F</usr>
+ * from its fstab) is mounted read-only for the duration of the
+ * checks.  If the caller has already mounted the guest, the checks run
+ * against those mounts, provided that C<fs> is what is mounted on
+ * F</>.
+ */
+int
+guestfs_int_inspect_complete (guestfs_h *g, struct inspect_fs *fs)
+{
+  CLEANUP_FREE_STRING_LIST char **mps = NULL;
+  const int what = fs->deferred;
+  bool mounted = false;
+  size_t i;
+  int r;
+
+  mps = guestfs_mountpoints (g);
+  if (mps == NULL)
+    return -1;
+
+  if (mps[0] != NULL) {
+    for (i = 0; mps[i] != NULL; i += 2) {
+      if (STREQ (mps[i+1], "/"))
+        break;
+    }
+    if (mps[i] == NULL || STRNEQ (mps[i], fs->mountable)) {
+      error (g, _("cannot complete inspection of %s because other filesystems are mounted"),
+             fs->mountable);
+      return -1;
+    }
+  }
+  else {
+    guestfs_push_error_handler (g, NULL, NULL);
+    r = guestfs_mount_ro (g, fs->mountable, "/");
+    if (r == -1 &&
+        (fs->type == OS_TYPE_FREEBSD || fs->type == OS_TYPE_NETBSD ||
+         fs->type == OS_TYPE_OPENBSD)) {
+      r = guestfs_mount_vfs (g, "ro,ufstype=ufs2", "ufs", fs->mountable, "/");
+      if (r == -1)
+        r = guestfs_mount_vfs (g, "ro,ufstype=44bsd", "ufs",
+                               fs->mountable, "/");
+    }
+    guestfs_pop_error_handler (g);
+    if (r == -1) {
+      error (g, _("cannot mount %s to complete inspection"), fs->mountable);
+      return -1;
+    }
+    mounted = true;
+
+    /* The binaries used to find the architecture may be on /usr. */
+    for (i = 0; i < fs->nr_fstab; ++i) {
+      if (STREQ (fs->fstab[i].mountpoint, "/usr") &&
+          STRNEQ (fs->fstab[i].mountable, fs->mountable)) {
+        guestfs_push_error_handler (g, NULL, NULL);
+        ignore_value (guestfs_mount_ro (g, fs->fstab[i].mountable, "/usr"));
+        guestfs_pop_error_handler (g);
+        break;
+      }
+    }
+  }
+
+  debug (g, "inspect: completing deferred checks 0x%x for %s",
+         (unsigned) what, fs->mountable);
+
+  fs->deferred = 0;
+  if (fs->type == OS_TYPE_WINDOWS)
+    r = guestfs_int_check_windows_deferred (g, fs, what);
+  else
+    r = guestfs_int_check_unix_deferred (g, fs, what);
+
+  if (mounted && guestfs_umount_all (g) == -1)
+    r = -1;
+
+  return r;
+}
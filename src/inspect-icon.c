@@ -32,10 +32,6 @@
 #if defined(PBMTEXT) && defined (PNMTOPNG)
 #define CAN_DO_CIRROS 1
 #endif
-#if defined(WRESTOOL) && defined(BMPTOPNM) && defined(PNMTOPNG) &&	\
-  defined(PAMCUT)
-#define CAN_DO_WINDOWS 1
-#endif
 
 /* All these icon_*() functions return the same way.  One of:
  *
@@ -63,9 +59,7 @@ static char *icon_cirros (guestfs_h *g, struct inspect_fs *fs, size_t *size_r);
 #endif
 static char *icon_voidlinux (guestfs_h *g, struct inspect_fs *fs, size_t *size_r);
 static char *icon_altlinux (guestfs_h *g, struct inspect_fs *fs, size_t *size_r);
-#if CAN_DO_WINDOWS
 static char *icon_windows (guestfs_h *g, struct inspect_fs *fs, size_t *size_r);
-#endif
 
 /* Dummy static object. */
 static char *NOT_FOUND = (char *) "not_found";
@@ -194,13 +188,11 @@ guestfs_impl_inspect_get_icon (guestfs_h *g, const char *root, size_t *size_r,
     break;
 
   case OS_TYPE_WINDOWS:
-#if CAN_DO_WINDOWS
     /* We don't know how to get high quality icons from a Windows guest,
      * so disable this if high quality was specified.
      */
     if (!highquality)
       r = icon_windows (g, fs, &size);
-#endif
     break;
 
   case OS_TYPE_FREEBSD:
@@ -463,35 +455,69 @@ icon_altlinux (guestfs_h *g, struct inspect_fs *fs, size_t *size_r)
   return get_png (g, fs, ALTLINUX_ICON, size_r, 20480);
 }
 
-#if CAN_DO_WINDOWS
-
 /* Windows, as usual, has to be much more complicated and stupid than
  * anything else.
  *
- * We have to download %systemroot%\explorer.exe and use a special
- * program called 'wrestool' to extract the icons from this file.  For
+ * We have to extract the icons from %systemroot%\explorer.exe.  For
  * each version of Windows, the icon we want is in a different place.
  * The icon is in a stupid format (BMP), and in some cases multiple
  * icons are in a single BMP file so we have to do some manipulation
- * on the file.
+ * on the file.  All of this is done in process (see F<src/pe.c> and
+ * F<src/png.c>), reading only the resource we need from the guest.
  *
  * XXX I've only bothered with this nonsense for a few versions of
  * Windows that I have handy.  Please send patches to support other
  * versions.
  */
 
+/* Extract bitmap resource 'name' from the executable 'filename',
+ * convert it to PNG, and keep the top 'max_height' rows (if > 0).
+ * If the inspection cache is enabled, the result is cached by the
+ * checksum of the executable, which is the same across every guest
+ * with the same build of Windows.
+ */
+static char *
+icon_from_pe (guestfs_h *g, const char *filename, int name, int max_height,
+              size_t *size_r)
+{
+  CLEANUP_FREE char *method = NULL;
+  CLEANUP_FREE char *key = NULL;
+  CLEANUP_FREE char *bitmap = NULL;
+  size_t bitmap_size;
+  char *ret;
+
+  method = safe_asprintf (g, "pe-2-%d-%d", name, max_height);
+  key = guestfs_int_inspect_cache_icon_key (g, filename, method);
+  if (key) {
+    ret = guestfs_int_inspect_cache_load_icon (g, key, size_r);
+    if (ret)
+      return ret;
+  }
+
+  bitmap = guestfs_int_pe_read_resource (g, filename, 2 /* RT_BITMAP */, name,
+                                         MAX_WINDOWS_EXPLORER_SIZE,
+                                         &bitmap_size);
+  if (bitmap == NULL)
+    return NOT_FOUND;
+
+  ret = guestfs_int_dib_to_png (g, bitmap, bitmap_size, max_height, size_r);
+  if (ret == NULL)
+    return NOT_FOUND;
+
+  if (key)
+    guestfs_int_inspect_cache_save_icon (g, key, ret, *size_r);
+
+  return ret;
+}
+
 static char *
 icon_windows_xp (guestfs_h *g, struct inspect_fs *fs, size_t *size_r)
 {
   CLEANUP_FREE char *filename = NULL;
   CLEANUP_FREE char *filename_case = NULL;
-  CLEANUP_FREE char *filename_downloaded = NULL;
-  CLEANUP_FREE char *pngfile = NULL;
-  CLEANUP_CMD_CLOSE struct command *cmd = guestfs_int_new_command (g);
   int r;
-  char *ret;
 
-  /* Download %systemroot%\explorer.exe */
+  /* %systemroot%\explorer.exe */
   filename = safe_asprintf (g, "%s/explorer.exe", fs->windows_systemroot);
   filename_case = guestfs_case_sensitive_path (g, filename);
   if (filename_case == NULL)
@@ -505,29 +531,7 @@ icon_windows_xp (guestfs_h *g, struct inspect_fs *fs, size_t *size_r)
   if (r == 0)
     return NOT_FOUND;
 
-  filename_downloaded = guestfs_int_download_to_tmp (g, fs, filename_case,
-						     "explorer.exe",
-						     MAX_WINDOWS_EXPLORER_SIZE);
-  if (filename_downloaded == NULL)
-    return NOT_FOUND;
-
-  pngfile = safe_asprintf (g, "%s/windows-xp-icon.png", g->tmpdir);
-
-  guestfs_int_cmd_add_string_unquoted (cmd, WRESTOOL " -x --type=2 --name=143 ");
-  guestfs_int_cmd_add_string_quoted   (cmd, filename_downloaded);
-  guestfs_int_cmd_add_string_unquoted (cmd,
-				       " | " BMPTOPNM " | " PNMTOPNG " > ");
-  guestfs_int_cmd_add_string_quoted   (cmd, pngfile);
-  r = guestfs_int_cmd_run (cmd);
-  if (r == -1)
-    return NULL;
-  if (!WIFEXITED (r) || WEXITSTATUS (r) != 0)
-    return NOT_FOUND;
-
-  if (guestfs_int_read_whole_file (g, pngfile, &ret, size_r) == -1)
-    return NULL;
-
-  return ret;
+  return icon_from_pe (g, filename_case, 143, 0, size_r);
 }
 
 /* For Windows 7 we get the icon from explorer.exe.  Prefer
@@ -547,11 +551,7 @@ icon_windows_7 (guestfs_h *g, struct inspect_fs *fs, size_t *size_r)
 {
   size_t i;
   CLEANUP_FREE char *filename_case = NULL;
-  CLEANUP_FREE char *filename_downloaded = NULL;
-  CLEANUP_FREE char *pngfile = NULL;
-  CLEANUP_CMD_CLOSE struct command *cmd = guestfs_int_new_command (g);
   int r;
-  char *ret;
 
   for (i = 0; win7_explorer[i] != NULL; ++i) {
     CLEANUP_FREE char *filename = NULL;
@@ -575,32 +575,10 @@ icon_windows_7 (guestfs_h *g, struct inspect_fs *fs, size_t *size_r)
   if (win7_explorer[i] == NULL)
     return NOT_FOUND;
 
-  filename_downloaded = guestfs_int_download_to_tmp (g, fs, filename_case,
-						     "explorer.exe",
-						     MAX_WINDOWS_EXPLORER_SIZE);
-  if (filename_downloaded == NULL)
-    return NOT_FOUND;
-
-  pngfile = safe_asprintf (g, "%s/windows-7-icon.png", g->tmpdir);
-
-  guestfs_int_cmd_add_string_unquoted (cmd,
-                                       WRESTOOL " -x --type=2 --name=6801 ");
-  guestfs_int_cmd_add_string_quoted   (cmd, filename_downloaded);
-  guestfs_int_cmd_add_string_unquoted (cmd,
-				       " | " BMPTOPNM " | "
-				       PAMCUT " -bottom 54 | "
-				       PNMTOPNG " > ");
-  guestfs_int_cmd_add_string_quoted   (cmd, pngfile);
-  r = guestfs_int_cmd_run (cmd);
-  if (r == -1)
-    return NULL;
-  if (!WIFEXITED (r) || WEXITSTATUS (r) != 0)
-    return NOT_FOUND;
-
-  if (guestfs_int_read_whole_file (g, pngfile, &ret, size_r) == -1)
-    return NULL;
-
-  return ret;
+  /* The bitmap contains several icons stacked vertically: keep only
+   * the top one (this used to be 'pamcut -bottom 54').
+   */
+  return icon_from_pe (g, filename_case, 6801, 55, size_r);
 }
 
 /* There are several sources we might use:
@@ -662,4 +640,3 @@ icon_windows (guestfs_h *g, struct inspect_fs *fs, size_t *size_r)
   else return NOT_FOUND;
 }
 
-#endif /* CAN_DO_WINDOWS */
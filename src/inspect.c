@@ -45,6 +45,7 @@
 
 COMPILE_REGEXP (re_primary_partition, "^/dev/(?:h|s|v)d.[1234]$", 0)
 
+static char **probe_vfs_types (guestfs_h *g, char **fses, size_t *n_rtn);
 static void check_for_duplicated_bsd_root (guestfs_h *g);
 static void collect_coreos_inspection_info (guestfs_h *g);
 static void collect_linux_inspection_info (guestfs_h *g);
@@ -54,10 +55,14 @@ static void collect_linux_inspection_info_for (guestfs_h *g, struct inspect_fs *
  * The main inspection API.
  */
 char **
-guestfs_impl_inspect_os (guestfs_h *g)
+guestfs_impl_inspect_os_opts (guestfs_h *g,
+                              const struct guestfs_inspect_os_opts_argv *optargs)
 {
   CLEANUP_FREE_STRING_LIST char **fses = NULL;
-  char **fs, **ret;
+  char **vfs_types;
+  char **ret;
+  size_t i, n;
+  int r = 0;
 
   /* Remove any information previously stored in the handle. */
   guestfs_int_free_inspect_info (g);
@@ -72,11 +77,25 @@ guestfs_impl_inspect_os (guestfs_h *g)
   fses = guestfs_list_filesystems (g);
   if (fses == NULL) return NULL;
 
-  for (fs = fses; *fs; fs += 2) {
-    if (guestfs_int_check_for_filesystem_on (g, *fs)) {
-      guestfs_int_free_inspect_info (g);
-      return NULL;
-    }
+  vfs_types = probe_vfs_types (g, fses, &n);
+
+  /* With defer=true, the more expensive checks are skipped here and
+   * done by the inspect_get_* call which first needs them.
+   */
+  g->inspect_defer =
+    (optargs->bitmask & GUESTFS_INSPECT_OS_OPTS_DEFER_BITMASK) &&
+    optargs->defer;
+
+  for (i = 0; i < n; ++i) {
+    if (r == 0)
+      r = guestfs_int_check_for_filesystem_on (g, fses[i*2], vfs_types[i]);
+    free (vfs_types[i]);
+  }
+  free (vfs_types);
+  g->inspect_defer = false;
+  if (r != 0) {
+    guestfs_int_free_inspect_info (g);
+    return NULL;
   }
 
   /* The OS inspection information for CoreOS are gathered by inspecting
@@ -108,6 +127,36 @@ guestfs_impl_inspect_os (guestfs_h *g)
   return ret;
 }
 
+/**
+ * Get the VFS type of every filesystem in C<fses> (as returned by
+ * L<guestfs(3)/guestfs_list_filesystems>).  All the requests are
+ * submitted before waiting for any of the replies, so that the daemon
+ * can run the blkid probes concurrently in its worker threads.
+ *
+ * Returns an array of C<*n_rtn> strings.  Entries are C<NULL> where
+ * the type could not be found, which is not an error.
+ */
+static char **
+probe_vfs_types (guestfs_h *g, char **fses, size_t *n_rtn)
+{
+  const size_t n = guestfs_int_count_strings (fses) / 2;
+  CLEANUP_FREE int *serials = safe_malloc (g, (n+1) * sizeof (int));
+  char **ret = safe_calloc (g, n+1, sizeof (char *));
+  size_t i;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  for (i = 0; i < n; ++i)
+    serials[i] = guestfs_submit_vfs_type (g, fses[i*2]);
+  for (i = 0; i < n; ++i) {
+    if (serials[i] >= 0)
+      ret[i] = guestfs_wait_vfs_type (g, serials[i]);
+  }
+  guestfs_pop_error_handler (g);
+
+  *n_rtn = n;
+  return ret;
+}
+
 /**
  * Traverse through the filesystem list and find out if it contains
  * the C</> and C</usr> filesystems of a CoreOS image. If this is the
@@ -321,6 +370,9 @@ guestfs_impl_inspect_get_arch (guestfs_h *g, const char *root)
   if (!fs)
     return NULL;
 
+  if (fs->deferred && guestfs_int_inspect_complete (g, fs) == -1)
+    return NULL;
+
   return safe_strdup (g, fs->arch ? : "unknown");
 }
 
@@ -439,6 +491,9 @@ guestfs_impl_inspect_get_windows_current_control_set (guestfs_h *g,
   if (!fs)
     return NULL;
 
+  if (fs->deferred && guestfs_int_inspect_complete (g, fs) == -1)
+    return NULL;
+
   if (!fs->windows_current_control_set) {
     error (g, _("not a Windows guest, or CurrentControlSet could not be determined"));
     return NULL;
@@ -589,6 +644,9 @@ guestfs_impl_inspect_get_drive_mappings (guestfs_h *g, const char *root)
   if (!fs)
     return NULL;
 
+  if (fs->deferred && guestfs_int_inspect_complete (g, fs) == -1)
+    return NULL;
+
   if (fs->drive_mappings) {
     for (i = 0; fs->drive_mappings[i] != NULL; ++i)
       guestfs_int_add_string (g, &ret, fs->drive_mappings[i]);
@@ -664,6 +722,9 @@ guestfs_impl_inspect_get_hostname (guestfs_h *g, const char *root)
   if (!fs)
     return NULL;
 
+  if (fs->deferred && guestfs_int_inspect_complete (g, fs) == -1)
+    return NULL;
+
   return safe_strdup (g, fs->hostname ? : "unknown");
 }
 
@@ -680,6 +741,7 @@ guestfs_int_free_inspect_info (guestfs_h *g)
     free (g->fses[i].hostname);
     free (g->fses[i].windows_systemroot);
     free (g->fses[i].windows_current_control_set);
+    free (g->fses[i].cache_key);
     for (j = 0; j < g->fses[i].nr_fstab; ++j) {
       free (g->fses[i].fstab[j].mountable);
       free (g->fses[i].fstab[j].mountpoint);
@@ -704,6 +766,10 @@ guestfs_int_free_inspect_info (guestfs_h *g)
  * Refuse to download the guest file if it is larger than C<max_size>.
  * On this and other errors, C<NULL> is returned.
  *
+ * If the persistent inspection cache is enabled, the file is also
+ * looked up there and saved there, so other handles do not need to
+ * download it again (see F<src/inspect-cache.c>).
+ *
  * There is actually one cache per C<struct inspect_fs *> in order to
  * handle the case of multiple roots.
  */
@@ -715,7 +781,8 @@ guestfs_int_download_to_tmp (guestfs_h *g, struct inspect_fs *fs,
   char *r;
   int fd;
   char devfd[32];
-  int64_t size;
+  CLEANUP_FREE_STATNS struct guestfs_statns *statbuf = NULL;
+  CLEANUP_FREE char *cache_key = NULL;
 
   /* Make the basename unique by prefixing it with the fs number.
    * This also ensures there is one cache per filesystem.
@@ -730,16 +797,20 @@ guestfs_int_download_to_tmp (guestfs_h *g, struct inspect_fs *fs,
     return r;
 
   /* Check size of remote file. */
-  size = guestfs_filesize (g, filename);
-  if (size == -1)
-    /* guestfs_filesize failed and has already set error in handle */
+  statbuf = guestfs_statns (g, filename);
+  if (statbuf == NULL)
+    /* guestfs_statns failed and has already set error in handle */
     goto error;
-  if ((uint64_t) size > max_size) {
+  if ((uint64_t) statbuf->st_size > max_size) {
     error (g, _("size of %s is unreasonably large (%" PRIi64 " bytes)"),
-           filename, size);
+           filename, statbuf->st_size);
     goto error;
   }
 
+  cache_key = guestfs_int_inspect_cache_file_key (g, fs, filename, statbuf);
+  if (cache_key && guestfs_int_inspect_cache_load_file (g, cache_key, r))
+    return r;
+
   fd = open (r, O_WRONLY|O_CREAT|O_TRUNC|O_NOCTTY|O_CLOEXEC, 0600);
   if (fd == -1) {
     perrorf (g, "open: %s", r);
@@ -760,6 +831,9 @@ guestfs_int_download_to_tmp (guestfs_h *g, struct inspect_fs *fs,
     goto error;
   }
 
+  if (cache_key)
+    guestfs_int_inspect_cache_save_file (g, cache_key, r);
+
   return r;
 
  error:
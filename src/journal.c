@@ -39,123 +39,154 @@
 #define be64toh(x) OSSwapBigToHostInt64(x)
 #endif
 
-#include "full-read.h"
-
 #include "guestfs.h"
 #include "guestfs-internal.h"
 #include "guestfs-internal-actions.h"
 
-/* This is implemented library-side in order to get around potential
- * protocol limits.
+/* Parse the fields received from the daemon into an xattr list.
  *
- * A journal record can contain an arbitrarily large amount of data
- * (stuff like core dumps in particular).  To save the user from
- * having to deal with it, the implementation uses an internal
- * function that downloads to a FileOut, and we reconstruct the
- * hashtable entries from that.
+ * There is a simple, private protocol employed here (note: it may
+ * be changed at any time), where fields are sent using a big-endian
+ * 64 bit length field followed by N bytes of 'field=data' binary
+ * data.  A zero length marks the end of an entry in the output of
+ * guestfs_journal_export, and is skipped.
+ *
+ * The buffer is parsed in place, and must be \0-terminated (which
+ * makes strchr etc safe).
  */
-struct guestfs_xattr_list *
-guestfs_impl_journal_get (guestfs_h *g)
+static struct guestfs_xattr_list *
+parse_journal_fields (guestfs_h *g, const char *fn, char *buf, size_t size)
 {
-  CLEANUP_UNLINK_FREE char *tmpfile = NULL;
-  CLEANUP_FREE char *buf = NULL;
-  struct stat statbuf;
-  struct guestfs_xattr_list *ret = NULL;
-  char *p, *eofield, *eobuf;
-  int fd = -1;
-  size_t i, j, size;
+  struct guestfs_xattr_list *ret;
+  char *p, *eofield;
+  size_t i, alloc = 0;
   uint64_t len;
 
-  tmpfile = guestfs_int_make_temp_path (g, "journal");
-  if (tmpfile == NULL)
-    goto err;
-
-  if (guestfs_internal_journal_get (g, tmpfile) == -1)
-    goto err;
-
-  fd = open (tmpfile, O_RDONLY|O_CLOEXEC);
-  if (fd == -1) {
-    perrorf (g, "open: %s", tmpfile);
-    goto err;
-  }
-
-  /* Read the whole file into memory. */
-  if (fstat (fd, &statbuf) == -1) {
-    perrorf (g, "stat: %s", tmpfile);
-    goto err;
-  }
-
-  /* Don't use safe_malloc.  Want to return an errno to the caller. */
-  size = statbuf.st_size;
-  buf = malloc (size+1);
-  if (!buf) {
-    perrorf (g, "malloc: %zu bytes", size);
-    goto err;
-  }
-  eobuf = &buf[size];
-  *eobuf = '\0';                /* Makes strchr etc safe. */
-
-  if (full_read (fd, buf, size) != size) {
-    perrorf (g, "full-read: %s: %zu bytes", tmpfile, size);
-    goto err;
-  }
-
-  if (close (fd) == -1) {
-    perrorf (g, "close: %s", tmpfile);
-    goto err;
-  }
-  fd = -1;
-
-  j = 0;
   ret = safe_malloc (g, sizeof *ret);
   ret->len = 0;
   ret->val = NULL;
 
-  /* There is a simple, private protocol employed here (note: it may
-   * be changed at any time), where fields are sent using a big-endian
-   * 64 bit length field followed by N bytes of 'field=data' binary
-   * data.
-   */
   for (i = 0; i < size; ) {
     if (i+8 > size) {
-      error (g, "invalid data from guestfs_internal_journal_get: "
+      error (g, "invalid data from %s: "
              "truncated: "
-             "size=%zu, i=%zu", size, i);
+             "size=%zu, i=%zu", fn, size, i);
       goto err;
     }
     memcpy(&len, &buf[i], sizeof(len));
     len = be64toh (len);
     i += 8;
-    eofield = &buf[i+len];
-    if (eofield > eobuf) {
-      error (g, "invalid data from guestfs_internal_journal_get: "
+    if (len == 0)
+      continue;
+    if (len > size - i) {
+      error (g, "invalid data from %s: "
              "length field is too large: "
-             "size=%zu, i=%zu, len=%" PRIu64, size, i, len);
+             "size=%zu, i=%zu, len=%" PRIu64, fn, size, i, len);
       goto err;
     }
+    eofield = &buf[i+len];
     p = strchr (&buf[i], '=');
     if (!p || p >= eofield) {
-      error (g, "invalid data from guestfs_internal_journal_get: "
+      error (g, "invalid data from %s: "
              "no '=' found separating field name and data: "
-             "size=%zu, i=%zu, p=%p", size, i, p);
+             "size=%zu, i=%zu, p=%p", fn, size, i, p);
       goto err;
     }
     *p = '\0';
 
-    j++;
-    ret->val = safe_realloc (g, ret->val, j * sizeof (struct guestfs_xattr));
-    ret->val[j-1].attrname = safe_strdup (g, &buf[i]);
-    ret->val[j-1].attrval_len = eofield - (p+1);
-    ret->val[j-1].attrval = safe_memdup (g, p+1, eofield - (p+1));
-    ret->len = j;
+    if (ret->len == alloc) {
+      alloc = alloc > 0 ? alloc * 2 : 32;
+      ret->val = safe_realloc (g, ret->val, alloc * sizeof (struct guestfs_xattr));
+    }
+    ret->val[ret->len].attrname = safe_strdup (g, &buf[i]);
+    ret->val[ret->len].attrval_len = eofield - (p+1);
+    ret->val[ret->len].attrval = safe_memdup (g, p+1, eofield - (p+1));
+    ret->len++;
     i += len;
   }
 
-  return ret;                   /* caller frees */
+  return ret;
 
  err:
   guestfs_free_xattr_list (ret);
-  if (fd >= 0)
-    close (fd);
   return NULL;
 }
+
+/* This is implemented library-side in order to get around potential
+ * protocol limits.
+ *
+ * A journal record can contain an arbitrarily large amount of data
+ * (stuff like core dumps in particular).  To save the user from
+ * having to deal with it, the implementation uses an internal
+ * function that downloads to a FileOut, and we reconstruct the
+ * hashtable entries from that.
+ */
+struct guestfs_xattr_list *
+guestfs_impl_journal_get (guestfs_h *g)
+{
+  struct recv_buffer rbuf = { .data = NULL };
+  CLEANUP_FREE char *buf = NULL;
+  int r;
+
+  /* The data is received into memory, the filename is ignored. */
+  g->recv_buffer = &rbuf;
+  r = guestfs_internal_journal_get (g, "/dev/null");
+  g->recv_buffer = NULL;
+  buf = rbuf.data;
+  if (r == -1)
+    return NULL;
+
+  return parse_journal_fields (g, "guestfs_internal_journal_get",
+                               buf, rbuf.size); /* caller frees */
+}
+
+/* Read the next batch of entries using guestfs_journal_export, so
+ * that walking the journal doesn't need a journal_next and a
+ * journal_get call for every entry.
+ */
+struct guestfs_xattr_list *
+guestfs_impl_journal_get_entries (guestfs_h *g,
+                                  const struct guestfs_journal_get_entries_argv *optargs)
+{
+  struct guestfs_journal_export_argv args = { .bitmask = 0 };
+  struct recv_buffer rbuf = { .data = NULL };
+  CLEANUP_FREE char *buf = NULL;
+  int r;
+
+  args.bitmask |= GUESTFS_JOURNAL_EXPORT_MAXENTRIES_BITMASK;
+  if (optargs->bitmask & GUESTFS_JOURNAL_GET_ENTRIES_MAXENTRIES_BITMASK) {
+    if (optargs->maxentries <= 0) {
+      error (g, _("maxentries must be greater than zero"));
+      return NULL;
+    }
+    args.maxentries = optargs->maxentries;
+  }
+  else
+    args.maxentries = 1000;
+  if (optargs->bitmask & GUESTFS_JOURNAL_GET_ENTRIES_CURSOR_BITMASK) {
+    args.bitmask |= GUESTFS_JOURNAL_EXPORT_CURSOR_BITMASK;
+    args.cursor = optargs->cursor;
+  }
+  if (optargs->bitmask & GUESTFS_JOURNAL_GET_ENTRIES_SINCE_BITMASK) {
+    args.bitmask |= GUESTFS_JOURNAL_EXPORT_SINCE_BITMASK;
+    args.since = optargs->since;
+  }
+  if (optargs->bitmask & GUESTFS_JOURNAL_GET_ENTRIES_UNTIL_BITMASK) {
+    args.bitmask |= GUESTFS_JOURNAL_EXPORT_UNTIL_BITMASK;
+    args.until = optargs->until;
+  }
+  if (optargs->bitmask & GUESTFS_JOURNAL_GET_ENTRIES_FIELDS_BITMASK) {
+    args.bitmask |= GUESTFS_JOURNAL_EXPORT_FIELDS_BITMASK;
+    args.fields = optargs->fields;
+  }
+
+  g->recv_buffer = &rbuf;
+  r = guestfs_journal_export_argv (g, "/dev/null", &args);
+  g->recv_buffer = NULL;
+  buf = rbuf.data;
+  if (r == -1)
+    return NULL;
+
+  return parse_journal_fields (g, "guestfs_journal_export",
+                               buf, rbuf.size); /* caller frees */
+}
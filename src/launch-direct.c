@@ -33,21 +33,43 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#include <time.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
 #include <signal.h>
+#include <pthread.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <assert.h>
 #include <string.h>
 #include <libintl.h>
 
+#ifdef HAVE_LINUX_MEMPOLICY_H
+#include <linux/mempolicy.h>
+#endif
+
 #include "cloexec.h"
+#include "full-write.h"
+#include "glthread/lock.h"
 
 #include "guestfs.h"
 #include "guestfs-internal.h"
+#include "guestfs-internal-actions.h"
 #include "guestfs_protocol.h"
 
+/* How long to wait for qemu to save or restore a snapshot. */
+#define SNAPSHOT_TIMEOUT 60 /* seconds */
+
+/* How launch_qemu starts the appliance.  See launch_direct. */
+enum launch_mode {
+  LAUNCH_BOOT,                  /* Cold boot with the drives. */
+  LAUNCH_SAVE,                  /* Boot the template and save a snapshot. */
+  LAUNCH_RESTORE,               /* Restore the snapshot, hotplug drives. */
+  LAUNCH_POOL,                  /* Start an idle appliance for the pool. */
+};
+
 /* Per-handle data. */
 struct backend_direct_data {
   pid_t pid;                    /* Qemu PID. */
@@ -57,20 +79,36 @@ struct backend_direct_data {
   struct qemu_data *qemu_data;  /* qemu -help output etc. */
 
   char guestfsd_sock[UNIX_PATH_MAX]; /* Path to daemon socket. */
+
+  /* Paths to the sockets for extra data channels.  Entry 0 is unused
+   * (it is guestfsd_sock above).
+   */
+  size_t nr_data_channels;
+  char data_sock[GUESTFS_MAX_DATA_CHANNELS][UNIX_PATH_MAX];
+
+  int qmp_sock;                 /* QMP connection of a pooled appliance. */
 };
 
 static int is_openable (guestfs_h *g, const char *path, int flags);
 static char *make_appliance_dev (guestfs_h *g, int virtio_scsi);
 static void print_qemu_command_line (guestfs_h *g, char **argv);
+static int shutdown_direct (guestfs_h *g, void *datav, int check_for_errors);
 
 static char *
 create_cow_overlay_direct (guestfs_h *g, void *datav, struct drive *drv)
 {
   char *overlay;
   CLEANUP_FREE char *backing_drive = NULL;
+  const char *backing_format = drv->src.format;
   struct guestfs_disk_create_argv optargs;
 
-  backing_drive = guestfs_int_drive_source_qemu_param (g, &drv->src);
+  /* See guestfs.pod / storage_proxy */
+  if (guestfs_int_use_storage_proxy (g, drv)) {
+    backing_drive = guestfs_int_storage_proxy_param (g, drv);
+    backing_format = "raw";
+  }
+  else
+    backing_drive = guestfs_int_drive_source_qemu_param (g, &drv->src);
   if (!backing_drive)
     return NULL;
 
@@ -81,9 +119,9 @@ create_cow_overlay_direct (guestfs_h *g, void *datav, struct drive *drv)
 
   optargs.bitmask = GUESTFS_DISK_CREATE_BACKINGFILE_BITMASK;
   optargs.backingfile = backing_drive;
-  if (drv->src.format) {
+  if (backing_format) {
     optargs.bitmask |= GUESTFS_DISK_CREATE_BACKINGFORMAT_BITMASK;
-    optargs.backingformat = drv->src.format;
+    optargs.backingformat = backing_format;
   }
 
   if (guestfs_disk_create_argv (g, overlay, "qcow2", -1, &optargs) == -1) {
@@ -155,6 +193,97 @@ add_cmdline_shell_unquoted (guestfs_h *g, struct stringsbuf *sb,
 }
 #endif /* defined QEMU_OPTIONS */
 
+/**
+ * Make the C<-drive> parameter for drive C<i>, everything up to the
+ * C<if=...> at the end.  This is used both on the qemu command line
+ * and when hotplugging the drive into a restored appliance.
+ */
+static char *
+make_drive_param (guestfs_h *g, struct backend_direct_data *data,
+                  size_t i, struct drive *drv)
+{
+  CLEANUP_FREE char *file = NULL, *escaped_file = NULL;
+  char *param;
+
+  if (!drv->overlay) {
+    const char *discard_mode = "";
+    const char *format = drv->src.format;
+    const char *cachemode = drv->cachemode ? drv->cachemode : "writeback";
+    const char *aio = guestfs_int_drive_aio (g, drv, &data->qemu_version);
+
+    /* qemu refuses native AIO unless the host page cache is bypassed. */
+    if (aio && STREQ (aio, "native"))
+      cachemode = "none";
+
+    switch (drv->discard) {
+    case discard_disable:
+      /* Since the default is always discard=ignore, don't specify it
+       * on the command line.  This also avoids unnecessary breakage
+       * with qemu < 1.5 which didn't have the option at all.
+       */
+      break;
+    case discard_enable:
+      if (!guestfs_int_discard_possible (g, drv, &data->qemu_version))
+        return NULL;
+      /*FALLTHROUGH*/
+    case discard_besteffort:
+      /* I believe from reading the code that this is always safe as
+       * long as qemu >= 1.5.
+       */
+      if (guestfs_int_version_ge (&data->qemu_version, 1, 5, 0))
+        discard_mode = ",discard=unmap";
+      /* Also turn writes of zeroes (eg. from zero-device when the
+       * guest kernel falls back to writing zero pages) into discards,
+       * so they don't allocate space in the host file.
+       */
+      if (guestfs_int_version_ge (&data->qemu_version, 2, 1, 0))
+        discard_mode = ",discard=unmap,detect-zeroes=unmap";
+      break;
+    }
+
+    /* Make the file= parameter.  Network drives may go through a
+     * storage proxy (see guestfs.pod / storage_proxy), which exports
+     * them as raw.
+     */
+    if (guestfs_int_use_storage_proxy (g, drv)) {
+      file = guestfs_int_storage_proxy_param (g, drv);
+      format = "raw";
+    }
+    else
+      file = guestfs_int_drive_source_qemu_param (g, &drv->src);
+    if (file == NULL)
+      return NULL;
+    escaped_file = guestfs_int_qemu_escape_param (g, file);
+
+    param = safe_asprintf
+      (g, "file=%s%s,cache=%s%s%s%s%s%s%s%s%s,id=hd%zu",
+       escaped_file,
+       drv->readonly ? ",snapshot=on" : "",
+       cachemode,
+       aio ? ",aio=" : "",
+       aio ? aio : "",
+       discard_mode,
+       format ? ",format=" : "",
+       format ? format : "",
+       drv->disk_label ? ",serial=" : "",
+       drv->disk_label ? drv->disk_label : "",
+       drv->copyonread ? ",copy-on-read=on" : "",
+       i);
+  }
+  else {
+    /* Writable qcow2 overlay on top of read-only drive. */
+    escaped_file = guestfs_int_qemu_escape_param (g, drv->overlay);
+    param = safe_asprintf
+      (g, "file=%s,cache=unsafe,format=qcow2%s%s,id=hd%zu",
+       escaped_file,
+       drv->disk_label ? ",serial=" : "",
+       drv->disk_label ? drv->disk_label : "",
+       i);
+  }
+
+  return param;
+}
+
 /* On Debian, /dev/kvm is mode 0660 and group kvm, so users need to
  * add themselves to the kvm group otherwise things are going to be
  * very slow (this is Debian bug 640328).  Warn about this.
@@ -215,38 +344,361 @@ debian_kvm_warning (guestfs_h *g)
 #endif /* __linux__ */
 }
 
+/**
+ * Poll C<query-migrate> until the migration started by
+ * C<save_snapshot> has finished.
+ */
 static int
-launch_direct (guestfs_h *g, void *datav, const char *arg)
+wait_for_migration (guestfs_h *g, int qmp_sock)
+{
+  time_t start_t, now_t;
+
+  time (&start_t);
+
+  for (;;) {
+    CLEANUP_FREE char *reply = NULL;
+
+    if (guestfs_int_qmp_command (g, qmp_sock, &reply,
+                                 "{ \"execute\": \"query-migrate\" }") == -1)
+      return -1;
+    if (guestfs_int_qmp_match (g, reply, "status", "completed"))
+      return 0;
+    if (guestfs_int_qmp_match (g, reply, "status", "failed") ||
+        guestfs_int_qmp_match (g, reply, "status", "cancelled")) {
+      error (g, _("qemu failed to save the appliance snapshot: %s"), reply);
+      return -1;
+    }
+
+    if (time (&now_t) - start_t > SNAPSHOT_TIMEOUT) {
+      error (g, _("timed out saving the appliance snapshot"));
+      return -1;
+    }
+
+    usleep (10000);
+  }
+}
+
+/**
+ * Stop the template appliance and write its state to
+ * F<snapshot_dir/state>.
+ *
+ * This is called just after the daemon has sent
+ * C<GUESTFS_LAUNCH_FLAG>, so the daemon in the snapshot is sitting in
+ * its main loop waiting for the first request.
+ */
+static int
+save_snapshot (guestfs_h *g, int qmp_sock, const char *snapshot_dir)
+{
+  CLEANUP_FREE char *state = NULL, *state_tmp = NULL;
+  CLEANUP_FREE char *uri = NULL, *quoted_uri = NULL;
+
+  state = safe_asprintf (g, "%s/state", snapshot_dir);
+  state_tmp = safe_asprintf (g, "%s/state.tmp", snapshot_dir);
+  uri = safe_asprintf (g, "exec:cat > '%s'", state_tmp);
+  quoted_uri = guestfs_int_qmp_quote (g, uri);
+
+  debug (g, "saving appliance snapshot to %s", state);
+
+  if (guestfs_int_qmp_command (g, qmp_sock, NULL,
+                               "{ \"execute\": \"stop\" }") == -1)
+    return -1;
+  if (guestfs_int_qmp_command (g, qmp_sock, NULL,
+                               "{ \"execute\": \"migrate\", "
+                               "\"arguments\": { \"uri\": %s } }",
+                               quoted_uri) == -1)
+    return -1;
+  if (wait_for_migration (g, qmp_sock) == -1) {
+    unlink (state_tmp);
+    return -1;
+  }
+
+  if (rename (state_tmp, state) == -1) {
+    perrorf (g, "rename: %s", state_tmp);
+    unlink (state_tmp);
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Wait for qemu to finish loading the snapshot given by C<-incoming>
+ * and start running the restored appliance.
+ */
+static int
+wait_for_incoming (guestfs_h *g, int qmp_sock)
+{
+  time_t start_t, now_t;
+
+  time (&start_t);
+
+  for (;;) {
+    CLEANUP_FREE char *reply = NULL;
+
+    if (guestfs_int_qmp_command (g, qmp_sock, &reply,
+                                 "{ \"execute\": \"query-status\" }") == -1)
+      return -1;
+    if (guestfs_int_qmp_match (g, reply, "status", "running"))
+      break;
+    if (!guestfs_int_qmp_match (g, reply, "status", "inmigrate")) {
+      error (g, _("qemu failed to restore the appliance snapshot: %s"),
+             reply);
+      return -1;
+    }
+
+    if (time (&now_t) - start_t > SNAPSHOT_TIMEOUT) {
+      error (g, _("timed out restoring the appliance snapshot"));
+      return -1;
+    }
+
+    usleep (10000);
+  }
+
+  debug (g, "appliance restored from snapshot");
+  return 0;
+}
+
+/**
+ * Return true if the appliance should boot without udev (see
+ * L<guestfs(3)/guestfs_set_appliance_profile>).  Drive labels are
+ * made by the udev rules, so they need udev.
+ */
+static bool
+boot_without_udev (guestfs_h *g)
+{
+  struct drive *drv;
+  size_t i;
+
+  if (!g->minimal_appliance)
+    return false;
+
+  ITER_DRIVES (g, i, drv) {
+    if (drv->disk_label)
+      return false;
+  }
+
+  return true;
+}
+
+/**
+ * Hotplug the drives into a restored appliance.
+ *
+ * The drives are added one at a time, waiting for each to appear in
+ * the appliance, so that they get the same device names as they
+ * would if they had been on the command line.
+ */
+static int
+hotplug_drives (guestfs_h *g, struct backend_direct_data *data, int qmp_sock)
+{
+  struct drive *drv;
+  size_t i, n = 0, nr_drives = 0;
+
+  ITER_DRIVES (g, i, drv)
+    nr_drives++;
+
+  ITER_DRIVES (g, i, drv) {
+    CLEANUP_FREE char *param = NULL, *hmp = NULL, *quoted_hmp = NULL;
+    CLEANUP_FREE char *reply = NULL;
+
+    param = make_drive_param (g, data, i, drv);
+    if (param == NULL)
+      return -1;
+
+    /* QMP blockdev-add takes different arguments in every qemu
+     * version, but the human monitor drive_add command takes the
+     * same string as -drive.
+     */
+    hmp = safe_asprintf (g, "drive_add 0 %s,if=none", param);
+    quoted_hmp = guestfs_int_qmp_quote (g, hmp);
+    if (guestfs_int_qmp_command (g, qmp_sock, &reply,
+                                 "{ \"execute\": \"human-monitor-command\", "
+                                 "\"arguments\": { \"command-line\": %s } }",
+                                 quoted_hmp) == -1)
+      return -1;
+    if (strstr (reply, "OK") == NULL) {
+      error (g, _("could not hot-add drive %zu: %s"), i, reply);
+      return -1;
+    }
+
+    if (guestfs_int_qmp_command (g, qmp_sock, NULL,
+                                 "{ \"execute\": \"device_add\", "
+                                 "\"arguments\": { \"driver\": \"scsi-hd\", "
+                                 "\"drive\": \"hd%zu\", \"id\": \"sd%zu\" } }",
+                                 i, i) == -1)
+      return -1;
+
+    n++;
+    if (guestfs_internal_wait_for_devices (g, (int) n,
+                                           n == nr_drives) == -1)
+      return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Return the size of the nvdimm used for the appliance root if the
+ * C<appliance_nvdimm> backend setting can be used, or C<0> if the
+ * appliance should be added as a disk as usual.
+ *
+ * qemu maps the whole file, and its size must be a multiple of the
+ * 2 MiB alignment of memory devices.  supermin creates the root
+ * filesystem with a size of a whole number of gigabytes.
+ */
+static int64_t
+get_appliance_nvdimm_size (guestfs_h *g, struct backend_direct_data *data,
+                           const char *appliance)
+{
+  struct stat statbuf;
+  const int64_t align = 2 * 1024 * 1024;
+
+  if (!guestfs_int_qemu_supports_device (g, data->qemu_data, "nvdimm")) {
+    debug (g, "appliance_nvdimm: qemu does not support nvdimm devices");
+    return 0;
+  }
+
+  if (stat (appliance, &statbuf) == -1) {
+    debug (g, "appliance_nvdimm: stat: %s: %m", appliance);
+    return 0;
+  }
+  if (!S_ISREG (statbuf.st_mode) || statbuf.st_size == 0 ||
+      statbuf.st_size % align != 0) {
+    debug (g, "appliance_nvdimm: %s: size %" PRIi64 " is not a multiple "
+           "of %" PRIi64, appliance, (int64_t) statbuf.st_size, align);
+    return 0;
+  }
+
+  return statbuf.st_size;
+}
+
+#ifdef HAVE_SCHED_SETAFFINITY
+/**
+ * Parse a list of CPUs like C<0-3,8> (the format of the NUMA node
+ * C<cpulist> files in sysfs) into C<set>.
+ */
+static int
+parse_cpu_list (guestfs_h *g, const char *list, cpu_set_t *set)
+{
+  const char *p = list;
+  char *end;
+  long first, last, i;
+
+  CPU_ZERO (set);
+  while (*p) {
+    errno = 0;
+    first = last = strtol (p, &end, 10);
+    if (errno != 0 || end == p || first < 0)
+      goto error;
+    p = end;
+    if (*p == '-') {
+      p++;
+      last = strtol (p, &end, 10);
+      if (errno != 0 || end == p || last < first)
+        goto error;
+      p = end;
+    }
+    for (i = first; i <= last && i < CPU_SETSIZE; ++i)
+      CPU_SET (i, set);
+    if (*p == ',')
+      p++;
+    else if (*p)
+      goto error;
+  }
+
+  if (CPU_COUNT (set) == 0)
+    goto error;
+  return 0;
+
+ error:
+  error (g, _("could not parse backend setting cpuset=%s"), list);
+  return -1;
+}
+#endif
+
+/**
+ * Bind the current process (the qemu child, just before exec) to the
+ * CPUs and NUMA node chosen by L</guestfs_int_get_appliance_placement>.
+ * Guest RAM is allocated by qemu, so a preferred memory policy set
+ * here applies to it, the same as running qemu under L<numactl(8)>.
+ * This does not change the qemu command line, so snapshots can be
+ * restored on any node.  Errors are ignored.
+ */
+static void
+set_appliance_placement (const void *cpus, int node)
+{
+#ifdef HAVE_SCHED_SETAFFINITY
+  if (cpus)
+    sched_setaffinity (0, sizeof (cpu_set_t), cpus);
+#endif
+#if defined(HAVE_LINUX_MEMPOLICY_H) && defined(SYS_set_mempolicy)
+  if (node >= 0 && node < 1024) {
+    unsigned long nodemask[1024 / (8 * sizeof (unsigned long))] = { 0 };
+
+    nodemask[node / (8 * sizeof (unsigned long))] |=
+      1UL << (node % (8 * sizeof (unsigned long)));
+    syscall (SYS_set_mempolicy, MPOL_PREFERRED, nodemask,
+             (unsigned long) 1024 + 1);
+  }
+#endif
+}
+
+/**
+ * Run qemu and wait for the appliance to come up.
+ *
+ * In C<LAUNCH_BOOT> mode this cold boots the appliance with all the
+ * drives on the command line.  In C<LAUNCH_SAVE> mode it boots a
+ * template appliance with no drives, saves a snapshot of it in
+ * C<snapshot_dir> and shuts it down again.  In C<LAUNCH_RESTORE>
+ * mode it restores the appliance from that snapshot and hotplugs the
+ * drives.  In C<LAUNCH_POOL> mode it starts an appliance with no
+ * drives (restoring it from the snapshot if C<snapshot_dir> is set)
+ * and leaves the QMP connection in C<data-E<gt>qmp_sock> so the drives
+ * can be hotplugged later.
+ */
+static int
+launch_qemu (guestfs_h *g, struct backend_direct_data *data,
+             const char *kernel, const char *initrd, const char *appliance,
+             const char *snapshot_dir, enum launch_mode mode)
 {
-  struct backend_direct_data *data = datav;
   CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (cmdline);
   int daemon_accept_sock = -1, console_sock = -1;
+  int data_accept_socks[GUESTFS_MAX_DATA_CHANNELS];
+  int qmp_accept_sock = -1, qmp_sock = -1;
+  char qmp_sockpath[UNIX_PATH_MAX] = "";
+  int nr_data_channels;
   int r;
   int flags;
   int sv[2];
   struct sockaddr_un addr;
   CLEANUP_FREE char *uefi_code = NULL, *uefi_vars = NULL;
   int uefi_flags;
-  CLEANUP_FREE char *kernel = NULL, *initrd = NULL, *appliance = NULL;
-  int has_appliance_drive;
+  int has_appliance_drive = appliance != NULL;
   CLEANUP_FREE char *appliance_dev = NULL;
+  CLEANUP_FREE char *appliance_overlay = NULL;
   uint32_t size;
   CLEANUP_FREE void *buf = NULL;
   struct drive *drv;
   size_t i;
   int virtio_scsi;
+  int iothread;
+  char scsi_queues[32] = "", blk_queues[32] = "";
   struct hv_param *hp;
   bool has_kvm;
   int force_tcg;
+  int hugepages, prealloc, free_page_reporting;
+  int64_t appliance_nvdimm_size = 0;
+  CLEANUP_FREE char *network_bridge = NULL;
   const char *cpu_model;
+  CLEANUP_FREE char *cpus = NULL;
+  int node;
+#ifdef HAVE_SCHED_SETAFFINITY
+  cpu_set_t cpu_set;
+#endif
+  const void *cpu_set_ptr = NULL;
+  const bool restore =
+    mode == LAUNCH_RESTORE || (mode == LAUNCH_POOL && snapshot_dir != NULL);
 
-  /* At present you must add drives before starting the appliance.  In
-   * future when we enable hotplugging you won't need to do this.
-   */
-  if (!g->nr_drives) {
-    error (g, _("you must call guestfs_add_drive before guestfs_launch"));
-    return -1;
-  }
+  data->qmp_sock = -1;
 
   /* Try to guess if KVM is available.  We are just checking that
    * /dev/kvm is openable.  That's not reliable, since /dev/kvm
@@ -260,21 +712,30 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
   if (force_tcg == -1)
     return -1;
 
-  if (!has_kvm && !force_tcg)
-    debian_kvm_warning (g);
-
-  guestfs_int_launch_send_progress (g, 0);
-
-  TRACE0 (launch_build_appliance_start);
-
-  /* Locate and/or build the appliance. */
-  if (guestfs_int_build_appliance (g, &kernel, &initrd, &appliance) == -1)
+  if (guestfs_int_get_appliance_placement (g, &cpus, &node) == -1)
     return -1;
-  has_appliance_drive = appliance != NULL;
+#ifdef HAVE_SCHED_SETAFFINITY
+  if (cpus) {
+    if (parse_cpu_list (g, cpus, &cpu_set) == -1)
+      return -1;
+    cpu_set_ptr = &cpu_set;
+  }
+#endif
+  if (cpus || node >= 0)
+    debug (g, "launch: placing appliance on cpus %s node %d",
+           cpus ? cpus : "any", node);
 
-  TRACE0 (launch_build_appliance_end);
+  nr_data_channels = guestfs_int_get_nr_data_channels (g);
+  if (nr_data_channels == -1)
+    return -1;
+  for (i = 0; i < GUESTFS_MAX_DATA_CHANNELS; ++i)
+    data_accept_socks[i] = -1;
 
-  guestfs_int_launch_send_progress (g, 3);
+  /* A restore always follows a save, so only warn once.  Pooled
+   * appliances are started in the background.
+   */
+  if (!has_kvm && !force_tcg && mode != LAUNCH_SAVE && mode != LAUNCH_POOL)
+    debian_kvm_warning (g);
 
   debug (g, "begin testing qemu features");
 
@@ -285,6 +746,46 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
       goto cleanup0;
   }
 
+  /* See guestfs.pod / appliance_nvdimm */
+  if (mode == LAUNCH_BOOT && has_appliance_drive &&
+      guestfs_int_get_backend_setting_bool (g, "appliance_nvdimm") > 0) {
+    appliance_nvdimm_size = get_appliance_nvdimm_size (g, data, appliance);
+    if (appliance_nvdimm_size > 0)
+      debug (g, "appliance root will be an nvdimm of %" PRIi64 " bytes",
+             appliance_nvdimm_size);
+  }
+
+  /* See guestfs.pod / hugepages, prealloc */
+  hugepages = guestfs_int_get_backend_setting_bool (g, "hugepages") > 0;
+  prealloc = guestfs_int_get_backend_setting_bool (g, "prealloc") > 0;
+  if ((hugepages || prealloc) &&
+      !guestfs_int_version_ge (&data->qemu_version, 2, 12, 0)) {
+    debug (g, "hugepages, prealloc: memory-backend-memfd needs qemu >= 2.12");
+    hugepages = prealloc = 0;
+  }
+
+  /* See guestfs.pod / free_page_reporting */
+  free_page_reporting =
+    guestfs_int_get_backend_setting_bool (g, "free_page_reporting") > 0;
+  if (free_page_reporting &&
+      (!guestfs_int_version_ge (&data->qemu_version, 5, 1, 0) ||
+       !guestfs_int_qemu_supports_device (g, data->qemu_data,
+                                          VIRTIO_BALLOON))) {
+    debug (g, "free_page_reporting: needs qemu >= 5.1 with %s",
+           VIRTIO_BALLOON);
+    free_page_reporting = 0;
+  }
+
+  /* See guestfs.pod / network_bridge */
+  if (g->enable_network) {
+    guestfs_push_error_handler (g, NULL, NULL);
+    network_bridge = guestfs_get_backend_setting (g, "network_bridge");
+    guestfs_pop_error_handler (g);
+    if (network_bridge &&
+        guestfs_int_check_bridge_exists (g, network_bridge) == -1)
+      goto cleanup0;
+  }
+
   /* Using virtio-serial, we need to create a local Unix domain socket
    * for qemu to connect to.
    */
@@ -313,6 +814,63 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
     goto cleanup0;
   }
 
+  /* Extra virtio-serial channels used to stripe file transfers. */
+  data->nr_data_channels = nr_data_channels;
+  for (i = 1; i < data->nr_data_channels; ++i) {
+    char name[32];
+
+    snprintf (name, sizeof name, "guestfsd%zu.sock", i);
+    if (guestfs_int_create_socketname (g, name, &data->data_sock[i]) == -1)
+      goto cleanup0;
+    data_accept_socks[i] =
+      guestfs_int_create_listening_socket (g, data->data_sock[i]);
+    if (data_accept_socks[i] == -1)
+      goto cleanup0;
+  }
+
+  /* Saving and restoring snapshots is driven through QMP. */
+  if (mode != LAUNCH_BOOT) {
+    if (guestfs_int_create_socketname (g, "qmp.sock", &qmp_sockpath) == -1)
+      goto cleanup0;
+    qmp_accept_sock = guestfs_int_create_listening_socket (g, qmp_sockpath);
+    if (qmp_accept_sock == -1)
+      goto cleanup0;
+  }
+
+  /* The template appliance writes to a persistent overlay in the
+   * snapshot directory, so that the saved memory image and the
+   * appliance disk agree.  Restored appliances put a throwaway
+   * overlay on top of that.
+   */
+  if (mode == LAUNCH_SAVE) {
+    struct guestfs_disk_create_argv optargs;
+
+    appliance_overlay = safe_asprintf (g, "%s/appliance.qcow2", snapshot_dir);
+    unlink (appliance_overlay);
+    optargs.bitmask = GUESTFS_DISK_CREATE_BACKINGFILE_BITMASK |
+      GUESTFS_DISK_CREATE_BACKINGFORMAT_BITMASK;
+    optargs.backingfile = appliance;
+    optargs.backingformat = "raw";
+    if (guestfs_disk_create_argv (g, appliance_overlay, "qcow2", -1,
+                                  &optargs) == -1)
+      goto cleanup0;
+  }
+  else if (restore) {
+    struct guestfs_disk_create_argv optargs;
+    CLEANUP_FREE char *template = NULL;
+
+    template = safe_asprintf (g, "%s/appliance.qcow2", snapshot_dir);
+    appliance_overlay = safe_asprintf (g, "%s/appliance%d.qcow2",
+                                       g->tmpdir, ++g->unique);
+    optargs.bitmask = GUESTFS_DISK_CREATE_BACKINGFILE_BITMASK |
+      GUESTFS_DISK_CREATE_BACKINGFORMAT_BITMASK;
+    optargs.backingfile = template;
+    optargs.backingformat = "qcow2";
+    if (guestfs_disk_create_argv (g, appliance_overlay, "qcow2", -1,
+                                  &optargs) == -1)
+      goto cleanup0;
+  }
+
   if (!g->direct_mode) {
     if (socketpair (AF_LOCAL, SOCK_STREAM|SOCK_CLOEXEC, 0, sv) == -1) {
       perrorf (g, "socketpair");
@@ -385,11 +943,12 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
 #ifdef __aarch64__
                       "%s"      /* gic-version */
 #endif
-                      "accel=%s",
+                      "accel=%s%s",
 #ifdef __aarch64__
                       has_kvm && !force_tcg ? "gic-version=host," : "",
 #endif
-                      !force_tcg ? "kvm:tcg" : "tcg");
+                      !force_tcg ? "kvm:tcg" : "tcg",
+                      appliance_nvdimm_size > 0 ? ",nvdimm=on" : "");
 
   cpu_model = guestfs_int_get_cpu_model (has_kvm && !force_tcg);
   if (cpu_model) {
@@ -403,7 +962,28 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
   }
 
   ADD_CMDLINE ("-m");
-  ADD_CMDLINE_PRINTF ("%d", g->memsize);
+  if (appliance_nvdimm_size > 0)
+    /* The nvdimm is plugged into a memory slot, and counts towards
+     * the maximum memory.
+     */
+    ADD_CMDLINE_PRINTF ("%d,slots=1,maxmem=%" PRIi64 "M",
+                        g->memsize,
+                        g->memsize + appliance_nvdimm_size / (1024 * 1024));
+  else
+    ADD_CMDLINE_PRINTF ("%d", g->memsize);
+
+  /* Back the appliance RAM with a memfd so that it can use huge pages
+   * and/or be faulted in before the appliance starts.
+   */
+  if (hugepages || prealloc) {
+    ADD_CMDLINE ("-object");
+    ADD_CMDLINE_PRINTF ("memory-backend-memfd,id=appliance-ram,size=%dM%s%s",
+                        g->memsize,
+                        hugepages ? ",hugetlb=on" : "",
+                        prealloc ? ",prealloc=on" : "");
+    ADD_CMDLINE ("-numa");
+    ADD_CMDLINE ("node,memdev=appliance-ram");
+  }
 
   /* Force exit instead of reboot on panic */
   ADD_CMDLINE ("-no-reboot");
@@ -464,107 +1044,126 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
     ADD_CMDLINE ("virtio-rng-pci,rng=rng0");
   }
 
+  /* Let the appliance give the pages it has freed back to the host. */
+  if (free_page_reporting) {
+    ADD_CMDLINE ("-device");
+    ADD_CMDLINE (VIRTIO_BALLOON ",free-page-reporting=on");
+  }
+
   /* Add drives */
   virtio_scsi = guestfs_int_qemu_supports_virtio_scsi (g, data->qemu_data,
                                                        &data->qemu_version);
 
+  /* Dedicated I/O threads for the disk controllers (see
+   * guestfs_set_iothread), and one queue per vCPU.
+   */
+  iothread = g->iothread;
+  if (iothread && !guestfs_int_version_ge (&data->qemu_version, 2, 4, 0)) {
+    debug (g, "launch: iothread needs qemu >= 2.4, ignored");
+    iothread = 0;
+  }
+  if (g->smp > 1) {
+    snprintf (scsi_queues, sizeof scsi_queues, ",num_queues=%d", g->smp);
+    if (guestfs_int_version_ge (&data->qemu_version, 2, 7, 0))
+      snprintf (blk_queues, sizeof blk_queues, ",num-queues=%d", g->smp);
+  }
+
   if (virtio_scsi) {
     /* Create the virtio-scsi bus. */
+    if (iothread) {
+      ADD_CMDLINE ("-object");
+      ADD_CMDLINE ("iothread,id=iothread-scsi");
+    }
     ADD_CMDLINE ("-device");
-    ADD_CMDLINE (VIRTIO_SCSI ",id=scsi");
+    ADD_CMDLINE_PRINTF (VIRTIO_SCSI ",id=scsi%s%s",
+                        iothread ? ",iothread=iothread-scsi" : "",
+                        scsi_queues);
   }
 
-  ITER_DRIVES (g, i, drv) {
-    CLEANUP_FREE char *file = NULL, *escaped_file = NULL, *param = NULL;
-
-    if (!drv->overlay) {
-      const char *discard_mode = "";
-
-      switch (drv->discard) {
-      case discard_disable:
-        /* Since the default is always discard=ignore, don't specify it
-         * on the command line.  This also avoids unnecessary breakage
-         * with qemu < 1.5 which didn't have the option at all.
-         */
-        break;
-      case discard_enable:
-        if (!guestfs_int_discard_possible (g, drv, &data->qemu_version))
-          goto cleanup0;
-        /*FALLTHROUGH*/
-      case discard_besteffort:
-        /* I believe from reading the code that this is always safe as
-         * long as qemu >= 1.5.
-         */
-        if (guestfs_int_version_ge (&data->qemu_version, 1, 5, 0))
-          discard_mode = ",discard=unmap";
-        break;
-      }
+  if (mode == LAUNCH_BOOT) {
+    ITER_DRIVES (g, i, drv) {
+      CLEANUP_FREE char *param = make_drive_param (g, data, i, drv);
 
-      /* Make the file= parameter. */
-      file = guestfs_int_drive_source_qemu_param (g, &drv->src);
-      escaped_file = guestfs_int_qemu_escape_param (g, file);
+      if (param == NULL)
+        goto cleanup0;
 
-      /* Make the first part of the -drive parameter, everything up to
-       * the if=... at the end.
+      /* If there's an explicit 'iface', use it.  Otherwise default to
+       * virtio-scsi if available.  Otherwise default to virtio-blk.
        */
-      param = safe_asprintf
-        (g, "file=%s%s,cache=%s%s%s%s%s%s%s,id=hd%zu",
-         escaped_file,
-         drv->readonly ? ",snapshot=on" : "",
-         drv->cachemode ? drv->cachemode : "writeback",
-         discard_mode,
-         drv->src.format ? ",format=" : "",
-         drv->src.format ? drv->src.format : "",
-         drv->disk_label ? ",serial=" : "",
-         drv->disk_label ? drv->disk_label : "",
-         drv->copyonread ? ",copy-on-read=on" : "",
-         i);
-    }
-    else {
-      /* Writable qcow2 overlay on top of read-only drive. */
-      escaped_file = guestfs_int_qemu_escape_param (g, drv->overlay);
-      param = safe_asprintf
-        (g, "file=%s,cache=unsafe,format=qcow2%s%s,id=hd%zu",
-         escaped_file,
-         drv->disk_label ? ",serial=" : "",
-         drv->disk_label ? drv->disk_label : "",
-         i);
-    }
-
-    /* If there's an explicit 'iface', use it.  Otherwise default to
-     * virtio-scsi if available.  Otherwise default to virtio-blk.
-     */
-    if (drv->iface && STREQ (drv->iface, "virtio")) /* virtio-blk */
-      goto virtio_blk;
+      if (drv->iface && STREQ (drv->iface, "virtio")) /* virtio-blk */
+        goto virtio_blk;
 #if defined(__arm__) || defined(__aarch64__) || defined(__powerpc__)
-    else if (drv->iface && STREQ (drv->iface, "ide")) {
-      error (g, "'ide' interface does not work on ARM or PowerPC");
-      goto cleanup0;
-    }
+      else if (drv->iface && STREQ (drv->iface, "ide")) {
+        error (g, "'ide' interface does not work on ARM or PowerPC");
+        goto cleanup0;
+      }
 #endif
-    else if (drv->iface) {
-      ADD_CMDLINE ("-drive");
-      ADD_CMDLINE_PRINTF ("%s,if=%s", param, drv->iface);
-    }
-    else if (virtio_scsi) {
-      ADD_CMDLINE ("-drive");
-      ADD_CMDLINE_PRINTF ("%s,if=none" /* sic */, param);
-      ADD_CMDLINE ("-device");
-      ADD_CMDLINE_PRINTF ("scsi-hd,drive=hd%zu", i);
-    }
-    else {
-    virtio_blk:
-      ADD_CMDLINE ("-drive");
-      ADD_CMDLINE_PRINTF ("%s,if=none" /* sic */, param);
-      ADD_CMDLINE ("-device");
-      ADD_CMDLINE_PRINTF (VIRTIO_BLK ",drive=hd%zu", i);
+      else if (drv->iface) {
+        ADD_CMDLINE ("-drive");
+        ADD_CMDLINE_PRINTF ("%s,if=%s", param, drv->iface);
+      }
+      else if (virtio_scsi) {
+        ADD_CMDLINE ("-drive");
+        ADD_CMDLINE_PRINTF ("%s,if=none" /* sic */, param);
+        ADD_CMDLINE ("-device");
+        ADD_CMDLINE_PRINTF ("scsi-hd,drive=hd%zu", i);
+      }
+      else {
+      virtio_blk:
+        ADD_CMDLINE ("-drive");
+        ADD_CMDLINE_PRINTF ("%s,if=none" /* sic */, param);
+        if (iothread) {
+          ADD_CMDLINE ("-object");
+          ADD_CMDLINE_PRINTF ("iothread,id=iothread-hd%zu", i);
+          ADD_CMDLINE ("-device");
+          ADD_CMDLINE_PRINTF (VIRTIO_BLK ",drive=hd%zu,iothread=iothread-hd%zu%s",
+                              i, i, blk_queues);
+        }
+        else {
+          ADD_CMDLINE ("-device");
+          ADD_CMDLINE_PRINTF (VIRTIO_BLK ",drive=hd%zu%s", i, blk_queues);
+        }
+      }
     }
   }
 
   /* Add the ext2 appliance drive (after all the drives). */
-  if (has_appliance_drive) {
+  if (mode != LAUNCH_BOOT && has_appliance_drive) {
+    /* Put the appliance on virtio-blk so that the drives hotplugged
+     * on the virtio-scsi bus later get the same names (/dev/sda etc)
+     * as they would at boot.
+     */
     ADD_CMDLINE ("-drive");
-    ADD_CMDLINE_PRINTF ("file=%s,snapshot=on,id=appliance,"
+    if (appliance_overlay)
+      ADD_CMDLINE_PRINTF ("file=%s,id=appliance,"
+                          "cache=unsafe,if=none,format=qcow2",
+                          appliance_overlay);
+    else
+      ADD_CMDLINE_PRINTF ("file=%s,snapshot=on,id=appliance,"
+                          "cache=unsafe,if=none,format=raw",
+                          appliance);
+    ADD_CMDLINE ("-device");
+    ADD_CMDLINE (VIRTIO_BLK ",drive=appliance");
+
+    appliance_dev = safe_strdup (g, "/dev/vda");
+  }
+  else if (appliance_nvdimm_size > 0) {
+    /* Map the appliance file privately, so that every appliance on
+     * the host shares the page cache of the file, and writes made
+     * by the appliance are discarded like snapshot=on does.
+     */
+    ADD_CMDLINE ("-object");
+    ADD_CMDLINE_PRINTF ("memory-backend-file,id=appliance,share=off,"
+                        "mem-path=%s,size=%" PRIi64,
+                        appliance, appliance_nvdimm_size);
+    ADD_CMDLINE ("-device");
+    ADD_CMDLINE ("nvdimm,memdev=appliance,id=appliance-nvdimm");
+
+    appliance_dev = safe_strdup (g, "/dev/pmem0");
+  }
+  else if (has_appliance_drive) {
+    ADD_CMDLINE ("-drive");
+    ADD_CMDLINE_PRINTF ("file=%s,snapshot=on,id=appliance,"
                         "cache=unsafe,if=none,format=raw",
                         appliance);
 
@@ -606,19 +1205,49 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
   ADD_CMDLINE_PRINTF ("socket,path=%s,id=channel0", data->guestfsd_sock);
   ADD_CMDLINE ("-device");
   ADD_CMDLINE ("virtserialport,chardev=channel0,name=org.libguestfs.channel.0");
+  for (i = 1; i < data->nr_data_channels; ++i) {
+    ADD_CMDLINE ("-chardev");
+    ADD_CMDLINE_PRINTF ("socket,path=%s,id=channel%zu", data->data_sock[i], i);
+    ADD_CMDLINE ("-device");
+    ADD_CMDLINE_PRINTF ("virtserialport,chardev=channel%zu,name=org.libguestfs.channel.%zu",
+                        i, i);
+  }
 
-  /* Enable user networking. */
+  /* Enable networking.  User networking (slirp) works everywhere
+   * but is slow.  If the network_bridge backend setting is used,
+   * connect a tap device to the bridge instead, using
+   * qemu-bridge-helper.  The appliance gets its address from DHCP in
+   * either case.
+   */
   if (g->enable_network) {
     ADD_CMDLINE ("-netdev");
-    ADD_CMDLINE ("user,id=usernet,net=169.254.0.0/16");
+    if (network_bridge)
+      ADD_CMDLINE_PRINTF ("bridge,id=usernet,br=%s", network_bridge);
+    else
+      ADD_CMDLINE ("user,id=usernet,net=169.254.0.0/16");
     ADD_CMDLINE ("-device");
     ADD_CMDLINE (VIRTIO_NET ",netdev=usernet");
   }
 
+  if (mode != LAUNCH_BOOT) {
+    ADD_CMDLINE ("-qmp");
+    ADD_CMDLINE_PRINTF ("unix:%s", qmp_sockpath);
+  }
+
+  /* The snapshot directory cannot contain a single quote, see
+   * get_snapshot_dir.
+   */
+  if (restore) {
+    ADD_CMDLINE ("-incoming");
+    ADD_CMDLINE_PRINTF ("exec:cat '%s/state'", snapshot_dir);
+  }
+
   ADD_CMDLINE ("-append");
   flags = 0;
   if (!has_kvm || force_tcg)
     flags |= APPLIANCE_COMMAND_LINE_IS_TCG;
+  if (boot_without_udev (g))
+    flags |= APPLIANCE_COMMAND_LINE_NO_UDEV;
   ADD_CMDLINE_STRING_NODUP
     (guestfs_int_appliance_command_line (g, appliance_dev, flags));
 
@@ -703,6 +1332,8 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
     if (g->pgroup)
       setpgid (0, 0);
 
+    set_appliance_placement (cpu_set_ptr, node);
+
     setenv ("LC_ALL", "C", 1);
     setenv ("QEMU_AUDIO_DRV", "none", 1); /* Prevents qemu opening /dev/dsp */
 
@@ -715,6 +1346,8 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
 
   /* Parent (library). */
   data->pid = r;
+  if (mode != LAUNCH_POOL)
+    guestfs_int_launch_phase (g, LAUNCH_PHASE_HYPERVISOR);
 
   /* Fork the recovery process off which will kill qemu if the parent
    * process fails to do so (eg. if the parent segfaults).
@@ -789,6 +1422,15 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
 
   g->state = LAUNCHING;
 
+  if (qmp_accept_sock >= 0) {
+    qmp_sock = guestfs_int_qmp_accept (g, qmp_accept_sock, data->pid);
+    qmp_accept_sock = -1;
+    if (qmp_sock == -1)
+      goto cleanup1;
+    unlink (qmp_sockpath);
+    qmp_sockpath[0] = '\0';
+  }
+
   /* Wait for qemu to start and to connect back to us via
    * virtio-serial and send the GUESTFS_LAUNCH_FLAG message.
    */
@@ -800,6 +1442,13 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
   /* g->conn now owns these sockets. */
   daemon_accept_sock = console_sock = -1;
 
+  for (i = 1; i < data->nr_data_channels; ++i) {
+    r = guestfs_int_conn_socket_add_channel (g, g->conn, data_accept_socks[i]);
+    data_accept_socks[i] = -1;
+    if (r == -1)
+      goto cleanup1;
+  }
+
   r = g->conn->ops->accept_connection (g, g->conn);
   if (r == -1)
     goto cleanup1;
@@ -815,16 +1464,26 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
    * able to open a drive.
    */
 
-  r = guestfs_int_recv_from_daemon (g, &size, &buf);
-
-  if (r == -1) {
-    guestfs_int_launch_failed_error (g);
-    goto cleanup1;
+  if (restore) {
+    /* The restored daemon sent GUESTFS_LAUNCH_FLAG to the template
+     * library long ago, so it won't send it again.
+     */
+    if (wait_for_incoming (g, qmp_sock) == -1)
+      goto cleanup1;
+    g->state = READY;
   }
+  else {
+    r = guestfs_int_recv_from_daemon (g, &size, &buf);
 
-  if (size != GUESTFS_LAUNCH_FLAG) {
-    guestfs_int_launch_failed_error (g);
-    goto cleanup1;
+    if (r == -1) {
+      guestfs_int_launch_failed_error (g);
+      goto cleanup1;
+    }
+
+    if (size != GUESTFS_LAUNCH_FLAG) {
+      guestfs_int_launch_failed_error (g);
+      goto cleanup1;
+    }
   }
 
   debug (g, "appliance is up");
@@ -839,6 +1498,32 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
     goto cleanup1;
   }
 
+  if (mode == LAUNCH_SAVE) {
+    if (save_snapshot (g, qmp_sock, snapshot_dir) == -1)
+      goto cleanup1;
+
+    /* The template has done its job. */
+    close (qmp_sock);
+    g->conn->ops->free_connection (g, g->conn);
+    g->conn = NULL;
+    r = shutdown_direct (g, data, 0);
+    g->state = CONFIG;
+    return r;
+  }
+
+  if (mode == LAUNCH_RESTORE) {
+    if (hotplug_drives (g, data, qmp_sock) == -1)
+      goto cleanup1;
+    close (qmp_sock);
+    qmp_sock = -1;
+  }
+
+  if (mode == LAUNCH_POOL) {
+    data->qmp_sock = qmp_sock;
+    debug (g, "pooled appliance %d is ready", data->pid);
+    return 0;
+  }
+
   TRACE0 (launch_end);
 
   guestfs_int_launch_send_progress (g, 12);
@@ -864,8 +1549,18 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
  cleanup0:
   if (daemon_accept_sock >= 0)
     close (daemon_accept_sock);
+  if (qmp_accept_sock >= 0)
+    close (qmp_accept_sock);
+  if (qmp_sock >= 0)
+    close (qmp_sock);
+  if (qmp_sockpath[0] != '\0')
+    unlink (qmp_sockpath);
   if (console_sock >= 0)
     close (console_sock);
+  for (i = 1; i < GUESTFS_MAX_DATA_CHANNELS; ++i) {
+    if (data_accept_socks[i] >= 0)
+      close (data_accept_socks[i]);
+  }
   if (g->conn) {
     g->conn->ops->free_connection (g, g->conn);
     g->conn = NULL;
@@ -874,6 +1569,667 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
   return -1;
 }
 
+/**
+ * Return the key which identifies the appliance a handle would
+ * launch.  If any of it changes the snapshot is rebuilt, and pooled
+ * appliances are only handed to handles with the same key.  Kernel,
+ * initrd and appliance modification times are included because
+ * supermin rebuilds them in place.
+ */
+static char *
+make_appliance_key (guestfs_h *g, struct backend_direct_data *data,
+                   const char *kernel, const char *initrd,
+                   const char *appliance)
+{
+  CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (key);
+  const char *files[] = { g->hv, kernel, initrd, appliance };
+  struct hv_param *hp;
+  struct stat statbuf;
+  size_t i;
+
+  for (i = 0; i < sizeof files / sizeof files[0]; ++i) {
+    if (stat (files[i], &statbuf) == -1) {
+      perrorf (g, "stat: %s", files[i]);
+      return NULL;
+    }
+    guestfs_int_add_sprintf (g, &key, "file=%s mtime=%" PRIi64 "\n",
+                             files[i], (int64_t) statbuf.st_mtime);
+  }
+  guestfs_int_add_sprintf (g, &key, "qemu=%d.%d.%d\n",
+                           data->qemu_version.v_major,
+                           data->qemu_version.v_minor,
+                           data->qemu_version.v_micro);
+  guestfs_int_add_sprintf (g, &key, "memsize=%d\n", g->memsize);
+  guestfs_int_add_sprintf (g, &key, "smp=%d\n", g->smp);
+  guestfs_int_add_sprintf (g, &key, "iothread=%d\n", g->iothread);
+  guestfs_int_add_sprintf (g, &key, "network=%d\n", g->enable_network);
+  if (g->enable_network) {
+    CLEANUP_FREE char *network_bridge = NULL;
+
+    guestfs_push_error_handler (g, NULL, NULL);
+    network_bridge = guestfs_get_backend_setting (g, "network_bridge");
+    guestfs_pop_error_handler (g);
+    guestfs_int_add_sprintf (g, &key, "network_bridge=%s\n",
+                             network_bridge ? network_bridge : "");
+  }
+  guestfs_int_add_sprintf (g, &key, "verbose=%d\n", g->verbose);
+  guestfs_int_add_sprintf (g, &key, "selinux=%d\n", g->selinux);
+  guestfs_int_add_sprintf (g, &key, "no_udev=%d\n", boot_without_udev (g));
+  guestfs_int_add_sprintf (g, &key, "append=%s\n",
+                           g->append ? g->append : "");
+  guestfs_int_add_sprintf (g, &key, "data_channels=%d\n",
+                           guestfs_int_get_nr_data_channels (g));
+  guestfs_int_add_sprintf (g, &key, "force_tcg=%d\n",
+                           guestfs_int_get_backend_setting_bool (g, "force_tcg"));
+  guestfs_int_add_sprintf (g, &key, "hugepages=%d prealloc=%d\n",
+                           guestfs_int_get_backend_setting_bool (g, "hugepages"),
+                           guestfs_int_get_backend_setting_bool (g, "prealloc"));
+  guestfs_int_add_sprintf (g, &key, "free_page_reporting=%d\n",
+                           guestfs_int_get_backend_setting_bool (g, "free_page_reporting"));
+  for (hp = g->hv_params; hp; hp = hp->next)
+    guestfs_int_add_sprintf (g, &key, "hv_param=%s %s\n",
+                             hp->hv_param, hp->hv_value ? hp->hv_value : "");
+  guestfs_int_end_stringsbuf (g, &key);
+
+  return guestfs_int_join_strings ("", key.argv);
+}
+
+/**
+ * Return true if F<snapshot_dir> contains a complete snapshot made
+ * with the same C<key>.
+ */
+static int
+is_snapshot_valid (guestfs_h *g, const char *snapshot_dir, const char *key)
+{
+  CLEANUP_FREE char *keyfile = NULL, *state = NULL, *template = NULL;
+  CLEANUP_FREE char *old_key = NULL;
+  int r;
+
+  keyfile = safe_asprintf (g, "%s/key", snapshot_dir);
+  state = safe_asprintf (g, "%s/state", snapshot_dir);
+  template = safe_asprintf (g, "%s/appliance.qcow2", snapshot_dir);
+
+  if (access (state, R_OK) == -1 || access (template, R_OK) == -1)
+    return 0;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  r = guestfs_int_read_whole_file (g, keyfile, &old_key, NULL);
+  guestfs_pop_error_handler (g);
+  if (r == -1)
+    return 0;
+
+  return STREQ (old_key, key);
+}
+
+/**
+ * Write the key file, which marks the snapshot as complete.
+ */
+static int
+write_snapshot_key (guestfs_h *g, const char *snapshot_dir, const char *key)
+{
+  CLEANUP_FREE char *keyfile = NULL;
+  int fd;
+  const size_t len = strlen (key);
+
+  keyfile = safe_asprintf (g, "%s/key", snapshot_dir);
+  fd = open (keyfile, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+  if (fd == -1) {
+    perrorf (g, "open: %s", keyfile);
+    return -1;
+  }
+  if (full_write (fd, key, len) != len) {
+    perrorf (g, "write: %s", keyfile);
+    close (fd);
+    return -1;
+  }
+  if (close (fd) == -1) {
+    perrorf (g, "close: %s", keyfile);
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Lock the snapshot directory so that only one handle at a time
+ * builds the template.  Returns the lock file descriptor, which the
+ * caller must close, or C<-1> on error.
+ */
+static int
+lock_snapshot_dir (guestfs_h *g, const char *snapshot_dir, int type)
+{
+  CLEANUP_FREE char *lockfile = NULL;
+  struct flock fl;
+  int fd;
+
+  lockfile = safe_asprintf (g, "%s/lock", snapshot_dir);
+  fd = open (lockfile, O_RDWR|O_CREAT|O_CLOEXEC, 0644);
+  if (fd == -1) {
+    perrorf (g, "open: %s", lockfile);
+    return -1;
+  }
+
+  fl.l_type = type;
+  fl.l_whence = SEEK_SET;
+  fl.l_start = 0;
+  fl.l_len = 0;
+  while (fcntl (fd, F_SETLKW, &fl) == -1) {
+    if (errno != EINTR) {
+      perrorf (g, "fcntl: F_SETLKW: %s", lockfile);
+      close (fd);
+      return -1;
+    }
+  }
+
+  return fd;
+}
+
+/**
+ * Return true if the drives can be hotplugged into an appliance
+ * started with no drives, which is how snapshot and pooled appliances
+ * work.  On error C<*err> is set to C<-1>.
+ */
+static int
+can_hotplug (guestfs_h *g, struct backend_direct_data *data,
+             const char *appliance, int *err)
+{
+  struct drive *drv;
+  size_t i;
+
+  *err = 0;
+
+  if (appliance == NULL) {
+    debug (g, "launch: cannot hotplug drives, there is no "
+           "appliance drive");
+    return 0;
+  }
+  if (guestfs_int_get_backend_setting_bool (g, "gdb") > 0) {
+    debug (g, "launch: cannot hotplug drives when gdb is enabled");
+    return 0;
+  }
+  ITER_DRIVES (g, i, drv) {
+    if (drv->iface) {
+      debug (g, "launch: cannot hotplug drives, drive %zu has an "
+             "explicit iface", i);
+      return 0;
+    }
+  }
+
+  if (data->qemu_data == NULL) {
+    data->qemu_data = guestfs_int_test_qemu (g, &data->qemu_version);
+    if (data->qemu_data == NULL) {
+      *err = -1;
+      return 0;
+    }
+  }
+  if (!guestfs_int_qemu_supports_virtio_scsi (g, data->qemu_data,
+                                              &data->qemu_version)) {
+    debug (g, "launch: cannot hotplug drives, qemu does not "
+           "support virtio-scsi");
+    return 0;
+  }
+
+  return 1;
+}
+
+/**
+ * Return the absolute path of the C<snapshot_dir> backend setting
+ * (caller frees), or C<NULL> if snapshots should not be used for this
+ * launch.  On error C<*err> is set to C<-1>.
+ */
+static char *
+get_snapshot_dir (guestfs_h *g, struct backend_direct_data *data,
+                  const char *appliance, int *err)
+{
+  CLEANUP_FREE char *dir = NULL;
+  char *ret;
+
+  *err = 0;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  dir = guestfs_get_backend_setting (g, "snapshot_dir");
+  guestfs_pop_error_handler (g);
+  if (dir == NULL)
+    return NULL;
+
+  if (!can_hotplug (g, data, appliance, err))
+    return NULL;
+
+  ret = realpath (dir, NULL);
+  if (ret == NULL) {
+    perrorf (g, "snapshot_dir: %s", dir);
+    *err = -1;
+    return NULL;
+  }
+  /* It is passed to the shell by qemu -incoming exec:. */
+  if (strchr (ret, '\'') != NULL) {
+    error (g, _("snapshot_dir: %s: directory name must not contain "
+                "a single quote character"), ret);
+    free (ret);
+    *err = -1;
+    return NULL;
+  }
+
+  return ret;
+}
+
+/**
+ * An appliance in the pool.  Each one is owned by a private handle
+ * C<g> until C<launch_direct> hands it out.  C<ready> is false while
+ * a thread is still starting it.
+ */
+struct pooled_appliance {
+  struct pooled_appliance *next;
+  bool ready;
+  guestfs_h *g;
+  char *key;
+  char *kernel, *initrd, *appliance, *snapshot_dir;
+};
+
+gl_lock_define_initialized (static, pool_lock);
+static struct pooled_appliance *pool;
+
+static void
+free_pooled_appliance (struct pooled_appliance *entry)
+{
+  guestfs_close (entry->g);
+  free (entry->key);
+  free (entry->kernel);
+  free (entry->initrd);
+  free (entry->appliance);
+  free (entry->snapshot_dir);
+  free (entry);
+}
+
+static void
+remove_pooled_appliance (struct pooled_appliance *entry)
+{
+  struct pooled_appliance **pp;
+
+  for (pp = &pool; *pp != entry; pp = &(*pp)->next)
+    ;
+  *pp = entry->next;
+}
+
+/**
+ * Take a ready appliance with a matching C<key> out of the pool.
+ * Returns C<NULL> if there isn't one.
+ */
+static struct pooled_appliance *
+take_pooled_appliance (const char *key)
+{
+  struct pooled_appliance *entry;
+
+  gl_lock_lock (pool_lock);
+  for (entry = pool; entry != NULL; entry = entry->next) {
+    if (entry->ready && STREQ (entry->key, key)) {
+      remove_pooled_appliance (entry);
+      break;
+    }
+  }
+  gl_lock_unlock (pool_lock);
+
+  return entry;
+}
+
+/**
+ * Thread which starts a pooled appliance in the background.
+ */
+static void *
+start_pooled_appliance (void *entryv)
+{
+  struct pooled_appliance *entry = entryv;
+  guestfs_h *pg = entry->g;
+  int lock_fd = -1;
+  int r = -1;
+
+  gettimeofday (&pg->launch_t, NULL);
+
+  if (guestfs_int_lazy_make_tmpdir (pg) == -1)
+    goto out;
+  if (entry->snapshot_dir) {
+    lock_fd = lock_snapshot_dir (pg, entry->snapshot_dir, F_RDLCK);
+    if (lock_fd == -1)
+      goto out;
+  }
+  r = launch_qemu (pg, pg->backend_data,
+                   entry->kernel, entry->initrd, entry->appliance,
+                   entry->snapshot_dir, LAUNCH_POOL);
+  if (lock_fd >= 0)
+    close (lock_fd);
+
+ out:
+  gl_lock_lock (pool_lock);
+  if (r == 0)
+    entry->ready = true;
+  else
+    remove_pooled_appliance (entry);
+  gl_lock_unlock (pool_lock);
+
+  if (r == -1) {
+    debug (pg, "pool: could not start appliance: %s",
+           guestfs_last_error (pg));
+    free_pooled_appliance (entry);
+  }
+
+  return NULL;
+}
+
+/**
+ * Create a private handle with the same settings as C<g>, which will
+ * own a pooled appliance.
+ */
+static guestfs_h *
+create_pool_handle (guestfs_h *g)
+{
+  guestfs_h *pg;
+  char *empty[] = { NULL };
+  struct hv_param *hp;
+
+  pg = guestfs_create_flags (GUESTFS_CREATE_NO_ENVIRONMENT);
+  if (pg == NULL) {
+    perrorf (g, "pool: guestfs_create_flags");
+    return NULL;
+  }
+  guestfs_set_error_handler (pg, NULL, NULL);
+
+  pg->verbose = g->verbose;
+  pg->direct_mode = g->direct_mode;
+  pg->recovery_proc = g->recovery_proc;
+  pg->enable_network = g->enable_network;
+  pg->selinux = g->selinux;
+  pg->pgroup = g->pgroup;
+  pg->smp = g->smp;
+  pg->memsize = g->memsize;
+  pg->iothread = g->iothread;
+
+  if (guestfs_set_backend (pg, "direct") == -1 ||
+      guestfs_set_backend_settings (pg, g->backend_settings ?
+                                    g->backend_settings : empty) == -1 ||
+      guestfs_set_hv (pg, g->hv) == -1 ||
+      guestfs_set_path (pg, g->path) == -1 ||
+      (g->append && guestfs_set_append (pg, g->append) == -1) ||
+      (g->int_tmpdir && guestfs_set_tmpdir (pg, g->int_tmpdir) == -1) ||
+      (g->int_cachedir &&
+       guestfs_set_cachedir (pg, g->int_cachedir) == -1))
+    goto error;
+
+  for (hp = g->hv_params; hp; hp = hp->next) {
+    if (guestfs_config (pg, hp->hv_param, hp->hv_value) == -1)
+      goto error;
+  }
+
+  return pg;
+
+ error:
+  error (g, "pool: %s", guestfs_last_error (pg));
+  guestfs_close (pg);
+  return NULL;
+}
+
+/**
+ * Start enough appliances in the background that there are
+ * C<pool_size> pooled appliances for C<key>, counting ones which are
+ * still starting.  Failures are not fatal, the next launch will just
+ * have to boot its own appliance.
+ */
+static void
+refill_pool (guestfs_h *g, int pool_size, const char *key,
+             const char *kernel, const char *initrd, const char *appliance,
+             const char *snapshot_dir)
+{
+  struct pooled_appliance *entry;
+  int n = 0;
+  pthread_attr_t attr;
+  pthread_t thread;
+  int err;
+
+  gl_lock_lock (pool_lock);
+  for (entry = pool; entry != NULL; entry = entry->next) {
+    if (STREQ (entry->key, key))
+      n++;
+  }
+  gl_lock_unlock (pool_lock);
+
+  pthread_attr_init (&attr);
+  pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+
+  for (; n < pool_size; ++n) {
+    guestfs_h *pg;
+
+    guestfs_push_error_handler (g, NULL, NULL);
+    pg = create_pool_handle (g);
+    if (pg == NULL)
+      debug (g, "pool: %s", guestfs_last_error (g));
+    guestfs_pop_error_handler (g);
+    if (pg == NULL)
+      break;
+
+    entry = safe_calloc (g, 1, sizeof *entry);
+    entry->g = pg;
+    entry->key = safe_strdup (g, key);
+    entry->kernel = safe_strdup (g, kernel);
+    entry->initrd = safe_strdup (g, initrd);
+    entry->appliance = safe_strdup (g, appliance);
+    entry->snapshot_dir = snapshot_dir ? safe_strdup (g, snapshot_dir) : NULL;
+
+    gl_lock_lock (pool_lock);
+    entry->next = pool;
+    pool = entry;
+    gl_lock_unlock (pool_lock);
+
+    err = pthread_create (&thread, &attr, start_pooled_appliance, entry);
+    if (err != 0) {
+      debug (g, "pool: pthread_create: %s", strerror (err));
+      gl_lock_lock (pool_lock);
+      remove_pooled_appliance (entry);
+      gl_lock_unlock (pool_lock);
+      free_pooled_appliance (entry);
+      break;
+    }
+  }
+
+  pthread_attr_destroy (&attr);
+}
+
+/**
+ * Move a pooled appliance into handle C<g> and hotplug the drives.
+ */
+static int
+adopt_pooled_appliance (guestfs_h *g, struct backend_direct_data *data,
+                        struct pooled_appliance *entry)
+{
+  guestfs_h *pg = entry->g;
+  struct backend_direct_data *pdata = pg->backend_data;
+  int r;
+
+  guestfs_int_free_qemu_data (data->qemu_data);
+  *data = *pdata;
+  memset (pdata, 0, sizeof *pdata);
+  pdata->qmp_sock = -1;
+  g->conn = pg->conn;
+  pg->conn = NULL;
+  pg->state = CONFIG;
+  g->state = READY;
+  free_pooled_appliance (entry);
+
+  debug (g, "launch: using pooled appliance %d", data->pid);
+
+  r = hotplug_drives (g, data, data->qmp_sock);
+  close (data->qmp_sock);
+  data->qmp_sock = -1;
+  if (r == -1) {
+    shutdown_direct (g, data, 0);
+    g->conn->ops->free_connection (g, g->conn);
+    g->conn = NULL;
+    g->state = CONFIG;
+    return -1;
+  }
+
+  TRACE0 (launch_end);
+
+  guestfs_int_launch_send_progress (g, 12);
+
+  guestfs_int_add_dummy_appliance_drive (g);
+
+  return 0;
+}
+
+/**
+ * Launch the appliance in one of three ways:
+ *
+ * =over 4
+ *
+ * =item *
+ *
+ * If the C<pool> backend setting is set and there is a pooled
+ * appliance with the same settings, hotplug the drives into that.
+ *
+ * =item *
+ *
+ * If the C<snapshot_dir> backend setting is set, restore the
+ * appliance from the snapshot (saving the snapshot first if there
+ * isn't a usable one) and hotplug the drives.
+ *
+ * =item *
+ *
+ * Otherwise boot the appliance with the drives on the command line.
+ *
+ * =back
+ *
+ * If C<pool> is set, after a successful launch the pool is topped up
+ * in the background.
+ */
+static int
+launch_direct (guestfs_h *g, void *datav, const char *arg)
+{
+  struct backend_direct_data *data = datav;
+  CLEANUP_FREE char *kernel = NULL, *initrd = NULL, *appliance = NULL;
+  CLEANUP_FREE char *snapshot_dir = NULL, *key = NULL, *pool_key = NULL;
+  struct pooled_appliance *entry = NULL;
+  int pool_size;
+  int lock_fd, err, r;
+
+  /* At present you must add drives before starting the appliance.  In
+   * future when we enable hotplugging you won't need to do this.
+   */
+  if (!g->nr_drives) {
+    error (g, _("you must call guestfs_add_drive before guestfs_launch"));
+    return -1;
+  }
+
+  pool_size = guestfs_int_get_backend_setting_int (g, "pool", 0);
+  if (pool_size == -1)
+    return -1;
+
+  guestfs_int_launch_send_progress (g, 0);
+
+  TRACE0 (launch_build_appliance_start);
+
+  /* Locate and/or build the appliance. */
+  if (guestfs_int_build_appliance (g, &kernel, &initrd, &appliance) == -1)
+    return -1;
+
+  TRACE0 (launch_build_appliance_end);
+  guestfs_int_launch_phase (g, LAUNCH_PHASE_APPLIANCE);
+
+  guestfs_int_launch_send_progress (g, 3);
+
+  /* Drives are hotplugged into snapshot and pooled appliances, so
+   * both are subject to the same restrictions.
+   */
+  snapshot_dir = get_snapshot_dir (g, data, appliance, &err);
+  if (err == -1)
+    return -1;
+  if (pool_size > 0 && !can_hotplug (g, data, appliance, &err)) {
+    if (err == -1)
+      return -1;
+    pool_size = 0;
+  }
+
+  if (snapshot_dir == NULL && pool_size == 0)
+    return launch_qemu (g, data, kernel, initrd, appliance,
+                        NULL, LAUNCH_BOOT);
+
+  key = make_appliance_key (g, data, kernel, initrd, appliance);
+  if (key == NULL)
+    return -1;
+
+  /* Pooled appliances are already running on their CPUs and NUMA
+   * node, so they are only handed to handles with the same placement.
+   * This is not part of the snapshot key because qemu can restore the
+   * snapshot anywhere.
+   */
+  if (pool_size > 0) {
+    CLEANUP_FREE char *cpuset = NULL, *numa_node = NULL;
+
+    guestfs_push_error_handler (g, NULL, NULL);
+    cpuset = guestfs_get_backend_setting (g, "cpuset");
+    numa_node = guestfs_get_backend_setting (g, "numa_node");
+    guestfs_pop_error_handler (g);
+    pool_key = safe_asprintf (g, "%scpuset=%s numa_node=%s\n", key,
+                              cpuset ? cpuset : "",
+                              numa_node ? numa_node : "");
+    entry = take_pooled_appliance (pool_key);
+  }
+
+  /* The pooled appliance might have died while it was idle, in
+   * which case carry on and start a new one.
+   */
+  r = -1;
+  if (entry) {
+    guestfs_push_error_handler (g, NULL, NULL);
+    r = adopt_pooled_appliance (g, data, entry);
+    guestfs_pop_error_handler (g);
+    if (r == -1)
+      debug (g, "launch: could not use pooled appliance: %s",
+             guestfs_last_error (g));
+  }
+
+  if (r == -1 && snapshot_dir == NULL)
+    r = launch_qemu (g, data, kernel, initrd, appliance,
+                     NULL, LAUNCH_BOOT);
+  else if (r == -1) {
+    /* Boot the template and save the snapshot if we don't have one
+     * already, then restore this handle from it.
+     */
+    lock_fd = lock_snapshot_dir (g, snapshot_dir, F_WRLCK);
+    if (lock_fd == -1)
+      return -1;
+
+    r = 0;
+    if (!is_snapshot_valid (g, snapshot_dir, key)) {
+      CLEANUP_FREE char *keyfile =
+        safe_asprintf (g, "%s/key", snapshot_dir);
+
+      debug (g, "creating appliance snapshot in %s", snapshot_dir);
+      unlink (keyfile);
+      r = launch_qemu (g, data, kernel, initrd, appliance,
+                       snapshot_dir, LAUNCH_SAVE);
+      if (r == 0)
+        r = write_snapshot_key (g, snapshot_dir, key);
+    }
+
+    /* Other handles may restore from the snapshot at the same time. */
+    if (r == 0) {
+      close (lock_fd);
+      lock_fd = lock_snapshot_dir (g, snapshot_dir, F_RDLCK);
+      if (lock_fd == -1)
+        return -1;
+      r = launch_qemu (g, data, kernel, initrd, appliance,
+                       snapshot_dir, LAUNCH_RESTORE);
+    }
+
+    close (lock_fd);
+  }
+
+  if (r == 0 && pool_size > 0)
+    refill_pool (g, pool_size, pool_key, kernel, initrd, appliance,
+                 snapshot_dir);
+
+  return r;
+}
+
 /* Calculate the appliance device name.
  *
  * The easy thing would be to use g->nr_drives (indeed, that's what we
@@ -961,6 +2317,7 @@ shutdown_direct (guestfs_h *g, void *datav, int check_for_errors)
   int ret = 0;
   int status;
   struct rusage rusage;
+  size_t i;
 
   /* Signal qemu to shutdown cleanly, and kill the recovery process. */
   if (data->pid > 0) {
@@ -991,6 +2348,18 @@ shutdown_direct (guestfs_h *g, void *datav, int check_for_errors)
     unlink (data->guestfsd_sock);
     data->guestfsd_sock[0] = '\0';
   }
+  for (i = 1; i < data->nr_data_channels; ++i) {
+    if (data->data_sock[i][0] != '\0') {
+      unlink (data->data_sock[i]);
+      data->data_sock[i][0] = '\0';
+    }
+  }
+  data->nr_data_channels = 0;
+
+  if (data->qmp_sock >= 0) {
+    close (data->qmp_sock);
+    data->qmp_sock = -1;
+  }
 
   guestfs_int_free_qemu_data (data->qemu_data);
   data->qemu_data = NULL;
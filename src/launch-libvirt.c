@@ -37,6 +37,7 @@
 #include <libvirt/virterror.h>
 #endif
 
+#include <libxml/uri.h>
 #include <libxml/xmlwriter.h>
 #include <libxml/xpath.h>
 
@@ -45,6 +46,7 @@
 #include <selinux/context.h>
 #endif
 
+#include "glthread/lock.h"
 #include "base64.h"
 
 #include "guestfs.h"
@@ -108,9 +110,31 @@ struct secret {
 
 #define DOMAIN_NAME_LEN (8+16+1) /* "guestfs-" + random + \0 */
 
+/* Opening the libvirt connection and fetching and parsing the
+ * capabilities XML are a large part of the cost of launching, so
+ * handles in the same process which use the same URI share one
+ * connection and the parsed capabilities.  Each launched handle
+ * holds a reference on the connection (see virConnectRef) and counts
+ * as one user of the entry.  The entry is freed when the last user
+ * goes away.
+ */
+struct libvirt_conn_cache {
+  struct libvirt_conn_cache *next;
+  char *uri;                    /* NULL = libvirt default URI */
+  virConnectPtr conn;
+  size_t users;                 /* number of handles using this entry */
+  bool shared;                  /* true if linked into conn_cache list */
+  struct version qemu_version;  /* qemu version (from libvirt) */
+  bool seen_qemu, seen_kvm;     /* domain types (from capabilities) */
+};
+
+gl_lock_define_initialized (static, conn_cache_lock);
+static struct libvirt_conn_cache *conn_cache = NULL;
+
 /* Per-handle data. */
 struct backend_libvirt_data {
   virConnectPtr conn;           /* libvirt connection */
+  struct libvirt_conn_cache *cached; /* shared connection and capabilities */
   virDomainPtr dom;             /* libvirt domain */
   char *selinux_label;
   char *selinux_imagelabel;
@@ -126,6 +150,8 @@ struct backend_libvirt_data {
   char *uefi_vars;
   char guestfsd_path[UNIX_PATH_MAX]; /* paths to sockets */
   char console_path[UNIX_PATH_MAX];
+  size_t nr_data_channels;      /* extra data channels (entry 0 unused) */
+  char data_path[GUESTFS_MAX_DATA_CHANNELS][UNIX_PATH_MAX];
 };
 
 /* Parameters passed to construct_libvirt_xml and subfunctions.  We
@@ -142,7 +168,10 @@ struct libvirt_xml_params {
   bool current_proc_is_root;    /* true = euid is root */
 };
 
-static int parse_capabilities (guestfs_h *g, const char *capabilities_xml, struct backend_libvirt_data *data);
+static struct libvirt_conn_cache *get_connection (guestfs_h *g, const char *uri, bool share);
+static void put_connection (struct libvirt_conn_cache *c);
+static int parse_capabilities (guestfs_h *g, const char *capabilities_xml, struct libvirt_conn_cache *c);
+static int check_capabilities (guestfs_h *g, const struct libvirt_conn_cache *c, struct backend_libvirt_data *data);
 static int add_secret (guestfs_h *g, virConnectPtr conn, struct backend_libvirt_data *data, const struct drive *drv);
 static int find_secret (guestfs_h *g, const struct backend_libvirt_data *data, const struct drive *drv, const char **type, const char **uuid);
 static int have_secret (guestfs_h *g, const struct backend_libvirt_data *data, const struct drive *drv);
@@ -152,12 +181,11 @@ static void debug_socket_permissions (guestfs_h *g);
 static void libvirt_error (guestfs_h *g, const char *fs, ...) __attribute__((format (printf,2,3)));
 static void libvirt_debug (guestfs_h *g, const char *fs, ...) __attribute__((format (printf,2,3)));
 static int is_custom_hv (guestfs_h *g);
+static int is_remote_uri (const char *uri);
 static int is_blk (const char *path);
 static void ignore_errors (void *ignore, virErrorPtr ignore2);
 static void set_socket_create_context (guestfs_h *g);
 static void clear_socket_create_context (guestfs_h *g);
-static int check_bridge_exists (guestfs_h *g, const char *brname);
-
 #if HAVE_LIBSELINUX
 static void selinux_warning (guestfs_h *g, const char *func, const char *selinux_op, const char *data);
 #endif
@@ -295,9 +323,10 @@ launch_libvirt (guestfs_h *g, void *datav, const char *libvirt_uri)
 {
   struct backend_libvirt_data *data = datav;
   int daemon_accept_sock = -1, console_sock = -1;
+  int data_accept_socks[GUESTFS_MAX_DATA_CHANNELS];
+  int nr_data_channels;
   virConnectPtr conn = NULL;
   virDomainPtr dom = NULL;
-  CLEANUP_FREE char *capabilities_xml = NULL;
   struct libvirt_xml_params params = {
     .data = data,
     .kernel = NULL,
@@ -317,6 +346,9 @@ launch_libvirt (guestfs_h *g, void *datav, const char *libvirt_uri)
 
   params.current_proc_is_root = geteuid () == 0;
 
+  for (i = 0; i < GUESTFS_MAX_DATA_CHANNELS; ++i)
+    data_accept_socks[i] = -1;
+
   /* XXX: It should be possible to make this work. */
   if (g->direct_mode) {
     error (g, _("direct mode flag is not supported yet for libvirt backend"));
@@ -364,49 +396,28 @@ launch_libvirt (guestfs_h *g, void *datav, const char *libvirt_uri)
     libvirt_uri = NULL;
   } /* else nothing */
 
-  /* Connect to libvirt, get capabilities. */
-  conn = guestfs_int_open_libvirt_connection (g, libvirt_uri, 0);
-  if (!conn) {
-    libvirt_error (g, _("could not connect to libvirt (URI = %s)"),
-		   libvirt_uri ? : "NULL");
+  /* Connect to libvirt, get capabilities.  If the caller wants to
+   * handle authentication itself (guestfs_set_libvirt_supported_credentials)
+   * then the connection is private to this handle.
+   */
+  data->cached = get_connection (g, libvirt_uri,
+                                 g->nr_supported_credentials == 0);
+  if (!data->cached)
     goto cleanup;
-  }
+  conn = data->cached->conn;
+  virConnectRef (conn);
 
-  /* Suppress default behaviour of printing errors to stderr.  Note
-   * you can't set this to NULL to ignore errors; setting it to NULL
-   * restores the default error handler ...
+  /* File transfers to an appliance on another host are compressed
+   * (see negotiate_chunk_codec in launch.c).
    */
-  virConnSetErrorFunc (conn, NULL, ignore_errors);
-
-  /* Get hypervisor (hopefully qemu) version. */
-  if (virConnectGetVersion (conn, &version_number) == 0) {
-    guestfs_int_version_from_libvirt (&data->qemu_version, version_number);
-    debug (g, "qemu version (reported by libvirt) = %lu (%d.%d.%d)",
-           version_number,
-           data->qemu_version.v_major,
-           data->qemu_version.v_minor,
-           data->qemu_version.v_micro);
-  }
-  else {
-    libvirt_debug (g, "unable to read qemu version from libvirt");
-    version_init_null (&data->qemu_version);
-  }
+  g->remote_appliance = is_remote_uri (libvirt_uri);
 
-  debug (g, "get libvirt capabilities");
+  data->qemu_version = data->cached->qemu_version;
 
-  capabilities_xml = virConnectGetCapabilities (conn);
-  if (!capabilities_xml) {
-    libvirt_error (g, _("could not get libvirt capabilities"));
-    goto cleanup;
-  }
-
-  /* Parse capabilities XML.  This fills in various fields in 'params'
-   * struct, and can also fail if we detect that the hypervisor cannot
-   * run qemu guests (RHBZ#886915).
+  /* This can fail if we detect that the hypervisor cannot run qemu
+   * guests (RHBZ#886915).
    */
-  debug (g, "parsing capabilities XML");
-
-  if (parse_capabilities (g, capabilities_xml, data) == -1)
+  if (check_capabilities (g, data->cached, data) == -1)
     goto cleanup;
 
   /* UEFI code and variables, on architectures where that is required. */
@@ -444,7 +455,8 @@ launch_libvirt (guestfs_h *g, void *datav, const char *libvirt_uri)
   }
   guestfs_pop_error_handler (g);
 
-  if (g->enable_network && check_bridge_exists (g, data->network_bridge) == -1)
+  if (g->enable_network &&
+      guestfs_int_check_bridge_exists (g, data->network_bridge) == -1)
     goto cleanup;
 
   /* Locate and/or build the appliance. */
@@ -458,6 +470,7 @@ launch_libvirt (guestfs_h *g, void *datav, const char *libvirt_uri)
 
   guestfs_int_launch_send_progress (g, 3);
   TRACE0 (launch_build_libvirt_appliance_end);
+  guestfs_int_launch_phase (g, LAUNCH_PHASE_APPLIANCE);
 
   /* Note that appliance can be NULL if using the old-style appliance. */
   if (appliance) {
@@ -497,6 +510,23 @@ launch_libvirt (guestfs_h *g, void *datav, const char *libvirt_uri)
     goto cleanup;
   }
 
+  /* Extra virtio-serial channels used to stripe file transfers. */
+  nr_data_channels = guestfs_int_get_nr_data_channels (g);
+  if (nr_data_channels == -1)
+    goto cleanup;
+  data->nr_data_channels = nr_data_channels;
+  for (i = 1; i < data->nr_data_channels; ++i) {
+    char name[32];
+
+    snprintf (name, sizeof name, "guestfsd%zu.sock", i);
+    if (guestfs_int_create_socketname (g, name, &data->data_path[i]) == -1)
+      goto cleanup;
+    data_accept_socks[i] =
+      guestfs_int_create_listening_socket (g, data->data_path[i]);
+    if (data_accept_socks[i] == -1)
+      goto cleanup;
+  }
+
   /* For the serial console. */
   if (guestfs_int_create_socketname (g, "console.sock",
                                      &data->console_path) == -1)
@@ -556,6 +586,13 @@ launch_libvirt (guestfs_h *g, void *datav, const char *libvirt_uri)
       goto cleanup;
     }
 
+    for (i = 1; i < data->nr_data_channels; ++i) {
+      if (chmod (data->data_path[i], 0660) == -1) {
+        perrorf (g, "chmod: %s", data->data_path[i]);
+        goto cleanup;
+      }
+    }
+
     grp = getgrnam ("qemu");
     if (grp != NULL) {
       if (chown (data->guestfsd_path, 0, grp->gr_gid) == -1) {
@@ -566,6 +603,12 @@ launch_libvirt (guestfs_h *g, void *datav, const char *libvirt_uri)
         perrorf (g, "chown: %s", data->console_path);
         goto cleanup;
       }
+      for (i = 1; i < data->nr_data_channels; ++i) {
+        if (chown (data->data_path[i], 0, grp->gr_gid) == -1) {
+          perrorf (g, "chown: %s", data->data_path[i]);
+          goto cleanup;
+        }
+      }
     } else
       debug (g, "cannot find group 'qemu'");
   }
@@ -612,6 +655,7 @@ launch_libvirt (guestfs_h *g, void *datav, const char *libvirt_uri)
   }
 
   g->state = LAUNCHING;
+  guestfs_int_launch_phase (g, LAUNCH_PHASE_HYPERVISOR);
 
   /* Wait for console socket to be opened (by qemu). */
   r = accept4 (console_sock, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC);
@@ -638,6 +682,13 @@ launch_libvirt (guestfs_h *g, void *datav, const char *libvirt_uri)
   /* g->conn now owns these sockets. */
   daemon_accept_sock = console_sock = -1;
 
+  for (i = 1; i < data->nr_data_channels; ++i) {
+    r = guestfs_int_conn_socket_add_channel (g, g->conn, data_accept_socks[i]);
+    data_accept_socks[i] = -1;
+    if (r == -1)
+      goto cleanup;
+  }
+
   r = g->conn->ops->accept_connection (g, g->conn);
   if (r == -1)
     goto cleanup;
@@ -700,6 +751,10 @@ launch_libvirt (guestfs_h *g, void *datav, const char *libvirt_uri)
     close (console_sock);
   if (daemon_accept_sock >= 0)
     close (daemon_accept_sock);
+  for (i = 1; i < GUESTFS_MAX_DATA_CHANNELS; ++i) {
+    if (data_accept_socks[i] >= 0)
+      close (data_accept_socks[i]);
+  }
   if (g->conn) {
     g->conn->ops->free_connection (g, g->conn);
     g->conn = NULL;
@@ -711,6 +766,10 @@ launch_libvirt (guestfs_h *g, void *datav, const char *libvirt_uri)
   }
   if (conn)
     virConnectClose (conn);
+  if (data->cached) {
+    put_connection (data->cached);
+    data->cached = NULL;
+  }
 
   free (params.kernel);
   free (params.initrd);
@@ -721,9 +780,149 @@ launch_libvirt (guestfs_h *g, void *datav, const char *libvirt_uri)
   return -1;
 }
 
+/**
+ * Return a connection to libvirt at C<uri> (C<NULL> for the libvirt
+ * default URI), with the qemu version and capabilities already read.
+ *
+ * If C<share> is true, an existing live connection to the same URI
+ * opened by another handle is reused.  Connections which have died
+ * (eg. because libvirtd was restarted) are not reused, and a new
+ * connection is opened instead.
+ *
+ * The caller must call C<put_connection> when it no longer needs the
+ * entry.  On error this sets the error in the handle and returns
+ * C<NULL>.
+ */
+static struct libvirt_conn_cache *
+get_connection (guestfs_h *g, const char *uri, bool share)
+{
+  struct libvirt_conn_cache *c, **cp;
+  CLEANUP_FREE char *capabilities_xml = NULL;
+  unsigned long version_number;
+
+  gl_lock_lock (conn_cache_lock);
+
+  if (share) {
+    for (cp = &conn_cache; *cp != NULL; cp = &(*cp)->next) {
+      c = *cp;
+      if (c->uri == NULL ? uri != NULL : uri == NULL || STRNEQ (c->uri, uri))
+        continue;
+      if (virConnectIsAlive (c->conn) == 1) {
+        c->users++;
+        gl_lock_unlock (conn_cache_lock);
+        debug (g, "reusing libvirt connection: URI = %s, conn = %p",
+               uri ? uri : "NULL", c->conn);
+        return c;
+      }
+      /* Stop new handles from using the dead connection.  Handles
+       * already using it free it when they are closed.
+       */
+      debug (g, "libvirt connection %p is dead, reconnecting", c->conn);
+      *cp = c->next;
+      c->shared = false;
+      break;
+    }
+  }
+
+  c = safe_calloc (g, 1, sizeof *c);
+  c->uri = uri ? safe_strdup (g, uri) : NULL;
+  c->users = 1;
+
+  c->conn = guestfs_int_open_libvirt_connection (g, uri, 0);
+  if (!c->conn) {
+    libvirt_error (g, _("could not connect to libvirt (URI = %s)"),
+		   uri ? : "NULL");
+    goto error;
+  }
+
+  /* Suppress default behaviour of printing errors to stderr.  Note
+   * you can't set this to NULL to ignore errors; setting it to NULL
+   * restores the default error handler ...
+   */
+  virConnSetErrorFunc (c->conn, NULL, ignore_errors);
+
+  /* Get hypervisor (hopefully qemu) version. */
+  if (virConnectGetVersion (c->conn, &version_number) == 0) {
+    guestfs_int_version_from_libvirt (&c->qemu_version, version_number);
+    debug (g, "qemu version (reported by libvirt) = %lu (%d.%d.%d)",
+           version_number,
+           c->qemu_version.v_major,
+           c->qemu_version.v_minor,
+           c->qemu_version.v_micro);
+  }
+  else {
+    libvirt_debug (g, "unable to read qemu version from libvirt");
+    version_init_null (&c->qemu_version);
+  }
+
+  debug (g, "get libvirt capabilities");
+
+  capabilities_xml = virConnectGetCapabilities (c->conn);
+  if (!capabilities_xml) {
+    libvirt_error (g, _("could not get libvirt capabilities"));
+    goto error;
+  }
+
+  debug (g, "parsing capabilities XML");
+
+  if (parse_capabilities (g, capabilities_xml, c) == -1)
+    goto error;
+
+  if (share) {
+    c->shared = true;
+    c->next = conn_cache;
+    conn_cache = c;
+  }
+
+  gl_lock_unlock (conn_cache_lock);
+  return c;
+
+ error:
+  gl_lock_unlock (conn_cache_lock);
+  if (c->conn)
+    virConnectClose (c->conn);
+  free (c->uri);
+  free (c);
+  return NULL;
+}
+
+/**
+ * Drop a reference to an entry returned by C<get_connection>.  The
+ * last user closes the connection and frees the entry.
+ */
+static void
+put_connection (struct libvirt_conn_cache *c)
+{
+  struct libvirt_conn_cache **cp;
+
+  gl_lock_lock (conn_cache_lock);
+
+  assert (c->users > 0);
+  if (--c->users > 0) {
+    gl_lock_unlock (conn_cache_lock);
+    return;
+  }
+
+  if (c->shared) {
+    for (cp = &conn_cache; *cp != c; cp = &(*cp)->next)
+      assert (*cp != NULL);
+    *cp = c->next;
+  }
+
+  gl_lock_unlock (conn_cache_lock);
+
+  virConnectClose (c->conn);
+  free (c->uri);
+  free (c);
+}
+
+/**
+ * Parse the capabilities XML and record which domain types the
+ * hypervisor supports in the connection cache entry.
+ */
 static int
 parse_capabilities (guestfs_h *g, const char *capabilities_xml,
-                    struct backend_libvirt_data *data)
+                    struct libvirt_conn_cache *c)
 {
   CLEANUP_XMLFREEDOC xmlDocPtr doc = NULL;
   CLEANUP_XMLXPATHFREECONTEXT xmlXPathContextPtr xpathCtx = NULL;
@@ -731,8 +930,6 @@ parse_capabilities (guestfs_h *g, const char *capabilities_xml,
   size_t i;
   xmlNodeSetPtr nodes;
   xmlAttrPtr attr;
-  size_t seen_qemu, seen_kvm;
-  int force_tcg;
 
   doc = xmlReadMemory (capabilities_xml, strlen (capabilities_xml),
                        NULL, NULL, XML_PARSE_NONET);
@@ -759,13 +956,13 @@ parse_capabilities (guestfs_h *g, const char *capabilities_xml,
 #undef XPATH_EXPR
 
   nodes = xpathObj->nodesetval;
-  seen_qemu = seen_kvm = 0;
+  c->seen_qemu = c->seen_kvm = false;
 
   if (nodes != NULL) {
     for (i = 0; i < (size_t) nodes->nodeNr; ++i) {
       CLEANUP_FREE char *type = NULL;
 
-      if (seen_qemu && seen_kvm)
+      if (c->seen_qemu && c->seen_kvm)
         break;
 
       assert (nodes->nodeTab[i]);
@@ -774,17 +971,30 @@ parse_capabilities (guestfs_h *g, const char *capabilities_xml,
       type = (char *) xmlNodeListGetString (doc, attr->children, 1);
 
       if (STREQ (type, "qemu"))
-        seen_qemu++;
+        c->seen_qemu = true;
       else if (STREQ (type, "kvm"))
-        seen_kvm++;
+        c->seen_kvm = true;
     }
   }
 
+  return 0;
+}
+
+/**
+ * Check the hypervisor can run the appliance, and fill in the
+ * per-handle fields derived from the capabilities.
+ */
+static int
+check_capabilities (guestfs_h *g, const struct libvirt_conn_cache *c,
+                    struct backend_libvirt_data *data)
+{
+  int force_tcg;
+
   /* This was RHBZ#886915: in that case the default libvirt URI
    * pointed to a Xen hypervisor, and so could not create the
    * appliance VM.
    */
-  if (!seen_qemu && !seen_kvm) {
+  if (!c->seen_qemu && !c->seen_kvm) {
     CLEANUP_FREE char *backend = guestfs_get_backend (g);
 
     error (g,
@@ -807,7 +1017,7 @@ parse_capabilities (guestfs_h *g, const char *capabilities_xml,
     return -1;
 
   if (!force_tcg)
-    data->is_kvm = seen_kvm;
+    data->is_kvm = c->seen_kvm;
   else
     data->is_kvm = 0;
 
@@ -824,6 +1034,22 @@ is_custom_hv (guestfs_h *g)
 #endif
 }
 
+/**
+ * Does the libvirt URI name another host, as in
+ * C<qemu+ssh://host/system>?
+ */
+static int
+is_remote_uri (const char *uri)
+{
+  CLEANUP_XMLFREEURI xmlURIPtr xmluri = NULL;
+
+  if (uri == NULL)
+    return 0;
+
+  xmluri = xmlParseURI (uri);
+  return xmluri && xmluri->server && STRNEQ (xmluri->server, "");
+}
+
 #if HAVE_LIBSELINUX
 
 /* Set sVirt (SELinux) socket create context.  For details see:
@@ -1079,6 +1305,18 @@ construct_libvirt_xml (guestfs_h *g, const struct libvirt_xml_params *params)
   return ret;
 }
 
+/* Should the virtio-scsi controller run in an iothread (see
+ * guestfs_set_iothread)?  The <driver iothread> attribute of
+ * controllers was added in libvirt 1.3.5.
+ */
+static bool
+use_iothread (guestfs_h *g, const struct backend_libvirt_data *data)
+{
+  return g->iothread &&
+    guestfs_int_version_ge (&data->libvirt_version, 1, 3, 5) &&
+    guestfs_int_version_ge (&data->qemu_version, 2, 4, 0);
+}
+
 static int
 construct_libvirt_xml_domain (guestfs_h *g,
                               const struct libvirt_xml_params *params,
@@ -1128,6 +1366,13 @@ construct_libvirt_xml_cpu (guestfs_h *g,
                            xmlTextWriterPtr xo)
 {
   const char *cpu_model;
+  bool hugepages, prealloc;
+  CLEANUP_FREE char *cpus = NULL;
+  int node;
+
+  /* See guestfs.pod / cpuset, numa_node */
+  if (guestfs_int_get_appliance_placement (g, &cpus, &node) == -1)
+    return -1;
 
   start_element ("memory") {
     attribute ("unit", "MiB");
@@ -1139,6 +1384,26 @@ construct_libvirt_xml_cpu (guestfs_h *g,
     string_format ("%d", g->memsize);
   } end_element ();
 
+  /* See guestfs.pod / hugepages, prealloc */
+  hugepages = guestfs_int_get_backend_setting_bool (g, "hugepages") > 0;
+  prealloc = guestfs_int_get_backend_setting_bool (g, "prealloc") > 0;
+  if (hugepages || prealloc) {
+    start_element ("memoryBacking") {
+      if (hugepages)
+        empty_element ("hugepages");
+      if (guestfs_int_version_ge (&params->data->libvirt_version, 4, 10, 0)) {
+        start_element ("source") {
+          attribute ("type", "memfd");
+        } end_element ();
+      }
+      if (prealloc) {
+        start_element ("allocation") {
+          attribute ("mode", "immediate");
+        } end_element ();
+      }
+    } end_element ();
+  }
+
   cpu_model = guestfs_int_get_cpu_model (params->data->is_kvm);
   if (cpu_model) {
     start_element ("cpu") {
@@ -1157,9 +1422,26 @@ construct_libvirt_xml_cpu (guestfs_h *g,
   }
 
   start_element ("vcpu") {
+    if (cpus)
+      attribute ("cpuset", cpus);
     string_format ("%d", g->smp);
   } end_element ();
 
+  if (node >= 0) {
+    start_element ("numatune") {
+      start_element ("memory") {
+        attribute ("mode", "preferred");
+        attribute_format ("nodeset", "%d", node);
+      } end_element ();
+    } end_element ();
+  }
+
+  if (use_iothread (g, params->data)) {
+    start_element ("iothreads") {
+      string ("1");
+    } end_element ();
+  }
+
   start_element ("clock") {
     attribute ("offset", "utc");
 
@@ -1345,6 +1627,14 @@ construct_libvirt_xml_devices (guestfs_h *g,
       attribute ("type", "scsi");
       attribute ("index", "0");
       attribute ("model", "virtio-scsi");
+      if (use_iothread (g, params->data) || g->smp > 1) {
+        start_element ("driver") {
+          if (use_iothread (g, params->data))
+            attribute ("iothread", "1");
+          if (g->smp > 1)
+            attribute_format ("queues", "%d", g->smp);
+        } end_element ();
+      }
     } end_element ();
 
     /* Disks. */
@@ -1384,6 +1674,21 @@ construct_libvirt_xml_devices (guestfs_h *g,
       } end_element ();
     } end_element ();
 
+    /* Extra virtio-serial channels for file transfers. */
+    for (i = 1; i < params->data->nr_data_channels; ++i) {
+      start_element ("channel") {
+        attribute ("type", "unix");
+        start_element ("source") {
+          attribute ("mode", "connect");
+          attribute ("path", params->data->data_path[i]);
+        } end_element ();
+        start_element ("target") {
+          attribute ("type", "virtio");
+          attribute_format ("name", "org.libguestfs.channel.%zu", i);
+        } end_element ();
+      } end_element ();
+    }
+
     /* Connect to libvirt bridge (see: RHBZ#1148012). */
     if (g->enable_network) {
       start_element ("interface") {
@@ -1405,9 +1710,20 @@ construct_libvirt_xml_devices (guestfs_h *g,
       attribute ("model", "none");
     } end_element ();
 
-    start_element ("memballoon") {
-      attribute ("model", "none");
-    } end_element ();
+    /* See guestfs.pod / free_page_reporting */
+    if (guestfs_int_get_backend_setting_bool (g, "free_page_reporting") > 0 &&
+        guestfs_int_version_ge (&params->data->libvirt_version, 6, 9, 0) &&
+        guestfs_int_version_ge (&params->data->qemu_version, 5, 1, 0)) {
+      start_element ("memballoon") {
+        attribute ("model", "virtio");
+        attribute ("freePageReporting", "on");
+      } end_element ();
+    }
+    else {
+      start_element ("memballoon") {
+        attribute ("model", "none");
+      } end_element ();
+    }
 
   } end_element (); /* </devices> */
 
@@ -1617,6 +1933,8 @@ construct_libvirt_xml_disk_driver_qemu (guestfs_h *g,
                                         bool copyonread)
 {
   bool discard_unmap = false;
+  bool detect_zeroes = false;
+  const char *aio = NULL;
 
   /* When adding the appliance disk, we don't have a 'drv' struct.
    * However the caller will use discard_disable, so we don't need it.
@@ -1639,15 +1957,36 @@ construct_libvirt_xml_disk_driver_qemu (guestfs_h *g,
      */
     if (guestfs_int_version_ge (&data->qemu_version, 1, 5, 0))
       discard_unmap = true;
+    /* See the comment in make_drive_param in launch-direct.c. */
+    if (discard_unmap &&
+        guestfs_int_version_ge (&data->qemu_version, 2, 1, 0) &&
+        guestfs_int_version_ge (&data->libvirt_version, 1, 2, 9))
+      detect_zeroes = true;
     break;
   }
 
+  /* See guestfs_set_aio.  io_uring needs libvirt >= 6.3. */
+  if (drv != NULL)
+    aio = guestfs_int_drive_aio (g, drv, &data->qemu_version);
+  if (aio && STREQ (aio, "io_uring") &&
+      !guestfs_int_version_ge (&data->libvirt_version, 6, 3, 0)) {
+    debug (g, "io_uring needs libvirt >= 6.3, using the default aio mode");
+    aio = NULL;
+  }
+  /* See the comment in make_drive_param in launch-direct.c. */
+  if (aio && STREQ (aio, "native"))
+    cachemode = "none";
+
   start_element ("driver") {
     attribute ("name", "qemu");
     attribute ("type", format);
     attribute ("cache", cachemode);
+    if (aio)
+      attribute ("io", aio);
     if (discard_unmap)
       attribute ("discard", "unmap");
+    if (detect_zeroes)
+      attribute ("detect_zeroes", "unmap");
     if (copyonread)
       attribute ("copy_on_read", "on");
   } end_element ();
@@ -2008,49 +2347,6 @@ is_blk (const char *path)
   return S_ISBLK (statbuf.st_mode);
 }
 
-static int
-is_dir (const char *path)
-{
-  struct stat statbuf;
-
-  if (stat (path, &statbuf) == -1)
-    return 0;
-  return S_ISDIR (statbuf.st_mode);
-}
-
-/* Used to check the network_bridge exists, or give a useful error
- * message.
- */
-static int
-check_bridge_exists (guestfs_h *g, const char *brname)
-{
-  CLEANUP_FREE char *path = NULL;
-
-  /* If this doesn't look like Linux, give up. */
-  if (!is_dir ("/sys/class/net"))
-    return 0;
-
-  /* Does the interface exist and is it a bridge? */
-  path = safe_asprintf (g, "/sys/class/net/%s/bridge", brname);
-  if (is_dir (path))
-    return 0;
-
-  error (g,
-         _("bridge '%s' not found.  Try running:\n"
-           "\n"
-           "  brctl show\n"
-           "\n"
-           "to get a list of bridges on the host, and then selecting the\n"
-           "bridge you wish the appliance network to connect to using:\n"
-           "\n"
-           "  export LIBGUESTFS_BACKEND_SETTINGS=network_bridge=<bridge name>\n"
-           "\n"
-           "You may also need to allow the bridge in /etc/qemu/bridge.conf.\n"
-           "For further information see guestfs(3)."),
-	 brname);
-  return -1;
-}
-
 static void
 ignore_errors (void *ignore, virErrorPtr ignore2)
 {
@@ -2077,6 +2373,10 @@ shutdown_libvirt (guestfs_h *g, void *datav, int check_for_errors)
   }
   if (conn != NULL)
     virConnectClose (conn);
+  if (data->cached != NULL) {
+    put_connection (data->cached);
+    data->cached = NULL;
+  }
 
   if (data->guestfsd_path[0] != '\0') {
     unlink (data->guestfsd_path);
@@ -2088,6 +2388,14 @@ shutdown_libvirt (guestfs_h *g, void *datav, int check_for_errors)
     data->console_path[0] = '\0';
   }
 
+  for (i = 1; i < data->nr_data_channels; ++i) {
+    if (data->data_path[i][0] != '\0') {
+      unlink (data->data_path[i]);
+      data->data_path[i][0] = '\0';
+    }
+  }
+  data->nr_data_channels = 0;
+
   data->conn = NULL;
   data->dom = NULL;
 
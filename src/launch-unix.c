@@ -91,6 +91,11 @@ launch_unix (guestfs_h *g, void *datav, const char *sockpath)
 
   debug (g, "connected");
 
+  /* The socket may be forwarded from another host (eg. with
+   * ssh -L), so treat the appliance as remote.
+   */
+  g->remote_appliance = 1;
+
   if (g->state != READY) {
     error (g, _("contacted guestfsd, but state != READY"));
     goto cleanup;
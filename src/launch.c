@@ -35,11 +35,14 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <errno.h>
 #include <assert.h>
 #include <libintl.h>
 
 #include "c-ctype.h"
+#include "glthread/lock.h"
 
 #include "guestfs.h"
 #include "guestfs-internal.h"
@@ -52,9 +55,22 @@ static struct backend {
   const struct backend_ops *ops;
 } *backends = NULL;
 
+static void negotiate_chunk_size (guestfs_h *g);
+static void negotiate_chunk_codec (guestfs_h *g);
+static void negotiate_data_channels (guestfs_h *g);
+static void auto_size_appliance (guestfs_h *g);
+
+/* The number of appliances which are running or being launched in
+ * this process, so automatic sizing can share the host between them.
+ */
+gl_lock_define_initialized (static, nr_appliances_lock);
+static size_t nr_appliances = 0;
+
 int
 guestfs_impl_launch (guestfs_h *g)
 {
+  size_t i;
+
   /* Configured? */
   if (g->state != CONFIG) {
     error (g, _("the libguestfs handle has already been launched"));
@@ -64,6 +80,9 @@ guestfs_impl_launch (guestfs_h *g)
   /* Start the clock ... */
   gettimeofday (&g->launch_t, NULL);
   TRACE0 (launch_start);
+  for (i = 0; i < NR_LAUNCH_PHASES; ++i)
+    g->launch_phases[i] = -1;
+  guestfs_int_launch_phase (g, LAUNCH_PHASE_START);
 
   /* Make the temporary directory. */
   if (guestfs_int_lazy_make_tmpdir (g) == -1)
@@ -94,13 +113,351 @@ guestfs_impl_launch (guestfs_h *g)
     debug (g, "launch: euid=%ju", (uintmax_t) geteuid ());
   }
 
+  auto_size_appliance (g);
+
   /* Launch the appliance. */
-  if (g->backend_ops->launch (g, g->backend_data, g->backend_arg) == -1)
+  g->remote_appliance = 0;
+  if (g->backend_ops->launch (g, g->backend_data, g->backend_arg) == -1) {
+    guestfs_int_appliance_stopped (g);
+    /* Make sure the messages explaining the failure are delivered. */
+    guestfs_int_flush_event_buffers (g);
     return -1;
+  }
+
+  guestfs_int_launch_phase (g, LAUNCH_PHASE_DAEMON);
+
+  negotiate_chunk_size (g);
+  negotiate_data_channels (g);
+  negotiate_chunk_codec (g);
+
+  /* Tell the daemon about the progress interval.  This fails silently
+   * on older appliances, as in negotiate_chunk_size.
+   */
+  if (g->progress_interval > 0) {
+    guestfs_push_error_handler (g, NULL, NULL);
+    guestfs_internal_set_progress_interval (g, g->progress_interval);
+    guestfs_pop_error_handler (g);
+  }
 
   return 0;
 }
 
+/**
+ * Ask the daemon to use large chunks for C<FileIn> and C<FileOut>
+ * transfers.
+ *
+ * Appliances built from older versions of libguestfs don't implement
+ * C<internal_set_chunk_size>, in which case this fails silently and
+ * we carry on using C<GUESTFS_DEFAULT_CHUNK_SIZE>.
+ */
+static void
+negotiate_chunk_size (guestfs_h *g)
+{
+  int r;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  r = guestfs_internal_set_chunk_size (g, GUESTFS_MAX_CHUNK_SIZE);
+  guestfs_pop_error_handler (g);
+
+  if (r >= GUESTFS_DEFAULT_CHUNK_SIZE && r <= GUESTFS_MAX_CHUNK_SIZE)
+    g->chunk_size = r;
+  else
+    g->chunk_size = GUESTFS_DEFAULT_CHUNK_SIZE;
+
+  debug (g, "launch: file transfer chunk size is %zu bytes", g->chunk_size);
+}
+
+/**
+ * If the backend started the appliance with extra virtio-serial data
+ * channels, ask the daemon to open them and stripe file transfers
+ * across them.  As with C<negotiate_chunk_size>, older appliances
+ * don't implement this and we carry on using a single channel.
+ */
+static void
+negotiate_data_channels (guestfs_h *g)
+{
+  size_t n = 1;
+  int r;
+
+  if (g->conn->ops->get_nr_channels)
+    n = g->conn->ops->get_nr_channels (g, g->conn);
+
+  g->nr_data_channels = 1;
+  if (n <= 1)
+    return;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  r = guestfs_internal_set_data_channels (g, (int) n);
+  guestfs_pop_error_handler (g);
+
+  if (r >= 1 && (size_t) r <= n)
+    g->nr_data_channels = r;
+
+  debug (g, "launch: striping file transfers across %zu channels",
+         g->nr_data_channels);
+}
+
+/**
+ * Agree with the daemon to send chunks of zeroes as holes and to
+ * compress other chunks, in both directions.  This saves bandwidth
+ * when the appliance is remote, so it is done by default if the
+ * backend set C<g-E<gt>remote_appliance>, and can be forced on or
+ * off with the C<transfer_compression> backend setting.  As with
+ * C<negotiate_chunk_size>, older appliances don't implement this and
+ * we carry on sending plain chunks.
+ */
+static void
+negotiate_chunk_codec (guestfs_h *g)
+{
+  CLEANUP_FREE char *setting = NULL;
+  int enable, codecs, r;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  setting = guestfs_get_backend_setting (g, "transfer_compression");
+  guestfs_pop_error_handler (g);
+
+  if (setting == NULL || STREQ (setting, "auto"))
+    enable = g->remote_appliance;
+  else
+    enable = guestfs_int_is_true (setting) > 0;
+
+  g->chunk_codecs = 0;
+  if (!enable)
+    return;
+
+  codecs = guestfs_int_init_chunk_codecs (g,
+                                          GUESTFS_CODEC_ZERO|GUESTFS_CODEC_ZSTD);
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  r = guestfs_internal_set_chunk_codec (g, codecs);
+  guestfs_pop_error_handler (g);
+
+  if (r > 0)
+    g->chunk_codecs = r & codecs;
+
+  debug (g, "launch: file transfer chunk codecs are 0x%x",
+         (unsigned) g->chunk_codecs);
+}
+
+/**
+ * Return the number of virtio-serial channels (including the main
+ * daemon channel) that the backend should give the appliance.  This
+ * is controlled by the C<data_channels> backend setting and defaults
+ * to C<1>.  Returns C<-1> on error.
+ */
+int
+guestfs_int_get_nr_data_channels (guestfs_h *g)
+{
+  int n;
+
+  n = guestfs_int_get_backend_setting_int (g, "data_channels", 1);
+  if (n == -1)
+    return -1;
+  if (n < 1)
+    n = 1;
+  if (n > GUESTFS_MAX_DATA_CHANNELS)
+    n = GUESTFS_MAX_DATA_CHANNELS;
+
+  return n;
+}
+
+static int
+is_dir (const char *path)
+{
+  struct stat statbuf;
+
+  if (stat (path, &statbuf) == -1)
+    return 0;
+  return S_ISDIR (statbuf.st_mode);
+}
+
+/**
+ * Used by the backends to check that the C<network_bridge> backend
+ * setting names a bridge, or give a useful error message.
+ */
+int
+guestfs_int_check_bridge_exists (guestfs_h *g, const char *brname)
+{
+  CLEANUP_FREE char *path = NULL;
+
+  /* If this doesn't look like Linux, give up. */
+  if (!is_dir ("/sys/class/net"))
+    return 0;
+
+  /* Does the interface exist and is it a bridge? */
+  path = safe_asprintf (g, "/sys/class/net/%s/bridge", brname);
+  if (is_dir (path))
+    return 0;
+
+  error (g,
+         _("bridge '%s' not found.  Try running:\n"
+           "\n"
+           "  brctl show\n"
+           "\n"
+           "to get a list of bridges on the host, and then selecting the\n"
+           "bridge you wish the appliance network to connect to using:\n"
+           "\n"
+           "  export LIBGUESTFS_BACKEND_SETTINGS=network_bridge=<bridge name>\n"
+           "\n"
+           "You may also need to allow the bridge in /etc/qemu/bridge.conf.\n"
+           "For further information see guestfs(3)."),
+	 brname);
+  return -1;
+}
+
+/**
+ * Used by the backends to find out where the appliance should run,
+ * from the C<cpuset> and C<numa_node> backend settings.
+ *
+ * C<*cpus_ret> is set to the list of host CPUs (in the usual Linux
+ * format, eg. C<0-3,8>), or C<NULL> if the appliance may run on any
+ * CPU.  If only C<numa_node> is set, the CPUs of that node are used.
+ * C<*node_ret> is set to the NUMA node that guest memory should come
+ * from, or C<-1>.  Returns C<-1> on error.
+ */
+int
+guestfs_int_get_appliance_placement (guestfs_h *g,
+                                     char **cpus_ret, int *node_ret)
+{
+  CLEANUP_FREE char *cpuset = NULL;
+  int node, r;
+  size_t len;
+
+  *cpus_ret = NULL;
+  *node_ret = -1;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  cpuset = guestfs_get_backend_setting (g, "cpuset");
+  guestfs_pop_error_handler (g);
+  if (cpuset && strspn (cpuset, "0123456789,-") != strlen (cpuset)) {
+    error (g, _("could not parse backend setting cpuset=%s"), cpuset);
+    return -1;
+  }
+
+  node = guestfs_int_get_backend_setting_int (g, "numa_node", -2);
+  if (node == -1)
+    return -1;
+  if (node == -2)
+    node = -1;
+
+  if (node >= 0 && cpuset == NULL) {
+    CLEANUP_FREE char *path = NULL;
+
+    path = safe_asprintf (g, "/sys/devices/system/node/node%d/cpulist",
+                          node);
+    guestfs_push_error_handler (g, NULL, NULL);
+    r = guestfs_int_read_whole_file (g, path, &cpuset, NULL);
+    guestfs_pop_error_handler (g);
+    if (r == -1) {
+      error (g, _("numa_node=%d: no such NUMA node on this host"), node);
+      return -1;
+    }
+    len = strlen (cpuset);
+    while (len > 0 && c_isspace (cpuset[len-1]))
+      cpuset[--len] = '\0';
+    /* A node may have memory but no CPUs. */
+    if (len == 0) {
+      free (cpuset);
+      cpuset = NULL;
+    }
+  }
+
+  if (cpuset && STRNEQ (cpuset, "")) {
+    *cpus_ret = cpuset;
+    cpuset = NULL;
+  }
+  *node_ret = node;
+  return 0;
+}
+
+/**
+ * Count this appliance in C<nr_appliances>, and if automatic sizing
+ * was selected (see L<guestfs(3)/guestfs_set_sizing>), choose the
+ * number of vCPUs and the memory size of the appliance, unless the
+ * caller set them.
+ *
+ * The host CPUs are shared out between the appliances running in
+ * this process.  Bulk work (compression, checksums, copying, fsck)
+ * runs on all the vCPUs of the appliance, and needs some more memory
+ * for each one.  Metadata work (inspection, listing files) gains
+ * little from more than two vCPUs.  The appliances together never
+ * get more than a quarter of the host memory, but each one always
+ * gets at least the default memory size.
+ */
+static void
+auto_size_appliance (guestfs_h *g)
+{
+  long ncpus, pages, pagesize;
+  size_t n;
+  int smp, max_smp, memsize;
+  uint64_t host_memsize;
+
+  gl_lock_lock (nr_appliances_lock);
+  if (!g->appliance_counted) {
+    nr_appliances++;
+    g->appliance_counted = true;
+  }
+  n = nr_appliances;
+  gl_lock_unlock (nr_appliances_lock);
+
+  if (g->sizing == NULL)
+    return;
+
+  if (STREQ (g->sizing, "metadata"))
+    max_smp = 2;
+  else if (STREQ (g->sizing, "bulk"))
+    max_smp = 16;
+  else /* auto */
+    max_smp = 4;
+
+  ncpus = sysconf (_SC_NPROCESSORS_ONLN);
+  if (ncpus < 1)
+    ncpus = 1;
+  smp = ncpus / n;
+  if (smp > max_smp)
+    smp = max_smp;
+  if (smp < 1)
+    smp = 1;
+
+  memsize = DEFAULT_MEMSIZE;
+  if (STRNEQ (g->sizing, "metadata"))
+    memsize += 64 * (smp - 1);
+  pages = sysconf (_SC_PHYS_PAGES);
+  pagesize = sysconf (_SC_PAGESIZE);
+  if (pages > 0 && pagesize > 0) {
+    host_memsize = (uint64_t) pages * pagesize / (1024 * 1024);
+    if ((uint64_t) memsize > host_memsize / 4 / n)
+      memsize = host_memsize / 4 / n;
+  }
+  if (memsize < DEFAULT_MEMSIZE)
+    memsize = DEFAULT_MEMSIZE;
+
+  if (!g->smp_set)
+    g->smp = smp;
+  if (!g->memsize_set)
+    g->memsize = memsize;
+
+  debug (g, "launch: sizing=%s: %ld host CPUs, %zu appliances: smp=%d memsize=%d",
+         g->sizing, ncpus, n, g->smp, g->memsize);
+}
+
+/**
+ * Stop counting this appliance in C<nr_appliances>.  This is called
+ * when the appliance is shut down or fails to launch, and when the
+ * handle is closed.
+ */
+void
+guestfs_int_appliance_stopped (guestfs_h *g)
+{
+  if (!g->appliance_counted)
+    return;
+
+  gl_lock_lock (nr_appliances_lock);
+  nr_appliances--;
+  gl_lock_unlock (nr_appliances_lock);
+  g->appliance_counted = false;
+}
+
 /**
  * This function sends a launch progress message.
  *
@@ -163,6 +520,64 @@ guestfs_int_timeval_diff (const struct timeval *x, const struct timeval *y)
   return msec;
 }
 
+static const char *const launch_phase_names[NR_LAUNCH_PHASES] = {
+  [LAUNCH_PHASE_START] = "start",
+  [LAUNCH_PHASE_APPLIANCE] = "appliance",
+  [LAUNCH_PHASE_HYPERVISOR] = "hypervisor",
+  [LAUNCH_PHASE_KERNEL] = "kernel",
+  [LAUNCH_PHASE_INIT] = "init",
+  [LAUNCH_PHASE_UDEV] = "udev",
+  [LAUNCH_PHASE_DAEMON] = "daemon",
+};
+
+/**
+ * Record that launch has reached C<phase>, and send a
+ * C<GUESTFS_EVENT_LAUNCH_PHASE> event.  The message is the phase
+ * name followed by a space and the time in milliseconds since
+ * launch started.
+ */
+void
+guestfs_int_launch_phase (guestfs_h *g, enum launch_phase phase)
+{
+  struct timeval tv;
+  char buf[64];
+  int len;
+
+  /* Phases seen from console messages may be printed again, eg. by
+   * virt-rescue.  Only record the first time.
+   */
+  if (g->launch_phases[phase] >= 0)
+    return;
+
+  gettimeofday (&tv, NULL);
+  g->launch_phases[phase] = guestfs_int_timeval_diff (&g->launch_t, &tv);
+
+  len = snprintf (buf, sizeof buf, "%s %" PRIi64,
+                  launch_phase_names[phase], g->launch_phases[phase]);
+  guestfs_int_call_callbacks_message (g, GUESTFS_EVENT_LAUNCH_PHASE,
+                                      buf, len);
+}
+
+/**
+ * Implements L<guestfs(3)/guestfs_get_launch_stats>.
+ */
+char **
+guestfs_impl_get_launch_stats (guestfs_h *g)
+{
+  DECLARE_STRINGSBUF (ret);
+  size_t i;
+
+  for (i = 0; i < NR_LAUNCH_PHASES; ++i) {
+    if (g->launch_phases[i] >= 0) {
+      guestfs_int_add_string (g, &ret, launch_phase_names[i]);
+      guestfs_int_add_sprintf (g, &ret, "%" PRIi64, g->launch_phases[i]);
+    }
+  }
+  guestfs_int_end_stringsbuf (g, &ret);
+
+  return ret.argv;              /* caller frees */
+}
+
 int
 guestfs_impl_get_pid (guestfs_h *g)
 {
@@ -307,6 +722,41 @@ guestfs_int_create_socketname (guestfs_h *g, const char *filename,
   return 0;
 }
 
+/**
+ * Create a Unix domain socket bound to C<sockpath> and listen on it.
+ * Returns the socket, or C<-1> on error.
+ */
+int
+guestfs_int_create_listening_socket (guestfs_h *g, const char *sockpath)
+{
+  int sock;
+  struct sockaddr_un addr;
+
+  sock = socket (AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+  if (sock == -1) {
+    perrorf (g, "socket");
+    return -1;
+  }
+
+  addr.sun_family = AF_UNIX;
+  strncpy (addr.sun_path, sockpath, UNIX_PATH_MAX);
+  addr.sun_path[UNIX_PATH_MAX-1] = '\0';
+
+  if (bind (sock, (struct sockaddr *) &addr, sizeof addr) == -1) {
+    perrorf (g, "bind");
+    close (sock);
+    return -1;
+  }
+
+  if (listen (sock, 1) == -1) {
+    perrorf (g, "listen");
+    close (sock);
+    return -1;
+  }
+
+  return sock;
+}
+
 /**
  * When the library is loaded, each backend calls this function to
  * register itself in a global list.
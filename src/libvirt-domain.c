@@ -92,6 +92,10 @@ guestfs_impl_add_domain (guestfs_h *g, const char *domain_name,
   copyonread = optargs->bitmask & GUESTFS_ADD_DOMAIN_COPYONREAD_BITMASK
     ? optargs->copyonread : false;
 
+  labels =
+    optargs->bitmask & GUESTFS_ADD_LIBVIRT_DOM_LABELS_BITMASK
+    ? optargs->labels : false;
+
   if (live && readonly) {
     error (g, _("you cannot set both live and readonly flags"));
     return -1;
@@ -182,6 +186,8 @@ enum readonlydisk {
 struct add_disk_data {
   int readonly;
   enum readonlydisk readonlydisk;
+  bool labels;
+  struct stringsbuf added;      /* labels of the disks added so far */
   /* Other args to pass through to add_drive_opts. */
   struct guestfs_add_drive_opts_argv optargs;
 };
@@ -197,6 +203,7 @@ guestfs_impl_add_libvirt_dom (guestfs_h *g, void *domvp,
   const char *cachemode;
   const char *discard;
   bool copyonread;
+  bool labels;
   int live;
   /* Default for back-compat reasons: */
   enum readonlydisk readonlydisk = readonlydisk_write;
@@ -299,6 +306,9 @@ guestfs_impl_add_libvirt_dom (guestfs_h *g, void *domvp,
   data.optargs.bitmask = 0;
   data.readonly = readonly;
   data.readonlydisk = readonlydisk;
+  data.labels = labels;
+  data.added.argv = NULL;
+  data.added.size = data.added.alloc = 0;
   if (iface) {
     data.optargs.bitmask |= GUESTFS_ADD_DRIVE_OPTS_IFACE_BITMASK;
     data.optargs.iface = iface;
@@ -320,13 +330,53 @@ guestfs_impl_add_libvirt_dom (guestfs_h *g, void *domvp,
    * all disks are added or none are added.
    */
   ckp = guestfs_int_checkpoint_drives (g);
+  /* When hotplugging, wait for all the disks to appear in the
+   * appliance at the end, instead of after each disk.
+   */
+  g->hotplug_defer_wait = g->state != CONFIG;
   r = for_each_disk (g, virDomainGetConnect (dom), doc, add_disk, &data);
-  if (r == -1)
-    guestfs_int_rollback_drives (g, ckp);
+  g->hotplug_defer_wait = false;
+  guestfs_int_end_stringsbuf (g, &data.added);
+  if (r != -1 && g->state != CONFIG) {
+    if (guestfs_internal_hot_add_drives (g, data.added.argv) == -1)
+      r = -1;
+  }
+  if (r == -1) {
+    if (g->state == CONFIG)
+      guestfs_int_rollback_drives (g, ckp);
+    else {
+      /* The disks added so far have been hotplugged, so they have to
+       * be hot-unplugged again.
+       */
+      guestfs_push_error_handler (g, NULL, NULL);
+      guestfs_remove_drives (g, data.added.argv);
+      guestfs_pop_error_handler (g);
+    }
+  }
+  guestfs_int_free_stringsbuf (&data.added);
 
   return r;
 }
 
+/* Return a disk label which is not used by any drive in the handle. */
+static char *
+make_disk_label (guestfs_h *g)
+{
+  char label[32] = "libvirt";
+  struct drive *drv;
+  size_t n, i;
+
+  for (n = 0;; ++n) {
+    guestfs_int_drive_name (n, &label[7]);
+    ITER_DRIVES (g, i, drv) {
+      if (drv->disk_label && STREQ (drv->disk_label, label))
+        goto next;
+    }
+    return safe_strdup (g, label);
+  next: ;
+  }
+}
+
 static int
 add_disk (guestfs_h *g,
           const char *filename, const char *format, int readonly_in_xml,
@@ -337,6 +387,7 @@ add_disk (guestfs_h *g,
   /* Copy whole struct so we can make local changes: */
   struct guestfs_add_drive_opts_argv optargs = data->optargs;
   int readonly = -1, error = 0, skip = 0;
+  char *label = NULL;
 
   if (readonly_in_xml) {        /* <readonly/> appears in the XML */
     if (data->readonly) {       /* asked to add disk read-only */
@@ -392,8 +443,20 @@ add_disk (guestfs_h *g,
     optargs.bitmask |= GUESTFS_ADD_DRIVE_OPTS_SECRET_BITMASK;
     optargs.secret = secret;
   }
+  if (data->labels) {
+    label = make_disk_label (g);
+    optargs.bitmask |= GUESTFS_ADD_DRIVE_OPTS_LABEL_BITMASK;
+    optargs.label = label;
+  }
 
-  return guestfs_add_drive_opts_argv (g, filename, &optargs);
+  if (guestfs_add_drive_opts_argv (g, filename, &optargs) == -1) {
+    free (label);
+    return -1;
+  }
+  if (label)
+    guestfs_int_add_string_nodup (g, &data->added, label);
+
+  return 0;
 }
 
 /* Find the <seclabel/> element in the libvirt XML, and if it exists
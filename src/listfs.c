@@ -144,6 +144,63 @@ remove_from_list (char **list, const char *item)
     }
 }
 
+/* Add the subvolumes of the btrfs filesystem on 'device' to the
+ * 'ret' string list, apart from the default subvolume which we get by
+ * simply mounting the whole device.  btrfs_inventory gets them all in
+ * one call, but older appliances may not support it.
+ */
+static int
+add_btrfs_subvolumes (guestfs_h *g, const char *device, struct stringsbuf *sb)
+{
+  CLEANUP_FREE_BTRFSINVENTORY_LIST struct guestfs_btrfsinventory_list *inv;
+  size_t i;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  inv = guestfs_btrfs_inventory (g, device);
+  guestfs_pop_error_handler (g);
+
+  if (inv != NULL) {
+    for (i = 0; i < inv->len; ++i) {
+      const struct guestfs_btrfsinventory *this = &inv->val[i];
+
+      if (this->btrfsinventory_default)
+        continue;
+
+      guestfs_int_add_sprintf (g, sb,
+                               "btrfsvol:%s/%s",
+                               device, this->btrfsinventory_path);
+      guestfs_int_add_string (g, sb, "btrfs");
+    }
+    return 0;
+  }
+
+  CLEANUP_FREE_BTRFSSUBVOLUME_LIST struct guestfs_btrfssubvolume_list *vols =
+    guestfs_btrfs_subvolume_list (g, device);
+
+  if (vols == NULL)
+    return -1;
+
+  const int64_t default_volume =
+    guestfs_btrfs_subvolume_get_default (g, device);
+
+  for (i = 0; i < vols->len; i++) {
+    struct guestfs_btrfssubvolume *this = &vols->val[i];
+
+    /* Ignore the default subvolume.  We get it by simply mounting
+     * the whole device of this btrfs filesystem.
+     */
+    if (this->btrfssubvolume_id == (uint64_t) default_volume)
+      continue;
+
+    guestfs_int_add_sprintf (g, sb,
+                             "btrfsvol:%s/%s",
+                             device, this->btrfssubvolume_path);
+    guestfs_int_add_string (g, sb, "btrfs");
+  }
+
+  return 0;
+}
+
 /* Use vfs-type to look for a filesystem of some sort on 'dev'.
  * Apart from some types which we ignore, add the result to the
  * 'ret' string list.
@@ -163,30 +220,9 @@ check_with_vfs_type (guestfs_h *g, const char *device, struct stringsbuf *sb)
   else if (STREQ (vfs_type, ""))
     v = "unknown";
   else if (STREQ (vfs_type, "btrfs")) {
-    CLEANUP_FREE_BTRFSSUBVOLUME_LIST struct guestfs_btrfssubvolume_list *vols =
-      guestfs_btrfs_subvolume_list (g, device);
-
-    if (vols == NULL)
+    if (add_btrfs_subvolumes (g, device, sb) == -1)
       return -1;
 
-    const int64_t default_volume =
-      guestfs_btrfs_subvolume_get_default (g, device);
-
-    for (size_t i = 0; i < vols->len; i++) {
-      struct guestfs_btrfssubvolume *this = &vols->val[i];
-
-      /* Ignore the default subvolume.  We get it by simply mounting
-       * the whole device of this btrfs filesystem.
-       */
-      if (this->btrfssubvolume_id == (uint64_t) default_volume)
-        continue;
-
-      guestfs_int_add_sprintf (g, sb,
-			       "btrfsvol:%s/%s",
-			       device, this->btrfssubvolume_path);
-      guestfs_int_add_string (g, sb, "btrfs");
-    }
-
     v = vfs_type;
   }
   else {
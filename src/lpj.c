@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
@@ -39,7 +40,10 @@
  *
  * Notes:
  *
- * - We only try to calculate lpj once.
+ * - We only try to calculate lpj once per process.  The result
+ *   (even if it could not be calculated) is also saved in the
+ *   cache directory with the host boot ID, so that short-lived
+ *   processes don't have to run dmesg and grep every time.
  *
  * - Trying to calculate lpj must not fail.  If the return value is
  *   <= 0, it is ignored by the caller.
@@ -52,6 +56,9 @@
 
 gl_lock_define_initialized (static, lpj_lock);
 static int lpj = 0;
+static int read_lpj_from_cache (guestfs_h *g, const char *cachefile, const char *boot_id);
+static void write_lpj_to_cache (guestfs_h *g, const char *cachefile, const char *boot_id, int lpj);
+static char *read_boot_id (guestfs_h *g);
 static int read_lpj_from_dmesg (guestfs_h *g);
 static int read_lpj_from_files (guestfs_h *g);
 static int read_lpj_common (guestfs_h *g, const char *func, struct command *cmd);
@@ -60,11 +67,27 @@ int
 guestfs_int_get_lpj (guestfs_h *g)
 {
   int r;
+  CLEANUP_FREE char *boot_id = NULL, *cachedir = NULL, *cachefile = NULL;
 
   gl_lock_lock (lpj_lock);
   if (lpj != 0)
     goto out;
 
+  boot_id = read_boot_id (g);
+  if (boot_id) {
+    guestfs_push_error_handler (g, NULL, NULL);
+    cachedir = guestfs_int_lazy_make_supermin_appliance_dir (g);
+    guestfs_pop_error_handler (g);
+    if (cachedir) {
+      cachefile = safe_asprintf (g, "%s/lpj", cachedir);
+      r = read_lpj_from_cache (g, cachefile, boot_id);
+      if (r != 0) {
+        lpj = r;
+        goto out;
+      }
+    }
+  }
+
   /* Try reading lpj from these sources:
    * - /proc/cpuinfo [in future]
    * - dmesg
@@ -73,17 +96,102 @@ guestfs_int_get_lpj (guestfs_h *g)
    *   + /var/log/boot.msg
    */
   r = read_lpj_from_dmesg (g);
-  if (r > 0) {
-    lpj = r;
-    goto out;
-  }
-  lpj = read_lpj_from_files (g);
+  if (r <= 0)
+    r = read_lpj_from_files (g);
+  lpj = r > 0 ? r : -1;
+
+  if (cachefile)
+    write_lpj_to_cache (g, cachefile, boot_id, lpj);
 
  out:
   gl_lock_unlock (lpj_lock);
   return lpj;
 }
 
+#define BOOT_ID_FILE "/proc/sys/kernel/random/boot_id"
+
+/* The boot ID changes every time the host boots, so it also covers
+ * booting a different host kernel.  Returns NULL if it is not
+ * available, in which case we don't use the cache.
+ */
+static char *
+read_boot_id (guestfs_h *g)
+{
+  FILE *fp;
+  char buf[64];
+  size_t len;
+
+  fp = fopen (BOOT_ID_FILE, "re");
+  if (fp == NULL) {
+    debug (g, "%s: %s: %m", __func__, BOOT_ID_FILE);
+    return NULL;
+  }
+  if (fgets (buf, sizeof buf, fp) == NULL) {
+    fclose (fp);
+    return NULL;
+  }
+  fclose (fp);
+
+  len = strcspn (buf, "\n");
+  if (len == 0)
+    return NULL;
+  return safe_strndup (g, buf, len);
+}
+
+/* The cache file contains "<boot_id> <lpj>".  A negative lpj means
+ * that we could not calculate it on this boot.  Returns 0 if there
+ * is no cached value for this boot.
+ */
+static int
+read_lpj_from_cache (guestfs_h *g, const char *cachefile, const char *boot_id)
+{
+  FILE *fp;
+  char id[64];
+  int r;
+
+  fp = fopen (cachefile, "re");
+  if (fp == NULL)
+    return 0;
+  if (fscanf (fp, "%63s %d", id, &r) != 2 || STRNEQ (id, boot_id) ||
+      r == 0) {
+    fclose (fp);
+    return 0;
+  }
+  fclose (fp);
+
+  debug (g, "%s: cached lpj=%d", __func__, r);
+  return r;
+}
+
+static void
+write_lpj_to_cache (guestfs_h *g, const char *cachefile, const char *boot_id,
+                    int r)
+{
+  CLEANUP_FREE char *tmpfile = safe_asprintf (g, "%s.XXXXXX", cachefile);
+  FILE *fp;
+  int fd;
+
+  /* Write a temporary file and rename it, so that other processes
+   * never see a partial file.
+   */
+  fd = mkstemp (tmpfile);
+  if (fd == -1) {
+    debug (g, "%s: mkstemp: %s: %m", __func__, tmpfile);
+    return;
+  }
+  fp = fdopen (fd, "w");
+  if (fp == NULL) {
+    close (fd);
+    unlink (tmpfile);
+    return;
+  }
+  fprintf (fp, "%s %d\n", boot_id, r);
+  if (fclose (fp) == EOF || rename (tmpfile, cachefile) == -1) {
+    debug (g, "%s: %s: %m", __func__, cachefile);
+    unlink (tmpfile);
+  }
+}
+
 /* Grep the output, and print just the matching string "lpj=NNN". */
 #define GREP_FLAGS "-Eoh"
 #define GREP_REGEX "lpj=[[:digit:]]+"
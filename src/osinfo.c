@@ -41,6 +41,12 @@
  * and keep them cached.  They are only read at all if someone tries
  * to inspect a CD/DVD/ISO.
  *
+ * (6) Since parsing the XML files is slow, the records (including the
+ * compiled regular expressions) are also saved in a binary file in
+ * the appliance cache directory, and later processes mmap that
+ * instead.  It is rebuilt when the mtime of any osinfo directory
+ * changes.
+ *
  * XXX Currently the database is not freed when the program exits /
  * library is unloaded, although we should probably do that.
  */
@@ -49,18 +55,24 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <dirent.h>
 #include <assert.h>
 #include <sys/types.h>
 #include <libintl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 
 #include <libxml/parser.h>
 #include <libxml/xpath.h>
 
 #include "ignore-value.h"
+#include "full-write.h"
 #include "glthread/lock.h"
 #include "c-ctype.h"
 
@@ -71,6 +83,11 @@ gl_lock_define_initialized (static, osinfo_db_lock);
 static ssize_t osinfo_db_size = 0; /* 0 = unread, -1 = error, >= 1 = #records */
 static struct osinfo *osinfo_db = NULL;
 
+/* If the database was loaded from the binary cache file, the strings
+ * and regular expressions in osinfo_db point into this mapping.
+ */
+static void *osinfo_db_map = NULL;
+
 static int read_osinfo_db (guestfs_h *g);
 static void free_osinfo_db_entry (struct osinfo *);
 
@@ -158,18 +175,76 @@ guestfs_int_osinfo_map (guestfs_h *g, const struct guestfs_isoinfo *isoinfo,
  */
 static int read_osinfo_db_xml (guestfs_h *g, const char *filename);
 
+static int scan_osinfo_db (guestfs_h *g);
 static int read_osinfo_db_flat (guestfs_h *g, const char *directory);
 static int read_osinfo_db_three_levels (guestfs_h *g, const char *directory);
 static int read_osinfo_db_directory (guestfs_h *g, const char *directory);
+static char *get_osinfo_db_cache_file (guestfs_h *g);
+static int load_osinfo_db_cache (guestfs_h *g, const char *filename, uint64_t stamp);
+static void save_osinfo_db_cache (guestfs_h *g, const char *filename, uint64_t stamp);
+
+/* When scan_stamp_only is set, scan_osinfo_db only finds the
+ * directories which would be read, and combines their names and
+ * mtimes into scan_stamp, without parsing any XML.
+ */
+static bool scan_stamp_only = false;
+static uint64_t scan_stamp;
 
 static int
 read_osinfo_db (guestfs_h *g)
 {
+  CLEANUP_FREE char *cache_file = NULL;
+  uint64_t stamp;
   int r;
   size_t i;
 
   assert (osinfo_db_size == 0);
 
+  scan_stamp_only = true;
+  scan_stamp = 0;
+  r = scan_osinfo_db (g);
+  scan_stamp_only = false;
+  if (r == -1)
+    goto error;
+  if (r == 0)                   /* Nothing found. */
+    return 0;
+  stamp = scan_stamp;
+
+  cache_file = get_osinfo_db_cache_file (g);
+  if (cache_file && load_osinfo_db_cache (g, cache_file, stamp) == 0)
+    return 0;
+
+  r = scan_osinfo_db (g);
+  if (r == -1)
+    goto error;
+
+  if (cache_file && osinfo_db_size > 0)
+    save_osinfo_db_cache (g, cache_file, stamp);
+
+  return 0;
+
+ error:
+  /* Fatal error: free any database entries which have been read, and
+   * mark the database as having a permanent error.
+   */
+  assert (osinfo_db_map == NULL);
+  if (osinfo_db_size > 0) {
+    for (i = 0; i < (size_t) osinfo_db_size; ++i)
+      free_osinfo_db_entry (&osinfo_db[i]);
+  }
+  free (osinfo_db);
+  osinfo_db = NULL;
+  osinfo_db_size = -1;
+
+  return -1;
+}
+
+/* Returns -1 on error, 1 if a database was found, or 0 if not. */
+static int
+scan_osinfo_db (guestfs_h *g)
+{
+  int r;
+
   /* (1) Try the shared osinfo directory, using either the
    * $OSINFO_SYSTEM_DIR envvar or its default value.
    */
@@ -183,51 +258,54 @@ read_osinfo_db (guestfs_h *g)
     os_path = safe_asprintf (g, "%s/os", path);
     r = read_osinfo_db_three_levels (g, os_path);
   }
-  if (r == -1)
-    goto error;
-  else if (r == 1)
-    return 0;
+  if (r != 0)
+    return r;
 
   /* (2) Try the libosinfo directory, using the newer three-directory
    * layout ($LIBOSINFO_DB_PATH / "os" / $group-ID / [file.xml]).
    */
   r = read_osinfo_db_three_levels (g, LIBOSINFO_DB_PATH "/os");
-  if (r == -1)
-    goto error;
-  else if (r == 1)
-    return 0;
+  if (r != 0)
+    return r;
 
   /* (3) Try the libosinfo directory, using the old flat directory
    * layout ($LIBOSINFO_DB_PATH / "oses" / [file.xml]).
    */
-  r = read_osinfo_db_flat (g, LIBOSINFO_DB_PATH "/oses");
-  if (r == -1)
-    goto error;
-  else if (r == 1)
-    return 0;
+  return read_osinfo_db_flat (g, LIBOSINFO_DB_PATH "/oses");
+}
 
-  /* Nothing found. */
-  return 0;
+/* Add a directory which is read to scan_stamp.  The stamps of the
+ * directories are summed so that the order of readdir does not
+ * matter.
+ */
+static void
+add_to_stamp (const char *directory, DIR *dir)
+{
+  struct stat statbuf;
+  uint64_t h = UINT64_C (0xcbf29ce484222325);
+  uint64_t v[3];
+  const unsigned char *p;
+  size_t i;
 
- error:
-  /* Fatal error: free any database entries which have been read, and
-   * mark the database as having a permanent error.
-   */
-  if (osinfo_db_size > 0) {
-    for (i = 0; i < (size_t) osinfo_db_size; ++i)
-      free_osinfo_db_entry (&osinfo_db[i]);
-  }
-  free (osinfo_db);
-  osinfo_db = NULL;
-  osinfo_db_size = -1;
+  if (fstat (dirfd (dir), &statbuf) == -1)
+    memset (&statbuf, 0, sizeof statbuf);
+  v[0] = statbuf.st_mtim.tv_sec;
+  v[1] = statbuf.st_mtim.tv_nsec;
+  v[2] = statbuf.st_ino;
 
-  return -1;
+  for (p = (const unsigned char *) directory; *p; ++p)
+    h = (h ^ *p) * UINT64_C (0x100000001b3);
+  for (p = (const unsigned char *) v, i = 0; i < sizeof v; ++i)
+    h = (h ^ p[i]) * UINT64_C (0x100000001b3);
+
+  scan_stamp += h;
 }
 
 static int
 read_osinfo_db_flat (guestfs_h *g, const char *directory)
 {
-  debug (g, "osinfo: loading flat database from %s", directory);
+  if (!scan_stamp_only)
+    debug (g, "osinfo: loading flat database from %s", directory);
 
   return read_osinfo_db_directory (g, directory);
 }
@@ -244,7 +322,10 @@ read_osinfo_db_three_levels (guestfs_h *g, const char *directory)
     return 0; /* This is not an error: RHBZ#948324. */
   }
 
-  debug (g, "osinfo: loading 3-level-directories database from %s", directory);
+  add_to_stamp (directory, dir);
+  if (!scan_stamp_only)
+    debug (g, "osinfo: loading 3-level-directories database from %s",
+           directory);
 
   for (;;) {
     struct dirent *d;
@@ -300,6 +381,12 @@ read_osinfo_db_directory (guestfs_h *g, const char *directory)
     return 0; /* This is not an error: RHBZ#948324. */
   }
 
+  add_to_stamp (directory, dir);
+  if (scan_stamp_only) {
+    closedir (dir);
+    return 1;
+  }
+
   for (;;) {
     struct dirent *d;
 
@@ -340,6 +427,260 @@ read_osinfo_db_directory (guestfs_h *g, const char *directory)
   return -1;
 }
 
+/* The binary cache file is a header, followed by an array of records,
+ * followed by the strings and compiled regular expressions which the
+ * records point to (as offsets from the start of the file).  Compiled
+ * PCRE patterns can be used directly from memory, but only by the
+ * same version of PCRE on the same architecture, so the PCRE version
+ * is recorded in the header.
+ */
+#define OSINFO_DB_MAGIC "GFOSDB01"
+
+struct osinfo_db_header {
+  char magic[8];
+  uint64_t stamp;               /* scan_stamp of the XML directories. */
+  char pcre_version[64];
+  uint32_t nr_records;
+  uint32_t record_size;
+};
+
+struct osinfo_db_record {
+  int32_t type, distro;
+  int32_t major_version, minor_version;
+  int32_t is_live_disk, is_installer;
+  uint32_t product_name, arch;  /* Offsets of strings, or 0 for NULL. */
+  uint32_t re[4];               /* Offsets of compiled patterns, or 0. */
+};
+
+static char *
+get_osinfo_db_cache_file (guestfs_h *g)
+{
+  CLEANUP_FREE char *cachedir = NULL;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  cachedir = guestfs_int_lazy_make_supermin_appliance_dir (g);
+  guestfs_pop_error_handler (g);
+  if (cachedir == NULL)
+    return NULL;
+
+  return safe_asprintf (g, "%s/osinfo.db", cachedir);
+}
+
+static pcre **
+get_re (struct osinfo *osinfo, size_t i)
+{
+  switch (i) {
+  case 0: return &osinfo->re_system_id;
+  case 1: return &osinfo->re_volume_id;
+  case 2: return &osinfo->re_publisher_id;
+  case 3: return &osinfo->re_application_id;
+  default: abort ();
+  }
+}
+
+/* Returns 0 if the database was loaded, or -1 if the cache file is
+ * missing or out of date (not an error).
+ */
+static int
+load_osinfo_db_cache (guestfs_h *g, const char *filename, uint64_t stamp)
+{
+  int fd;
+  struct stat statbuf;
+  void *map;
+  const char *base;
+  const struct osinfo_db_header *hdr;
+  const struct osinfo_db_record *rec;
+  struct osinfo *db;
+  size_t i, j, size;
+  int r;
+
+  fd = open (filename, O_RDONLY|O_CLOEXEC);
+  if (fd == -1)
+    return -1;
+  if (fstat (fd, &statbuf) == -1 ||
+      (size_t) statbuf.st_size < sizeof *hdr) {
+    close (fd);
+    return -1;
+  }
+  size = statbuf.st_size;
+  map = mmap (NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (map == MAP_FAILED)
+    return -1;
+
+  base = map;
+  hdr = map;
+  if (memcmp (hdr->magic, OSINFO_DB_MAGIC, 8) != 0 ||
+      hdr->stamp != stamp ||
+      strncmp (hdr->pcre_version, pcre_version (),
+               sizeof hdr->pcre_version) != 0 ||
+      hdr->record_size != sizeof *rec ||
+      hdr->nr_records == 0 ||
+      hdr->nr_records > (size - sizeof *hdr) / sizeof *rec) {
+    debug (g, "osinfo: %s is out of date", filename);
+    goto fail;
+  }
+
+  db = safe_calloc (g, hdr->nr_records, sizeof (struct osinfo));
+  rec = (const struct osinfo_db_record *) (base + sizeof *hdr);
+  for (i = 0; i < hdr->nr_records; ++i, ++rec) {
+    db[i].type = rec->type;
+    db[i].distro = rec->distro;
+    db[i].major_version = rec->major_version;
+    db[i].minor_version = rec->minor_version;
+    db[i].is_live_disk = rec->is_live_disk;
+    db[i].is_installer = rec->is_installer;
+
+    if ((rec->product_name &&
+         (rec->product_name >= size ||
+          memchr (base + rec->product_name, 0,
+                  size - rec->product_name) == NULL)) ||
+        (rec->arch &&
+         (rec->arch >= size ||
+          memchr (base + rec->arch, 0, size - rec->arch) == NULL)))
+      goto corrupt;
+    db[i].product_name = rec->product_name ?
+      (char *) base + rec->product_name : NULL;
+    db[i].arch = rec->arch ? (char *) base + rec->arch : NULL;
+
+    for (j = 0; j < 4; ++j) {
+      pcre *re;
+      size_t re_size;
+
+      if (rec->re[j] == 0)
+        continue;
+      if (rec->re[j] % 8 != 0 || rec->re[j] >= size)
+        goto corrupt;
+      /* pcre_fullinfo checks the magic number of the pattern. */
+      re = (pcre *) (base + rec->re[j]);
+      r = pcre_fullinfo (re, NULL, PCRE_INFO_SIZE, &re_size);
+      if (r != 0 || re_size > size - rec->re[j])
+        goto corrupt;
+      *get_re (&db[i], j) = re;
+    }
+  }
+
+  debug (g, "osinfo: loaded %" PRIu32 " records from %s",
+         hdr->nr_records, filename);
+  osinfo_db = db;
+  osinfo_db_size = hdr->nr_records;
+  osinfo_db_map = map;
+  return 0;
+
+ corrupt:
+  debug (g, "osinfo: %s is corrupt", filename);
+  free (db);
+ fail:
+  munmap (map, size);
+  return -1;
+}
+
+struct buffer {
+  char *data;
+  size_t len;
+};
+
+/* Append 'len' bytes to the buffer, aligned to 8 bytes, and return
+ * the offset.
+ */
+static uint32_t
+append (guestfs_h *g, struct buffer *buf, const void *data, size_t len)
+{
+  const size_t offset = (buf->len + 7) & ~(size_t) 7;
+
+  buf->data = safe_realloc (g, buf->data, offset + len);
+  memset (buf->data + buf->len, 0, offset - buf->len);
+  memcpy (buf->data + offset, data, len);
+  buf->len = offset + len;
+  return offset;
+}
+
+static void
+save_osinfo_db_cache (guestfs_h *g, const char *filename, uint64_t stamp)
+{
+  struct buffer buf = { .data = NULL, .len = 0 };
+  struct osinfo_db_header hdr;
+  struct osinfo_db_record *rec;
+  CLEANUP_FREE char *tmpfile = NULL;
+  size_t i, j, re_size;
+  int fd;
+
+  memset (&hdr, 0, sizeof hdr);
+  memcpy (hdr.magic, OSINFO_DB_MAGIC, 8);
+  hdr.stamp = stamp;
+  strncpy (hdr.pcre_version, pcre_version (), sizeof hdr.pcre_version - 1);
+  hdr.nr_records = osinfo_db_size;
+  hdr.record_size = sizeof *rec;
+  append (g, &buf, &hdr, sizeof hdr);
+
+  /* Reserve space for the records, then fill them in. */
+  buf.data = safe_realloc (g, buf.data, buf.len + osinfo_db_size * sizeof *rec);
+  memset (buf.data + buf.len, 0, osinfo_db_size * sizeof *rec);
+  buf.len += osinfo_db_size * sizeof *rec;
+
+  for (i = 0; i < (size_t) osinfo_db_size; ++i) {
+    struct osinfo *osinfo = &osinfo_db[i];
+    struct osinfo_db_record r;
+
+    memset (&r, 0, sizeof r);
+    r.type = osinfo->type;
+    r.distro = osinfo->distro;
+    r.major_version = osinfo->major_version;
+    r.minor_version = osinfo->minor_version;
+    r.is_live_disk = osinfo->is_live_disk;
+    r.is_installer = osinfo->is_installer;
+    if (osinfo->product_name)
+      r.product_name = append (g, &buf, osinfo->product_name,
+                               strlen (osinfo->product_name) + 1);
+    if (osinfo->arch)
+      r.arch = append (g, &buf, osinfo->arch, strlen (osinfo->arch) + 1);
+    for (j = 0; j < 4; ++j) {
+      const pcre *re = *get_re (osinfo, j);
+
+      if (re == NULL)
+        continue;
+      if (pcre_fullinfo (re, NULL, PCRE_INFO_SIZE, &re_size) != 0)
+        goto out;
+      r.re[j] = append (g, &buf, re, re_size);
+    }
+
+    rec = (struct osinfo_db_record *) (buf.data + sizeof hdr) + i;
+    memcpy (rec, &r, sizeof r);
+  }
+
+  if (buf.len > UINT32_MAX)
+    goto out;
+
+  /* Write it atomically, in case another process is reading it. */
+  tmpfile = safe_asprintf (g, "%s.%d", filename, getpid ());
+  fd = open (tmpfile, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+  if (fd == -1) {
+    debug (g, "osinfo: open: %s: %m", tmpfile);
+    goto out;
+  }
+  if (full_write (fd, buf.data, buf.len) != buf.len) {
+    debug (g, "osinfo: write: %s: %m", tmpfile);
+    close (fd);
+    unlink (tmpfile);
+    goto out;
+  }
+  if (close (fd) == -1) {
+    debug (g, "osinfo: close: %s: %m", tmpfile);
+    unlink (tmpfile);
+    goto out;
+  }
+  if (rename (tmpfile, filename) == -1) {
+    debug (g, "osinfo: rename: %s: %m", filename);
+    unlink (tmpfile);
+    goto out;
+  }
+
+  debug (g, "osinfo: saved %zd records to %s", osinfo_db_size, filename);
+
+ out:
+  free (buf.data);
+}
+
 static int read_iso_node (guestfs_h *g, xmlNodePtr iso_node, struct osinfo *osinfo);
 static int read_media_node (guestfs_h *g, xmlXPathContextPtr xpathCtx, xmlNodePtr media_node, struct osinfo *osinfo);
 static int read_os_node (guestfs_h *g, xmlXPathContextPtr xpathCtx, xmlNodePtr os_node, struct osinfo *osinfo);
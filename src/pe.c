@@ -0,0 +1,250 @@
+/* libguestfs
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * Read a single resource from a Windows PE executable in the guest.
+ *
+ * Only the headers, the few resource directories on the way to the
+ * resource, and the resource data itself are read, using
+ * L<guestfs(3)/guestfs_pread>.  The rest of the executable is never
+ * transferred from the appliance.  This replaces running
+ * L<wrestool(1)> on a downloaded copy of the whole file.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "guestfs.h"
+#include "guestfs-internal.h"
+
+/* Limit on the size of the PE headers plus section table. */
+#define MAX_HEADERS_SIZE 65536
+
+/* Limit on the number of entries in one resource directory. */
+#define MAX_DIR_ENTRIES 4096
+
+struct pe {
+  const char *filename;
+  const unsigned char *sections;  /* section table */
+  size_t nr_sections;
+  uint32_t rsrc_offset;           /* file offset of resource section */
+};
+
+static uint16_t
+get16 (const unsigned char *p)
+{
+  return p[0] | p[1] << 8;
+}
+
+static uint32_t
+get32 (const unsigned char *p)
+{
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+/* Read exactly 'count' bytes at 'offset'.  Returns NULL (and nothing
+ * is in the handle error) if the file is too short.
+ */
+static unsigned char *
+read_at (guestfs_h *g, const char *filename, int64_t offset, size_t count)
+{
+  char *buf;
+  size_t size;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  buf = guestfs_pread (g, filename, count, offset, &size);
+  guestfs_pop_error_handler (g);
+  if (buf == NULL)
+    return NULL;
+  if (size != count) {
+    free (buf);
+    return NULL;
+  }
+  return (unsigned char *) buf;
+}
+
+/* Map a relative virtual address to an offset in the file. */
+static int64_t
+rva_to_offset (const struct pe *pe, uint32_t rva)
+{
+  size_t i;
+
+  for (i = 0; i < pe->nr_sections; ++i) {
+    const unsigned char *s = pe->sections + 40*i;
+    const uint32_t vsize = get32 (s + 8);
+    const uint32_t vaddr = get32 (s + 12);
+    const uint32_t rawsize = get32 (s + 16);
+    const uint32_t rawptr = get32 (s + 20);
+    const uint32_t size = vsize > rawsize ? vsize : rawsize;
+
+    if (rva >= vaddr && rva - vaddr < size)
+      return (int64_t) rawptr + (rva - vaddr);
+  }
+
+  return -1;
+}
+
+/* Find the entry with numeric 'id' in the resource directory at
+ * 'offset' (relative to the start of the resource section), or the
+ * first entry if 'id' is -1.  Returns the OffsetToData field, or -1
+ * if not found.
+ */
+static int64_t
+find_dir_entry (guestfs_h *g, const struct pe *pe, uint32_t offset, int id)
+{
+  CLEANUP_FREE unsigned char *dir = NULL;
+  CLEANUP_FREE unsigned char *entries = NULL;
+  size_t i, nr_named, nr_ids;
+
+  dir = read_at (g, pe->filename, (int64_t) pe->rsrc_offset + offset, 16);
+  if (dir == NULL)
+    return -1;
+  nr_named = get16 (dir + 12);
+  nr_ids = get16 (dir + 14);
+  if (nr_named + nr_ids == 0 || nr_named + nr_ids > MAX_DIR_ENTRIES)
+    return -1;
+
+  entries = read_at (g, pe->filename,
+                     (int64_t) pe->rsrc_offset + offset + 16,
+                     8 * (nr_named + nr_ids));
+  if (entries == NULL)
+    return -1;
+
+  if (id == -1)
+    return get32 (entries + 4);
+
+  /* The entries with numeric IDs come after the named entries. */
+  for (i = nr_named; i < nr_named + nr_ids; ++i) {
+    if (get32 (entries + 8*i) == (uint32_t) id)
+      return get32 (entries + 8*i + 4);
+  }
+
+  return -1;
+}
+
+/**
+ * Read the resource of type C<type> and numeric name C<name> (in the
+ * first language available) from the PE executable C<filename>.  For
+ * example type 2 is C<RT_BITMAP>, which is what C<wrestool --type=2>
+ * extracts.  The resource data is returned without any header.
+ *
+ * Returns C<NULL> if the file is not a PE file, does not contain the
+ * resource, is corrupt, or the resource is larger than C<max_size>.
+ * No error is set in the handle in that case.
+ */
+char *
+guestfs_int_pe_read_resource (guestfs_h *g, const char *filename,
+                              int type, int name,
+                              size_t max_size, size_t *size_r)
+{
+  CLEANUP_FREE unsigned char *mz = NULL;
+  CLEANUP_FREE unsigned char *nt = NULL;
+  CLEANUP_FREE unsigned char *hdrs = NULL;
+  CLEANUP_FREE unsigned char *data_entry = NULL;
+  struct pe pe = { .filename = filename };
+  uint32_t pe_offset, dir_offset, nr_dirs_offset, rsrc_rva;
+  uint32_t data_rva, data_size;
+  size_t opt_size, hdrs_size;
+  const unsigned char *opt;
+  int64_t r, offset;
+  char *ret;
+
+  /* DOS header. */
+  mz = read_at (g, filename, 0, 64);
+  if (mz == NULL || mz[0] != 'M' || mz[1] != 'Z')
+    goto not_found;
+  pe_offset = get32 (mz + 0x3c);
+
+  /* PE signature and COFF header. */
+  nt = read_at (g, filename, pe_offset, 24);
+  if (nt == NULL || memcmp (nt, "PE\0\0", 4) != 0)
+    goto not_found;
+  pe.nr_sections = get16 (nt + 4 + 2);
+  opt_size = get16 (nt + 4 + 16);
+
+  /* Optional header and section table. */
+  hdrs_size = opt_size + 40 * pe.nr_sections;
+  if (hdrs_size > MAX_HEADERS_SIZE || opt_size < 2)
+    goto not_found;
+  hdrs = read_at (g, filename, (int64_t) pe_offset + 24, hdrs_size);
+  if (hdrs == NULL)
+    goto not_found;
+  opt = hdrs;
+  pe.sections = hdrs + opt_size;
+
+  switch (get16 (opt)) {
+  case 0x10b:                   /* PE32 */
+    nr_dirs_offset = 92; dir_offset = 96;
+    break;
+  case 0x20b:                   /* PE32+ */
+    nr_dirs_offset = 108; dir_offset = 112;
+    break;
+  default:
+    goto not_found;
+  }
+  /* The resource table is data directory 2. */
+  if (opt_size < dir_offset + 3*8 || get32 (opt + nr_dirs_offset) < 3)
+    goto not_found;
+  rsrc_rva = get32 (opt + dir_offset + 2*8);
+  if (rsrc_rva == 0)
+    goto not_found;
+  offset = rva_to_offset (&pe, rsrc_rva);
+  if (offset == -1 || offset > UINT32_MAX)
+    goto not_found;
+  pe.rsrc_offset = offset;
+
+  /* The resource tree has three levels: type, name, language.  The
+   * high bit of OffsetToData is set for subdirectories.
+   */
+  r = find_dir_entry (g, &pe, 0, type);
+  if (r == -1 || !(r & 0x80000000))
+    goto not_found;
+  r = find_dir_entry (g, &pe, r & 0x7fffffff, name);
+  if (r == -1 || !(r & 0x80000000))
+    goto not_found;
+  r = find_dir_entry (g, &pe, r & 0x7fffffff, -1);
+  if (r == -1 || (r & 0x80000000))
+    goto not_found;
+
+  /* IMAGE_RESOURCE_DATA_ENTRY. */
+  data_entry = read_at (g, filename, (int64_t) pe.rsrc_offset + r, 16);
+  if (data_entry == NULL)
+    goto not_found;
+  data_rva = get32 (data_entry);
+  data_size = get32 (data_entry + 4);
+  if (data_size == 0 || data_size > max_size)
+    goto not_found;
+  offset = rva_to_offset (&pe, data_rva);
+  if (offset == -1)
+    goto not_found;
+
+  ret = (char *) read_at (g, filename, offset, data_size);
+  if (ret == NULL)
+    goto not_found;
+
+  *size_r = data_size;
+  return ret;
+
+ not_found:
+  debug (g, "%s: resource type %d name %d not found", filename, type, name);
+  return NULL;
+}
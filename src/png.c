@@ -0,0 +1,291 @@
+/* libguestfs
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * Convert a Windows device independent bitmap (as stored in an
+ * C<RT_BITMAP> resource) to a PNG image, in place of running
+ * L<bmptopnm(1)>, L<pamcut(1)> and L<pnmtopng(1)>.
+ *
+ * The PNG is written as 8 bit RGB, and like L<bmptopnm(1)> any alpha
+ * channel in the bitmap is dropped.  So that we don't need zlib, the
+ * image data is stored in uncompressed deflate blocks.  The icons we
+ * convert are small, so this doesn't matter much.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "guestfs.h"
+#include "guestfs-internal.h"
+
+/* Limit on the width and height of images we will convert. */
+#define MAX_DIMENSION 1024
+
+/* Largest uncompressed deflate block. */
+#define MAX_STORED_BLOCK 65535
+
+static int32_t
+get_s32 (const unsigned char *p)
+{
+  return (int32_t) (p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24);
+}
+
+static uint16_t
+get16 (const unsigned char *p)
+{
+  return p[0] | p[1] << 8;
+}
+
+static void
+put32be (unsigned char *p, uint32_t v)
+{
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static uint32_t
+png_crc32 (const unsigned char *p, size_t len)
+{
+  uint32_t crc = 0xffffffff;
+  size_t i, j;
+
+  for (i = 0; i < len; ++i) {
+    crc ^= p[i];
+    for (j = 0; j < 8; ++j)
+      crc = crc & 1 ? 0xedb88320 ^ (crc >> 1) : crc >> 1;
+  }
+  return crc ^ 0xffffffff;
+}
+
+/* Append a PNG chunk.  'p' points to where the chunk is written. */
+static unsigned char *
+put_chunk (unsigned char *p, const char *type,
+           const unsigned char *data, size_t len)
+{
+  put32be (p, len);
+  memcpy (p+4, type, 4);
+  if (len > 0)
+    memmove (p+8, data, len);
+  put32be (p+8+len, png_crc32 (p+4, len+4));
+  return p + 12 + len;
+}
+
+/* Compute the RGB value of pixel 'x' in a bitmap row. */
+static void
+get_pixel (const unsigned char *row, int bpp, const unsigned char *palette,
+           size_t nr_colours, int x, unsigned char *rgb)
+{
+  const unsigned char *c;
+  size_t index;
+
+  switch (bpp) {
+  case 32:
+    c = &row[4*x];
+    break;
+  case 24:
+    c = &row[3*x];
+    break;
+  case 16: {
+    /* 5-5-5 RGB. */
+    const uint16_t v = get16 (&row[2*x]);
+    rgb[0] = ((v >> 10) & 0x1f) * 255 / 31;
+    rgb[1] = ((v >> 5) & 0x1f) * 255 / 31;
+    rgb[2] = (v & 0x1f) * 255 / 31;
+    return;
+  }
+  default:                      /* 1, 4 or 8 bits per pixel */
+    index = (row[x*bpp / 8] >> (8 - bpp - (x*bpp % 8))) & ((1 << bpp) - 1);
+    if (index >= nr_colours) {
+      rgb[0] = rgb[1] = rgb[2] = 0;
+      return;
+    }
+    c = &palette[4*index];
+  }
+
+  /* Windows stores BGR. */
+  rgb[0] = c[2];
+  rgb[1] = c[1];
+  rgb[2] = c[0];
+}
+
+/**
+ * Convert the device independent bitmap in C<dib> (a
+ * C<BITMAPINFOHEADER>, optional colour table, and the pixels) to a
+ * PNG.  If C<max_height> is greater than 0, only the top
+ * C<max_height> rows are kept, as with C<pamcut -bottom>.
+ *
+ * Returns C<NULL> if the bitmap is corrupt or uses a format we don't
+ * understand (eg. RLE compression).  No error is set in the handle in
+ * that case.
+ */
+char *
+guestfs_int_dib_to_png (guestfs_h *g, const char *dib, size_t len,
+                        int max_height, size_t *size_r)
+{
+  static const unsigned char png_signature[8] =
+    { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  const unsigned char *p = (const unsigned char *) dib;
+  const unsigned char *palette, *pixels;
+  unsigned char ihdr[13];
+  uint32_t header_size, compression, nr_colours;
+  int32_t width, height;
+  int bpp, top_down, y, x;
+  size_t stride, raw_size, nr_blocks, idat_size, i;
+  uint32_t adler_a = 1, adler_b = 0;
+  CLEANUP_FREE unsigned char *raw = NULL;
+  unsigned char *idat, *q, *ret;
+
+  if (len < 40)
+    goto unsupported;
+  header_size = get_s32 (p);
+  width = get_s32 (p + 4);
+  height = get_s32 (p + 8);
+  bpp = get16 (p + 14);
+  compression = get_s32 (p + 16);
+  nr_colours = get_s32 (p + 32);
+
+  if (header_size < 40 || header_size > len)
+    goto unsupported;
+  top_down = height < 0;
+  if (top_down)
+    height = -height;
+  if (width <= 0 || width > MAX_DIMENSION ||
+      height <= 0 || height > MAX_DIMENSION)
+    goto unsupported;
+
+  /* BI_RGB, or BI_BITFIELDS with the usual masks which we treat the
+   * same way.
+   */
+  if (compression == 3 && (bpp == 32 || bpp == 16)) {
+    const unsigned char *masks = p + 40;
+    if (header_size == 40) {
+      if (len < 52)
+        goto unsupported;
+      header_size += 12;
+    }
+    if (bpp == 32 &&
+        (get_s32 (masks) != 0xff0000 || get_s32 (masks+4) != 0xff00 ||
+         get_s32 (masks+8) != 0xff))
+      goto unsupported;
+    if (bpp == 16 &&
+        (get_s32 (masks) != 0x7c00 || get_s32 (masks+4) != 0x3e0 ||
+         get_s32 (masks+8) != 0x1f))
+      goto unsupported;
+  }
+  else if (compression != 0)
+    goto unsupported;
+
+  switch (bpp) {
+  case 1: case 4: case 8:
+    if (nr_colours == 0 || nr_colours > (1U << bpp))
+      nr_colours = 1U << bpp;
+    break;
+  case 16: case 24: case 32:
+    nr_colours = 0;
+    break;
+  default:
+    goto unsupported;
+  }
+
+  palette = p + header_size;
+  pixels = palette + 4 * nr_colours;
+  stride = ((size_t) width * bpp + 31) / 32 * 4;
+  if (4 * nr_colours > len - header_size ||
+      stride * height > len - header_size - 4 * nr_colours)
+    goto unsupported;
+
+  if (max_height > 0 && max_height < height) {
+    /* Keep the top rows, which are at the end of a bottom-up bitmap. */
+    if (!top_down)
+      pixels += stride * (height - max_height);
+    height = max_height;
+  }
+
+  /* The raw PNG image data: each row is a filter byte (0 = none)
+   * followed by RGB triples, top row first.
+   */
+  raw_size = (size_t) height * (1 + 3 * (size_t) width);
+  raw = safe_malloc (g, raw_size);
+  q = raw;
+  for (y = 0; y < height; ++y) {
+    const unsigned char *row =
+      pixels + stride * (top_down ? y : height - 1 - y);
+
+    *q++ = 0;
+    for (x = 0; x < width; ++x) {
+      get_pixel (row, bpp, palette, nr_colours, x, q);
+      q += 3;
+    }
+  }
+
+  /* Wrap it in a zlib stream of stored deflate blocks. */
+  nr_blocks = (raw_size + MAX_STORED_BLOCK - 1) / MAX_STORED_BLOCK;
+  idat_size = 2 + 5 * nr_blocks + raw_size + 4;
+
+  ret = safe_malloc (g, sizeof png_signature + 25 + 12 + idat_size + 12);
+  memcpy (ret, png_signature, sizeof png_signature);
+
+  put32be (ihdr, width);
+  put32be (ihdr+4, height);
+  ihdr[8] = 8;                  /* bit depth */
+  ihdr[9] = 2;                  /* colour type: RGB */
+  ihdr[10] = ihdr[11] = ihdr[12] = 0;
+  q = put_chunk (ret + sizeof png_signature, "IHDR", ihdr, sizeof ihdr);
+
+  /* Build the IDAT data in place, after the chunk length and type. */
+  idat = q + 8;
+  idat[0] = 0x78;               /* deflate, 32K window */
+  idat[1] = 0x01;               /* no preset dictionary, FCHECK */
+  idat += 2;
+  for (i = 0; i < nr_blocks; ++i) {
+    const size_t off = i * MAX_STORED_BLOCK;
+    const size_t n =
+      raw_size - off < MAX_STORED_BLOCK ? raw_size - off : MAX_STORED_BLOCK;
+    size_t j;
+
+    idat[0] = i == nr_blocks-1; /* BFINAL, BTYPE = 00 */
+    idat[1] = n & 0xff;
+    idat[2] = n >> 8;
+    idat[3] = ~n & 0xff;
+    idat[4] = (~n >> 8) & 0xff;
+    memcpy (idat+5, raw + off, n);
+    idat += 5 + n;
+
+    for (j = 0; j < n; ++j) {
+      adler_a = (adler_a + raw[off+j]) % 65521;
+      adler_b = (adler_b + adler_a) % 65521;
+    }
+  }
+  put32be (idat, adler_b << 16 | adler_a);
+  q = put_chunk (q, "IDAT", q + 8, idat_size);
+
+  q = put_chunk (q, "IEND", NULL, 0);
+
+  *size_r = q - ret;
+  return (char *) ret;
+
+ unsupported:
+  debug (g, "dib_to_png: unsupported or corrupt bitmap");
+  return NULL;
+}
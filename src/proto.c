@@ -64,6 +64,20 @@
  * this in the current API, but they would be implemented as a
  * combination of cases 3 and 4.
  *
+ * =item 6.
+ *
+ * An asynchronous call (eg. C<guestfs_submit_statns>).  We write the
+ * request and return the serial number to the caller straight away.
+ * Later the caller collects the reply.  The sequence of calls is:
+ *
+ *   guestfs_int_submit
+ *     ... other calls, which may include more guestfs_int_submit
+ *   guestfs_int_wait
+ *
+ * Several calls can be in flight at once.  Replies are matched to
+ * calls by serial number, and replies which arrive while we are
+ * waiting for something else are saved in C<g-E<gt>async_calls>.
+ *
  * =back
  *
  * All read/write/etc operations are performed using the current
@@ -82,22 +96,51 @@
 #include <errno.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/time.h>
 #include <assert.h>
 #include <libintl.h>
 
 #include <rpc/types.h>
 #include <rpc/xdr.h>
 
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
 #include "c-ctype.h"
+#include "full-write.h"
 #include "ignore-value.h"
 
 #include "guestfs.h"
 #include "guestfs-internal.h"
 #include "guestfs_protocol.h"
 
+#ifdef HAVE_LIBZSTD
+/* Chunks are compressed quickly, since the aim is to save network
+ * bandwidth to a remote appliance rather than space.
+ */
+#define CHUNK_ZSTD_LEVEL 1
+#endif
+
 /* Size of guestfs_progress message on the wire. */
 #define PROGRESS_MESSAGE_SIZE 24
 
+/* Maximum number of asynchronous calls that we allow to be sent to
+ * the daemon without their replies having been read.  While the
+ * daemon is writing a reply it is not reading requests, so if we
+ * kept writing requests without limit both sides could end up
+ * blocked in write(2).  Keeping the number small keeps the unread
+ * requests well inside the socket buffer.
+ */
+#define MAX_UNREAD_ASYNC_CALLS 16
+
+/* Initial size of the per-handle send buffer.  Almost all requests
+ * fit into this.  The buffer is grown if a larger message is sent.
+ */
+#define DEFAULT_SEND_BUFFER_SIZE 4096
+
+static int store_async_reply (guestfs_h *g, uint32_t size, void *buf);
+
 /**
  * This is called if we detect EOF, ie. qemu died.
  */
@@ -113,10 +156,55 @@ child_cleanup (guestfs_h *g)
   }
   memset (&g->launch_t, 0, sizeof g->launch_t);
   guestfs_int_free_drives (g);
+  g->chunk_size = GUESTFS_DEFAULT_CHUNK_SIZE;
+  g->nr_data_channels = 1;
+  guestfs_int_free_chunk_codecs (g);
+  guestfs_int_free_async_calls (g);
   g->state = CONFIG;
   guestfs_int_call_callbacks_void (g, GUESTFS_EVENT_SUBPROCESS_QUIT);
 }
 
+/**
+ * Decide if a progress message should be dropped because of the
+ * limits set by C<guestfs_set_progress_interval> and
+ * C<guestfs_set_progress_delta>.  The first and the final message of
+ * each call are always passed on.
+ */
+static int
+drop_progress_message (guestfs_h *g, const guestfs_progress *message)
+{
+  struct timeval now;
+
+  if (g->progress_interval == 0 && g->progress_delta == 0)
+    return 0;
+
+  gettimeofday (&now, NULL);
+
+  if (message->proc == g->progress_proc &&
+      message->serial == g->progress_serial &&
+      message->position != message->total) {
+    if (g->progress_interval > 0 &&
+        guestfs_int_timeval_diff (&g->progress_t, &now) <
+        g->progress_interval)
+      return 1;
+
+    /* Pulse mode messages have position 0 until the end, so only the
+     * interval applies to them.
+     */
+    if (g->progress_delta > 0 && message->position > 0 &&
+        message->position >= g->progress_position &&
+        (double) (message->position - g->progress_position) * 1000 <
+        (double) g->progress_delta * message->total)
+      return 1;
+  }
+
+  g->progress_proc = message->proc;
+  g->progress_serial = message->serial;
+  g->progress_position = message->position;
+  g->progress_t = now;
+  return 0;
+}
+
 /**
  * Convenient wrapper to generate a progress message callback.
  */
@@ -126,6 +214,9 @@ guestfs_int_progress_message_callback (guestfs_h *g,
 {
   uint64_t array[4];
 
+  if (drop_progress_message (g, message))
+    return;
+
   array[0] = message->proc;
   array[1] = message->serial;
   array[2] = message->position;
@@ -156,13 +247,22 @@ guestfs_int_log_message_callback (guestfs_h *g, const char *buf, size_t len)
      */
     sentinel = "Linux version"; /* kernel up */
     slen = strlen (sentinel);
-    if (memmem (buf, len, sentinel, slen) != NULL)
+    if (memmem (buf, len, sentinel, slen) != NULL) {
       guestfs_int_launch_send_progress (g, 6);
+      guestfs_int_launch_phase (g, LAUNCH_PHASE_KERNEL);
+    }
 
     sentinel = "Starting /init script"; /* /init running */
     slen = strlen (sentinel);
-    if (memmem (buf, len, sentinel, slen) != NULL)
+    if (memmem (buf, len, sentinel, slen) != NULL) {
       guestfs_int_launch_send_progress (g, 9);
+      guestfs_int_launch_phase (g, LAUNCH_PHASE_INIT);
+    }
+
+    sentinel = "Udev settled"; /* printed by /init */
+    slen = strlen (sentinel);
+    if (memmem (buf, len, sentinel, slen) != NULL)
+      guestfs_int_launch_phase (g, LAUNCH_PHASE_UDEV);
   }
 }
 
@@ -234,6 +334,22 @@ check_daemon_socket (guestfs_h *g)
     goto again;
   }
 
+  /* Reply to an earlier asynchronous call.  Save it for later. */
+  if (flag <= GUESTFS_MESSAGE_MAX && g->nr_async_calls > 0) {
+    void *mbuf = safe_malloc (g, flag);
+
+    n = g->conn->ops->read_data (g, g->conn, mbuf, flag);
+    if (n <= 0) { /* 0 or -1 */
+      free (mbuf);
+      return n;
+    }
+
+    if (store_async_reply (g, flag, mbuf) == -1)
+      return -1;
+
+    goto again;
+  }
+
   if (flag != GUESTFS_CANCEL_FLAG) {
     error (g, _("check_daemon_socket: read 0x%x from daemon, expected 0x%x.  Lost protocol synchronization (bad!)\n"),
            flag, GUESTFS_CANCEL_FLAG);
@@ -243,6 +359,47 @@ check_daemon_socket (guestfs_h *g)
   return -2;
 }
 
+/**
+ * Return the per-handle send buffer, growing it to at least C<size>
+ * bytes if necessary.  We reuse this buffer for every message, so
+ * that small requests don't cause a large allocation each time.
+ */
+static char *
+get_send_buffer (guestfs_h *g, size_t size)
+{
+  if (g->send_buf_size < size) {
+    g->send_buf = safe_realloc (g, g->send_buf, size);
+    g->send_buf_size = size;
+  }
+  return g->send_buf;
+}
+
+/**
+ * Encode the header and arguments of a request into C<buf> (which
+ * is C<bufsize> bytes long, not including space for the length
+ * word).  Returns the encoded length, or C<-1> if it doesn't fit.
+ */
+static ssize_t
+encode_message (char *buf, size_t bufsize,
+                struct guestfs_message_header *hdr,
+                xdrproc_t xdrp, char *args)
+{
+  XDR xdr;
+  ssize_t len = -1;
+
+  xdrmem_create (&xdr, buf + 4, bufsize, XDR_ENCODE);
+
+  /* Serialize the header and the args.  If any, because some message
+   * types have no parameters.
+   */
+  if (xdr_guestfs_message_header (&xdr, hdr) &&
+      (!xdrp || (*xdrp) (&xdr, args, 0)))
+    len = xdr_getpos (&xdr);
+
+  xdr_destroy (&xdr);
+  return len;
+}
+
 int
 guestfs_int_send (guestfs_h *g, int proc_nr,
 		  uint64_t progress_hint, uint64_t optargs_bitmask,
@@ -253,24 +410,15 @@ guestfs_int_send (guestfs_h *g, int proc_nr,
   uint32_t len;
   const int serial = g->msg_next_serial++;
   ssize_t r;
-  CLEANUP_FREE char *msg_out = NULL;
+  char *msg_out;
   size_t msg_out_size;
+  char fbuf[16];
 
   if (!g->conn) {
     guestfs_int_unexpected_close_error (g);
     return -1;
   }
 
-  /* We have to allocate this message buffer on the heap because
-   * it is quite large (although will be mostly unused).  We
-   * can't allocate it on the stack because in some environments
-   * we have quite limited stack space available, notably when
-   * running in the JVM.
-   */
-  msg_out = safe_malloc (g, GUESTFS_MESSAGE_MAX + 4);
-  xdrmem_create (&xdr, msg_out + 4, GUESTFS_MESSAGE_MAX, XDR_ENCODE);
-
-  /* Serialize the header. */
   hdr.prog = GUESTFS_PROGRAM;
   hdr.vers = GUESTFS_PROTOCOL_VERSION;
   hdr.proc = proc_nr;
@@ -280,28 +428,33 @@ guestfs_int_send (guestfs_h *g, int proc_nr,
   hdr.progress_hint = progress_hint;
   hdr.optargs_bitmask = optargs_bitmask;
 
-  if (!xdr_guestfs_message_header (&xdr, &hdr)) {
-    error (g, _("xdr_guestfs_message_header failed"));
-    return -1;
-  }
-
-  /* Serialize the args.  If any, because some message types
-   * have no parameters.
+  /* Try to encode the message into the send buffer at its current
+   * size.  If it doesn't fit, grow the buffer to the largest possible
+   * message and try again.  We can't allocate this buffer on the
+   * stack because in some environments we have quite limited stack
+   * space available, notably when running in the JVM.
    */
-  if (xdrp) {
-    if (!(*xdrp) (&xdr, args, 0)) {
-      error (g, _("dispatch failed to marshal args"));
-      return -1;
+  msg_out = get_send_buffer (g, DEFAULT_SEND_BUFFER_SIZE);
+  r = encode_message (msg_out, g->send_buf_size - 4, &hdr, xdrp, args);
+  if (r == -1 && g->send_buf_size < GUESTFS_MESSAGE_MAX + 4) {
+    msg_out = get_send_buffer (g, GUESTFS_MESSAGE_MAX + 4);
+    r = encode_message (msg_out, GUESTFS_MESSAGE_MAX, &hdr, xdrp, args);
+
+    /* Shrink the buffer back to what this message needed, so that
+     * one large call doesn't leave a 4 MB buffer on the handle.
+     */
+    if (r >= 0) {
+      g->send_buf = msg_out = safe_realloc (g, msg_out, r + 4);
+      g->send_buf_size = r + 4;
     }
   }
+  if (r == -1) {
+    error (g, _("dispatch failed to marshal args"));
+    return -1;
+  }
 
-  /* Get the actual length of the message, resize the buffer to match
-   * the actual length, and write the length word at the beginning.
-   */
-  len = xdr_getpos (&xdr);
-  xdr_destroy (&xdr);
-
-  msg_out = safe_realloc (g, msg_out, len + 4);
+  /* Write the length word at the beginning. */
+  len = r;
   msg_out_size = len + 4;
 
   xdrmem_create (&xdr, msg_out, 4, XDR_ENCODE);
@@ -320,6 +473,12 @@ guestfs_int_send (guestfs_h *g, int proc_nr,
     return -1;
   }
 
+  /* Likewise forget about guestfs_user_cancel calls made before this
+   * call started.
+   */
+  while (read (g->cancel_pipe[0], fbuf, sizeof fbuf) > 0)
+    ;
+
   /* Send the message. */
   r = g->conn->ops->write_data (g, g->conn, msg_out, msg_out_size);
   if (r == -1)
@@ -330,6 +489,8 @@ guestfs_int_send (guestfs_h *g, int proc_nr,
     return -1;
   }
 
+  guestfs_int_rpc_stats_send (g, proc_nr, serial, msg_out_size);
+
   return serial;
 }
 
@@ -337,6 +498,7 @@ static int send_file_chunk (guestfs_h *g, int cancel, const char *buf, size_t le
 static int send_file_data (guestfs_h *g, const char *buf, size_t len);
 static int send_file_cancellation (guestfs_h *g);
 static int send_file_complete (guestfs_h *g);
+static int send_file_from_source (guestfs_h *g, struct send_source *src);
 
 /**
  * Send a file.
@@ -347,10 +509,23 @@ static int send_file_complete (guestfs_h *g);
 int
 guestfs_int_send_file (guestfs_h *g, const char *filename)
 {
-  CLEANUP_FREE char *buf = safe_malloc (g, GUESTFS_MAX_CHUNK_SIZE);
+  const size_t chunk_size = g->chunk_size;
+  CLEANUP_FREE char *buf = safe_malloc (g, chunk_size);
   int fd, r = 0, err;
 
   g->user_cancel = 0;
+  g->next_data_channel = 0;
+
+  /* Internal callers can generate the file contents on the fly, in
+   * which case the filename is ignored.  This only applies to the
+   * one file.
+   */
+  if (g->send_source) {
+    struct send_source *src = g->send_source;
+
+    g->send_source = NULL;
+    return send_file_from_source (g, src);
+  }
 
   fd = open (filename, O_RDONLY|O_CLOEXEC);
   if (fd == -1) {
@@ -363,7 +538,7 @@ guestfs_int_send_file (guestfs_h *g, const char *filename)
 
   /* Send file in chunked encoding. */
   while (!g->user_cancel) {
-    r = read (fd, buf, GUESTFS_MAX_CHUNK_SIZE);
+    r = read (fd, buf, chunk_size);
     if (r == -1 && (errno == EINTR || errno == EAGAIN))
       continue;
     if (r <= 0) break;
@@ -374,6 +549,7 @@ guestfs_int_send_file (guestfs_h *g, const char *filename)
       close (fd);
       return err;
     }
+    guestfs_int_rpc_stats_file (g, r);
   }
 
   if (r == -1) {
@@ -410,11 +586,84 @@ guestfs_int_send_file (guestfs_h *g, const char *filename)
 }
 
 /**
- * Send a chunk of file data.
+ * Send a file whose contents are generated by C<src-E<gt>read>.
+ * Return values are the same as C<guestfs_int_send_file>.
+ */
+static int
+send_file_from_source (guestfs_h *g, struct send_source *src)
+{
+  const size_t chunk_size = g->chunk_size;
+  CLEANUP_FREE char *buf = safe_malloc (g, chunk_size);
+  ssize_t r;
+  int err;
+
+  for (;;) {
+    if (g->user_cancel) {
+      guestfs_int_error_errno (g, EINTR, _("operation cancelled by user"));
+      send_file_cancellation (g);
+      return -1;
+    }
+
+    r = src->read (g, buf, chunk_size, src->opaque);
+    if (r == -1) {
+      send_file_cancellation (g);
+      return -1;
+    }
+    if (r == 0)
+      break;
+
+    err = send_file_data (g, buf, r);
+    if (err < 0) {
+      if (err == -2)            /* daemon sent cancellation */
+        send_file_cancellation (g);
+      return err;
+    }
+    guestfs_int_rpc_stats_file (g, r);
+  }
+
+  err = send_file_complete (g);
+  if (err < 0) {
+    if (err == -2)              /* daemon sent cancellation */
+      send_file_cancellation (g);
+    return err;
+  }
+
+  return 0;
+}
+
+/**
+ * Send a chunk of file data.  If the daemon has agreed to it (see
+ * C<negotiate_chunk_codec> in F<src/launch.c>), a chunk of zeroes is
+ * sent as a hole and other chunks are compressed, when that makes
+ * them smaller.
  */
 static int
 send_file_data (guestfs_h *g, const char *buf, size_t len)
 {
+  if (len > 0 && (g->chunk_codecs & GUESTFS_CODEC_ZERO) &&
+      is_zero (buf, len)) {
+    char holebuf[8];
+    uint64_t hole_len = len;
+    XDR xdr;
+
+    xdrmem_create (&xdr, holebuf, sizeof holebuf, XDR_ENCODE);
+    xdr_uint64_t (&xdr, &hole_len);
+    xdr_destroy (&xdr);
+    return send_file_chunk (g, GUESTFS_CHUNK_HOLE, holebuf, sizeof holebuf);
+  }
+
+#ifdef HAVE_LIBZSTD
+  if (g->chunk_codecs & GUESTFS_CODEC_ZSTD) {
+    const size_t r =
+      ZSTD_compressCCtx (g->zstd_cctx, g->codec_buf,
+                         ZSTD_compressBound (GUESTFS_MAX_CHUNK_SIZE),
+                         buf, len, CHUNK_ZSTD_LEVEL);
+
+    if (!ZSTD_isError (r) && r < len)
+      return send_file_chunk (g, GUESTFS_CHUNK_ZSTD, g->codec_buf, r);
+  }
+#endif
+
   return send_file_chunk (g, 0, buf, len);
 }
 
@@ -437,43 +686,43 @@ send_file_complete (guestfs_h *g)
   return send_file_chunk (g, 0, buf, 0);
 }
 
+/**
+ * Send a file chunk.  A C<guestfs_chunk> is the length word, two XDR
+ * words (C<cancel> and the data length), the data and up to 3 bytes of
+ * padding, so we encode the header and write it followed by the
+ * caller's buffer, rather than copying the data into an XDR buffer.
+ *
+ * C<cancel> may also be one of the C<GUESTFS_CHUNK_*> chunk types.
+ */
 static int
 send_file_chunk (guestfs_h *g, int cancel, const char *buf, size_t buflen)
 {
-  uint32_t len;
+  static const char pad[4];
+  char hdr[12];
+  struct iovec iov[3];
+  uint32_t len, data_len = buflen;
+  const size_t pad_len = (4 - (buflen & 3)) & 3;
   ssize_t r;
-  guestfs_chunk chunk;
   XDR xdr;
-  CLEANUP_FREE char *msg_out = NULL;
-  size_t msg_out_size;
-
-  /* Allocate the chunk buffer.  Don't use the stack to avoid
-   * excessive stack usage and unnecessary copies.
-   */
-  msg_out = safe_malloc (g, GUESTFS_MAX_CHUNK_SIZE + 4 + 48);
-  xdrmem_create (&xdr, msg_out + 4, GUESTFS_MAX_CHUNK_SIZE + 48, XDR_ENCODE);
-
-  /* Serialize the chunk. */
-  chunk.cancel = cancel;
-  chunk.data.data_len = buflen;
-  chunk.data.data_val = (char *) buf;
 
-  if (!xdr_guestfs_chunk (&xdr, &chunk)) {
-    error (g, _("xdr_guestfs_chunk failed (buf = %p, buflen = %zu)"),
-           buf, buflen);
-    xdr_destroy (&xdr);
+  if (buflen > GUESTFS_MAX_CHUNK_SIZE) {
+    error (g, _("file chunk is too large (%zu bytes)"), buflen);
     return -1;
   }
 
-  len = xdr_getpos (&xdr);
+  len = 8 + data_len + pad_len;
+  xdrmem_create (&xdr, hdr, sizeof hdr, XDR_ENCODE);
+  xdr_uint32_t (&xdr, &len);
+  xdr_int (&xdr, &cancel);
+  xdr_uint32_t (&xdr, &data_len);
   xdr_destroy (&xdr);
 
-  /* Reduce the size of the outgoing message buffer to the real length. */
-  msg_out = safe_realloc (g, msg_out, len + 4);
-  msg_out_size = len + 4;
-
-  xdrmem_create (&xdr, msg_out, 4, XDR_ENCODE);
-  xdr_uint32_t (&xdr, &len);
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = sizeof hdr;
+  iov[1].iov_base = (char *) buf;
+  iov[1].iov_len = buflen;
+  iov[2].iov_base = (char *) pad;
+  iov[2].iov_len = pad_len;
 
   /* Did the daemon send a cancellation message? */
   r = check_daemon_socket (g);
@@ -489,8 +738,13 @@ send_file_chunk (guestfs_h *g, int cancel, const char *buf, size_t buflen)
     return -1;
   }
 
-  /* Send the chunk. */
-  r = g->conn->ops->write_data (g, g->conn, msg_out, msg_out_size);
+  /* Send the chunk.  Chunks are striped round-robin across the data
+   * channels (channel 0 is the daemon socket), and the daemon reads
+   * them back in the same order.
+   */
+  r = g->conn->ops->writev_channel (g, g->conn, g->next_data_channel,
+                                    iov, 3);
+  g->next_data_channel = (g->next_data_channel + 1) % g->nr_data_channels;
   if (r == -1)
     return -1;
   if (r == 0) {
@@ -561,6 +815,7 @@ recv_from_daemon (guestfs_h *g, uint32_t *size_rtn, void **buf_rtn)
              (int) g->state);
     else {
       g->state = READY;
+      guestfs_int_flush_event_buffers (g);
       guestfs_int_call_callbacks_void (g, GUESTFS_EVENT_LAUNCH_DONE);
     }
     debug (g, "recv_from_daemon: received GUESTFS_LAUNCH_FLAG");
@@ -669,21 +924,186 @@ guestfs_int_recv_from_daemon (guestfs_h *g, uint32_t *size_rtn, void **buf_rtn)
 }
 
 /**
- * Receive a reply.
+ * Find the asynchronous call with the given serial number, or return
+ * C<NULL> if there is no such call in flight.
  */
-int
-guestfs_int_recv (guestfs_h *g, const char *fn,
-		  guestfs_message_header *hdr,
-		  guestfs_message_error *err,
-		  xdrproc_t xdrp, char *ret)
+static struct async_call *
+find_async_call (guestfs_h *g, unsigned serial)
+{
+  size_t i;
+
+  for (i = 0; i < g->nr_async_calls; ++i) {
+    if (g->async_calls[i].serial == serial)
+      return &g->async_calls[i];
+  }
+
+  return NULL;
+}
+
+/**
+ * Decode just the serial number from the header of a reply message.
+ */
+static int
+get_reply_serial (void *buf, uint32_t size, unsigned *serial_rtn)
 {
   XDR xdr;
-  CLEANUP_FREE void *buf = NULL;
-  uint32_t size;
+  guestfs_message_header hdr;
+  int r;
+
+  xdrmem_create (&xdr, buf, size, XDR_DECODE);
+  r = xdr_guestfs_message_header (&xdr, &hdr);
+  xdr_destroy (&xdr);
+  if (!r)
+    return -1;
+
+  *serial_rtn = hdr.serial;
+  return 0;
+}
+
+/**
+ * Save the reply to an asynchronous call until the caller asks for
+ * it.  This takes ownership of C<buf>.
+ */
+static int
+store_async_reply (guestfs_h *g, uint32_t size, void *buf)
+{
+  struct async_call *call = NULL;
+  unsigned serial;
+
+  if (get_reply_serial (buf, size, &serial) == 0)
+    call = find_async_call (g, serial);
+  if (call == NULL || call->buf != NULL) {
+    error (g, _("received a reply from the daemon which does not match any call in flight"));
+    free (buf);
+    return -1;
+  }
+
+  call->size = size;
+  call->buf = buf;
+  return 0;
+}
+
+/**
+ * Return the number of asynchronous calls whose replies have not
+ * been read from the daemon yet.
+ */
+static size_t
+count_unread_async_calls (guestfs_h *g)
+{
+  size_t i, n = 0;
+
+  for (i = 0; i < g->nr_async_calls; ++i) {
+    if (g->async_calls[i].buf == NULL)
+      n++;
+  }
+
+  return n;
+}
+
+static void
+remove_async_call (guestfs_h *g, unsigned serial)
+{
+  struct async_call *call = find_async_call (g, serial);
+  size_t i;
+
+  if (call == NULL)
+    return;
+
+  i = call - g->async_calls;
+  free (call->buf);
+  memmove (&g->async_calls[i], &g->async_calls[i+1],
+           (g->nr_async_calls - i - 1) * sizeof (struct async_call));
+  g->nr_async_calls--;
+}
+
+/**
+ * Set up the chunk codecs in C<codecs> (C<GUESTFS_CODEC_*>) before
+ * they are negotiated with the daemon.  Returns the subset of
+ * C<codecs> which this library supports.  They are not used until
+ * C<g-E<gt>chunk_codecs> is set.
+ */
+int
+guestfs_int_init_chunk_codecs (guestfs_h *g, int codecs)
+{
+  int supported = GUESTFS_CODEC_ZERO;
+
+#ifdef HAVE_LIBZSTD
+  if (codecs & GUESTFS_CODEC_ZSTD) {
+    if (g->zstd_cctx == NULL)
+      g->zstd_cctx = ZSTD_createCCtx ();
+    if (g->zstd_dctx == NULL)
+      g->zstd_dctx = ZSTD_createDCtx ();
+    /* Big enough to compress or decompress any chunk. */
+    if (g->codec_buf == NULL)
+      g->codec_buf = safe_malloc (g, ZSTD_compressBound (GUESTFS_MAX_CHUNK_SIZE));
+    if (g->zstd_cctx && g->zstd_dctx)
+      supported |= GUESTFS_CODEC_ZSTD;
+  }
+#endif
+
+  return codecs & supported;
+}
+
+/**
+ * Stop using chunk codecs and free their state.  This is called
+ * when the appliance goes away.
+ */
+void
+guestfs_int_free_chunk_codecs (guestfs_h *g)
+{
+  g->chunk_codecs = 0;
+#ifdef HAVE_LIBZSTD
+  ZSTD_freeCCtx (g->zstd_cctx);
+  ZSTD_freeDCtx (g->zstd_dctx);
+#endif
+  g->zstd_cctx = NULL;
+  g->zstd_dctx = NULL;
+  free (g->codec_buf);
+  g->codec_buf = NULL;
+}
+
+/**
+ * Free any asynchronous calls still in flight.  This is called when
+ * the appliance goes away.
+ */
+void
+guestfs_int_free_async_calls (guestfs_h *g)
+{
+  size_t i;
+
+  for (i = 0; i < g->nr_async_calls; ++i)
+    free (g->async_calls[i].buf);
+  free (g->async_calls);
+  g->async_calls = NULL;
+  g->nr_async_calls = 0;
+}
+
+/**
+ * Read the reply message for C<serial>.  Replies to other
+ * asynchronous calls which arrive first are saved.
+ */
+static int
+recv_reply (guestfs_h *g, const char *fn, unsigned serial,
+            uint32_t *size_rtn, void **buf_rtn)
+{
+  struct async_call *call;
+  unsigned reply_serial;
   int r;
 
+  /* Did the reply already arrive while we were waiting for another? */
+  call = find_async_call (g, serial);
+  if (call && call->buf) {
+    *size_rtn = call->size;
+    *buf_rtn = call->buf;
+    call->buf = NULL;
+    return 0;
+  }
+
  again:
-  r = guestfs_int_recv_from_daemon (g, &size, &buf);
+  /* Long-running calls can be cancelled while we wait. */
+  g->reply_cancellable = 1;
+  r = guestfs_int_recv_from_daemon (g, size_rtn, buf_rtn);
+  g->reply_cancellable = 0;
   if (r == -1)
     return -1;
 
@@ -691,14 +1111,48 @@ guestfs_int_recv (guestfs_h *g, const char *fn,
    * of us sending a FileIn parameter to the daemon.  Discard.  The
    * daemon should send us an error message next.
    */
-  if (size == GUESTFS_CANCEL_FLAG)
+  if (*size_rtn == GUESTFS_CANCEL_FLAG)
     goto again;
 
-  if (size == GUESTFS_LAUNCH_FLAG) {
+  if (*size_rtn == GUESTFS_LAUNCH_FLAG) {
     error (g, "%s: received unexpected launch flag from daemon when expecting reply", fn);
     return -1;
   }
 
+  /* Reply to some other asynchronous call which is in flight. */
+  if (g->nr_async_calls > 0 &&
+      get_reply_serial (*buf_rtn, *size_rtn, &reply_serial) == 0 &&
+      reply_serial != serial &&
+      find_async_call (g, reply_serial) != NULL) {
+    r = store_async_reply (g, *size_rtn, *buf_rtn);
+    *buf_rtn = NULL;
+    if (r == -1)
+      return -1;
+    goto again;
+  }
+
+  return 0;
+}
+
+/**
+ * Receive a reply.
+ */
+int
+guestfs_int_recv (guestfs_h *g, const char *fn, unsigned serial,
+		  guestfs_message_header *hdr,
+		  guestfs_message_error *err,
+		  xdrproc_t xdrp, char *ret)
+{
+  XDR xdr;
+  CLEANUP_FREE void *buf = NULL;
+  uint32_t size;
+  int r;
+
+  r = recv_reply (g, fn, serial, &size, &buf);
+  guestfs_int_flush_event_buffers (g);
+  if (r == -1)
+    return -1;
+
   xdrmem_create (&xdr, buf, size, XDR_DECODE);
 
   if (!xdr_guestfs_message_header (&xdr, hdr)) {
@@ -721,6 +1175,9 @@ guestfs_int_recv (guestfs_h *g, const char *fn,
   }
   xdr_destroy (&xdr);
 
+  guestfs_int_rpc_stats_reply (g, fn, serial, size,
+                               hdr->status == GUESTFS_STATUS_ERROR);
+
   return 0;
 }
 
@@ -742,53 +1199,95 @@ guestfs_int_recv (guestfs_h *g, const char *fn,
  * =back
  */
 int
-guestfs_int_recv_discard (guestfs_h *g, const char *fn)
+guestfs_int_recv_discard (guestfs_h *g, const char *fn, unsigned serial)
 {
   CLEANUP_FREE void *buf = NULL;
   uint32_t size;
   int r;
 
- again:
-  r = guestfs_int_recv_from_daemon (g, &size, &buf);
+  r = recv_reply (g, fn, serial, &size, &buf);
+  guestfs_int_flush_event_buffers (g);
   if (r == -1)
     return -1;
 
-  /* This can happen if a cancellation happens right at the end
-   * of us sending a FileIn parameter to the daemon.  Discard.  The
-   * daemon should send us an error message next.
-   */
-  if (size == GUESTFS_CANCEL_FLAG)
-    goto again;
-
-  if (size == GUESTFS_LAUNCH_FLAG) {
-    error (g, "%s: received unexpected launch flag from daemon when expecting reply", fn);
-    return -1;
-  }
+  guestfs_int_rpc_stats_reply (g, fn, serial, size, 0);
 
   return 0;
 }
 
-/* Receive a file. */
-
-static int
-xwrite (int fd, const void *v_buf, size_t len)
+/**
+ * Submit an asynchronous call.  This sends the request and returns
+ * the serial number, which the caller later passes to
+ * C<guestfs_int_wait> to collect the reply.
+ */
+int
+guestfs_int_submit (guestfs_h *g, int proc_nr, xdrproc_t xdrp, char *args)
 {
-  const char *buf = v_buf;
-  int r;
+  int serial;
 
-  while (len > 0) {
-    r = write (fd, buf, len);
-    if (r == -1)
+  /* Don't let too many requests pile up unread in the daemon (see
+   * comment at MAX_UNREAD_ASYNC_CALLS above).
+   */
+  while (count_unread_async_calls (g) >= MAX_UNREAD_ASYNC_CALLS) {
+    void *buf;
+    uint32_t size;
+
+    if (guestfs_int_recv_from_daemon (g, &size, &buf) == -1)
       return -1;
+    if (size == GUESTFS_CANCEL_FLAG)
+      continue;
+    if (size == GUESTFS_LAUNCH_FLAG) {
+      error (g, "received unexpected launch flag from daemon when expecting reply");
+      return -1;
+    }
+    if (store_async_reply (g, size, buf) == -1)
+      return -1;
+  }
 
-    buf += r;
-    len -= r;
+  serial = guestfs_int_send (g, proc_nr, 0, 0, xdrp, args);
+  if (serial == -1)
+    return -1;
+
+  g->async_calls =
+    safe_realloc (g, g->async_calls,
+                  (g->nr_async_calls+1) * sizeof (struct async_call));
+  g->async_calls[g->nr_async_calls].serial = serial;
+  g->async_calls[g->nr_async_calls].size = 0;
+  g->async_calls[g->nr_async_calls].buf = NULL;
+  g->nr_async_calls++;
+
+  return serial;
+}
+
+/**
+ * Collect the reply to an asynchronous call previously sent by
+ * C<guestfs_int_submit>.  This blocks until the reply arrives.
+ */
+int
+guestfs_int_wait (guestfs_h *g, const char *fn, unsigned serial,
+                  guestfs_message_header *hdr,
+                  guestfs_message_error *err,
+                  xdrproc_t xdrp, char *ret)
+{
+  int r;
+
+  if (find_async_call (g, serial) == NULL) {
+    error (g, _("%s: serial number %u does not refer to an asynchronous call in flight"),
+           fn, serial);
+    return -1;
   }
 
-  return 0;
+  r = guestfs_int_recv (g, fn, serial, hdr, err, xdrp, ret);
+  remove_async_call (g, serial);
+
+  return r;
 }
 
-static ssize_t receive_file_data (guestfs_h *g, void **buf);
+/* Receive a file. */
+
+static ssize_t receive_file_data (guestfs_h *g, void **buf, uint64_t *hole_len_r);
+static ssize_t receive_file_data_to_fd (guestfs_h *g, int fd, int seekable);
+static int recv_file_to_buffer (guestfs_h *g, struct recv_buffer *rb);
 
 /**
  * Returns C<-1> = error, C<0> = EOF, C<E<gt>0> = more data
@@ -796,10 +1295,28 @@ static ssize_t receive_file_data (guestfs_h *g, void **buf);
 int
 guestfs_int_recv_file (guestfs_h *g, const char *filename)
 {
-  void *buf;
-  int fd, r;
+  ssize_t r;
+  int fd;
+  int seekable = 0;
+  struct stat statbuf;
+  off_t end;
 
   g->user_cancel = 0;
+  g->next_data_channel = 0;
+
+  /* Internal callers can ask for the file to be received into memory,
+   * in which case the filename is ignored.  This only applies to the
+   * one file.
+   */
+  if (g->recv_buffer) {
+    struct recv_buffer *rb = g->recv_buffer;
+
+    g->recv_buffer = NULL;
+    r = recv_file_to_buffer (g, rb);
+    if (r == -2)
+      goto cancel;
+    return r;
+  }
 
   /* If downloading to /dev/stdout or /dev/stderr, dup the file
    * descriptor instead of reopening the file, so that redirected
@@ -809,8 +1326,15 @@ guestfs_int_recv_file (guestfs_h *g, const char *filename)
     fd = dup (1);
   else if (STREQ (filename, "/dev/stderr"))
     fd = dup (2);
-  else
+  else {
     fd = open (filename, O_WRONLY|O_CREAT|O_TRUNC|O_NOCTTY|O_CLOEXEC, 0666);
+
+    /* Holes sent by the daemon can be left as holes if we have just
+     * truncated a regular file.  Otherwise zeroes have to be written.
+     */
+    if (fd >= 0 && fstat (fd, &statbuf) == 0 && S_ISREG (statbuf.st_mode))
+      seekable = 1;
+  }
   if (fd == -1) {
     perrorf (g, "%s", filename);
     goto cancel;
@@ -818,27 +1342,39 @@ guestfs_int_recv_file (guestfs_h *g, const char *filename)
 
   guestfs_int_fadvise_sequential (fd);
 
-  /* Receive the file in chunked encoding. */
-  while ((r = receive_file_data (g, &buf)) > 0) {
-    if (xwrite (fd, buf, r) == -1) {
-      perrorf (g, "%s: write", filename);
-      free (buf);
-      close (fd);
-      goto cancel;
-    }
-    free (buf);
-
+  /* Receive the file in chunked encoding.  The chunk payloads are
+   * moved straight from the socket to the file where possible.
+   */
+  while ((r = receive_file_data_to_fd (g, fd, seekable)) > 0) {
+    guestfs_int_rpc_stats_file (g, r);
     if (g->user_cancel) {
       close (fd);
       goto cancel;
     }
   }
 
+  if (r == -2) {
+    perrorf (g, "%s: write", filename);
+    close (fd);
+    goto cancel;
+  }
+
   if (r == -1) {
     close (fd);
     return -1;
   }
 
+  /* If the file ends with a hole, set the size of the file. */
+  if (seekable) {
+    end = lseek (fd, 0, SEEK_CUR);
+    if (end == -1 || fstat (fd, &statbuf) == -1 ||
+        (statbuf.st_size < end && ftruncate (fd, end) == -1)) {
+      perrorf (g, "%s", filename);
+      close (fd);
+      return -1;
+    }
+  }
+
   if (close (fd) == -1) {
     perrorf (g, "close: %s", filename);
     return -1;
@@ -866,67 +1402,531 @@ guestfs_int_recv_file (guestfs_h *g, const char *filename)
     return -1;
   }
 
-  while (receive_file_data (g, NULL) > 0)
+  while (receive_file_data (g, NULL, NULL) > 0)
     ;                           /* just discard it */
 
   return -1;
 }
 
 /**
- * Receive a chunk of file data.
+ * Make room for C<len> more bytes (plus a trailing C<\0>) in the
+ * receive buffer.  This uses plain L<realloc(3)> rather than
+ * C<safe_realloc> so that a large file which doesn't fit in memory
+ * is an error rather than an abort.
+ */
+static int
+recv_buffer_reserve (guestfs_h *g, struct recv_buffer *rb, uint64_t len)
+{
+  size_t alloc;
+  char *data;
+
+  if (len >= SIZE_MAX - rb->size) {
+    guestfs_int_error_errno (g, ENOMEM, _("file is too large to read into memory"));
+    return -1;
+  }
+  if (rb->size + len < rb->alloc)
+    return 0;
+
+  alloc = rb->alloc > 0 ? rb->alloc : 4096;
+  while (alloc <= rb->size + len) {
+    if (alloc > SIZE_MAX / 2) {
+      alloc = rb->size + len + 1;
+      break;
+    }
+    alloc *= 2;
+  }
+
+  data = realloc (rb->data, alloc);
+  if (data == NULL) {
+    perrorf (g, "realloc: %zu bytes", alloc);
+    return -1;
+  }
+  rb->data = data;
+  rb->alloc = alloc;
+  return 0;
+}
+
+/**
+ * Append C<len> bytes of C<data> (or zeroes if C<data> is C<NULL>)
+ * to the receive buffer, or pass them to the buffer's chunk
+ * callback.
+ */
+static int
+recv_buffer_append (guestfs_h *g, struct recv_buffer *rb,
+                    const char *data, uint64_t len)
+{
+  static const char zeroes[4096];
+
+  if (rb->chunk_cb) {
+    if (data)
+      return rb->chunk_cb (g, data, len, rb->opaque);
+    while (len > 0) {
+      const size_t n = MIN (len, sizeof zeroes);
+
+      if (rb->chunk_cb (g, zeroes, n, rb->opaque) == -1)
+        return -1;
+      len -= n;
+    }
+    return 0;
+  }
+
+  if (recv_buffer_reserve (g, rb, len) == -1)
+    return -1;
+  if (data)
+    memcpy (&rb->data[rb->size], data, len);
+  else
+    memset (&rb->data[rb->size], 0, len);
+  rb->size += len;
+  return 0;
+}
+
+/**
+ * Receive a file into C<rb>, growing the buffer as needed.  The
+ * buffer is always C<\0>-terminated on success.  Holes are filled
+ * with zeroes.
  *
- * Returns C<-1> = error, C<0> = EOF, C<E<gt>0> = more data
+ * If C<rb-E<gt>chunk_cb> is set, the data is passed to it as it
+ * arrives and is not stored in the buffer.  If the callback returns
+ * C<-1> (having set the error), the transfer is cancelled.
+ *
+ * Returns C<0> on success, C<-1> on error, or C<-2> if the transfer
+ * must be cancelled.  On error the caller must still free
+ * C<rb-E<gt>data>.
  */
-static ssize_t
-receive_file_data (guestfs_h *g, void **buf_r)
+static int
+recv_file_to_buffer (guestfs_h *g, struct recv_buffer *rb)
 {
-  int r;
-  CLEANUP_FREE void *buf = NULL;
-  uint32_t len;
-  XDR xdr;
-  guestfs_chunk chunk;
+  ssize_t r;
+  void *chunk;
+  uint64_t hole_len;
+  int err;
+
+  rb->size = 0;
+  if (!rb->chunk_cb && recv_buffer_reserve (g, rb, 0) == -1)
+    return -2;
+
+  for (;;) {
+    chunk = NULL;
+    r = receive_file_data (g, &chunk, &hole_len);
+    if (r <= 0)
+      break;
+    guestfs_int_rpc_stats_file (g, r);
 
-  r = guestfs_int_recv_from_daemon (g, &len, &buf);
+    if (hole_len > 0)
+      err = recv_buffer_append (g, rb, NULL, hole_len);
+    else
+      err = recv_buffer_append (g, rb, chunk, r);
+    free (chunk);
+    if (err == -1)
+      return -2;
+
+    if (g->user_cancel)
+      return -2;
+  }
   if (r == -1)
     return -1;
 
-  if (len == GUESTFS_LAUNCH_FLAG || len == GUESTFS_CANCEL_FLAG) {
+  if (!rb->chunk_cb)
+    rb->data[rb->size] = '\0';
+  return 0;
+}
+
+/**
+ * Read exactly C<len> bytes of a file chunk from channel C<ch>.
+ * Returns C<0> on success or C<-1> on error.
+ */
+static int
+read_chunk_bytes (guestfs_h *g, size_t ch, void *buf, size_t len)
+{
+  ssize_t n;
+
+  if (ch > 0)
+    n = g->conn->ops->read_channel (g, g->conn, ch, buf, len);
+  else
+    n = g->conn->ops->read_data (g, g->conn, buf, len);
+  if (n == -1)
+    return -1;
+  if (n == 0) {
+    guestfs_int_unexpected_close_error (g);
+    child_cleanup (g);
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Read the length word of the next file chunk on channel C<ch>,
+ * handling any progress messages that arrive first.
+ * Returns C<0> on success or C<-1> on error.
+ */
+static int
+recv_chunk_length (guestfs_h *g, size_t ch, uint32_t *len_rtn)
+{
+  char lenbuf[4];
+  XDR xdr;
+
+  if (!g->conn) {
+    guestfs_int_unexpected_close_error (g);
+    return -1;
+  }
+
+  /* Progress messages only arrive on the main channel. */
+  if (ch > 0) {
+    const ssize_t n = check_daemon_socket (g);
+    if (n == -2) {
+      error (g, _("receive_file_data: unexpected cancellation flag"));
+      return -1;
+    }
+    if (n == -1)
+      return -1;
+    if (n == 0) {
+      guestfs_int_unexpected_close_error (g);
+      child_cleanup (g);
+      return -1;
+    }
+  }
+
+ again:
+  if (read_chunk_bytes (g, ch, lenbuf, 4) == -1)
+    return -1;
+
+  xdrmem_create (&xdr, lenbuf, 4, XDR_DECODE);
+  xdr_uint32_t (&xdr, len_rtn);
+  xdr_destroy (&xdr);
+
+  if (ch == 0 && *len_rtn == GUESTFS_PROGRESS_FLAG) {
+    char mbuf[PROGRESS_MESSAGE_SIZE];
+    guestfs_progress message;
+
+    if (read_chunk_bytes (g, ch, mbuf, PROGRESS_MESSAGE_SIZE) == -1)
+      return -1;
+
+    xdrmem_create (&xdr, mbuf, PROGRESS_MESSAGE_SIZE, XDR_DECODE);
+    xdr_guestfs_progress (&xdr, &message);
+    xdr_destroy (&xdr);
+
+    guestfs_int_progress_message_callback (g, &message);
+    goto again;
+  }
+
+  if (*len_rtn == GUESTFS_LAUNCH_FLAG || *len_rtn == GUESTFS_CANCEL_FLAG) {
     error (g, _("receive_file_data: unexpected flag received when reading file chunks"));
     return -1;
   }
 
-  memset (&chunk, 0, sizeof chunk);
+  if (*len_rtn > GUESTFS_MESSAGE_MAX) {
+    error (g, _("message length (%u) > maximum possible size (%d)"),
+           (unsigned) *len_rtn, GUESTFS_MESSAGE_MAX);
+    return -1;
+  }
 
-  xdrmem_create (&xdr, buf, len, XDR_DECODE);
-  if (!xdr_guestfs_chunk (&xdr, &chunk)) {
+  return 0;
+}
+
+/**
+ * Write a hole of C<len> zero bytes sent by the daemon to C<fd>.  If
+ * C<fd> is a regular file which we created or truncated, seek over
+ * it, else write zeroes.
+ *
+ * Returns C<0> on success or C<-1> on error (with C<errno> set).
+ */
+static int
+write_hole (int fd, int seekable, uint64_t len)
+{
+  static const char zeroes[64 * 1024];
+  size_t n;
+
+  if (seekable)
+    return lseek (fd, len, SEEK_CUR) == -1 ? -1 : 0;
+
+  while (len > 0) {
+    n = MIN (len, sizeof zeroes);
+    if (full_write (fd, zeroes, n) != n)
+      return -1;
+    len -= n;
+  }
+
+  return 0;
+}
+
+/**
+ * Read the length word and header of the next file chunk, from the
+ * channel it is striped on.
+ *
+ * A C<guestfs_chunk> is encoded as two XDR words (C<cancel> and the
+ * data length) followed by the data itself and up to 3 bytes of
+ * padding.  Rather than decoding the whole chunk into a buffer (which
+ * copies the data again), the callers read the header with this and
+ * then read the data straight to where it is going.
+ *
+ * Returns C<0> on success or C<-1> on error.
+ */
+static int
+recv_chunk_header (guestfs_h *g, size_t *ch_r, int *cancel_r,
+                   uint32_t *data_len_r, size_t *pad_len_r)
+{
+  const size_t ch = g->next_data_channel;
+  uint32_t len;
+  char hdr[8];
+  XDR xdr;
+
+  if (recv_chunk_length (g, ch, &len) == -1)
+    return -1;
+  g->next_data_channel = (ch + 1) % g->nr_data_channels;
+
+  if (len < sizeof hdr) {
+    error (g, _("failed to parse file chunk"));
+    return -1;
+  }
+  if (read_chunk_bytes (g, ch, hdr, sizeof hdr) == -1)
+    return -1;
+
+  xdrmem_create (&xdr, hdr, sizeof hdr, XDR_DECODE);
+  xdr_int (&xdr, cancel_r);
+  xdr_uint32_t (&xdr, data_len_r);
+  xdr_destroy (&xdr);
+
+  *pad_len_r = (4 - (*data_len_r & 3)) & 3;
+  if (*data_len_r > GUESTFS_MAX_CHUNK_SIZE ||
+      len - sizeof hdr != *data_len_r + *pad_len_r) {
+    error (g, _("failed to parse file chunk"));
+    return -1;
+  }
+
+  *ch_r = ch;
+  return 0;
+}
+
+/**
+ * Read the 8 byte payload of a hole chunk from channel C<ch>.
+ * Returns C<0> on success or C<-1> on error.
+ */
+static int
+recv_hole_length (guestfs_h *g, size_t ch, uint32_t data_len,
+                  uint64_t *hole_len_r)
+{
+  char holebuf[8];
+  XDR xdr;
+
+  if (data_len != sizeof holebuf) {
     error (g, _("failed to parse file chunk"));
     return -1;
   }
+  if (read_chunk_bytes (g, ch, holebuf, sizeof holebuf) == -1)
+    return -1;
+
+  xdrmem_create (&xdr, holebuf, sizeof holebuf, XDR_DECODE);
+  xdr_uint64_t (&xdr, hole_len_r);
   xdr_destroy (&xdr);
 
-  if (chunk.cancel) {
+  if (*hole_len_r == 0 || *hole_len_r > INT64_MAX) {
+    error (g, _("failed to parse file chunk"));
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Decompress the zstd chunk C<data>, which the daemon may send once
+ * C<GUESTFS_CODEC_ZSTD> has been negotiated.  If C<*out_r> is
+ * C<NULL> a buffer is allocated, otherwise it must have room for
+ * C<GUESTFS_MAX_CHUNK_SIZE> bytes.
+ *
+ * Returns the decompressed length or C<-1> on error.
+ */
+static ssize_t
+decode_zstd_chunk (guestfs_h *g, const char *data, uint32_t data_len,
+                   char **out_r)
+{
+#ifdef HAVE_LIBZSTD
+  unsigned long long len;
+  size_t r;
+
+  if (g->chunk_codecs & GUESTFS_CODEC_ZSTD) {
+    len = ZSTD_getFrameContentSize (data, data_len);
+    if (len != ZSTD_CONTENTSIZE_UNKNOWN && len != ZSTD_CONTENTSIZE_ERROR &&
+        len > 0 && len <= GUESTFS_MAX_CHUNK_SIZE) {
+      if (*out_r == NULL)
+        *out_r = safe_malloc (g, len);
+      r = ZSTD_decompressDCtx (g->zstd_dctx, *out_r, len, data, data_len);
+      if (!ZSTD_isError (r) && r == len)
+        return len;
+    }
+  }
+#endif
+
+  error (g, _("failed to parse file chunk"));
+  return -1;
+}
+
+/**
+ * Receive a chunk of file data and write it to C<fd>.  The
+ * connection moves the data directly to C<fd>, which it does with
+ * L<splice(2)> if it can.
+ *
+ * Returns C<-1> = error, C<-2> = error writing to C<fd> (with
+ * C<errno> set), C<0> = EOF, C<E<gt>0> = more data
+ */
+static ssize_t
+receive_file_data_to_fd (guestfs_h *g, int fd, int seekable)
+{
+  size_t ch;
+  uint32_t data_len;
+  int cancel;
+  char pad[4];
+  size_t pad_len;
+  ssize_t n;
+  int write_errno = 0;
+
+  if (recv_chunk_header (g, &ch, &cancel, &data_len, &pad_len) == -1)
+    return -1;
+
+  if (cancel == GUESTFS_CHUNK_HOLE) {
+    uint64_t hole_len;
+
+    if (recv_hole_length (g, ch, data_len, &hole_len) == -1)
+      return -1;
+    if (write_hole (fd, seekable, hole_len) == -1)
+      return -2;
+
+    return data_len;            /* more data follows */
+  }
+
+  if (cancel == GUESTFS_CHUNK_ZSTD) {
+    CLEANUP_FREE char *buf = safe_malloc (g, data_len + pad_len);
+    char *out = g->codec_buf;
+    ssize_t len;
+
+    if (read_chunk_bytes (g, ch, buf, data_len + pad_len) == -1)
+      return -1;
+    len = decode_zstd_chunk (g, buf, data_len, &out);
+    if (len == -1)
+      return -1;
+    if (full_write (fd, out, len) != (size_t) len)
+      return -2;
+
+    return data_len;            /* more data follows */
+  }
+
+  if (data_len > 0 && !cancel) {
+    n = g->conn->ops->splice_channel (g, g->conn, ch, fd, data_len);
+    if (n == -1)
+      return -1;
+    if (n == 0) {
+      guestfs_int_unexpected_close_error (g);
+      child_cleanup (g);
+      return -1;
+    }
+    if (n == -2)
+      write_errno = errno;
+  }
+  else if (data_len > 0) {
+    /* Cancellation chunks should never carry data, but discard it. */
+    CLEANUP_FREE char *buf = safe_malloc (g, data_len);
+    if (read_chunk_bytes (g, ch, buf, data_len) == -1)
+      return -1;
+  }
+
+  if (pad_len > 0 && read_chunk_bytes (g, ch, pad, pad_len) == -1)
+    return -1;
+
+  if (cancel) {
+    if (g->user_cancel)
+      guestfs_int_error_errno (g, EINTR, _("operation cancelled by user"));
+    else
+      error (g, _("file receive cancelled by daemon"));
+    return -1;
+  }
+
+  if (write_errno) {
+    errno = write_errno;
+    return -2;
+  }
+
+  return data_len;             /* 0 = end of transfer */
+}
+
+/**
+ * Receive a chunk of file data.  The data is read directly into the
+ * buffer returned in C<*buf_r>.
+ *
+ * Returns C<-1> = error, C<0> = EOF, C<E<gt>0> = more data
+ */
+static ssize_t
+receive_file_data (guestfs_h *g, void **buf_r, uint64_t *hole_len_r)
+{
+  size_t ch;
+  uint32_t data_len;
+  int cancel;
+  char pad[4];
+  size_t pad_len;
+  char *buf;
+
+  if (recv_chunk_header (g, &ch, &cancel, &data_len, &pad_len) == -1)
+    return -1;
+
+  if (hole_len_r)
+    *hole_len_r = 0;
+  if (cancel == GUESTFS_CHUNK_HOLE) {
+    uint64_t hole_len;
+
+    if (recv_hole_length (g, ch, data_len, &hole_len) == -1)
+      return -1;
+    if (hole_len_r)
+      *hole_len_r = hole_len;
+    return data_len;            /* more data follows */
+  }
+
+  buf = safe_malloc (g, data_len > 0 ? data_len : 1);
+  if ((data_len > 0 && read_chunk_bytes (g, ch, buf, data_len) == -1) ||
+      (pad_len > 0 && read_chunk_bytes (g, ch, pad, pad_len) == -1)) {
+    free (buf);
+    return -1;
+  }
+
+  if (cancel == GUESTFS_CHUNK_ZSTD) {
+    char *out = NULL;
+    const ssize_t len = decode_zstd_chunk (g, buf, data_len, &out);
+
+    free (buf);
+    if (len == -1)
+      return -1;
+    if (buf_r) *buf_r = out;
+    else free (out);
+    return len;
+  }
+
+  if (cancel) {
     if (g->user_cancel)
       guestfs_int_error_errno (g, EINTR, _("operation cancelled by user"));
     else
       error (g, _("file receive cancelled by daemon"));
-    free (chunk.data.data_val);
+    free (buf);
     return -1;
   }
 
-  if (chunk.data.data_len == 0) { /* end of transfer */
-    free (chunk.data.data_val);
+  if (data_len == 0) {          /* end of transfer */
+    free (buf);
     return 0;
   }
 
-  if (buf_r) *buf_r = chunk.data.data_val;
-  else free (chunk.data.data_val); /* else caller frees */
+  if (buf_r) *buf_r = buf;
+  else free (buf); /* else caller frees */
 
-  return chunk.data.data_len;
+  return data_len;
 }
 
 int
 guestfs_user_cancel (guestfs_h *g)
 {
+  const char c = 0;
+
   g->user_cancel = 1;
+  /* Wake up recv_reply if it is waiting.  This is safe to call from
+   * a signal handler.
+   */
+  ignore_value (write (g->cancel_pipe[1], &c, 1));
   return 0;
 }
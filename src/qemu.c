@@ -37,6 +37,7 @@
 
 #include <libxml/uri.h>
 
+#include "full-write.h"
 #include "ignore-value.h"
 
 #include "guestfs.h"
@@ -46,21 +47,131 @@
 struct qemu_data {
   char *qemu_help;              /* Output of qemu -help. */
   char *qemu_devices;           /* Output of qemu -device ? */
+  /* The two strings above are NULL if the data was loaded from
+   * qemu.features, until something needs them.
+   */
+
+  uint64_t features;            /* Bitmask, see qemu_features below. */
 
   int virtio_scsi;              /* See function
                                    guestfs_int_qemu_supports_virtio_scsi */
 };
 
+/**
+ * The options and devices which the backends test for.  Whether each
+ * of these is supported is worked out once from the C<qemu -help> and
+ * C<qemu -device ?> output and saved as a bitmask in F<qemu.features>,
+ * so launching normally does no parsing of qemu output at all.
+ *
+ * There can be at most 64 entries.  Entries must only be added to the
+ * end.  If you remove or reorder entries, increment
+ * C<MEMO_GENERATION>.
+ */
+static const struct qemu_feature {
+  const char *name;
+  bool is_device;               /* Search qemu -device ? output. */
+} qemu_features[] = {
+  { "-global", false },
+  { "-nodefconfig", false },
+  { "-enable-fips", false },
+  { "-nodefaults", false },
+  { "-no-hpet", false },
+  { "virtio-rng-pci", true },
+  { "Serial Graphics Adapter", true },
+  { VIRTIO_SCSI, true },
+};
+#define NR_QEMU_FEATURES (sizeof qemu_features / sizeof qemu_features[0])
+
 static int test_qemu (guestfs_h *g, struct qemu_data *data, struct version *qemu_version);
 static void parse_qemu_version (guestfs_h *g, const char *, struct version *qemu_version);
 static void read_all (guestfs_h *g, void *retv, const char *buf, size_t len);
+static int load_qemu_output (guestfs_h *g, struct qemu_data *data);
+
+/* This is saved in the qemu.features file, so if we decide to change
+ * the test_qemu memoization format/data in future, we should
+ * increment this to discard any memoized data cached by previous
+ * versions of libguestfs.
+ */
+#define MEMO_GENERATION 2
 
-/* This is saved in the qemu.stat file, so if we decide to change the
- * test_qemu memoization format/data in future, we should increment
- * this to discard any memoized data cached by previous versions of
- * libguestfs.
+/**
+ * Read F<qemu.features>.  If it exists and was written for the same
+ * qemu binary (same device, inode, size and mtime), fill in
+ * C<data-E<gt>features> and C<qemu_version> and return C<0>.
+ * Otherwise return C<-1>, without setting an error.
  */
-#define MEMO_GENERATION 1
+static int
+read_qemu_features (guestfs_h *g, const char *filename,
+                    const struct stat *statbuf,
+                    struct qemu_data *data, struct version *qemu_version)
+{
+  FILE *fp;
+  int generation;
+  uint64_t prev_dev, prev_ino, prev_size, prev_mtime, features;
+  int major, minor, micro;
+  int r;
+
+  fp = fopen (filename, "r");
+  if (fp == NULL)
+    return -1;
+  r = fscanf (fp, "%d %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+              " %d %d %d %" SCNx64,
+              &generation, &prev_dev, &prev_ino, &prev_size, &prev_mtime,
+              &major, &minor, &micro, &features);
+  fclose (fp);
+  if (r != 9)
+    return -1;
+
+  if (generation != MEMO_GENERATION ||
+      (uint64_t) statbuf->st_dev != prev_dev ||
+      (uint64_t) statbuf->st_ino != prev_ino ||
+      (uint64_t) statbuf->st_size != prev_size ||
+      (uint64_t) statbuf->st_mtime != prev_mtime)
+    return -1;
+
+  qemu_version->v_major = major;
+  qemu_version->v_minor = minor;
+  qemu_version->v_micro = micro;
+  data->features = features;
+  return 0;
+}
+
+/**
+ * Write C<content> to C<filename> atomically, so that concurrent
+ * processes sharing the cache directory only ever see complete
+ * files.
+ */
+static int
+write_cache_file (guestfs_h *g, const char *filename, const char *content)
+{
+  CLEANUP_FREE char *tmpfile = safe_asprintf (g, "%s.XXXXXX", filename);
+  const size_t len = strlen (content);
+  int fd;
+
+  fd = mkstemp (tmpfile);
+  if (fd == -1) {
+    perrorf (g, "mkstemp: %s", tmpfile);
+    return -1;
+  }
+  if (full_write (fd, content, len) != len) {
+    perrorf (g, "write: %s", tmpfile);
+    close (fd);
+    unlink (tmpfile);
+    return -1;
+  }
+  if (close (fd) == -1) {
+    perrorf (g, "close: %s", tmpfile);
+    unlink (tmpfile);
+    return -1;
+  }
+  if (rename (tmpfile, filename) == -1) {
+    perrorf (g, "rename: %s", filename);
+    unlink (tmpfile);
+    return -1;
+  }
+
+  return 0;
+}
 
 /**
  * Test qemu binary (or wrapper) runs, and do C<qemu -help> so we know
@@ -71,18 +182,20 @@ static void read_all (guestfs_h *g, void *retv, const char *buf, size_t len);
  * C<&qemu_version>.
  *
  * This caches the results in the cachedir so that as long as the qemu
- * binary does not change, calling this is effectively free.
+ * binary does not change, calling this is effectively free: it reads
+ * one line from F<qemu.features>.  The full output is also saved in
+ * F<qemu.help> and F<qemu.devices> in case something asks about an
+ * option or device which is not in C<qemu_features>.
  */
 struct qemu_data *
 guestfs_int_test_qemu (guestfs_h *g, struct version *qemu_version)
 {
   struct qemu_data *data;
   struct stat statbuf;
-  CLEANUP_FREE char *cachedir = NULL, *qemu_stat_filename = NULL,
+  CLEANUP_FREE char *cachedir = NULL, *qemu_features_filename = NULL,
     *qemu_help_filename = NULL, *qemu_devices_filename = NULL;
-  FILE *fp;
-  int generation;
-  uint64_t prev_size, prev_mtime;
+  CLEANUP_FREE char *features_line = NULL;
+  size_t i;
 
   if (stat (g->hv, &statbuf) == -1) {
     perrorf (g, "stat: %s", g->hv);
@@ -93,7 +206,7 @@ guestfs_int_test_qemu (guestfs_h *g, struct version *qemu_version)
   if (cachedir == NULL)
     return NULL;
 
-  qemu_stat_filename = safe_asprintf (g, "%s/qemu.stat", cachedir);
+  qemu_features_filename = safe_asprintf (g, "%s/qemu.features", cachedir);
   qemu_help_filename = safe_asprintf (g, "%s/qemu.help", cachedir);
   qemu_devices_filename = safe_asprintf (g, "%s/qemu.devices", cachedir);
 
@@ -101,110 +214,98 @@ guestfs_int_test_qemu (guestfs_h *g, struct version *qemu_version)
   debug (g, "checking for previously cached test results of %s, in %s",
          g->hv, cachedir);
 
-  fp = fopen (qemu_stat_filename, "r");
-  if (fp == NULL)
-    goto do_test;
-  if (fscanf (fp, "%d %" SCNu64 " %" SCNu64,
-              &generation, &prev_size, &prev_mtime) != 3) {
-    fclose (fp);
-    goto do_test;
-  }
-  fclose (fp);
-
-  if (generation == MEMO_GENERATION &&
-      (uint64_t) statbuf.st_size == prev_size &&
-      (uint64_t) statbuf.st_mtime == prev_mtime) {
-    /* Same binary as before, so read the previously cached qemu -help
-     * and qemu -devices ? output.
-     */
-    if (access (qemu_help_filename, R_OK) == -1 ||
-        access (qemu_devices_filename, R_OK) == -1)
-      goto do_test;
-
-    debug (g, "loading previously cached test results");
-
-    data = safe_calloc (g, 1, sizeof *data);
-
-    if (guestfs_int_read_whole_file (g, qemu_help_filename,
-                                     &data->qemu_help, NULL) == -1) {
-      guestfs_int_free_qemu_data (data);
-      return NULL;
-    }
-
-    parse_qemu_version (g, data->qemu_help, qemu_version);
-
-    if (guestfs_int_read_whole_file (g, qemu_devices_filename,
-                                     &data->qemu_devices, NULL) == -1) {
-      guestfs_int_free_qemu_data (data);
-      return NULL;
-    }
+  data = safe_calloc (g, 1, sizeof *data);
 
+  if (read_qemu_features (g, qemu_features_filename, &statbuf,
+                          data, qemu_version) == 0) {
+    debug (g, "loaded previously cached test results: "
+           "qemu version %d.%d, features %" PRIx64,
+           qemu_version->v_major, qemu_version->v_minor, data->features);
     return data;
   }
 
- do_test:
-  data = safe_calloc (g, 1, sizeof *data);
-
   if (test_qemu (g, data, qemu_version) == -1) {
     guestfs_int_free_qemu_data (data);
     return NULL;
   }
 
-  /* Now memoize the qemu output in the cache directory. */
-  debug (g, "saving test results");
+  for (i = 0; i < NR_QEMU_FEATURES; ++i) {
+    const char *output =
+      qemu_features[i].is_device ? data->qemu_devices : data->qemu_help;
 
-  fp = fopen (qemu_help_filename, "w");
-  if (fp == NULL) {
-  help_error:
-    perrorf (g, "%s", qemu_help_filename);
-    if (fp != NULL) fclose (fp);
-    guestfs_int_free_qemu_data (data);
-    return NULL;
-  }
-  if (fprintf (fp, "%s", data->qemu_help) == -1)
-    goto help_error;
-  if (fclose (fp) == -1)
-    goto help_error;
-
-  fp = fopen (qemu_devices_filename, "w");
-  if (fp == NULL) {
-  devices_error:
-    perrorf (g, "%s", qemu_devices_filename);
-    if (fp != NULL) fclose (fp);
-    guestfs_int_free_qemu_data (data);
-    return NULL;
+    if (strstr (output, qemu_features[i].name) != NULL)
+      data->features |= UINT64_C(1) << i;
   }
-  if (fprintf (fp, "%s", data->qemu_devices) == -1)
-    goto devices_error;
-  if (fclose (fp) == -1)
-    goto devices_error;
 
-  /* Write the qemu.stat file last so that its presence indicates that
-   * the qemu.help and qemu.devices files ought to exist.
+  /* Now memoize the results in the cache directory.  Write the
+   * qemu.features file last so that its presence indicates that the
+   * qemu.help and qemu.devices files ought to exist.
    */
-  fp = fopen (qemu_stat_filename, "w");
-  if (fp == NULL) {
-  stat_error:
-    perrorf (g, "%s", qemu_stat_filename);
-    if (fp != NULL) fclose (fp);
-    guestfs_int_free_qemu_data (data);
-    return NULL;
-  }
+  debug (g, "saving test results");
+
   /* The path to qemu is stored for information only, it is not
    * used when we parse the file.
    */
-  if (fprintf (fp, "%d %" PRIu64 " %" PRIu64 " %s\n",
-               MEMO_GENERATION,
-               (uint64_t) statbuf.st_size,
-               (uint64_t) statbuf.st_mtime,
-               g->hv) == -1)
-    goto stat_error;
-  if (fclose (fp) == -1)
-    goto stat_error;
+  features_line =
+    safe_asprintf (g, "%d %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+                   " %d %d %d %" PRIx64 " %s\n",
+                   MEMO_GENERATION,
+                   (uint64_t) statbuf.st_dev,
+                   (uint64_t) statbuf.st_ino,
+                   (uint64_t) statbuf.st_size,
+                   (uint64_t) statbuf.st_mtime,
+                   qemu_version->v_major, qemu_version->v_minor,
+                   qemu_version->v_micro,
+                   data->features, g->hv);
+
+  if (write_cache_file (g, qemu_help_filename, data->qemu_help) == -1 ||
+      write_cache_file (g, qemu_devices_filename, data->qemu_devices) == -1 ||
+      write_cache_file (g, qemu_features_filename, features_line) == -1) {
+    guestfs_int_free_qemu_data (data);
+    return NULL;
+  }
 
   return data;
 }
 
+/**
+ * If the qemu data was loaded from F<qemu.features>, load the full
+ * C<qemu -help> and C<qemu -device ?> output as well.  This is only
+ * needed for options and devices not listed in C<qemu_features>.
+ */
+static int
+load_qemu_output (guestfs_h *g, struct qemu_data *data)
+{
+  CLEANUP_FREE char *cachedir = NULL, *qemu_help_filename = NULL,
+    *qemu_devices_filename = NULL;
+  struct version qemu_version;
+
+  if (data->qemu_help && data->qemu_devices)
+    return 0;
+
+  cachedir = guestfs_int_lazy_make_supermin_appliance_dir (g);
+  if (cachedir == NULL)
+    return -1;
+  qemu_help_filename = safe_asprintf (g, "%s/qemu.help", cachedir);
+  qemu_devices_filename = safe_asprintf (g, "%s/qemu.devices", cachedir);
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  if (guestfs_int_read_whole_file (g, qemu_help_filename,
+                                   &data->qemu_help, NULL) == 0 &&
+      guestfs_int_read_whole_file (g, qemu_devices_filename,
+                                   &data->qemu_devices, NULL) == 0) {
+    guestfs_pop_error_handler (g);
+    return 0;
+  }
+  guestfs_pop_error_handler (g);
+
+  /* Somebody removed the files, so run qemu again. */
+  free (data->qemu_help);
+  free (data->qemu_devices);
+  data->qemu_help = data->qemu_devices = NULL;
+  return test_qemu (g, data, &qemu_version);
+}
+
 static int
 test_qemu (guestfs_h *g, struct qemu_data *data, struct version *qemu_version)
 {
@@ -280,14 +381,41 @@ read_all (guestfs_h *g, void *retv, const char *buf, size_t len)
   *ret = safe_strndup (g, buf, len);
 }
 
+/**
+ * Look up C<name> in C<qemu_features>.  Returns C<1> or C<0> if it
+ * is there, or C<-1> if it is not listed.
+ */
+static int
+test_qemu_feature (const struct qemu_data *data, const char *name,
+                   bool is_device)
+{
+  size_t i;
+
+  for (i = 0; i < NR_QEMU_FEATURES; ++i) {
+    if (qemu_features[i].is_device == is_device &&
+        STREQ (qemu_features[i].name, name))
+      return (data->features & (UINT64_C(1) << i)) != 0;
+  }
+
+  return -1;
+}
+
 /**
  * Test if option is supported by qemu command line (just by grepping
  * the help text).
  */
 int
-guestfs_int_qemu_supports (guestfs_h *g, const struct qemu_data *data,
+guestfs_int_qemu_supports (guestfs_h *g, struct qemu_data *data,
                            const char *option)
 {
+  int r;
+
+  r = test_qemu_feature (data, option, false);
+  if (r >= 0)
+    return r;
+
+  if (load_qemu_output (g, data) == -1)
+    return 0;
   return strstr (data->qemu_help, option) != NULL;
 }
 
@@ -297,9 +425,17 @@ guestfs_int_qemu_supports (guestfs_h *g, const struct qemu_data *data,
  */
 int
 guestfs_int_qemu_supports_device (guestfs_h *g,
-                                  const struct qemu_data *data,
+                                  struct qemu_data *data,
                                   const char *device_name)
 {
+  int r;
+
+  r = test_qemu_feature (data, device_name, true);
+  if (r >= 0)
+    return r;
+
+  if (load_qemu_output (g, data) == -1)
+    return 0;
   return strstr (data->qemu_devices, device_name) != NULL;
 }
 
@@ -347,6 +483,37 @@ guestfs_int_qemu_supports_virtio_scsi (guestfs_h *g, struct qemu_data *data,
   return data->virtio_scsi == 1;
 }
 
+/**
+ * Return the C<aio> mode to use for drive C<drv> (see
+ * C<guestfs_set_aio>), or C<NULL> to use the hypervisor's default.
+ * Only raw host block devices which are not behind an overlay use
+ * native or io_uring AIO.  The C<io_uring> mode needs qemu E<ge> 5.0,
+ * and is otherwise ignored.
+ */
+const char *
+guestfs_int_drive_aio (guestfs_h *g, struct drive *drv,
+                       const struct version *qemu_version)
+{
+  struct stat statbuf;
+
+  if (g->aio == NULL || drv == NULL || drv->overlay ||
+      drv->src.protocol != drive_protocol_file ||
+      drv->src.format == NULL || STRNEQ (drv->src.format, "raw"))
+    return NULL;
+
+  if (stat (drv->src.u.path, &statbuf) == -1 || !S_ISBLK (statbuf.st_mode))
+    return NULL;
+
+  if (STREQ (g->aio, "io_uring") &&
+      !guestfs_int_version_ge (qemu_version, 5, 0, 0)) {
+    debug (g, "%s: io_uring needs qemu >= 5.0, using the default aio mode",
+           drv->src.u.path);
+    return NULL;
+  }
+
+  return g->aio;
+}
+
 /**
  * Escape a qemu parameter.
  *
@@ -0,0 +1,347 @@
+/* libguestfs
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * A minimal client for the QEMU Machine Protocol (QMP).
+ *
+ * This is used by the direct backend to save and restore appliance
+ * snapshots and to hotplug drives into a restored appliance.
+ *
+ * QMP is a line-based JSON protocol.  We only send a handful of
+ * fixed commands and need to know whether they succeeded, so instead
+ * of using a JSON parser the replies are examined with simple string
+ * matching.  Asynchronous events are ignored.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <libintl.h>
+
+#include "c-ctype.h"
+#include "full-write.h"
+
+#include "guestfs.h"
+#include "guestfs-internal.h"
+
+/* How long to wait for qemu to connect and to reply to commands. */
+#define QMP_TIMEOUT 60 /* seconds */
+
+/* Longest reply line we will accept. */
+#define QMP_MAX_LINE 65536
+
+/**
+ * Read a single line (terminated by C<\n>) from the QMP socket.
+ * The line terminator is removed.  Returns the line (caller frees)
+ * or C<NULL> on error.
+ */
+static char *
+read_line (guestfs_h *g, int sock)
+{
+  CLEANUP_FREE char *line = NULL;
+  size_t len = 0, alloc = 0;
+  struct pollfd fds[1];
+  char c;
+  ssize_t r;
+
+  for (;;) {
+    fds[0].fd = sock;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    r = poll (fds, 1, QMP_TIMEOUT * 1000);
+    if (r == -1) {
+      if (errno == EINTR)
+        continue;
+      perrorf (g, "qmp: poll");
+      return NULL;
+    }
+    if (r == 0) {
+      error (g, _("qmp: timed out waiting for a reply from qemu"));
+      return NULL;
+    }
+
+    r = read (sock, &c, 1);
+    if (r == -1) {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+      perrorf (g, "qmp: read");
+      return NULL;
+    }
+    if (r == 0) {
+      error (g, _("qmp: qemu closed the monitor connection"));
+      return NULL;
+    }
+    if (c == '\n')
+      break;
+
+    if (len >= QMP_MAX_LINE) {
+      error (g, _("qmp: reply from qemu is too long"));
+      return NULL;
+    }
+    if (len+2 > alloc) {
+      alloc = alloc ? alloc * 2 : 256;
+      line = safe_realloc (g, line, alloc);
+    }
+    line[len++] = c;
+  }
+
+  if (line == NULL)
+    line = safe_malloc (g, 1);
+  if (len > 0 && line[len-1] == '\r')
+    len--;
+  line[len] = '\0';
+
+  char *ret = line;
+  line = NULL;
+  return ret;
+}
+
+/**
+ * Find the JSON string value of C<key> in C<reply> (eg. for
+ * C<"desc": "some error">).  Escape sequences are not decoded.
+ * Returns the string (caller frees) or C<NULL> if not found.
+ */
+static char *
+get_string (guestfs_h *g, const char *reply, const char *key)
+{
+  CLEANUP_FREE char *quoted_key = safe_asprintf (g, "\"%s\"", key);
+  const char *p, *end;
+
+  p = strstr (reply, quoted_key);
+  if (p == NULL)
+    return NULL;
+  p += strlen (quoted_key);
+  while (c_isspace (*p))
+    p++;
+  if (*p != ':')
+    return NULL;
+  p++;
+  while (c_isspace (*p))
+    p++;
+  if (*p != '"')
+    return NULL;
+  p++;
+
+  for (end = p; *end && *end != '"'; ++end) {
+    if (*end == '\\' && end[1])
+      end++;
+  }
+
+  return safe_strndup (g, p, end - p);
+}
+
+/**
+ * Return true if C<reply> contains C<"key": "value...">, that is, a
+ * string value for C<key> starting with C<value>.
+ */
+int
+guestfs_int_qmp_match (guestfs_h *g, const char *reply,
+                       const char *key, const char *value)
+{
+  CLEANUP_FREE char *str = get_string (g, reply, key);
+
+  return str && STRPREFIX (str, value);
+}
+
+/**
+ * Quote C<str> as a JSON string, including the surrounding double
+ * quotes.  The caller must free the result.
+ */
+char *
+guestfs_int_qmp_quote (guestfs_h *g, const char *str)
+{
+  char *ret, *p;
+
+  /* Worst case every character becomes \u00XX. */
+  ret = safe_malloc (g, strlen (str) * 6 + 3);
+  p = ret;
+
+  *p++ = '"';
+  for (; *str; ++str) {
+    const unsigned char c = *str;
+
+    if (c == '"' || c == '\\') {
+      *p++ = '\\';
+      *p++ = c;
+    }
+    else if (c < 0x20)
+      p += sprintf (p, "\\u%04x", c);
+    else
+      *p++ = c;
+  }
+  *p++ = '"';
+  *p = '\0';
+
+  return ret;
+}
+
+/**
+ * Send a command (a complete JSON object, formatted from C<fs>) and
+ * wait for its reply.
+ *
+ * If the command succeeds this returns C<0>, and if C<reply_rtn> is
+ * not C<NULL> the reply line is returned there (caller frees).  If
+ * qemu returns an error, or on any other failure, this sets the
+ * handle error and returns C<-1>.
+ */
+int
+guestfs_int_qmp_command (guestfs_h *g, int sock, char **reply_rtn,
+                         const char *fs, ...)
+{
+  va_list args;
+  CLEANUP_FREE char *cmd = NULL;
+  char *reply;
+  size_t len;
+  int r;
+
+  va_start (args, fs);
+  r = vasprintf (&cmd, fs, args);
+  va_end (args);
+  if (r == -1) {
+    perrorf (g, "vasprintf");
+    return -1;
+  }
+
+  debug (g, "qmp: send: %s", cmd);
+
+  len = strlen (cmd);
+  cmd[len] = '\n';              /* overwrites the \0, which we don't send */
+  if (full_write (sock, cmd, len+1) != len+1) {
+    perrorf (g, "qmp: write");
+    return -1;
+  }
+  cmd[len] = '\0';
+
+  for (;;) {
+    reply = read_line (g, sock);
+    if (reply == NULL)
+      return -1;
+
+    /* Skip asynchronous events. */
+    if (strstr (reply, "\"event\"") == NULL ||
+        strstr (reply, "\"return\"") != NULL)
+      break;
+    debug (g, "qmp: event: %s", reply);
+    free (reply);
+  }
+
+  debug (g, "qmp: recv: %s", reply);
+
+  if (strstr (reply, "\"error\"") != NULL) {
+    CLEANUP_FREE char *desc = get_string (g, reply, "desc");
+
+    error (g, _("qemu monitor: %s: %s"), cmd, desc ? desc : reply);
+    free (reply);
+    return -1;
+  }
+
+  if (strstr (reply, "\"return\"") == NULL) {
+    error (g, _("qemu monitor: %s: unexpected reply: %s"), cmd, reply);
+    free (reply);
+    return -1;
+  }
+
+  if (reply_rtn)
+    *reply_rtn = reply;
+  else
+    free (reply);
+  return 0;
+}
+
+/**
+ * Wait for qemu (process C<pid>) to connect to the listening socket
+ * C<accept_sock> (which was passed to qemu as C<-qmp unix:...>), read
+ * the greeting and negotiate capabilities.  C<accept_sock> is always
+ * closed.  Returns the connected socket or C<-1> on error.
+ */
+int
+guestfs_int_qmp_accept (guestfs_h *g, int accept_sock, pid_t pid)
+{
+  struct pollfd fds[1];
+  int sock = -1;
+  time_t start_t, now_t;
+  CLEANUP_FREE char *greeting = NULL;
+  int r;
+
+  time (&start_t);
+
+  for (;;) {
+    fds[0].fd = accept_sock;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    r = poll (fds, 1, 1000);
+    if (r == -1) {
+      if (errno == EINTR)
+        continue;
+      perrorf (g, "qmp: poll");
+      goto error;
+    }
+    if (r > 0)
+      break;
+
+    /* Check that qemu is still running. */
+    if (pid > 0 && waitpid (pid, NULL, WNOHANG) != 0) {
+      error (g, _("qmp: qemu exited before connecting to the monitor"));
+      goto error;
+    }
+    if (time (&now_t) - start_t > QMP_TIMEOUT) {
+      error (g, _("qmp: timed out waiting for qemu to connect"));
+      goto error;
+    }
+  }
+
+  sock = accept4 (accept_sock, NULL, NULL, SOCK_CLOEXEC);
+  if (sock == -1) {
+    perrorf (g, "qmp: accept");
+    goto error;
+  }
+  close (accept_sock);
+  accept_sock = -1;
+
+  greeting = read_line (g, sock);
+  if (greeting == NULL)
+    goto error;
+  debug (g, "qmp: greeting: %s", greeting);
+  if (strstr (greeting, "\"QMP\"") == NULL) {
+    error (g, _("qmp: unexpected greeting from qemu: %s"), greeting);
+    goto error;
+  }
+
+  if (guestfs_int_qmp_command (g, sock, NULL,
+                               "{ \"execute\": \"qmp_capabilities\" }") == -1)
+    goto error;
+
+  return sock;
+
+ error:
+  if (accept_sock >= 0)
+    close (accept_sock);
+  if (sock >= 0)
+    close (sock);
+  return -1;
+}
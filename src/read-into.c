@@ -0,0 +1,234 @@
+/* libguestfs
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * Variants of C<guestfs_pread>, C<guestfs_pread_device> and
+ * C<guestfs_read_file> which read into a buffer supplied by the
+ * caller, instead of returning a newly allocated buffer.
+ *
+ * The pread replies are decoded straight from the message into the
+ * caller's buffer, and the file downloaded by C<guestfs_read_file_into>
+ * is copied into it as each chunk arrives, so the data is copied once
+ * in the library.  Language bindings use these to read into buffers
+ * owned by the language (eg. a Python C<bytearray>) without another
+ * copy.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <libintl.h>
+
+#include <rpc/types.h>
+#include <rpc/xdr.h>
+
+#include "guestfs.h"
+#include "guestfs-internal.h"
+#include "guestfs_protocol.h"
+#include "errnostring.h"
+
+/* The reply to pread and pread_device is "opaque content<>".  Unlike
+ * xdr_guestfs_pread_ret, this decodes it into the caller's buffer,
+ * which must not be overflowed whatever the daemon sends.
+ */
+struct pread_into_ret {
+  char *buf;
+  u_int len;
+  u_int count;                  /* Size of buf. */
+};
+
+static bool_t
+xdr_pread_into_ret (XDR *xdrs, struct pread_into_ret *ret)
+{
+  return xdr_bytes (xdrs, &ret->buf, &ret->len, ret->count);
+}
+
+static int64_t
+pread_into (guestfs_h *g, const char *name, int proc_nr,
+            xdrproc_t xdr_args, char *args,
+            char *buf, size_t count)
+{
+  guestfs_message_header hdr;
+  guestfs_message_error err;
+  struct pread_into_ret ret = { .buf = buf, .len = 0, .count = count };
+  int serial;
+  int r;
+
+  guestfs_int_call_callbacks_message (g, GUESTFS_EVENT_ENTER,
+                                      name, strlen (name));
+
+  if (buf == NULL && count > 0) {
+    error (g, "%s: %s: parameter cannot be NULL", name, "buf");
+    return -1;
+  }
+  /* The daemon limits the count to a single message anyway. */
+  if (count > GUESTFS_MESSAGE_MAX) {
+    error (g, _("%s: count is too large for the protocol, use smaller reads"),
+           name);
+    return -1;
+  }
+
+  if (guestfs_int_check_appliance_up (g, name) == -1)
+    return -1;
+
+  serial = guestfs_int_send (g, proc_nr, 0, 0, xdr_args, args);
+  if (serial == -1)
+    return -1;
+
+  memset (&hdr, 0, sizeof hdr);
+  memset (&err, 0, sizeof err);
+
+  r = guestfs_int_recv (g, name, serial, &hdr, &err,
+                        (xdrproc_t) xdr_pread_into_ret, (char *) &ret);
+  if (r == -1)
+    return -1;
+
+  if (guestfs_int_check_reply_header (g, &hdr, proc_nr, serial) == -1)
+    return -1;
+
+  if (hdr.status == GUESTFS_STATUS_ERROR) {
+    int errnum = 0;
+
+    if (err.errno_string[0] != '\0')
+      errnum = guestfs_int_string_to_errno (err.errno_string);
+    if (errnum <= 0)
+      error (g, "%s: %s", name, err.error_message);
+    else
+      guestfs_int_error_errno (g, errnum, "%s: %s", name,
+                               err.error_message);
+    free (err.error_message);
+    free (err.errno_string);
+    return -1;
+  }
+
+  return ret.len;
+}
+
+/**
+ * Read up to C<count> bytes at C<offset> from the file C<path> into
+ * C<buf>, like L<pread(2)>.  Returns the number of bytes read, C<0>
+ * at the end of the file, or C<-1> on error.
+ */
+GUESTFS_DLL_PUBLIC int64_t
+guestfs_pread_into (guestfs_h *g, const char *path,
+                    void *buf, size_t count, int64_t offset)
+{
+  struct guestfs_pread_args args;
+
+  if (path == NULL) {
+    error (g, "%s: %s: parameter cannot be NULL", "pread_into", "path");
+    return -1;
+  }
+
+  args.path = (char *) path;
+  args.count = count;
+  args.offset = offset;
+
+  return pread_into (g, "pread_into", GUESTFS_PROC_PREAD,
+                     (xdrproc_t) xdr_guestfs_pread_args, (char *) &args,
+                     buf, count);
+}
+
+/**
+ * The same as C<guestfs_pread_into>, but reads from a device.
+ */
+GUESTFS_DLL_PUBLIC int64_t
+guestfs_pread_device_into (guestfs_h *g, const char *device,
+                           void *buf, size_t count, int64_t offset)
+{
+  struct guestfs_pread_device_args args;
+
+  if (device == NULL) {
+    error (g, "%s: %s: parameter cannot be NULL",
+           "pread_device_into", "device");
+    return -1;
+  }
+
+  args.device = (char *) device;
+  args.count = count;
+  args.offset = offset;
+
+  return pread_into (g, "pread_device_into", GUESTFS_PROC_PREAD_DEVICE,
+                     (xdrproc_t) xdr_guestfs_pread_device_args,
+                     (char *) &args,
+                     buf, count);
+}
+
+struct read_file_into_data {
+  char *buf;
+  size_t size;                  /* Size of buf. */
+  size_t len;                   /* Bytes received so far. */
+  const char *path;
+};
+
+static int
+read_file_into_chunk (guestfs_h *g, const char *chunk, size_t len,
+                      void *datav)
+{
+  struct read_file_into_data *data = datav;
+
+  if (len > data->size - data->len) {
+    guestfs_int_error_errno (g, ERANGE,
+                             _("read_file_into: %s: file is larger than the buffer (%zu bytes)"),
+                             data->path, data->size);
+    return -1;
+  }
+
+  memcpy (data->buf + data->len, chunk, len);
+  data->len += len;
+  return 0;
+}
+
+/**
+ * Read the whole of the file C<path> into C<buf>, which is C<size>
+ * bytes long.  Returns the size of the file, or C<-1> on error.  If
+ * the file is larger than the buffer the error is C<ERANGE> (see
+ * C<guestfs_last_errno>), and the contents of the buffer are
+ * undefined.
+ */
+GUESTFS_DLL_PUBLIC int64_t
+guestfs_read_file_into (guestfs_h *g, const char *path,
+                        void *buf, size_t size)
+{
+  struct read_file_into_data data = {
+    .buf = buf, .size = size, .len = 0, .path = path
+  };
+  struct recv_buffer rbuf = {
+    .data = NULL, .chunk_cb = read_file_into_chunk, .opaque = &data
+  };
+  int r;
+
+  if (path == NULL || (buf == NULL && size > 0)) {
+    error (g, "%s: %s: parameter cannot be NULL",
+           "read_file_into", path == NULL ? "path" : "buf");
+    return -1;
+  }
+
+  /* As in guestfs_read_file, receive the file into memory. */
+  g->recv_buffer = &rbuf;
+  r = guestfs_download (g, path, "/dev/null");
+  g->recv_buffer = NULL;
+  if (r == -1)
+    return -1;
+
+  return data.len;
+}
@@ -0,0 +1,300 @@
+/* libguestfs
+ * Copyright (C) 2016 Red Hat Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * Per-procedure statistics about calls made to the daemon.
+ *
+ * This is only enabled by C<guestfs_set_rpc_stats>, and when it is
+ * disabled C<g-E<gt>rpc_stats> is C<NULL> so that the functions here
+ * return immediately.  F<src/proto.c> calls into this file when a
+ * call is sent, when its reply is received, and for each chunk of
+ * C<FileIn> or C<FileOut> data.
+ *
+ * Latencies are collected in a histogram with one bucket for each
+ * power of two microseconds, which is enough to see where the bulk
+ * of the calls lie without keeping every sample.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/time.h>
+#include <rpc/types.h>
+#include <rpc/xdr.h>
+
+#include "guestfs.h"
+#include "guestfs-internal.h"
+#include "guestfs_protocol.h"
+
+#define NR_LATENCY_BUCKETS 32
+
+/* Statistics for a single procedure. */
+struct rpc_proc_stats {
+  const char *name;             /* Function name, static string. */
+  uint64_t calls;
+  uint64_t errors;
+  uint64_t bytes_sent;          /* Call and reply messages. */
+  uint64_t bytes_received;
+  uint64_t file_bytes;          /* FileIn and FileOut data. */
+  uint64_t total_us;            /* Sum of latencies. */
+  uint64_t max_us;
+  /* Bucket i counts calls which took [2^i, 2^(i+1)) microseconds
+   * (bucket 0 also counts calls which took < 1 microsecond).
+   */
+  uint64_t latency[NR_LATENCY_BUCKETS];
+};
+
+/* A call which has been sent but whose reply has not arrived. */
+struct rpc_in_flight {
+  unsigned serial;
+  int proc_nr;
+  struct timeval start;
+};
+
+struct rpc_stats {
+  struct rpc_proc_stats *procs[GUESTFS_MAX_PROC_NR+1];
+
+  struct rpc_in_flight *in_flight;
+  size_t nr_in_flight;
+
+  /* The procedure which most recently sent a call or received a
+   * reply.  File data is accounted to this procedure.
+   */
+  int last_proc_nr;
+};
+
+static struct rpc_proc_stats *
+get_proc_stats (guestfs_h *g, int proc_nr)
+{
+  struct rpc_stats *s = g->rpc_stats;
+
+  if (proc_nr < 0 || proc_nr > GUESTFS_MAX_PROC_NR)
+    return NULL;
+
+  if (s->procs[proc_nr] == NULL)
+    s->procs[proc_nr] = safe_calloc (g, 1, sizeof (struct rpc_proc_stats));
+  return s->procs[proc_nr];
+}
+
+/**
+ * Record that call C<serial> of procedure C<proc_nr> was sent, and
+ * that the message was C<bytes> long.
+ */
+void
+guestfs_int_rpc_stats_send (guestfs_h *g, int proc_nr, unsigned serial,
+                            size_t bytes)
+{
+  struct rpc_stats *s = g->rpc_stats;
+  struct rpc_proc_stats *p;
+  struct rpc_in_flight *f;
+
+  if (s == NULL)
+    return;
+  p = get_proc_stats (g, proc_nr);
+  if (p == NULL)
+    return;
+
+  p->bytes_sent += bytes;
+  s->last_proc_nr = proc_nr;
+
+  /* If no asynchronous calls are in flight then any calls left in
+   * the list never got a reply (eg. the appliance died), so forget
+   * about them.
+   */
+  if (g->nr_async_calls == 0)
+    s->nr_in_flight = 0;
+
+  s->in_flight =
+    safe_realloc (g, s->in_flight,
+                  (s->nr_in_flight+1) * sizeof (struct rpc_in_flight));
+  f = &s->in_flight[s->nr_in_flight++];
+  f->serial = serial;
+  f->proc_nr = proc_nr;
+  gettimeofday (&f->start, NULL);
+}
+
+/**
+ * Record that the reply to call C<serial> was received.  C<fn> is
+ * the name of the function, C<bytes> is the length of the reply
+ * message and C<is_error> is true if the daemon returned an error.
+ */
+void
+guestfs_int_rpc_stats_reply (guestfs_h *g, const char *fn, unsigned serial,
+                             size_t bytes, int is_error)
+{
+  struct rpc_stats *s = g->rpc_stats;
+  struct rpc_proc_stats *p;
+  struct timeval end;
+  int64_t us;
+  size_t i, bucket;
+
+  if (s == NULL)
+    return;
+
+  for (i = 0; i < s->nr_in_flight; ++i)
+    if (s->in_flight[i].serial == serial)
+      break;
+  if (i == s->nr_in_flight)
+    return;
+
+  gettimeofday (&end, NULL);
+  us = (end.tv_sec - s->in_flight[i].start.tv_sec) * INT64_C (1000000) +
+    end.tv_usec - s->in_flight[i].start.tv_usec;
+  if (us < 0)
+    us = 0;
+
+  p = get_proc_stats (g, s->in_flight[i].proc_nr);
+  s->last_proc_nr = s->in_flight[i].proc_nr;
+  memmove (&s->in_flight[i], &s->in_flight[i+1],
+           (s->nr_in_flight - i - 1) * sizeof (struct rpc_in_flight));
+  s->nr_in_flight--;
+
+  p->name = fn;
+  p->calls++;
+  if (is_error)
+    p->errors++;
+  p->bytes_received += bytes;
+  p->total_us += us;
+  if ((uint64_t) us > p->max_us)
+    p->max_us = us;
+
+  for (bucket = 0; bucket < NR_LATENCY_BUCKETS-1 && us >= 2; ++bucket)
+    us >>= 1;
+  p->latency[bucket]++;
+}
+
+/**
+ * Record C<bytes> of C<FileIn> or C<FileOut> data sent or received.
+ */
+void
+guestfs_int_rpc_stats_file (guestfs_h *g, size_t bytes)
+{
+  struct rpc_stats *s = g->rpc_stats;
+  struct rpc_proc_stats *p;
+
+  if (s == NULL)
+    return;
+  p = get_proc_stats (g, s->last_proc_nr);
+  if (p == NULL)
+    return;
+
+  p->file_bytes += bytes;
+}
+
+void
+guestfs_int_free_rpc_stats (guestfs_h *g)
+{
+  struct rpc_stats *s = g->rpc_stats;
+  size_t i;
+
+  if (s == NULL)
+    return;
+
+  for (i = 0; i <= GUESTFS_MAX_PROC_NR; ++i)
+    free (s->procs[i]);
+  free (s->in_flight);
+  free (s);
+  g->rpc_stats = NULL;
+}
+
+int
+guestfs_impl_set_rpc_stats (guestfs_h *g, int enable)
+{
+  guestfs_int_free_rpc_stats (g);
+  if (enable) {
+    g->rpc_stats = safe_calloc (g, 1, sizeof (struct rpc_stats));
+    g->rpc_stats->last_proc_nr = -1;
+  }
+  return 0;
+}
+
+/* Return the upper bound of the bucket containing the given
+ * percentile of calls.
+ */
+static uint64_t
+latency_percentile (const struct rpc_proc_stats *p, unsigned percent)
+{
+  const uint64_t want = (p->calls * percent + 99) / 100;
+  uint64_t seen = 0;
+  size_t i;
+
+  for (i = 0; i < NR_LATENCY_BUCKETS; ++i) {
+    seen += p->latency[i];
+    if (seen >= want)
+      break;
+  }
+  if (i >= NR_LATENCY_BUCKETS-1)
+    return p->max_us;
+  return UINT64_C (1) << (i+1);
+}
+
+/**
+ * Implements L<guestfs(3)/guestfs_get_rpc_stats>.
+ */
+char **
+guestfs_impl_get_rpc_stats (guestfs_h *g)
+{
+  struct rpc_stats *s = g->rpc_stats;
+  DECLARE_STRINGSBUF (ret);
+  size_t i, j;
+
+  if (s == NULL) {
+    error (g, _("RPC statistics are not enabled, use guestfs_set_rpc_stats"));
+    return NULL;
+  }
+
+  for (i = 0; i <= GUESTFS_MAX_PROC_NR; ++i) {
+    const struct rpc_proc_stats *p = s->procs[i];
+
+    /* Calls which were sent but never got a reply have no name. */
+    if (p == NULL || p->name == NULL)
+      continue;
+
+#define ADD_STAT(suffix, v)                                             \
+    do {                                                                \
+      guestfs_int_add_sprintf (g, &ret, "%s.%s", p->name, (suffix));    \
+      guestfs_int_add_sprintf (g, &ret, "%" PRIu64, (uint64_t) (v));    \
+    } while (0)
+
+    ADD_STAT ("calls", p->calls);
+    ADD_STAT ("errors", p->errors);
+    ADD_STAT ("bytes_sent", p->bytes_sent);
+    ADD_STAT ("bytes_received", p->bytes_received);
+    if (p->file_bytes > 0)
+      ADD_STAT ("file_bytes", p->file_bytes);
+    ADD_STAT ("total_us", p->total_us);
+    ADD_STAT ("max_us", p->max_us);
+    ADD_STAT ("p50_us", latency_percentile (p, 50));
+    ADD_STAT ("p99_us", latency_percentile (p, 99));
+
+    for (j = 0; j < NR_LATENCY_BUCKETS; ++j) {
+      if (p->latency[j] > 0) {
+        guestfs_int_add_sprintf (g, &ret, "%s.latency_us.%" PRIu64,
+                                 p->name, UINT64_C (1) << (j+1));
+        guestfs_int_add_sprintf (g, &ret, "%" PRIu64, p->latency[j]);
+      }
+    }
+#undef ADD_STAT
+  }
+  guestfs_int_end_stringsbuf (g, &ret);
+
+  return ret.argv;              /* caller frees */
+}
@@ -0,0 +1,240 @@
+/* libguestfs
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * Persistent host-side proxies for network drives.
+ *
+ * Connecting to network storage (Ceph, iSCSI, NBD etc.) and
+ * authenticating can be a large part of the launch time when many
+ * short-lived handles open the same drives.  With the
+ * C<storage_proxy> backend setting, the direct backend does not give
+ * the URL of a network drive to qemu.  Instead it starts a
+ * L<qemu-nbd(8)> process which opens the drive and exports it on a
+ * Unix domain socket, and qemu connects to that socket.
+ *
+ * The proxy is shared by all the handles of the same user which add
+ * the same drive, and it keeps running after the handles are closed,
+ * so later launches reuse its open connection.  The files are in the
+ * cache directory:
+ *
+ *   $CACHEDIR/.guestfs-$UID/proxy/<hash>.sock - the NBD export
+ *   $CACHEDIR/.guestfs-$UID/proxy/<hash>.lock - held while starting it
+ *   $CACHEDIR/.guestfs-$UID/proxy/<hash>.log  - messages from qemu-nbd
+ *
+ * where C<hash> is a hash of the qemu source parameter, the format
+ * and the readonly flag of the drive.  qemu-nbd decodes the format,
+ * so the export is always raw.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <libintl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "sha256.h"
+#include "ignore-value.h"
+
+#include "guestfs.h"
+#include "guestfs-internal.h"
+
+/* Number of clients which can use one proxy at the same time. */
+#define PROXY_MAX_CLIENTS 64
+
+/**
+ * Return true if drive C<drv> should be accessed through a storage
+ * proxy, ie. the C<storage_proxy> backend setting is set and the
+ * drive is a network drive.
+ */
+bool
+guestfs_int_use_storage_proxy (guestfs_h *g, const struct drive *drv)
+{
+  return drv->src.protocol != drive_protocol_file &&
+    guestfs_int_get_backend_setting_bool (g, "storage_proxy") > 0;
+}
+
+/* Return true if something is listening on the Unix socket 'path'. */
+static bool
+proxy_is_running (const char *path)
+{
+  struct sockaddr_un addr;
+  int sock;
+  bool r;
+
+  if (strlen (path) >= sizeof addr.sun_path)
+    return false;
+
+  sock = socket (AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+  if (sock == -1)
+    return false;
+
+  memset (&addr, 0, sizeof addr);
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, path);
+  r = connect (sock, (struct sockaddr *) &addr, sizeof addr) == 0;
+  close (sock);
+
+  return r;
+}
+
+/* The proxy directory, created if necessary.  Caller frees. */
+static char *
+make_proxy_dir (guestfs_h *g)
+{
+  CLEANUP_FREE char *cachedir = NULL;
+  char *dir;
+
+  cachedir = guestfs_int_lazy_make_supermin_appliance_dir (g);
+  if (cachedir == NULL)
+    return NULL;
+
+  dir = safe_asprintf (g, "%s/proxy", cachedir);
+  if (mkdir (dir, 0700) == -1 && errno != EEXIST) {
+    perrorf (g, "mkdir: %s", dir);
+    free (dir);
+    return NULL;
+  }
+
+  return dir;
+}
+
+/* Start qemu-nbd.  It forks into the background once the socket
+ * is ready.  Its output goes to the log file, so that the background
+ * process does not hold our stderr pipe open.
+ */
+static int
+start_proxy (guestfs_h *g, struct drive *drv, const char *source,
+             const char *sockpath, const char *logpath)
+{
+  CLEANUP_CMD_CLOSE struct command *cmd = guestfs_int_new_command (g);
+  char shared[32];
+  int r;
+
+  snprintf (shared, sizeof shared, "--shared=%d ", PROXY_MAX_CLIENTS);
+  guestfs_int_cmd_add_string_unquoted (cmd, "qemu-nbd --fork --persistent ");
+  guestfs_int_cmd_add_string_unquoted (cmd, shared);
+  /* Whether discards are passed on is decided by each appliance. */
+  guestfs_int_cmd_add_string_unquoted (cmd, "--discard=unmap ");
+  if (drv->readonly)
+    guestfs_int_cmd_add_string_unquoted (cmd, "--read-only ");
+  if (drv->src.format) {
+    guestfs_int_cmd_add_string_unquoted (cmd, "-f ");
+    guestfs_int_cmd_add_string_quoted (cmd, drv->src.format);
+    guestfs_int_cmd_add_string_unquoted (cmd, " ");
+  }
+  guestfs_int_cmd_add_string_unquoted (cmd, "--socket=");
+  guestfs_int_cmd_add_string_quoted (cmd, sockpath);
+  guestfs_int_cmd_add_string_unquoted (cmd, " ");
+  guestfs_int_cmd_add_string_quoted (cmd, source);
+  guestfs_int_cmd_add_string_unquoted (cmd, " </dev/null >>");
+  guestfs_int_cmd_add_string_quoted (cmd, logpath);
+  guestfs_int_cmd_add_string_unquoted (cmd, " 2>&1");
+
+  r = guestfs_int_cmd_run (cmd);
+  if (r == -1)
+    return -1;
+  if (!WIFEXITED (r) || WEXITSTATUS (r) != 0) {
+    guestfs_int_external_command_failed (g, r, "qemu-nbd", logpath);
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Return the qemu C<file=> parameter which connects to the storage
+ * proxy for drive C<drv>, starting the proxy if it is not already
+ * running.  The caller must free the string.  Returns C<NULL> on
+ * error.
+ */
+char *
+guestfs_int_storage_proxy_param (guestfs_h *g, struct drive *drv)
+{
+  CLEANUP_FREE char *source = NULL, *key = NULL, *dir = NULL;
+  CLEANUP_FREE char *sockpath = NULL, *lockpath = NULL, *logpath = NULL;
+  unsigned char digest[32];
+  char hash[2*16+1];
+  size_t i;
+  int lock_fd;
+  char *ret = NULL;
+
+  source = guestfs_int_drive_source_qemu_param (g, &drv->src);
+  if (source == NULL)
+    return NULL;
+
+  /* Half of the SHA-256 is plenty to tell drives apart. */
+  key = safe_asprintf (g, "source=%s\nformat=%s\nreadonly=%d\n",
+                       source, drv->src.format ? drv->src.format : "",
+                       drv->readonly);
+  sha256_buffer (key, strlen (key), digest);
+  for (i = 0; i < 16; ++i)
+    snprintf (&hash[2*i], 3, "%02x", digest[i]);
+
+  dir = make_proxy_dir (g);
+  if (dir == NULL)
+    return NULL;
+  sockpath = safe_asprintf (g, "%s/%s.sock", dir, hash);
+  lockpath = safe_asprintf (g, "%s/%s.lock", dir, hash);
+  logpath = safe_asprintf (g, "%s/%s.log", dir, hash);
+
+  if (strlen (sockpath) >= UNIX_PATH_MAX) {
+    error (g, _("storage_proxy: socket path is too long: %s"), sockpath);
+    return NULL;
+  }
+
+  /* Stop other handles starting the same proxy at the same time. */
+  lock_fd = open (lockpath, O_WRONLY|O_CREAT|O_CLOEXEC, 0600);
+  if (lock_fd == -1) {
+    perrorf (g, "open: %s", lockpath);
+    return NULL;
+  }
+  if (flock (lock_fd, LOCK_EX) == -1) {
+    perrorf (g, "flock: %s", lockpath);
+    goto out;
+  }
+
+  if (proxy_is_running (sockpath))
+    debug (g, "storage_proxy: reusing %s", sockpath);
+  else {
+    debug (g, "storage_proxy: starting qemu-nbd on %s", sockpath);
+    ignore_value (unlink (sockpath));
+    if (start_proxy (g, drv, source, sockpath, logpath) == -1)
+      goto out;
+    if (!proxy_is_running (sockpath)) {
+      error (g, _("storage_proxy: qemu-nbd is not listening on %s, see %s"),
+             sockpath, logpath);
+      goto out;
+    }
+  }
+
+  ret = safe_asprintf (g, "nbd:unix:%s", sockpath);
+
+ out:
+  close (lock_fd);              /* also releases the lock */
+  return ret;
+}
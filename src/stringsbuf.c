@@ -44,7 +44,10 @@ void
 guestfs_int_add_string_nodup (guestfs_h *g, struct stringsbuf *sb, char *str)
 {
   if (sb->size >= sb->alloc) {
-    sb->alloc += 64;
+    /* Grow geometrically, so that building a list of n strings does
+     * O(log n) reallocs instead of O(n).
+     */
+    sb->alloc = sb->alloc > 0 ? sb->alloc * 2 : 64;
     sb->argv = safe_realloc (g, sb->argv, sb->alloc * sizeof (char *));
   }
 
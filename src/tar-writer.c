@@ -0,0 +1,485 @@
+/* libguestfs
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * A minimal tar writer, used to stream local files into the
+ * appliance with C<guestfs_tar_in> without running a host L<tar(1)>
+ * subprocess.
+ *
+ * The archive is generated incrementally by
+ * C<guestfs_int_tar_writer_read>, which is used as the
+ * C<struct send_source> of the C<FileIn>, so only one directory
+ * handle per level and one open file are held at a time.
+ *
+ * The format is the same as GNU tar's default: ustar headers with
+ * the GNU magic, C<././@LongLink> entries for names and link targets
+ * longer than 100 bytes, and base-256 numbers for values which don't
+ * fit in the octal fields.  Regular files, directories, symbolic
+ * links, hard links, devices and FIFOs are stored.  Sockets are
+ * skipped, as GNU tar does.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <libintl.h>
+
+#include "hash.h"
+
+#include "guestfs.h"
+#include "guestfs-internal.h"
+
+#define BLOCKSIZE 512
+
+/* A directory being walked. */
+struct tar_dir {
+  DIR *dir;
+  char *path;                   /* Path on the host. */
+  char *name;                   /* Name in the archive. */
+};
+
+/* A file with more than one link which has been stored already. */
+struct tar_link {
+  dev_t dev;
+  ino_t ino;
+  char *name;
+};
+
+struct tar_writer {
+  char *const *paths;           /* Sources, not owned. */
+  size_t next_path;
+
+  struct tar_dir *dirs;         /* Stack of directories being walked. */
+  size_t nr_dirs;
+
+  /* Headers and padding waiting to be returned. */
+  char *pending;
+  size_t pending_off, pending_len, pending_alloc;
+
+  /* Regular file whose contents are being returned. */
+  int fd;
+  char *fd_path;
+  uint64_t remaining;
+  size_t padding;
+
+  Hash_table *links;
+  bool done;
+};
+
+static size_t
+link_hasher (void const *x, size_t table_size)
+{
+  const struct tar_link *l = x;
+
+  return ((uint64_t) l->ino ^ (uint64_t) l->dev) % table_size;
+}
+
+static bool
+link_comparator (void const *x, void const *y)
+{
+  const struct tar_link *a = x, *b = y;
+
+  return a->dev == b->dev && a->ino == b->ino;
+}
+
+static void
+link_free (void *x)
+{
+  struct tar_link *l = x;
+
+  if (l) {
+    free (l->name);
+    free (l);
+  }
+}
+
+/**
+ * Create a tar writer which archives each of the local C<paths>
+ * (recursively), storing each under its base name.  The C<paths>
+ * list must remain valid until the writer is freed.
+ */
+struct tar_writer *
+guestfs_int_new_tar_writer (guestfs_h *g, char *const *paths)
+{
+  struct tar_writer *tw = safe_calloc (g, 1, sizeof *tw);
+
+  tw->paths = paths;
+  tw->fd = -1;
+  tw->links = hash_initialize (16, NULL, link_hasher, link_comparator,
+                               link_free);
+  if (tw->links == NULL)
+    g->abort_cb ();
+  return tw;
+}
+
+void
+guestfs_int_free_tar_writer (struct tar_writer *tw)
+{
+  size_t i;
+
+  if (tw == NULL)
+    return;
+
+  for (i = 0; i < tw->nr_dirs; ++i) {
+    closedir (tw->dirs[i].dir);
+    free (tw->dirs[i].path);
+    free (tw->dirs[i].name);
+  }
+  free (tw->dirs);
+  free (tw->pending);
+  if (tw->fd >= 0)
+    close (tw->fd);
+  free (tw->fd_path);
+  hash_free (tw->links);
+  free (tw);
+}
+
+/* Append len zero bytes to the pending data, returning a pointer to
+ * them.
+ */
+static char *
+queue_zeroes (guestfs_h *g, struct tar_writer *tw, size_t len)
+{
+  char *p;
+
+  if (tw->pending_off == tw->pending_len)
+    tw->pending_off = tw->pending_len = 0;
+
+  if (tw->pending_len + len > tw->pending_alloc) {
+    tw->pending_alloc = MAX (tw->pending_len + len, 2 * tw->pending_alloc);
+    tw->pending = safe_realloc (g, tw->pending, tw->pending_alloc);
+  }
+  p = &tw->pending[tw->pending_len];
+  memset (p, 0, len);
+  tw->pending_len += len;
+  return p;
+}
+
+/* Store a number in a header field.  Numbers are octal followed by a
+ * NUL, or GNU base-256 if they are too large for the field.
+ */
+static void
+put_number (char *field, size_t len, uint64_t v)
+{
+  size_t i;
+
+  if ((len-1) * 3 < 64 && (v >> ((len-1) * 3)) != 0) {
+    memset (field, 0, len);
+    for (i = len-1; i > 0; --i) {
+      field[i] = v & 0xff;
+      v >>= 8;
+    }
+    field[0] = (char) 0x80;
+    return;
+  }
+
+  field[len-1] = '\0';
+  for (i = len-1; i > 0; --i) {
+    field[i-1] = '0' + (v & 7);
+    v >>= 3;
+  }
+}
+
+static void queue_header (guestfs_h *g, struct tar_writer *tw, const char *name, const struct stat *st, char type, uint64_t size, const char *linkname);
+
+/* GNU extension for a name or link target longer than 100 bytes. */
+static void
+queue_long_name (guestfs_h *g, struct tar_writer *tw, char type,
+                 const char *str)
+{
+  const size_t len = strlen (str) + 1;
+  const struct stat st = { .st_mode = 0 };
+  char *p;
+
+  queue_header (g, tw, "././@LongLink", &st, type, len, NULL);
+  p = queue_zeroes (g, tw, (len + BLOCKSIZE - 1) & ~(BLOCKSIZE - 1));
+  memcpy (p, str, len);
+}
+
+static void
+queue_header (guestfs_h *g, struct tar_writer *tw, const char *name,
+              const struct stat *st, char type, uint64_t size,
+              const char *linkname)
+{
+  char *h;
+  unsigned sum = 0;
+  size_t i;
+
+  if (strlen (name) > 100)
+    queue_long_name (g, tw, 'L', name);
+  if (linkname && strlen (linkname) > 100)
+    queue_long_name (g, tw, 'K', linkname);
+
+  h = queue_zeroes (g, tw, BLOCKSIZE);
+  strncpy (&h[0], name, 100);
+  put_number (&h[100], 8, st->st_mode & 07777);
+  put_number (&h[108], 8, st->st_uid);
+  put_number (&h[116], 8, st->st_gid);
+  put_number (&h[124], 12, size);
+  put_number (&h[136], 12, st->st_mtime > 0 ? st->st_mtime : 0);
+  h[156] = type;
+  if (linkname)
+    strncpy (&h[157], linkname, 100);
+  memcpy (&h[257], "ustar  ", 8); /* GNU magic and version */
+  if (type == '3' || type == '4') {
+    put_number (&h[329], 8, major (st->st_rdev));
+    put_number (&h[337], 8, minor (st->st_rdev));
+  }
+
+  /* The checksum is calculated with the checksum field as spaces. */
+  memset (&h[148], ' ', 8);
+  for (i = 0; i < BLOCKSIZE; ++i)
+    sum += (unsigned char) h[i];
+  snprintf (&h[148], 8, "%06o", sum);
+}
+
+/* Add the file at path to the archive as name.  This takes ownership
+ * of both strings.
+ */
+static int
+add_entry (guestfs_h *g, struct tar_writer *tw, char *path, char *name)
+{
+  struct stat st;
+  CLEANUP_FREE char *dirname = NULL;
+  CLEANUP_FREE char *link = NULL;
+  struct tar_link key, *l;
+  DIR *dir;
+  ssize_t r;
+  int fd;
+
+  if (lstat (path, &st) == -1) {
+    perrorf (g, "lstat: %s", path);
+    goto err;
+  }
+
+  switch (st.st_mode & S_IFMT) {
+  case S_IFREG:
+    if (st.st_nlink > 1) {
+      key.dev = st.st_dev;
+      key.ino = st.st_ino;
+      l = hash_lookup (tw->links, &key);
+      if (l) {
+        queue_header (g, tw, name, &st, '1', 0, l->name);
+        break;
+      }
+      l = safe_malloc (g, sizeof *l);
+      l->dev = st.st_dev;
+      l->ino = st.st_ino;
+      l->name = safe_strdup (g, name);
+      if (hash_insert (tw->links, l) == NULL)
+        g->abort_cb ();
+    }
+
+    fd = open (path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+    if (fd == -1) {
+      perrorf (g, "open: %s", path);
+      goto err;
+    }
+    guestfs_int_fadvise_sequential (fd);
+    queue_header (g, tw, name, &st, '0', st.st_size, NULL);
+    tw->fd = fd;
+    tw->fd_path = path;
+    tw->remaining = st.st_size;
+    tw->padding = (BLOCKSIZE - st.st_size % BLOCKSIZE) % BLOCKSIZE;
+    free (name);
+    return 0;
+
+  case S_IFDIR:
+    dir = opendir (path);
+    if (dir == NULL) {
+      perrorf (g, "opendir: %s", path);
+      goto err;
+    }
+    dirname = safe_asprintf (g, "%s/", name);
+    queue_header (g, tw, dirname, &st, '5', 0, NULL);
+    tw->dirs = safe_realloc (g, tw->dirs,
+                             (tw->nr_dirs+1) * sizeof (struct tar_dir));
+    tw->dirs[tw->nr_dirs].dir = dir;
+    tw->dirs[tw->nr_dirs].path = path;
+    tw->dirs[tw->nr_dirs].name = name;
+    tw->nr_dirs++;
+    return 0;
+
+  case S_IFLNK:
+    link = safe_malloc (g, st.st_size + 1);
+    r = readlink (path, link, st.st_size + 1);
+    if (r == -1) {
+      perrorf (g, "readlink: %s", path);
+      goto err;
+    }
+    if (r > st.st_size) {
+      error (g, _("%s: symbolic link changed while it was being read"), path);
+      goto err;
+    }
+    link[r] = '\0';
+    queue_header (g, tw, name, &st, '2', 0, link);
+    break;
+
+  case S_IFCHR:
+    queue_header (g, tw, name, &st, '3', 0, NULL);
+    break;
+
+  case S_IFBLK:
+    queue_header (g, tw, name, &st, '4', 0, NULL);
+    break;
+
+  case S_IFIFO:
+    queue_header (g, tw, name, &st, '6', 0, NULL);
+    break;
+
+  default:
+    debug (g, "tar: %s: socket ignored", path);
+    break;
+  }
+
+  free (path);
+  free (name);
+  return 0;
+
+ err:
+  free (path);
+  free (name);
+  return -1;
+}
+
+/* Queue the next entry.  At the end of the archive this queues the
+ * two zero blocks which end a tar file and sets done.
+ */
+static int
+next_entry (guestfs_h *g, struct tar_writer *tw)
+{
+  struct tar_dir *top;
+  struct dirent *d;
+  const char *source, *p;
+  size_t len;
+
+  while (tw->nr_dirs > 0) {
+    top = &tw->dirs[tw->nr_dirs-1];
+
+    errno = 0;
+    d = readdir (top->dir);
+    if (d == NULL) {
+      if (errno != 0) {
+        perrorf (g, "readdir: %s", top->path);
+        return -1;
+      }
+      closedir (top->dir);
+      free (top->path);
+      free (top->name);
+      tw->nr_dirs--;
+      continue;
+    }
+    if (STREQ (d->d_name, ".") || STREQ (d->d_name, ".."))
+      continue;
+
+    return add_entry (g, tw,
+                      safe_asprintf (g, "%s/%s", top->path, d->d_name),
+                      safe_asprintf (g, "%s/%s", top->name, d->d_name));
+  }
+
+  source = tw->paths[tw->next_path];
+  if (source == NULL) {
+    queue_zeroes (g, tw, 2 * BLOCKSIZE);
+    tw->done = true;
+    return 0;
+  }
+  tw->next_path++;
+
+  /* Store the source under its base name, as if running
+   * "tar -C dirname -cf - basename".
+   */
+  len = strlen (source);
+  while (len > 1 && source[len-1] == '/')
+    len--;
+  p = memrchr (source, '/', len);
+  p = p ? p+1 : source;
+  if (p == &source[len])
+    return add_entry (g, tw, safe_strdup (g, source), safe_strdup (g, "."));
+  return add_entry (g, tw, safe_strdup (g, source),
+                    safe_strndup (g, p, &source[len] - p));
+}
+
+/**
+ * The C<read> function of a C<struct send_source>.  C<twv> is the
+ * C<struct tar_writer>.
+ */
+ssize_t
+guestfs_int_tar_writer_read (guestfs_h *g, char *buf, size_t len, void *twv)
+{
+  struct tar_writer *tw = twv;
+  size_t n = 0, m;
+  ssize_t r;
+
+  while (n < len) {
+    if (tw->pending_off < tw->pending_len) {
+      m = MIN (len - n, tw->pending_len - tw->pending_off);
+      memcpy (&buf[n], &tw->pending[tw->pending_off], m);
+      tw->pending_off += m;
+      n += m;
+    }
+    else if (tw->fd >= 0 && tw->remaining > 0) {
+      m = MIN (len - n, tw->remaining);
+      r = read (tw->fd, &buf[n], m);
+      if (r == -1) {
+        if (errno == EINTR)
+          continue;
+        perrorf (g, "read: %s", tw->fd_path);
+        return -1;
+      }
+      /* If the file shrank, pad it with zeroes to the size in the
+       * header, as GNU tar does.
+       */
+      if (r == 0) {
+        memset (&buf[n], 0, m);
+        r = m;
+      }
+      tw->remaining -= r;
+      n += r;
+    }
+    else if (tw->fd >= 0) {
+      if (close (tw->fd) == -1) {
+        perrorf (g, "close: %s", tw->fd_path);
+        tw->fd = -1;
+        return -1;
+      }
+      tw->fd = -1;
+      free (tw->fd_path);
+      tw->fd_path = NULL;
+      queue_zeroes (g, tw, tw->padding);
+    }
+    else if (!tw->done) {
+      if (next_entry (g, tw) == -1)
+        return -1;
+    }
+    else
+      break;
+  }
+
+  return n;
+}
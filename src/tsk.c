@@ -25,6 +25,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <string.h>
+#include <inttypes.h>
 #include <rpc/xdr.h>
 #include <rpc/types.h>
 
@@ -34,110 +35,212 @@
 #include "guestfs-internal-all.h"
 #include "guestfs-internal-actions.h"
 
-static struct guestfs_tsk_dirent_list *parse_dirent_file (guestfs_h *, const char *);
-static int deserialise_dirent_list (guestfs_h *, FILE *, struct guestfs_tsk_dirent_list *);
+/* The dirents sent by the daemon are a stream of XDR encoded
+ * guestfs_int_tsk_dirent structures.  They are decoded as each chunk
+ * of the FileOut arrives, so the whole stream is never held in
+ * memory.  Only a partial dirent at the end of a chunk is kept until
+ * the next chunk.
+ */
+typedef int (*dirent_callback) (guestfs_h *g, struct guestfs_tsk_dirent *dirent, void *opaque);
+
+struct dirent_stream {
+  char *pending;                /* Undecoded bytes. */
+  size_t pending_len;
+  size_t pending_alloc;
+  dirent_callback cb;           /* Called for each dirent. */
+  void *opaque;
+};
+
+/* The list being built by filesystem_walk and find_inode. */
+struct dirent_list {
+  struct guestfs_tsk_dirent_list *list;
+  size_t alloc;
+};
+
+static int walk_dirents (guestfs_h *g, const char *mountable, int64_t inode, dirent_callback cb, void *opaque);
+static int add_dirent_to_list (guestfs_h *g, struct guestfs_tsk_dirent *dirent, void *dlv);
+static int write_dirent (guestfs_h *g, struct guestfs_tsk_dirent *dirent, void *fpv);
 
 struct guestfs_tsk_dirent_list *
 guestfs_impl_filesystem_walk (guestfs_h *g, const char *mountable)
 {
-  int ret = 0;
-  CLEANUP_UNLINK_FREE char *tmpfile = NULL;
-
-  tmpfile = guestfs_int_make_temp_path (g, "filesystem_walk");
-  if (tmpfile == NULL)
-    return NULL;
+  struct dirent_list dl = { .alloc = 0 };
 
-  ret = guestfs_internal_filesystem_walk (g, mountable, tmpfile);
-  if (ret < 0)
+  dl.list = safe_calloc (g, 1, sizeof (*dl.list));
+  if (walk_dirents (g, mountable, -1, add_dirent_to_list, &dl) == -1) {
+    guestfs_free_tsk_dirent_list (dl.list);
     return NULL;
+  }
 
-  return parse_dirent_file (g, tmpfile);  /* caller frees */
+  return dl.list;               /* caller frees */
 }
 
 struct guestfs_tsk_dirent_list *
 guestfs_impl_find_inode (guestfs_h *g, const char *mountable, int64_t inode)
 {
-  int ret = 0;
-  CLEANUP_UNLINK_FREE char *tmpfile = NULL;
-
-  tmpfile = guestfs_int_make_temp_path (g, "find_inode");
-  if (tmpfile == NULL)
-    return NULL;
+  struct dirent_list dl = { .alloc = 0 };
 
-  ret = guestfs_internal_find_inode (g, mountable, inode, tmpfile);
-  if (ret < 0)
+  dl.list = safe_calloc (g, 1, sizeof (*dl.list));
+  if (walk_dirents (g, mountable, inode, add_dirent_to_list, &dl) == -1) {
+    guestfs_free_tsk_dirent_list (dl.list);
     return NULL;
+  }
 
-  return parse_dirent_file (g, tmpfile);  /* caller frees */
+  return dl.list;               /* caller frees */
 }
 
-/* Parse the file content and return dirents list.
- * Return a list of tsk_dirent on success, NULL on error.
- */
-static struct guestfs_tsk_dirent_list *
-parse_dirent_file (guestfs_h *g, const char *tmpfile)
+int
+guestfs_impl_filesystem_walk0 (guestfs_h *g, const char *mountable,
+                               const char *filename)
 {
-  int ret = 0;
-  CLEANUP_FCLOSE FILE *fp = NULL;
-  struct guestfs_tsk_dirent_list *dirents = NULL;
+  FILE *fp;
+  int r;
 
-  fp = fopen (tmpfile, "r");
+  fp = fopen (filename, "we");
   if (fp == NULL) {
-    perrorf (g, "fopen: %s", tmpfile);
-    return NULL;
+    perrorf (g, "fopen: %s", filename);
+    return -1;
   }
 
-  /* Initialise results array. */
-  dirents = safe_malloc (g, sizeof (*dirents));
-  dirents->len = 8;
-  dirents->val = safe_malloc (g, dirents->len * sizeof (*dirents->val));
+  r = walk_dirents (g, mountable, -1, write_dirent, fp);
 
-  /* Deserialise buffer into dirent list. */
-  ret = deserialise_dirent_list (g, fp, dirents);
-  if (ret < 0) {
-    guestfs_free_tsk_dirent_list (dirents);
-    return NULL;
+  if (fclose (fp) == EOF && r == 0) {
+    perrorf (g, "fclose: %s", filename);
+    return -1;
   }
 
-  return dirents;
+  return r;
 }
 
-/* Deserialise the file content and populate the dirent list.
- * Return the number of deserialised dirents, -1 on error.
+/* Decode as many complete dirents as possible from the pending
+ * bytes, and pass each to the callback.
  */
 static int
-deserialise_dirent_list (guestfs_h *g, FILE *fp,
-                         struct guestfs_tsk_dirent_list *dirents)
+decode_pending_dirents (guestfs_h *g, struct dirent_stream *ds)
 {
   XDR xdr;
-  int ret = 0;
-  uint32_t index = 0;
-  struct stat statbuf;
+  guestfs_int_tsk_dirent dirent;
+  size_t pos = 0;
+  int r = 0;
 
-  ret = fstat (fileno(fp), &statbuf);
-  if (ret == -1)
-    return -1;
-
-  xdrstdio_create (&xdr, fp, XDR_DECODE);
+  xdrmem_create (&xdr, ds->pending, ds->pending_len, XDR_DECODE);
 
-  for (index = 0; xdr_getpos (&xdr) < statbuf.st_size; index++) {
-    if (index == dirents->len) {
-      dirents->len = 2 * dirents->len;
-      dirents->val = safe_realloc (g, dirents->val,
-                                   dirents->len *
-                                   sizeof (*dirents->val));
+  while (pos < ds->pending_len) {
+    /* Clear the entry so xdr logic will allocate necessary memory. */
+    memset (&dirent, 0, sizeof dirent);
+    if (!xdr_guestfs_int_tsk_dirent (&xdr, &dirent)) {
+      /* Probably the dirent continues in the next chunk. */
+      xdr_free ((xdrproc_t) xdr_guestfs_int_tsk_dirent, (char *) &dirent);
+      break;
     }
+    pos = xdr_getpos (&xdr);
 
-    /* Clear the entry so xdr logic will allocate necessary memory. */
-    memset (&dirents->val[index], 0, sizeof (*dirents->val));
-    ret = xdr_guestfs_int_tsk_dirent (&xdr, (guestfs_int_tsk_dirent *)
-                                      &dirents->val[index]);
-    if (ret == 0)
+    /* The callback takes ownership of the strings in the dirent. */
+    r = ds->cb (g, (struct guestfs_tsk_dirent *) &dirent, ds->opaque);
+    if (r == -1)
       break;
   }
 
   xdr_destroy (&xdr);
-  dirents->len = index;
 
-  return ret ? 0 : -1;
+  memmove (ds->pending, &ds->pending[pos], ds->pending_len - pos);
+  ds->pending_len -= pos;
+
+  return r;
+}
+
+static int
+dirent_chunk_cb (guestfs_h *g, const char *buf, size_t len, void *dsv)
+{
+  struct dirent_stream *ds = dsv;
+
+  if (ds->pending_len + len > ds->pending_alloc) {
+    ds->pending_alloc = MAX (ds->pending_len + len, 2 * ds->pending_alloc);
+    ds->pending = safe_realloc (g, ds->pending, ds->pending_alloc);
+  }
+  memcpy (&ds->pending[ds->pending_len], buf, len);
+  ds->pending_len += len;
+
+  return decode_pending_dirents (g, ds);
+}
+
+/* Run internal_filesystem_walk (or internal_find_inode if inode >= 0)
+ * and call cb for each dirent as it is received.
+ */
+static int
+walk_dirents (guestfs_h *g, const char *mountable, int64_t inode,
+              dirent_callback cb, void *opaque)
+{
+  struct dirent_stream ds = { .pending = NULL, .cb = cb, .opaque = opaque };
+  struct recv_buffer rbuf = {
+    .data = NULL, .chunk_cb = dirent_chunk_cb, .opaque = &ds
+  };
+  int r;
+
+  /* The dirents are passed to the callback, the filename is ignored. */
+  g->recv_buffer = &rbuf;
+  if (inode >= 0)
+    r = guestfs_internal_find_inode (g, mountable, inode, "/dev/null");
+  else
+    r = guestfs_internal_filesystem_walk (g, mountable, "/dev/null");
+  g->recv_buffer = NULL;
+
+  if (r == 0 && ds.pending_len > 0) {
+    error (g, _("failed to parse dirents from the daemon: %zu bytes left over"),
+           ds.pending_len);
+    r = -1;
+  }
+
+  free (ds.pending);
+  return r;
+}
+
+static int
+add_dirent_to_list (guestfs_h *g, struct guestfs_tsk_dirent *dirent,
+                    void *dlv)
+{
+  struct dirent_list *dl = dlv;
+
+  if (dl->list->len == dl->alloc) {
+    dl->alloc = dl->alloc > 0 ? 2 * dl->alloc : 8;
+    dl->list->val = safe_realloc (g, dl->list->val,
+                                  dl->alloc * sizeof (*dl->list->val));
+  }
+  dl->list->val[dl->list->len++] = *dirent;
+  return 0;
+}
+
+/* Write a dirent in the format documented in guestfs_filesystem_walk0:
+ * the fields in struct order, each followed by a \0 character.
+ */
+static int
+write_dirent (guestfs_h *g, struct guestfs_tsk_dirent *dirent, void *fpv)
+{
+  FILE *fp = fpv;
+  int r;
+
+  r = fprintf (fp,
+               "%" PRIu64 "%c" "%c%c" "%" PRIi64 "%c" "%s%c" "%" PRIu32 "%c"
+               "%" PRIi64 "%c%" PRIi64 "%c" "%" PRIi64 "%c%" PRIi64 "%c"
+               "%" PRIi64 "%c%" PRIi64 "%c" "%" PRIi64 "%c%" PRIi64 "%c"
+               "%" PRIi64 "%c" "%s%c" "%" PRIi64 "%c",
+               dirent->tsk_inode, 0,
+               dirent->tsk_type, 0,
+               dirent->tsk_size, 0,
+               dirent->tsk_name, 0,
+               dirent->tsk_flags, 0,
+               dirent->tsk_atime_sec, 0, dirent->tsk_atime_nsec, 0,
+               dirent->tsk_mtime_sec, 0, dirent->tsk_mtime_nsec, 0,
+               dirent->tsk_ctime_sec, 0, dirent->tsk_ctime_nsec, 0,
+               dirent->tsk_crtime_sec, 0, dirent->tsk_crtime_nsec, 0,
+               dirent->tsk_nlink, 0,
+               dirent->tsk_link, 0,
+               dirent->tsk_spare1, 0);
+  free (dirent->tsk_name);
+  free (dirent->tsk_link);
+  if (r < 0) {
+    perrorf (g, "fprintf");
+    return -1;
+  }
+  return 0;
 }
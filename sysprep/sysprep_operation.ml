@@ -64,6 +64,7 @@ let defaults = {
   pod_notes = None;
   extra_args = [];
   not_enabled_check_args = (fun () -> ());
+  footprint = [];
   perform_on_filesystems = None;
   perform_on_devices = None;
 }
@@ -290,8 +291,26 @@ let perform_operations_on_filesystems ?operations g root
   (* Perform the operations in alphabetical, rather than random order. *)
   let ops = List.sort compare_operations ops in
 
+  (* Find which of the paths the operations act on exist, in one
+   * call, so operations with nothing to do can be skipped.
+   *)
+  let footprints =
+    List.concat (List.map (
+      function
+      | { footprint = footprint; perform_on_filesystems = Some _ } ->
+        footprint
+      | { perform_on_filesystems = None } -> []
+    ) ops) in
+  let existing =
+    if footprints = [] then []
+    else Array.to_list (g#globs_matching (Array.of_list footprints)) in
+
   List.iter (
     function
+    | { name = name; footprint = (_ :: _ as footprint);
+        perform_on_filesystems = Some _ }
+        when not (List.exists (fun p -> List.mem p existing) footprint) ->
+      debug "sysprep: skipping %s: no files to act on" name
     | { name = name; perform_on_filesystems = Some fn } ->
       message (f_"Performing %S ...") name;
       fn g root side_effects
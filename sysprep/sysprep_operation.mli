@@ -78,6 +78,18 @@ type operation = {
       called after argument parsing and can be used to check that
       no useless extra_args were passed by the user. *)
 
+  footprint : string list;
+  (** Absolute paths or wildcards, in the form accepted by
+      [g#glob_expand], covering every file that
+      {!perform_on_filesystems} acts on, if the operation does
+      nothing at all when none of them exist (eg. it only removes
+      files).  The default is [[]], meaning the operation always
+      runs.
+
+      The footprints of all the operations are checked in a single
+      call before running them, and the operations whose footprint
+      matches nothing in the guest are skipped. *)
+
   perform_on_filesystems : filesystem_side_effects callback option;
   (** The function which is called to perform this operation, when
       enabled.
@@ -24,10 +24,7 @@ module G = Guestfs
 let abrt_data_perform (g : Guestfs.guestfs) root side_effects =
   let typ = g#inspect_get_type root in
   if typ <> "windows" then (
-    let paths = g#glob_expand "/var/spool/abrt/*" in
-    Array.iter (
-      fun path -> g#rm_rf path;
-    ) paths
+    ignore (g#rm_globs [| "/var/spool/abrt/*" |])
   )
 
 let op = {
@@ -38,6 +35,7 @@ let op = {
     pod_description = Some (s_"\
 Remove the automatically generated ABRT crash data in
 C</var/spool/abrt/>.");
+    footprint = [ "/var/spool/abrt/*" ];
     perform_on_filesystems = Some abrt_data_perform;
 }
 
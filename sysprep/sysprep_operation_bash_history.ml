@@ -24,11 +24,10 @@ module G = Guestfs
 let bash_history_perform (g : Guestfs.guestfs) root side_effects =
   let typ = g#inspect_get_type root in
   if typ <> "windows" then (
-    let files = g#glob_expand "/home/*/.bash_history" in
-    Array.iter (
-      fun file -> try g#rm file with G.Error _ -> ();
-    ) files;
-    (try g#rm "/root/.bash_history" with G.Error _ -> ());
+    try
+      ignore (g#rm_globs ~norecurse:true [| "/home/*/.bash_history";
+                                            "/root/.bash_history" |])
+    with G.Error _ -> ()
   )
 
 let op = {
@@ -43,6 +42,7 @@ who have a C<.bash_history> file in their home directory.");
 Currently this only looks in C</root> and C</home/*> for
 home directories, so users with home directories in other
 locations won't have the bash history removed.");
+    footprint = [ "/home/*/.bash_history"; "/root/.bash_history" ];
     perform_on_filesystems = Some bash_history_perform;
 }
 
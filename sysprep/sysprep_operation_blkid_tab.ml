@@ -21,17 +21,18 @@ open Common_gettext.Gettext
 
 module G = Guestfs
 
+let files = [ "/var/run/blkid.tab";
+              "/var/run/blkid.tab.old";
+              "/etc/blkid/blkid.tab";
+              "/etc/blkid/blkid.tab.old";
+              "/etc/blkid.tab";
+              "/etc/blkid.tab.old";
+              "/dev/.blkid.tab";
+              "/dev/.blkid.tab.old"; ]
+
 let blkid_tab_perform g root side_effects =
   let typ = g#inspect_get_type root in
   if typ <> "windows" then (
-    let files = [ "/var/run/blkid.tab";
-                  "/var/run/blkid.tab.old";
-                  "/etc/blkid/blkid.tab";
-                  "/etc/blkid/blkid.tab.old";
-                  "/etc/blkid.tab";
-                  "/etc/blkid.tab.old";
-                  "/dev/.blkid.tab";
-                  "/dev/.blkid.tab.old"; ] in
     List.iter (
       fun file ->
         if not (g#is_symlink file) then (
@@ -45,6 +46,7 @@ let op = {
     name = "blkid-tab";
     enabled_by_default = true;
     heading = s_"Remove blkid tab in the guest";
+    footprint = files;
     perform_on_filesystems = Some blkid_tab_perform;
 }
 
@@ -19,29 +19,24 @@
 open Sysprep_operation
 open Common_gettext.Gettext
 
-module StringSet = Set.Make (String)
 module G = Guestfs
 
+let paths = [ "/etc/pki/CA/certs/*.crt";
+              "/etc/pki/CA/crl/*.crt";
+              "/etc/pki/CA/newcerts/*.crt";
+              "/etc/pki/CA/private/*.key";
+              "/etc/pki/tls/private/*.key";
+              "/etc/pki/tls/certs/*.crt"; ]
+
 let ca_certificates_perform (g : Guestfs.guestfs) root side_effects =
   let typ = g#inspect_get_type root in
   if typ <> "windows" then (
-    let paths = [ "/etc/pki/CA/certs/*.crt";
-                  "/etc/pki/CA/crl/*.crt";
-                  "/etc/pki/CA/newcerts/*.crt";
-                  "/etc/pki/CA/private/*.key";
-                  "/etc/pki/tls/private/*.key";
-                  "/etc/pki/tls/certs/*.crt"; ] in
     let excepts = [ "/etc/pki/tls/certs/ca-bundle.crt";
                     "/etc/pki/tls/certs/ca-bundle.trust.crt"; ] in
-    (* Thanks Rich for this StringSet method *)
-    let paths = List.concat (List.map Array.to_list (List.map g#glob_expand paths)) in
-    let set = List.fold_right StringSet.add paths StringSet.empty in
-    let excepts = List.fold_right StringSet.add excepts StringSet.empty in
-    let set = StringSet.diff set excepts in
-    StringSet.iter (
-      fun filename ->
-        try g#rm filename with G.Error _ -> ()
-    ) set
+    try
+      ignore (g#rm_globs ~norecurse:true ~exclude:(Array.of_list excepts)
+                (Array.of_list paths))
+    with G.Error _ -> ()
   )
 
 let op = {
@@ -49,6 +44,7 @@ let op = {
     name = "ca-certificates";
     enabled_by_default = false;
     heading = s_"Remove CA certificates in the guest";
+    footprint = paths;
     perform_on_filesystems = Some ca_certificates_perform;
 }
 
@@ -29,7 +29,7 @@ let globs = [
 let crash_data_perform (g : Guestfs.guestfs) root side_effects =
   let typ = g#inspect_get_type root in
   if typ = "linux" then (
-    List.iter (fun glob -> Array.iter g#rm_rf (g#glob_expand glob)) globs
+    ignore (g#rm_globs (Array.of_list globs))
   )
 
 let op = {
@@ -39,6 +39,7 @@ let op = {
     heading = s_"Remove the crash data generated by kexec-tools";
     pod_description = Some (s_"\
 Remove the automatically generated kdump kernel crash data.");
+    footprint = globs;
     perform_on_filesystems = Some crash_data_perform;
 }
 
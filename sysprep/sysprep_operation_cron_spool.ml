@@ -18,17 +18,10 @@
 
 open Sysprep_operation
 open Common_gettext.Gettext
-open Common_utils
 
 module G = Guestfs
 
 let cron_spool_perform (g : Guestfs.guestfs) root side_effects =
-  let is_seq path =
-    let basename =
-      match last_part_of path '/' with
-      | Some x -> x
-      | None -> path in
-    basename = ".SEQ" in
   let reset f =
     if g#is_file f then
       (* This should overwrite the file in-place, as it's a very
@@ -38,12 +31,15 @@ let cron_spool_perform (g : Guestfs.guestfs) root side_effects =
        *)
       g#write f "00000\n" in
 
-  rm_rf_only_files g ~filter:is_seq "/var/spool/cron/";
+  (* The .SEQ files are reset below, not removed. *)
+  ignore (g#rm_globs ~onlyfiles:true ~exclude:[| "*/.SEQ" |] [|
+    "/var/spool/cron";
+    "/var/spool/atjobs/*";
+    "/var/spool/atspool/*";
+    "/var/spool/at";
+  |]);
   reset "/var/spool/cron/atjobs/.SEQ";
-  Array.iter g#rm (g#glob_expand "/var/spool/atjobs/*");
   reset "/var/spool/atjobs/.SEQ";
-  Array.iter g#rm (g#glob_expand "/var/spool/atspool/*");
-  rm_rf_only_files g ~filter:is_seq "/var/spool/at/";
   reset "/var/spool/at/.SEQ"
 
 let op = {
@@ -51,6 +47,8 @@ let op = {
     name = "cron-spool";
     enabled_by_default = true;
     heading = s_"Remove user at-jobs and cron-jobs";
+    footprint = [ "/var/spool/cron"; "/var/spool/atjobs";
+                  "/var/spool/atspool/*"; "/var/spool/at" ];
     perform_on_filesystems = Some cron_spool_perform;
 }
 
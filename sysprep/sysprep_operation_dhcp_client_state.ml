@@ -21,12 +21,12 @@ open Common_gettext.Gettext
 
 module G = Guestfs
 
+let globs = [ "/var/lib/dhclient/*"; "/var/lib/dhcp/*" (* RHEL 3 *) ]
+
 let dhcp_client_state_perform (g : Guestfs.guestfs) root side_effects =
   let typ = g#inspect_get_type root in
   if typ = "linux" then (
-    List.iter (
-      fun glob -> Array.iter g#rm_rf (g#glob_expand glob)
-    ) [ "/var/lib/dhclient/*"; "/var/lib/dhcp/*" (* RHEL 3 *) ]
+    ignore (g#rm_globs (Array.of_list globs))
   )
 
 let op = {
@@ -34,6 +34,7 @@ let op = {
     name = "dhcp-client-state";
     enabled_by_default = true;
     heading = s_"Remove DHCP client leases";
+    footprint = globs;
     perform_on_filesystems = Some dhcp_client_state_perform;
 }
 
@@ -22,13 +22,14 @@ open Common_gettext.Gettext
 module G = Guestfs
 
 let dhcp_server_state_perform (g : Guestfs.guestfs) root side_effects =
-  Array.iter g#rm_rf (g#glob_expand "/var/lib/dhcpd/*")
+  ignore (g#rm_globs [| "/var/lib/dhcpd/*" |])
 
 let op = {
   defaults with
     name = "dhcp-server-state";
     enabled_by_default = true;
     heading = s_"Remove DHCP server leases";
+    footprint = [ "/var/lib/dhcpd/*" ];
     perform_on_filesystems = Some dhcp_server_state_perform;
 }
 
@@ -24,10 +24,8 @@ module G = Guestfs
 let dovecot_data_perform (g : Guestfs.guestfs) root side_effects =
   let typ = g#inspect_get_type root in
   if typ <> "windows" then (
-    let files = g#glob_expand "/var/lib/dovecot/*" in
-    Array.iter (
-      fun file -> try g#rm file with G.Error _ -> ()
-    ) files
+    try ignore (g#rm_globs ~norecurse:true [| "/var/lib/dovecot/*" |])
+    with G.Error _ -> ()
   )
 
 let op = {
@@ -35,6 +33,7 @@ let op = {
     name = "dovecot-data";
     enabled_by_default = true;
     heading = s_"Remove Dovecot (mail server) data";
+    footprint = [ "/var/lib/dovecot/*" ];
     perform_on_filesystems = Some dovecot_data_perform;
 }
 
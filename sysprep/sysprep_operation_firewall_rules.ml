@@ -21,20 +21,15 @@ open Common_gettext.Gettext
 
 module G = Guestfs
 
+let paths = [ "/etc/sysconfig/iptables";
+              "/etc/firewalld/services/*";
+              "/etc/firewalld/zones/*"; ]
+
 let firewall_rules_perform (g : Guestfs.guestfs) root side_effects =
   let typ = g#inspect_get_type root in
   if typ <> "windows" then (
-    let paths = [ "/etc/sysconfig/iptables";
-                  "/etc/firewalld/services/*";
-                  "/etc/firewalld/zones/*"; ] in
-    List.iter (
-      fun path ->
-        let files = g#glob_expand path in
-        Array.iter (
-          fun file ->
-            try g#rm file with G.Error _ -> ()
-        ) files;
-    ) paths
+    try ignore (g#rm_globs ~norecurse:true (Array.of_list paths))
+    with G.Error _ -> ()
   )
 
 let op = {
@@ -48,6 +43,7 @@ or custom firewalld configuration in C</etc/firewalld/*/*>.
 
 Note this is I<not> enabled by default since it may expose guests to
 exploits.  Use with care.");
+    footprint = paths;
     perform_on_filesystems = Some firewall_rules_perform;
 }
 
@@ -19,7 +19,6 @@
 open Sysprep_operation
 open Common_gettext.Gettext
 
-module StringSet = Set.Make (String)
 module G = Guestfs
 
 let kerberos_data_perform (g : Guestfs.guestfs) root side_effects =
@@ -27,14 +26,10 @@ let kerberos_data_perform (g : Guestfs.guestfs) root side_effects =
   if typ <> "windows" then (
     let excepts = [ "/var/kerberos/krb5kdc/kadm5.acl";
                     "/var/kerberos/krb5kdc/kdc.conf"; ] in
-    let paths = Array.to_list (g#glob_expand "/var/kerberos/krb5kdc/*") in
-    let set = List.fold_right StringSet.add paths StringSet.empty in
-    let excepts = List.fold_right StringSet.add excepts StringSet.empty in
-    let set = StringSet.diff set excepts in
-    StringSet.iter (
-      fun filename ->
-        try g#rm filename with G.Error _ -> ()
-    ) set
+    try
+      ignore (g#rm_globs ~norecurse:true ~exclude:(Array.of_list excepts)
+                [| "/var/kerberos/krb5kdc/*" |])
+    with G.Error _ -> ()
   )
 
 let op = {
@@ -42,6 +37,7 @@ let op = {
     name = "kerberos-data";
     enabled_by_default = false;
     heading = s_"Remove Kerberos data in the guest";
+    footprint = [ "/var/kerberos/krb5kdc/*" ];
     perform_on_filesystems = Some kerberos_data_perform;
 }
 
@@ -137,7 +137,7 @@ let globs_as_pod = pod_of_list globs
 let logfiles_perform (g : Guestfs.guestfs) root side_effects =
   let typ = g#inspect_get_type root in
   if typ = "linux" then (
-    List.iter (fun glob -> Array.iter g#rm_rf (g#glob_expand glob)) globs
+    ignore (g#rm_globs (Array.of_list globs))
   )
 
 let op = {
@@ -150,6 +150,7 @@ let op = {
 On Linux the following files are removed:
 
 %s") globs_as_pod);
+    footprint = globs;
     perform_on_filesystems = Some logfiles_perform;
 }
 
@@ -21,11 +21,12 @@ open Common_gettext.Gettext
 
 module G = Guestfs
 
+let paths = [ "/etc/machine-id";
+              "/var/lib/dbus/machine-id"; ]
+
 let machine_id_perform (g : Guestfs.guestfs) root side_effects =
   let typ = g#inspect_get_type root in
   if typ <> "windows" then (
-    let paths = [ "/etc/machine-id";
-                  "/var/lib/dbus/machine-id"; ] in
     let paths = List.filter g#is_file paths in
     List.iter g#truncate paths
   )
@@ -40,6 +41,7 @@ The machine ID is usually generated from a random source during system
 installation and stays constant for all subsequent boots.  Optionally,
 for stateless systems it is generated during runtime at boot if it is
 found to be empty.");
+    footprint = paths;
     perform_on_filesystems = Some machine_id_perform;
 }
 
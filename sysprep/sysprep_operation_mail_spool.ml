@@ -21,19 +21,20 @@ open Common_gettext.Gettext
 
 module G = Guestfs
 
+let globs = [
+  "/var/spool/mail/*";
+  "/var/mail/*";
+]
+
 let mail_spool_perform (g : Guestfs.guestfs) root side_effects =
-  List.iter (
-    fun glob -> Array.iter g#rm_rf (g#glob_expand glob)
-  ) [
-    "/var/spool/mail/*";
-    "/var/mail/*";
-  ]
+  ignore (g#rm_globs (Array.of_list globs))
 
 let op = {
   defaults with
     name = "mail-spool";
     enabled_by_default = true;
     heading = s_"Remove email from the local mail spool directory";
+    footprint = globs;
     perform_on_filesystems = Some mail_spool_perform;
 }
 
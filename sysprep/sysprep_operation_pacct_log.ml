@@ -26,22 +26,16 @@ let pacct_log_perform (g : Guestfs.guestfs) root side_effects =
   let distro = g#inspect_get_distro root in
   match typ, distro with
   | "linux", ("fedora"|"rhel"|"centos"|"scientificlinux"|"redhat-based") ->
-    let files = g#glob_expand "/var/account/pacct*" in
-    Array.iter (
-      fun file ->
-        try g#rm file with G.Error _ -> ()
-      ) files;
+    (try ignore (g#rm_globs ~norecurse:true [| "/var/account/pacct*" |])
+     with G.Error _ -> ());
     (try
        g#touch "/var/account/pacct";
        side_effects#created_file ()
      with G.Error _ -> ())
 
   | "linux", ("debian"|"ubuntu") ->
-    let files = g#glob_expand "/var/log/account/pacct*" in
-    Array.iter (
-      fun file ->
-        try g#rm file with G.Error _ -> ()
-      ) files;
+    (try ignore (g#rm_globs ~norecurse:true [| "/var/log/account/pacct*" |])
+     with G.Error _ -> ());
     (try
        g#touch "/var/log/account/pacct";
        side_effects#created_file ()
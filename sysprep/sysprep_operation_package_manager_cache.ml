@@ -18,7 +18,6 @@
 
 open Sysprep_operation
 open Common_gettext.Gettext
-open Common_utils
 
 module G = Guestfs
 
@@ -33,10 +32,10 @@ let package_manager_cache_perform (g : Guestfs.guestfs) root side_effects =
     | "yum" ->
       Some [ "/var/cache/yum/" ]
     | "zypper" ->
-      Some (Array.to_list (g#glob_expand "/var/cache/zypp*"))
+      Some [ "/var/cache/zypp*" ]
     | _ -> None in
   match cache_dirs with
-  | Some dirs -> List.iter (rm_rf_only_files g) dirs
+  | Some dirs -> ignore (g#rm_globs ~onlyfiles:true (Array.of_list dirs))
   | None -> ()
 
 let op = {
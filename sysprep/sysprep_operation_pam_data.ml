@@ -21,20 +21,15 @@ open Common_gettext.Gettext
 
 module G = Guestfs
 
+let paths = [ "/var/run/console/*";
+              "/var/run/faillock/*";
+              "/var/run/sepermit/*"; ]
+
 let pam_data_perform (g : Guestfs.guestfs) root side_effects =
   let typ = g#inspect_get_type root in
   if typ <> "windows" then (
-    let paths = [ "/var/run/console/*";
-                  "/var/run/faillock/*";
-                  "/var/run/sepermit/*"; ] in
-    List.iter (
-      fun path ->
-        let files = g#glob_expand path in
-        Array.iter (
-          fun file ->
-            try g#rm file with G.Error _ -> ()
-        ) files;
-    ) paths
+    try ignore (g#rm_globs ~norecurse:true (Array.of_list paths))
+    with G.Error _ -> ()
   )
 
 let op = {
@@ -42,6 +37,7 @@ let op = {
     name = "pam-data";
     enabled_by_default = true;
     heading = s_"Remove the PAM data in the guest";
+    footprint = paths;
     perform_on_filesystems = Some pam_data_perform;
 }
 
@@ -27,8 +27,8 @@ let rh_subscription_manager_perform (g : Guestfs.guestfs) root side_effects =
 
   match typ, distro with
   | "linux", "rhel" ->
-    Array.iter g#rm_rf (g#glob_expand "/etc/pki/consumer/*");
-    Array.iter g#rm_rf (g#glob_expand "/etc/pki/entitlement/*")
+    ignore (g#rm_globs [| "/etc/pki/consumer/*";
+                          "/etc/pki/entitlement/*" |])
   | _ -> ()
 
 let op = {
@@ -36,6 +36,7 @@ let op = {
     name = "rh-subscription-manager";
     enabled_by_default = true;
     heading = s_"Remove the RH subscription manager files";
+    footprint = [ "/etc/pki/consumer/*"; "/etc/pki/entitlement/*" ];
     perform_on_filesystems = Some rh_subscription_manager_perform;
 }
 
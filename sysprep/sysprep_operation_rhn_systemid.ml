@@ -36,6 +36,8 @@ let op = {
     name = "rhn-systemid";
     enabled_by_default = true;
     heading = s_"Remove the RHN system ID";
+    footprint = [ "/etc/sysconfig/rhn/systemid";
+                  "/etc/sysconfig/rhn/osad-auth.conf" ];
     perform_on_filesystems = Some rhn_systemid_perform;
 }
 
@@ -25,11 +25,8 @@ module G = Guestfs
 let rpm_db_perform (g : Guestfs.guestfs) root side_effects =
   let pf = g#inspect_get_package_format root in
   if pf = "rpm" then (
-    let paths = g#glob_expand "/var/lib/rpm/__db.*" in
-    Array.iter (
-      fun filename ->
-        try g#rm filename with G.Error _ -> ()
-    ) paths
+    try ignore (g#rm_globs ~norecurse:true [| "/var/lib/rpm/__db.*" |])
+    with G.Error _ -> ()
   )
 
 let op = {
@@ -40,6 +37,7 @@ let op = {
     pod_description = Some (s_"\
 Remove host-specific RPM database files and locks.  RPM will
 recreate these files automatically if needed.");
+    footprint = [ "/var/lib/rpm/__db.*" ];
     perform_on_filesystems = Some rpm_db_perform;
 }
 
@@ -21,21 +21,16 @@ open Common_gettext.Gettext
 
 module G = Guestfs
 
+let paths = [ "/var/log/samba/old/*";
+              "/var/log/samba/*";
+              "/var/lib/samba/*/*";
+              "/var/lib/samba/*"; ]
+
 let samba_db_log_perform (g : Guestfs.guestfs) root side_effects =
   let typ = g#inspect_get_type root in
   if typ <> "windows" then (
-    let paths = [ "/var/log/samba/old/*";
-                  "/var/log/samba/*";
-                  "/var/lib/samba/*/*";
-                  "/var/lib/samba/*"; ] in
-    List.iter (
-      fun path ->
-        let files = g#glob_expand path in
-        Array.iter (
-          fun file ->
-            try g#rm file with G.Error _ -> ()
-        ) files;
-    ) paths
+    try ignore (g#rm_globs ~norecurse:true (Array.of_list paths))
+    with G.Error _ -> ()
   )
 
 let op = {
@@ -43,6 +38,7 @@ let op = {
     name = "samba-db-log";
     enabled_by_default = true;
     heading = s_"Remove the database and log files of Samba";
+    footprint = paths;
     perform_on_filesystems = Some samba_db_log_perform;
 }
 
@@ -21,15 +21,15 @@ open Common_gettext.Gettext
 
 module G = Guestfs
 
+let files = [ "/etc/sysconfig/hw-uuid";
+              "/etc/smolt/uuid";
+              "/etc/smolt/hw-uuid" ]
+
 let smolt_uuid_perform g root side_effects =
   let typ = g#inspect_get_type root in
   if typ = "linux" then (
-    let files = [ "/etc/sysconfig/hw-uuid";
-                  "/etc/smolt/uuid";
-                  "/etc/smolt/hw-uuid" ] in
-    List.iter (
-      fun file -> try g#rm file with G.Error _ -> ()
-    ) files
+    try ignore (g#rm_globs ~norecurse:true (Array.of_list files))
+    with G.Error _ -> ()
   )
 
 let op = {
@@ -37,6 +37,7 @@ let op = {
     name = "smolt-uuid";
     enabled_by_default = true;
     heading = s_"Remove the Smolt hardware UUID";
+    footprint = files;
     perform_on_filesystems = Some smolt_uuid_perform;
 }
 
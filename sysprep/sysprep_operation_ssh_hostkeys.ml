@@ -24,8 +24,7 @@ module G = Guestfs
 let ssh_hostkeys_perform (g : Guestfs.guestfs) root side_effects =
   let typ = g#inspect_get_type root in
   if typ <> "windows" then (
-    let files = g#glob_expand "/etc/ssh/*_host_*" in
-    Array.iter g#rm files
+    ignore (g#rm_globs ~norecurse:true [| "/etc/ssh/*_host_*" |])
   )
 
 let op = {
@@ -44,6 +43,7 @@ you a stark warning about the host key changing:
  @    WARNING: REMOTE HOST IDENTIFICATION HAS CHANGED!     @
  @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
  IT IS POSSIBLE THAT SOMEONE IS DOING SOMETHING NASTY!");
+    footprint = [ "/etc/ssh/*_host_*" ];
     perform_on_filesystems = Some ssh_hostkeys_perform;
 }
 
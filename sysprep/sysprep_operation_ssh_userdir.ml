@@ -24,11 +24,7 @@ module G = Guestfs
 let ssh_userdir_perform (g : Guestfs.guestfs) root side_effects =
   let typ = g#inspect_get_type root in
   if typ <> "windows" then (
-    let dirs = g#glob_expand "/home/*/.ssh" in
-    Array.iter (
-      fun dir -> g#rm_rf dir;
-    ) dirs;
-    g#rm_rf "/root/.ssh"
+    ignore (g#rm_globs [| "/home/*/.ssh"; "/root/.ssh" |])
   )
 
 let op = {
@@ -43,6 +39,7 @@ users who have a C<.ssh> directory in their home directory.");
 Currently this only looks in C</root> and C</home/*> for
 home directories, so users with home directories in other
 locations won't have the ssh files removed.");
+    footprint = [ "/home/*/.ssh"; "/root/.ssh" ];
     perform_on_filesystems = Some ssh_userdir_perform;
 }
 
@@ -21,19 +21,14 @@ open Common_gettext.Gettext
 
 module G = Guestfs
 
+let paths = [ "/var/log/sssd/*";
+              "/var/lib/sss/db/*" ]
+
 let sssd_db_log_perform (g : Guestfs.guestfs) root side_effects =
   let typ = g#inspect_get_type root in
   if typ <> "windows" then (
-    let paths = [ "/var/log/sssd/*";
-                  "/var/lib/sss/db/*" ] in
-    List.iter (
-      fun path ->
-        let files = g#glob_expand path in
-        Array.iter (
-          fun file ->
-            try g#rm file with G.Error _ -> ()
-        ) files;
-    ) paths
+    try ignore (g#rm_globs ~norecurse:true (Array.of_list paths))
+    with G.Error _ -> ()
   )
 
 let op = {
@@ -41,6 +36,7 @@ let op = {
     name = "sssd-db-log";
     enabled_by_default = true;
     heading = s_"Remove the database and log files of sssd";
+    footprint = paths;
     perform_on_filesystems = Some sssd_db_log_perform;
 }
 
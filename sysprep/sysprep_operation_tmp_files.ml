@@ -21,27 +21,16 @@ open Common_gettext.Gettext
 
 module G = Guestfs
 
+(* The last two patterns match the hidden files, but not . and .. *)
+let globs =
+  List.concat (List.map (
+    fun path -> [ path ^ "/*"; path ^ "/.[!.]*"; path ^ "/..?*" ]
+  ) [ "/tmp"; "/var/tmp" ])
+
 let tmp_files_perform (g : Guestfs.guestfs) root side_effects =
   let typ = g#inspect_get_type root in
-  if typ <> "windows" then (
-    let paths = [ "/tmp";
-                  "/var/tmp"; ] in
-    List.iter (
-      fun path ->
-        let files = g#glob_expand (path ^ "/*") in
-        Array.iter (
-          fun file ->
-            g#rm_rf file;
-        ) files;
-        (try
-          let files = g#ls path in
-          Array.iter (
-            fun file ->
-              g#rm_rf (path ^ "/" ^ file);
-          ) files
-        with G.Error _ -> ());
-    ) paths
-  )
+  if typ <> "windows" then
+    ignore (g#rm_globs (Array.of_list globs))
 
 let op = {
   defaults with
@@ -50,6 +39,7 @@ let op = {
     heading = s_"Remove temporary files";
     pod_description = Some (s_"\
 This removes temporary files under C</tmp> and C</var/tmp>.");
+    footprint = globs;
     perform_on_filesystems = Some tmp_files_perform;
 }
 
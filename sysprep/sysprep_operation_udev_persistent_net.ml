@@ -41,6 +41,7 @@ After a guest is cloned, the MAC address usually changes.  Since the
 old MAC address occupies the old name (eg. eth0), this means the fresh
 MAC address is assigned to a new name (eg. eth1) and this is usually
 undesirable.  Erasing the udev persistent net rules avoids this.");
+    footprint = [ "/etc/udev/rules.d/70-persistent-net.rules" ];
     perform_on_filesystems = Some udev_persistent_net_perform;
 }
 
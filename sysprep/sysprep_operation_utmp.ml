@@ -37,6 +37,7 @@ let op = {
 This file records who is currently logged in on a machine.  In modern
 Linux distros it is stored in a ramdisk and hence not part of the
 virtual machine's disk, but it was stored on disk in older distros.");
+    footprint = [ "/var/run/utmp" ];
     perform_on_filesystems = Some utmp_perform;
 }
 
@@ -35,6 +35,7 @@ let op = {
     pod_description = Some (s_"\
 Yum creates a fresh UUID the next time it runs when it notices that the
 original UUID has been erased.");
+    footprint = [ "/var/lib/yum/uuid" ];
     perform_on_filesystems = Some yum_uuid_perform;
 }
 
@@ -20,6 +20,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <inttypes.h>
 #include <string.h>
@@ -31,6 +32,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/vfs.h>
 #include <locale.h>
 #include <limits.h>
 #include <libintl.h>
@@ -49,6 +52,7 @@
 static int timeout = DEFAULT_TIMEOUT;
 
 static void set_qemu (guestfs_h *g, const char *path, int use_wrapper);
+static void benchmark (const char *hv);
 
 static void
 usage (void)
@@ -58,6 +62,7 @@ usage (void)
             "Usage:\n"
             "  libguestfs-test-tool [--options]\n"
             "Options:\n"
+            "  --benchmark    Measure the speed of the appliance\n"
             "  --help         Display usage\n"
             "  --qemudir dir  Specify QEMU source directory\n"
             "  --qemu qemu    Specify QEMU binary\n"
@@ -80,6 +85,7 @@ main (int argc, char *argv[])
 
   static const char options[] = "t:V?";
   static const struct option long_options[] = {
+    { "benchmark", 0, 0, 0 },
     { "help", 0, 0, '?' },
     { "qemu", 1, 0, 0 },
     { "qemudir", 1, 0, 0 },
@@ -96,6 +102,7 @@ main (int argc, char *argv[])
   guestfs_h *g;
   char *qemu = NULL;
   int qemu_use_wrapper = 0;
+  int benchmark_mode = 0;
 
   for (;;) {
     c = getopt_long (argc, argv, options, long_options, &option_index);
@@ -103,7 +110,9 @@ main (int argc, char *argv[])
 
     switch (c) {
     case 0:			/* options which are long only */
-      if (STREQ (long_options[option_index].name, "qemu")) {
+      if (STREQ (long_options[option_index].name, "benchmark"))
+        benchmark_mode = 1;
+      else if (STREQ (long_options[option_index].name, "qemu")) {
         qemu = optarg;
         qemu_use_wrapper = 0;
       }
@@ -278,6 +287,12 @@ main (int argc, char *argv[])
   if (guestfs_shutdown (g) == -1)
     exit (EXIT_FAILURE);
 
+  if (benchmark_mode) {
+    p = guestfs_get_hv (g);
+    benchmark (p);
+    free (p);
+  }
+
   guestfs_close (g);
 
   /* Booted and performed some simple operations -- success! */
@@ -359,3 +374,343 @@ set_qemu (guestfs_h *g, const char *path, int use_wrapper)
   guestfs_set_hv (g, qemuwrapper);
   atexit (cleanup_wrapper);
 }
+
+/* Benchmark mode.
+ *
+ * The measurements are compared with what a reasonably modern host
+ * using KVM achieves easily, and anything well below that is
+ * reported as a finding together with the likely causes we can spot
+ * on the host.  The baselines are deliberately generous: the aim is
+ * to find environments which are broken or badly configured (TCG,
+ * nested virtualization, disks or temporary files on NFS), not to
+ * grade fast hosts.
+ */
+
+/* Expected values. */
+#define BASELINE_LAUNCH_MS        5000   /* launch time */
+#define BASELINE_RPC_US           300    /* round trip of a no-op call */
+#define BASELINE_CHANNEL_MBPS     100    /* upload/download */
+#define BASELINE_DISK_MBPS        20     /* small O_DIRECT reads/writes */
+
+#define BENCHMARK_RPC_CALLS       1000
+#define BENCHMARK_TRANSFER_SIZE   (INT64_C(256) * 1024 * 1024)
+#define BENCHMARK_DISK_SECS       "5"
+
+/* statfs f_type of filesystems which are slow for temporary files. */
+#define NFS_SUPER_MAGIC           0x6969
+#define SMB_SUPER_MAGIC           0x517B
+#define CIFS_MAGIC_NUMBER         0xFF534D42
+#define FUSE_SUPER_MAGIC          0x65735546
+#define CEPH_SUPER_MAGIC          0x00C36400
+
+/* Findings are printed after the measurements. */
+#define MAX_FINDINGS 16
+static char *findings[MAX_FINDINGS];
+static size_t nr_findings;
+
+static void finding (const char *fs, ...)
+  __attribute__((format (printf,1,2)));
+
+static void
+finding (const char *fs, ...)
+{
+  va_list args;
+  int r;
+
+  if (nr_findings >= MAX_FINDINGS)
+    return;
+
+  va_start (args, fs);
+  r = vasprintf (&findings[nr_findings], fs, args);
+  va_end (args);
+  if (r == -1)
+    error (EXIT_FAILURE, errno, "vasprintf");
+  nr_findings++;
+}
+
+/* Return Y - X in microseconds. */
+static int64_t
+timeval_diff_us (const struct timeval *x, const struct timeval *y)
+{
+  return (y->tv_sec - x->tv_sec) * INT64_C(1000000) +
+    (y->tv_usec - x->tv_usec);
+}
+
+static int64_t
+mbps (int64_t bytes, int64_t us)
+{
+  return us > 0 ? bytes * 1000000 / us / (1024 * 1024) : 0;
+}
+
+/* Return the name of the filesystem type if 'path' is on a network
+ * or FUSE filesystem, else NULL.
+ */
+static const char *
+slow_filesystem (const char *path)
+{
+  struct statfs buf;
+
+  if (path == NULL || statfs (path, &buf) == -1)
+    return NULL;
+
+  switch ((uint32_t) buf.f_type) {
+  case NFS_SUPER_MAGIC: return "NFS";
+  case SMB_SUPER_MAGIC: return "SMB";
+  case CIFS_MAGIC_NUMBER: return "CIFS";
+  case FUSE_SUPER_MAGIC: return "FUSE";
+  case CEPH_SUPER_MAGIC: return "CephFS";
+  default: return NULL;
+  }
+}
+
+/* Return true if any line of a file in /proc contains 'str'. */
+static int
+proc_file_contains (const char *filename, const char *str)
+{
+  FILE *fp;
+  CLEANUP_FREE char *line = NULL;
+  size_t len = 0;
+  int r = 0;
+
+  fp = fopen (filename, "r");
+  if (fp == NULL)
+    return 0;
+  while (!r && getline (&line, &len, fp) != -1) {
+    if (strstr (line, str) != NULL)
+      r = 1;
+  }
+  fclose (fp);
+  return r;
+}
+
+/* Return the number of free huge pages, or -1 if unknown. */
+static long
+free_huge_pages (void)
+{
+  FILE *fp;
+  CLEANUP_FREE char *line = NULL;
+  size_t len = 0;
+  long n = -1;
+
+  fp = fopen ("/proc/meminfo", "r");
+  if (fp == NULL)
+    return -1;
+  while (getline (&line, &len, fp) != -1) {
+    if (sscanf (line, "HugePages_Free: %ld", &n) == 1)
+      break;
+  }
+  fclose (fp);
+  return n;
+}
+
+/* Things we can check on the host without running anything. */
+static void
+check_host (guestfs_h *g)
+{
+  CLEANUP_FREE char *backend = guestfs_get_backend (g);
+  CLEANUP_FREE char *tmpdir = guestfs_get_tmpdir (g);
+  CLEANUP_FREE char *cachedir = guestfs_get_cachedir (g);
+  CLEANUP_FREE char *force_tcg = NULL, *hugepages = NULL;
+  const char *type;
+  int fd;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  force_tcg = guestfs_get_backend_setting (g, "force_tcg");
+  hugepages = guestfs_get_backend_setting (g, "hugepages");
+  guestfs_pop_error_handler (g);
+
+  if (force_tcg)
+    finding ("running under TCG (software emulation) because the "
+             "force_tcg backend setting is used");
+  else {
+    fd = open ("/dev/kvm", O_RDWR|O_CLOEXEC);
+    if (fd >= 0)
+      close (fd);
+    else if (backend && STREQ (backend, "direct"))
+      finding ("running under TCG (software emulation), which is 10-20 "
+               "times slower than KVM: /dev/kvm: %s", strerror (errno));
+    else
+      finding ("/dev/kvm: %s: if libvirt cannot use KVM either, the "
+               "appliance runs under TCG (software emulation)",
+               strerror (errno));
+  }
+
+  /* x86 hosts which are virtual machines have the "hypervisor" flag. */
+  if (proc_file_contains ("/proc/cpuinfo", " hypervisor"))
+    finding ("this host is a virtual machine, so the appliance uses "
+             "nested virtualization, which is much slower for I/O and "
+             "may not be available at all");
+
+  type = slow_filesystem (tmpdir);
+  if (type)
+    finding ("TMPDIR (%s) is on %s: the appliance overlay and scratch "
+             "disks are written there", tmpdir, type);
+  type = slow_filesystem (cachedir);
+  if (type)
+    finding ("LIBGUESTFS_CACHEDIR (%s) is on %s: the appliance is "
+             "read from there", cachedir, type);
+
+  if (hugepages && guestfs_int_is_true (hugepages) > 0 &&
+      free_huge_pages () == 0)
+    finding ("the hugepages backend setting is used, but there are no "
+             "free huge pages (see /proc/meminfo)");
+}
+
+/* Check how the disks are attached to the appliance. */
+static void
+check_disk_interface (guestfs_h *g)
+{
+  const char *sys_block[] = { "/sys/block", NULL };
+  const char *virtio_scsi[] = { "/sys/bus/virtio/drivers/virtio_scsi", NULL };
+  CLEANUP_FREE char *out = NULL, *out2 = NULL;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  out = guestfs_debug (g, "ls", (char **) sys_block);
+  if (out && strstr (out, "\nvda") != NULL)
+    finding ("virtio-scsi is not available, so the disks are attached "
+             "with virtio-blk");
+  else if (out) {
+    out2 = guestfs_debug (g, "ls", (char **) virtio_scsi);
+    if (out2 == NULL)
+      finding ("the disks are not attached with virtio (emulated "
+               "IDE or SATA), which is very slow");
+  }
+  guestfs_pop_error_handler (g);
+}
+
+static void
+benchmark (const char *hv)
+{
+  guestfs_h *g;
+  struct timeval start, end;
+  int64_t launch_us, rpc_us, upload_us, download_us, bytes;
+  char tmpfile[] = P_tmpdir "/libguestfs-test-tool-benchmark-XXXXXX";
+  const char *argv[4];
+  char *r;
+  size_t i;
+  int fd, ret;
+
+  printf ("===== Benchmark =====\n");
+  fflush (stdout);
+
+  /* A fresh, non-verbose handle, since the debug output slows down
+   * the appliance.
+   */
+  g = guestfs_create_flags (GUESTFS_CREATE_NO_ENVIRONMENT);
+  if (g == NULL)
+    error (EXIT_FAILURE, errno, "guestfs_create_flags");
+  if (guestfs_parse_environment (g) == -1)
+    exit (EXIT_FAILURE);
+  guestfs_set_verbose (g, 0);
+  guestfs_set_trace (g, 0);
+  if (hv)
+    guestfs_set_hv (g, hv);
+
+  check_host (g);
+
+  if (guestfs_add_drive_scratch (g, INT64_C(1024) * 1024 * 1024, -1) == -1)
+    exit (EXIT_FAILURE);
+
+  alarm (timeout);
+  gettimeofday (&start, NULL);
+  if (guestfs_launch (g) == -1)
+    exit (EXIT_FAILURE);
+  gettimeofday (&end, NULL);
+  alarm (0);
+  launch_us = timeval_diff_us (&start, &end);
+  printf ("%-24s %" PRIi64 " ms\n", "launch time:", launch_us / 1000);
+
+  check_disk_interface (g);
+
+  /* Round trip time of a call which does nothing in the daemon. */
+  gettimeofday (&start, NULL);
+  for (i = 0; i < BENCHMARK_RPC_CALLS; ++i) {
+    if (guestfs_ping_daemon (g) == -1)
+      exit (EXIT_FAILURE);
+  }
+  gettimeofday (&end, NULL);
+  rpc_us = timeval_diff_us (&start, &end) / BENCHMARK_RPC_CALLS;
+  printf ("%-24s %" PRIi64 " us\n", "RPC round trip:", rpc_us);
+
+  /* Channel throughput.  Upload a sparse file to /dev/null, and
+   * download the unwritten (sparse) scratch disk, so that neither
+   * disk is involved.
+   */
+  fd = mkstemp (tmpfile);
+  if (fd == -1)
+    error (EXIT_FAILURE, errno, "mkstemp: %s", tmpfile);
+  if (ftruncate (fd, BENCHMARK_TRANSFER_SIZE) == -1)
+    error (EXIT_FAILURE, errno, "ftruncate: %s", tmpfile);
+  close (fd);
+  gettimeofday (&start, NULL);
+  ret = guestfs_upload (g, tmpfile, "/dev/null");
+  gettimeofday (&end, NULL);
+  unlink (tmpfile);
+  if (ret == -1)
+    exit (EXIT_FAILURE);
+  upload_us = timeval_diff_us (&start, &end);
+  printf ("%-24s %" PRIi64 " MB/s\n", "channel upload:",
+          mbps (BENCHMARK_TRANSFER_SIZE, upload_us));
+
+  gettimeofday (&start, NULL);
+  if (guestfs_download_offset (g, "/dev/sda", "/dev/null",
+                               0, BENCHMARK_TRANSFER_SIZE) == -1)
+    exit (EXIT_FAILURE);
+  gettimeofday (&end, NULL);
+  download_us = timeval_diff_us (&start, &end);
+  printf ("%-24s %" PRIi64 " MB/s\n", "channel download:",
+          mbps (BENCHMARK_TRANSFER_SIZE, download_us));
+
+  /* Disk throughput, using small direct I/O to the scratch disk,
+   * which is a file in TMPDIR.
+   */
+  argv[0] = "/dev/sda";
+  argv[2] = BENCHMARK_DISK_SECS;
+  argv[3] = NULL;
+  for (i = 0; i < 2; ++i) {
+    const char *name = i == 0 ? "disk write:" : "disk read:";
+
+    argv[1] = i == 0 ? "w" : "r";
+    r = guestfs_debug (g, "device_speed", (char **) argv);
+    if (r == NULL)
+      exit (EXIT_FAILURE);
+    if (sscanf (r, "%" SCNi64, &bytes) != 1)
+      error (EXIT_FAILURE, 0,
+             _("could not parse device_speed output: %s"), r);
+    free (r);
+    bytes /= atoi (BENCHMARK_DISK_SECS);
+    printf ("%-24s %" PRIi64 " MB/s\n", name, bytes / 1024 / 1024);
+
+    if (bytes / 1024 / 1024 < BASELINE_DISK_MBPS)
+      finding ("%s %" PRIi64 " MB/s is slow (expected at least %d MB/s): "
+               "check the storage behind TMPDIR", name,
+               bytes / 1024 / 1024, BASELINE_DISK_MBPS);
+  }
+
+  if (guestfs_shutdown (g) == -1)
+    exit (EXIT_FAILURE);
+  guestfs_close (g);
+
+  if (launch_us / 1000 > BASELINE_LAUNCH_MS)
+    finding ("launching took %" PRIi64 " ms (expected under %d ms)",
+             launch_us / 1000, BASELINE_LAUNCH_MS);
+  if (rpc_us > BASELINE_RPC_US)
+    finding ("each call to the appliance takes %" PRIi64 " us (expected "
+             "under %d us), so programs making many small calls will "
+             "be slow", rpc_us, BASELINE_RPC_US);
+  if (mbps (BENCHMARK_TRANSFER_SIZE, upload_us) < BASELINE_CHANNEL_MBPS ||
+      mbps (BENCHMARK_TRANSFER_SIZE, download_us) < BASELINE_CHANNEL_MBPS)
+    finding ("uploads and downloads are slow (expected at least %d MB/s)",
+             BASELINE_CHANNEL_MBPS);
+
+  if (nr_findings == 0)
+    printf ("No problems found.\n");
+  else {
+    printf ("Findings:\n");
+    for (i = 0; i < nr_findings; ++i) {
+      printf (" - %s\n", findings[i]);
+      free (findings[i]);
+    }
+  }
+  fflush (stdout);
+}
@@ -0,0 +1,120 @@
+/* libguestfs
+ * Copyright (C) 2010 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Test the asynchronous guestfs_submit_* and guestfs_wait_* calls,
+ * with more calls in flight than the library lets go unread, replies
+ * collected out of order, and synchronous calls mixed in.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <error.h>
+
+#include "guestfs.h"
+#include "guestfs-internal-frontend.h"
+
+#define NR_FILES 40
+
+int
+main (int argc, char *argv[])
+{
+  guestfs_h *g;
+  char path[64];
+  int serials[NR_FILES];
+  int serial;
+  size_t i;
+
+  g = guestfs_create ();
+  if (g == NULL)
+    error (EXIT_FAILURE, errno, "guestfs_create");
+
+  if (guestfs_add_drive_scratch (g, 524288000, -1) == -1)
+    exit (EXIT_FAILURE);
+
+  if (guestfs_launch (g) == -1)
+    exit (EXIT_FAILURE);
+
+  if (guestfs_part_disk (g, "/dev/sda", "mbr") == -1)
+    exit (EXIT_FAILURE);
+
+  if (guestfs_mkfs (g, "ext2", "/dev/sda1") == -1)
+    exit (EXIT_FAILURE);
+
+  if (guestfs_mount (g, "/dev/sda1", "/") == -1)
+    exit (EXIT_FAILURE);
+
+  /* Create files of different sizes, so we can tell the replies apart. */
+  for (i = 0; i < NR_FILES; ++i) {
+    snprintf (path, sizeof path, "/file%zu", i);
+    if (guestfs_fallocate64 (g, path, 0, i * 512) == -1)
+      exit (EXIT_FAILURE);
+  }
+
+  /* Submit all of the calls before waiting for any. */
+  for (i = 0; i < NR_FILES; ++i) {
+    snprintf (path, sizeof path, "/file%zu", i);
+    serials[i] = guestfs_submit_statns (g, path);
+    if (serials[i] == -1)
+      exit (EXIT_FAILURE);
+  }
+
+  /* A synchronous call while the asynchronous calls are in flight. */
+  if (guestfs_exists (g, "/file0") != 1)
+    error (EXIT_FAILURE, 0, "guestfs_exists: /file0 should exist");
+
+  /* An asynchronous call which fails. */
+  serial = guestfs_submit_statns (g, "/nosuchfile");
+  if (serial == -1)
+    exit (EXIT_FAILURE);
+
+  /* Collect the replies in reverse order. */
+  for (i = NR_FILES; i > 0; --i) {
+    struct guestfs_statns *st = guestfs_wait_statns (g, serials[i-1]);
+
+    if (st == NULL)
+      exit (EXIT_FAILURE);
+    if (st->st_size != (int64_t) (i-1) * 512)
+      error (EXIT_FAILURE, 0,
+             "guestfs_wait_statns: /file%zu: expected size %zu, got %" PRIi64,
+             i-1, (i-1) * 512, st->st_size);
+    guestfs_free_statns (st);
+  }
+
+  if (guestfs_wait_statns (g, serial) != NULL)
+    error (EXIT_FAILURE, 0,
+           "guestfs_wait_statns: expected error for missing file");
+  if (guestfs_last_errno (g) != ENOENT)
+    error (EXIT_FAILURE, 0,
+           "guestfs_wait_statns: expected errno == ENOENT, but got %d",
+           guestfs_last_errno (g));
+
+  /* Waiting again for the same call is an error. */
+  if (guestfs_wait_statns (g, serial) != NULL)
+    error (EXIT_FAILURE, 0,
+           "guestfs_wait_statns: expected error waiting twice for a call");
+
+  guestfs_close (g);
+
+  exit (EXIT_SUCCESS);
+}
@@ -140,6 +140,32 @@ if [ "$(cat inspect-fstab.output)" != "/dev/VG/Root
     exit 1
 fi
 
+# Whitespace variations, which are parsed by the library without
+# using Augeas.
+printf '%b\n' \
+  '/dev/VG/Root\t/\text2\tdefault\t0\t0' \
+  '   # Indented comment.' \
+  '  /dev/xvda1   ///boot//   ext2 default' \
+  '/dev/VG/LV1 /usr ext2' > inspect-fstab.fstab
+
+guestfish --format=qcow2 -a inspect-fstab-1.qcow2 <<'EOF'
+  run
+  mount /dev/VG/Root /
+  upload inspect-fstab.fstab /etc/fstab
+EOF
+
+guestfish --format=qcow2 -a inspect-fstab-1.qcow2 -i <<'EOF' | sort | $canonical > inspect-fstab.output
+  inspect-get-mountpoints /dev/VG/Root
+EOF
+
+if [ "$(cat inspect-fstab.output)" != "/: /dev/VG/Root
+/boot: /dev/sda1
+/usr: /dev/VG/LV1" ]; then
+    echo "$0: error #4: unexpected output from inspect-get-mountpoints command"
+    cat inspect-fstab.output
+    exit 1
+fi
+
 rm inspect-fstab.fstab
 rm inspect-fstab-1.qcow2
 rm inspect-fstab.output
@@ -107,8 +107,8 @@ main (int argc, char *argv[])
     exit (77);
   }
 
-  /* Choose the number of threads based on the amount of free memory. */
-  nr_threads = MIN (MAX_THREADS, estimate_max_threads ());
+  /* Choose the number of threads based on the available memory. */
+  nr_threads = MIN (MAX_THREADS, estimate_max_threads (NULL));
 
   memset (&sa, 0, sizeof sa);
   sa.sa_handler = catch_sigint;
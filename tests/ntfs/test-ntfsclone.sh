@@ -25,7 +25,7 @@ if [ -n "$SKIP_TEST_NTFSCLONE_SH" ]; then
     exit 77
 fi
 
-rm -f test-ntfsclone.img ntfsclone-backup1 ntfsclone-backup2
+rm -f test-ntfsclone.img ntfsclone-backup1 ntfsclone-backup2 ntfsclone-backup3
 
 # Skip if ntfs-3g is not supported by the appliance.
 if ! guestfish add /dev/null : run : available "ntfs3g"; then
@@ -43,6 +43,7 @@ guestfish --ro --format=raw -a ../../test-data/phony-guests/windows.img <<EOF
 run
 ntfsclone-out /dev/sda1 ntfsclone-backup1 preservetimestamps:true force:true
 ntfsclone-out /dev/sda2 ntfsclone-backup2 metadataonly:true ignorefscheck:true
+ntfsclone-out /dev/sda1 ntfsclone-backup3 compress:gzip force:true
 EOF
 
 # Restore to another disk image.
@@ -57,6 +58,18 @@ if [ "$output" != "ntfs" ]; then
     exit 1
 fi
 
-#ls -lh ntfsclone-backup[12]
+# Restore the compressed backup.
+output=$(guestfish -N test-ntfsclone.img=part:300M <<EOF
+ntfsclone-in ntfsclone-backup3 /dev/sda1 compress:gzip
+vfs-type /dev/sda1
+EOF
+)
+
+if [ "$output" != "ntfs" ]; then
+    echo "$0: unexpected filesystem type after compressed restore: $output"
+    exit 1
+fi
+
+#ls -lh ntfsclone-backup[123]
 
-rm test-ntfsclone.img ntfsclone-backup1 ntfsclone-backup2
+rm test-ntfsclone.img ntfsclone-backup1 ntfsclone-backup2 ntfsclone-backup3
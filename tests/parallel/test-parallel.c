@@ -20,6 +20,13 @@
  * cases where libvirt is racy when creating transient guests.
  * Therefore this test simply launches lots of handles in parallel for
  * many minutes, hoping to reveal problems in libvirt this way.
+ *
+ * With --bench, this is instead a scalability benchmark: it runs
+ * 1, 2, 4, ... up to --max-threads threads, each of them launching
+ * appliances and making small calls, and for each number of threads
+ * reports the launch rate, the aggregate RPC rate and the memory used
+ * by each appliance, and finally the number of threads at which the
+ * launch rate stops improving.  Use 'make bench' to run it.
  */
 
 #include <config.h>
@@ -31,6 +38,10 @@
 #include <signal.h>
 #include <errno.h>
 #include <error.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <limits.h>
+#include <sys/time.h>
 
 #include <pthread.h>
 
@@ -43,14 +54,39 @@
 #define TOTAL_TIME 600          /* Seconds, excluding launch. */
 #define NR_THREADS 5
 
+/* Defaults for --bench. */
+#define BENCH_MAX_THREADS 16
+#define BENCH_TIME 60           /* Seconds for each number of threads. */
+#define BENCH_PINGS 1000        /* Calls made by each appliance. */
+
+/* A number of threads is considered to scale if the launch rate is
+ * at least this much better than with the previous number.
+ */
+#define SCALING_THRESHOLD 1.1
+
 struct thread_state {
   size_t thread_num;            /* Thread number. */
   pthread_t thread;             /* Thread handle. */
   int exit_status;              /* Thread exit status. */
+
+  /* Results of --bench. */
+  size_t launches;              /* Appliances launched. */
+  int64_t launch_us;            /* Total time spent launching. */
+  size_t pings;                 /* Calls made. */
+  int64_t ping_us;              /* Total time spent making calls. */
+  size_t nr_rss;                /* Number of hypervisor RSS samples. */
+  int64_t rss_kb;               /* Sum of hypervisor RSS samples. */
 };
-static struct thread_state threads[NR_THREADS];
+static struct thread_state *threads;
 
 static void *start_thread (void *) __attribute__((noreturn));
+static void *start_bench_thread (void *) __attribute__((noreturn));
+static void run_bench (void);
+
+static int bench = 0;
+static size_t max_threads = BENCH_MAX_THREADS;
+static int bench_time = BENCH_TIME;
+static int json = 0;
 
 static volatile sig_atomic_t quit = 0;
 
@@ -65,6 +101,82 @@ catch_sigint (int signal)
   }
 }
 
+static void
+usage (int exitcode)
+{
+  fprintf (stderr,
+           "%s: Launch many appliances in parallel.\n"
+           "Options:\n"
+           "  --help              Display this usage text and exit.\n"
+           "  --bench             Run the scalability benchmark.\n"
+           "  --json              Print the benchmark results as JSON.\n"
+           "  --max-threads N     Benchmark up to N threads (default: %d).\n"
+           "  --time SECS         Run each step of the benchmark for SECS\n"
+           "                      seconds (default: %d).\n",
+           getprogname (), BENCH_MAX_THREADS, BENCH_TIME);
+  exit (exitcode);
+}
+
+static void
+parse_options (int argc, char *argv[])
+{
+  enum { HELP_OPTION = CHAR_MAX + 1 };
+  static const char options[] = "";
+  static const struct option long_options[] = {
+    { "help", 0, 0, HELP_OPTION },
+    { "bench", 0, 0, 0 },
+    { "json", 0, 0, 0 },
+    { "max-threads", 1, 0, 0 },
+    { "time", 1, 0, 0 },
+    { 0, 0, 0, 0 }
+  };
+  int c, option_index, n;
+
+  for (;;) {
+    c = getopt_long (argc, argv, options, long_options, &option_index);
+    if (c == -1) break;
+
+    switch (c) {
+    case 0:                     /* Options which are long only. */
+      if (STREQ (long_options[option_index].name, "bench"))
+        bench = 1;
+      else if (STREQ (long_options[option_index].name, "json"))
+        json = 1;
+      else if (STREQ (long_options[option_index].name, "max-threads")) {
+        if (sscanf (optarg, "%d", &n) != 1 || n < 1) {
+          fprintf (stderr, "%s: could not parse max-threads parameter: %s\n",
+                   getprogname (), optarg);
+          exit (EXIT_FAILURE);
+        }
+        max_threads = n;
+      }
+      else if (STREQ (long_options[option_index].name, "time")) {
+        if (sscanf (optarg, "%d", &bench_time) != 1 || bench_time < 1) {
+          fprintf (stderr, "%s: could not parse time parameter: %s\n",
+                   getprogname (), optarg);
+          exit (EXIT_FAILURE);
+        }
+      }
+      else {
+        fprintf (stderr, "%s: unknown long option: %s (%d)\n",
+                 getprogname (), long_options[option_index].name,
+                 option_index);
+        exit (EXIT_FAILURE);
+      }
+      break;
+
+    case HELP_OPTION:
+      usage (EXIT_SUCCESS);
+
+    default:
+      usage (EXIT_FAILURE);
+    }
+  }
+
+  if (optind != argc)
+    usage (EXIT_FAILURE);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -76,6 +188,19 @@ main (int argc, char *argv[])
 
   srandom (time (NULL));
 
+  parse_options (argc, argv);
+
+  memset (&sa, 0, sizeof sa);
+  sa.sa_handler = catch_sigint;
+  sa.sa_flags = SA_RESTART;
+  sigaction (SIGINT, &sa, NULL);
+  sigaction (SIGQUIT, &sa, NULL);
+
+  if (bench) {
+    run_bench ();
+    exit (EXIT_SUCCESS);
+  }
+
   /* Only run this test when invoked by check-slow. */
   slow = getenv ("SLOW");
   if (!slow || guestfs_int_is_true (slow) <= 0) {
@@ -92,11 +217,9 @@ main (int argc, char *argv[])
     exit (77);
   }
 
-  memset (&sa, 0, sizeof sa);
-  sa.sa_handler = catch_sigint;
-  sa.sa_flags = SA_RESTART;
-  sigaction (SIGINT, &sa, NULL);
-  sigaction (SIGQUIT, &sa, NULL);
+  threads = calloc (NR_THREADS, sizeof (struct thread_state));
+  if (threads == NULL)
+    error (EXIT_FAILURE, errno, "calloc");
 
   for (i = 0; i < NR_THREADS; ++i) {
     threads[i].thread_num = i;
@@ -170,3 +293,221 @@ start_thread (void *statevp)
   state->exit_status = 0;
   pthread_exit (&state->exit_status);
 }
+
+/* Time now in microseconds. */
+static int64_t
+now_us (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* Resident memory of a process in kilobytes, or -1 if not known. */
+static int64_t
+get_rss_kb (pid_t pid)
+{
+  char path[64];
+  char line[256];
+  FILE *fp;
+  int64_t kb = -1;
+
+  snprintf (path, sizeof path, "/proc/%d/status", (int) pid);
+  fp = fopen (path, "r");
+  if (fp == NULL)
+    return -1;
+  while (fgets (line, sizeof line, fp) != NULL) {
+    if (sscanf (line, "VmRSS: %" SCNi64, &kb) == 1)
+      break;
+  }
+  fclose (fp);
+  return kb;
+}
+
+/* One thread of the benchmark.  It keeps launching appliances and
+ * making BENCH_PINGS calls to each, until bench_time has passed.
+ */
+static void *
+start_bench_thread (void *statevp)
+{
+  struct thread_state *state = statevp;
+  const int64_t end = now_us () + (int64_t) bench_time * 1000000;
+  guestfs_h *g;
+  int64_t t;
+  size_t i;
+  int pid;
+  char id[64];
+
+  while (!quit && now_us () < end) {
+    g = guestfs_create ();
+    if (g == NULL) {
+      perror ("guestfs_create");
+      state->exit_status = 1;
+      pthread_exit (&state->exit_status);
+    }
+
+    snprintf (id, sizeof id, "%zu", state->thread_num);
+    guestfs_set_identifier (g, id);
+
+    if (guestfs_add_drive_opts (g, "/dev/null",
+                                GUESTFS_ADD_DRIVE_OPTS_FORMAT, "raw",
+                                GUESTFS_ADD_DRIVE_OPTS_READONLY, 1,
+                                -1) == -1) {
+    error:
+      guestfs_close (g);
+      state->exit_status = 1;
+      pthread_exit (&state->exit_status);
+    }
+
+    t = now_us ();
+    if (guestfs_launch (g) == -1)
+      goto error;
+    state->launch_us += now_us () - t;
+    state->launches++;
+
+    t = now_us ();
+    for (i = 0; i < BENCH_PINGS; ++i) {
+      if (guestfs_ping_daemon (g) == -1)
+        goto error;
+    }
+    state->ping_us += now_us () - t;
+    state->pings += BENCH_PINGS;
+
+    /* The hypervisor pid is only available with the direct backend. */
+    guestfs_push_error_handler (g, NULL, NULL);
+    pid = guestfs_get_pid (g);
+    guestfs_pop_error_handler (g);
+    if (pid > 0) {
+      const int64_t kb = get_rss_kb (pid);
+      if (kb >= 0) {
+        state->rss_kb += kb;
+        state->nr_rss++;
+      }
+    }
+
+    if (guestfs_shutdown (g) == -1)
+      goto error;
+
+    guestfs_close (g);
+  }
+
+  state->exit_status = 0;
+  pthread_exit (&state->exit_status);
+}
+
+struct bench_result {
+  size_t nr_threads;
+  double launches_per_sec;      /* Aggregate launch rate. */
+  double launch_ms;             /* Mean time to launch one appliance. */
+  double rpcs_per_sec;          /* Aggregate rate of calls. */
+  int64_t rss_kb;               /* Mean hypervisor RSS, or -1. */
+};
+
+/* Run the benchmark with 'n' threads. */
+static void
+bench_step (size_t n, struct bench_result *result)
+{
+  size_t i, launches = 0, nr_rss = 0;
+  int64_t start, elapsed, launch_us = 0, rss_kb = 0;
+  double rpcs_per_sec = 0;
+  void *status;
+  int r;
+
+  memset (threads, 0, n * sizeof (struct thread_state));
+
+  start = now_us ();
+  for (i = 0; i < n; ++i) {
+    threads[i].thread_num = i;
+    r = pthread_create (&threads[i].thread, NULL, start_bench_thread,
+                        &threads[i]);
+    if (r != 0)
+      error (EXIT_FAILURE, r, "pthread_create");
+  }
+
+  for (i = 0; i < n; ++i) {
+    r = pthread_join (threads[i].thread, &status);
+    if (r != 0)
+      error (EXIT_FAILURE, r, "pthread_join");
+    if (*(int *)status != 0)
+      error (EXIT_FAILURE, 0, "%zu: thread returned an error", i);
+
+    launches += threads[i].launches;
+    launch_us += threads[i].launch_us;
+    if (threads[i].ping_us > 0)
+      rpcs_per_sec += threads[i].pings * 1000000.0 / threads[i].ping_us;
+    rss_kb += threads[i].rss_kb;
+    nr_rss += threads[i].nr_rss;
+  }
+  elapsed = now_us () - start;
+
+  result->nr_threads = n;
+  result->launches_per_sec = launches * 1000000.0 / elapsed;
+  result->launch_ms = launches > 0 ? launch_us / 1000.0 / launches : 0;
+  result->rpcs_per_sec = rpcs_per_sec;
+  result->rss_kb = nr_rss > 0 ? rss_kb / (int64_t) nr_rss : -1;
+}
+
+static void
+run_bench (void)
+{
+  CLEANUP_FREE struct bench_result *results = NULL;
+  size_t n, i, nr_results = 0, scaling_stops = 0;
+
+  threads = calloc (max_threads, sizeof (struct thread_state));
+  results = calloc (max_threads + 1, sizeof (struct bench_result));
+  if (threads == NULL || results == NULL)
+    error (EXIT_FAILURE, errno, "calloc");
+
+  if (!json)
+    printf ("%8s %12s %12s %12s %12s\n",
+            "threads", "launches/s", "launch (ms)", "rpcs/s", "rss (MB)");
+
+  /* 1, 2, 4, ... and finally max_threads. */
+  for (n = 1; !quit; n = n * 2 < max_threads ? n * 2 : max_threads) {
+    struct bench_result *r = &results[nr_results++];
+
+    bench_step (n, r);
+
+    if (scaling_stops == 0 && nr_results > 1 &&
+        r->launches_per_sec <
+        results[nr_results-2].launches_per_sec * SCALING_THRESHOLD)
+      scaling_stops = results[nr_results-2].nr_threads;
+
+    if (!json) {
+      printf ("%8zu %12.2f %12.1f %12.1f ",
+              r->nr_threads, r->launches_per_sec, r->launch_ms,
+              r->rpcs_per_sec);
+      if (r->rss_kb >= 0)
+        printf ("%12.1f\n", r->rss_kb / 1024.0);
+      else
+        printf ("%12s\n", "-");
+      fflush (stdout);
+    }
+
+    if (n == max_threads)
+      break;
+  }
+
+  if (json) {
+    printf ("{\n  \"results\": [");
+    for (i = 0; i < nr_results; ++i) {
+      printf ("%s\n    { \"threads\": %zu, \"launches_per_sec\": %.2f, "
+              "\"launch_ms\": %.1f, \"rpcs_per_sec\": %.1f, "
+              "\"rss_kb\": %" PRIi64 " }",
+              i == 0 ? "" : ",", results[i].nr_threads,
+              results[i].launches_per_sec, results[i].launch_ms,
+              results[i].rpcs_per_sec, results[i].rss_kb);
+    }
+    printf ("\n  ],\n  \"scaling_stops_at\": ");
+    if (scaling_stops > 0)
+      printf ("%zu\n}\n", scaling_stops);
+    else
+      printf ("null\n}\n");
+  }
+  else if (scaling_stops > 0)
+    printf ("Launch rate stops scaling after %zu threads.\n", scaling_stops);
+  else
+    printf ("Launch rate scales up to %zu threads.\n",
+            results[nr_results-1].nr_threads);
+}
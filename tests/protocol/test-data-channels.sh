@@ -0,0 +1,61 @@
+#!/bin/bash -
+# libguestfs
+# Copyright (C) 2017 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+# Test file transfers striped across several data channels.
+#
+# Upload and download a file whose size is not a multiple of the
+# chunk size, so the last chunk lands on a randomly chosen channel,
+# and check that a cancelled download leaves all the channels in
+# sync.
+
+set -e
+
+export LIBGUESTFS_BACKEND_SETTINGS=data_channels=4
+
+rm -f test-data-channels.img test-data-channels.in \
+   test-data-channels.out test-data-channels.out2
+
+size=$(awk 'BEGIN{ srand(); print 8*1024*1024 + int(1024*1024*rand()) }')
+echo "$0: test size $size (bytes)"
+
+head -c $size /dev/urandom > test-data-channels.in
+
+guestfish <<EOF
+sparse test-data-channels.img 64M
+run
+
+part-disk /dev/sda mbr
+mkfs ext2 /dev/sda1
+mount /dev/sda1 /
+
+upload test-data-channels.in /file
+download /file test-data-channels.out
+
+# Download into /dev/full so it is cancelled part way through.
+-download /file /dev/full
+
+# The daemon should still be reachable and in sync.
+ping-daemon
+download /file test-data-channels.out2
+EOF
+
+cmp test-data-channels.in test-data-channels.out
+cmp test-data-channels.in test-data-channels.out2
+
+rm test-data-channels.img test-data-channels.in \
+   test-data-channels.out test-data-channels.out2
@@ -32,6 +32,7 @@
 #include <error.h>
 #include <assert.h>
 #include <math.h>
+#include <sched.h>
 
 #include "guestfs.h"
 #include "guestfs-internal-frontend.h"
@@ -43,13 +44,29 @@
 #define NR_WARMUP_PASSES 3
 #define NR_TEST_PASSES   10
 
+/* Passes further than this many (scaled) median absolute deviations
+ * from the median are rejected as outliers.
+ */
+#define OUTLIER_MADS 3.0
+
 static const char *append = NULL;
 static int memsize = 0;
 static int smp = 1;
+static int nr_warmup_passes = NR_WARMUP_PASSES;
+static int nr_test_passes = NR_TEST_PASSES;
+static const char *cpus = NULL;
+static int json = 0;
+
+/* The launch phases reported by guestfs_get_launch_stats. */
+static const char *const phase_names[] = {
+  "appliance", "hypervisor", "kernel", "init", "udev", "daemon", NULL
+};
+#define NR_PHASES (sizeof phase_names / sizeof phase_names[0] - 1)
 
 static void run_test (void);
 static guestfs_h *create_handle (void);
 static void add_drive (guestfs_h *g);
+static void pin_cpus (const char *list);
 
 static void
 usage (int exitcode)
@@ -70,10 +87,14 @@ usage (int exitcode)
            "Options:\n"
            "  --help         Display this usage text and exit.\n"
            "  --append OPTS  Append OPTS to kernel command line.\n"
+           "  --cpus LIST    Run on host CPUs in LIST (eg. 2-3).\n"
+           "  --json         Print the results as JSON.\n"
            "  -m MB\n"
            "  --memsize MB   Set memory size in MB (default: %d).\n"
-           "  --smp N        Enable N virtual CPUs (default: 1).\n",
-           default_memsize);
+           "  --passes N     Number of timed passes (default: %d).\n"
+           "  --smp N        Enable N virtual CPUs (default: 1).\n"
+           "  --warmup N     Number of warm-up passes (default: %d).\n",
+           default_memsize, NR_TEST_PASSES, NR_WARMUP_PASSES);
   exit (exitcode);
 }
 
@@ -85,8 +106,12 @@ main (int argc, char *argv[])
   static const struct option long_options[] = {
     { "help", 0, 0, HELP_OPTION },
     { "append", 1, 0, 0 },
+    { "cpus", 1, 0, 0 },
+    { "json", 0, 0, 0 },
     { "memsize", 1, 0, 'm' },
+    { "passes", 1, 0, 0 },
     { "smp", 1, 0, 0 },
+    { "warmup", 1, 0, 0 },
     { 0, 0, 0, 0 }
   };
   int c, option_index;
@@ -101,6 +126,32 @@ main (int argc, char *argv[])
         append = optarg;
         break;
       }
+      else if (STREQ (long_options[option_index].name, "cpus")) {
+        cpus = optarg;
+        break;
+      }
+      else if (STREQ (long_options[option_index].name, "json")) {
+        json = 1;
+        break;
+      }
+      else if (STREQ (long_options[option_index].name, "passes")) {
+        if (sscanf (optarg, "%d", &nr_test_passes) != 1 ||
+            nr_test_passes < 2) {
+          fprintf (stderr, "%s: could not parse passes parameter: %s\n",
+                   getprogname (), optarg);
+          exit (EXIT_FAILURE);
+        }
+        break;
+      }
+      else if (STREQ (long_options[option_index].name, "warmup")) {
+        if (sscanf (optarg, "%d", &nr_warmup_passes) != 1 ||
+            nr_warmup_passes < 0) {
+          fprintf (stderr, "%s: could not parse warmup parameter: %s\n",
+                   getprogname (), optarg);
+          exit (EXIT_FAILURE);
+        }
+        break;
+      }
       else if (STREQ (long_options[option_index].name, "smp")) {
         if (sscanf (optarg, "%d", &smp) != 1) {
           fprintf (stderr, "%s: could not parse smp parameter: %s\n",
@@ -129,21 +180,192 @@ main (int argc, char *argv[])
     }
   }
 
+  if (cpus != NULL)
+    pin_cpus (cpus);
+
   run_test ();
 }
 
+/* Parse a list of CPUs such as "0,2-3" and restrict this process
+ * (and so qemu, which inherits the affinity) to those CPUs.
+ */
+static void
+pin_cpus (const char *list)
+{
+  cpu_set_t set;
+  const char *p = list;
+  unsigned lo, hi, i;
+  int n;
+
+  CPU_ZERO (&set);
+  for (;;) {
+    if (sscanf (p, "%u%n", &lo, &n) != 1)
+      goto parse_error;
+    p += n;
+    hi = lo;
+    if (*p == '-') {
+      p++;
+      if (sscanf (p, "%u%n", &hi, &n) != 1 || hi < lo)
+        goto parse_error;
+      p += n;
+    }
+    if (hi >= CPU_SETSIZE)
+      goto parse_error;
+    for (i = lo; i <= hi; ++i)
+      CPU_SET (i, &set);
+    if (*p == '\0')
+      break;
+    if (*p != ',')
+      goto parse_error;
+    p++;
+  }
+
+  if (sched_setaffinity (0, sizeof set, &set) == -1)
+    error (EXIT_FAILURE, errno, "sched_setaffinity: %s", list);
+  return;
+
+ parse_error:
+  fprintf (stderr, "%s: could not parse cpus parameter: %s\n",
+           getprogname (), list);
+  exit (EXIT_FAILURE);
+}
+
+static int
+compare_double (const void *av, const void *bv)
+{
+  const double a = *(const double *) av;
+  const double b = *(const double *) bv;
+
+  return a < b ? -1 : a > b ? 1 : 0;
+}
+
+/* Median of n values.  The array is sorted. */
+static double
+median (double *v, size_t n)
+{
+  qsort (v, n, sizeof (double), compare_double);
+  if (n & 1)
+    return v[n/2];
+  else
+    return (v[n/2-1] + v[n/2]) / 2;
+}
+
+/* Two-sided 95% critical value of Student's t distribution. */
+static double
+t_95 (size_t df)
+{
+  static const double t[] = {
+    0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+    2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093,
+    2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045,
+    2.042
+  };
+
+  if (df < sizeof t / sizeof t[0])
+    return t[df];
+  return 1.96;
+}
+
+struct stats {
+  size_t n;                     /* Number of samples kept. */
+  size_t outliers;              /* Number of samples rejected. */
+  double mean, sd, median, ci;  /* ci is the half-width of the 95% CI */
+};
+
+/* Reject outliers from the n samples in v (which are reordered), then
+ * calculate statistics of the rest.
+ */
+static void
+calculate_stats (double *v, size_t n, struct stats *st)
+{
+  CLEANUP_FREE double *dev = malloc (n * sizeof (double));
+  double med, mad;
+  size_t i, kept;
+
+  if (dev == NULL)
+    error (EXIT_FAILURE, errno, "malloc");
+
+  /* The median absolute deviation, scaled to be comparable with the
+   * standard deviation of a normal distribution.
+   */
+  med = median (v, n);
+  for (i = 0; i < n; ++i)
+    dev[i] = fabs (v[i] - med);
+  mad = 1.4826 * median (dev, n);
+
+  kept = 0;
+  for (i = 0; i < n; ++i) {
+    if (mad == 0 || fabs (v[i] - med) <= OUTLIER_MADS * mad)
+      v[kept++] = v[i];
+  }
+  st->n = kept;
+  st->outliers = n - kept;
+
+  st->mean = 0;
+  for (i = 0; i < kept; ++i)
+    st->mean += v[i];
+  st->mean /= kept;
+
+  st->sd = 0;
+  for (i = 0; i < kept; ++i)
+    st->sd += pow (v[i] - st->mean, 2);
+  st->sd = kept > 1 ? sqrt (st->sd / (kept - 1)) : 0;
+
+  st->median = median (v, kept);
+  st->ci = kept > 1 ? t_95 (kept - 1) * st->sd / sqrt (kept) : 0;
+}
+
+static void
+print_stats_json (const struct stats *st)
+{
+  printf ("{ \"passes\": %zu, \"outliers\": %zu, "
+          "\"mean_ms\": %.1f, \"sd_ms\": %.1f, \"median_ms\": %.1f, "
+          "\"ci95_ms\": [%.1f, %.1f] }",
+          st->n, st->outliers, st->mean, st->sd, st->median,
+          st->mean - st->ci, st->mean + st->ci);
+}
+
+/* Record the time of each launch phase of the last launch, in
+ * milliseconds since launch started, from guestfs_get_launch_stats
+ * (the same times are sent as GUESTFS_EVENT_LAUNCH_PHASE events).
+ */
+static void
+get_phases (guestfs_h *g, double *phases)
+{
+  CLEANUP_FREE_STRING_LIST char **stats = guestfs_get_launch_stats (g);
+  size_t i, j;
+
+  if (stats == NULL)
+    exit (EXIT_FAILURE);
+
+  for (j = 0; j < NR_PHASES; ++j) {
+    phases[j] = -1;
+    for (i = 0; stats[i] != NULL; i += 2) {
+      if (STREQ (stats[i], phase_names[j]))
+        phases[j] = atof (stats[i+1]);
+    }
+  }
+}
+
 static void
 run_test (void)
 {
   guestfs_h *g;
-  size_t i;
-  int64_t ns[NR_TEST_PASSES];
-  double mean;
-  double variance;
-  double sd;
-
-  printf ("Warming up the libguestfs cache ...\n");
-  for (i = 0; i < NR_WARMUP_PASSES; ++i) {
+  size_t i, j, n;
+  CLEANUP_FREE double *ms = NULL;
+  CLEANUP_FREE double *phases = NULL;
+  CLEANUP_FREE double *v = NULL;
+  struct stats st;
+  FILE *msgs = json ? stderr : stdout;
+
+  ms = malloc (nr_test_passes * sizeof (double));
+  phases = malloc (nr_test_passes * NR_PHASES * sizeof (double));
+  v = malloc (nr_test_passes * sizeof (double));
+  if (ms == NULL || phases == NULL || v == NULL)
+    error (EXIT_FAILURE, errno, "malloc");
+
+  fprintf (msgs, "Warming up the libguestfs cache ...\n");
+  for (i = 0; i < (size_t) nr_warmup_passes; ++i) {
     g = create_handle ();
     add_drive (g);
     if (guestfs_launch (g) == -1)
@@ -151,8 +373,8 @@ run_test (void)
     guestfs_close (g);
   }
 
-  printf ("Running the tests ...\n");
-  for (i = 0; i < NR_TEST_PASSES; ++i) {
+  fprintf (msgs, "Running the tests ...\n");
+  for (i = 0; i < (size_t) nr_test_passes; ++i) {
     struct timespec start_t, end_t;
 
     g = create_handle ();
@@ -160,34 +382,80 @@ run_test (void)
     get_time (&start_t);
     if (guestfs_launch (g) == -1)
       exit (EXIT_FAILURE);
+    get_phases (g, &phases[i * NR_PHASES]);
     guestfs_close (g);
     get_time (&end_t);
 
-    ns[i] = timespec_diff (&start_t, &end_t);
+    ms[i] = timespec_diff (&start_t, &end_t) / 1000000.0;
   }
 
-  /* Calculate the mean. */
-  mean = 0;
-  for (i = 0; i < NR_TEST_PASSES; ++i)
-    mean += ns[i];
-  mean /= NR_TEST_PASSES;
-
-  /* Calculate the variance and standard deviation. */
-  variance = 0;
-  for (i = 0; i < NR_TEST_PASSES; ++i)
-    variance = pow (ns[i] - mean, 2);
-  variance /= NR_TEST_PASSES;
-  sd = sqrt (variance);
-
-  /* Print the test parameters. */
-  printf ("\n");
-  g = create_handle ();
-  test_info (g, NR_TEST_PASSES);
-  guestfs_close (g);
-
-  /* Print the result. */
-  printf ("\n");
-  printf ("Result: %.1fms ±%.1fms\n", mean / 1000000, sd / 1000000);
+  memcpy (v, ms, nr_test_passes * sizeof (double));
+  calculate_stats (v, nr_test_passes, &st);
+
+  if (!json) {
+    /* Print the test parameters. */
+    printf ("\n");
+    g = create_handle ();
+    test_info (g, nr_test_passes);
+    guestfs_close (g);
+
+    /* Print the result. */
+    printf ("\n");
+    if (st.outliers > 0)
+      printf ("Rejected %zu outlier(s).\n", st.outliers);
+    printf ("95%% confidence interval: %.1fms .. %.1fms\n",
+            st.mean - st.ci, st.mean + st.ci);
+    printf ("Result: %.1fms ±%.1fms\n", st.mean, st.sd);
+    return;
+  }
+
+  printf ("{\n");
+  printf ("  \"memsize\": %d, \"smp\": %d, \"append\": ", memsize, smp);
+  if (append)
+    printf ("\"%s\"", append);
+  else
+    printf ("null");
+  printf (", \"cpus\": ");
+  if (cpus)
+    printf ("\"%s\"", cpus);
+  else
+    printf ("null");
+  printf (",\n  \"warmup_passes\": %d,\n", nr_warmup_passes);
+  printf ("  \"samples_ms\": [");
+  for (i = 0; i < (size_t) nr_test_passes; ++i)
+    printf ("%s%.1f", i == 0 ? "" : ", ", ms[i]);
+  printf ("],\n");
+  printf ("  \"launch\": ");
+  print_stats_json (&st);
+  printf (",\n  \"phases\": {");
+
+  /* Each phase is the time since the previous phase that was seen,
+   * so slow phases stand out.
+   */
+  for (j = 0; j < NR_PHASES; ++j) {
+    n = 0;
+    for (i = 0; i < (size_t) nr_test_passes; ++i) {
+      const double *p = &phases[i * NR_PHASES];
+      double prev = 0;
+      size_t k;
+
+      if (p[j] < 0)
+        continue;
+      for (k = j; k-- > 0; ) {
+        if (p[k] >= 0) {
+          prev = p[k];
+          break;
+        }
+      }
+      v[n++] = p[j] - prev;
+    }
+    if (n == 0)
+      continue;
+    calculate_stats (v, n, &st);
+    printf ("%s\n    \"%s\": ", j == 0 ? "" : ",", phase_names[j]);
+    print_stats_json (&st);
+  }
+  printf ("\n  }\n}\n");
 }
 
 /* Common function to create the handle and set various defaults. */
@@ -195,7 +463,6 @@ static guestfs_h *
 create_handle (void)
 {
   guestfs_h *g;
-  CLEANUP_FREE char *full_append = NULL;
 
   g = guestfs_create ();
   if (!g) error (EXIT_FAILURE, errno, "guestfs_create");
@@ -209,7 +476,7 @@ create_handle (void)
       exit (EXIT_FAILURE);
 
   if (append != NULL)
-    if (guestfs_set_append (g, full_append) == -1)
+    if (guestfs_set_append (g, append) == -1)
       exit (EXIT_FAILURE);
 
   return g;
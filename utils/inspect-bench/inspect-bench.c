@@ -0,0 +1,326 @@
+/* libguestfs
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Benchmark inspection.  For each disk image on the command line
+ * this launches an appliance and times each phase of inspection:
+ *   - inspect: guestfs_inspect_os
+ *   - get: the guestfs_inspect_get_* calls for each root
+ *   - mount: mounting the guest filesystems read-only
+ *   - applications: guestfs_inspect_list_applications2
+ *   - icon: guestfs_inspect_get_icon
+ * For each phase we also report the number of calls made to the
+ * appliance and the bytes transferred, using the RPC statistics (see
+ * guestfs_set_rpc_stats).  With --json the results are printed as
+ * one JSON object per phase, so they can be compared between
+ * versions.
+ *
+ * Use make-large-guest.pl to create guests which are large enough
+ * to show the cost of inspecting real installations.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <errno.h>
+#include <error.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "guestfs.h"
+#include "guestfs-internal-frontend.h"
+
+#include "getprogname.h"
+
+static int json = 0;
+static int repeat = 1;
+
+static void bench_image (const char *filename, const char *format);
+
+static void
+usage (int exitcode)
+{
+  fprintf (stderr,
+           "inspect-bench: Benchmark inspection of disk images.\n"
+           "\n"
+           "  inspect-bench [--options] disk.img [disk.img ...]\n"
+           "\n"
+           "Options:\n"
+           "  --help                       Display help output and exit\n"
+           "  --format=raw|qcow2|..        Format of the following disk images\n"
+           "  --json                       Print results as JSON\n"
+           "  -n <N> | --repeat=<N>        Inspect each image N times\n"
+           "\n"
+           "To benchmark the phony guests used by the test suite, do:\n"
+           "  ./run utils/inspect-bench/inspect-bench test-data/phony-guests/*.img\n"
+           );
+  exit (exitcode);
+}
+
+int
+main (int argc, char *argv[])
+{
+  enum { HELP_OPTION = CHAR_MAX + 1 };
+  static const char options[] = "n:";
+  static const struct option long_options[] = {
+    { "help", 0, 0, HELP_OPTION },
+    { "format", 1, 0, 0 },
+    { "json", 0, 0, 0 },
+    { "repeat", 1, 0, 'n' },
+    { 0, 0, 0, 0 }
+  };
+  int c, option_index, i;
+  const char *format = NULL;
+
+  for (;;) {
+    c = getopt_long (argc, argv, options, long_options, &option_index);
+    if (c == -1) break;
+
+    switch (c) {
+    case 0:
+      /* Options which are long only. */
+      if (STREQ (long_options[option_index].name, "format"))
+        format = STREQ (optarg, "") ? NULL : optarg;
+      else if (STREQ (long_options[option_index].name, "json"))
+        json = 1;
+      else {
+        fprintf (stderr, "%s: unknown long option: %s (%d)\n",
+                 getprogname (), long_options[option_index].name, option_index);
+        exit (EXIT_FAILURE);
+      }
+      break;
+
+    case 'n':
+      if (sscanf (optarg, "%d", &repeat) != 1 || repeat < 1) {
+        fprintf (stderr, "%s: -n: argument is not a positive integer\n",
+                 getprogname ());
+        exit (EXIT_FAILURE);
+      }
+      break;
+
+    case HELP_OPTION:
+      usage (EXIT_SUCCESS);
+
+    default:
+      usage (EXIT_FAILURE);
+    }
+  }
+
+  if (optind >= argc) {
+    fprintf (stderr, "%s: no disk images given on the command line\n",
+             getprogname ());
+    usage (EXIT_FAILURE);
+  }
+
+  if (!json)
+    printf ("%-30s %-14s %10s %10s %12s\n",
+            "image", "phase", "time (ms)", "rpc calls", "rpc bytes");
+
+  for (; optind < argc; ++optind) {
+    for (i = 0; i < repeat; ++i)
+      bench_image (argv[optind], format);
+  }
+
+  exit (EXIT_SUCCESS);
+}
+
+/* Time now in microseconds. */
+static int64_t
+now_us (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+struct phase {
+  const char *name;
+  int64_t start;
+};
+
+static void
+start_phase (guestfs_h *g, struct phase *phase, const char *name)
+{
+  phase->name = name;
+
+  /* Resets the statistics. */
+  if (guestfs_set_rpc_stats (g, 1) == -1)
+    exit (EXIT_FAILURE);
+
+  phase->start = now_us ();
+}
+
+/* Print the time taken by a phase and the calls made during it. */
+static void
+end_phase (guestfs_h *g, const char *filename, struct phase *phase)
+{
+  const int64_t elapsed_us = now_us () - phase->start;
+  CLEANUP_FREE_STRING_LIST char **stats = NULL;
+  uint64_t calls = 0, bytes = 0;
+  size_t i, len;
+  int first = 1;
+
+  stats = guestfs_get_rpc_stats (g);
+  if (stats == NULL)
+    exit (EXIT_FAILURE);
+
+  /* Add up the counters of all calls. */
+  for (i = 0; stats[i] != NULL; i += 2) {
+    len = strlen (stats[i]);
+    if (len > 6 && STREQ (&stats[i][len-6], ".calls"))
+      calls += strtoull (stats[i+1], NULL, 10);
+    else if ((len > 11 && STREQ (&stats[i][len-11], ".bytes_sent")) ||
+             (len > 15 && STREQ (&stats[i][len-15], ".bytes_received")) ||
+             (len > 11 && STREQ (&stats[i][len-11], ".file_bytes")))
+      bytes += strtoull (stats[i+1], NULL, 10);
+  }
+
+  if (!json) {
+    printf ("%-30s %-14s %10.1f %10" PRIu64 " %12" PRIu64 "\n",
+            filename, phase->name, elapsed_us / 1000.0, calls, bytes);
+    fflush (stdout);
+    return;
+  }
+
+  printf ("{ \"image\": \"%s\", \"phase\": \"%s\", \"time_us\": %" PRIi64 ", "
+          "\"rpc_calls\": %" PRIu64 ", \"rpc_bytes\": %" PRIu64 ", "
+          "\"calls\": {",
+          filename, phase->name, elapsed_us, calls, bytes);
+  for (i = 0; stats[i] != NULL; i += 2) {
+    len = strlen (stats[i]);
+    if (len > 6 && STREQ (&stats[i][len-6], ".calls")) {
+      printf ("%s \"%.*s\": %s", first ? "" : ",",
+              (int) (len-6), stats[i], stats[i+1]);
+      first = 0;
+    }
+  }
+  printf (" } }\n");
+  fflush (stdout);
+}
+
+static int
+compare_keys_len (const void *p1, const void *p2)
+{
+  const char *key1 = * (char * const *) p1;
+  const char *key2 = * (char * const *) p2;
+  return strlen (key1) - strlen (key2);
+}
+
+/* Mount the filesystems of a guest read-only, shortest mountpoint
+ * first, like virt-inspector does.  Errors are ignored.
+ */
+static void
+mount_guest (guestfs_h *g, const char *root)
+{
+  CLEANUP_FREE_STRING_LIST char **mountpoints = NULL;
+  size_t i, n;
+
+  mountpoints = guestfs_inspect_get_mountpoints (g, root);
+  if (mountpoints == NULL)
+    exit (EXIT_FAILURE);
+
+  n = guestfs_int_count_strings (mountpoints) / 2;
+  qsort (mountpoints, n, 2 * sizeof (char *), compare_keys_len);
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  for (i = 0; mountpoints[i] != NULL; i += 2)
+    guestfs_mount_ro (g, mountpoints[i+1], mountpoints[i]);
+  guestfs_pop_error_handler (g);
+}
+
+static void
+bench_image (const char *filename, const char *format)
+{
+  guestfs_h *g;
+  CLEANUP_FREE_STRING_LIST char **roots = NULL;
+  struct phase phase;
+  size_t i;
+
+  g = guestfs_create ();
+  if (!g)
+    error (EXIT_FAILURE, errno, "guestfs_create");
+
+  if (guestfs_add_drive_opts (g, filename,
+                              GUESTFS_ADD_DRIVE_OPTS_READONLY, 1,
+                              format ? GUESTFS_ADD_DRIVE_OPTS_FORMAT : -1,
+                              format,
+                              -1) == -1)
+    exit (EXIT_FAILURE);
+
+  start_phase (g, &phase, "launch");
+  if (guestfs_launch (g) == -1)
+    exit (EXIT_FAILURE);
+  end_phase (g, filename, &phase);
+
+  start_phase (g, &phase, "inspect");
+  roots = guestfs_inspect_os (g);
+  if (roots == NULL)
+    exit (EXIT_FAILURE);
+  end_phase (g, filename, &phase);
+
+  for (i = 0; roots[i] != NULL; ++i) {
+    const char *root = roots[i];
+    CLEANUP_FREE char *type = NULL, *distro = NULL, *product_name = NULL,
+      *hostname = NULL, *arch = NULL;
+    CLEANUP_FREE_STRING_LIST char **drives = NULL;
+    struct guestfs_application2_list *apps;
+    CLEANUP_FREE char *icon = NULL;
+    size_t size;
+
+    /* The fields which virt-inspector prints for every guest.  These
+     * are cached by inspect_os, so should need few or no calls.
+     */
+    start_phase (g, &phase, "get");
+    type = guestfs_inspect_get_type (g, root);
+    distro = guestfs_inspect_get_distro (g, root);
+    product_name = guestfs_inspect_get_product_name (g, root);
+    hostname = guestfs_inspect_get_hostname (g, root);
+    arch = guestfs_inspect_get_arch (g, root);
+    drives = guestfs_inspect_get_drive_mappings (g, root);
+    if (!type || !distro || !product_name || !hostname || !arch || !drives)
+      exit (EXIT_FAILURE);
+    end_phase (g, filename, &phase);
+
+    start_phase (g, &phase, "mount");
+    mount_guest (g, root);
+    end_phase (g, filename, &phase);
+
+    start_phase (g, &phase, "applications");
+    apps = guestfs_inspect_list_applications2 (g, root);
+    if (apps == NULL)
+      exit (EXIT_FAILURE);
+    guestfs_free_application2_list (apps);
+    end_phase (g, filename, &phase);
+
+    start_phase (g, &phase, "icon");
+    icon = guestfs_inspect_get_icon (g, root, &size, -1);
+    if (icon == NULL)
+      exit (EXIT_FAILURE);
+    end_phase (g, filename, &phase);
+
+    if (guestfs_umount_all (g) == -1)
+      exit (EXIT_FAILURE);
+  }
+
+  guestfs_close (g);
+}
@@ -0,0 +1,184 @@
+#!/usr/bin/env perl
+# libguestfs
+# Copyright (C) 2017 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+# Make large phony guests for inspect-bench.  These are built like
+# the phony guests in test-data/phony-guests, but are big enough to
+# show the cost of inspecting real installations:
+#
+#   large-fedora.img:  NR_FILES files and an RPM database with
+#                      NR_PACKAGES packages.
+#   large-windows.img: a SOFTWARE hive with NR_PACKAGES applications.
+#                      This is skipped if there is no NTFS support
+#                      or hivexregedit is not installed.
+#
+# The sizes can be changed by setting the environment variables.
+# SRCDIR must point to test-data/phony-guests.
+
+use strict;
+use warnings;
+
+use Sys::Guestfs;
+use File::Temp qw(tempdir);
+
+my $nr_files = $ENV{NR_FILES} // 100000;
+my $nr_packages = $ENV{NR_PACKAGES} // 5000;
+my $db_load = $ENV{DB_LOAD} // "db_load";
+
+defined ($ENV{SRCDIR}) or die "Missing environment variable: SRCDIR";
+my $srcdir = $ENV{SRCDIR};
+
+my $tmpdir = tempdir (CLEANUP => 1);
+
+# Print a 32 bit little-endian integer in db_load "print" format.
+sub le32 {
+    my ($i) = @_;
+    return join ("", map { sprintf ("\\%02x", ($i >> (8*$_)) & 0xff) } 0..3);
+}
+
+# Write the RPM Name and Packages databases.  All the packages have
+# the same version, release and arch header as the packages in
+# test-data/phony-guests/fedora-packages.db.txt.
+sub make_rpm_db {
+    my $header = "\\00\\00\\00\\03\\00\\00\\00\\11\\00\\00\\03\\e9\\00\\00\\00\\00\\00\\00\\00\\00\\00\\00\\00\\00\\00\\00\\03\\ea\\00\\00\\00\\00\\00\\00\\00\\04\\00\\00\\00\\00\\00\\00\\03\\fe\\00\\00\\00\\00\\00\\00\\00\\0b\\00\\00\\00\\001.0\\001.fc14\\00x86_64\\00";
+
+    foreach my $db ("Name", "Packages") {
+        open (my $fh, '>', "$tmpdir/$db.txt") or die;
+        print $fh "VERSION=3\nformat=print\ntype=hash\n";
+        print $fh "h_nelem=$nr_packages\ndb_pagesize=4096\nHEADER=END\n";
+        for (my $i = 1; $i <= $nr_packages; ++$i) {
+            if ($db eq "Name") {
+                printf $fh " package%05d\n", $i;
+                print $fh " ", le32 ($i), "\\00\\00\\00\\00\n";
+            } else {
+                print $fh " ", le32 ($i), "\n";
+                print $fh " $header\n";
+            }
+        }
+        print $fh "DATA=END\n";
+        close ($fh) or die;
+
+        system ("$db_load $tmpdir/$db < $tmpdir/$db.txt") == 0
+            or die "$db_load failed";
+    }
+}
+
+sub make_large_fedora {
+    make_rpm_db ();
+
+    my $g = Sys::Guestfs->new ();
+    $g->disk_create ("large-fedora.img-t", "raw", 2*1024*1024*1024);
+    $g->add_drive ("large-fedora.img-t", format => "raw");
+    $g->launch ();
+
+    $g->part_disk ('/dev/sda', 'mbr');
+    # Enough inodes for all the files.
+    $g->mke2fs ('/dev/sda1', fstype => 'ext4', bytesperinode => 4096,
+                label => 'ROOT');
+    $g->mount ('/dev/sda1', '/');
+
+    $g->mkdir_p ('/etc/sysconfig');
+    $g->mkdir_p ('/var/lib/rpm');
+    $g->mkdir ('/bin');
+    $g->write ('/etc/fstab', "LABEL=ROOT / ext4 defaults 0 0\n");
+    $g->write ('/etc/redhat-release', 'Fedora release 14 (Phony)');
+    $g->write ('/etc/fedora-release', 'Fedora release 14 (Phony)');
+    $g->write ('/etc/sysconfig/network', 'HOSTNAME=large-fedora.invalid');
+    $g->upload ("$tmpdir/Name", '/var/lib/rpm/Name');
+    $g->upload ("$tmpdir/Packages", '/var/lib/rpm/Packages');
+    $g->upload ($srcdir.'/../binaries/bin-x86_64-dynamic', '/bin/ls');
+
+    # The files are created by the daemon, 1000 per directory.
+    for (my $i = 0; $i * 1000 < $nr_files; ++$i) {
+        my $dir = sprintf ("/usr/share/large/%03d", $i);
+        my $n = $nr_files - $i * 1000;
+        $n = 1000 if $n > 1000;
+        $g->mkdir_p ($dir);
+        $g->fill_dir ($dir, $n);
+    }
+
+    $g->shutdown ();
+    $g->close ();
+    rename ("large-fedora.img-t", "large-fedora.img") or die;
+}
+
+sub make_large_windows {
+    my $g = Sys::Guestfs->new ();
+    $g->add_drive_scratch (1024*1024);
+    $g->launch ();
+    my $have_ntfs = $g->feature_available (["ntfs3g", "ntfsprogs"]);
+    $g->close ();
+
+    if (!$have_ntfs || system ("hivexregedit --help >/dev/null 2>&1") != 0) {
+        print STDERR "$0: skipping large-windows.img because NTFS support or hivexregedit is missing\n";
+        return;
+    }
+
+    # Registry hives.
+    open (my $fh, '>', "$tmpdir/software.reg") or die;
+    open (my $in, '<', "$srcdir/windows-software.reg") or die;
+    print $fh $_ while <$in>;
+    close ($in);
+    print $fh "\n";
+    for (my $i = 1; $i <= $nr_packages; ++$i) {
+        print $fh "[HKEY_LOCAL_MACHINE\\SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Uninstall\\app$i]\n";
+        print $fh "\"DisplayName\"=str(1):\"Application $i is not real software\"\n";
+        print $fh "\"DisplayVersion\"=str(1):\"1.0.$i\"\n";
+        print $fh "\"Publisher\"=str(1):\"Red Hat Inc.\"\n";
+        print $fh "\"InstallLocation\"=str(1):\"C:\\\\Program Files\\\\app$i\"\n";
+        print $fh "\"URLInfoAbout\"=str(1):\"http://libguestfs.org/\"\n\n";
+    }
+    close ($fh) or die;
+
+    foreach (["software", "SOFTWARE", "$tmpdir/software.reg"],
+             ["system", "SYSTEM", "$srcdir/windows-system.reg"]) {
+        my ($file, $key, $reg) = @$_;
+        system ("cp $srcdir/minimal-hive $tmpdir/$file") == 0 or die;
+        system ("hivexregedit", "--merge", "$tmpdir/$file",
+                "--prefix", "HKEY_LOCAL_MACHINE\\$key", $reg) == 0
+            or die "hivexregedit failed";
+    }
+
+    $g = Sys::Guestfs->new ();
+    $g->disk_create ("large-windows.img-t", "raw", 512*1024*1024);
+    $g->add_drive ("large-windows.img-t", format => "raw");
+    $g->launch ();
+
+    $g->part_init ('/dev/sda', 'mbr');
+    $g->part_add ('/dev/sda', 'p', 64, 524287);
+    $g->part_add ('/dev/sda', 'p', 524288, -64);
+    $g->pwrite_device ('/dev/sda', "1234", 0x01b8);
+    $g->mkfs ('ntfs', '/dev/sda1');
+    $g->mkfs ('ntfs', '/dev/sda2');
+
+    $g->mount ('/dev/sda2', '/');
+    $g->mkdir_p ('/Windows/System32/Config');
+    $g->mkdir_p ('/Windows/System32/Drivers');
+    $g->upload ("$tmpdir/software", '/Windows/System32/Config/SOFTWARE');
+    $g->upload ("$tmpdir/system", '/Windows/System32/Config/SYSTEM');
+    $g->upload ($srcdir.'/../binaries/bin-win32.exe',
+                '/Windows/System32/cmd.exe');
+    $g->mkdir ('/Program Files');
+    $g->touch ('/autoexec.bat');
+
+    $g->shutdown ();
+    $g->close ();
+    rename ("large-windows.img-t", "large-windows.img") or die;
+}
+
+make_large_fedora ();
+make_large_windows ();
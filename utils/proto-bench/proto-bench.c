@@ -0,0 +1,513 @@
+/* libguestfs
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Benchmark the protocol between the library and the daemon.
+ * Currently tested are:
+ *   - ping: round trips with no payload (ping_daemon)
+ *   - echo: round trips carrying a string of each requested size
+ *     (echo_daemon)
+ *   - upload: FileIn throughput (upload to /dev/null)
+ *   - download: FileOut throughput (download a sparse file)
+ *
+ * Small calls can be pipelined (see --depth) using the
+ * guestfs_submit_* and guestfs_wait_* functions.  For each test we
+ * report the rate, the median and 99th percentile latency and the
+ * throughput, either as a table or (with --json) as one JSON object
+ * per line so that results can be compared between releases.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <errno.h>
+#include <error.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "guestfs.h"
+#include "guestfs-internal-frontend.h"
+
+#include "getprogname.h"
+
+/* Which tests are enabled? -- All by default. */
+static int test_ping = 1;
+static int test_echo = 1;
+static int test_upload = 1;
+static int test_download = 1;
+
+static int count = 10000;       /* Number of small calls per test. */
+static int depth = 1;           /* Number of calls in flight. */
+static int transfers = 3;       /* Number of uploads and downloads. */
+static int64_t transfer_size = INT64_C (256) * 1024 * 1024;
+static int json = 0;
+
+/* Payload sizes for the echo test. */
+#define MAX_SIZES 16
+static size_t sizes[MAX_SIZES] = { 16, 1024, 65536 };
+static size_t nr_sizes = 3;
+
+/* The largest echo payload.  The string is sent and returned in a
+ * single message, which must be smaller than GUESTFS_MESSAGE_MAX.
+ */
+#define MAX_ECHO_SIZE (1024 * 1024)
+
+static guestfs_h *g;
+
+static void run_ping (void);
+static void run_echo (size_t size);
+static void run_upload (void);
+static void run_download (void);
+
+static void
+reset_default_tests (int *flag)
+{
+  if (*flag) {
+    test_ping = 0;
+    test_echo = 0;
+    test_upload = 0;
+    test_download = 0;
+    *flag = 0;
+  }
+}
+
+static void
+usage (int exitcode)
+{
+  fprintf (stderr,
+           "proto-bench: Benchmark the library to daemon protocol.\n"
+           "\n"
+           "To run all tests, do:\n"
+           "  proto-bench\n"
+           "\n"
+           "To run only specific tests, do:\n"
+           "  proto-bench --option [--option ...]\n"
+           "where the test options are:\n"
+           "  --ping\n"
+           "  --echo\n"
+           "  --upload\n"
+           "  --download\n"
+           "\n"
+           "Other options:\n"
+           "  --help                       Display help output and exit\n"
+           "  -n <N> | --count=<N>         Number of ping and echo calls\n"
+           "  -j <N> | --depth=<N>         Number of ping and echo calls in flight\n"
+           "  -s <S,..> | --sizes=<S,..>   Echo payload sizes in bytes\n"
+           "  --transfers=<N>              Number of uploads and downloads\n"
+           "  --transfer-size=<MB>         Size of each upload and download\n"
+           "  --json                       Print results as JSON\n"
+           );
+  exit (exitcode);
+}
+
+static int
+parse_int (const char *opt, const char *arg, int min)
+{
+  int i;
+
+  if (sscanf (arg, "%d", &i) != 1 || i < min) {
+    fprintf (stderr, "%s: %s: argument must be an integer >= %d\n",
+             getprogname (), opt, min);
+    exit (EXIT_FAILURE);
+  }
+  return i;
+}
+
+static void
+parse_sizes (const char *arg)
+{
+  const char *p = arg;
+  unsigned long size;
+  int n;
+
+  nr_sizes = 0;
+  for (;;) {
+    if (nr_sizes >= MAX_SIZES ||
+        sscanf (p, "%lu%n", &size, &n) != 1 ||
+        size < 1 || size > MAX_ECHO_SIZE) {
+      fprintf (stderr,
+               "%s: --sizes: expecting up to %d sizes from 1 to %d, separated by commas\n",
+               getprogname (), MAX_SIZES, MAX_ECHO_SIZE);
+      exit (EXIT_FAILURE);
+    }
+    sizes[nr_sizes++] = size;
+    p += n;
+    if (*p == '\0')
+      break;
+    if (*p != ',')
+      usage (EXIT_FAILURE);
+    p++;
+  }
+}
+
+int
+main (int argc, char *argv[])
+{
+  enum { HELP_OPTION = CHAR_MAX + 1 };
+  static const char options[] = "j:n:s:";
+  static const struct option long_options[] = {
+    { "help", 0, 0, HELP_OPTION },
+    { "count", 1, 0, 'n' },
+    { "depth", 1, 0, 'j' },
+    { "json", 0, 0, 0 },
+    { "sizes", 1, 0, 's' },
+    { "transfers", 1, 0, 0 },
+    { "transfer-size", 1, 0, 0 },
+
+    /* Tests. */
+    { "ping", 0, 0, 0 },
+    { "echo", 0, 0, 0 },
+    { "upload", 0, 0, 0 },
+    { "download", 0, 0, 0 },
+
+    { 0, 0, 0, 0 }
+  };
+  int c, option_index;
+  int reset_flag = 1;
+  size_t i;
+
+  for (;;) {
+    c = getopt_long (argc, argv, options, long_options, &option_index);
+    if (c == -1) break;
+
+    switch (c) {
+    case 0:
+      /* Options which are long only. */
+      if (STREQ (long_options[option_index].name, "json"))
+        json = 1;
+      else if (STREQ (long_options[option_index].name, "transfers"))
+        transfers = parse_int ("--transfers", optarg, 1);
+      else if (STREQ (long_options[option_index].name, "transfer-size"))
+        transfer_size =
+          (int64_t) parse_int ("--transfer-size", optarg, 1) * 1024 * 1024;
+      else if (STREQ (long_options[option_index].name, "ping")) {
+        reset_default_tests (&reset_flag);
+        test_ping = 1;
+      }
+      else if (STREQ (long_options[option_index].name, "echo")) {
+        reset_default_tests (&reset_flag);
+        test_echo = 1;
+      }
+      else if (STREQ (long_options[option_index].name, "upload")) {
+        reset_default_tests (&reset_flag);
+        test_upload = 1;
+      }
+      else if (STREQ (long_options[option_index].name, "download")) {
+        reset_default_tests (&reset_flag);
+        test_download = 1;
+      }
+      else {
+        fprintf (stderr, "%s: unknown long option: %s (%d)\n",
+                 getprogname (), long_options[option_index].name, option_index);
+        exit (EXIT_FAILURE);
+      }
+      break;
+
+    case 'j':
+      depth = parse_int ("-j", optarg, 1);
+      break;
+
+    case 'n':
+      count = parse_int ("-n", optarg, 1);
+      break;
+
+    case 's':
+      parse_sizes (optarg);
+      break;
+
+    case HELP_OPTION:
+      usage (EXIT_SUCCESS);
+
+    default:
+      usage (EXIT_FAILURE);
+    }
+  }
+
+  if (optind != argc) {
+    fprintf (stderr, "%s: extra arguments found on the command line\n",
+             getprogname ());
+    exit (EXIT_FAILURE);
+  }
+
+  g = guestfs_create ();
+  if (!g)
+    error (EXIT_FAILURE, errno, "guestfs_create");
+
+  /* The download test reads a sparse file from this filesystem. */
+  if (guestfs_add_drive_scratch (g, INT64_C (100*1024*1024), -1) == -1)
+    exit (EXIT_FAILURE);
+
+  if (guestfs_launch (g) == -1)
+    exit (EXIT_FAILURE);
+
+  if (guestfs_mkfs (g, "ext4", "/dev/sda") == -1)
+    exit (EXIT_FAILURE);
+  if (guestfs_mount (g, "/dev/sda", "/") == -1)
+    exit (EXIT_FAILURE);
+
+  if (!json)
+    printf ("%-20s %6s %10s %12s %12s %12s\n",
+            "test", "depth", "ops/s", "p50 (us)", "p99 (us)", "MB/s");
+
+  if (test_ping)
+    run_ping ();
+  if (test_echo) {
+    for (i = 0; i < nr_sizes; ++i)
+      run_echo (sizes[i]);
+  }
+  if (test_upload)
+    run_upload ();
+  if (test_download)
+    run_download ();
+
+  if (guestfs_shutdown (g) == -1)
+    exit (EXIT_FAILURE);
+  guestfs_close (g);
+
+  exit (EXIT_SUCCESS);
+}
+
+/* Time now in microseconds. */
+static int64_t
+now_us (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int
+compare_int64 (const void *av, const void *bv)
+{
+  const int64_t a = *(const int64_t *) av;
+  const int64_t b = *(const int64_t *) bv;
+
+  return a < b ? -1 : a > b ? 1 : 0;
+}
+
+/* Print the results of a test.  'latencies' (which is sorted) holds
+ * the time taken by each of the 'n' operations, and 'bytes' is the
+ * amount of data moved in each direction by all of them.
+ */
+static void
+print_result (const char *name, int test_depth,
+              int64_t *latencies, size_t n,
+              int64_t elapsed_us, int64_t bytes)
+{
+  double ops, mbs;
+  int64_t p50, p99;
+
+  qsort (latencies, n, sizeof (int64_t), compare_int64);
+  p50 = latencies[n / 2];
+  p99 = latencies[(n * 99) / 100 < n ? (n * 99) / 100 : n - 1];
+
+  if (elapsed_us < 1)
+    elapsed_us = 1;
+  ops = (double) n * 1000000 / elapsed_us;
+  mbs = (double) bytes / elapsed_us; /* bytes/us == MB/s */
+
+  if (json)
+    printf ("{ \"test\": \"%s\", \"depth\": %d, \"ops\": %zu, "
+            "\"elapsed_us\": %" PRIi64 ", \"ops_per_sec\": %.1f, "
+            "\"p50_us\": %" PRIi64 ", \"p99_us\": %" PRIi64 ", "
+            "\"mb_per_sec\": %.2f }\n",
+            name, test_depth, n, elapsed_us, ops, p50, p99, mbs);
+  else
+    printf ("%-20s %6d %10.1f %12" PRIi64 " %12" PRIi64 " %12.2f\n",
+            name, test_depth, ops, p50, p99, mbs);
+  fflush (stdout);
+}
+
+/* Run 'count' small calls with up to 'depth' of them in flight.  The
+ * calls are submitted by 'submit' and their replies collected, in
+ * order, by 'wait'.
+ */
+static void
+run_pipelined (const char *name,
+               int (*submit) (void *opaque),
+               int (*wait) (int serial, void *opaque),
+               void *opaque, int64_t bytes_per_call)
+{
+  CLEANUP_FREE int64_t *latencies = NULL;
+  CLEANUP_FREE int64_t *start = NULL;
+  CLEANUP_FREE int *serials = NULL;
+  size_t submitted = 0, completed = 0;
+  int64_t t0;
+
+  latencies = malloc (count * sizeof (int64_t));
+  start = malloc (depth * sizeof (int64_t));
+  serials = malloc (depth * sizeof (int));
+  if (!latencies || !start || !serials)
+    error (EXIT_FAILURE, errno, "malloc");
+
+  t0 = now_us ();
+  while (completed < (size_t) count) {
+    /* Fill the pipeline. */
+    while (submitted < (size_t) count &&
+           submitted - completed < (size_t) depth) {
+      const size_t slot = submitted % depth;
+
+      start[slot] = now_us ();
+      serials[slot] = submit (opaque);
+      if (serials[slot] == -1)
+        exit (EXIT_FAILURE);
+      submitted++;
+    }
+
+    /* Collect the oldest reply. */
+    {
+      const size_t slot = completed % depth;
+
+      if (wait (serials[slot], opaque) == -1)
+        exit (EXIT_FAILURE);
+      latencies[completed] = now_us () - start[slot];
+      completed++;
+    }
+  }
+
+  print_result (name, depth, latencies, count, now_us () - t0,
+                bytes_per_call * count);
+}
+
+static int
+submit_ping (void *opaque)
+{
+  return guestfs_submit_ping_daemon (g);
+}
+
+static int
+wait_ping (int serial, void *opaque)
+{
+  return guestfs_wait_ping_daemon (g, serial);
+}
+
+static void
+run_ping (void)
+{
+  run_pipelined ("ping", submit_ping, wait_ping, NULL, 0);
+}
+
+static int
+submit_echo (void *words)
+{
+  return guestfs_submit_echo_daemon (g, words);
+}
+
+static int
+wait_echo (int serial, void *opaque)
+{
+  char *r;
+
+  r = guestfs_wait_echo_daemon (g, serial);
+  if (r == NULL)
+    return -1;
+  free (r);
+  return 0;
+}
+
+static void
+run_echo (size_t size)
+{
+  CLEANUP_FREE char *payload = NULL;
+  char *words[2];
+  char name[32];
+
+  payload = malloc (size + 1);
+  if (payload == NULL)
+    error (EXIT_FAILURE, errno, "malloc");
+  memset (payload, 'x', size);
+  payload[size] = '\0';
+  words[0] = payload;
+  words[1] = NULL;
+
+  snprintf (name, sizeof name, "echo-%zu", size);
+  run_pipelined (name, submit_echo, wait_echo, words, size);
+}
+
+static void
+run_upload (void)
+{
+  CLEANUP_FREE int64_t *latencies = NULL;
+  char tmpfile[] = "/tmp/protobenchXXXXXX";
+  int fd, i;
+  int64_t t0, t;
+
+  /* Upload a sparse file, so this mostly measures the protocol and
+   * not the host disk.
+   */
+  fd = mkstemp (tmpfile);
+  if (fd == -1)
+    error (EXIT_FAILURE, errno, "mkstemp: %s", tmpfile);
+  if (ftruncate (fd, transfer_size) == -1)
+    error (EXIT_FAILURE, errno, "ftruncate");
+  if (close (fd) == -1)
+    error (EXIT_FAILURE, errno, "close");
+
+  latencies = malloc (transfers * sizeof (int64_t));
+  if (latencies == NULL)
+    error (EXIT_FAILURE, errno, "malloc");
+
+  t0 = now_us ();
+  for (i = 0; i < transfers; ++i) {
+    t = now_us ();
+    if (guestfs_upload (g, tmpfile, "/dev/null") == -1) {
+      unlink (tmpfile);
+      exit (EXIT_FAILURE);
+    }
+    latencies[i] = now_us () - t;
+  }
+  t = now_us () - t0;
+  unlink (tmpfile);
+
+  print_result ("upload", 1, latencies, transfers, t,
+                transfer_size * transfers);
+}
+
+static void
+run_download (void)
+{
+  CLEANUP_FREE int64_t *latencies = NULL;
+  int i;
+  int64_t t0, t;
+
+  if (guestfs_touch (g, "/sparse") == -1)
+    exit (EXIT_FAILURE);
+  if (guestfs_truncate_size (g, "/sparse", transfer_size) == -1)
+    exit (EXIT_FAILURE);
+
+  latencies = malloc (transfers * sizeof (int64_t));
+  if (latencies == NULL)
+    error (EXIT_FAILURE, errno, "malloc");
+
+  t0 = now_us ();
+  for (i = 0; i < transfers; ++i) {
+    t = now_us ();
+    if (guestfs_download (g, "/sparse", "/dev/null") == -1)
+      exit (EXIT_FAILURE);
+    latencies[i] = now_us () - t;
+  }
+  t = now_us () - t0;
+
+  print_result ("download", 1, latencies, transfers, t,
+                transfer_size * transfers);
+}
@@ -172,7 +172,7 @@ main (int argc, char *argv[])
   if (P > 0)
     P = MIN (n, P);
   else
-    P = MIN (n, MIN (MAX_THREADS, estimate_max_threads ()));
+    P = MIN (n, MIN (MAX_THREADS, estimate_max_threads (NULL)));
 
   run_test (P);
   exit (EXIT_SUCCESS);
@@ -35,6 +35,9 @@ module NetworkMap = Map.Make (NetTypeAndName)
 
 type cmdline = {
   compressed : bool;
+  copy_coroutines : int option;
+  copy_during_conversion : bool;
+  copy_out_of_order : bool;
   debug_overlays : bool;
   do_copy : bool;
   in_place : bool;
@@ -42,15 +45,20 @@ type cmdline = {
   output_alloc : output_allocation;
   output_format : string option;
   output_name : string option;
+  parallel : int;
   print_source : bool;
   root_choice : root_choice;
 }
 
 let parse_cmdline () =
   let compressed = ref false in
+  let copy_coroutines = ref None in
+  let copy_during_conversion = ref false in
+  let copy_out_of_order = ref false in
   let debug_overlays = ref false in
   let do_copy = ref true in
   let machine_readable = ref false in
+  let parallel = ref 1 in
   let print_source = ref false in
   let qemu_boot = ref false in
 
@@ -77,6 +85,12 @@ let parse_cmdline () =
        optref := Some arg
   in
 
+  let set_copy_coroutines n =
+    if n < 1 || n > 16 then
+      error (f_"--copy-coroutines must be between 1 and 16");
+    copy_coroutines := Some n
+  in
+
   let input_mode = ref `Not_set in
   let set_input_mode mode =
     if !input_mode <> `Not_set then
@@ -171,6 +185,12 @@ let parse_cmdline () =
   let argspec = [
     [ S 'b'; L"bridge" ],        Getopt.String ("in:out", add_bridge),     s_"Map bridge 'in' to 'out'";
     [ L"compressed" ], Getopt.Set compressed,     s_"Compress output file";
+    [ L"copy-coroutines" ], Getopt.Int ("n", set_copy_coroutines),
+                                            s_"Number of qemu-img coroutines per disk";
+    [ L"copy-during-conversion" ], Getopt.Set copy_during_conversion,
+                                            s_"Copy the disks while converting";
+    [ L"copy-out-of-order" ], Getopt.Set copy_out_of_order,
+                                            s_"Allow out-of-order writes when copying";
     [ L"dcpath"; L"dcPath" ],  Getopt.String ("path", set_string_option_once "--dcpath" dcpath),
                                             s_"Override dcPath (for vCenter)";
     [ L"debug-overlay"; L"debug-overlays" ], Getopt.Set debug_overlays, s_"Save overlay files";
@@ -196,6 +216,8 @@ let parse_cmdline () =
                                             s_"Rename guest when converting";
     [ M"os" ],       Getopt.String ("storage", set_string_option_once "-os" output_storage),
                                             s_"Set output storage location";
+    [ L"parallel" ], Getopt.Set_int ("n", parallel),
+                                            s_"Number of disks copied in parallel";
     [ L"password-file" ], Getopt.String ("file", set_string_option_once "--password-file" password_file),
                                             s_"Use password from file";
     [ L"print-source" ], Getopt.Set print_source, s_"Print source and stop";
@@ -241,6 +263,9 @@ read the man page virt-v2v(1).
   (* Dereference the arguments. *)
   let args = List.rev !args in
   let compressed = !compressed in
+  let copy_coroutines = !copy_coroutines in
+  let copy_during_conversion = !copy_during_conversion in
+  let copy_out_of_order = !copy_out_of_order in
   let dcpath = !dcpath in
   let debug_overlays = !debug_overlays in
   let do_copy = !do_copy in
@@ -258,6 +283,7 @@ read the man page virt-v2v(1).
   let output_format = !output_format in
   let output_mode = !output_mode in
   let output_name = !output_name in
+  let parallel = !parallel in
   let output_storage = !output_storage in
   let password_file = !password_file in
   let print_source = !print_source in
@@ -270,6 +296,11 @@ read the man page virt-v2v(1).
   let vdsm_ovf_output =
     match !vdsm_ovf_output with None -> "." | Some s -> s in
 
+  if parallel < 1 then
+    error (f_"--parallel must be at least 1");
+  if copy_during_conversion && (in_place || not do_copy) then
+    error (f_"--copy-during-conversion cannot be used with --in-place or --no-copy");
+
   (* No arguments and machine-readable mode?  Print out some facts
    * about what this binary supports.
    *)
@@ -278,6 +309,7 @@ read the man page virt-v2v(1).
     printf "libguestfs-rewrite\n";
     printf "colours-option\n";
     printf "vdsm-compat-option\n";
+    printf "parallel-copy-option\n";
     List.iter (printf "input:%s\n") (Modules_list.input_modules ());
     List.iter (printf "output:%s\n") (Modules_list.output_modules ());
     List.iter (printf "convert:%s\n") (Modules_list.convert_modules ());
@@ -426,10 +458,12 @@ read the man page virt-v2v(1).
       Output_vdsm.output_vdsm os vdsm_params output_alloc in
 
   {
-    compressed = compressed; debug_overlays = debug_overlays;
+    compressed = compressed; copy_coroutines = copy_coroutines;
+    copy_during_conversion = copy_during_conversion;
+    copy_out_of_order = copy_out_of_order; debug_overlays = debug_overlays;
     do_copy = do_copy; in_place = in_place; network_map = network_map;
     output_alloc = output_alloc; output_format = output_format;
-    output_name = output_name;
+    output_name = output_name; parallel = parallel;
     print_source = print_source; root_choice = root_choice;
   },
   input, output
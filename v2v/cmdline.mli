@@ -34,6 +34,9 @@ end
 
 type cmdline = {
   compressed : bool;
+  copy_coroutines : int option;
+  copy_during_conversion : bool;
+  copy_out_of_order : bool;
   debug_overlays : bool;
   do_copy : bool;
   in_place : bool;
@@ -41,6 +44,7 @@ type cmdline = {
   output_alloc : Types.output_allocation;
   output_format : string option;
   output_name : string option;
+  parallel : int;
   print_source : bool;
   root_choice : Types.root_choice;
 }
@@ -26,6 +26,112 @@ open Utils
 open Xpath_helpers
 open Name_from_disk
 
+(* Call [f buf len] on each piece of the [size] bytes at [offset]
+ * in [file].
+ *)
+let iter_range file offset size f =
+  let chan = open_in_bin file in
+  LargeFile.seek_in chan offset;
+  let buf = Bytes.create 65536 in
+  let rec loop n =
+    if n > 0L then (
+      let r = input chan buf 0 (Int64.to_int (min n 65536L)) in
+      if r = 0 then
+        error (f_"%s: unexpected end of file") file;
+      f buf r;
+      loop (n -^ Int64.of_int r)
+    )
+  in
+  loop size;
+  close_in chan
+
+let copy_range file offset size dest =
+  let chan = open_out_bin dest in
+  iter_range file offset size (fun buf len -> output chan buf 0 len);
+  close_out chan
+
+(* Return the regular files in an uncompressed tar file as a list of
+ * [(name, offset, size)], where [offset] is the start of the data.
+ * This understands ustar and the extensions which tar programs use
+ * for long names and large files (GNU long names, base-256 numbers
+ * and pax headers).  Returns [None] for anything else, such as GNU
+ * sparse files, which cannot be read in place.
+ *)
+let tar_members file =
+  let chan = open_in_bin file in
+  let header = Bytes.create 512 in
+  let cstring off len =
+    let s = Bytes.sub_string header off len in
+    try String.sub s 0 (String.index s '\000') with Not_found -> s in
+  let number off len =
+    if Char.code (Bytes.get header off) land 0x80 <> 0 then (
+      (* Base-256, used by GNU tar for sizes >= 8 GB. *)
+      let n = ref 0L in
+      for i = off+1 to off+len-1 do
+        n := Int64.logor (Int64.shift_left !n 8)
+                         (Int64.of_int (Char.code (Bytes.get header i)))
+      done;
+      !n
+    )
+    else (
+      let s = String.trim (cstring off len) in
+      if s = "" then 0L else Int64.of_string ("0o" ^ s)
+    ) in
+  let read_data size =
+    let s = really_input_string chan (Int64.to_int size) in
+    try String.sub s 0 (String.index s '\000') with Not_found -> s in
+  (* Pax extended headers are a list of "LEN KEY=VALUE\n" records. *)
+  let rec pax_records s =
+    if s = "" then []
+    else (
+      let sp = String.index s ' ' in
+      let len = int_of_string (String.sub s 0 sp) in
+      let record = String.sub s (sp+1) (len-sp-2) in
+      let rest = String.sub s len (String.length s - len) in
+      String.split "=" record :: pax_records rest
+    ) in
+  let rec loop pos long_name pax acc =
+    LargeFile.seek_in chan pos;
+    let eof =
+      try really_input chan header 0 512; Bytes.get header 0 = '\000'
+      with End_of_file -> true in
+    if eof then Some (List.rev acc)
+    else (
+      let size = number 124 12 in
+      let data = pos +^ 512L in
+      let next = data +^ (size +^ 511L) /^ 512L *^ 512L in
+      match Bytes.get header 156 with
+      | 'L' -> loop next (Some (read_data size)) pax acc
+      | 'x' -> loop next long_name (pax_records (read_data size)) acc
+      | 'S' -> None
+      | '0' | '\000' | '7' ->
+        let name =
+          match long_name with
+          | Some name -> name
+          | None ->
+            try List.assoc "path" pax
+            with Not_found ->
+              let name = cstring 0 100 in
+              if Bytes.sub_string header 257 6 = "ustar\000" then (
+                match cstring 345 155 with
+                | "" -> name
+                | prefix -> prefix ^ "/" ^ name
+              )
+              else name in
+        let size =
+          try Int64.of_string (List.assoc "size" pax)
+          with Not_found -> size in
+        let next = data +^ (size +^ 511L) /^ 512L *^ 512L in
+        loop next None [] ((name, data, size) :: acc)
+      | _ -> loop next None [] acc
+    )
+  in
+  let members =
+    try loop 0L None [] []
+    with End_of_file | Failure _ | Not_found | Invalid_argument _ -> None in
+  close_in chan;
+  members
+
 class input_ova ova =
   let tmpdir =
     let base_dir = (open_guestfs ())#get_cachedir () in
@@ -44,6 +150,12 @@ object
       if run_command cmd <> 0 then
         error (f_"error unpacking %s, see earlier error messages") ova in
 
+    (* Disks which are read in place from an uncompressed ova, as a
+     * map from the path they would have had if extracted to their
+     * offset and size in the ova.
+     *)
+    let in_place = Hashtbl.create 13 in
+
     (* Extract ova file. *)
     let exploded =
       (* The spec allows a directory to be specified as an ova.  This
@@ -69,8 +181,38 @@ object
 
         match detect_file_type ova with
         | `Tar ->
-          (* Normal ovas are tar file (not compressed). *)
-          untar ova tmpdir;
+          (* Normal ovas are tar file (not compressed).  If possible,
+           * extract only the small files and let qemu read the disks
+           * from the ova, to avoid copying them.
+           *)
+          let members =
+            if qemu_img_supports_offset_and_size () then tar_members ova
+            else None in
+          (match members with
+          | None -> untar ova tmpdir
+          | Some members ->
+            List.iter (
+              fun (name, offset, size) ->
+                let rec strip name =
+                  if String.is_prefix name "./" then
+                    strip (String.sub name 2 (String.length name - 2))
+                  else if String.is_prefix name "/" then
+                    strip (String.sub name 1 (String.length name - 1))
+                  else name in
+                let name = strip name in
+                if name <> "" && not (List.mem ".." (String.nsplit "/" name))
+                then (
+                  let path = tmpdir // name in
+                  if Filename.check_suffix name ".ovf" ||
+                     Filename.check_suffix name ".mf" then (
+                    mkdir_p (Filename.dirname path) 0o755;
+                    copy_range ova offset size path
+                  )
+                  else
+                    Hashtbl.replace in_place (absolute_path path) (offset, size)
+                )
+            ) members
+          );
           tmpdir
         | `Zip ->
           (* However, although not permitted by the spec, people ship
@@ -95,10 +237,10 @@ object
           | `Tar ->
             untar ~format:tar_fmt ova tmpdir;
             tmpdir
-          | `Zip | `GZip | `XZ | `Unknown ->
+          | `Zip | `GZip | `XZ | `Zstd | `Unknown ->
             error (f_"%s: unsupported file format\n\nFormats which we currently understand for '-i ova' are: tar (uncompressed, compress with gzip or xz), zip") ova
           )
-        | `Unknown ->
+        | `Zstd | `Unknown ->
           error (f_"%s: unsupported file format\n\nFormats which we currently understand for '-i ova' are: tar (uncompressed, compress with gzip or xz), zip") ova
       ) in
 
@@ -145,6 +287,9 @@ object
       | _ :: _ ->
         error (f_"more than one .ovf file was found in %s") ova in
 
+    let find_in_place path =
+      try Some (Hashtbl.find in_place path) with Not_found -> None in
+
     (* Read any .mf (manifest) files and verify sha1. *)
     let mf = find_files exploded ".mf" in
     let rex = Str.regexp "\\(SHA1\\|SHA256\\)(\\(.*\\))= \\([0-9a-fA-F]+\\)\r?" in
@@ -160,7 +305,16 @@ object
             let disk = Str.matched_group 2 line in
             let expected = Str.matched_group 3 line in
             let csum = Checksums.of_string mode expected in
-            try Checksums.verify_checksum csum (mf_folder // disk)
+            try
+              (match find_in_place (mf_folder // disk) with
+              | Some (offset, size) ->
+                let t = Checksums.create [csum] in
+                iter_range ova offset size (fun buf len ->
+                  Checksums.update t buf 0 len);
+                Checksums.verify t
+              | None ->
+                Checksums.verify_checksum csum (mf_folder // disk)
+              )
             with Checksums.Mismatched_checksum (_, actual) ->
               error (f_"checksum of disk %s does not match manifest %s (actual %s(%s) = %s, expected %s(%s) = %s)")
                 disk mf mode disk actual mode disk expected;
@@ -276,28 +430,69 @@ object
             | None -> error (f_"no href in ovf:File (id=%s)") file_ref
             | Some s -> s in
 
-          (* Does the file exist and is it readable? *)
+          let filename =
+            if String.is_prefix filename "./" then
+              String.sub filename 2 (String.length filename - 2)
+            else filename in
           let filename = ovf_folder // filename in
-          Unix.access filename [Unix.R_OK];
 
-          (* The spec allows the file to be gzip-compressed, in which case
-           * we must uncompress it into the tmpdir.
+          (* A compressed disk in the ova cannot be read in place, so
+           * extract it and handle it like a compressed file below.
            *)
-          let filename =
-            if detect_file_type filename = `GZip then (
-              let new_filename = tmpdir // String.random8 () ^ ".vmdk" in
-              let cmd =
-                sprintf "zcat %s > %s" (quote filename) (quote new_filename) in
-              if shell_command cmd <> 0 then
-                error (f_"error uncompressing %s, see earlier error messages")
-                  filename;
-              new_filename
-            )
-            else filename in
+          let filename, in_place =
+            match find_in_place filename with
+            | None -> filename, None
+            | Some (offset, size) ->
+              let magic = Bytes.make 2 '\000' in
+              iter_range ova offset (min size 2L)
+                         (fun buf len -> Bytes.blit buf 0 magic 0 len);
+              if Bytes.to_string magic = "\x1f\x8b" then (
+                let extracted = tmpdir // String.random8 () ^ ".vmdk.gz" in
+                copy_range ova offset size extracted;
+                extracted, None
+              )
+              else filename, Some (offset, size) in
+
+          let qemu_uri =
+            match in_place with
+            | Some (offset, size) ->
+              (* Read the disk from the ova through a raw driver
+               * limited to the tar member.
+               *)
+              let json_params = [
+                "file", JSON.Dict [
+                  "driver", JSON.String "raw";
+                  "offset", JSON.Int64 offset;
+                  "size", JSON.Int64 size;
+                  "file", JSON.Dict [
+                    "driver", JSON.String "file";
+                    "filename", JSON.String (absolute_path ova);
+                  ]
+                ]
+              ] in
+              debug "ova: json parameters: %s" (JSON.string_of_doc json_params);
+              "json: " ^ JSON.string_of_doc json_params
+            | None ->
+              (* Does the file exist and is it readable? *)
+              Unix.access filename [Unix.R_OK];
+
+              (* The spec allows the file to be gzip-compressed, in
+               * which case we must uncompress it into the tmpdir.
+               *)
+              if detect_file_type filename = `GZip then (
+                let new_filename = tmpdir // String.random8 () ^ ".vmdk" in
+                let cmd =
+                  sprintf "zcat %s > %s" (quote filename) (quote new_filename) in
+                if shell_command cmd <> 0 then
+                  error (f_"error uncompressing %s, see earlier error messages")
+                    filename;
+                new_filename
+              )
+              else filename in
 
           let disk = {
             s_disk_id = i;
-            s_qemu_uri = filename;
+            s_qemu_uri = qemu_uri;
             s_format = Some "vmdk";
             s_controller = controller;
           } in
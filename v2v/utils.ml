@@ -90,3 +90,33 @@ let du filename =
   match lines with
   | line::_ -> Int64.of_string line
   | [] -> invalid_arg filename
+
+let qemu_img_supports_offset_and_size () =
+  (* Try opening a file through a raw driver with an offset and
+   * size, which qemu >= 2.8 understands.
+   *)
+  let tmp = Filename.temp_file "v2vqemuimgtst" ".img" in
+  unlink_on_exit tmp;
+  let chan = open_out_bin tmp in
+  output_string chan (String.make 1024 '\000');
+  close_out chan;
+
+  let json = [
+    "file", JSON.Dict [
+      "driver", JSON.String "raw";
+      "offset", JSON.Int 512;
+      "size", JSON.Int 512;
+      "file", JSON.Dict [
+        "driver", JSON.String "file";
+        "filename", JSON.String tmp;
+      ]
+    ]
+  ] in
+  let cmd =
+    sprintf "qemu-img info %s >/dev/null 2>&1"
+      (quote ("json: " ^ JSON.string_of_doc ~fmt:JSON.Compact json)) in
+  debug "%s" cmd;
+  let r = Sys.command cmd = 0 in
+  Unix.unlink tmp;
+  debug "qemu-img supports offset and size in json URIs: %b" r;
+  r
@@ -43,6 +43,10 @@ val find_uefi_firmware : string -> Uefi.uefi_firmware
 val compare_app2_versions : Guestfs.application2 -> Guestfs.application2 -> int
 (** Compare two app versions. *)
 
+val qemu_img_supports_offset_and_size : unit -> bool
+(** Return true if qemu-img can open a part of a file, using the
+    [offset] and [size] options of the raw driver in a [json:] URI. *)
+
 val du : string -> int64
 (** Return the true size of a file in bytes, including any wasted
     space caused by internal fragmentation (the overhead of using
@@ -69,6 +69,12 @@ let rec main () =
     )
     else In_place in
 
+  let early_copy =
+    match conversion_mode with
+    | Copying (_, targets) when cmdline.copy_during_conversion ->
+       Some (start_early_copy cmdline targets input output)
+    | Copying _ | In_place -> None in
+
   (match conversion_mode with
    | Copying _ -> message (f_"Opening the overlay")
    | In_place -> message (f_"Opening the source VM")
@@ -121,6 +127,10 @@ let rec main () =
      *)
     message (f_"Mapping filesystem data to avoid copying unused and blank areas");
     do_fstrim g inspect;
+    (* Only the overlay may be changed like this, not the source. *)
+    (match conversion_mode with
+     | Copying _ -> discard_unused_space g
+     | In_place -> ())
   );
 
   (match conversion_mode with
@@ -146,7 +156,11 @@ let rec main () =
 
        let targets =
          if not cmdline.do_copy then targets
-         else copy_targets cmdline targets input output in
+         else (
+           match early_copy with
+           | None -> copy_targets cmdline targets input output
+           | Some pid -> finish_early_copy pid targets
+         ) in
 
        (* Create output metadata. *)
        message (f_"Creating output metadata");
@@ -242,29 +256,8 @@ and check_host_free_space () =
 and create_overlays src_disks =
   message (f_"Creating an overlay to protect the source from being modified");
   mapi (
-    fun i ({ s_qemu_uri = qemu_uri; s_format = format } as source) ->
-      let overlay_file =
-        Filename.temp_file ~temp_dir:overlay_dir "v2vovl" ".qcow2" in
-      unlink_on_exit overlay_file;
-
-      (* There is a specific reason to use the newer qcow2 variant:
-       * Because the L2 table can store zero clusters efficiently, and
-       * because discarded blocks are stored as zero clusters, this
-       * should allow us to fstrim/blkdiscard and avoid copying
-       * significant parts of the data over the wire.
-       *)
-      let options =
-        "compat=1.1" ^
-          (match format with None -> ""
-                           | Some fmt -> ",backing_fmt=" ^ fmt) in
-      let cmd = [ "qemu-img"; "create"; "-q"; "-f"; "qcow2"; "-b"; qemu_uri;
-                  "-o"; options; overlay_file ] in
-      if run_command cmd <> 0 then
-        error (f_"qemu-img command failed, see earlier errors");
-
-      (* Sanity check created overlay (see below). *)
-      if not ((open_guestfs ())#disk_has_backing_file overlay_file) then
-        error (f_"internal error: qemu-img did not create overlay with backing file");
+    fun i source ->
+      let overlay_file = create_overlay_file source in
 
       let sd = "sd" ^ drive_name i in
 
@@ -281,6 +274,33 @@ and create_overlays src_disks =
         ov_virtual_size = vsize; ov_source = source }
   ) src_disks
 
+(* Create a qcow2 v3 overlay file backed by the source disk. *)
+and create_overlay_file { s_qemu_uri = qemu_uri; s_format = format } =
+  let overlay_file =
+    Filename.temp_file ~temp_dir:overlay_dir "v2vovl" ".qcow2" in
+  unlink_on_exit overlay_file;
+
+  (* There is a specific reason to use the newer qcow2 variant:
+   * Because the L2 table can store zero clusters efficiently, and
+   * because discarded blocks are stored as zero clusters, this
+   * should allow us to fstrim/blkdiscard and avoid copying
+   * significant parts of the data over the wire.
+   *)
+  let options =
+    "compat=1.1" ^
+      (match format with None -> ""
+                       | Some fmt -> ",backing_fmt=" ^ fmt) in
+  let cmd = [ "qemu-img"; "create"; "-q"; "-f"; "qcow2"; "-b"; qemu_uri;
+              "-o"; options; overlay_file ] in
+  if run_command cmd <> 0 then
+    error (f_"qemu-img command failed, see earlier errors");
+
+  (* Sanity check created overlay (see below). *)
+  if not ((open_guestfs ())#disk_has_backing_file overlay_file) then
+    error (f_"internal error: qemu-img did not create overlay with backing file");
+
+  overlay_file
+
 (* Work out where we will write the final output.  Do this early
  * just so we can display errors to the user before doing too much
  * work.
@@ -400,12 +420,16 @@ and do_fstrim g inspect =
   let fses = g#list_filesystems () in
 
   let fses = filter_map (
-    function (_, ("unknown"|"swap")) -> None | (dev, _) -> Some dev
+    function (_, ("unknown"|"swap")) -> None | (dev, vfs) -> Some (dev, vfs)
   ) fses in
 
-  (* Trim the filesystems. *)
+  let have_blkdiscard = g#feature_available [|"blkdiscard"|] in
+
+  (* Trim the filesystems.  Trimmed blocks become zero clusters in
+   * the overlay, so qemu-img never reads them from the source.
+   *)
   List.iter (
-    fun dev ->
+    fun (dev, vfs) ->
       g#umount_all ();
       let mounted =
         try g#mount_options "discard" dev "/"; true
@@ -414,10 +438,80 @@ and do_fstrim g inspect =
       if mounted then (
         try g#fstrim "/"
         with G.Error msg ->
-          warning (f_"fstrim on guest filesystem %s failed.  Usually you can ignore this message.  To find out more read \"Trimming\" in virt-v2v(1).\n\nOriginal message: %s") dev msg
+          (* If the filesystem driver cannot trim, discard the free
+           * space found in the filesystem's own maps instead.  This
+           * is only safe now that the filesystem has been mounted
+           * read-write and is unmounted cleanly.
+           *)
+          g#umount_all ();
+          let discarded =
+            match vfs with
+            | ("ext2"|"ext3"|"ext4"|"xfs"|"ntfs") when have_blkdiscard ->
+              (try
+                 let bytes = g#discard_free_ranges dev in
+                 debug "%s: discarded %Ld bytes of free space" dev bytes;
+                 true
+               with G.Error msg ->
+                 debug "%s: discard_free_ranges: %s" dev msg;
+                 false)
+            | _ -> false in
+          if not discarded then
+            warning (f_"fstrim on guest filesystem %s failed.  Usually you can ignore this message.  To find out more read \"Trimming\" in virt-v2v(1).\n\nOriginal message: %s") dev msg
       )
   ) fses
 
+(* Discard the parts of the overlay which do not hold filesystem
+ * data, so they are not read from the source either: Linux swap,
+ * and the free space in LVM volume groups.  This matters most for
+ * physical machines (virt-p2v), which usually have both.
+ *)
+and discard_unused_space g =
+  if g#feature_available [|"blkdiscard"|] then (
+    g#umount_all ();
+
+    let swaps = g#list_filesystems () in
+    let swaps = filter_map (
+      function (dev, "swap") -> Some dev | _ -> None
+    ) swaps in
+    List.iter (
+      fun dev ->
+        (* Only the Linux swap signature on x86 is recognized.  This
+         * also leaves alone swap containing a hibernated image,
+         * where the signature is different.
+         *)
+        let is_linux_x86_swap =
+          try g#pread_device dev 10 4086L = "SWAPSPACE2"
+          with G.Error _ -> false in
+
+        if is_linux_x86_swap then (
+          debug "discarding swap on %s" dev;
+          (* Preserve the header containing the label and UUID. *)
+          let header = g#pread_device dev 4096 0L in
+          g#blkdiscard dev;
+          if g#pwrite_device dev header 0L <> 4096 then
+            error (f_"pwrite: short write restoring swap partition header")
+        )
+    ) swaps;
+
+    let vgs = Array.to_list (g#vgs ()) in
+    List.iter (
+      fun vg ->
+        let lvname = String.random8 () in
+        let lvdev = "/dev/" ^ vg ^ "/" ^ lvname in
+
+        let created =
+          try g#lvcreate_free lvname vg 100; true
+          with G.Error _ -> false in
+
+        if created then (
+          debug "discarding free space in volume group %s" vg;
+          g#blkdiscard lvdev;
+          g#sync ();
+          g#lvremove lvdev
+        )
+    ) vgs
+  )
+
 (* Estimate the space required on the target for each disk.  It is the
  * maximum space that might be required, but in reasonable cases much
  * less space would actually be needed.
@@ -606,114 +700,268 @@ and get_target_firmware inspect guestcaps source output =
 
 and delete_target_on_exit = ref true
 
-(* Copy the source (really, the overlays) to the output. *)
-and copy_targets cmdline targets input output =
+and delete_targets_on_exit targets =
   at_exit (fun () ->
     if !delete_target_on_exit then (
       List.iter (
         fun t -> try unlink t.target_file with _ -> ()
       ) targets
     )
+  )
+
+(* Copy the source (really, the overlays) to the output. *)
+and copy_targets ?(progress_bar = true) cmdline targets input output =
+  delete_targets_on_exit targets;
+  let nr_disks = List.length targets in
+
+  let mbps size time = Int64.to_float size /. 1024. /. 1024. *. 10. /. time in
+
+  (* Create the target disk and start qemu-img copying to it.
+   * Returns the pid of qemu-img.
+   *)
+  let start_copy i t =
+    message (f_"Copying disk %d/%d to %s (%s)")
+      (i+1) nr_disks t.target_file t.target_format;
+    debug "%s" (string_of_target t);
+
+    (* We noticed that qemu sometimes corrupts the qcow2 file on
+     * exit.  This only seemed to happen with lazy_refcounts was
+     * used.  The symptom was that the header wasn't written back
+     * to the disk correctly and the file appeared to have no
+     * backing file.  Just sanity check this here.
+     *)
+    let overlay_file = t.target_overlay.ov_overlay_file in
+    if not ((open_guestfs ())#disk_has_backing_file overlay_file) then
+      error (f_"internal error: qemu corrupted the overlay file");
+
+    (* Give the input module a chance to adjust the parameters
+     * of the overlay/backing file.  This allows us to increase
+     * the readahead parameter when copying (see RHBZ#1151033 and
+     * RHBZ#1153589 for the gruesome details).
+     *)
+    input#adjust_overlay_parameters t.target_overlay;
+
+    (* It turns out that libguestfs's disk creation code is
+     * considerably more flexible and easier to use than
+     * qemu-img, so create the disk explicitly using libguestfs
+     * then pass the 'qemu-img convert -n' option so qemu reuses
+     * the disk.
+     *
+     * Also we allow the output mode to actually create the disk
+     * image.  This lets the output mode set ownership and
+     * permissions correctly if required.
+     *)
+    (* What output preallocation mode should we use? *)
+    let preallocation =
+      match t.target_format, cmdline.output_alloc with
+      | ("raw"|"qcow2"), Sparse -> Some "sparse"
+      | ("raw"|"qcow2"), Preallocated -> Some "full"
+      | _ -> None (* ignore -oa flag for other formats *) in
+    let compat =
+      match t.target_format with "qcow2" -> Some "1.1" | _ -> None in
+    output#disk_create
+      t.target_file t.target_format t.target_overlay.ov_virtual_size
+      ?preallocation ?compat;
+
+    (* The progress bars of several qemu-img processes would
+     * overwrite each other, so only show it when copying one
+     * disk at a time.
+     *)
+    let cmd = [ "qemu-img"; "convert" ] @
+      (if not (quiet ()) && progress_bar && cmdline.parallel = 1 then [ "-p" ]
+       else []) @
+      [ "-n"; "-f"; "qcow2"; "-O"; t.target_format ] @
+      (if cmdline.compressed then [ "-c" ] else []) @
+      (match cmdline.copy_coroutines with
+       | None -> []
+       | Some n -> [ "-m"; string_of_int n ]) @
+      (if cmdline.copy_out_of_order then [ "-W" ] else []) @
+      [ overlay_file; t.target_file ] in
+    debug "%s" (stringify_args cmd);
+    create_process "qemu-img" (Array.of_list cmd) stdin stdout stderr
+  in
+
+  (* Called when qemu-img has finished copying the target. *)
+  let finish_copy t elapsed_time =
+    (* Calculate the actual size on the target, returns an updated
+     * target structure.
+     *)
+    let t = actual_target_size t in
+
+    (* If verbose, print the virtual and real copying rates. *)
+    if verbose () && elapsed_time > 0. then (
+      eprintf "%s: virtual copying rate: %.1f M bits/sec\n%!"
+        t.target_overlay.ov_sd
+        (mbps t.target_overlay.ov_virtual_size elapsed_time);
+
+      match t.target_actual_size with
+      | None -> ()
+      | Some actual ->
+         eprintf "%s: real copying rate: %.1f M bits/sec\n%!"
+                 t.target_overlay.ov_sd (mbps actual elapsed_time)
+    );
+
+    (* If verbose, find out how close the estimate was.  This is
+     * for developer information only - so we can increase the
+     * accuracy of the estimate.
+     *)
+    if verbose () then (
+      match t.target_estimated_size, t.target_actual_size with
+      | None, None | None, Some _ | Some _, None | Some _, Some 0L -> ()
+      | Some estimate, Some actual ->
+        let pc =
+          100. *. Int64.to_float estimate /. Int64.to_float actual
+          -. 100. in
+        eprintf "%s: estimate %Ld (%s) versus actual %Ld (%s): %.1f%%"
+          t.target_overlay.ov_sd
+          estimate (human_size estimate)
+          actual (human_size actual)
+          pc;
+        if pc < 0. then eprintf " ! ESTIMATE TOO LOW !";
+        eprintf "\n%!";
+    );
+
+    t
+  in
+
+  (* Copy up to cmdline.parallel disks at the same time.  Over a slow
+   * link (eg. from VMware vCenter) a single qemu-img process cannot
+   * use all of the bandwidth.
+   *)
+  let copied = Array.make nr_disks None in
+  let running = Hashtbl.create 13 in
+  let wait_one () =
+    let pid, stat = wait () in
+    if Hashtbl.mem running pid then (
+      let i, t, start_time = Hashtbl.find running pid in
+      Hashtbl.remove running pid;
+      match stat with
+      | WEXITED 0 ->
+        copied.(i) <- Some (finish_copy t (gettimeofday () -. start_time))
+      | WEXITED _ | WSIGNALED _ | WSTOPPED _ ->
+        (* Don't leave the other copies writing to the targets. *)
+        Hashtbl.iter (fun pid _ -> try kill pid Sys.sigterm with _ -> ())
+          running;
+        error (f_"qemu-img command failed, see earlier errors")
+    )
+  in
+
+  let start_time = gettimeofday () in
+  iteri (
+    fun i t ->
+      while Hashtbl.length running >= cmdline.parallel do wait_one () done;
+      let pid = start_copy i t in
+      Hashtbl.add running pid (i, t, gettimeofday ())
+  ) targets;
+  while Hashtbl.length running > 0 do wait_one () done;
+  let elapsed_time = gettimeofday () -. start_time in
+
+  let targets =
+    List.map (function Some t -> t | None -> assert false)
+      (Array.to_list copied) in
+
+  (* If verbose, print the copying rate of all the disks together. *)
+  if verbose () && elapsed_time > 0. && nr_disks > 1 then (
+    let sum = List.fold_left Int64.add 0L in
+    eprintf "aggregate virtual copying rate: %.1f M bits/sec\n%!"
+      (mbps (sum (List.map (fun t -> t.target_overlay.ov_virtual_size) targets))
+            elapsed_time);
+    let actuals = List.map (fun t -> t.target_actual_size) targets in
+    if List.for_all ((<>) None) actuals then (
+      let actuals = List.map (function Some a -> a | None -> 0L) actuals in
+      eprintf "aggregate real copying rate: %.1f M bits/sec\n%!"
+        (mbps (sum actuals) elapsed_time)
+    )
+  );
+
+  targets
+
+(* With --copy-during-conversion, copy the unmodified source disks
+ * to the targets in a subprocess while the guest is converted.  Each
+ * copy reads through a fresh overlay so the input module can adjust
+ * its parameters as usual.  Returns the pid of the subprocess.
+ *)
+and start_early_copy cmdline targets input output =
+  message (f_"Copying the source disks during the conversion");
+  let early_targets = List.map (
+    fun t ->
+      let ov = t.target_overlay in
+      let overlay_file = create_overlay_file ov.ov_source in
+      { t with target_overlay = { ov with ov_overlay_file = overlay_file } }
+  ) targets in
+  delete_targets_on_exit targets;
+
+  let pid = fork () in
+  if pid = 0 then (
+    (* Child.  Don't run the at_exit handlers of the parent, which
+     * would delete the overlays.
+     *)
+    at_exit (
+      fun () ->
+        Pervasives.flush Pervasives.stdout;
+        Pervasives.flush Pervasives.stderr;
+        Exit._exit 1
+    );
+    (* The qemu-img progress bar would be mixed up with the
+     * conversion messages.
+     *)
+    ignore (copy_targets ~progress_bar:false cmdline early_targets
+                         input output);
+    Pervasives.flush Pervasives.stdout;
+    Pervasives.flush Pervasives.stderr;
+    Exit._exit 0
   );
+
+  (* Parent. *)
+  early_copy_pid := Some pid;
+  at_exit (fun () ->
+    match !early_copy_pid with
+    | None -> ()
+    | Some pid -> (try kill pid Sys.sigterm with _ -> ())
+  );
+  pid
+
+and early_copy_pid = ref None
+
+(* Wait for the copy started by [start_early_copy], then copy the
+ * clusters which were written or discarded in the overlays during
+ * the conversion.  This is done by pointing each overlay at its
+ * target and committing it, so only the clusters allocated in the
+ * overlay are written.
+ *)
+and finish_early_copy pid targets =
+  message (f_"Waiting for the source disks to be copied");
+  let _, stat = waitpid [] pid in
+  early_copy_pid := None;
+  (match stat with
+   | WEXITED 0 -> ()
+   | WEXITED _ | WSIGNALED _ | WSTOPPED _ ->
+      error (f_"copying the source disks failed, see earlier errors")
+  );
+
+  let rebase overlay_file backing format =
+    let cmd = [ "qemu-img"; "rebase"; "-u"; "-b"; backing ] @
+      (match format with None -> [] | Some fmt -> [ "-F"; fmt ]) @
+      [ overlay_file ] in
+    if run_command cmd <> 0 then
+      error (f_"qemu-img command failed, see earlier errors")
+  in
+
   let nr_disks = List.length targets in
   mapi (
     fun i t ->
-      message (f_"Copying disk %d/%d to %s (%s)")
-        (i+1) nr_disks t.target_file t.target_format;
-      debug "%s" (string_of_target t);
-
-      (* We noticed that qemu sometimes corrupts the qcow2 file on
-       * exit.  This only seemed to happen with lazy_refcounts was
-       * used.  The symptom was that the header wasn't written back
-       * to the disk correctly and the file appeared to have no
-       * backing file.  Just sanity check this here.
-       *)
-      let overlay_file = t.target_overlay.ov_overlay_file in
-      if not ((open_guestfs ())#disk_has_backing_file overlay_file) then
-        error (f_"internal error: qemu corrupted the overlay file");
-
-      (* Give the input module a chance to adjust the parameters
-       * of the overlay/backing file.  This allows us to increase
-       * the readahead parameter when copying (see RHBZ#1151033 and
-       * RHBZ#1153589 for the gruesome details).
-       *)
-      input#adjust_overlay_parameters t.target_overlay;
-
-      (* It turns out that libguestfs's disk creation code is
-       * considerably more flexible and easier to use than
-       * qemu-img, so create the disk explicitly using libguestfs
-       * then pass the 'qemu-img convert -n' option so qemu reuses
-       * the disk.
-       *
-       * Also we allow the output mode to actually create the disk
-       * image.  This lets the output mode set ownership and
-       * permissions correctly if required.
-       *)
-      (* What output preallocation mode should we use? *)
-      let preallocation =
-        match t.target_format, cmdline.output_alloc with
-        | ("raw"|"qcow2"), Sparse -> Some "sparse"
-        | ("raw"|"qcow2"), Preallocated -> Some "full"
-        | _ -> None (* ignore -oa flag for other formats *) in
-      let compat =
-        match t.target_format with "qcow2" -> Some "1.1" | _ -> None in
-      output#disk_create
-        t.target_file t.target_format t.target_overlay.ov_virtual_size
-        ?preallocation ?compat;
-
-      let cmd = [ "qemu-img"; "convert" ] @
-        (if not (quiet ()) then [ "-p" ] else []) @
-        [ "-n"; "-f"; "qcow2"; "-O"; t.target_format ] @
-        (if cmdline.compressed then [ "-c" ] else []) @
-        [ overlay_file; t.target_file ] in
-      let start_time = gettimeofday () in
+      message (f_"Copying the changes made by the conversion to disk %d/%d")
+        (i+1) nr_disks;
+      let ov = t.target_overlay in
+      rebase ov.ov_overlay_file (absolute_path t.target_file)
+             (Some t.target_format);
+      let cmd = [ "qemu-img"; "commit"; "-q"; "-d"; ov.ov_overlay_file ] in
       if run_command cmd <> 0 then
         error (f_"qemu-img command failed, see earlier errors");
-      let end_time = gettimeofday () in
+      (* Point the overlay at the source again for --debug-overlays. *)
+      rebase ov.ov_overlay_file ov.ov_source.s_qemu_uri ov.ov_source.s_format;
 
-      (* Calculate the actual size on the target, returns an updated
-       * target structure.
-       *)
-      let t = actual_target_size t in
-
-      (* If verbose, print the virtual and real copying rates. *)
-      let elapsed_time = end_time -. start_time in
-      if verbose () && elapsed_time > 0. then (
-        let mbps size time =
-          Int64.to_float size /. 1024. /. 1024. *. 10. /. time
-        in
-
-        eprintf "virtual copying rate: %.1f M bits/sec\n%!"
-          (mbps t.target_overlay.ov_virtual_size elapsed_time);
-
-        match t.target_actual_size with
-        | None -> ()
-        | Some actual ->
-           eprintf "real copying rate: %.1f M bits/sec\n%!"
-                   (mbps actual elapsed_time)
-      );
-
-      (* If verbose, find out how close the estimate was.  This is
-       * for developer information only - so we can increase the
-       * accuracy of the estimate.
-       *)
-      if verbose () then (
-        match t.target_estimated_size, t.target_actual_size with
-        | None, None | None, Some _ | Some _, None | Some _, Some 0L -> ()
-        | Some estimate, Some actual ->
-          let pc =
-            100. *. Int64.to_float estimate /. Int64.to_float actual
-            -. 100. in
-          eprintf "%s: estimate %Ld (%s) versus actual %Ld (%s): %.1f%%"
-            t.target_overlay.ov_sd
-            estimate (human_size estimate)
-            actual (human_size actual)
-            pc;
-          if pc < 0. then eprintf " ! ESTIMATE TOO LOW !";
-          eprintf "\n%!";
-      );
-
-      t
+      actual_target_size t
   ) targets
 
 (* Update the target_actual_size field in the target structure. *)
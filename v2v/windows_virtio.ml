@@ -230,54 +230,122 @@ and ddb_regedits current_cs drv_name drv_pciid =
   ]
 
 (* Copy the matching drivers to the driverdir; return true if any have
- * been copied.
+ * been copied.  The drivers are collected in a tar file on the host
+ * and unpacked in the guest with a single tar_in.
  *)
 and copy_drivers g inspect driverdir =
-  let ret = ref false in
-  if is_directory virtio_win then (
-    let cmd = sprintf "cd %s && find -L -type f" (quote virtio_win) in
-    let paths = external_command cmd in
-    List.iter (
-      fun path ->
-        if virtio_iso_path_matches_guest_os path inspect then (
-          let source = virtio_win // path in
-          let target = driverdir //
-                         String.lowercase_ascii (Filename.basename path) in
+  let tarfile =
+    if is_directory virtio_win then (
+      let cmd = sprintf "cd %s && find -L -type f" (quote virtio_win) in
+      let paths = external_command cmd in
+      let paths =
+        List.filter (
+          fun path -> virtio_iso_path_matches_guest_os path inspect
+        ) paths in
+      if paths = [] then None
+      else (
+        let tmpdir = Mkdtemp.temp_dir "v2vdrv." "" in
+        rmdir_on_exit tmpdir;
+        let add path dest =
           debug "copying virtio driver bits: 'host:%s' -> '%s'"
-                source target;
-
-          g#write target (read_whole_file source);
-          ret := true
-        )
-      ) paths
-  )
-  else if is_regular_file virtio_win then (
-    try
-      let g2 = open_guestfs ~identifier:"virtio_win" () in
-      g2#add_drive_opts virtio_win ~readonly:true;
-      g2#launch ();
-      let vio_root = "/" in
-      g2#mount_ro "/dev/sda" vio_root;
-      let paths = g2#find vio_root in
-      Array.iter (
-        fun path ->
-          let source = vio_root // path in
-          if g2#is_file source ~followsymlinks:false &&
-               virtio_iso_path_matches_guest_os path inspect then (
-            let target = driverdir //
-                           String.lowercase_ascii (Filename.basename path) in
-            debug "copying virtio driver bits: '%s:%s' -> '%s'"
-                  virtio_win path target;
-
-            g#write target (g2#read_file source);
-            ret := true
-          )
-        ) paths;
-      g2#close()
-    with Guestfs.Error msg ->
-      error (f_"%s: cannot open virtio-win ISO file: %s") virtio_win msg
-  );
-  !ret
+                (virtio_win // path) (driverdir // Filename.basename dest);
+          Unix.symlink (absolute_path (virtio_win // path)) dest in
+        Some (make_drivers_tar tmpdir add paths)
+      )
+    )
+    else if is_regular_file virtio_win then (
+      (* Reading the ISO needs another appliance, so keep the tar file
+       * for the next conversion of the same version of Windows.
+       *)
+      let cachedir = (open_guestfs ())#get_cachedir () in
+      let cached = cachedir // virtio_win_cache_name inspect in
+      if Sys.file_exists cached then (
+        debug "using cached virtio drivers: %s" cached;
+        Some cached
+      )
+      else (
+        try
+          let g2 = open_guestfs ~identifier:"virtio_win" () in
+          g2#add_drive_opts virtio_win ~readonly:true;
+          g2#launch ();
+          let vio_root = "/" in
+          g2#mount_ro "/dev/sda" vio_root;
+          let paths = Array.to_list (g2#find vio_root) in
+          let paths =
+            List.filter (
+              fun path ->
+                virtio_iso_path_matches_guest_os path inspect &&
+                  g2#is_file (vio_root // path) ~followsymlinks:false
+            ) paths in
+          let tarfile =
+            if paths = [] then None
+            else (
+              let tmpdir = Mkdtemp.temp_dir ~base_dir:cachedir "v2vdrv." "" in
+              rmdir_on_exit tmpdir;
+              let add path dest =
+                debug "copying virtio driver bits: '%s:%s' -> '%s'"
+                      virtio_win path (driverdir // Filename.basename dest);
+                g2#download (vio_root // path) dest in
+              let tarfile = make_drivers_tar tmpdir add paths in
+              (* Rename atomically, in case another virt-v2v is
+               * doing the same.
+               *)
+              Unix.rename tarfile cached;
+              Some cached
+            ) in
+          g2#close ();
+          tarfile
+        with Guestfs.Error msg ->
+          error (f_"%s: cannot open virtio-win ISO file: %s") virtio_win msg
+      )
+    )
+    else None in
+
+  match tarfile with
+  | None -> false
+  | Some tarfile ->
+    g#tar_in tarfile driverdir;
+    true
+
+(* Create a tar file in [tmpdir] containing the files [paths] under
+ * their lowercased base names, which is how they are installed in
+ * the guest.  [add path dest] must create [dest] from [path].
+ *)
+and make_drivers_tar tmpdir add paths =
+  let filesdir = tmpdir // "files" in
+  Unix.mkdir filesdir 0o755;
+  let names =
+    List.map (
+      fun path ->
+        let name = String.lowercase_ascii (Filename.basename path) in
+        let dest = filesdir // name in
+        (* As before, the last file with the same name wins. *)
+        (try Unix.unlink dest with Unix.Unix_error _ -> ());
+        add path dest;
+        name
+    ) paths in
+  let names = sort_uniq names in
+  let tarfile = tmpdir // "drivers.tar" in
+  let cmd = [ "tar"; "-C"; filesdir; "-chf"; tarfile; "--" ] @ names in
+  if run_command cmd <> 0 then
+    error (f_"could not create a tar file of the virtio drivers, see earlier errors");
+  tarfile
+
+(* The name of the cached tar file of drivers for this guest taken
+ * from the virtio-win ISO.  The ISO is identified by its path, size
+ * and modification time, so a new version of virtio-win gets a new
+ * cache entry.
+ *)
+and virtio_win_cache_name inspect =
+  let statbuf = Unix.LargeFile.stat virtio_win in
+  let key =
+    sprintf "%s %Ld %.0f"
+            (absolute_path virtio_win)
+            statbuf.Unix.LargeFile.st_size statbuf.Unix.LargeFile.st_mtime in
+  sprintf "v2v-virtio-win-%s-%d.%d-%s-%s.tar"
+          (Digest.to_hex (Digest.string key))
+          inspect.i_major_version inspect.i_minor_version
+          inspect.i_arch inspect.i_product_variant
 
 (* Given a path of a file relative to the root of the directory tree
  * with virtio-win drivers, figure out if it's suitable for the